@@ -68,6 +68,15 @@
 
 #include "bzlib_private.h"
 
+#if !defined(BZ_SCALAR_GTU) && !defined(MEM_TRACE) && defined(__SSE2__)
+#  define BZ_SIMD_GTU_SSE2
+#  include <emmintrin.h>
+#elif !defined(BZ_SCALAR_GTU) && !defined(MEM_TRACE) \
+      && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+#  define BZ_SIMD_GTU_NEON
+#  include <arm_neon.h>
+#endif
+
 /*---------------------------------------------*/
 /*--- Fallback O(N log(N)^2) sorting        ---*/
 /*--- algorithm, for repetitive blocks      ---*/
@@ -389,6 +398,9 @@ void fallbackSort ( UInt32* fmap,
 /*---------------------------------------------*/
 
 /*---------------------------------------------*/
+/*-- Scalar comparison; SIMD builds use mainGtUVec
+     below instead, so it is only compiled without. --*/
+#if !defined(BZ_SIMD_GTU_SSE2) && !defined(BZ_SIMD_GTU_NEON)
 static
 __inline__
 Bool mainGtU ( UInt32  i1, 
@@ -403,6 +415,9 @@ Bool mainGtU ( UInt32  i1,
    UInt16 s1, s2;
 
    AssertD ( i1 != i2, "mainGtU" );
+   /* one record for each run of 12 or 8 bytes */
+   MEMTRACE_LOAD ( &block[i1] );
+   MEMTRACE_LOAD ( &block[i2] );
    /* 1 */
    c1 = block[i1]; c2 = block[i2];
    if (c1 != c2) return (c1 > c2);
@@ -455,6 +470,10 @@ Bool mainGtU ( UInt32  i1,
    k = nblock + 8;
 
    do {
+      MEMTRACE_LOAD ( &block[i1] );
+      MEMTRACE_LOAD ( &block[i2] );
+      MEMTRACE_LOAD ( &quadrant[i1] );
+      MEMTRACE_LOAD ( &quadrant[i2] );
       /* 1 */
       c1 = block[i1]; c2 = block[i2];
       if (c1 != c2) return (c1 > c2);
@@ -514,6 +533,158 @@ Bool mainGtU ( UInt32  i1,
 
    return False;
 }
+#endif
+
+/*---------------------------------------------*/
+/*--
+   Vector form of mainGtU.  It gives the same
+   answer and charges the same budget, but
+   compares a whole step group at once: the
+   lane compares become a mask (bit set = lanes
+   differ) and the first set bit is the first
+   difference, which is then ordered as in the
+   scalar code -- block byte first, quadrant
+   second.  Callers pass i1, i2 up to
+   nblock+14 (position + depth d, and d is at
+   most MAIN_QSORT_DEPTH_THRESH+1), so the
+   16-byte load reaches nblock+29 and the
+   first 8-lane block and quadrant loads,
+   at i+12 before any wrap, nblock+33: the
+   last of the BZ_N_OVERSHOOT (34) entries
+   mainSort copies, and no further than the
+   scalar code reads.  Build with
+   -DBZ_SCALAR_GTU to use the scalar
+   reference instead.
+--*/
+#if defined(BZ_SIMD_GTU_SSE2)
+
+static
+__inline__
+UInt32 gtuNeqBytes16 ( const UChar* a, const UChar* b )
+{
+   __m128i x = _mm_loadu_si128 ( (const __m128i*)a );
+   __m128i y = _mm_loadu_si128 ( (const __m128i*)b );
+   return (UInt32)_mm_movemask_epi8 ( _mm_cmpeq_epi8 ( x, y ) ) ^ 0xFFFF;
+}
+
+static
+__inline__
+UInt32 gtuNeqBytes8 ( const UChar* a, const UChar* b )
+{
+   __m128i x = _mm_loadl_epi64 ( (const __m128i*)a );
+   __m128i y = _mm_loadl_epi64 ( (const __m128i*)b );
+   return ((UInt32)_mm_movemask_epi8 ( _mm_cmpeq_epi8 ( x, y ) ) ^ 0xFF)
+          & 0xFF;
+}
+
+static
+__inline__
+UInt32 gtuNeqQuads8 ( const UInt16* a, const UInt16* b )
+{
+   __m128i x = _mm_loadu_si128 ( (const __m128i*)a );
+   __m128i y = _mm_loadu_si128 ( (const __m128i*)b );
+   __m128i e = _mm_cmpeq_epi16 ( x, y );
+   return ((UInt32)_mm_movemask_epi8 ( _mm_packs_epi16 ( e, e ) ) ^ 0xFF)
+          & 0xFF;
+}
+
+#elif defined(BZ_SIMD_GTU_NEON)
+
+/*-- NEON has no movemask: weight each lane by
+     its bit and add pairwise down to two bytes --*/
+static
+const UChar gtuBit[16] = { 1, 2, 4, 8, 16, 32, 64, 128,
+                           1, 2, 4, 8, 16, 32, 64, 128 };
+
+static
+__inline__
+UInt32 gtuMask16 ( uint8x16_t eq )
+{
+   uint8x16_t m = vbicq_u8 ( vld1q_u8 ( gtuBit ), eq );
+   uint8x8_t  p = vpadd_u8 ( vget_low_u8 ( m ), vget_high_u8 ( m ) );
+   p = vpadd_u8 ( p, p );
+   p = vpadd_u8 ( p, p );
+   return (UInt32)vget_lane_u8 ( p, 0 ) |
+          ((UInt32)vget_lane_u8 ( p, 1 ) << 8);
+}
+
+static
+__inline__
+UInt32 gtuNeqBytes16 ( const UChar* a, const UChar* b )
+{
+   return gtuMask16 ( vceqq_u8 ( vld1q_u8 ( a ), vld1q_u8 ( b ) ) );
+}
+
+static
+__inline__
+UInt32 gtuNeqBytes8 ( const UChar* a, const UChar* b )
+{
+   uint8x8_t eq = vceq_u8 ( vld1_u8 ( a ), vld1_u8 ( b ) );
+   return gtuMask16 ( vcombine_u8 ( eq, vdup_n_u8 ( 0xFF ) ) );
+}
+
+static
+__inline__
+UInt32 gtuNeqQuads8 ( const UInt16* a, const UInt16* b )
+{
+   uint8x8_t eq = vmovn_u16 ( vceqq_u16 ( vld1q_u16 ( a ), vld1q_u16 ( b ) ) );
+   return gtuMask16 ( vcombine_u8 ( eq, vdup_n_u8 ( 0xFF ) ) );
+}
+
+#endif
+
+#if defined(BZ_SIMD_GTU_SSE2) || defined(BZ_SIMD_GTU_NEON)
+
+static
+__inline__
+Bool mainGtUVec ( UInt32  i1, 
+                  UInt32  i2,
+                  UChar*  block, 
+                  UInt16* quadrant,
+                  UInt32  nblock,
+                  Int32*  budget )
+{
+   Int32  k;
+   UInt32 bm, qm, j;
+
+   AssertD ( i1 != i2, "mainGtUVec" );
+   /* 1 .. 12 */
+   bm = gtuNeqBytes16 ( &block[i1], &block[i2] ) & 0xFFF;
+   if (bm != 0) {
+      j = __builtin_ctz ( bm );
+      return (block[i1+j] > block[i2+j]);
+   }
+   i1 += 12; i2 += 12;
+
+   k = nblock + 8;
+
+   do {
+      /* 1 .. 8 */
+      bm = gtuNeqBytes8 ( &block[i1], &block[i2] );
+      qm = gtuNeqQuads8 ( &quadrant[i1], &quadrant[i2] );
+      if ((bm | qm) != 0) {
+         j = __builtin_ctz ( bm | qm );
+         if (bm & (1 << j)) return (block[i1+j] > block[i2+j]);
+         return (quadrant[i1+j] > quadrant[i2+j]);
+      }
+      i1 += 8; i2 += 8;
+
+      if (i1 >= nblock) i1 -= nblock;
+      if (i2 >= nblock) i2 -= nblock;
+
+      k -= 8;
+      (*budget)--;
+   }
+      while (k >= 0);
+
+   return False;
+}
+
+#define MAIN_GTU mainGtUVec
+#else
+#define MAIN_GTU mainGtU
+#endif
+
 
 
 /*---------------------------------------------*/
@@ -558,7 +729,7 @@ void mainSimpleSort ( UInt32* ptr,
          if (i > hi) break;
          v = ptr[i];
          j = i;
-         while ( mainGtU ( 
+         while ( MAIN_GTU ( 
                     ptr[j-h]+d, v+d, block, quadrant, nblock, budget 
                  ) ) {
             ptr[j] = ptr[j-h];
@@ -572,7 +743,7 @@ void mainSimpleSort ( UInt32* ptr,
          if (i > hi) break;
          v = ptr[i];
          j = i;
-         while ( mainGtU ( 
+         while ( MAIN_GTU ( 
                     ptr[j-h]+d, v+d, block, quadrant, nblock, budget 
                  ) ) {
             ptr[j] = ptr[j-h];
@@ -586,7 +757,7 @@ void mainSimpleSort ( UInt32* ptr,
          if (i > hi) break;
          v = ptr[i];
          j = i;
-         while ( mainGtU ( 
+         while ( MAIN_GTU ( 
                     ptr[j-h]+d, v+d, block, quadrant, nblock, budget 
                  ) ) {
             ptr[j] = ptr[j-h];
@@ -775,6 +946,297 @@ void mainQSort3 ( UInt32* ptr,
 #undef MAIN_QSORT_STACK_SIZE
 
 
+/*---------------------------------------------*/
+/*--- Intra-block parallel main sort        ---*/
+/*---------------------------------------------*/
+
+/*--
+   With -DBZ_PARALLEL and BZ2_bzSetSortThreads, mainSort
+   spreads the work of one block over a pool (the calling
+   thread plus nThreads-1 workers) wherever the serial
+   order does not matter:
+
+      the radix counts, one histogram per chunk of the
+      block; each chunk then scatters its pointers from
+      offsets that put them exactly where the serial
+      descending scan does;
+      Step 1's quicksorts of the small buckets [ss, j],
+      which touch disjoint parts of ptr and only read the
+      quadrants, settled by the big buckets before ss;
+      Step 3's quadrant update, disjoint per pointer.
+
+   Step 2's copy scan is left serial: it is the dependency
+   between the big buckets.  Each Step 1 task gets the work
+   budget left at the start of the bucket and the work done
+   is summed after, so the choice of the fallback sort, and
+   the output, are those of the serial sort.
+--*/
+
+typedef struct MainPool MainPool;
+
+#ifdef BZ_PARALLEL
+
+#include <pthread.h>
+#include <unistd.h>
+
+/* Below this many pointers a step runs on the calling thread */
+#define MAIN_PAR_MIN 4096
+#define MAIN_PAR_MAX_THREADS 64
+
+typedef void (*MainPoolFn) ( MainPool*, Int32 );
+
+struct MainPool {
+   bz_stream*      strm;
+   pthread_t       threads[MAIN_PAR_MAX_THREADS];
+   Int32           nWorkers;
+   Int32           nChunks;     /* workers + the caller */
+
+   pthread_mutex_t mutex;
+   pthread_cond_t  cvWork;
+   pthread_cond_t  cvDone;
+   UInt32          generation;
+   Bool            quit;
+   MainPoolFn      fn;
+   Int32           nItems;
+   Int32           next;        /* next item to hand out */
+   Int32           busy;        /* workers in this generation */
+
+   UInt32*         ptr;
+   UChar*          block;
+   UInt16*         quadrant;
+   Int32           nblock;
+
+   /* radix: nChunks histograms, then scatter offsets */
+   UInt32*         hist;
+
+   /* Step 1: the small buckets of one big bucket */
+   Int32           taskLo[256];
+   Int32           taskHi[256];
+   Int32           budgetLeft;
+   Int32           budgetUsed;
+   Bool            abandon;
+
+   /* Step 3: one big bucket */
+   Int32           bbStart;
+   Int32           bbSize;
+   Int32           shifts;
+};
+
+static
+void mainPoolDrain ( MainPool* p )
+{
+   Int32 i;
+   while (p->next < p->nItems) {
+      i = p->next++;
+      pthread_mutex_unlock ( &p->mutex );
+      p->fn ( p, i );
+      pthread_mutex_lock ( &p->mutex );
+   }
+}
+
+static
+void* mainPoolWorker ( void* arg )
+{
+   MainPool* p    = (MainPool*)arg;
+   UInt32    seen = 0;
+
+   pthread_mutex_lock ( &p->mutex );
+   while (True) {
+      while (!p->quit && p->generation == seen)
+         pthread_cond_wait ( &p->cvWork, &p->mutex );
+      if (p->quit) break;
+      seen = p->generation;
+      p->busy++;
+      mainPoolDrain ( p );
+      if (--p->busy == 0) pthread_cond_signal ( &p->cvDone );
+   }
+   pthread_mutex_unlock ( &p->mutex );
+   return NULL;
+}
+
+/*-- fn on items 0 .. nItems-1, returning when all are done;
+     work (pointers) below MAIN_PAR_MIN stays on this thread --*/
+static
+void mainPoolRun ( MainPool* p, MainPoolFn fn, Int32 nItems, Int32 work )
+{
+   Int32 i;
+   if (nItems < 2 || work < MAIN_PAR_MIN) {
+      for (i = 0; i < nItems; i++) fn ( p, i );
+      return;
+   }
+   pthread_mutex_lock ( &p->mutex );
+   p->fn     = fn;
+   p->nItems = nItems;
+   p->next   = 0;
+   p->generation++;
+   pthread_cond_broadcast ( &p->cvWork );
+   mainPoolDrain ( p );
+   while (p->busy > 0) pthread_cond_wait ( &p->cvDone, &p->mutex );
+   pthread_mutex_unlock ( &p->mutex );
+}
+
+static
+void mainPoolDestroy ( MainPool* p )
+{
+   bz_stream* strm = p->strm;
+   Int32      i;
+
+   pthread_mutex_lock ( &p->mutex );
+   p->quit = True;
+   pthread_cond_broadcast ( &p->cvWork );
+   pthread_mutex_unlock ( &p->mutex );
+   for (i = 0; i < p->nWorkers; i++) pthread_join ( p->threads[i], NULL );
+   pthread_mutex_destroy ( &p->mutex );
+   pthread_cond_destroy ( &p->cvWork );
+   pthread_cond_destroy ( &p->cvDone );
+   if (p->hist != NULL) BZFREE ( p->hist );
+   BZFREE ( p );
+}
+
+/*-- NULL (sort serially) for one thread, or if the pool
+     cannot be set up --*/
+static
+MainPool* mainPoolCreate ( EState* s )
+{
+   bz_stream* strm     = s->strm;
+   Int32      nThreads = s->sortThreads;
+   MainPool*  p;
+
+   if (nThreads <= 0) nThreads = (Int32)sysconf ( _SC_NPROCESSORS_ONLN );
+   if (nThreads > MAIN_PAR_MAX_THREADS) nThreads = MAIN_PAR_MAX_THREADS;
+   if (nThreads <= 1) return NULL;
+
+   p = BZALLOC ( sizeof(MainPool) );
+   if (p == NULL) return NULL;
+   p->strm       = strm;
+   p->nWorkers   = 0;
+   p->generation = 0;
+   p->quit       = False;
+   p->busy       = 0;
+   p->hist       = BZALLOC ( nThreads * 65536 * sizeof(UInt32) );
+   pthread_mutex_init ( &p->mutex, NULL );
+   pthread_cond_init ( &p->cvWork, NULL );
+   pthread_cond_init ( &p->cvDone, NULL );
+   if (p->hist == NULL) { mainPoolDestroy ( p ); return NULL; }
+
+   while (p->nWorkers < nThreads - 1 &&
+          pthread_create ( &p->threads[p->nWorkers], NULL,
+                           mainPoolWorker, p ) == 0)
+      p->nWorkers++;
+   if (p->nWorkers == 0) { mainPoolDestroy ( p ); return NULL; }
+   p->nChunks = p->nWorkers + 1;
+   return p;
+}
+
+#define CHUNK_LO(p,c) ((p)->nblock * (c) / (p)->nChunks)
+#define PAIR(p,i) \
+   ((((UInt16)(p)->block[i]) << 8) | \
+    (p)->block[(i) + 1 == (p)->nblock ? 0 : (i) + 1])
+
+static
+void mainParCount ( MainPool* p, Int32 c )
+{
+   UInt32* h  = p->hist + c * 65536;
+   Int32   lo = CHUNK_LO(p, c), hi = CHUNK_LO(p, c+1);
+   Int32   i;
+
+   for (i = 0; i < 65536; i++) h[i] = 0;
+   for (i = lo; i < hi; i++) {
+      p->quadrant[i] = 0;
+      h[PAIR(p, i)]++;
+   }
+}
+
+static
+void mainParScatter ( MainPool* p, Int32 c )
+{
+   UInt32* h  = p->hist + c * 65536;
+   Int32   lo = CHUNK_LO(p, c), hi = CHUNK_LO(p, c+1);
+   Int32   i;
+
+   for (i = hi - 1; i >= lo; i--)
+      p->ptr[ --h[PAIR(p, i)] ] = i;
+}
+
+#undef PAIR
+
+/*-- The radix sort of mainSort's set-up, overshoot included:
+     ftab [0 .. 65536] the first loc of every small bucket, ptr
+     in bucket order, quadrant zero --*/
+static
+void mainParRadix ( MainPool* p, UInt32* ftab )
+{
+   Int32  s, c, i;
+   UInt32 total, end, n;
+
+   for (i = 0; i < BZ_N_OVERSHOOT; i++) {
+      p->block   [p->nblock+i] = p->block[i];
+      p->quadrant[p->nblock+i] = 0;
+   }
+
+   mainPoolRun ( p, mainParCount, p->nChunks, p->nblock );
+
+   /*-- Chunk c's pointers of bucket s end where those of
+        the chunks after it (higher positions, scanned first
+        by the serial sort) begin --*/
+   total = 0;
+   for (s = 0; s < 65536; s++) {
+      for (c = 0; c < p->nChunks; c++) total += p->hist[c * 65536 + s];
+      end = total;
+      for (c = p->nChunks - 1; c >= 0; c--) {
+         n = p->hist[c * 65536 + s];
+         p->hist[c * 65536 + s] = end;
+         end -= n;
+      }
+      ftab[s] = end;
+   }
+   ftab[65536] = total;
+
+   mainPoolRun ( p, mainParScatter, p->nChunks, p->nblock );
+}
+
+static
+void mainParQSort ( MainPool* p, Int32 t )
+{
+   Int32 budget, used;
+   Bool  abandon;
+
+   pthread_mutex_lock ( &p->mutex );
+   abandon = p->abandon;
+   pthread_mutex_unlock ( &p->mutex );
+   if (abandon) return;
+   budget = p->budgetLeft;
+   mainQSort3 ( p->ptr, p->block, p->quadrant, p->nblock,
+                p->taskLo[t], p->taskHi[t], BZ_N_RADIX, &budget );
+   used = p->budgetLeft - budget;
+
+   pthread_mutex_lock ( &p->mutex );
+   p->budgetUsed += used;
+   if (budget < 0 || p->budgetUsed > p->budgetLeft) p->abandon = True;
+   pthread_mutex_unlock ( &p->mutex );
+}
+
+static
+void mainParQuadrant ( MainPool* p, Int32 c )
+{
+   Int32 lo = p->bbSize * c / p->nChunks;
+   Int32 hi = p->bbSize * (c+1) / p->nChunks;
+   Int32 j;
+
+   for (j = hi - 1; j >= lo; j--) {
+      Int32 a2update        = p->ptr[p->bbStart + j];
+      UInt16 qVal           = (UInt16)(j >> p->shifts);
+      p->quadrant[a2update] = qVal;
+      if (a2update < BZ_N_OVERSHOOT)
+         p->quadrant[a2update + p->nblock] = qVal;
+   }
+}
+
+#undef CHUNK_LO
+
+#endif /* BZ_PARALLEL */
+
+
 /*---------------------------------------------*/
 /* Pre:
       nblock > N_OVERSHOOT
@@ -801,7 +1263,8 @@ void mainSort ( UInt32* ptr,
                 UInt32* ftab,
                 Int32   nblock,
                 Int32   verb,
-                Int32*  budget )
+                Int32*  budget,
+                MainPool* pool )
 {
    Int32  i, j, k, ss, sb;
    Int32  runningOrder[256];
@@ -813,6 +1276,18 @@ void mainSort ( UInt32* ptr,
    UInt16 s;
    if (verb >= 4) VPrintf0 ( "        main sort initialise ...\n" );
 
+#ifdef BZ_PARALLEL
+   if (pool != NULL) {
+      pool->ptr      = ptr;
+      pool->block    = block;
+      pool->quadrant = quadrant;
+      pool->nblock   = nblock;
+      if (verb >= 4) VPrintf0 ( "        bucket sorting ...\n" );
+      mainParRadix ( pool, ftab );
+      goto radixDone;
+   }
+#endif
+
    /*-- set up the 2-byte frequency table --*/
    for (i = 65536; i >= 0; i--) ftab[i] = 0;
 
@@ -876,6 +1351,9 @@ void mainSort ( UInt32* ptr,
       ptr[j] = i;
    }
 
+#ifdef BZ_PARALLEL
+   radixDone:
+#endif
    /*--
       Now ftab contains the first loc of every small bucket.
       Calculate the running order, from smallest to largest
@@ -930,6 +1408,45 @@ void mainSort ( UInt32* ptr,
          completed many of the small buckets [ss, j], so
          we don't have to sort them at all.
       --*/
+#ifdef BZ_PARALLEL
+      if (pool != NULL) {
+         Int32 nTasks = 0, work = 0;
+         for (j = 0; j <= 255; j++) {
+            if (j != ss) {
+               sb = (ss << 8) + j;
+               if ( ! (ftab[sb] & SETMASK) ) {
+                  Int32 lo = ftab[sb]   & CLEARMASK;
+                  Int32 hi = (ftab[sb+1] & CLEARMASK) - 1;
+                  if (hi > lo) {
+                     if (verb >= 4)
+                        VPrintf4 ( "        qsort [0x%x, 0x%x]   "
+                                   "done %d   this %d\n",
+                                   (unsigned)ss, (unsigned)j, numQSorted + work,
+                                   hi - lo + 1 );
+                     /*-- largest first, for the balance --*/
+                     for (k = nTasks; k > 0 &&
+                          pool->taskHi[k-1] - pool->taskLo[k-1] < hi - lo; k--) {
+                        pool->taskLo[k] = pool->taskLo[k-1];
+                        pool->taskHi[k] = pool->taskHi[k-1];
+                     }
+                     pool->taskLo[k] = lo;
+                     pool->taskHi[k] = hi;
+                     nTasks++;
+                     work += hi - lo + 1;
+                  }
+               }
+               ftab[sb] |= SETMASK;
+            }
+         }
+         pool->budgetLeft = *budget;
+         pool->budgetUsed = 0;
+         pool->abandon    = False;
+         mainPoolRun ( pool, mainParQSort, nTasks, work );
+         numQSorted += work;
+         *budget -= pool->budgetUsed;
+         if (*budget < 0) return;
+      } else
+#endif
       for (j = 0; j <= 255; j++) {
          if (j != ss) {
             sb = (ss << 8) + j;
@@ -1040,6 +1557,14 @@ void mainSort ( UInt32* ptr,
 
          while ((bbSize >> shifts) > 65534) shifts++;
 
+#ifdef BZ_PARALLEL
+         if (pool != NULL) {
+            pool->bbStart = bbStart;
+            pool->bbSize  = bbSize;
+            pool->shifts  = shifts;
+            mainPoolRun ( pool, mainParQuadrant, pool->nChunks, bbSize );
+         } else
+#endif
          for (j = bbSize-1; j >= 0; j--) {
             Int32 a2update     = ptr[bbStart + j];
             UInt16 qVal        = (UInt16)(j >> shifts);
@@ -1062,6 +1587,260 @@ void mainSort ( UInt32* ptr,
 #undef CLEARMASK
 
 
+/*---------------------------------------------*/
+/*--- Induced sorting (SA-IS)               ---*/
+/*---------------------------------------------*/
+
+/*--
+   A linear-time alternative to mainSort/fallbackSort,
+   after Nong, Zhang and Chan's SA-IS.  Its running time
+   does not depend on how repetitive the block is, so it
+   never needs the workFactor budget.
+
+   SA-IS sorts suffixes, whereas the BWT wants cyclic
+   rotations.  The two orders agree when the block starts
+   at its lexicographically least rotation (it is then a
+   Lyndon word, or a power of one), so saisSort rotates the
+   block there, sorts the suffixes of the copy, and rotates
+   the answer back.  Rotations which are equal as strings
+   (only in periodic blocks) may come out in a different
+   order from mainSort's; that moves origPtr but not the
+   BWT, and both decode to the same block.
+
+   The end of each text is a virtual sentinel, smaller
+   than every symbol.  Types are kept one bit per symbol
+   in tb, set for S-type.
+--*/
+
+#define SAIS_EMPTY (-1)
+
+#define saisChr(i)                                  \
+   (cs == 1 ? (Int32)(((const UChar*)T)[i])         \
+            : ((const Int32*)T)[i])
+
+#define saisIsS(i)   ((tb[(i) >> 3] >> ((i) & 7)) & 1)
+#define saisSetS(i)  tb[(i) >> 3] |= (UChar)(1 << ((i) & 7))
+#define saisIsLMS(i) ((i) > 0 && saisIsS(i) && !saisIsS((i)-1))
+
+
+static
+void saisBuckets ( const Int32* C, Int32* B, Int32 k, Bool end )
+{
+   Int32 i, sum = 0;
+   for (i = 0; i < k; i++) {
+      sum += C[i];
+      B[i] = end ? sum : sum - C[i];
+   }
+}
+
+
+/*---------------------------------------------*/
+static
+void saisInduce ( const void* T, Int32* SA, const UChar* tb,
+                  const Int32* C, Int32* B,
+                  Int32 n, Int32 k, Int32 cs )
+{
+   Int32 i, j;
+
+   /*-- L-type, left to right.  The sentinel sorts
+        first and induces n-1, which is always L-type. --*/
+   saisBuckets ( C, B, k, False );
+   j = n - 1;
+   SA[B[saisChr(j)]++] = j;
+   for (i = 0; i < n; i++) {
+      j = SA[i] - 1;
+      if (j >= 0 && !saisIsS(j)) SA[B[saisChr(j)]++] = j;
+   }
+
+   /*-- S-type, right to left --*/
+   saisBuckets ( C, B, k, True );
+   for (i = n - 1; i >= 0; i--) {
+      j = SA[i] - 1;
+      if (j >= 0 && saisIsS(j)) SA[--B[saisChr(j)]] = j;
+   }
+}
+
+
+/*---------------------------------------------*/
+/* Pre:
+      T [0 .. n-1] holds the text, symbols in [0 .. k-1],
+         held as UChar (cs == 1) or Int32 (cs == 4)
+      SA exists for [0 .. n-1]
+      tb exists for [0 .. (n+7)/8 - 1]
+      C and B exist for [0 .. k-1]
+
+   Post:
+      SA [0 .. n-1] holds the sorted suffixes of T
+      tb, C and B destroyed
+
+   Returns False only if a recursion level
+   could not get its workspace.
+*/
+static
+Bool saisMain ( bz_stream* strm, const void* T, Int32* SA,
+                UChar* tb, Int32* C, Int32* B,
+                Int32 n, Int32 k, Int32 cs )
+{
+   Int32  i, j, d, c0, c1, n1, name, pos, prev;
+   Int32* s1;
+   UChar* tb1;
+   Int32* C1;
+   Int32* B1;
+   Bool   diff, ok;
+
+   /*-- Classify: n-1 is L-type, being above the sentinel --*/
+   for (i = 0; i < (n + 7) >> 3; i++) tb[i] = 0;
+   c1 = saisChr(n - 1);
+   for (i = n - 2; i >= 0; i--) {
+      c0 = saisChr(i);
+      if (c0 < c1 || (c0 == c1 && saisIsS(i + 1))) saisSetS(i);
+      c1 = c0;
+   }
+
+   for (i = 0; i < k; i++) C[i] = 0;
+   for (i = 0; i < n; i++) C[saisChr(i)]++;
+
+   /*-- Stage 1: sort the LMS substrings --*/
+   for (i = 0; i < n; i++) SA[i] = SAIS_EMPTY;
+   saisBuckets ( C, B, k, True );
+   for (i = 1; i < n; i++)
+      if (saisIsLMS(i)) SA[--B[saisChr(i)]] = i;
+   saisInduce ( T, SA, tb, C, B, n, k, cs );
+
+   n1 = 0;
+   for (i = 0; i < n; i++)
+      if (saisIsLMS(SA[i])) SA[n1++] = SA[i];
+
+   /*-- No LMS positions: the sentinel alone sorted it --*/
+   if (n1 == 0) return True;
+
+   /*-- Stage 2: name the LMS substrings.  LMS positions
+        are at least two apart, so pos/2 indexes the names
+        by position without collisions in SA [n1 .. n-1].
+   --*/
+   for (i = n1; i < n; i++) SA[i] = SAIS_EMPTY;
+   name = 0;
+   prev = -1;
+   for (i = 0; i < n1; i++) {
+      pos  = SA[i];
+      diff = (prev < 0);
+      for (d = 0; !diff; d++) {
+         if (pos + d == n || prev + d == n ||
+             saisChr(pos + d) != saisChr(prev + d) ||
+             saisIsS(pos + d) != saisIsS(prev + d)) {
+            diff = True;
+            break;
+         }
+         if (d > 0 && (saisIsLMS(pos + d) || saisIsLMS(prev + d))) {
+            diff = !(saisIsLMS(pos + d) && saisIsLMS(prev + d));
+            break;
+         }
+      }
+      if (diff) { name++; prev = pos; }
+      SA[n1 + (pos >> 1)] = name - 1;
+   }
+   for (i = n - 1, j = n - 1; i >= n1; i--)
+      if (SA[i] >= 0) SA[j--] = SA[i];
+
+   /*-- Sort the reduced string, recursing unless
+        the names are already unique --*/
+   s1 = SA + n - n1;
+   if (name < n1) {
+      tb1 = BZALLOC( (n1 + 7) >> 3 );
+      C1  = BZALLOC( name * sizeof(Int32) );
+      B1  = BZALLOC( name * sizeof(Int32) );
+      ok  = (tb1 != NULL && C1 != NULL && B1 != NULL);
+      if (ok)
+         ok = saisMain ( strm, s1, SA, tb1, C1, B1, n1, name,
+                         sizeof(Int32) );
+      if (tb1 != NULL) BZFREE(tb1);
+      if (C1  != NULL) BZFREE(C1);
+      if (B1  != NULL) BZFREE(B1);
+      if (!ok) return False;
+   } else {
+      for (i = 0; i < n1; i++) SA[s1[i]] = i;
+   }
+
+   /*-- Stage 3: map back to text positions, seed the
+        bucket ends in sorted order and induce again --*/
+   for (i = 1, j = 0; i < n; i++)
+      if (saisIsLMS(i)) s1[j++] = i;
+   for (i = 0; i < n1; i++) SA[i] = s1[SA[i]];
+   for (i = n1; i < n; i++) SA[i] = SAIS_EMPTY;
+   saisBuckets ( C, B, k, True );
+   for (i = n1 - 1; i >= 0; i--) {
+      j = SA[i];
+      SA[i] = SAIS_EMPTY;
+      SA[--B[saisChr(j)]] = j;
+   }
+   saisInduce ( T, SA, tb, C, B, n, k, cs );
+   return True;
+}
+
+#undef saisChr
+#undef saisIsS
+#undef saisSetS
+#undef saisIsLMS
+
+
+/*---------------------------------------------*/
+/* Pre:
+      nblock > 0
+      arr2 exists for [0 .. nblock-1 +N_OVERSHOOT]
+      ((UChar*)arr2)  [0 .. nblock-1] holds block
+      arr1 exists for [0 .. nblock-1]
+
+   Post:
+      ((UChar*)arr2) [0 .. nblock-1] holds block
+      ftab [ 0 .. 511 ] destroyed
+      arr1 [0 .. nblock-1] holds sorted order
+
+   The rotated copy and the type bits go in the part
+   of arr2 that mainSort would use for the quadrant.
+   Returns False if recursion ran out of memory, with
+   arr1 undefined.
+*/
+#define ROT(x) block[(x) >= nblock ? (x) - nblock : (x)]
+
+static
+Bool saisSort ( EState* s )
+{
+   bz_stream* strm   = s->strm;
+   UInt32*    ptr    = s->ptr;
+   UChar*     block  = s->block;
+   Int32      nblock = s->nblock;
+   Int32*     SA     = (Int32*)s->ptr;
+   Int32*     C      = (Int32*)s->ftab;
+   UChar*     text;
+   Int32      i, j, k, r;
+
+   /*-- Least rotation, two-pointer scan, O(nblock) --*/
+   i = 0; j = 1; k = 0;
+   while (i < nblock && j < nblock && k < nblock) {
+      if (ROT(i + k) == ROT(j + k)) { k++; continue; }
+      if (ROT(i + k) > ROT(j + k)) i += k + 1; else j += k + 1;
+      if (i == j) j++;
+      k = 0;
+   }
+   r = (i < j) ? i : j;
+
+   text = &block[nblock + BZ_N_OVERSHOOT];
+   for (i = 0; i < nblock; i++) text[i] = ROT(r + i);
+
+   if (!saisMain ( strm, text, SA, text + nblock, C, C + 256,
+                   nblock, 256, 1 ))
+      return False;
+
+   for (i = 0; i < nblock; i++) {
+      j = SA[i] + r;
+      ptr[i] = (UInt32)(j >= nblock ? j - nblock : j);
+   }
+   return True;
+}
+
+#undef ROT
+
+
 /*---------------------------------------------*/
 /* Pre:
       nblock > 0
@@ -1087,8 +1866,11 @@ void BZ2_blockSort ( EState* s )
    Int32   budget;
    Int32   budgetInit;
    Int32   i;
+   MainPool* pool;
 
-   if (nblock < 10000) {
+   if (s->sorter == BZ_SORT_SAIS && saisSort ( s )) {
+      if (verb >= 4) VPrintf0 ( "        induced sort done\n" );
+   } else if (nblock < 10000) {
       fallbackSort ( s->arr1, s->arr2, ftab, nblock, verb );
    } else {
       /* Calculate the location for quadrant, remembering to get
@@ -1112,7 +1894,14 @@ void BZ2_blockSort ( EState* s )
       budgetInit = nblock * ((wfact-1) / 3);
       budget = budgetInit;
 
-      mainSort ( ptr, block, quadrant, ftab, nblock, verb, &budget );
+      pool = NULL;
+#ifdef BZ_PARALLEL
+      if (s->sortThreads != 1) pool = mainPoolCreate ( s );
+#endif
+      mainSort ( ptr, block, quadrant, ftab, nblock, verb, &budget, pool );
+#ifdef BZ_PARALLEL
+      if (pool != NULL) mainPoolDestroy ( pool );
+#endif
       if (verb >= 3) 
          VPrintf3 ( "      %d work, %d block, ratio %5.2f\n",
                     budgetInit - budget,
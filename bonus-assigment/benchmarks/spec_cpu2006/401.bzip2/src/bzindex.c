@@ -0,0 +1,428 @@
+/*-------------------------------------------------------------*/
+/*--- Random-access block index                             ---*/
+/*---                                             bzindex.c ---*/
+/*-------------------------------------------------------------*/
+
+/*--
+  A bzip2 stream can only be read from the front: nothing in it
+  says where a block starts, in either the compressed or the
+  uncompressed data.  But each block decodes on its own, given
+  the stream header and its bits from the block magic on (see
+  BZ2_decodeRange, which parallel.c uses too).  So the compressor
+  can note, as it writes each block, the bit offset of its magic
+  and the uncompressed bytes before it (a run pending at a block
+  boundary goes in the next block, so the blocks cut the input
+  exactly), and a reader can then decode just the blocks holding
+  a range: the cost of a read is a block or two, not the stream.
+
+  BZ2_bzCompressSetIndex (or BZ2_bzWriteSetIndex) attaches a
+  bz_index to a compressor; BZ2_bzIndexPack / Unpack keep it in a
+  side file; BZ2_bzIndexSpan says which compressed bytes a range
+  needs and BZ2_bzIndexRead decodes it from them.
+--*/
+
+#include "bzlib_private.h"
+
+typedef unsigned long long IdxU64;
+
+#define BZ_IDX_MAGIC_EOS 0x177245385090ULL
+#define BZ_IDX_HEADER    28
+#define BZ_IDX_ENTRY     16
+
+
+/*---------------------------------------------------*/
+/*--- The realigned one-block stream              ---*/
+/*---------------------------------------------------*/
+
+/*---------------------------------------------------*/
+/*-- n (<= 32) bits of src from bit offset pos, MSB first;
+     bytes past srcLen read as zero --*/
+UInt32 BZ2_getBits ( const UChar* src, UInt32 srcLen, UInt32 pos, Int32 n )
+{
+   IdxU64 w = 0;
+   UInt32 k;
+   for (k = (pos >> 3); k < (pos >> 3) + 5; k++)
+      w = (w << 8) | (k < srcLen ? src[k] : 0);
+   return (UInt32)((w >> (40 - (pos & 7) - n)) & ((1ULL << n) - 1));
+}
+
+
+typedef
+   struct {
+      UChar*    buf;
+      Int32     n;
+      UInt32    bsBuff;
+      Int32     bsLive;
+   }
+   IdxBuf;
+
+/*---------------------------------------------------*/
+static
+void ib_putBits ( IdxBuf* b, Int32 n, UInt32 v )
+{
+   while (b->bsLive >= 8) {
+      b->buf[b->n++] = (UChar)(b->bsBuff >> 24);
+      b->bsBuff <<= 8;
+      b->bsLive -= 8;
+   }
+   b->bsBuff |= (v << (32 - b->bsLive - n));
+   b->bsLive += n;
+}
+
+
+/*---------------------------------------------------*/
+/*-- Decode the coded bits [start, end) of src (one block
+     from its magic on, or several) into *out, grown as
+     needed, with *nOut the bytes decoded.  crc is the first
+     block's stored CRC, which the one-block stream's trailer
+     repeats as its combined CRC.  strm is an initialised
+     decompressor, reset here so its arrays carry over. --*/
+Int32 BZ2_decodeRange ( bz_stream* strm,
+                        const UChar* src, UInt32 srcLen,
+                        UInt32 start, UInt32 end,
+                        Int32 level, UInt32 crc,
+                        UChar** out, UInt32* nOut, UInt32* capOut )
+{
+   IdxBuf    b;
+   UInt32    nBits = end - start, nBytes = nBits / 8, i;
+   Int32     sh = start & 7, ret;
+   const UChar* p = src + (start >> 3);
+   void*     tmp;
+
+   b.buf = malloc ( 4 + nBytes + 1 + 10 + 4 );
+   if (b.buf == NULL) return BZ_MEM_ERROR;
+   b.buf[0] = BZ_HDR_B; b.buf[1] = BZ_HDR_Z; b.buf[2] = BZ_HDR_h;
+   b.buf[3] = (UChar)(BZ_HDR_0 + level);
+   b.n = 4;
+   if (sh == 0) {
+      memcpy ( b.buf + 4, p, nBytes );
+   } else {
+      for (i = 0; i < nBytes; i++)
+         b.buf[4 + i] = (UChar)((p[i] << sh) | (p[i + 1] >> (8 - sh)));
+   }
+   b.n += nBytes;
+   b.bsBuff = 0;
+   b.bsLive = 0;
+   if (nBits & 7)
+      ib_putBits ( &b, nBits & 7, BZ2_getBits ( src, srcLen, start + nBytes * 8, nBits & 7 ) );
+   ib_putBits ( &b, 24, (UInt32)(BZ_IDX_MAGIC_EOS >> 24) );
+   ib_putBits ( &b, 24, (UInt32)(BZ_IDX_MAGIC_EOS & 0xffffff) );
+   ib_putBits ( &b, 16, crc >> 16 );
+   ib_putBits ( &b, 16, crc & 0xffff );
+   while (b.bsLive > 0) {
+      b.buf[b.n++] = (UChar)(b.bsBuff >> 24);
+      b.bsBuff <<= 8;
+      b.bsLive -= 8;
+   }
+
+   ret = BZ2_bzDecompressReset ( strm );
+   if (ret != BZ_OK) { free ( b.buf ); return ret; }
+   strm->next_in  = (char*)b.buf;
+   strm->avail_in = b.n;
+   *nOut = 0;
+   do {
+      if (*nOut == *capOut) {
+         tmp = realloc ( *out, *capOut * 2 + 100000 * level );
+         if (tmp == NULL) { ret = BZ_MEM_ERROR; break; }
+         *out = tmp;
+         *capOut = *capOut * 2 + 100000 * level;
+      }
+      strm->next_out  = (char*)*out + *nOut;
+      strm->avail_out = *capOut - *nOut;
+      ret = BZ2_bzDecompress ( strm );
+      *nOut = *capOut - strm->avail_out;
+   } while (ret == BZ_OK && (strm->avail_in > 0 || strm->avail_out == 0));
+   if (ret == BZ_OK) ret = BZ_UNEXPECTED_EOF;
+   if (ret == BZ_STREAM_END) ret = BZ_OK;
+
+   free ( b.buf );
+   return ret;
+}
+
+
+/*---------------------------------------------------*/
+/*--- Writing the index                           ---*/
+/*---------------------------------------------------*/
+
+/*---------------------------------------------------*/
+/*-- Called by BZ2_compressBlock just before it writes a
+     block magic (or, eos, the stream's end magic).  All
+     earlier blocks have gone out already, so the bit offset is
+     total_out plus what this block has put in zbits. --*/
+void BZ2_indexBlock ( EState* s, Bool eos )
+{
+   bz_index*  idx  = s->index;
+   bz_stream* strm = s->strm;
+   IdxU64     out  = ((IdxU64)strm->total_out_hi32 << 32) | strm->total_out_lo32;
+   IdxU64     in   = ((IdxU64)strm->total_in_hi32 << 32) | strm->total_in_lo32;
+   IdxU64     bit  = (out + s->numZ) * 8 + s->bsLive;
+   void*      tmp;
+
+   if (eos) {
+      idx->endBit = bit;
+      idx->size   = in;
+      return;
+   }
+   if (idx->nBlocks == idx->capBlocks) {
+      tmp = realloc ( idx->blocks,
+                      (idx->capBlocks * 2 + 16) * sizeof(bz_index_entry) );
+      if (tmp == NULL) {
+         idx->error = BZ_MEM_ERROR;
+      } else {
+         idx->blocks = tmp;
+         idx->capBlocks = idx->capBlocks * 2 + 16;
+      }
+   }
+   if (idx->error == BZ_OK) {
+      idx->blocks[idx->nBlocks].bit = bit;
+      idx->blocks[idx->nBlocks].pos = idx->size;
+      idx->nBlocks++;
+   }
+   /*-- up to the run still pending, which goes in the next --*/
+   idx->size = in - ((s->state_in_ch < 256 && s->state_in_len > 0)
+                     ? s->state_in_len : 0);
+}
+
+
+/*---------------------------------------------------*/
+int BZ_API(BZ2_bzCompressSetIndex) ( bz_stream* strm, bz_index* idx )
+{
+   EState* s;
+
+   if (strm == NULL) return BZ_PARAM_ERROR;
+   s = strm->state;
+   if (s == NULL || s->strm != strm) return BZ_PARAM_ERROR;
+   if (strm->total_in_lo32 != 0 || strm->total_in_hi32 != 0 ||
+       strm->total_out_lo32 != 0 || strm->total_out_hi32 != 0)
+      return BZ_SEQUENCE_ERROR;
+
+   if (idx != NULL) {
+      idx->level   = s->blockSize100k;
+      idx->nBlocks = 0;
+      idx->error   = BZ_OK;
+      idx->endBit  = 0;
+      idx->size    = 0;
+   }
+   s->index = idx;
+   return BZ_OK;
+}
+
+
+/*---------------------------------------------------*/
+void BZ_API(BZ2_bzIndexFree) ( bz_index* idx )
+{
+   if (idx == NULL) return;
+   free ( idx->blocks );
+   memset ( idx, 0, sizeof(*idx) );
+}
+
+
+/*---------------------------------------------------*/
+/*--- The side-file form                          ---*/
+/*---------------------------------------------------*/
+
+/*--
+   Big-endian throughout:
+      "BZIX", level, 3 zero bytes, nBlocks (4 bytes),
+      endBit (8), size (8), then per block bit (8), pos (8).
+--*/
+
+/*---------------------------------------------------*/
+static
+void idx_put ( UChar* p, IdxU64 v, Int32 n )
+{
+   while (n-- > 0) { p[n] = (UChar)v; v >>= 8; }
+}
+
+static
+IdxU64 idx_get ( const UChar* p, Int32 n )
+{
+   IdxU64 v = 0;
+   Int32  i;
+   for (i = 0; i < n; i++) v = (v << 8) | p[i];
+   return v;
+}
+
+
+/*---------------------------------------------------*/
+unsigned int BZ_API(BZ2_bzIndexSize) ( const bz_index* idx )
+{
+   return BZ_IDX_HEADER + BZ_IDX_ENTRY * (unsigned int)idx->nBlocks;
+}
+
+
+/*---------------------------------------------------*/
+void BZ_API(BZ2_bzIndexPack) ( const bz_index* idx, unsigned char* buf )
+{
+   Int32 i;
+
+   buf[0] = 'B'; buf[1] = 'Z'; buf[2] = 'I'; buf[3] = 'X';
+   buf[4] = (UChar)idx->level; buf[5] = buf[6] = buf[7] = 0;
+   idx_put ( buf + 8, (IdxU64)idx->nBlocks, 4 );
+   idx_put ( buf + 12, idx->endBit, 8 );
+   idx_put ( buf + 20, idx->size, 8 );
+   buf += BZ_IDX_HEADER;
+   for (i = 0; i < idx->nBlocks; i++, buf += BZ_IDX_ENTRY) {
+      idx_put ( buf, idx->blocks[i].bit, 8 );
+      idx_put ( buf + 8, idx->blocks[i].pos, 8 );
+   }
+}
+
+
+/*---------------------------------------------------*/
+/*-- Into a zeroed (or freed) idx; BZ_DATA_ERROR_MAGIC if
+     buf is no index, BZ_DATA_ERROR if it is inconsistent --*/
+int BZ_API(BZ2_bzIndexUnpack) ( bz_index* idx, const unsigned char* buf,
+                                unsigned int len )
+{
+   IdxU64 n;
+   Int32  i;
+
+   if (idx == NULL || buf == NULL) return BZ_PARAM_ERROR;
+   if (len < BZ_IDX_HEADER || buf[0] != 'B' || buf[1] != 'Z' ||
+       buf[2] != 'I' || buf[3] != 'X')
+      return BZ_DATA_ERROR_MAGIC;
+   n = idx_get ( buf + 8, 4 );
+   if (buf[4] < 1 || buf[4] > 9 || n > (len - BZ_IDX_HEADER) / BZ_IDX_ENTRY ||
+       BZ_IDX_HEADER + BZ_IDX_ENTRY * n != len)
+      return BZ_DATA_ERROR;
+
+   memset ( idx, 0, sizeof(*idx) );
+   idx->level  = buf[4];
+   idx->endBit = idx_get ( buf + 12, 8 );
+   idx->size   = idx_get ( buf + 20, 8 );
+   if (n > 0) {
+      idx->blocks = malloc ( n * sizeof(bz_index_entry) );
+      if (idx->blocks == NULL) return BZ_MEM_ERROR;
+   }
+   idx->nBlocks = idx->capBlocks = (int)n;
+   buf += BZ_IDX_HEADER;
+   for (i = 0; i < idx->nBlocks; i++, buf += BZ_IDX_ENTRY) {
+      idx->blocks[i].bit = idx_get ( buf, 8 );
+      idx->blocks[i].pos = idx_get ( buf + 8, 8 );
+      if ((i == 0 && idx->blocks[i].pos != 0) ||
+          (i > 0 && (idx->blocks[i].bit <= idx->blocks[i-1].bit ||
+                     idx->blocks[i].pos <= idx->blocks[i-1].pos)) ||
+          idx->blocks[i].bit >= idx->endBit ||
+          idx->blocks[i].pos >= idx->size) {
+         BZ2_bzIndexFree ( idx );
+         return BZ_DATA_ERROR;
+      }
+   }
+   return BZ_OK;
+}
+
+
+/*---------------------------------------------------*/
+/*--- Reading through the index                   ---*/
+/*---------------------------------------------------*/
+
+/*---------------------------------------------------*/
+/*-- The block holding uncompressed byte pos < size --*/
+static
+Int32 idx_find ( const bz_index* idx, IdxU64 pos )
+{
+   Int32 lo = 0, hi = idx->nBlocks - 1, mid;
+   while (lo < hi) {
+      mid = (lo + hi + 1) / 2;
+      if (idx->blocks[mid].pos <= pos) lo = mid; else hi = mid - 1;
+   }
+   return lo;
+}
+
+static
+IdxU64 idx_endBit ( const bz_index* idx, Int32 k )
+{
+   return (k + 1 < idx->nBlocks) ? idx->blocks[k+1].bit : idx->endBit;
+}
+
+static
+IdxU64 idx_endPos ( const bz_index* idx, Int32 k )
+{
+   return (k + 1 < idx->nBlocks) ? idx->blocks[k+1].pos : idx->size;
+}
+
+
+/*---------------------------------------------------*/
+int BZ_API(BZ2_bzIndexSpan) ( const bz_index* idx,
+                              unsigned long long pos, unsigned int len,
+                              unsigned long long* first,
+                              unsigned long long* last )
+{
+   IdxU64 end;
+
+   if (idx == NULL || first == NULL || last == NULL) return BZ_PARAM_ERROR;
+   if (idx->error != BZ_OK) return idx->error;
+   *first = *last = 0;
+   if (len == 0 || pos >= idx->size || idx->nBlocks == 0) return BZ_OK;
+
+   end = (len > idx->size - pos) ? idx->size : pos + len;
+   *first = idx->blocks[idx_find ( idx, pos )].bit / 8;
+   *last  = (idx_endBit ( idx, idx_find ( idx, end - 1 ) ) + 7) / 8;
+   return BZ_OK;
+}
+
+
+/*---------------------------------------------------*/
+int BZ_API(BZ2_bzIndexRead) ( const bz_index* idx,
+                              const unsigned char* span,
+                              unsigned int spanLen,
+                              unsigned long long spanFirst,
+                              unsigned long long pos,
+                              unsigned char* dest, unsigned int len )
+{
+   bz_stream strm;
+   UChar*    out = NULL;
+   UInt32    nOut = 0, capOut = 0, done = 0, n, from, start, end;
+   IdxU64    spanBit = spanFirst * 8;
+   Int32     k, ret;
+
+   if (idx == NULL || span == NULL || dest == NULL ||
+       spanLen > 0xffffffffU / 8)
+      return BZ_PARAM_ERROR;
+   if (idx->error != BZ_OK) return idx->error;
+   if (len == 0 || pos >= idx->size || idx->nBlocks == 0) return 0;
+   if (len > idx->size - pos) len = (UInt32)(idx->size - pos);
+
+   memset ( &strm, 0, sizeof(strm) );
+   ret = BZ2_bzDecompressInit ( &strm, 0, 0 );
+   if (ret != BZ_OK) return ret;
+
+   for (k = idx_find ( idx, pos ); done < len; k++) {
+      if (idx->blocks[k].bit < spanBit ||
+          idx_endBit ( idx, k ) > spanBit + (IdxU64)spanLen * 8) {
+         ret = BZ_PARAM_ERROR;
+         break;
+      }
+      start = (UInt32)(idx->blocks[k].bit - spanBit);
+      end   = (UInt32)(idx_endBit ( idx, k ) - spanBit);
+      ret = BZ2_decodeRange ( &strm, span, spanLen, start, end, idx->level,
+                              BZ2_getBits ( span, spanLen, start + 48, 32 ),
+                              &out, &nOut, &capOut );
+      if (ret != BZ_OK) break;
+      if (nOut != idx_endPos ( idx, k ) - idx->blocks[k].pos) {
+         ret = BZ_DATA_ERROR;
+         break;
+      }
+      /* idx_find gives block 0 below its pos; Unpack keeps that 0 */
+      if (pos + done < idx->blocks[k].pos ||
+          pos + done - idx->blocks[k].pos >= nOut) {
+         ret = BZ_DATA_ERROR;
+         break;
+      }
+      from = (UInt32)(pos + done - idx->blocks[k].pos);
+      n    = nOut - from;
+      if (n > len - done) n = len - done;
+      memcpy ( dest + done, out + from, n );
+      done += n;
+   }
+
+   BZ2_bzDecompressEnd ( &strm );
+   free ( out );
+   return (ret == BZ_OK) ? (int)done : ret;
+}
+
+
+/*-------------------------------------------------------------*/
+/*--- end                                         bzindex.c ---*/
+/*-------------------------------------------------------------*/
@@ -152,6 +152,7 @@
 #include <math.h>
 #include <errno.h>
 #include <ctype.h>
+#include <setjmp.h>
 #include "bzlib.h"
 #include "spec.h"
 
@@ -282,7 +283,8 @@ typedef int IntNative;
 Int32   verbosity;
 Bool    keepInputFiles, smallMode, deleteOutputOnInterrupt;
 Bool    forceOverwrite, testFailsExist, unzFailsExist, noisy;
-Int32   numFileNames, numFilesProcessed, blockSize100k;
+Int32   numFileNames, numFilesProcessed;
+SPEC_TLS Int32 blockSize100k;
 Int32   exitValue;
 
 /*-- source modes; F==file, I==stdin, O==stdout --*/
@@ -307,11 +309,16 @@ Char    tmpName[FILE_NAME_LEN];
 Char    *progName;
 Char    progNameReally[FILE_NAME_LEN];
 #if defined(SPEC_CPU)
-int     outputHandleJustInCase;
+SPEC_TLS int   outputHandleJustInCase;
 #else
-FILE    *outputHandleJustInCase;
+SPEC_TLS FILE *outputHandleJustInCase;
 #endif
 Int32   workFactor;
+/* when set, compressStream writes a block index into it (bzindex.c) */
+SPEC_TLS bz_index *compressIndex;
+/* when set, cleanUpAndFail longjmps here with its exit code instead
+   of exiting (spec.c's streaming mode, where failures must not be 0) */
+SPEC_TLS jmp_buf *failJump;
 
 static void    panic                 ( Char* )   NORETURN;
 static void    ioError               ( void )    NORETURN;
@@ -439,7 +446,9 @@ void compressStream ( FILE *stream, FILE *zStream )
 #endif
 {
    BZFILE* bzf = NULL;
+#if !(defined(SPEC_CPU) && defined(SPEC_MMAP))
    UChar   ibuf[5000];
+#endif
    Int32   nIbuf;
    UInt32  nbytes_in_lo32, nbytes_in_hi32;
    UInt32  nbytes_out_lo32, nbytes_out_hi32;
@@ -454,15 +463,28 @@ void compressStream ( FILE *stream, FILE *zStream )
    bzf = BZ2_bzWriteOpen ( &bzerr, zStream, 
                            blockSize100k, verbosity, workFactor );   
    if (bzerr != BZ_OK) goto errhandler;
+   if (compressIndex != NULL) {
+      BZ2_bzWriteSetIndex ( &bzerr, bzf, compressIndex );
+      if (bzerr != BZ_OK) goto errhandler;
+   }
 
    if (verbosity >= 2) fprintf ( stderr, "\n" );
 
    while (True) {
 
       if (myfeof(stream)) break;
+#if defined(SPEC_CPU) && defined(SPEC_MMAP)
+      /* Compress straight out of the input mapping, not via ibuf */
+      {
+         UChar* inp;
+         nIbuf = spec_view ( stream, &inp, 1 << 20 );
+         if (nIbuf > 0) BZ2_bzWrite ( &bzerr, bzf, (void*)inp, nIbuf );
+      }
+#else
       nIbuf = fread ( ibuf, sizeof(UChar), 5000, stream );
       if (ferror(stream)) goto errhandler_io;
       if (nIbuf > 0) BZ2_bzWrite ( &bzerr, bzf, (void*)ibuf, nIbuf );
+#endif
       if (bzerr != BZ_OK) goto errhandler;
 
    }
@@ -538,6 +560,72 @@ void compressStream ( FILE *stream, FILE *zStream )
 }
 
 
+#if defined(SPEC_CPU) && defined(SPEC_INDEX)
+/*---------------------------------------------*/
+/*-- For spec.c's -DSPEC_INDEX check: index the next
+     compressStream, then read ranges of the data back
+     through the index. --*/
+static SPEC_TLS bz_index specIndex;
+
+void specIndexBegin ( void )
+{
+   BZ2_bzIndexFree ( &specIndex );
+   compressIndex = &specIndex;
+}
+
+/*-- nRanges random ranges of plain[0 .. plainLen), decoded
+     from the compressed z[0 .. zLen) through specIndex once
+     it has been through its side-file form.  Returns the
+     number of blocks, or -1 if a read went wrong. --*/
+Int32 specIndexCheck ( const UChar* plain, UInt32 plainLen,
+                       const UChar* z, UInt32 zLen,
+                       Int32 nRanges, UInt32 seed )
+{
+   bz_index           idx;
+   UChar*             packed;
+   UChar*             dest;
+   UInt32             size, pos, len, want;
+   unsigned long long first, last;
+   Int32              r, n, ret = -1;
+
+   compressIndex = NULL;
+   memset ( &idx, 0, sizeof(idx) );
+   size   = BZ2_bzIndexSize ( &specIndex );
+   packed = malloc ( size );
+   dest   = malloc ( 65536 );
+   if (packed == NULL || dest == NULL || specIndex.error != BZ_OK)
+      goto out;
+   BZ2_bzIndexPack ( &specIndex, packed );
+   if (BZ2_bzIndexUnpack ( &idx, packed, size ) != BZ_OK ||
+       idx.size != plainLen)
+      goto out;
+
+   for (r = 0; r < nRanges && plainLen > 0; r++) {
+      seed = seed * 1103515245 + 12345;
+      pos  = (seed >> 4) % plainLen;
+      seed = seed * 1103515245 + 12345;
+      len  = 1 + (seed >> 4) % 65536;
+      want = (len < plainLen - pos) ? len : plainLen - pos;
+      if (BZ2_bzIndexSpan ( &idx, pos, len, &first, &last ) != BZ_OK ||
+          last > zLen)
+         goto out;
+      n = BZ2_bzIndexRead ( &idx, z + first, (UInt32)(last - first), first,
+                            pos, dest, len );
+      if (n != (Int32)want || memcmp ( dest, plain + pos, want ) != 0)
+         goto out;
+   }
+   ret = idx.nBlocks;
+
+   out:
+   BZ2_bzIndexFree ( &idx );
+   BZ2_bzIndexFree ( &specIndex );
+   free ( packed );
+   free ( dest );
+   return ret;
+}
+#endif /* SPEC_INDEX */
+
+
 
 /*---------------------------------------------*/
 #if defined(SPEC_CPU)
@@ -869,6 +957,7 @@ void cleanUpAndFail ( Int32 ec )
                 numFileNames, numFileNames - numFilesProcessed );
    }
 #endif /* !SPEC_CPU */
+   if (failJump != NULL) longjmp(*failJump, ec);
    setExit(ec);
    exit(exitValue);
 }
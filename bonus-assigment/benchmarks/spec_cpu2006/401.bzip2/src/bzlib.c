@@ -201,6 +201,70 @@ Bool isempty_RL ( EState* s )
 }
 
 
+/*---------------------------------------------------*/
+/*-- Sorter taken by each stream at BZ2_bzCompressInit;
+     set it before starting any compressor threads. --*/
+static int bzBlockSorter = BZ_SORT_MAIN;
+
+int BZ_API(BZ2_bzSetBlockSorter) ( int sorter )
+{
+   if (sorter != BZ_SORT_MAIN && sorter != BZ_SORT_SAIS)
+      return BZ_PARAM_ERROR;
+   bzBlockSorter = sorter;
+   return BZ_OK;
+}
+
+/*-- Likewise the threads of each block's main sort (0 = one
+     per online CPU); only 1 without BZ_PARALLEL. --*/
+static int bzSortThreads = 1;
+
+int BZ_API(BZ2_bzSetSortThreads) ( int nThreads )
+{
+#ifdef BZ_PARALLEL
+   if (nThreads < 0) return BZ_PARAM_ERROR;
+#else
+   if (nThreads != 1) return BZ_PARAM_ERROR;
+#endif
+   bzSortThreads = nThreads;
+   return BZ_OK;
+}
+
+
+/*---------------------------------------------------*/
+/*-- Fresh-stream state, arrays already allocated --*/
+static
+void init_EState ( EState* s, int blockSize100k, 
+                   int verbosity, int workFactor )
+{
+   bz_stream* strm = s->strm;
+
+   s->blockNo           = 0;
+   s->state             = BZ_S_INPUT;
+   s->mode              = BZ_M_RUNNING;
+   s->combinedCRC       = 0;
+   s->blockSize100k     = blockSize100k;
+   s->nblockMAX         = 100000 * blockSize100k - 19;
+   s->verbosity         = verbosity;
+   s->workFactor        = workFactor;
+   s->sorter            = bzBlockSorter;
+   s->sortThreads       = bzSortThreads;
+   s->index             = NULL;
+
+   s->block             = (UChar*)s->arr2;
+   s->mtfv              = (UInt16*)s->arr1;
+   s->zbits             = NULL;
+   s->ptr               = (UInt32*)s->arr1;
+
+   strm->state          = s;
+   strm->total_in_lo32  = 0;
+   strm->total_in_hi32  = 0;
+   strm->total_out_lo32 = 0;
+   strm->total_out_hi32 = 0;
+   init_RL ( s );
+   prepare_new_block ( s );
+}
+
+
 /*---------------------------------------------------*/
 int BZ_API(BZ2_bzCompressInit) 
                     ( bz_stream* strm, 
@@ -242,41 +306,61 @@ int BZ_API(BZ2_bzCompressInit)
       if (s       != NULL) BZFREE(s);
       return BZ_MEM_ERROR;
    }
+   s->allocSize100k     = blockSize100k;
 
-   s->blockNo           = 0;
-   s->state             = BZ_S_INPUT;
-   s->mode              = BZ_M_RUNNING;
-   s->combinedCRC       = 0;
-   s->blockSize100k     = blockSize100k;
-   s->nblockMAX         = 100000 * blockSize100k - 19;
-   s->verbosity         = verbosity;
-   s->workFactor        = workFactor;
+   init_EState ( s, blockSize100k, verbosity, workFactor );
+   return BZ_OK;
+}
 
-   s->block             = (UChar*)s->arr2;
-   s->mtfv              = (UInt16*)s->arr1;
-   s->zbits             = NULL;
-   s->ptr               = (UInt32*)s->arr1;
 
-   strm->state          = s;
-   strm->total_in_lo32  = 0;
-   strm->total_in_hi32  = 0;
-   strm->total_out_lo32 = 0;
-   strm->total_out_hi32 = 0;
-   init_RL ( s );
-   prepare_new_block ( s );
+/*---------------------------------------------------*/
+/*-- Start a new stream on an existing compressor.  The
+     block arrays are kept (and only regrown if the new
+     blockSize100k is larger), so compressing many small
+     payloads one after another allocates nothing.  After
+     a BZ_MEM_ERROR only BZ2_bzCompressEnd may follow. --*/
+int BZ_API(BZ2_bzCompressReset) 
+                    ( bz_stream* strm, 
+                     int        blockSize100k,
+                     int        verbosity,
+                     int        workFactor )
+{
+   Int32   n;
+   EState* s;
+
+   if (strm == NULL) return BZ_PARAM_ERROR;
+   s = strm->state;
+   if (s == NULL) return BZ_PARAM_ERROR;
+   if (s->strm != strm) return BZ_PARAM_ERROR;
+   if (blockSize100k < 1 || blockSize100k > 9 ||
+       workFactor < 0 || workFactor > 250)
+     return BZ_PARAM_ERROR;
+
+   if (workFactor == 0) workFactor = 30;
+
+   if (blockSize100k > s->allocSize100k) {
+      if (s->arr1 != NULL) BZFREE(s->arr1);
+      if (s->arr2 != NULL) BZFREE(s->arr2);
+      s->allocSize100k = 0;
+      n       = 100000 * blockSize100k;
+      s->arr1 = BZALLOC( n                  * sizeof(UInt32) );
+      s->arr2 = BZALLOC( (n+BZ_N_OVERSHOOT) * sizeof(UInt32) );
+      if (s->arr1 == NULL || s->arr2 == NULL) return BZ_MEM_ERROR;
+      s->allocSize100k = blockSize100k;
+   }
+
+   init_EState ( s, blockSize100k, verbosity, workFactor );
    return BZ_OK;
 }
 
 
 /*---------------------------------------------------*/
+/*-- blockCRC is not kept here but by the callers, over
+     whole buffers where they can (crc_committed) --*/
 static
 void add_pair_to_block ( EState* s )
 {
-   Int32 i;
    UChar ch = (UChar)(s->state_in_ch);
-   for (i = 0; i < s->state_in_len; i++) {
-      BZ_UPDATE_CRC( s->blockCRC, ch );
-   }
    s->inUse[s->state_in_ch] = True;
    switch (s->state_in_len) {
       case 1:
@@ -308,11 +392,35 @@ void add_pair_to_block ( EState* s )
 static
 void flush_RL ( EState* s )
 {
-   if (s->state_in_ch < 256) add_pair_to_block ( s );
+   Int32 i;
+   if (s->state_in_ch < 256) {
+      for (i = 0; i < s->state_in_len; i++) {
+         BZ_UPDATE_CRC( s->blockCRC, s->state_in_ch );
+      }
+      add_pair_to_block ( s );
+   }
    init_RL ( s );
 }
 
 
+/*---------------------------------------------------*/
+/*-- Bring blockCRC up to date after copying n bytes from
+     in.  The bytes now in the block are, in order, the run
+     that was pending before (pend0 of ch0) and then the
+     input, less the run still pending, which a full block
+     carries over to the next one. --*/
+static
+void crc_committed ( EState* s, UInt32 ch0, Int32 pend0, 
+                     const char* in, Int32 n )
+{
+   Int32 c = pend0 + n - (s->state_in_ch < 256 ? s->state_in_len : 0);
+   for (; c > 0 && pend0 > 0; c--, pend0--) {
+      BZ_UPDATE_CRC( s->blockCRC, ch0 );
+   }
+   if (c > 0) BZ_UPDATE_CRC_BUF ( s->blockCRC, in, c );
+}
+
+
 /*---------------------------------------------------*/
 #define ADD_CHAR_TO_BLOCK(zs,zchh0)               \
 {                                                 \
@@ -321,7 +429,6 @@ void flush_RL ( EState* s )
    if (zchh != zs->state_in_ch &&                 \
        zs->state_in_len == 1) {                   \
       UChar ch = (UChar)(zs->state_in_ch);        \
-      BZ_UPDATE_CRC( zs->blockCRC, ch );          \
       zs->inUse[zs->state_in_ch] = True;          \
       zs->block[zs->nblock] = (UChar)ch;          \
       zs->nblock++;                               \
@@ -345,7 +452,10 @@ void flush_RL ( EState* s )
 static
 Bool copy_input_until_stop ( EState* s )
 {
-   Bool progress_in = False;
+   Bool   progress_in  = False;
+   char*  next_in_INIT = s->strm->next_in;
+   UInt32 ch_INIT      = s->state_in_ch;
+   Int32  len_INIT     = s->state_in_ch < 256 ? s->state_in_len : 0;
 
    if (s->mode == BZ_M_RUNNING) {
 
@@ -382,6 +492,8 @@ Bool copy_input_until_stop ( EState* s )
          s->avail_in_expect--;
       }
    }
+   crc_committed ( s, ch_INIT, len_INIT, next_in_INIT,
+                   s->strm->next_in - next_in_INIT );
    return progress_in;
 }
 
@@ -413,6 +525,34 @@ Bool copy_output_until_stop ( EState* s )
 }
 
 
+/*---------------------------------------------------*/
+/*-- For the block-parallel compressor (parallel.c).  A new
+     block in s starts with the run carried over from the previous
+     one, and is filled with the same run-length front end as
+     BZ2_bzCompress, so blocks split exactly where the serial
+     compressor splits them.  A full block leaves its pending run in
+     s->state_in_ch/len for the next block; once the input ends
+     (finish) the run goes into this block instead. --*/
+
+void BZ2_blockStart ( EState* s, UInt32 run_ch, Int32 run_len )
+{
+   prepare_new_block ( s );
+   s->state_in_ch  = run_ch;
+   s->state_in_len = run_len;
+}
+
+Int32 BZ2_blockFill ( EState* s, UChar* buf, Int32 n, Bool finish )
+{
+   s->mode           = BZ_M_RUNNING;
+   s->strm->next_in  = (char*)buf;
+   s->strm->avail_in = n;
+   copy_input_until_stop ( s );
+   if (finish && s->strm->avail_in == 0 && s->nblock < s->nblockMAX)
+      flush_RL ( s );
+   return n - (Int32)s->strm->avail_in;
+}
+
+
 /*---------------------------------------------------*/
 static
 Bool handle_compress ( bz_stream* strm )
@@ -578,6 +718,7 @@ int BZ_API(BZ2_bzDecompressInit)
    s->ll4                   = NULL;
    s->ll16                  = NULL;
    s->tt                    = NULL;
+   s->allocSize100k         = 0;
    s->currBlockNo           = 0;
    s->verbosity             = verbosity;
 
@@ -585,6 +726,33 @@ int BZ_API(BZ2_bzDecompressInit)
 }
 
 
+/*---------------------------------------------------*/
+/*-- Start a new stream on an existing decompressor,
+     keeping tt (or ll16/ll4) for the next header to
+     reuse when its block size fits. --*/
+int BZ_API(BZ2_bzDecompressReset) ( bz_stream *strm )
+{
+   DState* s;
+
+   if (strm == NULL) return BZ_PARAM_ERROR;
+   s = strm->state;
+   if (s == NULL) return BZ_PARAM_ERROR;
+   if (s->strm != strm) return BZ_PARAM_ERROR;
+
+   s->state                 = BZ_X_MAGIC_1;
+   s->bsLive                = 0;
+   s->bsBuff                = 0;
+   s->calculatedCombinedCRC = 0;
+   strm->total_in_lo32      = 0;
+   strm->total_in_hi32      = 0;
+   strm->total_out_lo32     = 0;
+   strm->total_out_hi32     = 0;
+   s->currBlockNo           = 0;
+
+   return BZ_OK;
+}
+
+
 /*---------------------------------------------------*/
 /* Return  True iff data corruption is discovered.
    Returns False if there is no problem.
@@ -658,6 +826,7 @@ Bool unRLE_obuf_to_output_FAST ( DState* s )
       /* end restore */
 
       UInt32       avail_out_INIT = cs_avail_out;
+      char*        next_out_INIT  = cs_next_out;  /* CRC'd at return_notr */
       Int32        s_save_nblockPP = s->save_nblock+1;
       unsigned int total_out_lo32_old;
 
@@ -669,7 +838,6 @@ Bool unRLE_obuf_to_output_FAST ( DState* s )
                if (cs_avail_out == 0) goto return_notr;
                if (c_state_out_len == 1) break;
                *( (UChar*)(cs_next_out) ) = c_state_out_ch;
-               BZ_UPDATE_CRC ( c_calculatedBlockCRC, c_state_out_ch );
                c_state_out_len--;
                cs_next_out++;
                cs_avail_out--;
@@ -680,7 +848,6 @@ Bool unRLE_obuf_to_output_FAST ( DState* s )
                   c_state_out_len = 1; goto return_notr;
                };
                *( (UChar*)(cs_next_out) ) = c_state_out_ch;
-               BZ_UPDATE_CRC ( c_calculatedBlockCRC, c_state_out_ch );
                cs_next_out++;
                cs_avail_out--;
             }
@@ -717,6 +884,8 @@ Bool unRLE_obuf_to_output_FAST ( DState* s )
       }
 
       return_notr:
+      BZ_UPDATE_CRC_BUF ( c_calculatedBlockCRC, next_out_INIT,
+                          cs_next_out - next_out_INIT );
       total_out_lo32_old = s->strm->total_out_lo32;
       s->strm->total_out_lo32 += (avail_out_INIT - cs_avail_out);
       if (s->strm->total_out_lo32 < total_out_lo32_old)
@@ -1073,6 +1242,23 @@ void BZ_API(BZ2_bzWrite)
 }
 
 
+/*---------------------------------------------------*/
+void BZ_API(BZ2_bzWriteSetIndex)
+             ( int*      bzerror, 
+               BZFILE*   b, 
+               bz_index* idx )
+{
+   bzFile* bzf = (bzFile*)b;
+
+   BZ_SETERR(BZ_OK);
+   if (bzf == NULL)
+      { BZ_SETERR(BZ_PARAM_ERROR); return; };
+   if (!(bzf->writing))
+      { BZ_SETERR(BZ_SEQUENCE_ERROR); return; };
+   BZ_SETERR(BZ2_bzCompressSetIndex ( &(bzf->strm), idx ));
+}
+
+
 /*---------------------------------------------------*/
 void BZ_API(BZ2_bzWriteClose)
                   ( int*          bzerror, 
@@ -259,6 +259,15 @@ BZ_EXTERN int BZ_API(BZ2_bzCompressInit) (
       int        workFactor 
    );
 
+/*-- Start another stream on an initialised compressor,
+     reusing its block arrays --*/
+BZ_EXTERN int BZ_API(BZ2_bzCompressReset) ( 
+      bz_stream* strm, 
+      int        blockSize100k, 
+      int        verbosity, 
+      int        workFactor 
+   );
+
 BZ_EXTERN int BZ_API(BZ2_bzCompress) ( 
       bz_stream* strm, 
       int action 
@@ -268,12 +277,42 @@ BZ_EXTERN int BZ_API(BZ2_bzCompressEnd) (
       bz_stream* strm 
    );
 
+/*-- Block sorters for BZ2_bzSetBlockSorter --*/
+#define BZ_SORT_MAIN 0
+#define BZ_SORT_SAIS 1
+
+BZ_EXTERN int BZ_API(BZ2_bzSetBlockSorter) ( 
+      int sorter 
+   );
+
+/*-- Threads sorting each block (BZ_PARALLEL builds) --*/
+BZ_EXTERN int BZ_API(BZ2_bzSetSortThreads) ( 
+      int nThreads 
+   );
+
+/*-- CRC implementations for BZ2_bzSetCrcImpl (default
+     BZ_CRC_AUTO, the fastest this CPU supports) --*/
+#define BZ_CRC_AUTO    0
+#define BZ_CRC_TABLE   1
+#define BZ_CRC_SLICE8  2
+#define BZ_CRC_SLICE16 3
+#define BZ_CRC_CLMUL   4
+
+BZ_EXTERN int BZ_API(BZ2_bzSetCrcImpl) ( 
+      int impl 
+   );
+
 BZ_EXTERN int BZ_API(BZ2_bzDecompressInit) ( 
       bz_stream *strm, 
       int       verbosity, 
       int       small
    );
 
+/*-- Likewise for a decompressor --*/
+BZ_EXTERN int BZ_API(BZ2_bzDecompressReset) ( 
+      bz_stream *strm 
+   );
+
 BZ_EXTERN int BZ_API(BZ2_bzDecompress) ( 
       bz_stream* strm 
    );
@@ -283,6 +322,84 @@ BZ_EXTERN int BZ_API(BZ2_bzDecompressEnd) (
    );
 
 
+/*-- Random-access block index (bzindex.c).  Attached to a
+     compressor, it gets one entry per block as the block is
+     written; BZ2_bzIndexRead then decodes a byte range from
+     the blocks holding it alone.  Offsets are from the start
+     of the compressed / uncompressed stream. --*/
+
+typedef
+   struct {
+      unsigned long long bit;     /* of the block's magic */
+      unsigned long long pos;     /* uncompressed bytes before it */
+   }
+   bz_index_entry;
+
+typedef
+   struct {
+      int                level;   /* blockSize100k of the stream */
+      int                nBlocks;
+      int                capBlocks;
+      int                error;   /* BZ_MEM_ERROR if an entry was lost */
+      bz_index_entry*    blocks;
+      unsigned long long endBit;  /* of the end-of-stream magic */
+      unsigned long long size;    /* uncompressed bytes */
+   }
+   bz_index;
+
+/*-- idx must be zeroed (or freed) first; set it before the
+     first BZ2_bzCompress of the stream --*/
+BZ_EXTERN int BZ_API(BZ2_bzCompressSetIndex) ( 
+      bz_stream* strm, 
+      bz_index*  idx 
+   );
+
+BZ_EXTERN void BZ_API(BZ2_bzIndexFree) ( 
+      bz_index* idx 
+   );
+
+/*-- Side-file form: BZ2_bzIndexPack writes
+     BZ2_bzIndexSize(idx) bytes --*/
+BZ_EXTERN unsigned int BZ_API(BZ2_bzIndexSize) ( 
+      const bz_index* idx 
+   );
+
+BZ_EXTERN void BZ_API(BZ2_bzIndexPack) ( 
+      const bz_index* idx, 
+      unsigned char*  buf 
+   );
+
+BZ_EXTERN int BZ_API(BZ2_bzIndexUnpack) ( 
+      bz_index*            idx, 
+      const unsigned char* buf, 
+      unsigned int         len 
+   );
+
+/*-- Compressed bytes [*first, *last) that BZ2_bzIndexRead
+     needs for uncompressed bytes [pos, pos+len) --*/
+BZ_EXTERN int BZ_API(BZ2_bzIndexSpan) ( 
+      const bz_index*     idx, 
+      unsigned long long  pos, 
+      unsigned int        len, 
+      unsigned long long* first, 
+      unsigned long long* last 
+   );
+
+/*-- Decode uncompressed bytes [pos, pos+len) into dest from
+     span, the compressed bytes from spanFirst on (at least
+     BZ2_bzIndexSpan's).  Returns the bytes read (short only
+     at the end of the stream) or a BZ_ error. --*/
+BZ_EXTERN int BZ_API(BZ2_bzIndexRead) ( 
+      const bz_index*      idx, 
+      const unsigned char* span, 
+      unsigned int         spanLen, 
+      unsigned long long   spanFirst, 
+      unsigned long long   pos, 
+      unsigned char*       dest, 
+      unsigned int         len 
+   );
+
+
 
 /*-- High(er) level library functions --*/
 
@@ -342,6 +459,13 @@ BZ_EXTERN void BZ_API(BZ2_bzWrite) (
       int     len 
    );
 
+/*-- BZ2_bzCompressSetIndex for a BZFILE, before any BZ2_bzWrite --*/
+BZ_EXTERN void BZ_API(BZ2_bzWriteSetIndex) ( 
+      int*      bzerror, 
+      BZFILE*   b, 
+      bz_index* idx 
+   );
+
 BZ_EXTERN void BZ_API(BZ2_bzWriteClose) ( 
       int*          bzerror, 
       BZFILE*       b, 
@@ -133,6 +133,18 @@ extern void bz_internal_error ( int errcode );
 #endif
 
 
+/*-- With MEM_TRACE (make trace), mainGtU logs the
+     block and quadrant runs it compares, see
+     ../../memtrace/memtrace.h --*/
+
+#ifdef MEM_TRACE
+#include "memtrace.h"
+#else
+#define MEMTRACE_LOAD(p)  /* */
+#define MEMTRACE_STORE(p) /* */
+#endif
+
+
 #define BZALLOC(nnn) (strm->bzalloc)(strm->opaque,(nnn),1)
 #define BZFREE(ppp)  (strm->bzfree)(strm->opaque,(ppp))
 
@@ -158,6 +170,10 @@ extern void bz_internal_error ( int errcode );
 
 #define BZ_MAX_SELECTORS (2 + (900000 / BZ_G_SIZE))
 
+/*-- Window of the decoder's one-lookup Huffman table.
+     Codes up to this long decode in one step. --*/
+#define BZ_HUFF_FAST_BITS 10
+
 
 
 /*-- Stuff for randomising repetitive blocks. --*/
@@ -205,6 +221,16 @@ extern UInt32 BZ2_crc32Table[256];
                            ((UChar)cha)];      \
 }
 
+/* The same over n bytes at p; see crctable.c */
+extern UInt32 (*BZ2_crcUpdate) ( UInt32 crc, const UChar* p, Int32 n );
+
+#define BZ_UPDATE_CRC_BUF(crcVar,p,n)          \
+{                                              \
+   crcVar = BZ2_crcUpdate ( crcVar,            \
+                            (const UChar*)(p), \
+                            (Int32)(n) );      \
+}
+
 
 
 /*-- States and modes for compression. --*/
@@ -255,6 +281,15 @@ typedef
       /* for deciding when to use the fallback sorting algorithm */
       Int32    workFactor;
 
+      /* BZ_SORT_MAIN (main/fallback) or BZ_SORT_SAIS */
+      Int32    sorter;
+
+      /* threads for one block's main sort (BZ_PARALLEL) */
+      Int32    sortThreads;
+
+      /* block index being written, or NULL (bzindex.c) */
+      bz_index* index;
+
       /* run-length-encoding of the input */
       UInt32   state_in_ch;
       Int32    state_in_len;
@@ -283,6 +318,7 @@ typedef
       Int32    verbosity;
       Int32    blockNo;
       Int32    blockSize100k;
+      Int32    allocSize100k;   /* arr1/arr2 capacity */
 
       /* stuff for coding the MTF values */
       Int32    nMTF;
@@ -312,6 +348,22 @@ BZ2_compressBlock ( EState*, Bool );
 extern void 
 BZ2_bsInitWrite ( EState* );
 
+extern void 
+BZ2_blockStart ( EState*, UInt32, Int32 );
+
+extern Int32 
+BZ2_blockFill ( EState*, UChar*, Int32, Bool );
+
+extern void 
+BZ2_indexBlock ( EState*, Bool );
+
+extern UInt32 
+BZ2_getBits ( const UChar*, UInt32, UInt32, Int32 );
+
+extern Int32 
+BZ2_decodeRange ( bz_stream*, const UChar*, UInt32, UInt32, UInt32,
+                  Int32, UInt32, UChar**, UInt32*, UInt32* );
+
 extern void 
 BZ2_hbAssignCodes ( Int32*, UChar*, Int32, Int32, Int32 );
 
@@ -375,6 +427,127 @@ BZ2_hbMakeCodeLengths ( UChar*, Int32*, Int32, Int32 );
 #define MTFL_SIZE 16
 
 
+/*-- Vector move-to-front, for generateMTFValues and
+     the decoder's MTFL_SIZE lists.  BZ2_mtfShift16 reads
+     and rewrites p[0 .. 16] whatever n is, so a table
+     needs one byte past the last list it shifts.
+     Build with -DBZ_SCALAR_MTF for the byte loops.
+     Each file uses only some of them, hence unused. --*/
+
+#if !defined(BZ_SCALAR_MTF) && defined(__SSE2__)
+#define BZ_SIMD_MTF
+#include <emmintrin.h>
+
+#define BZ_MTF_COPY16(dst,src)                             \
+   _mm_storeu_si128 ( (__m128i*)(dst),                     \
+                      _mm_loadu_si128 ( (const __m128i*)(src) ) )
+
+/* Index of the first c in yy, which must hold one */
+static __inline__ __attribute__((unused))
+Int32 BZ2_mtfFind ( const UChar* yy, UChar c )
+{
+   __m128i cc = _mm_set1_epi8 ( (char)c );
+   Int32   i, m;
+   for (i = 0; ; i += 16) {
+      m = _mm_movemask_epi8 ( _mm_cmpeq_epi8 (
+             _mm_loadu_si128 ( (const __m128i*)(yy + i) ), cc ) );
+      if (m != 0) return i + __builtin_ctz ( m );
+   }
+}
+
+/* p[0 .. n-1] to p[1 .. n], 0 <= n <= 16 */
+static __inline__ __attribute__((unused))
+void BZ2_mtfShift16 ( UChar* p, Int32 n )
+{
+   __m128i v = _mm_loadu_si128 ( (const __m128i*)p );
+   __m128i w = _mm_loadu_si128 ( (const __m128i*)(p + 1) );
+   __m128i m = _mm_cmplt_epi8 ( _mm_setr_epi8 ( 0, 1, 2, 3, 4, 5, 6, 7,
+                                                8, 9, 10, 11, 12, 13, 14, 15 ),
+                                _mm_set1_epi8 ( (char)n ) );
+   _mm_storeu_si128 ( (__m128i*)(p + 1),
+                      _mm_or_si128 ( _mm_and_si128 ( m, v ),
+                                     _mm_andnot_si128 ( m, w ) ) );
+}
+
+#elif !defined(BZ_SCALAR_MTF) && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+#define BZ_SIMD_MTF
+#include <arm_neon.h>
+
+#define BZ_MTF_COPY16(dst,src)                             \
+   vst1q_u8 ( (dst), vld1q_u8 ( (src) ) )
+
+static __inline__ __attribute__((unused))
+Int32 BZ2_mtfFind ( const UChar* yy, UChar c )
+{
+   /* No movemask: weight the lanes by bit, add pairwise */
+   static const UChar bit[16] = { 1, 2, 4, 8, 16, 32, 64, 128,
+                                  1, 2, 4, 8, 16, 32, 64, 128 };
+   uint8x16_t cc = vdupq_n_u8 ( c );
+   uint8x16_t bb = vld1q_u8 ( bit );
+   uint8x8_t  q;
+   Int32      i, m;
+   for (i = 0; ; i += 16) {
+      uint8x16_t e = vandq_u8 ( vceqq_u8 ( vld1q_u8 ( yy + i ), cc ), bb );
+      q = vpadd_u8 ( vget_low_u8 ( e ), vget_high_u8 ( e ) );
+      q = vpadd_u8 ( q, q );
+      q = vpadd_u8 ( q, q );
+      m = vget_lane_u8 ( q, 0 ) | (vget_lane_u8 ( q, 1 ) << 8);
+      if (m != 0) return i + __builtin_ctz ( m );
+   }
+}
+
+static __inline__ __attribute__((unused))
+void BZ2_mtfShift16 ( UChar* p, Int32 n )
+{
+   static const UChar lane[16] = { 0, 1, 2, 3, 4, 5, 6, 7,
+                                   8, 9, 10, 11, 12, 13, 14, 15 };
+   uint8x16_t m = vcltq_u8 ( vld1q_u8 ( lane ), vdupq_n_u8 ( (UChar)n ) );
+   vst1q_u8 ( p + 1, vbslq_u8 ( m, vld1q_u8 ( p ), vld1q_u8 ( p + 1 ) ) );
+}
+
+#endif
+
+#ifdef BZ_SIMD_MTF
+/* p[0 .. n-1] to p[1 .. n]: whole 16-byte chunks from
+   the top down, then the rest in one masked step */
+static __inline__ __attribute__((unused))
+void BZ2_mtfShift ( UChar* p, Int32 n )
+{
+   Int32 k;
+   for (k = n - 16; k > 0; k -= 16) BZ_MTF_COPY16 ( p + k + 1, p + k );
+   BZ2_mtfShift16 ( p, k + 16 );
+}
+#endif
+
+
+/*-- Vector group costs for sendMTFValues: a row of
+     len_pack (four UInt32s, the 16-bit lengths of tables
+     2k and 2k+1 in each, little-endian as both targets
+     are) is eight 16-bit lanes, one per table, so a single
+     add per symbol scores a group against every table.
+     50 lengths of at most 17 bits fit a lane.  Build with
+     -DBZ_SCALAR_COST for the packed scalar adds. --*/
+
+#if !defined(BZ_SCALAR_COST) && defined(__SSE2__)
+#define BZ_SIMD_COST
+#include <emmintrin.h>
+typedef __m128i BZ_COST_VEC;
+#define BZ_COST_ZERO()         _mm_setzero_si128 ( )
+#define BZ_COST_ADD(acc,row)                                 \
+   acc = _mm_add_epi16 ( acc, _mm_loadu_si128 ( (const __m128i*)(row) ) )
+#define BZ_COST_STORE(dst,acc) _mm_storeu_si128 ( (__m128i*)(dst), acc )
+
+#elif !defined(BZ_SCALAR_COST) && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+#define BZ_SIMD_COST
+#include <arm_neon.h>
+typedef uint16x8_t BZ_COST_VEC;
+#define BZ_COST_ZERO()         vdupq_n_u16 ( 0 )
+#define BZ_COST_ADD(acc,row)                                 \
+   acc = vaddq_u16 ( acc, vld1q_u16 ( (const uint16_t*)(row) ) )
+#define BZ_COST_STORE(dst,acc) vst1q_u16 ( (uint16_t*)(dst), acc )
+#endif
+
+
 
 /*-- Structure holding all the decompression-side stuff. --*/
 
@@ -398,6 +571,7 @@ typedef
 
       /* misc administratium */
       Int32    blockSize100k;
+      Int32    allocSize100k;   /* tt or ll16/ll4 capacity */
       Bool     smallDecompress;
       Int32    currBlockNo;
       Int32    verbosity;
@@ -431,7 +605,7 @@ typedef
       UChar    seqToUnseq[256];
 
       /* for decoding the MTF values */
-      UChar    mtfa   [MTFA_SIZE];
+      UChar    mtfa   [MTFA_SIZE + 1];
       Int32    mtfbase[256 / MTFL_SIZE];
       UChar    selector   [BZ_MAX_SELECTORS];
       UChar    selectorMtf[BZ_MAX_SELECTORS];
@@ -441,6 +615,7 @@ typedef
       Int32    base   [BZ_N_GROUPS][BZ_MAX_ALPHA_SIZE];
       Int32    perm   [BZ_N_GROUPS][BZ_MAX_ALPHA_SIZE];
       Int32    minLens[BZ_N_GROUPS];
+      UInt16   fast   [BZ_N_GROUPS][1 << BZ_HUFF_FAST_BITS];
 
       /* save area for scalars in the main decompress code */
       Int32    save_i;
@@ -516,7 +691,7 @@ extern Int32
 BZ2_decompress ( DState* );
 
 extern void 
-BZ2_hbCreateDecodeTables ( Int32*, Int32*, Int32*, UChar*,
+BZ2_hbCreateDecodeTables ( Int32*, Int32*, Int32*, UInt16*, UChar*,
                            Int32,  Int32, Int32 );
 
 
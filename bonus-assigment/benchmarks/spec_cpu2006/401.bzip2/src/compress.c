@@ -202,7 +202,7 @@ void generateMTFValues ( EState* s )
 
    wr = 0;
    zPend = 0;
-   for (i = 0; i < s->nInUse; i++) yy[i] = (UChar) i;
+   for (i = 0; i < 256; i++) yy[i] = (UChar) i;
 
    for (i = 0; i < s->nblock; i++) {
       UChar ll_i;
@@ -230,6 +230,12 @@ void generateMTFValues ( EState* s )
             };
             zPend = 0;
          }
+#ifdef BZ_SIMD_MTF
+         j = BZ2_mtfFind ( yy, ll_i );
+         BZ2_mtfShift ( yy, j );
+         yy[0] = ll_i;
+         mtfv[wr] = j+1; wr++; s->mtfFreq[j+1]++;
+#else
          {
             register UChar  rtmp;
             register UChar* ryy_j;
@@ -249,6 +255,7 @@ void generateMTFValues ( EState* s )
             j = ryy_j - &(yy[0]);
             mtfv[wr] = j+1; wr++; s->mtfFreq[j+1]++;
          }
+#endif
 
       }
    }
@@ -375,6 +382,15 @@ void sendMTFValues ( EState* s )
         Set up an auxiliary length table which is used to fast-track
 	the common case (nGroups == 6). 
       ---*/
+#ifdef BZ_SIMD_COST
+      /*-- With vector costs, any nGroups: the tables past
+           nGroups are zero lanes --*/
+      for (v = 0; v < alphaSize; v++)
+         for (t = 0; t < 4; t++)
+            s->len_pack[v][t] =
+               (2*t+1 < nGroups ? s->len[2*t+1][v] << 16 : 0) |
+               (2*t   < nGroups ? s->len[2*t  ][v]       : 0);
+#else
       if (nGroups == 6) {
          for (v = 0; v < alphaSize; v++) {
             s->len_pack[v][0] = (s->len[1][v] << 16) | s->len[0][v];
@@ -382,6 +398,7 @@ void sendMTFValues ( EState* s )
             s->len_pack[v][2] = (s->len[5][v] << 16) | s->len[4][v];
 	 }
       }
+#endif
 
       nSelectors = 0;
       totc = 0;
@@ -399,6 +416,17 @@ void sendMTFValues ( EState* s )
          --*/
          for (t = 0; t < nGroups; t++) cost[t] = 0;
 
+#ifdef BZ_SIMD_COST
+         if (50 == ge-gs+1) {
+            /*--- every table at once, one add per symbol ---*/
+            BZ_COST_VEC acc = BZ_COST_ZERO ( );
+            UInt16      lane[8];
+            for (i = 0; i < 50; i++)
+               BZ_COST_ADD ( acc, s->len_pack[mtfv[gs+i]] );
+            BZ_COST_STORE ( lane, acc );
+            for (t = 0; t < nGroups; t++) cost[t] = lane[t];
+         } else
+#endif
          if (nGroups == 6 && 50 == ge-gs+1) {
             /*--- fast track the common case ---*/
             register UInt32 cost01, cost23, cost45;
@@ -673,6 +701,7 @@ void BZ2_compressBlock ( EState* s, Bool is_last_block )
 
    if (s->nblock > 0) {
 
+      if (s->index != NULL) BZ2_indexBlock ( s, False );
       bsPutUChar ( s, 0x31 ); bsPutUChar ( s, 0x41 );
       bsPutUChar ( s, 0x59 ); bsPutUChar ( s, 0x26 );
       bsPutUChar ( s, 0x53 ); bsPutUChar ( s, 0x59 );
@@ -700,6 +729,7 @@ void BZ2_compressBlock ( EState* s, Bool is_last_block )
    /*-- If this is the last block, add the stream trailer. --*/
    if (is_last_block) {
 
+      if (s->index != NULL) BZ2_indexBlock ( s, True );
       bsPutUChar ( s, 0x17 ); bsPutUChar ( s, 0x72 );
       bsPutUChar ( s, 0x45 ); bsPutUChar ( s, 0x38 );
       bsPutUChar ( s, 0x50 ); bsPutUChar ( s, 0x90 );
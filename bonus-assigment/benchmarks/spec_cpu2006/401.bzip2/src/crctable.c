@@ -139,6 +139,309 @@ UInt32 BZ2_crc32Table[256] = {
 };
 
 
+/*-------------------------------------------------------------*/
+/*--- Whole-buffer CRC updates                              ---*/
+/*-------------------------------------------------------------*/
+
+/*--
+  BZ2_crc32Table does one byte per dependent lookup.  Where a
+  whole buffer is at hand (block input in copy_input_until_stop,
+  fast-path output in unRLE_obuf_to_output_FAST) these go faster:
+
+     slice-by-8/16: T[k][b] is the CRC of b followed by k zero
+        bytes, so a group of 8 or 16 bytes costs 8 or 16
+        independent lookups and one dependent step;
+
+     carry-less multiply (x86 PCLMULQDQ, AArch64 PMULL): the
+        buffer is read as one big-endian polynomial and folded,
+        64 bytes a step, into a 128-bit residue congruent to it
+        mod P.  Its CRC (from zero) is then the whole buffer's,
+        since CRC(M) = M * x^32 mod P once the incoming CRC is
+        xor'ed into M's first four bytes.
+
+  BZ2_crcUpdate is pointed at the fastest one this CPU runs
+  before main (GCC constructor); BZ2_bzSetCrcImpl overrides it.
+--*/
+
+#if !defined(BZ_NO_CLMUL) && defined(__GNUC__) && \
+    (defined(__x86_64__) || defined(__i386__))
+#  define BZ_CRC_PCLMUL
+#  include <cpuid.h>
+#  include <immintrin.h>
+#elif !defined(BZ_NO_CLMUL) && defined(__GNUC__) && \
+      defined(__aarch64__) && defined(__linux__)
+#  define BZ_CRC_PMULL
+#  include <arm_neon.h>
+#  include <sys/auxv.h>
+#  ifndef HWCAP_PMULL
+#     define HWCAP_PMULL (1 << 4)
+#  endif
+#endif
+
+typedef unsigned long long CrcU64;
+
+static UInt32 crcSlice[16][256];
+static Bool   crcReady = False;
+#if defined(BZ_CRC_PCLMUL) || defined(BZ_CRC_PMULL)
+static Bool   crcHaveClmul = False;
+#endif
+
+/* x^n mod P for the fold constants */
+static CrcU64 crcK576, crcK512, crcK192, crcK128;
+
+
+/*---------------------------------------------*/
+static
+UInt32 crcBytes ( UInt32 crc, const UChar* p, Int32 n )
+{
+   for (; n > 0; n--, p++) BZ_UPDATE_CRC ( crc, *p );
+   return crc;
+}
+
+
+/*---------------------------------------------*/
+#define CRC_BE32(p)                                  \
+   (((UInt32)(p)[0] << 24) | ((UInt32)(p)[1] << 16) | \
+    ((UInt32)(p)[2] << 8)  |  (UInt32)(p)[3])
+
+#define CRC_SLICE4(crc,t)                            \
+   (crcSlice[(t)+3][(crc) >> 24]         ^          \
+    crcSlice[(t)+2][((crc) >> 16) & 0xff] ^          \
+    crcSlice[(t)+1][((crc) >> 8) & 0xff]  ^          \
+    crcSlice[(t)][(crc) & 0xff])
+
+static
+UInt32 crcSlice8 ( UInt32 crc, const UChar* p, Int32 n )
+{
+   UInt32 w;
+   for (; n >= 8; n -= 8, p += 8) {
+      crc ^= CRC_BE32 ( p );
+      w    = CRC_BE32 ( p + 4 );
+      crc  = CRC_SLICE4 ( crc, 4 ) ^ CRC_SLICE4 ( w, 0 );
+   }
+   return crcBytes ( crc, p, n );
+}
+
+
+/*---------------------------------------------*/
+static
+UInt32 crcSlice16 ( UInt32 crc, const UChar* p, Int32 n )
+{
+   UInt32 w1, w2, w3;
+   for (; n >= 16; n -= 16, p += 16) {
+      crc ^= CRC_BE32 ( p );
+      w1   = CRC_BE32 ( p + 4 );
+      w2   = CRC_BE32 ( p + 8 );
+      w3   = CRC_BE32 ( p + 12 );
+      crc  = CRC_SLICE4 ( crc, 12 ) ^ CRC_SLICE4 ( w1, 8 ) ^
+             CRC_SLICE4 ( w2, 4 )   ^ CRC_SLICE4 ( w3, 0 );
+   }
+   return crcBytes ( crc, p, n );
+}
+
+
+#ifdef BZ_CRC_PCLMUL
+/*---------------------------------------------*/
+/* x * (x^(m+64) mod P, x^m mod P) + d: x times x^m, mod P,
+   plus the next 16 bytes; k holds (hi const, lo const) */
+__attribute__((target("pclmul,ssse3")))
+static __inline__
+__m128i crcFold ( __m128i x, __m128i k, __m128i d )
+{
+   return _mm_xor_si128 ( _mm_xor_si128 ( _mm_clmulepi64_si128 ( x, k, 0x01 ),
+                                          _mm_clmulepi64_si128 ( x, k, 0x10 ) ),
+                          d );
+}
+
+#define CRC_LOAD(p)                                              \
+   _mm_shuffle_epi8 ( _mm_loadu_si128 ( (const __m128i*)(p) ), rev )
+
+__attribute__((target("pclmul,ssse3")))
+static
+UInt32 crcClmul ( UInt32 crc, const UChar* p, Int32 n )
+{
+   const __m128i rev = _mm_set_epi8 ( 0, 1, 2, 3, 4, 5, 6, 7,
+                                      8, 9, 10, 11, 12, 13, 14, 15 );
+   __m128i k, x0, x1, x2, x3;
+   UChar   last[16];
+
+   if (n < 64) return crcSlice16 ( crc, p, n );
+
+   x0 = _mm_xor_si128 ( CRC_LOAD ( p ), _mm_set_epi32 ( (int)crc, 0, 0, 0 ) );
+   x1 = CRC_LOAD ( p + 16 );
+   x2 = CRC_LOAD ( p + 32 );
+   x3 = CRC_LOAD ( p + 48 );
+   p += 64; n -= 64;
+
+   k = _mm_set_epi64x ( (long long)crcK512, (long long)crcK576 );
+   for (; n >= 64; n -= 64, p += 64) {
+      x0 = crcFold ( x0, k, CRC_LOAD ( p ) );
+      x1 = crcFold ( x1, k, CRC_LOAD ( p + 16 ) );
+      x2 = crcFold ( x2, k, CRC_LOAD ( p + 32 ) );
+      x3 = crcFold ( x3, k, CRC_LOAD ( p + 48 ) );
+   }
+
+   k  = _mm_set_epi64x ( (long long)crcK128, (long long)crcK192 );
+   x1 = crcFold ( x0, k, x1 );
+   x2 = crcFold ( x1, k, x2 );
+   x3 = crcFold ( x2, k, x3 );
+   for (; n >= 16; n -= 16, p += 16)
+      x3 = crcFold ( x3, k, CRC_LOAD ( p ) );
+
+   _mm_storeu_si128 ( (__m128i*)last, _mm_shuffle_epi8 ( x3, rev ) );
+   crc = crcSlice16 ( 0, last, 16 );
+   return crcSlice16 ( crc, p, n );
+}
+
+#undef CRC_LOAD
+
+static
+Bool crcCpuClmul ( void )
+{
+   unsigned int a, b, c, d;
+   if (!__get_cpuid ( 1, &a, &b, &c, &d )) return False;
+   return (c & bit_PCLMUL) && (c & bit_SSSE3);
+}
+#endif
+
+
+#ifdef BZ_CRC_PMULL
+/*---------------------------------------------*/
+/* As the x86 version; lane 1 is the high 64 bits */
+__attribute__((target("+crypto")))
+static __inline__
+uint64x2_t crcFold ( uint64x2_t x, CrcU64 khi, CrcU64 klo, uint64x2_t d )
+{
+   poly128_t h = vmull_p64 ( (poly64_t)vgetq_lane_u64 ( x, 1 ), (poly64_t)khi );
+   poly128_t l = vmull_p64 ( (poly64_t)vgetq_lane_u64 ( x, 0 ), (poly64_t)klo );
+   return veorq_u64 ( veorq_u64 ( vreinterpretq_u64_p128 ( h ),
+                                  vreinterpretq_u64_p128 ( l ) ), d );
+}
+
+/* 16 bytes as one big-endian 128-bit value, and back */
+static __inline__
+uint8x16_t crcRev ( uint8x16_t v )
+{
+   v = vrev64q_u8 ( v );
+   return vextq_u8 ( v, v, 8 );
+}
+
+#define CRC_LOAD(p) vreinterpretq_u64_u8 ( crcRev ( vld1q_u8 ( (p) ) ) )
+
+__attribute__((target("+crypto")))
+static
+UInt32 crcClmul ( UInt32 crc, const UChar* p, Int32 n )
+{
+   uint64x2_t x0, x1, x2, x3;
+   UChar      last[16];
+
+   if (n < 64) return crcSlice16 ( crc, p, n );
+
+   x0 = veorq_u64 ( CRC_LOAD ( p ),
+                    vcombine_u64 ( vcreate_u64 ( 0 ),
+                                   vcreate_u64 ( (CrcU64)crc << 32 ) ) );
+   x1 = CRC_LOAD ( p + 16 );
+   x2 = CRC_LOAD ( p + 32 );
+   x3 = CRC_LOAD ( p + 48 );
+   p += 64; n -= 64;
+
+   for (; n >= 64; n -= 64, p += 64) {
+      x0 = crcFold ( x0, crcK576, crcK512, CRC_LOAD ( p ) );
+      x1 = crcFold ( x1, crcK576, crcK512, CRC_LOAD ( p + 16 ) );
+      x2 = crcFold ( x2, crcK576, crcK512, CRC_LOAD ( p + 32 ) );
+      x3 = crcFold ( x3, crcK576, crcK512, CRC_LOAD ( p + 48 ) );
+   }
+
+   x1 = crcFold ( x0, crcK192, crcK128, x1 );
+   x2 = crcFold ( x1, crcK192, crcK128, x2 );
+   x3 = crcFold ( x2, crcK192, crcK128, x3 );
+   for (; n >= 16; n -= 16, p += 16)
+      x3 = crcFold ( x3, crcK192, crcK128, CRC_LOAD ( p ) );
+
+   vst1q_u8 ( last, crcRev ( vreinterpretq_u8_u64 ( x3 ) ) );
+   crc = crcSlice16 ( 0, last, 16 );
+   return crcSlice16 ( crc, p, n );
+}
+
+#undef CRC_LOAD
+
+static
+Bool crcCpuClmul ( void )
+{
+   return (getauxval ( AT_HWCAP ) & HWCAP_PMULL) != 0;
+}
+#endif
+
+
+/*---------------------------------------------*/
+static
+CrcU64 crcXPowMod ( Int32 n )
+{
+   CrcU64 r = 1;
+   for (; n > 0; n--) {
+      r <<= 1;
+      if (r & 0x100000000ULL) r ^= 0x104c11db7ULL;
+   }
+   return r;
+}
+
+UInt32 (*BZ2_crcUpdate) ( UInt32 crc, const UChar* p, Int32 n ) = crcBytes;
+
+#ifdef __GNUC__
+__attribute__((constructor))
+#endif
+static
+void crcInit ( void )
+{
+   Int32 i, k;
+
+   if (crcReady) return;
+   for (i = 0; i < 256; i++) crcSlice[0][i] = BZ2_crc32Table[i];
+   for (k = 1; k < 16; k++)
+      for (i = 0; i < 256; i++)
+         crcSlice[k][i] = (crcSlice[k-1][i] << 8) ^
+                          BZ2_crc32Table[crcSlice[k-1][i] >> 24];
+   crcK576 = crcXPowMod ( 576 );
+   crcK512 = crcXPowMod ( 512 );
+   crcK192 = crcXPowMod ( 192 );
+   crcK128 = crcXPowMod ( 128 );
+
+   BZ2_crcUpdate = crcSlice16;
+#  if defined(BZ_CRC_PCLMUL) || defined(BZ_CRC_PMULL)
+   crcHaveClmul = crcCpuClmul ( );
+   if (crcHaveClmul) BZ2_crcUpdate = crcClmul;
+#  endif
+   crcReady = True;
+}
+
+
+/*---------------------------------------------*/
+/*-- Like BZ2_bzSetBlockSorter: call it before starting any
+     threads.  BZ_PARAM_ERROR if this CPU (or build) lacks
+     the one asked for. --*/
+int BZ_API(BZ2_bzSetCrcImpl) ( int impl )
+{
+   UInt32 (*f) ( UInt32, const UChar*, Int32 );
+
+   crcInit ( );
+   switch (impl) {
+      case BZ_CRC_AUTO:    crcReady = False; crcInit ( ); return BZ_OK;
+      case BZ_CRC_TABLE:   f = crcBytes;   break;
+      case BZ_CRC_SLICE8:  f = crcSlice8;  break;
+      case BZ_CRC_SLICE16: f = crcSlice16; break;
+#     if defined(BZ_CRC_PCLMUL) || defined(BZ_CRC_PMULL)
+      case BZ_CRC_CLMUL:
+         if (!crcHaveClmul) return BZ_PARAM_ERROR;
+         f = crcClmul;
+         break;
+#     endif
+      default:             return BZ_PARAM_ERROR;
+   }
+   BZ2_crcUpdate = f;
+   return BZ_OK;
+}
+
+
 /*-------------------------------------------------------------*/
 /*--- end                                        crctable.c ---*/
 /*-------------------------------------------------------------*/
@@ -107,6 +107,26 @@ void makeMaps_d ( DState* s )
 #define GET_UCHAR(lll,uuu)                        \
    GET_BITS(lll,uuu,8)
 
+/*-- Top the bit buffer up to 25+ bits, enough for the
+     fast table or any whole code.  Never suspends; at
+     most 4 bytes are read ahead, and the stream always
+     has more than that (the 80-bit trailer) after the
+     last code, so no unused input is swallowed. --*/
+#define FILL_BITS                                 \
+   while (s->bsLive <= 24 &&                      \
+          s->strm->avail_in > 0) {                \
+      s->bsBuff                                   \
+         = (s->bsBuff << 8) |                     \
+           ((UInt32)                              \
+              (*((UChar*)(s->strm->next_in))));   \
+      s->bsLive += 8;                             \
+      s->strm->next_in++;                         \
+      s->strm->avail_in--;                        \
+      s->strm->total_in_lo32++;                   \
+      if (s->strm->total_in_lo32 == 0)            \
+         s->strm->total_in_hi32++;                \
+   }
+
 #define GET_BIT(lll,uuu)                          \
    GET_BITS(lll,uuu,1)
 
@@ -125,6 +145,15 @@ void makeMaps_d ( DState* s )
       gBase = &(s->base[gSel][0]);                \
    }                                              \
    groupPos--;                                    \
+   FILL_BITS;                                     \
+   if (s->bsLive >= BZ_HUFF_FAST_BITS &&          \
+       (zf = s->fast[gSel][(s->bsBuff >>          \
+          (s->bsLive - BZ_HUFF_FAST_BITS))        \
+          & ((1 << BZ_HUFF_FAST_BITS) - 1)])      \
+       != 0) {                                    \
+      s->bsLive -= zf & 31;                       \
+      lval = zf >> 5;                             \
+   } else {                                       \
    zn = gMinlen;                                  \
    GET_BITS(label1, zvec, zn);                    \
    while (1) {                                    \
@@ -139,6 +168,7 @@ void makeMaps_d ( DState* s )
        || zvec - gBase[zn] >= BZ_MAX_ALPHA_SIZE)  \
       RETURN(BZ_DATA_ERROR);                      \
    lval = gPerm[zvec - gBase[zn]];                \
+   }                                              \
 }
 
 
@@ -176,6 +206,9 @@ Int32 BZ2_decompress ( DState* s )
    Int32* gBase;
    Int32* gPerm;
 
+   /* not saved: only live inside one GET_MTF_VAL */
+   UInt16 zf;
+
    if (s->state == BZ_X_MAGIC_1) {
       /*initialise the save area*/
       s->save_i           = 0;
@@ -248,15 +281,24 @@ Int32 BZ2_decompress ( DState* s )
           s->blockSize100k > (BZ_HDR_0 + 9)) RETURN(BZ_DATA_ERROR_MAGIC);
       s->blockSize100k -= BZ_HDR_0;
 
-      if (s->smallDecompress) {
-         s->ll16 = BZALLOC( s->blockSize100k * 100000 * sizeof(UInt16) );
-         s->ll4  = BZALLOC( 
-                      ((1 + s->blockSize100k * 100000) >> 1) * sizeof(UChar) 
-                   );
-         if (s->ll16 == NULL || s->ll4 == NULL) RETURN(BZ_MEM_ERROR);
-      } else {
-         s->tt  = BZALLOC( s->blockSize100k * 100000 * sizeof(Int32) );
-         if (s->tt == NULL) RETURN(BZ_MEM_ERROR);
+      /* A reset stream keeps its arrays; regrow only if too small */
+      if (s->blockSize100k > s->allocSize100k) {
+         if (s->ll16 != NULL) BZFREE(s->ll16);
+         if (s->ll4  != NULL) BZFREE(s->ll4);
+         if (s->tt   != NULL) BZFREE(s->tt);
+         s->ll16 = NULL; s->ll4 = NULL; s->tt = NULL;
+         s->allocSize100k = 0;
+         if (s->smallDecompress) {
+            s->ll16 = BZALLOC( s->blockSize100k * 100000 * sizeof(UInt16) );
+            s->ll4  = BZALLOC( 
+                         ((1 + s->blockSize100k * 100000) >> 1) * sizeof(UChar) 
+                      );
+            if (s->ll16 == NULL || s->ll4 == NULL) RETURN(BZ_MEM_ERROR);
+         } else {
+            s->tt  = BZALLOC( s->blockSize100k * 100000 * sizeof(Int32) );
+            if (s->tt == NULL) RETURN(BZ_MEM_ERROR);
+         }
+         s->allocSize100k = s->blockSize100k;
       }
 
       GET_UCHAR(BZ_X_BLKHDR_1, uc);
@@ -380,6 +422,7 @@ Int32 BZ2_decompress ( DState* s )
             &(s->limit[t][0]), 
             &(s->base[t][0]), 
             &(s->perm[t][0]), 
+            &(s->fast[t][0]),
             &(s->len[t][0]),
             minLen, maxLen, alphaSize
          );
@@ -463,6 +506,9 @@ Int32 BZ2_decompress ( DState* s )
                   /* avoid general-case expense */
                   pp = s->mtfbase[0];
                   uc = s->mtfa[pp+nn];
+#ifdef BZ_SIMD_MTF
+                  BZ2_mtfShift16 ( &(s->mtfa[pp]), nn );
+#else
                   while (nn > 3) {
                      Int32 z = pp+nn;
                      s->mtfa[(z)  ] = s->mtfa[(z)-1];
@@ -474,6 +520,7 @@ Int32 BZ2_decompress ( DState* s )
                   while (nn > 0) { 
                      s->mtfa[(pp+nn)] = s->mtfa[(pp+nn)-1]; nn--; 
                   };
+#endif
                   s->mtfa[pp] = uc;
                } else { 
                   /* general case */
@@ -481,9 +528,13 @@ Int32 BZ2_decompress ( DState* s )
                   off = nn % MTFL_SIZE;
                   pp = s->mtfbase[lno] + off;
                   uc = s->mtfa[pp];
+#ifdef BZ_SIMD_MTF
+                  BZ2_mtfShift16 ( &(s->mtfa[s->mtfbase[lno]]), off );
+#else
                   while (pp > s->mtfbase[lno]) { 
                      s->mtfa[pp] = s->mtfa[pp-1]; pp--; 
                   };
+#endif
                   s->mtfbase[lno]++;
                   while (lno > 0) {
                      s->mtfbase[lno]--;
@@ -210,6 +210,7 @@ void BZ2_hbAssignCodes ( Int32 *code,
 void BZ2_hbCreateDecodeTables ( Int32 *limit,
                                 Int32 *base,
                                 Int32 *perm,
+                                UInt16 *fast,
                                 UChar *length,
                                 Int32 minLen,
                                 Int32 maxLen,
@@ -237,6 +238,25 @@ void BZ2_hbCreateDecodeTables ( Int32 *limit,
    }
    for (i = minLen + 1; i <= maxLen; i++)
       base[i] = ((limit[i-1] + 1) << 1) - base[i];
+
+   /*-- Each BZ_HUFF_FAST_BITS-bit window whose leading
+        code fits in it maps to (symbol << 5) | length,
+        found by the same limit/base/perm walk the
+        bit-by-bit decoder does.  0 sends the decoder the
+        slow way, which also reports any bad code. --*/
+   for (pp = 0; pp < (1 << BZ_HUFF_FAST_BITS); pp++) {
+      fast[pp] = 0;
+      for (i = minLen; i <= BZ_HUFF_FAST_BITS; i++) {
+         vec = pp >> (BZ_HUFF_FAST_BITS - i);
+         if (vec <= limit[i]) {
+            j = vec - base[i];
+            if (j >= 0 && j < BZ_MAX_ALPHA_SIZE &&
+                perm[j] >= 0 && perm[j] < BZ_MAX_ALPHA_SIZE)
+               fast[pp] = (UInt16)((perm[j] << 5) | i);
+            break;
+         }
+      }
+   }
 }
 
 
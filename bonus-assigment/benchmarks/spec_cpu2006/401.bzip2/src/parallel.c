@@ -0,0 +1,780 @@
+/*-------------------------------------------------------------*/
+/*--- Block-parallel compression and decompression         ---*/
+/*---                                            parallel.c ---*/
+/*-------------------------------------------------------------*/
+
+/*--
+  Each bzip2 block is sorted and entropy-coded independently of the
+  others; only the run-length front end (which decides where a
+  block ends) and the bit stream (which packs the blocks back to
+  back, with no byte alignment between them) are sequential.  So:
+
+     reader  (the calling thread) fills each block's EState with
+             BZ2_blockFill, carrying the pending run from block to
+             block exactly as BZ2_bzCompress does;
+     workers sort and code the blocks (BZ2_compressBlock), each
+             into its own zbits, starting at bit 0;
+     writer  takes the coded blocks in order, shifts each one to
+             the current bit position of the output, folds the
+             block CRCs into the combined CRC, and finally writes
+             the stream trailer.
+
+  The output is bit-identical to compressStream's for the same
+  blockSize100k and workFactor.  Blocks live in a ring of
+  BZ_PAR_JOBS_PER_THREAD * nThreads EStates, so memory is bounded
+  by the blocks in flight, not by the input.
+
+  Decompression (BZ2_bzParDecompressBuf, further down) works on a
+  compressed stream already in memory, as the spec harness keeps
+  it: the blocks are located by their magic, decoded on a pool and
+  written in order.
+
+  Built only with -DBZ_PARALLEL (and -pthread).
+--*/
+
+#ifdef BZ_PARALLEL
+
+#include <pthread.h>
+#include <unistd.h>
+#include "bzlib_private.h"
+#include "spec.h"
+
+#define BZ_PAR_JOBS_PER_THREAD 2
+#define BZ_PAR_INBUF  65536
+#define BZ_PAR_OUTBUF 65536
+
+#if defined(SPEC_CPU)
+typedef int   ParFile;
+#else
+typedef FILE* ParFile;
+#endif
+
+typedef
+   struct {
+      bz_stream strm;
+      EState*   s;
+      Bool      last;
+      Bool      done;
+   }
+   ParJob;
+
+typedef
+   struct {
+      ParJob*         jobs;
+      Int32           nJobs;
+      Int32           nFilled;     /* blocks handed to the workers */
+      Int32           nTaken;      /* blocks a worker has started */
+      Int32           nWritten;    /* blocks spliced into the output */
+      Int32           nLast;       /* number of blocks, once known */
+      Bool            ioError;
+
+      pthread_mutex_t mutex;
+      pthread_cond_t  cvFilled;
+      pthread_cond_t  cvDone;
+      pthread_cond_t  cvFree;
+
+      ParFile         zStream;
+      UChar           obuf[BZ_PAR_OUTBUF];
+      Int32           nObuf;
+      UInt32          bsBuff;      /* bits not yet in obuf, MSB first */
+      Int32           bsLive;
+      UInt32          combinedCRC;
+   }
+   ParState;
+
+
+/*---------------------------------------------------*/
+/*--- The writer: bit-splicing the coded blocks   ---*/
+/*---------------------------------------------------*/
+
+/*---------------------------------------------------*/
+static
+void par_flushOut ( ParState* p )
+{
+   if (p->nObuf > 0 &&
+       fwrite ( p->obuf, sizeof(UChar), p->nObuf, p->zStream ) != p->nObuf)
+      p->ioError = True;
+   p->nObuf = 0;
+}
+
+
+/*---------------------------------------------------*/
+static
+void par_putByte ( ParState* p, UChar c )
+{
+   if (p->nObuf == BZ_PAR_OUTBUF) par_flushOut ( p );
+   p->obuf[p->nObuf++] = c;
+}
+
+
+/*---------------------------------------------------*/
+/*-- Same contract as compress.c's bsW: n <= 24 --*/
+static
+void par_putBits ( ParState* p, Int32 n, UInt32 v )
+{
+   while (p->bsLive >= 8) {
+      par_putByte ( p, (UChar)(p->bsBuff >> 24) );
+      p->bsBuff <<= 8;
+      p->bsLive -= 8;
+   }
+   p->bsBuff |= (v << (32 - p->bsLive - n));
+   p->bsLive += n;
+}
+
+
+/*---------------------------------------------------*/
+/*-- Append a whole block: numZ bytes of zbits, then the
+     bsLive bits still in its bit buffer. --*/
+static
+void par_spliceBlock ( ParState* p, EState* s )
+{
+   Int32  i, sh;
+   UInt32 hi;
+
+   while (p->bsLive >= 8) {
+      par_putByte ( p, (UChar)(p->bsBuff >> 24) );
+      p->bsBuff <<= 8;
+      p->bsLive -= 8;
+   }
+
+   if (p->bsLive == 0) {
+      /*-- byte aligned: the block's bytes go out as they are --*/
+      par_flushOut ( p );
+      if (s->numZ > 0 &&
+          fwrite ( s->zbits, sizeof(UChar), s->numZ, p->zStream ) != s->numZ)
+         p->ioError = True;
+   } else {
+      /*-- each output byte is the tail of one block byte and
+           the head of the next --*/
+      sh = p->bsLive;
+      hi = p->bsBuff >> 24;
+      for (i = 0; i < s->numZ; i++) {
+         par_putByte ( p, (UChar)(hi | (s->zbits[i] >> sh)) );
+         hi = ((UInt32)s->zbits[i] << (8 - sh)) & 0xff;
+      }
+      p->bsBuff = hi << 24;
+   }
+
+   while (s->bsLive >= 8) {
+      par_putBits ( p, 8, s->bsBuff >> 24 );
+      s->bsBuff <<= 8;
+      s->bsLive -= 8;
+   }
+   if (s->bsLive > 0)
+      par_putBits ( p, s->bsLive, s->bsBuff >> (32 - s->bsLive) );
+}
+
+
+/*---------------------------------------------------*/
+static
+void par_putTrailer ( ParState* p )
+{
+   par_putBits ( p, 8, 0x17 ); par_putBits ( p, 8, 0x72 );
+   par_putBits ( p, 8, 0x45 ); par_putBits ( p, 8, 0x38 );
+   par_putBits ( p, 8, 0x50 ); par_putBits ( p, 8, 0x90 );
+   par_putBits ( p, 16, p->combinedCRC >> 16 );
+   par_putBits ( p, 16, p->combinedCRC & 0xffff );
+   while (p->bsLive > 0) {
+      par_putByte ( p, (UChar)(p->bsBuff >> 24) );
+      p->bsBuff <<= 8;
+      p->bsLive -= 8;
+   }
+   par_flushOut ( p );
+}
+
+
+/*---------------------------------------------------*/
+static
+void* par_writer ( void* arg )
+{
+   ParState* p = (ParState*)arg;
+   ParJob*   job;
+   Int32     seq;
+   Bool      last;
+
+   for (seq = 0; ; seq++) {
+      job = &p->jobs[seq % p->nJobs];
+      pthread_mutex_lock ( &p->mutex );
+      while (!job->done) pthread_cond_wait ( &p->cvDone, &p->mutex );
+      pthread_mutex_unlock ( &p->mutex );
+
+      if (job->s->nblock > 0) {
+         p->combinedCRC = (p->combinedCRC << 1) | (p->combinedCRC >> 31);
+         p->combinedCRC ^= job->s->blockCRC;
+      }
+      par_spliceBlock ( p, job->s );
+      if (job->last) par_putTrailer ( p );
+
+      pthread_mutex_lock ( &p->mutex );
+      last = job->last;
+      job->done = False;
+      p->nWritten = seq + 1;
+      pthread_cond_signal ( &p->cvFree );
+      pthread_mutex_unlock ( &p->mutex );
+      if (last) break;
+   }
+   return NULL;
+}
+
+
+/*---------------------------------------------------*/
+/*--- The workers                                 ---*/
+/*---------------------------------------------------*/
+
+/*---------------------------------------------------*/
+static
+void* par_worker ( void* arg )
+{
+   ParState* p = (ParState*)arg;
+   ParJob*   job;
+   Int32     seq;
+
+   while (True) {
+      pthread_mutex_lock ( &p->mutex );
+      while (p->nTaken == p->nFilled && p->nTaken != p->nLast)
+         pthread_cond_wait ( &p->cvFilled, &p->mutex );
+      if (p->nTaken == p->nLast) {
+         pthread_mutex_unlock ( &p->mutex );
+         return NULL;
+      }
+      seq = p->nTaken++;
+      pthread_mutex_unlock ( &p->mutex );
+
+      /*-- Block 1 writes the stream header itself; every block
+           codes from bit 0, and the stream trailer is the
+           writer's, since only it sees every block CRC. --*/
+      job = &p->jobs[seq % p->nJobs];
+      BZ2_bsInitWrite ( job->s );
+      BZ2_compressBlock ( job->s, False );
+
+      pthread_mutex_lock ( &p->mutex );
+      job->done = True;
+      pthread_cond_broadcast ( &p->cvDone );
+      pthread_mutex_unlock ( &p->mutex );
+   }
+}
+
+
+/*---------------------------------------------------*/
+/*--- The reader                                  ---*/
+/*---------------------------------------------------*/
+
+/*---------------------------------------------------*/
+/*-- Compress all of stream onto zStream with nThreads sorting
+     threads (0 = one per online CPU).  Returns BZ_OK, or
+     BZ_MEM_ERROR / BZ_CONFIG_ERROR before any output if the
+     blocks or threads cannot be set up, or BZ_IO_ERROR. --*/
+int BZ2_bzParCompressStream ( ParFile stream, ParFile zStream,
+                              int blockSize100k, int verbosity,
+                              int workFactor, int nThreads )
+{
+   ParState*  p;
+   ParJob*    job;
+   pthread_t* workers;
+   pthread_t  writer;
+   UChar      ibuf[BZ_PAR_INBUF];
+   Int32      nIbuf = 0, posIbuf = 0;
+   Bool       eof = False, last = False;
+   UInt32     run_ch = 256;
+   Int32      run_len = 0;
+   Int32      i, seq, nStarted, ret;
+
+   if (nThreads <= 0) nThreads = (int)sysconf ( _SC_NPROCESSORS_ONLN );
+   if (nThreads <= 0) nThreads = 1;
+
+   p = calloc ( 1, sizeof(ParState) );
+   workers = calloc ( nThreads, sizeof(pthread_t) );
+   if (p == NULL || workers == NULL) {
+      free ( p ); free ( workers );
+      return BZ_MEM_ERROR;
+   }
+   p->nJobs   = BZ_PAR_JOBS_PER_THREAD * nThreads;
+   p->jobs    = calloc ( p->nJobs, sizeof(ParJob) );
+   p->nLast   = -1;
+   p->zStream = zStream;
+   ret = (p->jobs == NULL) ? BZ_MEM_ERROR : BZ_OK;
+   for (i = 0; ret == BZ_OK && i < p->nJobs; i++) {
+      ret = BZ2_bzCompressInit ( &p->jobs[i].strm, blockSize100k,
+                                 verbosity, workFactor );
+      if (ret == BZ_OK) p->jobs[i].s = p->jobs[i].strm.state;
+   }
+
+   pthread_mutex_init ( &p->mutex, NULL );
+   pthread_cond_init ( &p->cvFilled, NULL );
+   pthread_cond_init ( &p->cvDone, NULL );
+   pthread_cond_init ( &p->cvFree, NULL );
+   nStarted = 0;
+   for (i = 0; ret == BZ_OK && i < nThreads; i++) {
+      if (pthread_create ( &workers[i], NULL, par_worker, p ) != 0) break;
+      nStarted++;
+   }
+   if (ret == BZ_OK &&
+       (nStarted == 0 || pthread_create ( &writer, NULL, par_writer, p ) != 0)) {
+      /*-- no block yet: nLast = 0 sends the workers home --*/
+      pthread_mutex_lock ( &p->mutex );
+      p->nLast = 0;
+      pthread_cond_broadcast ( &p->cvFilled );
+      pthread_mutex_unlock ( &p->mutex );
+      for (i = 0; i < nStarted; i++) pthread_join ( workers[i], NULL );
+      nStarted = 0;
+      ret = BZ_CONFIG_ERROR;
+   }
+
+   for (seq = 0; ret == BZ_OK && !last; seq++) {
+      job = &p->jobs[seq % p->nJobs];
+      pthread_mutex_lock ( &p->mutex );
+      while (seq >= p->nWritten + p->nJobs)
+         pthread_cond_wait ( &p->cvFree, &p->mutex );
+      pthread_mutex_unlock ( &p->mutex );
+
+      BZ2_blockStart ( job->s, run_ch, run_len );
+      job->s->blockNo = seq + 1;
+      while (True) {
+         if (posIbuf == nIbuf && !eof) {
+            nIbuf = fread ( ibuf, sizeof(UChar), BZ_PAR_INBUF, stream );
+            if (nIbuf <= 0) { nIbuf = 0; eof = True; }
+            posIbuf = 0;
+         }
+         posIbuf += BZ2_blockFill ( job->s, ibuf + posIbuf,
+                                    nIbuf - posIbuf, eof );
+         /*-- a full block at the very end still carries its run --*/
+         if (eof && posIbuf == nIbuf && job->s->state_in_len == 0) {
+            last = True;
+            break;
+         }
+         if (job->s->nblock >= job->s->nblockMAX) break;
+      }
+      run_ch  = job->s->state_in_ch;
+      run_len = job->s->state_in_len;
+      job->last = last;
+
+      pthread_mutex_lock ( &p->mutex );
+      p->nFilled = seq + 1;
+      if (last) p->nLast = seq + 1;
+      pthread_cond_broadcast ( &p->cvFilled );
+      pthread_mutex_unlock ( &p->mutex );
+   }
+
+   if (nStarted > 0) {
+      for (i = 0; i < nStarted; i++) pthread_join ( workers[i], NULL );
+      pthread_join ( writer, NULL );
+      if (ret == BZ_OK && p->ioError) ret = BZ_IO_ERROR;
+   }
+
+   pthread_cond_destroy ( &p->cvFree );
+   pthread_cond_destroy ( &p->cvDone );
+   pthread_cond_destroy ( &p->cvFilled );
+   pthread_mutex_destroy ( &p->mutex );
+   for (i = 0; p->jobs != NULL && i < p->nJobs; i++)
+      if (p->jobs[i].s != NULL) BZ2_bzCompressEnd ( &p->jobs[i].strm );
+   free ( p->jobs );
+   free ( workers );
+   free ( p );
+   return ret;
+}
+
+
+/*---------------------------------------------------*/
+/*--- Decompression: scanning for block boundaries ---*/
+/*---------------------------------------------------*/
+
+/*--
+  A compressed stream gives no block lengths, but every block starts
+  with the 48-bit magic 0x314159265359 (pi) at an arbitrary bit
+  offset, and the stream ends with 0x177245385090 (sqrt pi).  One
+  fast pass finds them all; then each block is decoded on its own by
+  handing BZ2_bzDecompress a one-block stream: the original header,
+  the block's bits realigned to a byte, and a trailer whose combined
+  CRC is the block's own.  BZ2_bzDecompress therefore checks the
+  block CRC on the worker, and the writer (the calling thread)
+  checks each stream's combined CRC over the block CRCs in order.
+
+  The pi magic can also occur inside coded data.  A block split at
+  such a false boundary fails to decode, and the writer retries it
+  joined with the following piece(s).  A false sqrt pi is rejected
+  by the scanner, since a real one is followed by the end of the
+  input or by another stream header.
+--*/
+
+#define BZ_PAR_MAGIC_BLOCK 0x314159265359ULL
+#define BZ_PAR_MAGIC_EOS   0x177245385090ULL
+#define BZ_PAR_MAGIC_MASK  0xffffffffffffULL
+
+/*-- How a piece cut at a false magic fails to decode --*/
+#define BZ_PAR_TRUNCATED(r) \
+   ((r) == BZ_DATA_ERROR || (r) == BZ_DATA_ERROR_MAGIC || (r) == BZ_UNEXPECTED_EOF)
+
+typedef unsigned long long ParU64;
+
+typedef
+   struct {
+      UInt32    start;       /* bit offset of the block magic */
+      UInt32    end;         /* bit offset of the next magic */
+      UInt32    crc;         /* stored block CRC */
+      Int32     level;       /* blockSize100k of its stream */
+   }
+   ParBlock;
+
+typedef
+   struct {
+      Int32     first;       /* index of its first block */
+      Int32     nBlocks;
+      UInt32    crc;         /* stored combined CRC */
+   }
+   ParStream;
+
+typedef
+   struct {
+      UChar*    out;
+      UInt32    nOut;
+      UInt32    capOut;
+      Int32     ret;
+      Bool      done;
+   }
+   ParDJob;
+
+typedef
+   struct {
+      const UChar*    src;
+      UInt32          srcLen;
+      ParBlock*       blocks;
+      Int32           nBlocks;
+      ParDJob*        jobs;
+      Int32           nJobs;
+      Int32           nTaken;
+      Int32           nWritten;
+
+      pthread_mutex_t mutex;
+      pthread_cond_t  cvDone;
+      pthread_cond_t  cvFree;
+   }
+   ParDState;
+
+
+/*---------------------------------------------------*/
+/*-- First magic (either kind) starting at a bit offset
+     >= from and ending by bit nBits, or nBits if none. --*/
+static
+UInt32 par_findMagic ( const UChar* src, UInt32 from, UInt32 nBits,
+                       Bool* isEOS )
+{
+   ParU64 reg = 0, w;
+   UInt32 i, s;
+   Int32  j;
+
+   if (nBits < 48 || from > nBits - 48) return nBits;
+   for (i = (from >> 3); i < (nBits >> 3); i++) {
+      reg = (reg << 8) | src[i];
+      if ((i + 1) * 8 < from + 48) continue;
+      /*-- windows ending inside byte i, leftmost first --*/
+      for (j = 7; j >= 0; j--) {
+         s = (i + 1) * 8 - j - 48;
+         if (s < from) continue;
+         w = (reg >> j) & BZ_PAR_MAGIC_MASK;
+         if (w == BZ_PAR_MAGIC_BLOCK) { *isEOS = False; return s; }
+         if (w == BZ_PAR_MAGIC_EOS)   { *isEOS = True;  return s; }
+      }
+   }
+   return nBits;
+}
+
+
+/*---------------------------------------------------*/
+static
+Bool par_isHeader ( const UChar* src, UInt32 srcLen, UInt32 pos )
+{
+   return pos + 4 <= srcLen &&
+          src[pos] == BZ_HDR_B && src[pos+1] == BZ_HDR_Z &&
+          src[pos+2] == BZ_HDR_h &&
+          src[pos+3] >= BZ_HDR_0 + 1 && src[pos+3] <= BZ_HDR_0 + 9;
+}
+
+
+/*---------------------------------------------------*/
+/*-- Find every block and stream in src.  Streams may be
+     concatenated, as uncompressStream allows; anything after
+     the last stream is ignored, as there. --*/
+static
+Int32 par_scan ( const UChar* src, UInt32 srcLen,
+                 ParBlock** blocksOut, Int32* nBlocksOut,
+                 ParStream** streamsOut, Int32* nStreamsOut )
+{
+   ParBlock*  blocks = NULL;
+   ParStream* streams = NULL;
+   Int32      nBlocks = 0, capBlocks = 0, nStreams = 0, capStreams = 0;
+   UInt32     pos = 0, bit, nBits, m, crcEnd;
+   Int32      level;
+   Bool       isEOS, open;
+   void*      tmp;
+
+   if (srcLen > 0xffffffffU / 8) return BZ_PARAM_ERROR;
+   nBits = srcLen * 8;
+
+   while (par_isHeader ( src, srcLen, pos )) {
+      level = src[pos+3] - BZ_HDR_0;
+      if (nStreams == capStreams) {
+         capStreams = capStreams * 2 + 4;
+         tmp = realloc ( streams, capStreams * sizeof(ParStream) );
+         if (tmp == NULL) goto mem_error;
+         streams = tmp;
+      }
+      streams[nStreams].first   = nBlocks;
+      streams[nStreams].nBlocks = 0;
+
+      bit  = (pos + 4) * 8;
+      open = False;
+      while (True) {
+         m = par_findMagic ( src, bit, nBits, &isEOS );
+         if (m == nBits || (!open && m != (pos + 4) * 8)) goto data_error;
+         if (isEOS) {
+            crcEnd = m + 48 + 32;
+            if (crcEnd <= nBits &&
+                ((crcEnd + 7) / 8 == srcLen ||
+                 par_isHeader ( src, srcLen, (crcEnd + 7) / 8 )))
+               break;
+            /*-- not followed by the end or a header: coded data --*/
+            bit = m + 1;
+            continue;
+         }
+         if (open) blocks[nBlocks - 1].end = m;
+         if (nBlocks == capBlocks) {
+            capBlocks = capBlocks * 2 + 16;
+            tmp = realloc ( blocks, capBlocks * sizeof(ParBlock) );
+            if (tmp == NULL) goto mem_error;
+            blocks = tmp;
+         }
+         if (m + 48 + 32 > nBits) goto data_error;
+         blocks[nBlocks].start = m;
+         blocks[nBlocks].end   = m;
+         blocks[nBlocks].crc   = BZ2_getBits ( src, srcLen, m + 48, 32 );
+         blocks[nBlocks].level = level;
+         nBlocks++;
+         streams[nStreams].nBlocks++;
+         open = True;
+         bit  = m + 48;
+      }
+      if (open) blocks[nBlocks - 1].end = m;
+      streams[nStreams].crc = BZ2_getBits ( src, srcLen, m + 48, 32 );
+      nStreams++;
+      pos = (m + 48 + 32 + 7) / 8;
+   }
+   if (nStreams == 0) {
+      free ( blocks );
+      free ( streams );
+      return BZ_DATA_ERROR_MAGIC;
+   }
+
+   *blocksOut   = blocks;
+   *nBlocksOut  = nBlocks;
+   *streamsOut  = streams;
+   *nStreamsOut = nStreams;
+   return BZ_OK;
+
+   mem_error:
+   free ( blocks );
+   free ( streams );
+   return BZ_MEM_ERROR;
+
+   data_error:
+   free ( blocks );
+   free ( streams );
+   return BZ_DATA_ERROR;
+}
+
+
+/*---------------------------------------------------*/
+/*--- Decompression: decoding one piece           ---*/
+/*---------------------------------------------------*/
+
+/*---------------------------------------------------*/
+/*-- Decode the coded bits [start, end) of src (one block,
+     or several if a false magic split one) into job->out
+     with BZ2_decodeRange (bzindex.c, which realigns them
+     into a one-block stream).  strm is the worker's
+     decompressor, reset there so its arrays carry over from
+     one block to the next. --*/
+static
+Int32 par_decodeRange ( bz_stream* strm,
+                        const UChar* src, UInt32 srcLen,
+                        UInt32 start, UInt32 end,
+                        Int32 level, UInt32 crc, ParDJob* job )
+{
+   return BZ2_decodeRange ( strm, src, srcLen, start, end, level, crc,
+                            &job->out, &job->nOut, &job->capOut );
+}
+
+
+/*---------------------------------------------------*/
+static
+void* par_dworker ( void* arg )
+{
+   ParDState* p = (ParDState*)arg;
+   ParDJob*   job;
+   ParBlock*  blk;
+   Int32      seq, initRet;
+   bz_stream  strm;
+
+   memset ( &strm, 0, sizeof(strm) );
+   initRet = BZ2_bzDecompressInit ( &strm, 0, 0 );
+
+   while (True) {
+      pthread_mutex_lock ( &p->mutex );
+      while (p->nTaken < p->nBlocks && p->nTaken >= p->nWritten + p->nJobs)
+         pthread_cond_wait ( &p->cvFree, &p->mutex );
+      if (p->nTaken == p->nBlocks) {
+         pthread_mutex_unlock ( &p->mutex );
+         if (initRet == BZ_OK) BZ2_bzDecompressEnd ( &strm );
+         return NULL;
+      }
+      seq = p->nTaken++;
+      pthread_mutex_unlock ( &p->mutex );
+
+      job = &p->jobs[seq % p->nJobs];
+      blk = &p->blocks[seq];
+      job->ret = initRet != BZ_OK ? initRet :
+                 par_decodeRange ( &strm, p->src, p->srcLen, blk->start,
+                                   blk->end, blk->level, blk->crc, job );
+
+      pthread_mutex_lock ( &p->mutex );
+      job->done = True;
+      pthread_cond_broadcast ( &p->cvDone );
+      pthread_mutex_unlock ( &p->mutex );
+   }
+}
+
+
+/*---------------------------------------------------*/
+/*--- Decompression: the ordered writer           ---*/
+/*---------------------------------------------------*/
+
+/*---------------------------------------------------*/
+static
+void par_waitDone ( ParDState* p, Int32 seq )
+{
+   ParDJob* job = &p->jobs[seq % p->nJobs];
+   pthread_mutex_lock ( &p->mutex );
+   while (!job->done) pthread_cond_wait ( &p->cvDone, &p->mutex );
+   pthread_mutex_unlock ( &p->mutex );
+}
+
+static
+void par_release ( ParDState* p, Int32 seq )
+{
+   pthread_mutex_lock ( &p->mutex );
+   p->jobs[seq % p->nJobs].done = False;
+   p->nWritten = seq + 1;
+   pthread_cond_broadcast ( &p->cvFree );
+   pthread_mutex_unlock ( &p->mutex );
+}
+
+
+/*---------------------------------------------------*/
+/*-- Decompress all of src[0 .. srcLen) onto stream with
+     nThreads decoding threads (0 = one per online CPU).
+     Returns BZ_OK; BZ_MEM_ERROR / BZ_CONFIG_ERROR /
+     BZ_DATA_ERROR(_MAGIC) before any output if src cannot be
+     split into blocks or the threads cannot be set up; or
+     BZ_DATA_ERROR / BZ_IO_ERROR after partial output. --*/
+int BZ2_bzParDecompressBuf ( const unsigned char* src, unsigned int srcLen,
+                             ParFile stream, int nThreads )
+{
+   ParDState  p;
+   ParStream* streams = NULL;
+   Int32      nStreams = 0, st, seq, last, joined, i, nStarted, ret;
+   ParDJob    merged;
+   ParDJob*   job;
+   bz_stream  mstrm;
+   pthread_t* workers;
+   UInt32     combinedCRC;
+
+   if (nThreads <= 0) nThreads = (int)sysconf ( _SC_NPROCESSORS_ONLN );
+   if (nThreads <= 0) nThreads = 1;
+
+   memset ( &p, 0, sizeof(p) );
+   p.src    = src;
+   p.srcLen = srcLen;
+   ret = par_scan ( src, srcLen, &p.blocks, &p.nBlocks, &streams, &nStreams );
+   if (ret != BZ_OK) return ret;
+
+   p.nJobs = BZ_PAR_JOBS_PER_THREAD * nThreads;
+   p.jobs  = calloc ( p.nJobs, sizeof(ParDJob) );
+   workers = calloc ( nThreads, sizeof(pthread_t) );
+   memset ( &merged, 0, sizeof(merged) );
+   memset ( &mstrm, 0, sizeof(mstrm) );
+   pthread_mutex_init ( &p.mutex, NULL );
+   pthread_cond_init ( &p.cvDone, NULL );
+   pthread_cond_init ( &p.cvFree, NULL );
+
+   nStarted = 0;
+   if (p.jobs == NULL || workers == NULL) ret = BZ_MEM_ERROR;
+   if (ret == BZ_OK) ret = BZ2_bzDecompressInit ( &mstrm, 0, 0 );
+   for (i = 0; ret == BZ_OK && i < nThreads; i++) {
+      if (pthread_create ( &workers[i], NULL, par_dworker, &p ) != 0) break;
+      nStarted++;
+   }
+   if (ret == BZ_OK && nStarted == 0) ret = BZ_CONFIG_ERROR;
+
+   for (st = 0; ret == BZ_OK && st < nStreams; st++) {
+      combinedCRC = 0;
+      last = streams[st].first + streams[st].nBlocks;
+      for (seq = streams[st].first; ret == BZ_OK && seq < last; seq++) {
+         par_waitDone ( &p, seq );
+         job = &p.jobs[seq % p.nJobs];
+
+         /*-- A false magic split this block: join the pieces
+              that follow (up to the ring size) until it decodes.
+              Every piece joined is waited for, then skipped. --*/
+         joined = seq;
+         while (BZ_PAR_TRUNCATED ( job->ret ) && joined + 1 < last &&
+                joined + 1 < seq + p.nJobs) {
+            joined++;
+            par_waitDone ( &p, joined );
+            job = &merged;
+            job->ret = par_decodeRange ( &mstrm, src, srcLen,
+                                         p.blocks[seq].start,
+                                         p.blocks[joined].end,
+                                         p.blocks[seq].level,
+                                         p.blocks[seq].crc, job );
+         }
+         if (job->ret == BZ_OK &&
+             job->nOut > 0 &&
+             (UInt32)fwrite ( job->out, sizeof(UChar), job->nOut, stream ) != job->nOut)
+            job->ret = BZ_IO_ERROR;
+         ret = job->ret;
+
+         combinedCRC = (combinedCRC << 1) | (combinedCRC >> 31);
+         combinedCRC ^= p.blocks[seq].crc;
+         for (i = seq; i <= joined; i++) par_release ( &p, i );
+         seq = joined;
+      }
+      if (ret == BZ_OK && combinedCRC != streams[st].crc) ret = BZ_DATA_ERROR;
+   }
+
+   /*-- On an error, send the workers home without the rest --*/
+   if (nStarted > 0) {
+      pthread_mutex_lock ( &p.mutex );
+      p.nTaken = p.nBlocks;
+      pthread_cond_broadcast ( &p.cvFree );
+      pthread_mutex_unlock ( &p.mutex );
+      for (i = 0; i < nStarted; i++) pthread_join ( workers[i], NULL );
+   }
+
+   pthread_cond_destroy ( &p.cvFree );
+   pthread_cond_destroy ( &p.cvDone );
+   pthread_mutex_destroy ( &p.mutex );
+   for (i = 0; p.jobs != NULL && i < p.nJobs; i++) free ( p.jobs[i].out );
+   free ( merged.out );
+   if (mstrm.state != NULL) BZ2_bzDecompressEnd ( &mstrm );
+   free ( p.jobs );
+   free ( workers );
+   free ( p.blocks );
+   free ( streams );
+   return ret;
+}
+
+#endif /* BZ_PARALLEL */
+
+
+/*-------------------------------------------------------------*/
+/*--- end                                        parallel.c ---*/
+/*-------------------------------------------------------------*/
@@ -7,9 +7,17 @@
 #include <sys/time.h>
 #endif /* TIMING_OUTPUT */
 #include <string.h>
+#include <setjmp.h>
 #if !defined(SPEC_CPU_WINDOWS)
 # include <unistd.h>
 #endif
+#ifdef SPEC_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif /* SPEC_MMAP */
+#ifdef SPEC_LEVELS_MT
+#include <pthread.h>
+#endif
 #include "spec.h"
 
 #define SPEC_BZIP
@@ -21,6 +29,32 @@
 Bool uncompressStream ( int zStream, int stream );
 void compressStream ( int zStream, int stream );
 void allocateCompressStructures ( void );
+extern SPEC_TLS jmp_buf *failJump;
+/* Prototype for stuff in bzlib.c (argv[5]: 0 = main sort, 1 = SA-IS) */
+int BZ2_bzSetBlockSorter ( int sorter );
+#ifdef BZ_PARALLEL
+/* argv[6]: threads sorting each block (0 = one per CPU) */
+int BZ2_bzSetSortThreads ( int nThreads );
+#endif
+#ifdef BZ_PARALLEL
+/* Prototypes for stuff in parallel.c */
+int BZ2_bzParCompressStream ( int stream, int zStream, int blockSize100k,
+                              int verbosity, int workFactor, int nThreads );
+int BZ2_bzParDecompressBuf ( const unsigned char* src, unsigned int srcLen,
+                             int stream, int nThreads );
+
+/* Threads for spec_compress / spec_uncompress (argv[4]; 0 = one per CPU) */
+int spec_threads = 1;
+#endif
+
+#ifdef SPEC_INDEX
+/* Prototypes for stuff in bzip2.c (ranges read per level) */
+#define SPEC_INDEX_READS 64
+void specIndexBegin ( void );
+int specIndexCheck ( const unsigned char* plain, unsigned int plainLen,
+                     const unsigned char* z, unsigned int zLen,
+                     int nRanges, unsigned int seed );
+#endif
 
 #define DEBUG
 
@@ -41,12 +75,20 @@ int dbglvl=4;
 
 #define FUDGE_BUF (1024*1024)
 #define VALIDATE_SKIP 1027
+#ifdef SPEC_LEVELS_MT
+/* One context per level of main's loop: fds 3k, 3k+1 and 3k+2 are its
+   input (a read-only alias of fd 0), compressed data and output */
+#define SPEC_LEVELS 3
+#define MAX_SPEC_FD (3*SPEC_LEVELS)
+#else
 #define MAX_SPEC_FD 3
+#endif
 struct spec_fd_t {
     int limit;
     int len;
     int pos;
     unsigned char *buf;
+    int osfd;		/* streaming: the OS fd behind buf, else -1 */
 } spec_fd[MAX_SPEC_FD];
 
 long int seedi;
@@ -78,7 +120,10 @@ double ran()
 
 
 int spec_init () {
-    int i, j;
+    int i;
+#ifndef SPEC_MMAP
+    int j;
+#endif
     debug(3,"spec_init\n");
 
     /* Clear the spec_fd structure */
@@ -88,6 +133,17 @@ int spec_init () {
 	int limit = spec_fd[i].limit;
 	memset(&spec_fd[i], 0, sizeof(*spec_fd));
 	spec_fd[i].limit = limit;
+	spec_fd[i].osfd = -1;
+#ifdef SPEC_MMAP
+	/* Anonymous pages are zero and only faulted in when touched,
+	   so there is nothing to pre-fill */
+	spec_fd[i].buf = (unsigned char *)mmap(NULL, limit+FUDGE_BUF,
+			PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	if (spec_fd[i].buf == MAP_FAILED) {
+	    printf ("spec_init: Error mapping memory!\n");
+	    exit(0);
+	}
+#else
 	spec_fd[i].buf = (unsigned char *)malloc(limit+FUDGE_BUF);
 	if (spec_fd[i].buf == NULL) {
 	    printf ("spec_init: Error mallocing memory!\n");
@@ -96,10 +152,92 @@ int spec_init () {
 	for (j = 0; j < limit; j+=1024) {
 	    spec_fd[i].buf[j] = 0;
 	}
+#endif /* SPEC_MMAP */
     }
     return 0;
 }
 
+/* Streaming mode: instead of holding a whole "file", buf is a window
+   of limit bytes onto a real descriptor or pipe.  For input, [pos, len)
+   is unread and buf[pos-1] is kept across refills for spec_ungetc; for
+   output, [0, len) waits for spec_flush.  Memory no longer grows with
+   the data, only with the compressor's blocks. */
+int spec_stream (int fd, int osfd) {
+    debug2(3,"spec_stream: %d <- %d\n", fd, osfd);
+    spec_fd[fd].osfd = osfd;
+    spec_fd[fd].pos = spec_fd[fd].len = 0;
+    return 0;
+}
+
+static int spec_fill (int fd) {
+    int rc;
+    if (spec_fd[fd].len > 0) {
+	spec_fd[fd].buf[0] = spec_fd[fd].buf[spec_fd[fd].len-1];
+	spec_fd[fd].pos = spec_fd[fd].len = 1;
+    }
+    do {
+	rc = read(spec_fd[fd].osfd, spec_fd[fd].buf+spec_fd[fd].len,
+		  spec_fd[fd].limit-spec_fd[fd].len);
+    } while (rc < 0 && errno == EINTR);
+    if (rc < 0) {
+	fprintf(stderr, "spec_fill: fd=%d: %s\n", fd, strerror(errno));
+	exit (1);
+    }
+    spec_fd[fd].len += rc;
+    return rc;
+}
+
+static int spec_put (int osfd, unsigned char *buf, int size) {
+    int rc;
+    while (size > 0) {
+	rc = write(osfd, buf, size);
+	if (rc < 0 && errno == EINTR) continue;
+	if (rc <= 0) {
+	    fprintf(stderr, "spec_put: fd=%d: %s\n", osfd, strerror(errno));
+	    exit (1);
+	}
+	buf += rc;
+	size -= rc;
+    }
+    return 0;
+}
+
+int spec_flush (int fd) {
+    if (spec_fd[fd].osfd >= 0)
+	spec_put(spec_fd[fd].osfd, spec_fd[fd].buf, spec_fd[fd].len);
+    spec_fd[fd].pos = spec_fd[fd].len = 0;
+    return 0;
+}
+
+/* Buffered write to a streaming fd; large writes bypass buf */
+static int spec_drain (int fd, unsigned char *buf, int size) {
+    if (spec_fd[fd].len + size > spec_fd[fd].limit) spec_flush(fd);
+    if (size > spec_fd[fd].limit) {
+	spec_put(spec_fd[fd].osfd, buf, size);
+	return size;
+    }
+    memcpy(&(spec_fd[fd].buf[spec_fd[fd].len]), buf, size);
+    spec_fd[fd].len += size;
+    spec_fd[fd].pos = spec_fd[fd].len;
+    return size;
+}
+
+#ifdef SPEC_LEVELS_MT
+/* Point fd at src's data for reading, with a position of its own;
+   nothing may write to src while fd is in use */
+int spec_alias (int fd, int src) {
+    debug2(3,"spec_alias: %d -> %d\n", fd, src);
+#ifdef SPEC_MMAP
+    munmap(spec_fd[fd].buf, spec_fd[fd].limit+FUDGE_BUF);
+#else
+    free(spec_fd[fd].buf);
+#endif /* SPEC_MMAP */
+    spec_fd[fd] = spec_fd[src];
+    spec_fd[fd].pos = 0;
+    return 0;
+}
+#endif /* SPEC_LEVELS_MT */
+
 int spec_random_load (int fd) {
     /* Now fill up the first chunk with random data, if this data is truly
        random then we will not get much of a boost out of it */
@@ -131,7 +269,10 @@ int spec_random_load (int fd) {
 
 int spec_load (int num, char *filename, int size) {
 #define FILE_CHUNK (128*1024)
-    int fd, rc, i;
+    int fd, rc;
+#ifndef SPEC_MMAP
+    int i;
+#endif
 #ifndef O_BINARY
 #define O_BINARY 0
 #endif
@@ -141,6 +282,26 @@ int spec_load (int num, char *filename, int size) {
 	exit (0);
     }
     spec_fd[num].pos = spec_fd[num].len = 0;
+#ifdef SPEC_MMAP
+    /* Map the file privately over the front of the buffer: pages fault
+       in from the page cache as they are read, and a write (the
+       decompressed data lands back in this fd) only copies that page */
+    {
+	struct stat st;
+	if (fstat(fd, &st) < 0) {
+	    fprintf(stderr, "Can't stat %s: %s\n", filename, strerror(errno));
+	    exit (0);
+	}
+	rc = (st.st_size < size) ? (int)st.st_size : size;
+	if (rc > 0 &&
+	    mmap(spec_fd[num].buf, rc, PROT_READ|PROT_WRITE,
+		 MAP_PRIVATE|MAP_FIXED, fd, 0) == MAP_FAILED) {
+	    fprintf(stderr, "Can't map %s: %s\n", filename, strerror(errno));
+	    exit (0);
+	}
+	spec_fd[num].len = rc;
+    }
+#else
     for (i = 0 ; i < size; i+= rc) {
 	rc = read(fd, spec_fd[num].buf+i, FILE_CHUNK);
 	if (rc == 0) break;
@@ -150,6 +311,7 @@ int spec_load (int num, char *filename, int size) {
 	}
 	spec_fd[num].len += rc;
     }
+#endif /* SPEC_MMAP */
     close(fd);
     while (spec_fd[num].len < size) {
 	int tmp = size - spec_fd[num].len;
@@ -168,6 +330,8 @@ int spec_read (int fd, unsigned char *buf, int size) {
 	fprintf(stderr, "spec_read: fd=%d, > MAX_SPEC_FD!\n", fd);
 	exit (0);
     }
+    if (spec_fd[fd].osfd >= 0 && spec_fd[fd].pos >= spec_fd[fd].len)
+	spec_fill(fd);
     if (spec_fd[fd].pos >= spec_fd[fd].len) {
 	debug(4,"EOF\n");
 	return EOF;
@@ -189,6 +353,8 @@ int spec_fread (unsigned char *buf, int size, int num, int fd) {
 	fprintf(stderr, "spec_fread: fd=%d, > MAX_SPEC_FD!\n", fd);
 	exit (0);
     }
+    if (spec_fd[fd].osfd >= 0 && spec_fd[fd].pos >= spec_fd[fd].len)
+	spec_fill(fd);
     if (spec_fd[fd].pos >= spec_fd[fd].len) {
 	debug(4,"EOF\n");
 	return EOF;
@@ -203,6 +369,32 @@ int spec_fread (unsigned char *buf, int size, int num, int fd) {
     debug1(4,"%d\n", rc * size);
     return rc;
 }
+#ifdef SPEC_MMAP
+/* Like spec_read, but points *buf at the data instead of copying it */
+int spec_view (int fd, unsigned char **buf, int size) {
+    int rc = 0;
+    debug3(4,"spec_view: %d, %p, %d = ", fd, (void *)buf, size);
+    if (fd > MAX_SPEC_FD) {
+	fprintf(stderr, "spec_view: fd=%d, > MAX_SPEC_FD!\n", fd);
+	exit (0);
+    }
+    if (spec_fd[fd].osfd >= 0 && spec_fd[fd].pos >= spec_fd[fd].len)
+	spec_fill(fd);
+    if (spec_fd[fd].pos >= spec_fd[fd].len) {
+	debug(4,"EOF\n");
+	return EOF;
+    }
+    if (spec_fd[fd].pos + size >= spec_fd[fd].len) {
+	rc = spec_fd[fd].len - spec_fd[fd].pos;
+    } else {
+	rc = size;
+    }
+    *buf = &(spec_fd[fd].buf[spec_fd[fd].pos]);
+    spec_fd[fd].pos += rc;
+    debug1(4,"%d\n", rc);
+    return rc;
+}
+#endif /* SPEC_MMAP */
 int spec_getc (int fd) {
     int rc = 0;
     debug1(4,"spec_getc: %d = ", fd);
@@ -210,6 +402,8 @@ int spec_getc (int fd) {
 	fprintf(stderr, "spec_read: fd=%d, > MAX_SPEC_FD!\n", fd);
 	exit (0);
     }
+    if (spec_fd[fd].osfd >= 0 && spec_fd[fd].pos >= spec_fd[fd].len)
+	spec_fill(fd);
     if (spec_fd[fd].pos >= spec_fd[fd].len) {
 	debug(4,"EOF\n");
 	return EOF;
@@ -241,7 +435,11 @@ int spec_rewind(int fd) {
     return 0;
 }
 int spec_reset(int fd) {
+#ifndef SPEC_MMAP
+    /* Nothing reads past len; under SPEC_MMAP skip the clear, which
+       would fault in (and copy) every page of the mapping */
     memset(spec_fd[fd].buf, 0, spec_fd[fd].len);
+#endif /* SPEC_MMAP */
     spec_fd[fd].pos = spec_fd[fd].len = 0;
     return 0;
 }
@@ -252,6 +450,8 @@ int spec_write(int fd, unsigned char *buf, int size) {
 	fprintf(stderr, "spec_write: fd=%d, > MAX_SPEC_FD!\n", fd);
 	exit (0);
     }
+    if (spec_fd[fd].osfd >= 0)
+	return spec_drain(fd, buf, size);
     memcpy(&(spec_fd[fd].buf[spec_fd[fd].pos]), buf, size); 
     spec_fd[fd].len += size;
     spec_fd[fd].pos += size;
@@ -264,6 +464,10 @@ int spec_fwrite(unsigned char *buf, int size, int num, int fd) {
 	fprintf(stderr, "spec_fwrite: fd=%d, > MAX_SPEC_FD!\n", fd);
 	exit (0);
     }
+    if (spec_fd[fd].osfd >= 0) {
+	spec_drain(fd, buf, size*num);
+	return num;
+    }
     memcpy(&(spec_fd[fd].buf[spec_fd[fd].pos]), buf, size*num); 
     spec_fd[fd].len += size*num;
     spec_fd[fd].pos += size*num;
@@ -276,6 +480,8 @@ int spec_putc(unsigned char ch, int fd) {
 	fprintf(stderr, "spec_write: fd=%d, > MAX_SPEC_FD!\n", fd);
 	exit (0);
     }
+    if (spec_fd[fd].osfd >= 0 && spec_fd[fd].len >= spec_fd[fd].limit)
+	spec_flush(fd);
     spec_fd[fd].buf[spec_fd[fd].pos++] = ch;
     spec_fd[fd].len ++;
     return ch;
@@ -283,11 +489,68 @@ int spec_putc(unsigned char ch, int fd) {
 
 #define MB (1024*1024)
 #ifdef SPEC_CPU
+#ifdef SPEC_INDEX
+/* Read ranges of fd in's data back from fd z, just compressed,
+   through the block index compressStream wrote */
+static void spec_check_index (int in, int z, int level) {
+    int nBlocks = specIndexCheck(spec_fd[in].buf, spec_fd[in].len,
+				 spec_fd[z].buf, spec_fd[z].len,
+				 SPEC_INDEX_READS, level);
+    if (nBlocks < 0) {
+	printf ("Tested %dMB buffer: Index read miscompared!!\n",
+		spec_fd[in].len / MB);
+	exit (0);
+    }
+    debug2(3, "Index of %d blocks read back correctly, level %d\n",
+	   nBlocks, level);
+}
+#endif /* SPEC_INDEX */
+
+#ifdef SPEC_LEVELS_MT
+struct spec_level_t {
+    int level;
+    int in, z, out;		/* input alias, compressed and output fds */
+    int input_size;
+    unsigned char *validate_array;
+};
+
+/* One pass of main's level loop, on a context of its own: the input
+   is only read, so the decompressed data goes to out, not back to in */
+static void *spec_run_level (void *arg) {
+    struct spec_level_t *l = (struct spec_level_t *)arg;
+    int i;
+
+    debug1(2, "Compressing Input Data, level %d\n", l->level);
+    spec_compress(l->in, l->z, l->level);
+    debug2(3, "Compressed data %d bytes in length, level %d\n",
+	   spec_fd[l->z].len, l->level);
+#ifdef SPEC_INDEX
+    spec_check_index(l->in, l->z, l->level);
+#endif
+
+    spec_rewind(l->z);
+    debug1(2, "Uncompressing Data, level %d\n", l->level);
+    spec_uncompress(l->z, l->out, l->level);
+    debug2(3, "Uncompressed data %d bytes in length, level %d\n",
+	   spec_fd[l->out].len, l->level);
+
+    for (i = 0; i*VALIDATE_SKIP < l->input_size*MB; i++) {
+	if (l->validate_array[i] != spec_fd[l->out].buf[i*VALIDATE_SKIP]) {
+	    printf ("Tested %dMB buffer: Miscompared!!\n", l->input_size);
+	    exit (0);
+	}
+    }
+    debug1(3, "Uncompressed data compared correctly, level %d\n", l->level);
+    return NULL;
+}
+#endif /* SPEC_LEVELS_MT */
+
 int main (int argc, char *argv[]) {
     int i, level;
     int input_size=64, compressed_size;
     char *input_name="input.combined";
     unsigned char *validate_array;
+    jmp_buf fail;
     seedi = 10;
 
     if (argc > 1) input_name=argv[1];
@@ -296,10 +559,59 @@ int main (int argc, char *argv[]) {
 	compressed_size=atoi(argv[3]);
     else
 	compressed_size=input_size;
+#ifdef BZ_PARALLEL
+    if (argc > 4) spec_threads=atoi(argv[4]);
+#endif
+    if (argc > 5) BZ2_bzSetBlockSorter(atoi(argv[5]));
+#ifdef BZ_PARALLEL
+    if (argc > 6) BZ2_bzSetSortThreads(atoi(argv[6]));
+#endif
+
+    if (strcmp(input_name, "-") == 0) {
+	/* Streaming: stdin to stdout, argv[2] a level or "d" */
+#ifdef DEBUG
+	dbglvl = 0;	/* stdout carries the data */
+#endif
+	level = (argc > 2) ? atoi(argv[2]) : 9;
+	if (level < 1 || level > 9) level = 9;
+	spec_fd[0].limit = spec_fd[1].limit = spec_fd[2].limit = 0;
+	spec_init();
+	spec_fd[0].limit = spec_fd[1].limit = FUDGE_BUF;
+	spec_initbufs();
+	/* A failure (truncated or corrupt input, I/O) comes back here
+	   with bzip2's exit code: SPEC_CPU builds would otherwise exit 0 */
+	if ((i = setjmp(fail)) != 0) return i;
+	failJump = &fail;
+	/* fd 0 is the plain side, fd 1 the compressed one, as above
+	   (and bzReadOpen takes fd 0 for NULL) */
+	if (argc > 2 && argv[2][0] == 'd') {
+	    spec_stream(1, 0);
+	    spec_stream(0, 1);
+	    if (spec_uncompress(1, 0, level) != 0) {
+		fprintf(stderr, "specbzip: stdin is not a bzip2 stream\n");
+		return 1;
+	    }
+	    spec_flush(0);
+	} else {
+	    spec_stream(0, 0);
+	    spec_stream(1, 1);
+	    spec_compress(0, 1, level);
+	    spec_flush(1);
+	}
+	failJump = NULL;
+	return 0;
+    }
 
     spec_fd[0].limit=input_size*MB;
     spec_fd[1].limit=compressed_size*MB;
     spec_fd[2].limit=input_size*MB;
+#ifdef SPEC_LEVELS_MT
+    for (i = 1; i < SPEC_LEVELS; i++) {
+	spec_fd[3*i].limit=0;
+	spec_fd[3*i+1].limit=compressed_size*MB;
+	spec_fd[3*i+2].limit=input_size*MB;
+    }
+#endif
     spec_init();
 
     debug_time();
@@ -326,6 +638,34 @@ int main (int argc, char *argv[]) {
 
     spec_initbufs();
 
+#ifdef SPEC_LEVELS_MT
+    /* Levels 5, 7 and 9 at once, each on its own thread and fds, all
+       reading the one loaded input */
+    for (i = 1; i < SPEC_LEVELS; i++) spec_alias(3*i, 0);
+    ROI_BEGIN();
+    {
+	pthread_t threads[SPEC_LEVELS];
+	struct spec_level_t levels[SPEC_LEVELS];
+	int started[SPEC_LEVELS];
+
+	for (i = 0; i < SPEC_LEVELS; i++) {
+	    levels[i].level = 5 + 2*i;
+	    levels[i].in = 3*i;
+	    levels[i].z = 3*i+1;
+	    levels[i].out = 3*i+2;
+	    levels[i].input_size = input_size;
+	    levels[i].validate_array = validate_array;
+	    /* Without a thread, run the level here before the next */
+	    started[i] = pthread_create(&threads[i], NULL, spec_run_level,
+					&levels[i]) == 0;
+	    if (!started[i]) spec_run_level(&levels[i]);
+	}
+	for (i = 0; i < SPEC_LEVELS; i++)
+	    if (started[i]) pthread_join(threads[i], NULL);
+    }
+    ROI_END();
+#else
+    ROI_BEGIN();
     for (level=5; level <= 9; level += 2) {
 	debug_time();
 	debug1(2, "Compressing Input Data, level %d\n", level);
@@ -334,6 +674,9 @@ int main (int argc, char *argv[]) {
 
 	debug_time();
 	debug1(3, "Compressed data %d bytes in length\n", spec_fd[1].len);
+#ifdef SPEC_INDEX
+	spec_check_index(0, 1, level);
+#endif
 
 #ifdef DEBUG_DUMP
 	{
@@ -375,6 +718,8 @@ int main (int argc, char *argv[]) {
 	spec_reset(1);
 	spec_rewind(0);
     }
+    ROI_END();
+#endif /* SPEC_LEVELS_MT */
     printf ("Tested %dMB buffer: OK!\n", input_size);
 
     return 0;
@@ -384,7 +729,8 @@ int main (int argc, char *argv[]) {
 extern unsigned char smallMode;
 extern int     verbosity;
 extern int     bsStream;
-extern int     workFactor, blockSize100k;
+extern int     workFactor;
+extern SPEC_TLS int blockSize100k;
 void spec_initbufs() {
    smallMode               = 0;
    verbosity               = 0;
@@ -395,11 +741,37 @@ void spec_initbufs() {
 }
 void spec_compress(int in, int out, int lev) {
     blockSize100k           = lev;
+#ifdef SPEC_INDEX
+    /* Only compressStream writes the index */
+    specIndexBegin();
+#elif defined(BZ_PARALLEL)
+    /* Same stream as compressStream; if the blocks or threads cannot
+       be set up (nothing written yet), fall back to it */
+    if (spec_threads != 1 &&
+	BZ2_bzParCompressStream(in, out, lev, verbosity, workFactor,
+				spec_threads) == 0)
+	return;
+#endif
     compressStream ( in, out );
 }
-void spec_uncompress(int in, int out, int lev) {
+/* 0 on success, 1 if in held no bzip2 stream (other errors go to
+   cleanUpAndFail) */
+int spec_uncompress(int in, int out, int lev) {
     blockSize100k           = 0;
-    uncompressStream( in, out );
+#ifdef BZ_PARALLEL
+    /* On any failure, start over serially: uncompressStream then
+       reports a corrupt stream the usual way */
+    if (spec_threads != 1 && spec_fd[in].osfd < 0) {
+	if (BZ2_bzParDecompressBuf(spec_fd[in].buf + spec_fd[in].pos,
+				   spec_fd[in].len - spec_fd[in].pos,
+				   out, spec_threads) == 0) {
+	    spec_fd[in].pos = spec_fd[in].len;
+	    return 0;
+	}
+	spec_reset(out);
+    }
+#endif
+    return uncompressStream( in, out ) ? 0 : 1;
 }
 #else
 #error You must have SPEC_BZIP defined!
@@ -1,7 +1,7 @@
 /* Prototypes for stuff in spec.c */
 void spec_initbufs();
 void spec_compress(int in, int out, int level);
-void spec_uncompress(int in, int out, int level);
+int spec_uncompress(int in, int out, int level);
 int spec_init ();
 int spec_random_load (int fd);
 int spec_load (int num, char *filename, int size);
@@ -14,5 +14,34 @@ int spec_fread (unsigned char *buf, int size, int num, int fd);
 int spec_fwrite (unsigned char *buf, int size, int num, int fd);
 int spec_rewind (int fd);
 int spec_putc (unsigned char ch, int fd);
+int spec_stream (int fd, int osfd);
+int spec_flush (int fd);
+#ifdef SPEC_LEVELS_MT
+int spec_alias (int fd, int src);
+#endif
+#ifdef SPEC_MMAP
+int spec_view (int fd, unsigned char **buf, int size);
+#endif
 int debug_time();
 
+/* Built with -DGEM5_ROI (make roi), main() marks the compress and
+   uncompress levels for gem5: the statistics are reset when they
+   start, after the input is loaded, and dumped when they are done */
+#ifdef GEM5_ROI
+#include <gem5/m5ops.h>
+#define ROI_BEGIN() do { m5_work_begin(0, 0); m5_reset_stats(0, 0); } while (0)
+#define ROI_END()   do { m5_dump_stats(0, 0); m5_work_end(0, 0); } while (0)
+#else
+#define ROI_BEGIN() do { } while (0)
+#define ROI_END()   do { } while (0)
+#endif
+
+
+/* Built with -DSPEC_LEVELS_MT (make levels), main() runs its levels on
+   threads of their own, so the compressor state they set per level
+   (blockSize100k, outputHandleJustInCase) is per thread */
+#ifdef SPEC_LEVELS_MT
+#define SPEC_TLS __thread
+#else
+#define SPEC_TLS
+#endif
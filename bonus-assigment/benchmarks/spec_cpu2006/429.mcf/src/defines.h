@@ -86,6 +86,11 @@ typedef long cost_t;
 #endif
 
 
+#ifndef MIN
+#define MIN(a,b) (((a) < (b)) ? (a) : (b))
+#endif
+
+
 #ifndef SET_ZERO
 #define SET_ZERO( vec, n ) if( vec ) memset( (void *)vec, 0, (size_t)n )
 #endif
@@ -96,14 +101,74 @@ typedef long cost_t;
 #endif
 
 
+/* Software prefetch distance, in loop iterations, of the pricing
+   kernels, price_out_impl and refresh_potential; 0 (the default)
+   leaves them to the hardware prefetcher. Build with, e.g.,
+   -DMCF_PREFETCH=16. */
+#ifndef MCF_PREFETCH
+#define MCF_PREFETCH 0
+#endif
+
+#if MCF_PREFETCH > 0 && defined(__GNUC__)
+#define PREFETCH( p ) __builtin_prefetch( (const void *)(p) )
+#else
+#define PREFETCH( p )
+#endif
+
+
+/* The batch driver (mcfbatch.c) runs one solve per thread, so what
+   is global to a solve is thread-local there */
+#ifdef MCF_BATCH
+#define MCF_TLS __thread
+#else
+#define MCF_TLS
+#endif
+
+
+/* gem5 markers of the solve, after read_min, built with -DGEM5_ROI
+   (make roi): statistics are reset at ROI_BEGIN and dumped at ROI_END */
+#ifdef GEM5_ROI
+#include <gem5/m5ops.h>
+#define ROI_BEGIN() do { m5_work_begin( 0, 0 ); m5_reset_stats( 0, 0 ); } while( 0 )
+#define ROI_END()   do { m5_dump_stats( 0, 0 ); m5_work_end( 0, 0 ); } while( 0 )
+#else
+#define ROI_BEGIN() do { } while( 0 )
+#define ROI_END()   do { } while( 0 )
+#endif
+
+/* addresses the pricing scan of primal_bea_mpp loads and stores, built
+   with -DMEM_TRACE (make trace, see ../../memtrace/memtrace.h) */
+#ifdef MEM_TRACE
+#include "memtrace.h"
+#else
+#define MEMTRACE_LOAD( p )  do { } while( 0 )
+#define MEMTRACE_STORE( p ) do { } while( 0 )
+#endif
+
+/* wall time of a solve's pricing, summed into the network_t bench_*
+   fields, built with -DMCF_BENCH (make bench, see mcfbench.c) */
+#ifdef MCF_BENCH
+extern double bench_time _PROTO_(( void ));
+#define BENCH_BEGIN( t ) do { (t) -= bench_time(); } while( 0 )
+#define BENCH_END( t )   do { (t) += bench_time(); } while( 0 )
+#else
+#define BENCH_BEGIN( t ) do { } while( 0 )
+#define BENCH_END( t )   do { } while( 0 )
+#endif
+
+
 typedef struct node node_t;
 typedef struct node *node_p;
 
 typedef struct arc arc_t;
 typedef struct arc *arc_p;
 
+typedef unsigned int node_idx_t;
+typedef unsigned int arc_idx_t;
 
 
+
+#ifndef MCF_COMPACT
 struct node
 {
   cost_t potential; 
@@ -132,6 +197,175 @@ struct arc
   flow_t flow;
   cost_t org_cost;
 };
+#else
+/* Compact layout (-DMCF_COMPACT): every link is a 32-bit index and
+   struct node keeps only what the tree walks of the simplex touch
+   (refresh_potential, update_tree, primal_iminus); the adjacency
+   half lives in the parallel array mcf_node_cold. On LP64 a node
+   drops from 104 to 48 (+20 cold) bytes and an arc from 64 to 48.
+   Index 0 is NULL: the node, cold and arc arrays each start with an
+   unused slot (the *_base pointers below), and the dummy arcs sit in
+   front of net->arcs in the same block, so any basic arc is one
+   index and resize_prob has nothing to rebase. */
+typedef struct node_cold node_cold_t;
+
+struct node
+{
+  cost_t potential; 
+  flow_t flow;
+  node_idx_t child;
+  node_idx_t pred;
+  node_idx_t sibling;
+  node_idx_t sibling_prev;     
+  arc_idx_t basic_arc; 
+  int depth; 
+  int orientation;
+};
+
+struct node_cold
+{
+  arc_idx_t firstout, firstin;
+  arc_idx_t arc_tmp;
+  int number;
+  int time;
+};
+
+struct arc
+{
+  cost_t cost;
+  cost_t org_cost;
+  flow_t flow;
+  node_idx_t tail, head;
+  arc_idx_t nextout, nextin;
+  int ident;
+};
+
+extern MCF_TLS node_p mcf_node_base;
+extern MCF_TLS node_cold_t *mcf_node_cold;
+extern MCF_TLS arc_p mcf_arc_base;
+#endif
+
+
+
+/* Link fields are read with NODE_* / ARC_* and written with SET_*,
+   so both layouts compile from the same code. Arguments may be
+   evaluated more than once. NODE_COLD( n ) gives the number, time
+   and adjacency fields of node n. An arc always has both ends, so
+   ARC_TAIL and ARC_HEAD skip the NULL test. */
+#ifndef MCF_COMPACT
+#define NODE_COLD( n )              ( n )
+#define NODE_CHILD( n )             ( (n)->child )
+#define NODE_PRED( n )              ( (n)->pred )
+#define NODE_SIBLING( n )           ( (n)->sibling )
+#define NODE_SIBLING_PREV( n )      ( (n)->sibling_prev )
+#define NODE_BASIC_ARC( n )         ( (n)->basic_arc )
+#define NODE_FIRSTOUT( n )          ( (n)->firstout )
+#define NODE_FIRSTIN( n )           ( (n)->firstin )
+#define NODE_ARC_TMP( n )           ( (n)->arc_tmp )
+#define ARC_TAIL( a )               ( (a)->tail )
+#define ARC_HEAD( a )               ( (a)->head )
+#define ARC_NEXTOUT( a )            ( (a)->nextout )
+#define ARC_NEXTIN( a )             ( (a)->nextin )
+
+#define SET_CHILD( n, v )           ( (n)->child = (v) )
+#define SET_PRED( n, v )            ( (n)->pred = (v) )
+#define SET_SIBLING( n, v )         ( (n)->sibling = (v) )
+#define SET_SIBLING_PREV( n, v )    ( (n)->sibling_prev = (v) )
+#define SET_BASIC_ARC( n, v )       ( (n)->basic_arc = (v) )
+#define SET_FIRSTOUT( n, v )        ( (n)->firstout = (v) )
+#define SET_FIRSTIN( n, v )         ( (n)->firstin = (v) )
+#define SET_ARC_TMP( n, v )         ( (n)->arc_tmp = (v) )
+#define SET_TAIL( a, v )            ( (a)->tail = (v) )
+#define SET_HEAD( a, v )            ( (a)->head = (v) )
+#define SET_NEXTOUT( a, v )         ( (a)->nextout = (v) )
+#define SET_NEXTIN( a, v )          ( (a)->nextin = (v) )
+#else
+#define NODE_OF( i )    ( (i) ? mcf_node_base + (i) : (node_p)NULL )
+#define ARC_OF( i )     ( (i) ? mcf_arc_base + (i) : (arc_p)NULL )
+#define NODE_AT( i )    ( mcf_node_base + (i) )
+#define NODE_IDX( p )   ( (p) ? (node_idx_t)((node_p)(p) - mcf_node_base) : 0 )
+#define ARC_IDX( p )    ( (p) ? (arc_idx_t)((arc_p)(p) - mcf_arc_base) : 0 )
+
+#define NODE_COLD( n )              ( mcf_node_cold + ((n) - mcf_node_base) )
+#define NODE_CHILD( n )             NODE_OF( (n)->child )
+#define NODE_PRED( n )              NODE_OF( (n)->pred )
+#define NODE_SIBLING( n )           NODE_OF( (n)->sibling )
+#define NODE_SIBLING_PREV( n )      NODE_OF( (n)->sibling_prev )
+#define NODE_BASIC_ARC( n )         ARC_OF( (n)->basic_arc )
+#define NODE_FIRSTOUT( n )          ARC_OF( NODE_COLD( n )->firstout )
+#define NODE_FIRSTIN( n )           ARC_OF( NODE_COLD( n )->firstin )
+#define NODE_ARC_TMP( n )           ARC_OF( NODE_COLD( n )->arc_tmp )
+#define ARC_TAIL( a )               NODE_AT( (a)->tail )
+#define ARC_HEAD( a )               NODE_AT( (a)->head )
+#define ARC_NEXTOUT( a )            ARC_OF( (a)->nextout )
+#define ARC_NEXTIN( a )             ARC_OF( (a)->nextin )
+
+#define SET_CHILD( n, v )           ( (n)->child = NODE_IDX( v ) )
+#define SET_PRED( n, v )            ( (n)->pred = NODE_IDX( v ) )
+#define SET_SIBLING( n, v )         ( (n)->sibling = NODE_IDX( v ) )
+#define SET_SIBLING_PREV( n, v )    ( (n)->sibling_prev = NODE_IDX( v ) )
+#define SET_BASIC_ARC( n, v )       ( (n)->basic_arc = ARC_IDX( v ) )
+#define SET_FIRSTOUT( n, v )        ( NODE_COLD( n )->firstout = ARC_IDX( v ) )
+#define SET_FIRSTIN( n, v )         ( NODE_COLD( n )->firstin = ARC_IDX( v ) )
+#define SET_ARC_TMP( n, v )         ( NODE_COLD( n )->arc_tmp = ARC_IDX( v ) )
+#define SET_TAIL( a, v )            ( (a)->tail = NODE_IDX( v ) )
+#define SET_HEAD( a, v )            ( (a)->head = NODE_IDX( v ) )
+#define SET_NEXTOUT( a, v )         ( (a)->nextout = ARC_IDX( v ) )
+#define SET_NEXTIN( a, v )          ( (a)->nextin = ARC_IDX( v ) )
+#endif
+
+
+
+/* Pricing copy of net->arcs, one array per field, so the pricing
+   loop in pbeampp.c reads 4+4+8+1 bytes per arc instead of a whole
+   arc_t. The arcs are stored group by group (arcs g, g+nr_group,
+   g+2*nr_group, ... for g = 0, 1, ...), the order in which
+   primal_bea_mpp prices them, so each group is one dense run; tail
+   and head are indices into nodes. Rebuilt by refresh_arc_soa at the
+   start of every primal_net_simplex (the arc set only changes
+   between calls); within a call the simplex writes ident through to
+   both copies (SOA_POS). */
+typedef struct arc_soa
+{
+  long m, max_m;
+  long nr_group;
+  node_p nodes;
+  cost_t *cost;
+  node_idx_t *tail, *head;
+  signed char *ident;
+} arc_soa_t;
+
+/* First SoA entry of group g, and the entry holding arc i */
+#define SOA_GROUP_START( soa, g ) \
+    ( (g) * ((soa)->m / (soa)->nr_group) + MIN( (g), (soa)->m % (soa)->nr_group ) )
+#define SOA_POS( soa, i ) \
+    ( SOA_GROUP_START( soa, (i) % (soa)->nr_group ) + (i) / (soa)->nr_group )
+
+
+
+/* What primal_bea_mpp keeps from one call to the next: the basket
+   of dual infeasible arcs, as (|reduced cost|, arc number) pairs with
+   the best BEA_B first, and the next of the nr_group groups of about
+   BEA_K arcs to price. A zeroed bea_t, as in a cleared network_t,
+   starts afresh. */
+#define BEA_K 300
+#define BEA_B  50
+
+typedef struct basket
+{
+  cost_t abs_cost;
+  long a;
+} BASKET;
+
+typedef struct bea
+{
+  long initialized;
+  long nr_group, group_pos;
+  long basket_size;
+  BASKET basket[BEA_B+BEA_K];
+  long group_hit[BEA_K];
+  cost_t group_hit_cost[BEA_K];
+} bea_t;
 
 
 
@@ -141,6 +375,7 @@ typedef struct network
   char clustfile[200];
   long n, n_trips;
   long max_m, m, m_org, m_impl;
+  long m_dead;        /* suspended implicit arcs not yet compacted away */
   long max_residual_new_m, max_new_m;
   
   long primal_unbounded;
@@ -160,6 +395,14 @@ typedef struct network
   long iterations;
   long bound_exchanges;
   long checksum;
+  node_p *thread;     /* non-root nodes in DFS preorder, see mcfutil.c */
+  long n_down;        /* non-root nodes with orientation DOWN */
+  arc_soa_t soa;
+  bea_t bea;
+#ifdef MCF_BENCH
+  double bench_price;       /* in primal_bea_mpp */
+  double bench_price_impl;  /* in price_out_impl */
+#endif
 } network_t;
 
 
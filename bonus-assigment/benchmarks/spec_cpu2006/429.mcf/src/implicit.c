@@ -21,6 +21,7 @@ Copyright (c) 2003-2005 Andreas Loebel.
 
 
 #include "implicit.h"
+#include "mcfpar.h"
 
 
 
@@ -32,8 +33,10 @@ long resize_prob( net )
 #endif
 {
     arc_t *arc;
+#ifndef MCF_COMPACT
     node_t *node, *stop, *root;
     size_t off;
+#endif
             
     
     assert( net->max_new_m >= 3 );
@@ -52,7 +55,12 @@ long resize_prob( net )
 #endif
 
 
-    arc = (arc_t *) realloc( net->arcs, net->max_m * sizeof(arc_t) );
+#ifdef MCF_COMPACT
+    arc = (arc_t *) mem_realloc( mcf_arc_base, 
+                                 (1 + net->n + net->max_m) * sizeof(arc_t) );
+#else
+    arc = (arc_t *) mem_realloc( net->arcs, net->max_m * sizeof(arc_t) );
+#endif
     if( !arc )
     {
         printf( "network %s: not enough memory\n", net->inputfile );
@@ -60,15 +68,28 @@ long resize_prob( net )
         return -1;
     }
     
+#ifdef MCF_COMPACT
+    /* links are indices, only the block moves */
+    mcf_arc_base = arc;
+    net->dummy_arcs = arc + 1;
+    net->stop_dummy = net->dummy_arcs + net->n;
+    net->arcs = net->stop_dummy;
+    net->stop_arcs = net->arcs + net->m;
+#else
     off = (size_t)arc - (size_t)net->arcs;
         
     net->arcs = arc;
     net->stop_arcs = arc + net->m;
 
-    root = node = net->nodes;
-    for( node++, stop = (void *)net->stop_nodes; node < stop; node++ )
-        if( node->pred != root )
-            node->basic_arc = (arc_t *)((size_t)node->basic_arc + off);
+    /* a block grown in place (mem_realloc) needs no rebasing */
+    if( off )
+    {
+        root = node = net->nodes;
+        for( node++, stop = (void *)net->stop_nodes; node < stop; node++ )
+            if( node->pred != root )
+                node->basic_arc = (arc_t *)((size_t)node->basic_arc + off);
+    }
+#endif
         
     return 0;
 }
@@ -94,8 +115,8 @@ void insert_new_arc( new, newpos, tail, head, cost, red_cost )
 {
     long pos;
 
-    new[newpos].tail      = tail;
-    new[newpos].head      = head;
+    SET_TAIL( new + newpos, tail );
+    SET_HEAD( new + newpos, head );
     new[newpos].org_cost  = cost;
     new[newpos].cost      = cost;
     new[newpos].flow      = (flow_t)red_cost; 
@@ -110,8 +131,8 @@ void insert_new_arc( new, newpos, tail, head, cost, red_cost )
         new[pos-1].flow     = new[pos/2-1].flow;
         
         pos = pos/2;
-        new[pos-1].tail     = tail;
-        new[pos-1].head     = head;
+        SET_TAIL( new + pos-1, tail );
+        SET_HEAD( new + pos-1, head );
         new[pos-1].cost     = cost;
         new[pos-1].org_cost = cost;
         new[pos-1].flow     = (flow_t)red_cost; 
@@ -141,8 +162,8 @@ void replace_weaker_arc( net, new, tail, head, cost, red_cost )
     long pos;
     long cmp;
 
-    new[0].tail     = tail;
-    new[0].head     = head;
+    SET_TAIL( new, tail );
+    SET_HEAD( new, head );
     new[0].org_cost = cost;
     new[0].cost     = cost;
     new[0].flow     = (flow_t)red_cost; 
@@ -157,8 +178,8 @@ void replace_weaker_arc( net, new, tail, head, cost, red_cost )
         new[pos-1].org_cost = new[cmp-1].cost;
         new[pos-1].flow = new[cmp-1].flow;
         
-        new[cmp-1].tail = tail;
-        new[cmp-1].head = head;
+        SET_TAIL( new + cmp-1, tail );
+        SET_HEAD( new + cmp-1, head );
         new[cmp-1].cost = cost;
         new[cmp-1].org_cost = cost;
         new[cmp-1].flow = (flow_t)red_cost; 
@@ -175,6 +196,152 @@ void replace_weaker_arc( net, new, tail, head, cost, red_cost )
 
 
 
+#ifdef MCF_PARALLEL
+/* Parallel candidate scan for price_out_impl. The sparse list that
+   the serial loop grows trip by trip is linked first (each trip only
+   prepends, so the list as trip i sees it starts at sparse[i] and
+   stays intact). Trips are then taken PAR_TRIP_CHUNK at a time, each
+   thread scanning a contiguous share into its own buffer, and the
+   caller offers the candidates to the new-arc heap in trip order, so
+   the new arcs come out as from the serial loop. */
+#define PAR_TRIP_CHUNK 1024
+
+typedef struct cand
+{
+    node_t *tail, *head;
+    cost_t red_cost;
+} cand_t;
+
+static struct
+{
+    arc_t *arcs;
+    arc_t **sparse;
+    long lo, hi;
+    cost_t bigM_minus_min_impl_duration;
+    cost_t arc_cost;
+    cand_t *buf[PAR_MAX_THREADS];
+    long n[PAR_MAX_THREADS], max[PAR_MAX_THREADS];
+    long oom;
+} scan;
+
+
+static void scan_trips( void *arg, long t )
+{
+    long span = scan.hi - scan.lo;
+    long i = scan.lo + span * t / par_threads;
+    long stop = scan.lo + span * (t + 1) / par_threads;
+    long n = 0;
+    long latest;
+    arc_t *arcout, *arcin;
+    node_t *tail, *head;
+    cost_t red_cost;
+    cand_t *grown;
+
+    for( arcout = scan.arcs + 3 * i; i < stop; i++, arcout += 3 )
+    {
+        if( arcout->ident == FIXED )
+            continue;
+
+        head = ARC_HEAD( arcout );
+        latest = NODE_COLD( head )->time - arcout->org_cost 
+            + (long)scan.bigM_minus_min_impl_duration;
+
+        for( arcin = NODE_ARC_TMP( ARC_TAIL( scan.sparse[i] ) ); arcin;
+             arcin = NODE_ARC_TMP( tail ) )
+        {
+            tail = ARC_TAIL( arcin );
+            if( NODE_COLD( tail )->time + arcin->org_cost > latest )
+                continue;
+
+            red_cost = scan.arc_cost - tail->potential + head->potential;
+            if( red_cost < 0 )
+            {
+                if( n == scan.max[t] )
+                {
+                    grown = (cand_t *) realloc( scan.buf[t],
+                                    2 * (n + 1024) * sizeof(cand_t) );
+                    if( !grown )
+                    {
+                        scan.oom = 1;
+                        scan.n[t] = n;
+                        return;
+                    }
+                    scan.buf[t] = grown;
+                    scan.max[t] = 2 * (n + 1024);
+                }
+                scan.buf[t][n].tail = tail;
+                scan.buf[t][n].head = head;
+                scan.buf[t][n].red_cost = red_cost;
+                n++;
+            }
+        }
+    }
+    scan.n[t] = n;
+}
+
+
+/* Trips i0 .. n_trips-1 of price_out_impl's loop; -1 without memory */
+static long price_out_par( network_t *net, long i0, arc_t *arcnew, 
+                           long *new_arcs, cost_t bigM_minus_min_impl_duration,
+                           cost_t arc_cost )
+{
+    long i, t, k;
+    long trips = net->n_trips;
+    arc_t *arcout;
+    arc_t *first_of_sparse_list = (arc_t *)NULL;
+    cand_t *c;
+
+    scan.sparse = (arc_t **) malloc( trips * sizeof(arc_t *) );
+    if( !scan.sparse )
+        return -1;
+    for( i = i0, arcout = net->arcs + 3 * i0; i < trips; i++, arcout += 3 )
+    {
+        if( arcout[1].ident != FIXED )
+        {
+            SET_ARC_TMP( ARC_HEAD( NODE_FIRSTOUT( ARC_HEAD( arcout ) ) ),
+                         first_of_sparse_list );
+            first_of_sparse_list = arcout + 1;
+        }
+        scan.sparse[i] = first_of_sparse_list;
+    }
+
+    scan.arcs = net->arcs;
+    scan.bigM_minus_min_impl_duration = bigM_minus_min_impl_duration;
+    scan.arc_cost = arc_cost;
+    scan.oom = 0;
+    for( scan.lo = i0; scan.lo < trips && !scan.oom; scan.lo = scan.hi )
+    {
+        scan.hi = MIN( scan.lo + PAR_TRIP_CHUNK, trips );
+        par_run( scan_trips, NULL );
+        for( t = 0; t < par_threads && !scan.oom; t++ )
+            for( k = 0, c = scan.buf[t]; k < scan.n[t]; k++, c++ )
+            {
+                if( *new_arcs < net->max_residual_new_m )
+                {
+                    insert_new_arc( arcnew, *new_arcs, c->tail, c->head, 
+                                    arc_cost, c->red_cost );
+                    (*new_arcs)++;
+                }
+                else if( (cost_t)arcnew[0].flow > c->red_cost )
+                    replace_weaker_arc( net, arcnew, c->tail, c->head, 
+                                        arc_cost, c->red_cost );
+            }
+    }
+
+    FREE( scan.sparse );
+    for( t = 0; t < par_threads; t++ )
+    {
+        FREE( scan.buf[t] );
+        scan.buf[t] = NULL;
+        scan.max[t] = 0;
+    }
+    return scan.oom ? -1 : 0;
+}
+#endif
+
+
+
+
 #if defined AT_HOME
 #include <sys/time.h>
 double Get_Time( void  ) 
@@ -212,6 +379,9 @@ long price_out_impl( net )
         
     register arc_t *arcout, *arcin, *arcnew, *stop;
     register arc_t *first_of_sparse_list;
+#if MCF_PREFETCH
+    arc_t *ahead;
+#endif
     register node_t *tail, *head;
 
 
@@ -261,32 +431,62 @@ long price_out_impl( net )
 
     arcout = net->arcs;
     for( i = 0; i < trips && arcout[1].ident == FIXED; i++, arcout += 3 );
+#ifdef MCF_PARALLEL
+    if( par_threads > 1 )
+    {
+        if( price_out_par( net, i, arcnew, &new_arcs,
+                           bigM_minus_min_impl_duration, arc_cost ) )
+            return -1;
+        goto COLLECTED;
+    }
+#endif
     first_of_sparse_list = (arc_t *)NULL;
     for( ; i < trips; i++, arcout += 3 )
     {
         if( arcout[1].ident != FIXED )
         {
-            arcout->head->firstout->head->arc_tmp = first_of_sparse_list;
+            SET_ARC_TMP( ARC_HEAD( NODE_FIRSTOUT( ARC_HEAD( arcout ) ) ),
+                         first_of_sparse_list );
             first_of_sparse_list = arcout + 1;
         }
         
         if( arcout->ident == FIXED )
             continue;
         
-        head = arcout->head;
-        latest = head->time - arcout->org_cost 
+#if MCF_PREFETCH
+        if( i + MCF_PREFETCH < trips )
+        {
+            PREFETCH( ARC_HEAD( arcout + 3 * MCF_PREFETCH ) );
+            PREFETCH( NODE_COLD( ARC_HEAD( arcout + 3 * MCF_PREFETCH ) ) );
+        }
+#endif
+        head = ARC_HEAD( arcout );
+        latest = NODE_COLD( head )->time - arcout->org_cost 
             + (long)bigM_minus_min_impl_duration;
                 
         head_potential = head->potential;
         
-        arcin = first_of_sparse_list->tail->arc_tmp;
+        arcin = NODE_ARC_TMP( ARC_TAIL( first_of_sparse_list ) );
         while( arcin )
         {
-            tail = arcin->tail;
+#if MCF_PREFETCH
+            /* the sparse list runs down the trip arcs (stride 3, less
+               the fixed ones): fetch the trip arc twice the distance
+               ahead, and the tail of the one at the distance */
+            ahead = arcin - 3 * MCF_PREFETCH;
+            if( ahead >= net->arcs )
+            {
+                PREFETCH( ARC_TAIL( ahead ) );
+                PREFETCH( NODE_COLD( ARC_TAIL( ahead ) ) );
+                if( ahead - 3 * MCF_PREFETCH >= net->arcs )
+                    PREFETCH( ahead - 3 * MCF_PREFETCH );
+            }
+#endif
+            tail = ARC_TAIL( arcin );
 
-            if( tail->time + arcin->org_cost > latest )
+            if( NODE_COLD( tail )->time + arcin->org_cost > latest )
             {
-                arcin = tail->arc_tmp;
+                arcin = NODE_ARC_TMP( tail );
                 continue;
             }
             
@@ -305,10 +505,13 @@ long price_out_impl( net )
                                         arc_cost, red_cost );
             }
 
-            arcin = tail->arc_tmp;
+            arcin = NODE_ARC_TMP( tail );
         }
     }
-    
+
+#ifdef MCF_PARALLEL
+COLLECTED:
+#endif
     if( new_arcs )
     {
         arcnew = net->stop_arcs;
@@ -328,10 +531,10 @@ long price_out_impl( net )
             {
                 arcnew->flow = (flow_t)0;
                 arcnew->ident = AT_LOWER;
-                arcnew->nextout = arcnew->tail->firstout;
-                arcnew->tail->firstout = arcnew;
-                arcnew->nextin = arcnew->head->firstin;
-                arcnew->head->firstin = arcnew;
+                SET_NEXTOUT( arcnew, NODE_FIRSTOUT( ARC_TAIL( arcnew ) ) );
+                SET_FIRSTOUT( ARC_TAIL( arcnew ), arcnew );
+                SET_NEXTIN( arcnew, NODE_FIRSTIN( ARC_HEAD( arcnew ) ) );
+                SET_FIRSTIN( ARC_HEAD( arcnew ), arcnew );
             }
         }
         
@@ -355,6 +558,55 @@ long price_out_impl( net )
 
 
 
+/* Drops the suspended (FIXED) implicit arcs, moving the others down in
+   order, and returns how many went */
+#ifdef _PROTO_
+static long compact_impl( network_t *net )
+#else
+static long compact_impl( net )
+     network_t *net;
+#endif
+{
+    arc_t *new_arc, *arc;
+    void *stop;
+    long dropped;
+
+
+    stop = (void *)net->stop_arcs;
+    new_arc = &(net->arcs[net->m - net->m_impl]);
+    for( dropped = 0, arc = new_arc; arc < (arc_t *)stop; arc++ )
+    {
+        if( arc->ident == FIXED )
+        {
+            dropped++;
+            continue;
+        }
+
+        if( arc->ident == BASIC )
+        {
+            if( NODE_BASIC_ARC( ARC_TAIL( arc ) ) == arc )
+                SET_BASIC_ARC( ARC_TAIL( arc ), new_arc );
+            else
+                SET_BASIC_ARC( ARC_HEAD( arc ), new_arc );
+        }
+
+        if( new_arc != arc )
+            *new_arc = *arc;
+        new_arc++;
+    }
+
+    return dropped;
+}
+
+
+
+
+/* Suspends the implicit arcs at their lower bound with reduced cost
+   above threshold (all of them if all), and returns how many. A
+   suspended arc is only marked FIXED, which pricing skips like a
+   closed input arc; the arc array is compacted, and the neighbour
+   lists rebuilt, once the marked arcs are more than 1/SUSPEND_COMPACT
+   of it, so suspending a few arcs costs no O(m) moves. */
 #ifdef _PROTO_
 long suspend_impl( network_t *net, cost_t threshold, long all )
 #else
@@ -364,60 +616,55 @@ long suspend_impl( net, threshold, all )
      long all;
 #endif
 {
-    long susp;
+    long susp, dropped = 0;
     
     cost_t red_cost;
-    arc_t *new_arc, *arc;
+    arc_t *arc;
     void *stop;
 
     
 
     if( all )
-        susp = net->m_impl;
+    {
+        susp = net->m_impl - net->m_dead;
+        dropped = net->m_impl;
+    }
     else
     {
         stop = (void *)net->stop_arcs;
-        new_arc = &(net->arcs[net->m - net->m_impl]);
-        for( susp = 0, arc = new_arc; arc < (arc_t *)stop; arc++ )
+        arc = &(net->arcs[net->m - net->m_impl]);
+        for( susp = 0; arc < (arc_t *)stop; arc++ )
         {
-            if( arc->ident == AT_LOWER )
-                red_cost = arc->cost - arc->tail->potential 
-                        + arc->head->potential;
-            else
-            {
-                red_cost = (cost_t)-2;
-                
-                if( arc->ident == BASIC )
-                {
-                    if( arc->tail->basic_arc == arc )
-                        arc->tail->basic_arc = new_arc;
-                    else
-                        arc->head->basic_arc = new_arc;
-                }
-            }
-            
+            if( arc->ident != AT_LOWER )
+                continue;
+
+            red_cost = arc->cost - ARC_TAIL( arc )->potential 
+                    + ARC_HEAD( arc )->potential;
             if( red_cost > threshold )
-                susp++;
-            else
             {
-                *new_arc = *arc;
-                new_arc++;
+                arc->ident = FIXED;
+                susp++;
             }
         }
+
+        net->m_dead += susp;
+        if( net->m_dead > net->m / SUSPEND_COMPACT )
+            dropped = compact_impl( net );
     }
     
         
 #if defined AT_HOME
-    printf( "\nremove %ld arcs\n\n", susp );
+    printf( "\nremove %ld arcs\n\n", dropped );
     fflush( stdout );
 #endif
 
-    if( susp )
+    if( dropped )
     {
-        net->m -= susp;
-        net->m_impl -= susp;
-        net->stop_arcs -= susp;
-        net->max_residual_new_m += susp;
+        net->m -= dropped;
+        net->m_impl -= dropped;
+        net->m_dead = 0;
+        net->stop_arcs -= dropped;
+        net->max_residual_new_m += dropped;
         
         refresh_neighbour_lists( net );
     }
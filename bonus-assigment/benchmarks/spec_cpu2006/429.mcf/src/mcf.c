@@ -22,19 +22,31 @@ Copyright (c) 2003-2005 Andreas Loebel.
 
 #include "mcf.h"
 
+/* the batch and benchmark drivers (mcfbatch.c, mcfbench.c) print one
+   line per instance instead */
+#if !defined MCF_BATCH && !defined MCF_BENCH
 #define REPORT
+#endif
 
 extern long min_impl_duration;
+#if !defined MCF_BATCH && !defined MCF_BENCH
 network_t net;
+#endif
 
 
 
 
 
+/* Solves net from its current basis: the artificial start of
+   primal_start_artificial, or the basis of an earlier solve as kept
+   by apply_arc_changes (resolve.h). All solver state lives in net,
+   so different networks may be solved on different threads at once
+   (see mcfbatch.c). Returns -1 without memory for new arcs. */
 #ifdef _PROTO_
-long global_opt( void )
+long global_opt( network_t *net )
 #else
-long global_opt( )
+long global_opt( net )
+    network_t *net;
 #endif
 {
     long new_arcs;
@@ -42,21 +54,21 @@ long global_opt( )
     
 
     new_arcs = -1;
-    residual_nb_it = net.n_trips <= MAX_NB_TRIPS_FOR_SMALL_NET ?
+    residual_nb_it = net->n_trips <= MAX_NB_TRIPS_FOR_SMALL_NET ?
         MAX_NB_ITERATIONS_SMALL_NET : MAX_NB_ITERATIONS_LARGE_NET;
 
     while( new_arcs )
     {
 #ifdef REPORT
-        printf( "active arcs                : %ld\n", net.m );
+        printf( "active arcs                : %ld\n", net->m );
 #endif
 
-        primal_net_simplex( &net );
+        primal_net_simplex( net );
 
 
 #ifdef REPORT
-        printf( "simplex iterations         : %ld\n", net.iterations );
-        printf( "objective value            : %0.0f\n", flow_cost(&net) );
+        printf( "simplex iterations         : %ld\n", net->iterations );
+        printf( "objective value            : %0.0f\n", flow_cost(net) );
 #endif
 
 
@@ -68,9 +80,9 @@ long global_opt( )
             break;
 
 
-        if( net.m_impl )
+        if( net->m_impl )
         {
-          new_arcs = suspend_impl( &net, (cost_t)-1, 0 );
+          new_arcs = suspend_impl( net, (cost_t)-1, 0 );
 
 #ifdef REPORT
           if( new_arcs )
@@ -79,7 +91,9 @@ long global_opt( )
         }
 
 
-        new_arcs = price_out_impl( &net );
+        BENCH_BEGIN( net->bench_price_impl );
+        new_arcs = price_out_impl( net );
+        BENCH_END( net->bench_price_impl );
 
 #ifdef REPORT
         if( new_arcs )
@@ -92,10 +106,10 @@ long global_opt( )
             printf( "not enough memory, exit(-1)\n" );
 #endif
 
-            exit(-1);
+            return -1;
         }
 
-#ifndef REPORT
+#if !defined REPORT && !defined MCF_BATCH && !defined MCF_BENCH
         printf( "\n" );
 #endif
 
@@ -103,7 +117,9 @@ long global_opt( )
         residual_nb_it--;
     }
 
-    printf( "checksum                   : %ld\n", net.checksum );
+#if !defined MCF_BATCH && !defined MCF_BENCH
+    printf( "checksum                   : %ld\n", net->checksum );
+#endif
 
     return 0;
 }
@@ -113,6 +129,7 @@ long global_opt( )
 
 
 
+#if !defined MCF_BATCH && !defined MCF_BENCH
 #ifdef _PROTO_
 int main( int argc, char *argv[] )
 #else
@@ -137,6 +154,20 @@ int main( argc, argv )
     net.bigM = (long)BIGM;
 
     strcpy( net.inputfile, argv[1] );
+
+    /* optional pricing kernel, PRICE_* in pbeampp.h (default: auto) */
+    if( argc > 2 && set_pricing_kernel( atol( argv[2] ) ) )
+    {
+        printf( "pricing kernel %s not available, exit\n", argv[2] );
+        return -1;
+    }
+
+    /* optional pricing threads, needs a -DMCF_PARALLEL build (default: 1) */
+    if( argc > 3 && par_init( atol( argv[3] ) ) )
+    {
+        printf( "%s pricing threads not available, exit\n", argv[3] );
+        return -1;
+    }
     
     if( read_min( &net ) )
     {
@@ -151,8 +182,11 @@ int main( argc, argv )
 #endif
 
 
+    ROI_BEGIN();
     primal_start_artificial( &net );
-    global_opt( );
+    if( global_opt( &net ) )
+        exit(-1);
+    ROI_END();
 
 
 #ifdef REPORT
@@ -169,5 +203,7 @@ int main( argc, argv )
 
 
     getfree( &net );
+    par_exit( );
     return 0;
 }
+#endif
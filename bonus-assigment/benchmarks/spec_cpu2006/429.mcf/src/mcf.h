@@ -32,7 +32,12 @@ Copyright (c) 2003-2005 Andreas Loebel.
 #include "psimplex.h"
 #include "pbeampp.h"
 #include "implicit.h"
+#include "mcfpar.h"
+#include "resolve.h"
 #include "limits.h"
 
 
+extern long global_opt _PROTO_(( network_t * ));
+
+
 #endif
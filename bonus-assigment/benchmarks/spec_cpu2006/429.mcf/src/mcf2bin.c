@@ -0,0 +1,113 @@
+/**************************************************************************
+MCF2BIN.C: converts an MCF instance from the text format read by
+read_min (readmin.c) into the binary format described in readmin.h
+
+usage: mcf2bin <text input> <binary output>
+**************************************************************************/
+
+
+#include "readmin.h"
+
+
+
+
+#ifdef _PROTO_
+static long convert( FILE *in, FILE *out )
+#else
+static long convert( in, out )
+     FILE *in;
+     FILE *out;
+#endif
+{
+    char instring[201];
+    mcf_bin_header_t hdr;
+    long t, h, c;
+    long i;
+    int rec[3];
+
+
+    if( !fgets( instring, 200, in ) 
+        || sscanf( instring, "%ld %ld", &t, &h ) != 2 
+        || t < 0 || h < 0 || t > INT_MAX || h > INT_MAX )
+        return -1;
+
+    memcpy( hdr.magic, MCF_BIN_MAGIC, 4 );
+    hdr.version = MCF_BIN_VERSION;
+    hdr.n_trips = (int)t;
+    hdr.m_org = (int)h;
+    if( fwrite( &hdr, sizeof(hdr), 1, out ) != 1 )
+        return -1;
+
+    for( i = 0; i < hdr.n_trips; i++ )
+    {
+        if( !fgets( instring, 200, in ) 
+            || sscanf( instring, "%ld %ld", &t, &h ) != 2 || t > h 
+            || t < INT_MIN || h > INT_MAX )
+            return -1;
+        rec[0] = (int)t;
+        rec[1] = (int)h;
+        if( fwrite( rec, sizeof(int), 2, out ) != 2 )
+            return -1;
+    }
+
+    for( i = 0; i < hdr.m_org; i++ )
+    {
+        if( !fgets( instring, 200, in ) 
+            || sscanf( instring, "%ld %ld %ld", &t, &h, &c ) != 3 
+            || t < 1 || t > hdr.n_trips || h < 1 || h > hdr.n_trips
+            || c < INT_MIN || c > INT_MAX )
+            return -1;
+        rec[0] = (int)t;
+        rec[1] = (int)h;
+        rec[2] = (int)c;
+        if( fwrite( rec, sizeof(int), 3, out ) != 3 )
+            return -1;
+    }
+
+    return 0;
+}
+
+
+
+
+#ifdef _PROTO_
+int main( int argc, char *argv[] )
+#else
+int main( argc, argv )
+    int argc;
+    char *argv[];
+#endif
+{
+    FILE *in, *out;
+    long ret;
+
+
+    if( argc != 3 )
+    {
+        printf( "usage: %s <text input> <binary output>\n", argv[0] );
+        return -1;
+    }
+
+    if(( in = fopen( argv[1], "r" )) == NULL )
+    {
+        printf( "cannot open %s\n", argv[1] );
+        return -1;
+    }
+    if(( out = fopen( argv[2], "wb" )) == NULL )
+    {
+        printf( "cannot create %s\n", argv[2] );
+        fclose( in );
+        return -1;
+    }
+
+    ret = convert( in, out );
+    fclose( in );
+    if( fclose( out ) || ret )
+    {
+        printf( "%s: conversion failed\n", argv[1] );
+        remove( argv[2] );
+        return -1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,194 @@
+/**************************************************************************
+MCFBATCH.C: solves independent MCF instances concurrently
+
+usage: specmcf_batch <threads> <input>...
+
+Each of the threads (<= 0: one per online CPU) takes the next instance
+not yet started, solves it as main in mcf.c does and writes its
+circulations to <input>.out. When all are done one line per instance
+is printed, in the order given.
+
+Built with -DMCF_BATCH (make batch), which leaves main out of mcf.c
+and makes the little state a solve keeps outside its network_t (the
+MCF_COMPACT bases, the MCF_HUGEPAGES block table) thread-local. Every
+worker reuses one network_t of its own, and its nodes and arcs come
+from its own malloc arena or mappings, so the solves share nothing.
+**************************************************************************/
+
+
+#include "mcf.h"
+
+#include <pthread.h>
+#include <time.h>
+
+#ifdef MCF_PARALLEL
+#error "the pricing pool of mcfpar.c serves one solve; build without -DMCF_PARALLEL"
+#endif
+
+#define BATCH_MAX_THREADS 256
+
+
+typedef struct batch_result
+{
+    const char *error;          /* NULL: solved */
+    long n_trips;
+    long iterations;
+    double objective;
+    long checksum;
+    double secs;
+} batch_result_t;
+
+
+static char **batch_input;
+static batch_result_t *batch_result;
+static long batch_n;
+static long batch_next;
+
+
+
+
+static double batch_time( void )
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1.0e9;
+}
+
+
+
+
+static void batch_solve( network_t *net, long i )
+{
+    batch_result_t *r = &batch_result[i];
+    char outfile[sizeof(net->inputfile) + 4];
+    double start = batch_time();
+
+    memset( (void *)net, 0, (size_t)sizeof(network_t) );
+    net->bigM = (long)BIGM;
+
+    if( strlen( batch_input[i] ) >= sizeof(net->inputfile) )
+    {
+        r->error = "file name too long";
+        return;
+    }
+    strcpy( net->inputfile, batch_input[i] );
+    sprintf( outfile, "%s.out", net->inputfile );
+
+    if( read_min( net ) )
+        r->error = "read error";
+    else
+    {
+        primal_start_artificial( net );
+        if( global_opt( net ) )
+            r->error = "not enough memory";
+        else
+        {
+            /* flow_cost also sets the arc flows write_circulations
+               follows (with REPORT, global_opt has called it) */
+            r->objective = flow_cost( net );
+            r->n_trips = net->n_trips;
+            r->iterations = net->iterations;
+            r->checksum = net->checksum;
+            if( write_circulations( outfile, net ) )
+                r->error = "write error";
+        }
+    }
+    getfree( net );
+    r->secs = batch_time() - start;
+}
+
+
+
+
+static void *batch_loop( void *arg )
+{
+    network_t *net;
+    long i;
+
+    if( !(net = (network_t *) malloc( sizeof(network_t) )) )
+        return (void *)-1;
+
+    while( (i = __atomic_fetch_add( &batch_next, 1, __ATOMIC_RELAXED ))
+           < batch_n )
+        batch_solve( net, i );
+
+    free( net );
+    return NULL;
+}
+
+
+
+
+int main( int argc, char *argv[] )
+{
+    pthread_t worker[BATCH_MAX_THREADS];
+    long threads, t, i;
+    long failed = 0;
+    void *ret;
+    double start;
+
+
+    if( argc < 3 )
+    {
+        printf( "usage: %s <threads> <input>...\n", argv[0] );
+        return -1;
+    }
+
+    batch_input = argv + 2;
+    batch_n = argc - 2;
+    batch_result = (batch_result_t *) calloc( batch_n,
+                                              sizeof(batch_result_t) );
+    if( !batch_result )
+    {
+        printf( "not enough memory, exit\n" );
+        return -1;
+    }
+
+    threads = atol( argv[1] );
+    if( threads <= 0 )
+        threads = sysconf( _SC_NPROCESSORS_ONLN );
+    threads = MAX( 1, MIN( threads, MIN( batch_n, BATCH_MAX_THREADS ) ) );
+
+    /* pick the kernel once, not racing in the first pricing calls */
+    set_pricing_kernel( PRICE_AUTO );
+
+    start = batch_time();
+    for( t = 0; t < threads; t++ )
+        if( pthread_create( &worker[t], NULL, batch_loop, NULL ) )
+            break;
+    if( !t )
+    {
+        printf( "cannot start threads, exit\n" );
+        return -1;
+    }
+    threads = t;
+    for( t = 0; t < threads; t++ )
+    {
+        pthread_join( worker[t], &ret );
+        if( ret )
+            failed = 1;
+    }
+
+    for( i = 0; i < batch_n; i++ )
+    {
+        if( !batch_result[i].error && i >= batch_next )
+            batch_result[i].error = "not solved";
+        if( batch_result[i].error )
+        {
+            printf( "%s: %s\n", batch_input[i], batch_result[i].error );
+            failed = 1;
+        }
+        else
+            printf( "%s: trips %ld, iterations %ld, objective %0.0f, "
+                    "checksum %ld, %.3f s\n", batch_input[i],
+                    batch_result[i].n_trips, batch_result[i].iterations,
+                    batch_result[i].objective, batch_result[i].checksum,
+                    batch_result[i].secs );
+    }
+    printf( "%ld instances on %ld threads: %.3f s\n", batch_n, threads,
+            batch_time() - start );
+
+    free( batch_result );
+    return failed ? -1 : 0;
+}
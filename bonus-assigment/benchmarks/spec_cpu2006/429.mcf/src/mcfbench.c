@@ -0,0 +1,234 @@
+/**************************************************************************
+MCFBENCH.C: times global_opt on generated instances of growing size
+
+usage: specmcf_bench [-k kernel] [-t threads] [-s seed] <arcs per trip>
+                     <trips>...
+
+For each trip count mcfgen (mcfgen.c) writes an instance with about
+<arcs per trip> deadhead arcs per trip to a file in $TMPDIR (default
+/tmp), and a child process reads and solves it as main in mcf.c does,
+with pricing kernel PRICE_* of pbeampp.h (default: auto) and, in a
+-DMCF_PARALLEL build, the given pricing threads. One line per size
+gives the wall time of the solve (read_min excluded), the simplex
+iterations, the share of that time in primal_bea_mpp and in
+price_out_impl, and the child's peak resident set, read_min included.
+Each size runs in a fresh process, so its peak is its own.
+
+Built with -DMCF_BENCH (make bench), which leaves main out of mcf.c
+and mcfgen.c and quiets global_opt as -DMCF_BATCH does, but keeps the
+solve's state global, so a -DMCF_PARALLEL build works too; BENCH_FLAGS
+adds the options of the build to measure, e.g. make bench
+BENCH_FLAGS="-DMCF_PARALLEL -DMCF_COMPACT".
+**************************************************************************/
+
+
+#include "mcf.h"
+#include "mcfgen.h"
+
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+
+
+typedef struct bench_result
+{
+    char error[64];             /* "": solved */
+    long m_org;
+    long iterations;
+    double objective;
+    double secs;
+    double price_secs;
+    double price_impl_secs;
+} bench_result_t;
+
+
+
+
+double bench_time( void )
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1.0e9;
+}
+
+
+
+
+static void bench_solve( const char *file, long kernel, long threads,
+                         bench_result_t *r )
+{
+    network_t *net;
+    double start;
+
+    memset( (void *)r, 0, sizeof(bench_result_t) );
+    if( set_pricing_kernel( kernel ) )
+    {
+        strcpy( r->error, "pricing kernel not available" );
+        return;
+    }
+    if( par_init( threads ) )
+    {
+        strcpy( r->error, "pricing threads not available" );
+        return;
+    }
+    if( !(net = (network_t *) calloc( 1, sizeof(network_t) )) )
+    {
+        strcpy( r->error, "not enough memory" );
+        return;
+    }
+    net->bigM = (long)BIGM;
+    strcpy( net->inputfile, file );
+
+    if( read_min( net ) )
+        strcpy( r->error, "read error" );
+    else
+    {
+        start = bench_time();
+        primal_start_artificial( net );
+        if( global_opt( net ) )
+            strcpy( r->error, "not enough memory" );
+        r->secs = bench_time() - start;
+        r->m_org = net->m_org;
+        r->iterations = net->iterations;
+        r->objective = flow_cost( net );
+        r->price_secs = net->bench_price;
+        r->price_impl_secs = net->bench_price_impl;
+    }
+    getfree( net );
+    free( net );
+}
+
+
+
+
+/* Solves file in a child, for a peak resident set of its own */
+static long bench_run( const char *file, long kernel, long threads,
+                       bench_result_t *r, long *peak_kb )
+{
+    struct rusage ru;
+    int fd[2], status;
+    pid_t pid;
+    long got;
+
+    if( pipe( fd ) )
+        return -1;
+    fflush( stdout );
+    if( (pid = fork()) < 0 )
+    {
+        close( fd[0] );
+        close( fd[1] );
+        return -1;
+    }
+    if( !pid )
+    {
+        close( fd[0] );
+        bench_solve( file, kernel, threads, r );
+        _exit( write( fd[1], r, sizeof(bench_result_t) )
+               == (ssize_t)sizeof(bench_result_t) ? 0 : 1 );
+    }
+
+    close( fd[1] );
+    got = (long)read( fd[0], r, sizeof(bench_result_t) );
+    close( fd[0] );
+    if( wait4( pid, &status, 0, &ru ) != pid
+        || got != (long)sizeof(bench_result_t) )
+        return -1;
+    *peak_kb = (long)ru.ru_maxrss;
+    return 0;
+}
+
+
+
+
+int main( int argc, char *argv[] )
+{
+    char file[sizeof(((network_t *)0)->inputfile)];
+    const char *tmpdir = getenv( "TMPDIR" );
+    bench_result_t r;
+    long kernel = PRICE_AUTO, threads = 1, per_trip, trips, peak_kb;
+    long failed = 0, written;
+    unsigned int seed = 1;
+    FILE *out;
+    int opt, fd, i;
+
+
+    while( (opt = getopt( argc, argv, "k:t:s:" )) != -1 )
+        switch( opt )
+        {
+        case 'k':
+            kernel = atol( optarg );
+            break;
+        case 't':
+            threads = atol( optarg );
+            break;
+        case 's':
+            seed = (unsigned int)atol( optarg );
+            break;
+        default:
+            optind = argc;
+            break;
+        }
+    if( argc - optind < 2 || (per_trip = atol( argv[optind] )) < 0 )
+    {
+        printf( "usage: %s [-k kernel] [-t threads] [-s seed] "
+                "<arcs per trip> <trips>...\n", argv[0] );
+        return -1;
+    }
+
+    if( !tmpdir || !*tmpdir )
+        tmpdir = "/tmp";
+    if( strlen( tmpdir ) + sizeof("/mcfbenchXXXXXX") > sizeof(file) )
+    {
+        printf( "TMPDIR too long, exit\n" );
+        return -1;
+    }
+
+    for( i = optind + 1; i < argc; i++ )
+    {
+        if( (trips = atol( argv[i] )) < 1 )
+        {
+            printf( "%s: not a trip count\n", argv[i] );
+            failed = 1;
+            continue;
+        }
+
+        sprintf( file, "%s/mcfbenchXXXXXX", tmpdir );
+        if( (fd = mkstemp( file )) < 0 || !(out = fdopen( fd, "w" )) )
+        {
+            printf( "cannot create %s, exit\n", file );
+            return -1;
+        }
+        written = mcfgen( out, trips, per_trip * trips, seed );
+        if( fclose( out ) || written < 0 )
+        {
+            printf( "trips %ld: cannot write %s\n", trips, file );
+            remove( file );
+            failed = 1;
+            continue;
+        }
+
+        if( bench_run( file, kernel, threads, &r, &peak_kb ) )
+        {
+            printf( "trips %ld: solve failed\n", trips );
+            failed = 1;
+        }
+        else if( r.error[0] )
+        {
+            printf( "trips %ld: %s\n", trips, r.error );
+            failed = 1;
+        }
+        else
+            printf( "trips %ld, arcs %ld: %.3f s, iterations %ld, "
+                    "objective %0.0f, pricing %.1f %%, price_out_impl "
+                    "%.1f %%, peak RSS %.1f MB\n", trips, r.m_org, r.secs,
+                    r.iterations, r.objective,
+                    r.secs > 0 ? 100.0 * r.price_secs / r.secs : 0.0,
+                    r.secs > 0 ? 100.0 * r.price_impl_secs / r.secs : 0.0,
+                    (double)peak_kb / 1024.0 );
+        remove( file );
+    }
+
+    return failed ? -1 : 0;
+}
@@ -0,0 +1,231 @@
+/**************************************************************************
+MCFGEN.C: writes a synthetic MCF instance shaped like data/inp.in
+
+usage: mcfgen <trips> <arcs> [seed] > <text input>
+
+The trips start uniformly over the service day of inp.in (minute 240
+to 1470) and last 2 to 80 minutes, mostly about 40; the file lists
+them by start. Each trip gets about arcs / trips deadhead arcs from
+trips that end at most GEN_WINDOW minutes before it starts, spread
+over that window and costing the idle time give or take 20; one in
+GEN_PENALTY_ODDS costs GEN_PENALTY more, as do 7 % of those of inp.in.
+How many a trip gets is exponentially distributed, which matches the
+in-degrees of inp.in (median 8, a tenth with 3 or fewer) and leaves
+enough trips poorly connected that the implicit arcs of price_out_impl
+matter. A trip with fewer reachable predecessors gets all of them, so
+small instances may fall short of arcs (the count written goes to
+stderr). The same arguments always give the same
+file. Built into specmcf_bench with -DMCF_BENCH, which leaves main out
+(see mcfbench.c).
+**************************************************************************/
+
+
+#include "mcfgen.h"
+
+
+#define GEN_DAY_START     240
+#define GEN_DAY_END      1470
+#define GEN_WINDOW         60
+#define GEN_PENALTY 100000000
+#define GEN_PENALTY_ODDS   14
+
+
+
+
+/* xorshift32: the same stream on 32 and 64 bit longs */
+#ifdef _PROTO_
+static unsigned int gen_rand( unsigned int *state )
+#else
+static unsigned int gen_rand( state )
+     unsigned int *state;
+#endif
+{
+    unsigned int x = *state;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+
+
+
+/* order[] = trip numbers (0 based) by time[], a minute of the day or
+   up to 81 past its end; a counting sort, so equal times keep order */
+#define GEN_TIMES ( GEN_DAY_END + 82 )
+
+#ifdef _PROTO_
+static void sort_by_time( long *order, long *time, long trips )
+#else
+static void sort_by_time( order, time, trips )
+     long *order;
+     long *time;
+     long trips;
+#endif
+{
+    long count[GEN_TIMES];
+    long i, t;
+
+    memset( (void *)count, 0, sizeof(count) );
+    for( i = 0; i < trips; i++ )
+        count[time[i] + 1]++;
+    for( t = 1; t < GEN_TIMES; t++ )
+        count[t] += count[t - 1];
+    for( i = 0; i < trips; i++ )
+        order[count[time[i]]++] = i;
+}
+
+
+
+
+/* First of by_end[0, trips) ending at time or later */
+#ifdef _PROTO_
+static long first_end( long *by_end, long *end, long trips, long time )
+#else
+static long first_end( by_end, end, trips, time )
+     long *by_end;
+     long *end;
+     long trips;
+     long time;
+#endif
+{
+    long lo = 0, hi = trips, mid;
+
+    while( lo < hi )
+    {
+        mid = lo + (hi - lo) / 2;
+        if( end[by_end[mid]] < time )
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+
+
+
+#ifdef _PROTO_
+long mcfgen( FILE *out, long trips, long arcs, unsigned int seed )
+#else
+long mcfgen( out, trips, arcs, seed )
+     FILE *out;
+     long trips;
+     long arcs;
+     unsigned int seed;
+#endif
+{
+    unsigned int state = seed ? seed : 1;
+    long *start, *end, *by_end, *want;
+    long h, i, k, lo, hi, range, step, slice, t;
+    long cost, written = 0;
+
+
+    start = (long *) malloc( trips * sizeof(long) );
+    end = (long *) malloc( trips * sizeof(long) );
+    by_end = (long *) malloc( trips * sizeof(long) );
+    want = (long *) malloc( trips * sizeof(long) );
+    if( !start || !end || !by_end || !want )
+    {
+        FREE( start );
+        FREE( end );
+        FREE( by_end );
+        FREE( want );
+        return -1;
+    }
+
+    /* uniform starts, sorted */
+    for( i = 0; i < trips; i++ )
+        start[i] = GEN_DAY_START
+            + (long)(gen_rand( &state ) % (GEN_DAY_END - GEN_DAY_START + 1));
+    sort_by_time( by_end, start, trips );
+    for( i = 0; i < trips; i++ )
+        end[i] = start[by_end[i]];
+    for( i = 0; i < trips; i++ )
+    {
+        start[i] = end[i];
+        end[i] = start[i] + 2 + (long)(gen_rand( &state ) % 40)
+            + (long)(gen_rand( &state ) % 40);
+    }
+    sort_by_time( by_end, end, trips );
+
+    /* the arc count comes first, so count before drawing */
+    for( h = 0; h < trips; h++ )
+    {
+        range = first_end( by_end, end, trips, start[h] + 1 )
+            - first_end( by_end, end, trips, start[h] - GEN_WINDOW );
+        want[h] = (long)( -log( ((double)gen_rand( &state ) + 1.0)
+                                / 4294967296.0 ) * arcs / trips + 0.5 );
+        want[h] = MIN( want[h], range );
+        written += want[h];
+    }
+    if( fprintf( out, "%ld %ld\n", trips, written ) < 0 )
+        written = -1;
+
+    for( i = 0; i < trips && written >= 0; i++ )
+        if( fprintf( out, "%ld %ld\n", start[i], end[i] ) < 0 )
+            written = -1;
+
+    /* want of the range, one from each of want equal slices (the last
+       takes the remainder) */
+    for( h = 0; h < trips && written >= 0; h++ )
+    {
+        lo = first_end( by_end, end, trips, start[h] - GEN_WINDOW );
+        hi = first_end( by_end, end, trips, start[h] + 1 );
+        range = hi - lo;
+        for( k = 0; k < want[h]; k++ )
+        {
+            step = range / want[h];
+            slice = ( k < want[h] - 1 ) ? step : range - k * step;
+            i = lo + k * step + (long)(gen_rand( &state ) % slice);
+            t = by_end[i];
+            cost = start[h] - end[t] + (long)(gen_rand( &state ) % 41) - 20;
+            if( gen_rand( &state ) % GEN_PENALTY_ODDS == 0 )
+                cost += GEN_PENALTY;
+            if( fprintf( out, "%ld %ld %ld\n", t + 1, h + 1, cost ) < 0 )
+                written = -1;
+        }
+    }
+
+    free( start );
+    free( end );
+    free( by_end );
+    free( want );
+    return written;
+}
+
+
+
+
+#ifndef MCF_BENCH
+#ifdef _PROTO_
+int main( int argc, char *argv[] )
+#else
+int main( argc, argv )
+    int argc;
+    char *argv[];
+#endif
+{
+    long trips, arcs, written;
+
+
+    if( argc < 3 || argc > 4
+        || (trips = atol( argv[1] )) < 1 || (arcs = atol( argv[2] )) < 0 )
+    {
+        fprintf( stderr, "usage: %s <trips> <arcs> [seed]\n", argv[0] );
+        return -1;
+    }
+
+    written = mcfgen( stdout, trips, arcs,
+                      argc > 3 ? (unsigned int)atol( argv[3] ) : 1 );
+    if( fflush( stdout ) || written < 0 )
+    {
+        fprintf( stderr, "write error\n" );
+        return -1;
+    }
+    fprintf( stderr, "%ld trips, %ld arcs\n", trips, written );
+
+    return 0;
+}
+#endif
@@ -0,0 +1,19 @@
+/**************************************************************************
+MCFGEN.H: synthetic vehicle scheduling instances in the text format read
+by read_min (readmin.c), see mcfgen.c
+**************************************************************************/
+
+
+#ifndef _MCFGEN_H
+#define _MCFGEN_H
+
+
+#include "defines.h"
+
+
+/* Writes an instance of trips trips and about arcs arcs drawn from
+   seed to out; returns the arcs written, -1 on a write error */
+extern long mcfgen _PROTO_(( FILE *, long, long, unsigned int ));
+
+
+#endif
@@ -34,6 +34,10 @@ Copyright (c) 2003-2005 Andreas Loebel.
 #define MAX_NB_ITERATIONS_SMALL_NET  5
 #define MAX_NB_ITERATIONS_LARGE_NET  5
 
+/* suspend_impl compacts the arc array once more than 1/SUSPEND_COMPACT
+   of it are suspended arcs */
+#define SUSPEND_COMPACT 8
+
 
 /*
 // Some operating systems and compiler, respectively, do not handle reallocs
@@ -0,0 +1,274 @@
+/**************************************************************************
+MCFMEM.C of ZIB optimizer MCF, SPEC version
+
+Each huge-page block is either a hugetlb mapping of fixed size or a
+PROT_NONE reservation whose first size bytes are read-write and
+advised MADV_HUGEPAGE. Growing a reserved block only extends the
+read-write part, so its address never changes; past the reservation
+mremap moves the read-write part (page tables, no copy) into a fresh
+reservation twice as large. hugetlb mappings cannot grow, so blocks
+that are given a reserve always take the THP path.
+**************************************************************************/
+
+
+
+#ifdef MCF_HUGEPAGES
+#define _GNU_SOURCE             /* mremap */
+#endif
+
+#include "mcfmem.h"
+
+
+#ifndef MCF_HUGEPAGES
+
+
+void *mem_alloc( size_t size, size_t reserve )
+{
+    return calloc( 1, size );
+}
+
+
+
+void *mem_realloc( void *p, size_t size )
+{
+    return realloc( p, size );
+}
+
+
+
+void mem_free( void *p )
+{
+    free( p );
+}
+
+
+#else
+
+
+#include <string.h>
+#include <sys/mman.h>
+
+#ifndef MAP_NORESERVE
+#define MAP_NORESERVE 0
+#endif
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+#ifndef MAP_HUGE_2MB
+#define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#endif
+#ifndef MAP_HUGE_1GB
+#define MAP_HUGE_1GB (30 << MAP_HUGE_SHIFT)
+#endif
+
+#define MEM_HUGE_2M ((size_t)1 << 21)
+#define MEM_HUGE_1G ((size_t)1 << 30)
+#define MEM_ROUND( x, a ) (((x) + (a) - 1) & ~((a) - 1))
+
+#define MEM_MAX_BLOCKS 8
+
+
+typedef struct mem_block
+{
+    char *p;
+    size_t size;                /* read-write bytes */
+    size_t reserve;             /* mapped bytes, size <= reserve */
+    int tlb;                    /* hugetlb mapping, cannot grow */
+} mem_block_t;
+
+
+/* per thread, like the blocks a solve allocates (see MCF_TLS) */
+static MCF_TLS mem_block_t mem_block[MEM_MAX_BLOCKS];
+
+
+
+
+static mem_block_t *mem_find( void *p )
+{
+    long i;
+
+    for( i = 0; i < MEM_MAX_BLOCKS; i++ )
+        if( mem_block[i].p == (char *)p )
+            return &mem_block[i];
+    return NULL;
+}
+
+
+
+
+#ifdef MAP_HUGETLB
+static char *mem_hugetlb( size_t *size )
+{
+    size_t page = *size >= MEM_HUGE_1G ? MEM_HUGE_1G : MEM_HUGE_2M;
+    int flag = page == MEM_HUGE_1G ? MAP_HUGE_1GB : MAP_HUGE_2MB;
+    void *p;
+
+    p = mmap( NULL, MEM_ROUND( *size, page ), PROT_READ | PROT_WRITE,
+              MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | flag, -1, 0 );
+    if( p == MAP_FAILED && page == MEM_HUGE_1G )
+    {
+        page = MEM_HUGE_2M;
+        p = mmap( NULL, MEM_ROUND( *size, page ), PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_HUGE_2MB,
+                  -1, 0 );
+    }
+    if( p == MAP_FAILED )
+        return NULL;
+    *size = MEM_ROUND( *size, page );
+    return (char *)p;
+}
+#endif
+
+
+
+
+/* PROT_NONE reservation of reserve bytes on a 2 MB boundary, so THP can
+   back it from the first byte */
+static char *mem_reserve( size_t reserve )
+{
+    char *p, *q;
+
+    p = (char *)mmap( NULL, reserve + MEM_HUGE_2M, PROT_NONE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0 );
+    if( p == (char *)MAP_FAILED )
+        return NULL;
+    q = (char *)MEM_ROUND( (size_t)p, MEM_HUGE_2M );
+    if( q > p )
+        munmap( p, q - p );
+    munmap( q + reserve, p + MEM_HUGE_2M - q );
+    return q;
+}
+
+
+
+
+/* Make [from, to) of b read-write */
+static long mem_commit( mem_block_t *b, size_t from, size_t to )
+{
+    if( to <= from )
+        return 0;
+    if( mprotect( b->p + from, to - from, PROT_READ | PROT_WRITE ) )
+        return -1;
+#ifdef MADV_HUGEPAGE
+    madvise( b->p + from, to - from, MADV_HUGEPAGE );
+#endif
+    return 0;
+}
+
+
+
+
+void *mem_alloc( size_t size, size_t reserve )
+{
+    mem_block_t *b = mem_find( NULL );
+
+    if( !b || !size )
+        return NULL;
+
+    size = MEM_ROUND( size, MEM_HUGE_2M );
+    reserve = MEM_ROUND( reserve, MEM_HUGE_2M );
+
+    b->tlb = 0;
+#ifdef MAP_HUGETLB
+    if( reserve <= size )
+    {
+        b->reserve = size;
+        if( (b->p = mem_hugetlb( &b->reserve )) )
+        {
+            b->size = b->reserve;
+            b->tlb = 1;
+            return b->p;
+        }
+    }
+#endif
+
+    if( reserve < size )
+        reserve = size;
+    if( !(b->p = mem_reserve( reserve )) && reserve > size )
+        b->p = mem_reserve( reserve = size );
+    if( !b->p )
+        return NULL;
+    b->size = 0;
+    b->reserve = reserve;
+    if( mem_commit( b, 0, size ) )
+    {
+        munmap( b->p, reserve );
+        b->p = NULL;
+        return NULL;
+    }
+    b->size = size;
+    return b->p;
+}
+
+
+
+
+void *mem_realloc( void *p, size_t size )
+{
+    mem_block_t *b;
+    char *q;
+    size_t reserve;
+
+    if( !p )
+        return mem_alloc( size, size );
+    if( !(b = mem_find( p )) )
+        return NULL;
+
+    size = MEM_ROUND( size, MEM_HUGE_2M );
+    if( size <= b->size )
+        return p;
+
+    if( b->tlb )
+    {
+        if( !(q = (char *)mem_alloc( size, 2 * size )) )
+            return NULL;
+        memcpy( q, b->p, b->size );
+        mem_free( p );
+        return q;
+    }
+
+    if( size > b->reserve )
+    {
+        reserve = MAX( size, 2 * b->reserve );
+        if( !(q = mem_reserve( reserve )) )
+            return NULL;
+        if( mremap( b->p, b->size, b->size, MREMAP_MAYMOVE | MREMAP_FIXED, q )
+            == MAP_FAILED )
+        {
+            /* read-write part split over several mappings: copy it */
+            mem_block_t t = *b;
+            t.p = q;
+            if( mem_commit( &t, 0, b->size ) )
+            {
+                munmap( q, reserve );
+                return NULL;
+            }
+            memcpy( q, b->p, b->size );
+            munmap( b->p, b->size );
+        }
+        munmap( b->p + b->size, b->reserve - b->size );
+        b->p = q;
+        b->reserve = reserve;
+    }
+
+    if( mem_commit( b, b->size, size ) )
+        return NULL;
+    b->size = size;
+    return b->p;
+}
+
+
+
+
+void mem_free( void *p )
+{
+    mem_block_t *b;
+
+    if( !p || !(b = mem_find( p )) )
+        return;
+    munmap( b->p, b->reserve );
+    b->p = NULL;
+}
+
+
+#endif
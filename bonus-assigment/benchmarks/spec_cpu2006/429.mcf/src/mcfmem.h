@@ -0,0 +1,28 @@
+/**************************************************************************
+MCFMEM.H of ZIB optimizer MCF, SPEC version
+
+Allocation of the node and arc arrays. Built with -DMCF_HUGEPAGES the
+arrays are mapped on huge pages: hugetlb pages (1 GB or 2 MB) where the
+kernel has a pool reserved, otherwise transparent huge pages requested
+with madvise. The arc array is placed in an address reservation of its
+own so resize_prob grows it in place. Without the flag these are
+calloc, realloc and free.
+**************************************************************************/
+
+
+
+#ifndef _MCFMEM_H
+#define _MCFMEM_H
+
+
+#include "defines.h"
+
+
+/* Zeroed block of size bytes; reserve > size keeps address space for
+   mem_realloc to grow into without moving the block. */
+extern void *mem_alloc _PROTO_(( size_t size, size_t reserve ));
+extern void *mem_realloc _PROTO_(( void *p, size_t size ));
+extern void mem_free _PROTO_(( void *p ));
+
+
+#endif
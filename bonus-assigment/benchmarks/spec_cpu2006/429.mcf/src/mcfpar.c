@@ -0,0 +1,176 @@
+/**************************************************************************
+MCFPAR.C of ZIB optimizer MCF, SPEC version
+
+par_run( fn, arg ) calls fn( arg, t ) for t = 0 .. par_threads-1, t = 0
+on the calling thread, and returns once all have returned. Pricing
+calls it once per simplex iteration with a few microseconds of work,
+so workers spin on the round counter for a while before sleeping on
+the condition variable, and the caller spins (yielding) for the
+stragglers.
+**************************************************************************/
+
+
+
+#include "mcfpar.h"
+
+
+long par_threads = 1;
+
+
+#ifdef MCF_PARALLEL
+
+#include <pthread.h>
+#include <sched.h>
+
+#define PAR_SPIN 20000
+
+
+static pthread_t par_worker[PAR_MAX_THREADS];
+static pthread_mutex_t par_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t par_wake = PTHREAD_COND_INITIALIZER;
+static par_fn_t par_fn;
+static void *par_arg;
+static long par_round;
+static long par_pending;
+static long par_quit;
+
+
+
+
+static void *par_loop( void *arg )
+{
+    long t = (long)arg;
+    long seen = 0;
+    long spin;
+
+    while( 1 )
+    {
+        for( spin = 0; spin < PAR_SPIN
+             && __atomic_load_n( &par_round, __ATOMIC_ACQUIRE ) == seen; spin++ )
+            ;
+        if( __atomic_load_n( &par_round, __ATOMIC_ACQUIRE ) == seen )
+        {
+            pthread_mutex_lock( &par_mutex );
+            while( __atomic_load_n( &par_round, __ATOMIC_ACQUIRE ) == seen )
+                pthread_cond_wait( &par_wake, &par_mutex );
+            pthread_mutex_unlock( &par_mutex );
+        }
+        seen++;
+
+        if( par_quit )
+            return NULL;
+        par_fn( par_arg, t );
+        __atomic_sub_fetch( &par_pending, 1, __ATOMIC_RELEASE );
+    }
+}
+
+
+
+
+/* Start n-1 workers (n <= 0: one thread per online CPU). Returns -1,
+   leaving par_threads at 1, if n is too large or a thread cannot be
+   created. */
+long par_init( long n )
+{
+    long t;
+
+    if( n <= 0 )
+        n = sysconf( _SC_NPROCESSORS_ONLN );
+    if( n <= 1 )
+        return 0;
+    if( n > PAR_MAX_THREADS )
+        return -1;
+
+    for( t = 1; t < n; t++ )
+        if( pthread_create( &par_worker[t], NULL, par_loop, (void *)t ) )
+        {
+            par_threads = t;
+            par_exit();
+            return -1;
+        }
+    par_threads = n;
+    return 0;
+}
+
+
+
+
+void par_run( par_fn_t fn, void *arg )
+{
+    long spin;
+
+    if( par_threads == 1 )
+    {
+        fn( arg, 0 );
+        return;
+    }
+
+    par_fn = fn;
+    par_arg = arg;
+    __atomic_store_n( &par_pending, par_threads - 1, __ATOMIC_RELAXED );
+    pthread_mutex_lock( &par_mutex );
+    __atomic_add_fetch( &par_round, 1, __ATOMIC_RELEASE );
+    pthread_cond_broadcast( &par_wake );
+    pthread_mutex_unlock( &par_mutex );
+
+    fn( arg, 0 );
+
+    for( spin = 0; __atomic_load_n( &par_pending, __ATOMIC_ACQUIRE ); spin++ )
+        if( spin > PAR_SPIN )
+            sched_yield();
+}
+
+
+
+
+void par_exit( void )
+{
+    long t;
+
+    if( par_threads == 1 )
+        return;
+
+    par_quit = 1;
+    pthread_mutex_lock( &par_mutex );
+    __atomic_add_fetch( &par_round, 1, __ATOMIC_RELEASE );
+    pthread_cond_broadcast( &par_wake );
+    pthread_mutex_unlock( &par_mutex );
+    for( t = 1; t < par_threads; t++ )
+        pthread_join( par_worker[t], NULL );
+    par_threads = 1;
+    par_quit = 0;
+}
+
+
+#else
+
+
+#ifdef _PROTO_
+long par_init( long n )
+#else
+long par_init( n )
+    long n;
+#endif
+{
+    return ( n == 1 || n == 0 ) ? 0 : -1;
+}
+
+
+#ifdef _PROTO_
+void par_run( par_fn_t fn, void *arg )
+#else
+void par_run( fn, arg )
+    par_fn_t fn;
+    void *arg;
+#endif
+{
+    fn( arg, 0 );
+}
+
+
+void par_exit( )
+{
+}
+
+
+#endif
@@ -0,0 +1,30 @@
+/**************************************************************************
+MCFPAR.H of ZIB optimizer MCF, SPEC version
+
+Fork-join thread pool for the parallel pricing in pbeampp.c and
+implicit.c. Built only with -DMCF_PARALLEL (and -pthread); otherwise
+par_threads is 1 and par_run calls its function inline.
+**************************************************************************/
+
+
+
+#ifndef _MCFPAR_H
+#define _MCFPAR_H
+
+
+#include "defines.h"
+
+
+#define PAR_MAX_THREADS 64
+
+
+typedef void (*par_fn_t) _PROTO_(( void *, long ));
+
+extern long par_threads;
+
+extern long par_init _PROTO_(( long ));
+extern void par_run _PROTO_(( par_fn_t, void * ));
+extern void par_exit _PROTO_(( void ));
+
+
+#endif
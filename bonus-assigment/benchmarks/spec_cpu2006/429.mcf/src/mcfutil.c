@@ -23,6 +23,12 @@ Copyright (c) 2003-2005 Andreas Loebel.
 #include "mcfutil.h"
 
 
+#ifdef MCF_COMPACT
+MCF_TLS node_p mcf_node_base = NULL;
+MCF_TLS node_cold_t *mcf_node_cold = NULL;
+MCF_TLS arc_p mcf_arc_base = NULL;
+#endif
+
 
 #ifdef _PROTO_
 void refresh_neighbour_lists( network_t *net )
@@ -39,17 +45,17 @@ void refresh_neighbour_lists( net )
     node = net->nodes;
     for( stop = (void *)net->stop_nodes; node < (node_t *)stop; node++ )
     {
-        node->firstin = (arc_t *)NULL;
-        node->firstout = (arc_t *)NULL;
+        SET_FIRSTIN( node, (arc_t *)NULL );
+        SET_FIRSTOUT( node, (arc_t *)NULL );
     }
     
     arc = net->arcs;
     for( stop = (void *)net->stop_arcs; arc < (arc_t *)stop; arc++ )
     {
-        arc->nextout = arc->tail->firstout;
-        arc->tail->firstout = arc;
-        arc->nextin = arc->head->firstin;
-        arc->head->firstin = arc;
+        SET_NEXTOUT( arc, NODE_FIRSTOUT( ARC_TAIL( arc ) ) );
+        SET_FIRSTOUT( ARC_TAIL( arc ), arc );
+        SET_NEXTIN( arc, NODE_FIRSTIN( ARC_HEAD( arc ) ) );
+        SET_FIRSTIN( ARC_HEAD( arc ), arc );
     }
     
     return;
@@ -64,50 +70,89 @@ void refresh_neighbour_lists( net )
 
 
 
+/* Store the non-root nodes of the basis tree in DFS preorder (the
+   thread) in net->thread; returns their number. Every node's pred
+   comes before it, so the potentials can then be set in one
+   forward sweep whose loads do not depend on each other. */
 #ifdef _PROTO_
-long refresh_potential( network_t *net )
+static long tree_preorder( network_t *net )
 #else
-long refresh_potential( net )
+static long tree_preorder( net )
     network_t *net;
 #endif
 {
     node_t *node, *tmp;
     node_t *root = net->nodes;
-    long checksum = 0;
+    node_t **thread = net->thread;
     
 
-    root->potential = (cost_t) -MAX_ART_COST;
-    tmp = node = root->child;
+    tmp = node = NODE_CHILD( root );
     while( node != root )
     {
         while( node )
         {
-            if( node->orientation == UP )
-                node->potential = node->basic_arc->cost + node->pred->potential;
-            else /* == DOWN */
-            {
-                node->potential = node->pred->potential - node->basic_arc->cost;
-                checksum++;
-            }
-
+            *thread++ = node;
             tmp = node;
-            node = node->child;
+            node = NODE_CHILD( node );
         }
         
         node = tmp;
 
-        while( node->pred )
+        while( NODE_PRED( node ) )
         {
-            tmp = node->sibling;
+            tmp = NODE_SIBLING( node );
             if( tmp )
             {
                 node = tmp;
                 break;
             }
             else
-                node = node->pred;
+                node = NODE_PRED( node );
+        }
+    }
+    
+    return thread - net->thread;
+}
+
+
+
+
+#ifdef _PROTO_
+long refresh_potential( network_t *net )
+#else
+long refresh_potential( net )
+    network_t *net;
+#endif
+{
+    node_t *node;
+    node_t **thread, **stop;
+    node_t *root = net->nodes;
+    long checksum = 0;
+    
+
+    root->potential = (cost_t) -MAX_ART_COST;
+    stop = net->thread + tree_preorder( net );
+    for( thread = net->thread; thread != stop; thread++ )
+    {
+#if MCF_PREFETCH
+        /* the nodes are in preorder, their basic arcs are not */
+        if( thread + MCF_PREFETCH < stop )
+            PREFETCH( NODE_BASIC_ARC( thread[MCF_PREFETCH] ) );
+#endif
+        node = *thread;
+        if( node->orientation == UP )
+            node->potential = NODE_BASIC_ARC( node )->cost 
+                + NODE_PRED( node )->potential;
+        else /* == DOWN */
+        {
+            node->potential = NODE_PRED( node )->potential 
+                - NODE_BASIC_ARC( node )->cost;
+            checksum++;
         }
     }
+
+    assert( checksum == net->n_down );
+    net->n_down = checksum;
     
     return checksum;
 }
@@ -115,6 +160,99 @@ long refresh_potential( net )
 
 
 
+/* Move the nodes into the DFS preorder of the current basis tree,
+   so that the tree walks of the next iterations (refresh_potential,
+   update_tree, primal_iminus) run mostly forward through memory.
+   The root stays first. Only addresses change: every link, the
+   arcs' ends and the pricing copy are remapped, so the tree, the
+   arc order and hence the pivots are exactly as before. Returns -1
+   without memory, leaving the network untouched. */
+#ifdef _PROTO_
+long relayout_tree( network_t *net )
+#else
+long relayout_tree( net )
+    network_t *net;
+#endif
+{
+    node_t *nodes = net->nodes;
+    node_t *node;
+    arc_t *arc;
+    long n = net->stop_nodes - net->nodes;
+    long k;
+    long *pos;
+    void *copy;
+    size_t copy_size = sizeof(node_t);
+
+
+#ifdef MCF_COMPACT
+    /* copy takes the cold halves too, after the nodes */
+    if( sizeof(node_cold_t) > copy_size )
+        copy_size = sizeof(node_cold_t);
+#endif
+    pos = (long *) malloc( n * sizeof(long) );
+    copy = malloc( n * copy_size );
+    if( !pos || !copy )
+    {
+        FREE( pos );
+        FREE( copy );
+        return -1;
+    }
+
+    /* pos[k]: new place of the node now at nodes + k */
+    tree_preorder( net );
+    pos[0] = 0;
+    for( k = 1; k < n; k++ )
+        pos[net->thread[k-1] - nodes] = k;
+    for( k = 1; k < n; k++ )
+        net->thread[k-1] = nodes + k;
+
+#define RELOCATED( p ) ( nodes + pos[(p) - nodes] )
+    for( node = nodes; node < net->stop_nodes; node++ )
+    {
+        if( NODE_PRED( node ) )
+            SET_PRED( node, RELOCATED( NODE_PRED( node ) ) );
+        if( NODE_CHILD( node ) )
+            SET_CHILD( node, RELOCATED( NODE_CHILD( node ) ) );
+        if( NODE_SIBLING( node ) )
+            SET_SIBLING( node, RELOCATED( NODE_SIBLING( node ) ) );
+        if( NODE_SIBLING_PREV( node ) )
+            SET_SIBLING_PREV( node, RELOCATED( NODE_SIBLING_PREV( node ) ) );
+    }
+    for( arc = net->dummy_arcs; arc < net->stop_dummy; arc++ )
+    {
+        SET_TAIL( arc, RELOCATED( ARC_TAIL( arc ) ) );
+        SET_HEAD( arc, RELOCATED( ARC_HEAD( arc ) ) );
+    }
+    for( arc = net->arcs; arc < net->stop_arcs; arc++ )
+    {
+        SET_TAIL( arc, RELOCATED( ARC_TAIL( arc ) ) );
+        SET_HEAD( arc, RELOCATED( ARC_HEAD( arc ) ) );
+    }
+#undef RELOCATED
+    if( net->soa.tail )
+        for( k = 0; k < net->soa.m; k++ )
+        {
+            net->soa.tail[k] = (node_idx_t)pos[net->soa.tail[k]];
+            net->soa.head[k] = (node_idx_t)pos[net->soa.head[k]];
+        }
+
+    for( k = 0; k < n; k++ )
+        ((node_t *)copy)[pos[k]] = nodes[k];
+    memcpy( (void *)nodes, copy, (size_t)n * sizeof(node_t) );
+#ifdef MCF_COMPACT
+    for( k = 0; k < n; k++ )
+        ((node_cold_t *)copy)[pos[k]] = *NODE_COLD( nodes + k );
+    memcpy( (void *)NODE_COLD( nodes ), copy, (size_t)n * sizeof(node_cold_t) );
+#endif
+
+    FREE( pos );
+    FREE( copy );
+    return 0;
+}
+
+
+
+
 
 
 
@@ -144,16 +282,17 @@ double flow_cost( net )
 
     stop = (void *)net->stop_nodes;
     for( node = net->nodes, node++; node != (node_t *)stop; node++ )
-        node->basic_arc->flow = node->flow;
+        NODE_BASIC_ARC( node )->flow = node->flow;
     
     stop = (void *)net->stop_arcs;
     for( arc = net->arcs; arc != (arc_t *)stop; arc++ )
     {
         if( arc->flow )
         {
-            if( !(arc->tail->number < 0 && arc->head->number > 0) )
+            if( !(NODE_COLD( ARC_TAIL( arc ) )->number < 0 
+                  && NODE_COLD( ARC_HEAD( arc ) )->number > 0) )
             {
-                if( !arc->tail->number )
+                if( !NODE_COLD( ARC_TAIL( arc ) )->number )
                 {
                     operational_cost += (arc->cost - net->bigM);
                     fleet++;
@@ -203,16 +342,17 @@ double flow_org_cost( net )
 
     stop = (void *)net->stop_nodes;
     for( node = net->nodes, node++; node != (node_t *)stop; node++ )
-        node->basic_arc->flow = node->flow;
+        NODE_BASIC_ARC( node )->flow = node->flow;
     
     stop = (void *)net->stop_arcs;
     for( arc = net->arcs; arc != (arc_t *)stop; arc++ )
     {
         if( arc->flow )
         {
-            if( !(arc->tail->number < 0 && arc->head->number > 0) )
+            if( !(NODE_COLD( ARC_TAIL( arc ) )->number < 0 
+                  && NODE_COLD( ARC_HEAD( arc ) )->number > 0) )
             {
-                if( !arc->tail->number )
+                if( !NODE_COLD( ARC_TAIL( arc ) )->number )
                 {
                     operational_cost += (arc->org_cost - net->bigM);
                     fleet++;
@@ -255,7 +395,7 @@ long primal_feasible( net )
 
     for( node++; node < (node_t *)stop; node++ )
     {
-        arc = node->basic_arc;
+        arc = NODE_BASIC_ARC( node );
         flow = node->flow;
         if( arc >= dummy && arc < stop_dummy )
         {
@@ -263,7 +403,7 @@ long primal_feasible( net )
             {
                 printf( "PRIMAL NETWORK SIMPLEX: " );
                 printf( "artificial arc with nonzero flow, node %d (%ld)\n",
-                        node->number, flow );
+                        NODE_COLD( node )->number, flow );
             }
         }
         else
@@ -308,8 +448,8 @@ long dual_feasible(  net )
 
     for( arc = net->arcs; arc < stop; arc++ )
     {
-        red_cost = arc->cost - arc->tail->potential 
-            + arc->head->potential;
+        red_cost = arc->cost - ARC_TAIL( arc )->potential 
+            + ARC_HEAD( arc )->potential;
         switch( arc->ident )
         {
         case BASIC:
@@ -317,7 +457,8 @@ long dual_feasible(  net )
         case AT_ZERO:
             if( ABS(red_cost) > (cost_t)net->feas_tol )
 #ifdef DEBUG
-                printf("%d %d %d %ld\n", arc->tail->number, arc->head->number,
+                printf("%d %d %d %ld\n", NODE_COLD( ARC_TAIL( arc ) )->number, 
+                       NODE_COLD( ARC_HEAD( arc ) )->number,
                        arc->ident, red_cost );
 #else
                 goto DUAL_INFEAS;
@@ -328,7 +469,8 @@ long dual_feasible(  net )
         case AT_LOWER:
             if( red_cost < (cost_t)-net->feas_tol )
 #ifdef DEBUG
-                printf("%d %d %d %ld\n", arc->tail->number, arc->head->number,
+                printf("%d %d %d %ld\n", NODE_COLD( ARC_TAIL( arc ) )->number, 
+                       NODE_COLD( ARC_HEAD( arc ) )->number,
                        arc->ident, red_cost );
 #else
                 goto DUAL_INFEAS;
@@ -338,7 +480,8 @@ long dual_feasible(  net )
         case AT_UPPER:
             if( red_cost > (cost_t)net->feas_tol )
 #ifdef DEBUG
-                printf("%d %d %d %ld\n", arc->tail->number, arc->head->number,
+                printf("%d %d %d %ld\n", NODE_COLD( ARC_TAIL( arc ) )->number, 
+                       NODE_COLD( ARC_HEAD( arc ) )->number,
                        arc->ident, red_cost );
 #else
                 goto DUAL_INFEAS;
@@ -374,12 +517,28 @@ long getfree( net )
      network_t *net;
 #endif
 {  
-    FREE( net->nodes );
-    FREE( net->arcs );
-    FREE( net->dummy_arcs );
+#ifdef MCF_COMPACT
+    mem_free( mcf_node_base );
+    FREE( mcf_node_cold );
+    mem_free( mcf_arc_base );
+    mcf_node_base = NULL;
+    mcf_node_cold = NULL;
+    mcf_arc_base = NULL;
+#else
+    mem_free( net->nodes );
+    mem_free( net->arcs );
+    mem_free( net->dummy_arcs );
+#endif
+    FREE( net->thread );
+    FREE( net->soa.cost );
+    FREE( net->soa.tail );
+    FREE( net->soa.head );
+    FREE( net->soa.ident );
+    memset( (void *)(&net->soa), 0, sizeof(arc_soa_t) );
     net->nodes = net->stop_nodes = NULL;
     net->arcs = net->stop_arcs = NULL;
     net->dummy_arcs = net->stop_dummy = NULL;
+    net->thread = NULL;
 
     return 0;
 }
@@ -25,10 +25,12 @@ Copyright (c) 2003-2005 Andreas Loebel.
 
 
 #include "defines.h"
+#include "mcfmem.h"
 
 
 extern void refresh_neighbour_lists _PROTO_(( network_t * ));
 extern long refresh_potential _PROTO_(( network_t * ));
+extern long relayout_tree _PROTO_(( network_t * ));
 extern double flow_cost _PROTO_(( network_t * ));
 extern double flow_org_cost _PROTO_(( network_t * ));
 extern long primal_feasible _PROTO_(( network_t * ));
@@ -48,7 +48,11 @@ long write_circulations( outfile, net )
 
     refresh_neighbour_lists( net );
     
-    for( block = net->nodes[net->n].firstout; block; block = block->nextout )
+    /* relayout_tree moves nodes, so find the depot (tail of the first
+       arc) and the end of trip i (head of its trip arc, arcs[3i-1])
+       through the arcs, whose order read_min fixed */
+    for( block = NODE_FIRSTOUT( ARC_TAIL( net->arcs ) ); block; 
+         block = ARC_NEXTOUT( block ) )
     {
         if( block->flow )
         {
@@ -60,9 +64,10 @@ long write_circulations( outfile, net )
                 if( arc >= first_impl )
                     fprintf( out, "***\n" );
 
-                fprintf( out, "%d\n", - arc->head->number );
-                arc2 = arc->head[net->n_trips].firstout; 
-                for( ; arc2; arc2 = arc2->nextout )
+                fprintf( out, "%d\n", - NODE_COLD( ARC_HEAD( arc ) )->number );
+                arc2 = net->arcs + 3 * (-NODE_COLD( ARC_HEAD( arc ) )->number) - 1;
+                arc2 = NODE_FIRSTOUT( ARC_HEAD( arc2 ) ); 
+                for( ; arc2; arc2 = ARC_NEXTOUT( arc2 ) )
                     if( arc2->flow )
                         break;
                 if( !arc2 )
@@ -71,7 +76,7 @@ long write_circulations( outfile, net )
                     return -1;
                 }
                 
-                if( arc2->head->number )
+                if( NODE_COLD( ARC_HEAD( arc2 ) )->number )
                     arc = arc2;
                 else
                     arc = NULL;
@@ -20,12 +20,19 @@ Copyright (c) 2003-2005 Andreas Loebel.
 
 
 
-#define K 300
-#define B  50
+#define K BEA_K
+#define B BEA_B
 
 
 
 #include "pbeampp.h"
+#include "mcfpar.h"
+
+#if defined(__GNUC__) && defined(__x86_64__) && !defined(MCF_NO_SIMD_PRICING) \
+    && !defined(MEM_TRACE)
+#define MCF_SIMD_PRICING
+#include <immintrin.h>
+#endif
 
 
 
@@ -48,154 +55,552 @@ int bea_is_dual_infeasible( arc, red_cost )
 
 
 
-typedef struct basket
+/* Puts the k largest abs_cost entries of basket[0, n) first, in
+   decreasing order. This is the partial quicksort SPEC's sort_basket
+   ran over BASKET pointers, on (abs_cost, arc) pairs and without the
+   recursion: a range is split about the cost of its middle entry, and
+   a right part starting at k or later is dropped unsorted, as pricing
+   only ever reads the first k. Keeping its cut keeps its order among
+   equal costs, and with it the simplex path. The smaller part is
+   split first, so fewer than 64 ranges wait on the stack. */
+#define BASKET_STACK 64
+
+#ifdef _PROTO_
+static void select_basket( BASKET *basket, long n, long k )
+#else
+static void select_basket( basket, n, k )
+    BASKET *basket;
+    long n, k;
+#endif
 {
-    arc_t *a;
-    cost_t cost;
-    cost_t abs_cost;
-} BASKET;
+    long stack_lo[BASKET_STACK], stack_hi[BASKET_STACK];
+    long top = 0, lo = 0, hi = n - 1, l, r;
+    cost_t cut;
+    BASKET xchange;
+
+    for( ;; )
+    {
+        if( lo < hi )
+        {
+            l = lo; r = hi;
+            cut = basket[ (l + r) / 2 ].abs_cost;
+
+            do
+            {
+                while( basket[l].abs_cost > cut )
+                    l++;
+                while( cut > basket[r].abs_cost )
+                    r--;
+
+                if( l < r )
+                {
+                    xchange = basket[l];
+                    basket[l] = basket[r];
+                    basket[r] = xchange;
+                }
+                if( l <= r )
+                {
+                    l++; r--;
+                }
+            }
+            while( l <= r );
+
+            if( l >= k )
+                l = hi + 1;
+            if( r - lo < hi - l )
+            {
+                stack_lo[top] = l; stack_hi[top++] = hi;
+                hi = r;
+            }
+            else
+            {
+                stack_lo[top] = lo; stack_hi[top++] = r;
+                lo = l;
+            }
+        }
+        else if( top )
+        {
+            lo = stack_lo[--top];
+            hi = stack_hi[top];
+        }
+        else
+            break;
+    }
+}
+
+
 
-static long basket_size;
-static BASKET basket[B+K+1];
-static BASKET *perm[B+K+1];
 
+/* Group count for m arcs, as primal_bea_mpp sets it up */
+#define NR_GROUP( m ) ( (((m)-1) / K) + 1 )
 
 
 #ifdef _PROTO_
-void sort_basket( long min, long max )
+long refresh_arc_soa( network_t *net )
 #else
-void sort_basket( min, max )
-    long min, max;
+long refresh_arc_soa( net )
+    network_t *net;
 #endif
 {
-    long l, r;
-    cost_t cut;
-    BASKET *xchange;
-
-    l = min; r = max;
+    arc_soa_t *soa = &(net->soa);
+    arc_t *arc;
+    long g, i, j;
 
-    cut = perm[ (long)( (l+r) / 2 ) ]->abs_cost;
 
-    do
+    if( soa->max_m < net->m )
     {
-        while( perm[l]->abs_cost > cut )
-            l++;
-        while( cut > perm[r]->abs_cost )
-            r--;
-            
-        if( l < r )
+        FREE( soa->cost );
+        FREE( soa->tail );
+        FREE( soa->head );
+        FREE( soa->ident );
+        soa->max_m = net->max_m;
+        soa->cost  = (cost_t *) malloc( soa->max_m * sizeof(cost_t) );
+        soa->tail  = (node_idx_t *) malloc( soa->max_m * sizeof(node_idx_t) );
+        soa->head  = (node_idx_t *) malloc( soa->max_m * sizeof(node_idx_t) );
+        soa->ident = (signed char *) malloc( soa->max_m * sizeof(signed char) );
+        if( !soa->cost || !soa->tail || !soa->head || !soa->ident )
         {
-            xchange = perm[l];
-            perm[l] = perm[r];
-            perm[r] = xchange;
+            FREE( soa->cost );
+            FREE( soa->tail );
+            FREE( soa->head );
+            FREE( soa->ident );
+            memset( (void *)soa, 0, sizeof(arc_soa_t) );
+            return -1;
         }
-        if( l <= r )
+    }
+
+    soa->m = net->m;
+    soa->nr_group = NR_GROUP( net->m );
+    soa->nodes = net->nodes;
+    for( g = 0, j = 0; g < soa->nr_group; g++ )
+        for( i = g; i < net->m; i += soa->nr_group, j++ )
         {
-            l++; r--;
+            arc = net->arcs + i;
+            soa->cost[j]  = arc->cost;
+            soa->tail[j]  = (node_idx_t)(ARC_TAIL( arc ) - net->nodes);
+            soa->head[j]  = (node_idx_t)(ARC_HEAD( arc ) - net->nodes);
+            soa->ident[j] = (signed char)arc->ident;
         }
 
+    return 0;
+}
+
+
+
+/* Reduced cost and dual infeasibility of SoA entry i */
+#define SOA_RED_COST( soa, i ) \
+    ( (soa)->cost[i] - (soa)->nodes[(soa)->tail[i]].potential \
+                     + (soa)->nodes[(soa)->head[i]].potential )
+
+#define SOA_DUAL_INFEASIBLE( soa, i, red_cost ) \
+    (    ((red_cost) < 0 && (soa)->ident[i] == AT_LOWER) \
+      || ((red_cost) > 0 && (soa)->ident[i] == AT_UPPER) )
+
+/* Fetch the endpoints of entry i + MCF_PREFETCH; the tail/head streams
+   themselves are sequential and left to the hardware prefetcher. Only
+   the scalar kernel does this: the gathers of the SIMD ones already
+   keep 8 or 16 misses in flight, and the extra instructions cost them
+   more than they hide. */
+#if MCF_PREFETCH
+#define SOA_PREFETCH( soa, i ) \
+    if( (i) + MCF_PREFETCH < (soa)->m ) \
+    { \
+        PREFETCH( (soa)->nodes + (soa)->tail[(i) + MCF_PREFETCH] ); \
+        PREFETCH( (soa)->nodes + (soa)->head[(i) + MCF_PREFETCH] ); \
     }
-    while( l <= r );
+#endif
+
+
+
+
+/* A pricing kernel scans SoA entries [j, j_end) and writes the dual
+   infeasible ones, in order, to hit[] (entry numbers) and hit_cost[]
+   (their reduced costs); it returns how many it found. The AVX2 and
+   AVX-512 ones gather the endpoint potentials for 4 or 8 arcs at a
+   time (cost_t is 64 bits on x86-64); AVX-512 compress-stores the
+   hits. They pick the same arcs as the scalar loop. */
+typedef long (*price_kernel_t) _PROTO_(( arc_soa_t*, long, long, long*,
+                                         cost_t* ));
+
+#ifdef _PROTO_
+static long price_scalar( arc_soa_t *soa, long j, long j_end, long *hit,
+                          cost_t *hit_cost )
+#else
+static long price_scalar( soa, j, j_end, hit, hit_cost )
+    arc_soa_t *soa;
+    long j, j_end;
+    long *hit;
+    cost_t *hit_cost;
+#endif
+{
+    long n = 0;
+    cost_t red_cost;
 
-    if( min < r )
-        sort_basket( min, r );
-    if( l < max && l <= B )
-        sort_basket( l, max ); 
+    for( ; j < j_end; j++ )
+    {
+#if MCF_PREFETCH
+        SOA_PREFETCH( soa, j );
+#endif
+        MEMTRACE_LOAD( soa->ident + j );
+        if( soa->ident[j] > BASIC )
+        {
+            MEMTRACE_LOAD( soa->cost + j );
+            MEMTRACE_LOAD( soa->tail + j );
+            MEMTRACE_LOAD( &soa->nodes[soa->tail[j]].potential );
+            MEMTRACE_LOAD( soa->head + j );
+            MEMTRACE_LOAD( &soa->nodes[soa->head[j]].potential );
+            red_cost = SOA_RED_COST( soa, j );
+            if( SOA_DUAL_INFEASIBLE( soa, j, red_cost ) )
+            {
+                MEMTRACE_STORE( hit + n );
+                MEMTRACE_STORE( hit_cost + n );
+                hit[n] = j;
+                hit_cost[n++] = red_cost;
+            }
+        }
+    }
+    return n;
 }
 
 
+#ifdef MCF_SIMD_PRICING
+__attribute__((target("avx2")))
+static long price_avx2( arc_soa_t *soa, long j, long j_end, long *hit,
+                        cost_t *hit_cost )
+{
+    const long long *pot = (const long long *)&(soa->nodes->potential);
+    const __m128i node_size = _mm_set1_epi32( (int)sizeof(node_t) );
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i lower = _mm256_set1_epi64x( AT_LOWER );
+    const __m256i upper = _mm256_set1_epi64x( AT_UPPER );
+    __m256i red, ident, dual;
+    long long lane[4];
+    long n = 0;
+    int mask, id4, b;
+
+    for( ; j + 4 <= j_end; j += 4 )
+    {
+        red = _mm256_sub_epi64( _mm256_loadu_si256( (const __m256i *)(soa->cost + j) ),
+              _mm256_i32gather_epi64( pot, _mm_mullo_epi32( node_size,
+                  _mm_loadu_si128( (const __m128i *)(soa->tail + j) ) ), 1 ) );
+        red = _mm256_add_epi64( red,
+              _mm256_i32gather_epi64( pot, _mm_mullo_epi32( node_size,
+                  _mm_loadu_si128( (const __m128i *)(soa->head + j) ) ), 1 ) );
+
+        memcpy( &id4, soa->ident + j, 4 );
+        ident = _mm256_cvtepi8_epi64( _mm_cvtsi32_si128( id4 ) );
+        dual = _mm256_or_si256(
+            _mm256_and_si256( _mm256_cmpgt_epi64( zero, red ),
+                              _mm256_cmpeq_epi64( ident, lower ) ),
+            _mm256_and_si256( _mm256_cmpgt_epi64( red, zero ),
+                              _mm256_cmpeq_epi64( ident, upper ) ) );
+
+        mask = _mm256_movemask_pd( _mm256_castsi256_pd( dual ) );
+        if( mask )
+        {
+            _mm256_storeu_si256( (__m256i *)lane, red );
+            for( ; mask; mask &= mask - 1 )
+            {
+                b = __builtin_ctz( mask );
+                hit[n] = j + b;
+                hit_cost[n++] = (cost_t)lane[b];
+            }
+        }
+    }
+    return n + price_scalar( soa, j, j_end, hit + n, hit_cost + n );
+}
+
+
+__attribute__((target("avx512f")))
+static long price_avx512( arc_soa_t *soa, long j, long j_end, long *hit,
+                          cost_t *hit_cost )
+{
+    const void *pot = (const void *)&(soa->nodes->potential);
+    const __m256i node_size = _mm256_set1_epi32( (int)sizeof(node_t) );
+    const __m512i zero = _mm512_setzero_si512();
+    const __m512i lower = _mm512_set1_epi64( AT_LOWER );
+    const __m512i upper = _mm512_set1_epi64( AT_UPPER );
+    const __m512i iota = _mm512_set_epi64( 7, 6, 5, 4, 3, 2, 1, 0 );
+    __m512i red, ident;
+    __mmask8 dual;
+    long n = 0;
+
+    for( ; j + 8 <= j_end; j += 8 )
+    {
+        red = _mm512_sub_epi64( _mm512_loadu_si512( (const void *)(soa->cost + j) ),
+              _mm512_i32gather_epi64( _mm256_mullo_epi32( node_size,
+                  _mm256_loadu_si256( (const __m256i *)(soa->tail + j) ) ), pot, 1 ) );
+        red = _mm512_add_epi64( red,
+              _mm512_i32gather_epi64( _mm256_mullo_epi32( node_size,
+                  _mm256_loadu_si256( (const __m256i *)(soa->head + j) ) ), pot, 1 ) );
+
+        ident = _mm512_cvtepi8_epi64(
+                    _mm_loadl_epi64( (const __m128i *)(soa->ident + j) ) );
+        dual = ( _mm512_cmplt_epi64_mask( red, zero )
+                 & _mm512_cmpeq_epi64_mask( ident, lower ) )
+             | ( _mm512_cmpgt_epi64_mask( red, zero )
+                 & _mm512_cmpeq_epi64_mask( ident, upper ) );
+
+        if( dual )
+        {
+            _mm512_mask_compressstoreu_epi64( (void *)(hit_cost + n), dual, red );
+            _mm512_mask_compressstoreu_epi64( (void *)(hit + n), dual,
+                _mm512_add_epi64( _mm512_set1_epi64( j ), iota ) );
+            n += __builtin_popcount( dual );
+        }
+    }
+    return n + price_scalar( soa, j, j_end, hit + n, hit_cost + n );
+}
+#endif
 
 
+static price_kernel_t price_kernel = (price_kernel_t)NULL;
 
 
-static long nr_group;
-static long group_pos;
 
 
-static long initialize = 1;
+#ifdef MCF_PARALLEL
+/* One speculative round of pricing: thread t prices group
+   (round_first + t) % nr_group into round_hit[t]. primal_bea_mpp
+   then takes the groups in order and stops where the serial loop
+   would, so the basket is the serial one; groups past that point
+   are dropped. */
+static arc_soa_t *round_soa;
+static long round_first, round_groups, round_nr_group;
+static long round_n[PAR_MAX_THREADS];
+static long round_hit[PAR_MAX_THREADS][K];
+static cost_t round_hit_cost[PAR_MAX_THREADS][K];
 
 
+static void price_round( void *arg, long t )
+{
+    arc_soa_t *soa = round_soa;
+    long g;
+
+    if( t >= round_groups )
+        return;
+    g = (round_first + t) % round_nr_group;
+    round_n[t] = price_kernel( soa, SOA_GROUP_START( soa, g ),
+                               SOA_GROUP_START( soa, g + 1 ),
+                               round_hit[t], round_hit_cost[t] );
+}
+#endif
+
+
+/* PRICE_AUTO (the widest this CPU runs), PRICE_SCALAR, PRICE_AVX2 or
+   PRICE_AVX512; -1 if this build or CPU lacks the one asked for */
+#ifdef _PROTO_
+long set_pricing_kernel( long kind )
+#else
+long set_pricing_kernel( kind )
+    long kind;
+#endif
+{
+    switch( kind )
+    {
+    case PRICE_AUTO:
+        price_kernel = price_scalar;
+#ifdef MCF_SIMD_PRICING
+        if( __builtin_cpu_supports( "avx512f" ) )
+            price_kernel = price_avx512;
+        else if( __builtin_cpu_supports( "avx2" ) )
+            price_kernel = price_avx2;
+#endif
+        return 0;
+    case PRICE_SCALAR:
+        price_kernel = price_scalar;
+        return 0;
+#ifdef MCF_SIMD_PRICING
+    case PRICE_AVX2:
+        if( !__builtin_cpu_supports( "avx2" ) )
+            return -1;
+        price_kernel = price_avx2;
+        return 0;
+    case PRICE_AVX512:
+        if( !__builtin_cpu_supports( "avx512f" ) )
+            return -1;
+        price_kernel = price_avx512;
+        return 0;
+#endif
+    }
+    return -1;
+}
+
+
+
+
+/* soa is the simplex's pricing copy of arcs (NULL: price straight
+   from the arc_t array, as does a build with -DMCF_AOS_PRICING), bea
+   the network's pricing state */
 #ifdef _PROTO_
 arc_t *primal_bea_mpp( long m,  arc_t *arcs, arc_t *stop_arcs, 
-                              cost_t *red_cost_of_bea )
+                              cost_t *red_cost_of_bea, arc_soa_t *soa,
+                              bea_t *bea )
 #else
-arc_t *primal_bea_mpp( m, arcs, stop_arcs, red_cost_of_bea )
+arc_t *primal_bea_mpp( m, arcs, stop_arcs, red_cost_of_bea, soa, bea )
     long m;
     arc_t *arcs;
     arc_t *stop_arcs;
     cost_t *red_cost_of_bea;
+    arc_soa_t *soa;
+    bea_t *bea;
 #endif
 {
-    long i, next, old_group_pos;
+    long i, j, n, next, old_group_pos;
+    long priced = 0;
+    BASKET *basket = bea->basket;
+    long *hits;
+    cost_t *hit_costs;
     arc_t *arc;
     cost_t red_cost;
+    int infeasible;
+#ifdef MCF_PARALLEL
+    long round_i = 0, round_left = 0;
+#endif
+
+#ifdef MCF_AOS_PRICING
+    soa = NULL;
+#endif
+    if( !price_kernel )
+        set_pricing_kernel( PRICE_AUTO );
 
-    if( initialize )
+    if( !bea->initialized )
     {
-        for( i=1; i < K+B+1; i++ )
-            perm[i] = &(basket[i]);
-        nr_group = ( (m-1) / K ) + 1;
-        group_pos = 0;
-        basket_size = 0;
-        initialize = 0;
+        bea->nr_group = NR_GROUP( m );
+        bea->group_pos = 0;
+        bea->basket_size = 0;
+        bea->initialized = 1;
     }
     else
     {
-        for( i = 2, next = 0; i <= B && i <= basket_size; i++ )
+        /* basket[0] has just entered the basis */
+        for( i = 1, next = 0; i < B && i < bea->basket_size; i++ )
         {
-            arc = perm[i]->a;
-            red_cost = arc->cost - arc->tail->potential + arc->head->potential;
-            if( (red_cost < 0 && arc->ident == AT_LOWER)
-                || (red_cost > 0 && arc->ident == AT_UPPER) )
+            arc = arcs + basket[i].a;
+            if( soa )
+            {
+                j = SOA_POS( soa, arc - arcs );
+                red_cost = SOA_RED_COST( soa, j );
+                infeasible = SOA_DUAL_INFEASIBLE( soa, j, red_cost );
+            }
+            else
             {
+                red_cost = arc->cost - ARC_TAIL( arc )->potential 
+                    + ARC_HEAD( arc )->potential;
+                infeasible = (red_cost < 0 && arc->ident == AT_LOWER)
+                             || (red_cost > 0 && arc->ident == AT_UPPER);
+            }
+            if( infeasible )
+            {
+                basket[next].abs_cost = ABS(red_cost);
+                basket[next].a = basket[i].a;
                 next++;
-                perm[next]->a = arc;
-                perm[next]->cost = red_cost;
-                perm[next]->abs_cost = ABS(red_cost);
             }
                 }   
-        basket_size = next;
+        bea->basket_size = next;
         }
 
-    old_group_pos = group_pos;
+    old_group_pos = bea->group_pos;
 
 NEXT:
     /* price next group */
-    arc = arcs + group_pos;
-    for( ; arc < stop_arcs; arc += nr_group )
+    if( soa )
     {
+        j = SOA_GROUP_START( soa, bea->group_pos );
+#ifdef MCF_PARALLEL
+        if( par_threads > 1 )
+        {
+            if( !round_left )
+            {
+                round_soa = soa;
+                round_first = bea->group_pos;
+                round_nr_group = bea->nr_group;
+                round_groups = MIN( par_threads, bea->nr_group - priced );
+                par_run( price_round, NULL );
+                round_i = 0;
+                round_left = round_groups;
+            }
+            n = round_n[round_i];
+            hits = round_hit[round_i];
+            hit_costs = round_hit_cost[round_i];
+            round_i++;
+            round_left--;
+        }
+        else
+#endif
+        {
+            n = price_kernel( soa, j, 
+                              SOA_GROUP_START( soa, bea->group_pos + 1 ),
+                              bea->group_hit, bea->group_hit_cost );
+            hits = bea->group_hit;
+            hit_costs = bea->group_hit_cost;
+        }
+        for( i = 0; i < n; i++ )
+        {
+            basket[bea->basket_size].abs_cost = ABS(hit_costs[i]);
+            basket[bea->basket_size].a = bea->group_pos 
+                + (hits[i] - j) * bea->nr_group;
+            bea->basket_size++;
+        }
+    }
+    else
+    for( arc = arcs + bea->group_pos; arc < stop_arcs; arc += bea->nr_group )
+    {
+#if MCF_PREFETCH
+        /* the arc MCF_PREFETCH groups ahead, and the ends of the one
+           half way there, whose line should have arrived by now */
+        if( arc + MCF_PREFETCH * bea->nr_group < stop_arcs )
+            PREFETCH( arc + MCF_PREFETCH * bea->nr_group );
+        if( arc + (MCF_PREFETCH / 2) * bea->nr_group < stop_arcs )
+        {
+            PREFETCH( ARC_TAIL( arc + (MCF_PREFETCH / 2) * bea->nr_group ) );
+            PREFETCH( ARC_HEAD( arc + (MCF_PREFETCH / 2) * bea->nr_group ) );
+        }
+#endif
+        MEMTRACE_LOAD( &arc->ident );
         if( arc->ident > BASIC )
         {
+            MEMTRACE_LOAD( &arc->cost );
+            MEMTRACE_LOAD( &arc->tail );
+            MEMTRACE_LOAD( &ARC_TAIL( arc )->potential );
+            MEMTRACE_LOAD( &arc->head );
+            MEMTRACE_LOAD( &ARC_HEAD( arc )->potential );
             /* red_cost = bea_compute_red_cost( arc ); */
-            red_cost = arc->cost - arc->tail->potential + arc->head->potential;
+            red_cost = arc->cost - ARC_TAIL( arc )->potential 
+                + ARC_HEAD( arc )->potential;
             if( bea_is_dual_infeasible( arc, red_cost ) )
             {
-                basket_size++;
-                perm[basket_size]->a = arc;
-                perm[basket_size]->cost = red_cost;
-                perm[basket_size]->abs_cost = ABS(red_cost);
+                MEMTRACE_STORE( basket + bea->basket_size );
+                basket[bea->basket_size].abs_cost = ABS(red_cost);
+                basket[bea->basket_size].a = arc - arcs;
+                bea->basket_size++;
             }
         }
         
     }
 
-    if( ++group_pos == nr_group )
-        group_pos = 0;
+    priced++;
+    if( ++bea->group_pos == bea->nr_group )
+        bea->group_pos = 0;
 
-    if( basket_size < B && group_pos != old_group_pos )
+    if( bea->basket_size < B && bea->group_pos != old_group_pos )
         goto NEXT;
 
-    if( basket_size == 0 )
+    if( bea->basket_size == 0 )
     {
-        initialize = 1;
+        bea->initialized = 0;
         *red_cost_of_bea = 0; 
         return NULL;
     }
     
-    sort_basket( 1, basket_size );
+    select_basket( basket, bea->basket_size, B );
     
-    *red_cost_of_bea = perm[1]->cost;
-    return( perm[1]->a );
+    /* a dual infeasible arc's reduced cost is negative at its lower
+       bound and positive at its upper one */
+    arc = arcs + basket[0].a;
+    *red_cost_of_bea = ( arc->ident == AT_LOWER ) ? -basket[0].abs_cost
+                                                  : basket[0].abs_cost;
+    return( arc );
 }
 
 
@@ -27,7 +27,16 @@ Copyright (c) 2003-2005 Andreas Loebel.
 #include "defines.h"
 
 
-extern arc_t *primal_bea_mpp _PROTO_(( long, arc_t*, arc_t*, cost_t* ));
+/* Pricing kernels for set_pricing_kernel */
+#define PRICE_AUTO    0
+#define PRICE_SCALAR  1
+#define PRICE_AVX2    2
+#define PRICE_AVX512  3
+
+extern long set_pricing_kernel _PROTO_(( long ));
+extern long refresh_arc_soa _PROTO_(( network_t * ));
+extern arc_t *primal_bea_mpp _PROTO_(( long, arc_t*, arc_t*, cost_t*,
+                                       arc_soa_t*, bea_t* ));
 
 
 #endif
@@ -62,17 +62,17 @@ node_t *primal_iminus( delta, xchange, iplus, jplus, w )
         {
             if( iplus->orientation )
                 TEST_MIN( iplus, 0, iplus->flow, > )
-            else if( iplus->pred->pred )
+            else if( NODE_PRED( NODE_PRED( iplus ) ) )
                 TEST_MIN( iplus, 0, (flow_t)1 - iplus->flow, > )
-            iplus = iplus->pred;
+            iplus = NODE_PRED( iplus );
         }
         else
         {
             if( !jplus->orientation )
                 TEST_MIN( jplus, 1, jplus->flow, >= )
-            else if( jplus->pred->pred )
+            else if( NODE_PRED( NODE_PRED( jplus ) ) )
                 TEST_MIN( jplus, 1, (flow_t)1 - jplus->flow, >= )
-            jplus = jplus->pred;
+            jplus = NODE_PRED( jplus );
         }
     } 
 
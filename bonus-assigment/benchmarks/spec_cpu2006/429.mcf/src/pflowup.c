@@ -37,7 +37,7 @@ void primal_update_flow( iplus, jplus, w )
     node_t *w; 
 #endif
 {
-    for( ; iplus != w; iplus = iplus->pred )
+    for( ; iplus != w; iplus = NODE_PRED( iplus ) )
     {
         if( iplus->orientation )
             iplus->flow = (flow_t)0;
@@ -45,7 +45,7 @@ void primal_update_flow( iplus, jplus, w )
             iplus->flow = (flow_t)1;
     }
 
-    for( ; jplus != w; jplus = jplus->pred )
+    for( ; jplus != w; jplus = NODE_PRED( jplus ) )
     {
         if( jplus->orientation )
             jplus->flow = (flow_t)1;
@@ -25,6 +25,14 @@ Copyright (c) 2003-2005 Andreas Loebel.
 #include "psimplex.h"
 
 
+/* update_tree shifts the potentials of the subtree it moves by the
+   entering arc's reduced cost, which keeps them exact (the costs are
+   integral), and counts the DOWN nodes it creates or removes. The
+   checksum therefore takes that count every 200 iterations, and
+   the full refresh_potential, which derives both from the tree
+   again, only runs every FULL_REFRESH iterations and at the end. */
+#define FULL_REFRESH 10000
+
 
 #ifdef _PROTO_
 long primal_net_simplex( network_t *net )
@@ -54,29 +62,41 @@ long primal_net_simplex(  net )
     long          *iterations = &(net->iterations);
     long          *bound_exchanges = &(net->bound_exchanges);
     long          *checksum = &(net->checksum);
+    arc_soa_t     *soa;
+
+
+    /* Without memory the nodes just keep their places */
+    relayout_tree( net );
 
+    /* Without memory for the SoA copy, price from arc_t as before */
+    soa = refresh_arc_soa( net ) ? (arc_soa_t *)NULL : &(net->soa);
 
     while( !opt )
     {       
-        if( (bea = primal_bea_mpp( m, arcs, stop_arcs, &red_cost_of_bea )) )
+        BENCH_BEGIN( net->bench_price );
+        bea = primal_bea_mpp( m, arcs, stop_arcs, &red_cost_of_bea,
+                              soa, &(net->bea) );
+        BENCH_END( net->bench_price );
+        if( bea )
         {
             (*iterations)++;
 
 #ifdef DEBUG
             printf( "it %ld: bea = (%ld,%ld), red_cost = %ld\n", 
-                    *iterations, bea->tail->number, bea->head->number,
+                    *iterations, NODE_COLD( ARC_TAIL( bea ) )->number, 
+                    NODE_COLD( ARC_HEAD( bea ) )->number,
                     red_cost_of_bea );
 #endif
 
             if( red_cost_of_bea > ZERO ) 
             {
-                iplus = bea->head;
-                jplus = bea->tail;
+                iplus = ARC_HEAD( bea );
+                jplus = ARC_TAIL( bea );
             }
             else 
             {
-                iplus = bea->tail;
-                jplus = bea->head;
+                iplus = ARC_TAIL( bea );
+                jplus = ARC_HEAD( bea );
             }
 
             delta = (flow_t)1;
@@ -91,6 +111,9 @@ long primal_net_simplex(  net )
                     bea->ident = AT_LOWER;
                 else
                     bea->ident = AT_UPPER;
+                if( soa )
+                    soa->ident[SOA_POS( soa, bea - arcs )] = 
+                        (signed char)bea->ident;
 
                 if( delta )
                     primal_update_flow( iplus, jplus, w );
@@ -104,9 +127,9 @@ long primal_net_simplex(  net )
                     iplus = temp;
                 }
 
-                jminus = iminus->pred;
+                jminus = NODE_PRED( iminus );
 
-                bla = iminus->basic_arc;
+                bla = NODE_BASIC_ARC( iminus );
                  
                 if( xchange != iminus->orientation )
                     new_set = AT_LOWER;
@@ -118,22 +141,33 @@ long primal_net_simplex(  net )
                 else
                     new_flow = delta;
 
-                if( bea->tail == iplus )
+                if( ARC_TAIL( bea ) == iplus )
                     new_orientation = UP;
                 else
                     new_orientation = DOWN;
 
-                update_tree( !xchange, new_orientation,
+                net->n_down += update_tree( !xchange, new_orientation,
                             delta, new_flow, iplus, jplus, iminus, 
                             jminus, w, bea, red_cost_of_bea,
                             (flow_t)net->feas_tol );
 
                 bea->ident = BASIC; 
                 bla->ident = new_set;
+                if( soa )
+                {
+                    /* bla may be one of the artificial dummy_arcs */
+                    soa->ident[SOA_POS( soa, bea - arcs )] = BASIC;
+                    if( bla >= arcs && bla < stop_arcs )
+                        soa->ident[SOA_POS( soa, bla - arcs )] = 
+                            (signed char)new_set;
+                }
                
                 if( !((*iterations-1) % 200) )
                 {
-                    *checksum += refresh_potential( net );
+                    if( !((*iterations-1) % FULL_REFRESH) )
+                        *checksum += refresh_potential( net );
+                    else
+                        *checksum += net->n_down;
 #if defined AT_HOME
                     if( *checksum > 2000000000l )
                     {
@@ -38,11 +38,11 @@ long primal_start_artificial( net )
 
 
     root = node = net->nodes; node++;
-    root->basic_arc = NULL;
-    root->pred = NULL;
-    root->child = node;
-    root->sibling = NULL;
-    root->sibling_prev = NULL;
+    SET_BASIC_ARC( root, NULL );
+    SET_PRED( root, NULL );
+    SET_CHILD( root, node );
+    SET_SIBLING( root, NULL );
+    SET_SIBLING_PREV( root, NULL );
     root->depth = (net->n) + 1;
     root->orientation = 0;
     root->potential = (cost_t) -MAX_ART_COST;
@@ -56,11 +56,11 @@ long primal_start_artificial( net )
     arc = net->dummy_arcs;
     for( stop = (void *)net->stop_nodes; node != (node_t *)stop; arc++, node++ )
     {
-        node->basic_arc = arc;
-        node->pred = root;
-        node->child = NULL;
-        node->sibling = node + 1; 
-        node->sibling_prev = node - 1;
+        SET_BASIC_ARC( node, arc );
+        SET_PRED( node, root );
+        SET_CHILD( node, NULL );
+        SET_SIBLING( node, node + 1 ); 
+        SET_SIBLING_PREV( node, node - 1 );
         node->depth = 1;
 
         arc->cost = (cost_t) MAX_ART_COST;
@@ -68,14 +68,15 @@ long primal_start_artificial( net )
 
         node->orientation = UP; 
         node->potential = ZERO;
-        arc->tail = node;
-        arc->head = root;                
+        SET_TAIL( arc, node );
+        SET_HEAD( arc, root );                
         node->flow = (flow_t)0;
     }
 
     node--; root++;
-    node->sibling = NULL;
-    root->sibling_prev = NULL;
+    SET_SIBLING( node, NULL );
+    SET_SIBLING_PREV( root, NULL );
+    net->n_down = 0;
 
     return 0;
 }
@@ -22,31 +22,25 @@ Copyright (c) 2003-2005 Andreas Loebel.
 
 #include "readmin.h"
 
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
 
 
 
+/* Size and allocate the network for t trips and h deadhead arcs */
 #ifdef _PROTO_
-long read_min( network_t *net )
+static long alloc_min( network_t *net, long t, long h )
 #else
-long read_min( net )
+static long alloc_min( net, t, h )
      network_t *net;
+     long t, h;
 #endif
-{                                       
-    FILE *in = NULL;
-    char instring[201];
-    long t, h, c;
-    long i;
-    arc_t *arc;
-    node_t *node;
-
-
-    if(( in = fopen( net->inputfile, "r")) == NULL )
-        return -1;
-
-    fgets( instring, 200, in );
-    if( sscanf( instring, "%ld %ld", &t, &h ) != 2 )
-        return -1;
-    
+{
+    long max_arcs;
 
     net->n_trips = t;
     net->m_org = h;
@@ -77,11 +71,30 @@ long read_min( net )
     assert( net->max_new_m >= 3 );
 
     
-    net->nodes      = (node_t *) calloc( net->n + 1, sizeof(node_t) );
-    net->dummy_arcs = (arc_t *)  calloc( net->n,   sizeof(arc_t) );
-    net->arcs       = (arc_t *)  calloc( net->max_m,   sizeof(arc_t) );
+    /* address space for resize_prob, which stops growing the arcs of a
+       small net at about n_trips^2/2 + m */
+    max_arcs = net->max_m;
+    if( net->n_trips <= MAX_NB_TRIPS_FOR_SMALL_NET )
+      max_arcs = MAX( max_arcs, net->m + net->max_new_m + (t * t) / 2 );
+
+#ifdef MCF_COMPACT
+    mcf_node_base   = (node_t *) mem_alloc( (net->n + 2) * sizeof(node_t), 0 );
+    mcf_node_cold   = (node_cold_t *) calloc( net->n + 2, sizeof(node_cold_t) );
+    mcf_arc_base    = (arc_t *)  mem_alloc( 
+                              (1 + net->n + net->max_m) * sizeof(arc_t),
+                              (1 + net->n + max_arcs) * sizeof(arc_t) );
+    net->nodes      = mcf_node_base && mcf_node_cold ? mcf_node_base + 1 : NULL;
+    net->dummy_arcs = mcf_arc_base ? mcf_arc_base + 1 : NULL;
+    net->arcs       = mcf_arc_base ? net->dummy_arcs + net->n : NULL;
+#else
+    net->nodes      = (node_t *) mem_alloc( (net->n + 1) * sizeof(node_t), 0 );
+    net->dummy_arcs = (arc_t *)  mem_alloc( net->n * sizeof(arc_t), 0 );
+    net->arcs       = (arc_t *)  mem_alloc( net->max_m * sizeof(arc_t),
+                                            max_arcs * sizeof(arc_t) );
+#endif
+    net->thread     = (node_t **) malloc( net->n * sizeof(node_t *) );
 
-    if( !( net->nodes && net->arcs && net->dummy_arcs ) )
+    if( !( net->nodes && net->arcs && net->dummy_arcs && net->thread ) )
     {
       printf( "read_min(): not enough memory\n" );
       getfree( net );
@@ -109,75 +122,76 @@ long read_min( net )
     net->stop_arcs  = net->arcs + net->m;
     net->stop_dummy = net->dummy_arcs + net->n;
 
+    return 0;
+}
 
-    node = net->nodes;
-    arc = net->arcs;
 
-    for( i = 1; i <= net->n_trips; i++ )
-    {
-        fgets( instring, 200, in );
 
-        if( sscanf( instring, "%ld %ld", &t, &h ) != 2 || t > h )
-            return -1;
 
-        node[i].number = -i;
-        node[i].flow = (flow_t)-1;
-            
-        node[i+net->n_trips].number = i;
-        node[i+net->n_trips].flow = (flow_t)1;
-        
-        node[i].time = t;
-        node[i+net->n_trips].time = h;
-
-        arc->tail = &(node[net->n]);
-        arc->head = &(node[i]);
-        arc->org_cost = arc->cost = (cost_t)(net->bigM+15);
-        arc->nextout = arc->tail->firstout;
-        arc->tail->firstout = arc;
-        arc->nextin = arc->head->firstin;
-        arc->head->firstin = arc; 
-        arc++;
-                                    
-        arc->tail = &(node[i+net->n_trips]);
-        arc->head = &(node[net->n]);
-        arc->org_cost = arc->cost = (cost_t)15;
-        arc->nextout = arc->tail->firstout;
-        arc->tail->firstout = arc;
-        arc->nextin = arc->head->firstin;
-        arc->head->firstin = arc; 
-        arc++;
-
-        arc->tail = &(node[i]);
-        arc->head = &(node[i+net->n_trips]);
-        arc->org_cost = arc->cost = (cost_t)(2*MAX(net->bigM,(long)BIGM));
-        arc->nextout = arc->tail->firstout;
-        arc->tail->firstout = arc;
-        arc->nextin = arc->head->firstin;
-        arc->head->firstin = arc; 
-        arc++;
-    }
+#ifdef _PROTO_
+static void add_arc( arc_t *arc, node_t *tail, node_t *head, cost_t cost )
+#else
+static void add_arc( arc, tail, head, cost )
+     arc_t *arc;
+     node_t *tail, *head;
+     cost_t cost;
+#endif
+{
+    SET_TAIL( arc, tail );
+    SET_HEAD( arc, head );
+    arc->org_cost = arc->cost = cost;
+    SET_NEXTOUT( arc, NODE_FIRSTOUT( tail ) );
+    SET_FIRSTOUT( tail, arc );
+    SET_NEXTIN( arc, NODE_FIRSTIN( head ) );
+    SET_FIRSTIN( head, arc ); 
+}
 
-    
-    if( i != net->n_trips + 1 )
-        return -1;
 
 
-    for( i = 0; i < net->m_org; i++, arc++ )
-    {
-        fgets( instring, 200, in );
+
+/* Trip i (1..n_trips) from time t to h: its two nodes and the pull
+   out, pull in and trip arcs, arcs[3i-3] .. arcs[3i-1] */
+#ifdef _PROTO_
+static void add_trip( network_t *net, long i, long t, long h )
+#else
+static void add_trip( net, i, t, h )
+     network_t *net;
+     long i, t, h;
+#endif
+{
+    node_t *node = net->nodes;
+    arc_t *arc = net->arcs + 3 * (i - 1);
+
+
+    NODE_COLD( node + i )->number = -i;
+    node[i].flow = (flow_t)-1;
         
-        if( sscanf( instring, "%ld %ld %ld", &t, &h, &c ) != 3 )
-                return -1;
+    NODE_COLD( node + i + net->n_trips )->number = i;
+    node[i+net->n_trips].flow = (flow_t)1;
+    
+    NODE_COLD( node + i )->time = t;
+    NODE_COLD( node + i + net->n_trips )->time = h;
+
+    add_arc( arc++, &(node[net->n]), &(node[i]), 
+             (cost_t)(net->bigM+15) );
+    add_arc( arc++, &(node[i+net->n_trips]), &(node[net->n]), 
+             (cost_t)15 );
+    add_arc( arc, &(node[i]), &(node[i+net->n_trips]), 
+             (cost_t)(2*MAX(net->bigM,(long)BIGM)) );
+}
 
-        arc->tail = &(node[t+net->n_trips]);
-        arc->head = &(node[h]);
-        arc->org_cost = (cost_t)c;
-        arc->cost = (cost_t)c;
-        arc->nextout = arc->tail->firstout;
-        arc->tail->firstout = arc;
-        arc->nextin = arc->head->firstin;
-        arc->head->firstin = arc; 
-    }
+
+
+
+#ifdef _PROTO_
+static void finish_min( network_t *net, arc_t *arc )
+#else
+static void finish_min( net, arc )
+     network_t *net;
+     arc_t *arc;
+#endif
+{
+    long i;
 
 
     if( net->stop_arcs != arc )
@@ -189,8 +203,6 @@ long read_min( net )
         net->m_org = net->m;
     }
     
-    fclose( in );
-
 
     net->clustfile[0] = (char)0;
         
@@ -201,7 +213,154 @@ long read_min( net )
         net->arcs[3*i-1].org_cost = 
             (cost_t)((-2)*(MAX(net->bigM,(long) BIGM)));
     }
+}
+
+
+
+
+/* Binary instance in the first size bytes of buf. Each record is
+   checked before use, so a truncated or foreign file is refused. */
+#ifdef _PROTO_
+static long read_min_bin( network_t *net, const char *buf, size_t size )
+#else
+static long read_min_bin( net, buf, size )
+     network_t *net;
+     const char *buf;
+     size_t size;
+#endif
+{
+    const mcf_bin_header_t *hdr = (const mcf_bin_header_t *)buf;
+    const int *rec;
+    size_t words;
+    long i, t, h;
+    arc_t *arc;
+
+
+    if( size < sizeof(mcf_bin_header_t) || hdr->version != MCF_BIN_VERSION
+        || hdr->n_trips < 0 || hdr->m_org < 0 )
+        return -1;
+    words = (size - sizeof(mcf_bin_header_t)) / sizeof(int);
+    if( (size_t)hdr->n_trips > words / 2 
+        || (size_t)hdr->m_org > (words - 2 * (size_t)hdr->n_trips) / 3 )
+        return -1;
+
+    if( alloc_min( net, hdr->n_trips, hdr->m_org ) )
+        return -1;
+
+    rec = (const int *)(hdr + 1);
+    for( i = 1; i <= net->n_trips; i++, rec += 2 )
+    {
+        if( rec[0] > rec[1] )
+            return -1;
+        add_trip( net, i, rec[0], rec[1] );
+    }
+
+    arc = net->arcs + 3 * net->n_trips;
+    for( i = 0; i < net->m_org; i++, arc++, rec += 3 )
+    {
+        t = rec[0];
+        h = rec[1];
+        if( t < 1 || t > net->n_trips || h < 1 || h > net->n_trips )
+            return -1;
+        add_arc( arc, &(net->nodes[t+net->n_trips]), &(net->nodes[h]), 
+                 (cost_t)rec[2] );
+    }
+
+    finish_min( net, arc );
+    return 0;
+}
+
+
+
+
+#ifdef _PROTO_
+long read_min( network_t *net )
+#else
+long read_min( net )
+     network_t *net;
+#endif
+{                                       
+    FILE *in = NULL;
+    char instring[201];
+    long t, h, c;
+    long i;
+    arc_t *arc;
+    node_t *node;
+
+
+    if(( in = fopen( net->inputfile, "r")) == NULL )
+        return -1;
+
+    if( !fgets( instring, 200, in ) )
+        return -1;
+
+    if( !strncmp( instring, MCF_BIN_MAGIC, 4 ) )
+    {
+        /* map the file where we can, read it into memory elsewhere */
+        void *buf;
+        long size;
+        long ret;
+
+        fseek( in, 0, SEEK_END );
+        size = ftell( in );
+#ifndef _WIN32
+        buf = mmap( NULL, (size_t)size, PROT_READ, MAP_PRIVATE, 
+                    fileno( in ), 0 );
+        if( buf == MAP_FAILED )
+            buf = NULL;
+        ret = buf ? read_min_bin( net, (const char *)buf, (size_t)size ) : -1;
+        if( buf )
+            munmap( buf, (size_t)size );
+#else
+        buf = malloc( (size_t)size );
+        in = freopen( net->inputfile, "rb", in );
+        ret = buf && in && fread( buf, 1, (size_t)size, in ) == (size_t)size
+            ? read_min_bin( net, (const char *)buf, (size_t)size ) : -1;
+        FREE( buf );
+#endif
+        if( in )
+            fclose( in );
+        return ret;
+    }
+
+    if( sscanf( instring, "%ld %ld", &t, &h ) != 2 )
+        return -1;
+    
+    if( alloc_min( net, t, h ) )
+        return -1;
+
+
+    node = net->nodes;
+
+    for( i = 1; i <= net->n_trips; i++ )
+    {
+        fgets( instring, 200, in );
+
+        if( sscanf( instring, "%ld %ld", &t, &h ) != 2 || t > h )
+            return -1;
+
+        add_trip( net, i, t, h );
+    }
+
     
+    if( i != net->n_trips + 1 )
+        return -1;
+
+
+    arc = net->arcs + 3 * net->n_trips;
+    for( i = 0; i < net->m_org; i++, arc++ )
+    {
+        fgets( instring, 200, in );
+        
+        if( sscanf( instring, "%ld %ld %ld", &t, &h, &c ) != 3 )
+                return -1;
+
+        add_arc( arc, &(node[t+net->n_trips]), &(node[h]), (cost_t)c );
+    }
+
+    fclose( in );
+
+    finish_min( net, arc );
     
     return 0;
 }
@@ -29,6 +29,23 @@ Copyright (c) 2003-2005 Andreas Loebel.
 #include "mcflimit.h"
 
 
+/* Binary instance, written by mcf2bin from the text format and
+   recognised by read_min from its magic: this header, then n_trips
+   (start, end) pairs and m_org (from trip, to trip, cost) triples,
+   all int in host byte order, trips numbered from 1 as in the text
+   file. read_min maps it and builds the network without parsing. */
+#define MCF_BIN_MAGIC   "MCFB"
+#define MCF_BIN_VERSION 1
+
+typedef struct mcf_bin_header
+{
+    char magic[4];
+    int version;
+    int n_trips;
+    int m_org;
+} mcf_bin_header_t;
+
+
 extern long read_min _PROTO_(( network_t * ));
 
 
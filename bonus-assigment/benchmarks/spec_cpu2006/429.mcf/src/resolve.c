@@ -0,0 +1,66 @@
+/**************************************************************************
+RESOLVE.C of ZIB optimizer MCF, SPEC version
+
+The basis stays primal feasible under cost changes, since the flows
+do not move. Only the potentials follow the new basic arc costs, and
+primal_net_simplex prices out whatever became dual infeasible. Closing
+an arc without flow fixes it (FIXED, never priced). An arc in the basis
+or at its upper bound instead gets the artificial arcs' cost
+MAX_ART_COST, so the next solve pivots the flow off it whenever the
+trips can be covered otherwise. A later change with a real cost
+reopens the arc either way.
+
+Only arcs of the input file can be changed. The implicit arcs that
+price_out_impl generates from trip times are not affected.
+**************************************************************************/
+
+
+
+#include "resolve.h"
+
+
+
+
+/* Returns -1, changing nothing, if an arc number is out of range */
+#ifdef _PROTO_
+long apply_arc_changes( network_t *net, arc_change_t *chg, long nb_chg )
+#else
+long apply_arc_changes( net, chg, nb_chg )
+     network_t *net;
+     arc_change_t *chg;
+     long nb_chg;
+#endif
+{
+    /* read_min put the input arcs behind the 3 n_trips trip arcs, and
+       only implicit arcs are ever moved or removed */
+    arc_t *input = net->arcs + 3 * net->n_trips - 1;
+    arc_t *arc;
+    long i;
+
+
+    for( i = 0; i < nb_chg; i++ )
+        if( chg[i].arc < 1 || chg[i].arc > net->m_org )
+            return -1;
+
+    for( i = 0; i < nb_chg; i++ )
+    {
+        arc = input + chg[i].arc;
+        if( chg[i].cost == ARC_CLOSED )
+        {
+            if( arc->ident == AT_LOWER )
+                arc->ident = FIXED;
+            else if( arc->ident != FIXED )
+                arc->org_cost = arc->cost = (cost_t)MAX_ART_COST;
+        }
+        else
+        {
+            if( arc->ident == FIXED )
+                arc->ident = AT_LOWER;
+            arc->org_cost = arc->cost = chg[i].cost;
+        }
+    }
+
+    refresh_potential( net );
+
+    return 0;
+}
@@ -0,0 +1,42 @@
+/**************************************************************************
+RESOLVE.H of ZIB optimizer MCF, SPEC version
+
+Warm start: after a solve, apply_arc_changes changes the costs of some
+deadhead arcs, or closes/reopens them, while keeping the basis tree,
+the flows and the implicit arcs. Calling global_opt( net ) again then
+resumes the simplex from that basis, so a re-solve only pays for the
+pivots the change causes:
+
+    read_min( net ); primal_start_artificial( net ); global_opt( net );
+    ...
+    apply_arc_changes( net, changes, nb_changes ); global_opt( net );
+**************************************************************************/
+
+
+
+#ifndef _RESOLVE_H
+#define _RESOLVE_H
+
+
+#include "defines.h"
+#include "mcfutil.h"
+
+
+/* cost value that closes an arc (capacity 0) */
+#define ARC_CLOSED ((cost_t)LONG_MAX)
+
+
+/* New cost, or ARC_CLOSED, of input arc number `arc': 1 .. m_org
+   in the order of the input file's arc lines (trips may be joined
+   by several arcs, so their numbers would not name one) */
+typedef struct arc_change
+{
+    long arc;
+    cost_t cost;
+} arc_change_t;
+
+
+extern long apply_arc_changes _PROTO_(( network_t *, arc_change_t *, long ));
+
+
+#endif
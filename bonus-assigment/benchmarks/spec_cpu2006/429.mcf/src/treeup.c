@@ -25,8 +25,9 @@ Copyright (c) 2003-2005 Andreas Loebel.
 
 
 
+/* Returns the change in the number of DOWN nodes */
 #ifdef _PROTO_
-void update_tree( 
+long update_tree( 
                  long cycle_ori,
                  long new_orientation,
                  flow_t delta,
@@ -41,7 +42,7 @@ void update_tree(
                  flow_t feas_tol
                 )
 #else
-void update_tree( cycle_ori, new_orientation, delta, new_flow, 
+long update_tree( cycle_ori, new_orientation, delta, new_flow, 
                  iplus, jplus, iminus, jminus, w, bea, sigma, feas_tol )
      long cycle_ori;
      long new_orientation;
@@ -65,11 +66,12 @@ void update_tree( cycle_ori, new_orientation, delta, new_flow,
     long     depth_iminus;    
     long     new_depth;       
     flow_t   flow_temp;       
+    long     down = 0;
 
 
     /**/
-    if( (bea->tail == jplus && sigma < 0) ||
-        (bea->tail == iplus && sigma > 0) )
+    if( (ARC_TAIL( bea ) == jplus && sigma < 0) ||
+        (ARC_TAIL( bea ) == iplus && sigma > 0) )
         sigma = ABS(sigma);
     else
         sigma = -(ABS(sigma));
@@ -77,7 +79,7 @@ void update_tree( cycle_ori, new_orientation, delta, new_flow,
     father = iminus;
     father->potential += sigma;
  RECURSION:
-    temp = father->child;
+    temp = NODE_CHILD( father );
     if( temp )
     {
     ITERATION:
@@ -88,10 +90,10 @@ void update_tree( cycle_ori, new_orientation, delta, new_flow,
  TEST:
     if( father == iminus )
         goto CONTINUE;
-    temp = father->sibling;
+    temp = NODE_SIBLING( father );
     if( temp )
         goto ITERATION;
-    father = father->pred;
+    father = NODE_PRED( father );
     goto TEST;
     
  CONTINUE:
@@ -99,37 +101,38 @@ void update_tree( cycle_ori, new_orientation, delta, new_flow,
 
 
     temp = iplus;
-    father = temp->pred;
+    father = NODE_PRED( temp );
     new_depth = depth_iminus = iminus->depth;
     new_pred = jplus;
     new_basic_arc = bea;
     while( temp != jminus )
     {
-        if( temp->sibling )
-            temp->sibling->sibling_prev = temp->sibling_prev;
-        if( temp->sibling_prev )
-            temp->sibling_prev->sibling = temp->sibling;
-        else father->child = temp->sibling;
+        if( NODE_SIBLING( temp ) )
+            SET_SIBLING_PREV( NODE_SIBLING( temp ), NODE_SIBLING_PREV( temp ) );
+        if( NODE_SIBLING_PREV( temp ) )
+            SET_SIBLING( NODE_SIBLING_PREV( temp ), NODE_SIBLING( temp ) );
+        else SET_CHILD( father, NODE_SIBLING( temp ) );
 
 
-        temp->pred = new_pred;
-        temp->sibling = new_pred->child;
-        if( temp->sibling )
-            temp->sibling->sibling_prev = temp;
-        new_pred->child = temp;
-        temp->sibling_prev = 0;
+        SET_PRED( temp, new_pred );
+        SET_SIBLING( temp, NODE_CHILD( new_pred ) );
+        if( NODE_SIBLING( temp ) )
+            SET_SIBLING_PREV( NODE_SIBLING( temp ), temp );
+        SET_CHILD( new_pred, temp );
+        SET_SIBLING_PREV( temp, NULL );
 
         orientation_temp = !(temp->orientation); 
         if( orientation_temp == cycle_ori )
             flow_temp = temp->flow + delta;
         else
             flow_temp = temp->flow - delta;
-        basic_arc_temp = temp->basic_arc;
+        basic_arc_temp = NODE_BASIC_ARC( temp );
         depth_temp = temp->depth;
 
+        down += (new_orientation == DOWN) - (temp->orientation == DOWN);
         temp->orientation = new_orientation;
         temp->flow = new_flow;
-        temp->basic_arc = new_basic_arc;
+        SET_BASIC_ARC( temp, new_basic_arc );
         temp->depth = new_depth;
 
         new_pred = temp;
@@ -138,12 +141,12 @@ void update_tree( cycle_ori, new_orientation, delta, new_flow,
         new_basic_arc = basic_arc_temp;
         new_depth = depth_iminus - depth_temp;      
         temp = father;
-        father = temp->pred;
+        father = NODE_PRED( temp );
     } 
 
     if( delta > feas_tol )
     {
-        for( temp = jminus; temp != w; temp = temp->pred )
+        for( temp = jminus; temp != w; temp = NODE_PRED( temp ) )
         {
             temp->depth -= depth_iminus;
             if( temp->orientation != cycle_ori )
@@ -151,7 +154,7 @@ void update_tree( cycle_ori, new_orientation, delta, new_flow,
             else
                 temp->flow -= delta;
         }
-        for( temp = jplus; temp != w; temp = temp->pred )
+        for( temp = jplus; temp != w; temp = NODE_PRED( temp ) )
         {
             temp->depth += depth_iminus;
             if( temp->orientation == cycle_ori )
@@ -162,12 +165,14 @@ void update_tree( cycle_ori, new_orientation, delta, new_flow,
     }
     else
     {
-        for( temp = jminus; temp != w; temp = temp->pred )
+        for( temp = jminus; temp != w; temp = NODE_PRED( temp ) )
             temp->depth -= depth_iminus;
-        for( temp = jplus; temp != w; temp = temp->pred )
+        for( temp = jplus; temp != w; temp = NODE_PRED( temp ) )
             temp->depth += depth_iminus;
     }
 
+
+    return down;
 }
 
 
@@ -220,6 +220,178 @@ DigitizeSequence(char *seq, int L)
 }
 
 
+/* Function: DigitizedRandomSequence()
+ * 
+ * Purpose:  Generate an iid sequence of length L straight into
+ *           digitized form, in a buffer the caller keeps:
+ *           the same sequence, from the same sre_random() draws,
+ *           as DigitizeSequence(RandomSequence(Alphabet, p,
+ *           Alphabet_size, L), L), without its two allocations.
+ *           
+ * Args:     p   - residue probabilities [0..Alphabet_size-1]
+ *           L   - length of sequence
+ *           dsq - RETURN: digitized sequence; room for L+2 chars
+ */
+void
+DigitizedRandomSequence(float *p, int L, char *dsq)
+{
+  int i;
+
+  dsq[0] = dsq[L+1] = (char) Alphabet_iupac;
+  for (i = 1; i <= L; i++)
+    dsq[i] = (char) FChoose(p, Alphabet_size);
+}
+
+
+/* Function: SetResidueAlias()
+ * 
+ * Purpose:  Build the alias table for drawing residues from the
+ *           distribution p, by Vose's method: columns with less
+ *           than their share 1/n of the mass are topped up from
+ *           one with more, until every column holds exactly 1/n.
+ *           
+ * Args:     ra  - RETURN: the table
+ *           p   - residue probabilities [0..Alphabet_size-1]
+ */
+void
+SetResidueAlias(struct ralias_s *ra, float *p)
+{
+  double q[MAXABET];		/* mass of each column, x n */
+  int    small[MAXABET], large[MAXABET];
+  int    nsmall, nlarge;
+  double sum;
+  int    x, s, l;
+
+  ra->n = Alphabet_size;
+  sum   = 0.;
+  for (x = 0; x < ra->n; x++) sum += p[x];
+  nsmall = nlarge = 0;
+  for (x = 0; x < ra->n; x++)
+    {
+      q[x] = p[x] * ra->n / sum;
+      if (q[x] < 1.) small[nsmall++] = x;
+      else           large[nlarge++] = x;
+    }
+  while (nsmall > 0 && nlarge > 0)
+    {
+      s = small[--nsmall];
+      l = large[--nlarge];
+      ra->thresh[s] = (unsigned int) (q[s] * 4294967296.);
+      ra->alias[s]  = (char) l;
+      q[l] -= 1. - q[s];
+      if (q[l] < 1.) small[nsmall++] = l;
+      else           large[nlarge++] = l;
+    }
+  /* what's left is full, up to roundoff */
+  while (nlarge > 0) { l = large[--nlarge]; ra->thresh[l] = 0xffffffffU; ra->alias[l] = (char) l; }
+  while (nsmall > 0) { s = small[--nsmall]; ra->thresh[s] = 0xffffffffU; ra->alias[s] = (char) s; }
+}
+
+/* Function: alias_draw()
+ * 
+ * Purpose:  Residue i of the stream key: one 64-bit draw, whose
+ *           high half picks the column, and low half tosses its
+ *           coin.
+ */
+static inline char
+alias_draw(struct ralias_s *ra, unsigned long long key, int i)
+{
+  unsigned long long z;
+  unsigned int       j;
+
+  z = sre_ctr_random64(key, i);
+  j = (unsigned int) (((z >> 32) * (unsigned long long) ra->n) >> 32);
+  return (unsigned int) z < ra->thresh[j] ? (char) j : ra->alias[j];
+}
+
+#if defined(__GNUC__) && defined(__x86_64__) && !defined(NO_SIMD_VITERBI)
+#include <immintrin.h>
+#define SIMD_ALIAS_X86
+
+/* Function: alias_fill_avx512()
+ * 
+ * Purpose:  alias_draw() for residues 1.., eight at a time in
+ *           64-bit lanes: the SplitMix64 states are a running sum,
+ *           the table lookups are gathers.
+ *           
+ * Return:   the first residue not drawn, for the scalar tail.
+ */
+__attribute__((target("avx512f,avx512dq")))
+static int
+alias_fill_avx512(struct ralias_s *ra, unsigned long long key, int L, char *dsq)
+{
+  long long thresh[MAXABET], alias[MAXABET];
+  __m512i   st, z, j, keep;
+  __mmask8  lo;
+  const __m512i step = _mm512_set1_epi64(8 * 0x9e3779b97f4a7c15ULL);
+  const __m512i c1   = _mm512_set1_epi64(0xbf58476d1ce4e5b9ULL);
+  const __m512i c2   = _mm512_set1_epi64(0x94d049bb133111ebULL);
+  const __m512i n    = _mm512_set1_epi64(ra->n);
+  const __m512i low  = _mm512_set1_epi64(0xffffffffULL);
+  int i, x;
+
+  for (x = 0; x < ra->n; x++)
+    {
+      thresh[x] = ra->thresh[x];
+      alias[x]  = ra->alias[x];
+    }
+				/* states of residues 1..8 */
+  st = _mm512_add_epi64(_mm512_set1_epi64(key),
+			_mm512_mullo_epi64(_mm512_setr_epi64(2, 3, 4, 5, 6, 7, 8, 9),
+					   _mm512_set1_epi64(0x9e3779b97f4a7c15ULL)));
+  for (i = 1; i + 7 <= L; i += 8)
+    {
+      z  = _mm512_mullo_epi64(_mm512_xor_si512(st, _mm512_srli_epi64(st, 30)), c1);
+      z  = _mm512_mullo_epi64(_mm512_xor_si512(z,  _mm512_srli_epi64(z,  27)), c2);
+      z  = _mm512_xor_si512(z, _mm512_srli_epi64(z, 31));
+      st = _mm512_add_epi64(st, step);
+
+      j    = _mm512_srli_epi64(_mm512_mul_epu32(_mm512_srli_epi64(z, 32), n), 32);
+      lo   = _mm512_cmplt_epu64_mask(_mm512_and_si512(z, low),
+				     _mm512_i64gather_epi64(j, thresh, 8));
+      keep = _mm512_mask_blend_epi64(lo, _mm512_i64gather_epi64(j, alias, 8), j);
+      _mm_storel_epi64((__m128i *) (dsq + i), _mm512_cvtepi64_epi8(keep));
+    }
+  return i;
+}
+#endif /* SIMD_ALIAS_X86 */
+
+/* Function: DigitizedAliasSequence()
+ * 
+ * Purpose:  Generate an iid sequence of length L straight into
+ *           digitized form, like DigitizedRandomSequence(), but
+ *           from an alias table and the counter-based stream key:
+ *           residue i is a function of (key, i) alone
+ *           (alias_draw()). No divisions, no search and no
+ *           dependence between residues, so on x86-64 with
+ *           AVX-512 they are drawn eight at a time; the call is
+ *           threadsafe.
+ *           
+ * Args:     ra  - alias table, SetResidueAlias()
+ *           key - the stream; e.g. sre_ctr_random64(seed, sample#)
+ *           L   - length of sequence
+ *           dsq - RETURN: digitized sequence; room for L+2 chars
+ */
+void
+DigitizedAliasSequence(struct ralias_s *ra, unsigned long long key, int L, char *dsq)
+{
+#ifdef SIMD_ALIAS_X86
+  static int use_avx512 = -1;
+#endif
+  int i;
+
+  i = 1;
+#ifdef SIMD_ALIAS_X86
+  if (use_avx512 < 0) 
+    use_avx512 = __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq");
+  if (use_avx512) i = alias_fill_avx512(ra, key, L, dsq);
+#endif
+  for (; i <= L; i++)
+    dsq[i] = alias_draw(ra, key, i);
+  dsq[0] = dsq[L+1] = (char) Alphabet_iupac;
+}
+
+
 /* Function: DedigitizeSequence()
  * Date:     SRE, Tue Dec 16 10:39:19 1997 [StL]
  * 
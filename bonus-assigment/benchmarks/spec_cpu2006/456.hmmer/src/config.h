@@ -49,6 +49,20 @@
  */
 /* #define HMMER_NCPU 4 */
 
+/* gem5 region of interest: built with -DGEM5_ROI (make roi), the
+ * search and calibration loops reset the gem5 statistics when they
+ * start, after the HMM is read, and dump them when they are done.
+ * The gem5 include directory and libm5.a must be given to the build.
+ */
+#ifdef GEM5_ROI
+#include <gem5/m5ops.h>
+#define ROI_BEGIN() do { m5_work_begin(0, 0); m5_reset_stats(0, 0); } while (0)
+#define ROI_END()   do { m5_dump_stats(0, 0); m5_work_end(0, 0); } while (0)
+#else
+#define ROI_BEGIN() do { } while (0)
+#define ROI_END()   do { } while (0)
+#endif
+
 
 /*****************************************************************
  * The following section probably shouldn't be edited, unless
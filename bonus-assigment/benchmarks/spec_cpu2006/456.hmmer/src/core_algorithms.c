@@ -24,7 +24,11 @@
 #include "squid.h"
 
 #include <string.h>
+#include <math.h>
 #include <assert.h>
+#ifdef HMMER_THREADS
+#include <pthread.h>
+#endif
 
 static float get_wee_midpt(struct plan7_s *hmm, char *dsq, int L, 
 			   int k1, char t1, int s1,
@@ -379,7 +383,33 @@ P7WeeViterbiSize(int L, int M)
 	  / 1000000);
 }
 
+/* Function: P7CheckpointViterbiSize()
+ *
+ * Purpose:  Returns the ballpark predicted memory requirement for
+ *           a P7CheckpointViterbi() alignment, in MB: about 2 sqrt(L)
+ *           rows of the matrix, and the O(L) row pointers.
+ *
+ * Args:     L - length of sequence
+ *           M - length of HMM   
+ *               
+ * Returns:  # of MB 
+ */
+int
+P7CheckpointViterbiSize(int L, int M)
+{
+  float Mbytes;
+  int   C;			/* checkpoint interval, rows */
+
+  C = MAX(1, (int) ceil(sqrt((double) L)));
+  Mbytes =  (float) sizeof(struct dpmatrix_s); 
+  Mbytes += (float) (L/C + 1 + C+1) * (float) (3*(M+2) + 5) * (float) sizeof(int);
+  Mbytes += 4. * (float) (L+1) * (float) sizeof(int *); 
+  Mbytes /= 1048576.;
+  return (int) Mbytes;
+}
+
 
+#ifdef SLOW
 /* Function: P7Forward()
  * 
  * Purpose:  The Forward dynamic programming algorithm.
@@ -389,7 +419,9 @@ P7WeeViterbiSize(int L, int M)
  * Args:     dsq    - sequence in digitized form
  *           L      - length of dsq
  *           hmm    - the model
- *           ret_mx - RETURN: dp matrix; pass NULL if it's not wanted
+ *           ret_mx - RETURN: dp matrix; pass NULL if it's not wanted,
+ *                    and then only two rolling rows are allocated,
+ *                    O(M) memory for any L
  *           
  * Return:   log P(S|M)/P(S|R), as a bit score.
  */
@@ -403,14 +435,16 @@ P7Forward(char *dsq, int L, struct plan7_s *hmm, struct dpmatrix_s **ret_mx)
   int **dmx;
   int   i,k;
   int   sc;
+  int   cur, prv;		/* rows of mx for i, i-1 */
 
-  /* Allocate a DP matrix with 0..L rows, 0..M-1 columns.
+  /* Allocate a DP matrix with 0..L rows, 0..M-1 columns;
+   * for the score alone, rows 0 and 1 are reused for all i.
    */ 
-  mx = AllocPlan7Matrix(L+1, hmm->M, &xmx, &mmx, &imx, &dmx);
+  mx = AllocPlan7Matrix(ret_mx != NULL ? L+1 : 2, hmm->M, &xmx, &mmx, &imx, &dmx);
 
   /* Initialization of the zero row.
    * Note that xmx[i][stN] = 0 by definition for all i,
-   *    and xmx[i][stT] = xmx[i][stC], so neither stN nor stT need
+     *    and xmx[i][stT] = xmx[i][stC], so neither stN nor stT need
    *    to be calculated in DP matrices.
    */
   xmx[0][XMN] = 0;		                     /* S->N, p=1            */
@@ -426,53 +460,56 @@ P7Forward(char *dsq, int L, struct plan7_s *hmm, struct dpmatrix_s **ret_mx)
    */
   for (i = 1; i <= L; i++)
     {
-      mmx[i][0] = imx[i][0] = dmx[i][0] = -INFTY;
+      cur = ret_mx != NULL ? i   : i & 1;
+      prv = ret_mx != NULL ? i-1 : (i-1) & 1;
+      mmx[cur][0] = imx[cur][0] = dmx[cur][0] = -INFTY;
       for (k = 1; k < hmm->M; k++)
 	{
-	  mmx[i][k]  = ILogsum(ILogsum(mmx[i-1][k-1] + hmm->tsc[TMM][k-1],
-				     imx[i-1][k-1] + hmm->tsc[TIM][k-1]),
-			      ILogsum(xmx[i-1][XMB] + hmm->bsc[k],
-				     dmx[i-1][k-1] + hmm->tsc[TDM][k-1]));
-	  mmx[i][k] += hmm->msc[(int) dsq[i]][k];
-
-	  dmx[i][k]  = ILogsum(mmx[i][k-1] + hmm->tsc[TMD][k-1],
-			      dmx[i][k-1] + hmm->tsc[TDD][k-1]);
-	  imx[i][k]  = ILogsum(mmx[i-1][k] + hmm->tsc[TMI][k],
-			      imx[i-1][k] + hmm->tsc[TII][k]);
-	  imx[i][k] += hmm->isc[(int) dsq[i]][k];
+	  mmx[cur][k]  = ILogsum(ILogsum(mmx[prv][k-1] + hmm->tsc[TMM][k-1],
+				       imx[prv][k-1] + hmm->tsc[TIM][k-1]),
+				ILogsum(xmx[prv][XMB] + hmm->bsc[k],
+				       dmx[prv][k-1] + hmm->tsc[TDM][k-1]));
+	  mmx[cur][k] += hmm->msc[(int) dsq[i]][k];
+
+	  dmx[cur][k]  = ILogsum(mmx[cur][k-1] + hmm->tsc[TMD][k-1],
+				dmx[cur][k-1] + hmm->tsc[TDD][k-1]);
+	  imx[cur][k]  = ILogsum(mmx[prv][k] + hmm->tsc[TMI][k],
+				imx[prv][k] + hmm->tsc[TII][k]);
+	  imx[cur][k] += hmm->isc[(int) dsq[i]][k];
 	}
-      mmx[i][hmm->M] = ILogsum(ILogsum(mmx[i-1][hmm->M-1] + hmm->tsc[TMM][hmm->M-1],
-				   imx[i-1][hmm->M-1] + hmm->tsc[TIM][hmm->M-1]),
-			       ILogsum(xmx[i-1][XMB] + hmm->bsc[hmm->M-1],
-				   dmx[i-1][hmm->M-1] + hmm->tsc[TDM][hmm->M-1]));
-      mmx[i][hmm->M] += hmm->msc[(int) dsq[i]][hmm->M];
+      mmx[cur][hmm->M] = ILogsum(ILogsum(mmx[prv][hmm->M-1] + hmm->tsc[TMM][hmm->M-1],
+				     imx[prv][hmm->M-1] + hmm->tsc[TIM][hmm->M-1]),
+				 ILogsum(xmx[prv][XMB] + hmm->bsc[hmm->M-1],
+				     dmx[prv][hmm->M-1] + hmm->tsc[TDM][hmm->M-1]));
+      mmx[cur][hmm->M] += hmm->msc[(int) dsq[i]][hmm->M];
 
       /* Now the special states.
        * remember, C and J emissions are zero score by definition
        */
-      xmx[i][XMN] = xmx[i-1][XMN] + hmm->xsc[XTN][LOOP];
+      xmx[cur][XMN] = xmx[prv][XMN] + hmm->xsc[XTN][LOOP];
 
-      xmx[i][XME] = -INFTY;
+      xmx[cur][XME] = -INFTY;
       for (k = 1; k <= hmm->M; k++)
-	xmx[i][XME] = ILogsum(xmx[i][XME], mmx[i][k] + hmm->esc[k]);
+	xmx[cur][XME] = ILogsum(xmx[cur][XME], mmx[cur][k] + hmm->esc[k]);
 
-      xmx[i][XMJ] = ILogsum(xmx[i-1][XMJ] + hmm->xsc[XTJ][LOOP],
-			   xmx[i][XME]   + hmm->xsc[XTE][LOOP]);
+      xmx[cur][XMJ] = ILogsum(xmx[prv][XMJ] + hmm->xsc[XTJ][LOOP],
+			     xmx[cur][XME]   + hmm->xsc[XTE][LOOP]);
 
-      xmx[i][XMB] = ILogsum(xmx[i][XMN] + hmm->xsc[XTN][MOVE],
-			    xmx[i][XMJ] + hmm->xsc[XTJ][MOVE]);
+      xmx[cur][XMB] = ILogsum(xmx[cur][XMN] + hmm->xsc[XTN][MOVE],
+			      xmx[cur][XMJ] + hmm->xsc[XTJ][MOVE]);
 
-      xmx[i][XMC] = ILogsum(xmx[i-1][XMC] + hmm->xsc[XTC][LOOP],
-			    xmx[i][XME] + hmm->xsc[XTE][MOVE]);
+      xmx[cur][XMC] = ILogsum(xmx[prv][XMC] + hmm->xsc[XTC][LOOP],
+			      xmx[cur][XME] + hmm->xsc[XTE][MOVE]);
     }
 			    
-  sc = xmx[L][XMC] + hmm->xsc[XTC][MOVE];
+  sc = xmx[ret_mx != NULL ? L : L & 1][XMC] + hmm->xsc[XTC][MOVE];
 
   if (ret_mx != NULL) *ret_mx = mx;
   else                FreePlan7Matrix(mx);
 
   return Scorify(sc);		/* the total Forward score. */
 }
+#endif /*SLOW*/
 
       
 #ifdef SLOW
@@ -507,7 +544,7 @@ P7Viterbi(char *dsq, int L, struct plan7_s *hmm, struct dpmatrix_s *mx, struct p
   int **mmx;
   int **imx;
   int **dmx;
-  int   i,k;
+  int   k;
   int   sc;
 
   /* Allocate a DP matrix with 0..L rows, 0..M-1 columns.
@@ -522,12 +559,55 @@ P7Viterbi(char *dsq, int L, struct plan7_s *hmm, struct dpmatrix_s *mx, struct p
   for (k = 0; k <= hmm->M; k++)
     mmx[0][k] = imx[0][k] = dmx[0][k] = -INFTY;      /* need seq to get here */
 
+  /* Recursion, in P7ViterbiRows().
+   */
+  P7ViterbiRows(dsq, 1, L, hmm, mx);
+
+				/* T state (not stored) */
+  sc = xmx[L][XMC] + hmm->xsc[XTC][MOVE];
+
+  if (ret_tr != NULL) {
+    P7ViterbiTrace(hmm, dsq, L, mx, &tr);
+    *ret_tr = tr;
+  }
+
+  return Scorify(sc);		/* the total Viterbi score. */
+}
+#endif /*SLOW*/
+
+#if defined(SLOW) || defined(ALTIVEC)
+/* Function: P7ViterbiRows()
+ * 
+ * Purpose:  Fill rows i1..i2 of a Viterbi matrix, given row i1-1.
+ *           Only the row pointers of mx are used, so rows need not
+ *           be contiguous or distinct from other rows of the
+ *           matrix, as long as rows i and i-1 are distinct: this
+ *           is what P7CheckpointViterbi() recomputes its blocks
+ *           with. The reference implementation; the default one is
+ *           in fast_algorithms.c.
+ *           
+ * Args:     dsq    - sequence in digitized form
+ *           i1, i2 - first and last row to fill, 1 <= i1 <= i2 <= L
+ *           hmm    - the model
+ *           mx     - the matrix; row i1-1 is set, rows i1..i2
+ *                    have room for hmm->M
+ */
+void
+P7ViterbiRows(char *dsq, int i1, int i2, struct plan7_s *hmm, struct dpmatrix_s *mx)
+{
+  int **xmx = mx->xmx;
+  int **mmx = mx->mmx;
+  int **imx = mx->imx;
+  int **dmx = mx->dmx;
+  int   i,k;
+  int   sc;
+
   /* Recursion. Done as a pull.
    * Note some slightly wasteful boundary conditions:  
    *    tsc[0] = -INFTY for all eight transitions (no node 0)
    *    D_M and I_M are wastefully calculated (they don't exist)
    */
-  for (i = 1; i <= L; i++) {
+  for (i = i1; i <= i2; i++) {
     mmx[i][0] = imx[i][0] = dmx[i][0] = -INFTY;
 
     for (k = 1; k <= hmm->M; k++) {
@@ -597,17 +677,60 @@ P7Viterbi(char *dsq, int L, struct plan7_s *hmm, struct dpmatrix_s *mx, struct p
     if ((sc = xmx[i][XME] + hmm->xsc[XTE][MOVE]) > xmx[i][XMC])
       xmx[i][XMC] = sc;
   }
-				/* T state (not stored) */
-  sc = xmx[L][XMC] + hmm->xsc[XTC][MOVE];
+}
+#endif /*SLOW || ALTIVEC*/
 
-  if (ret_tr != NULL) {
-    P7ViterbiTrace(hmm, dsq, L, mx, &tr);
-    *ret_tr = tr;
-  }
+/* A checkpointed Viterbi matrix, see P7CheckpointViterbi(): rows
+ * 0, C, 2C... are kept from the fill; the rows between two of them
+ * are recomputed into blk as the traceback comes down to them.
+ */
+struct vitckpt_s {
+  char              *dsq;
+  struct plan7_s    *hmm;
+  struct dpmatrix_s *mx;	/* row ptrs 0..L                        */
+  int  L;
+  int  C;			/* checkpoint interval                  */
+  int  lo;			/* rows lo..min(lo+C+1,L) are in place  */
+  int *blk;			/* C+1 rows for the current block       */
+  int  rowsize;			/* ints per row                         */
+};
+
+/* Function: ckpt_setrow()
+ * 
+ * Purpose:  Point row i of mx at one row's worth of memory, p.
+ */
+static void
+ckpt_setrow(struct dpmatrix_s *mx, int i, int *p, int M)
+{
+  mx->xmx[i] = p;
+  mx->mmx[i] = p + 5;
+  mx->imx[i] = p + 5 + (M+18);
+  mx->dmx[i] = p + 5 + 2*(M+18);
+}
 
-  return Scorify(sc);		/* the total Viterbi score. */
+/* Function: ckpt_window()
+ * 
+ * Purpose:  Bring rows i-1..i+1 into place for the traceback: 
+ *           recompute the block from the checkpoint at or below
+ *           i-1, up to one row past the next checkpoint, since the
+ *           M and I states look back at row i+1.
+ */
+static void
+ckpt_window(struct vitckpt_s *ck, int i)
+{
+  int lo, hi, r;
+
+  lo = ((i-1) / ck->C) * ck->C;
+  hi = MIN(lo + ck->C + 1, ck->L);
+  for (r = lo+1; r <= hi; r++)
+    if (r % ck->C != 0)		/* checkpoints are just rewritten */
+      ckpt_setrow(ck->mx, r, ck->blk + (r-lo-1) * ck->rowsize, ck->hmm->M);
+  P7ViterbiRows(ck->dsq, lo+1, hi, ck->hmm, ck->mx);
+  ck->lo = lo;
 }
-#endif /*SLOW*/
+
+static void viterbi_trace(struct plan7_s *hmm, char *dsq, int N, struct dpmatrix_s *mx,
+			  struct vitckpt_s *ck, struct p7trace_s **ret_tr);
 
 /* Function: P7ViterbiTrace()
  * Date:     SRE, Sat Aug 23 10:30:11 1997 (St. Louis Lambert Field) 
@@ -627,6 +750,19 @@ P7Viterbi(char *dsq, int L, struct plan7_s *hmm, struct dpmatrix_s *mx, struct p
 void
 P7ViterbiTrace(struct plan7_s *hmm, char *dsq, int N,
 	       struct dpmatrix_s *mx, struct p7trace_s **ret_tr)
+{
+  viterbi_trace(hmm, dsq, N, mx, NULL, ret_tr);
+}
+
+/* Function: viterbi_trace()
+ * 
+ * Purpose:  P7ViterbiTrace(), on a full matrix (ck == NULL) or
+ *           a checkpointed one, whose rows are recomputed by
+ *           ckpt_window() as the trace needs them.
+ */
+static void
+viterbi_trace(struct plan7_s *hmm, char *dsq, int N, struct dpmatrix_s *mx,
+	      struct vitckpt_s *ck, struct p7trace_s **ret_tr)
 {
   struct p7trace_s *tr;
   int curralloc;		/* current allocated length of trace */
@@ -663,6 +799,9 @@ P7ViterbiTrace(struct plan7_s *hmm, char *dsq, int N,
   /* Traceback
    */
   while (tr->statetype[tpos-1] != STS) {
+    if (ck != NULL && i > 0 && i-1 < ck->lo)
+      ckpt_window(ck, i);	/* rows i-1..i+1 are used below */
+
     switch (tr->statetype[tpos-1]) {
     case STM:			/* M connects from i-1,k-1, or B */
       sc = mmx[i+1][k+1] - hmm->msc[(int) dsq[i+1]][k+1];
@@ -868,18 +1007,98 @@ P7ViterbiTrace(struct plan7_s *hmm, char *dsq, int N,
 }
 
 
+/* Function: P7CheckpointViterbi()
+ * 
+ * Purpose:  The Viterbi alignment of P7Viterbi(), in O(M sqrt(L))
+ *           memory rather than O(ML). The fill keeps one row in
+ *           every C = ceil(sqrt(L)); the traceback then recomputes
+ *           each block of C rows from its checkpoint as it reaches
+ *           it, into one buffer of C+1 rows. Each row is computed
+ *           about twice, and the trace is the very one P7Viterbi()
+ *           returns, unlike P7WeeViterbi()'s, which takes O(log L)
+ *           divide-and-conquer passes over single-hit segments.
+ *           
+ * Args:     dsq    - sequence in digitized form
+ *           L      - length of dsq
+ *           hmm    - the model
+ *           ret_tr - RETURN: traceback; pass NULL if it's not wanted
+ *           
+ * Return:   log P(S|M)/P(S|R), as a bit score
+ */
+float
+P7CheckpointViterbi(char *dsq, int L, struct plan7_s *hmm, struct p7trace_s **ret_tr)
+{
+  struct dpmatrix_s mx;
+  struct vitckpt_s  ck;
+  int  *ckmem;			/* the checkpoint rows */
+  int   i,k;
+  int   sc;
+
+  ck.dsq     = dsq;
+  ck.hmm     = hmm;
+  ck.mx      = &mx;
+  ck.L       = L;
+  ck.C       = MAX(1, (int) ceil(sqrt((double) L)));
+  ck.rowsize = 5 + 3 * (hmm->M+18); /* same overrun pad as CreatePlan7Matrix() */
+  ckmem      = MallocOrDie(sizeof(int) * (L/ck.C + 1) * ck.rowsize);
+  ck.blk     = MallocOrDie(sizeof(int) * (ck.C + 1) * ck.rowsize);
+  mx.xmx     = MallocOrDie(sizeof(int *) * (L+1));
+  mx.mmx     = MallocOrDie(sizeof(int *) * (L+1));
+  mx.imx     = MallocOrDie(sizeof(int *) * (L+1));
+  mx.dmx     = MallocOrDie(sizeof(int *) * (L+1));
+  mx.xmx_mem = mx.mmx_mem = mx.imx_mem = mx.dmx_mem = NULL;
+  mx.maxN    = L;
+  mx.maxM    = hmm->M;
+  mx.padN    = mx.padM = 0;
+
+  /* The fill: checkpoints in place, the other rows alternate
+   * between the first two of the block buffer.
+   */
+  for (i = 0; i <= L; i++)
+    if (i % ck.C == 0) ckpt_setrow(&mx, i, ckmem + (i/ck.C) * ck.rowsize, hmm->M);
+    else               ckpt_setrow(&mx, i, ck.blk + (i&1) * ck.rowsize,    hmm->M);
+
+  /* Initialization of the zero row.
+   */
+  mx.xmx[0][XMN] = 0;		                     /* S->N, p=1            */
+  mx.xmx[0][XMB] = hmm->xsc[XTN][MOVE];              /* S->N->B, no N-tail   */
+  mx.xmx[0][XME] = mx.xmx[0][XMC] = mx.xmx[0][XMJ] = -INFTY;
+  for (k = 0; k <= hmm->M; k++)
+    mx.mmx[0][k] = mx.imx[0][k] = mx.dmx[0][k] = -INFTY;
+
+  if (L > 0) P7ViterbiRows(dsq, 1, L, hmm, &mx);
+				/* T state (not stored) */
+  sc = mx.xmx[L][XMC] + hmm->xsc[XTC][MOVE];
+
+  if (ret_tr != NULL) {
+    ck.lo = L+1;		/* nothing but row L in place yet */
+    viterbi_trace(hmm, dsq, L, &mx, &ck, ret_tr);
+  }
+
+  free(mx.xmx);
+  free(mx.mmx);
+  free(mx.imx);
+  free(mx.dmx);
+  free(ck.blk);
+  free(ckmem);
+  return Scorify(sc);		/* the total Viterbi score. */
+}
+
+
 /* Function: P7SmallViterbi()
  * Date:     SRE, Fri Mar  6 15:29:41 1998 [St. Louis]
  *
  * Purpose:  Wrapper function, for linear memory alignment
  *           with same arguments as P7Viterbi(). 
  *           
- *           Calls P7ParsingViterbi to break the sequence
+ *           If a P7CheckpointViterbi() matrix fits in RAMLIMIT,
+ *           that gives the trace in one go. Else calls
+ *           P7ParsingViterbi to break the sequence
  *           into fragments. Then, based on size of fragments,
- *           calls either P7Viterbi() or P7WeeViterbi() to 
- *           get traces for them. Finally, assembles all these
- *           traces together to produce an overall optimal
- *           trace for the sequence.
+ *           calls P7Viterbi(), P7CheckpointViterbi() or
+ *           P7WeeViterbi() to get traces for them. Finally,
+ *           assembles all these traces together to produce an
+ *           overall optimal trace for the sequence.
  *           
  *           If the trace isn't needed for some reason,
  *           all we do is call P7ParsingViterbi.
@@ -908,6 +1127,11 @@ P7SmallViterbi(char *dsq, int L, struct plan7_s *hmm, struct dpmatrix_s *mx, str
   float sc;			/* score of optimal alignment */
   int   t2;			/* position in a subtrace */
   
+  /* Step 0. If sqrt(L) rows of the matrix fit, align in one pass.
+   */
+  if (ret_tr != NULL && P7CheckpointViterbiSize(L, hmm->M) <= RAMLIMIT)
+    return P7CheckpointViterbi(dsq, L, hmm, ret_tr);
+
   /* Step 1. Call P7ParsingViterbi to calculate an optimal parse
    *         of the sequence into single-hit subsequences; this parse
    *         is returned in a "collapsed" trace
@@ -922,9 +1146,9 @@ P7SmallViterbi(char *dsq, int L, struct plan7_s *hmm, struct dpmatrix_s *mx, str
       return sc;
     }
   
-  /* Step 2. Call either P7Viterbi or P7WeeViterbi on each subsequence
-   *         to recover a full traceback of each, collecting them in 
-   *         an array. 
+  /* Step 2. Call P7Viterbi, P7CheckpointViterbi or P7WeeViterbi on
+   *         each subsequence to recover a full traceback of each,
+   *         collecting them in an array. 
    */
   ndom = ctr->tlen/2 - 1;
   tarr = MallocOrDie(sizeof(struct p7trace_s *) * ndom);
@@ -933,8 +1157,10 @@ P7SmallViterbi(char *dsq, int L, struct plan7_s *hmm, struct dpmatrix_s *mx, str
     {
       sqlen = ctr->pos[i*2+2] - ctr->pos[i*2+1];   /* length of subseq */
 
-      if (P7ViterbiSize(sqlen, hmm->M) > RAMLIMIT)
+      if (P7CheckpointViterbiSize(sqlen, hmm->M) > RAMLIMIT)
 	P7WeeViterbi(dsq + ctr->pos[i*2+1], sqlen, hmm, &(tarr[i]));
+      else if (P7ViterbiSize(sqlen, hmm->M) > RAMLIMIT)
+	P7CheckpointViterbi(dsq + ctr->pos[i*2+1], sqlen, hmm, &(tarr[i]));
       else
 	P7Viterbi(dsq + ctr->pos[i*2+1], sqlen, hmm, mx, &(tarr[i]));
 
@@ -1983,6 +2209,83 @@ get_wee_midpt(struct plan7_s *hmm, char *dsq, int L,
 }
 
 
+/* consensus_counts(): columns from..to of P7ViterbiAlignAlignment()'s
+ * consensus counts, sequence by sequence, so each aseq row is read in
+ * order. Every column still adds up its sequences in index order, so
+ * the counts are the same however the columns are split up.
+ */
+static void
+consensus_counts(MSA *msa, float **con, int from, int to)
+{
+  int idx, i;
+
+  for (idx = 0; idx < msa->nseq; idx++)
+    for (i = from; i <= to; i++)
+      if (! isgap(msa->aseq[idx][i-1]))
+	P7CountSymbol(con[i], SYMIDX(msa->aseq[idx][i-1]), msa->wgt[idx]);
+}
+
+#ifdef HMMER_THREADS
+/* Alignments with fewer residues than this are counted by one thread.
+ */
+#define CONSENSUS_MIN_CELLS 1000000
+
+/* One worker's share of the consensus: columns from..to.
+ */
+struct conshare_s {
+  MSA    *msa;
+  float **con;
+  int     from, to;
+};
+
+static void *
+consensus_thread(void *ptr)
+{
+  struct conshare_s *sh = (struct conshare_s *) ptr;
+
+  consensus_counts(sh->msa, sh->con, sh->from, sh->to);
+  return NULL;
+}
+
+/* consensus_threaded(): consensus_counts() of all the columns, on up
+ * to ThreadNumber() threads, each a contiguous block of columns.
+ */
+static void
+consensus_threaded(MSA *msa, float **con)
+{
+  struct conshare_s *share;
+  pthread_t         *thread;
+  int nthreads, t, rtn;
+
+  nthreads = ThreadNumber();
+  if ((double) msa->nseq * msa->alen < CONSENSUS_MIN_CELLS) nthreads = 1;
+  if (nthreads > msa->alen) nthreads = msa->alen;
+  if (nthreads <= 1) {
+    consensus_counts(msa, con, 1, msa->alen);
+    return;
+  }
+
+  share  = MallocOrDie(sizeof(struct conshare_s) * nthreads);
+  thread = MallocOrDie(sizeof(pthread_t) * nthreads);
+  for (t = 0; t < nthreads; t++) {
+    share[t].msa  = msa;
+    share[t].con  = con;
+    share[t].from = 1 + (int) ((long) msa->alen * t / nthreads);
+    share[t].to   = (int) ((long) msa->alen * (t+1) / nthreads);
+  }
+  for (t = 1; t < nthreads; t++)
+    if ((rtn = pthread_create(&(thread[t]), NULL, consensus_thread, 
+			      (void *) &(share[t]))) != 0)
+      Die("Failed to create thread %d; return code %d\n", t, rtn);
+  consensus_thread((void *) &(share[0]));
+  for (t = 1; t < nthreads; t++)
+    if (pthread_join(thread[t], NULL) != 0)
+      Die("pthread_join failed");
+  free(thread);
+  free(share);
+}
+#endif /* HMMER_THREADS */
+
 /* Function: P7ViterbiAlignAlignment()
  * Date:     SRE, Sat Jul  4 13:39:00 1998 [St. Louis]
  *
@@ -2030,7 +2333,6 @@ P7ViterbiAlignAlignment(MSA *msa, struct plan7_s *hmm)
   float  *mocc;                 /* fractional occupancy of a column; used to weight transitions */
   int     i;			/* counter for columns */
   int     k;			/* counter for model positions */
-  int     idx;			/* counter for seqs */
   int     sym;			/* counter for alphabet symbols */
   int     sc;			/* temp variable for holding score */
   float   denom;		/* total weight of seqs; used to "normalize" counts */
@@ -2051,12 +2353,16 @@ P7ViterbiAlignAlignment(MSA *msa, struct plan7_s *hmm)
 				/* initialization */
 				/* note: aseq is off by one, 0..alen-1 */
 				/* "normalized" to have a max total count of 1 per col */
+				/* the counts are the O(nseq*alen) part; */
+				/* with threads, blocks of columns in parallel */
   denom = FSum(msa->wgt, msa->nseq);
+#ifdef HMMER_THREADS
+  consensus_threaded(msa, con);
+#else
+  consensus_counts(msa, con, 1, msa->alen);
+#endif
   for (i = 1; i <= msa->alen; i++)
     {
-      for (idx = 0; idx < msa->nseq; idx++)
-	if (! isgap(msa->aseq[idx][i-1]))
-	  P7CountSymbol(con[i], SYMIDX(msa->aseq[idx][i-1]), msa->wgt[idx]);
       FScale(con[i], Alphabet_size, 1./denom);
       mocc[i] = FSum(con[i], Alphabet_size);
     }
@@ -2407,7 +2713,9 @@ ShadowTrace(struct dpshadow_s *tb, struct plan7_s *hmm, int L)
  *           We don't have final evalues, so we may put a few
  *           more hits into the hit lists than we end up reporting.
  *           The main output routine is responsible for final
- *           enforcement of the thresholds.
+ *           enforcement of the thresholds. Alignments, though,
+ *           are only made for domains that can still be shown,
+ *           and dhit may drop all but its best (TophitsAliLimit()).
  *          
  *           This routine is NOT THREADSAFE. When multithreaded,
  *           with using shared ghit/dhit output buffers, calls to
@@ -2422,6 +2730,7 @@ ShadowTrace(struct dpshadow_s *tb, struct plan7_s *hmm, int L)
  *           seqname  - name of sequence (same as targname, in hmmsearch)
  *           seqacc   - seq's accession (or NULL)
  *           seqdesc  - seq's description (or NULL)
+ *           seqidx   - seq's index in the database, to rank ties
  *           do_forward  - TRUE if we've already calculated final per-seq score
  *           sc_override - per-seq score to use if do_forward is TRUE
  *           do_null2    - TRUE to apply the null2 scoring correction
@@ -2442,6 +2751,7 @@ PostprocessSignificantHit(struct tophit_s    *ghit,
 			  char               *seqname,
 			  char               *seqacc,
 			  char               *seqdesc,
+			  int                 seqidx,
 			  int                 do_forward,
 			  float               sc_override,
 			  int                 do_null2,
@@ -2523,7 +2833,17 @@ PostprocessSignificantHit(struct tophit_s    *ghit,
     pvalue = PValue(hmm, score[tidx]); 
 
     if (pvalue <= thresh->domE && score[tidx] >= thresh->domT) {
-      ali     = CreateFancyAli(tarr[tidx], hmm, dsq, seqname);
+      /* hmmsearch never shows an alignment whose sequence misses
+       * globT, or, once Z is fixed, either E-value cutoff; nor any
+       * with -A 0. Don't build those.
+       */
+      if (! hmmpfam_mode &&
+	  (dhit->alimit == 0 || whole_sc < thresh->globT ||
+	   (thresh->Z && (whole_pval * (double) thresh->Z > thresh->globE ||
+			  pvalue * (double) thresh->Z > thresh->domE))))
+	ali   = NULL;
+      else
+	ali   = CreateFancyAli(tarr[tidx], hmm, dsq, seqname);
 
       if (hmmpfam_mode) 
 	sortkey = -1.*(double)i1; /* hmmpfam: sort on position in seq    */
@@ -2536,6 +2856,7 @@ PostprocessSignificantHit(struct tophit_s    *ghit,
 		  hmmpfam_mode ? hmm->name : seqname,
 		  hmmpfam_mode ? hmm->acc  : seqacc,
 		  hmmpfam_mode ? hmm->desc : seqdesc,
+		  seqidx,
 		  i1,i2, L, 
 		  k1,k2, hmm->M, 
 		  didx,ndom,ali);
@@ -2580,6 +2901,7 @@ PostprocessSignificantHit(struct tophit_s    *ghit,
 		hmmpfam_mode ? hmm->name : seqname,
 		hmmpfam_mode ? hmm->acc  : seqacc,
 		hmmpfam_mode ? hmm->desc : seqdesc,
+		seqidx,
 		0,0,0,                	  /* seq positions  */
 		0,0,0,	                  /* HMM positions  */
 		0, ndom,	          /* # domains info    */
@@ -39,6 +39,8 @@
  *   to understand the DP code.
  * -DALTIVEC
  *   enable Erik Lindahl's Altivec code for Macintosh OSX
+ *
+ * P7Forward() is optimized here in the same way, unless -DSLOW.
  */
 
 #include "config.h"
@@ -51,6 +53,354 @@
 /* the DEFAULT P7Viterbi() is portably optimized; code follows:
  */
 #if !defined ALTIVEC && !defined SLOW
+/* The M, D and I cells of one row and the E state, which is all of
+ * P7Viterbi()'s inner loop, are done by a row kernel: the portable
+ * loop below, or on x86-64 an AVX2 or AVX-512 one (NEON on ARM),
+ * picked once per process by the CPU it runs on. The SIMD kernels
+ * use 32-bit lanes along k, on the same matrix layout, so they
+ * produce the very cells of the portable loop and P7ViterbiTrace()
+ * works unchanged. M and I only read row i-1 and go a vector at a
+ * time; the D->D chain along the row is taken lazily: D is first set
+ * from M alone (plus the carry from the previous vector), then
+ * D->D moves are propagated lane by lane until no cell improves,
+ * which is usually after one or two passes.
+ * The scores come from hmm->vsc (P7CompileScores()): one array for
+ * the residue of row i, so a row streams through a single array
+ * instead of ten.
+ * -DNO_SIMD_VITERBI leaves only the portable kernel.
+ */
+struct vitrow_s {
+  int  M;
+  int *mc, *dc, *ic;		/* row i; mc[0], dc[0], ic[0] are set   */
+  int *mpp, *dpp, *ip;		/* row i-1                              */
+  int  xmb;			/* xmx[i-1][XMB]                        */
+  int *st;			/* hmm->vsc[dsq[i]]: all the row's scores */
+};
+
+typedef int (*vitrow_f)(struct vitrow_s *r);
+
+/* The scores of field f for nodes k.. (to the end of their stripe) */
+#define VS(r, k, f) ((r)->st + VSC_IDX(k, f))
+
+/* Function: viterbi_row_portable()
+ * 
+ * Purpose:  Fill mc[1..M], dc[1..M], ic[1..M-1] of row r.
+ * 
+ * Return:   the score of the E state, max_k mc[k] + esc[k]
+ */
+static int
+viterbi_row_portable(struct vitrow_s *r)
+{
+  int  k, sc, xme;
+  int  M    = r->M;
+  int *mc   = r->mc,   *dc   = r->dc,   *ic   = r->ic;
+  int *mpp  = r->mpp,  *dpp  = r->dpp,  *ip   = r->ip;
+  int  xmb  = r->xmb;
+  int *v;
+
+  xme = -INFTY;
+  for (k = 1; k <= M; k++) {
+    v = r->st + VSC_IDX(k, 0);
+    mc[k] = mpp[k-1]   + v[VSC_TMM*P7_VSTRIPE];
+    if ((sc = ip[k-1]  + v[VSC_TIM*P7_VSTRIPE]) > mc[k])  mc[k] = sc;
+    if ((sc = dpp[k-1] + v[VSC_TDM*P7_VSTRIPE]) > mc[k])  mc[k] = sc;
+    if ((sc = xmb      + v[VSC_BSC*P7_VSTRIPE]) > mc[k])  mc[k] = sc; 
+    mc[k] += v[VSC_MSC*P7_VSTRIPE];
+    if (mc[k] < -INFTY) mc[k] = -INFTY;  
+    if ((sc = mc[k] + v[VSC_ESC*P7_VSTRIPE]) > xme) xme = sc; 
+
+    dc[k] = dc[k-1] + v[VSC_TDD*P7_VSTRIPE];
+    if ((sc = mc[k-1] + v[VSC_TMD*P7_VSTRIPE]) > dc[k]) dc[k] = sc;
+    if (dc[k] < -INFTY) dc[k] = -INFTY;  
+
+    if (k < M) {
+      ic[k] = mpp[k] + v[VSC_TMI*P7_VSTRIPE];
+      if ((sc = ip[k] + v[VSC_TII*P7_VSTRIPE]) > ic[k]) ic[k] = sc; 
+      ic[k] += v[VSC_ISC*P7_VSTRIPE];
+      if (ic[k] < -INFTY) ic[k] = -INFTY; 
+    }
+  }
+  return xme;
+}
+
+#if defined(__GNUC__) && defined(__x86_64__) && !defined(NO_SIMD_VITERBI)
+#include <immintrin.h>
+#define SIMD_VITERBI_X86
+
+/* Lanes at and past n are masked off: they are neither loaded nor
+ * stored, so a row of any M is done in whole vectors. A vector of
+ * k never straddles two stripes of hmm->vsc, and the scores' loads
+ * are aligned.
+ */
+__attribute__((target("avx2")))
+static int
+viterbi_row_avx2(struct vitrow_s *r)
+{
+  const __m256i neginf = _mm256_set1_epi32(-INFTY);
+  const __m256i iota   = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  const __m256i rot    = _mm256_setr_epi32(7, 0, 1, 2, 3, 4, 5, 6);
+  const __m256i xmb    = _mm256_set1_epi32(r->xmb);
+  __m256i mask, m, sc, d, nd, t, e = neginf;
+  int     M = r->M;
+  int     k, xme;
+  int     lane[8];
+
+#define LD(p) _mm256_maskload_epi32((p), mask)
+#define LS(f) _mm256_load_si256((__m256i *) VS(r, k, f))
+  for (k = 1; k <= M; k += 8) {
+    mask = _mm256_cmpgt_epi32(_mm256_set1_epi32(M - k + 1), iota);
+    m  = _mm256_add_epi32(LD(r->mpp + k-1), LS(VSC_TMM));
+    m  = _mm256_max_epi32(m, _mm256_add_epi32(LD(r->ip  + k-1), LS(VSC_TIM)));
+    m  = _mm256_max_epi32(m, _mm256_add_epi32(LD(r->dpp + k-1), LS(VSC_TDM)));
+    m  = _mm256_max_epi32(m, _mm256_add_epi32(xmb, LS(VSC_BSC)));
+    m  = _mm256_max_epi32(_mm256_add_epi32(m, LS(VSC_MSC)), neginf);
+    _mm256_maskstore_epi32(r->mc + k, mask, m);
+    e  = _mm256_max_epi32(e, _mm256_blendv_epi8(neginf, 
+			  _mm256_add_epi32(m, LS(VSC_ESC)), mask));
+
+    if (k < M) {		/* I: k < M only */
+      mask = _mm256_cmpgt_epi32(_mm256_set1_epi32(M - k), iota);
+      sc = _mm256_max_epi32(_mm256_add_epi32(LD(r->mpp + k), LS(VSC_TMI)),
+			    _mm256_add_epi32(LD(r->ip  + k), LS(VSC_TII)));
+      sc = _mm256_max_epi32(_mm256_add_epi32(sc, LS(VSC_ISC)), neginf);
+      _mm256_maskstore_epi32(r->ic + k, mask, sc);
+    }
+  }
+
+  for (k = 1; k <= M; k += 8) {
+    mask = _mm256_cmpgt_epi32(_mm256_set1_epi32(M - k + 1), iota);
+    d  = _mm256_max_epi32(_mm256_add_epi32(LD(r->mc + k-1), LS(VSC_TMD)), 
+			  neginf);
+    t  = LS(VSC_TDD);
+    do {			/* D->D, from dc[k-1] on */
+      nd = _mm256_blend_epi32(_mm256_permutevar8x32_epi32(d, rot), 
+			      _mm256_set1_epi32(r->dc[k-1]), 0x01);
+      nd = _mm256_max_epi32(d, _mm256_add_epi32(nd, t));
+      sc = _mm256_andnot_si256(_mm256_cmpeq_epi32(nd, d), mask);
+      d  = nd;
+    } while (!_mm256_testz_si256(sc, sc));
+    _mm256_maskstore_epi32(r->dc + k, mask, d);
+  }
+#undef LS
+#undef LD
+
+  _mm256_storeu_si256((__m256i *) lane, e);
+  xme = -INFTY;
+  for (k = 0; k < 8; k++)
+    if (lane[k] > xme) xme = lane[k];
+  return xme;
+}
+
+__attribute__((target("avx512f")))
+static int
+viterbi_row_avx512(struct vitrow_s *r)
+{
+  const __m512i neginf = _mm512_set1_epi32(-INFTY);
+  const __m512i xmb    = _mm512_set1_epi32(r->xmb);
+  __m512i  m, sc, d, nd, t, e = neginf;
+  __mmask16 mask;
+  int      M = r->M;
+  int      k;
+
+#define LD(p) _mm512_maskz_loadu_epi32(mask, (p))
+#define LS(f) _mm512_load_si512(VS(r, k, f))
+#define MASK(n) ((n) >= 16 ? (__mmask16) 0xffff : (__mmask16) ((1u << (n)) - 1))
+  for (k = 1; k <= M; k += 16) {
+    mask = MASK(M - k + 1);
+    m  = _mm512_add_epi32(LD(r->mpp + k-1), LS(VSC_TMM));
+    m  = _mm512_max_epi32(m, _mm512_add_epi32(LD(r->ip  + k-1), LS(VSC_TIM)));
+    m  = _mm512_max_epi32(m, _mm512_add_epi32(LD(r->dpp + k-1), LS(VSC_TDM)));
+    m  = _mm512_max_epi32(m, _mm512_add_epi32(xmb, LS(VSC_BSC)));
+    m  = _mm512_max_epi32(_mm512_add_epi32(m, LS(VSC_MSC)), neginf);
+    _mm512_mask_storeu_epi32(r->mc + k, mask, m);
+    e  = _mm512_mask_max_epi32(e, mask, e, _mm512_add_epi32(m, LS(VSC_ESC)));
+
+    if (k < M) {		/* I: k < M only */
+      mask = MASK(M - k);
+      sc = _mm512_max_epi32(_mm512_add_epi32(LD(r->mpp + k), LS(VSC_TMI)),
+			    _mm512_add_epi32(LD(r->ip  + k), LS(VSC_TII)));
+      sc = _mm512_max_epi32(_mm512_add_epi32(sc, LS(VSC_ISC)), neginf);
+      _mm512_mask_storeu_epi32(r->ic + k, mask, sc);
+    }
+  }
+
+  for (k = 1; k <= M; k += 16) {
+    mask = MASK(M - k + 1);
+    d  = _mm512_max_epi32(_mm512_add_epi32(LD(r->mc + k-1), LS(VSC_TMD)), 
+			  neginf);
+    t  = LS(VSC_TDD);
+    do {			/* D->D, from dc[k-1] on */
+      nd = _mm512_alignr_epi32(d, _mm512_set1_epi32(r->dc[k-1]), 15);
+      nd = _mm512_max_epi32(d, _mm512_add_epi32(nd, t));
+      sc = d;
+      d  = nd;
+    } while (_mm512_mask_cmpneq_epi32_mask(mask, nd, sc));
+    _mm512_mask_storeu_epi32(r->dc + k, mask, d);
+  }
+#undef MASK
+#undef LS
+#undef LD
+
+  return _mm512_reduce_max_epi32(e);
+}
+#endif /* SIMD_VITERBI_X86 */
+
+#if (defined(__ARM_NEON) || defined(__ARM_NEON__)) && !defined(NO_SIMD_VITERBI)
+#include <arm_neon.h>
+#define SIMD_VITERBI_NEON
+
+/* NEON has no masked loads: whole vectors while they fit, then the
+ * cells of the portable loop for the rest of the row.
+ */
+static int
+viterbi_row_neon(struct vitrow_s *r)
+{
+  const int32x4_t neginf = vdupq_n_s32(-INFTY);
+  const int32x4_t xmb    = vdupq_n_s32(r->xmb);
+  int32x4_t m, sc, d, nd, t, e = neginf;
+  uint32x4_t same;
+  uint32x2_t all;
+  int       M = r->M;
+  int       k, s, xme;
+  int       lane[4];
+  int      *v;
+
+#define LD(p) vld1q_s32(p)
+#define LS(f) vld1q_s32(VS(r, k, f))
+#define SS(f) (v[(f) * P7_VSTRIPE])
+  for (k = 1; k + 3 <= M; k += 4) {
+    m  = vaddq_s32(LD(r->mpp + k-1), LS(VSC_TMM));
+    m  = vmaxq_s32(m, vaddq_s32(LD(r->ip  + k-1), LS(VSC_TIM)));
+    m  = vmaxq_s32(m, vaddq_s32(LD(r->dpp + k-1), LS(VSC_TDM)));
+    m  = vmaxq_s32(m, vaddq_s32(xmb, LS(VSC_BSC)));
+    m  = vmaxq_s32(vaddq_s32(m, LS(VSC_MSC)), neginf);
+    vst1q_s32(r->mc + k, m);
+    e  = vmaxq_s32(e, vaddq_s32(m, LS(VSC_ESC)));
+  }
+  for (; k <= M; k++) {
+    v = VS(r, k, 0);
+    r->mc[k] = r->mpp[k-1]   + SS(VSC_TMM);
+    if ((s = r->ip[k-1]  + SS(VSC_TIM)) > r->mc[k]) r->mc[k] = s;
+    if ((s = r->dpp[k-1] + SS(VSC_TDM)) > r->mc[k]) r->mc[k] = s;
+    if ((s = r->xmb      + SS(VSC_BSC)) > r->mc[k]) r->mc[k] = s;
+    r->mc[k] += SS(VSC_MSC);
+    if (r->mc[k] < -INFTY) r->mc[k] = -INFTY;
+  }
+
+  for (k = 1; k + 3 < M; k += 4) {
+    sc = vmaxq_s32(vaddq_s32(LD(r->mpp + k), LS(VSC_TMI)),
+		   vaddq_s32(LD(r->ip  + k), LS(VSC_TII)));
+    vst1q_s32(r->ic + k, vmaxq_s32(vaddq_s32(sc, LS(VSC_ISC)), neginf));
+  }
+  for (; k < M; k++) {
+    v = VS(r, k, 0);
+    r->ic[k] = r->mpp[k] + SS(VSC_TMI);
+    if ((s = r->ip[k] + SS(VSC_TII)) > r->ic[k]) r->ic[k] = s;
+    r->ic[k] += SS(VSC_ISC);
+    if (r->ic[k] < -INFTY) r->ic[k] = -INFTY;
+  }
+
+  for (k = 1; k + 3 <= M; k += 4) {
+    d  = vmaxq_s32(vaddq_s32(LD(r->mc + k-1), LS(VSC_TMD)), neginf);
+    t  = LS(VSC_TDD);
+    do {			/* D->D, from dc[k-1] on */
+      nd   = vextq_s32(vdupq_n_s32(r->dc[k-1]), d, 3);
+      nd   = vmaxq_s32(d, vaddq_s32(nd, t));
+      same = vceqq_s32(nd, d);
+      all  = vand_u32(vget_low_u32(same), vget_high_u32(same));
+      d    = nd;
+    } while (!(vget_lane_u32(all, 0) & vget_lane_u32(all, 1)));
+    vst1q_s32(r->dc + k, d);
+  }
+  for (; k <= M; k++) {
+    v = VS(r, k, 0);
+    r->dc[k] = r->dc[k-1] + SS(VSC_TDD);
+    if ((s = r->mc[k-1] + SS(VSC_TMD)) > r->dc[k]) r->dc[k] = s;
+    if (r->dc[k] < -INFTY) r->dc[k] = -INFTY;
+  }
+
+  vst1q_s32(lane, e);
+  xme = -INFTY;
+  for (s = 0; s < 4; s++)
+    if (lane[s] > xme) xme = lane[s];
+  for (k = 1 + ((M / 4) * 4); k <= M; k++) {
+    v = VS(r, k, 0);
+    if ((s = r->mc[k] + SS(VSC_ESC)) > xme) xme = s;
+  }
+#undef SS
+#undef LS
+#undef LD
+  return xme;
+}
+#endif /* SIMD_VITERBI_NEON */
+
+/* Function: viterbi_row_select()
+ * 
+ * Purpose:  Pick the widest row kernel this CPU runs.
+ */
+static vitrow_f
+viterbi_row_select(void)
+{
+#ifdef SIMD_VITERBI_X86
+  if (__builtin_cpu_supports("avx512f")) return viterbi_row_avx512;
+  if (__builtin_cpu_supports("avx2"))    return viterbi_row_avx2;
+#endif
+#ifdef SIMD_VITERBI_NEON
+  return viterbi_row_neon;
+#endif
+  return viterbi_row_portable;
+}
+
+static vitrow_f viterbi_row = NULL;
+
+/* Function: viterbi_step()
+ * 
+ * Purpose:  One row of the Viterbi recursion: the M, D and I cells
+ *           by the row kernel, then the special states from the E
+ *           score it returns. r holds the cells of rows i and i-1,
+ *           xc and xp the special states of rows i and i-1.
+ */
+static inline void
+viterbi_step(struct plan7_s *hmm, char *dsq, int i, struct vitrow_s *r, int *xc, int *xp)
+{
+  int sc;
+
+  r->M     = hmm->M;
+  r->xmb   = xp[XMB];
+  r->st    = hmm->vsc[(int) dsq[i]];
+  r->mc[0] = -INFTY;
+  r->dc[0] = -INFTY;
+  r->ic[0] = -INFTY;
+
+  xc[XME] = viterbi_row(r);
+
+  /* Now the special states. Order is important here.
+   * remember, C and J emissions are zero score by definition,
+   */
+				/* N state */
+  xc[XMN] = -INFTY;
+  if ((sc = xp[XMN] + hmm->xsc[XTN][LOOP]) > -INFTY)
+    xc[XMN] = sc;
+				/* J state */
+  xc[XMJ] = -INFTY;
+  if ((sc = xp[XMJ] + hmm->xsc[XTJ][LOOP]) > -INFTY)
+    xc[XMJ] = sc;
+  if ((sc = xc[XME] + hmm->xsc[XTE][LOOP]) > xc[XMJ])
+    xc[XMJ] = sc;
+				/* B state */
+  xc[XMB] = -INFTY;
+  if ((sc = xc[XMN] + hmm->xsc[XTN][MOVE]) > -INFTY)
+    xc[XMB] = sc;
+  if ((sc = xc[XMJ] + hmm->xsc[XTJ][MOVE]) > xc[XMB])
+    xc[XMB] = sc;
+				/* C state */
+  xc[XMC] = -INFTY;
+  if ((sc = xp[XMC] + hmm->xsc[XTC][LOOP]) > -INFTY)
+    xc[XMC] = sc;
+  if ((sc = xc[XME] + hmm->xsc[XTE][MOVE]) > xc[XMC])
+    xc[XMC] = sc;
+}
+
 /* Function: P7Viterbi() - portably optimized version
  * Incept:   SRE, Fri Nov 15 13:14:33 2002 [St. Louis]
  * 
@@ -61,13 +411,16 @@
  *           L      - length of dsq
  *           hmm    - the model
  *           mx     - re-used DP matrix
- *           ret_tr - RETURN: traceback; pass NULL if it's not wanted
+ *           ret_tr - RETURN: traceback; pass NULL if it's not wanted,
+ *                    and then only two rolling rows of mx are used,
+ *                    O(M) memory for any L
  *           
  * Return:   log P(S|M)/P(S|R), as a bit score
  */
 float
 P7Viterbi(char *dsq, int L, struct plan7_s *hmm, struct dpmatrix_s *mx, struct p7trace_s **ret_tr)
 {
+  struct vitrow_s r;
   struct p7trace_s  *tr;
   int **xmx;
   int **mmx;
@@ -75,20 +428,14 @@ P7Viterbi(char *dsq, int L, struct plan7_s *hmm, struct dpmatrix_s *mx, struct p
   int **dmx;
   int   i,k;
   int   sc;
-  int  *mc, *dc, *ic;        /* pointers to rows of mmx, dmx, imx */
-  int  *ms, *is;             /* pointers to msc[i], isc[i] */
-  int  *mpp, *mpc, *ip;      /* ptrs to mmx[i-1], mmx[i], imx[i-1] */
-  int  *bp;		     /* ptr into bsc[] */
-  int  *ep;                  /* ptr into esc[] */
-  int   xmb;		     /* value of xmx[i-1][XMB] */
-  int   xme;                 /* max for xmx[i][XME] */
-  int  *dpp;                 /* ptr into dmx[i-1] (previous row) */
-  int  *tpmm, *tpmi, *tpmd, *tpim, *tpii, *tpdm, *tpdd; /* ptrs into tsc */
-  int   M;
+  int   cur, prv;	     /* rows of mx for i, i-1 */
   
-  /* Make sure we have space for a DP matrix with 0..L rows, 0..M-1 columns.
+  if (viterbi_row == NULL) viterbi_row = viterbi_row_select();
+
+  /* Make sure we have space for a DP matrix with 0..L rows, 0..M-1 columns;
+   * for the score alone, rows 0 and 1 are reused for all i.
    */ 
-  ResizePlan7Matrix(mx, L, hmm->M, &xmx, &mmx, &imx, &dmx);
+  ResizePlan7Matrix(mx, ret_tr != NULL ? L : 1, hmm->M, &xmx, &mmx, &imx, &dmx);
 
   /* Initialization of the zero row.
    */
@@ -98,96 +445,24 @@ P7Viterbi(char *dsq, int L, struct plan7_s *hmm, struct dpmatrix_s *mx, struct p
   for (k = 0; k <= hmm->M; k++)
     mmx[0][k] = imx[0][k] = dmx[0][k] = -INFTY;      /* need seq to get here */
 
-  /* Initializations that help icc vectorize.
-   */
-  M        = hmm->M;
-
   /* Recursion. Done as a pull.
    * Note some slightly wasteful boundary conditions:  
    *    tsc[0] = -INFTY for all eight transitions (no node 0)
    *    D_M and I_M are wastefully calculated (they don't exist)
    */
-
-  tpmm  = hmm->tsc[TMM];
-  tpim  = hmm->tsc[TIM];
-  tpdm  = hmm->tsc[TDM];
-  tpmd  = hmm->tsc[TMD];
-  tpdd  = hmm->tsc[TDD];
-  tpmi  = hmm->tsc[TMI];
-  tpii  = hmm->tsc[TII];
-  bp    = hmm->bsc;
   for (i = 1; i <= L; i++) {
-    mc    = mmx[i];    
-    dc    = dmx[i];
-    ic    = imx[i];
-    mpp   = mmx[i-1];
-    dpp   = dmx[i-1];
-    ip    = imx[i-1];
-    xmb   = xmx[i-1][XMB];
-    ms    = hmm->msc[(int) dsq[i]];
-    is    = hmm->isc[(int) dsq[i]];
-    mc[0] = -INFTY;
-    dc[0] = -INFTY;
-    ic[0] = -INFTY;
-
-    for (k = 1; k <= M; k++) {
-      mc[k] = mpp[k-1]   + tpmm[k-1];
-      if ((sc = ip[k-1]  + tpim[k-1]) > mc[k])  mc[k] = sc;
-      if ((sc = dpp[k-1] + tpdm[k-1]) > mc[k])  mc[k] = sc;
-      if ((sc = xmb  + bp[k])         > mc[k])  mc[k] = sc; 
-      mc[k] += ms[k];
-      if (mc[k] < -INFTY) mc[k] = -INFTY;  
-
-      dc[k] = dc[k-1] + tpdd[k-1];
-      if ((sc = mc[k-1] + tpmd[k-1]) > dc[k]) dc[k] = sc;
-      if (dc[k] < -INFTY) dc[k] = -INFTY;  
-
-      if (k < M) {
-	ic[k] = mpp[k] + tpmi[k];
-	if ((sc = ip[k] + tpii[k]) > ic[k]) ic[k] = sc; 
-	ic[k] += is[k];
-	if (ic[k] < -INFTY) ic[k] = -INFTY; 
-      }
-    }
-
-    /* Now the special states. Order is important here.
-     * remember, C and J emissions are zero score by definition,
-     */
-				/* N state */
-    xmx[i][XMN] = -INFTY;
-    if ((sc = xmx[i-1][XMN] + hmm->xsc[XTN][LOOP]) > -INFTY)
-      xmx[i][XMN] = sc;
-
-				/* E state */
-    xme = -INFTY;
-    mpc = mmx[i];
-    ep  = hmm->esc;
-    for (k = 1; k <= hmm->M; k++)
-      if ((sc =  mpc[k] + ep[k]) > xme) xme = sc; 
-    xmx[i][XME] = xme;
-				/* J state */
-    xmx[i][XMJ] = -INFTY;
-    if ((sc = xmx[i-1][XMJ] + hmm->xsc[XTJ][LOOP]) > -INFTY)
-      xmx[i][XMJ] = sc;
-    if ((sc = xmx[i][XME]   + hmm->xsc[XTE][LOOP]) > xmx[i][XMJ])
-      xmx[i][XMJ] = sc;
-
-				/* B state */
-    xmx[i][XMB] = -INFTY;
-    if ((sc = xmx[i][XMN] + hmm->xsc[XTN][MOVE]) > -INFTY)
-      xmx[i][XMB] = sc;
-    if ((sc = xmx[i][XMJ] + hmm->xsc[XTJ][MOVE]) > xmx[i][XMB])
-      xmx[i][XMB] = sc;
-
-				/* C state */
-    xmx[i][XMC] = -INFTY;
-    if ((sc = xmx[i-1][XMC] + hmm->xsc[XTC][LOOP]) > -INFTY)
-      xmx[i][XMC] = sc;
-    if ((sc = xmx[i][XME] + hmm->xsc[XTE][MOVE]) > xmx[i][XMC])
-      xmx[i][XMC] = sc;
+    cur = ret_tr != NULL ? i   : i & 1;
+    prv = ret_tr != NULL ? i-1 : (i-1) & 1;
+    r.mc  = mmx[cur];    
+    r.dc  = dmx[cur];
+    r.ic  = imx[cur];
+    r.mpp = mmx[prv];
+    r.dpp = dmx[prv];
+    r.ip  = imx[prv];
+    viterbi_step(hmm, dsq, i, &r, xmx[cur], xmx[prv]);
   }
 				/* T state (not stored) */
-  sc = xmx[L][XMC] + hmm->xsc[XTC][MOVE];
+  sc = xmx[ret_tr != NULL ? L : L & 1][XMC] + hmm->xsc[XTC][MOVE];
 
   if (ret_tr != NULL) {
     P7ViterbiTrace(hmm, dsq, L, mx, &tr);
@@ -196,8 +471,679 @@ P7Viterbi(char *dsq, int L, struct plan7_s *hmm, struct dpmatrix_s *mx, struct p
 
   return Scorify(sc);		/* the total Viterbi score. */
 }
+
+/* Function: P7ViterbiRows()
+ * 
+ * Purpose:  Fill rows i1..i2 of a Viterbi matrix, given row i1-1.
+ *           Only the row pointers of mx are used, so rows need not
+ *           be contiguous or distinct from other rows of the
+ *           matrix, as long as rows i and i-1 are distinct: this
+ *           is what P7CheckpointViterbi() recomputes its blocks
+ *           with.
+ *           
+ * Args:     dsq    - sequence in digitized form
+ *           i1, i2 - first and last row to fill, 1 <= i1 <= i2 <= L
+ *           hmm    - the model
+ *           mx     - the matrix; row i1-1 is set, rows i1..i2
+ *                    have room for hmm->M
+ */
+void
+P7ViterbiRows(char *dsq, int i1, int i2, struct plan7_s *hmm, struct dpmatrix_s *mx)
+{
+  struct vitrow_s r;
+  int i;
+
+  if (viterbi_row == NULL) viterbi_row = viterbi_row_select();
+
+  for (i = i1; i <= i2; i++) {
+    r.mc  = mx->mmx[i];    
+    r.dc  = mx->dmx[i];
+    r.ic  = mx->imx[i];
+    r.mpp = mx->mmx[i-1];
+    r.dpp = mx->dmx[i-1];
+    r.ip  = mx->imx[i-1];
+    viterbi_step(hmm, dsq, i, &r, mx->xmx[i], mx->xmx[i-1]);
+  }
+}
 #endif /*default P7Viterbi, used when ALTIVEC and SLOW are not defined*/
 
+/*################################################################
+ * Inter-sequence Viterbi: scores only, for a batch of targets.
+ * 
+ * P7ViterbiBatch() sorts the targets by length and runs them
+ * VITERBI_LANES at a time, one sequence per 32-bit lane of a GCC
+ * vector, through the same recursion as P7Viterbi() with rolling
+ * rows. Every lane sees the same model position k at the same time,
+ * so the lanes never talk to each other: no D->D fixup and no model
+ * length minimum, which is what makes this worth it for short
+ * targets and small models. The price is one gather of the emission
+ * scores per row and lane, and lanes idling while the longest
+ * sequence of their group finishes; sorting keeps that small.
+ * On x86-64 the kernel is cloned for AVX-512 and AVX2, resolved at
+ * load time. -DNO_SIMD_VITERBI, or a compiler without GCC vectors,
+ * scores the batch one P7Viterbi() at a time instead.
+ * -DHMMER_GPU sends the batch to an offload device instead, when
+ * there is one (viterbi_gpu()).
+ ################################################################*/
+#ifndef VITERBI_LANES
+#if defined(__x86_64__)
+#define VITERBI_LANES 16	/* one AVX-512 register */
+#else
+#define VITERBI_LANES 8		/* two NEON registers */
+#endif
+#endif
+
+#if defined(__GNUC__) && !defined(NO_SIMD_VITERBI)
+#define VITERBI_BATCH_SIMD
+
+typedef int vitlane_t __attribute__ ((vector_size (4 * VITERBI_LANES)));
+
+/* lane-wise max; a macro, since passing 64-byte vectors by value
+ * to a function changes ABI between the clones */
+#define vl_max(a, b) \
+  ({ vitlane_t va_ = (a), vb_ = (b), gt_ = va_ > vb_; (va_ & gt_) | (vb_ & ~gt_); })
+
+/* Function: viterbi_lanes()
+ * 
+ * Purpose:  Score n <= VITERBI_LANES digitized sequences at once.
+ *           dp is scratch for 8*(M+1) vectors, aligned to one.
+ *           
+ * Args:     dsq    - the sequences, 1..L[j]
+ *           L      - their lengths, all >= 1
+ *           n      - number of sequences
+ *           hmm    - the model
+ *           dp     - scratch space
+ *           ret_sc - RETURN: integer Viterbi score of each
+ */
+#if defined(__x86_64__) && defined(__GNUC__) && __GNUC__ >= 6
+__attribute__ ((target_clones ("avx512f", "avx2", "default")))
+#endif
+static void
+viterbi_lanes(char **dsq, int *L, int n, struct plan7_s *hmm, vitlane_t *dp,
+	      int *ret_sc)
+{
+  vitlane_t *mm[2], *ii[2], *dd[2]; /* rows i&1 and (i-1)&1        */
+  vitlane_t *ms, *is;               /* emission scores of row i    */
+  vitlane_t  xN, xB, xE, xJ, xC;    /* special states of row i-1/i */
+  vitlane_t  ninf, sv, e;
+  int       *msl[VITERBI_LANES];    /* msc[dsq[j][i]] of each lane */
+  int       *isl[VITERBI_LANES];
+  int        M = hmm->M;
+  int        Lmax, i, j, k, c, p;
+
+  mm[0] = dp;		  mm[1] = dp + (M+1);
+  dd[0] = dp + 2*(M+1);   dd[1] = dp + 3*(M+1);
+  ii[0] = dp + 4*(M+1);   ii[1] = dp + 5*(M+1);
+  ms    = dp + 6*(M+1);   is    = dp + 7*(M+1);
+
+  ninf = (vitlane_t) {0} - INFTY;
+  for (k = 0; k <= M; k++)
+    mm[0][k] = dd[0][k] = ii[0][k] = ninf;
+  mm[1][0] = dd[1][0] = ii[1][0] = ninf;
+  ii[1][M] = ninf;
+  xN = (vitlane_t) {0};
+  xB = xN + hmm->xsc[XTN][MOVE];
+  xJ = xC = ninf;
+
+  Lmax = 0;
+  for (j = 0; j < n; j++) Lmax = MAX(Lmax, L[j]);
+
+  for (i = 1; i <= Lmax; i++)
+    {
+      c = i & 1;
+      p = c ^ 1;
+      /* gather this row's emissions; finished and empty lanes
+       * just run on residue 0 */
+      for (j = 0; j < VITERBI_LANES; j++) {
+	int x = (j < n && i <= L[j]) ? dsq[j][i] : 0;
+	msl[j] = hmm->msc[x];
+	isl[j] = hmm->isc[x];
+      }
+      for (k = 1; k <= M; k++)
+	for (j = 0; j < VITERBI_LANES; j++) {
+	  ms[k][j] = msl[j][k];
+	  is[k][j] = k < M ? isl[j][k] : 0;
+	}
+
+      e = ninf;
+      for (k = 1; k <= M; k++)
+	{
+	  sv = mm[p][k-1] + hmm->tsc[TMM][k-1];
+	  sv = vl_max(sv, ii[p][k-1] + hmm->tsc[TIM][k-1]);
+	  sv = vl_max(sv, dd[p][k-1] + hmm->tsc[TDM][k-1]);
+	  sv = vl_max(sv, xB + hmm->bsc[k]);
+	  mm[c][k] = vl_max(sv + ms[k], ninf);
+
+	  sv = vl_max(dd[c][k-1] + hmm->tsc[TDD][k-1],
+		      mm[c][k-1] + hmm->tsc[TMD][k-1]);
+	  dd[c][k] = vl_max(sv, ninf);
+
+	  if (k < M) {
+	    sv = vl_max(mm[p][k] + hmm->tsc[TMI][k],
+			ii[p][k] + hmm->tsc[TII][k]);
+	    ii[c][k] = vl_max(sv + is[k], ninf);
+	  }
+	  e = vl_max(e, mm[c][k] + hmm->esc[k]);
+	}
+
+      /* the special states, in P7Viterbi()'s order */
+      xN = vl_max(xN + hmm->xsc[XTN][LOOP], ninf);
+      xE = e;
+      xJ = vl_max(vl_max(xJ + hmm->xsc[XTJ][LOOP], ninf),
+		  xE + hmm->xsc[XTE][LOOP]);
+      xB = vl_max(vl_max(xN + hmm->xsc[XTN][MOVE], ninf),
+		  xJ + hmm->xsc[XTJ][MOVE]);
+      xC = vl_max(vl_max(xC + hmm->xsc[XTC][LOOP], ninf),
+		  xE + hmm->xsc[XTE][MOVE]);
+
+      for (j = 0; j < n; j++)
+	if (L[j] == i) ret_sc[j] = xC[j] + hmm->xsc[XTC][MOVE];
+    }
+}
+#endif /* VITERBI_BATCH_SIMD */
+
+#ifdef HMMER_GPU
+/* -DHMMER_GPU, with -fopenmp and an offload target (make gpu):
+ * P7ViterbiBatch() runs the whole batch on the device through OpenMP
+ * target offload, one team of VITERBI_WARP threads (a warp) per
+ * sequence. Within a row M and I only read row i-1, so the team
+ * shares out k; the D->D chain and the E state are then one thread's
+ * pass along the row,
+ * as in viterbi_row_portable(). The model goes over as hmm->vsc, all
+ * MAXCODE stripe arrays in one block, and each team keeps its two
+ * rolling rows in device memory. Without a device the batch takes
+ * the CPU path below instead: OpenMP's host fallback of these loops
+ * scores the same, but a barrier per row makes it very slow.
+ */
+#include <omp.h>
+#include <string.h>		/* memcpy() of the batch */
+
+#ifndef VITERBI_WARP
+#define VITERBI_WARP 32
+#endif
+
+/* Function: viterbi_gpu()
+ * 
+ * Purpose:  Score n digitized sequences on the offload device.
+ *           
+ * Args:     seq    - the sequences, packed: sequence j is
+ *                    seq[off[j]+1..off[j]+L[j]]
+ *           off    - their offsets in seq
+ *           tot    - length of seq
+ *           L      - their lengths, all >= 1
+ *           n      - number of sequences
+ *           hmm    - the model, hmm->vsc compiled
+ *           ret_sc - RETURN: integer Viterbi score of each
+ */
+static void
+viterbi_gpu(char *seq, long *off, long tot, int *L, int n, struct plan7_s *hmm,
+	    int *ret_sc)
+{
+  int  M   = hmm->M;
+  int  nv  = ((M + P7_VSTRIPE - 1) / P7_VSTRIPE) * VSC_NSC * P7_VSTRIPE;
+  long nsc = (long) MAXCODE * nv;
+  long ndp = (long) n * 6 * (M+1);
+  int *vsc = hmm->vsc[0];
+  int  xsc[8];
+  int *dp;
+  int  j;
+
+  for (j = 0; j < 8; j++) xsc[j] = hmm->xsc[j/2][j%2];
+  dp = MallocOrDie(sizeof(int) * ndp);
+
+#pragma omp target teams distribute thread_limit(VITERBI_WARP)	\
+  map(to: vsc[0:nsc], seq[0:tot], off[0:n], L[0:n], xsc[0:8])	\
+  map(alloc: dp[0:ndp]) map(from: ret_sc[0:n])
+  for (j = 0; j < n; j++)
+    {
+      int  *mm[2], *dd[2], *ii[2];	/* rows i&1 and (i-1)&1 */
+      int   xN, xB, xJ, xC;
+      char *s  = seq + off[j];
+      int  *rw = dp + (long) j * 6 * (M+1);
+      int   k;
+
+      mm[0] = rw;	    mm[1] = rw + (M+1);
+      dd[0] = rw + 2*(M+1); dd[1] = rw + 3*(M+1);
+      ii[0] = rw + 4*(M+1); ii[1] = rw + 5*(M+1);
+      for (k = 0; k <= M; k++)
+	mm[0][k] = dd[0][k] = ii[0][k] = -INFTY;
+      mm[1][0] = dd[1][0] = ii[1][0] = -INFTY;
+      xN = 0;
+      xB = xsc[2*XTN+MOVE];
+      xJ = xC = -INFTY;
+
+#pragma omp parallel num_threads(VITERBI_WARP)
+      {
+	int i, c, p, kk, sc, xE;
+	int *v;
+
+	for (i = 1; i <= L[j]; i++)
+	  {
+	    c = i & 1;
+	    p = c ^ 1;
+
+#pragma omp for
+	    for (kk = 1; kk <= M; kk++)
+	      {
+		int *w = vsc + (long) nv * s[i] + VSC_IDX(kk, 0);
+		int  m;
+
+		m = mm[p][kk-1] + w[VSC_TMM*P7_VSTRIPE];
+		if ((sc = ii[p][kk-1] + w[VSC_TIM*P7_VSTRIPE]) > m) m = sc;
+		if ((sc = dd[p][kk-1] + w[VSC_TDM*P7_VSTRIPE]) > m) m = sc;
+		if ((sc = xB          + w[VSC_BSC*P7_VSTRIPE]) > m) m = sc;
+		m += w[VSC_MSC*P7_VSTRIPE];
+		mm[c][kk] = m < -INFTY ? -INFTY : m;
+
+		if (kk < M) {
+		  m = mm[p][kk] + w[VSC_TMI*P7_VSTRIPE];
+		  if ((sc = ii[p][kk] + w[VSC_TII*P7_VSTRIPE]) > m) m = sc;
+		  m += w[VSC_ISC*P7_VSTRIPE];
+		  ii[c][kk] = m < -INFTY ? -INFTY : m;
+		}
+	      }
+
+#pragma omp single
+	    {
+	      v  = vsc + (long) nv * s[i];
+	      xE = -INFTY;
+	      for (kk = 1; kk <= M; kk++)
+		{
+		  int *w = v + VSC_IDX(kk, 0);
+
+		  dd[c][kk] = dd[c][kk-1] + w[VSC_TDD*P7_VSTRIPE];
+		  if ((sc = mm[c][kk-1] + w[VSC_TMD*P7_VSTRIPE]) > dd[c][kk])
+		    dd[c][kk] = sc;
+		  if (dd[c][kk] < -INFTY) dd[c][kk] = -INFTY;
+		  if ((sc = mm[c][kk] + w[VSC_ESC*P7_VSTRIPE]) > xE) xE = sc;
+		}
+
+	      /* the special states, in P7Viterbi()'s order */
+	      xN = xN + xsc[2*XTN+LOOP];
+	      if (xN < -INFTY) xN = -INFTY;
+	      xJ = xJ + xsc[2*XTJ+LOOP];
+	      if (xJ < -INFTY) xJ = -INFTY;
+	      if ((sc = xE + xsc[2*XTE+LOOP]) > xJ) xJ = sc;
+	      xB = xN + xsc[2*XTN+MOVE];
+	      if (xB < -INFTY) xB = -INFTY;
+	      if ((sc = xJ + xsc[2*XTJ+MOVE]) > xB) xB = sc;
+	      xC = xC + xsc[2*XTC+LOOP];
+	      if (xC < -INFTY) xC = -INFTY;
+	      if ((sc = xE + xsc[2*XTE+MOVE]) > xC) xC = sc;
+	    }
+	  }
+      }
+      ret_sc[j] = xC + xsc[2*XTC+MOVE];
+    }
+
+  free(dp);
+}
+#endif /* HMMER_GPU */
+
+/* Function: P7ViterbiBatch()
+ * 
+ * Purpose:  Viterbi scores, without traces, of n target
+ *           sequences against one model; the same scores
+ *           P7Viterbi() returns.
+ *           
+ * Args:     dsq    - sequences in digitized form [0..n-1]
+ *           L      - their lengths [0..n-1], each >= 1
+ *           n      - number of sequences
+ *           hmm    - the model
+ *           ret_sc - RETURN: bit scores [0..n-1]
+ *           
+ * Return:   (void)
+ */
+void
+P7ViterbiBatch(char **dsq, int *L, int n, struct plan7_s *hmm, float *ret_sc)
+{
+#ifdef HMMER_GPU
+  if (omp_get_num_devices() > 0)
+    {
+      char *seq;		/* the batch, packed for the device */
+      long *off;
+      int  *sc;
+      long  tot;
+      int   j;
+
+      off = MallocOrDie(sizeof(long) * n);
+      for (tot = 0, j = 0; j < n; j++) {
+	off[j] = tot;
+	tot   += L[j] + 2;
+      }
+      seq = MallocOrDie(sizeof(char) * tot);
+      for (j = 0; j < n; j++)
+	memcpy(seq + off[j], dsq[j], L[j] + 2);
+      sc = MallocOrDie(sizeof(int) * n);
+
+      viterbi_gpu(seq, off, tot, L, n, hmm, sc);
+      for (j = 0; j < n; j++)
+	ret_sc[j] = Scorify(sc[j]);
+      free(sc);
+      free(seq);
+      free(off);
+      return;
+    }
+#endif
+#ifdef VITERBI_BATCH_SIMD
+  int       *order;		/* targets, shortest first */
+  char      *gdsq[VITERBI_LANES];
+  int        gL[VITERBI_LANES];
+  int        gsc[VITERBI_LANES];
+  void      *mem;
+  vitlane_t *dp;
+  int        g, j, t, x;
+
+  /* insertion sort on length: batches are small */
+  order = MallocOrDie(sizeof(int) * n);
+  for (j = 0; j < n; j++) {
+    for (t = j; t > 0 && L[order[t-1]] > L[j]; t--)
+      order[t] = order[t-1];
+    order[t] = j;
+  }
+
+  mem = MallocOrDie(sizeof(vitlane_t) * (8 * (hmm->M+1) + 1));
+  dp  = (vitlane_t *) (((unsigned long) mem + sizeof(vitlane_t) - 1) 
+		       & ~((unsigned long) sizeof(vitlane_t) - 1));
+
+  for (g = 0; g < n; g += VITERBI_LANES)
+    {
+      t = MIN(VITERBI_LANES, n - g);
+      for (j = 0; j < t; j++) {
+	x       = order[g+j];
+	gdsq[j] = dsq[x];
+	gL[j]   = L[x];
+      }
+      viterbi_lanes(gdsq, gL, t, hmm, dp, gsc);
+      for (j = 0; j < t; j++)
+	ret_sc[order[g+j]] = Scorify(gsc[j]);
+    }
+  free(mem);
+  free(order);
+#else
+  struct dpmatrix_s *mx;
+  int j;
+
+  mx = CreatePlan7Matrix(1, hmm->M, 25, 0);
+  for (j = 0; j < n; j++)
+    ret_sc[j] = P7Viterbi(dsq[j], L[j], hmm, mx, NULL);
+  FreePlan7Matrix(mx);
+#endif
+}
+
+/*################################################################
+ * P7Forward(), optimized; core_algorithms.c's is used with -DSLOW.
+ * 
+ * The recursion and the order of every ILogsum() are those of
+ * core_algorithms.c:P7Forward(), so the cells and the score are the
+ * same, but ILogsum() is inlined, table and all (ILogsumTable()),
+ * in a branch-free form. M and I only read row i-1, so on x86-64
+ * they go a vector at a time, the table looked up by a gather
+ * (AVX2 or AVX-512, picked by the CPU as for P7Viterbi()); D and E
+ * are chains along k, and stay scalar.
+ * -DNO_SIMD_VITERBI leaves only the portable kernel.
+ ################################################################*/
+#ifndef SLOW
+
+struct fwdrow_s {
+  int  M;
+  int *mc, *ic;			/* row i, M and I; 1..M and 1..M-1 set */
+  int *mpp, *dpp, *ip;		/* row i-1                             */
+  int  xmb;			/* xmx[i-1][XMB]                       */
+  int *ms, *is;			/* msc[dsq[i]], isc[dsq[i]]            */
+  int *bp;			/* bsc                                 */
+  int *tpmm, *tpmi, *tpim, *tpii, *tpdm; 
+  int *lt;			/* ILogsumTable()                      */
+};
+
+typedef void (*fwdrow_f)(struct fwdrow_s *r);
+
+/* ILogsum(p1, p2), the difference taken mod 2^32 as the int
+ * subtraction in ILogsum() would wrap.
+ */
+static inline int
+ilogsum_lt(const int *lt, int p1, int p2)
+{
+  int      diff = (int) ((unsigned int) p1 - (unsigned int) p2);
+  unsigned adiff = diff < 0 ? 0u - (unsigned int) diff : (unsigned int) diff;
+  return (diff > 0 ? p1 : p2) + lt[adiff < LOGSUM_TBL ? adiff : LOGSUM_TBL];
+}
+
+/* M_M, whose B->M term is core_algorithms.c's bsc[M-1], kept */
+static void
+forward_row_last(struct fwdrow_s *r)
+{
+  int M = r->M;
+  r->mc[M] = ilogsum_lt(r->lt, 
+			ilogsum_lt(r->lt, r->mpp[M-1] + r->tpmm[M-1], 
+				   r->ip[M-1]  + r->tpim[M-1]),
+			ilogsum_lt(r->lt, r->xmb + r->bp[M-1],
+				   r->dpp[M-1] + r->tpdm[M-1]));
+  r->mc[M] += r->ms[M];
+}
+
+static void
+forward_row_portable(struct fwdrow_s *r)
+{
+  int *lt = r->lt;
+  int  k;
+
+  for (k = 1; k < r->M; k++) {
+    r->mc[k]  = ilogsum_lt(lt, ilogsum_lt(lt, r->mpp[k-1] + r->tpmm[k-1],
+					  r->ip[k-1]  + r->tpim[k-1]),
+			   ilogsum_lt(lt, r->xmb + r->bp[k],
+				      r->dpp[k-1] + r->tpdm[k-1]));
+    r->mc[k] += r->ms[k];
+    r->ic[k]  = ilogsum_lt(lt, r->mpp[k] + r->tpmi[k], r->ip[k] + r->tpii[k]);
+    r->ic[k] += r->is[k];
+  }
+  forward_row_last(r);
+}
+
+#if defined(__GNUC__) && defined(__x86_64__) && !defined(NO_SIMD_VITERBI)
+#include <immintrin.h>
+#define SIMD_FORWARD_X86
+
+/* Lanes at and past M-k are masked off, loaded as 0: they look up
+ * lt[0], and nothing is stored from them.
+ */
+__attribute__((target("avx2")))
+static inline __m256i
+ilogsum_avx2(const int *lt, __m256i p1, __m256i p2)
+{
+  __m256i diff = _mm256_sub_epi32(p1, p2);
+  __m256i idx  = _mm256_min_epu32(_mm256_abs_epi32(diff), _mm256_set1_epi32(LOGSUM_TBL));
+  __m256i gt   = _mm256_cmpgt_epi32(diff, _mm256_setzero_si256());
+  return _mm256_add_epi32(_mm256_blendv_epi8(p2, p1, gt),
+			  _mm256_i32gather_epi32(lt, idx, 4));
+}
+
+__attribute__((target("avx2")))
+static void
+forward_row_avx2(struct fwdrow_s *r)
+{
+  const __m256i iota = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  const __m256i xmb  = _mm256_set1_epi32(r->xmb);
+  const int    *lt   = r->lt;
+  __m256i mask, a, b, sc;
+  int     k;
+
+#define LD(p) _mm256_maskload_epi32((p), mask)
+  for (k = 1; k < r->M; k += 8) {
+    mask = _mm256_cmpgt_epi32(_mm256_set1_epi32(r->M - k), iota);
+    a  = ilogsum_avx2(lt, _mm256_add_epi32(LD(r->mpp + k-1), LD(r->tpmm + k-1)),
+		      _mm256_add_epi32(LD(r->ip  + k-1), LD(r->tpim + k-1)));
+    b  = ilogsum_avx2(lt, _mm256_add_epi32(xmb, LD(r->bp + k)),
+		      _mm256_add_epi32(LD(r->dpp + k-1), LD(r->tpdm + k-1)));
+    sc = _mm256_add_epi32(ilogsum_avx2(lt, a, b), LD(r->ms + k));
+    _mm256_maskstore_epi32(r->mc + k, mask, sc);
+
+    sc = ilogsum_avx2(lt, _mm256_add_epi32(LD(r->mpp + k), LD(r->tpmi + k)),
+		      _mm256_add_epi32(LD(r->ip  + k), LD(r->tpii + k)));
+    _mm256_maskstore_epi32(r->ic + k, mask, _mm256_add_epi32(sc, LD(r->is + k)));
+  }
+#undef LD
+  forward_row_last(r);
+}
+
+__attribute__((target("avx512f")))
+static inline __m512i
+ilogsum_avx512(const int *lt, __m512i p1, __m512i p2)
+{
+  __m512i   diff = _mm512_sub_epi32(p1, p2);
+  __m512i   idx  = _mm512_min_epu32(_mm512_abs_epi32(diff), _mm512_set1_epi32(LOGSUM_TBL));
+  __mmask16 gt   = _mm512_cmpgt_epi32_mask(diff, _mm512_setzero_si512());
+  return _mm512_add_epi32(_mm512_mask_blend_epi32(gt, p2, p1),
+			  _mm512_i32gather_epi32(idx, lt, 4));
+}
+
+__attribute__((target("avx512f")))
+static void
+forward_row_avx512(struct fwdrow_s *r)
+{
+  const __m512i xmb = _mm512_set1_epi32(r->xmb);
+  const int    *lt  = r->lt;
+  __m512i   a, b, sc;
+  __mmask16 mask;
+  int       k, n;
+
+#define LD(p) _mm512_maskz_loadu_epi32(mask, (p))
+  for (k = 1; k < r->M; k += 16) {
+    n    = r->M - k;
+    mask = n >= 16 ? (__mmask16) 0xffff : (__mmask16) ((1u << n) - 1);
+    a  = ilogsum_avx512(lt, _mm512_add_epi32(LD(r->mpp + k-1), LD(r->tpmm + k-1)),
+			_mm512_add_epi32(LD(r->ip  + k-1), LD(r->tpim + k-1)));
+    b  = ilogsum_avx512(lt, _mm512_add_epi32(xmb, LD(r->bp + k)),
+			_mm512_add_epi32(LD(r->dpp + k-1), LD(r->tpdm + k-1)));
+    sc = _mm512_add_epi32(ilogsum_avx512(lt, a, b), LD(r->ms + k));
+    _mm512_mask_storeu_epi32(r->mc + k, mask, sc);
+
+    sc = ilogsum_avx512(lt, _mm512_add_epi32(LD(r->mpp + k), LD(r->tpmi + k)),
+			_mm512_add_epi32(LD(r->ip  + k), LD(r->tpii + k)));
+    _mm512_mask_storeu_epi32(r->ic + k, mask, _mm512_add_epi32(sc, LD(r->is + k)));
+  }
+#undef LD
+  forward_row_last(r);
+}
+#endif /* SIMD_FORWARD_X86 */
+
+/* Function: forward_row_select()
+ * 
+ * Purpose:  Pick the widest Forward row kernel this CPU runs.
+ */
+static fwdrow_f
+forward_row_select(void)
+{
+#ifdef SIMD_FORWARD_X86
+  if (__builtin_cpu_supports("avx512f")) return forward_row_avx512;
+  if (__builtin_cpu_supports("avx2"))    return forward_row_avx2;
+#endif
+  return forward_row_portable;
+}
+
+/* Function: P7Forward() - optimized version
+ * 
+ * Purpose:  The Forward dynamic programming algorithm.
+ *           Derived from core_algorithms.c:P7Forward(); the
+ *           same cells, and the same score.
+ *           
+ * Args:     dsq    - sequence in digitized form
+ *           L      - length of dsq
+ *           hmm    - the model
+ *           ret_mx - RETURN: dp matrix; pass NULL if it's not wanted,
+ *                    and then only two rolling rows are allocated,
+ *                    O(M) memory for any L
+ *           
+ * Return:   log P(S|M)/P(S|R), as a bit score.
+ */
+float
+P7Forward(char *dsq, int L, struct plan7_s *hmm, struct dpmatrix_s **ret_mx)
+{
+  static fwdrow_f forward_row = NULL;
+  struct fwdrow_s r;
+  struct dpmatrix_s *mx;
+  int **xmx;
+  int **mmx;
+  int **imx;
+  int **dmx;
+  int  *lt;
+  int   i,k;
+  int   sc;
+  int   cur, prv;		/* rows of mx for i, i-1 */
+
+  if (forward_row == NULL) forward_row = forward_row_select();
+  lt = ILogsumTable();
+
+  /* Allocate a DP matrix with 0..L rows, 0..M-1 columns;
+   * for the score alone, rows 0 and 1 are reused for all i.
+   */ 
+  mx = AllocPlan7Matrix(ret_mx != NULL ? L+1 : 2, hmm->M, &xmx, &mmx, &imx, &dmx);
+
+  /* Initialization of the zero row.
+   */
+  xmx[0][XMN] = 0;		                     /* S->N, p=1            */
+  xmx[0][XMB] = hmm->xsc[XTN][MOVE];                 /* S->N->B, no N-tail   */
+  xmx[0][XME] = xmx[0][XMC] = xmx[0][XMJ] = -INFTY;  /* need seq to get here */
+  for (k = 0; k <= hmm->M; k++)
+    mmx[0][k] = imx[0][k] = dmx[0][k] = -INFTY;      /* need seq to get here */
+
+  r.M    = hmm->M;
+  r.tpmm = hmm->tsc[TMM];
+  r.tpim = hmm->tsc[TIM];
+  r.tpdm = hmm->tsc[TDM];
+  r.tpmi = hmm->tsc[TMI];
+  r.tpii = hmm->tsc[TII];
+  r.bp   = hmm->bsc;
+  r.lt   = lt;
+  for (i = 1; i <= L; i++)
+    {
+      cur = ret_mx != NULL ? i   : i & 1;
+      prv = ret_mx != NULL ? i-1 : (i-1) & 1;
+      mmx[cur][0] = imx[cur][0] = dmx[cur][0] = -INFTY;
+
+      r.mc  = mmx[cur];
+      r.ic  = imx[cur];
+      r.mpp = mmx[prv];
+      r.dpp = dmx[prv];
+      r.ip  = imx[prv];
+      r.xmb = xmx[prv][XMB];
+      r.ms  = hmm->msc[(int) dsq[i]];
+      r.is  = hmm->isc[(int) dsq[i]];
+      forward_row(&r);
+
+      for (k = 1; k < hmm->M; k++)
+	dmx[cur][k] = ilogsum_lt(lt, mmx[cur][k-1] + hmm->tsc[TMD][k-1],
+				 dmx[cur][k-1] + hmm->tsc[TDD][k-1]);
+
+      /* Now the special states.
+       * remember, C and J emissions are zero score by definition
+       */
+      xmx[cur][XMN] = xmx[prv][XMN] + hmm->xsc[XTN][LOOP];
+
+      xmx[cur][XME] = -INFTY;
+      for (k = 1; k <= hmm->M; k++)
+	xmx[cur][XME] = ilogsum_lt(lt, xmx[cur][XME], mmx[cur][k] + hmm->esc[k]);
+
+      xmx[cur][XMJ] = ilogsum_lt(lt, xmx[prv][XMJ] + hmm->xsc[XTJ][LOOP],
+				 xmx[cur][XME]   + hmm->xsc[XTE][LOOP]);
+
+      xmx[cur][XMB] = ilogsum_lt(lt, xmx[cur][XMN] + hmm->xsc[XTN][MOVE],
+				 xmx[cur][XMJ] + hmm->xsc[XTJ][MOVE]);
+
+      xmx[cur][XMC] = ilogsum_lt(lt, xmx[prv][XMC] + hmm->xsc[XTC][LOOP],
+				 xmx[cur][XME] + hmm->xsc[XTE][MOVE]);
+    }
+			    
+  sc = xmx[ret_mx != NULL ? L : L & 1][XMC] + hmm->xsc[XTC][MOVE];
+
+  if (ret_mx != NULL) *ret_mx = mx;
+  else                FreePlan7Matrix(mx);
+
+  return Scorify(sc);		/* the total Forward score. */
+}
+#endif /*!SLOW*/
+
+
 #if !defined(SPEC_CPU)
 #ifdef ALTIVEC
 /*################################################################
@@ -29,6 +29,10 @@ extern void  DetermineAlphabet(char **rseqs, int  nseq);
 extern void  SetAlphabet(int type);
 extern int   SymbolIndex(char sym);
 extern char *DigitizeSequence(char *seq, int L);
+extern void  DigitizedRandomSequence(float *p, int L, char *dsq);
+extern void  SetResidueAlias(struct ralias_s *ra, float *p);
+extern void  DigitizedAliasSequence(struct ralias_s *ra, unsigned long long key,
+				    int L, char *dsq);
 extern char *DedigitizeSequence(char *dsq, int L);
 extern void  DigitizeAlignment(MSA *msa, char ***ret_dsqs);
 extern void  P7CountSymbol(float *counters, char sym, float wt);
@@ -50,10 +54,15 @@ extern void  FreeShadowMatrix(struct dpshadow_s *tb);
 extern int   P7ViterbiSize(int L, int M);
 extern int   P7SmallViterbiSize(int L, int M);
 extern int   P7WeeViterbiSize(int L, int M);
+extern int   P7CheckpointViterbiSize(int L, int M);
 extern float P7Forward(char *dsq, int L, struct plan7_s *hmm, 
 			  struct dpmatrix_s **ret_mx);
 extern float P7Viterbi(char *dsq, int L, struct plan7_s *hmm, struct dpmatrix_s *mx,
 			  struct p7trace_s **ret_tr);
+extern void  P7ViterbiRows(char *dsq, int i1, int i2, struct plan7_s *hmm,
+			   struct dpmatrix_s *mx);
+extern void  P7ViterbiBatch(char **dsq, int *L, int n, struct plan7_s *hmm,
+			    float *ret_sc);
 extern void  P7ViterbiTrace(struct plan7_s *hmm, char *dsq, int L,
 			   struct dpmatrix_s *mx, struct p7trace_s **ret_tr);
 extern float P7SmallViterbi(char *dsq, int L, struct plan7_s *hmm, struct dpmatrix_s *mx, struct p7trace_s **ret_tr);
@@ -61,11 +70,13 @@ extern float P7ParsingViterbi(char *dsq, int L, struct plan7_s *hmm,
 			      struct p7trace_s **ret_tr);
 extern float P7WeeViterbi(char *dsq, int L, struct plan7_s *hmm, 
 			  struct p7trace_s **ret_tr);
+extern float P7CheckpointViterbi(char *dsq, int L, struct plan7_s *hmm, 
+				 struct p7trace_s **ret_tr);
 extern float Plan7ESTViterbi(char *dsq, int L, struct plan7_s *hmm, 
 			     struct dpmatrix_s **ret_mx);
 extern struct p7trace_s *P7ViterbiAlignAlignment(MSA *msa, struct plan7_s *hmm);
 extern struct p7trace_s *ShadowTrace(struct dpshadow_s *tb, struct plan7_s *hmm, int L);
-extern float  PostprocessSignificantHit(struct tophit_s *ghit, struct tophit_s *dhit, struct p7trace_s   *tr, struct plan7_s *hmm, char *dsq, int L, char *seqname, char *seqacc, char *seqdesc, int do_forward, float sc_override, int do_null2, struct threshold_s *thresh, int hmmpfam_mode);
+extern float  PostprocessSignificantHit(struct tophit_s *ghit, struct tophit_s *dhit, struct p7trace_s   *tr, struct plan7_s *hmm, char *dsq, int L, char *seqname, char *seqacc, char *seqdesc, int seqidx, int do_forward, float sc_override, int do_null2, struct threshold_s *thresh, int hmmpfam_mode);
 
 
 /* from debug.c
@@ -115,6 +126,7 @@ extern struct histogram_s *AllocHistogram(int min, int max, int lumpsize);
 extern void FreeHistogram(struct histogram_s *h);
 extern void UnfitHistogram(struct histogram_s *h);
 extern void AddToHistogram(struct histogram_s *h, float sc);
+extern void MergeHistogram(struct histogram_s *h, struct histogram_s *h2);
 extern void PrintASCIIHistogram(FILE *fp, struct histogram_s *h); 
 extern void PrintXMGRHistogram(FILE *fp, struct histogram_s *h);
 extern void PrintXMGRDistribution(FILE *fp, struct histogram_s *h);
@@ -169,6 +181,7 @@ extern float Scorify(int sc);
 extern double PValue(struct plan7_s *hmm, float sc);
 extern float LogSum(float p1, float p2);
 extern int   ILogsum(int p1, int p2);
+extern int  *ILogsumTable(void);
 extern void  LogNorm(float *vec, int n);
 extern float Logp_cvec(float *cvec, int n, float *alpha);
 extern void  SampleDirichlet(float *alpha, int n, float *p);
@@ -198,6 +211,14 @@ extern void P7Maxmodelmaker(MSA *msa, char **dsq,
 			    struct plan7_s **ret_hmm,
 			    struct p7trace_s  ***ret_tr);
 
+/* from msvfilter.c
+ * MSV prefilter for hmmsearch
+ */
+extern struct msvprofile_s *CreateMSVProfile(struct plan7_s *hmm);
+extern void   FreeMSVProfile(struct msvprofile_s *om);
+extern float  MSVFilter(char *dsq, int L, struct msvprofile_s *om);
+extern double MSVPValue(struct msvprofile_s *om, float sc);
+
 /* from plan7.c
  * Plan7 HMM structure support
  */
@@ -213,6 +234,7 @@ extern void Plan7ComlogAppend(struct plan7_s *hmm, int argc, char **argv);
 extern void Plan7SetCtime(struct plan7_s *hmm);
 extern void Plan7SetNullModel(struct plan7_s *hmm, float null[MAXABET], float p1);
 extern void P7Logoddsify(struct plan7_s *hmm, int viterbi_mode);
+extern void P7CompileScores(struct plan7_s *hmm);
 extern void Plan7Renormalize(struct plan7_s *hmm);
 extern void Plan7RenormalizeExits(struct plan7_s *hmm);
 extern void Plan7NakedConfig(struct plan7_s *hmm);
@@ -304,7 +326,7 @@ extern void   FreeFancyAli(struct fancyali_s *ali);
 extern void   RegisterHit(struct tophit_s *h, double sortkey, 
 			  double pvalue, float score, 
 			  double motherp, float mothersc,
-			  char *name, char *acc, char *desc, 
+			  char *name, char *acc, char *desc, int seqidx,
 			  int sqfrom, int sqto, int sqlen, 
 			  int hmmfrom, int hmmto, int hmmlen, 
 			  int domidx, int ndom, 
@@ -317,6 +339,8 @@ extern void GetRankedHit(struct tophit_s *h, int rank,
 			 int *r_hmmfrom, int *r_hmmto, int *r_hmmlen,
 			 int *r_domidx, int *r_ndom,
 			 struct fancyali_s **r_ali);
+extern void   TophitsAliLimit(struct tophit_s *h, int K);
+extern void   MergeTophits(struct tophit_s *dest, struct tophit_s *src);
 extern int    TophitsMaxName(struct tophit_s *h);
 extern void   FullSortTophits(struct tophit_s *h);
 extern void   TophitsReport(struct tophit_s *h, double E, int nseq);
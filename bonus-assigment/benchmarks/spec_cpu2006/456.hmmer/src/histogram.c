@@ -175,6 +175,31 @@ AddToHistogram(struct histogram_s *h, float sc)
 }
 
 
+/* Function: MergeHistogram()
+ * 
+ * Purpose:  Add all the counts of histogram h2 into h, as if
+ *           each of its scores were given to AddToHistogram(h).
+ *           Used to gather per-thread histograms.
+ */
+void
+MergeHistogram(struct histogram_s *h, struct histogram_s *h2)
+{
+  int sc;
+  int n;
+
+  if (h->fit_type != HISTFIT_NONE)
+    Die("MergeHistogram(): Can't add to a fitted histogram\n");
+
+  for (sc = h2->lowscore; sc <= h2->highscore; sc++)
+    {
+      if ((n = h2->histogram[sc - h2->min]) == 0) continue;
+      AddToHistogram(h, (float) sc); /* grows h, sets low/highscore */
+      h->histogram[sc - h->min] += n-1;
+      h->total                  += n-1;
+    }
+}
+
+
 
 /* Function: PrintASCIIHistogram()
  * 
@@ -1034,6 +1059,7 @@ Lawless416(float *x, int *y, int n, float lambda, float *ret_f, float *ret_df)
   double xsum;			/* \sum xi                  */
   double mult;			/* histogram count multiplier */
   double total;			/* total samples            */
+  double ex;			/* e^(-lambda xi)           */
   int i;
 
 
@@ -1041,10 +1067,11 @@ Lawless416(float *x, int *y, int n, float lambda, float *ret_f, float *ret_df)
   for (i = 0; i < n; i++)
     {
       mult = (y == NULL) ? 1. : (double) y[i];
+      ex   = exp(-1. * lambda * x[i]);
       xsum   += mult * x[i];
-      xesum  += mult * x[i] * exp(-1. * lambda * x[i]);
-      xxesum += mult * x[i] * x[i] * exp(-1. * lambda * x[i]);
-      esum   += mult * exp(-1. * lambda * x[i]);
+      xesum  += mult * x[i] * ex;
+      xxesum += mult * x[i] * x[i] * ex;
+      esum   += mult * ex;
       total  += mult;
     }
   *ret_f  = 1./lambda - xsum / total + xesum / esum;
@@ -1091,24 +1118,27 @@ Lawless422(float *x, int *y, int n, int z, float c,
   double xsum;			/* \sum xi                  (no z term) */
   double mult;			/* histogram count multiplier */
   double total;			/* total samples            */
+  double ex;			/* e^(-lambda xi)           */
   int i;
 
   esum = xesum = xsum  = xxesum = total = 0.;
   for (i = 0; i < n; i++)
     {
       mult = (y == NULL) ? 1. : (double) y[i];
+      ex   = exp(-1. * lambda * x[i]);
       xsum   += mult * x[i];
-      esum   += mult *               exp(-1. * lambda * x[i]);
-      xesum  += mult * x[i] *        exp(-1. * lambda * x[i]);
-      xxesum += mult * x[i] * x[i] * exp(-1. * lambda * x[i]);
+      esum   += mult *               ex;
+      xesum  += mult * x[i] *        ex;
+      xxesum += mult * x[i] * x[i] * ex;
       total  += mult;
     }
 
   /* Add z terms for censored data
    */
-  esum   += (double) z *         exp(-1. * lambda * c);
-  xesum  += (double) z * c *     exp(-1. * lambda * c);
-  xxesum += (double) z * c * c * exp(-1. * lambda * c);
+  ex      = exp(-1. * lambda * c);
+  esum   += (double) z *         ex;
+  xesum  += (double) z * c *     ex;
+  xxesum += (double) z * c * c * ex;
 
   *ret_f  = 1./lambda - xsum / total + xesum / esum;
   *ret_df = ((xesum / esum) * (xesum / esum))
@@ -54,7 +54,9 @@ Available options are:\n\
 ";
 
 static char experts[] = "\
+  --cache <f>    : reuse/record calibrations of unchanged models in file <f>\n\
   --cpu <n>      : run <n> threads in parallel (if threaded)\n\
+  --fastrng      : draw samples from a counter-based generator, alias tables\n\
   --fixed <n>    : fix random sequence length at <n>\n\
   --histfile <f> : save histogram(s) to file <f>\n\
   --mean <x>     : set random seq length mean at <x> [350]\n\
@@ -66,7 +68,9 @@ static char experts[] = "\
 
 static struct opt_s OPTIONS[] = {
    { "-h",         TRUE,  sqdARG_NONE  },
+   { "--cache",    FALSE, sqdARG_STRING },
    { "--cpu",      FALSE, sqdARG_INT },
+   { "--fastrng",  FALSE, sqdARG_NONE  },
    { "--fixed",    FALSE, sqdARG_INT   },
    { "--histfile", FALSE, sqdARG_STRING },
    { "--mean",     FALSE, sqdARG_FLOAT },
@@ -79,10 +83,40 @@ static struct opt_s OPTIONS[] = {
 
 
 static void main_loop_serial(struct plan7_s *hmm, int seed, int nsample,
-			     float lenmean, float lensd, int fixedlen,
+			     float lenmean, float lensd, int fixedlen, int fastrng,
 			     struct histogram_s **ret_hist, float *ret_max);
+static int  ctr_sample(int seed, int idx, float lenmean, float lensd, int fixedlen,
+		       struct ralias_s *ra, char **dsq, int *dsqlen);
+
+/* The --cache file: one line per calibration, "<key> <mu> <lambda>
+ * <max> <name>", where key is a 64-bit FNV-1a hash (in hex) of the
+ * model parameters the simulation depends on and of the options of
+ * the run. It is read once at startup and appended to after each
+ * fresh fit; the name is only there for people reading the file.
+ */
+struct calcache_s {
+  unsigned long long key;
+  float  mu;
+  float  lambda;
+  float  max;
+};
+static unsigned long long calcache_key(struct plan7_s *hmm, int seed, int seeded,
+				       int nsample, float lenmean, float lensd,
+				       int fixedlen, int fastrng);
+static struct calcache_s *calcache_read(char *file, int *ret_n);
+static struct calcache_s *calcache_find(struct calcache_s *cache, int n,
+					unsigned long long key);
 
 #ifdef HMMER_THREADS
+/* A worker takes this many samples per acquisition of the input
+ * lock, and keeps its own histogram until it is done, so the locks
+ * stay cold even with many threads. The samples are still drawn from
+ * sre_random() in order, so the histogram is the serial one. With
+ * --fastrng the lock only hands out sample numbers, and each thread
+ * synthesizes its own (ctr_sample()).
+ */
+#define WORKPOOL_BATCH 16
+
 /* A structure of this type is shared by worker threads in the POSIX
  * threads parallel version.
  */
@@ -95,12 +129,15 @@ struct workpool_s {
   float  lensd;			/* s.d. of Gaussian for random seq len */
   float *randomseq;             /* 0..Alphabet_size-1 i.i.d. probs     */
   int    nsample;		/* number of random seqs to do         */
+  int    seed;			/* random number seed                  */
+  int    fastrng;		/* TRUE: ctr_sample(), from ralias     */
+  struct ralias_s ralias;	/* alias table of randomseq            */
 
   /* Shared (mutex-protected) input:
    */
-  int    nseq;			/* current number of seqs searched     */
+  int    nseq;			/* number of seqs handed out so far    */
 
-  /* Shared (mutex-protected) output:
+  /* Shared (mutex-protected) output, merged by each thread at its end:
    */
   struct histogram_s *hist;     /* histogram          */
   float          max_score;     /* maximum score seen */
@@ -115,12 +152,13 @@ struct workpool_s {
 };
 static void main_loop_threaded(struct plan7_s *hmm, int seed, int nsample, 
 			       float lenmean, float lensd, int fixedlen,
-			       int nthreads,
+			       int fastrng, int nthreads,
 			       struct histogram_s **ret_hist, float *ret_max,
 			       Stopwatch_t *twatch);
 static struct workpool_s *workpool_start(struct plan7_s *hmm, 
 				 float lenmean, float lensd, int fixedlen,
 				 float *randomseq, int nsample, 
+				 int seed, int fastrng,
 				 struct histogram_s *hist, 
 				 int num_threads);
 static void  workpool_stop(struct workpool_s *wpool);
@@ -183,6 +221,15 @@ main(int argc, char **argv)
   int   optind;		        /* index in argv[]                  */
 
   int   num_threads;            /* number of worker threads */   
+  int   fastrng;		/* TRUE to use ctr_sample()  */
+  int   seeded;			/* TRUE if --seed was given  */
+
+  char   *cachefile;		/* --cache file, or NULL           */
+  FILE   *cfp;			/* open for appending, or NULL     */
+  struct calcache_s *cache;	/* sorted calibrations read from it */
+  struct calcache_s *hit;	/* entry for this HMM, or NULL     */
+  int     ncache;		/* number of entries in cache      */
+  unsigned long long key;	/* calcache_key() of this HMM      */
 
 
   /***********************************************
@@ -199,7 +246,10 @@ main(int argc, char **argv)
   lensd        = 200.;
   seed         = (int) time ((time_t *) NULL);
   histfile     = NULL;
+  cachefile    = NULL;
+  seeded       = FALSE;
   do_pvm       = FALSE;
+  fastrng      = FALSE;
   pvm_lumpsize = 20;		/* 20 seqs/PVM exchange: sets granularity */
   mu_lumpsize  = 100;
 #ifdef HMMER_THREADS
@@ -211,14 +261,16 @@ main(int argc, char **argv)
   while (Getopt(argc, argv, OPTIONS, NOPTIONS, usage,
 		&optind, &optname, &optarg))
     {
-      if      (strcmp(optname, "--cpu")      == 0) num_threads  = atoi(optarg);
+      if      (strcmp(optname, "--cache")    == 0) cachefile    = optarg;
+      else if (strcmp(optname, "--cpu")      == 0) num_threads  = atoi(optarg);
+      else if (strcmp(optname, "--fastrng")  == 0) fastrng  = TRUE;
       else if (strcmp(optname, "--fixed")    == 0) fixedlen = atoi(optarg);
       else if (strcmp(optname, "--histfile") == 0) histfile = optarg;
       else if (strcmp(optname, "--mean")     == 0) lenmean  = atof(optarg); 
       else if (strcmp(optname, "--num")      == 0) nsample  = atoi(optarg); 
       else if (strcmp(optname, "--pvm")      == 0) do_pvm   = TRUE;
       else if (strcmp(optname, "--sd")       == 0) lensd    = atof(optarg); 
-      else if (strcmp(optname, "--seed")     == 0) seed     = atoi(optarg);
+      else if (strcmp(optname, "--seed")     == 0) { seed   = atoi(optarg); seeded = TRUE; }
       else if (strcmp(optname, "-h") == 0)
 	{
 	  HMMERBanner(stdout, banner);
@@ -234,6 +286,7 @@ main(int argc, char **argv)
 #ifndef HMMER_PVM
   if (do_pvm) Die("PVM support is not compiled into HMMER; --pvm doesn't work.");
 #endif
+  if (do_pvm && fastrng) Die("--fastrng doesn't work with --pvm");
 #ifndef HMMER_THREADS
   if (num_threads) Die("Posix threads support is not compiled into HMMER; --cpu doesn't have any effect");
 #endif
@@ -253,6 +306,16 @@ main(int argc, char **argv)
       Die("Failed to open histogram save file %s for writing\n", histfile);
   }
 
+				/* calibration cache */
+  cfp    = NULL;
+  cache  = NULL;
+  ncache = 0;
+  if (cachefile != NULL) {
+    cache = calcache_read(cachefile, &ncache);
+    if ((cfp = fopen(cachefile, "a")) == NULL)
+      Die("Failed to open calibration cache %s for writing\n", cachefile);
+  }
+
   /* Generate calibrated HMM(s) in a tmp file in the current
    * directory. When we're finished, we delete the original
    * HMM file and rename() this one. That way, the worst
@@ -288,8 +351,12 @@ main(int argc, char **argv)
   }
   printf("Number of samples:        %d\n", nsample);
   printf("random seed:              %d\n", seed);
+  if (fastrng)
+    printf("random numbers:           counter-based (--fastrng)\n");
   printf("histogram(s) saved to:    %s\n",
 	 histfile != NULL ? histfile : "[not saved]");
+  if (cachefile != NULL)
+    printf("calibration cache:        %s (%d entries)\n", cachefile, ncache);
   if (do_pvm)
     printf("PVM:                      ACTIVE\n");
   else if (num_threads > 0)
@@ -313,58 +380,92 @@ main(int argc, char **argv)
       if (hmm == NULL)
 	Die("HMM file may be corrupt or in incorrect format; parse failed");
 
-      if (! do_pvm && num_threads == 0)
-	main_loop_serial(hmm, seed, nsample, lenmean, lensd, fixedlen, 
-			 &hist, &max);
-#ifdef HMMER_PVM
-      else if (do_pvm) {
-	pvm_nslaves = 0;	/* solely to silence compiler warnings */
-	main_loop_pvm(hmm, seed, nsample, pvm_lumpsize, 
-		      lenmean, lensd, fixedlen, 
-		      &hist, &max, &extrawatch, &pvm_nslaves);
+      /* A model calibrated before with the same options is not
+       * simulated again. Without --seed the seed is left out of the
+       * key: any seed would do, so any earlier run's fit does too.
+       */
+      hist = NULL;
+      hit  = NULL;
+      key  = 0;			/* only used with cfp */
+      max  = 0.;		/* each path below sets it, or Die()s */
+      if (cfp != NULL) {
+	key = calcache_key(hmm, seed, seeded, nsample, lenmean, lensd,
+			   fixedlen, fastrng);
+	hit = calcache_find(cache, ncache, key);
       }
+
+      if (hit != NULL)
+	{
+	  mu[nhmm]     = hit->mu;
+	  lambda[nhmm] = hit->lambda;
+	  max          = hit->max;
+	}
+      else
+	{
+	  ROI_BEGIN();
+	  if (! do_pvm && num_threads == 0)
+	    main_loop_serial(hmm, seed, nsample, lenmean, lensd, fixedlen, fastrng,
+			     &hist, &max);
+#ifdef HMMER_PVM
+	  else if (do_pvm) {
+	    pvm_nslaves = 0;	/* solely to silence compiler warnings */
+	    main_loop_pvm(hmm, seed, nsample, pvm_lumpsize, 
+			  lenmean, lensd, fixedlen, 
+			  &hist, &max, &extrawatch, &pvm_nslaves);
+	  }
 #endif 
 #ifdef HMMER_THREADS
-      else if (num_threads > 0)
-	main_loop_threaded(hmm, seed, nsample, lenmean, lensd, fixedlen,
-			   num_threads, &hist, &max, &extrawatch);
+	  else if (num_threads > 0)
+	    main_loop_threaded(hmm, seed, nsample, lenmean, lensd, fixedlen,
+			       fastrng, num_threads, &hist, &max, &extrawatch);
 #endif
-      else 
-	Die("wait. that can't happen. I didn't do anything.");
-
+	  else 
+	    Die("wait. that can't happen. I didn't do anything.");
+
+
+	  /* Fit an EVD to the observed histogram.
+	   * The TRUE left-censors and fits only the right slope of the histogram.
+	   * The 9999. is an arbitrary high number that means we won't trim
+	   * outliers on the right.
+	   */
+	  if (! ExtremeValueFitHistogram(hist, TRUE, 9999.))
+	    Die("fit failed; --num may be set too small?\n");
+	  ROI_END();		/* one statistics dump per HMM */
+
+	  mu[nhmm]     = hist->param[EVD_MU];
+	  lambda[nhmm] = hist->param[EVD_LAMBDA];
+
+				/* %.9g gives the float back bit for bit */
+	  if (cfp != NULL) {
+	    fprintf(cfp, "%016llx %.9g %.9g %.9g %s\n", key,
+		    mu[nhmm], lambda[nhmm], max, hmm->name);
+	    if (fflush(cfp) != 0)
+	      Die("Failed to write calibration cache %s\n", cachefile);
+	  }
+	}
 
-      /* Fit an EVD to the observed histogram.
-       * The TRUE left-censors and fits only the right slope of the histogram.
-       * The 9999. is an arbitrary high number that means we won't trim
-       * outliers on the right.
+      /* Output
        */
-      if (! ExtremeValueFitHistogram(hist, TRUE, 9999.))
-	Die("fit failed; --num may be set too small?\n");
-      
-      mu[nhmm]     = hist->param[EVD_MU];
-      lambda[nhmm] = hist->param[EVD_LAMBDA];
+      printf("HMM    : %s\n",   hmm->name);
+      printf("mu     : %12f\n", mu[nhmm]);
+      printf("lambda : %12f\n", lambda[nhmm]);
+      printf("max    : %12f\n", max);
+      printf("//\n");
+
       nhmm++;
       if (nhmm % 100 == 0) {
 	mu     = ReallocOrDie(mu,     sizeof(float) * (nhmm+mu_lumpsize));
 	lambda = ReallocOrDie(lambda, sizeof(float) * (nhmm+mu_lumpsize));
       }      
 
-      /* Output
-       */
-      printf("HMM    : %s\n",   hmm->name);
-      printf("mu     : %12f\n", hist->param[EVD_MU]);
-      printf("lambda : %12f\n", hist->param[EVD_LAMBDA]);
-      printf("max    : %12f\n", max);
-      printf("//\n");
-
-      if (hfp != NULL) 
+      if (hfp != NULL && hist != NULL) 
 	{
 	  fprintf(hfp, "HMM: %s\n", hmm->name);
 	  PrintASCIIHistogram(hfp, hist);
 	  fprintf(hfp, "//\n");
 	}
 
-      FreeHistogram(hist);
+      if (hist != NULL) FreeHistogram(hist);
       FreePlan7(hmm);
     }
   SQD_DPRINTF1(("Main body believes it has calibrations for %d HMMs\n", nhmm));
@@ -446,6 +547,9 @@ main(int argc, char **argv)
   free(mu);
   free(lambda);
   if (hfp != NULL) fclose(hfp);
+  if (cfp != NULL && fclose(cfp) != 0)
+    Die("Failed to write calibration cache %s\n", cachefile);
+  if (cache != NULL) free(cache);
   SqdClean();
   return 0;
 }
@@ -463,6 +567,7 @@ main(int argc, char **argv)
  *           lenmean  - mean length of random sequence
  *           lensd    - std dev of random seq length
  *           fixedlen - if nonzero, override lenmean, always this len
+ *           fastrng  - TRUE to synthesize with ctr_sample()
  *           ret_hist - RETURN: the score histogram 
  *           ret_max  - RETURN: highest score seen in simulation
  *
@@ -471,16 +576,17 @@ main(int argc, char **argv)
  */
 static void
 main_loop_serial(struct plan7_s *hmm, int seed, int nsample, 
-		 float lenmean, float lensd, int fixedlen,
+		 float lenmean, float lensd, int fixedlen, int fastrng,
 		 struct histogram_s **ret_hist, float *ret_max)
 {
   struct histogram_s *hist;
   struct dpmatrix_s  *mx;
+  struct ralias_s     ralias;
   float  randomseq[MAXABET];
   float  p1;
   float  max;
-  char  *seq;
-  char  *dsq;
+  char  *dsq;			/* digitized random seq, reused      */
+  int    dsqlen;		/* dsq has room for dsqlen residues  */
   float  score;
   int    sqlen;
   int    idx;
@@ -492,37 +598,225 @@ main_loop_serial(struct plan7_s *hmm, int seed, int nsample,
   sre_srandom(seed);
   P7Logoddsify(hmm, TRUE);
   P7DefaultNullModel(randomseq, &p1);
+  SetResidueAlias(&ralias, randomseq);
   hist = AllocHistogram(-200, 200, 100);
   mx = CreatePlan7Matrix(1, hmm->M, 25, 0);
   max = -FLT_MAX;
+  dsqlen = 0;
+  dsq    = NULL;
 
   for (idx = 0; idx < nsample; idx++)
     {
+      if (fastrng) 
+	sqlen = ctr_sample(seed, idx, lenmean, lensd, fixedlen, &ralias, &dsq, &dsqlen);
+      else 
+	{
 				/* choose length of random sequence */
-      if (fixedlen) sqlen = fixedlen;
-      else do sqlen = (int) Gaussrandom(lenmean, lensd); while (sqlen < 1);
-				/* generate it */
-      seq = RandomSequence(Alphabet, randomseq, Alphabet_size, sqlen);
-      dsq = DigitizeSequence(seq, sqlen);
-
-      if (P7ViterbiSize(sqlen, hmm->M) <= RAMLIMIT)
-	score = P7Viterbi(dsq, sqlen, hmm, mx, NULL);
-      else
-	score = P7SmallViterbi(dsq, sqlen, hmm, mx, NULL);
+	  if (fixedlen) sqlen = fixedlen;
+	  else do sqlen = (int) Gaussrandom(lenmean, lensd); while (sqlen < 1);
+				/* generate it, growing dsq as needed */
+	  if (sqlen > dsqlen) {
+	    dsqlen = sqlen + 100;
+	    dsq    = ReallocOrDie(dsq, sizeof(char) * (dsqlen+2));
+	  }
+	  DigitizedRandomSequence(randomseq, sqlen, dsq);
+	}
+
+				/* score only: two DP rows, any length */
+      score = P7Viterbi(dsq, sqlen, hmm, mx, NULL);
 
       AddToHistogram(hist, score);
       if (score > max) max = score;
-
-      free(dsq); 
-      free(seq);
     }
 
+  free(dsq);
   FreePlan7Matrix(mx);
   *ret_hist   = hist;
   *ret_max    = max;
   return;
 }
 
+/* Function: ctr_sample()
+ * 
+ * Purpose:  Synthesize random sequence number idx for --fastrng:
+ *           its length and residues come from two counter-based
+ *           streams of (seed, idx), so it is the same sequence
+ *           whichever thread draws it, in whatever order.
+ *           
+ * Args:     seed     - random number seed
+ *           idx      - sample number, 0..nsample-1
+ *           lenmean  - mean length of random sequence
+ *           lensd    - std dev of random seq length
+ *           fixedlen - if nonzero, override lenmean, always this len
+ *           ra       - alias table of the residue distribution
+ *           dsq      - digitized sequence, grown as needed
+ *           dsqlen   - dsq has room for this many residues
+ *           
+ * Returns:  the length of the sequence.
+ */
+static int
+ctr_sample(int seed, int idx, float lenmean, float lensd, int fixedlen,
+	   struct ralias_s *ra, char **dsq, int *dsqlen)
+{
+  unsigned long long lkey, rkey; /* streams for the length, residues */
+  unsigned long long t;
+  int sqlen;
+
+  lkey = sre_ctr_random64((unsigned long long) seed, 2 * (unsigned long long) idx);
+  rkey = sre_ctr_random64((unsigned long long) seed, 2 * (unsigned long long) idx + 1);
+
+  if (fixedlen) sqlen = fixedlen;
+  else {
+    t = 0;
+    do sqlen = (int) CtrGaussrandom(lkey, t += 2, lenmean, lensd); while (sqlen < 1);
+  }
+  if (sqlen > *dsqlen) {
+    *dsqlen = sqlen + 100;
+    *dsq    = ReallocOrDie(*dsq, sizeof(char) * (*dsqlen+2));
+  }
+  DigitizedAliasSequence(ra, rkey, sqlen, *dsq);
+  return sqlen;
+}
+
+
+/* fnv1a(): fold n bytes at p into the FNV-1a hash h */
+static unsigned long long
+fnv1a(unsigned long long h, void *p, size_t n)
+{
+  unsigned char *c = (unsigned char *) p;
+
+  while (n-- > 0) {
+    h ^= *c++;
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+/* Function: calcache_key()
+ * 
+ * Purpose:  Hash what a calibration depends on: the alphabet, the
+ *           probability parameters P7Logoddsify() scores the model
+ *           from, and the options that shape the random sequences.
+ *           Annotation (name, comlog, the old mu and lambda...) is
+ *           left out, so recalibrating or renaming a model keeps
+ *           its key. The float parameters are hashed bit for bit.
+ *           
+ * Args:     hmm      - the HMM to calibrate, in probability form
+ *           seed     - random number seed
+ *           seeded   - TRUE if seed was set (--seed); else it's ignored
+ *           nsample  - number of seqs to synthesize
+ *           lenmean  - mean length of random sequence
+ *           lensd    - std dev of random seq length
+ *           fixedlen - if nonzero, override lenmean, always this len
+ *           fastrng  - TRUE to synthesize with ctr_sample()
+ *           
+ * Returns:  the 64-bit FNV-1a hash.
+ */
+static unsigned long long
+calcache_key(struct plan7_s *hmm, int seed, int seeded, int nsample,
+	     float lenmean, float lensd, int fixedlen, int fastrng)
+{
+  unsigned long long h = 14695981039346656037ULL;
+  int opt[6];
+  float len[2];
+  int k;
+
+  opt[0] = Alphabet_type;
+  opt[1] = hmm->M;
+  opt[2] = seeded ? seed : 0;
+  opt[3] = seeded;
+  opt[4] = nsample;
+  opt[5] = fastrng;
+  len[0] = fixedlen ? (float) fixedlen : lenmean;
+  len[1] = fixedlen ? 0. : lensd;
+  h = fnv1a(h, opt, sizeof(opt));
+  h = fnv1a(h, &fixedlen, sizeof(int));
+  h = fnv1a(h, len, sizeof(len));
+
+  for (k = 1; k < hmm->M; k++) {
+    h = fnv1a(h, hmm->t[k],   sizeof(float) * 7);
+    h = fnv1a(h, hmm->ins[k], sizeof(float) * Alphabet_size);
+  }
+  for (k = 1; k <= hmm->M; k++)
+    h = fnv1a(h, hmm->mat[k], sizeof(float) * Alphabet_size);
+  h = fnv1a(h, hmm->begin + 1, sizeof(float) * hmm->M);
+  h = fnv1a(h, hmm->end + 1,   sizeof(float) * hmm->M);
+  h = fnv1a(h, &(hmm->tbd1),   sizeof(float));
+  h = fnv1a(h, hmm->xt,        sizeof(hmm->xt));
+  h = fnv1a(h, hmm->null,      sizeof(float) * Alphabet_size);
+  h = fnv1a(h, &(hmm->p1),     sizeof(float));
+  return h;
+}
+
+/* calcache_cmp(): qsort()/bsearch() order of entries, by key */
+static int
+calcache_cmp(const void *a, const void *b)
+{
+  unsigned long long ka = ((const struct calcache_s *) a)->key;
+  unsigned long long kb = ((const struct calcache_s *) b)->key;
+
+  return (ka > kb) - (ka < kb);
+}
+
+/* Function: calcache_read()
+ * 
+ * Purpose:  Read the --cache file <file>, if there is one yet, into
+ *           an array sorted by key for calcache_find(). Lines that
+ *           don't parse (say, one cut short by a crash) are skipped.
+ *           
+ * Returns:  the array, or NULL if there are no entries; 
+ *           *ret_n is the number of entries. Caller frees.
+ */
+static struct calcache_s *
+calcache_read(char *file, int *ret_n)
+{
+  struct calcache_s *cache;
+  FILE *fp;
+  char *buf;
+  int   buflen;
+  int   n, nalloc;
+
+  *ret_n = 0;
+  if ((fp = fopen(file, "r")) == NULL) return NULL;
+
+  cache  = NULL;
+  buf    = NULL;
+  buflen = 0;
+  n      = nalloc = 0;
+  while (sre_fgets(&buf, &buflen, fp) != NULL)
+    {
+      if (n == nalloc) {
+	nalloc += 256;
+	cache   = ReallocOrDie(cache, sizeof(struct calcache_s) * nalloc);
+      }
+      if (sscanf(buf, "%llx %g %g %g", &(cache[n].key), &(cache[n].mu),
+		 &(cache[n].lambda), &(cache[n].max)) == 4)
+	n++;
+    }
+  if (buf != NULL) free(buf);
+  fclose(fp);
+
+  if (n > 1) qsort(cache, n, sizeof(struct calcache_s), calcache_cmp);
+  *ret_n = n;
+  return cache;
+}
+
+/* Function: calcache_find()
+ * 
+ * Purpose:  Look up key in the sorted cache of n entries.
+ *           
+ * Returns:  the entry, or NULL if key isn't there.
+ */
+static struct calcache_s *
+calcache_find(struct calcache_s *cache, int n, unsigned long long key)
+{
+  struct calcache_s probe;
+
+  if (n == 0) return NULL;
+  probe.key = key;
+  return bsearch(&probe, cache, n, sizeof(struct calcache_s), calcache_cmp);
+}
+
 
 #ifdef HMMER_THREADS
 /* Function: main_loop_threaded()
@@ -538,6 +832,7 @@ main_loop_serial(struct plan7_s *hmm, int seed, int nsample,
  *           lenmean  - mean length of random sequence
  *           lensd    - std dev of random seq length
  *           fixedlen - if nonzero, override lenmean, always this len
+ *           fastrng  - TRUE to synthesize with ctr_sample()
  *           nthreads - number of threads to start
  *           ret_hist - RETURN: the score histogram 
  *           ret_max  - RETURN: highest score seen in simulation
@@ -549,7 +844,7 @@ main_loop_serial(struct plan7_s *hmm, int seed, int nsample,
 static void
 main_loop_threaded(struct plan7_s *hmm, int seed, int nsample, 
 		   float lenmean, float lensd, int fixedlen,
-		   int nthreads,
+		   int fastrng, int nthreads,
 		   struct histogram_s **ret_hist, float *ret_max,
 		   Stopwatch_t *twatch)
 {
@@ -568,12 +863,14 @@ main_loop_threaded(struct plan7_s *hmm, int seed, int nsample,
   hist = AllocHistogram(-200, 200, 100);
 
   wpool = workpool_start(hmm, lenmean, lensd, fixedlen, randomseq, nsample,
-			 hist, nthreads);
+			 seed, fastrng, hist, nthreads);
   workpool_stop(wpool);
 
   *ret_hist = hist;
   *ret_max  = wpool->max_score;
+#ifndef SPEC_CPU
   StopwatchInclude(twatch, &(wpool->watch));
+#endif
 
   workpool_free(wpool);
   return;
@@ -602,6 +899,8 @@ main_loop_threaded(struct plan7_s *hmm, int seed, int nsample,
  *           lensd    - std. dev. for sequence length
  *           randomseq- i.i.d. frequencies for residues, 0..Alphabet_size-1
  *           nsample  - how many seqs to calibrate on
+ *           seed     - random number seed, for ctr_sample()
+ *           fastrng  - TRUE to synthesize with ctr_sample()
  *           hist     - histogram structure for storing results
  *           num_threads - how many processors to run on
  *
@@ -611,8 +910,8 @@ main_loop_threaded(struct plan7_s *hmm, int seed, int nsample,
  */
 static struct workpool_s *
 workpool_start(struct plan7_s *hmm, float lenmean, float lensd, int fixedlen,
-	       float *randomseq, int nsample, struct histogram_s *hist, 
-	       int num_threads)
+	       float *randomseq, int nsample, int seed, int fastrng,
+	       struct histogram_s *hist, int num_threads)
 {
   struct workpool_s *wpool;
   pthread_attr_t    attr;
@@ -627,13 +926,18 @@ workpool_start(struct plan7_s *hmm, float lenmean, float lensd, int fixedlen,
   wpool->lensd      = lensd;
   wpool->randomseq  = randomseq;
   wpool->nsample    = nsample;
+  wpool->seed       = seed;
+  wpool->fastrng    = fastrng;
+  SetResidueAlias(&(wpool->ralias), randomseq);
   
   wpool->nseq       = 0;
   wpool->hist       = hist;
   wpool->max_score  = -FLT_MAX;
   wpool->num_threads= num_threads;
 
+#ifndef SPEC_CPU
   StopwatchZero(&(wpool->watch));
+#endif
   
   if ((rtn = pthread_mutex_init(&(wpool->input_lock), NULL)) != 0)
     Die("pthread_mutex_init FAILED; %s\n", strerror(rtn));
@@ -728,78 +1032,97 @@ worker_thread(void *ptr)
   struct plan7_s    *hmm;
   struct dpmatrix_s *mx;
   struct workpool_s *wpool;
-  char       *seq;
-  char       *dsq;
-  int         len;
+  struct histogram_s *hist;	/* this thread's share of the histogram */
+  float       max;		/* this thread's maximum score */
+  char       *dsq[WORKPOOL_BATCH];	/* digitized random seqs, reused */
+  int         dsqlen[WORKPOOL_BATCH];	/* room in each, residues        */
+  int         len[WORKPOOL_BATCH];
+  int         nbatch;
+  int         idx0;		/* sample number of the batch's first */
   float       sc;
   int         rtn;
+  int         i;
+#ifndef SPEC_CPU
   Stopwatch_t thread_watch;
 
   StopwatchStart(&thread_watch);
+#endif
   wpool = (struct workpool_s *) ptr;
   hmm   = wpool->hmm;
   mx    = CreatePlan7Matrix(1, hmm->M, 25, 0);
+  hist  = AllocHistogram(-200, 200, 100);
+  max   = -FLT_MAX;
+  for (i = 0; i < WORKPOOL_BATCH; i++) {
+    dsq[i]    = NULL;
+    dsqlen[i] = 0;
+  }
   for (;;)
     {
-      /* 1. Synthesize a random sequence. 
+      /* 1. Synthesize a batch of random sequences. 
        *    The input sequence number is a shared resource,
        *    and sre_random() isn't thread-safe, so protect
-       *    the whole section with mutex.
+       *    the whole section with mutex. ctr_sample() is
+       *    thread-safe: then only the numbers are taken
+       *    under the lock.
        */
 				/* acquire a lock */
       if ((rtn = pthread_mutex_lock(&(wpool->input_lock))) != 0)
 	Die("pthread_mutex_lock failure: %s\n", strerror(rtn));
-				/* generate a sequence */
-      wpool->nseq++;
-      if (wpool->nseq > wpool->nsample) 
-	{ /* we're done; release input lock, break loop */
-	  if ((rtn = pthread_mutex_unlock(&(wpool->input_lock))) != 0)
-	    Die("pthread_mutex_unlock failure: %s\n", strerror(rtn));
-	  break;
+      nbatch = MIN(WORKPOOL_BATCH, wpool->nsample - wpool->nseq);
+      idx0   = wpool->nseq;
+      for (i = 0; ! wpool->fastrng && i < nbatch; i++)
+	{
+	  if (wpool->fixedlen) len[i] = wpool->fixedlen;
+	  else do len[i] = (int) Gaussrandom(wpool->lenmean, wpool->lensd); while (len[i] < 1);
+	  if (len[i] > dsqlen[i]) {
+	    dsqlen[i] = len[i] + 100;
+	    dsq[i]    = ReallocOrDie(dsq[i], sizeof(char) * (dsqlen[i]+2));
+	  }
+	  DigitizedRandomSequence(wpool->randomseq, len[i], dsq[i]);
 	}
-      if (wpool->fixedlen) len = wpool->fixedlen;
-      else do len = (int) Gaussrandom(wpool->lenmean, wpool->lensd); while (len < 1);
-      seq = RandomSequence(Alphabet, wpool->randomseq, Alphabet_size, len);
-
+      if (nbatch > 0) wpool->nseq += nbatch;
 				/* release the lock */
       if ((rtn = pthread_mutex_unlock(&(wpool->input_lock))) != 0)
 	Die("pthread_mutex_unlock failure: %s\n", strerror(rtn));
+      if (nbatch <= 0) break;	/* we're done */
+      for (i = 0; wpool->fastrng && i < nbatch; i++)
+	len[i] = ctr_sample(wpool->seed, idx0 + i, wpool->lenmean, wpool->lensd,
+			    wpool->fixedlen, &(wpool->ralias), &(dsq[i]), &(dsqlen[i]));
 
-      /* 2. Score the sequence against the model.
+      /* 2. Score the sequences against the model, into our
+       *    own histogram.
        */
-      dsq = DigitizeSequence(seq, len);
-      
-      if (P7ViterbiSize(len, hmm->M) <= RAMLIMIT)
-	sc = P7Viterbi(dsq, len, hmm, mx, NULL);
-      else
-	sc = P7SmallViterbi(dsq, len, hmm, mx, NULL);
-      free(dsq); 
-      free(seq);
-      
-      /* 3. Save the output; hist and max_score are shared,
-       *    so protect this section with the output mutex.
-       */
-				/* acquire lock on the output queue */
-      if ((rtn = pthread_mutex_lock(&(wpool->output_lock))) != 0)
-	Die("pthread_mutex_lock failure: %s\n", strerror(rtn));
-				/* save output */
-      AddToHistogram(wpool->hist, sc);
-      if (sc > wpool->max_score) wpool->max_score = sc;
-    				/* release our lock */
-      if ((rtn = pthread_mutex_unlock(&(wpool->output_lock))) != 0)
-	Die("pthread_mutex_unlock failure: %s\n", strerror(rtn));
+      for (i = 0; i < nbatch; i++)
+	{
+				/* score only: two DP rows, any length */
+	  sc = P7Viterbi(dsq[i], len[i], hmm, mx, NULL);
+
+	  AddToHistogram(hist, sc);
+	  if (sc > max) max = sc;
+	}
     }
 
+  /* 3. Save the output; hist and max_score are shared,
+   *    so protect this section with the output mutex.
+   */
+#ifndef SPEC_CPU
   StopwatchStop(&thread_watch);
+#endif
 				/* acquire lock on the output queue */
   if ((rtn = pthread_mutex_lock(&(wpool->output_lock))) != 0)
     Die("pthread_mutex_lock failure: %s\n", strerror(rtn));
+  MergeHistogram(wpool->hist, hist);
+  if (max > wpool->max_score) wpool->max_score = max;
+#ifndef SPEC_CPU
 				/* accumulate cpu time into main stopwatch */
   StopwatchInclude(&(wpool->watch), &thread_watch);
+#endif
     				/* release our lock */
   if ((rtn = pthread_mutex_unlock(&(wpool->output_lock))) != 0)
     Die("pthread_mutex_unlock failure: %s\n", strerror(rtn));
 
+  for (i = 0; i < WORKPOOL_BATCH; i++) free(dsq[i]);
+  FreeHistogram(hist);
   FreePlan7Matrix(mx);
   pthread_exit(NULL);
   return NULL; /* solely to silence compiler warnings */
@@ -14,6 +14,8 @@
  * Search a sequence database with a profile HMM.
  * Conditionally includes PVM parallelization when HMMER_PVM is defined
  *    at compile time; hmmsearch --pvm runs the PVM version.
+ * hmmsearch --all searches with every HMM in the HMM file, reading
+ *    the database only once (see search_all()).
  *
  * CVS $Id: hmmsearch.c,v 1.40 2003/04/14 16:00:17 eddy Exp $
  */
@@ -42,6 +44,14 @@
 extern int hmmcalibrate(int argc, char **argv);
 #endif
 
+/* Default --F1: P-value cutoff of the MSV prefilter; 1.0 turns
+ * the filter off. The SPEC command line takes no options, so
+ * builds that want the filter there set it with -DMSV_F1=0.02.
+ */
+#ifndef MSV_F1
+#define MSV_F1 1.0
+#endif
+
 static char banner[] = "hmmsearch - search a sequence database with a profile HMM";
 
 static char usage[]  = "\
@@ -55,6 +65,7 @@ Usage: hmmsearch [-options] <hmmfile> <sequence file or database>\n\
 ";
 
 static char experts[] = "\
+   --all          : search with every HMM in <hmmfile>, reading the db once\n\
    --compat       : make best effort to use last version's output style\n\
    --cpu <n>      : run <n> threads in parallel (if threaded)\n\
    --cut_ga       : use Pfam GA gathering threshold cutoffs\n\
@@ -62,6 +73,7 @@ static char experts[] = "\
    --cut_tc       : use Pfam TC trusted threshold cutoffs\n\
    --domE <x>     : sets domain Eval cutoff (2nd threshold) to <= x\n\
    --domT <x>     : sets domain T bit thresh (2nd threshold) to >= x\n\
+   --F1 <x>       : MSV prefilter: only Viterbi seqs with MSV P <= x\n\
    --forward      : use the full Forward() algorithm instead of Viterbi\n\
    --informat <s> : sequence file is in format <s>\n\
    --null2        : turn OFF the post hoc second null model\n\
@@ -75,6 +87,7 @@ static struct opt_s OPTIONS[] = {
   { "-E",        TRUE,  sqdARG_FLOAT},  
   { "-T",        TRUE,  sqdARG_FLOAT},  
   { "-Z",        TRUE,  sqdARG_INT  },
+  { "--all",     FALSE, sqdARG_NONE },
   { "--compat",  FALSE, sqdARG_NONE },
   { "--cpu",     FALSE, sqdARG_INT  },
   { "--cut_ga",  FALSE, sqdARG_NONE },
@@ -82,6 +95,7 @@ static struct opt_s OPTIONS[] = {
   { "--cut_tc",  FALSE, sqdARG_NONE },
   { "--domE",    FALSE, sqdARG_FLOAT},
   { "--domT",    FALSE, sqdARG_FLOAT},
+  { "--F1",      FALSE, sqdARG_FLOAT},
   { "--forward", FALSE, sqdARG_NONE },  
   { "--informat",FALSE, sqdARG_STRING},
   { "--null2",   FALSE, sqdARG_NONE },
@@ -92,6 +106,55 @@ static struct opt_s OPTIONS[] = {
 #define NOPTIONS (sizeof(OPTIONS) / sizeof(struct opt_s))
 
 
+/* The serial version reads SERIAL_BATCH seqs at a time and scores
+ * them together with P7ViterbiBatch(); a device (-DHMMER_GPU) 
+ * wants many more in flight.
+ */
+#ifdef HMMER_GPU
+#define SERIAL_BATCH 512
+#else
+#define SERIAL_BATCH 64
+#endif
+
+/* --all: the database, read and digitized once for all the models.
+ */
+struct targets_s {
+  int     nseq;			/* number of seqs (length 0 ones skipped) */
+  char  **dsq;			/* digitized seqs, 0..nseq-1              */
+  SQINFO *sqinfo;		/* their info; ss, sa already freed       */
+};
+
+/* --all: one model's search, and its results.
+ */
+struct modelsearch_s {
+  struct plan7_s      *hmm;	/* the model, in log-odds form          */
+  struct msvprofile_s *msv;	/* its MSV prefilter profile, or NULL   */
+  struct threshold_s   thresh;	/* thresholds, with its own autocuts    */
+  struct histogram_s  *hist;	/* score histogram                      */
+  struct tophit_s     *ghit;	/* per-seq hits                         */
+  struct tophit_s     *dhit;	/* domain hits                          */
+#ifdef HMMER_THREADS
+  pthread_mutex_t      lock;	/* protects hist, ghit and dhit         */
+#endif
+};
+
+static void print_thresholds(struct threshold_s *thresh);
+static void report_hits(struct plan7_s *hmm, struct threshold_s *thresh,
+			int Alimit, int be_backwards,
+			struct histogram_s *histogram, struct tophit_s *ghit,
+			struct tophit_s *dhit, int nseq);
+static void search_all(char *hmmfile, HMMFILE *hmmfp, char *seqfile, SQFILE *sqfp,
+		       struct threshold_s *thresh, int Alimit, int be_backwards,
+		       int do_forward, int do_null2, int do_xnu, int num_threads);
+static struct targets_s *read_targets(SQFILE *sqfp, int do_xnu);
+static void search_tile(struct modelsearch_s *ms, struct targets_s *db, int from,
+			struct dpmatrix_s *mx, int do_forward, int do_null2);
+static void main_loop_all_serial(struct modelsearch_s **order, int nmodels,
+				 struct targets_s *db, int do_forward, int do_null2);
+static void main_loop_all_threaded(struct modelsearch_s **order, int nmodels,
+				   struct targets_s *db, int do_forward, int do_null2,
+				   int num_threads);
+
 static void main_loop_serial(struct plan7_s *hmm, SQFILE *sqfp, struct threshold_s *thresh,
 			     int do_forward, int do_null2, int do_xnu, 
 			     struct histogram_s *histogram, struct tophit_s *ghit, 
@@ -109,8 +172,12 @@ static void main_loop_threaded(struct plan7_s *hmm, SQFILE *sqfp, struct thresho
 /* POSIX threads version:
  * the threads share a workpool_s structure amongst themselves,
  * for obtaining locks on input HMM file and output histogram and
- * tophits structures.
+ * tophits structures. A thread reads WORKPOOL_BATCH sequences per
+ * input lock, and keeps its own histogram, merged when it is done;
+ * only significant hits take the output lock.
  */
+#define WORKPOOL_BATCH 16
+
 struct workpool_s {
   /* Shared configuration resources which don't change:
    */
@@ -119,11 +186,12 @@ struct workpool_s {
   int    do_forward;		/* TRUE to score using Forward     */
   int    do_null2;		/* TRUE to apply null2 ad hoc correction */
   struct threshold_s *thresh;   /* score/evalue threshold info     */
+  struct msvprofile_s *msv;     /* MSV prefilter profile, or NULL  */
   
   /* Shared (mutex-protected) input resources:
    */
   SQFILE *sqfp;                 /* ptr to open sequence file      */
-  int nseq;			/* number of seqs searched so far */
+  int nseq;			/* number of seqs read so far     */
   pthread_mutex_t input_lock;   /* mutex for locking input        */
 
   /* Shared (mutex-protected) output resources:
@@ -146,6 +214,21 @@ static struct workpool_s *workpool_start(struct plan7_s *hmm, SQFILE *sqfp,
 static void  workpool_stop(struct workpool_s *wpool);
 static void  workpool_free(struct workpool_s *wpool);
 static void *worker_thread(void *ptr);
+
+/* The --all pool: workers take the next (model, batch) tile off a
+ * shared counter until all are done.
+ */
+struct allpool_s {
+  struct modelsearch_s **order;	/* models, largest M first        */
+  int    nmodels;
+  struct targets_s *db;		/* the database                   */
+  int    do_forward;
+  int    do_null2;
+  int    ntiles;		/* tiles per model                */
+  int    next;			/* next tile to hand out          */
+  pthread_mutex_t tile_lock;	/* protects next                  */
+};
+static void *all_worker_thread(void *ptr);
 #endif /* HMMER_THREADS */
 
 
@@ -158,29 +241,13 @@ main(int argc, char **argv)
   char    *seqfile;             /* file to read target sequence(s) from    */ 
   SQFILE   *sqfp;               /* opened seqfile for reading              */
   int       format;	        /* format of seqfile                       */
-  int       i; 
   struct plan7_s  *hmm;         /* HMM to search with                      */ 
   struct histogram_s *histogram;/* histogram of all scores                 */
-  struct fancyali_s *ali;       /* displayed alignment info                */ 
   struct tophit_s   *ghit;      /* list of top hits for whole sequences    */
   struct tophit_s   *dhit;	/* list of top hits for domains            */
 
-  float     sc;	        	/* score of an HMM search                  */
-  double  pvalue;		/* pvalue of an HMM score                  */
-  double  evalue;		/* evalue of an HMM score                  */
-  double  motherp;		/* pvalue of a whole seq HMM score         */
-  float   mothersc;		/* score of a whole seq parent of domain   */
-  int     sqfrom, sqto;		/* coordinates in sequence                 */
-  int     hmmfrom, hmmto;	/* coordinate in HMM                       */
-  char   *name, *desc;          /* hit sequence name and description       */
-  int     sqlen;		/* length of seq that was hit              */
   int     nseq;			/* number of sequences searched            */
   int     Z;			/* # of seqs for purposes of E-val calc    */
-  int     domidx;		/* number of this domain                   */
-  int     ndom;			/* total # of domains in this seq          */
-  int     namewidth;		/* max width of sequence name              */
-  int     descwidth;		/* max width of description */
-  int     nreported;		/* # of hits reported in a list            */
 
   int    Alimit;		/* A parameter limiting output alignments   */
   struct threshold_s thresh;    /* contains all threshold (cutoff) info     */
@@ -192,13 +259,14 @@ main(int argc, char **argv)
   int   do_forward;		/* TRUE to use Forward() not Viterbi()      */
   int   do_xnu;			/* TRUE to filter sequences thru XNU        */
   int   do_pvm;			/* TRUE to run on Parallel Virtual Machine  */
+  int   do_all;			/* TRUE to search with every HMM in hmmfile */
   int   be_backwards;		/* TRUE to be backwards-compatible in output*/
   int   num_threads;		/* number of worker threads                 */
   int   threads_support;	/* TRUE if threads support compiled in      */
   int   pvm_support;		/* TRUE if PVM support compiled in          */
 
 #ifdef SPEC_CPU
-  if (argc != 3) {
+  if (argc != 3 && !(argc == 4 && strcmp(argv[1], "--all") == 0)) {
     return hmmcalibrate (argc, argv);
   }
 #endif
@@ -212,6 +280,7 @@ main(int argc, char **argv)
   do_null2    = TRUE;
   do_xnu      = FALSE;
   do_pvm      = FALSE;  
+  do_all      = FALSE;
   Z           = 0;
   be_backwards= FALSE; 
 
@@ -233,6 +302,7 @@ main(int argc, char **argv)
   thresh.domE    = FLT_MAX;     /*   and no domain Eval threshold.    */
   thresh.autocut = CUT_NONE;	/*   and no Pfam cutoffs used         */
   thresh.Z       = 0;           /* Z not preset; use actual # of seqs */
+  thresh.F1      = MSV_F1;	/* MSV prefilter cutoff (1.0 = off)   */
 
   while (Getopt(argc, argv, OPTIONS, NOPTIONS, usage,
                 &optind, &optname, &optarg))  {
@@ -240,6 +310,7 @@ main(int argc, char **argv)
     else if (strcmp(optname, "-E") == 0)        thresh.globE   = atof(optarg);
     else if (strcmp(optname, "-T") == 0)        thresh.globT   = atof(optarg);
     else if (strcmp(optname, "-Z") == 0)        thresh.Z       = atoi(optarg);
+    else if (strcmp(optname, "--all")     == 0) do_all         = TRUE;
     else if (strcmp(optname, "--compat")  == 0) be_backwards   = TRUE;
     else if (strcmp(optname, "--cpu")     == 0) num_threads    = atoi(optarg);
     else if (strcmp(optname, "--cut_ga")  == 0) thresh.autocut = CUT_GA;
@@ -247,6 +318,7 @@ main(int argc, char **argv)
     else if (strcmp(optname, "--cut_tc")  == 0) thresh.autocut = CUT_TC;
     else if (strcmp(optname, "--domE")    == 0) thresh.domE    = atof(optarg);
     else if (strcmp(optname, "--domT")    == 0) thresh.domT    = atof(optarg);
+    else if (strcmp(optname, "--F1")      == 0) thresh.F1      = atof(optarg);
     else if (strcmp(optname, "--forward") == 0) do_forward     = TRUE;
     else if (strcmp(optname, "--null2")   == 0) do_null2       = FALSE;
     else if (strcmp(optname, "--pvm")     == 0) do_pvm         = TRUE;
@@ -273,6 +345,10 @@ main(int argc, char **argv)
     Die("PVM support is not compiled into your HMMER software; --pvm doesn't work.");
   if (num_threads && ! threads_support)
     Die("POSIX threads support is not compiled into HMMER; --cpu doesn't have any effect");
+  if (do_pvm && thresh.F1 < 1.0)
+    Die("The PVM slaves have no MSV prefilter; --F1 doesn't work with --pvm");
+  if (do_pvm && do_all)
+    Die("--all doesn't work with --pvm");
 
   /* Try to work around inability to autodetect from a pipe or .gz:
    * assume FASTA format
@@ -296,6 +372,14 @@ main(int argc, char **argv)
 
   if ((hmmfp = HMMFileOpen(hmmfile, "HMMERDB")) == NULL)
     Die("Failed to open HMM file %s\n%s", hmmfile, usage);
+  if (do_all) {
+    search_all(hmmfile, hmmfp, seqfile, sqfp, &thresh, Alimit, be_backwards,
+	       do_forward, do_null2, do_xnu, num_threads);
+    HMMFileClose(hmmfp);
+    SeqfileClose(sqfp);
+    SqdClean();
+    return 0;
+  }
   if (!HMMFileRead(hmmfp, &hmm)) 
     Die("Failed to read any HMMs from %s\n", hmmfile);
   if (hmm == NULL) 
@@ -323,31 +407,7 @@ main(int argc, char **argv)
   printf(   "Sequence database:          %s\n", seqfile); 
   if (do_pvm)
     printf( "PVM:                        ACTIVE\n");
-  printf(   "per-sequence score cutoff:  ");
-  if (thresh.globT == -FLT_MAX) printf("[none]\n");
-  else  {
-    printf(">= %.1f", thresh.globT);
-    if      (thresh.autocut == CUT_GA) printf(" [GA1]\n");
-    else if (thresh.autocut == CUT_NC) printf(" [NC1]\n");
-    else if (thresh.autocut == CUT_TC) printf(" [TC1]\n");
-    else                               printf("\n");
-  }
-  printf(   "per-domain score cutoff:    ");
-  if (thresh.domT == -FLT_MAX) printf("[none]\n");
-  else  {
-    printf(">= %.1f", thresh.domT);
-    if      (thresh.autocut == CUT_GA) printf(" [GA2]\n");
-    else if (thresh.autocut == CUT_NC) printf(" [NC2]\n");
-    else if (thresh.autocut == CUT_TC) printf(" [TC2]\n");
-    else                               printf("\n");
-  }
-  printf(   "per-sequence Eval cutoff:   ");
-  if (thresh.globE == FLT_MAX) printf("[none]\n");
-  else                  printf("<= %-10.2g\n", thresh.globE);
-    
-  printf(   "per-domain Eval cutoff:     ");
-  if (thresh.domE == FLT_MAX) printf("[none]\n");
-  else                 printf("<= %10.2g\n", thresh.domE);
+  print_thresholds(&thresh);
   printf("- - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -\n");
 
   /*********************************************** 
@@ -358,7 +418,10 @@ main(int argc, char **argv)
   histogram = AllocHistogram(-200, 200, 100);  /* keeps full histogram */
   ghit      = AllocTophits(200);         /* per-seq hits: 200=lumpsize */
   dhit      = AllocTophits(200);         /* domain hits:  200=lumpsize */
+  if (Alimit == 0 || (thresh.Z && Alimit > 0))
+    TophitsAliLimit(dhit, Alimit);       /* report_hits() shows no more */
 
+  ROI_BEGIN();
   if (pvm_support && do_pvm)
     main_loop_pvm(hmm, sqfp, &thresh, do_forward, do_null2, do_xnu, 
 		  histogram, ghit, dhit, &nseq);
@@ -368,18 +431,114 @@ main(int argc, char **argv)
   else
     main_loop_serial(hmm, sqfp, &thresh, do_forward, do_null2, do_xnu, 
 		     histogram, ghit, dhit, &nseq);
+  ROI_END();
 
   /*********************************************** 
    * Process hit lists, produce text output
    ***********************************************/
 
+  report_hits(hmm, &thresh, Alimit, be_backwards, histogram, ghit, dhit, nseq);
+
+printf("\nTotal sequences searched: %d\n", nseq); /*Kaivalya 6-11-03 */
+  /*********************************************** 
+   * Clean-up and exit.
+   ***********************************************/
+
+  FreeHistogram(histogram);
+  HMMFileClose(hmmfp);
+  SeqfileClose(sqfp);
+  FreeTophits(ghit);
+  FreeTophits(dhit);
+  FreePlan7(hmm);
+  SqdClean();
+
+  return 0;
+}
+
+
+/* Function: print_thresholds()
+ *
+ * Purpose:  The score and E-value cutoffs part of the banner.
+ */
+static void
+print_thresholds(struct threshold_s *thresh)
+{
+  printf(   "per-sequence score cutoff:  ");
+  if (thresh->globT == -FLT_MAX) printf("[none]\n");
+  else  {
+    printf(">= %.1f", thresh->globT);
+    if      (thresh->autocut == CUT_GA) printf(" [GA1]\n");
+    else if (thresh->autocut == CUT_NC) printf(" [NC1]\n");
+    else if (thresh->autocut == CUT_TC) printf(" [TC1]\n");
+    else                               printf("\n");
+  }
+  printf(   "per-domain score cutoff:    ");
+  if (thresh->domT == -FLT_MAX) printf("[none]\n");
+  else  {
+    printf(">= %.1f", thresh->domT);
+    if      (thresh->autocut == CUT_GA) printf(" [GA2]\n");
+    else if (thresh->autocut == CUT_NC) printf(" [NC2]\n");
+    else if (thresh->autocut == CUT_TC) printf(" [TC2]\n");
+    else                               printf("\n");
+  }
+  printf(   "per-sequence Eval cutoff:   ");
+  if (thresh->globE == FLT_MAX) printf("[none]\n");
+  else                  printf("<= %-10.2g\n", thresh->globE);
+    
+  printf(   "per-domain Eval cutoff:     ");
+  if (thresh->domE == FLT_MAX) printf("[none]\n");
+  else                 printf("<= %10.2g\n", thresh->domE);
+  if (thresh->F1 < 1.0)
+    printf( "MSV prefilter P cutoff:     <= %-10.2g\n", thresh->F1);
+}
+
+/* Function: report_hits()
+ *
+ * Purpose:  Report the results of searching one HMM against
+ *           the database: the ranked sequence and domain hits,
+ *           the alignments and (unless SPEC_CPU) the histogram.
+ *           Sets thresh->Z to nseq if it was not set.
+ *
+ * Args:     hmm          - the HMM that was searched with
+ *           thresh       - its thresholds
+ *           Alimit       - most domain alignments to show
+ *           be_backwards - TRUE for the last version's output style
+ *           histogram    - its score histogram
+ *           ghit         - its per-seq hits
+ *           dhit         - its domain hits
+ *           nseq         - number of seqs searched
+ *
+ * Returns:  (void)
+ */
+static void
+report_hits(struct plan7_s *hmm, struct threshold_s *thresh, int Alimit,
+	    int be_backwards, struct histogram_s *histogram,
+	    struct tophit_s *ghit, struct tophit_s *dhit, int nseq)
+{
+  struct fancyali_s *ali;       /* displayed alignment info                */ 
+  float   sc;	        	/* score of an HMM search                  */
+  double  pvalue;		/* pvalue of an HMM score                  */
+  double  evalue;		/* evalue of an HMM score                  */
+  double  motherp;		/* pvalue of a whole seq HMM score         */
+  float   mothersc;		/* score of a whole seq parent of domain   */
+  int     sqfrom, sqto;		/* coordinates in sequence                 */
+  int     hmmfrom, hmmto;	/* coordinate in HMM                       */
+  char   *name, *desc;          /* hit sequence name and description       */
+  int     sqlen;		/* length of seq that was hit              */
+  int     domidx;		/* number of this domain                   */
+  int     ndom;			/* total # of domains in this seq          */
+  int     namewidth;		/* max width of sequence name              */
+  int     descwidth;		/* max width of description */
+  int     nreported;		/* # of hits reported in a list            */
+  int     i;
+
   /* Set the theoretical EVD curve in our histogram using 
    * calibration in the HMM, if available. 
    */
   if (hmm->flags & PLAN7_STATS)
     ExtremeValueSetHistogram(histogram, hmm->mu, hmm->lambda, 
 			     histogram->lowscore, histogram->highscore, 0);
-  if (!thresh.Z) thresh.Z = nseq;		/* set Z for good now that we're done. */
+  if (!thresh->Z) thresh->Z = nseq;		/* set Z for good now that we're done. */
 
   /* Format and report our output 
    */
@@ -423,7 +582,7 @@ main(int argc, char **argv)
 		   NULL, NULL, NULL,               /* HMM positions      */
 		   NULL, &ndom,	                   /* domain info        */
 		   NULL);	                   /* alignment info     */
-      evalue = pvalue * (double) thresh.Z;
+      evalue = pvalue * (double) thresh->Z;
 
       /* safedesc is a workaround for an apparent Linux printf()
        * bug with the *.*s format. dbmalloc crashes with a memchr() ptr out of bounds
@@ -437,7 +596,7 @@ main(int argc, char **argv)
 	}
       else safedesc = Strdup(desc);
 
-      if (evalue <= thresh.globE && sc >= thresh.globT) {
+      if (evalue <= thresh->globE && sc >= thresh->globT) {
 	printf("%-*s %-*.*s %7.1f %10.2g %3d\n", 
 	       namewidth, name, 
 	       descwidth, descwidth, safedesc != NULL ? safedesc : "",
@@ -475,11 +634,11 @@ main(int argc, char **argv)
 		   &hmmfrom, &hmmto, NULL,            /* HMM position info  */
 		   &domidx, &ndom,                    /* domain info        */
 		   NULL);	                      /* alignment info     */
-      evalue = pvalue * (double) thresh.Z;
+      evalue = pvalue * (double) thresh->Z;
 
-      if (motherp * (double) thresh.Z > thresh.globE || mothersc < thresh.globT) 
+      if (motherp * (double) thresh->Z > thresh->globE || mothersc < thresh->globT) 
 	continue;
-      else if (evalue <= thresh.domE && sc >= thresh.domT) {
+      else if (evalue <= thresh->domE && sc >= thresh->domT) {
 	printf("%-*s %3d/%-3d %5d %5d %c%c %5d %5d %c%c %7.1f %8.2g\n",
 	       namewidth, name, 
 	       domidx, ndom,
@@ -513,11 +672,11 @@ main(int argc, char **argv)
 		       &hmmfrom, &hmmto, NULL,            /* HMM position info  */
 		       &domidx, &ndom,                    /* domain info        */
 		       &ali);	                      /* alignment info     */
-	  evalue = pvalue * (double) thresh.Z;
+	  evalue = pvalue * (double) thresh->Z;
 
-	  if (motherp * (double) thresh.Z > thresh.globE || mothersc < thresh.globT) 
+	  if (motherp * (double) thresh->Z > thresh->globE || mothersc < thresh->globT) 
 	    continue;
-	  else if (evalue <= thresh.domE && sc >= thresh.domT) 
+	  else if (evalue <= thresh->domE && sc >= thresh->domT) 
 	    {
 	      printf("%s: domain %d of %d, from %d to %d: score %.1f, E = %.2g\n", 
 		     name, domidx, ndom, sqfrom, sqto, sc, evalue);
@@ -548,26 +707,11 @@ main(int argc, char **argv)
    */
   printf("\nTotal sequences searched: %d\n", nseq);
   printf("\nWhole sequence top hits:\n");
-  TophitsReport(ghit, thresh.globE, nseq);
+  TophitsReport(ghit, thresh->globE, nseq);
   printf("\nDomain top hits:\n");
-  TophitsReport(dhit, thresh.domE, nseq);
+  TophitsReport(dhit, thresh->domE, nseq);
 /*  #endif   Kaivalya turn on later */
 #endif
-
-printf("\nTotal sequences searched: %d\n", nseq); /*Kaivalya 6-11-03 */
-  /*********************************************** 
-   * Clean-up and exit.
-   ***********************************************/
-
-  FreeHistogram(histogram);
-  HMMFileClose(hmmfp);
-  SeqfileClose(sqfp);
-  FreeTophits(ghit);
-  FreeTophits(dhit);
-  FreePlan7(hmm);
-  SqdClean();
-
-  return 0;
 }
 
 
@@ -583,7 +727,10 @@ printf("\nTotal sequences searched: %d\n", nseq); /*Kaivalya 6-11-03 */
  *
  * Args:     hmm        - the HMM to search with. 
  *           sqfp       - open SQFILE for sequence database
- *           thresh     - score/evalue threshold info
+ *           thresh     - score/evalue threshold info; thresh->F1 < 1
+ *                        runs the MSV prefilter, and seqs it rejects
+ *                        are counted in nseq but not scored or
+ *                        added to the histogram
  *           do_forward - TRUE to score using Forward()        
  *           do_null2   - TRUE to use ad hoc null2 score correction
  *           do_xnu     - TRUE to apply XNU mask
@@ -592,6 +739,10 @@ printf("\nTotal sequences searched: %d\n", nseq); /*Kaivalya 6-11-03 */
  *           dhit       - RETURN: ranked domain scores
  *           ret_nseq   - RETURN: actual number of seqs searched
  *           
+ *           Viterbi scores are computed SERIAL_BATCH seqs at a
+ *           time by P7ViterbiBatch(); traces, only for the
+ *           significant hits.
+ *
  * Returns:  (void)
  */
 static void
@@ -601,89 +752,149 @@ main_loop_serial(struct plan7_s *hmm, SQFILE *sqfp, struct threshold_s *thresh,
 		 struct tophit_s *ghit, struct tophit_s *dhit, int *ret_nseq)
 {
   struct dpmatrix_s *mx;        /* DP matrix, growable                     */
+  struct msvprofile_s *msv;     /* MSV prefilter profile, or NULL          */
   struct p7trace_s *tr;         /* traceback                               */
-  char   *seq;                  /* target sequence                         */
-  char   *dsq;		        /* digitized target sequence               */
-  SQINFO sqinfo;		/* optional info for seq                   */
+  char   *seq[SERIAL_BATCH];    /* target sequences                        */
+  char   *dsq[SERIAL_BATCH];    /* digitized target sequences              */
+  SQINFO sqinfo[SERIAL_BATCH];	/* optional info for seqs                  */
+  int    ord[SERIAL_BATCH];     /* number of each seq, 1..                 */
+  float  bsc[SERIAL_BATCH];     /* Viterbi scores of the batched ones      */
+  char  *vdsq[SERIAL_BATCH];    /* the batched ones: seqs, lengths, index  */
+  int    vlen[SERIAL_BATCH];
+  int    vidx[SERIAL_BATCH];
+  int    nbatch;                /* number of seqs in this batch            */
+  int    nv;                    /* number of them scored by the batch      */
+  int    more;                  /* TRUE while the database lasts           */
+  int    batched;               /* TRUE if seq i was scored by the batch   */
   float  sc;	        	/* score of an HMM search                  */
   double pvalue;		/* pvalue of an HMM score                  */
   double evalue;		/* evalue of an HMM score                  */
   int    nseq;			/* number of sequences searched            */
+  int    i, v;
  
   /* Create a DP matrix; initially only two rows big, but growable;
    * we overalloc by 25 rows (L dimension) when we grow; not growable
    * in model dimension, since we know the hmm size
    */
   mx = CreatePlan7Matrix(1, hmm->M, 25, 0); 
+  msv = thresh->F1 < 1.0 ? CreateMSVProfile(hmm) : NULL;
 
   nseq = 0;
-  while (ReadSeq(sqfp, sqfp->format, &seq, &sqinfo))
+  more = TRUE;
+  while (more)
     {
-      /* Silently skip length 0 seqs. 
-       * What, you think this doesn't occur? Welcome to genomics, 
-       * young grasshopper.
-       */
-      if (sqinfo.len == 0) continue;
-
-      nseq++;
-      dsq = DigitizeSequence(seq, sqinfo.len);
-      
-      if (do_xnu && Alphabet_type == hmmAMINO) XNU(dsq, sqinfo.len);
-      
-      /* 1. Recover a trace by Viterbi.
-       *    In extreme cases, the alignment may be literally impossible;
-       *    in which case, the score comes out ridiculously small (but not
-       *    necessarily <= -INFTY, because we're not terribly careful
-       *    about underflow issues), and tr will be returned as NULL.
+      /* 0. Read the next SERIAL_BATCH seqs that pass the MSV
+       *    prefilter, skipping length 0 seqs silently.
+       *    What, you think this doesn't occur? Welcome to genomics, 
+       *    young grasshopper.
        */
-      if (P7ViterbiSize(sqinfo.len, hmm->M) <= RAMLIMIT)
-	sc = P7Viterbi(dsq, sqinfo.len, hmm, mx, &tr);
-      else
-	sc = P7SmallViterbi(dsq, sqinfo.len, hmm, mx, &tr);
+      nbatch = 0;
+      while (nbatch < SERIAL_BATCH && 
+	     (more = ReadSeq(sqfp, sqfp->format, &seq[nbatch], &sqinfo[nbatch])))
+	{
+	  i = nbatch;
+	  if (sqinfo[i].len == 0) { FreeSequence(seq[i], &sqinfo[i]); continue; }
+
+	  ord[i] = ++nseq;
+	  dsq[i] = DigitizeSequence(seq[i], sqinfo[i].len);
+	  if (do_xnu && Alphabet_type == hmmAMINO) XNU(dsq[i], sqinfo[i].len);
+
+	  /* most targets are not homologs, and an ungapped byte score
+	   * is enough to tell.
+	   */
+	  if (msv != NULL &&
+	      MSVPValue(msv, MSVFilter(dsq[i], sqinfo[i].len, msv)) > thresh->F1)
+	    {
+	      FreeSequence(seq[i], &sqinfo[i]);
+	      free(dsq[i]);
+	      continue;
+	    }
+	  nbatch++;
+	}
 
-      /* 2. If we're using Forward scores, calculate the
-       *    whole sequence score; this overrides anything
-       *    PostprocessSignificantHit() is going to do to the per-seq score.
+      /* 1. Viterbi scores of the whole batch at once, across
+       *    sequences (P7ViterbiBatch()); only Forward scoring and
+       *    seqs too long for a full matrix go one at a time.
        */
-      if (do_forward) {
-	sc  = P7Forward(dsq, sqinfo.len, hmm, NULL);
-	if (do_null2)   sc -= TraceScoreCorrection(hmm, tr, dsq); 
-      }
-
+      nv = 0;
+      if (! do_forward)
+	for (i = 0; i < nbatch; i++)
+	  if (P7ViterbiSize(sqinfo[i].len, hmm->M) <= RAMLIMIT) {
+	    vdsq[nv] = dsq[i];
+	    vlen[nv] = sqinfo[i].len;
+	    vidx[nv] = i;
+	    nv++;
+	  }
+      if (nv > 0) P7ViterbiBatch(vdsq, vlen, nv, hmm, bsc);
+
+      for (i = 0, v = 0; i < nbatch; i++)
+	{
+	  /* 2. The score, and a trace for the seqs that need one.
+	   *    In extreme cases, the alignment may be literally impossible;
+	   *    in which case, the score comes out ridiculously small (but not
+	   *    necessarily <= -INFTY, because we're not terribly careful
+	   *    about underflow issues), and tr will be returned as NULL.
+	   */
+	  tr      = NULL;
+	  batched = (v < nv && vidx[v] == i);
+	  if (batched)
+	    sc = bsc[v++];
+	  else
+	    {
+	      if (P7ViterbiSize(sqinfo[i].len, hmm->M) <= RAMLIMIT)
+		sc = P7Viterbi(dsq[i], sqinfo[i].len, hmm, mx, &tr);
+	      else
+		sc = P7SmallViterbi(dsq[i], sqinfo[i].len, hmm, mx, &tr);
+
+	      /* If we're using Forward scores, calculate the
+	       * whole sequence score; this overrides anything
+	       * PostprocessSignificantHit() is going to do to the per-seq score.
+	       */
+	      if (do_forward) {
+		sc  = P7Forward(dsq[i], sqinfo[i].len, hmm, NULL);
+		if (do_null2)   sc -= TraceScoreCorrection(hmm, tr, dsq[i]); 
+	      }
 #if DEBUGLEVEL >= 2
-      P7PrintTrace(stdout, tr, hmm, dsq); 
+	      P7PrintTrace(stdout, tr, hmm, dsq[i]); 
 #endif
+	    }
 
-      /* 2. Store score/pvalue for global alignment; will sort on score,
-       *    which in hmmsearch is monotonic with E-value. 
-       *    Keep all domains in a significant sequence hit.
-       *    We can only make a lower bound estimate of E-value since
-       *    we don't know the final value of nseq yet, so the list
-       *    of hits we keep in memory is >= the list we actually
-       *    output. 
-       */
-      pvalue = PValue(hmm, sc);
-      evalue = thresh->Z ? (double) thresh->Z * pvalue : (double) nseq * pvalue;
-      if (sc >= thresh->globT && evalue <= thresh->globE) 
-	{
-	  sc = PostprocessSignificantHit(ghit, dhit, 
-					 tr, hmm, dsq, sqinfo.len,
-					 sqinfo.name, 
-					 sqinfo.flags & SQINFO_ACC  ? sqinfo.acc  : NULL, 
-					 sqinfo.flags & SQINFO_DESC ? sqinfo.desc : NULL, 
-					 do_forward, sc,
-					 do_null2,
-					 thresh,
-					 FALSE); /* FALSE-> not hmmpfam mode, hmmsearch mode */
+	  /* 3. Store score/pvalue for global alignment; will sort on score,
+	   *    which in hmmsearch is monotonic with E-value. 
+	   *    Keep all domains in a significant sequence hit.
+	   *    We can only make a lower bound estimate of E-value since
+	   *    we don't know the final value of nseq yet, so the list
+	   *    of hits we keep in memory is >= the list we actually
+	   *    output. A batched hit gets its trace now, from the
+	   *    same Viterbi.
+	   */
+	  pvalue = PValue(hmm, sc);
+	  evalue = thresh->Z ? (double) thresh->Z * pvalue : (double) ord[i] * pvalue;
+	  if (sc >= thresh->globT && evalue <= thresh->globE) 
+	    {
+	      if (batched)
+		P7Viterbi(dsq[i], sqinfo[i].len, hmm, mx, &tr);
+	      sc = PostprocessSignificantHit(ghit, dhit, 
+					     tr, hmm, dsq[i], sqinfo[i].len,
+					     sqinfo[i].name, 
+					     sqinfo[i].flags & SQINFO_ACC  ? sqinfo[i].acc  : NULL, 
+					     sqinfo[i].flags & SQINFO_DESC ? sqinfo[i].desc : NULL, 
+					     ord[i],
+					     do_forward, sc,
+					     do_null2,
+					     thresh,
+					     FALSE); /* FALSE-> not hmmpfam mode, hmmsearch mode */
+	    }
+	  SQD_DPRINTF2(("AddToHistogram: %s\t%f\n", sqinfo[i].name, sc));
+	  AddToHistogram(histogram, sc);
+	  FreeSequence(seq[i], &sqinfo[i]); 
+	  P7FreeTrace(tr);
+	  free(dsq[i]);
 	}
-      SQD_DPRINTF2(("AddToHistogram: %s\t%f\n", sqinfo.name, sc));
-      AddToHistogram(histogram, sc);
-      FreeSequence(seq, &sqinfo); 
-      P7FreeTrace(tr);
-      free(dsq);
     }
 
   FreePlan7Matrix(mx);
+  if (msv != NULL) FreeMSVProfile(msv);
   *ret_nseq = nseq;
   return;
 }
@@ -736,6 +947,7 @@ main_loop_pvm(struct plan7_s *hmm, SQFILE *sqfp, struct threshold_s *thresh, int
   char **acclist ;              /* remember what seq accessions slaves are doing */
   char **desclist;              /* remember what seq desc's slaves are doing */
   int   *lenlist;               /* remember lengths of seqs slaves are doing */
+  int   *ordlist;               /* remember numbers of seqs slaves are doing */
   int    slaveidx;		/* counter for slaves */
   float  sc;			/* score of an alignment */
   double pvalue;		/* P-value of a score of an alignment */
@@ -780,6 +992,7 @@ main_loop_pvm(struct plan7_s *hmm, SQFILE *sqfp, struct threshold_s *thresh, int
   desclist = MallocOrDie(sizeof(char *) * nslaves);
   dsqlist  = MallocOrDie(sizeof(char *) * nslaves);
   lenlist  = MallocOrDie(sizeof(int) * nslaves);
+  ordlist  = MallocOrDie(sizeof(int) * nslaves);
 
   /* Load the slaves.
    * Give them all a sequence number and a digitized sequence
@@ -806,6 +1019,7 @@ main_loop_pvm(struct plan7_s *hmm, SQFILE *sqfp, struct threshold_s *thresh, int
       acclist[nseq]  = (sqinfo.flags & SQINFO_ACC)  ? Strdup(sqinfo.acc)  : NULL;
       desclist[nseq] = (sqinfo.flags & SQINFO_DESC) ? Strdup(sqinfo.desc) : NULL;
       lenlist[nseq]  = sqinfo.len;
+      ordlist[nseq]  = nseq;
       dsqlist[nseq]  = dsq;
 
       FreeSequence(seq, &sqinfo);
@@ -847,6 +1061,7 @@ main_loop_pvm(struct plan7_s *hmm, SQFILE *sqfp, struct threshold_s *thresh, int
 	  sc = PostprocessSignificantHit(ghit, dhit, 
 					 tr, hmm, dsqlist[slaveidx], lenlist[slaveidx],
 					 namelist[slaveidx], acclist[slaveidx], desclist[slaveidx],
+					 ordlist[slaveidx],
 					 do_forward, sc,
 					 do_null2,
 					 thresh,
@@ -866,6 +1081,7 @@ main_loop_pvm(struct plan7_s *hmm, SQFILE *sqfp, struct threshold_s *thresh, int
       acclist[slaveidx]  = (sqinfo.flags & SQINFO_ACC)  ? Strdup(sqinfo.acc)  : NULL;
       desclist[slaveidx] = (sqinfo.flags & SQINFO_DESC) ? Strdup(sqinfo.desc) : NULL;
       lenlist[slaveidx]  = sqinfo.len;
+      ordlist[slaveidx]  = nseq;
 
       FreeSequence(seq, &sqinfo); 
     }
@@ -892,6 +1108,7 @@ main_loop_pvm(struct plan7_s *hmm, SQFILE *sqfp, struct threshold_s *thresh, int
 	  sc = PostprocessSignificantHit(ghit, dhit, 
 					 tr, hmm, dsqlist[slaveidx], lenlist[slaveidx],
 					 namelist[slaveidx], acclist[slaveidx], desclist[slaveidx],
+					 ordlist[slaveidx],
 					 do_forward, sc,
 					 do_null2,
 					 thresh,
@@ -923,6 +1140,7 @@ main_loop_pvm(struct plan7_s *hmm, SQFILE *sqfp, struct threshold_s *thresh, int
   free(acclist);
   free(desclist);
   free(lenlist);
+  free(ordlist);
   pvm_exit();
   *ret_nseq = nseq;
   return;
@@ -1028,6 +1246,7 @@ workpool_start(struct plan7_s *hmm, SQFILE *sqfp, int do_xnu,
   wpool->do_forward = do_forward;
   wpool->do_null2   = do_null2;
   wpool->thresh     = thresh;
+  wpool->msv        = thresh->F1 < 1.0 ? CreateMSVProfile(hmm) : NULL;
 
   wpool->sqfp       = sqfp;
   wpool->nseq       = 0;
@@ -1097,6 +1316,7 @@ workpool_stop(struct workpool_s *wpool)
 static void
 workpool_free(struct workpool_s *wpool)
 {
+  if (wpool->msv != NULL) FreeMSVProfile(wpool->msv);
   free(wpool->thread);
   free(wpool);
   return;
@@ -1117,94 +1337,143 @@ void *
 worker_thread(void *ptr)
 {
   struct workpool_s *wpool;     /* our working threads structure   */
-  char  *seq;                   /* target sequence                 */
-  SQINFO sqinfo;		/* information assoc w/ seq        */
+  char  *seq[WORKPOOL_BATCH];   /* target sequences                */
+  SQINFO sqinfo[WORKPOOL_BATCH];/* information assoc w/ seqs       */
+  int    nbatch;		/* number of seqs in this batch    */
+  int    nseq;			/* number of the first one, 1..    */
   char  *dsq;                   /* digitized sequence              */
   struct dpmatrix_s *mx;        /* growable DP matrix              */
+  struct histogram_s *hist;     /* this thread's histogram         */
+  struct tophit_s *ghit;        /* this thread's per-seq hits      */
+  struct tophit_s *dhit;        /* this thread's domain hits       */
   struct p7trace_s  *tr;        /* traceback from an alignment     */
   float  sc;			/* score of an alignment           */
   int    rtn;			/* a return code from pthreads lib */
   double pvalue;		/* P-value of score                */
   double evalue;		/* E-value of score                */
+  int    i;
 
   wpool = (struct workpool_s *) ptr;
 
   /* Init with a small DP matrix; we'll grow in the sequence dimension
    * overalloc'ing by 25 rows (residues).
    */
-  mx = CreatePlan7Matrix(1, wpool->hmm->M, 25, 0);
+  mx   = CreatePlan7Matrix(1, wpool->hmm->M, 25, 0);
+  hist = AllocHistogram(-200, 200, 100);
+  ghit = AllocTophits(200);
+  dhit = AllocTophits(200);
+  if (wpool->dhit->alimit >= 0) TophitsAliLimit(dhit, wpool->dhit->alimit);
   for (;;) {
 
     /* 1. acquire lock on sequence input, and get
-     *    the next seq to work on.
+     *    the next batch of seqs to work on.
+     *    Length 0 seqs are silently skipped, as in main_loop_serial().
      */
 				/* acquire a lock */
     if ((rtn = pthread_mutex_lock(&(wpool->input_lock))) != 0)
       Die("pthread_mutex_lock failure: %s\n", strerror(rtn));
-    if (! ReadSeq(wpool->sqfp, wpool->sqfp->format, &seq, &sqinfo))
-      {	/* we're done. release lock, exit thread */
-	if ((rtn = pthread_mutex_unlock(&(wpool->input_lock))) != 0)
-	  Die("pthread_mutex_unlock failure: %s\n", strerror(rtn));
-	FreePlan7Matrix(mx);
-	pthread_exit(NULL);
+    nbatch = 0;
+    while (nbatch < WORKPOOL_BATCH &&
+	   ReadSeq(wpool->sqfp, wpool->sqfp->format, &seq[nbatch], &sqinfo[nbatch]))
+      {
+	if (sqinfo[nbatch].len == 0) FreeSequence(seq[nbatch], &sqinfo[nbatch]);
+	else                         nbatch++;
       }
-    SQD_DPRINTF1(("a thread is working on %s\n", sqinfo.name));
-    wpool->nseq++;
+    nseq         = wpool->nseq + 1;
+    wpool->nseq += nbatch;
 				/* release the lock */
     if ((rtn = pthread_mutex_unlock(&(wpool->input_lock))) != 0)
       Die("pthread_mutex_unlock failure: %s\n", strerror(rtn));
+    if (nbatch == 0) break;	/* we're done */
 
-    if (sqinfo.len == 0) continue; /* silent skip of len=0 seqs (wormpep!?!) */
+    for (i = 0; i < nbatch; i++, nseq++) {
+      SQD_DPRINTF1(("a thread is working on %s\n", sqinfo[i].name));
+      dsq = DigitizeSequence(seq[i], sqinfo[i].len);
+      if (wpool->do_xnu) XNU(dsq, sqinfo[i].len);
 
-    dsq = DigitizeSequence(seq, sqinfo.len);
-    if (wpool->do_xnu) XNU(dsq, sqinfo.len);
+      /* 0. The MSV prefilter; the profile is read-only, so shared.
+       */
+      if (wpool->msv != NULL &&
+	  MSVPValue(wpool->msv, MSVFilter(dsq, sqinfo[i].len, wpool->msv)) > wpool->thresh->F1)
+	{
+	  FreeSequence(seq[i], &sqinfo[i]);
+	  free(dsq);
+	  continue;
+	}
       
-    /* 1. Recover a trace by Viterbi.
-     */
-    if (P7ViterbiSize(sqinfo.len, wpool->hmm->M) <= RAMLIMIT)
-      sc = P7Viterbi(dsq, sqinfo.len, wpool->hmm, mx, &tr);
-    else
-      sc = P7SmallViterbi(dsq, sqinfo.len, wpool->hmm, mx, &tr);
-
-    /* 2. If we're using Forward scores, do another DP
-     *    to get it; else, we already have a Viterbi score
-     *    in sc.
-     */
-    if (wpool->do_forward) {
-      sc  = P7Forward(dsq, sqinfo.len, wpool->hmm, NULL);
-      if (wpool->do_null2) sc -= TraceScoreCorrection(wpool->hmm, tr, dsq);
-    }
+      /* 1. Recover a trace by Viterbi.
+       */
+      if (P7ViterbiSize(sqinfo[i].len, wpool->hmm->M) <= RAMLIMIT)
+	sc = P7Viterbi(dsq, sqinfo[i].len, wpool->hmm, mx, &tr);
+      else
+	sc = P7SmallViterbi(dsq, sqinfo[i].len, wpool->hmm, mx, &tr);
 
-    /* 3. Save the output in tophits and histogram structures, after acquiring a lock
-     */
-    if ((rtn = pthread_mutex_lock(&(wpool->output_lock))) != 0)
-      Die("pthread_mutex_lock failure: %s\n", strerror(rtn));
-    SQD_DPRINTF1(("seq %s scores %f\n", sqinfo.name, sc));
+      /* 2. If we're using Forward scores, do another DP
+       *    to get it; else, we already have a Viterbi score
+       *    in sc.
+       */
+      if (wpool->do_forward) {
+	sc  = P7Forward(dsq, sqinfo[i].len, wpool->hmm, NULL);
+	if (wpool->do_null2) sc -= TraceScoreCorrection(wpool->hmm, tr, dsq);
+      }
+      SQD_DPRINTF1(("seq %s scores %f\n", sqinfo[i].name, sc));
 
-    pvalue = PValue(wpool->hmm, sc);
-    evalue = wpool->thresh->Z ? (double) wpool->thresh->Z * pvalue : (double) wpool->nseq * pvalue;
+      /* 3. Save significant hits in our own tophits, moved to
+       *    the shared ones after each batch; the E-value bound uses
+       *    this seq's own number, as the serial loop does.
+       */
+      pvalue = PValue(wpool->hmm, sc);
+      evalue = wpool->thresh->Z ? (double) wpool->thresh->Z * pvalue : (double) nseq * pvalue;
  
-    if (sc >= wpool->thresh->globT && evalue <= wpool->thresh->globE) 
-      { 
-	sc = PostprocessSignificantHit(wpool->ghit, wpool->dhit, 
-				       tr, wpool->hmm, dsq, sqinfo.len,
-				       sqinfo.name, 
-				       sqinfo.flags & SQINFO_ACC  ? sqinfo.acc  : NULL, 
-				       sqinfo.flags & SQINFO_DESC ? sqinfo.desc : NULL, 
-				       wpool->do_forward, sc,
-				       wpool->do_null2,
-				       wpool->thresh,
-				       FALSE); /* FALSE-> not hmmpfam mode, hmmsearch mode */
-      }
-    SQD_DPRINTF2(("AddToHistogram: %s\t%f\n", sqinfo.name, sc));
-    AddToHistogram(wpool->hist, sc);
-    if ((rtn = pthread_mutex_unlock(&(wpool->output_lock))) != 0)
-      Die("pthread_mutex_unlock failure: %s\n", strerror(rtn));
+      if (sc >= wpool->thresh->globT && evalue <= wpool->thresh->globE) 
+	{ 
+	  sc = PostprocessSignificantHit(ghit, dhit, 
+					 tr, wpool->hmm, dsq, sqinfo[i].len,
+					 sqinfo[i].name, 
+					 sqinfo[i].flags & SQINFO_ACC  ? sqinfo[i].acc  : NULL, 
+					 sqinfo[i].flags & SQINFO_DESC ? sqinfo[i].desc : NULL, 
+					 nseq,
+					 wpool->do_forward, sc,
+					 wpool->do_null2,
+					 wpool->thresh,
+					 FALSE); /* FALSE-> not hmmpfam mode, hmmsearch mode */
+	}
+      SQD_DPRINTF2(("AddToHistogram: %s\t%f\n", sqinfo[i].name, sc));
+      AddToHistogram(hist, sc);
 
-    P7FreeTrace(tr);
-    FreeSequence(seq, &sqinfo);
-    free(dsq);
+      P7FreeTrace(tr);
+      FreeSequence(seq[i], &sqinfo[i]);
+      free(dsq);
+    }
+
+    /* 4. Hand the batch's hits over, under one lock; batch by
+     *    batch, so they keep about the order of the database.
+     */
+    if (ghit->num > 0 || dhit->num > 0)
+      {
+	if ((rtn = pthread_mutex_lock(&(wpool->output_lock))) != 0)
+	  Die("pthread_mutex_lock failure: %s\n", strerror(rtn));
+	MergeTophits(wpool->ghit, ghit);
+	MergeTophits(wpool->dhit, dhit);
+	if ((rtn = pthread_mutex_unlock(&(wpool->output_lock))) != 0)
+	  Die("pthread_mutex_unlock failure: %s\n", strerror(rtn));
+      }
   } /* end 'infinite' loop over seqs in this thread */
+
+  /* 5. Merge our histogram into the shared one.
+   */
+  if ((rtn = pthread_mutex_lock(&(wpool->output_lock))) != 0)
+    Die("pthread_mutex_lock failure: %s\n", strerror(rtn));
+  MergeHistogram(wpool->hist, hist);
+  if ((rtn = pthread_mutex_unlock(&(wpool->output_lock))) != 0)
+    Die("pthread_mutex_unlock failure: %s\n", strerror(rtn));
+
+  FreeHistogram(hist);
+  FreeTophits(ghit);
+  FreeTophits(dhit);
+  FreePlan7Matrix(mx);
+  pthread_exit(NULL);
+  return NULL; /* solely to silence compiler warnings */
 }
 #else /*HMMER_THREADS off; no threads support; dummy stub: */
 static void
@@ -1217,3 +1486,448 @@ main_loop_threaded(struct plan7_s *hmm, SQFILE *sqfp, struct threshold_s *thresh
 }
 #endif /* HMMER_THREADS */
 
+
+
+
+/*****************************************************************
+ * Multi-model search: hmmsearch --all.
+ * 
+ * Every HMM in the HMM file is searched against the database, which
+ * is read and digitized only once and kept in memory. The work is
+ * cut into tiles of one model by SERIAL_BATCH consecutive targets;
+ * the threaded version's workers each take the next tile off a
+ * shared counter, so one that finishes early simply takes more.
+ * Tiles are handed out largest model first: the long ones go early,
+ * with the short ones left to even out the end, and each worker's
+ * DP matrix is allocated once, at the largest M.
+ * The hits and histogram of each model are those a hmmsearch with
+ * that model alone would find, and are reported the same way, in
+ * the order of the HMM file.
+ *****************************************************************/
+
+/* Function: search_all()
+ *
+ * Purpose:  Read every HMM of an open HMM file, search them all
+ *           against the database and report, one after another.
+ *
+ * Args:     hmmfile      - name of the HMM file, for the banner
+ *           hmmfp        - the open HMM file, at its start
+ *           seqfile      - name of the database, for the banner
+ *           sqfp         - the open database, at its start
+ *           thresh       - thresholds from the command line
+ *           Alimit       - most domain alignments shown per model
+ *           be_backwards - TRUE for the last version's output style
+ *           do_forward   - TRUE to score using Forward()
+ *           do_null2     - TRUE to use ad hoc null2 score correction
+ *           do_xnu       - TRUE to apply XNU mask
+ *           num_threads  - worker threads; 0 for the serial version
+ *
+ * Returns:  (void)
+ */
+static void
+search_all(char *hmmfile, HMMFILE *hmmfp, char *seqfile, SQFILE *sqfp,
+	   struct threshold_s *thresh, int Alimit, int be_backwards,
+	   int do_forward, int do_null2, int do_xnu, int num_threads)
+{
+  struct plan7_s        *hmm;
+  struct modelsearch_s  *ms;	/* the models, in file order         */
+  struct modelsearch_s **order;	/* the same, largest M first         */
+  struct modelsearch_s  *tmp;
+  struct targets_s      *db;	/* the database                      */
+  int    nmodels;
+  int    nalloc;
+  int    m, j;
+
+  /* 1. Read the models; each gets its own Pfam autocuts, MSV
+   *    profile and results.
+   */
+  ms      = NULL;
+  nmodels = nalloc = 0;
+  while (HMMFileRead(hmmfp, &hmm))
+    {
+      if (hmm == NULL) 
+	Die("HMM file %s corrupt or in incorrect format? Parse failed", hmmfile);
+      P7Logoddsify(hmm, !do_forward);
+      if (nmodels == nalloc) {
+	nalloc += 64;
+	ms      = ReallocOrDie(ms, sizeof(struct modelsearch_s) * nalloc);
+      }
+      ms[nmodels].hmm    = hmm;
+      ms[nmodels].thresh = *thresh;
+      if (! SetAutocuts(&(ms[nmodels].thresh), hmm)) 
+	Die("HMM %s did not contain the GA, TC, or NC cutoffs you needed",
+	    hmm->name);
+      ms[nmodels].msv  = thresh->F1 < 1.0 ? CreateMSVProfile(hmm) : NULL;
+      ms[nmodels].hist = AllocHistogram(-200, 200, 100);
+      ms[nmodels].ghit = AllocTophits(200);
+      ms[nmodels].dhit = AllocTophits(200);
+      if (Alimit == 0 || (thresh->Z && Alimit > 0))
+	TophitsAliLimit(ms[nmodels].dhit, Alimit);
+      nmodels++;
+    }
+  if (nmodels == 0)
+    Die("Failed to read any HMMs from %s\n", hmmfile);
+  if (do_xnu && Alphabet_type == hmmNUCLEIC) 
+    Die("The HMM is a DNA model, and you can't use the --xnu filter on DNA data");
+#ifdef HMMER_THREADS
+  for (m = 0; m < nmodels; m++)	/* not before: ms[] was moving */
+    pthread_mutex_init(&(ms[m].lock), NULL);
+#endif
+
+  HMMERBanner(stdout, banner);
+  printf(   "HMM file:                   %s [%d models]\n", hmmfile, nmodels);
+  printf(   "Sequence database:          %s\n", seqfile); 
+  print_thresholds(thresh);
+  printf("- - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -\n");
+
+  /* 2. Read and digitize the database, once.
+   */
+  db = read_targets(sqfp, do_xnu);
+
+  /* 3. Search, largest model first (an insertion sort; ties stay
+   *    in file order).
+   */
+  order = MallocOrDie(sizeof(struct modelsearch_s *) * nmodels);
+  for (m = 0; m < nmodels; m++)
+    {
+      tmp = &(ms[m]);
+      for (j = m; j > 0 && order[j-1]->hmm->M < tmp->hmm->M; j--)
+	order[j] = order[j-1];
+      order[j] = tmp;
+    }
+  if (num_threads > 0)
+    main_loop_all_threaded(order, nmodels, db, do_forward, do_null2, num_threads);
+  else
+    main_loop_all_serial(order, nmodels, db, do_forward, do_null2);
+
+  /* 4. Report, in file order.
+   */
+  for (m = 0; m < nmodels; m++)
+    report_hits(ms[m].hmm, &(ms[m].thresh), Alimit, be_backwards,
+		ms[m].hist, ms[m].ghit, ms[m].dhit, db->nseq);
+  printf("\nTotal sequences searched: %d\n", db->nseq);
+
+  for (m = 0; m < nmodels; m++)
+    {
+#ifdef HMMER_THREADS
+      pthread_mutex_destroy(&(ms[m].lock));
+#endif
+      if (ms[m].msv != NULL) FreeMSVProfile(ms[m].msv);
+      FreeHistogram(ms[m].hist);
+      FreeTophits(ms[m].ghit);
+      FreeTophits(ms[m].dhit);
+      FreePlan7(ms[m].hmm);
+    }
+  for (j = 0; j < db->nseq; j++)
+    free(db->dsq[j]);
+  free(db->dsq);
+  free(db->sqinfo);
+  free(db);
+  free(order);
+  free(ms);
+}
+
+/* Function: read_targets()
+ *
+ * Purpose:  Read and digitize a whole sequence database,
+ *           skipping length 0 seqs as main_loop_serial() does.
+ *
+ * Args:     sqfp   - open sequence database
+ *           do_xnu - TRUE to apply XNU mask (to protein seqs)
+ *
+ * Returns:  ptr to the new targets_s. 
+ *           Caller frees its dsq[], dsq, sqinfo, and it.
+ */
+static struct targets_s *
+read_targets(SQFILE *sqfp, int do_xnu)
+{
+  struct targets_s *db;
+  char   *seq;
+  SQINFO  sqinfo;
+  int     nalloc;
+
+  db         = MallocOrDie(sizeof(struct targets_s));
+  db->nseq   = 0;
+  db->dsq    = NULL;
+  db->sqinfo = NULL;
+  nalloc     = 0;
+  while (ReadSeq(sqfp, sqfp->format, &seq, &sqinfo))
+    {
+      if (sqinfo.len == 0) { FreeSequence(seq, &sqinfo); continue; }
+      if (db->nseq == nalloc) {
+	nalloc    += 1024;
+	db->dsq    = ReallocOrDie(db->dsq,    sizeof(char *) * nalloc);
+	db->sqinfo = ReallocOrDie(db->sqinfo, sizeof(SQINFO) * nalloc);
+      }
+      db->dsq[db->nseq] = DigitizeSequence(seq, sqinfo.len);
+      if (do_xnu && Alphabet_type == hmmAMINO) XNU(db->dsq[db->nseq], sqinfo.len);
+
+      FreeSequence(seq, &sqinfo);	/* keep name, acc, desc, len */
+      sqinfo.flags &= ~(SQINFO_SS | SQINFO_SA);
+      db->sqinfo[db->nseq] = sqinfo;
+      db->nseq++;
+    }
+  return db;
+}
+
+/* Function: search_tile()
+ *
+ * Purpose:  Search one model against targets from..from+SERIAL_BATCH-1
+ *           (or to the end of the database), as main_loop_serial()
+ *           does a batch, and add the results to the model's.
+ *           Threads may run tiles of the same model at once; only
+ *           the last step takes the model's lock.
+ *
+ * Args:     ms         - the model and its results
+ *           db         - the database
+ *           from       - first target of the tile, 0..
+ *           mx         - the caller's DP matrix, growable
+ *           do_forward - TRUE to score using Forward()
+ *           do_null2   - TRUE to use ad hoc null2 score correction
+ *
+ * Returns:  (void)
+ */
+static void
+search_tile(struct modelsearch_s *ms, struct targets_s *db, int from,
+	    struct dpmatrix_s *mx, int do_forward, int do_null2)
+{
+  struct plan7_s   *hmm = ms->hmm;
+  struct p7trace_s *tr[SERIAL_BATCH];  /* tracebacks, or NULL            */
+  float  sc[SERIAL_BATCH];      /* scores                                  */
+  int    pass[SERIAL_BATCH];	/* TRUE if passed the MSV prefilter        */
+  int    sig[SERIAL_BATCH];	/* TRUE if a significant hit               */
+  float  bsc[SERIAL_BATCH];     /* Viterbi scores of the batched ones      */
+  char  *vdsq[SERIAL_BATCH];    /* the batched ones: seqs, lengths, index  */
+  int    vlen[SERIAL_BATCH];
+  int    vidx[SERIAL_BATCH];
+  char  *dsq;
+  SQINFO *sqinfo;
+  double pvalue;		/* pvalue of an HMM score                  */
+  double evalue;		/* evalue of an HMM score                  */
+  int    n, nv, i, v;
+  int    batched;               /* TRUE if seq i was scored by the batch   */
+#ifdef HMMER_THREADS
+  int    rtn;
+#endif
+
+  n = MIN(SERIAL_BATCH, db->nseq - from);
+
+  /* 1. The MSV prefilter, then the Viterbi scores of the seqs
+   *    that pass, all at once.
+   */
+  nv = 0;
+  for (i = 0; i < n; i++)
+    {
+      dsq     = db->dsq[from+i];
+      sqinfo  = &(db->sqinfo[from+i]);
+      tr[i]   = NULL;
+      pass[i] = (ms->msv == NULL ||
+		 MSVPValue(ms->msv, MSVFilter(dsq, sqinfo->len, ms->msv)) <= ms->thresh.F1);
+      if (pass[i] && ! do_forward && 
+	  P7ViterbiSize(sqinfo->len, hmm->M) <= RAMLIMIT) {
+	vdsq[nv] = dsq;
+	vlen[nv] = sqinfo->len;
+	vidx[nv] = i;
+	nv++;
+      }
+    }
+  if (nv > 0) P7ViterbiBatch(vdsq, vlen, nv, hmm, bsc);
+
+  /* 2. The other scores, and the traces of the significant hits.
+   *    The E-value bound uses the target's number, 1.., as the
+   *    serial loop does.
+   */
+  for (i = 0, v = 0; i < n; i++)
+    {
+      if (! pass[i]) continue;
+      dsq    = db->dsq[from+i];
+      sqinfo = &(db->sqinfo[from+i]);
+      batched = (v < nv && vidx[v] == i);
+      if (batched)
+	sc[i] = bsc[v++];
+      else
+	{
+	  if (P7ViterbiSize(sqinfo->len, hmm->M) <= RAMLIMIT)
+	    sc[i] = P7Viterbi(dsq, sqinfo->len, hmm, mx, &(tr[i]));
+	  else
+	    sc[i] = P7SmallViterbi(dsq, sqinfo->len, hmm, mx, &(tr[i]));
+	  if (do_forward) {
+	    sc[i] = P7Forward(dsq, sqinfo->len, hmm, NULL);
+	    if (do_null2) sc[i] -= TraceScoreCorrection(hmm, tr[i], dsq); 
+	  }
+	}
+
+      pvalue = PValue(hmm, sc[i]);
+      evalue = ms->thresh.Z ? (double) ms->thresh.Z * pvalue : (double) (from+i+1) * pvalue;
+      sig[i] = (sc[i] >= ms->thresh.globT && evalue <= ms->thresh.globE);
+      if (sig[i] && batched)
+	P7Viterbi(dsq, sqinfo->len, hmm, mx, &(tr[i]));
+    }
+
+  /* 3. Into the model's hit lists and histogram.
+   */
+#ifdef HMMER_THREADS
+  if ((rtn = pthread_mutex_lock(&(ms->lock))) != 0)
+    Die("pthread_mutex_lock failure: %s\n", strerror(rtn));
+#endif
+  for (i = 0; i < n; i++)
+    {
+      if (! pass[i]) continue;
+      sqinfo = &(db->sqinfo[from+i]);
+      if (sig[i])
+	sc[i] = PostprocessSignificantHit(ms->ghit, ms->dhit, 
+					  tr[i], hmm, db->dsq[from+i], sqinfo->len,
+					  sqinfo->name, 
+					  sqinfo->flags & SQINFO_ACC  ? sqinfo->acc  : NULL, 
+					  sqinfo->flags & SQINFO_DESC ? sqinfo->desc : NULL, 
+					  from+i+1,
+					  do_forward, sc[i],
+					  do_null2,
+					  &(ms->thresh),
+					  FALSE); /* FALSE-> not hmmpfam mode, hmmsearch mode */
+      AddToHistogram(ms->hist, sc[i]);
+    }
+#ifdef HMMER_THREADS
+  if ((rtn = pthread_mutex_unlock(&(ms->lock))) != 0)
+    Die("pthread_mutex_unlock failure: %s\n", strerror(rtn));
+#endif
+  for (i = 0; i < n; i++)
+    P7FreeTrace(tr[i]);
+}
+
+/* Function: main_loop_all_serial()
+ *
+ * Purpose:  Search the models against the database, one tile
+ *           after the other.
+ *
+ * Args:     order      - the models, largest M first
+ *           nmodels    - number of models
+ *           db         - the database
+ *           do_forward - TRUE to score using Forward()
+ *           do_null2   - TRUE to use ad hoc null2 score correction
+ *
+ * Returns:  (void)
+ */
+static void
+main_loop_all_serial(struct modelsearch_s **order, int nmodels,
+		     struct targets_s *db, int do_forward, int do_null2)
+{
+  struct dpmatrix_s *mx;
+  int    ntiles;		/* tiles per model */
+  int    t;
+
+  ntiles = (db->nseq + SERIAL_BATCH - 1) / SERIAL_BATCH;
+  mx     = CreatePlan7Matrix(1, order[0]->hmm->M, 25, 0); 
+  for (t = 0; t < nmodels * ntiles; t++)
+    search_tile(order[t / ntiles], db, (t % ntiles) * SERIAL_BATCH, 
+		mx, do_forward, do_null2);
+  FreePlan7Matrix(mx);
+}
+
+#ifdef HMMER_THREADS
+/* Function: main_loop_all_threaded()
+ *
+ * Purpose:  Search the models against the database with a
+ *           pool of worker threads.
+ *
+ * Args:     order       - the models, largest M first
+ *           nmodels     - number of models
+ *           db          - the database
+ *           do_forward  - TRUE to score using Forward()
+ *           do_null2    - TRUE to use ad hoc null2 score correction
+ *           num_threads - number of worker threads, >= 1
+ *
+ * Returns:  (void)
+ */
+static void
+main_loop_all_threaded(struct modelsearch_s **order, int nmodels,
+		       struct targets_s *db, int do_forward, int do_null2,
+		       int num_threads)
+{
+  struct allpool_s pool;
+  pthread_t       *thread;
+  pthread_attr_t   attr;
+  int i;
+  int rtn;
+
+  pool.order      = order;
+  pool.nmodels    = nmodels;
+  pool.db         = db;
+  pool.do_forward = do_forward;
+  pool.do_null2   = do_null2;
+  pool.ntiles     = (db->nseq + SERIAL_BATCH - 1) / SERIAL_BATCH;
+  pool.next       = 0;
+  if ((rtn = pthread_mutex_init(&(pool.tile_lock), NULL)) != 0)
+    Die("pthread_mutex_init FAILED; %s\n", strerror(rtn));
+
+  /* Same thread setup as workpool_start().
+   */
+  thread = MallocOrDie(num_threads * sizeof(pthread_t));
+  pthread_attr_init(&attr);
+#ifndef __sgi
+#ifdef HAVE_PTHREAD_ATTR_SETSCOPE
+  pthread_attr_setscope(&attr, PTHREAD_SCOPE_SYSTEM);
+#endif
+#endif
+#ifdef HAVE_PTHREAD_SETCONCURRENCY
+  pthread_setconcurrency(num_threads+1);
+#endif
+  for (i = 0; i < num_threads; i++)
+    if ((rtn = pthread_create(&(thread[i]), &attr,
+			      all_worker_thread, (void *) &pool)) != 0)
+      Die("Failed to create thread %d; return code %d\n", i, rtn);
+  pthread_attr_destroy(&attr);
+
+  for (i = 0; i < num_threads; i++)
+    if (pthread_join(thread[i], NULL) != 0)
+      Die("pthread_join failed");
+  pthread_mutex_destroy(&(pool.tile_lock));
+  free(thread);
+}
+
+/* Function: all_worker_thread()
+ *
+ * Purpose:  The procedure executed by the --all worker threads:
+ *           take tiles until there are none left.
+ *
+ * Args:     ptr  - (void *) that is recast to a pointer to
+ *                  the allpool_s.
+ *
+ * Returns:  (void *)
+ */
+static void *
+all_worker_thread(void *ptr)
+{
+  struct allpool_s  *pool;
+  struct dpmatrix_s *mx;
+  int    t;
+  int    rtn;
+
+  pool = (struct allpool_s *) ptr;
+  mx   = CreatePlan7Matrix(1, pool->order[0]->hmm->M, 25, 0);
+  for (;;)
+    {
+      if ((rtn = pthread_mutex_lock(&(pool->tile_lock))) != 0)
+	Die("pthread_mutex_lock failure: %s\n", strerror(rtn));
+      t = pool->next++;
+      if ((rtn = pthread_mutex_unlock(&(pool->tile_lock))) != 0)
+	Die("pthread_mutex_unlock failure: %s\n", strerror(rtn));
+      if (t >= pool->nmodels * pool->ntiles) break;
+
+      search_tile(pool->order[t / pool->ntiles], pool->db,
+		  (t % pool->ntiles) * SERIAL_BATCH, 
+		  mx, pool->do_forward, pool->do_null2);
+    }
+  FreePlan7Matrix(mx);
+  pthread_exit(NULL);
+  return NULL; /* solely to silence compiler warnings */
+}
+#else /*HMMER_THREADS off; no threads support; dummy stub: */
+static void
+main_loop_all_threaded(struct modelsearch_s **order, int nmodels,
+		       struct targets_s *db, int do_forward, int do_null2,
+		       int num_threads)
+{
+  Die("No threads support");
+}
+#endif /* HMMER_THREADS */
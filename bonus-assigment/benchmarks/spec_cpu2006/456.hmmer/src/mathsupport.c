@@ -144,7 +144,7 @@ LogSum(float p1, float p2)
  *                    
  * Return:   scaled integer log_2 probability of the sum.
  */
-static int ilogsum_lookup[LOGSUM_TBL];
+static int ilogsum_lookup[LOGSUM_TBL+1]; /* +1: a 0 for all diff >= LOGSUM_TBL */
 static void 
 init_ilogsum(void)
 {
@@ -152,6 +152,7 @@ init_ilogsum(void)
   for (i = 0; i < LOGSUM_TBL; i++) 
     ilogsum_lookup[i] = (int) (INTSCALE * 1.44269504 * 
 	   (log(1.+exp(0.69314718 * (float) -i/INTSCALE))));
+  ilogsum_lookup[LOGSUM_TBL] = 0;
 }
 int 
 ILogsum(int p1, int p2)
@@ -172,6 +173,23 @@ ILogsum(int p1, int p2)
   else                          return p2 + ilogsum_lookup[-diff];
 } 
 
+/* Function: ILogsumTable()
+ * 
+ * Purpose:  The lookup table of ILogsum(), for DP loops that
+ *           inline it: ILogsum(p1, p2) is 
+ *              (diff > 0 ? p1 : p2) + tbl[MIN(|diff|, LOGSUM_TBL)]
+ *           for diff = p1-p2, with no branches on diff's size,
+ *           so it can be done a vector of cells at a time.
+ *           
+ * Return:   ptr to the table, 0..LOGSUM_TBL; shared, don't free.
+ */
+int *
+ILogsumTable(void)
+{
+  (void) ILogsum(0, 0);		/* sees to the one-time init */
+  return ilogsum_lookup;
+}
+
 /* Function: LogNorm()
  * 
  * Purpose:  Normalize a vector of log likelihoods, changing it
@@ -0,0 +1,236 @@
+/************************************************************
+ * HMMER - Biological sequence analysis with profile HMMs
+ * Copyright (C) 1992-2003 Washington University School of Medicine
+ * All Rights Reserved
+ *
+ *     This source code is distributed under the terms of the
+ *     GNU General Public License. See the files COPYING and LICENSE
+ *     for details.
+ ************************************************************/
+
+/* msvfilter.c
+ *
+ * The MSV ("multiple segment Viterbi") prefilter for hmmsearch.
+ *
+ * MSV scores a target against an ungapped, local, multihit
+ * version of the model: only the match states, entered anywhere
+ * with uniform probability, with match->match transitions free,
+ * and the J state allowing several such segments per target.
+ * That is all a true homolog usually needs to stand out from
+ * the noise, and it can be done in unsigned bytes: scores are in
+ * 1/3 bit units, offset by a base of 190, with every match
+ * emission turned into a cost (bias - score) so that each step
+ * is a saturating add and a saturating subtract. A cell that
+ * saturates at 255 means a score far above anything the filter
+ * needs to decide, so the target just passes.
+ *
+ * The score is turned into a P-value with a Gumbel of fixed
+ * lambda = log 2, whose mu is fit when the profile is built by
+ * scoring random sequences from the model's null composition.
+ * hmmsearch runs the full P7Viterbi() only on targets whose MSV
+ * P-value is <= its --F1 cutoff.
+ *
+ * References: the byte MSV filter of HMMER3 (Eddy, 2011,
+ * PLoS Comp Biol 7:e1002195), simplified to a plain k loop.
+ */
+
+#include "config.h"
+#include "squidconf.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+
+#include "squid.h"
+#include "structs.h"
+#include "funcs.h"
+
+
+#define MSV_SCALE   3.0		/* byte units per bit                  */
+#define MSV_BASE    190		/* offset of the zero score            */
+#define MSV_LAMBDA  0.693147	/* Gumbel lambda of MSV bit scores     */
+#define MSV_CALIB_L 200		/* length of the random calibration seqs */
+#define MSV_CALIB_N 200		/* number of them                        */
+#define MSV_SEED    42		/* fixed, so mu is reproducible          */
+
+#define SATADD(a, b) ((a) + (b) > 255 ? 255 : (a) + (b))
+#define SATSUB(a, b) ((a) > (b) ? (a) - (b) : 0)
+
+/* Function: msv_byte()
+ *
+ * Purpose:  Convert a length (bits) into a byte cost, rounded
+ *           and clamped to 0..255.
+ */
+static unsigned char
+msv_byte(double bits)
+{
+  double x = floor(MSV_SCALE * bits + 0.5);
+  if (x < 0.)   return 0;
+  if (x > 255.) return 255;
+  return (unsigned char) x;
+}
+
+/* Function: CreateMSVProfile()
+ *
+ * Purpose:  Build the byte profile for the MSV filter from
+ *           the log-odds scores of a Plan7 model, and fit the
+ *           mu of its score distribution.
+ *
+ *           The model must have scores (P7Logoddsify()). The
+ *           profile only reads from it, so threads can share
+ *           it once it is built; building it reseeds and uses
+ *           sre_random().
+ *
+ * Args:     hmm - the model, in log-odds form.
+ *
+ * Return:   ptr to the new profile.
+ *           Caller frees with FreeMSVProfile().
+ */
+struct msvprofile_s *
+CreateMSVProfile(struct plan7_s *hmm)
+{
+  struct msvprofile_s *om;
+  char   *dsq;
+  double  sum;
+  int     max, sc;
+  int     x, k, idx;
+
+  om      = MallocOrDie(sizeof(struct msvprofile_s));
+  om->M   = hmm->M;
+  om->rbv = MallocOrDie(sizeof(unsigned char *) * Alphabet_iupac);
+  om->rbv[0] = MallocOrDie(sizeof(unsigned char) * Alphabet_iupac * (hmm->M+1));
+  for (x = 1; x < Alphabet_iupac; x++)
+    om->rbv[x] = om->rbv[0] + x * (hmm->M+1);
+
+  /* bias = the best match score, so every cost is >= 0 */
+  max = 0;
+  for (x = 0; x < Alphabet_iupac; x++)
+    for (k = 1; k <= hmm->M; k++)
+      if (hmm->msc[x][k] > max) max = hmm->msc[x][k];
+  om->bias = msv_byte((double) max / INTSCALE);
+
+  for (x = 0; x < Alphabet_iupac; x++)
+    {
+      om->rbv[x][0] = 255;
+      for (k = 1; k <= hmm->M; k++)
+	{
+	  sc = om->bias - (int) floor(MSV_SCALE * hmm->msc[x][k] / INTSCALE + 0.5);
+	  om->rbv[x][k] = sc > 255 ? 255 : (unsigned char) sc;
+	}
+    }
+
+  /* uniform local entry, and E->C = E->J = 1/2 */
+  om->tbm = msv_byte(-sreLOG2(2. / ((double) hmm->M * (double) (hmm->M+1))));
+  om->tec = msv_byte(1.);
+
+  /* Fit mu with lambda fixed: the ML location of a Gumbel
+   * is mu = -1/lambda log(1/N sum exp(-lambda x_i)).
+   */
+  om->mu     = 0.;
+  om->lambda = MSV_LAMBDA;
+  sre_srandom(MSV_SEED);
+  sum = 0.;
+  dsq = MallocOrDie(sizeof(char) * (MSV_CALIB_L+2));
+  for (idx = 0; idx < MSV_CALIB_N; idx++)
+    {
+      DigitizedRandomSequence(hmm->null, MSV_CALIB_L, dsq);
+      sum += exp(-1. * om->lambda * MSVFilter(dsq, MSV_CALIB_L, om));
+    }
+  free(dsq);
+  om->mu = -1. * log(sum / (double) MSV_CALIB_N) / om->lambda;
+  return om;
+}
+
+/* Function: FreeMSVProfile()
+ */
+void
+FreeMSVProfile(struct msvprofile_s *om)
+{
+  free(om->rbv[0]);
+  free(om->rbv);
+  free(om);
+}
+
+/* Function: MSVFilter()
+ *
+ * Purpose:  Score a digitized sequence against the MSV profile.
+ *
+ * Args:     dsq - sequence in digitized form, 1..L
+ *           L   - length of dsq
+ *           om  - MSV profile
+ *
+ * Return:   MSV score in bits; FLT_MAX if the byte range was
+ *           exceeded, which is far above any filter cutoff.
+ */
+float
+MSVFilter(char *dsq, int L, struct msvprofile_s *om)
+{
+  unsigned char *mpv, *dp, *tmp;
+  unsigned char *rsc;
+  int  xE, xJ, xB;		/* special states, bytes          */
+  int  xBv;			/* xB - tbm, the entry to any M_k */
+  int  tjb;			/* N->B, J->B: length dependent   */
+  int  sv;
+  int  i, k;
+  double usc, nullsc;
+
+  mpv = MallocOrDie(sizeof(unsigned char) * (om->M+1));
+  dp  = MallocOrDie(sizeof(unsigned char) * (om->M+1));
+  memset(mpv, 0, om->M+1);
+  dp[0] = 0;
+
+  /* N, C and J loops cost L/(L+3) each, their moves out 3/(L+3).
+   */
+  tjb = msv_byte(-sreLOG2(3. / (double) (L+3)));
+  xJ  = 0;
+  xB  = SATSUB(MSV_BASE, tjb);
+
+  for (i = 1; i <= L; i++)
+    {
+      rsc = om->rbv[(int) dsq[i]];
+      xBv = SATSUB(xB, om->tbm);
+      xE  = 0;
+      for (k = 1; k <= om->M; k++)
+	{
+	  sv    = MAX(mpv[k-1], xBv);
+	  sv    = SATADD(sv, om->bias);
+	  sv    = SATSUB(sv, rsc[k]);
+	  dp[k] = (unsigned char) sv;
+	  xE    = MAX(xE, sv);
+	}
+      if (xE >= 255 - om->bias)
+	{
+	  free(mpv);
+	  free(dp);
+	  return FLT_MAX;
+	}
+      tmp = mpv; mpv = dp; dp = tmp;
+
+      xE = SATSUB(xE, om->tec);
+      xJ = MAX(xJ, xE);
+      xB = SATSUB(MAX(MSV_BASE, xJ), tjb);
+    }
+  free(mpv);
+  free(dp);
+
+  /* Back to bits. The three N/C/J loops add about L log(L/(L+3))
+   * = -3 nats; the null model's length distribution contributes
+   * L log(L/(L+1)) + log(1/(L+1)).
+   */
+  usc    = ((double) (xJ - tjb) - (double) MSV_BASE) / MSV_SCALE;
+  nullsc = (double) L * log((double) L / (double) (L+1)) - log((double) (L+1));
+  return (float) (usc + (-3. - nullsc) / 0.69314718);
+}
+
+/* Function: MSVPValue()
+ *
+ * Purpose:  P-value of an MSV score.
+ */
+double
+MSVPValue(struct msvprofile_s *om, float sc)
+{
+  if (sc == FLT_MAX) return 0.;
+  return ExtremeValueP(sc, om->mu, om->lambda);
+}
@@ -86,6 +86,8 @@ AllocPlan7Shell(void)
 
   hmm->bsc = hmm->bsc_mem = NULL;
   hmm->esc = hmm->esc_mem = NULL;
+  hmm->vsc = NULL;
+  hmm->vsc_mem = NULL;
 
 				/* DNA translation is not enabled by default */
   hmm->dnam   = NULL;
@@ -189,6 +191,8 @@ FreePlan7(struct plan7_s *hmm)
   if (hmm->msc_mem != NULL) free(hmm->msc_mem);
   if (hmm->isc_mem != NULL) free(hmm->isc_mem);
   if (hmm->tsc_mem != NULL) free(hmm->tsc_mem);
+  if (hmm->vsc_mem != NULL) free(hmm->vsc_mem);
+  if (hmm->vsc     != NULL) free(hmm->vsc);
   if (hmm->mat     != NULL) free(hmm->mat[0]);
   if (hmm->ins     != NULL) free(hmm->ins[0]);
   if (hmm->t       != NULL) free(hmm->t[0]);
@@ -509,9 +513,62 @@ P7Logoddsify(struct plan7_s *hmm, int viterbi_mode)
   hmm->xsc[XTJ][LOOP] = Prob2Score(hmm->xt[XTJ][LOOP], hmm->p1);
   hmm->xsc[XTJ][MOVE] = Prob2Score(hmm->xt[XTJ][MOVE], 1.0);
 
+  P7CompileScores(hmm);
   hmm->flags |= PLAN7_HASBITS;	/* raise the log-odds ready flag */
 }
 
+/* Function: P7CompileScores()
+ * 
+ * Purpose:  Lay the log-odds scores of a model out again in 
+ *           hmm->vsc, for P7Viterbi(): one array per residue,
+ *           each node's scores next to each other (see VSC_IDX()
+ *           in structs.h). P7Logoddsify() calls it; anything that
+ *           changes the scores directly afterwards calls it again.
+ *           
+ * Args:     hmm - the model, scores filled in.
+ *
+ * Return:   (void)
+ */
+void
+P7CompileScores(struct plan7_s *hmm)
+{
+  int  M = hmm->M;
+  int  n;			/* ints in one residue's array */
+  int  k, x;
+  int *v;
+
+  n = ((M + P7_VSTRIPE - 1) / P7_VSTRIPE) * VSC_NSC * P7_VSTRIPE;
+  if (hmm->vsc == NULL) {
+    hmm->vsc     = MallocOrDie(MAXCODE * sizeof(int *));
+    hmm->vsc_mem = MallocOrDie(MAXCODE * n * sizeof(int) + 64);
+    hmm->vsc[0]  = (int *) (((unsigned long) hmm->vsc_mem + 63) & ~63UL);
+    for (x = 1; x < MAXCODE; x++)
+      hmm->vsc[x] = hmm->vsc[0] + x * n;
+  }
+  memset(hmm->vsc[0], 0, MAXCODE * n * sizeof(int));
+
+  for (x = 0; x < MAXCODE; x++)
+    {
+      v = hmm->vsc[x];
+      for (k = 1; k <= M; k++)
+	{
+	  v[VSC_IDX(k, VSC_TMM)] = hmm->tsc[TMM][k-1];
+	  v[VSC_IDX(k, VSC_TIM)] = hmm->tsc[TIM][k-1];
+	  v[VSC_IDX(k, VSC_TDM)] = hmm->tsc[TDM][k-1];
+	  v[VSC_IDX(k, VSC_BSC)] = hmm->bsc[k];
+	  v[VSC_IDX(k, VSC_MSC)] = hmm->msc[x][k];
+	  v[VSC_IDX(k, VSC_ESC)] = hmm->esc[k];
+	  v[VSC_IDX(k, VSC_TMD)] = hmm->tsc[TMD][k-1];
+	  v[VSC_IDX(k, VSC_TDD)] = hmm->tsc[TDD][k-1];
+	  if (k < M) {
+	    v[VSC_IDX(k, VSC_TMI)] = hmm->tsc[TMI][k];
+	    v[VSC_IDX(k, VSC_TII)] = hmm->tsc[TII][k];
+	    v[VSC_IDX(k, VSC_ISC)] = hmm->isc[x][k];
+	  }
+	}
+    }
+}
+
 
 
 /* Function: Plan7Renormalize()
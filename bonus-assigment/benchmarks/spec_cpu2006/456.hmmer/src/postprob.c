@@ -164,6 +164,7 @@ P7Backward(char *dsq, int L, struct plan7_s *hmm, struct dpmatrix_s **ret_mx)
    * as Plan7Logoddsify does not do this for us (I think? - ihh).
    */
   hmm->tsc[TDD][hmm->M-1] = hmm->tsc[TMD][hmm->M-1] = -INFTY;    /* no D_M state -- HACK -- should be in Plan7Logoddsify */
+  P7CompileScores(hmm);
   for (i = L-1; i >= 0; i--)
     {
       /* Do the special states first.
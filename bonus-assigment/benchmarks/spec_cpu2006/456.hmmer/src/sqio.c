@@ -57,11 +57,21 @@
 #include <unistd.h>	
 #endif
 
+#ifdef HAVE_MMAP
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#endif
+
 #include "squid.h"
 #include "msa.h"
 #include "ssi.h"
 
 static void SeqfileGetLine(SQFILE *V);
+#ifdef HAVE_MMAP
+static void seqfile_map(SQFILE *V);
+static void readPearsonMapped(struct ReadSeqVars *V);
+#endif
 
 #define kStartLength  500
 
@@ -107,6 +117,7 @@ seqfile_open(char *filename, int format, char *env, int ssimode)
   dbfp->bpl      = -1;		/* flag meaning "unset" */
   dbfp->lastbpl  = 0;
   dbfp->maxbpl   = 0;
+  dbfp->map      = NULL;
 
   /* Open our file handle.
    * Three possibilities:
@@ -206,12 +217,49 @@ seqfile_open(char *filename, int format, char *env, int ssimode)
       return dbfp;
     }
 
-  /* Load the first line.
+  /* A plain FASTA file is read from a mapping of it, if we can;
+   * else load the first line.
    */
-  SeqfileGetLine(dbfp); 
+#ifdef HAVE_MMAP
+  if (format == SQFILE_FASTA && ssimode == -1 && !dbfp->do_stdin && !dbfp->do_gzip)
+    seqfile_map(dbfp);
+#endif
+  if (dbfp->map == NULL)
+    SeqfileGetLine(dbfp); 
   return dbfp;
 }
 
+#ifdef HAVE_MMAP
+/* Function: seqfile_map()
+ * 
+ * Purpose:  Map the whole of V's open file read-only, for
+ *           readPearsonMapped(). The kernel's sequential
+ *           readahead then keeps the pages ahead of the parser
+ *           coming in while we search.
+ *           Leaves V->map NULL if it can't (empty file, no
+ *           room in the address space), and the caller falls
+ *           back to stdio.
+ */
+static void
+seqfile_map(SQFILE *V)
+{
+  struct stat st;
+  void  *map;
+
+  if (fstat(fileno(V->f), &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0)
+    return;
+  if ((off_t) (size_t) st.st_size != st.st_size)
+    return;
+  map = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fileno(V->f), 0);
+  if (map == MAP_FAILED)
+    return;
+  posix_madvise(map, (size_t) st.st_size, POSIX_MADV_SEQUENTIAL);
+  V->map    = map;
+  V->maplen = (size_t) st.st_size;
+  V->mapoff = 0;
+}
+#endif /*HAVE_MMAP*/
+
 /* Function: SeqfilePosition()
  * 
  * Purpose:  Move to a particular offset in a seqfile.
@@ -223,6 +271,13 @@ SeqfilePosition(SQFILE *sqfp, SSIOFFSET *offset)
   if (sqfp->do_stdin || sqfp->do_gzip || IsAlignmentFormat(sqfp->format))
     Die("SeqfilePosition() failed: in a nonrewindable data file or stream");
 
+#ifdef HAVE_MMAP
+  if (sqfp->map != NULL) {
+    sqfp->mapoff = offset->mode == SSI_OFFSET_I32 ? 
+      (size_t) offset->off.i32 : (size_t) offset->off.i64;
+    return;
+  }
+#endif
   if (SSISetFilePosition(sqfp->f, offset) != 0)
     Die("SSISetFilePosition failed, but that shouldn't happen.");
   SeqfileGetLine(sqfp);
@@ -244,6 +299,9 @@ SeqfileRewind(SQFILE *sqfp)
   if (sqfp->do_stdin || sqfp->do_gzip)
     Die("SeqfileRewind() failed: in a nonrewindable data file or stream");
 
+#ifdef HAVE_MMAP
+  if (sqfp->map != NULL) { sqfp->mapoff = 0; return; }
+#endif
   rewind(sqfp->f);
   SeqfileGetLine(sqfp);
 }
@@ -298,6 +356,9 @@ SeqfileClose(SQFILE *sqfp)
   if (sqfp->do_gzip)         pclose(sqfp->f);
 #endif  
   else if (! sqfp->do_stdin) fclose(sqfp->f);
+#ifdef HAVE_MMAP
+  if (sqfp->map   != NULL) munmap(sqfp->map, sqfp->maplen);
+#endif
   if (sqfp->buf   != NULL) free(sqfp->buf);
   if (sqfp->fname != NULL) free(sqfp->fname);
   free(sqfp);
@@ -892,6 +953,71 @@ Usually this is done with an option --informat <fmt>.\n",
   }
 }
 
+#ifdef HAVE_MMAP
+/* Function: readPearsonMapped()
+ * 
+ * Purpose:  readPearson() for a mapped file. The record is
+ *           found with memchr(), from its '>' to the next
+ *           '>' that starts a line, and its residues are
+ *           copied out of the mapping in one pass, with the
+ *           same filtering as addseq(); only the header line
+ *           goes through V->buf, for the same strtok() parse.
+ */
+static void
+readPearsonMapped(struct ReadSeqVars *V)
+{
+  char  *rec, *end, *hend, *s, *sq, *q;
+  char  *sptr;
+  size_t n;
+
+  rec = V->map + V->mapoff;
+  end = V->map + V->maplen;
+
+  if (*rec != '>') 
+    {	/* count lines only now, for the message */
+      V->linenumber = 1;
+      for (q = V->map; (q = memchr(q, '\n', rec - q)) != NULL; q++)
+	V->linenumber++;
+      Die("\
+File %s does not appear to be in FASTA format at line %d.\n\
+You may want to specify the file format on the command line.\n\
+Usually this is done with an option --informat <fmt>.\n", 
+	  V->fname, V->linenumber);
+    }
+
+  /* the header line, newline included, as sre_fgets() would have it */
+  hend = memchr(rec, '\n', end - rec);
+  hend = (hend == NULL) ? end : hend + 1;
+  n    = hend - rec;
+  if (n + 1 > (size_t) V->buflen) {
+    V->buflen = n + 1;
+    V->buf    = ReallocOrDie(V->buf, V->buflen);
+  }
+  memcpy(V->buf, rec, n);
+  V->buf[n] = '\0';
+  if ((sptr = strtok(V->buf+1, "\n\t ")) != NULL)
+    SetSeqinfoString(V->sqinfo, sptr, SQINFO_NAME);
+  if ((sptr = strtok(NULL, "\n")) != NULL)
+    SetSeqinfoString(V->sqinfo, sptr, SQINFO_DESC);
+
+  /* the record ends at the next line that starts with '>' */
+  for (s = hend; (q = memchr(s, '>', end - s)) != NULL && q[-1] != '\n'; s = q + 1)
+    ;
+  if (q == NULL) q = end;
+
+  n = q - hend;
+  if ((int) n > V->maxseq) {
+    V->maxseq = n;
+    V->seq    = ReallocOrDie(V->seq, V->maxseq+1);
+  }
+  for (s = hend, sq = V->seq; s < q; s++)
+    if (! isdigit((int) *s) && ! isspace((int) *s))
+      *sq++ = *s;
+  V->seqlen = sq - V->seq;
+  V->mapoff = q - V->map;
+}
+#endif /*HAVE_MMAP*/
+
 
 static int
 endEMBL(char *s, int *addend)
@@ -1086,7 +1212,12 @@ ReadSeq(SQFILE *V, int format, char **ret_seq, SQINFO *sqinfo)
       V->msa->lastidx++;
     } 
   else {
+#ifdef HAVE_MMAP
+    if (V->map != NULL && V->mapoff >= V->maplen) return 0;
+    if (V->map == NULL && feof(V->f)) return 0;
+#else
     if (feof(V->f)) return 0;
+#endif
 
     if (V->ssimode == -1) {	/* normal mode */
       V->seq           = (char*) calloc (kStartLength+1, sizeof(char));
@@ -1103,7 +1234,14 @@ ReadSeq(SQFILE *V, int format, char **ret_seq, SQINFO *sqinfo)
     case SQFILE_IG      : readIG(V);      break;
     case SQFILE_STRIDER : readStrider(V); break;
     case SQFILE_GENBANK : readGenBank(V); break;
+#ifdef HAVE_MMAP
+    case SQFILE_FASTA   : 
+      if (V->map != NULL) readPearsonMapped(V); 
+      else                readPearson(V); 
+      break;
+#else
     case SQFILE_FASTA   : readPearson(V); break;
+#endif
     case SQFILE_EMBL    : readEMBL(V);    break;
     case SQFILE_ZUKER   : readZuker(V);   break;
     case SQFILE_PIR     : readPIR(V);     break;
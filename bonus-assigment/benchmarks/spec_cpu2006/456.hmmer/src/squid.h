@@ -201,6 +201,10 @@ struct ReadSeqVars {
 
   char   *buf;                  /* dynamically allocated sre_fgets() buffer */
   int     buflen;               /* allocation length for buf                */
+
+  char   *map;                  /* HAVE_MMAP: FASTA file mapped whole, or NULL */
+  size_t  maplen;               /* length of the mapping                       */
+  size_t  mapoff;               /* offset of the next record in it             */
   
   int       ssimode;		/* SSI_OFFSET_I32 or SSI_OFFSET_I64        */
   SSIOFFSET ssioffset;		/* disk offset to last line read into buf  */
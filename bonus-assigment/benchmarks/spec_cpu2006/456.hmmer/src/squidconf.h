@@ -74,6 +74,13 @@
  */
 /* #undef SQD_ENABLE_PVM */
 
+/* mmap() and posix_madvise(): sqio.c reads plain FASTA files
+ * through a mapping. -DSQD_NO_MMAP to use stdio throughout.
+ */
+#ifndef SQD_NO_MMAP
+#define HAVE_MMAP 1
+#endif
+
 
 
 /*****************************************************************
@@ -84,6 +84,7 @@ sre_random(void)
 	tbl[i] = rnd1-rnd2;
 	if (tbl[i] < 0) tbl[i] += m1;
       }
+      rnd          = 0;		/* so a reseed repeats a fresh start's numbers */
       sre_randseed = 0;		/* drop the flag. */
     }/* end of initialization*/
 
@@ -271,6 +272,37 @@ S160:
   goto S140;
 }
 
+
+/* Function: sre_ctr_random()
+ * 
+ * Purpose:  Return a uniform deviate x, 0.0 <= x < 1.0: number
+ *           ctr of the counter-based stream key (see
+ *           sre_ctr_random64() in sre_random.h). Unlike
+ *           sre_random(), this is threadsafe.
+ */
+double
+sre_ctr_random(unsigned long long key, unsigned long long ctr)
+{
+  return (double) (sre_ctr_random64(key, ctr) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/* Function: CtrGaussrandom()
+ * 
+ * Purpose:  Pick a Gaussian-distributed random variable with some
+ *           mean and standard deviation from the counter-based
+ *           stream key, by the Box-Muller transform of its
+ *           draws ctr and ctr+1. Threadsafe.
+ */
+double
+CtrGaussrandom(unsigned long long key, unsigned long long ctr, 
+	       double mean, double stddev)
+{
+  double u1, u2;
+
+  u1 = 1.0 - sre_ctr_random(key, ctr); /* (0,1], for the log */
+  u2 = sre_ctr_random(key, ctr+1);
+  return mean + stddev * sqrt(-2.0 * log(u1)) * cos(2.0 * 3.14159265358979323846 * u2);
+}
   
 /* Functions: DChoose(), FChoose()
  *
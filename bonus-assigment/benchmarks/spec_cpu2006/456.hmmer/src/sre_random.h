@@ -4,6 +4,8 @@
  * SRE, Tue Oct  1 15:24:29 2002
  * CVS $Id: sre_random.h,v 1.1 2002/10/09 14:26:09 eddy Exp $
  */
+#ifndef SRE_RANDOMH_INCLUDED
+#define SRE_RANDOMH_INCLUDED
 
 extern double sre_random(void);
 extern void   sre_srandom(int seed);
@@ -13,6 +15,33 @@ extern double Gaussrandom(double mean, double stddev);
 extern int    DChoose(double *p, int N);
 extern int    FChoose(float *p, int N);
 
+extern double sre_ctr_random(unsigned long long key, unsigned long long ctr);
+extern double CtrGaussrandom(unsigned long long key, unsigned long long ctr,
+			     double mean, double stddev);
+
 #define CHOOSE(a)   ((int) (sre_random() * (a)))
 
-  
+/* Function: sre_ctr_random64()
+ * 
+ * Purpose:  A counter-based generator: number ctr of the stream
+ *           key, as SplitMix64 would return it ctr+1 calls after
+ *           being seeded with key. It has no state, so draws can be
+ *           made in any order, by any thread, and a loop over ctr
+ *           has no dependence between iterations. Inline, so that
+ *           bulk samplers can fill whole arrays with it.
+ *           
+ * Reference: Steele, Lea & Flood, "Fast splittable pseudorandom
+ *           number generators", OOPSLA 2014.
+ */
+static inline unsigned long long
+sre_ctr_random64(unsigned long long key, unsigned long long ctr)
+{
+  unsigned long long z;
+
+  z = key + (ctr+1) * 0x9e3779b97f4a7c15ULL;
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+#endif /* SRE_RANDOMH_INCLUDED */
@@ -18,22 +18,31 @@
 #if !defined(SPEC_CPU_WINDOWS)
 #include <unistd.h>
 #endif /* SPEC_CPU_WINDOWS */
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#endif
 #include "squid.h"
 #include "ssi.h"
 
 static sqd_uint32 v20magic = 0xf3f3e9b1; /* SSI 1.0: "ssi1" + 0x80808080 */
 static sqd_uint32 v20swap  = 0xb1e9f3f3; /* byteswapped */
 
-static int read_i16(FILE *fp, sqd_uint16 *ret_result);
-static int read_i32(FILE *fp, sqd_uint32 *ret_result);
-static int read_i64(FILE *fp, sqd_uint64 *ret_result);
-static int read_offset(FILE *fp, char mode, SSIOFFSET *ret_offset);
+static int read_bytes(SSIFILE *sfp, void *buf, sqd_uint32 n);
+static int read_i16(SSIFILE *sfp, sqd_uint16 *ret_result);
+static int read_i32(SSIFILE *sfp, sqd_uint32 *ret_result);
+static int read_i64(SSIFILE *sfp, sqd_uint64 *ret_result);
+static int read_offset(SSIFILE *sfp, char mode, SSIOFFSET *ret_offset);
 static int write_i16(FILE *fp, sqd_uint16 n);
 static int write_i32(FILE *fp, sqd_uint32 n);
 static int write_i64(FILE *fp, sqd_uint64 n);
 static int write_offset(FILE *fp, SSIOFFSET *offset);
 static int binary_search(SSIFILE *sfp, char *key, int klen, SSIOFFSET *base, 
 			 sqd_uint32 recsize, sqd_uint32 maxidx);
+#ifdef HAVE_MMAP
+static void ssi_map(SSIFILE *sfp);
+static int  mapped_binary_search(SSIFILE *sfp, char *key, int klen, SSIOFFSET *base,
+				 sqd_uint32 recsize, sqd_uint32 maxidx);
+#endif
 static int indexfile_position(SSIFILE *sfp, SSIOFFSET *base, sqd_uint32 len,
 			      sqd_uint32 n);
 static void clear_ssifile(SSIFILE *sfp);
@@ -66,10 +75,48 @@ SSIOpen(char *filename, SSIFILE **ret_sfp)
     free(sfp);
     return SSI_ERR_NOFILE;    
   }
+  sfp->map = NULL;
   status = load_indexfile(sfp);
+#ifdef HAVE_MMAP
+  if (status == 0) ssi_map(sfp);
+#endif
   *ret_sfp = sfp;
   return status;
 }
+
+#ifdef HAVE_MMAP
+/* ssi_map(): map the whole of an opened index read-only, so key
+ *    lookups binary-search the sorted key records in place instead
+ *    of seeking and fread()ing each probe. Leaves sfp->map NULL, and
+ *    lookups on stdio, if it can't or if the key sections don't fit
+ *    in the file (a damaged index then fails as it always did).
+ */
+static void
+ssi_map(SSIFILE *sfp)
+{
+  struct stat st;
+  sqd_uint64  pend, send;
+  void       *map;
+
+  if (fstat(fileno(sfp->fp), &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0)
+    return;
+  if ((off_t) (size_t) st.st_size != st.st_size)
+    return;
+  pend = (sfp->imode == SSI_OFFSET_I64) ? sfp->poffset.off.i64 : sfp->poffset.off.i32;
+  send = (sfp->imode == SSI_OFFSET_I64) ? sfp->soffset.off.i64 : sfp->soffset.off.i32;
+  pend += (sqd_uint64) sfp->precsize * sfp->nprimary;
+  send += (sqd_uint64) sfp->srecsize * sfp->nsecondary;
+  if (pend > (sqd_uint64) st.st_size || send > (sqd_uint64) st.st_size)
+    return;
+  map = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fileno(sfp->fp), 0);
+  if (map == MAP_FAILED)
+    return;
+  posix_madvise(map, (size_t) st.st_size, POSIX_MADV_RANDOM);
+  sfp->map    = map;
+  sfp->maplen = (size_t) st.st_size;
+  sfp->mapoff = 0;
+}
+#endif /*HAVE_MMAP*/
 /* load_indexfile(): given a SSIFILE structure with an open and positioned 
  *    stream (fp) -- but no other data loaded -- read the next SSIFILE
  *    in from disk. We use this routine without its SSIOpen() wrapper
@@ -90,9 +137,9 @@ load_indexfile(SSIFILE *sfp)
   sfp->bpl        = NULL;
   sfp->rpl        = NULL;
   sfp->nfiles     = 0;          
-  if (! read_i32(sfp->fp, &magic))               {status = SSI_ERR_BADMAGIC;  goto FAILURE; }
+  if (! read_i32(sfp, &magic))               {status = SSI_ERR_BADMAGIC;  goto FAILURE; }
   if (magic != v20magic && magic != v20swap)     {status = SSI_ERR_BADMAGIC;  goto FAILURE; }
-  if (! read_i32(sfp->fp, &(sfp->flags))) goto FAILURE; 
+  if (! read_i32(sfp, &(sfp->flags))) goto FAILURE; 
 
   /* If we have 64-bit offsets, make sure we can deal with them.
    */
@@ -105,19 +152,19 @@ load_indexfile(SSIFILE *sfp)
   sfp->imode = (sfp->flags & SSI_USE64_INDEX) ? SSI_OFFSET_I64 : SSI_OFFSET_I32;
   sfp->smode = (sfp->flags & SSI_USE64) ?       SSI_OFFSET_I64 : SSI_OFFSET_I32;
 
-  if (! read_i16(sfp->fp, &(sfp->nfiles)))     goto FAILURE;
-  if (! read_i32(sfp->fp, &(sfp->nprimary)))   goto FAILURE;
-  if (! read_i32(sfp->fp, &(sfp->nsecondary))) goto FAILURE;
-  if (! read_i32(sfp->fp, &(sfp->flen)))       goto FAILURE;
-  if (! read_i32(sfp->fp, &(sfp->plen)))       goto FAILURE;
-  if (! read_i32(sfp->fp, &(sfp->slen)))       goto FAILURE;
-  if (! read_i32(sfp->fp, &(sfp->frecsize)))   goto FAILURE;
-  if (! read_i32(sfp->fp, &(sfp->precsize)))   goto FAILURE;
-  if (! read_i32(sfp->fp, &(sfp->srecsize)))   goto FAILURE;
+  if (! read_i16(sfp, &(sfp->nfiles)))     goto FAILURE;
+  if (! read_i32(sfp, &(sfp->nprimary)))   goto FAILURE;
+  if (! read_i32(sfp, &(sfp->nsecondary))) goto FAILURE;
+  if (! read_i32(sfp, &(sfp->flen)))       goto FAILURE;
+  if (! read_i32(sfp, &(sfp->plen)))       goto FAILURE;
+  if (! read_i32(sfp, &(sfp->slen)))       goto FAILURE;
+  if (! read_i32(sfp, &(sfp->frecsize)))   goto FAILURE;
+  if (! read_i32(sfp, &(sfp->precsize)))   goto FAILURE;
+  if (! read_i32(sfp, &(sfp->srecsize)))   goto FAILURE;
   
-  if (! read_offset(sfp->fp, sfp->imode, &(sfp->foffset))) goto FAILURE;
-  if (! read_offset(sfp->fp, sfp->imode, &(sfp->poffset))) goto FAILURE;
-  if (! read_offset(sfp->fp, sfp->imode, &(sfp->soffset))) goto FAILURE;
+  if (! read_offset(sfp, sfp->imode, &(sfp->foffset))) goto FAILURE;
+  if (! read_offset(sfp, sfp->imode, &(sfp->poffset))) goto FAILURE;
+  if (! read_offset(sfp, sfp->imode, &(sfp->soffset))) goto FAILURE;
 
   /* Read the file information and keep it.
    * We expect the number of files to be small, so reading it
@@ -141,11 +188,11 @@ load_indexfile(SSIFILE *sfp)
        */ 
       if (indexfile_position(sfp, &(sfp->foffset), sfp->frecsize, i) !=0)  goto FAILURE;
       if ((sfp->filename[i] =malloc(sizeof(char)*sfp->flen)) == NULL)        {status = SSI_ERR_MALLOC; goto FAILURE; }
-      if (fread(sfp->filename[i],sizeof(char),sfp->flen, sfp->fp)!=sfp->flen) goto FAILURE;
-      if (! read_i32(sfp->fp, &(sfp->fileformat[i])))                             goto FAILURE;
-      if (! read_i32(sfp->fp, &(sfp->fileflags[i])))                              goto FAILURE;
-      if (! read_i32(sfp->fp, &(sfp->bpl[i])))                                    goto FAILURE;
-      if (! read_i32(sfp->fp, &(sfp->rpl[i])))                                    goto FAILURE;
+      if (! read_bytes(sfp, sfp->filename[i], sfp->flen))                         goto FAILURE;
+      if (! read_i32(sfp, &(sfp->fileformat[i])))                             goto FAILURE;
+      if (! read_i32(sfp, &(sfp->fileflags[i])))                              goto FAILURE;
+      if (! read_i32(sfp, &(sfp->bpl[i])))                                    goto FAILURE;
+      if (! read_i32(sfp, &(sfp->rpl[i])))                                    goto FAILURE;
     }
   
   /* Success. Return 0.
@@ -194,9 +241,9 @@ SSIGetOffsetByName(SSIFILE *sfp, char *key, int *ret_fh,
   if (status == 0) {		
     /* We found it as a primary key; get our data & return.
      */
-    if (! read_i16(sfp->fp, &fnum)) return SSI_ERR_NODATA;
+    if (! read_i16(sfp, &fnum)) return SSI_ERR_NODATA;
     *ret_fh = (int) fnum;
-    if (! read_offset(sfp->fp, sfp->smode, ret_offset))  return SSI_ERR_NODATA;
+    if (! read_offset(sfp, sfp->smode, ret_offset))  return SSI_ERR_NODATA;
 
     return 0;	/* success! (we don't need the other key data) */
   } else if (status == SSI_ERR_NO_SUCH_KEY) {
@@ -208,7 +255,7 @@ SSIGetOffsetByName(SSIFILE *sfp, char *key, int *ret_fh,
 			     sfp->nsecondary);
       if (status != 0) return status;
       if ((pkey = malloc(sizeof(char) * sfp->plen)) == NULL) return SSI_ERR_MALLOC;
-      if (fread(pkey, sizeof(char), sfp->plen, sfp->fp) != sfp->plen) return SSI_ERR_NODATA;
+      if (! read_bytes(sfp, pkey, sfp->plen)) return SSI_ERR_NODATA;
 
       status = SSIGetOffsetByName(sfp, pkey, ret_fh, ret_offset);
       free(pkey);
@@ -249,9 +296,9 @@ SSIGetOffsetByNumber(SSIFILE *sfp, int n, int *ret_fh, SSIOFFSET *ret_offset)
     return SSI_ERR_SEEK_FAILED;
 
   if ((pkey = malloc(sizeof(char) * sfp->plen)) == NULL) return SSI_ERR_MALLOC;
-  if (fread(pkey, sizeof(char), sfp->plen, sfp->fp) != sfp->plen) return SSI_ERR_NODATA;
-  if (! read_i16(sfp->fp, &fnum))                      return SSI_ERR_NODATA;
-  if (! read_offset(sfp->fp, sfp->smode, ret_offset))  return SSI_ERR_NODATA;  
+  if (! read_bytes(sfp, pkey, sfp->plen)) return SSI_ERR_NODATA;
+  if (! read_i16(sfp, &fnum))                      return SSI_ERR_NODATA;
+  if (! read_offset(sfp, sfp->smode, ret_offset))  return SSI_ERR_NODATA;  
   *ret_fh = fnum;
   free(pkey);
   return 0;
@@ -311,8 +358,8 @@ SSIGetSubseqOffset(SSIFILE *sfp, char *key, int requested_start,
 
   /* Read the data we need for subseq lookup
    */
-  if (! read_offset(sfp->fp, sfp->smode, data_offset)) return SSI_ERR_NODATA;
-  if (! read_i32(sfp->fp, &len))                         return SSI_ERR_NODATA;
+  if (! read_offset(sfp, sfp->smode, data_offset)) return SSI_ERR_NODATA;
+  if (! read_i32(sfp, &len))                         return SSI_ERR_NODATA;
 
   /* Set up tmp variables for clarity of equations below,
    * and to make them match documentation (ssi-format.tex).
@@ -437,6 +484,9 @@ SSIClose(SSIFILE *sfp)
 {
   if (sfp != NULL) {
     clear_ssifile(sfp);
+#ifdef HAVE_MMAP
+    if (sfp->map      != NULL) munmap(sfp->map, sfp->maplen);
+#endif
     if (sfp->fp       != NULL) fclose(sfp->fp);
     free(sfp);
   }
@@ -1136,11 +1186,28 @@ SSIErrorString(int n)
   /*NOTREACHED*/
 }
 
+/* read_bytes(): the next n bytes of the index: from the mapping at
+ * sfp->mapoff if there is one, else from the stream.
+ */
+static int
+read_bytes(SSIFILE *sfp, void *buf, sqd_uint32 n)
+{
+#ifdef HAVE_MMAP
+  if (sfp->map != NULL) {
+    if (sfp->mapoff > sfp->maplen || n > sfp->maplen - sfp->mapoff) return 0;
+    memcpy(buf, sfp->map + sfp->mapoff, n);
+    sfp->mapoff += n;
+    return 1;
+  }
+#endif
+  if (fread(buf, sizeof(char), n, sfp->fp) != n) return 0;
+  return 1;
+}
 static int
-read_i16(FILE *fp, sqd_uint16 *ret_result)
+read_i16(SSIFILE *sfp, sqd_uint16 *ret_result)
 {
   sqd_uint16 result;
-  if (fread(&result, sizeof(sqd_uint16), 1, fp) != 1) return 0;
+  if (! read_bytes(sfp, &result, sizeof(sqd_uint16))) return 0;
   *ret_result = sre_ntoh16(result);
   return 1;
 }
@@ -1152,10 +1219,10 @@ write_i16(FILE *fp, sqd_uint16 n)
   return 1;
 }
 static int
-read_i32(FILE *fp, sqd_uint32 *ret_result)
+read_i32(SSIFILE *sfp, sqd_uint32 *ret_result)
 {
   sqd_uint32 result;
-  if (fread(&result, sizeof(sqd_uint32), 1, fp) != 1) return 0;
+  if (! read_bytes(sfp, &result, sizeof(sqd_uint32))) return 0;
   *ret_result = sre_ntoh32(result);
   return 1;
 }
@@ -1167,10 +1234,10 @@ write_i32(FILE *fp, sqd_uint32 n)
   return 1;
 }
 static int
-read_i64(FILE *fp, sqd_uint64 *ret_result)
+read_i64(SSIFILE *sfp, sqd_uint64 *ret_result)
 {
   sqd_uint64 result;
-  if (fread(&result, sizeof(sqd_uint64), 1, fp) != 1) return 0;
+  if (! read_bytes(sfp, &result, sizeof(sqd_uint64))) return 0;
   *ret_result = sre_ntoh64(result);
   return 1;
 }
@@ -1182,14 +1249,14 @@ write_i64(FILE *fp, sqd_uint64 n)
   return 1;
 }
 static int			
-read_offset(FILE *fp, char mode, SSIOFFSET *ret_offset)
+read_offset(SSIFILE *sfp, char mode, SSIOFFSET *ret_offset)
 {
   if (mode == SSI_OFFSET_I32) {
     ret_offset->mode = SSI_OFFSET_I32;
-    if (! read_i32(fp, &(ret_offset->off.i32))) return 0;
+    if (! read_i32(sfp, &(ret_offset->off.i32))) return 0;
   } else if (mode == SSI_OFFSET_I64) {
     ret_offset->mode = SSI_OFFSET_I64;
-    if (! read_i64(fp, &(ret_offset->off.i64))) return 0;
+    if (! read_i64(sfp, &(ret_offset->off.i64))) return 0;
   } else return 0;
 
   return 1;
@@ -1289,6 +1356,10 @@ binary_search(SSIFILE *sfp, char *key, int klen, SSIOFFSET *base,
   int          status;
   
   if (maxidx == 0) return SSI_ERR_NO_SUCH_KEY; /* special case: empty index */
+#ifdef HAVE_MMAP
+  if (sfp->map != NULL) 
+    return mapped_binary_search(sfp, key, klen, base, recsize, maxidx);
+#endif
   if ((name = malloc (sizeof(char)*klen)) == NULL) return SSI_ERR_MALLOC;
   left  = 0;
   right = maxidx-1;
@@ -1313,6 +1384,41 @@ binary_search(SSIFILE *sfp, char *key, int klen, SSIOFFSET *base,
   return 0;			/* and sfp->fp is positioned... */
 }
 
+#ifdef HAVE_MMAP
+/* mapped_binary_search(): binary_search() on the mapped index,
+ *    comparing {key} against each probed record where it lies.
+ *    ssi_map() checked that all key records are in the mapping.
+ *    On success sfp->mapoff is left at the rest of the key's data.
+ */
+static int
+mapped_binary_search(SSIFILE *sfp, char *key, int klen, SSIOFFSET *base,
+		     sqd_uint32 recsize, sqd_uint32 maxidx)
+{
+  sqd_uint64   start;
+  const char  *keys;
+  sqd_uint32   left, right, mid;
+  int          cmp;
+
+  start = (base->mode == SSI_OFFSET_I64) ? base->off.i64 : base->off.i32;
+  keys  = sfp->map + (size_t) start;
+  left  = 0;
+  right = maxidx-1;
+  while (1) {
+    mid = (left+right) / 2;
+    cmp = strncmp(keys + (size_t) mid * recsize, key, klen);
+    if      (cmp == 0) break;
+    else if (left >= right) return SSI_ERR_NO_SUCH_KEY;
+    else if (cmp < 0)       left  = mid+1;
+    else if (cmp > 0) {
+      if (mid == 0) return SSI_ERR_NO_SUCH_KEY;
+      else right = mid-1;
+    }
+  }
+  sfp->mapoff = (size_t) start + (size_t) mid * recsize + klen;
+  return 0;
+}
+#endif /*HAVE_MMAP*/
+
 /* Function: indexfile_position()
  * Date:     SRE, Mon Jan  1 19:32:49 2001 [St. Louis]
  *
@@ -1341,6 +1447,12 @@ indexfile_position(SSIFILE *sfp, SSIOFFSET *base, sqd_uint32 len, sqd_uint32 n)
     pos.mode    = SSI_OFFSET_I64;
     pos.off.i64 = base->off.i64 + n*len;
   } else return 0;
+#ifdef HAVE_MMAP
+  if (sfp->map != NULL) {
+    sfp->mapoff = (pos.mode == SSI_OFFSET_I64) ? (size_t) pos.off.i64 : (size_t) pos.off.i32;
+    return 0;
+  }
+#endif
   if ((status = SSISetFilePosition(sfp->fp, &pos)) != 0) return status;
   return 0;
 }
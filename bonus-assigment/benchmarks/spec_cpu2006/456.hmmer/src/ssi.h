@@ -72,6 +72,10 @@ struct ssifile_s {
   sqd_uint32  *fileflags;       /* optional per-file behavior flags    */
   sqd_uint32  *bpl;     	/* bytes per line in file              */
   sqd_uint32  *rpl;     	/* residues per line in file           */
+
+  char        *map;		/* HAVE_MMAP: index file mapped whole, or NULL */
+  size_t       maplen;		/* length of the mapping                       */
+  size_t       mapoff;		/* read position in it, in place of fp's       */
 };
 typedef struct ssifile_s SSIFILE;
 
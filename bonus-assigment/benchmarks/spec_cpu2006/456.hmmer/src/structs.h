@@ -202,6 +202,15 @@ struct plan7_s {
   int   *esc;			/* end transitions       [1.M]              -*/
   int  *tsc_mem, *msc_mem, *isc_mem, *bsc_mem, *esc_mem;
 
+  /* The same scores "compiled" for P7Viterbi() by P7Logoddsify():
+   * vsc[x] holds, for residue x, everything a DP row reads for
+   * node k, in stripes of P7_VSTRIPE nodes, one field after the
+   * other (VSC_IDX()); each row streams through one array. 
+   * Aligned to 64 bytes. Only valid if PLAN7_HASBITS is set.
+   */
+  int  **vsc;                   /* [0.MAXCODE-1][VSC_IDX(k,f)]               -*/
+  int   *vsc_mem;
+
   /* DNA translation scoring parameters
    * For aligning protein Plan7 models to DNA sequence.
    * Lookup value for a codon is calculated by pos1 * 16 + pos2 * 4 + pos3,
@@ -225,6 +234,27 @@ struct plan7_s {
   int flags;                    /* bit flags indicating state of HMM, valid data +*/
 };
 
+/* Fields of the compiled scores hmm->vsc[x] of a node k. Each is
+ * the score used in the recursion of cell k, so some are shifted:
+ * the transitions into M_k and D_k are those out of node k-1.
+ * Those that do not exist (I_M) are 0.
+ */
+#define P7_VSTRIPE 16		/* nodes per stripe: one AVX-512 vector */
+#define VSC_TMM  0		/* tsc[TMM][k-1]  */
+#define VSC_TIM  1		/* tsc[TIM][k-1]  */
+#define VSC_TDM  2		/* tsc[TDM][k-1]  */
+#define VSC_BSC  3		/* bsc[k]         */
+#define VSC_MSC  4		/* msc[x][k]      */
+#define VSC_ESC  5		/* esc[k]         */
+#define VSC_TMI  6		/* tsc[TMI][k]    */
+#define VSC_TII  7		/* tsc[TII][k]    */
+#define VSC_ISC  8		/* isc[x][k]      */
+#define VSC_TMD  9		/* tsc[TMD][k-1]  */
+#define VSC_TDD 10		/* tsc[TDD][k-1]  */
+#define VSC_NSC 11
+#define VSC_IDX(k, f) ((((k)-1) / P7_VSTRIPE) * (VSC_NSC * P7_VSTRIPE) + \
+                       (f) * P7_VSTRIPE + ((k)-1) % P7_VSTRIPE)
+
 /* Flags for plan7->flags.
  * Note: Some models have scores but no probabilities (for instance,
  *       after reading from an HMM save file). Other models have
@@ -325,6 +355,30 @@ struct dpshadow_s {
   int   *esrc;                  /* E trace is special; must store a M state number 1..M */
 };
 
+/* Declaration of the byte profile for the MSV prefilter (msvfilter.c).
+ * Scores are in 1/3 bit units; emissions are stored as costs
+ * bias - score, so the filter only needs saturating byte arithmetic.
+ */
+struct msvprofile_s {
+  int M;			/* length of the model                      */
+  unsigned char **rbv;		/* emission costs [0.Alphabet_iupac-1][1.M] */
+  int bias;			/* byte score of the best match emission    */
+  int tbm;			/* B->M_k cost, uniform local entry         */
+  int tec;			/* E->C and E->J cost                       */
+  float mu;			/* Gumbel mu of MSV bit scores              */
+  float lambda;			/* Gumbel lambda                            */
+};
+
+/* Declaration of an alias table for drawing residues in O(1)
+ * (alphabet.c): column j = floor(u n) keeps residue j with
+ * probability thresh[j] / 2^32, else takes alias[j].
+ */
+struct ralias_s {
+  int          n;		/* number of residues, Alphabet_size  */
+  unsigned int thresh[MAXABET];	/* keep threshold, 32-bit fixed point */
+  char         alias[MAXABET];	/* residue drawn otherwise            */
+};
+
 /* Structure: HMMFILE
  * 
  * Purpose:   An open HMM file or HMM library. See hmmio.c.
@@ -476,6 +530,7 @@ struct hit_s {
   char   *name;			/* name of the target               */
   char   *acc;			/* accession of the target          */
   char   *desc;			/* description of the target        */
+  int    seqidx;		/* index of the target in the db    */
   int    sqfrom;		/* start position in seq (1..N)     */
   int    sqto;			/* end position in seq (1..N)       */
   int    sqlen;			/* length of sequence (N)           */
@@ -500,6 +555,9 @@ struct tophit_s {
   int            alloc;		/* current allocation size                  */
   int            num;		/* number of hits in list now               */
   int            lump;       	/* allocation lumpsize                      */
+  int            alimit;	/* most alignments kept (-1: all)           */
+  int           *aheap;		/* min-heap of unsrt[] idx holding an ali   */
+  int            nheap;		/* number of entries in aheap               */
 };
 
 /* struct threshold_s 
@@ -523,6 +581,7 @@ struct threshold_s {
 				/* autosetting of cutoffs using Pfam annot: */
   enum { CUT_NONE, CUT_GA, CUT_NC, CUT_TC } autocut;
   int   Z;			/* nseq to base E value calculation on      */
+  double F1;			/* MSV prefilter P-value cutoff; >= 1: off  */
 };
 
 /**********************************************************
@@ -0,0 +1,63 @@
+/************************************************************
+ * HMMER - Biological sequence analysis with profile HMMs
+ * Copyright (C) 1992-2003 Washington University School of Medicine
+ * All Rights Reserved
+ *
+ *     This source code is distributed under the terms of the
+ *     GNU General Public License. See the files COPYING and LICENSE
+ *     for details.
+ ************************************************************/
+
+/* threads.c
+ *
+ * Support for the POSIX threads versions of hmmsearch and
+ * hmmcalibrate (HMMER_THREADS).
+ */
+
+#include "config.h"
+#include "squidconf.h"
+
+#ifdef HMMER_THREADS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "squid.h"
+#include "structs.h"
+#include "funcs.h"
+
+/* Function: ThreadNumber()
+ *
+ * Purpose:  Decide how many worker threads to run by default
+ *           (see HMMER_NCPU in config.h): the HMMER_NCPU
+ *           environment variable if it is set, else HMMER_NCPU
+ *           if it was defined at compile time, else the number
+ *           of online processors, else 2.
+ *
+ * Return:   number of threads, >= 1.
+ */
+int
+ThreadNumber(void)
+{
+  char *env;
+  long  num;
+
+  num = 0;
+  if ((env = getenv("HMMER_NCPU")) != NULL)
+    num = atol(env);
+#ifdef HMMER_NCPU
+  if (num <= 0)
+    num = HMMER_NCPU;
+#endif
+#ifdef _SC_NPROCESSORS_ONLN
+  if (num <= 0)
+    num = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+  if (num <= 0)
+    num = 2;
+  SQD_DPRINTF1(("ThreadNumber(): setting number of threads to %ld\n", num));
+  return (int) num;
+}
+
+#endif /* HMMER_THREADS */
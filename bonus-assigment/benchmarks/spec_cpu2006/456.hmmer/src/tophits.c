@@ -20,6 +20,8 @@
  * AllocTophits()       - allocation
  * FreeTophits()        - free'ing
  * RegisterHit()        - put information about a hit in the list
+ * TophitsAliLimit()    - keep alignments for the K best hits only
+ * MergeTophits()       - move the hits of one list into another
  * GetRankedHit()       - recovers information about a hit
  * FullSortTophits()    - sorts the top H hits.
  * 
@@ -85,12 +87,17 @@ AllocTophits(int lumpsize)
   hitlist->alloc = lumpsize;
   hitlist->num   = 0;
   hitlist->lump  = lumpsize; 
+  hitlist->alimit= -1;
+  hitlist->aheap = NULL;
+  hitlist->nheap = 0;
   return hitlist;
 }
 void
 GrowTophits(struct tophit_s *h)
 {
   h->unsrt = ReallocOrDie(h->unsrt,(h->alloc + h->lump) * sizeof(struct hit_s));
+  if (h->aheap != NULL)
+    h->aheap = ReallocOrDie(h->aheap, (h->alloc + h->lump) * sizeof(int));
   h->alloc += h->lump;
 }
 void
@@ -105,7 +112,8 @@ FreeTophits(struct tophit_s *h)
       if (h->unsrt[pos].desc != NULL) free(h->unsrt[pos].desc);
     }
   free(h->unsrt);
-  if (h->hit != NULL) free(h->hit);
+  if (h->hit   != NULL) free(h->hit);
+  if (h->aheap != NULL) free(h->aheap);
   free(h);
 }
 
@@ -134,6 +142,83 @@ FreeFancyAli(struct fancyali_s *ali)
     free(ali);
   }
 }
+
+/* Function: heap_up(), heap_down(), heap_add()
+ * 
+ * Purpose:  The min-heap (on sortkey) of the hits in h->unsrt
+ *           that still hold an alignment, used by TophitsAliLimit().
+ *           heap_add() puts hit <idx> on it, and once more than
+ *           2*alimit hits are there, frees the alignments of the
+ *           worst until alimit are left - but only whole groups
+ *           of equal keys, and only with at least alimit hits
+ *           strictly better than the group.
+ */
+static void
+heap_up(struct tophit_s *h, int n)
+{
+  int tmp;
+
+  while (n > 0 && 
+	 h->unsrt[h->aheap[n]].sortkey < h->unsrt[h->aheap[(n-1)/2]].sortkey)
+    {
+      tmp = h->aheap[n]; h->aheap[n] = h->aheap[(n-1)/2]; h->aheap[(n-1)/2] = tmp;
+      n   = (n-1)/2;
+    }
+}
+static void
+heap_down(struct tophit_s *h, int n)
+{
+  int c, tmp;
+
+  while ((c = 2*n+1) < h->nheap)
+    {
+      if (c+1 < h->nheap && 
+	  h->unsrt[h->aheap[c+1]].sortkey < h->unsrt[h->aheap[c]].sortkey)
+	c++;
+      if (h->unsrt[h->aheap[c]].sortkey >= h->unsrt[h->aheap[n]].sortkey) break;
+      tmp = h->aheap[n]; h->aheap[n] = h->aheap[c]; h->aheap[c] = tmp;
+      n   = c;
+    }
+}
+static void
+heap_add(struct tophit_s *h, int idx)
+{
+  double key;
+  int    n, g;
+
+  h->aheap[h->nheap] = idx;
+  heap_up(h, h->nheap);
+  h->nheap++;
+  if (h->nheap <= 2 * h->alimit) return;
+
+  while (h->nheap > h->alimit)
+    {
+      /* Pop the group of the smallest key; the popped entries
+       * collect at the end of aheap, past nheap.
+       */
+      key = h->unsrt[h->aheap[0]].sortkey;
+      g   = 0;
+      while (h->nheap > 0 && h->unsrt[h->aheap[0]].sortkey == key)
+	{
+	  n = h->aheap[0];
+	  h->nheap--;
+	  h->aheap[0]        = h->aheap[h->nheap];
+	  h->aheap[h->nheap] = n;
+	  heap_down(h, 0);
+	  g++;
+	}
+      if (h->nheap < h->alimit)
+	{			/* the group reaches into the top K: put it back */
+	  for (; g > 0; g--) heap_up(h, h->nheap++);
+	  break;
+	}
+      for (n = h->nheap; n < h->nheap + g; n++)
+	{
+	  FreeFancyAli(h->unsrt[h->aheap[n]].ali);
+	  h->unsrt[h->aheap[n]].ali = NULL;
+	}
+    }
+}
     
 /* Function: RegisterHit()
  * 
@@ -159,6 +244,9 @@ FreeFancyAli(struct fancyali_s *ali)
  *           name     - name of target  
  *           acc      - accession of target (may be NULL)
  *           desc     - description of target (may be NULL) 
+ *           seqidx   - index of target in the database; breaks ties
+ *                      of key, so the ranks don't depend on the order
+ *                      the hits were registered in
  *           sqfrom   - 1..L pos in target seq  of start
  *           sqto     - 1..L pos; sqfrom > sqto if rev comp
  *           sqlen    - length of sequence, L
@@ -175,7 +263,7 @@ FreeFancyAli(struct fancyali_s *ali)
 void
 RegisterHit(struct tophit_s *h, double key, 
 	    double pvalue, float score, double motherp, float mothersc,
-	    char *name, char *acc, char *desc, 
+	    char *name, char *acc, char *desc, int seqidx,
 	    int sqfrom, int sqto, int sqlen,
 	    int hmmfrom, int hmmto, int hmmlen, 
 	    int domidx, int ndom,
@@ -188,6 +276,7 @@ RegisterHit(struct tophit_s *h, double key,
   h->unsrt[h->num].name    = Strdup(name);
   h->unsrt[h->num].acc     = Strdup(acc);
   h->unsrt[h->num].desc    = Strdup(desc);
+  h->unsrt[h->num].seqidx  = seqidx;
   h->unsrt[h->num].sortkey = key;
   h->unsrt[h->num].pvalue  = pvalue;
   h->unsrt[h->num].score   = score;
@@ -203,9 +292,62 @@ RegisterHit(struct tophit_s *h, double key,
   h->unsrt[h->num].ndom    = ndom;
   h->unsrt[h->num].ali     = ali;
   h->num++; 
+  if (ali != NULL && h->alimit >= 0) heap_add(h, h->num-1);
   return;
 }
 
+/* Function: TophitsAliLimit()
+ * 
+ * Purpose:  Tell a hit list that only the alignments of its K
+ *           best hits (by sortkey) will ever be looked at, so
+ *           RegisterHit() can free the others as better hits
+ *           come in instead of holding on to every one of them.
+ *           A freed alignment reads back as NULL from
+ *           GetRankedHit(). Hits tied with the K'th best keep
+ *           theirs, so it doesn't matter how a sort orders them.
+ *
+ *           Call it before the first hit is registered. The list
+ *           holds at most 2K alignments (plus ties) at any time.
+ *           
+ * Args:     h - top hit list, still empty
+ *           K - number of best alignments to keep, >= 0
+ */
+void
+TophitsAliLimit(struct tophit_s *h, int K)
+{
+  h->alimit = K;
+  if (h->aheap == NULL) h->aheap = MallocOrDie(h->alloc * sizeof(int));
+  h->nheap  = 0;
+}
+
+/* Function: MergeTophits()
+ * 
+ * Purpose:  Move every hit of src to the end of dest, e.g. to
+ *           fold a thread's own hit list into the shared one.
+ *           Names and alignments change hands rather than being
+ *           copied; dest's alignment limit applies to them.
+ *           src is left empty, ready for more hits.
+ *           
+ * Args:     dest - hit list to add to
+ *           src  - hit list to empty; not sorted yet
+ */
+void
+MergeTophits(struct tophit_s *dest, struct tophit_s *src)
+{
+  int pos;
+
+  for (pos = 0; pos < src->num; pos++)
+    {
+      if (dest->num == dest->alloc) GrowTophits(dest);
+      dest->unsrt[dest->num] = src->unsrt[pos];
+      dest->num++;
+      if (dest->unsrt[dest->num-1].ali != NULL && dest->alimit >= 0)
+	heap_add(dest, dest->num-1);
+    }
+  src->num   = 0;
+  src->nheap = 0;
+}
+
 /* Function: GetRankedHit()
  * Date:     SRE, Tue Oct 28 10:06:48 1997 [Newton Institute, Cambridge UK]
  * 
@@ -281,6 +423,11 @@ hit_comparison(const void *vh1, const void *vh2)
 
   if      (h1->sortkey < h2->sortkey)  return  1;
   else if (h1->sortkey > h2->sortkey)  return -1;
+				/* ties: database order, then domain order */
+  else if (h1->seqidx  < h2->seqidx)   return -1;
+  else if (h1->seqidx  > h2->seqidx)   return  1;
+  else if (h1->domidx  < h2->domidx)   return -1;
+  else if (h1->domidx  > h2->domidx)   return  1;
   else if (h1->sortkey == h2->sortkey) return  0;
   /*NOTREACHED*/
   return 0;
@@ -170,6 +170,10 @@ xbool is_attacked (int square, int color) {
   register int ndir, a_sq;
   register int basq, i;
 
+#ifdef SJENG_BITBOARD
+  if (board[square] != frame) return bb_attacked (square, color, TRUE);
+#endif
+
   /* white attacker: */
   if (color&1) {
     
@@ -272,6 +276,10 @@ xbool nk_attacked (int square, int color) {
   register int ndir, a_sq;
   register int basq, i;
 
+#ifdef SJENG_BITBOARD
+  if (board[square] != frame) return bb_attacked (square, color, FALSE);
+#endif
+
   /* white attacker: */
   if (color&1) {
     
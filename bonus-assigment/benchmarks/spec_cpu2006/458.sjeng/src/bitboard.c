@@ -0,0 +1,430 @@
+/*
+    Sjeng - a chess variants playing program
+    Copyright (C) 2000-2003 Gian-Carlo Pascutto
+
+    File: bitboard.c
+    Purpose: bitboard attack tables, next to the 144-square board
+
+*/
+
+/* Built with -DSJENG_BITBOARD (make bitboard), a 64-bit board per
+   piece and one of all occupied squares ride along with board[].
+   board[] stays the position everything else reads, eval included;
+   the bitboards follow it through the Hash() macro, which make()
+   and unmake() already apply to every piece they put on or take off
+   a square, and are rebuilt from it by bb_reset() whenever the hash
+   is (initialize_hash()).
+
+   is_attacked() and nk_attacked(), and so in_check() and the
+   legality checks, look the sliders up in magic tables (PEXT ones
+   when built for BMI2), the sliding move generation finds the end
+   of each ray with one bit scan, and SEE takes the first piece on
+   each line the same way. Those keep the order in which the mailbox
+   code visits squares and directions, so the moves and scores come
+   out as before. std_eval () takes the pawn files and the piece
+   material of its first pass from the boards instead of a sweep of
+   pieces[]. */
+
+#include "sjeng.h"
+#include "protos.h"
+#include "extvars.h"
+
+#ifdef SJENG_BITBOARD
+
+#ifdef __BMI2__
+#include <immintrin.h>
+#endif
+
+SJENG_TLS bitboard bb_piece[14];
+SJENG_TLS bitboard bb_occ;
+bitboard bb_sq144[144];                 /* a square's bit, 0 on the frame */
+
+static int sq64[144];                   /* -1 on the frame */
+static int sq144[64];
+
+/* directions, as offsets on the 144-square board */
+static const int bb_offset[8] = {12, -12, 1, -1, 13, 11, -11, -13};
+static bitboard ray[8][64];
+static bitboard knight_bb[64], king_bb[64];
+static bitboard pawn_from[2][64];       /* where a black/white pawn attacks s from */
+
+typedef struct
+{
+  bitboard mask;
+  bitboard magic;
+  bitboard *att;
+  int shift;
+} magic_t;
+
+static magic_t rook_magic[64], bishop_magic[64];
+static bitboard rook_table[102400], bishop_table[5248];
+
+#ifdef __BMI2__
+#define MAGIC_INDEX(m, occ) _pext_u64((occ), (m)->mask)
+#define MAGIC(x) 0
+#else
+#define MAGIC_INDEX(m, occ) ((((occ) & (m)->mask) * (m)->magic) >> (m)->shift)
+#define MAGIC(x) (x)
+#endif
+
+#define bb_lsb(b) __builtin_ctzll(b)
+#define bb_msb(b) (63 - __builtin_clzll(b))
+
+/* the square of b nearest to the start of a ray along d */
+#define bb_nearest(d, b) (bb_offset[(d)] > 0 ? bb_lsb(b) : bb_msb(b))
+
+
+static int on_board (int sq) {
+
+  int f = sq % 12, r = sq / 12;
+
+  return (f >= 2 && f <= 9 && r >= 2 && r <= 9);
+}
+
+
+static bitboard offsets_bb (int sq, const int *o, int n) {
+
+  bitboard b = 0;
+  int i;
+
+  for (i = 0; i < n; i++)
+    if (on_board(sq + o[i]))
+      b |= bb_sq144[sq + o[i]];
+  return b;
+}
+
+
+/* attacks of a slider on s along the directions first..last, with
+   the pieces of occ in the way: the slow way, for building tables */
+static bitboard slide (int s, bitboard occ, int first, int last) {
+
+  bitboard a = 0, r;
+  int d;
+
+  for (d = first; d <= last; d++)
+    {
+      r = ray[d][s];
+      if (r & occ)
+	r ^= ray[d][bb_nearest(d, r & occ)];
+      a |= r;
+    }
+  return a;
+}
+
+
+#ifndef __BMI2__
+/* found by trying sparse random numbers until one maps every set
+   of blockers of a square to its own entry, or to one with the same
+   attacks */
+static const bitboard rook_magics[64] = {
+  0x1080004008801020ULL, 0x0840092002c03000ULL, 0x1900200010400900ULL,
+  0x0880100008000480ULL, 0x4200100420080200ULL, 0x8100020100080400ULL,
+  0x0200040110886200ULL, 0x0200008040220411ULL, 0x0404800084400220ULL,
+  0x0000401000402000ULL, 0x0086001081220440ULL, 0x0408800800100280ULL,
+  0x000a001201040820ULL, 0x8848800200840080ULL, 0x4001000100040200ULL,
+  0x0442000102105084ULL, 0x9080010020804100ULL, 0x0040404000201009ULL,
+  0x0000808010002009ULL, 0x2200090021d00100ULL, 0x0008008008040080ULL,
+  0x0004004002010040ULL, 0x0011040008015042ULL, 0x00000a0001768104ULL,
+  0x0000800080204009ULL, 0x2010004140002001ULL, 0x9800200280100080ULL,
+  0x1000100080080080ULL, 0x0050500500080100ULL, 0x0000020080040080ULL,
+  0x0c10010400420810ULL, 0x1040008200005104ULL, 0x01808240088004a0ULL,
+  0x0882804004802000ULL, 0x0880402001001100ULL, 0x2000210409001000ULL,
+  0x2000480131001500ULL, 0x0000800400800200ULL, 0x000002380c001003ULL,
+  0x4600084882000431ULL, 0x0080002000504000ULL, 0x0300500020004002ULL,
+  0x0040408200220011ULL, 0x0010040008004040ULL, 0x0000080004008080ULL,
+  0x0010040002008080ULL, 0x2012004881020004ULL, 0x8300842444820011ULL,
+  0x0088403882010200ULL, 0x0820400080210100ULL, 0x0110910040a00300ULL,
+  0x0801100280080480ULL, 0x0242009008200600ULL, 0x1002000489500200ULL,
+  0x0040800200010080ULL, 0x0091800041000080ULL, 0x0000209300488001ULL,
+  0x04c1002414824001ULL, 0x020020000b001041ULL, 0x7000100004200901ULL,
+  0x8002002004100802ULL, 0x30010002084c0007ULL, 0x0888221800813004ULL,
+  0x4000002840840112ULL
+};
+
+static const bitboard bishop_magics[64] = {
+  0x20c0090901061081ULL, 0x0024040094030104ULL, 0x8210810200290200ULL,
+  0x0011040484620000ULL, 0x0081104002221000ULL, 0x0009012011001350ULL,
+  0x0081010802400380ULL, 0x0000420210010408ULL, 0x0008105002280050ULL,
+  0x0001028484040044ULL, 0x2a00880810408804ULL, 0x7020022282000100ULL,
+  0x0084040420100a50ULL, 0x000401010840e000ULL, 0x2020020210420888ULL,
+  0x0008084202012010ULL, 0x2010400810018800ULL, 0x0445122008020840ULL,
+  0x0804100808002008ULL, 0x0008002104110100ULL, 0x0061005820080800ULL,
+  0x2001000200820100ULL, 0x480c210084010800ULL, 0x3004442500480420ULL,
+  0x1010102240048100ULL, 0x00182009084220a3ULL, 0x8803090a10004205ULL,
+  0x0208080040202020ULL, 0x000c044084010040ULL, 0x00a1010002004106ULL,
+  0x6008210020640202ULL, 0x1600902112860801ULL, 0x00042008c1220200ULL,
+  0x010c042002440140ULL, 0x5022080200040820ULL, 0x0402004042940100ULL,
+  0x0860108400008020ULL, 0x000c080022021000ULL, 0x0264080652822100ULL,
+  0x4005031221010401ULL, 0x0004502410008400ULL, 0x000500b010a20400ULL,
+  0x0415094050080800ULL, 0x080000201800a104ULL, 0x4022a80304000110ULL,
+  0x4012140802028020ULL, 0x40200104010100a0ULL, 0x12810806008b0c41ULL,
+  0x0020441008080000ULL, 0x2002120084045420ULL, 0x0704020062080002ULL,
+  0x0000001084040001ULL, 0x0322200891240200ULL, 0xf040200210024800ULL,
+  0x0140824832008042ULL, 0x000210020a004602ULL, 0x0083042805141020ULL,
+  0x002c12009a011000ULL, 0x0041a00044140400ULL, 0x00004004020a0202ULL,
+  0x0000140010020210ULL, 0x2864160811012200ULL, 0x2060080841082a17ULL,
+  0xa010041108003100ULL
+};
+#endif
+
+
+static void init_magic (magic_t *m, bitboard *table, bitboard magic,
+			int s, int first, int last) {
+
+  bitboard b, r;
+  int d;
+
+  /* the squares that can block, i.e. each ray less its last square */
+  m->mask = 0;
+  for (d = first; d <= last; d++)
+    {
+      r = ray[d][s];
+      if (r)
+	r &= ~(1ULL << (bb_offset[d] > 0 ? bb_msb(r) : bb_lsb(r)));
+      m->mask |= r;
+    }
+  m->shift = 64 - __builtin_popcountll(m->mask);
+  m->magic = magic;
+  m->att = table;
+
+  /* every subset of the mask, by the carry-rippler */
+  b = 0;
+  do
+    {
+      table[MAGIC_INDEX(m, b)] = slide(s, b, first, last);
+      b = (b - m->mask) & m->mask;
+    }
+  while (b);
+}
+
+
+void init_bitboards (void) {
+
+  static const int knight_o[8] = {10, -10, 14, -14, 23, -23, 25, -25};
+  static const int king_o[8] = {12, -12, 1, -1, 13, 11, -11, -13};
+  static const int bpawn_o[2] = {11, 13};
+  static const int wpawn_o[2] = {-11, -13};
+  bitboard *rt = rook_table, *bt = bishop_table;
+  int sq, s, d, t;
+
+  for (sq = 0; sq < 144; sq++)
+    {
+      sq64[sq] = -1;
+      bb_sq144[sq] = 0;
+      if (on_board(sq))
+	{
+	  s = (sq / 12 - 2) * 8 + (sq % 12 - 2);
+	  sq64[sq] = s;
+	  sq144[s] = sq;
+	  bb_sq144[sq] = 1ULL << s;
+	}
+    }
+
+  for (s = 0; s < 64; s++)
+    {
+      sq = sq144[s];
+      for (d = 0; d < 8; d++)
+	{
+	  ray[d][s] = 0;
+	  for (t = sq + bb_offset[d]; on_board(t); t += bb_offset[d])
+	    ray[d][s] |= bb_sq144[t];
+	}
+      knight_bb[s] = offsets_bb(sq, knight_o, 8);
+      king_bb[s] = offsets_bb(sq, king_o, 8);
+      pawn_from[0][s] = offsets_bb(sq, bpawn_o, 2);
+      pawn_from[1][s] = offsets_bb(sq, wpawn_o, 2);
+    }
+
+  /* rook directions are 0-3, bishop ones 4-7 */
+  for (s = 0; s < 64; s++)
+    {
+      init_magic(&rook_magic[s], rt, MAGIC(rook_magics[s]), s, 0, 3);
+      rt += 1 << (64 - rook_magic[s].shift);
+      init_magic(&bishop_magic[s], bt, MAGIC(bishop_magics[s]), s, 4, 7);
+      bt += 1 << (64 - bishop_magic[s].shift);
+    }
+}
+
+
+void bb_reset (void) {
+
+  int sq;
+
+  memset(bb_piece, 0, sizeof(bb_piece));
+  bb_occ = 0;
+
+  for (sq = 0; sq < 144; sq++)
+    if (board[sq] != npiece && board[sq] != frame)
+      {
+	bb_piece[board[sq]] |= bb_sq144[sq];
+	bb_occ |= bb_sq144[sq];
+      }
+}
+
+
+xbool bb_attacked (int square, int color, xbool with_king) {
+
+  /* is_attacked() (nk_attacked() without the king) for a square on
+     the board, color&1 being the attacking side as there */
+
+  int s = sq64[square];
+  const magic_t *rm = &rook_magic[s], *bm = &bishop_magic[s];
+
+  if (color & 1)
+    {
+      if (pawn_from[1][s] & bb_piece[wpawn]) return TRUE;
+      if (knight_bb[s] & bb_piece[wknight]) return TRUE;
+      if (with_king && (king_bb[s] & bb_piece[wking])) return TRUE;
+      if (bm->att[MAGIC_INDEX(bm, bb_occ)] & (bb_piece[wbishop] | bb_piece[wqueen]))
+	return TRUE;
+      if (rm->att[MAGIC_INDEX(rm, bb_occ)] & (bb_piece[wrook] | bb_piece[wqueen]))
+	return TRUE;
+    }
+  else
+    {
+      if (pawn_from[0][s] & bb_piece[bpawn]) return TRUE;
+      if (knight_bb[s] & bb_piece[bknight]) return TRUE;
+      if (with_king && (king_bb[s] & bb_piece[bking])) return TRUE;
+      if (bm->att[MAGIC_INDEX(bm, bb_occ)] & (bb_piece[bbishop] | bb_piece[bqueen]))
+	return TRUE;
+      if (rm->att[MAGIC_INDEX(rm, bb_occ)] & (bb_piece[brook] | bb_piece[bqueen]))
+	return TRUE;
+    }
+  return FALSE;
+}
+
+
+int bb_direction (int offset) {
+
+  /* the direction of a king-step offset */
+  static const signed char dir[27] =
+    {7, 1, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, 3,
+     -1, 2, -1, -1, -1, -1, -1, -1, -1, -1, -1, 5, 0, 4};
+
+  return dir[offset + 13];
+}
+
+
+int bb_first (int square, int d) {
+
+  /* the first occupied square from square along d, 0 for none */
+
+  bitboard b = ray[d][sq64[square]] & bb_occ;
+
+  return b ? sq144[bb_nearest(d, b)] : 0;
+}
+
+
+int bb_ray (int square, int d, int *targets) {
+
+  /* the empty squares from square along d, nearest first, and then
+     the piece that ends the ray if there is one; returns how many */
+
+  bitboard r = ray[d][sq64[square]], b = r & bb_occ;
+  int n = 0;
+
+  if (b)
+    r ^= ray[d][bb_nearest(d, b)];
+  while (r)
+    {
+      if (bb_offset[d] > 0)
+	{
+	  targets[n++] = sq144[bb_lsb(r)];
+	  r &= r - 1;
+	}
+      else
+	{
+	  targets[n++] = sq144[bb_msb(r)];
+	  r ^= 1ULL << bb_msb(r);
+	}
+    }
+  return n;
+}
+
+
+int bb_knights (int square, int *targets) {
+
+  /* the squares of the knights, of either side, attacking square;
+     only those on bb_occ, which see() takes the capturer off */
+
+  bitboard b = knight_bb[sq64[square]] & bb_occ
+    & (bb_piece[wknight] | bb_piece[bknight]);
+  int n = 0;
+
+  while (b)
+    {
+      targets[n++] = sq144[bb_lsb(b)];
+      b &= b - 1;
+    }
+  return n;
+}
+
+
+int bb_piece_material (int color) {
+
+  /* the material of color's pieces, pawns and king left out, as
+     std_eval's first pass counts it */
+
+  static const int white[4] = {wknight, wbishop, wrook, wqueen};
+  static const int black[4] = {bknight, bbishop, brook, bqueen};
+  const int *p = (color == WHITE) ? white : black;
+  int i, mat = 0;
+
+  for (i = 0; i < 4; i++)
+    mat += __builtin_popcountll(bb_piece[p[i]]) * abs(material[p[i]]);
+  return mat;
+}
+
+
+void bb_pawn_files (int pawns[2][11], int white_back_pawn[11], int black_back_pawn[11]) {
+
+  /* std_eval's pawn counts per file (file+1, [1] white) and the
+     rank of each side's rearmost pawn on it, from the pawn boards */
+
+  bitboard w, b;
+  int f, r;
+
+  for (f = 0; f < 8; f++)
+    {
+      w = bb_piece[wpawn] & (0x0101010101010101ULL << f);
+      b = bb_piece[bpawn] & (0x0101010101010101ULL << f);
+
+      if (w)
+	{
+	  pawns[1][f+2] = __builtin_popcountll(w);
+	  r = bb_lsb(w) / 8 + 1;
+	  if (r < white_back_pawn[f+2]) white_back_pawn[f+2] = r;
+	}
+      if (b)
+	{
+	  pawns[0][f+2] = __builtin_popcountll(b);
+	  r = bb_msb(b) / 8 + 1;
+	  if (r > black_back_pawn[f+2]) black_back_pawn[f+2] = r;
+	}
+    }
+}
+
+unsigned int bb_pawn_key (void) {
+
+  /* the Zobrist key of the pawns alone, for the pawn hash */
+
+  bitboard p;
+  unsigned int key = 0;
+
+  for (p = bb_piece[wpawn]; p; p &= p - 1)
+    key ^= zobrist[wpawn][sq144[bb_lsb(p)]];
+  for (p = bb_piece[bpawn]; p; p &= p - 1)
+    key ^= zobrist[bpawn][sq144[bb_lsb(p)]];
+
+  return key;
+}
+
+#else /* no SJENG_BITBOARD: the mailbox alone */
+
+void init_bitboards (void) {
+}
+
+void bb_reset (void) {
+}
+
+#endif /* SJENG_BITBOARD */
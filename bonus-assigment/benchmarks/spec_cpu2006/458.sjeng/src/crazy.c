@@ -12,18 +12,18 @@
 #include "protos.h"
 #include "extvars.h"
 
-int holding[2][16];
-int num_holding[2];
+SJENG_TLS int holding[2][16];
+SJENG_TLS int num_holding[2];
 
 char realholdings[255];
 int userealholdings;
 
-int drop_piece;
+SJENG_TLS int drop_piece;
 
-int white_hand_eval;
-int black_hand_eval;
+SJENG_TLS int white_hand_eval;
+SJENG_TLS int black_hand_eval;
 
-unsigned int hold_hash;
+SJENG_TLS hashkey_t hold_hash;
 
 #define HHash(x,y)  (hold_hash ^= zobrist[(x)][(y)])
 
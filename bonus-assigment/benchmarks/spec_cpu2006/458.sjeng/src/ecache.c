@@ -3,7 +3,7 @@
     Copyright (C) 2000-2003 Gian-Carlo Pascutto
 
     File: ecache.c                                             
-    Purpose: handling of the evaluation cache
+    Purpose: handling of the evaluation cache and the pawn hash
 
 */
 
@@ -13,25 +13,43 @@
 
 typedef struct  
 {
-    unsigned int stored_hash;
-    unsigned int hold_hash;
+    hashkey_t lock;               /* HashLock(hash, hold_hash) */
     int score;
 } ECacheType;
 
 
-ECacheType *ECache;
+/* one cache per search thread (see smp.c) */
+SJENG_TLS ECacheType *ECache;
 
-unsigned int ECacheProbes;
-unsigned int ECacheHits;
+SJENG_TLS unsigned int ECacheProbes;
+SJENG_TLS unsigned int ECacheHits;
+
+/* std_eval's pawn structure terms depend on the pawns alone, and
+   the pawns change in few of the moves searched: keep them under
+   the Zobrist key of the pawns, with the passed pawns whose
+   queening race still needs the kings. Direct-mapped, 24 bytes
+   an entry, small enough to stay in cache. */
+#define PAWN_HASH_SIZE (1 << 14)
+
+typedef struct
+{
+    unsigned int pawn_hash;
+    int score;
+    unsigned char passed[2][8];   /* squares, 0 ends the list */
+} PawnHashType;
+
+SJENG_TLS PawnHashType *PawnHash;
+
+SJENG_TLS unsigned int PawnHashProbes;
+SJENG_TLS unsigned int PawnHashHits;
 
 void storeECache(int score)
 {
   int ecindex;
 
-  ecindex = hash % ECacheSize;
+  ecindex = (unsigned int) hash % ECacheSize;
 
-  ECache[ecindex].stored_hash = hash;
-  ECache[ecindex].hold_hash = hold_hash;
+  ECache[ecindex].lock = HashLock(hash, hold_hash);
   ECache[ecindex].score = score;
 }
 
@@ -41,10 +59,9 @@ void checkECache(int *score, int *in_cache)
 
   ECacheProbes++;
 
-  ecindex = hash % ECacheSize;
+  ecindex = (unsigned int) hash % ECacheSize;
 
-  if(ECache[ecindex].stored_hash == hash &&
-	  ECache[ecindex].hold_hash == hold_hash)
+  if(ECache[ecindex].lock == HashLock(hash, hold_hash))
     
     {
       ECacheHits++;  
@@ -54,9 +71,41 @@ void checkECache(int *score, int *in_cache)
     }
 }
 
+void storePawnHash(unsigned int key, int score, unsigned char passed[2][8])
+{
+  PawnHashType *p;
+
+  p = &PawnHash[key & (PAWN_HASH_SIZE - 1)];
+
+  p->pawn_hash = key;
+  p->score = score;
+  memcpy(p->passed, passed, sizeof(p->passed));
+}
+
+void checkPawnHash(unsigned int key, int *score, unsigned char passed[2][8],
+		   int *in_cache)
+{
+  PawnHashType *p;
+
+  PawnHashProbes++;
+
+  p = &PawnHash[key & (PAWN_HASH_SIZE - 1)];
+
+  /* an empty entry is the right one for no pawns, key 0 */
+  if (p->pawn_hash == key)
+    {
+      PawnHashHits++;
+
+      *in_cache = 1;
+      *score = p->score;
+      memcpy(passed, p->passed, sizeof(p->passed));
+    }
+}
+
 void reset_ecache(void)
 {
   memset(ECache, 0, sizeof(ECacheType) * ECacheSize );
+  memset(PawnHash, 0, sizeof(PawnHashType) * PAWN_HASH_SIZE);
   return;
 }
 
@@ -69,6 +118,14 @@ void alloc_ecache(void)
     printf("Out of memory allocating ECache.\n");
     exit(EXIT_FAILURE);
   }
+
+  PawnHash = (PawnHashType*)malloc(sizeof(PawnHashType)*PAWN_HASH_SIZE);
+
+  if (PawnHash == NULL)
+  {
+    printf("Out of memory allocating pawn hash.\n");
+    exit(EXIT_FAILURE);
+  }
   
 /*  printf("Allocated %i eval cache entries, totalling %i bytes.\n",
           ECacheSize, (int)sizeof(ECacheType)*ECacheSize);
@@ -79,5 +136,6 @@ void alloc_ecache(void)
 void free_ecache(void)
 {
   free(ECache);
+  free(PawnHash);
   return;
 }
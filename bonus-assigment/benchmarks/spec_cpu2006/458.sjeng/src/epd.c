@@ -256,6 +256,9 @@ void run_epd_testsuite(void)
       printf("ECacheProbes : %u   ECacheHits : %u   HitRate : %f%%\n", 
 	     ECacheProbes, ECacheHits, 
 	     ((float)ECacheHits/((float)ECacheProbes+1)) * 100);
+      printf("PawnHashProbes : %u   PawnHashHits : %u   HitRate : %f%%\n", 
+	     PawnHashProbes, PawnHashHits, 
+	     ((float)PawnHashHits/((float)PawnHashProbes+1)) * 100);
       
       printf("TTStores : %u TTProbes : %u   TTHits : %u   HitRate : %f%%\n", 
 	     TTStores, TTProbes, TTHits, 
@@ -309,6 +312,7 @@ void run_autotest(char *testset)
 	if (testsuite == NULL) exit(EXIT_FAILURE);
 
 	start = rtime();
+	ROI_BEGIN();
 	
 	while (fgets(readbuff, STR_BUFF, testsuite) != NULL)
  	{
@@ -332,6 +336,7 @@ void run_autotest(char *testset)
 		fixed_time = INF;
 		comp_move = think();
 	}
+	ROI_END();
 		
 	end = rtime();
 /*        printf("Total elapsed: %i.%02i seconds\n", rdifftime(end, start)/100,
@@ -341,3 +346,97 @@ void run_autotest(char *testset)
 	exit(EXIT_SUCCESS);
 }
 
+
+/* the bench positions: the two of data/test.txt, the usual movegen
+   test positions and a pawn ending for the hash tables */
+static const char *bench_suite[] =
+{
+  "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq -",
+  "r3kb1r/3n1pp1/p6p/2pPp2q/Pp2N3/3B2PP/1PQ2P2/R3K2R w KQkq -",
+  "1k1r3r/pp2qpp1/3b1n1p/3pNQ2/2pP1P2/2N1P3/PP4PP/1K1RR3 b - -",
+  "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q2/PPPBBPPP/R3K2R w KQkq -",
+  "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq -",
+  "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ -",
+  "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - -",
+  "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - -",
+  "8/k7/3p4/p2P1p2/P2P1P2/8/8/K7 w - -",
+  NULL
+};
+
+#define BENCH_DEPTH 8
+
+double bench_now (void) {
+
+  struct timespec t;
+
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+void run_bench(int depth)
+{
+  /* search every bench position to a fixed depth from empty tables
+     and print one line per position, and one for the suite, of
+     key=value pairs that scripts can compare commit over commit */
+
+  char readbuff[STR_BUFF];
+  char san[STR_BUFF];
+  double start, secs, total_secs;
+  double total_nodes;
+  unsigned int total_evals, total_probes, total_hits;
+  int n, oldpost, oldmaxdepth, oldfixed;
+  move_s comp_move;
+
+  if (depth <= 0)
+    depth = BENCH_DEPTH;
+
+  oldpost = post;
+  oldmaxdepth = maxdepth;
+  oldfixed = fixed_time;
+  post = FALSE;
+  maxdepth = depth;
+
+  total_secs = 0;
+  total_nodes = 0;
+  total_evals = total_probes = total_hits = 0;
+
+  for (n = 0; bench_suite[n] != NULL; n++)
+    {
+      strcpy(readbuff, bench_suite[n]);
+      setup_epd_line(readbuff);
+      root_to_move = ToMove;
+
+      clear_tt();
+      reset_ecache();
+      initialize_hash();
+
+      fixed_time = INF;
+      start = bench_now();
+      comp_move = think();
+      secs = bench_now() - start;
+
+      comp_to_san(comp_move, san);
+
+      printf("bench pos=%d depth=%d move=%s nodes=%d qnodes=%d evals=%u "
+	     "tt_probes=%u tt_hits=%u tt_rate=%.2f time=%.3f nps=%.0f\n",
+	     n + 1, depth, san, nodes, qnodes, EvalCalls, TTProbes, TTHits,
+	     ((float)TTHits/((float)TTProbes+1)) * 100,
+	     secs, secs > 0 ? nodes / secs : 0.0);
+
+      total_secs += secs;
+      total_nodes += nodes;
+      total_evals += EvalCalls;
+      total_probes += TTProbes;
+      total_hits += TTHits;
+    }
+
+  printf("bench total positions=%d depth=%d nodes=%.0f evals=%u "
+	 "tt_probes=%u tt_hits=%u tt_rate=%.2f time=%.3f nps=%.0f\n",
+	 n, depth, total_nodes, total_evals, total_probes, total_hits,
+	 ((float)total_hits/((float)total_probes+1)) * 100,
+	 total_secs, total_secs > 0 ? total_nodes / total_secs : 0.0);
+
+  post = oldpost;
+  maxdepth = oldmaxdepth;
+  fixed_time = oldfixed;
+}
@@ -12,7 +12,8 @@
 #include "protos.h"
 #include "squares.h"
 
-int Material;
+SJENG_TLS int Material;
+SJENG_TLS unsigned int EvalCalls;
 int std_material[] = { 0, 100, -100, 310, -310, 4000, -4000, 500, -500, 900, -900, 325, -325, 0 };
 
 int zh_material[] = { 0, 100, -100, 210, -210, 4000, -4000, 250, -250, 450, -450, 230, -230, 0 };
@@ -369,6 +370,8 @@ int eval (int alpha, int beta) {
   int norm_white_hand_eval, norm_black_hand_eval;
   int wdev_dscale, bdev_dscale;
 
+  EvalCalls++;
+
   if (Variant == Normal)
     {
       return std_eval(alpha, beta);
@@ -9,40 +9,44 @@
 
 extern char divider[50];
 
-extern int board[144], moved[144], ep_square, white_to_move, wking_loc,
+extern SJENG_TLS int board[144], moved[144], ep_square, white_to_move, wking_loc,
   bking_loc, white_castled, black_castled, result, ply, pv_length[PV_BUFF],
-  squares[144], num_pieces, i_depth, comp_color, fifty, piece_count;
+  squares[144], num_pieces, i_depth, fifty, piece_count;
+extern int comp_color;
 
-extern int nodes, raw_nodes, qnodes, killer_scores[PV_BUFF],
-  killer_scores2[PV_BUFF], killer_scores3[PV_BUFF], moves_to_tc, min_per_game,
-  sec_per_game, inc, time_left, opp_time, time_cushion, time_for_move, cur_score;
+extern SJENG_TLS int nodes, raw_nodes, qnodes, killer_scores[PV_BUFF],
+  killer_scores2[PV_BUFF], killer_scores3[PV_BUFF], cur_score;
+extern int moves_to_tc, min_per_game,
+  sec_per_game, inc, time_left, opp_time, time_cushion, time_for_move;
 
-extern unsigned int history_h[144][144];
+extern SJENG_TLS unsigned int history_h[144][144];
 
-extern xbool captures, searching_pv, post, time_exit, time_failure;
+extern SJENG_TLS xbool captures, searching_pv, time_exit, time_failure;
+extern xbool post;
 extern int xb_mode, maxdepth;
 
-extern move_s pv[PV_BUFF][PV_BUFF], dummy, killer1[PV_BUFF], killer2[PV_BUFF],
+extern SJENG_TLS move_s pv[PV_BUFF][PV_BUFF], killer1[PV_BUFF], killer2[PV_BUFF],
   killer3[PV_BUFF];
+extern move_s dummy;
 
-extern  move_x path_x[PV_BUFF];
-extern  move_s path[PV_BUFF];
-extern  int maxposdiff;
+extern SJENG_TLS move_x path_x[PV_BUFF];
+extern SJENG_TLS move_s path[PV_BUFF];
+extern SJENG_TLS int maxposdiff;
 
 extern rtime_t start_time;
 
-extern int holding[2][16];
-extern int num_holding[2];
+extern SJENG_TLS int holding[2][16];
+extern SJENG_TLS int num_holding[2];
 
-extern int white_hand_eval;
-extern int black_hand_eval;
+extern SJENG_TLS int white_hand_eval;
+extern SJENG_TLS int black_hand_eval;
 extern int hand_value[];
 
 
-extern int drop_piece;
+extern SJENG_TLS int drop_piece;
 
-extern int pieces[62];
-extern int is_promoted[62];
+extern SJENG_TLS int pieces[62];
+extern SJENG_TLS int is_promoted[62];
 
 extern int num_makemoves;
 extern int num_unmakemoves;
@@ -52,17 +56,22 @@ extern int num_piecedowns;
 extern int max_moves;
 
 /* piece types range form 0..16 */
-extern unsigned int zobrist[14][144];
-extern unsigned int hash;
+extern hashkey_t zobrist[14][144];
+extern SJENG_TLS hashkey_t hash;
 
-extern unsigned int ECacheProbes;
-extern unsigned int ECacheHits;
+extern SJENG_TLS unsigned int ECacheProbes;
+extern SJENG_TLS unsigned int ECacheHits;
+extern SJENG_TLS unsigned int PawnHashProbes;
+extern SJENG_TLS unsigned int PawnHashHits;
+extern SJENG_TLS unsigned int EvalCalls;
 
-extern unsigned int TTProbes;
-extern unsigned int TTHits;
-extern unsigned int TTStores;
+extern SJENG_TLS unsigned int TTProbes;
+extern SJENG_TLS unsigned int TTHits;
+extern SJENG_TLS unsigned int TTStores;
+extern SJENG_TLS unsigned int TTCollisions;
+extern SJENG_TLS unsigned int SEECalls;
 
-extern unsigned int hold_hash;
+extern SJENG_TLS hashkey_t hold_hash;
 
 extern char book[4000][161];
 extern int num_book_lines;
@@ -71,25 +80,25 @@ extern int use_book;
 extern char opening_history[STR_BUFF];
 extern unsigned int bookpos[400], booktomove[400], bookidx;
 
-extern int Material;
+extern SJENG_TLS int Material;
 extern int material[14];
 extern int zh_material[14];
 extern int std_material[14];
 extern int suicide_material[14];
 extern int losers_material[14];
 
-extern unsigned int NTries, NCuts, TExt;
+extern SJENG_TLS unsigned int NTries, NCuts, TExt;
 
 extern char ponder_input[STR_BUFF];
 
 extern xbool is_pondering;
 
-extern unsigned int FH, FHF, PVS, FULL, PVSF;
-extern unsigned int ext_check, ext_recap, ext_onerep;
-extern unsigned int razor_drop, razor_material;
+extern SJENG_TLS unsigned int FH, FHF, PVS, FULL, PVSF;
+extern SJENG_TLS unsigned int ext_check, ext_recap, ext_onerep;
+extern SJENG_TLS unsigned int razor_drop, razor_material;
 
-extern unsigned int total_moves;
-extern unsigned int total_movegens;
+extern SJENG_TLS unsigned int total_moves;
+extern SJENG_TLS unsigned int total_movegens;
 
 extern const int Xrank[144], Xfile[144], Xdiagl[144], Xdiagr[144], sqcolor[144];
 extern int distance[144][144];
@@ -111,21 +120,21 @@ extern xbool piecedead;
 extern xbool partnerdead;
 extern int tradefreely;
 
-extern char true_i_depth;
+extern SJENG_TLS char true_i_depth;
 
 extern int fixed_time;
 
-extern int numb_moves;
+extern SJENG_TLS int numb_moves;
 
-extern int phase;
+extern SJENG_TLS int phase;
 
-extern int bestmovenum;
+extern SJENG_TLS int bestmovenum;
 
-extern int ugly_ep_hack;
+extern SJENG_TLS int ugly_ep_hack;
 
-extern int root_to_move;
+extern SJENG_TLS int root_to_move;
 
-extern int kingcap;
+extern SJENG_TLS int kingcap;
 
 extern int pn_time;
 extern move_s pn_move;
@@ -133,7 +142,7 @@ extern move_s pn_saver;
 extern xbool kibitzed;
 extern int rootlosers[PV_BUFF];
 extern int alllosers;
-extern int s_threat;
+extern SJENG_TLS int s_threat;
 
 extern int cfg_booklearn;
 extern int cfg_devscale;
@@ -151,17 +160,26 @@ extern int havercfile;
 extern int TTSize;
 extern int PBSize;
 extern int ECacheSize;
+extern int cfg_threads;
+extern int cfg_hash_mb;
 
 extern int my_rating, opp_rating;
 extern int userealholdings;
 extern char realholdings[255];
 
-extern int move_number;
-extern unsigned int hash_history[600];
+extern SJENG_TLS int move_number;
+extern SJENG_TLS hashkey_t hash_history[600];
 
-extern int moveleft;
-extern int movetotal;
-extern char searching_move[20];
+extern SJENG_TLS int moveleft;
+extern SJENG_TLS int movetotal;
+extern SJENG_TLS char searching_move[20];
 
 extern char setcode[30];
 
+extern SJENG_TLS int smp_helper;
+
+#ifdef SJENG_BITBOARD
+extern SJENG_TLS bitboard bb_piece[14];
+extern SJENG_TLS bitboard bb_occ;
+extern bitboard bb_sq144[144];
+#endif
@@ -11,16 +11,16 @@
 #include "extvars.h"
 #include "protos.h"
 
-unsigned int total_moves;
-unsigned int total_movegens;
+SJENG_TLS unsigned int total_moves;
+SJENG_TLS unsigned int total_movegens;
 
-int numb_moves;
-static move_s *genfor;
+SJENG_TLS int numb_moves;
+static SJENG_TLS move_s *genfor;
 
-xbool fcaptures;
-int gfrom;
+SJENG_TLS xbool fcaptures;
+SJENG_TLS int gfrom;
 
-int kingcap; /* break if we capture the king */
+SJENG_TLS int kingcap; /* break if we capture the king */
 
 xbool check_legal (move_s moves[], int m, int incheck) {
 
@@ -1275,7 +1275,7 @@ int extended_in_check(void)
   return 0;
 }
 
-void make (move_s moves[], int i) {
+static void make_move (move_s moves[], int i) {
 
   /* make a move */
 
@@ -1863,6 +1863,43 @@ void push_pawn_simple (int target) {
   return;
 }
 
+#ifdef SJENG_BITBOARD
+
+void push_slidE (int target) {
+
+  /* add moves for sliding pieces to the moves array, taking the
+     squares of the ray from the bitboards, nearest first as below */
+
+  int ray[7];
+  int n, k, d;
+  int mycolor;
+
+  d = bb_direction (target - gfrom);
+  mycolor = board[gfrom]&1;
+
+  /* in qsearch only the piece ending the ray matters: */
+  if (captures) {
+    target = bb_first (gfrom, d);
+    if (target && (board[target]&1) != mycolor)
+      add_capture(target, board[target], 0, FALSE);
+    return;
+  }
+
+  n = bb_ray (gfrom, d, ray);
+  for (k = 0; k < n; k++) {
+    target = ray[k];
+    if (board[target] == npiece)
+      add_move(target, 0);
+    else if ((board[target]&1) != mycolor)
+      add_capture(target, board[target], 0, FALSE);
+  }
+
+  return;
+
+}
+
+#else
+
 void push_slidE (int target) {
 
   /* add moves for sliding pieces to the moves array */
@@ -1901,6 +1938,17 @@ void push_slidE (int target) {
 
 }
 
+#endif /* SJENG_BITBOARD */
+
+void make (move_s moves[], int i) {
+
+  /* make a move, then start loading the new position's transposition
+     table entries, which search() will probe after its own checks */
+  make_move (moves, i);
+  prefetch_tt ();
+}
+
+
 void unmake (move_s moves[], int i) {
 
   /* un-make a move */
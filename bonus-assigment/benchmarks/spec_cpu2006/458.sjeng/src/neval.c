@@ -30,15 +30,15 @@ static EVALFUNC evalRoutines[7] = {
   Queen,
   Bishop };
 
-int maxposdiff;
+SJENG_TLS int maxposdiff;
 
 #define ENDGAME_MAT 1300
 #define OPENING_MAT 2200
 
 int distance[144][144];
 int rookdistance[144][144];
-int king_locs[2];
-int wmat, bmat;
+SJENG_TLS int king_locs[2];
+SJENG_TLS int wmat, bmat;
 
 /* these tables will be used for positional bonuses: */
 
@@ -400,6 +400,9 @@ int std_eval (int alpha, int beta) {
   int rbrook, fbrook, rwrook, fwrook;
   int wpotential, bpotential, tmp;
   int wksafety, bksafety;
+  unsigned int pawn_key;
+  int pawn_score, in_pawn_hash, npassed[2];
+  unsigned char passed[2][8];
 
   if ((white_to_move?Material:-Material) - maxposdiff >= beta)
    return (white_to_move?Material:-Material) - maxposdiff;
@@ -424,10 +427,18 @@ int std_eval (int alpha, int beta) {
 
   wmat = 0;
   bmat = 0;
+  pawn_key = 0;
 
   king_locs[WHITE] = wking_loc;
   king_locs[BLACK] = bking_loc;
 
+#ifdef SJENG_BITBOARD
+  /* Evaluation Pass 1 from the bitboards make () and unmake () keep */
+  wmat = bb_piece_material (WHITE);
+  bmat = bb_piece_material (BLACK);
+  bb_pawn_files (pawns, white_back_pawn, black_back_pawn);
+  pawn_key = bb_pawn_key ();
+#else
   /* Evaluation Pass 1 : rude information round */
   for (j = 1, a = 1; (a <= piece_count); j++) {
     i = pieces[j];
@@ -449,6 +460,7 @@ int std_eval (int alpha, int beta) {
 
     if (piecet(i) == pawn)
     {
+      pawn_key ^= zobrist[board[i]][i];
       pawn_file = file (i)+1;
       srank = rank (i);
 
@@ -468,6 +480,18 @@ int std_eval (int alpha, int beta) {
       }
     }
   }
+#endif
+
+  /* the pawn structure terms, if the pawn hash has seen these pawns */
+  in_pawn_hash = 0;
+  checkPawnHash(pawn_key, &pawn_score, passed, &in_pawn_hash);
+  if (!in_pawn_hash)
+    {
+      pawn_score = 0;
+      memset (passed, 0, sizeof (passed));
+      npassed[WHITE] = 0;
+      npassed[BLACK] = 0;
+    }
 
   /* ready, set, ... */
   wpotential = 0;
@@ -503,71 +527,52 @@ int std_eval (int alpha, int beta) {
     srank = rank (i);
     switch (board[i]) {
       case (wpawn):
+	wp++;
+	if (in_pawn_hash)
+	  break;
+
 	isolated = FALSE;
 	backwards = FALSE;
-	score += swhite_pawn[i];
-	wp++;
+	pawn_score += swhite_pawn[i];
 
 	/* check for backwards pawns: */
 	if (white_back_pawn[pawn_file+1] > srank
 	    && white_back_pawn[pawn_file-1] > srank) {
-	  score -= 8;
+	  pawn_score -= 8;
 	  backwards = TRUE;
 	  /* check to see if it is furthermore isolated: */
 	  if (!pawns[1][pawn_file+1] && !pawns[1][pawn_file-1]) {
-	    score -= 5;
+	    pawn_score -= 5;
 	    isolated = TRUE;
 	  }
 	}
 
 	/* give weak, exposed pawns a penalty */
 	if (!pawns[0][pawn_file]) {
-	  if (backwards) score -= 3;
-	  if (isolated) score -= 5;
+	  if (backwards) pawn_score -= 3;
+	  if (isolated) pawn_score -= 5;
 	}
 
 	/* give doubled, trippled, etc.. pawns a penalty */
 	if (pawns[1][pawn_file] > 1)
-	  score -= 3*(pawns[1][pawn_file]-1);
+	  pawn_score -= 3*(pawns[1][pawn_file]-1);
 
 	/* give bonuses for passed pawns */
 	if (!pawns[0][pawn_file] && srank >= black_back_pawn[pawn_file-1] &&
 	    srank >= black_back_pawn[pawn_file+1]) {
-	  score += 30 + 3*swhite_pawn[i];
-
-	  if (white_to_move)
-	  {
-	    /* check queening race */
-	    /* tmp = queening square */
-	    tmp = A8 + file(i) - 1;
-	    /* king is away how much ?*/
-	    if (max(abs(file(bking_loc)-file(tmp)), abs(rank(bking_loc)-rank(tmp)))
-		> (abs(rank(tmp) - rank(i))))
-	    {
-	      wpotential += 800;
-	    }
-	  }
-	  else
-	  {
-	    /* check queening race */
-	    /* tmp = queening square */
-	    tmp = A8 + file(i) - 1;
-	    /* king is away how much ?*/
-	    if ((max(abs(file(bking_loc)-file(tmp)), abs(rank(bking_loc)-rank(tmp)))-1)
-		> (abs(rank(tmp) - rank(i))))
-	    {
-	      wpotential += 800;
-	    }
-	  }
+	  pawn_score += 30 + 3*swhite_pawn[i];
+
+	  /* its queening race needs the kings: after the loop */
+	  passed[WHITE][npassed[WHITE]++] = i;
 
 	  /* outside passer ? */
 	  if (file(i) == 1 || file(i) == 8)
-	    score += 12 + 2*swhite_pawn[i];
+	    pawn_score += 12 + 2*swhite_pawn[i];
 
 	  /* give an extra bonus if a connected, passed pawn: */
 	  if (!isolated)
 	    {
-	      score += 12;
+	      pawn_score += 12;
 
 	      /* check whether supporter is passed */
 	      if (pawns[1][pawn_file+1])
@@ -575,12 +580,12 @@ int std_eval (int alpha, int beta) {
 		  if (!pawns[0][pawn_file+1]
 		      && white_back_pawn[pawn_file+1] >= black_back_pawn[pawn_file+2])
 		    {
-		      score += 7*rank(i);
+		      pawn_score += 7*rank(i);
 
 		      /* connected on seventh ? */
 		      if (rank(i) == 7 && white_back_pawn[pawn_file+1] >= 6)
 			{
-			  score += 50;
+			  pawn_score += 50;
 			}
 		    }
 		}
@@ -589,12 +594,12 @@ int std_eval (int alpha, int beta) {
 		   if (!pawns[0][pawn_file-1]
 		      && white_back_pawn[pawn_file+1] >= black_back_pawn[pawn_file-2])
 		    {
-		      score += 7*rank(i);
+		      pawn_score += 7*rank(i);
 
 		      /* connected on seventh ? */
 		      if (rank(i) == 7 && white_back_pawn[pawn_file-1] >= 6)
 			{
-			  score += 50;
+			  pawn_score += 50;
 			}
 		    }
 		}
@@ -602,77 +607,57 @@ int std_eval (int alpha, int beta) {
 	}
 
 	if (!pawns[1][pawn_file-1])
-	  score -= 7;
+	  pawn_score -= 7;
 
 	break;
 
       case (bpawn):
+	bp++;
+	if (in_pawn_hash)
+	  break;
+
 	isolated = FALSE;
 	backwards = FALSE;
-	score -= sblack_pawn[i];
-	bp++;
+	pawn_score -= sblack_pawn[i];
 
 
 	/* check for backwards pawns: */
 	if (black_back_pawn[pawn_file+1] < srank
 	    && black_back_pawn[pawn_file-1] < srank) {
-	  score += 8;
+	  pawn_score += 8;
 	  backwards = TRUE;
 	  /* check to see if it is furthermore isolated: */
 	  if (!pawns[0][pawn_file+1] && !pawns[0][pawn_file-1]) {
-	    score += 5;
+	    pawn_score += 5;
 	    isolated = TRUE;
 	  }
 	}
 
 	/* give weak, exposed pawns a penalty  */
 	if (!pawns[1][pawn_file]) {
-	  if (backwards) score += 3;
-	  if (isolated) score += 5;
+	  if (backwards) pawn_score += 3;
+	  if (isolated) pawn_score += 5;
 	}
 
 	/* give doubled, trippled, etc.. pawns a penalty */
 	if (pawns[0][pawn_file] > 1)
-	  score += 3*(pawns[0][pawn_file]-1);
+	  pawn_score += 3*(pawns[0][pawn_file]-1);
 
 	/* give bonuses for passed pawns  */
 	if (!pawns[1][pawn_file] && srank <= white_back_pawn[pawn_file-1] &&
 	    srank <= white_back_pawn[pawn_file+1]) {
-	  score -= 30 + 3*sblack_pawn[i];
-
-	  if (!white_to_move)
-	  {
-	    /* check queening race */
-	    /* tmp = queening square */
-	    tmp = A1 + file(i) - 1;
-	    /* king is away how much ?*/
-	    if (max(abs(file(wking_loc)-file(tmp)), abs(rank(wking_loc)-rank(tmp)))
-		> (abs(rank(tmp) - (rank(i)))))
-	    {
-	      bpotential -= 800;
-	    }
-	  }
-	  else
-	  {
-	    /* check queening race */
-	    /* tmp = queening square */
-	    tmp = A1 + file(i) - 1;
-	    /* king is away how much ?*/
-	    if ((max(abs(file(wking_loc)-file(tmp)), abs(rank(wking_loc)-rank(tmp)))-1)
-		> abs((rank(tmp) - rank(i))))
-	    {
-	      bpotential -= 800;
-	    }
-	  }
+	  pawn_score -= 30 + 3*sblack_pawn[i];
+
+	  passed[BLACK][npassed[BLACK]++] = i;
 
 	  /* outside passer ? */
 	  if (file(i) == 1 || file(i) == 8)
-	    score -= 12 + 2*sblack_pawn[i];
+	    pawn_score -= 12 + 2*sblack_pawn[i];
 
 	  /* give an extra bonus if a connected, passed pawn: */
 	  if (!isolated)
 	    {
-	      score -= 12;
+	      pawn_score -= 12;
 
 	      /* check whether supporter is passed */
 	      if (pawns[0][pawn_file+1])
@@ -680,12 +665,12 @@ int std_eval (int alpha, int beta) {
 		  if (!pawns[1][pawn_file+1]
 		      && black_back_pawn[pawn_file+1] <= white_back_pawn[pawn_file+2])
 		    {
-		      score -= 7*(9-rank(i));
+		      pawn_score -= 7*(9-rank(i));
 
 		      /* on seventh and supported ? */
 		      if (rank(i) == 2 && black_back_pawn[pawn_file+1] <= 3)
 			{
-			  score -= 50;
+			  pawn_score -= 50;
 			}
 		    }
 		}
@@ -694,12 +679,12 @@ int std_eval (int alpha, int beta) {
 		   if (!pawns[1][pawn_file-1]
 		      && black_back_pawn[pawn_file-1] <= white_back_pawn[pawn_file-2])
 		    {
-		      score -= 7*(9-rank(i));
+		      pawn_score -= 7*(9-rank(i));
 
 		      /* connected on seventh ? */
 		      if (rank(i) == 2 && black_back_pawn[pawn_file-1] <= 3)
 			{
-			  score -= 50;
+			  pawn_score -= 50;
 			}
 
 		    }
@@ -708,7 +693,7 @@ int std_eval (int alpha, int beta) {
 	}
 
 	if (!pawns[0][pawn_file-1])
-	  score += 7;
+	  pawn_score += 7;
 
 	break;
 
@@ -912,6 +897,27 @@ int std_eval (int alpha, int beta) {
     }
   }
 
+  if (!in_pawn_hash)
+    storePawnHash(pawn_key, pawn_score, passed);
+  score += pawn_score;
+
+  /* queening races of the passed pawns */
+  for (j = 0; j < 8 && passed[WHITE][j]; j++) {
+    i = passed[WHITE][j];
+    /* tmp = queening square */
+    tmp = A8 + file(i) - 1;
+    /* king is away how much ?*/
+    if ((max(abs(file(bking_loc)-file(tmp)), abs(rank(bking_loc)-rank(tmp)))
+	 - (white_to_move ? 0 : 1)) > abs(rank(tmp) - rank(i)))
+      wpotential += 800;
+  }
+  for (j = 0; j < 8 && passed[BLACK][j]; j++) {
+    i = passed[BLACK][j];
+    tmp = A1 + file(i) - 1;
+    if ((max(abs(file(wking_loc)-file(tmp)), abs(rank(wking_loc)-rank(tmp)))
+	 - (white_to_move ? 1 : 0)) > abs(rank(tmp) - rank(i)))
+      bpotential -= 800;
+  }
 
   if (wmat > OPENING_MAT || bmat > OPENING_MAT)
   {
@@ -22,7 +22,14 @@
 /* we can exceed PBSize before exiting the main search loop */
 #define SAFETY     10000
 
-/* define this to use the pn^2 search */
+/* once the tree fills this much of the node buffer, new nodes get
+   their numbers from a second level search (pn^2) whose tree lives
+   above the first one and is dropped as soon as it is done; each
+   may grow to 1/PN2_RATIO of the first tree */
+#define PN2_CAP    ((unsigned)(PBSize / 2) * sizeof(node_t))
+#define PN2_RATIO  64
+
+/* define this to print the PV at every iteration of proofnumbersearch */
 #undef PN2
 
 int nodecount;
@@ -50,7 +57,7 @@ typedef struct node
     unsigned char evaluated;
     int proof;
     int disproof;
-    struct node **children;
+    struct node *children;	/* num_children of them, side by side */
     struct node *parent;
     move_s move;
   }
@@ -61,46 +68,43 @@ void suicide_pn_eval (node_t *this);
 void std_pn_eval (node_t *this);
 void losers_pn_eval (node_t *this);
 
+/* all nodes of a search come from membuff, PBSize nodes big: the
+   tree from the bottom up, a pn^2 tree from wherever the first
+   tree ends. Nothing is freed but by dropping a whole tree. */
 unsigned char *membuff;
 int bufftop = 0;
+int pn2top = 0;
 
 void* Xmalloc(int size)
 {
-  int oldtop = bufftop;
-  
-  bufftop += size;
+  int oldtop;
+
+  if (pn2)
+    {
+      oldtop = pn2top;
+      pn2top += size;
+    }
+  else
+    {
+      oldtop = bufftop;
+      bufftop += size;
+    }
   
   return (&membuff[oldtop]);
 }
 
-void Xfree(void)
+/* give back the tail of the last Xmalloc that was not used */
+void Xshrink(int size)
 {
-  bufftop = 0;
+  if (pn2)
+    pn2top -= size;
+  else
+    bufftop -= size;
 }
 
-void freenodes (node_t * node)
+void Xfree(void)
 {
-  int i;
-
-  if (!node)
-    return;
-
-  if (node->children)
-    {
-      if (node->num_children > 0)
-	{
-	  for (i = 0; i < (node->num_children); i++)
-	    {
-	      if (node->children[i] != 0)
-		{
-		  freenodes (node->children[i]);
-		};
-	    };
-	  free (node->children);
-	}
-    };
-
-  free (node);
+  bufftop = 0;
 }
 
 void pn_eval(node_t * this)
@@ -411,7 +415,7 @@ node_t *select_most_proving (node_t * node)
 	{
 	  i = 0;
 
-	  while (tnode->children[i]->proof != tnode->proof)
+	  while (tnode->children[i].proof != tnode->proof)
 	    {
 	      i++;
 	    };
@@ -420,13 +424,13 @@ node_t *select_most_proving (node_t * node)
 	{
 	  i = 0;
 
-	  while (tnode->children[i]->disproof != tnode->disproof)
+	  while (tnode->children[i].disproof != tnode->disproof)
 	    {
 	      i++;
 	    };
 	};
 
-      tnode = tnode->children[i];
+      tnode = &tnode->children[i];
 
       hash_history[move_number+ply-1] = hash; 	  
       
@@ -459,14 +463,14 @@ void set_proof_and_disproof_numbers (node_t * node)
 
 	  for (i = 0; i < node->num_children; i++)
 	    {
-	      proof += node->children[i]->proof;
+	      proof += node->children[i].proof;
 
 	      if (proof > PN_INF)
 		proof = PN_INF;
 
-	      if (node->children[i]->disproof < disproof)
+	      if (node->children[i].disproof < disproof)
 		{
-		  disproof = node->children[i]->disproof;
+		  disproof = node->children[i].disproof;
 		}
 	    }
 	  
@@ -489,14 +493,14 @@ void set_proof_and_disproof_numbers (node_t * node)
 	  for (i = 0; i < node->num_children; i++)
 	    {
 
-	      disproof += node->children[i]->disproof;
+	      disproof += node->children[i].disproof;
 
 	      if (disproof > PN_INF)
 		disproof = PN_INF;
 
-	      if (node->children[i]->proof < proof)
+	      if (node->children[i].proof < proof)
 		{
-		  proof = node->children[i]->proof;
+		  proof = node->children[i].proof;
 		}
 	    }
 
@@ -710,19 +714,13 @@ void develop_node (node_t * node)
   move_s moves[MOVE_BUFF];
   int i, l;
   node_t *newnode;
-#ifdef PN2
-  node_t **newchildren;
-#endif
+  node_t *newchildren;
+  node_t *pn2children;
   int leg;
   int ic;
 
   /*ept = ep_square; */
 
-#ifdef PN2
-  if (!pn2)
-    pn2_eval(node);
-#endif
-
   ic = in_check();
   
   if (Variant != Losers)
@@ -765,14 +763,16 @@ void develop_node (node_t * node)
 	}
     }
  
-#ifdef PN2
-  if (pn2)
-#endif
-    node->children = (node_t **) Xmalloc (num_moves * sizeof (node_t **));
-#ifdef PN2
-  else
-    newchildren = (node_t **) malloc (num_moves * sizeof (node_t **));
-#endif
+  /* room for every move, the illegal ones are given back below */
+  newchildren = (node_t *) Xmalloc (num_moves * sizeof (node_t));
+
+  /* short of memory: let a pn^2 search find the children's numbers */
+  pn2children = NULL;
+  if (!pn2 && (unsigned)bufftop > PN2_CAP)
+    {
+      pn2_eval (node);
+      pn2children = node->children;
+    }
 
   l = 0;
 
@@ -785,53 +785,30 @@ void develop_node (node_t * node)
       /* check to see if our move is legal: */
       if (check_legal (&moves[0], i, ic))
 	{
-#ifdef PN2
-	  if (pn2)
-#endif
-	    newnode = (node_t *) Xmalloc (sizeof (node_t));
-#ifdef PN2
-	  else
-	    newnode = (node_t *) malloc (sizeof (node_t));
-#endif
-	  newnode->value = 0;
-#ifdef PN2
-	  if (!pn2)
-	    { 
-	      newnode->proof = node->children[l]->proof;
-	      newnode->disproof = node->children[l]->disproof;
-	    }
-	  else
-	    {
-#endif
-	      newnode->proof = newnode->disproof = 1; 
-#ifdef PN2
-	    };
-#endif
+	  newnode = &newchildren[l];
 
+	  newnode->value = 0;
 	  newnode->num_children = 0;
+	  newnode->children = NULL;
 	  newnode->parent = node;
 	  newnode->evaluated = FALSE;
 	  newnode->expanded = FALSE;
 	  newnode->move = moves[i];
 
-#ifdef PN2
-	  if (!pn2)
-	    newchildren[l] = newnode;
-	  else 
-#endif
-	    node->children[l] = newnode;	  	  
+	  if (pn2children)
+	    {
+	      /* the pn^2 search saw the same legal moves in the same order */
+	      newnode->proof = pn2children[l].proof;
+	      newnode->disproof = pn2children[l].disproof;
+	    }
+	  else
+	    {
+	      newnode->proof = newnode->disproof = 1; 
+	      pn_eval (newnode);
+	      set_proof_and_disproof_numbers (newnode);
+	    }
 
 	  l++;
-#ifdef PN2
-	  if (pn2 == FALSE)
-	    /*use delayed eval */;
-	  else if (pn2)
-#endif
-	    pn_eval (newnode);
-#ifdef PN2
-	  if (pn2)
-#endif
-	    set_proof_and_disproof_numbers (newnode);
 
 	  unmake (&moves[0], i);	 
 
@@ -840,13 +817,11 @@ void develop_node (node_t * node)
 	unmake (&moves[0], i);
     };
 
+  Xshrink ((num_moves - l) * sizeof (node_t));
+
+  node->children = newchildren;
   node->expanded = TRUE;
   node->num_children = l;
-
-#ifdef PN2
-  if (!pn2)
-    node->children = newchildren;
-#endif
   
   /* account for stalemate ! */
   if (node->num_children == 0)
@@ -870,19 +845,15 @@ void develop_node (node_t * node)
       };
       
     };
-#ifdef PN2
+
   if (pn2)
     nodecount2 += num_moves;
   else
-#endif
     nodecount += num_moves;
 
   frees += num_moves;
   
   /*ep_square = ept;*/
-#ifdef PN2
-  if (!pn2) Xfree();
-#endif
 }
 
 void update_ancestors (node_t * node)
@@ -915,29 +886,32 @@ void update_ancestors (node_t * node)
 
 }
 
+/* search below root in the space above the main tree, until root
+   is decided or this tree has 1/PN2_RATIO the nodes of the main
+   one. root is left unexpanded, but with children pointing at the
+   first level of what was found (NULL if it was decided at once),
+   for develop_node () to copy before anything else is allocated. */
 void 
 pn2_eval (node_t * root)
 {
   node_t *mostproving;
-#ifdef PN2
-  node_t *newroot;
-#endif
-  node_t *currentnode;
   node_t *oldparent;
 
   nodecount2 = 0;
   pn2 = TRUE;
+  pn2top = bufftop;
 
   oldparent = root->parent;
   root->parent = 0;
+  root->children = NULL;
 
   pn_eval (root);
   
   set_proof_and_disproof_numbers (root);
 
-  currentnode = root;
-
-  while (root->proof != 0 && root->disproof != 0 && nodecount2 < nodecount )
+  while (root->proof != 0 && root->disproof != 0
+	 && nodecount2 < nodecount / PN2_RATIO
+	 && (unsigned)pn2top < ((PBSize-SAFETY) * sizeof(node_t)))
     {
       mostproving = select_most_proving (root);
       develop_node (mostproving);
@@ -1063,7 +1037,7 @@ void proofnumberscan (void)
 
 	 /* what was the mostproving node ? */
 	 i = 0;
-	 while (root->children[i]->proof != root->proof) i++;
+	 while (root->children[i].proof != root->proof) i++;
 
 	 nodesspent[i] += nodecount - xnodecount;
 
@@ -1077,7 +1051,7 @@ void proofnumberscan (void)
 		 printf("tellics kibitz Forced win!\n");
 	       }
               
-	     pn_move = root->children[i]->move;
+	     pn_move = root->children[i].move;
 
 	   }
 	 else if (root->disproof == 0 && root->proof == PN_INF)
@@ -1114,7 +1088,7 @@ void proofnumberscan (void)
 	  
 	 make(&moves[0], leastlooked_i);
 
-	 currentnode = root->children[leastlooked_l];
+	 currentnode = &root->children[leastlooked_l];
 	 
 	 mostproving = select_most_proving (currentnode);
 	 develop_node (mostproving);
@@ -1124,8 +1098,8 @@ void proofnumberscan (void)
 	 
 	 /* should be back at root now */
 
-	 if (root->children[leastlooked_l]->proof == 0 &&
-	     root->children[leastlooked_l]->disproof == PN_INF)
+	 if (root->children[leastlooked_l].proof == 0 &&
+	     root->children[leastlooked_l].disproof == PN_INF)
 	   {
 	     /* alternate move was forced win */
 	     forcedwin = TRUE;
@@ -1136,10 +1110,10 @@ void proofnumberscan (void)
 		 printf("tellics kibitz Forced win! (alt)\n");
 	       }	     
 
-	     pn_move = root->children[leastlooked_l]->move;
+	     pn_move = root->children[leastlooked_l].move;
 	   }
-	 else if (root->children[leastlooked_l]->disproof == 0
-	     &&   root->children[leastlooked_l]->proof == PN_INF)
+	 else if (root->children[leastlooked_l].disproof == 0
+	     &&   root->children[leastlooked_l].proof == PN_INF)
 	   {
 	     /* alternate move loses */
 	     rootlosers[leastlooked_i] = 1;
@@ -1160,17 +1134,17 @@ void proofnumberscan (void)
    {
      comp_to_san(moves[i], output);
      /*printf("checked %s, nodes: %d, pn: %d, dp: %d\n", 
-         output, nodesspent[i], root->children[l]->proof, root->children[l]->disproof);
+         output, nodesspent[i], root->children[l].proof, root->children[l].disproof);
      */
 	 
-     if (root->children[l]->proof != 0)
+     if (root->children[l].proof != 0)
      {
-       if (((float)root->children[l]->disproof / (float)root->children[l]->proof) > bdp)
+       if (((float)root->children[l].disproof / (float)root->children[l].proof) > bdp)
        {
-         bdp = ((float)root->children[l]->disproof / (float)root->children[l]->proof);
-	 pn_move = root->children[l]->move;
+         bdp = ((float)root->children[l].disproof / (float)root->children[l].proof);
+	 pn_move = root->children[l].move;
        }
-       if ((root->children[l]->disproof == 0) && (root->children[l]->proof == PN_INF))
+       if ((root->children[l].disproof == 0) && (root->children[l].proof == PN_INF))
        {
 	 altlosers++;
        }
@@ -1178,7 +1152,7 @@ void proofnumberscan (void)
      else
      {
        forcedwin = TRUE;
-       pn_move = root->children[l]->move;
+       pn_move = root->children[l].move;
        bdp = PN_INF;
      }
    l++;
@@ -1311,7 +1285,7 @@ proofnumbersearch (void)
 	      if (ToMove == root_to_move)
 		{
 		  i = 0;
-		  while (currentnode->children[i]->proof != currentnode->proof)
+		  while (currentnode->children[i].proof != currentnode->proof)
 		    {
 		      i++;
 		    };
@@ -1319,13 +1293,13 @@ proofnumbersearch (void)
 	      else
 		{
 		  i = 0;
-		  while (currentnode->children[i]->disproof != currentnode->disproof)
+		  while (currentnode->children[i].disproof != currentnode->disproof)
 		    {
 		      i++;
 		    }
 		};
 	      
-	      currentnode = currentnode->children[i];
+	      currentnode = &currentnode->children[i];
 	      
 	      comp_to_coord (currentnode->move, output);
 	      printf ("%s ", output);
@@ -1379,7 +1353,7 @@ proofnumbersearch (void)
 	  if (ToMove == root_to_move)
 	    {
 	      i = 0;
-	      while (currentnode->children[i]->proof != currentnode->proof)
+	      while (currentnode->children[i].proof != currentnode->proof)
 		{
 		  i++;
 		};
@@ -1387,13 +1361,13 @@ proofnumbersearch (void)
 	  else
 	    {
 	      i = 0;
-	      while (currentnode->children[i]->disproof != currentnode->disproof)
+	      while (currentnode->children[i].disproof != currentnode->disproof)
 		{
 		  i++;
 		}
 	    };
 
-	  currentnode = currentnode->children[i];
+	  currentnode = &currentnode->children[i];
 
 	  comp_to_coord (currentnode->move, output);
 	  printf ("%s ", output);
@@ -1458,17 +1432,17 @@ proofnumbersearch (void)
   
   for (i = 0; i < root->num_children; i++)
     {
-      if (root->children[i]->proof != 0)
+      if (root->children[i].proof != 0)
       {
-      	if (((float)(root->children[i]->disproof) / (float)(root->children[i]->proof)) > bdp)
+      	if (((float)(root->children[i].disproof) / (float)(root->children[i].proof)) > bdp)
 	{
-	  bdp = (float)root->children[i]->disproof / (float)(root->children[i]->proof);
-	  pn_move = root->children[i]->move;
+	  bdp = (float)root->children[i].disproof / (float)(root->children[i].proof);
+	  pn_move = root->children[i].move;
 	}
       }
       else
       {
-	pn_move = root->children[i]->move;
+	pn_move = root->children[i].move;
 	break;
       }
     };
@@ -33,6 +33,9 @@ void order_moves (move_s moves[], int move_ordering[], int see_values[], int num
 int suicide_mid_eval(void);
 void check_phase(void);
 void perft (int depth);
+void perft_hash_clear (void);
+unsigned long long hperft (int depth);
+unsigned long long pperft (int depth);
 void perft_debug (void);
 void post_thinking (int score);
 void post_fl_thinking (int score, move_s *failmove);
@@ -88,12 +91,14 @@ void initialize_eval(void);
 
 void checkECache(int *score, int *in_cache);
 void storeECache(int score);
+void checkPawnHash(unsigned int key, int *score, unsigned char passed[2][8], int *in_cache);
+void storePawnHash(unsigned int key, int score, unsigned char passed[2][8]);
 
 void StoreTT(int score, int alpha, int beta, int best , int threat, int depth);
 void QStoreTT(int score, int alpha, int beta, int best);
 int ProbeTT(int *score, int beta, int *best, int *threat, int *donull, int depth);
 int QProbeTT(int *score, int *best);
-void LearnStoreTT(int score, unsigned nhash, unsigned hhash, int tomove, int best, int depth);
+void LearnStoreTT(int score, hashkey_t nhash, hashkey_t hhash, int tomove, int best, int depth);
 
 void pinput (int n, FILE *stream);
 
@@ -113,6 +118,8 @@ void CheckBadFlow(xbool reset);
 
 void run_epd_testsuite(void);
 void run_autotest(char *testset);
+void run_bench(int depth);
+double bench_now(void);
 
 void ResetHandValue(void);
 
@@ -121,6 +128,8 @@ void stringize_pv (char str[]);
   
 void clear_tt(void);
 void clear_dp_tt(void);
+void age_tt(void);
+void prefetch_tt(void);
 
 move_s proofnumbercheck(move_s compmove);
 void proofnumbersearch(void);
@@ -138,6 +147,23 @@ unsigned int randomMT(void);
 
 void setup_epd_line(char* inbuff);
 
+void smp_start(void);
+void smp_finish(void);
+xbool smp_stopped(void);
+
+void init_bitboards(void);
+void bb_reset(void);
+#ifdef SJENG_BITBOARD
+xbool bb_attacked(int square, int color, xbool with_king);
+int bb_direction(int offset);
+int bb_first(int square, int d);
+int bb_ray(int square, int d, int *targets);
+int bb_knights(int square, int *targets);
+int bb_piece_material(int color);
+void bb_pawn_files(int pawns[2][11], int white_back_pawn[11], int black_back_pawn[11]);
+unsigned int bb_pawn_key(void);
+#endif
+
 int see(int color, int square, int from);
 
 #endif
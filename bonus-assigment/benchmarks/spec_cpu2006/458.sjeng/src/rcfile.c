@@ -11,12 +11,18 @@
 #include "protos.h"
 #include "extvars.h"
 
+#ifdef SJENG_SMP
+#include <unistd.h>
+#endif
+
 FILE *rcfile;
 char line[STR_BUFF];
 
 int TTSize;
 int ECacheSize;
 int PBSize;
+int cfg_threads;
+int cfg_hash_mb;
 
 int cfg_booklearn;
 int cfg_razordrop;
@@ -52,6 +58,23 @@ void read_rcfile (void)
       
       havercfile = 0;
 
+      /* search threads, -DSJENG_SMP only: SJENG_THREADS if it is
+         set, else one per online CPU */
+      cfg_threads = 1;
+#ifdef SJENG_SMP
+      if (getenv("SJENG_THREADS") != NULL)
+	cfg_threads = atoi(getenv("SJENG_THREADS"));
+      else
+	cfg_threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+      if (cfg_threads < 1) cfg_threads = 1;
+#endif
+
+      /* transposition table memory in MB: SJENG_HASH_MB if it is
+         set, else TTSize entries (see alloc_hash) */
+      cfg_hash_mb = 0;
+      if (getenv("SJENG_HASH_MB") != NULL)
+	cfg_hash_mb = atoi(getenv("SJENG_HASH_MB"));
+
       setc =   havercfile 
 	    + (cfg_devscale << 1) 
 	    + (1 << 2)
@@ -12,40 +12,44 @@
 #include "protos.h"
 #include "limits.h"
 
-unsigned int FH, FHF;
-unsigned int razor_drop, razor_material, drop_cuts, ext_recap, ext_onerep;
+SJENG_TLS unsigned int FH, FHF;
+SJENG_TLS unsigned int razor_drop, razor_material, drop_cuts, ext_recap, ext_onerep;
 
-char true_i_depth;
+SJENG_TLS char true_i_depth;
 
-int bestmovenum;
+SJENG_TLS int bestmovenum;
 
-int ugly_ep_hack;
+SJENG_TLS int ugly_ep_hack;
 
-char postpv[STR_BUFF];
+SJENG_TLS char postpv[STR_BUFF];
 
-char searching_move[20];
-int moveleft;
-int movetotal;
+SJENG_TLS char searching_move[20];
+SJENG_TLS int moveleft;
+SJENG_TLS int movetotal;
 
-int legals;
+SJENG_TLS int legals;
 
-int failed;
-int extendedtime;
+SJENG_TLS int failed;
+SJENG_TLS int extendedtime;
 
 int tradefreely;
 
-int s_threat;
+SJENG_TLS int s_threat;
 
-unsigned int rootnodecount[MOVE_BUFF];
+SJENG_TLS unsigned int rootnodecount[MOVE_BUFF];
 
-xbool checks[PV_BUFF];
-xbool recaps[PV_BUFF];
-xbool singular[PV_BUFF];
+SJENG_TLS xbool checks[PV_BUFF];
+SJENG_TLS xbool recaps[PV_BUFF];
+SJENG_TLS xbool singular[PV_BUFF];
 
 #define KINGCAP 50000
 #define NONE    0
 #define SINGLE  1
 
+/* with SJENG_ASPIRATION a failed aspiration window is widened step
+   by step (see think), and opened fully once the step passes this */
+#define ASPIRATION_MAX 600
+
 #define MAINVAR 100000000
 #define CAPTURE  50000000
 #define KILLER1  25000000
@@ -330,6 +334,92 @@ void perft (int depth) {
 }
 
 
+/* hperft() is perft() with a table of subtree counts, keyed by the
+   position and the depth left, which smp.c's pperft threads share
+   without locks. An entry stores lock = key ^ nodes beside nodes, so
+   one torn by a concurrent store fails the check and is only a miss
+   (Hyatt's lockless hashing). sjeng's hash leaves out the side to
+   move, the en passant square and the castling rights, so the key
+   adds them. In crazyhouse and bughouse a capture also depends on
+   is_promoted[], which no key has, so the table is not used there. */
+
+#define PERFT_HASH_BITS 20            /* 2^20 entries: 16 MB */
+
+typedef struct
+{
+  unsigned long long lock;
+  unsigned long long nodes;
+} perft_entry_t;
+
+static perft_entry_t *perft_table;
+
+
+void perft_hash_clear (void) {
+
+  if (!perft_table)
+    perft_table = (perft_entry_t *) malloc(sizeof(perft_entry_t) << PERFT_HASH_BITS);
+  if (perft_table)
+    memset(perft_table, 0, sizeof(perft_entry_t) << PERFT_HASH_BITS);
+}
+
+
+static unsigned long long perft_key (int depth) {
+
+  unsigned long long k;
+  int castle;
+
+  castle = (!moved[30]) | ((!moved[26]) << 1) | ((!moved[33]) << 2)
+    | ((!moved[114]) << 3) | ((!moved[110]) << 4) | ((!moved[117]) << 5);
+  k = HashLock(hash, hold_hash);
+  k ^= (unsigned long long) (depth << 8 | castle << 1 | (white_to_move & 1))
+    * 0x9E3779B97F4A7C15ULL;
+  k ^= (unsigned long long) ep_square * 0xC2B2AE3D27D4EB4FULL;
+  return k;
+}
+
+
+unsigned long long hperft (int depth) {
+
+  move_s moves[MOVE_BUFF];
+  perft_entry_t *e = NULL;
+  unsigned long long key = 0, sum, n;
+  int num_moves, i;
+  int ic;
+
+  if (!depth)
+    return 1;
+
+  if (depth > 1 && perft_table
+      && Variant != Crazyhouse && Variant != Bughouse)
+    {
+      key = perft_key(depth);
+      e = &perft_table[(key ^ key >> 32) & ((1UL << PERFT_HASH_BITS) - 1)];
+      n = __atomic_load_n(&e->nodes, __ATOMIC_RELAXED);
+      if ((__atomic_load_n(&e->lock, __ATOMIC_RELAXED) ^ n) == key)
+	return n;
+    }
+
+  gen (&moves[0]);
+  num_moves = numb_moves;
+  ic = in_check();
+
+  sum = 0;
+  for (i = 0; i < num_moves; i++) {
+    make (&moves[0], i);
+    if (check_legal (&moves[0], i, ic))
+      sum += hperft (depth-1);
+    unmake (&moves[0], i);
+  }
+
+  if (e)
+    {
+      __atomic_store_n(&e->nodes, sum, __ATOMIC_RELAXED);
+      __atomic_store_n(&e->lock, key ^ sum, __ATOMIC_RELAXED);
+    }
+  return sum;
+}
+
+
 int qsearch (int alpha, int beta, int depth) {
 
   /* perform a quiscense search on the current node using alpha-beta with
@@ -351,7 +441,16 @@ int qsearch (int alpha, int beta, int depth) {
   /* before we do anything, see if we're out of time: */
   if (!(nodes & ((1<<16)-1))) 
     {
-      if (interrupt()) 
+      if (smp_helper)
+	{
+	  /* a helper thread stops when think() says so, see smp.c */
+	  if (smp_stopped())
+	    {
+	      time_exit = TRUE;
+	      return 0;
+	    }
+	}
+      else if (interrupt()) 
 	{
 	  time_exit = TRUE;
 	  return 0;
@@ -528,6 +627,114 @@ xbool remove_one (int *marker, int move_ordering[], int num_moves) {
 
 }
 
+#ifdef SJENG_STAGED
+
+/* Staged move picking for search() off the pv (make staged). The
+   hash move is tried before anything is scored. Then the captures are
+   scored, with SEE where it is needed, and the winning and even ones
+   tried. Only then are the killers, quiet moves and losing captures
+   scored, with the same values order_moves () gives them, and tried
+   best first. A cutoff on the hash move or a capture saves scoring
+   the rest. gen () still produces every move first, as the hash
+   move is stored as its index in that list. */
+
+#define STAGE_HASH     0
+#define STAGE_CAPTURES 1
+#define STAGE_GOOD     2
+#define STAGE_REST     3
+
+static int capture_order (move_s *m) {
+
+  int seev;
+
+  /* No SEE for 'obviously not losing' captures */
+  if (abs(material[m->captured])+15 >= abs(material[board[m->from]]))
+    return CAPTURE + abs(material[m->captured]) - (abs(material[board[m->from]])>>4);
+
+  seev = see(ToMove, m->target, m->from);
+
+  return (seev >= -50) ? CAPTURE + seev : seev;
+}
+
+static int heuristic_order (move_s *m) {
+
+  int order = history_h[m->from][m->target];
+
+  if (m->from == killer1[ply].from && m->target == killer1[ply].target
+      && m->promoted == killer1[ply].promoted)
+    order += KILLER1;
+  else if (m->from == killer2[ply].from && m->target == killer2[ply].target
+	   && m->promoted == killer2[ply].promoted)
+    order += KILLER2;
+  else if (m->from == killer3[ply].from && m->target == killer3[ply].target
+	   && m->promoted == killer3[ply].promoted)
+    order += KILLER3;
+
+  return order;
+}
+
+static xbool pick_staged (int *stage, int *marker, move_s moves[], int move_ordering[],
+			  int num_moves, int best) {
+
+  /* remove_one () for the stages above: the next move to try in
+     *marker, FALSE when all have been tried */
+
+  int i, top;
+
+  if (*stage == STAGE_HASH)
+    {
+      for (i = 0; i < num_moves; i++)
+	move_ordering[i] = 0;
+
+      *stage = STAGE_CAPTURES;
+
+      if (best >= 0 && best < num_moves)
+	{
+	  move_ordering[best] = -INF;
+	  *marker = best;
+	  return TRUE;
+	}
+    }
+
+  if (*stage == STAGE_CAPTURES)
+    {
+      for (i = 0; i < num_moves; i++)
+	if (move_ordering[i] != -INF && moves[i].captured != npiece)
+	  move_ordering[i] = capture_order(&moves[i]) + heuristic_order(&moves[i]);
+
+      *stage = STAGE_GOOD;
+    }
+
+  if (*stage == STAGE_GOOD)
+    {
+      top = CAPTURE - 51;
+      *marker = -INF;
+
+      for (i = 0; i < num_moves; i++)
+	if (moves[i].captured != npiece && move_ordering[i] > top)
+	  {
+	    *marker = i;
+	    top = move_ordering[i];
+	  }
+
+      if (*marker > -INF)
+	{
+	  move_ordering[*marker] = -INF;
+	  return TRUE;
+	}
+
+      for (i = 0; i < num_moves; i++)
+	if (move_ordering[i] != -INF && moves[i].captured == npiece)
+	  move_ordering[i] = heuristic_order(&moves[i]);
+
+      *stage = STAGE_REST;
+    }
+
+  return remove_one (marker, move_ordering, num_moves);
+}
+
+#endif /* SJENG_STAGED */
+
 int search (int alpha, int beta, int depth, int is_null) {
 
   /* search the current node using alpha-beta with negamax search */
@@ -546,13 +753,24 @@ int search (int alpha, int beta, int depth, int is_null) {
   int legalmoves;
   int dropcut;
   int oldtime;
+#ifdef SJENG_STAGED
+  int stage;
+#endif
   static const int rc_index[14] = {0,1,1,2,2,5,5,3,3,4,4,2,2,0};
 
   nodes++;
  
   /* before we do anything, see if we're out of time: */
   if (!(nodes & ((1<<16)-1))) {
-    if (interrupt()) 
+    if (smp_helper)
+      {
+	if (smp_stopped())
+	  {
+	    time_exit = TRUE;
+	    return 0;
+	  }
+      }
+    else if (interrupt()) 
       {
 	time_exit = TRUE;
 	return 0;
@@ -844,10 +1062,23 @@ int search (int alpha, int beta, int depth, int is_null) {
   
   if (num_moves > 0)
     {
+#ifdef SJENG_STAGED
+      if (searching_pv)
+	{
+	  order_moves (&moves[0], &move_ordering[0], &see_values[0], num_moves, best);
+	  stage = STAGE_REST;
+	}
+      else
+	stage = STAGE_HASH;
+
+      /* loop through the moves at the current node: */
+      while (pick_staged (&stage, &i, &moves[0], &move_ordering[0], num_moves, best)) {
+#else
       order_moves (&moves[0], &move_ordering[0], &see_values[0], num_moves, best);
       
       /* loop through the moves at the current node: */
       while (remove_one (&i, &move_ordering[0], num_moves)) {
+#endif
       
 	make (&moves[0], i);
    
@@ -1441,6 +1672,27 @@ move_s search_root (int originalalpha, int originalbeta, int depth) {
 }
 
 
+#ifdef SJENG_STATS
+
+static void stat_report (void) {
+
+  /* think ()'s counts, the main thread's alone under SJENG_SMP */
+
+  printf("Stats: nodes %d  qnodes %d (%.2f%%)  evals %u\n",
+	 nodes, qnodes, nodes ? (float)qnodes * 100 / nodes : 0.0, EvalCalls);
+  printf("Stats: TT probes %u  hits %u (%.2f%%)  collisions %u (%.2f%%)  "
+	 "stores %u\n", TTProbes, TTHits,
+	 (float)TTHits * 100 / ((float)TTProbes + 1), TTCollisions,
+	 (float)TTCollisions * 100 / ((float)TTProbes + 1), TTStores);
+  printf("Stats: fail highs %u  on first move %u (%.2f%%)\n",
+	 FH, FHF, (float)FHF * 100 / ((float)FH + 1));
+  printf("Stats: SEE calls %u  ECache hits %.2f%%  pawn hash hits %.2f%%\n",
+	 SEECalls, (float)ECacheHits * 100 / ((float)ECacheProbes + 1),
+	 (float)PawnHashHits * 100 / ((float)PawnHashProbes + 1));
+}
+
+#endif
+
 move_s think (void) {
 
   /* Perform iterative deepening to go further in the search */
@@ -1456,6 +1708,9 @@ move_s think (void) {
   int pn_restart;
   int num_moves;
   char output[8];
+#ifdef SJENG_ASPIRATION
+  int delta;
+#endif
   
   userealholdings = 0;
   pn_restart = 0;
@@ -1466,9 +1721,14 @@ restart:
 
   ECacheProbes = 0;
   ECacheHits = 0;
+  PawnHashProbes = 0;
+  PawnHashHits = 0;
+  EvalCalls = 0;
   TTProbes = 0;
   TTHits = 0;
   TTStores = 0;  
+  TTCollisions = 0;
+  SEECalls = 0;
   NCuts = 0;
   NTries = 0;
   TExt = 0;
@@ -1497,6 +1757,7 @@ restart:
   
  
   start_time = rtime ();
+  age_tt();
 
   /* we need to know if we must sit or not in bug */ 
   legals = 0;
@@ -1653,6 +1914,9 @@ restart:
        cur_score = 0;
        true_score = 0;
        
+       /* Lazy SMP helpers, if any, search beside us until the loop ends */
+       smp_start();
+
        for (i_depth = 1; i_depth <= maxdepth; i_depth++) {
 	 
 	 /* don't bother going deeper if we've already used 2/3 of our time, and we
@@ -1673,6 +1937,31 @@ restart:
 	 if (cur_score <= alpha) failed = 1;
 	 else failed = 0;
 	 
+#ifdef SJENG_ASPIRATION
+	 /* widen only the side that failed, twice as far each time,
+	    instead of opening the window at once */
+	 delta = (Variant == Normal ? 35 : 100);
+	 while (!time_exit && !result
+		&& ((cur_score <= alpha && alpha > -INF)
+		    || (cur_score >= beta && beta < INF)))
+	   {
+	     delta *= 2;
+
+	     if (cur_score <= alpha) /* fail low */
+	       alpha = (delta > ASPIRATION_MAX) ? -INF : alpha - delta;
+	     else /* fail high */
+	       {
+		 comp_move = temp_move;
+		 temp_score = cur_score;
+		 beta = (delta > ASPIRATION_MAX) ? INF : beta + delta;
+	       }
+
+	     rs++;
+
+	     temp_move = search_root (alpha, beta, i_depth);
+	     if (!time_exit) failed = (cur_score <= alpha);
+	   }
+#else
 	 if (cur_score <= alpha && !time_exit) /* fail low */
 	   {	     	     	     
 	     rs++;
@@ -1692,12 +1981,16 @@ restart:
 	     if (!time_exit) failed = 0;
 	     
 	   };
+#endif
 	 
 	 
 	 if (interrupt() && (i_depth > 1)) 
 	   {
 	     if (is_pondering)
+	     {
+	       smp_finish();
 	       return dummy;
+	     }
 	     else if (!go_fast)
 	       break;
 	   }
@@ -1709,7 +2002,11 @@ restart:
 	      search, just use previous results */
 
 	   /* accidentally pondering if mated */
-	   if (cur_score == -INF) return dummy;
+	   if (cur_score == -INF)
+	   {
+	     smp_finish();
+	     return dummy;
+	   }
 	   
 	   comp_move = temp_move;
 	   temp_score = cur_score;
@@ -1742,6 +2039,8 @@ restart:
 	 }
 	 
        }
+
+       smp_finish();
      }
        
 
@@ -1902,6 +2201,10 @@ restart:
       printf("tellics ptell I'll have to sit...(lose piece that mates you)\n");
     }
 
+#ifdef SJENG_STATS
+  stat_report();
+#endif
+
   return comp_move;
 
 }
@@ -8,6 +8,7 @@
 */
 
 #include "sjeng.h"
+#include "protos.h"
 #include "extvars.h"
 
 typedef struct
@@ -16,8 +17,89 @@ typedef struct
   int square;
 } see_data;
 
-see_data see_attackers[2][16];
-int see_num_attackers[2];
+SJENG_TLS see_data see_attackers[2][16];
+SJENG_TLS int see_num_attackers[2];
+SJENG_TLS unsigned int SEECalls;
+
+#ifdef SJENG_BITBOARD
+
+#define see_add(c, n, p, s) \
+  (see_attackers[(c)][(n)].piece = (p), see_attackers[(c)][(n)].square = (s), (n)++)
+
+void setup_attackers (int square) {
+
+  /* the scan below, with the first piece along each line from the
+     bitboards; it stops where that one does, so SEE is unchanged */
+
+  static const int rook_o[4] = {12, -12, 1, -1};
+  static const int bishop_o[4] = {11, -11, 13, -13};
+  int a_sq, b_sq, i, n, knights[8];
+  int numw = see_num_attackers[WHITE], numb = see_num_attackers[BLACK];
+
+  /* rook-style moves: */
+  for (i = 0; i < 4; i++)
+    {
+      if (!(a_sq = bb_first(square, bb_direction(rook_o[i]))))
+	continue;
+      b_sq = board[a_sq];
+
+      /* the king can attack from one square away: */
+      if (a_sq == square + rook_o[i] && (b_sq == wking || b_sq == bking))
+	{
+	  if (b_sq == wking)
+	    see_add(WHITE, numw, b_sq, a_sq);
+	  else
+	    see_add(BLACK, numb, b_sq, a_sq);
+	  break;
+	}
+      if (b_sq == wrook || b_sq == wqueen)
+	see_add(WHITE, numw, b_sq, a_sq);
+      else if (b_sq == brook || b_sq == bqueen)
+	see_add(BLACK, numb, b_sq, a_sq);
+    }
+
+  /* bishop-style moves: */
+  for (i = 0; i < 4; i++)
+    {
+      if (!(a_sq = bb_first(square, bb_direction(bishop_o[i]))))
+	continue;
+      b_sq = board[a_sq];
+
+      /* pawns and the king attack from one square away: */
+      if (a_sq == square + bishop_o[i])
+	{
+	  if ((b_sq == wpawn && i%2) || b_sq == wking)
+	    {
+	      see_add(WHITE, numw, b_sq, a_sq);
+	      break;
+	    }
+	  else if ((b_sq == bpawn && !(i%2)) || b_sq == bking)
+	    {
+	      see_add(BLACK, numb, b_sq, a_sq);
+	      break;
+	    }
+	}
+      if (b_sq == wbishop || b_sq == wqueen)
+	see_add(WHITE, numw, b_sq, a_sq);
+      else if (b_sq == bbishop || b_sq == bqueen)
+	see_add(BLACK, numb, b_sq, a_sq);
+    }
+
+  /* knight-style moves: */
+  n = bb_knights(square, knights);
+  for (i = 0; i < n; i++)
+    {
+      if (board[knights[i]] == wknight)
+	see_add(WHITE, numw, wknight, knights[i]);
+      else
+	see_add(BLACK, numb, bknight, knights[i]);
+    }
+
+  see_num_attackers[WHITE] = numw;
+  see_num_attackers[BLACK] = numb;
+}
+
+#else
 
 void setup_attackers (int square) {
 
@@ -158,6 +240,8 @@ void setup_attackers (int square) {
   see_num_attackers[BLACK] = numb;
 }
 
+#endif /* SJENG_BITBOARD */
+
 void findlowest(int color, int next)
 {
   int lowestp;
@@ -193,6 +277,8 @@ int see(int color, int square, int from)
   int ourbestvalue;
   int hisbestvalue;
 
+  Stat(SEECalls);
+
   /* reset data */
   see_num_attackers[WHITE] = 0;
   see_num_attackers[BLACK] = 0;
@@ -200,6 +286,9 @@ int see(int color, int square, int from)
   /* remove original capturer from board, exposing his first xray-er */
   origpiece = board[from];
   board[from] = npiece;
+#ifdef SJENG_BITBOARD
+  bb_occ ^= bb_sq144[from];
+#endif
 
   see_num_attackers[color]++;
   see_attackers[color][0].piece = origpiece;
@@ -215,6 +304,9 @@ int see(int color, int square, int from)
   if (!see_num_attackers[!color])
     {
       board[from] = origpiece;
+#ifdef SJENG_BITBOARD
+      bb_occ ^= bb_sq144[from];
+#endif
       return value;
     }
   else
@@ -279,6 +371,9 @@ int see(int color, int square, int from)
 
   /* restore capturer */
   board[from] = origpiece;
+#ifdef SJENG_BITBOARD
+  bb_occ ^= bb_sq144[from];
+#endif
 
   /* we return our best score now, keeping in mind that
      it can never we better than the best for our opponent */
@@ -16,43 +16,46 @@
 char divider[50] = "-------------------------------------------------";
 move_s dummy = {0,0,0,0,0,0};
 
-int board[144], moved[144], ep_square, white_to_move, comp_color, wking_loc,
+SJENG_TLS int board[144], moved[144], ep_square, white_to_move, wking_loc,
   bking_loc, white_castled, black_castled, result, ply, pv_length[PV_BUFF],
   pieces[62], squares[144], num_pieces, i_depth, fifty, piece_count;
+int comp_color;
 
-int nodes, raw_nodes, qnodes,  killer_scores[PV_BUFF],
-  killer_scores2[PV_BUFF], killer_scores3[PV_BUFF], moves_to_tc, min_per_game,
-  sec_per_game, inc, time_left, opp_time, time_cushion, time_for_move, cur_score;
+SJENG_TLS int nodes, raw_nodes, qnodes,  killer_scores[PV_BUFF],
+  killer_scores2[PV_BUFF], killer_scores3[PV_BUFF], cur_score;
+int moves_to_tc, min_per_game,
+  sec_per_game, inc, time_left, opp_time, time_cushion, time_for_move;
 
-unsigned int history_h[144][144];
+SJENG_TLS unsigned int history_h[144][144];
 
-unsigned int hash_history[600];
-int move_number;
+SJENG_TLS hashkey_t hash_history[600];
+SJENG_TLS int move_number;
 
-xbool captures, searching_pv, post, time_exit, time_failure;
+SJENG_TLS xbool captures, searching_pv, time_exit, time_failure;
+xbool post;
 
 int xb_mode, maxdepth;
 
-int phase;
-int root_to_move;
+SJENG_TLS int phase;
+SJENG_TLS int root_to_move;
 
 int my_rating, opp_rating;
 
 char setcode[30];
 
-move_s pv[PV_BUFF][PV_BUFF], killer1[PV_BUFF], killer2[PV_BUFF],
+SJENG_TLS move_s pv[PV_BUFF][PV_BUFF], killer1[PV_BUFF], killer2[PV_BUFF],
  killer3[PV_BUFF];
 
-move_x path_x[PV_BUFF];
-move_s path[PV_BUFF];
+SJENG_TLS move_x path_x[PV_BUFF];
+SJENG_TLS move_s path[PV_BUFF];
  
 rtime_t start_time;
 
-int is_promoted[62];
+SJENG_TLS int is_promoted[62];
 
-unsigned int NTries, NCuts, TExt;
-unsigned int PVS, FULL, PVSF;
-unsigned int ext_check;
+SJENG_TLS unsigned int NTries, NCuts, TExt;
+SJENG_TLS unsigned int PVS, FULL, PVSF;
+SJENG_TLS unsigned int ext_check;
 
 xbool is_pondering, allow_pondering, is_analyzing;
 
@@ -89,6 +92,7 @@ int main (int argc, char *argv[]) {
   
   read_rcfile();
   initialize_zobrist();
+  init_bitboards();
  
   Variant = Normal;
   /*Variant = Crazyhouse;*/
@@ -104,6 +108,9 @@ int main (int argc, char *argv[]) {
     
   ECacheProbes = 0;
   ECacheHits = 0;
+  PawnHashProbes = 0;
+  PawnHashHits = 0;
+  EvalCalls = 0;
   TTProbes = 0;
   TTStores = 0;
   TTHits = 0;
@@ -149,7 +156,12 @@ int main (int argc, char *argv[]) {
   start_up ();
 
   
-  if (argc == 2)
+  if (argc >= 2 && !strcmp (argv[1], "bench"))
+  {
+	run_bench(argc > 2 ? atoi(argv[2]) : 0);
+	exit(EXIT_SUCCESS);
+  }
+  else if (argc == 2)
   {
   	printf("SPEC Workload\n");
         run_autotest(argv[1]);    
@@ -230,6 +242,9 @@ int main (int argc, char *argv[]) {
 	    printf("ECacheProbes : %u   ECacheHits : %u   HitRate : %f%%\n", 
 		   ECacheProbes, ECacheHits, 
 		   ((float)ECacheHits/((float)ECacheProbes+1)) * 100);
+	    printf("PawnHashProbes : %u   PawnHashHits : %u   HitRate : %f%%\n", 
+		   PawnHashProbes, PawnHashHits, 
+		   ((float)PawnHashHits/((float)PawnHashProbes+1)) * 100);
 	    
 	    printf("TTStores : %u TTProbes : %u   TTHits : %u   HitRate : %f%%\n", 
 		   TTStores, TTProbes, TTHits, 
@@ -245,7 +260,7 @@ int main (int argc, char *argv[]) {
 	    printf("Material score: %d   Eval : %d  MaxPosDiff: %d  White hand: %d  Black hand : %d\n", 
 		Material, eval(-INF,INF), maxposdiff, white_hand_eval, black_hand_eval);
 	    
-	    printf("Hash : %X  HoldHash : %X\n", hash, hold_hash);
+	    printf("Hash : %llX  HoldHash : %llX\n", hash, hold_hash);
 
 	    /* check to see if we mate our opponent with our current move: */
 	    if (!result) {
@@ -417,6 +432,19 @@ int main (int argc, char *argv[]) {
 	printf ("Raw nodes for depth %d: %i\n", depth, raw_nodes);
 	printf("Time : %.2f\n", (float)rdifftime(rtime(), xstart_time)/100.);
       }
+      else if (!strncmp (input, "pperft", 6)) {
+	unsigned long long pnodes;
+	double pstart, secs;
+
+	sscanf (input+7, "%d", &depth);
+	pstart = bench_now();
+	pnodes = pperft (depth);
+	secs = bench_now() - pstart;
+	printf ("Raw nodes for depth %d: %llu\n", depth, pnodes);
+	printf ("Time : %.3f\n", secs);
+	printf ("Nodes/sec : %.0f (threads %d)\n",
+		secs > 0 ? (double)pnodes / secs : 0.0, cfg_threads);
+      }
       else if (!strcmp (input, "new")) {
 
 	if (xb_mode)
@@ -673,6 +701,9 @@ int main (int argc, char *argv[]) {
       else if (!strncmp (input, "test", 4)) {
 	run_epd_testsuite();
       }
+      else if (!strncmp (input, "bench", 5)) {
+	run_bench(atoi(input+5));
+      }
       else if (!strncmp (input, "st", 2)) {
 	sscanf(input+3, "%d", &fixed_time);
 	fixed_time = fixed_time * 100;
@@ -759,9 +790,11 @@ int main (int argc, char *argv[]) {
 	printf ("  c -> increment in seconds\n");
 	printf ("nodes:           outputs the number of nodes searched\n");
 	printf ("perft <x>:       compute raw nodes to depth x\n");
+	printf ("pperft <x>:      perft on SJENG_THREADS threads, hashed\n");
 	printf ("post:            toggles thinking output\n");
 	printf ("xboard:          put Sjeng into xboard mode\n");
 	printf ("test:            run an EPD testsuite\n");
+	printf ("bench [x]:       search the bench positions to depth x\n");
 	printf ("speed:           test movegen and evaluation speed\n");
 	printf( "proof:           try to prove or disprove the current pos\n");
 	printf( "sd <x>:          limit thinking to depth x\n");
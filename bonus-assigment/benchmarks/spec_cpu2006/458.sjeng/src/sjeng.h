@@ -31,7 +31,32 @@ typedef enum {FALSE, TRUE} xbool;
 #define ToMove (white_to_move ? 0 : 1)
 #define NotToMove (white_to_move ? 1 : 0)
 
+/* Zobrist keys are 64 bits. The low 32 are the keys sjeng always
+   had (initialize_zobrist()), and the tables take their index from
+   them; an entry is verified against all 64, so a table of any size
+   still has 32 or more bits that it never indexes with. HashLock()
+   folds hold_hash into the key for one 64-bit compare. */
+typedef unsigned long long hashkey_t;
+
+#define HashLock(h, hh) ((h) ^ ((hh) << 32 | (hh) >> 32))
+
+/* with SJENG_BITBOARD every change Hash() hashes in or out of the
+   position moves the piece on its bitboards too (see bitboard.c) */
+#ifdef SJENG_BITBOARD
+#define Hash(x,y) (hash ^= zobrist[(x)][(y)], bb_piece[(x)] ^= bb_sq144[(y)], \
+		   bb_occ ^= bb_sq144[(y)])
+#else
 #define Hash(x,y) (hash ^= zobrist[(x)][(y)])
+#endif
+
+/* with SJENG_STATS the counters below Stat() bumps are kept and
+   think () ends with a summary of them (see search.c); without,
+   Stat() is nothing */
+#ifdef SJENG_STATS
+#define Stat(x) ((x)++)
+#else
+#define Stat(x) ((void)0)
+#endif
 
 #define Crazyhouse 0
 #define Bughouse 1
@@ -162,5 +187,40 @@ typedef struct {
 #endif
 #endif
 
+/* With SJENG_SMP (make smp) helper threads search the same root
+   beside the main one (see smp.c), so the position and everything
+   a search keeps outside its stack frames are thread-local */
+#ifdef SJENG_SMP
+#define SJENG_TLS __thread
+#else
+#define SJENG_TLS
+#endif
+
+#ifdef SJENG_BITBOARD
+typedef unsigned long long bitboard;    /* bit 8*rank+file, a1 = 0 */
+#endif
+
+/* With GEM5_ROI (make roi) run_autotest() brackets the test positions
+   with gem5 markers, so the statistics leave out start_up() and the
+   table set-up: they are reset at ROI_BEGIN and dumped at ROI_END */
+#ifdef GEM5_ROI
+#include <gem5/m5ops.h>
+#define ROI_BEGIN() do { m5_work_begin(0, 0); m5_reset_stats(0, 0); } while (0)
+#define ROI_END()   do { m5_dump_stats(0, 0); m5_work_end(0, 0); } while (0)
+#else
+#define ROI_BEGIN() do { } while (0)
+#define ROI_END()   do { } while (0)
+#endif
+
+/* With MEM_TRACE (make trace) the transposition table probes and
+   stores of ttable.c log the entries they touch (see
+   ../../memtrace/memtrace.h) */
+#ifdef MEM_TRACE
+#include "memtrace.h"
+#else
+#define MEMTRACE_LOAD(p)  do { } while (0)
+#define MEMTRACE_STORE(p) do { } while (0)
+#endif
+
 #endif
 
@@ -0,0 +1,295 @@
+/*
+    Sjeng - a chess variants playing program
+    Copyright (C) 2000-2003 Gian-Carlo Pascutto
+
+    File: smp.c
+    Purpose: Lazy SMP, helper threads for think()
+
+*/
+
+/* Built with -DSJENG_SMP (make smp), think() starts cfg_threads-1
+   helpers when its iterative deepening begins. Each copies the root
+   position, gets an eval cache of its own and searches the root
+   with search_root() at ever greater depths, odd helpers one ply
+   ahead, until told to stop. Nothing of theirs is used but what
+   they leave in the transposition tables, which all threads share
+   without locks: make smp builds the bucketed tables of ttable.c,
+   whose entries check themselves against their key, and with the
+   old ones a torn entry can at worst give a wrong bound or a move
+   index that matches no move. Everything else a search
+   touches is thread-local (SJENG_TLS), and helpers neither print
+   nor look at the input; they stop when think() leaves its loop,
+   and their nodes are added to the main thread's count. Without
+   SJENG_SMP the calls below do nothing, and pperft() is hperft()
+   on one thread. */
+
+#include "sjeng.h"
+#include "protos.h"
+#include "extvars.h"
+
+SJENG_TLS int smp_helper;      /* 0: main thread, else helper number */
+
+#ifdef SJENG_SMP
+
+#include <pthread.h>
+
+#define SMP_MAX_THREADS 64
+#define SMP_STACK_SIZE (64*1024*1024)  /* thread-local pv[] is 2 MB */
+
+typedef struct
+{
+  int board[144], moved[144], squares[144], pieces[62], is_promoted[62];
+  int num_pieces, piece_count, ep_square, white_to_move, wking_loc,
+    bking_loc, white_castled, black_castled, fifty, Material, phase,
+    root_to_move, ugly_ep_hack, maxposdiff;
+  int holding[2][16], num_holding[2], white_hand_eval, black_hand_eval;
+  hashkey_t hash, hold_hash, hash_history[600];
+  int move_number;
+} smp_root_t;
+
+static smp_root_t smp_root;
+static pthread_t smp_worker[SMP_MAX_THREADS];
+static int smp_nodes[SMP_MAX_THREADS], smp_qnodes[SMP_MAX_THREADS];
+static int smp_running;
+static int smp_stop;
+
+
+static void smp_save (smp_root_t *r) {
+
+  memcpy(r->board, board, sizeof(board));
+  memcpy(r->moved, moved, sizeof(moved));
+  memcpy(r->squares, squares, sizeof(squares));
+  memcpy(r->pieces, pieces, sizeof(pieces));
+  memcpy(r->is_promoted, is_promoted, sizeof(is_promoted));
+  memcpy(r->holding, holding, sizeof(holding));
+  memcpy(r->num_holding, num_holding, sizeof(num_holding));
+  memcpy(r->hash_history, hash_history, sizeof(hash_history));
+  r->num_pieces = num_pieces;
+  r->piece_count = piece_count;
+  r->ep_square = ep_square;
+  r->white_to_move = white_to_move;
+  r->wking_loc = wking_loc;
+  r->bking_loc = bking_loc;
+  r->white_castled = white_castled;
+  r->black_castled = black_castled;
+  r->fifty = fifty;
+  r->Material = Material;
+  r->phase = phase;
+  r->root_to_move = root_to_move;
+  r->ugly_ep_hack = ugly_ep_hack;
+  r->maxposdiff = maxposdiff;
+  r->white_hand_eval = white_hand_eval;
+  r->black_hand_eval = black_hand_eval;
+  r->hash = hash;
+  r->hold_hash = hold_hash;
+  r->move_number = move_number;
+}
+
+
+static void smp_load (const smp_root_t *r) {
+
+  memcpy(board, r->board, sizeof(board));
+  memcpy(moved, r->moved, sizeof(moved));
+  memcpy(squares, r->squares, sizeof(squares));
+  memcpy(pieces, r->pieces, sizeof(pieces));
+  memcpy(is_promoted, r->is_promoted, sizeof(is_promoted));
+  memcpy(holding, r->holding, sizeof(holding));
+  memcpy(num_holding, r->num_holding, sizeof(num_holding));
+  memcpy(hash_history, r->hash_history, sizeof(hash_history));
+  num_pieces = r->num_pieces;
+  piece_count = r->piece_count;
+  ep_square = r->ep_square;
+  white_to_move = r->white_to_move;
+  wking_loc = r->wking_loc;
+  bking_loc = r->bking_loc;
+  white_castled = r->white_castled;
+  black_castled = r->black_castled;
+  fifty = r->fifty;
+  Material = r->Material;
+  phase = r->phase;
+  root_to_move = r->root_to_move;
+  ugly_ep_hack = r->ugly_ep_hack;
+  maxposdiff = r->maxposdiff;
+  white_hand_eval = r->white_hand_eval;
+  black_hand_eval = r->black_hand_eval;
+  hash = r->hash;
+  hold_hash = r->hold_hash;
+  move_number = r->move_number;
+}
+
+
+static void *smp_loop (void *arg) {
+
+  int id = (int)(long) arg;
+  int depth;
+
+  smp_helper = id;
+  smp_load(&smp_root);
+  bb_reset();
+  alloc_ecache();
+  reset_ecache();
+
+  /* pv, killers and history start out empty in a new thread */
+  nodes = 0;
+  qnodes = 0;
+  captures = FALSE;
+
+  for (depth = 1 + (id & 1); depth <= maxdepth; depth++)
+    {
+      i_depth = depth;
+      search_root(-INF, INF, depth);
+      if (time_exit || result) break;
+    }
+
+  smp_nodes[id] = nodes;
+  smp_qnodes[id] = qnodes;
+  free_ecache();
+  return NULL;
+}
+
+
+xbool smp_stopped (void) {
+
+  return __atomic_load_n(&smp_stop, __ATOMIC_RELAXED) ? TRUE : FALSE;
+}
+
+
+void smp_start (void) {
+
+  pthread_attr_t attr;
+  int t, helpers;
+
+  helpers = min(cfg_threads, SMP_MAX_THREADS) - 1;
+  if (helpers <= 0 || smp_running) return;
+
+  smp_save(&smp_root);
+  __atomic_store_n(&smp_stop, 0, __ATOMIC_RELAXED);
+
+  pthread_attr_init(&attr);
+  pthread_attr_setstacksize(&attr, SMP_STACK_SIZE);
+  for (t = 1; t <= helpers; t++)
+    if (pthread_create(&smp_worker[t], &attr, smp_loop, (void *)(long) t))
+      break;
+  pthread_attr_destroy(&attr);
+  smp_running = t - 1;
+}
+
+
+void smp_finish (void) {
+
+  int t;
+
+  if (!smp_running) return;
+
+  __atomic_store_n(&smp_stop, 1, __ATOMIC_RELAXED);
+  for (t = 1; t <= smp_running; t++)
+    {
+      pthread_join(smp_worker[t], NULL);
+      nodes += smp_nodes[t];
+      qnodes += smp_qnodes[t];
+    }
+  smp_running = 0;
+}
+
+
+/* pperft: the legal root moves go to cfg_threads threads, the main
+   one included, one at a time from a shared counter. Each thread
+   counts its moves' subtrees with hperft() on its own copy of the
+   root, and the counts are summed, so the total does not depend on
+   who took which move. */
+
+static move_s pperft_moves[MOVE_BUFF];
+static int pperft_num, pperft_ic, pperft_ply, pperft_depth;
+static int pperft_next;
+static unsigned long long pperft_nodes[SMP_MAX_THREADS];
+
+
+static void *pperft_loop (void *arg) {
+
+  move_s moves[MOVE_BUFF];
+  int id = (int)(long) arg;
+  unsigned long long sum = 0;
+  int i;
+
+  if (id)
+    {
+      smp_helper = id;
+      smp_load(&smp_root);
+      bb_reset();
+      ply = pperft_ply;
+      captures = FALSE;
+    }
+  memcpy(moves, pperft_moves, sizeof(moves));
+
+  while ((i = __atomic_fetch_add(&pperft_next, 1, __ATOMIC_RELAXED))
+	 < pperft_num)
+    {
+      make (&moves[0], i);
+      if (check_legal (&moves[0], i, pperft_ic))
+	sum += hperft (pperft_depth-1);
+      unmake (&moves[0], i);
+    }
+
+  pperft_nodes[id] = sum;
+  return NULL;
+}
+
+
+unsigned long long pperft (int depth) {
+
+  pthread_attr_t attr;
+  unsigned long long sum;
+  int t, threads;
+
+  perft_hash_clear();
+  if (depth <= 0)
+    return 1;
+
+  threads = min(max(cfg_threads, 1), SMP_MAX_THREADS);
+  captures = FALSE;
+  gen (&pperft_moves[0]);
+  pperft_num = numb_moves;
+  pperft_ic = in_check();
+  pperft_ply = ply;
+  pperft_depth = depth;
+  pperft_next = 0;
+  smp_save(&smp_root);
+
+  pthread_attr_init(&attr);
+  pthread_attr_setstacksize(&attr, SMP_STACK_SIZE);
+  for (t = 1; t < threads; t++)
+    if (pthread_create(&smp_worker[t], &attr, pperft_loop, (void *)(long) t))
+      break;
+  pthread_attr_destroy(&attr);
+  threads = t;
+
+  pperft_loop((void *) 0);
+  sum = pperft_nodes[0];
+  for (t = 1; t < threads; t++)
+    {
+      pthread_join(smp_worker[t], NULL);
+      sum += pperft_nodes[t];
+    }
+  return sum;
+}
+
+#else /* no SJENG_SMP: search alone */
+
+xbool smp_stopped (void) {
+
+  return FALSE;
+}
+
+void smp_start (void) {
+}
+
+void smp_finish (void) {
+}
+
+unsigned long long pperft (int depth) {
+
+  perft_hash_clear();
+  return hperft(depth);
+}
+
+#endif /* SJENG_SMP */
@@ -12,13 +12,202 @@
 #include "extvars.h"
 #include "limits.h"
 
-unsigned int zobrist[14][144];
+#if defined(SJENG_HUGEPAGES) || defined(SJENG_PERSIST_TT)
+#include <sys/mman.h>
+#endif
+#ifdef SJENG_PERSIST_TT
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
-unsigned int hash;
+hashkey_t zobrist[14][144];
 
-unsigned int TTProbes;
-unsigned int TTHits;
-unsigned int TTStores;
+SJENG_TLS hashkey_t hash;
+
+SJENG_TLS unsigned int TTProbes;
+SJENG_TLS unsigned int TTHits;
+SJENG_TLS unsigned int TTStores;
+SJENG_TLS unsigned int TTCollisions;   /* misses on another position's slot */
+
+/* Memory for the tables. Probes go all over several MB, so with
+   4 KB pages nearly every one is a TLB miss as well. Built with
+   -DSJENG_HUGEPAGES (make huge) the tables are mapped with huge
+   pages if the system has some reserved (MAP_HUGETLB), else with
+   transparent huge pages where it allows them (MADV_HUGEPAGE).
+   NULL if out of memory. */
+
+#ifdef SJENG_HUGEPAGES
+
+#define TT_HUGE (2*1024*1024)   /* the usual huge page size */
+
+static size_t tt_huge_size(size_t size)
+{
+  return (size + TT_HUGE - 1) & ~(size_t)(TT_HUGE - 1);
+}
+
+static void *tt_mem(size_t size)
+{
+  void *p = MAP_FAILED;
+
+#ifdef MAP_HUGETLB
+  p = mmap(NULL, tt_huge_size(size), PROT_READ | PROT_WRITE,
+	   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+  if (p == MAP_FAILED)
+    {
+      p = mmap(NULL, tt_huge_size(size), PROT_READ | PROT_WRITE,
+	       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (p == MAP_FAILED)
+	return NULL;
+#ifdef MADV_HUGEPAGE
+      madvise(p, tt_huge_size(size), MADV_HUGEPAGE);
+#endif
+    }
+  return p;
+}
+
+static void tt_unmem(void *p, size_t size)
+{
+  if (p != NULL)
+    munmap(p, tt_huge_size(size));
+}
+
+#else
+
+static void *tt_mem(size_t size)
+{
+  return malloc(size);
+}
+
+static void tt_unmem(void *p, size_t size)
+{
+  free(p);
+}
+
+#endif /* SJENG_HUGEPAGES */
+
+/* Tables that outlive the run. Built with -DSJENG_PERSIST_TT (make
+   persist) and run with SJENG_TT_FILE naming a file, alloc_hash()
+   maps the tables from that file, shared, so what one run stores,
+   LearnStoreTT()'s book learning included, is there for the next and
+   its searches start warm. The file starts with a tt_file_t; if it
+   is missing, or was written by another layout or table size, the
+   tables start empty. Every run and every search is a new age
+   (age_tt()), and replacement counts an entry as 8 plies shallower
+   for every age it is old, so stale entries give way to new ones.
+   clear_tt() only ages file tables, unless the variant changed since
+   they were filled. The file is locked, so a second process gets
+   tables in memory. Bump TT_FILE_VERSION whenever the entries or the
+   keys change. */
+
+#define TT_FILE_MAGIC   0x54544A53      /* "SJTT" */
+#define TT_FILE_VERSION 1
+
+typedef struct
+{
+  unsigned int magic;
+  unsigned int version;
+  unsigned int shape[4];        /* layout and sizes, see alloc_hash() */
+  int variant;                  /* of the entries */
+  int age;                      /* of the last search */
+  char pad[32];                 /* the tables start cache aligned */
+}
+tt_file_t;
+
+static tt_file_t *tt_file;      /* NULL: tables in memory */
+static int tt_age;
+
+#ifdef SJENG_PERSIST_TT
+
+static size_t tt_file_size;
+static int tt_file_fd = -1;
+
+/* size bytes of tables shaped as shape[] says, from SJENG_TT_FILE,
+   or NULL for tables in memory */
+static void *tt_file_map(size_t size, const unsigned int *shape)
+{
+  const char *name = getenv("SJENG_TT_FILE");
+  struct stat st;
+  void *p;
+  int fd;
+
+  if (name == NULL || !*name)
+    return NULL;
+
+  size += sizeof(tt_file_t);
+  fd = open(name, O_RDWR | O_CREAT, 0644);
+  if (fd < 0 || flock(fd, LOCK_EX | LOCK_NB) != 0
+      || fstat(fd, &st) != 0
+      || ((size_t) st.st_size != size
+	  && (ftruncate(fd, 0) != 0 || ftruncate(fd, (off_t) size) != 0))
+      || (p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+		   fd, 0)) == MAP_FAILED)
+    {
+      printf("Cannot map hashtables from %s, using memory.\n", name);
+      if (fd >= 0)
+	close(fd);
+      return NULL;
+    }
+
+  tt_file = (tt_file_t *) p;
+  tt_file_size = size;
+  tt_file_fd = fd;
+
+  if (tt_file->magic != TT_FILE_MAGIC || tt_file->version != TT_FILE_VERSION
+      || memcmp(tt_file->shape, shape, sizeof(tt_file->shape)))
+    {
+      memset(p, 0, size);
+      tt_file->magic = TT_FILE_MAGIC;
+      tt_file->version = TT_FILE_VERSION;
+      memcpy(tt_file->shape, shape, sizeof(tt_file->shape));
+      tt_file->variant = Normal;
+    }
+
+  /* a new run is a new age */
+  tt_age = tt_file->age = (tt_file->age + 1) & 15;
+
+  return tt_file + 1;
+}
+
+static void tt_file_unmap(void)
+{
+  munmap(tt_file, tt_file_size);
+  close(tt_file_fd);
+  tt_file = NULL;
+}
+
+#else
+
+static void *tt_file_map(size_t size, const unsigned int *shape)
+{
+  return NULL;
+}
+
+static void tt_file_unmap(void)
+{
+}
+
+#endif /* SJENG_PERSIST_TT */
+
+/* clear_tt() of file tables that hold this variant: age them instead */
+static xbool tt_keep(void)
+{
+  if (tt_file == NULL)
+    return FALSE;
+
+  if (tt_file->variant == Variant)
+    {
+      age_tt();
+      return TRUE;
+    }
+
+  tt_file->variant = Variant;
+  return FALSE;
+}
+
+#ifndef SJENG_BUCKET_TT
 
 typedef struct 
 {
@@ -27,9 +216,9 @@ typedef struct
   char Threat;
   char Type;
   unsigned short Bestmove;  
-  unsigned int HashKey;
-  unsigned int Hold_hash;
+  unsigned char Age;            /* tt_age of the store */
   int Bound;
+  hashkey_t HashKey;            /* HashLock(hash, hold_hash) */
 }
 TType;
 
@@ -38,9 +227,8 @@ typedef struct
   char OnMove;  
   char Type;  
   unsigned short Bestmove;  
-  unsigned int HashKey;
-  unsigned int Hold_hash;
   int Bound;
+  hashkey_t HashKey;
 }
 QTType;
 
@@ -50,6 +238,9 @@ QTType *QS_TTable;
 
 void clear_tt(void)
 {
+  if (tt_keep())
+    return;
+
   memset(DP_TTable, 0, sizeof(TType) * TTSize);
   memset(AS_TTable, 0, sizeof(TType) * TTSize);
   memset(QS_TTable, 0, sizeof(QTType) * TTSize);
@@ -60,8 +251,49 @@ void clear_dp_tt(void)
   memset(DP_TTable, 0, sizeof(TType) * TTSize);
 }
 
+/* only file tables age: in memory they are cleared before every
+   search anyway, and the depth-preferred table replaces as it always
+   has */
+void age_tt(void)
+{
+  if (tt_file != NULL)
+    tt_age = tt_file->age = (tt_age + 1) & 15;
+}
+
+/* the depth of e for replacement, less 8 plies an age */
+static int tt_depth(const TType *e)
+{
+  return (int) e->Depth - 8 * ((tt_age - e->Age) & 15);
+}
+
+void prefetch_tt(void)
+{
+#ifdef __GNUC__
+  unsigned int ttindex = (unsigned int) hash % TTSize;
+
+  __builtin_prefetch(&DP_TTable[ttindex]);
+  __builtin_prefetch(&AS_TTable[ttindex]);
+  __builtin_prefetch(&QS_TTable[ttindex]);
+#endif
+}
+
+#endif /* !SJENG_BUCKET_TT */
+
+/* splitmix64, for the upper halves of the keys: randomMT() draws
+   the lower halves as it always has, and nothing else of its stream
+   changes */
+static hashkey_t zobrist_high(hashkey_t *state)
+{
+  hashkey_t z = (*state += 0x9E3779B97F4A7C15ULL);
+
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
 void initialize_zobrist(void)
 {
+  hashkey_t high = 31657;
   int p, q;
   
   seedMT(31657);
@@ -71,6 +303,7 @@ void initialize_zobrist(void)
     for(q = 0; q < 144; q++)
       {
 	zobrist[p][q] = randomMT();
+	zobrist[p][q] |= zobrist_high(&high) & 0xFFFFFFFF00000000ULL;
       }
   }
   /* our magic number */
@@ -94,15 +327,20 @@ void initialize_hash(void)
   hold_hash = 0xC0FFEE00;
   /* we need to set up hold_hash here, rely on ProcessHolding for now */
 
+  bb_reset();
+
 }
 
+#ifndef SJENG_BUCKET_TT
+
 void QStoreTT(int score, int alpha, int beta, int best)
 {
   unsigned int ttindex;
   
   TTStores++;
 
-  ttindex = hash % TTSize;
+  ttindex = (unsigned int) hash % TTSize;
+  MEMTRACE_STORE(QS_TTable + ttindex);
 
   if (score <= alpha)     
     QS_TTable[ttindex].Type = UPPER;
@@ -111,8 +349,7 @@ void QStoreTT(int score, int alpha, int beta, int best)
   else                  
     QS_TTable[ttindex].Type = EXACT;
   
-  QS_TTable[ttindex].HashKey = hash;
-  QS_TTable[ttindex].Hold_hash = hold_hash;
+  QS_TTable[ttindex].HashKey = HashLock(hash, hold_hash);
   QS_TTable[ttindex].Bestmove = best;
   QS_TTable[ttindex].Bound = score;
   QS_TTable[ttindex].OnMove = ToMove;
@@ -126,11 +363,12 @@ void StoreTT(int score, int alpha, int beta, int best, int threat, int depth)
   
   TTStores++;
 
-  ttindex = hash % TTSize;
+  ttindex = (unsigned int) hash % TTSize;
+  MEMTRACE_LOAD(DP_TTable + ttindex);
 
   /* Prefer storing entries with more information */
-  if ((      ((int)DP_TTable[ttindex].Depth < depth) 
-        ||  (((int)DP_TTable[ttindex].Depth == depth) && 
+  if ((      (tt_depth(&DP_TTable[ttindex]) < depth) 
+        ||  ((tt_depth(&DP_TTable[ttindex]) == depth) && 
 	        (    ((DP_TTable[ttindex].Type == UPPER) && (score > alpha))
 		 ||  ((score > alpha) && (score < beta))
 		)
@@ -138,6 +376,7 @@ void StoreTT(int score, int alpha, int beta, int best, int threat, int depth)
       )
       && !is_pondering)
     {
+      MEMTRACE_STORE(DP_TTable + ttindex);
       if (score <= alpha)  
       {
 	DP_TTable[ttindex].Type = UPPER;
@@ -159,9 +398,9 @@ void StoreTT(int score, int alpha, int beta, int best, int threat, int depth)
 	  score -= ply;
       }
       
-      DP_TTable[ttindex].HashKey = hash;
-      DP_TTable[ttindex].Hold_hash = hold_hash;
+      DP_TTable[ttindex].HashKey = HashLock(hash, hold_hash);
       DP_TTable[ttindex].Depth = depth;
+      DP_TTable[ttindex].Age = tt_age;
       DP_TTable[ttindex].Bestmove = best;
       DP_TTable[ttindex].Bound = score;
       DP_TTable[ttindex].OnMove = ToMove;
@@ -169,6 +408,7 @@ void StoreTT(int score, int alpha, int beta, int best, int threat, int depth)
     }
   else 
     {
+      MEMTRACE_STORE(AS_TTable + ttindex);
       if (score <= alpha)  
       {
 	AS_TTable[ttindex].Type = UPPER;
@@ -190,9 +430,9 @@ void StoreTT(int score, int alpha, int beta, int best, int threat, int depth)
 	  score -= ply;
       }
       
-      AS_TTable[ttindex].HashKey = hash;
-      AS_TTable[ttindex].Hold_hash = hold_hash;
+      AS_TTable[ttindex].HashKey = HashLock(hash, hold_hash);
       AS_TTable[ttindex].Depth = depth;
+      AS_TTable[ttindex].Age = tt_age;
       AS_TTable[ttindex].Bestmove = best;
       AS_TTable[ttindex].Bound = score;
       AS_TTable[ttindex].OnMove = ToMove;
@@ -202,13 +442,14 @@ void StoreTT(int score, int alpha, int beta, int best, int threat, int depth)
   return;
 }
 
-void LearnStoreTT(int score, unsigned nhash, unsigned hhash, int tomove, int best, int depth)
+void LearnStoreTT(int score, hashkey_t nhash, hashkey_t hhash, int tomove, int best, int depth)
 {
   unsigned int ttindex;
 
-  ttindex = nhash % TTSize;
+  ttindex = (unsigned int) nhash % TTSize;
 
   AS_TTable[ttindex].Depth = depth;
+  AS_TTable[ttindex].Age = tt_age;
   
   if (Variant != Suicide && Variant != Losers)
   {
@@ -219,8 +460,7 @@ void LearnStoreTT(int score, unsigned nhash, unsigned hhash, int tomove, int bes
     AS_TTable[ttindex].Type = UPPER;
   }
   
-  AS_TTable[ttindex].HashKey = nhash;
-  AS_TTable[ttindex].Hold_hash = hhash;
+  AS_TTable[ttindex].HashKey = HashLock(nhash, hhash);
   AS_TTable[ttindex].Bestmove = best;
   AS_TTable[ttindex].Bound = score;
   AS_TTable[ttindex].OnMove = tomove;
@@ -237,10 +477,13 @@ int ProbeTT(int *score, int beta, int *best, int *threat, int *donull, int depth
 
   TTProbes++;
 
-  ttindex = hash % TTSize;
+  ttindex = (unsigned int) hash % TTSize;
+  /* a miss in the depth-preferred table, the usual case, reads the
+     always-store entry too */
+  MEMTRACE_LOAD(DP_TTable + ttindex);
+  MEMTRACE_LOAD(AS_TTable + ttindex);
   
-  if ((DP_TTable[ttindex].HashKey == hash) 
-      && (DP_TTable[ttindex].Hold_hash == hold_hash) 
+  if ((DP_TTable[ttindex].HashKey == HashLock(hash, hold_hash)) 
       && (DP_TTable[ttindex].OnMove == (char)ToMove))
     {
       TTHits++;
@@ -274,8 +517,7 @@ int ProbeTT(int *score, int beta, int *best, int *threat, int *donull, int depth
 	  return DUMMY;
 	}
     }
-  else if ((AS_TTable[ttindex].HashKey == hash) 
-      && (AS_TTable[ttindex].Hold_hash == hold_hash) 
+  else if ((AS_TTable[ttindex].HashKey == HashLock(hash, hold_hash)) 
       && (AS_TTable[ttindex].OnMove == (char)ToMove))
     {
       TTHits++;
@@ -310,7 +552,11 @@ int ProbeTT(int *score, int beta, int *best, int *threat, int *donull, int depth
 	}
     }
   else
-    return HMISS;
+    {
+      if (DP_TTable[ttindex].HashKey || AS_TTable[ttindex].HashKey)
+	Stat(TTCollisions);
+      return HMISS;
+    }
 
 }
 
@@ -321,10 +567,10 @@ int QProbeTT(int *score, int *best)
 
   TTProbes++;
 
-  ttindex = hash % TTSize;
+  ttindex = (unsigned int) hash % TTSize;
+  MEMTRACE_LOAD(QS_TTable + ttindex);
   
-  if ((QS_TTable[ttindex].HashKey == hash) 
-      && (QS_TTable[ttindex].Hold_hash == hold_hash) 
+  if ((QS_TTable[ttindex].HashKey == HashLock(hash, hold_hash)) 
       && (QS_TTable[ttindex].OnMove == (char)ToMove))
     {
       TTHits++;
@@ -336,16 +582,40 @@ int QProbeTT(int *score, int *best)
       return QS_TTable[ttindex].Type;
     }
   else
-    return HMISS;
+    {
+      if (QS_TTable[ttindex].HashKey)
+	Stat(TTCollisions);
+      return HMISS;
+    }
 
 }
 
 
 void alloc_hash(void)
 {
-  AS_TTable = (TType *) malloc(sizeof(TType) * TTSize);
-  DP_TTable = (TType *) malloc(sizeof(TType) * TTSize);
-  QS_TTable = (QTType *) malloc(sizeof(QTType) * TTSize);
+  unsigned int shape[4];
+
+  if (cfg_hash_mb > 0)
+    TTSize = (int) (((size_t) cfg_hash_mb << 20)
+		    / (2 * sizeof(TType) + sizeof(QTType)));
+
+  shape[0] = 0;
+  shape[1] = sizeof(TType);
+  shape[2] = sizeof(QTType);
+  shape[3] = TTSize;
+
+  AS_TTable = (TType *) tt_file_map((2 * sizeof(TType) + sizeof(QTType))
+				    * (size_t) TTSize, shape);
+  if (AS_TTable != NULL)
+    {
+      DP_TTable = AS_TTable + TTSize;
+      QS_TTable = (QTType *) (DP_TTable + TTSize);
+      return;
+    }
+
+  AS_TTable = (TType *) tt_mem(sizeof(TType) * TTSize);
+  DP_TTable = (TType *) tt_mem(sizeof(TType) * TTSize);
+  QS_TTable = (QTType *) tt_mem(sizeof(QTType) * TTSize);
 
   if (AS_TTable == NULL || DP_TTable == NULL || QS_TTable == NULL)
   {
@@ -363,9 +633,357 @@ void alloc_hash(void)
 
 void free_hash(void)
 {
-  free(AS_TTable);
-  free(DP_TTable);
-  free(QS_TTable);
+  if (tt_file != NULL)
+    {
+      tt_file_unmap();
+      return;
+    }
+
+  tt_unmem(AS_TTable, sizeof(TType) * TTSize);
+  tt_unmem(DP_TTable, sizeof(TType) * TTSize);
+  tt_unmem(QS_TTable, sizeof(QTType) * TTSize);
+  return;
+}
+
+#else /* SJENG_BUCKET_TT */
+
+/* Bucketed tables (make bucket). A 64-byte line holds a bucket of
+   four entries, picked with a power-of-two mask of the hash. An
+   entry packs its fields into one 64-bit word and stores the key
+   HashLock(hash, hold_hash) XORed with that word in the other. So an entry
+   half written by one thread and half by another, or read half
+   written, does not match its key, and the Lazy SMP threads of smp.c
+   can share the tables without locks. This is Hyatt's lockless
+   hashing.
+
+   One table takes the place of the depth-preferred and the
+   always-store ones, with the same memory. A store replaces the
+   entry of the same position if the bucket has one, else the empty
+   or least valuable entry, counting depth less 8 plies for every
+   search it is old (age_tt()); file tables keep the age across runs.
+
+   Quiescence entries get a second table of half the size. */
+
+#define TT_WAYS 4
+
+typedef unsigned long long tt_word;
+
+typedef struct
+{
+  tt_word check;                /* key ^ data */
+  tt_word data;
+}
+TTEntry;
+
+typedef struct
+{
+  TTEntry e[TT_WAYS];
+}
+TTBucket;
+
+/* data: bound 0-31, best move 32-47, depth 48-55, type 56-57,
+   threat 58, side to move 59, age 60-63 */
+#define TT_BOUND(d)  ((int)(unsigned int)(d))
+#define TT_BEST(d)   ((int)(((d) >> 32) & 0xFFFF))
+#define TT_DEPTH(d)  ((int)(signed char)(((d) >> 48) & 0xFF))
+#define TT_TYPE(d)   ((int)(((d) >> 56) & 3))
+#define TT_THREAT(d) ((int)(((d) >> 58) & 1))
+#define TT_ONMOVE(d) ((int)(((d) >> 59) & 1))
+#define TT_AGE(d)    ((int)(((d) >> 60) & 15))
+
+static TTBucket *TTable, *QS_TTable;
+static void *TTable_mem, *QS_TTable_mem;
+static unsigned int TT_mask, QS_mask;
+
+static tt_word tt_key(hashkey_t nhash, hashkey_t hhash)
+{
+  return HashLock(nhash, hhash);
+}
+
+static tt_word tt_pack(int score, int best, int threat, int depth,
+		       int type, int tomove)
+{
+  return (tt_word)(unsigned int) score
+    | ((tt_word)(best & 0xFFFF) << 32)
+    | ((tt_word)(depth & 0xFF) << 48)
+    | ((tt_word)(type & 3) << 56)
+    | ((tt_word)(threat ? 1 : 0) << 58)
+    | ((tt_word)(tomove & 1) << 59)
+    | ((tt_word) tt_age << 60);
+}
+
+static void tt_store(TTBucket *b, tt_word key, tt_word data)
+{
+  TTEntry *victim;
+  tt_word d;
+  int i, value, low;
+
+  victim = &b->e[0];
+  low = INT_MAX;
+
+  for (i = 0; i < TT_WAYS; i++)
+    {
+      MEMTRACE_LOAD(&b->e[i]);
+      d = b->e[i].data;
+
+      /* the newest result for a position is the one to keep */
+      if ((b->e[i].check ^ d) == key)
+	{
+	  victim = &b->e[i];
+	  break;
+	}
+
+      if (d == 0 && b->e[i].check == 0)
+	value = -INT_MAX;
+      else
+	value = TT_DEPTH(d) - 8 * ((tt_age - TT_AGE(d)) & 15);
+
+      if (value < low)
+	{
+	  low = value;
+	  victim = &b->e[i];
+	}
+    }
+
+  MEMTRACE_STORE(victim);
+  victim->data = data;
+  victim->check = key ^ data;
+}
+
+/* the matching entry's data in *data, or FALSE */
+static xbool tt_find(TTBucket *b, tt_word key, tt_word *data)
+{
+  tt_word d;
+  int i;
+
+  for (i = 0; i < TT_WAYS; i++)
+    {
+      MEMTRACE_LOAD(&b->e[i]);
+      d = b->e[i].data;
+
+      if ((b->e[i].check ^ d) == key && TT_ONMOVE(d) == ToMove)
+	{
+	  *data = d;
+	  return TRUE;
+	}
+    }
+
+  /* a collision: missed in a bucket with no room left */
+  if (b->e[TT_WAYS-1].data)
+    Stat(TTCollisions);
+
+  return FALSE;
+}
+
+void clear_tt(void)
+{
+  if (tt_keep())
+    return;
+
+  memset(TTable, 0, sizeof(TTBucket) * ((size_t)TT_mask + 1));
+  memset(QS_TTable, 0, sizeof(TTBucket) * ((size_t)QS_mask + 1));
+}
+
+void clear_dp_tt(void)
+{
+  memset(TTable, 0, sizeof(TTBucket) * ((size_t)TT_mask + 1));
+}
+
+void age_tt(void)
+{
+  tt_age = (tt_age + 1) & 15;
+  if (tt_file != NULL)
+    tt_file->age = tt_age;
+}
+
+void prefetch_tt(void)
+{
+#ifdef __GNUC__
+  __builtin_prefetch(&TTable[hash & TT_mask]);
+  __builtin_prefetch(&QS_TTable[hash & QS_mask]);
+#endif
+}
+
+void QStoreTT(int score, int alpha, int beta, int best)
+{
+  int type;
+
+  TTStores++;
+
+  if (score <= alpha)     
+    type = UPPER;
+  else if(score >= beta) 
+    type = LOWER;
+  else                  
+    type = EXACT;
+
+  tt_store(&QS_TTable[hash & QS_mask], tt_key(hash, hold_hash),
+	   tt_pack(score, best, 0, 0, type, ToMove));
+}
+
+void StoreTT(int score, int alpha, int beta, int best, int threat, int depth)
+{
+  int type;
+
+  TTStores++;
+
+  if (score <= alpha)  
+    {
+      type = UPPER;
+      if (score < -INF+500) score = -INF+500;
+    }
+  else if(score >= beta) 
+    {
+      type = LOWER;
+      if (score > INF-500) score = INF-500;
+    }
+  else                  
+    {
+      type = EXACT;
+
+      /* normalize mate scores */
+      if (score > (INF-500))
+	score += ply;
+      else if (score < (-INF+500))
+	score -= ply;
+    }
+
+  tt_store(&TTable[hash & TT_mask], tt_key(hash, hold_hash),
+	   tt_pack(score, best, threat, depth, type, ToMove));
+}
+
+void LearnStoreTT(int score, hashkey_t nhash, hashkey_t hhash, int tomove, int best, int depth)
+{
+  int type;
+
+  if (Variant != Suicide && Variant != Losers)
+    type = EXACT;
+  else
+    type = UPPER;
+
+  tt_store(&TTable[nhash & TT_mask], tt_key(nhash, hhash),
+	   tt_pack(score, best, 0, depth, type, tomove));
+}
+
+int ProbeTT(int *score, int beta, int *best, int *threat, int *donull, int depth)
+{
+  tt_word d;
+
+  *donull = TRUE;
+
+  TTProbes++;
+
+  if (!tt_find(&TTable[hash & TT_mask], tt_key(hash, hold_hash), &d))
+    return HMISS;
+
+  TTHits++;
+
+  if ((TT_TYPE(d) == UPPER) 
+      && ((depth-2-1) <= TT_DEPTH(d)) 
+      && (TT_BOUND(d) < beta)) 
+    *donull = FALSE;
+
+  if (TT_THREAT(d)) depth++;
+
+  *best = TT_BEST(d);
+  *threat = TT_THREAT(d);
+
+  if (TT_DEPTH(d) >= depth)
+    {
+      *score = TT_BOUND(d);
+
+      if (*score > (INF-500))
+	*score -= ply;
+      else if (*score < (-INF+500))
+	*score += ply;
+
+      return TT_TYPE(d);
+    }
+  else
+    return DUMMY;
+}
+
+int QProbeTT(int *score, int *best)
+{
+  tt_word d;
+
+  TTProbes++;
+
+  if (!tt_find(&QS_TTable[hash & QS_mask], tt_key(hash, hold_hash), &d))
+    return HMISS;
+
+  TTHits++;
+
+  *score = TT_BOUND(d);
+  *best = TT_BEST(d);
+
+  return TT_TYPE(d);
+}
+
+/* the largest power of two <= n, at least 1 */
+static unsigned int tt_pow2(unsigned int n)
+{
+  unsigned int p = 1;
+
+  while (p <= n / 2) p *= 2;
+  return p;
+}
+
+static TTBucket *tt_alloc(unsigned int buckets, void **mem)
+{
+  *mem = tt_mem(sizeof(TTBucket) * (size_t) buckets + 63);
+
+  if (*mem == NULL)
+  {
+    printf("Out of memory allocating hashtables.\n");
+    exit(EXIT_FAILURE);
+  }
+  return (TTBucket *)(((size_t) *mem + 63) & ~(size_t) 63);
+}
+
+void alloc_hash(void)
+{
+  unsigned int shape[4];
+
+  /* two thirds of SJENG_HASH_MB for the main table, a third for
+     the quiescence one */
+  if (cfg_hash_mb > 0)
+    TTSize = (int) (((size_t) cfg_hash_mb << 20) / (3 * sizeof(TTEntry)));
+
+  /* the entries of the two TTSize tables, and of the quiescence one */
+  TT_mask = tt_pow2(2 * TTSize / TT_WAYS) - 1;
+  QS_mask = tt_pow2(TTSize / TT_WAYS) - 1;
+
+  shape[0] = 1;
+  shape[1] = sizeof(TTBucket);
+  shape[2] = TT_mask + 1;
+  shape[3] = QS_mask + 1;
+
+  TTable = (TTBucket *) tt_file_map(sizeof(TTBucket)
+				    * ((size_t) TT_mask + QS_mask + 2), shape);
+  if (TTable != NULL)
+    {
+      QS_TTable = TTable + TT_mask + 1;
+      return;
+    }
+
+  TTable = tt_alloc(TT_mask + 1, &TTable_mem);
+  QS_TTable = tt_alloc(QS_mask + 1, &QS_TTable_mem);
+  return;
+}
+
+void free_hash(void)
+{
+  if (tt_file != NULL)
+    {
+      tt_file_unmap();
+      return;
+    }
+
+  tt_unmem(TTable_mem, sizeof(TTBucket) * ((size_t)TT_mask + 1) + 63);
+  tt_unmem(QS_TTable_mem, sizeof(TTBucket) * ((size_t)QS_mask + 1) + 63);
   return;
 }
 
+#endif /* SJENG_BUCKET_TT */
+
@@ -559,6 +559,9 @@ void post_thinking (int score) {
   char output[STR_BUFF];
   char hashpv[STR_BUFF];
 
+  /* helper threads of smp.c search in silence */
+  if (smp_helper) return;
+
   /* in xboard mode, follow xboard conventions for thinking output, otherwise
      output the iterative depth, human readable score, and the pv */
 /*  if (xb_mode) {*/
@@ -618,6 +621,8 @@ void post_fail_thinking(int score, move_s *failmove)
   int elapsed,nps;
   char output[STR_BUFF];
 
+  if (smp_helper) return;
+
   /* in xboard mode, follow xboard conventions for thinking output, otherwise
      output the iterative depth, human readable score, and the pv */
     elapsed = rdifftime (rtime (), start_time);
@@ -647,6 +652,8 @@ void post_fh_thinking(int score, move_s *failmove)
   int elapsed,nps;
   char output[STR_BUFF];
 
+  if (smp_helper) return;
+
   /* in xboard mode, follow xboard conventions for thinking output, otherwise
      output the iterative depth, human readable score, and the pv */
     elapsed = rdifftime (rtime (), start_time);
@@ -676,6 +683,8 @@ void post_fl_thinking(int score, move_s *failmove)
   int elapsed,nps;
   char output[STR_BUFF];
 
+  if (smp_helper) return;
+
   /* in xboard mode, follow xboard conventions for thinking output, otherwise
      output the iterative depth, human readable score, and the pv */
     elapsed = rdifftime (rtime (), start_time);
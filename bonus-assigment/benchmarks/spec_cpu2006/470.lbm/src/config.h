@@ -8,18 +8,112 @@
 /*############################################################################*/
 
 #define SIZE   (100)
-#define SIZE_X (1*SIZE)
-#define SIZE_Y (1*SIZE)
-#define SIZE_Z (130)
+#define DEFAULT_SIZE_X (1*SIZE)
+#define DEFAULT_SIZE_Y (1*SIZE)
+#define DEFAULT_SIZE_Z (130)
+
+/* Built with -DLBM_DYNAMIC_SIZE (make dynamic), the domain size is
+   chosen at run time by LBM_setSize() from --size or the obstacle
+   file, and rows are PITCH_X cells apart. */
+
+#if defined(LBM_DYNAMIC_SIZE)
+
+extern int  LBM_sizeX, LBM_sizeY, LBM_sizeZ;
+extern long LBM_pitchX;
+
+#define SIZE_X  LBM_sizeX
+#define SIZE_Y  LBM_sizeY
+#define SIZE_Z  LBM_sizeZ
+#define PITCH_X LBM_pitchX
+
+#else /* LBM_DYNAMIC_SIZE */
+
+#define SIZE_X DEFAULT_SIZE_X
+#define SIZE_Y DEFAULT_SIZE_Y
+#define SIZE_Z DEFAULT_SIZE_Z
+#define PITCH_X SIZE_X
+
+#endif /* LBM_DYNAMIC_SIZE */
+
+/* Built with -DLBM_MPI (make mpi), every MPI rank holds the SIZE_Z
+   planes from OFFSET_Z on of a domain GLOBAL_SIZE_Z planes high, and
+   only the root rank prints. */
+
+#if defined(LBM_MPI)
+
+#if !defined(LBM_DYNAMIC_SIZE)
+#error "LBM_MPI needs LBM_DYNAMIC_SIZE"
+#endif
+
+extern int LBM_rank, LBM_nRanks, LBM_globalSizeZ, LBM_offsetZ;
+
+#define GLOBAL_SIZE_Z LBM_globalSizeZ
+#define OFFSET_Z      LBM_offsetZ
+#define IS_ROOT       (LBM_rank == 0)
+
+#else /* LBM_MPI */
+
+#define GLOBAL_SIZE_Z SIZE_Z
+#define OFFSET_Z      0
+#define IS_ROOT       TRUE
+
+#endif /* LBM_MPI */
 
 #define OMEGA (1.95)
 
+/* The collision operator, -DLBM_COLLISION=LBM_TRT (make trt) or
+   LBM_MRT (make mrt); the default is the BGK of the original code.
+   TRT_MAGIC sets the second rate of TRT, and the MRT_S_* the rates of
+   the moments that MRT does not relax with OMEGA (see lbm.c). */
+#define LBM_BGK 0
+#define LBM_TRT 1
+#define LBM_MRT 2
+#if !defined(LBM_COLLISION)
+#define LBM_COLLISION LBM_BGK
+#endif
+
+#define TRT_MAGIC (0.25)
+
+#define MRT_S_E   (1.19)  /* energy           */
+#define MRT_S_EPS (1.4 )  /* energy squared   */
+#define MRT_S_Q   (1.2 )  /* energy flux      */
+#define MRT_S_PI  (1.4 )  /* fourth order     */
+#define MRT_S_M   (1.98)  /* third order      */
+
 #define OUTPUT_PRECISION float
 
+/* Built with -DLBM_FLOAT (make float), the grid holds floats, which
+   halves the memory traffic of every sweep; sums over a cell are
+   still taken in double. */
+#if defined(LBM_FLOAT)
+#define GRID_PRECISION float
+#else
+#define GRID_PRECISION double
+#endif
+
 #define BOOL int
 #define TRUE (-1)
 #define FALSE (0)
 
+/* Built with -DGEM5_ROI (make roi), the time step loop is marked for
+   gem5: the statistics are reset when it starts, once the grids are
+   set up, and dumped when it ends, before the result is written. */
+#if defined(GEM5_ROI)
+#include <gem5/m5ops.h>
+#define ROI_BEGIN() do { m5_work_begin( 0, 0 ); m5_reset_stats( 0, 0 ); } while( 0 )
+#define ROI_END()   do { m5_dump_stats( 0, 0 ); m5_work_end( 0, 0 ); } while( 0 )
+#else
+#define ROI_BEGIN() do { } while( 0 )
+#define ROI_END()   do { } while( 0 )
+#endif
+
+/* Built with -DMEM_TRACE (make trace), the scalar stream-collide sweep
+   logs the addresses of its loads and stores (see lbm.c and
+   ../../memtrace/memtrace.h). */
+#if defined(MEM_TRACE)
+#include "memtrace.h"
+#endif
+
 /*############################################################################*/
 
 #endif /* _CONFIG_H_ */
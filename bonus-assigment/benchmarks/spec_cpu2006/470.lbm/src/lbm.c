@@ -6,9 +6,18 @@
 #include <math.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
 
+#if defined(LBM_CHECKPOINT)
+#include <pthread.h>
+#endif
 
-#if !defined(SPEC_CPU)
+#if defined(LBM_MPI)
+#include <mpi.h>
+#endif
+
+#if !defined(SPEC_CPU) || defined(LBM_OMP) || defined(LBM_GPU)
 #ifdef _OPENMP
 #include <omp.h>
 #endif
@@ -20,13 +29,344 @@
 #define DFL2 (1.0/18.0)
 #define DFL3 (1.0/36.0)
 
+/* the functions of a single cell go inline into the loops of the
+   sweeps, even where they are too long for the compiler to think so */
+#if defined(__GNUC__)
+#define CELL_FUNC static inline __attribute__(( always_inline ))
+#else
+#define CELL_FUNC static inline
+#endif
+
+#if defined(LBM_SIMD) && !defined(LBM_SIMD_WIDTH)
+#define LBM_SIMD_WIDTH 4
+#endif
+
+#if defined(LBM_AA) || defined(LBM_MPI) || LBM_COLLISION != LBM_BGK
+/* the lattice vector (x, y, z) of each distribution */
+static const int distrDir[N_DISTR_FUNCS][3] = {
+	{  0,  0,  0 },
+	{  0, +1,  0 }, {  0, -1,  0 }, { +1,  0,  0 }, { -1,  0,  0 },
+	{  0,  0, +1 }, {  0,  0, -1 },
+	{ +1, +1,  0 }, { -1, +1,  0 }, { +1, -1,  0 }, { -1, -1,  0 },
+	{  0, +1, +1 }, {  0, +1, -1 }, {  0, -1, +1 }, {  0, -1, -1 },
+	{ +1,  0, +1 }, { +1,  0, -1 }, { -1,  0, +1 }, { -1,  0, -1 }};
+#endif
+
+/*############################################################################*/
+
+/* Built with -DLBM_OMP (make omp), the SPEC build runs in parallel
+   too. Instead of handing out the cells of one long sweep, every
+   thread of a parallel region takes a slab of whole z planes, and it
+   is the same slab in LBM_initializeGrid and in the stream-collide
+   sweep, so each page of the grids is first touched, and thus
+   placed on a NUMA node, by the thread that works on it later. */
+
+#if defined(LBM_OMP)
+
+#if !defined(_OPENMP)
+#error "LBM_OMP needs OpenMP (-fopenmp)"
+#endif
+
+/* planes [*z1, *z2) of the calling thread; the planes of [zBegin,
+   zEnd) inside 0..SIZE_Z-1 are split evenly, and the first and the
+   last thread also take the ghost planes below and above */
+static void threadSlab( const int zBegin, const int zEnd, int* z1, int* z2 ) {
+	const int n  = omp_get_num_threads(),
+	          t  = omp_get_thread_num(),
+	          lo = (zBegin < 0     ) ? 0      : zBegin,
+	          hi = (zEnd   > SIZE_Z) ? SIZE_Z : zEnd;
+
+	*z1 = (t == 0  ) ? zBegin : lo + ((hi-lo)* t   ) / n;
+	*z2 = (t == n-1) ? zEnd   : lo + ((hi-lo)*(t+1)) / n;
+}
+
+#define SLAB_SWEEP_START(zBegin,zEnd) { \
+	int _z1_, _z2_; \
+	threadSlab( zBegin, zEnd, &_z1_, &_z2_ ); \
+	SWEEP_START( 0, 0, _z1_, 0, 0, _z2_ )
+
+#define SLAB_SWEEP_END SWEEP_END }
+
+#else /* LBM_OMP */
+
+#define SLAB_SWEEP_START(zBegin,zEnd) SWEEP_START( 0, 0, zBegin, 0, 0, zEnd )
+#define SLAB_SWEEP_END SWEEP_END
+
+#endif /* LBM_OMP */
+
+/* Built with -DLBM_SPARSE (make sparse), the stream-collide sweeps
+   visit only the cells of LBM_buildCellList(): the fluid cells and
+   the obstacle cells next to one. An obstacle cell sends each value
+   back to the cell it came from, so between two obstacle cells the
+   values of the initial rest state just go back and forth, and
+   skipping the cells inside a solid changes nothing, not even the
+   statistics. The list holds runs of such cells that follow each
+   other in memory, so the inner loop remains a plain sweep, and it
+   is ordered by z, so CELL_SWEEP_START() can take the planes
+   [zBegin, zEnd) of it, or a thread's slab. */
+
+#if defined(LBM_SPARSE)
+
+#if defined(LBM_SIMD)
+#error "LBM_SPARSE has no SIMD kernel"
+#endif
+
+static long *sparseRun   = NULL,  /* [begin, end) index of each run */
+            *sparseStart = NULL;  /* first run of each z plane      */
+
+static long planeRun( int z ) {
+	if( z < 0      ) z = 0;
+	if( z > SIZE_Z ) z = SIZE_Z;
+	return sparseStart[z];
+}
+
+#define RUN_SWEEP_START(z1,z2) \
+	for( long _r_ = planeRun( z1 ); _r_ < planeRun( z2 ); _r_++ ) \
+		for( i = sparseRun[2*_r_]; i < sparseRun[2*_r_+1]; \
+		     i += CALC_INDEX( 1, 0, 0, 0 )) {
+
+#if defined(LBM_OMP)
+#define CELL_SWEEP_START(zBegin,zEnd) { \
+	int _z1_, _z2_; \
+	threadSlab( zBegin, zEnd, &_z1_, &_z2_ ); \
+	RUN_SWEEP_START( _z1_, _z2_ )
+#define CELL_SWEEP_END } }
+#else
+#define CELL_SWEEP_START(zBegin,zEnd) RUN_SWEEP_START( zBegin, zEnd )
+#define CELL_SWEEP_END }
+#endif
+
+#else /* LBM_SPARSE */
+
+#define CELL_SWEEP_START(zBegin,zEnd) SLAB_SWEEP_START( zBegin, zEnd )
+#define CELL_SWEEP_END SLAB_SWEEP_END
+
+#endif /* LBM_SPARSE */
+
+/*############################################################################*/
+
+#if defined(LBM_DYNAMIC_SIZE)
+
+int  LBM_sizeX = DEFAULT_SIZE_X, LBM_sizeY = DEFAULT_SIZE_Y, LBM_sizeZ = DEFAULT_SIZE_Z;
+long LBM_pitchX = DEFAULT_SIZE_X;
+#if defined(LBM_GPU)
+#pragma omp declare target( LBM_sizeX, LBM_sizeY, LBM_sizeZ, LBM_pitchX )
+#endif
+
+#if defined(LBM_SIMD)
+#define PITCH_STEP LBM_SIMD_WIDTH
+#else
+#define PITCH_STEP 1
+#endif
+
+/*############################################################################*/
+
+void LBM_setSize( const int sizeX, const int sizeY, const int sizeZ ) {
+	int n;
+
+	LBM_sizeX = sizeX;
+	LBM_sizeY = sizeY;
+	LBM_sizeZ = sizeZ;
+
+	/* Rows are padded only where they have to be, because the side
+	   walls of a padded row no longer wrap around to the next row,
+	   and in a channel the inflow extrapolates its density from the
+	   walls too: padding changes the results slightly. SIMD sweeps
+	   need whole vectors per z plane; and a z plane that is a
+	   multiple of 4 KByte long would map the z neighbours of a cell
+	   onto the same cache sets. */
+	LBM_pitchX = sizeX;
+#if defined(LBM_SIMD)
+	if( (LBM_pitchX*sizeY) % LBM_SIMD_WIDTH != 0 )
+		LBM_pitchX = (sizeX + LBM_SIMD_WIDTH-1) / LBM_SIMD_WIDTH * LBM_SIMD_WIDTH;
+#endif
+	for( n = 0; n < 8 && ((CALC_INDEX( 0, 0, 1, 0 ) - CALC_INDEX( 0, 0, 0, 0 ))
+	                      * sizeof( GRID_PRECISION )) % 4096 == 0; n++ )
+		LBM_pitchX += PITCH_STEP;
+}
+
+/*############################################################################*/
+
+BOOL LBM_readObstacleFileSize( const char* filename,
+                               int* sizeX, int* sizeY, int* sizeZ ) {
+	struct stat fileStat;
+	int c;
+
+	FILE* file = fopen( filename, "rb" );
+	if( ! file || fstat( fileno( file ), &fileStat ) != 0 ) {
+		if( file ) fclose( file );
+		return FALSE;
+	}
+
+	/* SIZE_X characters and a newline per row, an empty line after
+	   the SIZE_Y rows of every z plane */
+	*sizeX = *sizeY = 0;
+	while( (c = fgetc( file )) != EOF && c != '\n' ) (*sizeX)++;
+	while( c == '\n' ) {
+		(*sizeY)++;
+		if( fseek( file, *sizeX, SEEK_CUR ) != 0 ) break;
+		c = fgetc( file );
+	}
+	fclose( file );
+
+	if( *sizeX == 0 || *sizeY == 0 ) return FALSE;
+	*sizeZ = fileStat.st_size / ((long) (*sizeX+1)*(*sizeY) + 1);
+	return (long) *sizeX*(*sizeY)*(*sizeZ) + (long) (*sizeY+1)*(*sizeZ)
+	       == fileStat.st_size;
+}
+
+#endif /* LBM_DYNAMIC_SIZE */
+
+/*############################################################################*/
+
+#if defined(LBM_MPI)
+
+/* The ranks split the domain along z. A cell only reads its own
+   values and pushes the results to its neighbours, so there is no
+   data to fetch before a sweep; what a rank pushes into its ghost
+   planes belongs to the rank below or above, which takes it over
+   afterwards. As a push of (dx, dy, dz) is one of d = dx + dy*PITCH_X
+   + dz*PITCH_X*SIZE_Y cells in memory, the values that leave the top
+   of a slab in direction e are those of the first d cells from plane
+   SIZE_Z on, whatever their z; across the ends of rows these are in
+   plane SIZE_Z+1, or in the planes 0 and 1 of the next rank, just as
+   the pushes of a single domain go. LBM_performStreamCollide() sweeps
+   the planes that feed the ghost planes first and exchanges their
+   values while it sweeps the rest. */
+
+#if defined(LBM_AA) || defined(LBM_CHECKPOINT)
+#error "LBM_MPI works with neither LBM_AA nor LBM_CHECKPOINT"
+#endif
+
+int LBM_rank = 0, LBM_nRanks = 1, LBM_globalSizeZ = DEFAULT_SIZE_Z, LBM_offsetZ = 0;
+
+static GRID_PRECISION *haloSend[2] = { NULL, NULL },  /* 0: down, 1: up */
+                      *haloRecv[2] = { NULL, NULL };
+static long haloSize[2];
+static MPI_Request haloRequest[4];
+static int nHaloRequests = 0;
+
+#define HALO_TYPE (sizeof( GRID_PRECISION ) == sizeof( double ) ? MPI_DOUBLE : MPI_FLOAT)
+
+static long cellOffset( const int e ) {
+	return distrDir[e][0] + distrDir[e][1]*PITCH_X + distrDir[e][2]*PITCH_X*SIZE_Y;
+}
+
+/*############################################################################*/
+
+void LBM_initializeMPI( int* nArgs, char*** arg ) {
+	int provided;
+
+	MPI_Init_thread( nArgs, arg, MPI_THREAD_FUNNELED, &provided );
+	MPI_Comm_rank( MPI_COMM_WORLD, &LBM_rank );
+	MPI_Comm_size( MPI_COMM_WORLD, &LBM_nRanks );
+}
+
+/*############################################################################*/
+
+void LBM_finalizeMPI( void ) {
+	int h;
+
+	for( h = 0; h < 2; h++ ) {
+		free( haloSend[h] );
+		free( haloRecv[h] );
+	}
+	MPI_Finalize();
+}
+
+/*############################################################################*/
+
+/* gives this rank its share of the sizeZ planes; FALSE if a slab
+   would be thinner than the three planes in/out-flow reads */
+BOOL LBM_splitDomain( const int sizeX, const int sizeY, const int sizeZ ) {
+	const int nz = sizeZ / LBM_nRanks + (LBM_rank < sizeZ % LBM_nRanks);
+	int e, h;
+
+	LBM_globalSizeZ = sizeZ;
+	LBM_offsetZ     = LBM_rank * (sizeZ / LBM_nRanks) +
+	                  (LBM_rank < sizeZ % LBM_nRanks ? LBM_rank : sizeZ % LBM_nRanks);
+	LBM_setSize( sizeX, sizeY, nz );
+	if( sizeZ / LBM_nRanks < 3 ) return FALSE;
+
+	haloSize[0] = haloSize[1] = 0;
+	for( e = 0; e < N_DISTR_FUNCS; e++ ) {
+		if( cellOffset( e ) < 0 ) haloSize[0] -= cellOffset( e );
+		if( cellOffset( e ) > 0 ) haloSize[1] += cellOffset( e );
+	}
+	for( h = 0; h < 2; h++ ) {
+		haloSend[h] = malloc( haloSize[h]*sizeof( GRID_PRECISION ));
+		haloRecv[h] = malloc( haloSize[1-h]*sizeof( GRID_PRECISION ));
+		if( ! haloSend[h] || ! haloRecv[h] ) {
+			printf( "LBM_splitDomain: could not allocate the halo buffers\n" );
+			exit( 1 );
+		}
+	}
+	return TRUE;
+}
+
+/*############################################################################*/
+
+/* the values pushed out of a slab at the bottom (h = 0) or the top
+   (h = 1): from the ghost planes of the rank they leave, or (in) into
+   the planes of the rank they go to, at the other end of its slab */
+static void copyHalo( LBM_Grid grid, const int h, const BOOL in,
+                      GRID_PRECISION* buffer ) {
+	long d, k, n = 0;
+	int e;
+
+	for( e = 0; e < N_DISTR_FUNCS; e++ ) {
+		d = cellOffset( e );
+		if( (h == 0) ? (d >= 0) : (d <= 0) ) continue;
+
+		for( k = (d < 0 ? d : 0); k < (d > 0 ? d : 0); k++ ) {
+			/* leaving: past the own planes; coming in: inside them */
+			const long j = (in ? h == 1 : h == 0) ? CALC_INDEX( k, 0, 0,      e )
+			                                      : CALC_INDEX( k, 0, SIZE_Z, e );
+			if( in ) grid[j] = buffer[n++];
+			else     buffer[n++] = grid[j];
+		}
+	}
+}
+
+/*############################################################################*/
+
+static void startHaloExchange( LBM_Grid grid ) {
+	const int neighbour[2] = { LBM_rank-1, LBM_rank+1 };
+	int h;
+
+	nHaloRequests = 0;
+	for( h = 0; h < 2; h++ ) {
+		if( neighbour[h] < 0 || neighbour[h] >= LBM_nRanks ) continue;
+
+		copyHalo( grid, h, FALSE, haloSend[h] );
+		MPI_Irecv( haloRecv[h], haloSize[1-h], HALO_TYPE, neighbour[h], 1-h,
+		           MPI_COMM_WORLD, &haloRequest[nHaloRequests++] );
+		MPI_Isend( haloSend[h], haloSize[h], HALO_TYPE, neighbour[h], h,
+		           MPI_COMM_WORLD, &haloRequest[nHaloRequests++] );
+	}
+}
+
+/*############################################################################*/
+
+static void finishHaloExchange( LBM_Grid grid ) {
+	MPI_Waitall( nHaloRequests, haloRequest, MPI_STATUSES_IGNORE );
+
+	/* the rank below sent what left its top, and the other way round */
+	if( LBM_rank > 0              ) copyHalo( grid, 1, TRUE, haloRecv[0] );
+	if( LBM_rank < LBM_nRanks - 1 ) copyHalo( grid, 0, TRUE, haloRecv[1] );
+}
+
+#endif /* LBM_MPI */
+
 /*############################################################################*/
 
-void LBM_allocateGrid( double** ptr ) {
-	const size_t margin = 2*SIZE_X*SIZE_Y*N_CELL_ENTRIES,
-	             size   = sizeof( LBM_Grid ) + 2*margin*sizeof( double );
+void LBM_allocateGrid( GRID_PRECISION** ptr ) {
+	const size_t margin = GRID_MARGIN,
+	             size   = GRID_SIZE*sizeof( GRID_PRECISION );
+	void* aux;
 
-	*ptr = malloc( size );
+	/* aligned to a cache line */
+	*ptr = posix_memalign( &aux, 64, size ) == 0 ? aux : NULL;
 	if( ! *ptr ) {
 		printf( "LBM_allocateGrid: could not allocate %.1f MByte\n",
 		        size / (1024.0*1024.0) );
@@ -41,8 +381,8 @@ void LBM_allocateGrid( double** ptr ) {
 
 /*############################################################################*/
 
-void LBM_freeGrid( double** ptr ) {
-	const size_t margin = 2*SIZE_X*SIZE_Y*N_CELL_ENTRIES;
+void LBM_freeGrid( GRID_PRECISION** ptr ) {
+	const size_t margin = GRID_MARGIN;
 
 	free( *ptr-margin );
 	*ptr = NULL;
@@ -50,16 +390,22 @@ void LBM_freeGrid( double** ptr ) {
 
 /*############################################################################*/
 
+#if defined(LBM_AA)
+static void initializeInPlace( LBM_Grid grid );
+#endif
+
 void LBM_initializeGrid( LBM_Grid grid ) {
 	SWEEP_VAR
 
 	/*voption indep*/
-#if !defined(SPEC_CPU)
+#if defined(LBM_OMP)
+#pragma omp parallel private( i )
+#elif !defined(SPEC_CPU)
 #ifdef _OPENMP
 #pragma omp parallel for
 #endif
 #endif
-	SWEEP_START( 0, 0, -2, 0, 0, SIZE_Z+2 )
+	SLAB_SWEEP_START( -2, SIZE_Z+2 )
 		LOCAL( grid, C  ) = DFL1;
 		LOCAL( grid, N  ) = DFL2;
 		LOCAL( grid, S  ) = DFL2;
@@ -81,7 +427,16 @@ void LBM_initializeGrid( LBM_Grid grid ) {
 		LOCAL( grid, WB ) = DFL3;
 
 		CLEAR_ALL_FLAGS_SWEEP( grid );
-	SWEEP_END
+#if defined(LBM_DYNAMIC_SIZE)
+		/* SWEEP_X is negative below z = 0 */
+		if( (SWEEP_X + PITCH_X) % PITCH_X >= SIZE_X )
+			SET_FLAG_SWEEP( grid, OBSTACLE );
+#endif
+	SLAB_SWEEP_END
+
+#if defined(LBM_AA)
+	initializeInPlace( grid );
+#endif
 }
 
 /*############################################################################*/
@@ -99,6 +454,10 @@ void LBM_loadObstacleFile( LBM_Grid grid, const char* filename ) {
 
 	FILE* file = fopen( filename, "rb" );
 
+#if defined(LBM_MPI)
+	/* SIZE_Y rows and an empty line per plane */
+	fseek( file, (long) OFFSET_Z*(SIZE_Y*(SIZE_X+1)+1), SEEK_SET );
+#endif
 	for( z = 0; z < SIZE_Z; z++ ) {
 		for( y = 0; y < SIZE_Y; y++ ) {
 			for( x = 0; x < SIZE_X; x++ ) {
@@ -118,7 +477,7 @@ void LBM_initializeSpecialCellsForLDC( LBM_Grid grid ) {
 	int x,  y,  z;
 
 	/*voption indep*/
-#if !defined(SPEC_CPU)
+#if !defined(SPEC_CPU) || defined(LBM_OMP)
 #ifdef _OPENMP
 #pragma omp parallel for private( x, y )
 #endif
@@ -128,11 +487,11 @@ void LBM_initializeSpecialCellsForLDC( LBM_Grid grid ) {
 			for( x = 0; x < SIZE_X; x++ ) {
 				if( x == 0 || x == SIZE_X-1 ||
 				    y == 0 || y == SIZE_Y-1 ||
-				    z == 0 || z == SIZE_Z-1 ) {
+				    z+OFFSET_Z == 0 || z+OFFSET_Z == GLOBAL_SIZE_Z-1 ) {
 					SET_FLAG( grid, x, y, z, OBSTACLE );
 				}
 				else {
-					if( (z == 1 || z == SIZE_Z-2) &&
+					if( (z+OFFSET_Z == 1 || z+OFFSET_Z == GLOBAL_SIZE_Z-2) &&
 					     x > 1 && x < SIZE_X-2 &&
 					     y > 1 && y < SIZE_Y-2 ) {
 						SET_FLAG( grid, x, y, z, ACCEL );
@@ -149,7 +508,7 @@ void LBM_initializeSpecialCellsForChannel( LBM_Grid grid ) {
 	int x,  y,  z;
 
 	/*voption indep*/
-#if !defined(SPEC_CPU)
+#if !defined(SPEC_CPU) || defined(LBM_OMP)
 #ifdef _OPENMP
 #pragma omp parallel for private( x, y )
 #endif
@@ -161,7 +520,7 @@ void LBM_initializeSpecialCellsForChannel( LBM_Grid grid ) {
 				    y == 0 || y == SIZE_Y-1 ) {
 					SET_FLAG( grid, x, y, z, OBSTACLE );
 
-					if( (z == 0 || z == SIZE_Z-1) &&
+					if( (z+OFFSET_Z == 0 || z+OFFSET_Z == GLOBAL_SIZE_Z-1) &&
 					    ! TEST_FLAG( grid, x, y, z, OBSTACLE ))
 						SET_FLAG( grid, x, y, z, IN_OUT_FLOW );
 				}
@@ -170,277 +529,1273 @@ void LBM_initializeSpecialCellsForChannel( LBM_Grid grid ) {
 	}
 }
 
+#if defined(LBM_SPARSE)
 /*############################################################################*/
 
-void LBM_performStreamCollide( LBM_Grid srcGrid, LBM_Grid dstGrid ) {
+/* TRUE if the cell at i is fluid or has a fluid neighbour; a push
+   across the end of a row reaches the cell that follows in memory,
+   so that is the neighbour here too */
+static BOOL isActiveCell( LBM_Grid grid, const long i ) {
+	int dx, dy, dz;
+
+	if( ! TEST_FLAG_SWEEP( grid, OBSTACLE )) return TRUE;
+
+	for( dz = -1; dz <= 1; dz++ ) {
+		for( dy = -1; dy <= 1; dy++ ) {
+			for( dx = -1; dx <= 1; dx++ ) {
+				const long n = i + CALC_INDEX( dx, dy, dz, 0 );
+
+				if( abs( dx ) + abs( dy ) + abs( dz ) != 1 &&
+				    abs( dx ) + abs( dy ) + abs( dz ) != 2 ) continue;
+				if( n <  CALC_INDEX( 0, 0, 0,      0 ) ||
+				    n >= CALC_INDEX( 0, 0, SIZE_Z, 0 )) continue;
+
+				if( ! ((*MAGIC_CAST( GRID_ENTRY_SWEEP( grid, dx, dy, dz, FLAGS )))
+				       & OBSTACLE )) return TRUE;
+			}
+		}
+	}
+	return FALSE;
+}
+
+/*############################################################################*/
+
+void LBM_buildCellList( LBM_Grid grid ) {
+	long n = 0, nCells = 0;
+	BOOL active;
+	int z;
+	SWEEP_VAR
+
+	/* a run ends at a skipped cell or at the end of a plane, so there
+	   are at most half as many runs as cells, plus one per plane */
+	LBM_freeCellList();
+	sparseRun   = malloc( ((long) SIZE_Z*SIZE_Y*PITCH_X + 2*SIZE_Z) * sizeof( long ));
+	sparseStart = malloc( (SIZE_Z+1) * sizeof( long ));
+	if( ! sparseRun || ! sparseStart ) {
+		printf( "LBM_buildCellList: could not allocate the cell list\n" );
+		exit( 1 );
+	}
+
+	for( z = 0; z < SIZE_Z; z++ ) {
+		sparseStart[z] = n;
+		SWEEP_START( 0, 0, z, 0, 0, z+1 )
+			active = isActiveCell( grid, i );
+			if( active && (n == sparseStart[z] || sparseRun[2*n-1] != i) ) {
+				sparseRun[2*n] = i;
+				n++;
+			}
+			if( active ) {
+				sparseRun[2*n-1] = i + CALC_INDEX( 1, 0, 0, 0 );
+				nCells++;
+			}
+		SWEEP_END
+	}
+	sparseStart[SIZE_Z] = n;
+
+#if !defined(SPEC_CPU)
+	printf( "LBM_buildCellList: %li of %li cells to visit, in %li runs\n",
+	        nCells, (long) SIZE_Z*SIZE_Y*PITCH_X, n );
+#else
+	(void) nCells;
+#endif
+}
+
+/*############################################################################*/
+
+void LBM_freeCellList( void ) {
+	free( sparseRun );
+	free( sparseStart );
+	sparseRun = sparseStart = NULL;
+}
+#endif /* LBM_SPARSE */
+
+/*############################################################################*/
+
+/* the stream-collide sweeps of a channel do the in- and outflow of
+   the planes they start with; see handleSlabInOutFlow() */
+static void handleSlabInOutFlow( LBM_Grid srcGrid, const int z1, const int z2,
+                                 const BOOL parallel );
+
+#if defined(LBM_GPU)
+/* the timestep on the device; FALSE if the grids are not there */
+static BOOL gpuStreamCollide( LBM_Grid srcGrid, LBM_Grid dstGrid,
+                              const BOOL channel );
+#endif
+
+#if defined(LBM_SIMD)
+
+/* Built with -DLBM_SIMD (make simd), the collision works on
+   LBM_SIMD_WIDTH neighbouring cells at once. GCC's vector types
+   become AVX or AVX-512 on x86 and NEON on AArch64, and plain scalar
+   code where there is no double-precision SIMD (ARMv7). Obstacle and
+   acceleration cells are blended in with masks instead of taking
+   branches. Every lane evaluates the same expressions as the scalar
+   loop below, so without FMA contraction the results agree to the
+   bit. The neighbours of a run of cells along x are runs too, so this
+   needs the LBM_SOA layout. */
+
+#if !defined(LBM_SOA)
+#error "LBM_SIMD needs the LBM_SOA grid layout"
+#endif
+#if defined(LBM_FLOAT)
+#error "LBM_SIMD works on a double grid only"
+#endif
+#if LBM_COLLISION != LBM_BGK
+#error "LBM_SIMD has the BGK collision only"
+#endif
+
+/* LBM_setSize() pads the rows of a run-time size as needed */
+#if !defined(LBM_DYNAMIC_SIZE) && (SIZE_X*SIZE_Y) % LBM_SIMD_WIDTH != 0
+#error "the cells of a z plane must be a multiple of LBM_SIMD_WIDTH"
+#endif
+
+typedef double    SIMD_Double __attribute__(( vector_size( LBM_SIMD_WIDTH*sizeof( double ))));
+typedef long long SIMD_Mask   __attribute__(( vector_size( LBM_SIMD_WIDTH*sizeof( double ))));
+/* the same vector at the alignment of a double, to load any cell from */
+typedef double    SIMD_DoubleU __attribute__(( vector_size( LBM_SIMD_WIDTH*sizeof( double )),
+                                               aligned( sizeof( double )), may_alias ));
+
+/* Macros, not functions: a vector wider than the enabled ISA passed or
+   returned by value changes the calling convention (-Wpsabi). */
+#define simdLoad(p)       (*(const SIMD_DoubleU*) (p))
+#define simdStore(p,v)    (*(SIMD_DoubleU*) (p) = (v))
+#define simdSelect(m,a,b) ((SIMD_Double) (((SIMD_Mask) (a) & (m)) | ((SIMD_Mask) (b) & ~(m))))
+
+static inline void simdFlags( SIMD_Mask* m, double* flags, const unsigned int f ) {
+	int k;
+
+	for( k = 0; k < LBM_SIMD_WIDTH; k++ )
+		(*m)[k] = ((*MAGIC_CAST( flags[k] )) & f) ? -1 : 0;
+}
+
+#define VSRC(d,g) simdLoad( &SRC_##d( g ))
+#define VDST(d,g,v) simdStore( &DST_##d( g ), v )
+
+static void performStreamCollidePlanes( LBM_Grid srcGrid, LBM_Grid dstGrid,
+                                        const int zBegin, const int zEnd,
+                                        const BOOL channel ) {
 	SWEEP_VAR
 
+	SIMD_Double ux, uy, uz, u2, rho,
+	            fC, fN, fS, fE, fW, fT, fB, fNE, fNW, fSE, fSW,
+	            fNT, fNB, fST, fSB, fET, fEB, fWT, fWB;
+	SIMD_Mask obst, accel;
+	const SIMD_Double zero = { 0 };
+
+#if defined(LBM_OMP)
+#pragma omp parallel private( i, ux, uy, uz, u2, rho, \
+                              fC, fN, fS, fE, fW, fT, fB, fNE, fNW, fSE, fSW, \
+                              fNT, fNB, fST, fSB, fET, fEB, fWT, fWB, obst, accel )
+	{
+	int z1, z2;
+
+	threadSlab( zBegin, zEnd, &z1, &z2 );
+	if( channel ) handleSlabInOutFlow( srcGrid, z1, z2, FALSE );
+#else
+	const int z1 = zBegin, z2 = zEnd;
+
+	if( channel ) handleSlabInOutFlow( srcGrid, z1, z2, TRUE );
+#if !defined(SPEC_CPU)
+#ifdef _OPENMP
+#pragma omp parallel for private( ux, uy, uz, u2, rho, \
+                                  fC, fN, fS, fE, fW, fT, fB, fNE, fNW, fSE, fSW, \
+                                  fNT, fNB, fST, fSB, fET, fEB, fWT, fWB, obst, accel )
+#endif
+#endif
+#endif
+	for( i = CALC_INDEX( 0, 0, z1, 0 );
+	     i < CALC_INDEX( 0, 0, z2, 0 );
+	     i += LBM_SIMD_WIDTH ) {
+		simdFlags( &obst , &LOCAL( srcGrid, FLAGS ), OBSTACLE );
+		simdFlags( &accel, &LOCAL( srcGrid, FLAGS ), ACCEL );
+
+		fC  = VSRC( C , srcGrid ); fN  = VSRC( N , srcGrid );
+		fS  = VSRC( S , srcGrid ); fE  = VSRC( E , srcGrid );
+		fW  = VSRC( W , srcGrid ); fT  = VSRC( T , srcGrid );
+		fB  = VSRC( B , srcGrid ); fNE = VSRC( NE, srcGrid );
+		fNW = VSRC( NW, srcGrid ); fSE = VSRC( SE, srcGrid );
+		fSW = VSRC( SW, srcGrid ); fNT = VSRC( NT, srcGrid );
+		fNB = VSRC( NB, srcGrid ); fST = VSRC( ST, srcGrid );
+		fSB = VSRC( SB, srcGrid ); fET = VSRC( ET, srcGrid );
+		fEB = VSRC( EB, srcGrid ); fWT = VSRC( WT, srcGrid );
+		fWB = VSRC( WB, srcGrid );
+
+		rho = + fC  + fN  + fS  + fE  + fW  + fT  + fB
+		      + fNE + fNW + fSE + fSW + fNT + fNB + fST
+		      + fSB + fET + fEB + fWT + fWB;
+
+		ux = + fE  - fW  + fNE - fNW + fSE - fSW + fET + fEB - fWT - fWB;
+		uy = + fN  - fS  + fNE + fNW - fSE - fSW + fNT + fNB - fST - fSB;
+		uz = + fT  - fB  + fNT - fNB + fST - fSB + fET - fEB + fWT - fWB;
+
+		ux = simdSelect( accel, zero + 0.005, ux / rho );
+		uy = simdSelect( accel, zero + 0.002, uy / rho );
+		uz = simdSelect( accel, zero + 0.000, uz / rho );
+
+		u2 = 1.5 * (ux*ux + uy*uy + uz*uz);
+
+		VDST( C , dstGrid, simdSelect( obst, fC , (1.0-OMEGA)*fC  + DFL1*OMEGA*rho*(1.0                                 - u2)));
+
+		VDST( S , dstGrid, simdSelect( obst, fN , (1.0-OMEGA)*fS  + DFL2*OMEGA*rho*(1.0 +       uy*(4.5*uy       - 3.0) - u2)));
+		VDST( N , dstGrid, simdSelect( obst, fS , (1.0-OMEGA)*fN  + DFL2*OMEGA*rho*(1.0 +       uy*(4.5*uy       + 3.0) - u2)));
+		VDST( W , dstGrid, simdSelect( obst, fE , (1.0-OMEGA)*fW  + DFL2*OMEGA*rho*(1.0 +       ux*(4.5*ux       - 3.0) - u2)));
+		VDST( E , dstGrid, simdSelect( obst, fW , (1.0-OMEGA)*fE  + DFL2*OMEGA*rho*(1.0 +       ux*(4.5*ux       + 3.0) - u2)));
+		VDST( B , dstGrid, simdSelect( obst, fT , (1.0-OMEGA)*fB  + DFL2*OMEGA*rho*(1.0 +       uz*(4.5*uz       - 3.0) - u2)));
+		VDST( T , dstGrid, simdSelect( obst, fB , (1.0-OMEGA)*fT  + DFL2*OMEGA*rho*(1.0 +       uz*(4.5*uz       + 3.0) - u2)));
+
+		VDST( SW, dstGrid, simdSelect( obst, fNE, (1.0-OMEGA)*fSW + DFL3*OMEGA*rho*(1.0 + (-ux-uy)*(4.5*(-ux-uy) + 3.0) - u2)));
+		VDST( SE, dstGrid, simdSelect( obst, fNW, (1.0-OMEGA)*fSE + DFL3*OMEGA*rho*(1.0 + (+ux-uy)*(4.5*(+ux-uy) + 3.0) - u2)));
+		VDST( NW, dstGrid, simdSelect( obst, fSE, (1.0-OMEGA)*fNW + DFL3*OMEGA*rho*(1.0 + (-ux+uy)*(4.5*(-ux+uy) + 3.0) - u2)));
+		VDST( NE, dstGrid, simdSelect( obst, fSW, (1.0-OMEGA)*fNE + DFL3*OMEGA*rho*(1.0 + (+ux+uy)*(4.5*(+ux+uy) + 3.0) - u2)));
+		VDST( SB, dstGrid, simdSelect( obst, fNT, (1.0-OMEGA)*fSB + DFL3*OMEGA*rho*(1.0 + (-uy-uz)*(4.5*(-uy-uz) + 3.0) - u2)));
+		VDST( ST, dstGrid, simdSelect( obst, fNB, (1.0-OMEGA)*fST + DFL3*OMEGA*rho*(1.0 + (-uy+uz)*(4.5*(-uy+uz) + 3.0) - u2)));
+		VDST( NB, dstGrid, simdSelect( obst, fST, (1.0-OMEGA)*fNB + DFL3*OMEGA*rho*(1.0 + (+uy-uz)*(4.5*(+uy-uz) + 3.0) - u2)));
+		VDST( NT, dstGrid, simdSelect( obst, fSB, (1.0-OMEGA)*fNT + DFL3*OMEGA*rho*(1.0 + (+uy+uz)*(4.5*(+uy+uz) + 3.0) - u2)));
+		VDST( WB, dstGrid, simdSelect( obst, fET, (1.0-OMEGA)*fWB + DFL3*OMEGA*rho*(1.0 + (-ux-uz)*(4.5*(-ux-uz) + 3.0) - u2)));
+		VDST( WT, dstGrid, simdSelect( obst, fEB, (1.0-OMEGA)*fWT + DFL3*OMEGA*rho*(1.0 + (-ux+uz)*(4.5*(-ux+uz) + 3.0) - u2)));
+		VDST( EB, dstGrid, simdSelect( obst, fWT, (1.0-OMEGA)*fEB + DFL3*OMEGA*rho*(1.0 + (+ux-uz)*(4.5*(+ux-uz) + 3.0) - u2)));
+		VDST( ET, dstGrid, simdSelect( obst, fWB, (1.0-OMEGA)*fET + DFL3*OMEGA*rho*(1.0 + (+ux+uz)*(4.5*(+ux+uz) + 3.0) - u2)));
+	}
+#if defined(LBM_OMP)
+	}
+#endif
+}
+
+#else /* LBM_SIMD */
+
+/* With MEM_TRACE (make trace) every cell of the scalar sweep logs the
+   flags and the 19 values it reads and the 19 it writes */
+#if defined(MEM_TRACE)
+#define TRACE_CELL(src,dst) do { \
+	MEMTRACE_LOAD ( &LOCAL( src, FLAGS )); \
+	MEMTRACE_LOAD ( &SRC_C ( src )); \
+	MEMTRACE_LOAD ( &SRC_N ( src )); \
+	MEMTRACE_LOAD ( &SRC_S ( src )); \
+	MEMTRACE_LOAD ( &SRC_E ( src )); \
+	MEMTRACE_LOAD ( &SRC_W ( src )); \
+	MEMTRACE_LOAD ( &SRC_T ( src )); \
+	MEMTRACE_LOAD ( &SRC_B ( src )); \
+	MEMTRACE_LOAD ( &SRC_NE( src )); \
+	MEMTRACE_LOAD ( &SRC_NW( src )); \
+	MEMTRACE_LOAD ( &SRC_SE( src )); \
+	MEMTRACE_LOAD ( &SRC_SW( src )); \
+	MEMTRACE_LOAD ( &SRC_NT( src )); \
+	MEMTRACE_LOAD ( &SRC_NB( src )); \
+	MEMTRACE_LOAD ( &SRC_ST( src )); \
+	MEMTRACE_LOAD ( &SRC_SB( src )); \
+	MEMTRACE_LOAD ( &SRC_ET( src )); \
+	MEMTRACE_LOAD ( &SRC_EB( src )); \
+	MEMTRACE_LOAD ( &SRC_WT( src )); \
+	MEMTRACE_LOAD ( &SRC_WB( src )); \
+	MEMTRACE_STORE( &DST_C ( dst )); \
+	MEMTRACE_STORE( &DST_N ( dst )); \
+	MEMTRACE_STORE( &DST_S ( dst )); \
+	MEMTRACE_STORE( &DST_E ( dst )); \
+	MEMTRACE_STORE( &DST_W ( dst )); \
+	MEMTRACE_STORE( &DST_T ( dst )); \
+	MEMTRACE_STORE( &DST_B ( dst )); \
+	MEMTRACE_STORE( &DST_NE( dst )); \
+	MEMTRACE_STORE( &DST_NW( dst )); \
+	MEMTRACE_STORE( &DST_SE( dst )); \
+	MEMTRACE_STORE( &DST_SW( dst )); \
+	MEMTRACE_STORE( &DST_NT( dst )); \
+	MEMTRACE_STORE( &DST_NB( dst )); \
+	MEMTRACE_STORE( &DST_ST( dst )); \
+	MEMTRACE_STORE( &DST_SB( dst )); \
+	MEMTRACE_STORE( &DST_ET( dst )); \
+	MEMTRACE_STORE( &DST_EB( dst )); \
+	MEMTRACE_STORE( &DST_WT( dst )); \
+	MEMTRACE_STORE( &DST_WB( dst )); \
+	} while( 0 )
+#else
+#define TRACE_CELL(src,dst) do { } while( 0 )
+#endif
+
+#if defined(LBM_GPU)
+#pragma omp declare target
+#endif
+
+/* The collision operator is chosen at compile time (LBM_COLLISION,
+   see config.h). BGK is the hand-expanded one of streamCollideCell().
+   The others are written once, as loops over the D3Q19 velocity set,
+   whose lattice vectors, weights and moments are constant tables; the
+   loops are unrolled and the constants folded in, zeros included.
+   Both take the equilibrium of BGK, and with all their rates at OMEGA
+   they are BGK, up to rounding.
+
+   LBM_TRT relaxes the part of each opposite pair that is even in the
+   lattice vector with OMEGA, which sets the viscosity, and the odd
+   part with the rate for which (1/OMEGA - 1/2)(1/rate - 1/2) is
+   TRT_MAGIC. With 1/4 it stays stable to much smaller viscosities,
+   that is higher Reynolds numbers, than BGK.
+
+   LBM_MRT relaxes the 19 orthogonal moments of d'Humieres et al.
+   (2002) of the non-equilibrium part: the stress with OMEGA, the rest
+   with the MRT_S_* rates. The equilibrium holds the mass and the
+   momentum of the cell, so their rates do not matter, except in the
+   acceleration cells, whose velocity is set; they are OMEGA as in
+   BGK. */
+
+#if LBM_COLLISION != LBM_BGK
+
+#if defined(__GNUC__) && __GNUC__ >= 8
+#define CELL_LOOP _Pragma( "GCC unroll 19" )
+#else
+#define CELL_LOOP
+#endif
+
+#if defined(LBM_GPU)
+#pragma omp declare target( distrDir )
+#endif
+
+/* the lattice weight of each distribution */
+static const double distrWeight[N_DISTR_FUNCS] = {
+	DFL1,
+	DFL2, DFL2, DFL2, DFL2, DFL2, DFL2,
+	DFL3, DFL3, DFL3, DFL3, DFL3, DFL3, DFL3, DFL3, DFL3, DFL3, DFL3, DFL3 };
+
+/* distribution e of the cell at i, and where it streams to */
+#define DISTR_SRC(g,e) ((g)[CALC_INDEX( 0, 0, 0, e ) + (i)])
+#define DISTR_DST(g,e) ((g)[CALC_INDEX( distrDir[e][0], distrDir[e][1], \
+                                        distrDir[e][2], e ) + (i)])
+
+/* the equilibrium of distribution e */
+CELL_FUNC double equilibrium( const int e, const double rho, const double ux,
+                              const double uy, const double uz,
+                              const double u2 ) {
+	const double cu = distrDir[e][0]*ux + distrDir[e][1]*uy + distrDir[e][2]*uz;
+
+	return distrWeight[e]*rho*(1.0 + cu*(4.5*cu + 3.0) - u2);
+}
+
+#if LBM_COLLISION == LBM_TRT
+
+#define TRT_OMEGA_ODD (1.0 / (TRT_MAGIC / (1.0/OMEGA - 0.5) + 0.5))
+
+/* the opposite pairs */
+static const int trtPair[(N_DISTR_FUNCS-1)/2][2] = {
+	{ N , S  }, { E , W  }, { T , B  }, { NE, SW }, { NW, SE },
+	{ NT, SB }, { NB, ST }, { ET, WB }, { EB, WT }};
+
+CELL_FUNC void collideCell( LBM_Grid srcGrid, LBM_Grid dstGrid, const long i,
+                            const double rho, const double ux,
+                            const double uy, const double uz,
+                            const double u2 ) {
+	double fe, fo, qe, qo, even, odd;
+	int p;
+
+	fe = DISTR_SRC( srcGrid, C );
+	DISTR_DST( dstGrid, C ) = fe - OMEGA*(fe - equilibrium( C, rho, ux, uy, uz, u2 ));
+
+	CELL_LOOP
+	for( p = 0; p < (N_DISTR_FUNCS-1)/2; p++ ) {
+		const int e = trtPair[p][0], o = trtPair[p][1];
+
+		fe = DISTR_SRC( srcGrid, e );
+		fo = DISTR_SRC( srcGrid, o );
+		qe = equilibrium( e, rho, ux, uy, uz, u2 );
+		qo = equilibrium( o, rho, ux, uy, uz, u2 );
+
+		even = 0.5*OMEGA        *((fe + fo) - (qe + qo));
+		odd  = 0.5*TRT_OMEGA_ODD*((fe - fo) - (qe - qo));
+		DISTR_DST( dstGrid, e ) = fe - even - odd;
+		DISTR_DST( dstGrid, o ) = fo - even + odd;
+	}
+}
+
+#else /* LBM_COLLISION == LBM_MRT */
+
+#if LBM_COLLISION != LBM_MRT
+#error "LBM_COLLISION is LBM_BGK, LBM_TRT or LBM_MRT"
+#endif
+
+/* moment k of the lattice vector (x, y, z), c2 its squared length:
+   rho, e, eps, jx, qx, jy, qy, jz, qz, 3pxx, 3pixx, pww, piww,
+   pxy, pyz, pxz, mx, my, mz */
+#define MRT_C2(x,y,z) ((x)*(x) + (y)*(y) + (z)*(z))
+#define MRT_MOMENT(k,x,y,z) ( \
+	(k) ==  0 ? 1 : \
+	(k) ==  1 ? 19*MRT_C2( x, y, z ) - 30 : \
+	(k) ==  2 ? (21*MRT_C2( x, y, z )*MRT_C2( x, y, z ) - 53*MRT_C2( x, y, z ) + 24) / 2 : \
+	(k) ==  3 ? (x) : \
+	(k) ==  4 ? (5*MRT_C2( x, y, z ) - 9)*(x) : \
+	(k) ==  5 ? (y) : \
+	(k) ==  6 ? (5*MRT_C2( x, y, z ) - 9)*(y) : \
+	(k) ==  7 ? (z) : \
+	(k) ==  8 ? (5*MRT_C2( x, y, z ) - 9)*(z) : \
+	(k) ==  9 ? 3*(x)*(x) - MRT_C2( x, y, z ) : \
+	(k) == 10 ? (3*MRT_C2( x, y, z ) - 5)*(3*(x)*(x) - MRT_C2( x, y, z )) : \
+	(k) == 11 ? (y)*(y) - (z)*(z) : \
+	(k) == 12 ? (3*MRT_C2( x, y, z ) - 5)*((y)*(y) - (z)*(z)) : \
+	(k) == 13 ? (x)*(y) : \
+	(k) == 14 ? (y)*(z) : \
+	(k) == 15 ? (x)*(z) : \
+	(k) == 16 ? ((y)*(y) - (z)*(z))*(x) : \
+	(k) == 17 ? ((z)*(z) - (x)*(x))*(y) : \
+	            ((x)*(x) - (y)*(y))*(z) )
+#define MRT_SQUARE(k,x,y,z) (MRT_MOMENT( k, x, y, z )*MRT_MOMENT( k, x, y, z ))
+
+/* F( k, x, y, z ) of the lattice vectors of distrDir, joined by op */
+#define D3Q19_MAP(F,k,op) \
+	F( k,  0,  0,  0 ) op \
+	F( k,  0, +1,  0 ) op F( k,  0, -1,  0 ) op F( k, +1,  0,  0 ) op \
+	F( k, -1,  0,  0 ) op F( k,  0,  0, +1 ) op F( k,  0,  0, -1 ) op \
+	F( k, +1, +1,  0 ) op F( k, -1, +1,  0 ) op F( k, +1, -1,  0 ) op \
+	F( k, -1, -1,  0 ) op F( k,  0, +1, +1 ) op F( k,  0, +1, -1 ) op \
+	F( k,  0, -1, +1 ) op F( k,  0, -1, -1 ) op F( k, +1,  0, +1 ) op \
+	F( k, +1,  0, -1 ) op F( k, -1,  0, +1 ) op F( k, -1,  0, -1 )
+#define MRT_COMMA ,
+#define MRT_PLUS  +
+#define MRT_ROW(k)  { D3Q19_MAP( MRT_MOMENT, k, MRT_COMMA ) }
+#define MRT_NORM(k) ((double) (D3Q19_MAP( MRT_SQUARE, k, MRT_PLUS )))
+
+/* the rows are orthogonal, so the inverse is the transpose, divided
+   by the squared norm of each row */
+static const double mrtMatrix[N_DISTR_FUNCS][N_DISTR_FUNCS] = {
+	MRT_ROW(  0 ), MRT_ROW(  1 ), MRT_ROW(  2 ), MRT_ROW(  3 ), MRT_ROW(  4 ),
+	MRT_ROW(  5 ), MRT_ROW(  6 ), MRT_ROW(  7 ), MRT_ROW(  8 ), MRT_ROW(  9 ),
+	MRT_ROW( 10 ), MRT_ROW( 11 ), MRT_ROW( 12 ), MRT_ROW( 13 ), MRT_ROW( 14 ),
+	MRT_ROW( 15 ), MRT_ROW( 16 ), MRT_ROW( 17 ), MRT_ROW( 18 ) };
+
+/* the rate of each moment over its squared norm */
+static const double mrtRate[N_DISTR_FUNCS] = {
+	OMEGA    /MRT_NORM(  0 ), MRT_S_E  /MRT_NORM(  1 ), MRT_S_EPS/MRT_NORM(  2 ),
+	OMEGA    /MRT_NORM(  3 ), MRT_S_Q  /MRT_NORM(  4 ), OMEGA    /MRT_NORM(  5 ),
+	MRT_S_Q  /MRT_NORM(  6 ), OMEGA    /MRT_NORM(  7 ), MRT_S_Q  /MRT_NORM(  8 ),
+	OMEGA    /MRT_NORM(  9 ), MRT_S_PI /MRT_NORM( 10 ), OMEGA    /MRT_NORM( 11 ),
+	MRT_S_PI /MRT_NORM( 12 ), OMEGA    /MRT_NORM( 13 ), OMEGA    /MRT_NORM( 14 ),
+	OMEGA    /MRT_NORM( 15 ), MRT_S_M  /MRT_NORM( 16 ), MRT_S_M  /MRT_NORM( 17 ),
+	MRT_S_M  /MRT_NORM( 18 ) };
+
+CELL_FUNC void collideCell( LBM_Grid srcGrid, LBM_Grid dstGrid, const long i,
+                            const double rho, const double ux,
+                            const double uy, const double uz,
+                            const double u2 ) {
+	double f[N_DISTR_FUNCS], m[N_DISTR_FUNCS], d;
+	int e, k;
+
+	CELL_LOOP
+	for( k = 0; k < N_DISTR_FUNCS; k++ ) m[k] = 0.0;
+
+	CELL_LOOP
+	for( e = 0; e < N_DISTR_FUNCS; e++ ) {
+		f[e] = DISTR_SRC( srcGrid, e );
+		d = f[e] - equilibrium( e, rho, ux, uy, uz, u2 );
+		CELL_LOOP
+		for( k = 0; k < N_DISTR_FUNCS; k++ ) m[k] += mrtMatrix[k][e]*d;
+	}
+
+	CELL_LOOP
+	for( k = 0; k < N_DISTR_FUNCS; k++ ) m[k] *= mrtRate[k];
+
+	CELL_LOOP
+	for( e = 0; e < N_DISTR_FUNCS; e++ ) {
+		d = 0.0;
+		CELL_LOOP
+		for( k = 0; k < N_DISTR_FUNCS; k++ ) d += mrtMatrix[k][e]*m[k];
+		DISTR_DST( dstGrid, e ) = f[e] - d;
+	}
+}
+
+#endif /* LBM_COLLISION */
+
+#endif /* LBM_COLLISION != LBM_BGK */
+
+/* the stream-collide step of the cell at i */
+CELL_FUNC void streamCollideCell( LBM_Grid srcGrid, LBM_Grid dstGrid,
+                                   const long i ) {
 	double ux, uy, uz, u2, rho;
 
+	if( TEST_FLAG_SWEEP( srcGrid, OBSTACLE )) {
+		DST_C ( dstGrid ) = SRC_C ( srcGrid );
+		DST_S ( dstGrid ) = SRC_N ( srcGrid );
+		DST_N ( dstGrid ) = SRC_S ( srcGrid );
+		DST_W ( dstGrid ) = SRC_E ( srcGrid );
+		DST_E ( dstGrid ) = SRC_W ( srcGrid );
+		DST_B ( dstGrid ) = SRC_T ( srcGrid );
+		DST_T ( dstGrid ) = SRC_B ( srcGrid );
+		DST_SW( dstGrid ) = SRC_NE( srcGrid );
+		DST_SE( dstGrid ) = SRC_NW( srcGrid );
+		DST_NW( dstGrid ) = SRC_SE( srcGrid );
+		DST_NE( dstGrid ) = SRC_SW( srcGrid );
+		DST_SB( dstGrid ) = SRC_NT( srcGrid );
+		DST_ST( dstGrid ) = SRC_NB( srcGrid );
+		DST_NB( dstGrid ) = SRC_ST( srcGrid );
+		DST_NT( dstGrid ) = SRC_SB( srcGrid );
+		DST_WB( dstGrid ) = SRC_ET( srcGrid );
+		DST_WT( dstGrid ) = SRC_EB( srcGrid );
+		DST_EB( dstGrid ) = SRC_WT( srcGrid );
+		DST_ET( dstGrid ) = SRC_WB( srcGrid );
+		return;
+	}
+
+	rho = + (double) SRC_C ( srcGrid ) + SRC_N ( srcGrid )
+	      + SRC_S ( srcGrid ) + SRC_E ( srcGrid )
+	      + SRC_W ( srcGrid ) + SRC_T ( srcGrid )
+	      + SRC_B ( srcGrid ) + SRC_NE( srcGrid )
+	      + SRC_NW( srcGrid ) + SRC_SE( srcGrid )
+	      + SRC_SW( srcGrid ) + SRC_NT( srcGrid )
+	      + SRC_NB( srcGrid ) + SRC_ST( srcGrid )
+	      + SRC_SB( srcGrid ) + SRC_ET( srcGrid )
+	      + SRC_EB( srcGrid ) + SRC_WT( srcGrid )
+	      + SRC_WB( srcGrid );
+
+	ux = + (double) SRC_E ( srcGrid ) - SRC_W ( srcGrid )
+	     + SRC_NE( srcGrid ) - SRC_NW( srcGrid )
+	     + SRC_SE( srcGrid ) - SRC_SW( srcGrid )
+	     + SRC_ET( srcGrid ) + SRC_EB( srcGrid )
+	     - SRC_WT( srcGrid ) - SRC_WB( srcGrid );
+	uy = + (double) SRC_N ( srcGrid ) - SRC_S ( srcGrid )
+	     + SRC_NE( srcGrid ) + SRC_NW( srcGrid )
+	     - SRC_SE( srcGrid ) - SRC_SW( srcGrid )
+	     + SRC_NT( srcGrid ) + SRC_NB( srcGrid )
+	     - SRC_ST( srcGrid ) - SRC_SB( srcGrid );
+	uz = + (double) SRC_T ( srcGrid ) - SRC_B ( srcGrid )
+	     + SRC_NT( srcGrid ) - SRC_NB( srcGrid )
+	     + SRC_ST( srcGrid ) - SRC_SB( srcGrid )
+	     + SRC_ET( srcGrid ) - SRC_EB( srcGrid )
+	     + SRC_WT( srcGrid ) - SRC_WB( srcGrid );
+
+	ux /= rho;
+	uy /= rho;
+	uz /= rho;
+
+	if( TEST_FLAG_SWEEP( srcGrid, ACCEL )) {
+		ux = 0.005;
+		uy = 0.002;
+		uz = 0.000;
+	}
+
+	u2 = 1.5 * (ux*ux + uy*uy + uz*uz);
+#if LBM_COLLISION != LBM_BGK
+	collideCell( srcGrid, dstGrid, i, rho, ux, uy, uz, u2 );
+#else
+	DST_C ( dstGrid ) = (1.0-OMEGA)*SRC_C ( srcGrid ) + DFL1*OMEGA*rho*(1.0                                 - u2);
+
+	DST_N ( dstGrid ) = (1.0-OMEGA)*SRC_N ( srcGrid ) + DFL2*OMEGA*rho*(1.0 +       uy*(4.5*uy       + 3.0) - u2);
+	DST_S ( dstGrid ) = (1.0-OMEGA)*SRC_S ( srcGrid ) + DFL2*OMEGA*rho*(1.0 +       uy*(4.5*uy       - 3.0) - u2);
+	DST_E ( dstGrid ) = (1.0-OMEGA)*SRC_E ( srcGrid ) + DFL2*OMEGA*rho*(1.0 +       ux*(4.5*ux       + 3.0) - u2);
+	DST_W ( dstGrid ) = (1.0-OMEGA)*SRC_W ( srcGrid ) + DFL2*OMEGA*rho*(1.0 +       ux*(4.5*ux       - 3.0) - u2);
+	DST_T ( dstGrid ) = (1.0-OMEGA)*SRC_T ( srcGrid ) + DFL2*OMEGA*rho*(1.0 +       uz*(4.5*uz       + 3.0) - u2);
+	DST_B ( dstGrid ) = (1.0-OMEGA)*SRC_B ( srcGrid ) + DFL2*OMEGA*rho*(1.0 +       uz*(4.5*uz       - 3.0) - u2);
+
+	DST_NE( dstGrid ) = (1.0-OMEGA)*SRC_NE( srcGrid ) + DFL3*OMEGA*rho*(1.0 + (+ux+uy)*(4.5*(+ux+uy) + 3.0) - u2);
+	DST_NW( dstGrid ) = (1.0-OMEGA)*SRC_NW( srcGrid ) + DFL3*OMEGA*rho*(1.0 + (-ux+uy)*(4.5*(-ux+uy) + 3.0) - u2);
+	DST_SE( dstGrid ) = (1.0-OMEGA)*SRC_SE( srcGrid ) + DFL3*OMEGA*rho*(1.0 + (+ux-uy)*(4.5*(+ux-uy) + 3.0) - u2);
+	DST_SW( dstGrid ) = (1.0-OMEGA)*SRC_SW( srcGrid ) + DFL3*OMEGA*rho*(1.0 + (-ux-uy)*(4.5*(-ux-uy) + 3.0) - u2);
+	DST_NT( dstGrid ) = (1.0-OMEGA)*SRC_NT( srcGrid ) + DFL3*OMEGA*rho*(1.0 + (+uy+uz)*(4.5*(+uy+uz) + 3.0) - u2);
+	DST_NB( dstGrid ) = (1.0-OMEGA)*SRC_NB( srcGrid ) + DFL3*OMEGA*rho*(1.0 + (+uy-uz)*(4.5*(+uy-uz) + 3.0) - u2);
+	DST_ST( dstGrid ) = (1.0-OMEGA)*SRC_ST( srcGrid ) + DFL3*OMEGA*rho*(1.0 + (-uy+uz)*(4.5*(-uy+uz) + 3.0) - u2);
+	DST_SB( dstGrid ) = (1.0-OMEGA)*SRC_SB( srcGrid ) + DFL3*OMEGA*rho*(1.0 + (-uy-uz)*(4.5*(-uy-uz) + 3.0) - u2);
+	DST_ET( dstGrid ) = (1.0-OMEGA)*SRC_ET( srcGrid ) + DFL3*OMEGA*rho*(1.0 + (+ux+uz)*(4.5*(+ux+uz) + 3.0) - u2);
+	DST_EB( dstGrid ) = (1.0-OMEGA)*SRC_EB( srcGrid ) + DFL3*OMEGA*rho*(1.0 + (+ux-uz)*(4.5*(+ux-uz) + 3.0) - u2);
+	DST_WT( dstGrid ) = (1.0-OMEGA)*SRC_WT( srcGrid ) + DFL3*OMEGA*rho*(1.0 + (-ux+uz)*(4.5*(-ux+uz) + 3.0) - u2);
+	DST_WB( dstGrid ) = (1.0-OMEGA)*SRC_WB( srcGrid ) + DFL3*OMEGA*rho*(1.0 + (-ux-uz)*(4.5*(-ux-uz) + 3.0) - u2);
+#endif
+}
+
+#if defined(LBM_GPU)
+#pragma omp end declare target
+#endif
+
+static void performStreamCollidePlanes( LBM_Grid srcGrid, LBM_Grid dstGrid,
+                                        const int zBegin, const int zEnd,
+                                        const BOOL channel ) {
+	SWEEP_VAR
+
 	/*voption indep*/
+#if defined(LBM_OMP)
+#pragma omp parallel private( i )
+	{
+	int z1, z2;
+
+	threadSlab( zBegin, zEnd, &z1, &z2 );
+	if( channel ) handleSlabInOutFlow( srcGrid, z1, z2, FALSE );
+#else
+	if( channel ) handleSlabInOutFlow( srcGrid, zBegin, zEnd, TRUE );
 #if !defined(SPEC_CPU)
 #ifdef _OPENMP
-#pragma omp parallel for private( ux, uy, uz, u2, rho )
+#pragma omp parallel for private( i )
 #endif
 #endif
-	SWEEP_START( 0, 0, 0, 0, 0, SIZE_Z )
-		if( TEST_FLAG_SWEEP( srcGrid, OBSTACLE )) {
-			DST_C ( dstGrid ) = SRC_C ( srcGrid );
-			DST_S ( dstGrid ) = SRC_N ( srcGrid );
-			DST_N ( dstGrid ) = SRC_S ( srcGrid );
-			DST_W ( dstGrid ) = SRC_E ( srcGrid );
-			DST_E ( dstGrid ) = SRC_W ( srcGrid );
-			DST_B ( dstGrid ) = SRC_T ( srcGrid );
-			DST_T ( dstGrid ) = SRC_B ( srcGrid );
-			DST_SW( dstGrid ) = SRC_NE( srcGrid );
-			DST_SE( dstGrid ) = SRC_NW( srcGrid );
-			DST_NW( dstGrid ) = SRC_SE( srcGrid );
-			DST_NE( dstGrid ) = SRC_SW( srcGrid );
-			DST_SB( dstGrid ) = SRC_NT( srcGrid );
-			DST_ST( dstGrid ) = SRC_NB( srcGrid );
-			DST_NB( dstGrid ) = SRC_ST( srcGrid );
-			DST_NT( dstGrid ) = SRC_SB( srcGrid );
-			DST_WB( dstGrid ) = SRC_ET( srcGrid );
-			DST_WT( dstGrid ) = SRC_EB( srcGrid );
-			DST_EB( dstGrid ) = SRC_WT( srcGrid );
-			DST_ET( dstGrid ) = SRC_WB( srcGrid );
+#endif
+	CELL_SWEEP_START( zBegin, zEnd )
+		TRACE_CELL( srcGrid, dstGrid );
+		streamCollideCell( srcGrid, dstGrid, i );
+	CELL_SWEEP_END
+#if defined(LBM_OMP)
+	}
+#endif
+}
+
+#endif /* LBM_SIMD */
+
+/*############################################################################*/
+
+void LBM_performStreamCollide( LBM_Grid srcGrid, LBM_Grid dstGrid,
+                               const BOOL channel ) {
+#if defined(LBM_GPU)
+	if( gpuStreamCollide( srcGrid, dstGrid, channel )) return;
+#endif
+#if defined(LBM_MPI)
+	/* only the two planes at either end push into the ghost planes */
+	const int z1 = 2, z2 = (SIZE_Z-2 > z1) ? SIZE_Z-2 : z1;
+
+	performStreamCollidePlanes( srcGrid, dstGrid, 0,  z1,     channel );
+	performStreamCollidePlanes( srcGrid, dstGrid, z2, SIZE_Z, channel );
+	startHaloExchange( dstGrid );
+	performStreamCollidePlanes( srcGrid, dstGrid, z1, z2,     FALSE   );
+	finishHaloExchange( dstGrid );
+#else
+	performStreamCollidePlanes( srcGrid, dstGrid, 0, SIZE_Z, channel );
+#endif
+}
+
+/*############################################################################*/
+
+/* Built with -DLBM_AA (make aa), lbm keeps a single grid and streams
+   in place with the AA pattern. An even step reads the values of a
+   cell from the cell itself and writes the collided ones back into
+   it, each into the slot of the opposite direction; an odd step reads
+   them from the neighbours, where the even step left them, and pushes
+   its results to the neighbours as LBM_performStreamCollide() does.
+   Either way, every cell reads and writes the same 19 locations, so
+   the cells can go in any order, and after every odd step the grid is
+   in the usual layout again. In between, the value f_e of the cell
+   at i is found at i + aaRead[1][e] rather than i + aaRead[0][e];
+   INOUT_ENTRY() lets LBM_handleInOutFlow() work in both layouts, and
+   LBM_finishInPlace() brings a grid back to the usual one. No cell
+   pushes into the slots of the planes z = 0 and SIZE_Z-1 that point
+   in from the ghost planes, so two grids keep there what the in- and
+   outflow (or the initialization) wrote into the same grid a step
+   earlier, and one grid what the even step wrote. They show up in the
+   statistics and the velocities of these two planes, so aaInOut keeps
+   them as each of the two grids would, and LBM_finishInPlace() puts
+   back those of the grid that two grids would end on. */
+
+#if defined(LBM_AA)
+
+#if defined(LBM_SIMD)
+#error "LBM_AA has no SIMD kernel"
+#endif
+#if LBM_COLLISION != LBM_BGK
+#error "LBM_AA has the BGK collision only"
+#endif
+
+static const int aaOpposite[N_DISTR_FUNCS] = {
+	C, S, N, W, E, B, T, SW, SE, NW, NE, SB, ST, NB, NT, WB, WT, EB, ET };
+
+static long aaRead[2][N_CELL_ENTRIES], aaWrite[2][N_CELL_ENTRIES];
+static int  aaSwapped = 0;  /* 1 after an even step */
+
+/* the slots of the planes z = 0 and SIZE_Z-1 that the ghost planes
+   push into, as each of two grids would hold them */
+static GRID_PRECISION* aaInOut[2];
+static long aaSteps = 0;            /* steps taken; two grids alternate */
+
+#define INOUT_ENTRY(g,dz,e) ((g)[CALC_INDEX( 0, 0, dz, 0 ) + (i) + aaRead[aaSwapped][e]])
+
+/* copy the slots of the planes z = 0 and SIZE_Z-1 whose value comes
+   from a cell outside the domain, in the grid's current layout, to v
+   (save) or from v back into it; as the index wraps around in x and
+   y, that is not just the slots that point in along z */
+static void copyGhostIn( LBM_Grid grid, GRID_PRECISION* v, const BOOL save ) {
+	const long* const rd = aaRead[aaSwapped];
+	const long begin = CALC_INDEX( 0, 0, 0, 0 ), end = CALC_INDEX( 0, 0, SIZE_Z, 0 );
+	long n = 0;
+	int p, e;
+	SWEEP_VAR
+
+	for( p = 0; p < 2; p++ ) {
+		const int z = (p == 0) ? 0 : SIZE_Z-1;
+
+		SWEEP_START( 0, 0, z, 0, 0, z+1 )
+			for( e = 0; e < N_DISTR_FUNCS; e++, n++ ) {
+				const int* c = distrDir[e];
+				const long from = i - CALC_INDEX( c[0], c[1], c[2], 0 );
+
+				if( from >= begin && from < end ) continue;
+				if( save ) v[n] = grid[i + rd[e]];
+				else       grid[i + rd[e]] = v[n];
+			}
+		SWEEP_END
+	}
+}
+
+/*############################################################################*/
+
+static void initializeInPlace( LBM_Grid grid ) {
+	int e;
+
+	for( e = 0; e < N_DISTR_FUNCS; e++ ) {
+		const int* c = distrDir[e];
+		const int  o = aaOpposite[e];
+
+		aaRead [0][e] = CALC_INDEX(     0,     0,     0, e );
+		aaWrite[0][e] = CALC_INDEX(     0,     0,     0, o );
+		aaRead [1][e] = CALC_INDEX( -c[0], -c[1], -c[2], o );
+		aaWrite[1][e] = CALC_INDEX( +c[0], +c[1], +c[2], e );
+	}
+	aaRead [0][FLAGS] = aaRead [1][FLAGS] =
+	aaWrite[0][FLAGS] = aaWrite[1][FLAGS] = CALC_INDEX( 0, 0, 0, FLAGS );
+	aaSwapped = 0;
+	aaSteps   = 0;
+
+	if( aaInOut[0] == NULL ) {
+		const size_t n = 2*N_DISTR_FUNCS*(size_t) PITCH_X*SIZE_Y;
+
+		aaInOut[0] = malloc( 2*n*sizeof( GRID_PRECISION ));
+		if( aaInOut[0] == NULL ) {
+			printf( "initializeInPlace: could not allocate the in- and outflow slots\n" );
+			exit( 1 );
+		}
+		aaInOut[1] = aaInOut[0] + n;
+	}
+	/* both of two grids start out like this one */
+	copyGhostIn( grid, aaInOut[0], TRUE );
+	copyGhostIn( grid, aaInOut[1], TRUE );
+}
+
+/*############################################################################*/
+
+void LBM_performStreamCollideInPlace( LBM_Grid grid ) {
+	SWEEP_VAR
+
+	const long* const rd = aaRead [aaSwapped];
+	const long* const wr = aaWrite[aaSwapped];
+	double f[N_DISTR_FUNCS];
+	double ux, uy, uz, u2, rho;
+	int e;
+
+	/*voption indep*/
+#if defined(LBM_OMP)
+#pragma omp parallel private( i, e, f, ux, uy, uz, u2, rho )
+#elif !defined(SPEC_CPU)
+#ifdef _OPENMP
+#pragma omp parallel for private( i, e, f, ux, uy, uz, u2, rho )
+#endif
+#endif
+	CELL_SWEEP_START( 0, SIZE_Z )
+		for( e = 0; e < N_DISTR_FUNCS; e++ )
+			f[e] = grid[i + rd[e]];
+
+		if( TEST_FLAG_SWEEP( grid, OBSTACLE )) {
+			for( e = 0; e < N_DISTR_FUNCS; e++ )
+				grid[i + wr[aaOpposite[e]]] = f[e];
 			continue;
 		}
 
-		rho = + SRC_C ( srcGrid ) + SRC_N ( srcGrid )
-		      + SRC_S ( srcGrid ) + SRC_E ( srcGrid )
-		      + SRC_W ( srcGrid ) + SRC_T ( srcGrid )
-		      + SRC_B ( srcGrid ) + SRC_NE( srcGrid )
-		      + SRC_NW( srcGrid ) + SRC_SE( srcGrid )
-		      + SRC_SW( srcGrid ) + SRC_NT( srcGrid )
-		      + SRC_NB( srcGrid ) + SRC_ST( srcGrid )
-		      + SRC_SB( srcGrid ) + SRC_ET( srcGrid )
-		      + SRC_EB( srcGrid ) + SRC_WT( srcGrid )
-		      + SRC_WB( srcGrid );
-
-		ux = + SRC_E ( srcGrid ) - SRC_W ( srcGrid )
-		     + SRC_NE( srcGrid ) - SRC_NW( srcGrid )
-		     + SRC_SE( srcGrid ) - SRC_SW( srcGrid )
-		     + SRC_ET( srcGrid ) + SRC_EB( srcGrid )
-		     - SRC_WT( srcGrid ) - SRC_WB( srcGrid );
-		uy = + SRC_N ( srcGrid ) - SRC_S ( srcGrid )
-		     + SRC_NE( srcGrid ) + SRC_NW( srcGrid )
-		     - SRC_SE( srcGrid ) - SRC_SW( srcGrid )
-		     + SRC_NT( srcGrid ) + SRC_NB( srcGrid )
-		     - SRC_ST( srcGrid ) - SRC_SB( srcGrid );
-		uz = + SRC_T ( srcGrid ) - SRC_B ( srcGrid )
-		     + SRC_NT( srcGrid ) - SRC_NB( srcGrid )
-		     + SRC_ST( srcGrid ) - SRC_SB( srcGrid )
-		     + SRC_ET( srcGrid ) - SRC_EB( srcGrid )
-		     + SRC_WT( srcGrid ) - SRC_WB( srcGrid );
+		rho = + f[C ] + f[N ]
+		      + f[S ] + f[E ]
+		      + f[W ] + f[T ]
+		      + f[B ] + f[NE]
+		      + f[NW] + f[SE]
+		      + f[SW] + f[NT]
+		      + f[NB] + f[ST]
+		      + f[SB] + f[ET]
+		      + f[EB] + f[WT]
+		      + f[WB];
+
+		ux = + f[E ] - f[W ]
+		     + f[NE] - f[NW]
+		     + f[SE] - f[SW]
+		     + f[ET] + f[EB]
+		     - f[WT] - f[WB];
+		uy = + f[N ] - f[S ]
+		     + f[NE] + f[NW]
+		     - f[SE] - f[SW]
+		     + f[NT] + f[NB]
+		     - f[ST] - f[SB];
+		uz = + f[T ] - f[B ]
+		     + f[NT] - f[NB]
+		     + f[ST] - f[SB]
+		     + f[ET] - f[EB]
+		     + f[WT] - f[WB];
 
 		ux /= rho;
 		uy /= rho;
 		uz /= rho;
 
-		if( TEST_FLAG_SWEEP( srcGrid, ACCEL )) {
+		if( TEST_FLAG_SWEEP( grid, ACCEL )) {
 			ux = 0.005;
 			uy = 0.002;
 			uz = 0.000;
 		}
 
 		u2 = 1.5 * (ux*ux + uy*uy + uz*uz);
-		DST_C ( dstGrid ) = (1.0-OMEGA)*SRC_C ( srcGrid ) + DFL1*OMEGA*rho*(1.0                                 - u2);
-
-		DST_N ( dstGrid ) = (1.0-OMEGA)*SRC_N ( srcGrid ) + DFL2*OMEGA*rho*(1.0 +       uy*(4.5*uy       + 3.0) - u2);
-		DST_S ( dstGrid ) = (1.0-OMEGA)*SRC_S ( srcGrid ) + DFL2*OMEGA*rho*(1.0 +       uy*(4.5*uy       - 3.0) - u2);
-		DST_E ( dstGrid ) = (1.0-OMEGA)*SRC_E ( srcGrid ) + DFL2*OMEGA*rho*(1.0 +       ux*(4.5*ux       + 3.0) - u2);
-		DST_W ( dstGrid ) = (1.0-OMEGA)*SRC_W ( srcGrid ) + DFL2*OMEGA*rho*(1.0 +       ux*(4.5*ux       - 3.0) - u2);
-		DST_T ( dstGrid ) = (1.0-OMEGA)*SRC_T ( srcGrid ) + DFL2*OMEGA*rho*(1.0 +       uz*(4.5*uz       + 3.0) - u2);
-		DST_B ( dstGrid ) = (1.0-OMEGA)*SRC_B ( srcGrid ) + DFL2*OMEGA*rho*(1.0 +       uz*(4.5*uz       - 3.0) - u2);
-
-		DST_NE( dstGrid ) = (1.0-OMEGA)*SRC_NE( srcGrid ) + DFL3*OMEGA*rho*(1.0 + (+ux+uy)*(4.5*(+ux+uy) + 3.0) - u2);
-		DST_NW( dstGrid ) = (1.0-OMEGA)*SRC_NW( srcGrid ) + DFL3*OMEGA*rho*(1.0 + (-ux+uy)*(4.5*(-ux+uy) + 3.0) - u2);
-		DST_SE( dstGrid ) = (1.0-OMEGA)*SRC_SE( srcGrid ) + DFL3*OMEGA*rho*(1.0 + (+ux-uy)*(4.5*(+ux-uy) + 3.0) - u2);
-		DST_SW( dstGrid ) = (1.0-OMEGA)*SRC_SW( srcGrid ) + DFL3*OMEGA*rho*(1.0 + (-ux-uy)*(4.5*(-ux-uy) + 3.0) - u2);
-		DST_NT( dstGrid ) = (1.0-OMEGA)*SRC_NT( srcGrid ) + DFL3*OMEGA*rho*(1.0 + (+uy+uz)*(4.5*(+uy+uz) + 3.0) - u2);
-		DST_NB( dstGrid ) = (1.0-OMEGA)*SRC_NB( srcGrid ) + DFL3*OMEGA*rho*(1.0 + (+uy-uz)*(4.5*(+uy-uz) + 3.0) - u2);
-		DST_ST( dstGrid ) = (1.0-OMEGA)*SRC_ST( srcGrid ) + DFL3*OMEGA*rho*(1.0 + (-uy+uz)*(4.5*(-uy+uz) + 3.0) - u2);
-		DST_SB( dstGrid ) = (1.0-OMEGA)*SRC_SB( srcGrid ) + DFL3*OMEGA*rho*(1.0 + (-uy-uz)*(4.5*(-uy-uz) + 3.0) - u2);
-		DST_ET( dstGrid ) = (1.0-OMEGA)*SRC_ET( srcGrid ) + DFL3*OMEGA*rho*(1.0 + (+ux+uz)*(4.5*(+ux+uz) + 3.0) - u2);
-		DST_EB( dstGrid ) = (1.0-OMEGA)*SRC_EB( srcGrid ) + DFL3*OMEGA*rho*(1.0 + (+ux-uz)*(4.5*(+ux-uz) + 3.0) - u2);
-		DST_WT( dstGrid ) = (1.0-OMEGA)*SRC_WT( srcGrid ) + DFL3*OMEGA*rho*(1.0 + (-ux+uz)*(4.5*(-ux+uz) + 3.0) - u2);
-		DST_WB( dstGrid ) = (1.0-OMEGA)*SRC_WB( srcGrid ) + DFL3*OMEGA*rho*(1.0 + (-ux-uz)*(4.5*(-ux-uz) + 3.0) - u2);
-	SWEEP_END
+		grid[i + wr[C ]] = (1.0-OMEGA)*f[C ] + DFL1*OMEGA*rho*(1.0                                 - u2);
+
+		grid[i + wr[N ]] = (1.0-OMEGA)*f[N ] + DFL2*OMEGA*rho*(1.0 +       uy*(4.5*uy       + 3.0) - u2);
+		grid[i + wr[S ]] = (1.0-OMEGA)*f[S ] + DFL2*OMEGA*rho*(1.0 +       uy*(4.5*uy       - 3.0) - u2);
+		grid[i + wr[E ]] = (1.0-OMEGA)*f[E ] + DFL2*OMEGA*rho*(1.0 +       ux*(4.5*ux       + 3.0) - u2);
+		grid[i + wr[W ]] = (1.0-OMEGA)*f[W ] + DFL2*OMEGA*rho*(1.0 +       ux*(4.5*ux       - 3.0) - u2);
+		grid[i + wr[T ]] = (1.0-OMEGA)*f[T ] + DFL2*OMEGA*rho*(1.0 +       uz*(4.5*uz       + 3.0) - u2);
+		grid[i + wr[B ]] = (1.0-OMEGA)*f[B ] + DFL2*OMEGA*rho*(1.0 +       uz*(4.5*uz       - 3.0) - u2);
+
+		grid[i + wr[NE]] = (1.0-OMEGA)*f[NE] + DFL3*OMEGA*rho*(1.0 + (+ux+uy)*(4.5*(+ux+uy) + 3.0) - u2);
+		grid[i + wr[NW]] = (1.0-OMEGA)*f[NW] + DFL3*OMEGA*rho*(1.0 + (-ux+uy)*(4.5*(-ux+uy) + 3.0) - u2);
+		grid[i + wr[SE]] = (1.0-OMEGA)*f[SE] + DFL3*OMEGA*rho*(1.0 + (+ux-uy)*(4.5*(+ux-uy) + 3.0) - u2);
+		grid[i + wr[SW]] = (1.0-OMEGA)*f[SW] + DFL3*OMEGA*rho*(1.0 + (-ux-uy)*(4.5*(-ux-uy) + 3.0) - u2);
+		grid[i + wr[NT]] = (1.0-OMEGA)*f[NT] + DFL3*OMEGA*rho*(1.0 + (+uy+uz)*(4.5*(+uy+uz) + 3.0) - u2);
+		grid[i + wr[NB]] = (1.0-OMEGA)*f[NB] + DFL3*OMEGA*rho*(1.0 + (+uy-uz)*(4.5*(+uy-uz) + 3.0) - u2);
+		grid[i + wr[ST]] = (1.0-OMEGA)*f[ST] + DFL3*OMEGA*rho*(1.0 + (-uy+uz)*(4.5*(-uy+uz) + 3.0) - u2);
+		grid[i + wr[SB]] = (1.0-OMEGA)*f[SB] + DFL3*OMEGA*rho*(1.0 + (-uy-uz)*(4.5*(-uy-uz) + 3.0) - u2);
+		grid[i + wr[ET]] = (1.0-OMEGA)*f[ET] + DFL3*OMEGA*rho*(1.0 + (+ux+uz)*(4.5*(+ux+uz) + 3.0) - u2);
+		grid[i + wr[EB]] = (1.0-OMEGA)*f[EB] + DFL3*OMEGA*rho*(1.0 + (+ux-uz)*(4.5*(+ux-uz) + 3.0) - u2);
+		grid[i + wr[WT]] = (1.0-OMEGA)*f[WT] + DFL3*OMEGA*rho*(1.0 + (-ux+uz)*(4.5*(-ux+uz) + 3.0) - u2);
+		grid[i + wr[WB]] = (1.0-OMEGA)*f[WB] + DFL3*OMEGA*rho*(1.0 + (-ux-uz)*(4.5*(-ux-uz) + 3.0) - u2);
+	CELL_SWEEP_END
+
+	aaSwapped = ! aaSwapped;
+	aaSteps++;
+}
+
+/*############################################################################*/
+
+void LBM_finishInPlace( LBM_Grid grid ) {
+	/* one direction of each opposite pair */
+	const int pair[] = { N, E, T, NE, NW, NT, NB, ET, EB };
+	double aux;
+	int p;
+	SWEEP_VAR
+
+	/* slot e of the cell at i and slot opp(e) of the cell at i-c(e)
+	   hold each other's values; either of them may be in the domain,
+	   so the sweep reaches d = c(e) cells past it on one side */
+	if( aaSwapped ) {
+		for( p = 0; p < sizeof( pair ) / sizeof( pair[0] ); p++ ) {
+			const int* c = distrDir[pair[p]];
+			const long d = c[0] + c[1]*PITCH_X + c[2]*PITCH_X*SIZE_Y;
+			const long a = aaRead[0][pair[p]], b = aaRead[1][pair[p]];
+
+			SWEEP_START( (d < 0 ? d : 0), 0, 0, (d > 0 ? d : 0), 0, SIZE_Z )
+				aux         = grid[i + a];
+				grid[i + a] = grid[i + b];
+				grid[i + b] = aux;
+			SWEEP_END
+		}
+		aaSwapped = 0;
+	}
+
+	/* after t steps two grids end on the one that was written t-1 steps in */
+	copyGhostIn( grid, aaInOut[aaSteps & 1], FALSE );
 }
 
+#else /* LBM_AA */
+
+#define INOUT_ENTRY(g,dz,e) (GRID_ENTRY_SWEEP( g, 0, 0, dz, e ))
+
+#endif /* LBM_AA */
+
 /*############################################################################*/
 
 void LBM_handleInOutFlow( LBM_Grid srcGrid ) {
+	if( OFFSET_Z == 0 ) LBM_handleInFlow( srcGrid );
+	if( OFFSET_Z + SIZE_Z == GLOBAL_SIZE_Z ) LBM_handleOutFlow( srcGrid );
+#if defined(LBM_AA)
+	copyGhostIn( srcGrid, aaInOut[aaSteps & 1], TRUE );
+#endif
+}
+
+/*############################################################################*/
+
+#if defined(LBM_GPU)
+#pragma omp declare target
+#endif
+
+/* the inflow values of the cell at i of plane 0 */
+CELL_FUNC void inFlowCell( LBM_Grid srcGrid, const long i ) {
+	double ux , uy , uz , rho ,
+	       rho1, rho2,
+	       u2, px, py;
+
+	rho1 = + (double) INOUT_ENTRY( srcGrid, 1, C  ) + INOUT_ENTRY( srcGrid, 1, N  )
+	       + INOUT_ENTRY( srcGrid, 1, S  ) + INOUT_ENTRY( srcGrid, 1, E  )
+	       + INOUT_ENTRY( srcGrid, 1, W  ) + INOUT_ENTRY( srcGrid, 1, T  )
+	       + INOUT_ENTRY( srcGrid, 1, B  ) + INOUT_ENTRY( srcGrid, 1, NE )
+	       + INOUT_ENTRY( srcGrid, 1, NW ) + INOUT_ENTRY( srcGrid, 1, SE )
+	       + INOUT_ENTRY( srcGrid, 1, SW ) + INOUT_ENTRY( srcGrid, 1, NT )
+	       + INOUT_ENTRY( srcGrid, 1, NB ) + INOUT_ENTRY( srcGrid, 1, ST )
+	       + INOUT_ENTRY( srcGrid, 1, SB ) + INOUT_ENTRY( srcGrid, 1, ET )
+	       + INOUT_ENTRY( srcGrid, 1, EB ) + INOUT_ENTRY( srcGrid, 1, WT )
+	       + INOUT_ENTRY( srcGrid, 1, WB );
+	rho2 = + (double) INOUT_ENTRY( srcGrid, 2, C  ) + INOUT_ENTRY( srcGrid, 2, N  )
+	       + INOUT_ENTRY( srcGrid, 2, S  ) + INOUT_ENTRY( srcGrid, 2, E  )
+	       + INOUT_ENTRY( srcGrid, 2, W  ) + INOUT_ENTRY( srcGrid, 2, T  )
+	       + INOUT_ENTRY( srcGrid, 2, B  ) + INOUT_ENTRY( srcGrid, 2, NE )
+	       + INOUT_ENTRY( srcGrid, 2, NW ) + INOUT_ENTRY( srcGrid, 2, SE )
+	       + INOUT_ENTRY( srcGrid, 2, SW ) + INOUT_ENTRY( srcGrid, 2, NT )
+	       + INOUT_ENTRY( srcGrid, 2, NB ) + INOUT_ENTRY( srcGrid, 2, ST )
+	       + INOUT_ENTRY( srcGrid, 2, SB ) + INOUT_ENTRY( srcGrid, 2, ET )
+	       + INOUT_ENTRY( srcGrid, 2, EB ) + INOUT_ENTRY( srcGrid, 2, WT )
+	       + INOUT_ENTRY( srcGrid, 2, WB );
+
+	rho = 2.0*rho1 - rho2;
+
+	px = (SWEEP_X / (0.5*(SIZE_X-1))) - 1.0;
+	py = (SWEEP_Y / (0.5*(SIZE_Y-1))) - 1.0;
+	ux = 0.00;
+	uy = 0.00;
+	uz = 0.01 * (1.0-px*px) * (1.0-py*py);
+
+	u2 = 1.5 * (ux*ux + uy*uy + uz*uz);
+
+	INOUT_ENTRY( srcGrid, 0, C ) = DFL1*rho*(1.0                                 - u2);
+
+	INOUT_ENTRY( srcGrid, 0, N ) = DFL2*rho*(1.0 +       uy*(4.5*uy       + 3.0) - u2);
+	INOUT_ENTRY( srcGrid, 0, S ) = DFL2*rho*(1.0 +       uy*(4.5*uy       - 3.0) - u2);
+	INOUT_ENTRY( srcGrid, 0, E ) = DFL2*rho*(1.0 +       ux*(4.5*ux       + 3.0) - u2);
+	INOUT_ENTRY( srcGrid, 0, W ) = DFL2*rho*(1.0 +       ux*(4.5*ux       - 3.0) - u2);
+	INOUT_ENTRY( srcGrid, 0, T ) = DFL2*rho*(1.0 +       uz*(4.5*uz       + 3.0) - u2);
+	INOUT_ENTRY( srcGrid, 0, B ) = DFL2*rho*(1.0 +       uz*(4.5*uz       - 3.0) - u2);
+
+	INOUT_ENTRY( srcGrid, 0, NE) = DFL3*rho*(1.0 + (+ux+uy)*(4.5*(+ux+uy) + 3.0) - u2);
+	INOUT_ENTRY( srcGrid, 0, NW) = DFL3*rho*(1.0 + (-ux+uy)*(4.5*(-ux+uy) + 3.0) - u2);
+	INOUT_ENTRY( srcGrid, 0, SE) = DFL3*rho*(1.0 + (+ux-uy)*(4.5*(+ux-uy) + 3.0) - u2);
+	INOUT_ENTRY( srcGrid, 0, SW) = DFL3*rho*(1.0 + (-ux-uy)*(4.5*(-ux-uy) + 3.0) - u2);
+	INOUT_ENTRY( srcGrid, 0, NT) = DFL3*rho*(1.0 + (+uy+uz)*(4.5*(+uy+uz) + 3.0) - u2);
+	INOUT_ENTRY( srcGrid, 0, NB) = DFL3*rho*(1.0 + (+uy-uz)*(4.5*(+uy-uz) + 3.0) - u2);
+	INOUT_ENTRY( srcGrid, 0, ST) = DFL3*rho*(1.0 + (-uy+uz)*(4.5*(-uy+uz) + 3.0) - u2);
+	INOUT_ENTRY( srcGrid, 0, SB) = DFL3*rho*(1.0 + (-uy-uz)*(4.5*(-uy-uz) + 3.0) - u2);
+	INOUT_ENTRY( srcGrid, 0, ET) = DFL3*rho*(1.0 + (+ux+uz)*(4.5*(+ux+uz) + 3.0) - u2);
+	INOUT_ENTRY( srcGrid, 0, EB) = DFL3*rho*(1.0 + (+ux-uz)*(4.5*(+ux-uz) + 3.0) - u2);
+	INOUT_ENTRY( srcGrid, 0, WT) = DFL3*rho*(1.0 + (-ux+uz)*(4.5*(-ux+uz) + 3.0) - u2);
+	INOUT_ENTRY( srcGrid, 0, WB) = DFL3*rho*(1.0 + (-ux-uz)*(4.5*(-ux-uz) + 3.0) - u2);
+}
+
+/*############################################################################*/
+
+/* the outflow values of the cell at i of plane SIZE_Z-1 */
+CELL_FUNC void outFlowCell( LBM_Grid srcGrid, const long i ) {
 	double ux , uy , uz , rho ,
 	       ux1, uy1, uz1, rho1,
 	       ux2, uy2, uz2, rho2,
-	       u2, px, py;
+	       u2;
+
+	rho1 = + (double) INOUT_ENTRY( srcGrid, -1, C  ) + INOUT_ENTRY( srcGrid, -1, N  )
+	       + INOUT_ENTRY( srcGrid, -1, S  ) + INOUT_ENTRY( srcGrid, -1, E  )
+	       + INOUT_ENTRY( srcGrid, -1, W  ) + INOUT_ENTRY( srcGrid, -1, T  )
+	       + INOUT_ENTRY( srcGrid, -1, B  ) + INOUT_ENTRY( srcGrid, -1, NE )
+	       + INOUT_ENTRY( srcGrid, -1, NW ) + INOUT_ENTRY( srcGrid, -1, SE )
+	       + INOUT_ENTRY( srcGrid, -1, SW ) + INOUT_ENTRY( srcGrid, -1, NT )
+	       + INOUT_ENTRY( srcGrid, -1, NB ) + INOUT_ENTRY( srcGrid, -1, ST )
+	       + INOUT_ENTRY( srcGrid, -1, SB ) + INOUT_ENTRY( srcGrid, -1, ET )
+	       + INOUT_ENTRY( srcGrid, -1, EB ) + INOUT_ENTRY( srcGrid, -1, WT )
+	       + INOUT_ENTRY( srcGrid, -1, WB );
+	ux1 = + (double) INOUT_ENTRY( srcGrid, -1, E  ) - INOUT_ENTRY( srcGrid, -1, W  )
+	      + INOUT_ENTRY( srcGrid, -1, NE ) - INOUT_ENTRY( srcGrid, -1, NW )
+	      + INOUT_ENTRY( srcGrid, -1, SE ) - INOUT_ENTRY( srcGrid, -1, SW )
+	      + INOUT_ENTRY( srcGrid, -1, ET ) + INOUT_ENTRY( srcGrid, -1, EB )
+	      - INOUT_ENTRY( srcGrid, -1, WT ) - INOUT_ENTRY( srcGrid, -1, WB );
+	uy1 = + (double) INOUT_ENTRY( srcGrid, -1, N  ) - INOUT_ENTRY( srcGrid, -1, S  )
+	      + INOUT_ENTRY( srcGrid, -1, NE ) + INOUT_ENTRY( srcGrid, -1, NW )
+	      - INOUT_ENTRY( srcGrid, -1, SE ) - INOUT_ENTRY( srcGrid, -1, SW )
+	      + INOUT_ENTRY( srcGrid, -1, NT ) + INOUT_ENTRY( srcGrid, -1, NB )
+	      - INOUT_ENTRY( srcGrid, -1, ST ) - INOUT_ENTRY( srcGrid, -1, SB );
+	uz1 = + (double) INOUT_ENTRY( srcGrid, -1, T  ) - INOUT_ENTRY( srcGrid, -1, B  )
+	      + INOUT_ENTRY( srcGrid, -1, NT ) - INOUT_ENTRY( srcGrid, -1, NB )
+	      + INOUT_ENTRY( srcGrid, -1, ST ) - INOUT_ENTRY( srcGrid, -1, SB )
+	      + INOUT_ENTRY( srcGrid, -1, ET ) - INOUT_ENTRY( srcGrid, -1, EB )
+	      + INOUT_ENTRY( srcGrid, -1, WT ) - INOUT_ENTRY( srcGrid, -1, WB );
+
+	ux1 /= rho1;
+	uy1 /= rho1;
+	uz1 /= rho1;
+
+	rho2 = + (double) INOUT_ENTRY( srcGrid, -2, C  ) + INOUT_ENTRY( srcGrid, -2, N  )
+	       + INOUT_ENTRY( srcGrid, -2, S  ) + INOUT_ENTRY( srcGrid, -2, E  )
+	       + INOUT_ENTRY( srcGrid, -2, W  ) + INOUT_ENTRY( srcGrid, -2, T  )
+	       + INOUT_ENTRY( srcGrid, -2, B  ) + INOUT_ENTRY( srcGrid, -2, NE )
+	       + INOUT_ENTRY( srcGrid, -2, NW ) + INOUT_ENTRY( srcGrid, -2, SE )
+	       + INOUT_ENTRY( srcGrid, -2, SW ) + INOUT_ENTRY( srcGrid, -2, NT )
+	       + INOUT_ENTRY( srcGrid, -2, NB ) + INOUT_ENTRY( srcGrid, -2, ST )
+	       + INOUT_ENTRY( srcGrid, -2, SB ) + INOUT_ENTRY( srcGrid, -2, ET )
+	       + INOUT_ENTRY( srcGrid, -2, EB ) + INOUT_ENTRY( srcGrid, -2, WT )
+	       + INOUT_ENTRY( srcGrid, -2, WB );
+	ux2 = + (double) INOUT_ENTRY( srcGrid, -2, E  ) - INOUT_ENTRY( srcGrid, -2, W  )
+	      + INOUT_ENTRY( srcGrid, -2, NE ) - INOUT_ENTRY( srcGrid, -2, NW )
+	      + INOUT_ENTRY( srcGrid, -2, SE ) - INOUT_ENTRY( srcGrid, -2, SW )
+	      + INOUT_ENTRY( srcGrid, -2, ET ) + INOUT_ENTRY( srcGrid, -2, EB )
+	      - INOUT_ENTRY( srcGrid, -2, WT ) - INOUT_ENTRY( srcGrid, -2, WB );
+	uy2 = + (double) INOUT_ENTRY( srcGrid, -2, N  ) - INOUT_ENTRY( srcGrid, -2, S  )
+	      + INOUT_ENTRY( srcGrid, -2, NE ) + INOUT_ENTRY( srcGrid, -2, NW )
+	      - INOUT_ENTRY( srcGrid, -2, SE ) - INOUT_ENTRY( srcGrid, -2, SW )
+	      + INOUT_ENTRY( srcGrid, -2, NT ) + INOUT_ENTRY( srcGrid, -2, NB )
+	      - INOUT_ENTRY( srcGrid, -2, ST ) - INOUT_ENTRY( srcGrid, -2, SB );
+	uz2 = + (double) INOUT_ENTRY( srcGrid, -2, T  ) - INOUT_ENTRY( srcGrid, -2, B  )
+	      + INOUT_ENTRY( srcGrid, -2, NT ) - INOUT_ENTRY( srcGrid, -2, NB )
+	      + INOUT_ENTRY( srcGrid, -2, ST ) - INOUT_ENTRY( srcGrid, -2, SB )
+	      + INOUT_ENTRY( srcGrid, -2, ET ) - INOUT_ENTRY( srcGrid, -2, EB )
+	      + INOUT_ENTRY( srcGrid, -2, WT ) - INOUT_ENTRY( srcGrid, -2, WB );
+
+	ux2 /= rho2;
+	uy2 /= rho2;
+	uz2 /= rho2;
+
+	rho = 1.0;
+
+	ux = 2*ux1 - ux2;
+	uy = 2*uy1 - uy2;
+	uz = 2*uz1 - uz2;
+
+	u2 = 1.5 * (ux*ux + uy*uy + uz*uz);
+
+	INOUT_ENTRY( srcGrid, 0, C ) = DFL1*rho*(1.0                                 - u2);
+
+	INOUT_ENTRY( srcGrid, 0, N ) = DFL2*rho*(1.0 +       uy*(4.5*uy       + 3.0) - u2);
+	INOUT_ENTRY( srcGrid, 0, S ) = DFL2*rho*(1.0 +       uy*(4.5*uy       - 3.0) - u2);
+	INOUT_ENTRY( srcGrid, 0, E ) = DFL2*rho*(1.0 +       ux*(4.5*ux       + 3.0) - u2);
+	INOUT_ENTRY( srcGrid, 0, W ) = DFL2*rho*(1.0 +       ux*(4.5*ux       - 3.0) - u2);
+	INOUT_ENTRY( srcGrid, 0, T ) = DFL2*rho*(1.0 +       uz*(4.5*uz       + 3.0) - u2);
+	INOUT_ENTRY( srcGrid, 0, B ) = DFL2*rho*(1.0 +       uz*(4.5*uz       - 3.0) - u2);
+
+	INOUT_ENTRY( srcGrid, 0, NE) = DFL3*rho*(1.0 + (+ux+uy)*(4.5*(+ux+uy) + 3.0) - u2);
+	INOUT_ENTRY( srcGrid, 0, NW) = DFL3*rho*(1.0 + (-ux+uy)*(4.5*(-ux+uy) + 3.0) - u2);
+	INOUT_ENTRY( srcGrid, 0, SE) = DFL3*rho*(1.0 + (+ux-uy)*(4.5*(+ux-uy) + 3.0) - u2);
+	INOUT_ENTRY( srcGrid, 0, SW) = DFL3*rho*(1.0 + (-ux-uy)*(4.5*(-ux-uy) + 3.0) - u2);
+	INOUT_ENTRY( srcGrid, 0, NT) = DFL3*rho*(1.0 + (+uy+uz)*(4.5*(+uy+uz) + 3.0) - u2);
+	INOUT_ENTRY( srcGrid, 0, NB) = DFL3*rho*(1.0 + (+uy-uz)*(4.5*(+uy-uz) + 3.0) - u2);
+	INOUT_ENTRY( srcGrid, 0, ST) = DFL3*rho*(1.0 + (-uy+uz)*(4.5*(-uy+uz) + 3.0) - u2);
+	INOUT_ENTRY( srcGrid, 0, SB) = DFL3*rho*(1.0 + (-uy-uz)*(4.5*(-uy-uz) + 3.0) - u2);
+	INOUT_ENTRY( srcGrid, 0, ET) = DFL3*rho*(1.0 + (+ux+uz)*(4.5*(+ux+uz) + 3.0) - u2);
+	INOUT_ENTRY( srcGrid, 0, EB) = DFL3*rho*(1.0 + (+ux-uz)*(4.5*(+ux-uz) + 3.0) - u2);
+	INOUT_ENTRY( srcGrid, 0, WT) = DFL3*rho*(1.0 + (-ux+uz)*(4.5*(-ux+uz) + 3.0) - u2);
+	INOUT_ENTRY( srcGrid, 0, WB) = DFL3*rho*(1.0 + (-ux-uz)*(4.5*(-ux-uz) + 3.0) - u2);
+}
+
+#if defined(LBM_GPU)
+#pragma omp end declare target
+#endif
+
+/*############################################################################*/
+
+static void handleInFlow( LBM_Grid srcGrid, const BOOL parallel ) {
 	SWEEP_VAR
 
-	/* inflow */
 	/*voption indep*/
-#if !defined(SPEC_CPU)
+#if !defined(SPEC_CPU) || defined(LBM_OMP)
 #ifdef _OPENMP
-#pragma omp parallel for private( ux, uy, uz, rho, ux1, uy1, uz1, rho1, \
-                                  ux2, uy2, uz2, rho2, u2, px, py )
+#pragma omp parallel for if( parallel )
 #endif
 #endif
 	SWEEP_START( 0, 0, 0, 0, 0, 1 )
-		rho1 = + GRID_ENTRY_SWEEP( srcGrid, 0, 0, 1, C  ) + GRID_ENTRY_SWEEP( srcGrid, 0, 0, 1, N  )
-		       + GRID_ENTRY_SWEEP( srcGrid, 0, 0, 1, S  ) + GRID_ENTRY_SWEEP( srcGrid, 0, 0, 1, E  )
-		       + GRID_ENTRY_SWEEP( srcGrid, 0, 0, 1, W  ) + GRID_ENTRY_SWEEP( srcGrid, 0, 0, 1, T  )
-		       + GRID_ENTRY_SWEEP( srcGrid, 0, 0, 1, B  ) + GRID_ENTRY_SWEEP( srcGrid, 0, 0, 1, NE )
-		       + GRID_ENTRY_SWEEP( srcGrid, 0, 0, 1, NW ) + GRID_ENTRY_SWEEP( srcGrid, 0, 0, 1, SE )
-		       + GRID_ENTRY_SWEEP( srcGrid, 0, 0, 1, SW ) + GRID_ENTRY_SWEEP( srcGrid, 0, 0, 1, NT )
-		       + GRID_ENTRY_SWEEP( srcGrid, 0, 0, 1, NB ) + GRID_ENTRY_SWEEP( srcGrid, 0, 0, 1, ST )
-		       + GRID_ENTRY_SWEEP( srcGrid, 0, 0, 1, SB ) + GRID_ENTRY_SWEEP( srcGrid, 0, 0, 1, ET )
-		       + GRID_ENTRY_SWEEP( srcGrid, 0, 0, 1, EB ) + GRID_ENTRY_SWEEP( srcGrid, 0, 0, 1, WT )
-		       + GRID_ENTRY_SWEEP( srcGrid, 0, 0, 1, WB );
-		rho2 = + GRID_ENTRY_SWEEP( srcGrid, 0, 0, 2, C  ) + GRID_ENTRY_SWEEP( srcGrid, 0, 0, 2, N  )
-		       + GRID_ENTRY_SWEEP( srcGrid, 0, 0, 2, S  ) + GRID_ENTRY_SWEEP( srcGrid, 0, 0, 2, E  )
-		       + GRID_ENTRY_SWEEP( srcGrid, 0, 0, 2, W  ) + GRID_ENTRY_SWEEP( srcGrid, 0, 0, 2, T  )
-		       + GRID_ENTRY_SWEEP( srcGrid, 0, 0, 2, B  ) + GRID_ENTRY_SWEEP( srcGrid, 0, 0, 2, NE )
-		       + GRID_ENTRY_SWEEP( srcGrid, 0, 0, 2, NW ) + GRID_ENTRY_SWEEP( srcGrid, 0, 0, 2, SE )
-		       + GRID_ENTRY_SWEEP( srcGrid, 0, 0, 2, SW ) + GRID_ENTRY_SWEEP( srcGrid, 0, 0, 2, NT )
-		       + GRID_ENTRY_SWEEP( srcGrid, 0, 0, 2, NB ) + GRID_ENTRY_SWEEP( srcGrid, 0, 0, 2, ST )
-		       + GRID_ENTRY_SWEEP( srcGrid, 0, 0, 2, SB ) + GRID_ENTRY_SWEEP( srcGrid, 0, 0, 2, ET )
-		       + GRID_ENTRY_SWEEP( srcGrid, 0, 0, 2, EB ) + GRID_ENTRY_SWEEP( srcGrid, 0, 0, 2, WT )
-		       + GRID_ENTRY_SWEEP( srcGrid, 0, 0, 2, WB );
-
-		rho = 2.0*rho1 - rho2;
-
-		px = (SWEEP_X / (0.5*(SIZE_X-1))) - 1.0;
-		py = (SWEEP_Y / (0.5*(SIZE_Y-1))) - 1.0;
-		ux = 0.00;
-		uy = 0.00;
-		uz = 0.01 * (1.0-px*px) * (1.0-py*py);
+		inFlowCell( srcGrid, i );
+	SWEEP_END
+}
 
-		u2 = 1.5 * (ux*ux + uy*uy + uz*uz);
+/*############################################################################*/
 
-		LOCAL( srcGrid, C ) = DFL1*rho*(1.0                                 - u2);
-
-		LOCAL( srcGrid, N ) = DFL2*rho*(1.0 +       uy*(4.5*uy       + 3.0) - u2);
-		LOCAL( srcGrid, S ) = DFL2*rho*(1.0 +       uy*(4.5*uy       - 3.0) - u2);
-		LOCAL( srcGrid, E ) = DFL2*rho*(1.0 +       ux*(4.5*ux       + 3.0) - u2);
-		LOCAL( srcGrid, W ) = DFL2*rho*(1.0 +       ux*(4.5*ux       - 3.0) - u2);
-		LOCAL( srcGrid, T ) = DFL2*rho*(1.0 +       uz*(4.5*uz       + 3.0) - u2);
-		LOCAL( srcGrid, B ) = DFL2*rho*(1.0 +       uz*(4.5*uz       - 3.0) - u2);
-
-		LOCAL( srcGrid, NE) = DFL3*rho*(1.0 + (+ux+uy)*(4.5*(+ux+uy) + 3.0) - u2);
-		LOCAL( srcGrid, NW) = DFL3*rho*(1.0 + (-ux+uy)*(4.5*(-ux+uy) + 3.0) - u2);
-		LOCAL( srcGrid, SE) = DFL3*rho*(1.0 + (+ux-uy)*(4.5*(+ux-uy) + 3.0) - u2);
-		LOCAL( srcGrid, SW) = DFL3*rho*(1.0 + (-ux-uy)*(4.5*(-ux-uy) + 3.0) - u2);
-		LOCAL( srcGrid, NT) = DFL3*rho*(1.0 + (+uy+uz)*(4.5*(+uy+uz) + 3.0) - u2);
-		LOCAL( srcGrid, NB) = DFL3*rho*(1.0 + (+uy-uz)*(4.5*(+uy-uz) + 3.0) - u2);
-		LOCAL( srcGrid, ST) = DFL3*rho*(1.0 + (-uy+uz)*(4.5*(-uy+uz) + 3.0) - u2);
-		LOCAL( srcGrid, SB) = DFL3*rho*(1.0 + (-uy-uz)*(4.5*(-uy-uz) + 3.0) - u2);
-		LOCAL( srcGrid, ET) = DFL3*rho*(1.0 + (+ux+uz)*(4.5*(+ux+uz) + 3.0) - u2);
-		LOCAL( srcGrid, EB) = DFL3*rho*(1.0 + (+ux-uz)*(4.5*(+ux-uz) + 3.0) - u2);
-		LOCAL( srcGrid, WT) = DFL3*rho*(1.0 + (-ux+uz)*(4.5*(-ux+uz) + 3.0) - u2);
-		LOCAL( srcGrid, WB) = DFL3*rho*(1.0 + (-ux-uz)*(4.5*(-ux-uz) + 3.0) - u2);
-	SWEEP_END
+static void handleOutFlow( LBM_Grid srcGrid, const BOOL parallel ) {
+	SWEEP_VAR
 
-	/* outflow */
 	/*voption indep*/
-#if !defined(SPEC_CPU)
+#if !defined(SPEC_CPU) || defined(LBM_OMP)
 #ifdef _OPENMP
-#pragma omp parallel for private( ux, uy, uz, rho, ux1, uy1, uz1, rho1, \
-                                  ux2, uy2, uz2, rho2, u2, px, py )
+#pragma omp parallel for if( parallel )
 #endif
 #endif
-
 	SWEEP_START( 0, 0, SIZE_Z-1, 0, 0, SIZE_Z )
-		rho1 = + GRID_ENTRY_SWEEP( srcGrid, 0, 0, -1, C  ) + GRID_ENTRY_SWEEP( srcGrid, 0, 0, -1, N  )
-		       + GRID_ENTRY_SWEEP( srcGrid, 0, 0, -1, S  ) + GRID_ENTRY_SWEEP( srcGrid, 0, 0, -1, E  )
-		       + GRID_ENTRY_SWEEP( srcGrid, 0, 0, -1, W  ) + GRID_ENTRY_SWEEP( srcGrid, 0, 0, -1, T  )
-		       + GRID_ENTRY_SWEEP( srcGrid, 0, 0, -1, B  ) + GRID_ENTRY_SWEEP( srcGrid, 0, 0, -1, NE )
-		       + GRID_ENTRY_SWEEP( srcGrid, 0, 0, -1, NW ) + GRID_ENTRY_SWEEP( srcGrid, 0, 0, -1, SE )
-		       + GRID_ENTRY_SWEEP( srcGrid, 0, 0, -1, SW ) + GRID_ENTRY_SWEEP( srcGrid, 0, 0, -1, NT )
-		       + GRID_ENTRY_SWEEP( srcGrid, 0, 0, -1, NB ) + GRID_ENTRY_SWEEP( srcGrid, 0, 0, -1, ST )
-		       + GRID_ENTRY_SWEEP( srcGrid, 0, 0, -1, SB ) + GRID_ENTRY_SWEEP( srcGrid, 0, 0, -1, ET )
-		       + GRID_ENTRY_SWEEP( srcGrid, 0, 0, -1, EB ) + GRID_ENTRY_SWEEP( srcGrid, 0, 0, -1, WT )
-		       + GRID_ENTRY_SWEEP( srcGrid, 0, 0, -1, WB );
-		ux1 = + GRID_ENTRY_SWEEP( srcGrid, 0, 0, -1, E  ) - GRID_ENTRY_SWEEP( srcGrid, 0, 0, -1, W  )
-		      + GRID_ENTRY_SWEEP( srcGrid, 0, 0, -1, NE ) - GRID_ENTRY_SWEEP( srcGrid, 0, 0, -1, NW )
-		      + GRID_ENTRY_SWEEP( srcGrid, 0, 0, -1, SE ) - GRID_ENTRY_SWEEP( srcGrid, 0, 0, -1, SW )
-		      + GRID_ENTRY_SWEEP( srcGrid, 0, 0, -1, ET ) + GRID_ENTRY_SWEEP( srcGrid, 0, 0, -1, EB )
-		      - GRID_ENTRY_SWEEP( srcGrid, 0, 0, -1, WT ) - GRID_ENTRY_SWEEP( srcGrid, 0, 0, -1, WB );
-		uy1 = + GRID_ENTRY_SWEEP( srcGrid, 0, 0, -1, N  ) - GRID_ENTRY_SWEEP( srcGrid, 0, 0, -1, S  )
-		      + GRID_ENTRY_SWEEP( srcGrid, 0, 0, -1, NE ) + GRID_ENTRY_SWEEP( srcGrid, 0, 0, -1, NW )
-		      - GRID_ENTRY_SWEEP( srcGrid, 0, 0, -1, SE ) - GRID_ENTRY_SWEEP( srcGrid, 0, 0, -1, SW )
-		      + GRID_ENTRY_SWEEP( srcGrid, 0, 0, -1, NT ) + GRID_ENTRY_SWEEP( srcGrid, 0, 0, -1, NB )
-		      - GRID_ENTRY_SWEEP( srcGrid, 0, 0, -1, ST ) - GRID_ENTRY_SWEEP( srcGrid, 0, 0, -1, SB );
-		uz1 = + GRID_ENTRY_SWEEP( srcGrid, 0, 0, -1, T  ) - GRID_ENTRY_SWEEP( srcGrid, 0, 0, -1, B  )
-		      + GRID_ENTRY_SWEEP( srcGrid, 0, 0, -1, NT ) - GRID_ENTRY_SWEEP( srcGrid, 0, 0, -1, NB )
-		      + GRID_ENTRY_SWEEP( srcGrid, 0, 0, -1, ST ) - GRID_ENTRY_SWEEP( srcGrid, 0, 0, -1, SB )
-		      + GRID_ENTRY_SWEEP( srcGrid, 0, 0, -1, ET ) - GRID_ENTRY_SWEEP( srcGrid, 0, 0, -1, EB )
-		      + GRID_ENTRY_SWEEP( srcGrid, 0, 0, -1, WT ) - GRID_ENTRY_SWEEP( srcGrid, 0, 0, -1, WB );
-
-		ux1 /= rho1;
-		uy1 /= rho1;
-		uz1 /= rho1;
-
-		rho2 = + GRID_ENTRY_SWEEP( srcGrid, 0, 0, -2, C  ) + GRID_ENTRY_SWEEP( srcGrid, 0, 0, -2, N  )
-		       + GRID_ENTRY_SWEEP( srcGrid, 0, 0, -2, S  ) + GRID_ENTRY_SWEEP( srcGrid, 0, 0, -2, E  )
-		       + GRID_ENTRY_SWEEP( srcGrid, 0, 0, -2, W  ) + GRID_ENTRY_SWEEP( srcGrid, 0, 0, -2, T  )
-		       + GRID_ENTRY_SWEEP( srcGrid, 0, 0, -2, B  ) + GRID_ENTRY_SWEEP( srcGrid, 0, 0, -2, NE )
-		       + GRID_ENTRY_SWEEP( srcGrid, 0, 0, -2, NW ) + GRID_ENTRY_SWEEP( srcGrid, 0, 0, -2, SE )
-		       + GRID_ENTRY_SWEEP( srcGrid, 0, 0, -2, SW ) + GRID_ENTRY_SWEEP( srcGrid, 0, 0, -2, NT )
-		       + GRID_ENTRY_SWEEP( srcGrid, 0, 0, -2, NB ) + GRID_ENTRY_SWEEP( srcGrid, 0, 0, -2, ST )
-		       + GRID_ENTRY_SWEEP( srcGrid, 0, 0, -2, SB ) + GRID_ENTRY_SWEEP( srcGrid, 0, 0, -2, ET )
-		       + GRID_ENTRY_SWEEP( srcGrid, 0, 0, -2, EB ) + GRID_ENTRY_SWEEP( srcGrid, 0, 0, -2, WT )
-		       + GRID_ENTRY_SWEEP( srcGrid, 0, 0, -2, WB );
-		ux2 = + GRID_ENTRY_SWEEP( srcGrid, 0, 0, -2, E  ) - GRID_ENTRY_SWEEP( srcGrid, 0, 0, -2, W  )
-		      + GRID_ENTRY_SWEEP( srcGrid, 0, 0, -2, NE ) - GRID_ENTRY_SWEEP( srcGrid, 0, 0, -2, NW )
-		      + GRID_ENTRY_SWEEP( srcGrid, 0, 0, -2, SE ) - GRID_ENTRY_SWEEP( srcGrid, 0, 0, -2, SW )
-		      + GRID_ENTRY_SWEEP( srcGrid, 0, 0, -2, ET ) + GRID_ENTRY_SWEEP( srcGrid, 0, 0, -2, EB )
-		      - GRID_ENTRY_SWEEP( srcGrid, 0, 0, -2, WT ) - GRID_ENTRY_SWEEP( srcGrid, 0, 0, -2, WB );
-		uy2 = + GRID_ENTRY_SWEEP( srcGrid, 0, 0, -2, N  ) - GRID_ENTRY_SWEEP( srcGrid, 0, 0, -2, S  )
-		      + GRID_ENTRY_SWEEP( srcGrid, 0, 0, -2, NE ) + GRID_ENTRY_SWEEP( srcGrid, 0, 0, -2, NW )
-		      - GRID_ENTRY_SWEEP( srcGrid, 0, 0, -2, SE ) - GRID_ENTRY_SWEEP( srcGrid, 0, 0, -2, SW )
-		      + GRID_ENTRY_SWEEP( srcGrid, 0, 0, -2, NT ) + GRID_ENTRY_SWEEP( srcGrid, 0, 0, -2, NB )
-		      - GRID_ENTRY_SWEEP( srcGrid, 0, 0, -2, ST ) - GRID_ENTRY_SWEEP( srcGrid, 0, 0, -2, SB );
-		uz2 = + GRID_ENTRY_SWEEP( srcGrid, 0, 0, -2, T  ) - GRID_ENTRY_SWEEP( srcGrid, 0, 0, -2, B  )
-		      + GRID_ENTRY_SWEEP( srcGrid, 0, 0, -2, NT ) - GRID_ENTRY_SWEEP( srcGrid, 0, 0, -2, NB )
-		      + GRID_ENTRY_SWEEP( srcGrid, 0, 0, -2, ST ) - GRID_ENTRY_SWEEP( srcGrid, 0, 0, -2, SB )
-		      + GRID_ENTRY_SWEEP( srcGrid, 0, 0, -2, ET ) - GRID_ENTRY_SWEEP( srcGrid, 0, 0, -2, EB )
-		      + GRID_ENTRY_SWEEP( srcGrid, 0, 0, -2, WT ) - GRID_ENTRY_SWEEP( srcGrid, 0, 0, -2, WB );
-
-		ux2 /= rho2;
-		uy2 /= rho2;
-		uz2 /= rho2;
-
-		rho = 1.0;
-
-		ux = 2*ux1 - ux2;
-		uy = 2*uy1 - uy2;
-		uz = 2*uz1 - uz2;
+		outFlowCell( srcGrid, i );
+	SWEEP_END
+}
 
-		u2 = 1.5 * (ux*ux + uy*uy + uz*uz);
+/*############################################################################*/
+
+/* A channel's sweep of the planes [z1, z2) first sets the in- or
+   outflow plane among them, so that it is still in the cache when the
+   sweep reads it. With LBM_OMP the thread whose slab holds the plane
+   does so on its own, inside the parallel region of the sweep. The
+   inflow reads the planes 1 and 2 and the outflow SIZE_Z-2 and
+   SIZE_Z-3 of srcGrid, which no sweep writes, and the plane they set
+   is read by the sweep of that thread only. */
+static void handleSlabInOutFlow( LBM_Grid srcGrid, const int z1, const int z2,
+                                 const BOOL parallel ) {
+	if( OFFSET_Z == 0 && z1 <= 0 && 0 < z2 )
+		handleInFlow( srcGrid, parallel );
+	if( OFFSET_Z + SIZE_Z == GLOBAL_SIZE_Z && z1 < SIZE_Z && SIZE_Z <= z2 )
+		handleOutFlow( srcGrid, parallel );
+}
+
+/*############################################################################*/
+
+void LBM_handleInFlow( LBM_Grid srcGrid ) {
+	handleInFlow( srcGrid, TRUE );
+}
+
+/*############################################################################*/
+
+void LBM_handleOutFlow( LBM_Grid srcGrid ) {
+	handleOutFlow( srcGrid, TRUE );
+}
+
+/*############################################################################*/
+
+/* Built with -DLBM_GPU (make gpu), the grids stay on an OpenMP
+   offload device, a GPU, from LBM_gpuAttachGrid() on, and a timestep
+   is a single kernel there: each cell of a channel's in- or outflow
+   plane first sets its values from the planes behind it, which no
+   one writes in that step, and then every cell streams and collides
+   as on the host. LBM_showGridStatistics() reduces on the device, so
+   only its sums cross the bus, and the host copy of a grid is only
+   brought up to date for a checkpoint or the result
+   (LBM_gpuUpdateHost()). The threads of a team take neighbouring
+   cells, so this needs the LBM_SOA layout for its unit-stride loads.
+   Without a device the kernels run on the host. The mass is summed in
+   another order than on the host, which may change its last digit. */
+
+#if defined(LBM_GPU)
+
+#if !defined(_OPENMP)
+#error "LBM_GPU needs OpenMP offloading (-fopenmp)"
+#endif
+#if !defined(LBM_SOA)
+#error "LBM_GPU needs the LBM_SOA grid layout"
+#endif
+#if defined(LBM_OMP) || defined(LBM_SIMD) || defined(LBM_AA) || \
+    defined(LBM_SPARSE) || defined(LBM_MPI) || defined(MEM_TRACE)
+#error "LBM_GPU has a sweep of its own, which LBM_OMP, LBM_SIMD, LBM_AA, LBM_SPARSE, LBM_MPI and MEM_TRACE do not change"
+#endif
+
+/* the host grids and their device copies, margins left out */
+static GRID_PRECISION* gpuHostGrid[2]   = { NULL, NULL };
+static GRID_PRECISION* gpuDeviceCopy[2] = { NULL, NULL };
+static int gpuDevice;
+
+/* the device copy of grid, or NULL */
+static GRID_PRECISION* gpuDeviceGrid( LBM_Grid grid ) {
+	int g;
+
+	for( g = 0; g < 2; g++ )
+		if( gpuHostGrid[g] == grid ) return gpuDeviceCopy[g];
+	return NULL;
+}
 
-		LOCAL( srcGrid, C ) = DFL1*rho*(1.0                                 - u2);
-
-		LOCAL( srcGrid, N ) = DFL2*rho*(1.0 +       uy*(4.5*uy       + 3.0) - u2);
-		LOCAL( srcGrid, S ) = DFL2*rho*(1.0 +       uy*(4.5*uy       - 3.0) - u2);
-		LOCAL( srcGrid, E ) = DFL2*rho*(1.0 +       ux*(4.5*ux       + 3.0) - u2);
-		LOCAL( srcGrid, W ) = DFL2*rho*(1.0 +       ux*(4.5*ux       - 3.0) - u2);
-		LOCAL( srcGrid, T ) = DFL2*rho*(1.0 +       uz*(4.5*uz       + 3.0) - u2);
-		LOCAL( srcGrid, B ) = DFL2*rho*(1.0 +       uz*(4.5*uz       - 3.0) - u2);
-
-		LOCAL( srcGrid, NE) = DFL3*rho*(1.0 + (+ux+uy)*(4.5*(+ux+uy) + 3.0) - u2);
-		LOCAL( srcGrid, NW) = DFL3*rho*(1.0 + (-ux+uy)*(4.5*(-ux+uy) + 3.0) - u2);
-		LOCAL( srcGrid, SE) = DFL3*rho*(1.0 + (+ux-uy)*(4.5*(+ux-uy) + 3.0) - u2);
-		LOCAL( srcGrid, SW) = DFL3*rho*(1.0 + (-ux-uy)*(4.5*(-ux-uy) + 3.0) - u2);
-		LOCAL( srcGrid, NT) = DFL3*rho*(1.0 + (+uy+uz)*(4.5*(+uy+uz) + 3.0) - u2);
-		LOCAL( srcGrid, NB) = DFL3*rho*(1.0 + (+uy-uz)*(4.5*(+uy-uz) + 3.0) - u2);
-		LOCAL( srcGrid, ST) = DFL3*rho*(1.0 + (-uy+uz)*(4.5*(-uy+uz) + 3.0) - u2);
-		LOCAL( srcGrid, SB) = DFL3*rho*(1.0 + (-uy-uz)*(4.5*(-uy-uz) + 3.0) - u2);
-		LOCAL( srcGrid, ET) = DFL3*rho*(1.0 + (+ux+uz)*(4.5*(+ux+uz) + 3.0) - u2);
-		LOCAL( srcGrid, EB) = DFL3*rho*(1.0 + (+ux-uz)*(4.5*(+ux-uz) + 3.0) - u2);
-		LOCAL( srcGrid, WT) = DFL3*rho*(1.0 + (-ux+uz)*(4.5*(-ux+uz) + 3.0) - u2);
-		LOCAL( srcGrid, WB) = DFL3*rho*(1.0 + (-ux-uz)*(4.5*(-ux-uz) + 3.0) - u2);
+/*############################################################################*/
+
+void LBM_gpuAttachGrid( LBM_Grid grid ) {
+	const size_t margin = GRID_MARGIN,
+	             size   = GRID_SIZE*sizeof( GRID_PRECISION );
+	GRID_PRECISION* aux;
+	int g;
+
+	for( g = 0; g < 2 && gpuHostGrid[g] != NULL; g++ );
+	if( g == 2 ) {
+		printf( "LBM_gpuAttachGrid: there are two grids already\n" );
+		exit( 1 );
+	}
+
+	gpuDevice = omp_get_num_devices() > 0 ? omp_get_default_device()
+	                                      : omp_get_initial_device();
+	aux = omp_target_alloc( size, gpuDevice );
+	if( ! aux ) {
+		printf( "LBM_gpuAttachGrid: could not allocate %.1f MByte on device %i\n",
+		        size / (1024.0*1024.0), gpuDevice );
+		exit( 1 );
+	}
+	omp_target_memcpy( aux, grid-margin, size, 0, 0,
+	                   gpuDevice, omp_get_initial_device() );
+#if defined(LBM_DYNAMIC_SIZE)
+#pragma omp target update to( LBM_sizeX, LBM_sizeY, LBM_sizeZ, LBM_pitchX ) \
+                          device( gpuDevice )
+#endif
+#if !defined(SPEC_CPU)
+	printf( "LBM_gpuAttachGrid: allocated %.1f MByte on device %i\n",
+	        size / (1024.0*1024.0), gpuDevice );
+#endif
+
+	gpuHostGrid[g]   = grid;
+	gpuDeviceCopy[g] = aux + margin;
+}
+
+/*############################################################################*/
+
+void LBM_gpuUpdateHost( LBM_Grid grid ) {
+	const size_t margin = GRID_MARGIN,
+	             size   = GRID_SIZE*sizeof( GRID_PRECISION );
+	GRID_PRECISION* device = gpuDeviceGrid( grid );
+
+	if( device )
+		omp_target_memcpy( grid-margin, device-margin, size, 0, 0,
+		                   omp_get_initial_device(), gpuDevice );
+}
+
+/*############################################################################*/
+
+void LBM_gpuDetachGrid( LBM_Grid grid ) {
+	const size_t margin = GRID_MARGIN;
+	int g;
+
+	for( g = 0; g < 2; g++ ) {
+		if( gpuHostGrid[g] != grid ) continue;
+		omp_target_free( gpuDeviceCopy[g]-margin, gpuDevice );
+		gpuHostGrid[g]   = NULL;
+		gpuDeviceCopy[g] = NULL;
+	}
+}
+
+/*############################################################################*/
+
+static BOOL gpuStreamCollide( LBM_Grid srcGrid, LBM_Grid dstGrid,
+                              const BOOL channel ) {
+	GRID_PRECISION *src = gpuDeviceGrid( srcGrid ),
+	               *dst = gpuDeviceGrid( dstGrid );
+	SWEEP_VAR
+
+	if( ! src || ! dst ) return FALSE;
+
+#pragma omp target teams distribute parallel for device( gpuDevice ) \
+                                                 is_device_ptr( src, dst )
+	SWEEP_START( 0, 0, 0, 0, 0, SIZE_Z )
+		if( channel && SWEEP_Z == 0 ) inFlowCell( src, i );
+		if( channel && SWEEP_Z == SIZE_Z-1 ) outFlowCell( src, i );
+		streamCollideCell( src, dst, i );
 	SWEEP_END
+
+	return TRUE;
+}
+
+#endif /* LBM_GPU */
+
+/*############################################################################*/
+
+/* Temporal blocking: LBM_performWavefront() advances the grids by
+   nSteps timesteps in one sweep over z. Each round moves a front of
+   `block' planes one block up, and step j+1 follows step j at
+   WAVEFRONT_LAG planes distance, so the planes a step needs are still
+   in the cache from the step before. With the push scheme, step j+1
+   only reads a plane once step j has finished the one above it, and
+   it writes its results into the grid that holds step j-1, which no
+   one reads anymore by then. Three planes of lag also let the inflow
+   of a step read the planes 1 and 2 and the outflow read the planes
+   SIZE_Z-2 and SIZE_Z-3 while they hold that step's input, just as
+   in a single sweep, so the results are the same as those of nSteps
+   separate timesteps. */
+
+#define WAVEFRONT_LAG 3
+
+void LBM_performWavefront( LBM_GridPtr* srcGrid, LBM_GridPtr* dstGrid,
+                           const int nSteps, const int block,
+                           const BOOL channel ) {
+	LBM_GridPtr grid[2];
+	int front, j, z1, z2;
+
+	grid[0] = *srcGrid;
+	grid[1] = *dstGrid;
+
+	for( front = 0; front < SIZE_Z + (nSteps-1)*WAVEFRONT_LAG; front += block ) {
+		for( j = 0; j < nSteps; j++ ) {
+			z1 = front - j*WAVEFRONT_LAG;
+			z2 = z1 + block;
+			if( z2 <= 0 || z1 >= SIZE_Z ) continue;
+			if( z1 < 0      ) z1 = 0;
+			if( z2 > SIZE_Z ) z2 = SIZE_Z;
+
+			performStreamCollidePlanes( *grid[j & 1], *grid[(j+1) & 1],
+			                            z1, z2, channel );
+		}
+	}
+
+	if( nSteps & 1 ) LBM_swapGrids( srcGrid, dstGrid );
 }
 
 /*############################################################################*/
@@ -453,11 +1808,35 @@ void LBM_showGridStatistics( LBM_Grid grid ) {
 	double minU2  = 1e+30, maxU2  = -1e+30, u2;
 	double minRho = 1e+30, maxRho = -1e+30, rho;
 	double mass = 0;
+#if defined(LBM_GPU)
+	GRID_PRECISION* const device = gpuDeviceGrid( grid );
+#endif
 
 	SWEEP_VAR
 
+#if defined(LBM_MPI)
+	/* the mass is summed up rank by rank, in the order of one domain */
+	if( LBM_rank > 0 )
+		MPI_Recv( &mass, 1, MPI_DOUBLE, LBM_rank-1, 2, MPI_COMM_WORLD,
+		          MPI_STATUS_IGNORE );
+#endif
+#if defined(LBM_GPU)
+	/* on the device, if the grid is there */
+	if( device ) grid = device;
+#pragma omp target teams distribute parallel for \
+            if( target: device != NULL ) device( gpuDevice ) \
+            is_device_ptr( grid ) private( ux, uy, uz, u2, rho ) \
+            map( tofrom: nObstacleCells, nAccelCells, nFluidCells, \
+                         minU2, maxU2, minRho, maxRho, mass ) \
+            reduction( +: nObstacleCells, nAccelCells, nFluidCells, mass ) \
+            reduction( min: minU2, minRho ) reduction( max: maxU2, maxRho )
+#endif
+
 	SWEEP_START( 0, 0, 0, 0, 0, SIZE_Z )
-		rho = + LOCAL( grid, C  ) + LOCAL( grid, N  )
+#if defined(LBM_DYNAMIC_SIZE)
+		if( SWEEP_X >= SIZE_X ) continue;
+#endif
+		rho = + (double) LOCAL( grid, C  ) + LOCAL( grid, N  )
 		      + LOCAL( grid, S  ) + LOCAL( grid, E  )
 		      + LOCAL( grid, W  ) + LOCAL( grid, T  )
 		      + LOCAL( grid, B  ) + LOCAL( grid, NE )
@@ -480,17 +1859,17 @@ void LBM_showGridStatistics( LBM_Grid grid ) {
 			else
 				nFluidCells++;
 
-			ux = + LOCAL( grid, E  ) - LOCAL( grid, W  )
+			ux = + (double) LOCAL( grid, E  ) - LOCAL( grid, W  )
 			     + LOCAL( grid, NE ) - LOCAL( grid, NW )
 			     + LOCAL( grid, SE ) - LOCAL( grid, SW )
 			     + LOCAL( grid, ET ) + LOCAL( grid, EB )
 			     - LOCAL( grid, WT ) - LOCAL( grid, WB );
-			uy = + LOCAL( grid, N  ) - LOCAL( grid, S  )
+			uy = + (double) LOCAL( grid, N  ) - LOCAL( grid, S  )
 			     + LOCAL( grid, NE ) + LOCAL( grid, NW )
 			     - LOCAL( grid, SE ) - LOCAL( grid, SW )
 			     + LOCAL( grid, NT ) + LOCAL( grid, NB )
 			     - LOCAL( grid, ST ) - LOCAL( grid, SB );
-			uz = + LOCAL( grid, T  ) - LOCAL( grid, B  )
+			uz = + (double) LOCAL( grid, T  ) - LOCAL( grid, B  )
 			     + LOCAL( grid, NT ) - LOCAL( grid, NB )
 			     + LOCAL( grid, ST ) - LOCAL( grid, SB )
 			     + LOCAL( grid, ET ) - LOCAL( grid, EB )
@@ -501,6 +1880,29 @@ void LBM_showGridStatistics( LBM_Grid grid ) {
 		}
 	SWEEP_END
 
+#if defined(LBM_MPI)
+	if( LBM_rank < LBM_nRanks-1 )
+		MPI_Send( &mass, 1, MPI_DOUBLE, LBM_rank+1, 2, MPI_COMM_WORLD );
+	if( LBM_nRanks > 1 && LBM_rank == LBM_nRanks-1 )
+		MPI_Send( &mass, 1, MPI_DOUBLE, 0, 3, MPI_COMM_WORLD );
+	if( LBM_nRanks > 1 && LBM_rank == 0 )
+		MPI_Recv( &mass, 1, MPI_DOUBLE, LBM_nRanks-1, 3, MPI_COMM_WORLD,
+		          MPI_STATUS_IGNORE );
+	{
+		int    nCells[3] = { nObstacleCells, nAccelCells, nFluidCells };
+		double minima[2] = { minRho, minU2 },
+		       maxima[2] = { maxRho, maxU2 };
+
+		MPI_Allreduce( MPI_IN_PLACE, nCells, 3, MPI_INT,    MPI_SUM, MPI_COMM_WORLD );
+		MPI_Allreduce( MPI_IN_PLACE, minima, 2, MPI_DOUBLE, MPI_MIN, MPI_COMM_WORLD );
+		MPI_Allreduce( MPI_IN_PLACE, maxima, 2, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD );
+		nObstacleCells = nCells[0]; nAccelCells = nCells[1]; nFluidCells = nCells[2];
+		minRho = minima[0]; minU2 = minima[1];
+		maxRho = maxima[0]; maxU2 = maxima[1];
+	}
+#endif
+
+	if( IS_ROOT )
         printf( "LBM_showGridStatistics:\n"
         "\tnObstacleCells: %7i nAccelCells: %7i nFluidCells: %7i\n"
         "\tminRho: %8.4f maxRho: %8.4f mass: %e\n"
@@ -513,104 +1915,233 @@ void LBM_showGridStatistics( LBM_Grid grid ) {
 
 /*############################################################################*/
 
-static void storeValue( FILE* file, OUTPUT_PRECISION* v ) {
+/* The binary files are little endian. They are written and read a
+   z plane at a time, SIZE_X*SIZE_Y cells of three values each, which
+   a big-endian host swaps in memory, all of them in one loop. */
+
+#define PLANE_VALUES (3L*SIZE_X*SIZE_Y)
+#define PLANE_VALUE(p,x,y,c) ((p)[3*((x)+(y)*(long) SIZE_X)+(c)])
+
+static void swapValues( OUTPUT_PRECISION* v, const long n ) {
 	const int litteBigEndianTest = 1;
-	if( (*((unsigned char*) &litteBigEndianTest)) == 0 ) {         /* big endian */
-		const char* vPtr = (char*) v;
-		char buffer[sizeof( OUTPUT_PRECISION )];
-		int i;
+	unsigned char* b = (unsigned char*) v;
+	unsigned char aux;
+	long k;
+	int j;
+
+	if( (*((unsigned char*) &litteBigEndianTest)) != 0 ) return;  /* little endian */
+
+	for( k = 0; k < n*sizeof( OUTPUT_PRECISION ); k += sizeof( OUTPUT_PRECISION )) {
+		for( j = 0; j < sizeof( OUTPUT_PRECISION ) / 2; j++ ) {
+			aux = b[k + j];
+			b[k + j] = b[k + sizeof( OUTPUT_PRECISION ) - j - 1];
+			b[k + sizeof( OUTPUT_PRECISION ) - j - 1] = aux;
+		}
+	}
+}
+
+/*############################################################################*/
+
+static void storeValues( FILE* file, OUTPUT_PRECISION* v, const long n ) {
+	swapValues( v, n );
+	fwrite( v, sizeof( OUTPUT_PRECISION ), n, file );
+}
+
+/*############################################################################*/
+
+static void loadValues( FILE* file, OUTPUT_PRECISION* v, const long n ) {
+	const size_t nRead = fread( v, sizeof( OUTPUT_PRECISION ), n, file );
+
+	/* like a failing fread() of each value did, leave the rest be */
+	swapValues( v, nRead );
+}
+
+/*############################################################################*/
 
-		for (i = 0; i < sizeof( OUTPUT_PRECISION ); i++)
-			buffer[i] = vPtr[sizeof( OUTPUT_PRECISION ) - i - 1];
+static OUTPUT_PRECISION* allocatePlane( void ) {
+	OUTPUT_PRECISION* plane = malloc( PLANE_VALUES*sizeof( OUTPUT_PRECISION ));
 
-		fwrite( buffer, sizeof( OUTPUT_PRECISION ), 1, file );
+	if( ! plane ) {
+		printf( "allocatePlane: could not allocate %.1f KByte\n",
+		        PLANE_VALUES*sizeof( OUTPUT_PRECISION ) / 1024.0 );
+		exit( 1 );
 	}
-	else {                                                     /* little endian */
-		fwrite( v, sizeof( OUTPUT_PRECISION ), 1, file );
+	return plane;
+}
+
+/*############################################################################*/
+
+/* the velocities of the cells of plane z, as they are stored */
+static void velocityPlane( LBM_Grid grid, const int z, OUTPUT_PRECISION* plane ) {
+	int x, y;
+	OUTPUT_PRECISION rho, ux, uy, uz;
+
+	for( y = 0; y < SIZE_Y; y++ ) {
+		for( x = 0; x < SIZE_X; x++ ) {
+			rho = + (double) GRID_ENTRY( grid, x, y, z, C  ) + GRID_ENTRY( grid, x, y, z, N  )
+			      + GRID_ENTRY( grid, x, y, z, S  ) + GRID_ENTRY( grid, x, y, z, E  )
+			      + GRID_ENTRY( grid, x, y, z, W  ) + GRID_ENTRY( grid, x, y, z, T  )
+			      + GRID_ENTRY( grid, x, y, z, B  ) + GRID_ENTRY( grid, x, y, z, NE )
+			      + GRID_ENTRY( grid, x, y, z, NW ) + GRID_ENTRY( grid, x, y, z, SE )
+			      + GRID_ENTRY( grid, x, y, z, SW ) + GRID_ENTRY( grid, x, y, z, NT )
+			      + GRID_ENTRY( grid, x, y, z, NB ) + GRID_ENTRY( grid, x, y, z, ST )
+			      + GRID_ENTRY( grid, x, y, z, SB ) + GRID_ENTRY( grid, x, y, z, ET )
+			      + GRID_ENTRY( grid, x, y, z, EB ) + GRID_ENTRY( grid, x, y, z, WT )
+			      + GRID_ENTRY( grid, x, y, z, WB );
+			ux = + (double) GRID_ENTRY( grid, x, y, z, E  ) - GRID_ENTRY( grid, x, y, z, W  ) 
+			     + GRID_ENTRY( grid, x, y, z, NE ) - GRID_ENTRY( grid, x, y, z, NW ) 
+			     + GRID_ENTRY( grid, x, y, z, SE ) - GRID_ENTRY( grid, x, y, z, SW ) 
+			     + GRID_ENTRY( grid, x, y, z, ET ) + GRID_ENTRY( grid, x, y, z, EB ) 
+			     - GRID_ENTRY( grid, x, y, z, WT ) - GRID_ENTRY( grid, x, y, z, WB );
+			uy = + (double) GRID_ENTRY( grid, x, y, z, N  ) - GRID_ENTRY( grid, x, y, z, S  ) 
+			     + GRID_ENTRY( grid, x, y, z, NE ) + GRID_ENTRY( grid, x, y, z, NW ) 
+			     - GRID_ENTRY( grid, x, y, z, SE ) - GRID_ENTRY( grid, x, y, z, SW ) 
+			     + GRID_ENTRY( grid, x, y, z, NT ) + GRID_ENTRY( grid, x, y, z, NB ) 
+			     - GRID_ENTRY( grid, x, y, z, ST ) - GRID_ENTRY( grid, x, y, z, SB );
+			uz = + (double) GRID_ENTRY( grid, x, y, z, T  ) - GRID_ENTRY( grid, x, y, z, B  ) 
+			     + GRID_ENTRY( grid, x, y, z, NT ) - GRID_ENTRY( grid, x, y, z, NB ) 
+			     + GRID_ENTRY( grid, x, y, z, ST ) - GRID_ENTRY( grid, x, y, z, SB ) 
+			     + GRID_ENTRY( grid, x, y, z, ET ) - GRID_ENTRY( grid, x, y, z, EB ) 
+			     + GRID_ENTRY( grid, x, y, z, WT ) - GRID_ENTRY( grid, x, y, z, WB );
+			ux /= rho;
+			uy /= rho;
+			uz /= rho;
+
+			PLANE_VALUE( plane, x, y, 0 ) = ux;
+			PLANE_VALUE( plane, x, y, 1 ) = uy;
+			PLANE_VALUE( plane, x, y, 2 ) = uz;
+		}
 	}
 }
 
 /*############################################################################*/
 
-static void loadValue( FILE* file, OUTPUT_PRECISION* v ) {
-	const int litteBigEndianTest = 1;
-	if( (*((unsigned char*) &litteBigEndianTest)) == 0 ) {         /* big endian */
-		char* vPtr = (char*) v;
-		char buffer[sizeof( OUTPUT_PRECISION )];
-		int i;
+static void storePlanes( LBM_Grid grid, FILE* file, const int binary ) {
+	int x, y, z;
+	OUTPUT_PRECISION* plane = allocatePlane();
 
-		fread( buffer, sizeof( OUTPUT_PRECISION ), 1, file );
+	for( z = 0; z < SIZE_Z; z++ ) {
+		velocityPlane( grid, z, plane );
 
-		for (i = 0; i < sizeof( OUTPUT_PRECISION ); i++)
-			vPtr[i] = buffer[sizeof( OUTPUT_PRECISION ) - i - 1];
-	}
-	else {                                                     /* little endian */
-		fread( v, sizeof( OUTPUT_PRECISION ), 1, file );
+		if( binary )
+			storeValues( file, plane, PLANE_VALUES );
+		else {
+			for( y = 0; y < SIZE_Y; y++ )
+				for( x = 0; x < SIZE_X; x++ )
+					fprintf( file, "%e %e %e\n", PLANE_VALUE( plane, x, y, 0 ),
+					                             PLANE_VALUE( plane, x, y, 1 ),
+					                             PLANE_VALUE( plane, x, y, 2 ));
+		}
 	}
+	free( plane );
 }
 
 /*############################################################################*/
 
 void LBM_storeVelocityField( LBM_Grid grid, const char* filename,
                              const int binary ) {
-	int x, y, z;
-	OUTPUT_PRECISION rho, ux, uy, uz;
-
+#if defined(LBM_MPI)
+	int r;
+
+	/* the ranks append their planes in turn */
+	for( r = 0; r < LBM_nRanks; r++ ) {
+		if( r == LBM_rank ) {
+			FILE* file = fopen( filename, (r == 0) ? (binary ? "wb" : "w")
+			                                       : (binary ? "ab" : "a") );
+			storePlanes( grid, file, binary );
+			fclose( file );
+		}
+		MPI_Barrier( MPI_COMM_WORLD );
+	}
+#else
 	FILE* file = fopen( filename, (binary ? "wb" : "w") );
 
-	for( z = 0; z < SIZE_Z; z++ ) {
-		for( y = 0; y < SIZE_Y; y++ ) {
-			for( x = 0; x < SIZE_X; x++ ) {
-				rho = + GRID_ENTRY( grid, x, y, z, C  ) + GRID_ENTRY( grid, x, y, z, N  )
-				      + GRID_ENTRY( grid, x, y, z, S  ) + GRID_ENTRY( grid, x, y, z, E  )
-				      + GRID_ENTRY( grid, x, y, z, W  ) + GRID_ENTRY( grid, x, y, z, T  )
-				      + GRID_ENTRY( grid, x, y, z, B  ) + GRID_ENTRY( grid, x, y, z, NE )
-				      + GRID_ENTRY( grid, x, y, z, NW ) + GRID_ENTRY( grid, x, y, z, SE )
-				      + GRID_ENTRY( grid, x, y, z, SW ) + GRID_ENTRY( grid, x, y, z, NT )
-				      + GRID_ENTRY( grid, x, y, z, NB ) + GRID_ENTRY( grid, x, y, z, ST )
-				      + GRID_ENTRY( grid, x, y, z, SB ) + GRID_ENTRY( grid, x, y, z, ET )
-				      + GRID_ENTRY( grid, x, y, z, EB ) + GRID_ENTRY( grid, x, y, z, WT )
-				      + GRID_ENTRY( grid, x, y, z, WB );
-				ux = + GRID_ENTRY( grid, x, y, z, E  ) - GRID_ENTRY( grid, x, y, z, W  ) 
-				     + GRID_ENTRY( grid, x, y, z, NE ) - GRID_ENTRY( grid, x, y, z, NW ) 
-				     + GRID_ENTRY( grid, x, y, z, SE ) - GRID_ENTRY( grid, x, y, z, SW ) 
-				     + GRID_ENTRY( grid, x, y, z, ET ) + GRID_ENTRY( grid, x, y, z, EB ) 
-				     - GRID_ENTRY( grid, x, y, z, WT ) - GRID_ENTRY( grid, x, y, z, WB );
-				uy = + GRID_ENTRY( grid, x, y, z, N  ) - GRID_ENTRY( grid, x, y, z, S  ) 
-				     + GRID_ENTRY( grid, x, y, z, NE ) + GRID_ENTRY( grid, x, y, z, NW ) 
-				     - GRID_ENTRY( grid, x, y, z, SE ) - GRID_ENTRY( grid, x, y, z, SW ) 
-				     + GRID_ENTRY( grid, x, y, z, NT ) + GRID_ENTRY( grid, x, y, z, NB ) 
-				     - GRID_ENTRY( grid, x, y, z, ST ) - GRID_ENTRY( grid, x, y, z, SB );
-				uz = + GRID_ENTRY( grid, x, y, z, T  ) - GRID_ENTRY( grid, x, y, z, B  ) 
-				     + GRID_ENTRY( grid, x, y, z, NT ) - GRID_ENTRY( grid, x, y, z, NB ) 
-				     + GRID_ENTRY( grid, x, y, z, ST ) - GRID_ENTRY( grid, x, y, z, SB ) 
-				     + GRID_ENTRY( grid, x, y, z, ET ) - GRID_ENTRY( grid, x, y, z, EB ) 
-				     + GRID_ENTRY( grid, x, y, z, WT ) - GRID_ENTRY( grid, x, y, z, WB );
-				ux /= rho;
-				uy /= rho;
-				uz /= rho;
+	storePlanes( grid, file, binary );
+	fclose( file );
+#endif
+}
 
-				if( binary ) {
-					/*
-					fwrite( &ux, sizeof( ux ), 1, file );
-					fwrite( &uy, sizeof( uy ), 1, file );
-					fwrite( &uz, sizeof( uz ), 1, file );
-					*/
-					storeValue( file, &ux );
-					storeValue( file, &uy );
-					storeValue( file, &uz );
-				} else
-					fprintf( file, "%e %e %e\n", ux, uy, uz );
+/*############################################################################*/
 
-			}
+#if defined(LBM_CHECKPOINT)
+
+/* Built with -DLBM_CHECKPOINT (make checkpoint), the run can store
+   snapshots of the velocity field while it goes on. The time loop
+   only computes the field into a staging buffer, already in file
+   byte order, and a thread of its own writes it out meanwhile; if
+   that write is not done by the next snapshot, that one waits. The
+   files are those of LBM_storeVelocityField( ..., TRUE ). */
+
+static OUTPUT_PRECISION* stageBuffer = NULL;
+static char      stageFilename[1024];
+static pthread_t stageThread;
+static BOOL      stageBusy = FALSE;
+
+static void* writeStage( void* arg ) {
+	FILE* file = fopen( stageFilename, "wb" );
+
+	(void) arg;
+	if( ! file ) {
+		printf( "LBM_storeVelocityFieldAsync: could not open '%s'\n",
+		        stageFilename );
+		return NULL;
+	}
+	fwrite( stageBuffer, sizeof( OUTPUT_PRECISION ), SIZE_Z*PLANE_VALUES, file );
+	fclose( file );
+	return NULL;
+}
+
+/*############################################################################*/
+
+void LBM_storeVelocityFieldAsync( LBM_Grid grid, const char* filename ) {
+	int z;
+
+	LBM_waitVelocityField();
+	if( ! stageBuffer ) {
+		stageBuffer = malloc( SIZE_Z*PLANE_VALUES*sizeof( OUTPUT_PRECISION ));
+		if( ! stageBuffer ) {
+			printf( "LBM_storeVelocityFieldAsync: could not allocate %.1f MByte\n",
+			        SIZE_Z*PLANE_VALUES*sizeof( OUTPUT_PRECISION ) / (1024.0*1024.0) );
+			exit( 1 );
 		}
 	}
 
-	fclose( file );
+#if !defined(SPEC_CPU) || defined(LBM_OMP)
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+#endif
+	for( z = 0; z < SIZE_Z; z++ ) {
+		velocityPlane( grid, z, stageBuffer + z*PLANE_VALUES );
+		swapValues( stageBuffer + z*PLANE_VALUES, PLANE_VALUES );
+	}
+
+	snprintf( stageFilename, sizeof( stageFilename ), "%s", filename );
+	if( pthread_create( &stageThread, NULL, writeStage, NULL ) == 0 )
+		stageBusy = TRUE;
+	else
+		writeStage( NULL );
+}
+
+/*############################################################################*/
+
+void LBM_waitVelocityField( void ) {
+	if( stageBusy ) pthread_join( stageThread, NULL );
+	stageBusy = FALSE;
 }
 
 /*############################################################################*/
 
+void LBM_freeVelocityFieldStage( void ) {
+	LBM_waitVelocityField();
+	free( stageBuffer );
+	stageBuffer = NULL;
+}
+
+#endif /* LBM_CHECKPOINT */
+
+/*############################################################################*/
+
 void LBM_compareVelocityField( LBM_Grid grid, const char* filename,
                              const int binary ) {
 	int x, y, z;
@@ -618,13 +2149,30 @@ void LBM_compareVelocityField( LBM_Grid grid, const char* filename,
 	OUTPUT_PRECISION fileUx, fileUy, fileUz,
 	                 dUx, dUy, dUz,
 	                 diff2, maxDiff2 = -1e+30;
+#if defined(LBM_FLOAT)
+	double sumDiff2 = 0;
+#endif
+#if defined(LBM_MPI)
+	long skip;
+#endif
+
+	OUTPUT_PRECISION* plane = binary ? allocatePlane() : NULL;
 
 	FILE* file = fopen( filename, (binary ? "rb" : "r") );
 
+#if defined(LBM_MPI)
+	/* each rank compares its own planes */
+	if( binary )
+		fseek( file, (long) OFFSET_Z*PLANE_VALUES*sizeof( OUTPUT_PRECISION ), SEEK_SET );
+	else
+		for( skip = 0; skip < (long) OFFSET_Z*SIZE_Y*SIZE_X; skip++ )
+			fscanf( file, "%*f %*f %*f\n" );
+#endif
 	for( z = 0; z < SIZE_Z; z++ ) {
+		if( binary ) loadValues( file, plane, PLANE_VALUES );
 		for( y = 0; y < SIZE_Y; y++ ) {
 			for( x = 0; x < SIZE_X; x++ ) {
-				rho = + GRID_ENTRY( grid, x, y, z, C  ) + GRID_ENTRY( grid, x, y, z, N  )
+				rho = + (double) GRID_ENTRY( grid, x, y, z, C  ) + GRID_ENTRY( grid, x, y, z, N  )
 				      + GRID_ENTRY( grid, x, y, z, S  ) + GRID_ENTRY( grid, x, y, z, E  )
 				      + GRID_ENTRY( grid, x, y, z, W  ) + GRID_ENTRY( grid, x, y, z, T  )
 				      + GRID_ENTRY( grid, x, y, z, B  ) + GRID_ENTRY( grid, x, y, z, NE )
@@ -634,17 +2182,17 @@ void LBM_compareVelocityField( LBM_Grid grid, const char* filename,
 				      + GRID_ENTRY( grid, x, y, z, SB ) + GRID_ENTRY( grid, x, y, z, ET )
 				      + GRID_ENTRY( grid, x, y, z, EB ) + GRID_ENTRY( grid, x, y, z, WT )
 				      + GRID_ENTRY( grid, x, y, z, WB );
-				ux = + GRID_ENTRY( grid, x, y, z, E  ) - GRID_ENTRY( grid, x, y, z, W  ) 
+				ux = + (double) GRID_ENTRY( grid, x, y, z, E  ) - GRID_ENTRY( grid, x, y, z, W  ) 
 				     + GRID_ENTRY( grid, x, y, z, NE ) - GRID_ENTRY( grid, x, y, z, NW ) 
 				     + GRID_ENTRY( grid, x, y, z, SE ) - GRID_ENTRY( grid, x, y, z, SW ) 
 				     + GRID_ENTRY( grid, x, y, z, ET ) + GRID_ENTRY( grid, x, y, z, EB ) 
 				     - GRID_ENTRY( grid, x, y, z, WT ) - GRID_ENTRY( grid, x, y, z, WB );
-				uy = + GRID_ENTRY( grid, x, y, z, N  ) - GRID_ENTRY( grid, x, y, z, S  ) 
+				uy = + (double) GRID_ENTRY( grid, x, y, z, N  ) - GRID_ENTRY( grid, x, y, z, S  ) 
 				     + GRID_ENTRY( grid, x, y, z, NE ) + GRID_ENTRY( grid, x, y, z, NW ) 
 				     - GRID_ENTRY( grid, x, y, z, SE ) - GRID_ENTRY( grid, x, y, z, SW ) 
 				     + GRID_ENTRY( grid, x, y, z, NT ) + GRID_ENTRY( grid, x, y, z, NB ) 
 				     - GRID_ENTRY( grid, x, y, z, ST ) - GRID_ENTRY( grid, x, y, z, SB );
-				uz = + GRID_ENTRY( grid, x, y, z, T  ) - GRID_ENTRY( grid, x, y, z, B  ) 
+				uz = + (double) GRID_ENTRY( grid, x, y, z, T  ) - GRID_ENTRY( grid, x, y, z, B  ) 
 				     + GRID_ENTRY( grid, x, y, z, NT ) - GRID_ENTRY( grid, x, y, z, NB ) 
 				     + GRID_ENTRY( grid, x, y, z, ST ) - GRID_ENTRY( grid, x, y, z, SB ) 
 				     + GRID_ENTRY( grid, x, y, z, ET ) - GRID_ENTRY( grid, x, y, z, EB ) 
@@ -654,9 +2202,9 @@ void LBM_compareVelocityField( LBM_Grid grid, const char* filename,
 				uz /= rho;
 
 				if( binary ) {
-					loadValue( file, &fileUx );
-					loadValue( file, &fileUy );
-					loadValue( file, &fileUz );
+					fileUx = PLANE_VALUE( plane, x, y, 0 );
+					fileUy = PLANE_VALUE( plane, x, y, 1 );
+					fileUz = PLANE_VALUE( plane, x, y, 2 );
 				}
 				else {
 					if( sizeof( OUTPUT_PRECISION ) == sizeof( double )) {
@@ -672,10 +2220,36 @@ void LBM_compareVelocityField( LBM_Grid grid, const char* filename,
 				dUz = uz - fileUz;
 				diff2 = dUx*dUx + dUy*dUy + dUz*dUz;
 				if( diff2 > maxDiff2 ) maxDiff2 = diff2;
+#if defined(LBM_FLOAT)
+				sumDiff2 += diff2;
+#endif
 			}
 		}
 	}
 
+#if defined(LBM_MPI)
+	{
+		double d2 = maxDiff2;
+
+		MPI_Allreduce( MPI_IN_PLACE, &d2, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD );
+		maxDiff2 = d2;
+#if defined(LBM_FLOAT)
+		MPI_Allreduce( MPI_IN_PLACE, &sumDiff2, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD );
+#endif
+	}
+	if( ! IS_ROOT ) {
+		fclose( file );
+		free( plane );
+		return;
+	}
+#endif
+
+#if defined(LBM_FLOAT)
+	/* the result file comes from a double precision run */
+	printf( "LBM_compareVelocityField: float grid, rmsDiff = %e\n",
+	        sqrt( sumDiff2 / ((double) SIZE_X*SIZE_Y*GLOBAL_SIZE_Z) ));
+#endif
+
 #if defined(SPEC_CPU)
 	printf( "LBM_compareVelocityField: maxDiff = %e  \n\n",
 	        sqrt( maxDiff2 )  );
@@ -685,5 +2259,6 @@ void LBM_compareVelocityField( LBM_Grid grid, const char* filename,
 	        sqrt( maxDiff2 ) > 1e-5 ? "##### ERROR #####" : "OK" );
 #endif
 	fclose( file );
+	free( plane );
 }
 
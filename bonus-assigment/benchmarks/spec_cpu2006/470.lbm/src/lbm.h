@@ -27,20 +27,54 @@ typedef enum {OBSTACLE    = 1 << 0,
 
 /*############################################################################*/
 
-void LBM_allocateGrid( double** ptr );
-void LBM_freeGrid( double** ptr );
+#if defined(LBM_DYNAMIC_SIZE)
+void LBM_setSize( const int sizeX, const int sizeY, const int sizeZ );
+BOOL LBM_readObstacleFileSize( const char* filename,
+                               int* sizeX, int* sizeY, int* sizeZ );
+#endif
+#if defined(LBM_MPI)
+void LBM_initializeMPI( int* nArgs, char*** arg );
+void LBM_finalizeMPI( void );
+BOOL LBM_splitDomain( const int sizeX, const int sizeY, const int sizeZ );
+#endif
+void LBM_allocateGrid( GRID_PRECISION** ptr );
+void LBM_freeGrid( GRID_PRECISION** ptr );
 void LBM_initializeGrid( LBM_Grid grid );
 void LBM_initializeSpecialCellsForLDC( LBM_Grid grid );
 void LBM_loadObstacleFile( LBM_Grid grid, const char* filename );
 void LBM_initializeSpecialCellsForChannel( LBM_Grid grid );
+#if defined(LBM_SPARSE)
+void LBM_buildCellList( LBM_Grid grid );
+void LBM_freeCellList( void );
+#endif
+#if defined(LBM_GPU)
+void LBM_gpuAttachGrid( LBM_Grid grid );
+void LBM_gpuUpdateHost( LBM_Grid grid );
+void LBM_gpuDetachGrid( LBM_Grid grid );
+#endif
 void LBM_swapGrids( LBM_GridPtr* grid1, LBM_GridPtr* grid2 );
-void LBM_performStreamCollide( LBM_Grid srcGrid, LBM_Grid dstGrid );
+void LBM_performStreamCollide( LBM_Grid srcGrid, LBM_Grid dstGrid,
+                               const BOOL channel );
 void LBM_handleInOutFlow( LBM_Grid srcGrid );
+void LBM_handleInFlow( LBM_Grid srcGrid );
+void LBM_handleOutFlow( LBM_Grid srcGrid );
+void LBM_performWavefront( LBM_GridPtr* srcGrid, LBM_GridPtr* dstGrid,
+                           const int nSteps, const int block,
+                           const BOOL channel );
+#if defined(LBM_AA)
+void LBM_performStreamCollideInPlace( LBM_Grid grid );
+void LBM_finishInPlace( LBM_Grid grid );
+#endif
 void LBM_showGridStatistics( LBM_Grid Grid );
 void LBM_storeVelocityField( LBM_Grid grid, const char* filename,
                            const BOOL binary );
 void LBM_compareVelocityField( LBM_Grid grid, const char* filename,
                              const BOOL binary );
+#if defined(LBM_CHECKPOINT)
+void LBM_storeVelocityFieldAsync( LBM_Grid grid, const char* filename );
+void LBM_waitVelocityField( void );
+void LBM_freeVelocityFieldStage( void );
+#endif
 
 /*############################################################################*/
 
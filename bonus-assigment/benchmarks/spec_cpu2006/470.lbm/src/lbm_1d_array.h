@@ -5,15 +5,40 @@
 
 /*############################################################################*/
 
-typedef double LBM_Grid[SIZE_Z*SIZE_Y*SIZE_X*N_CELL_ENTRIES];
+/* The default layout stores the N_CELL_ENTRIES values of a cell side
+   by side (array of structures). With LBM_SOA each entry gets an array
+   of its own instead (structure of arrays), so that a sweep reads and
+   writes 20 unit-stride streams that the compiler can vectorize along
+   x. Each of these arrays carries the two ghost layers below and above
+   the domain that the margin provides in the default layout. */
+
+/* Rows are PITCH_X cells apart. That is SIZE_X, unless the size is
+   set at run time (LBM_DYNAMIC_SIZE, see config.h) and LBM_setSize()
+   pads the rows; LBM_initializeGrid marks the cells past SIZE_X as
+   obstacles then. Such a grid has no size known to the compiler, and
+   its indices can exceed an int. */
+
+#if defined(LBM_DYNAMIC_SIZE)
+typedef GRID_PRECISION LBM_Grid[];  /* GRID_SIZE values less the margins */
+#define SWEEP_VAR long i;
+#else
+#define SWEEP_VAR int i;
+#endif
+
+#ifndef LBM_SOA
+
+#if !defined(LBM_DYNAMIC_SIZE)
+typedef GRID_PRECISION LBM_Grid[SIZE_Z*SIZE_Y*SIZE_X*N_CELL_ENTRIES];
+#endif
 typedef LBM_Grid* LBM_GridPtr;
 
+#define GRID_MARGIN (2*PITCH_X*SIZE_Y*N_CELL_ENTRIES)
+#define GRID_SIZE   (SIZE_Z*SIZE_Y*PITCH_X*N_CELL_ENTRIES + 2*GRID_MARGIN)
+
 /*############################################################################*/
 
 #define CALC_INDEX(x,y,z,e) ((e)+N_CELL_ENTRIES*((x)+ \
-                             (y)*SIZE_X+(z)*SIZE_X*SIZE_Y))
-
-#define SWEEP_VAR int i;
+                             (y)*PITCH_X+(z)*PITCH_X*SIZE_Y))
 
 #define SWEEP_START(x1,y1,z1,x2,y2,z2) \
 	for( i = CALC_INDEX(x1, y1, z1, 0); \
@@ -22,9 +47,39 @@ typedef LBM_Grid* LBM_GridPtr;
 
 #define SWEEP_END }
 
-#define SWEEP_X  ((i / N_CELL_ENTRIES) % SIZE_X)
-#define SWEEP_Y (((i / N_CELL_ENTRIES) / SIZE_X) % SIZE_Y)
-#define SWEEP_Z  ((i / N_CELL_ENTRIES) / (SIZE_X*SIZE_Y))
+#define SWEEP_X  ((i / N_CELL_ENTRIES) % PITCH_X)
+#define SWEEP_Y (((i / N_CELL_ENTRIES) / PITCH_X) % SIZE_Y)
+#define SWEEP_Z  ((i / N_CELL_ENTRIES) / (PITCH_X*SIZE_Y))
+
+#else /* LBM_SOA */
+
+#define SOA_STRIDE (PITCH_X*SIZE_Y*(SIZE_Z+4))
+
+#if !defined(LBM_DYNAMIC_SIZE)
+typedef GRID_PRECISION LBM_Grid[N_CELL_ENTRIES*SOA_STRIDE];
+#endif
+typedef LBM_Grid* LBM_GridPtr;
+
+#define GRID_MARGIN (2*PITCH_X*SIZE_Y)
+#define GRID_SIZE   (N_CELL_ENTRIES*SOA_STRIDE)
+
+/*############################################################################*/
+
+#define CALC_INDEX(x,y,z,e) ((e)*SOA_STRIDE+(x)+ \
+                             (y)*PITCH_X+(z)*PITCH_X*SIZE_Y)
+
+#define SWEEP_START(x1,y1,z1,x2,y2,z2) \
+	for( i = CALC_INDEX(x1, y1, z1, 0); \
+	     i < CALC_INDEX(x2, y2, z2, 0); \
+			 i++ ) {
+
+#define SWEEP_END }
+
+#define SWEEP_X  (i % PITCH_X)
+#define SWEEP_Y ((i / PITCH_X) % SIZE_Y)
+#define SWEEP_Z  (i / (PITCH_X*SIZE_Y))
+
+#endif /* LBM_SOA */
 
 #define GRID_ENTRY(g,x,y,z,e)          ((g)[CALC_INDEX( x,  y,  z, e)])
 #define GRID_ENTRY_SWEEP(g,dx,dy,dz,e) ((g)[CALC_INDEX(dx, dy, dz, e)+(i)])
@@ -15,10 +15,18 @@
 #endif
 
 #include <sys/stat.h>
+#include <string.h>
+
+#if defined(LBM_OMP)
+#include <omp.h>
+#endif
 
 /*############################################################################*/
 
-static LBM_GridPtr srcGrid, dstGrid;
+static LBM_GridPtr srcGrid;
+#if !defined(LBM_AA)
+static LBM_GridPtr dstGrid;
+#endif
 
 /*############################################################################*/
 
@@ -27,33 +35,91 @@ int main( int nArgs, char* arg[] ) {
 #if !defined(SPEC_CPU)
 	MAIN_Time time;
 #endif
-	int t;
+#if defined(LBM_OMP)
+	double wallStart;
+#endif
+	int t, nSteps;
 
+#if defined(LBM_MPI)
+	LBM_initializeMPI( &nArgs, &arg );
+#endif
 	MAIN_parseCommandLine( nArgs, arg, &param );
-	MAIN_printInfo( &param );
+	if( IS_ROOT ) MAIN_printInfo( &param );
 	MAIN_initialize( &param );
+	ROI_BEGIN();
 #if !defined(SPEC_CPU)
 	MAIN_startClock( &time );
 #endif
+#if defined(LBM_OMP)
+	wallStart = omp_get_wtime();
+#endif
 
-	for( t = 1; t <= param.nTimeSteps; t++ ) {
+	for( t = 1; t <= param.nTimeSteps; t += nSteps ) {
+		/* a wavefront stops at every statistics timestep */
+		nSteps = param.nWavefront;
+		if( nSteps > 64 - ((t-1) & 63) ) nSteps = 64 - ((t-1) & 63);
+		if( nSteps > param.nTimeSteps-t+1 ) nSteps = param.nTimeSteps-t+1;
+		if( param.nCheckpoint > 0 &&
+		    nSteps > param.nCheckpoint - (t-1) % param.nCheckpoint )
+			nSteps = param.nCheckpoint - (t-1) % param.nCheckpoint;
+
+#if defined(LBM_AA)
+		/* one grid, updated in place; no wavefronts */
 		if( param.simType == CHANNEL ) {
 			LBM_handleInOutFlow( *srcGrid );
 		}
 
-		LBM_performStreamCollide( *srcGrid, *dstGrid );
-		LBM_swapGrids( &srcGrid, &dstGrid );
+		LBM_performStreamCollideInPlace( *srcGrid );
+#else
+		if( nSteps > 1 ) {
+			LBM_performWavefront( &srcGrid, &dstGrid, nSteps, param.nThreads,
+			                      param.simType == CHANNEL );
+		}
+		else {
+			LBM_performStreamCollide( *srcGrid, *dstGrid,
+			                          param.simType == CHANNEL );
+			LBM_swapGrids( &srcGrid, &dstGrid );
+		}
+#endif
 
-		if( (t & 63) == 0 ) {
-			printf( "timestep: %i\n", t );
+		if( ((t+nSteps-1) & 63) == 0 ) {
+			if( IS_ROOT ) printf( "timestep: %i\n", t+nSteps-1 );
+#if defined(LBM_AA)
+			LBM_finishInPlace( *srcGrid );
+#endif
 			LBM_showGridStatistics( *srcGrid );
 		}
+#if defined(LBM_CHECKPOINT)
+		if( param.nCheckpoint > 0 && (t+nSteps-1) % param.nCheckpoint == 0 ) {
+			char filename[1024];
+
+#if defined(LBM_AA)
+			LBM_finishInPlace( *srcGrid );
+#endif
+			snprintf( filename, sizeof( filename ), "%s.%i",
+			          param.checkpointFilename, t+nSteps-1 );
+#if defined(LBM_GPU)
+			LBM_gpuUpdateHost( *srcGrid );
+#endif
+			LBM_storeVelocityFieldAsync( *srcGrid, filename );
+		}
+#endif
 	}
 
+	ROI_END();
 #if !defined(SPEC_CPU)
 	MAIN_stopClock( &time, &param );
+#endif
+#if defined(LBM_OMP)
+	printf( "MAIN_wallClock: %i threads, %.2f s, MLUPS: %.2f\n\n",
+	        param.nThreads, omp_get_wtime() - wallStart,
+	        1.0e-6 * SIZE_X * SIZE_Y * SIZE_Z * param.nTimeSteps /
+	        (omp_get_wtime() - wallStart) );
 #endif
 	MAIN_finalize( &param );
+#if defined(LBM_MPI)
+	LBM_finalizeMPI();
+#endif
 
 	return 0;
 }
@@ -62,12 +128,96 @@ int main( int nArgs, char* arg[] ) {
 
 void MAIN_parseCommandLine( int nArgs, char* arg[], MAIN_Param* param ) {
 	struct stat fileStat;
-	
+	int a, n;
+#if defined(LBM_DYNAMIC_SIZE)
+	int sizeX = 0, sizeY = 0, sizeZ = 0;
+#define SIZE_SYNTAX "[--size <x> <y> <z>] "
+#else
+#define SIZE_SYNTAX ""
+#endif
+#if defined(LBM_CHECKPOINT)
+#define CHECKPOINT_SYNTAX "[--checkpoint <steps> <file>] "
+#else
+#define CHECKPOINT_SYNTAX ""
+#endif
+#if defined(LBM_AA) || defined(LBM_MPI) || defined(LBM_GPU)
+#define WAVEFRONT_SYNTAX ""
+#else
+#define WAVEFRONT_SYNTAX "[--wavefront <steps>] "
+#endif
+
+	/* options may come anywhere; they are taken out of arg[] here */
+	param->nThreads = 1;
+	param->nWavefront = 1;
+	param->nCheckpoint = 0;
+	param->checkpointFilename = NULL;
+	for( a = n = 1; a < nArgs; a++ ) {
+		if( strcmp( arg[a], "--threads" ) == 0 && a+1 < nArgs ) {
+			param->nThreads = atoi( arg[++a] );
+			if( param->nThreads < 1 ) param->nThreads = 1;
+		}
+#if !defined(LBM_AA) && !defined(LBM_MPI) && !defined(LBM_GPU)
+		else if( strcmp( arg[a], "--wavefront" ) == 0 && a+1 < nArgs ) {
+			param->nWavefront = atoi( arg[++a] );
+			if( param->nWavefront < 1 ) param->nWavefront = 1;
+		}
+#endif
+#if defined(LBM_CHECKPOINT)
+		else if( strcmp( arg[a], "--checkpoint" ) == 0 && a+2 < nArgs ) {
+			param->nCheckpoint = atoi( arg[++a] );
+			param->checkpointFilename = arg[++a];
+			if( param->nCheckpoint < 0 ) param->nCheckpoint = 0;
+		}
+#endif
+#if defined(LBM_DYNAMIC_SIZE)
+		else if( strcmp( arg[a], "--size" ) == 0 && a+3 < nArgs ) {
+			sizeX = atoi( arg[++a] );
+			sizeY = atoi( arg[++a] );
+			sizeZ = atoi( arg[++a] );
+		}
+#endif
+		else arg[n++] = arg[a];
+	}
+	nArgs = n;
+
 	if( nArgs < 5 || nArgs > 6 ) {
-		printf( "syntax: lbm <time steps> <result file> <0: nil, 1: cmp, 2: str> <0: ldc, 1: channel flow> [<obstacle file>]\n" );
+		printf( "syntax: lbm [--threads <n>] " WAVEFRONT_SYNTAX CHECKPOINT_SYNTAX SIZE_SYNTAX "<time steps> <result file> <0: nil, 1: cmp, 2: str> <0: ldc, 1: channel flow> [<obstacle file>]\n" );
 		exit( 1 );
 	}
 
+#if defined(LBM_DYNAMIC_SIZE)
+	/* without --size, the obstacle file tells the size */
+	if( sizeX == 0 && nArgs == 6 &&
+	    ! LBM_readObstacleFileSize( arg[5], &sizeX, &sizeY, &sizeZ )) {
+		printf( "MAIN_parseCommandLine: cannot tell the size of obstacle file '%s'\n",
+		        arg[5] );
+		exit( 1 );
+	}
+	if( sizeX == 0 ) {
+		sizeX = DEFAULT_SIZE_X;
+		sizeY = DEFAULT_SIZE_Y;
+		sizeZ = DEFAULT_SIZE_Z;
+	}
+	if( sizeX < 3 || sizeY < 3 || sizeZ < 3 ) {
+		printf( "MAIN_parseCommandLine: bad grid size %i x %i x %i\n",
+		        sizeX, sizeY, sizeZ );
+		exit( 1 );
+	}
+#if defined(LBM_MPI)
+	if( ! LBM_splitDomain( sizeX, sizeY, sizeZ )) {
+		if( IS_ROOT )
+			printf( "MAIN_parseCommandLine: %i planes are too few for %i ranks\n",
+			        sizeZ, LBM_nRanks );
+		exit( 1 );
+	}
+#else
+	LBM_setSize( sizeX, sizeY, sizeZ );
+#endif
+#endif
+#if defined(LBM_OMP)
+	omp_set_num_threads( param->nThreads );
+#endif
+
 	param->nTimeSteps     = atoi( arg[1] );
 	param->resultFilename = arg[2];
 	param->action         = (MAIN_Action) atoi( arg[3] );
@@ -81,12 +231,12 @@ void MAIN_parseCommandLine( int nArgs, char* arg[], MAIN_Param* param ) {
 			         param->obstacleFilename );
 			exit( 1 );
 		}
-		if( fileStat.st_size != SIZE_X*SIZE_Y*SIZE_Z+(SIZE_Y+1)*SIZE_Z ) {
+		if( fileStat.st_size != (long) SIZE_X*SIZE_Y*GLOBAL_SIZE_Z+(SIZE_Y+1)*GLOBAL_SIZE_Z ) {
 			printf( "MAIN_parseCommandLine:\n"
-			        "\tsize of file '%s' is %i bytes\n"
-					    "\texpected size is %i bytes\n",
-			        param->obstacleFilename, (int) fileStat.st_size,
-			        SIZE_X*SIZE_Y*SIZE_Z+(SIZE_Y+1)*SIZE_Z );
+			        "\tsize of file '%s' is %li bytes\n"
+					    "\texpected size is %li bytes\n",
+			        param->obstacleFilename, (long) fileStat.st_size,
+			        (long) SIZE_X*SIZE_Y*GLOBAL_SIZE_Z+(SIZE_Y+1)*GLOBAL_SIZE_Z );
 			exit( 1 );
 		}
 	}
@@ -112,7 +262,7 @@ void MAIN_printInfo( const MAIN_Param* param ) {
 	        "\taction         : %s\n"
 	        "\tsimulation type: %s\n"
 	        "\tobstacle file  : %s\n\n",
-	        SIZE_X, SIZE_Y, SIZE_Z, 1e-6*SIZE_X*SIZE_Y*SIZE_Z,
+	        SIZE_X, SIZE_Y, GLOBAL_SIZE_Z, 1e-6*SIZE_X*SIZE_Y*GLOBAL_SIZE_Z,
 	        param->nTimeSteps, param->resultFilename, 
 	        actionString[param->action], simTypeString[param->simType],
 	        (param->obstacleFilename == NULL) ? "<none>" :
@@ -122,32 +272,62 @@ void MAIN_printInfo( const MAIN_Param* param ) {
 /*############################################################################*/
 
 void MAIN_initialize( const MAIN_Param* param ) {
-	LBM_allocateGrid( (double**) &srcGrid );
-	LBM_allocateGrid( (double**) &dstGrid );
+	LBM_allocateGrid( (GRID_PRECISION**) &srcGrid );
+#if !defined(LBM_AA)
+	LBM_allocateGrid( (GRID_PRECISION**) &dstGrid );
+#endif
 
 	LBM_initializeGrid( *srcGrid );
+#if !defined(LBM_AA)
 	LBM_initializeGrid( *dstGrid );
+#endif
 
 	if( param->obstacleFilename != NULL ) {
 		LBM_loadObstacleFile( *srcGrid, param->obstacleFilename );
+#if !defined(LBM_AA)
 		LBM_loadObstacleFile( *dstGrid, param->obstacleFilename );
+#endif
 	}
 
 	if( param->simType == CHANNEL ) {
 		LBM_initializeSpecialCellsForChannel( *srcGrid );
+#if !defined(LBM_AA)
 		LBM_initializeSpecialCellsForChannel( *dstGrid );
+#endif
 	}
 	else {
 		LBM_initializeSpecialCellsForLDC( *srcGrid );
+#if !defined(LBM_AA)
 		LBM_initializeSpecialCellsForLDC( *dstGrid );
+#endif
 	}
 
+#if defined(LBM_SPARSE)
+	LBM_buildCellList( *srcGrid );
+#endif
+#if defined(LBM_GPU)
+	/* from here on the timesteps run on the device */
+	LBM_gpuAttachGrid( *srcGrid );
+	LBM_gpuAttachGrid( *dstGrid );
+#endif
+
 	LBM_showGridStatistics( *srcGrid );
 }
 
 /*############################################################################*/
 
 void MAIN_finalize( const MAIN_Param* param ) {
+#if defined(LBM_CHECKPOINT)
+	LBM_freeVelocityFieldStage();
+#endif
+#if defined(LBM_AA)
+	LBM_finishInPlace( *srcGrid );
+#endif
+#if defined(LBM_GPU)
+	LBM_gpuUpdateHost( *srcGrid );
+	LBM_gpuDetachGrid( *srcGrid );
+	LBM_gpuDetachGrid( *dstGrid );
+#endif
 	LBM_showGridStatistics( *srcGrid );
 
 	if( param->action == COMPARE )
@@ -155,8 +335,13 @@ void MAIN_finalize( const MAIN_Param* param ) {
 	if( param->action == STORE )
 	LBM_storeVelocityField( *srcGrid, param->resultFilename, TRUE );
 
-	LBM_freeGrid( (double**) &srcGrid );
-	LBM_freeGrid( (double**) &dstGrid );
+#if defined(LBM_SPARSE)
+	LBM_freeCellList();
+#endif
+	LBM_freeGrid( (GRID_PRECISION**) &srcGrid );
+#if !defined(LBM_AA)
+	LBM_freeGrid( (GRID_PRECISION**) &dstGrid );
+#endif
 }
 
 #if !defined(SPEC_CPU)
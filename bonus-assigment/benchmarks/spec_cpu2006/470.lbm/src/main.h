@@ -33,6 +33,10 @@ typedef struct {
 	MAIN_Action action;
 	MAIN_SimType simType;
 	char* obstacleFilename;
+	int nThreads;
+	int nWavefront;  /* timesteps per sweep, see LBM_performWavefront() */
+	int nCheckpoint;  /* timesteps between snapshots, 0: none */
+	char* checkpointFilename;
 } MAIN_Param;
 
 /*############################################################################*/
@@ -0,0 +1,147 @@
+/*
+ * memtrace.c - the buffers and files behind memtrace.h
+ *
+ * Every thread gets a buffer of MEMTRACE_ENTRIES addresses and a file of
+ * its own on its first access, so the threads never wait on each other
+ * while tracing. The buffers are registered in a list, which exit()
+ * walks to write what the threads have left, the main thread's and those
+ * of pool threads that are still parked; threads that end before then
+ * flush themselves through a pthread key destructor.
+ */
+
+#include "memtrace.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MEMTRACE_ENTRIES (1 << 20)      /* 8 MB a thread */
+#define MEMTRACE_VARINT  10             /* bytes of the longest record */
+
+typedef struct trace {
+    uintptr_t *buf;
+    uintptr_t **pos;                    /* the thread's memtrace_pos */
+    uintptr_t prev;
+    unsigned char *out;                 /* one coded chunk */
+    FILE *f;
+    struct trace *next;
+} trace_t;
+
+__thread uintptr_t *memtrace_pos, *memtrace_end;
+
+static __thread trace_t *self;
+static trace_t *all;
+static int nThreads;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t key;
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+
+static void put32(unsigned char *p, uint32_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+static void writeChunk(trace_t *t, const uintptr_t *end)
+{
+    const uintptr_t *p;
+    unsigned char *o = t->out + 8;
+    uint64_t z;
+    int64_t d;
+
+    if (!t->f || end == t->buf)
+        return;   /* closed at exit, or nothing new */
+    for (p = t->buf; p < end; p++) {
+        d = (int64_t) ((*p >> 1) - t->prev);
+        t->prev = *p >> 1;
+        z = ((uint64_t) d << 1 ^ (uint64_t) (d >> 63)) << 1 | (*p & 1);
+        while (z >= 0x80) {
+            *o++ = (unsigned char) (z | 0x80);
+            z >>= 7;
+        }
+        *o++ = (unsigned char) z;
+    }
+    put32(t->out, (uint32_t) (end - t->buf));
+    put32(t->out + 4, (uint32_t) (o - t->out - 8));
+    fwrite(t->out, 1, o - t->out, t->f);
+}
+
+static void done(void *arg)
+{
+    trace_t *t = arg;
+
+    pthread_mutex_lock(&lock);
+    if (t->f) {
+        writeChunk(t, *t->pos);
+        fclose(t->f);
+        t->f = NULL;
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+static void finish(void)
+{
+    trace_t *t;
+
+    for (t = all; t; t = t->next)
+        done(t);
+}
+
+static void init(void)
+{
+    pthread_key_create(&key, done);
+    atexit(finish);
+}
+
+/* the calling thread's buffer and file */
+static void start(void)
+{
+    const char *prefix = getenv("MEMTRACE");
+    char name[4096];
+    trace_t *t;
+
+    pthread_once(&once, init);
+    t = malloc(sizeof(*t));
+    if (t)
+        t->buf = malloc(MEMTRACE_ENTRIES * sizeof(*t->buf));
+    if (t && t->buf)
+        t->out = malloc(8 + (size_t) MEMTRACE_ENTRIES * MEMTRACE_VARINT);
+    if (!t || !t->buf || !t->out) {
+        fprintf(stderr, "memtrace: out of memory\n");
+        exit(1);
+    }
+    t->pos = &memtrace_pos;
+    t->prev = 0;
+
+    pthread_mutex_lock(&lock);
+    snprintf(name, sizeof(name), "%s.%d.mtr", prefix ? prefix : "memtrace",
+             nThreads++);
+    t->next = all;
+    all = t;
+    pthread_mutex_unlock(&lock);
+
+    t->f = fopen(name, "wb");
+    if (!t->f) {
+        perror(name);
+        exit(1);
+    }
+    fwrite(MEMTRACE_MAGIC, 1, 8, t->f);
+
+    self = t;
+    pthread_setspecific(key, t);
+    memtrace_pos = t->buf;
+    memtrace_end = t->buf + MEMTRACE_ENTRIES;
+}
+
+void memtrace_flush(void)
+{
+    if (!self) {
+        start();
+        return;
+    }
+    writeChunk(self, memtrace_pos);
+    memtrace_pos = self->buf;
+}
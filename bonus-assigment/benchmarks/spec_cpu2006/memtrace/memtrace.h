@@ -0,0 +1,43 @@
+/*
+ * memtrace.h - load/store address traces of the benchmarks' hot loops
+ *
+ * Built with -DMEM_TRACE -I../../memtrace and memtrace.c (make trace in
+ * a benchmark's src), MEMTRACE_LOAD(p) and MEMTRACE_STORE(p) append the
+ * address p to a buffer of the calling thread: one compare and one store
+ * in the common case. A full buffer is delta and varint coded, 1 to 3
+ * bytes an access on the usual strides, and written as one chunk to the
+ * thread's file, $MEMTRACE.<n>.mtr (MEMTRACE defaults to "memtrace", n
+ * counts threads in the order of their first access). Buffers are
+ * flushed when their thread exits and at exit().
+ *
+ * File: "MTRACE1\n", then chunks of a little-endian u32 record count,
+ * a u32 byte count and the records. A record is the varint of
+ * zigzag(address - previous address) << 1 | store; the previous address
+ * is 0 at the start of every file. Files may be concatenated, as each
+ * magic resets it. cache_screen reads them.
+ *
+ * Without MEM_TRACE, the benchmarks' headers define both macros away.
+ */
+
+#ifndef MEMTRACE_H
+#define MEMTRACE_H
+
+#include <stdint.h>
+
+#define MEMTRACE_MAGIC "MTRACE1\n"
+
+extern __thread uintptr_t *memtrace_pos, *memtrace_end;
+
+void memtrace_flush(void);
+
+#define MEMTRACE_RECORD(a) \
+    do { \
+        if (memtrace_pos == memtrace_end) \
+            memtrace_flush(); \
+        *memtrace_pos++ = (a); \
+    } while (0)
+
+#define MEMTRACE_LOAD(p)  MEMTRACE_RECORD((uintptr_t) (p) << 1)
+#define MEMTRACE_STORE(p) MEMTRACE_RECORD((uintptr_t) (p) << 1 | 1)
+
+#endif /* MEMTRACE_H */
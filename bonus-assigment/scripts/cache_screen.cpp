@@ -0,0 +1,432 @@
+/*
+ * cache_screen.cpp - one-pass cache design-space screening before gem5
+ *
+ * Usage: cache_screen [options] <trace | ->
+ *   -I sizes   L1i sizes           (default 16kB,32kB,64kB)
+ *   -D sizes   L1d sizes           (default 16kB,32kB,64kB,128kB)
+ *   -L sizes   L2 sizes            (default 256kB,512kB,1MB,2MB,4MB)
+ *   -w ways    L1i/L1d assocs      (default 1,2,4,8,16)
+ *   -W ways    L2 assocs           (default 1,2,4,8,16)
+ *   -b bytes   cachelines          (default 64,128,256,512,1024,2048)
+ *   -s insts   skip the first insts instructions
+ *   -n insts   stop after insts instructions (default 100000000, as -I)
+ *   -t cycles  L2 and memory latency for the CPI estimate (default 20,100)
+ *   -o file    write every configuration to a CSV file
+ *
+ * Reads a valgrind lackey trace of a native run of a benchmark,
+ *   valgrind --tool=lackey --trace-mem=yes ./specmcf inp.in 2>&1 | cache_screen -
+ * or a trace of a benchmark's make trace build (memtrace.h), whose data
+ * accesses stand in for instructions in -s, -n and the CPI estimate,
+ *   MEMTRACE=/tmp/mcf ./specmcf_trace inp.in; cat /tmp/mcf.*.mtr | cache_screen -
+ * and evaluates every L1i x L1d x L2 x line combination of the lists
+ * (L1 total at most 256kB, L2 at most 4MB, as in task2.sh) in one pass.
+ *
+ * Each line size and set count is one LRU stack per set (Mattson et al.),
+ * which gives the hits of every associativity at once: an access hits a
+ * W-way cache iff its stack distance is below W. The L1s see the fetches
+ * and the data accesses; the L2 sees both together, and for LRU caches
+ * with inclusion its misses behind an L1 are those it has on the whole
+ * stream, so one L2 stack serves all L1s. The estimate
+ *   CPI ~ 1 + (L1 misses x L2 latency + L2 misses x memory latency) / insts
+ * is only meant to rank configurations. The configurations on the Pareto
+ * front of that estimate and of the cost of plot_3.py are printed in the
+ * CONFIGS_spec* format of task2.sh, to be simulated in gem5.
+ *
+ * Build: c++ -O2 -std=c++17 -o cache_screen cache_screen.cpp
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+// Cost model of plot_3.py (COST_PARAMS)
+const double GAMMA_L1 = 2.0;
+const double GAMMA_L2 = 1.0;
+const int ADDR_WIDTH = 32;
+const double DELTA = 0.02;
+
+const uint64_t L1_LIMIT = 256 << 10;
+const uint64_t L2_LIMIT = 4 << 20;
+
+const char MTRACE_MAGIC[] = "MTRACE1\n";  // memtrace.h
+
+// LRU stacks of one set count and line size, most recent first
+struct Stack {
+    unsigned lineShift;
+    uint64_t setMask;
+    unsigned ways;                  // depth kept, the largest assoc asked
+    std::vector<uint64_t> tags;     // sets x ways, ~0 when empty
+    std::vector<uint64_t> hits;     // hits[d]: accesses at distance d
+    uint64_t accesses = 0;
+
+    Stack(unsigned lineShift, uint64_t sets, unsigned ways)
+        : lineShift(lineShift), setMask(sets - 1), ways(ways),
+          tags(sets * ways, ~0ull), hits(ways, 0) {}
+
+    void access(uint64_t line)
+    {
+        uint64_t *set = &tags[(line & setMask) * ways];
+        unsigned d = 0;
+
+        accesses++;
+        while (d < ways && set[d] != line)
+            d++;
+        if (d < ways)
+            hits[d]++;
+        else
+            d = ways - 1;
+        std::memmove(set + 1, set, d * sizeof(*set));
+        set[0] = line;
+    }
+
+    uint64_t misses(unsigned assoc) const
+    {
+        uint64_t h = 0;
+
+        for (unsigned d = 0; d < assoc; d++)
+            h += hits[d];
+        return accesses - h;
+    }
+};
+
+// the stacks of one cache level and line size, by set count
+typedef std::map<uint64_t, Stack> Stacks;
+
+struct Grid {
+    std::vector<uint64_t> l1i, l1d, l2, lines;
+    std::vector<unsigned> l1Ways, l2Ways;
+};
+
+struct Config {
+    uint64_t l1i, l1d, l2, line;
+    unsigned l1iWays, l1dWays, l2Ways;
+    double l1iMiss, l1dMiss, l2Miss, cpi, cost;
+    bool pareto;
+};
+
+uint64_t parseSize(const char *s)
+{
+    char *end;
+    uint64_t n = std::strtoull(s, &end, 10);
+
+    if (*end == 'k' || *end == 'K')
+        n <<= 10;
+    else if (*end == 'M' || *end == 'm')
+        n <<= 20;
+    return n;
+}
+
+uint32_t get32(const unsigned char *p)
+{
+    return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t) p[3] << 24;
+}
+
+std::string formatSize(uint64_t n)
+{
+    if (n >= (1 << 20) && n % (1 << 20) == 0)
+        return std::to_string(n >> 20) + "MB";
+    if (n >= (1 << 10) && n % (1 << 10) == 0)
+        return std::to_string(n >> 10) + "kB";
+    return std::to_string(n);
+}
+
+template <typename T>
+std::vector<T> parseList(const char *s)
+{
+    std::vector<T> v;
+    std::string list(s);
+    size_t p = 0;
+
+    while (p <= list.size()) {
+        size_t q = list.find(',', p);
+        if (q == std::string::npos)
+            q = list.size();
+        if (q > p)
+            v.push_back((T) parseSize(list.substr(p, q - p).c_str()));
+        p = q + 1;
+    }
+    return v;
+}
+
+bool powerOf2(uint64_t n)
+{
+    return n && !(n & (n - 1));
+}
+
+// sets of a size/assoc/line, 0 if it is not a whole power of two
+uint64_t setsOf(uint64_t size, unsigned assoc, uint64_t line)
+{
+    if (size % (assoc * line))
+        return 0;
+    uint64_t sets = size / (assoc * line);
+    return powerOf2(sets) ? sets : 0;
+}
+
+// one stack per set count that some size and assoc of the lists needs
+void addStacks(Stacks &stacks, const std::vector<uint64_t> &sizes,
+               const std::vector<unsigned> &ways, uint64_t line)
+{
+    unsigned deepest = *std::max_element(ways.begin(), ways.end());
+    unsigned shift = 0;
+
+    while ((1ull << shift) < line)
+        shift++;
+    for (uint64_t size : sizes)
+        for (unsigned w : ways) {
+            uint64_t sets = setsOf(size, w, line);
+            if (sets && !stacks.count(sets))
+                stacks.emplace(sets, Stack(shift, sets, deepest));
+        }
+}
+
+void touch(Stacks &stacks, uint64_t addr, uint64_t size)
+{
+    for (auto &s : stacks) {
+        Stack &st = s.second;
+        uint64_t first = addr >> st.lineShift;
+        uint64_t last = (addr + (size ? size : 1) - 1) >> st.lineShift;
+        for (uint64_t line = first; line <= last; line++)
+            st.access(line);
+    }
+}
+
+// plot_3.py calculate_cost, sizes in bytes
+double cacheCost(uint64_t size, unsigned assoc, uint64_t line, double gamma)
+{
+    uint64_t sets = size / line / assoc;
+    int tagWidth = ADDR_WIDTH - (int) std::log2((double) line)
+                   - (sets > 1 ? (int) std::log2((double) sets) : 0);
+    int status = 2 + (assoc > 1 ? (int) std::ceil(std::log2((double) assoc)) : 0);
+
+    return ((double) size / 1024 / line) * (std::max(tagWidth, 1) + status) / 8
+           * gamma * (1 + DELTA * assoc);
+}
+
+double cost(const Config &c)
+{
+    return (double) (c.l1i + c.l1d) / 1024 * GAMMA_L1
+           + (double) c.l2 / 1024 * GAMMA_L2
+           + cacheCost(c.l1i, c.l1iWays, c.line, GAMMA_L1)
+           + cacheCost(c.l1d, c.l1dWays, c.line, GAMMA_L1)
+           + cacheCost(c.l2, c.l2Ways, c.line, GAMMA_L2);
+}
+
+void usage()
+{
+    std::fprintf(stderr, "Usage: cache_screen [-I sizes] [-D sizes] [-L sizes] "
+                 "[-w ways] [-W ways] [-b bytes] [-s insts] [-n insts] "
+                 "[-t l2,mem] [-o csv] <trace | ->\n");
+    std::exit(1);
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    Grid g;
+    g.l1i = parseList<uint64_t>("16kB,32kB,64kB");
+    g.l1d = parseList<uint64_t>("16kB,32kB,64kB,128kB");
+    g.l2 = parseList<uint64_t>("256kB,512kB,1MB,2MB,4MB");
+    g.l1Ways = parseList<unsigned>("1,2,4,8,16");
+    g.l2Ways = parseList<unsigned>("1,2,4,8,16");
+    g.lines = parseList<uint64_t>("64,128,256,512,1024,2048");
+    uint64_t skip = 0, limit = 100000000;
+    double l2Lat = 20, memLat = 100;
+    const char *csv = nullptr;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "I:D:L:w:W:b:s:n:t:o:")) != -1) {
+        switch (opt) {
+        case 'I': g.l1i = parseList<uint64_t>(optarg); break;
+        case 'D': g.l1d = parseList<uint64_t>(optarg); break;
+        case 'L': g.l2 = parseList<uint64_t>(optarg); break;
+        case 'w': g.l1Ways = parseList<unsigned>(optarg); break;
+        case 'W': g.l2Ways = parseList<unsigned>(optarg); break;
+        case 'b': g.lines = parseList<uint64_t>(optarg); break;
+        case 's': skip = std::strtoull(optarg, nullptr, 10); break;
+        case 'n': limit = std::strtoull(optarg, nullptr, 10); break;
+        case 't': std::sscanf(optarg, "%lf,%lf", &l2Lat, &memLat); break;
+        case 'o': csv = optarg; break;
+        default: usage();
+        }
+    }
+    if (optind != argc - 1 || g.l1i.empty() || g.l1d.empty() || g.l2.empty()
+        || g.l1Ways.empty() || g.l2Ways.empty() || g.lines.empty())
+        usage();
+
+    std::map<uint64_t, Stacks> iStacks, dStacks, l2Stacks;
+    for (uint64_t line : g.lines) {
+        if (!powerOf2(line)) {
+            std::fprintf(stderr, "cache_screen: line %llu is not a power of two\n",
+                         (unsigned long long) line);
+            return 1;
+        }
+        addStacks(iStacks[line], g.l1i, g.l1Ways, line);
+        addStacks(dStacks[line], g.l1d, g.l1Ways, line);
+        addStacks(l2Stacks[line], g.l2, g.l2Ways, line);
+    }
+
+    // --- The trace, once ---
+    std::FILE *in = std::strcmp(argv[optind], "-") ? std::fopen(argv[optind], "r") : stdin;
+    if (!in) {
+        std::perror(argv[optind]);
+        return 1;
+    }
+    char *buf = nullptr;
+    size_t cap = 0;
+    uint64_t insts = 0;
+    bool fetches = true;
+    auto record = [&](char kind, uint64_t addr, uint64_t size) {
+        if (kind == 'I' && ++insts <= skip)
+            return;
+        if (insts <= skip)
+            return;
+        auto &l1 = kind == 'I' ? iStacks : dStacks;
+        for (int n = kind == 'M' ? 2 : 1; n > 0; n--)  // load, then store
+            for (uint64_t line : g.lines) {
+                touch(l1[line], addr, size);
+                touch(l2Stacks[line], addr, size);
+            }
+    };
+
+    if (getline(&buf, &cap, in) > 0 && std::strcmp(buf, MTRACE_MAGIC) == 0) {
+        // memtrace.h chunks: data accesses only, counted as instructions
+        std::vector<unsigned char> chunk;
+        unsigned char head[8];
+        uint64_t prev = 0;
+        fetches = false;
+        while (insts < skip + limit && std::fread(head, 1, 8, in) == 8) {
+            if (std::memcmp(head, MTRACE_MAGIC, 8) == 0) {
+                prev = 0;
+                continue;
+            }
+            uint32_t count = get32(head), bytes = get32(head + 4);
+            chunk.resize(bytes);
+            if (std::fread(chunk.data(), 1, bytes, in) != bytes)
+                break;
+            const unsigned char *p = chunk.data(), *end = p + bytes;
+            for (; count && p < end && insts < skip + limit; count--) {
+                uint64_t z = 0;
+                for (int shift = 0; p < end; shift += 7) {
+                    z |= (uint64_t) (*p & 0x7f) << shift;
+                    if (!(*p++ & 0x80))
+                        break;
+                }
+                uint64_t d = z >> 1;
+                prev += (d >> 1) ^ -(d & 1);
+                insts++;
+                record(z & 1 ? 'S' : 'L', prev, 1);
+            }
+        }
+    }
+    else do {
+        const char *p = buf;
+        while (*p == ' ')
+            p++;
+        char kind = *p;
+        if ((kind != 'I' && kind != 'L' && kind != 'S' && kind != 'M') || p[1] != ' ')
+            continue;
+        char *end;
+        uint64_t addr = std::strtoull(p + 2, &end, 16);
+        if (*end != ',')
+            continue;
+        record(kind, addr, std::strtoull(end + 1, nullptr, 10));
+    } while (insts < skip + limit && getline(&buf, &cap, in) > 0);
+    std::free(buf);
+    if (in != stdin)
+        std::fclose(in);
+    insts = insts > skip ? insts - skip : 0;
+    if (!insts) {
+        std::fprintf(stderr, "cache_screen: no %s in %s\n",
+                     fetches ? "instructions" : "accesses", argv[optind]);
+        return 1;
+    }
+
+    // --- Every configuration of the grid ---
+    std::vector<Config> configs;
+    for (uint64_t line : g.lines)
+        for (uint64_t l1i : g.l1i)
+            for (uint64_t l1d : g.l1d) {
+                if (l1i + l1d > L1_LIMIT)
+                    continue;
+                for (uint64_t l2 : g.l2) {
+                    if (l2 > L2_LIMIT)
+                        continue;
+                    for (unsigned wi : g.l1Ways)
+                        for (unsigned wd : g.l1Ways)
+                            for (unsigned w2 : g.l2Ways) {
+                                uint64_t si = setsOf(l1i, wi, line);
+                                uint64_t sd = setsOf(l1d, wd, line);
+                                uint64_t s2 = setsOf(l2, w2, line);
+                                if (!si || !sd || !s2)
+                                    continue;
+                                const Stack &i = iStacks[line].at(si);
+                                const Stack &d = dStacks[line].at(sd);
+                                const Stack &u = l2Stacks[line].at(s2);
+                                double mi = (double) i.misses(wi);
+                                double md = (double) d.misses(wd);
+                                double m2 = std::min((double) u.misses(w2), mi + md);
+                                Config c = { l1i, l1d, l2, line, wi, wd, w2,
+                                             i.accesses ? mi / i.accesses : 0,
+                                             d.accesses ? md / d.accesses : 0,
+                                             mi + md > 0 ? m2 / (mi + md) : 0,
+                                             1 + ((mi + md) * l2Lat + m2 * memLat) / insts,
+                                             0, false };
+                                c.cost = cost(c);
+                                configs.push_back(c);
+                            }
+                }
+            }
+
+    // Pareto front: cheaper first, kept if no cheaper one is as fast
+    std::vector<Config *> order;
+    for (Config &c : configs)
+        order.push_back(&c);
+    std::sort(order.begin(), order.end(), [](const Config *a, const Config *b) {
+        return a->cost != b->cost ? a->cost < b->cost : a->cpi < b->cpi;
+    });
+    double best = INFINITY;
+    for (Config *c : order)
+        if (c->cpi < best) {
+            c->pareto = true;
+            best = c->cpi;
+        }
+
+    if (csv) {
+        std::FILE *out = std::fopen(csv, "w");
+        if (!out) {
+            std::perror(csv);
+            return 1;
+        }
+        std::fprintf(out, "l1i_size,l1d_size,l2_size,l1i_assoc,l1d_assoc,l2_assoc,"
+                     "cacheline,l1i_miss_rate,l1d_miss_rate,l2_miss_rate,cpi_estimate,cost,pareto\n");
+        for (const Config &c : configs)
+            std::fprintf(out, "%s,%s,%s,%u,%u,%u,%llu,%.6f,%.6f,%.6f,%.4f,%.1f,%d\n",
+                         formatSize(c.l1i).c_str(), formatSize(c.l1d).c_str(),
+                         formatSize(c.l2).c_str(), c.l1iWays, c.l1dWays, c.l2Ways,
+                         (unsigned long long) c.line, c.l1iMiss, c.l1dMiss, c.l2Miss,
+                         c.cpi, c.cost, c.pareto ? 1 : 0);
+        std::fclose(out);
+    }
+
+    std::printf("# %llu %s, %zu configurations; the Pareto front:\n",
+                (unsigned long long) insts, fetches ? "instructions" : "data accesses",
+                configs.size());
+    int n = 0;
+    for (const Config *c : order)
+        if (c->pareto)
+            std::printf("    \"screen%d|%s|%s|%s|%u|%u|%u|%llu\"  # CPI ~%.3f, cost %.1f\n",
+                        ++n, formatSize(c->l1i).c_str(), formatSize(c->l1d).c_str(),
+                        formatSize(c->l2).c_str(), c->l1iWays, c->l1dWays, c->l2Ways,
+                        (unsigned long long) c->line, c->cpi, c->cost);
+    return 0;
+}
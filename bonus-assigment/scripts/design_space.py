@@ -0,0 +1,234 @@
+#!/usr/bin/env python3
+"""
+Design-space search over the cost model of plot_3.py
+
+Usage: design_space.py [-s store] [-n max] [-o csv] [benchmark ...]
+
+Enumerates every legal cache configuration (power-of-two sizes with
+L1i + L1d <= 256kB and L2 <= 4MB, associativities 1-16, lines of
+32B-2kB), costs all of them at once with the additive data/tag/logic
+model of plot_3.py, and predicts their CPI with a model fitted on the
+gem5 runs of the results store (results_store.py). The configurations
+on the Pareto front of (cost, predicted CPI) that were not simulated yet
+are printed in the CONFIGS_spec* format of task2.sh, at most <max> per
+benchmark (default 10) spread over the front, so gem5 only runs those.
+With -o, the whole front of every benchmark goes to a CSV file.
+
+The CPI model is linear in log2 of each size, associativity and line
+size, plus the square of log2 of the line, whose optimum is benchmark
+specific (256B for bzip2, 2kB for libm). With some ten runs per
+benchmark it is fitted by ridge regression on standardised features,
+so a parameter the runs never varied keeps a zero weight instead of an
+arbitrary one. It ranks candidates; the leave-one-out error printed
+for each benchmark says how far to trust it.
+"""
+
+import sys
+from pathlib import Path
+
+import numpy as np
+
+from results_store import read_columns
+
+SCRIPT_DIR = Path(__file__).parent
+STORE = SCRIPT_DIR.parent / 'results' / 'results.store'
+
+BENCHMARKS = ['specbzip', 'spechmmer', 'specmcf', 'specsjeng', 'speclibm']
+
+# Same parameters as plot_3.py
+COST_PARAMS = {
+    'GAMMA_L1': 2.0,          # L1 cell density factor (8T SRAM ~2× larger than 6T)
+    'GAMMA_L2': 1.0,          # L2 baseline (6T SRAM)
+    'ADDR_WIDTH': 32,         # Address width in bits
+    'DELTA': 0.02,            # Logic overhead per way (~2% comparator/mux per way)
+}
+
+L1_SIZES_KB = [8, 16, 32, 64, 128, 256]
+L2_SIZES_KB = [128, 256, 512, 1024, 2048, 4096]
+ASSOCS = [1, 2, 4, 8, 16]
+CACHELINES_B = [32, 64, 128, 256, 512, 1024, 2048]
+L1_LIMIT_KB = 256
+L2_LIMIT_KB = 4096
+
+PARAMS = ['L1i_size_KB', 'L1d_size_KB', 'L2_size_KB',
+          'L1i_assoc', 'L1d_assoc', 'L2_assoc', 'cacheline_B']
+
+STORE_COLUMNS = {
+    'L1i_size_KB': 'config:system.cpu.icache.size',
+    'L1d_size_KB': 'config:system.cpu.dcache.size',
+    'L2_size_KB': 'config:system.l2.size',
+    'L1i_assoc': 'config:system.cpu.icache.assoc',
+    'L1d_assoc': 'config:system.cpu.dcache.assoc',
+    'L2_assoc': 'config:system.l2.assoc',
+    'cacheline_B': 'config:system.cache_line_size',
+}
+
+RIDGE = 0.1
+
+
+# =============================================================================
+# DESIGN SPACE AND COST
+# =============================================================================
+
+def enumerate_space() -> dict:
+    """Every legal configuration, as one array per parameter of PARAMS."""
+    grids = np.meshgrid(L1_SIZES_KB, L1_SIZES_KB, L2_SIZES_KB,
+                        ASSOCS, ASSOCS, ASSOCS, CACHELINES_B, indexing='ij')
+    space = {name: grid.ravel() for name, grid in zip(PARAMS, grids)}
+
+    legal = (space['L1i_size_KB'] + space['L1d_size_KB'] <= L1_LIMIT_KB) \
+        & (space['L2_size_KB'] <= L2_LIMIT_KB)
+    # at least one set of each cache
+    for size, assoc in [('L1i_size_KB', 'L1i_assoc'), ('L1d_size_KB', 'L1d_assoc'),
+                        ('L2_size_KB', 'L2_assoc')]:
+        legal &= space[size] * 1024 >= space[assoc] * space['cacheline_B']
+    return {name: values[legal] for name, values in space.items()}
+
+
+def tag_and_logic(size_kb, assoc, cacheline_b, gamma):
+    """(S/CL) × (T_w + σ)/8 × γ × (1 + δ × W) of calculate_cost, elementwise."""
+    p = COST_PARAMS
+    num_sets = size_kb * 1024 // cacheline_b // assoc
+    tag_width = np.maximum(p['ADDR_WIDTH'] - np.log2(cacheline_b) - np.log2(num_sets), 1)
+    status = 2 + np.ceil(np.log2(assoc))
+    return (size_kb / cacheline_b) * (tag_width + status) / 8 * gamma * (1 + p['DELTA'] * assoc)
+
+
+def calculate_cost(space: dict):
+    """calculate_cost of plot_3.py over arrays of configurations."""
+    p = COST_PARAMS
+    cl = space['cacheline_B']
+    c_data = (space['L1i_size_KB'] + space['L1d_size_KB']) * p['GAMMA_L1'] \
+        + space['L2_size_KB'] * p['GAMMA_L2']
+    c_tag_logic = tag_and_logic(space['L1i_size_KB'], space['L1i_assoc'], cl, p['GAMMA_L1']) \
+        + tag_and_logic(space['L1d_size_KB'], space['L1d_assoc'], cl, p['GAMMA_L1']) \
+        + tag_and_logic(space['L2_size_KB'], space['L2_assoc'], cl, p['GAMMA_L2'])
+    return np.round(c_data + c_tag_logic, 1)
+
+
+# =============================================================================
+# CPI MODEL
+# =============================================================================
+
+def features(space: dict):
+    """log2 of every parameter, and the square of log2 of the line."""
+    logs = [np.log2(space[name]) for name in PARAMS]
+    return np.column_stack(logs + [logs[-1] ** 2])
+
+
+class CpiModel:
+    """Ridge regression of CPI on features(), standardised by the runs."""
+
+    def __init__(self, runs: dict, cpi):
+        x = features(runs)
+        self.mean = x.mean(axis=0)
+        self.scale = x.std(axis=0)
+        self.scale[self.scale == 0] = 1
+        z = (x - self.mean) / self.scale
+        self.intercept = cpi.mean()
+        self.weights = np.linalg.solve(z.T @ z + RIDGE * np.eye(z.shape[1]),
+                                       z.T @ (cpi - self.intercept))
+
+    def predict(self, space: dict):
+        return self.intercept + ((features(space) - self.mean) / self.scale) @ self.weights
+
+
+def load_runs(store: Path, bench: str) -> tuple:
+    """The configurations and CPIs of the store's runs of bench."""
+    rows, values = read_columns(store, list(STORE_COLUMNS.values()) + ['system.cpu.cpi'])
+    # task2's runs and the task1 baseline have the same clocks and memory
+    keep = [i for i, (b, config, task, _) in enumerate(rows)
+            if b == bench and (task == 'task2' or config == 'default')
+            and not np.isnan(values['system.cpu.cpi'][i])]
+    runs = {name: np.array([values[column][i] for i in keep])
+            for name, column in STORE_COLUMNS.items()}
+    runs['L1i_size_KB'] = runs['L1i_size_KB'] / 1024
+    runs['L1d_size_KB'] = runs['L1d_size_KB'] / 1024
+    runs['L2_size_KB'] = runs['L2_size_KB'] / 1024
+    return runs, np.array([values['system.cpu.cpi'][i] for i in keep])
+
+
+def loo_error(runs: dict, cpi) -> float:
+    """Root mean square leave-one-out error of CpiModel on the runs."""
+    errors = []
+    for i in range(len(cpi)):
+        rest = np.arange(len(cpi)) != i
+        model = CpiModel({name: v[rest] for name, v in runs.items()}, cpi[rest])
+        errors.append(model.predict({name: v[i:i + 1] for name, v in runs.items()})[0] - cpi[i])
+    return float(np.sqrt(np.mean(np.square(errors))))
+
+
+# =============================================================================
+# PARETO FRONT
+# =============================================================================
+
+def pareto_front(cost, cpi):
+    """Indices of the configurations no other one beats on both, by cost."""
+    order = np.lexsort((cpi, cost))
+    best = np.minimum.accumulate(cpi[order])
+    on_front = np.concatenate(([True], cpi[order][1:] < best[:-1]))
+    return order[on_front]
+
+
+def size_name(kb: int) -> str:
+    return f'{kb // 1024}MB' if kb >= 1024 else f'{kb}kB'
+
+
+def main(argv: list) -> int:
+    store, limit, csv, benchmarks = STORE, 10, None, []
+    args = iter(argv)
+    for arg in args:
+        if arg == '-s':
+            store = Path(next(args))
+        elif arg == '-n':
+            limit = int(next(args))
+        elif arg == '-o':
+            csv = open(next(args), 'w')
+            csv.write('benchmark,' + ','.join(PARAMS) + ',cost,cpi,simulated\n')
+        elif arg.startswith('-'):
+            print('Usage: design_space.py [-s store] [-n max] [-o csv] [benchmark ...]')
+            return 1
+        else:
+            benchmarks.append(arg)
+
+    space = enumerate_space()
+    cost = calculate_cost(space)
+    print(f'# {len(cost)} legal configurations')
+
+    for bench in benchmarks or BENCHMARKS:
+        runs, cpi = load_runs(store, bench)
+        if len(cpi) < 2:
+            print(f'\n# {bench}: {len(cpi)} runs in {store}, too few to fit')
+            continue
+        predicted = CpiModel(runs, cpi).predict(space)
+        front = pareto_front(cost, predicted)
+
+        simulated = {tuple(int(runs[name][i]) for name in PARAMS) for i in range(len(cpi))}
+        points = [tuple(int(space[name][i]) for name in PARAMS) for i in front]
+        new = [k for k, point in enumerate(points) if point not in simulated]
+        pick = [new[round(j * (len(new) - 1) / max(limit - 1, 1))]
+                for j in range(min(limit, len(new)))] if new else []
+
+        print(f'\n# {bench}: {len(cpi)} runs, leave-one-out CPI error {loo_error(runs, cpi):.3f}; '
+              f'{len(front)} on the front, {len(new)} not simulated')
+        print(f'CONFIGS_{bench}=(')
+        for n, k in enumerate(sorted(set(pick))):
+            l1i, l1d, l2, a1i, a1d, a2, cl = points[k]
+            i = front[k]
+            print(f'    "front{n + 1}|{size_name(l1i)}|{size_name(l1d)}|{size_name(l2)}|'
+                  f'{a1i}|{a1d}|{a2}|{cl}"  # CPI ~{predicted[i]:.3f}, cost {cost[i]:.1f}')
+        print(')')
+
+        if csv:
+            for k, point in enumerate(points):
+                i = front[k]
+                csv.write(f'{bench},' + ','.join(map(str, point))
+                          + f',{cost[i]:.1f},{predicted[i]:.4f},{int(point in simulated)}\n')
+
+    if csv:
+        csv.close()
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv[1:]))
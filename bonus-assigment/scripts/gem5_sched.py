@@ -0,0 +1,157 @@
+#!/usr/bin/env python3
+"""
+Runs a file of gem5 commands within the host's cores and memory.
+
+Usage: gem5_sched.py [-j jobs] [--joblog file] [--mem MB] [--results dir]
+                     [--dry-run] [--bar] < commands
+
+A drop-in for the `parallel -j N --joblog file < commands` of the task
+scripts: one shell command a line, at most <jobs> at a time (default:
+cores - 1), a GNU parallel joblog, and the number of failed jobs as the
+exit status. On top of the job count, the memory the running jobs are
+expected to use is kept within <MB> (default: 90% of MemAvailable), so
+that lbm and mcf, whose gem5 processes are far larger than hmmer's, do
+not push the host into swap.
+
+Every job's memory and run time are estimated from the runs already in
+<dir> (default: results/ next to this script), through the results
+store: the host_mem_usage and host_seconds of a run into the same -d
+directory (a task2 cache entry) if there is one, otherwise the median of
+the runs of the same benchmark binary (-c), otherwise the largest of all
+runs. Jobs start longest first, which keeps the makespan short (LPT);
+when the next one does not fit, a shorter one that does is started
+instead, and a job larger than the whole budget runs alone. --dry-run
+prints the estimates and the order without running anything.
+"""
+
+import os
+import re
+import statistics
+import subprocess
+import sys
+import time
+from pathlib import Path
+
+sys.path.insert(0, str(Path(__file__).resolve().parent))
+from results_store import build, read_columns  # noqa: E402
+
+MEM_FRACTION = 0.9
+DEFAULT_MEM_MB = 2048       # a job nothing is known about, and no runs at all
+POLL_SECONDS = 0.5
+
+
+def mem_available_mb() -> float:
+    with open("/proc/meminfo") as f:
+        for line in f:
+            if line.startswith("MemAvailable:"):
+                return int(line.split()[1]) / 1024
+    return float("inf")
+
+
+def prior_runs(results: Path) -> tuple:
+    """({run dir: (MB, s)}, {benchmark: [(MB, s), ...]}) of results/."""
+    by_dir, by_bench = {}, {}
+    if not results.is_dir():
+        return by_dir, by_bench
+    store = results / "results.store"
+    build(results, store)
+    rows, values = read_columns(store, ["host_mem_usage", "host_seconds"])
+    for i, (bench, _, _, path) in enumerate(rows):
+        mem, secs = values["host_mem_usage"][i], values["host_seconds"][i]
+        if mem != mem or secs != secs:      # NaN
+            continue
+        run = (mem / 1024, secs)
+        by_dir[os.path.realpath(path)] = run
+        by_bench.setdefault(bench, []).append(run)
+    return by_dir, by_bench
+
+
+def estimate(command: str, by_dir: dict, by_bench: dict) -> tuple:
+    """(MB, s) expected of one gem5 command."""
+    out = re.search(r"(?:^|\s)-d\s+(\S+)", command)
+    if out and os.path.realpath(out.group(1)) in by_dir:
+        return by_dir[os.path.realpath(out.group(1))]
+    binary = re.search(r"(?:^|\s)-c\s+(\S+)", command)
+    runs = by_bench.get(os.path.basename(binary.group(1)), []) if binary else []
+    if runs:
+        return (statistics.median(r[0] for r in runs), statistics.median(r[1] for r in runs))
+    everything = [r for bench in by_bench.values() for r in bench]
+    if everything:
+        return (max(r[0] for r in everything), max(r[1] for r in everything))
+    return (DEFAULT_MEM_MB, 0.0)
+
+
+def main(argv: list) -> int:
+    jobs = max((os.cpu_count() or 2) - 1, 1)
+    joblog, budget, dry_run, bar = None, None, False, False
+    results = Path(__file__).resolve().parent.parent / "results"
+    args = iter(argv)
+    for arg in args:
+        if arg == "-j":
+            jobs = max(int(next(args)), 1)
+        elif arg == "--joblog":
+            joblog = next(args)
+        elif arg == "--mem":
+            budget = float(next(args))
+        elif arg == "--results":
+            results = Path(next(args))
+        elif arg == "--dry-run":
+            dry_run = True
+        elif arg == "--bar":
+            bar = True
+        else:
+            print(__doc__.split("\n\n")[1], file=sys.stderr)
+            return 255
+
+    commands = [line.rstrip("\n") for line in sys.stdin if line.strip()]
+    by_dir, by_bench = prior_runs(results)
+    if budget is None:
+        budget = mem_available_mb() * MEM_FRACTION
+    # (seq, command, MB, s), longest first
+    pending = sorted(((seq, cmd) + estimate(cmd, by_dir, by_bench)
+                      for seq, cmd in enumerate(commands, 1)), key=lambda j: -j[3])
+
+    print(f"gem5_sched: {len(pending)} jobs, {jobs} at a time within {budget:.0f} MB",
+          file=sys.stderr)
+    if dry_run:
+        for seq, cmd, mem, secs in pending:
+            print(f"{seq:4d} {mem:8.0f} MB {secs:8.0f} s  {cmd}")
+        return 0
+
+    log = open(joblog, "w") if joblog else None
+    if log:
+        log.write("Seq\tHost\tStarttime\tJobRuntime\tSend\tReceive\tExitval\tSignal\tCommand\n")
+    running = {}            # Popen -> (seq, command, MB, start)
+    failed = done = 0
+    while pending or running:
+        used = sum(job[2] for job in running.values())
+        while len(running) < jobs and pending:
+            fits = [j for j in pending if used + j[2] <= budget]
+            if not fits and running:
+                break
+            job = fits[0] if fits else pending[0]
+            pending.remove(job)
+            proc = subprocess.Popen(job[1], shell=True, executable="/bin/bash")
+            running[proc] = (job[0], job[1], job[2], time.time())
+            used += job[2]
+        time.sleep(POLL_SECONDS)
+        for proc in [p for p in running if p.poll() is not None]:
+            seq, cmd, _, start = running.pop(proc)
+            status = proc.returncode
+            failed += status != 0
+            done += 1
+            if log:
+                log.write(f"{seq}\t:\t{start:.3f}\t{time.time() - start:.3f}\t0\t0\t"
+                          f"{max(status, 0)}\t{max(-status, 0)}\t{cmd}\n")
+                log.flush()
+            if bar:
+                print(f"\r{done}/{len(commands)} done, {failed} failed", end="", file=sys.stderr)
+    if bar:
+        print(file=sys.stderr)
+    if log:
+        log.close()
+    return min(failed, 101)
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv[1:]))
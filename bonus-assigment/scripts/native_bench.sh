@@ -0,0 +1,96 @@
+#!/bin/bash
+# Description: Native timing of the five benchmarks on the host (runspec-lite)
+# Builds every benchmark with the same compiler and flags, runs each one
+# RUNS times pinned to CPUS, and collects wall time and hardware counters
+# (perf_run.c, perf_event) into one CSV, to set native optimizations
+# beside the gem5 CPI study.
+#
+# RUNS=5 CPUS=2 NATIVE_CFLAGS="-O3 -march=native" bash native_bench.sh
+#
+# results/native/
+#   ├── build/<name>/       copy of src and data, built and run here
+#   ├── logs/<name>_<n>.log output of each run
+#   └── native_results.csv  Benchmarks,run,wall_s,cycles,instructions,ipc,llc_misses,dtlb_misses
+
+# --- Configuration ---
+SCRIPT_DIR=$(dirname "$(realpath "$0")")
+PROJECT_ROOT=$(dirname "$SCRIPT_DIR")
+
+BENCH_DIR="$PROJECT_ROOT/benchmarks/spec_cpu2006"
+RESULTS_DIR="$PROJECT_ROOT/results/native"
+WORK_DIR="$RESULTS_DIR/build"
+LOG_DIR="$RESULTS_DIR/logs"
+RESULTS_CSV="$RESULTS_DIR/native_results.csv"
+
+RUNS=${RUNS:-5}
+CPUS=${CPUS:-0}
+NATIVE_CC=${NATIVE_CC:-gcc}
+NATIVE_CFLAGS=${NATIVE_CFLAGS:--O2}
+
+# Benchmark Definitions: "Name|Source dir|Binary|Args", as in task2.sh but
+# on the copies in WORK_DIR, so outputs (mcf.out, hmmer's .new model)
+# stay out of the tree
+BENCHMARKS=(
+    "specbzip|401.bzip2|specbzip|$WORK_DIR/specbzip/data/input.program 10"
+    "specmcf|429.mcf|specmcf|$WORK_DIR/specmcf/data/inp.in"
+    "spechmmer|456.hmmer|spechmmer|--fixed 0 --mean 325 --num 45000 --sd 200 --seed 0 $WORK_DIR/spechmmer/data/bombesin.hmm"
+    "specsjeng|458.sjeng|specsjeng|$WORK_DIR/specsjeng/data/test.txt"
+    "speclibm|470.lbm|speclibm|20 $WORK_DIR/speclibm/data/lbm.in 0 1 $WORK_DIR/speclibm/data/100_100_130_cf_a.of"
+)
+
+# --- Counter helper ---
+runner="$SCRIPT_DIR/perf_run"
+if [ ! -x "$runner" -o "$runner.c" -nt "$runner" ]; then
+    ${CC:-cc} -O2 -o "$runner" "$runner.c" || { echo "Error: cannot build $runner"; exit 1; }
+fi
+if [ "$(cat /proc/sys/kernel/perf_event_paranoid 2> /dev/null || echo 0)" -gt 2 ]; then
+    echo "⚠️  perf_event_paranoid > 2: counters will read NAN (sysctl kernel.perf_event_paranoid=2)"
+fi
+
+mkdir -p "$WORK_DIR" "$LOG_DIR"
+
+# --- Build ---
+echo "Building with $NATIVE_CC $NATIVE_CFLAGS..."
+for bench in "${BENCHMARKS[@]}"; do
+    IFS='|' read -r name dir bin args <<< "$bench"
+    rm -rf "$WORK_DIR/$name"
+    mkdir -p "$WORK_DIR/$name"
+    cp -r "$BENCH_DIR/$dir/src" "$BENCH_DIR/$dir/data" "$WORK_DIR/$name/"
+    if ! make -s -C "$WORK_DIR/$name/src" all CC="$NATIVE_CC" CFLAGS="$NATIVE_CFLAGS" > "$LOG_DIR/${name}_build.log" 2>&1; then
+        echo "  ⚠️  $name: build failed, see $LOG_DIR/${name}_build.log"
+    fi
+done
+
+# --- Runs ---
+echo ""
+echo "Running each benchmark $RUNS times on CPU(s) $CPUS..."
+echo "Benchmarks,run,wall_s,cycles,instructions,ipc,llc_misses,dtlb_misses" > "$RESULTS_CSV"
+for bench in "${BENCHMARKS[@]}"; do
+    IFS='|' read -r name dir bin args <<< "$bench"
+    BIN="$WORK_DIR/$name/src/$bin"
+    [ -x "$BIN" ] || continue
+    for run in $(seq 1 "$RUNS"); do
+        # every run from a fresh working directory of its own
+        RUN_DIR="$WORK_DIR/$name/run"
+        rm -rf "$RUN_DIR"
+        mkdir -p "$RUN_DIR"
+        counts=$(cd "$RUN_DIR" && "$runner" -c "$CPUS" $BIN $args 2> "$LOG_DIR/${name}_$run.log" \
+                     | tee -a "$LOG_DIR/${name}_$run.log" | tail -n 1)
+        echo "$name,$run,$counts" | awk -F, -v OFS=, '{
+            ipc = ($4 == "NAN" || $5 == "NAN" || $4 == 0) ? "NAN" : sprintf("%.4f", $5 / $4)
+            print $1, $2, $3, $4, $5, ipc, $6, $7 }' >> "$RESULTS_CSV"
+        echo "  $name run $run: ${counts%%,*} s"
+    done
+done
+
+# --- Summary: median wall time per benchmark ---
+echo ""
+echo "Median wall time (s):"
+for bench in "${BENCHMARKS[@]}"; do
+    IFS='|' read -r name dir bin args <<< "$bench"
+    grep "^$name," "$RESULTS_CSV" | cut -d, -f3 | sort -g | awk -v b="$name" '
+        { t[++n] = $1 }
+        END { if (n) printf "  %-10s %.3f\n", b, (n % 2) ? t[(n + 1) / 2] : (t[n / 2] + t[n / 2 + 1]) / 2 }'
+done
+echo ""
+echo "✅ Results saved to $RESULTS_CSV"
@@ -0,0 +1,152 @@
+/*
+ * perf_run.c - run a command on pinned CPUs and count it with perf_event
+ *
+ * Usage: perf_run [-c cpu[,cpu...]] command [args...]
+ *
+ * Prints one CSV line for native_bench.sh,
+ *   wall_s,cycles,instructions,llc_misses,dtlb_misses
+ * after the command exits; the command's own output is left alone. The
+ * counters follow the command and every thread it starts (inherit) and
+ * count user mode only, so they work with perf_event_paranoid <= 2.
+ * They are opened on the child before it execs, enabled by the exec, and
+ * scaled when the kernel had to multiplex them; a counter the CPU or the
+ * kernel does not offer is printed as NAN. Exits with the command's
+ * status.
+ *
+ * Build: cc -O2 -o perf_run perf_run.c
+ * (native_bench.sh does this itself when the binary is missing or old)
+ */
+
+#define _GNU_SOURCE
+
+#include <linux/perf_event.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define CACHE_MISS(cache) \
+    ((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) \
+     | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+static const struct {
+    uint32_t type;
+    uint64_t config;
+} events[] = {
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { PERF_TYPE_HW_CACHE, CACHE_MISS(PERF_COUNT_HW_CACHE_LL) },
+    { PERF_TYPE_HW_CACHE, CACHE_MISS(PERF_COUNT_HW_CACHE_DTLB) },
+};
+
+#define N_EVENTS (int) (sizeof(events) / sizeof(events[0]))
+
+static int openCounter(int e, pid_t pid)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = events[e].type;
+    attr.config = events[e].config;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED
+                       | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    attr.disabled = 1;
+    attr.enable_on_exec = 1;
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int) syscall(SYS_perf_event_open, &attr, pid, -1, -1, 0);
+}
+
+static int pin(const char *list)
+{
+    cpu_set_t set;
+    char *copy = strdup(list), *tok;
+
+    CPU_ZERO(&set);
+    for (tok = strtok(copy, ","); tok; tok = strtok(NULL, ","))
+        CPU_SET(atoi(tok), &set);
+    free(copy);
+    return sched_setaffinity(0, sizeof(set), &set);
+}
+
+static double now(void)
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+int main(int argc, char **argv)
+{
+    const char *cpus = NULL;
+    int fd[N_EVENTS], go[2], a = 1, e, status;
+    uint64_t v[3];
+    double start, wall;
+    pid_t pid;
+    char c = 0;
+
+    if (a + 1 < argc && strcmp(argv[a], "-c") == 0) {
+        cpus = argv[a + 1];
+        a += 2;
+    }
+    if (a >= argc) {
+        fprintf(stderr, "Usage: perf_run [-c cpu[,cpu...]] command [args...]\n");
+        return 1;
+    }
+    if (pipe(go) < 0) {
+        perror("perf_run: pipe");
+        return 1;
+    }
+
+    pid = fork();
+    if (pid < 0) {
+        perror("perf_run: fork");
+        return 1;
+    }
+    if (pid == 0) {
+        /* wait until the counters are on us, then become the command */
+        close(go[1]);
+        if (read(go[0], &c, 1) != 1)
+            _exit(127);
+        close(go[0]);
+        if (cpus && pin(cpus) < 0)
+            perror("perf_run: sched_setaffinity");
+        execvp(argv[a], argv + a);
+        perror(argv[a]);
+        _exit(127);
+    }
+
+    close(go[0]);
+    for (e = 0; e < N_EVENTS; e++)
+        fd[e] = openCounter(e, pid);
+    start = now();
+    if (write(go[1], &c, 1) != 1) {
+        perror("perf_run: write");
+        return 1;
+    }
+    close(go[1]);
+    waitpid(pid, &status, 0);
+    wall = now() - start;
+
+    printf("%.6f", wall);
+    for (e = 0; e < N_EVENTS; e++) {
+        if (fd[e] < 0 || read(fd[e], v, sizeof(v)) != sizeof(v) || v[2] == 0)
+            printf(",NAN");
+        else
+            printf(",%.0f", (double) v[0] * ((double) v[1] / (double) v[2]));
+        if (fd[e] >= 0)
+            close(fd[e]);
+    }
+    printf("\n");
+
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+}
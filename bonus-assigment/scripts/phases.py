@@ -0,0 +1,208 @@
+#!/usr/bin/env python3
+"""
+Phase analysis of gem5 runs whose statistics were dumped every N
+instructions (se_dump.py, phases.sh).
+
+  phases.py [-k max_phases] <run dir>...
+      Splits each <run dir>/stats.txt into its dumps, one interval each,
+      and groups the intervals into phases by their CPI and L1i, L1d and
+      L2 miss rates. Writes <run dir>/phases.csv, one row per interval:
+          interval,start_inst,insts,cycles,cpi,dcache_miss_rate,
+          icache_miss_rate,l2_miss_rate,phase
+      and prints, like read_results.sh, one row per run:
+          Benchmarks,intervals,phases,cpi,
+          phase1_time,phase1_insts,phase1_cpi,phase1_dcache_miss_rate,
+          phase1_icache_miss_rate,phase1_l2_miss_rate,phase2_time,...
+      phase1 is the phase with the most cycles: <k>_time and <k>_insts
+      are its shares of the run's cycles and instructions, its CPI and
+      miss rates those of all its intervals together.
+
+The intervals are clustered by the k-means of simpoint.py, for the
+smallest k in 1..max_phases (default 10) whose clusters leave at most
+SPREAD_LEFT of the spread of the intervals around their mean; runs
+whose intervals are within FLAT_CPI of their mean, root mean square,
+are one phase. (The BIC of simpoint.py wants many more intervals than a
+100M instruction run has dumps.) Each interval is placed by its CPI and its
+misses per instruction at each cache times a nominal miss penalty
+(MISS_CYCLES), all in cycles per instruction, so metrics differ between
+phases by what they cost in run time and not by their spread; an L1i
+whose misses go from 10 to 40 does not make a phase. Counts of
+every core are added up (system.cpu0, system.cpu1, ... and the
+switch_cpus of a restored run).
+"""
+
+import math
+import random
+import re
+import sys
+from pathlib import Path
+
+sys.path.insert(0, str(Path(__file__).resolve().parent))
+from simpoint import BEGIN_STATS, END_STATS, SEED, SEEDS, kmeans  # noqa: E402
+
+CORE_STAT = re.compile(r"^system\.(?:cpu|switch_cpus)\d*\.(.+)$")
+
+# counts of an interval, by the names old and new gem5 give them
+COUNTS = {
+    "insts": ("committedInsts",),
+    "cycles": ("numCycles",),
+    "dcache_misses": ("dcache.overall_misses::total", "dcache.overallMisses::total"),
+    "dcache_accesses": ("dcache.overall_accesses::total", "dcache.overallAccesses::total"),
+    "icache_misses": ("icache.overall_misses::total", "icache.overallMisses::total"),
+    "icache_accesses": ("icache.overall_accesses::total", "icache.overallAccesses::total"),
+}
+L2_COUNTS = {
+    "l2_misses": ("system.l2.overall_misses::total", "system.l2.overallMisses::total"),
+    "l2_accesses": ("system.l2.overall_accesses::total", "system.l2.overallAccesses::total"),
+}
+METRICS = ["cpi", "dcache_miss_rate", "icache_miss_rate", "l2_miss_rate"]
+
+# cycles a miss costs, about: an L2 hit for the L1s, DRAM for the L2
+MISS_CYCLES = {"dcache": 20.0, "icache": 20.0, "l2": 100.0}
+SPREAD_LEFT = 0.1
+FLAT_CPI = 0.02
+
+CORE_NAMES = {name: key for key, names in COUNTS.items() for name in names}
+L2_NAMES = {name: key for key, names in L2_COUNTS.items() for name in names}
+
+
+def read_intervals(stats_file: Path) -> list:
+    """The counts of every dump of a stats.txt that committed instructions."""
+    intervals, counts = [], None
+    with open(stats_file) as f:
+        for line in f:
+            if line.startswith(BEGIN_STATS):
+                counts = dict.fromkeys(list(COUNTS) + list(L2_COUNTS), 0.0)
+                continue
+            if line.startswith(END_STATS):
+                if counts and counts["insts"] > 0:
+                    intervals.append(counts)
+                counts = None
+                continue
+            fields = line.split()
+            if counts is None or len(fields) < 2:
+                continue
+            m = CORE_STAT.match(fields[0])
+            key = CORE_NAMES.get(m.group(1)) if m else L2_NAMES.get(fields[0])
+            if key is None:
+                continue
+            try:
+                value = float(fields[1])
+            except ValueError:
+                continue
+            if math.isfinite(value):
+                counts[key] += value
+    return intervals
+
+
+def ratio(a: float, b: float) -> float:
+    return a / b if b > 0 else math.nan
+
+
+def metrics(counts: dict) -> dict:
+    return {
+        "cpi": ratio(counts["cycles"], counts["insts"]),
+        "dcache_miss_rate": ratio(counts["dcache_misses"], counts["dcache_accesses"]),
+        "icache_miss_rate": ratio(counts["icache_misses"], counts["icache_accesses"]),
+        "l2_miss_rate": ratio(counts["l2_misses"], counts["l2_accesses"]),
+    }
+
+
+def total(intervals: list) -> dict:
+    return {key: sum(c[key] for c in intervals) for key in intervals[0]}
+
+
+def point(counts: dict) -> list:
+    """The CPI and the miss cycles per instruction of each cache."""
+    return [ratio(counts["cycles"], counts["insts"])] + \
+        [MISS_CYCLES[cache] * counts[cache + "_misses"] / counts["insts"]
+         for cache in ("dcache", "icache", "l2")]
+
+
+def phases_of(points: list, max_phases: int) -> list:
+    """The phase of each point, as k-means labels."""
+    rng = random.Random(SEED)
+    spread = None
+    for k in range(1, max(1, min(max_phases, len(points))) + 1):
+        labels, _, sse = min((kmeans(points, k, rng) for _ in range(SEEDS)),
+                             key=lambda run: run[2])
+        if spread is None:
+            spread = sse
+            if sse <= FLAT_CPI * FLAT_CPI * len(points):
+                break
+        if sse <= SPREAD_LEFT * spread:
+            break
+    return labels
+
+
+def analyze(run: Path, max_phases: int) -> tuple:
+    """(whole-run metrics, [(time, insts, metrics) per phase]) of a run."""
+    intervals = read_intervals(run / "stats.txt")
+    if not intervals:
+        return None, []
+    rows = [metrics(c) for c in intervals]
+    labels = phases_of([point(c) for c in intervals], max_phases)
+
+    whole = total(intervals)
+    phases = []
+    for label in sorted(set(labels)):
+        members = [c for c, l in zip(intervals, labels) if l == label]
+        counts = total(members)
+        phases.append((ratio(counts["cycles"], whole["cycles"]),
+                       ratio(counts["insts"], whole["insts"]), metrics(counts), label))
+    phases.sort(key=lambda p: -p[0])
+    number = {p[3]: k for k, p in enumerate(phases, 1)}
+
+    start = 0.0
+    with open(run / "phases.csv", "w") as f:
+        f.write("interval,start_inst,insts,cycles," + ",".join(METRICS) + ",phase\n")
+        for i, (counts, row, label) in enumerate(zip(intervals, rows, labels), 1):
+            f.write(f"{i},{start:.0f},{counts['insts']:.0f},{counts['cycles']:.0f},"
+                    + ",".join(fmt(row[m]) for m in METRICS) + f",{number[label]}\n")
+            start += counts["insts"]
+    return (metrics(whole), len(intervals)), [p[:3] for p in phases]
+
+
+def fmt(value: float) -> str:
+    return "NAN" if math.isnan(value) else f"{value:.6g}"
+
+
+def main(argv: list) -> int:
+    max_phases = 10
+    if len(argv) >= 2 and argv[0] == "-k":
+        max_phases = int(argv[1])
+        argv = argv[2:]
+    if not argv or argv[0] in ("-h", "--help"):
+        print(__doc__)
+        return 0 if argv else 1
+
+    results = []
+    for run in map(Path, argv):
+        if not (run / "stats.txt").is_file():
+            print(f"phases.py: no {run / 'stats.txt'}", file=sys.stderr)
+            continue
+        whole, phases = analyze(run, max_phases)
+        if whole is None:
+            print(f"phases.py: {run / 'stats.txt'} has no intervals", file=sys.stderr)
+            continue
+        results.append((run.name, whole, phases))
+
+    most = max((len(p) for _, _, p in results), default=0)
+    header = ["Benchmarks", "intervals", "phases", "cpi"]
+    for k in range(1, most + 1):
+        header += [f"phase{k}_time", f"phase{k}_insts"] + [f"phase{k}_{m}" for m in METRICS]
+    print(",".join(header))
+    for name, (whole, intervals), phases in results:
+        row = [name, str(intervals), str(len(phases)), fmt(whole["cpi"])]
+        for k in range(most):
+            if k < len(phases):
+                time, insts, values = phases[k]
+                row += [fmt(time), fmt(insts)] + [fmt(values[m]) for m in METRICS]
+            else:
+                row += ["NAN"] * (2 + len(METRICS))
+        print(",".join(row))
+    return 0 if results else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv[1:]))
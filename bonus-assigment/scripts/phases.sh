@@ -0,0 +1,125 @@
+#!/bin/bash
+# Description: Phase behaviour of the five benchmarks from periodic stats dumps
+# Runs each benchmark under se_dump.py, which dumps and resets the gem5
+# statistics every DUMP_INSTS instructions, then groups the intervals
+# into phases by CPI and miss rates (phases.py): bzip2's block sorting
+# and its MTF/Huffman coding, say, come out as phases of their own, each
+# with its share of the run time, CPI and L1i/L1d/L2 miss rates.
+#
+# DUMP_INSTS=5000000 bash phases.sh
+#
+# results/phases/
+#   ├── <name>/<config>/stats.txt   one dump per interval
+#   ├── <name>/<config>/phases.csv  one row per interval, with its phase
+#   ├── <name>/logs/                gem5 logs
+#   └── <name>_phases.csv           per-phase columns, one row per config
+#
+# The first dump of these runs is one interval, not the run, so
+# results_store.py leaves results/phases out.
+
+# --- Configuration ---
+SCRIPT_DIR=$(dirname "$(realpath "$0")")
+PROJECT_ROOT=$(dirname "$SCRIPT_DIR")
+
+# Calculate max parallel jobs (Total Cores - 1)
+MAX_PARALLEL=$(nproc)
+MAX_PARALLEL=$((MAX_PARALLEL - 1))
+
+GEM5_DIR="/home/arch/Desktop/gem5"
+GEM5_BIN="./build/ARM/gem5.opt"
+BENCH_DIR="$PROJECT_ROOT/benchmarks/spec_cpu2006"
+
+RESULTS_DIR="$PROJECT_ROOT/results/"
+PH_DIR="$RESULTS_DIR/phases"
+
+# Instructions per dump, and the most phases per run
+DUMP_INSTS=${DUMP_INSTS:-5000000}
+MAX_PHASES=${MAX_PHASES:-10}
+
+# Benchmark Definitions: "Name|Binary|Args"
+BENCHMARKS=(
+    "specbzip|$BENCH_DIR/401.bzip2/src/specbzip|$BENCH_DIR/401.bzip2/data/input.program 10"
+    "specmcf|$BENCH_DIR/429.mcf/src/specmcf|$BENCH_DIR/429.mcf/data/inp.in"
+    "spechmmer|$BENCH_DIR/456.hmmer/src/spechmmer|--fixed 0 --mean 325 --num 45000 --sd 200 --seed 0 $BENCH_DIR/456.hmmer/data/bombesin.hmm"
+    "specsjeng|$BENCH_DIR/458.sjeng/src/specsjeng|$BENCH_DIR/458.sjeng/data/test.txt"
+    "speclibm|$BENCH_DIR/470.lbm/src/speclibm|20 $BENCH_DIR/470.lbm/data/lbm.in 0 1 $BENCH_DIR/470.lbm/data/100_100_130_cf_a.of"
+)
+
+# Format: "config_name|l1i_size|l1d_size|l2_size|l1i_assoc|l1d_assoc|l2_assoc|cacheline"
+# as in task2.sh; add a benchmark's best one there to see which phases it helps
+CONFIGS=(
+    "baseline|32kB|64kB|2MB|2|2|8|64"             # Default Config
+)
+
+GEM5_OPTS=(
+    "--cpu-type=MinorCPU"
+    "--caches"
+    "--l2cache"
+    "-I 100000000"
+)
+
+# --- Safety Checks ---
+if ! command -v python3 &> /dev/null; then
+    echo "Error: python3 is not installed (gem5_sched.py)."
+    exit 1
+fi
+[ ! -d "$GEM5_DIR" ] && { echo "Error: gem5 directory not found at $GEM5_DIR"; exit 1; }
+
+for bench in "${BENCHMARKS[@]}"; do
+    IFS='|' read -r name bin args <<< "$bench"
+    mkdir -p "$PH_DIR/$name/logs"
+done
+
+CMD_FILE="/tmp/phases_commands.txt"
+trap "rm -f $CMD_FILE" EXIT
+
+cd "$GEM5_DIR" || exit 1
+
+# --- Step 1: Runs, dumped every DUMP_INSTS instructions ---
+echo "Running with a stats dump every $DUMP_INSTS instructions..."
+> "$CMD_FILE"
+for bench in "${BENCHMARKS[@]}"; do
+    IFS='|' read -r name bin args <<< "$bench"
+    for config in "${CONFIGS[@]}"; do
+        IFS='|' read -r cfg_name l1i_size l1d_size l2_size l1i_assoc l1d_assoc l2_assoc cacheline <<< "$config"
+        CACHE_OPTS=(
+            "--l1i_size=$l1i_size"
+            "--l1d_size=$l1d_size"
+            "--l2_size=$l2_size"
+            "--l1i_assoc=$l1i_assoc"
+            "--l1d_assoc=$l1d_assoc"
+            "--l2_assoc=$l2_assoc"
+            "--cacheline_size=$cacheline"
+        )
+        echo "$GEM5_BIN -d $PH_DIR/$name/$cfg_name $SCRIPT_DIR/se_dump.py --dump-insts=$DUMP_INSTS ${GEM5_OPTS[*]} ${CACHE_OPTS[*]} -c $bin -o \"$args\" > $PH_DIR/$name/logs/${cfg_name}.log 2>&1" >> "$CMD_FILE"
+    done
+done
+python3 "$SCRIPT_DIR/gem5_sched.py" --results "$RESULTS_DIR" -j "$MAX_PARALLEL" --joblog "$PH_DIR/jobs.log" < "$CMD_FILE"
+EXIT_STATUS=$?
+
+echo ""
+if [ $EXIT_STATUS -eq 0 ]; then
+    echo "✅ All runs completed successfully!"
+else
+    echo "⚠️  WARNING: Some runs returned errors. Check logs in $PH_DIR/<name>/logs."
+fi
+
+# --- Step 2: Phases ---
+echo ""
+echo "Grouping intervals into phases (at most $MAX_PHASES per run)..."
+for bench in "${BENCHMARKS[@]}"; do
+    IFS='|' read -r name bin args <<< "$bench"
+    runs=()
+    for config in "${CONFIGS[@]}"; do
+        IFS='|' read -r cfg_name rest <<< "$config"
+        runs+=("$PH_DIR/$name/$cfg_name")
+    done
+    if python3 "$SCRIPT_DIR/phases.py" -k "$MAX_PHASES" "${runs[@]}" > "$PH_DIR/${name}_phases.csv"; then
+        echo "  $name: $(tail -n +2 "$PH_DIR/${name}_phases.csv" | cut -d, -f1,3 | tr ',\n' ': ')phases"
+    else
+        echo "  ⚠️  $name: no intervals, see $PH_DIR/$name/logs"
+    fi
+done
+
+echo ""
+echo "Done. Results saved to $PH_DIR/<name>_phases.csv"
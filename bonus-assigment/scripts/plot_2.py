@@ -250,6 +250,16 @@ def plot_cpi_progression_per_benchmark():
 def load_new_benchmark_results() -> Dict[str, pd.DataFrame]:
     """Load benchmark results from the new structure (results/spec*_results.csv)."""
     data = {}
+    store_path = RESULTS_DIR / 'results.store'
+    if store_path.exists():
+        # every run in one file (results_store.py build), same columns as the CSVs
+        from results_store import load
+        store = load(store_path, task='task2').rename(columns={'config': 'Benchmarks'})
+        for bench in BENCHMARKS:
+            df = store[store['benchmark'] == bench].reset_index(drop=True)
+            if len(df):
+                data[bench] = df
+        return data
     for bench in BENCHMARKS:
         csv_path = RESULTS_DIR / f"{bench}_results.csv"
         if csv_path.exists():
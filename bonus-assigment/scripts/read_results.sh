@@ -24,6 +24,9 @@ fi
 inFile="$1"
 outFile="$2"
 
+# keys like system.cpu*.numCycles are no globs
+set -f
+
 bms=$(awk '{if ($1 ~ /^\[Benchmarks\]/) fs=1; else if ($1 ~ /^\[/) fs=0; else if ($1 !~ /^$/ && fs==1) print $1}' $inFile)
 ps=$(awk '{if ($1 ~ /^\[Parameters\]/) fs=1; else if ($1 ~ /^\[/) fs=0; else if ($1 !~ /^$/ && fs==1) print $1}' $inFile)
 of=$(awk '{if ($1 ~ /^\[Output\]/) fs=1; else if ($1 ~ /^\[/) fs=0; else if ($1 !~ /^$/ && fs==1 && fi==0) {print $1;fi=1}}' $inFile)
@@ -44,6 +47,20 @@ if [ -f $outFile ];then
     mv $outFile $outFile".bak"
 fi
 
+# Fast path: the compiled single-pass reader (read_stats.c), built on
+# first use next to this script; the loop below is the fallback when
+# there is no C compiler
+parser="$(dirname "$(realpath "$0")")/read_stats"
+if [ ! -x "$parser" -o "$parser.c" -nt "$parser" ]; then
+    ${CC:-cc} -O2 -pthread -o "$parser" "$parser.c" 2> /dev/null
+fi
+if [ -x "$parser" ] && [ ! "$parser.c" -nt "$parser" ]; then
+    if "$parser" "$(echo $ps | tr ' ' ',')" $bms > $outFile; then
+        echo $outFile generated.
+        exit 0
+    fi
+fi
+
 echo -n "Benchmarks" > $outFile
 for p in $ps
 do
@@ -65,7 +82,15 @@ do
     echo -n "$(basename "$bm")" >> $outFile
     for p in $ps
     do
-        val=$(grep $p $file_found | awk '{print $2}')
+        if [[ "$p" == *"*"* ]]; then
+            # a '*' is any run of digits: the sum over the cores, first dump
+            val=$(awk -v re="^$(echo "$p" | sed 's/\./[.]/g; s/\*/[0-9]*/g')\$" '
+                /^---------- End Simulation Statistics/ { exit }
+                $1 ~ re { s += $2; n++ }
+                END { if (n) printf (s == int(s) ? "%.0f" : "%.10g"), s }' $file_found)
+        else
+            val=$(grep $p $file_found | awk '{print $2}')
+        fi
         if [ -z "$val" ]; then 
             echo -ne ",NAN" >> $outFile 
         else
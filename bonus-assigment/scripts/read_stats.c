@@ -0,0 +1,356 @@
+/*
+ * read_stats.c - single-pass gem5 stats.txt reader behind read_results.sh
+ *
+ * Usage: read_stats [-j jobs] <key,key,...> <benchmark dir>...
+ *
+ * Prints the same CSV as the shell loop of read_results.sh: a header
+ * "Benchmarks,<key>,..." and, for every benchmark whose stats.txt is
+ * found, its basename and the value of each key, or NAN. A file is
+ * mapped once and every line is looked up in a hash set of the keys,
+ * instead of one grep per key. Where <dir>/stats.txt does not exist,
+ * the first stats.txt under .. whose path contains <dir> is taken, as
+ * `find .. | grep` did, but .. is walked once for all benchmarks.
+ * Keys match the whole stat name; when a file holds several dumps, the
+ * value of the first one is printed. A key with a '*' in it stands
+ * for every stat it matches, the '*' for any run of digits, none
+ * included, and gets the sum of their values in the first dump:
+ * system.cpu*.dcache.overall_misses::total adds up the L1d misses of
+ * every core of a multi-core run (system.cpu0, system.cpu1, ...) and
+ * is the one of system.cpu in a single-core run. The files are read by
+ * <jobs> threads (default: one per CPU), and the rows come out in input
+ * order.
+ *
+ * Build: cc -O2 -pthread -o read_stats read_stats.c
+ * (read_results.sh does this itself when the binary is missing or old)
+ */
+
+#define _XOPEN_SOURCE 700
+
+#include <fcntl.h>
+#include <ftw.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+typedef struct {
+    const char *dir;        /* as given */
+    char *path;             /* its stats.txt, NULL if none */
+    char **vals;            /* one per key, NULL if not found */
+} bench_t;
+
+#define END_STATS "---------- End Simulation Statistics"
+
+static char **keys;
+static int nKeys;
+static int *wild;           /* the keys with a '*', nWild of them */
+static int nWild;
+static int *slot;           /* open-addressing table of key indices */
+static unsigned int mask;
+
+static bench_t *benches;
+static int nBenches;
+static int next;            /* next benchmark to read */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+static char **found;        /* every stats.txt under .., in walk order */
+static int nFound, capFound;
+
+static void *xmalloc(size_t n)
+{
+    void *p = malloc(n ? n : 1);
+
+    if (!p) {
+        fprintf(stderr, "read_stats: out of memory\n");
+        exit(1);
+    }
+    return p;
+}
+
+static unsigned int hash(const char *s, size_t n)
+{
+    unsigned int h = 2166136261u;   /* FNV-1a */
+
+    while (n--)
+        h = (h ^ (unsigned char) *s++) * 16777619u;
+    return h;
+}
+
+static void addKey(int k)
+{
+    unsigned int h = hash(keys[k], strlen(keys[k])) & mask;
+
+    while (slot[h] >= 0)
+        h = (h + 1) & mask;
+    slot[h] = k;
+}
+
+/* whether s[0..e) is the wildcard key p */
+static int wildMatch(const char *p, const char *s, const char *e)
+{
+    const char *t;
+
+    for (; *p; p++, s++) {
+        if (*p == '*') {
+            for (t = s; t < e && *t >= '0' && *t <= '9'; t++)
+                ;
+            for (; t >= s; t--)
+                if (wildMatch(p + 1, t, e))
+                    return 1;
+            return 0;
+        }
+        if (s == e || *s != *p)
+            return 0;
+    }
+    return s == e;
+}
+
+/* index of the key s[0..n), or -1 */
+static int findKey(const char *s, size_t n)
+{
+    unsigned int h = hash(s, n) & mask;
+
+    for (; slot[h] >= 0; h = (h + 1) & mask)
+        if (strlen(keys[slot[h]]) == n && memcmp(keys[slot[h]], s, n) == 0)
+            return slot[h];
+    return -1;
+}
+
+static void parse(bench_t *b)
+{
+    struct stat st;
+    const char *p, *end, *eol, *s, *v, *name_end;
+    char *data, num[64];
+    double *sum;
+    int *hits;
+    int fd, k, w, left = nKeys - nWild, dumped = 0;
+
+    fd = open(b->path, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        perror(b->path);
+        if (fd >= 0)
+            close(fd);
+        return;
+    }
+    if (st.st_size == 0) {
+        close(fd);
+        return;
+    }
+    data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        perror(b->path);
+        return;
+    }
+    sum = xmalloc(nWild * sizeof(*sum));
+    hits = xmalloc(nWild * sizeof(*hits));
+    memset(sum, 0, nWild * sizeof(*sum));
+    memset(hits, 0, nWild * sizeof(*hits));
+
+    end = data + st.st_size;
+    for (p = data; p < end && (left > 0 || (nWild && !dumped)); p = eol + 1) {
+        eol = memchr(p, '\n', end - p);
+        if (!eol)
+            eol = end;
+        if (eol - p >= (long) sizeof(END_STATS) - 1
+            && memcmp(p, END_STATS, sizeof(END_STATS) - 1) == 0) {
+            dumped = 1;
+            continue;
+        }
+
+        /* name, then the first value after it */
+        for (s = p; s < eol && *s != ' ' && *s != '\t'; s++)
+            ;
+        name_end = s;
+        k = findKey(p, s - p);
+        if (k >= 0 && b->vals[k])
+            k = -1;
+        for (w = 0; w < nWild && !dumped; w++)
+            if (wildMatch(keys[wild[w]], p, name_end))
+                break;
+        if (k < 0 && (dumped || w == nWild))
+            continue;
+        for (v = s; v < eol && (*v == ' ' || *v == '\t'); v++)
+            ;
+        for (s = v; s < eol && *s != ' ' && *s != '\t' && *s != '\r'; s++)
+            ;
+        if (s == v)
+            continue;
+        if (k >= 0) {
+            b->vals[k] = xmalloc(s - v + 1);
+            memcpy(b->vals[k], v, s - v);
+            b->vals[k][s - v] = '\0';
+            left--;
+        }
+        if (dumped || w == nWild || s - v >= (long) sizeof(num))
+            continue;
+
+        /* every wildcard key the name matches, from the first one on */
+        memcpy(num, v, s - v);
+        num[s - v] = '\0';
+        for (; w < nWild; w++)
+            if (wildMatch(keys[wild[w]], p, name_end)) {
+                sum[w] += strtod(num, NULL);
+                hits[w]++;
+            }
+    }
+    munmap(data, st.st_size);
+
+    for (w = 0; w < nWild; w++) {
+        if (!hits[w])
+            continue;
+        b->vals[wild[w]] = xmalloc(32);
+        if (sum[w] > -9.0e15 && sum[w] < 9.0e15 && sum[w] == (double) (long long) sum[w])
+            sprintf(b->vals[wild[w]], "%.0f", sum[w]);
+        else
+            sprintf(b->vals[wild[w]], "%.10g", sum[w]);
+    }
+    free(sum);
+    free(hits);
+}
+
+static void *worker(void *arg)
+{
+    int i;
+
+    (void) arg;
+    for (;;) {
+        pthread_mutex_lock(&lock);
+        i = next++;
+        pthread_mutex_unlock(&lock);
+        if (i >= nBenches)
+            return NULL;
+        if (benches[i].path)
+            parse(&benches[i]);
+    }
+}
+
+static int collect(const char *path, const struct stat *st, int type,
+                   struct FTW *ftw)
+{
+    (void) st;
+    if (type != FTW_F || strcmp(path + ftw->base, "stats.txt") != 0)
+        return 0;
+    if (nFound == capFound) {
+        capFound = capFound ? 2 * capFound : 256;
+        found = realloc(found, capFound * sizeof(*found));
+        if (!found) {
+            fprintf(stderr, "read_stats: out of memory\n");
+            exit(1);
+        }
+    }
+    found[nFound] = xmalloc(strlen(path) + 1);
+    strcpy(found[nFound++], path);
+    return 0;
+}
+
+static void locate(bench_t *b)
+{
+    static int walked = 0;
+    size_t n = strlen(b->dir);
+    int i;
+
+    b->path = xmalloc(n + sizeof("/stats.txt"));
+    sprintf(b->path, "%s/stats.txt", b->dir);
+    if (access(b->path, R_OK) == 0)
+        return;
+    free(b->path);
+    b->path = NULL;
+
+    if (!walked) {
+        nftw("..", collect, 64, FTW_PHYS);
+        walked = 1;
+    }
+    for (i = 0; i < nFound; i++)
+        if (strstr(found[i], b->dir)) {
+            b->path = found[i];
+            return;
+        }
+}
+
+/* the basename of dir, n characters long */
+static const char *base(const char *dir, int *n)
+{
+    const char *s, *e = dir + strlen(dir);
+
+    while (e > dir + 1 && e[-1] == '/')
+        e--;
+    for (s = e; s > dir && s[-1] != '/'; s--)
+        ;
+    *n = (int) (e - s);
+    return s;
+}
+
+int main(int argc, char **argv)
+{
+    pthread_t *threads;
+    char *list, *tok;
+    long nJobs = sysconf(_SC_NPROCESSORS_ONLN);
+    const char *name;
+    int a = 1, i, k, n;
+
+    if (a + 1 < argc && strcmp(argv[a], "-j") == 0) {
+        nJobs = atol(argv[a + 1]);
+        a += 2;
+    }
+    if (argc - a < 1) {
+        fprintf(stderr, "Usage: read_stats [-j jobs] <key,key,...> <benchmark dir>...\n");
+        return 1;
+    }
+    if (nJobs < 1)
+        nJobs = 1;
+
+    list = argv[a++];
+    keys = xmalloc((strlen(list) / 2 + 1) * sizeof(*keys));
+    for (tok = strtok(list, ","); tok; tok = strtok(NULL, ","))
+        keys[nKeys++] = tok;
+    for (mask = 1; mask < 2u * nKeys; mask <<= 1)
+        ;
+    slot = xmalloc(mask * sizeof(*slot));
+    memset(slot, -1, mask * sizeof(*slot));
+    mask--;
+    wild = xmalloc(nKeys * sizeof(*wild));
+    for (k = 0; k < nKeys; k++)
+        if (strchr(keys[k], '*'))
+            wild[nWild++] = k;
+        else
+            addKey(k);
+
+    nBenches = argc - a;
+    benches = xmalloc(nBenches * sizeof(*benches));
+    for (i = 0; i < nBenches; i++) {
+        benches[i].dir = argv[a + i];
+        benches[i].vals = xmalloc(nKeys * sizeof(char *));
+        memset(benches[i].vals, 0, nKeys * sizeof(char *));
+        locate(&benches[i]);
+    }
+
+    if (nJobs > nBenches)
+        nJobs = nBenches ? nBenches : 1;
+    threads = xmalloc(nJobs * sizeof(*threads));
+    for (i = 0; i < nJobs; i++)
+        if (pthread_create(&threads[i], NULL, worker, NULL) != 0)
+            break;
+    if (i == 0)
+        worker(NULL);
+    while (i > 0)
+        pthread_join(threads[--i], NULL);
+
+    printf("Benchmarks");
+    for (k = 0; k < nKeys; k++)
+        printf(",%s", keys[k]);
+    printf("\n");
+    for (i = 0; i < nBenches; i++) {
+        if (!benches[i].path)
+            continue;
+        name = base(benches[i].dir, &n);
+        printf("%.*s", n, name);
+        for (k = 0; k < nKeys; k++)
+            printf(",%s", benches[i].vals[k] ? benches[i].vals[k] : "NAN");
+        printf("\n");
+    }
+    return 0;
+}
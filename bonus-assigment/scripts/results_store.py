@@ -0,0 +1,272 @@
+#!/usr/bin/env python3
+"""
+One columnar store of every gem5 run under results/, for the plots.
+
+  results_store.py build [-j jobs] [results dir] [store]
+      Reads the stats.txt (first dump, as read_results.sh) and the cache
+      and clock parameters of config.ini of every run, by <jobs> worker
+      processes (default: one per CPU), and writes them to <store>
+      (default <results dir>/results.store). Rebuilds only when runs were
+      added, removed or rerun since.
+
+  results_store.py info [store]
+      Lists the runs and the number of columns.
+
+  results_store.py csv <benchmark> <key,key,...> [store]
+      Prints the task2 runs of <benchmark> as read_results.sh would.
+
+Runs are indexed by (benchmark, config, task): results/<run>/<bench>
+of task1 (config = 1GHz, default, ...), results/<bench>/<config> of
+task2 and results/multicore/<bench>/<n>cpu_<config> of the multi-core
+runs (task2_multicore.sh, task "multicore"). The sweep's cache,
+checkpoints, simpoint and phases directories, .bak copies and the sp<k>
+parts of weighted runs are left out.
+
+Store: "G5STORE1", a little-endian u32 length and that many bytes of
+JSON, {"rows": [[benchmark, config, task, path], ...], "columns":
+[...]}, zero padding to 8 bytes, then one float64 column of len(rows)
+values after the other, in the order of "columns"; NaN where a run has
+no such stat. load() reads the header and only the columns it is asked
+for, so a plot touches a few kilobytes instead of every stats.txt.
+"""
+
+import json
+import math
+import os
+import struct
+import sys
+from array import array
+from multiprocessing import Pool
+from pathlib import Path
+
+MAGIC = b"G5STORE1"
+BEGIN_STATS = "---------- Begin Simulation Statistics ----------"
+END_STATS = "---------- End Simulation Statistics   ----------"
+
+# directories of results/ that hold no runs of their own
+SKIP_DIRS = {"cache", "checkpoints", "simpoint", "phases", "native", "logs"}
+
+# config.ini parameters kept, as "config:<section>.<key>"
+CONFIG_PARAMS = [
+    ("system", "cache_line_size"),
+    ("system.clk_domain", "clock"),
+    ("system.cpu_clk_domain", "clock"),
+    ("system.cpu.icache", "size"),
+    ("system.cpu.icache", "assoc"),
+    ("system.cpu.dcache", "size"),
+    ("system.cpu.dcache", "assoc"),
+    ("system.l2", "size"),
+    ("system.l2", "assoc"),
+]
+
+
+def number(text: str) -> float:
+    try:
+        return float(text)
+    except ValueError:
+        return math.nan
+
+
+def read_stats(path: Path) -> dict:
+    """{stat: value} of the first dump of a stats.txt."""
+    stats = {}
+    with open(path) as f:
+        for line in f:
+            if line.startswith(END_STATS) and stats:
+                break
+            fields = line.split()
+            if len(fields) < 2 or line.startswith(BEGIN_STATS):
+                continue
+            stats.setdefault(fields[0], number(fields[1]))
+    return stats
+
+
+def read_config(path: Path) -> dict:
+    """
+    The CONFIG_PARAMS of a config.ini, without a full parse, and the
+    number of cores as config:cpus. Those of system.cpu are the ones of
+    system.cpu0 in a multi-core run.
+    """
+    wanted = {}
+    for section, key in CONFIG_PARAMS:
+        wanted.setdefault(section, set()).add(key)
+    params = {}
+    section = None
+    cpus = 0
+    try:
+        with open(path) as f:
+            for line in f:
+                if line.startswith("["):
+                    section = line.strip()[1:-1]
+                    if section == "system.cpu" or (section.startswith("system.cpu")
+                                                   and section[10:].isdigit()):
+                        cpus += 1
+                    if section.startswith("system.cpu0"):
+                        section = "system.cpu" + section[11:]
+                elif section in wanted:
+                    key, _, value = line.partition("=")
+                    if key in wanted[section]:
+                        fields = value.split()
+                        params[f"config:{section}.{key}"] = number(fields[0]) if fields else math.nan
+    except OSError:
+        pass
+    if cpus:
+        params["config:cpus"] = float(cpus)
+    return params
+
+
+def read_run(run: tuple) -> tuple:
+    bench, config, task, path = run
+    values = read_stats(path / "stats.txt")
+    values.update(read_config(path / "config.ini"))
+    return (bench, config, task, str(path)), values
+
+
+def find_runs(results: Path) -> list:
+    """(benchmark, config, task, dir) of every run, in a stable order."""
+    runs = []
+    for top in sorted(results.iterdir()):
+        if not top.is_dir() or top.name in SKIP_DIRS or top.suffix == ".bak":
+            continue
+        if top.name == "multicore":
+            for bench in sorted(top.iterdir()):
+                if not bench.is_dir():
+                    continue
+                for sub in sorted(bench.iterdir()):
+                    if (sub / "stats.txt").is_file():
+                        runs.append((bench.name, sub.name, "multicore", sub))
+            continue
+        for sub in sorted(top.iterdir()):
+            if sub.suffix == ".bak" or not (sub / "stats.txt").is_file():
+                continue
+            if top.name.startswith("spec"):
+                runs.append((top.name, sub.name, "task2", sub))
+            else:
+                runs.append((sub.name, top.name, "task1", sub))
+    return runs
+
+
+def build(results: Path, store: Path, jobs: int = 0) -> bool:
+    """Write the store of results/, unless it holds every run already."""
+    runs = find_runs(results)
+    if store.exists():
+        built = store.stat().st_mtime
+        with open(store, "rb") as f:
+            stored = [row[3] for row in read_header(f)[0]]
+        if stored == [str(r[3]) for r in runs] and \
+                all((r[3] / "stats.txt").stat().st_mtime < built for r in runs):
+            return False
+
+    with Pool(jobs or os.cpu_count()) as pool:
+        parsed = pool.map(read_run, runs)
+
+    columns = sorted({name for _, values in parsed for name in values})
+    header = json.dumps({"rows": [row for row, _ in parsed],
+                         "columns": columns}).encode()
+    tmp = store.with_suffix(".tmp")
+    with open(tmp, "wb") as f:
+        f.write(MAGIC + struct.pack("<I", len(header)) + header)
+        f.write(b"\0" * (-f.tell() % 8))
+        for name in columns:
+            column = array("d", (values.get(name, math.nan) for _, values in parsed))
+            if sys.byteorder != "little":
+                column.byteswap()
+            f.write(column.tobytes())
+    tmp.replace(store)
+    return True
+
+
+def read_header(f) -> tuple:
+    """(rows, columns, offset of the first column) of an open store."""
+    if f.read(8) != MAGIC:
+        raise ValueError(f"{f.name}: not a results store")
+    (size,) = struct.unpack("<I", f.read(4))
+    header = json.loads(f.read(size))
+    start = 12 + size
+    return header["rows"], header["columns"], start + (-start % 8)
+
+
+def read_columns(store, columns=None) -> tuple:
+    """(rows, {column: values}) of the given columns, all by default."""
+    with open(store, "rb") as f:
+        rows, names, start = read_header(f)
+        index = {name: i for i, name in enumerate(names)}
+        values = {}
+        for name in names if columns is None else columns:
+            if name not in index:
+                values[name] = [math.nan] * len(rows)
+                continue
+            f.seek(start + index[name] * 8 * len(rows))
+            column = array("d")
+            column.frombytes(f.read(8 * len(rows)))
+            if sys.byteorder != "little":
+                column.byteswap()
+            values[name] = column.tolist()
+    return rows, values
+
+
+def load(store, columns=None, task=None):
+    """
+    The runs of the store as a pandas DataFrame: benchmark, config, task,
+    path and the given stat columns (all of them by default). With task,
+    only that task's runs.
+    """
+    import pandas as pd
+
+    rows, values = read_columns(store, columns)
+    frame = pd.DataFrame(rows, columns=["benchmark", "config", "task", "path"])
+    for name, column in values.items():
+        frame[name] = column
+    if task is not None:
+        frame = frame[frame["task"] == task].reset_index(drop=True)
+    return frame
+
+
+def main(argv: list) -> int:
+    usage = ("Usage: results_store.py build [-j jobs] [results dir] [store]\n"
+             "       results_store.py info [store]\n"
+             "       results_store.py csv <benchmark> <key,key,...> [store]")
+    default_results = Path(__file__).resolve().parent.parent / "results"
+    if not argv or argv[0] in ("-h", "--help"):
+        print(usage)
+        return 0 if argv else 1
+
+    if argv[0] == "build":
+        args = argv[1:]
+        jobs = 0
+        if len(args) >= 2 and args[0] == "-j":
+            jobs = int(args[1])
+            args = args[2:]
+        results = Path(args[0]) if args else default_results
+        store = Path(args[1]) if len(args) > 1 else results / "results.store"
+        if build(results, store, jobs):
+            print(f"Wrote {store}")
+        else:
+            print(f"{store} is up to date")
+        return 0
+
+    if argv[0] == "info":
+        store = argv[1] if len(argv) > 1 else default_results / "results.store"
+        with open(store, "rb") as f:
+            rows, names, _ = read_header(f)
+        for bench, config, task, _ in rows:
+            print(f"{task}  {bench:<10} {config}")
+        print(f"{len(rows)} runs, {len(names)} columns")
+        return 0
+
+    if argv[0] == "csv" and len(argv) >= 3:
+        keys = argv[2].split(",")
+        store = argv[3] if len(argv) > 3 else default_results / "results.store"
+        rows, values = read_columns(store, keys)
+        print(",".join(["Benchmarks"] + keys))
+        for i, (bench, config, task, _) in enumerate(rows):
+            if bench == argv[1] and task == "task2":
+                print(",".join([config] + ["NAN" if math.isnan(values[k][i]) else f"{values[k][i]:.10g}" for k in keys]))
+        return 0
+
+    print(usage)
+    return 1
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv[1:]))
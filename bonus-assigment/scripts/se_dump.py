@@ -0,0 +1,83 @@
+# gem5 config: se.py with the statistics dumped every N instructions
+#
+# Usage, from the gem5 directory, with the options of se.py:
+#   build/ARM/gem5.opt -d <out> <scripts>/se_dump.py --dump-insts=<n>
+#       [--se-script=configs/example/se.py] <se.py options>
+#
+# Runs se.py as it is, but every <n> instructions committed by the
+# first core the statistics are dumped to <out>/stats.txt and reset, so
+# its dumps are consecutive intervals of <n> instructions (the last one
+# shorter) and not one aggregate; phases.py reads them. Counting goes
+# over to the switched-in cores of a checkpoint restore. gem5 runs its
+# configs in Python 2 or 3, so this file keeps to both.
+
+import os
+import sys
+
+import m5
+from m5.objects import Root
+
+DUMP_CAUSE = "stats dump interval reached"
+
+
+def take_option(argv, name, default):
+    """The value of --name=<value> or --name <value>, taken out of argv."""
+    for i, arg in enumerate(argv):
+        if arg == name and i + 1 < len(argv):
+            value = argv[i + 1]
+            del argv[i:i + 2]
+            return value
+        if arg.startswith(name + "="):
+            del argv[i]
+            return arg[len(name) + 1:]
+    return default
+
+
+def active_cpu():
+    """The first core that is running: of switch_cpus once switched in."""
+    system = Root.getInstance().system
+    for name in ("switch_cpus", "cpu"):
+        cpus = getattr(system, name, None)
+        if cpus is None:
+            continue
+        cpu = cpus[0] if isinstance(cpus, list) else cpus
+        if not cpu.switchedOut():
+            return cpu
+    return system.cpu[0]
+
+
+argv = sys.argv[1:]
+interval = int(take_option(argv, "--dump-insts", "0"))
+se_script = os.path.abspath(take_option(argv, "--se-script", "configs/example/se.py"))
+if interval <= 0:
+    sys.exit("se_dump.py: --dump-insts=<instructions> is required")
+
+# the core whose instruction count has the next dump pending
+pending = {"cpu": None}
+simulate = m5.simulate
+
+
+def dumping_simulate(ticks=m5.MaxTick):
+    """m5.simulate, dumping and resetting the statistics every interval."""
+    end = min(m5.curTick() + ticks, m5.MaxTick)
+    while True:
+        cpu = active_cpu()
+        if pending["cpu"] is not cpu:
+            cpu.scheduleInstStop(0, interval, DUMP_CAUSE)
+            pending["cpu"] = cpu
+        event = simulate(end - m5.curTick())
+        if event.getCause() != DUMP_CAUSE:
+            return event
+        pending["cpu"] = None
+        m5.stats.dump()
+        m5.stats.reset()
+
+
+m5.simulate = dumping_simulate
+
+# se.py finds its modules from sys.path[0], its own directory
+sys.argv = [se_script] + argv
+sys.path[0] = os.path.dirname(se_script)
+with open(se_script) as f:
+    code = compile(f.read(), se_script, "exec")
+exec(code, {"__name__": "__main__", "__file__": se_script})
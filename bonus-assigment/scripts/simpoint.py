@@ -0,0 +1,239 @@
+#!/usr/bin/env python3
+"""
+SimPoint phase analysis for the gem5 runs of simpoint.sh and task2.sh.
+
+  simpoint.py cluster <simpoint.bb.gz> <prefix> [max_k]
+      Clusters the basic block vectors that gem5 wrote with
+      --simpoint-profile and writes <prefix>.simpoints and
+      <prefix>.weights in the format of SimPoint 3.2, which is what
+      se.py --take-simpoint-checkpoints reads.
+
+  simpoint.py combine <checkpoint dir> <config dir>
+      Weights the statistics of the restored runs <config dir>/sp<k>
+      by the weights in the names of the checkpoints, and writes the
+      result to <config dir>/stats.txt for read_results.sh.
+
+The clustering follows SimPoint: every vector is normalised, projected
+to 15 random dimensions, and clustered by k-means for k = 1..max_k
+(default 10); the smallest k whose BIC reaches 90% of the range of BIC
+scores wins. Each cluster is represented by the interval closest to its
+centre and weighted by its share of the intervals. Plain Python, so it
+runs on the simulation host without numpy.
+"""
+
+import gzip
+import math
+import random
+import re
+import sys
+from pathlib import Path
+
+DIMS = 15           # random projection, as SimPoint -dim 15
+SEEDS = 5           # k-means runs per k, best one kept
+ITERATIONS = 100
+BIC_THRESHOLD = 0.9
+SEED = 493575226    # SimPoint's default -seedproj
+
+BEGIN_STATS = "---------- Begin Simulation Statistics ----------"
+END_STATS = "---------- End Simulation Statistics   ----------"
+
+
+def read_bbv(path: str) -> list:
+    """One {block: count} dict per interval of a simpoint.bb.gz."""
+    vectors = []
+    with gzip.open(path, "rt") as f:
+        for line in f:
+            if not line.startswith("T"):
+                continue
+            bbv = {}
+            for item in line[1:].split():
+                _, block, count = item.split(":")
+                bbv[int(block)] = bbv.get(int(block), 0) + int(count)
+            vectors.append(bbv)
+    return vectors
+
+
+def project(vectors: list) -> list:
+    """Normalise each vector and project it to DIMS dimensions."""
+    rng = random.Random(SEED)
+    columns = {}
+    points = []
+    for bbv in vectors:
+        total = float(sum(bbv.values())) or 1.0
+        point = [0.0] * DIMS
+        for block in sorted(bbv):
+            column = columns.get(block)
+            if column is None:
+                column = [rng.uniform(-1.0, 1.0) for _ in range(DIMS)]
+                columns[block] = column
+            weight = bbv[block] / total
+            for d in range(DIMS):
+                point[d] += weight * column[d]
+        points.append(point)
+    return points
+
+
+def distance(a: list, b: list) -> float:
+    return sum((x - y) * (x - y) for x, y in zip(a, b))
+
+
+def kmeans(points: list, k: int, rng: random.Random) -> tuple:
+    """k-means with k-means++ seeding; returns (labels, centres, sse)."""
+    dims = len(points[0])
+    centres = [list(rng.choice(points))]
+    while len(centres) < k:
+        d = [min(distance(p, c) for c in centres) for p in points]
+        total = sum(d)
+        if total == 0.0:
+            break
+        r = rng.uniform(0.0, total)
+        for i, di in enumerate(d):
+            r -= di
+            if r <= 0.0:
+                break
+        centres.append(list(points[i]))
+
+    labels = [-1] * len(points)
+    for _ in range(ITERATIONS):
+        changed = False
+        for i, p in enumerate(points):
+            best = min(range(len(centres)), key=lambda c: distance(p, centres[c]))
+            if best != labels[i]:
+                labels[i] = best
+                changed = True
+        if not changed:
+            break
+        sums = [[0.0] * dims for _ in centres]
+        sizes = [0] * len(centres)
+        for p, c in zip(points, labels):
+            sizes[c] += 1
+            for d in range(dims):
+                sums[c][d] += p[d]
+        for c in range(len(centres)):
+            if sizes[c]:
+                centres[c] = [s / sizes[c] for s in sums[c]]
+
+    sse = sum(distance(p, centres[c]) for p, c in zip(points, labels))
+    return labels, centres, sse
+
+
+def bic(points: list, labels: list, k: int, sse: float) -> float:
+    """BIC of a clustering under the spherical Gaussian model of X-means."""
+    r = len(points)
+    if r <= k:
+        return -math.inf
+    variance = max(sse / (DIMS * (r - k)), 1e-300)
+    sizes = [0] * k
+    for c in labels:
+        sizes[c] += 1
+    likelihood = 0.0
+    for n in sizes:
+        if n:
+            likelihood += (n * math.log(n) - n * math.log(r)
+                           - n * DIMS / 2.0 * math.log(2.0 * math.pi * variance)
+                           - DIMS * (n - 1) / 2.0)
+    parameters = (k - 1) + DIMS * k + 1
+    return likelihood - parameters / 2.0 * math.log(r)
+
+
+def cluster(bbv_file: str, prefix: str, max_k: int = 10) -> None:
+    points = project(read_bbv(bbv_file))
+    if not points:
+        sys.exit(f"simpoint.py: no intervals in {bbv_file}")
+    max_k = max(1, min(max_k, len(points)))
+
+    rng = random.Random(SEED)
+    runs = []
+    for k in range(1, max_k + 1):
+        best = min((kmeans(points, k, rng) for _ in range(SEEDS)),
+                   key=lambda run: run[2])
+        runs.append((bic(points, best[0], k, best[2]), best))
+
+    scores = [score for score, _ in runs if score != -math.inf]
+    low, high = min(scores), max(scores)
+    for score, (labels, centres, _) in runs:
+        if score >= low + BIC_THRESHOLD * (high - low):
+            break
+
+    simpoints, weights = [], []
+    for c, centre in enumerate(centres):
+        members = [i for i, label in enumerate(labels) if label == c]
+        if not members:
+            continue
+        closest = min(members, key=lambda i: distance(points[i], centre))
+        simpoints.append(f"{closest} {len(simpoints)}")
+        weights.append(f"{len(members) / len(points):.6f} {len(weights)}")
+
+    Path(prefix + ".simpoints").write_text("\n".join(simpoints) + "\n")
+    Path(prefix + ".weights").write_text("\n".join(weights) + "\n")
+    print(f"{bbv_file}: {len(points)} intervals, {len(simpoints)} simpoints")
+
+
+def last_dump(stats_file: Path) -> dict:
+    """The numeric statistics of the last dump in a gem5 stats.txt."""
+    dump = {}
+    for line in stats_file.read_text().splitlines():
+        if line.startswith(BEGIN_STATS):
+            dump = {}
+            continue
+        fields = line.split()
+        if len(fields) < 2 or line.startswith("-"):
+            continue
+        try:
+            value = float(fields[1])
+        except ValueError:
+            continue
+        if math.isfinite(value):
+            dump[fields[0]] = value
+    return dump
+
+
+def combine(checkpoint_dir: str, config_dir: str) -> None:
+    """
+    Writes the weighted mean of every statistic that all restored runs
+    report. A restored run dumps once after its warm-up and once at the
+    end, so the last dump is the measured interval.
+    """
+    pattern = re.compile(r"cpt\.simpoint_(\d+)_inst_\d+_weight_([0-9.e-]+)_")
+    checkpoints = []
+    for cpt in Path(checkpoint_dir).iterdir():
+        m = pattern.match(cpt.name)
+        if m:
+            checkpoints.append((int(m.group(1)), float(m.group(2))))
+    checkpoints.sort()
+
+    dumps, weights = [], []
+    for k, (_, weight) in enumerate(checkpoints, 1):
+        stats = Path(config_dir) / f"sp{k}" / "stats.txt"
+        if not stats.is_file():
+            print(f"simpoint.py: {stats} missing, skipped", file=sys.stderr)
+            continue
+        dumps.append(last_dump(stats))
+        weights.append(weight)
+    if not dumps or sum(weights) == 0.0:
+        sys.exit(f"simpoint.py: no simpoint results in {config_dir}")
+
+    total = sum(weights)
+    names = [name for name in dumps[0] if all(name in d for d in dumps)]
+    with open(Path(config_dir) / "stats.txt", "w") as f:
+        f.write(f"\n{BEGIN_STATS}\n")
+        for name in names:
+            value = sum(w * d[name] for w, d in zip(weights, dumps)) / total
+            f.write(f"{name:<50} {value:>20.10g}"
+                    f"   # weighted over {len(dumps)} simpoints\n")
+        f.write(f"\n{END_STATS}\n")
+    print(f"{config_dir}: {len(dumps)} simpoints combined")
+
+
+def main() -> None:
+    if len(sys.argv) >= 4 and sys.argv[1] == "cluster":
+        cluster(sys.argv[2], sys.argv[3],
+                int(sys.argv[4]) if len(sys.argv) > 4 else 10)
+    elif len(sys.argv) == 4 and sys.argv[1] == "combine":
+        combine(sys.argv[2], sys.argv[3])
+    else:
+        sys.exit(__doc__)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,108 @@
+#!/bin/bash
+# Description: SimPoint phase profiling of the five benchmarks
+# Profiles the basic block vectors of each whole run, picks its
+# representative intervals and weights (simpoint.py), and takes a gem5
+# checkpoint just before each one. SIMPOINT=1 bash task2.sh then simulates
+# only these intervals in detail for every configuration.
+#
+# results/simpoint/<name>/
+#   ├── profile/simpoint.bb.gz      basic block vectors, one per interval
+#   ├── <name>.simpoints/.weights   chosen intervals and their weights
+#   └── cpt/cpt.simpoint_XX_...     one checkpoint per simpoint
+
+# --- Configuration ---
+SCRIPT_DIR=$(dirname "$(realpath "$0")")
+PROJECT_ROOT=$(dirname "$SCRIPT_DIR")
+
+# Calculate max parallel jobs (Total Cores - 1)
+MAX_PARALLEL=$(nproc)
+MAX_PARALLEL=$((MAX_PARALLEL - 1))
+
+GEM5_DIR="/home/arch/Desktop/gem5"
+GEM5_BIN="./build/ARM/gem5.opt"
+BENCH_DIR="$PROJECT_ROOT/benchmarks/spec_cpu2006"
+
+RESULTS_DIR="$PROJECT_ROOT/results/"
+SP_DIR="$RESULTS_DIR/simpoint"
+
+# Interval and detailed warm-up length in instructions, and the most
+# clusters (simpoints) allowed per benchmark
+INTERVAL=${INTERVAL:-10000000}
+WARMUP=${WARMUP:-1000000}
+MAX_K=${MAX_K:-10}
+
+# Benchmark Definitions: "Name|Binary|Args"
+BENCHMARKS=(
+    "specbzip|$BENCH_DIR/401.bzip2/src/specbzip|$BENCH_DIR/401.bzip2/data/input.program 10"
+    "specmcf|$BENCH_DIR/429.mcf/src/specmcf|$BENCH_DIR/429.mcf/data/inp.in"
+    "spechmmer|$BENCH_DIR/456.hmmer/src/spechmmer|--fixed 0 --mean 325 --num 45000 --sd 200 --seed 0 $BENCH_DIR/456.hmmer/data/bombesin.hmm"
+    "specsjeng|$BENCH_DIR/458.sjeng/src/specsjeng|$BENCH_DIR/458.sjeng/data/test.txt"
+    "speclibm|$BENCH_DIR/470.lbm/src/speclibm|20 $BENCH_DIR/470.lbm/data/lbm.in 0 1 $BENCH_DIR/470.lbm/data/100_100_130_cf_a.of"
+)
+
+GEM5_SCRIPT="configs/example/se.py"
+# Profiling and checkpointing need the atomic CPU and no caches
+ATOMIC_OPTS=(
+    "--cpu-type=AtomicSimpleCPU"
+)
+
+# --- Safety Checks ---
+if ! command -v python3 &> /dev/null; then
+    echo "Error: python3 is not installed (gem5_sched.py)."
+    exit 1
+fi
+[ ! -d "$GEM5_DIR" ] && { echo "Error: gem5 directory not found at $GEM5_DIR"; exit 1; }
+
+for bench in "${BENCHMARKS[@]}"; do
+    IFS='|' read -r name bin args <<< "$bench"
+    mkdir -p "$SP_DIR/$name/logs"
+done
+
+CMD_FILE="/tmp/simpoint_commands.txt"
+trap "rm -f $CMD_FILE" EXIT
+
+cd "$GEM5_DIR" || exit 1
+
+# --- Step 1: Basic block vector profiles ---
+echo "Profiling basic block vectors ($INTERVAL instructions per interval)..."
+> "$CMD_FILE"
+for bench in "${BENCHMARKS[@]}"; do
+    IFS='|' read -r name bin args <<< "$bench"
+    echo "$GEM5_BIN -d $SP_DIR/$name/profile $GEM5_SCRIPT ${ATOMIC_OPTS[*]} --simpoint-profile --simpoint-interval=$INTERVAL -c $bin -o \"$args\" > $SP_DIR/$name/logs/profile.log 2>&1" >> "$CMD_FILE"
+done
+python3 "$SCRIPT_DIR/gem5_sched.py" --results "$RESULTS_DIR" -j "$MAX_PARALLEL" --joblog "$SP_DIR/profile_jobs.log" < "$CMD_FILE"
+
+# --- Step 2: Clustering ---
+echo ""
+echo "Choosing simpoints (at most $MAX_K per benchmark)..."
+for bench in "${BENCHMARKS[@]}"; do
+    IFS='|' read -r name bin args <<< "$bench"
+    BBV="$SP_DIR/$name/profile/simpoint.bb.gz"
+    if [ ! -f "$BBV" ]; then
+        echo "  ⚠️  $name: no profile, see $SP_DIR/$name/logs/profile.log"
+        continue
+    fi
+    python3 "$SCRIPT_DIR/simpoint.py" cluster "$BBV" "$SP_DIR/$name/$name" "$MAX_K"
+done
+
+# --- Step 3: Checkpoints ---
+echo ""
+echo "Taking checkpoints ($WARMUP instructions of warm-up)..."
+> "$CMD_FILE"
+for bench in "${BENCHMARKS[@]}"; do
+    IFS='|' read -r name bin args <<< "$bench"
+    PREFIX="$SP_DIR/$name/$name"
+    [ -f "$PREFIX.simpoints" ] || continue
+    rm -rf "$SP_DIR/$name/cpt"
+    echo "$GEM5_BIN -d $SP_DIR/$name/cpt $GEM5_SCRIPT ${ATOMIC_OPTS[*]} --take-simpoint-checkpoints=$PREFIX.simpoints,$PREFIX.weights,$INTERVAL,$WARMUP -c $bin -o \"$args\" > $SP_DIR/$name/logs/checkpoint.log 2>&1" >> "$CMD_FILE"
+done
+python3 "$SCRIPT_DIR/gem5_sched.py" --results "$RESULTS_DIR" -j "$MAX_PARALLEL" --joblog "$SP_DIR/checkpoint_jobs.log" < "$CMD_FILE"
+EXIT_STATUS=$?
+
+echo ""
+if [ $EXIT_STATUS -eq 0 ]; then
+    echo "✅ SimPoint checkpoints ready in $SP_DIR"
+    echo "   Run: SIMPOINT=1 bash $SCRIPT_DIR/task2.sh"
+else
+    echo "⚠️  WARNING: Some checkpoints failed. Check logs in $SP_DIR/<name>/logs."
+fi
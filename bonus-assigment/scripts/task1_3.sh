@@ -83,7 +83,7 @@ echo ""
 cd "$GEM5_DIR" || exit 1
 
 # Run in parallel
-parallel -j "$MAX_PARALLEL" --bar --joblog "$LOG_DIR/step3_jobs.log" < "$CMD_FILE"
+python3 "$SCRIPT_DIR/gem5_sched.py" --results "$RESULTS_DIR" -j "$MAX_PARALLEL" --bar --joblog "$LOG_DIR/step3_jobs.log" < "$CMD_FILE"
 EXIT_STATUS=$?
 
 echo ""
@@ -77,7 +77,7 @@ cd "$GEM5_DIR" || exit 1
 
 # Run in parallel
 # We capture the exit status to print a friendly message
-parallel -j "$MAX_PARALLEL" --bar --joblog "$LOG_DIR/jobs.log" < "$CMD_FILE"
+python3 "$SCRIPT_DIR/gem5_sched.py" --results "$RESULTS_DIR" -j "$MAX_PARALLEL" --bar --joblog "$LOG_DIR/jobs.log" < "$CMD_FILE"
 EXIT_STATUS=$?
 
 echo ""
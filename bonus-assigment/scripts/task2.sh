@@ -19,6 +19,29 @@ BENCH_DIR="$PROJECT_ROOT/benchmarks/spec_cpu2006"
 RESULTS_DIR="$PROJECT_ROOT/results/"
 CONFIG_DIR="$PROJECT_ROOT/config/"
 
+# SimPoint mode (SIMPOINT=1 bash task2.sh): where simpoint.sh left
+# checkpoints for a benchmark, run each configuration only on its
+# simpoints and weight their statistics into <config>/stats.txt
+SIMPOINT=${SIMPOINT:-0}
+SP_DIR="$RESULTS_DIR/simpoint"
+
+# Checkpoint mode (CHECKPOINT=1 bash task2.sh): fast-forward each benchmark
+# FAST_FORWARD instructions once with the atomic CPU, checkpoint it there,
+# and restore every configuration from that checkpoint into MinorCPU, so a
+# configuration only simulates the measured 100M instructions
+CHECKPOINT=${CHECKPOINT:-0}
+FAST_FORWARD=${FAST_FORWARD:-1000000000}
+CKPT_DIR="$RESULTS_DIR/checkpoints"
+
+# Results cache: every run is simulated into $CACHE_DIR/<key>, the key
+# hashing its binary, arguments, gem5 options and checkpoints, and
+# <config> links there. A key that finished (stats.txt and .done) is not
+# run again, and configurations that are the same run are simulated
+# once, so an interrupted or edited sweep only runs what is missing.
+# CACHE=0 runs everything into the config directories as before.
+CACHE=${CACHE:-1}
+CACHE_DIR="$RESULTS_DIR/cache"
+
 # Benchmark Definitions: "Name|Binary|Args"
 BENCHMARKS=(
     "specbzip|$BENCH_DIR/401.bzip2/src/specbzip|$BENCH_DIR/401.bzip2/data/input.program 10"
@@ -107,10 +130,25 @@ BASE_OPTS=(
     "--l2cache"
     "-I 100000000"
 )
+# A restored simpoint runs for one interval, so no instruction limit
+SP_OPTS=(
+    "--cpu-type=MinorCPU"
+    "--caches"
+    "--l2cache"
+    "--restore-simpoint-checkpoint"
+)
+CKPT_OPTS=(
+    "--cpu-type=MinorCPU"
+    "--caches"
+    "--l2cache"
+    "-I 100000000"
+    "--at-instruction"
+    "-r $FAST_FORWARD"
+)
 
 # --- Safety Checks ---
-if ! command -v parallel &> /dev/null; then
-    echo "Error: GNU parallel is not installed."
+if ! command -v python3 &> /dev/null; then
+    echo "Error: python3 is not installed (gem5_sched.py)."
     exit 1
 fi
 [ ! -d "$GEM5_DIR" ] && { echo "Error: gem5 directory not found at $GEM5_DIR"; exit 1; }
@@ -140,14 +178,72 @@ echo "  ├── specmcf/      (7 configs)"
 echo "  └── specsjeng/    (9 configs)"
 echo ""
 
-# --- Command Generation ---
 CMD_FILE="/tmp/part2_best_commands.txt"
-trap "rm -f $CMD_FILE" EXIT
+CKPT_CMD_FILE="/tmp/part2_checkpoint_commands.txt"
+trap "rm -f $CMD_FILE $CKPT_CMD_FILE" EXIT
+
+# --- Checkpoints (CHECKPOINT=1) ---
+# One atomic run per benchmark whose checkpoint is missing; the
+# checkpoint is written to $CKPT_DIR/<name>/cpt..$FAST_FORWARD
+if [ "$CHECKPOINT" = "1" ]; then
+    > "$CKPT_CMD_FILE"
+    for bench in "${BENCHMARKS[@]}"; do
+        IFS='|' read -r name bin args <<< "$bench"
+        ls -d "$CKPT_DIR/$name"/cpt.*."$FAST_FORWARD" &> /dev/null && continue
+        mkdir -p "$CKPT_DIR/$name"
+        echo "$GEM5_BIN -d $CKPT_DIR/$name $GEM5_SCRIPT --cpu-type=AtomicSimpleCPU --at-instruction --take-checkpoints=$FAST_FORWARD -c $bin -o \"$args\" > $CKPT_DIR/$name/checkpoint.log 2>&1" >> "$CKPT_CMD_FILE"
+    done
+    if [ -s "$CKPT_CMD_FILE" ]; then
+        echo "Checkpointing after $FAST_FORWARD instructions..."
+        (cd "$GEM5_DIR" && python3 "$SCRIPT_DIR/gem5_sched.py" --results "$RESULTS_DIR" -j "$MAX_PARALLEL" --joblog "$CKPT_DIR/jobs.log" < "$CKPT_CMD_FILE")
+        echo ""
+    fi
+fi
+
+# --- Command Generation ---
 > "$CMD_FILE"
 
 echo "Generating benchmark commands..."
 echo ""
 
+declare -A QUEUED
+CACHED=0
+
+# Queue one gem5 run into <out>, or link <out> to its cached result:
+# queue_run <out> <log> <bin> <args> <key salt> <gem5 options...>
+queue_run() {
+    local out=$1 log=$2 bin=$3 args=$4 salt=$5
+    shift 5
+    local opts="$*"
+
+    if [ "$CACHE" != "1" ]; then
+        [ -L "$out" ] && rm -f "$out"
+        echo "$GEM5_BIN -d $out $GEM5_SCRIPT $opts -c $bin -o \"$args\" > $log 2>&1" >> "$CMD_FILE"
+        return
+    fi
+
+    local key
+    key=$(echo "$salt|$GEM5_BIN|$GEM5_SCRIPT|$opts|$args" | sha1sum | cut -c1-16)
+    local entry="$CACHE_DIR/$key"
+
+    # a run directory of an older sweep is kept aside, not overwritten
+    if [ -e "$out" ] && [ ! -L "$out" ]; then
+        rm -rf "$out.bak"
+        mv "$out" "$out.bak"
+    fi
+    mkdir -p "$(dirname "$out")"
+    ln -sfn "$entry" "$out"
+
+    if [ -f "$entry/stats.txt" ] && [ -f "$entry/.done" ]; then
+        CACHED=$((CACHED + 1))
+        return
+    fi
+    [ -n "${QUEUED[$key]}" ] && return
+    QUEUED[$key]=1
+    rm -rf "$entry"
+    echo "$GEM5_BIN -d $entry $GEM5_SCRIPT $opts -c $bin -o \"$args\" > $log 2>&1 && touch $entry/.done" >> "$CMD_FILE"
+}
+
 # Function to generate commands and INI for a benchmark
 run_benchmark() {
     local bench_name=$1
@@ -158,6 +254,30 @@ run_benchmark() {
     
     local BENCH_RESULTS="$RESULTS_DIR/$bench_name"
     local LOG_DIR="$BENCH_RESULTS/logs"
+    local CPT_DIR="$SP_DIR/$bench_name/cpt"
+    local simpoints=0
+    local restore=0
+    local salt=""
+    
+    if [ "$SIMPOINT" = "1" ]; then
+        simpoints=$(ls -d "$CPT_DIR"/cpt.simpoint_* 2>/dev/null | wc -l)
+        [ "$simpoints" -eq 0 ] && echo "  ⚠️  $bench_name: no simpoint checkpoints, running the first 100M instructions"
+    fi
+    if [ "$CHECKPOINT" = "1" ] && [ "$simpoints" -eq 0 ]; then
+        if ls -d "$CKPT_DIR/$bench_name"/cpt.*."$FAST_FORWARD" &> /dev/null; then
+            restore=1
+        else
+            echo "  ⚠️  $bench_name: no checkpoint (see $CKPT_DIR/$bench_name/checkpoint.log), running from instruction 0"
+        fi
+    fi
+    
+    # what the runs depend on besides their options: the binary, and
+    # the checkpoints they restore
+    if [ "$CACHE" = "1" ]; then
+        salt=$(sha1sum "$bin" 2> /dev/null | cut -c1-40)
+        [ "$simpoints" -gt 0 ] && salt="$salt $(find "$CPT_DIR" -maxdepth 1 -name 'cpt.*' -printf '%f %T@ ' | sort)"
+        [ "$restore" -eq 1 ] && salt="$salt $(find "$CKPT_DIR/$bench_name" -maxdepth 1 -name 'cpt.*' -printf '%f %T@ ' | sort)"
+    fi
     
     echo "  $bench_name: ${#configs[@]} configurations"
     
@@ -177,7 +297,25 @@ run_benchmark() {
         )
         
         echo "    $cfg_name: L1i=$l1i_size L1d=$l1d_size L2=$l2_size line=$cacheline"
-        echo "$GEM5_BIN -d $OUTPUT_DIR $GEM5_SCRIPT ${BASE_OPTS[*]} ${CACHE_OPTS[*]} -c $bin -o \"$args\" > $LOG_DIR/${cfg_name}.log 2>&1" >> "$CMD_FILE"
+        if [ "$simpoints" -gt 0 ]; then
+            # sp<k> and the combined stats.txt live in a directory of
+            # their own: a link left by a cached full run would put
+            # them into its cache entry, which still has .done
+            [ -L "$OUTPUT_DIR" ] && rm -f "$OUTPUT_DIR"
+            mkdir -p "$OUTPUT_DIR"
+            for k in $(seq 1 "$simpoints"); do
+                queue_run "$OUTPUT_DIR/sp$k" "$LOG_DIR/${cfg_name}_sp$k.log" "$bin" "$args" "$salt" \
+                    ${SP_OPTS[*]} -r $k --checkpoint-dir=$CPT_DIR ${CACHE_OPTS[*]}
+            done
+            continue
+        fi
+        if [ "$restore" -eq 1 ]; then
+            queue_run "$OUTPUT_DIR" "$LOG_DIR/${cfg_name}.log" "$bin" "$args" "$salt" \
+                ${CKPT_OPTS[*]} --checkpoint-dir=$CKPT_DIR/$bench_name ${CACHE_OPTS[*]}
+            continue
+        fi
+        queue_run "$OUTPUT_DIR" "$LOG_DIR/${cfg_name}.log" "$bin" "$args" "$salt" \
+            ${BASE_OPTS[*]} ${CACHE_OPTS[*]}
     done
 }
 
@@ -193,6 +331,7 @@ done
 TOTAL_CMDS=$(wc -l < "$CMD_FILE")
 echo ""
 echo "Total configurations to run: $TOTAL_CMDS"
+[ "$CACHE" = "1" ] && echo "Already in the results cache: $CACHED ($CACHE_DIR)"
 echo ""
 
 # --- Execution ---
@@ -202,7 +341,7 @@ echo ""
 
 cd "$GEM5_DIR" || exit 1
 
-parallel -j "$MAX_PARALLEL" --joblog "$RESULTS_DIR/jobs.log" < "$CMD_FILE"
+python3 "$SCRIPT_DIR/gem5_sched.py" --results "$RESULTS_DIR" -j "$MAX_PARALLEL" --joblog "$RESULTS_DIR/jobs.log" < "$CMD_FILE"
 EXIT_STATUS=$?
 
 echo ""
@@ -212,6 +351,21 @@ else
     echo "⚠️  WARNING: Some benchmarks returned errors. Check logs."
 fi
 
+# --- SimPoint weighting ---
+if [ "$SIMPOINT" = "1" ]; then
+    echo ""
+    echo "Weighting simpoint statistics..."
+    for bench in "${BENCHMARKS[@]}"; do
+        IFS='|' read -r name bin args <<< "$bench"
+        ls -d "$SP_DIR/$name/cpt"/cpt.simpoint_* &> /dev/null || continue
+        config_var="CONFIGS_$name[@]"
+        for config in "${!config_var}"; do
+            IFS='|' read -r cfg_name rest <<< "$config"
+            python3 "$SCRIPT_DIR/simpoint.py" combine "$SP_DIR/$name/cpt" "$RESULTS_DIR/$name/$cfg_name"
+        done
+    done
+fi
+
 # --- Results Collection (Separate CSV per benchmark) ---
 echo ""
 echo "Extracting results per benchmark..."
@@ -251,6 +405,10 @@ EOF
     bash "$SCRIPT_DIR/read_results.sh" "$INI_FILE"
 done
 
+# --- Results store for the plots ---
+echo ""
+python3 "$SCRIPT_DIR/results_store.py" build "$RESULTS_DIR" "$RESULTS_DIR/results.store"
+
 echo ""
 echo "=============================================="
 echo "Done! Results saved to:"
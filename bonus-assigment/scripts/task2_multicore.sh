@@ -0,0 +1,210 @@
+#!/bin/bash
+# Description: Part 2 - Multi-core runs of the threaded benchmark builds
+# Runs the threaded builds (Lazy SMP sjeng, OpenMP lbm, threaded hmmer,
+# parallel-pricing mcf) on CORES MinorCPU cores of one se.py process:
+# private L1s, one L2 shared over tol2bus, the benchmark's threads on
+# the cores. Every core count runs every L2 of CONFIGS, so the L2 sizes
+# of task2 can be checked against contention for the shared L2, and the
+# results carry the coherence traffic (snoops, upgrades, writebacks).
+#
+# CORES="1 2 4 8" bash task2_multicore.sh
+#
+# results/multicore/
+#   ├── <bench>/<n>cpu_<config>/   gem5 output of each run
+#   ├── <bench>/logs/              gem5 logs
+#   ├── <bench>/env_<n>            se.py --env file of benchmarks that take one
+#   └── <bench>_results.csv        one row per run
+#
+# Stats of an -n N run are per core (system.cpu0, system.cpu1, ...);
+# the system.cpu*.<stat> keys below are summed over the cores by
+# read_results.sh, and are the plain system.cpu.<stat> of 1-core runs.
+# -I stops a run when any one core has committed that many instructions.
+
+# --- Configuration ---
+SCRIPT_DIR=$(dirname "$(realpath "$0")")
+PROJECT_ROOT=$(dirname "$SCRIPT_DIR")
+
+# Calculate max parallel jobs (Total Cores - 1)
+MAX_PARALLEL=$(nproc)
+MAX_PARALLEL=$((MAX_PARALLEL - 1))
+
+GEM5_DIR="/home/arch/Desktop/gem5"
+GEM5_BIN="./build/ARM/gem5.opt"
+BENCH_DIR="$PROJECT_ROOT/benchmarks/spec_cpu2006"
+
+RESULTS_DIR="$PROJECT_ROOT/results"
+MC_DIR="$RESULTS_DIR/multicore"
+CONFIG_DIR="$PROJECT_ROOT/config"
+
+CORES=(${CORES:-1 2 4})
+
+# Benchmark Definitions: "Name|Binary|Make target|Args|Env"
+# {threads} is the core count and {workers} one less, for hmmer, whose
+# master thread only waits on its workers; a thread needs a core of its
+# own in SE mode. Env lines are ';' separated.
+BENCHMARKS=(
+    "specmcf|$BENCH_DIR/429.mcf/src/specmcf_mt|parallel|$BENCH_DIR/429.mcf/data/inp.in 0 {threads}|"
+    "spechmmer|$BENCH_DIR/456.hmmer/src/spechmmer_mt|threads|--cpu {workers} --fixed 0 --mean 325 --num 45000 --sd 200 --seed 0 $BENCH_DIR/456.hmmer/data/bombesin.hmm|"
+    "specsjeng|$BENCH_DIR/458.sjeng/src/specsjeng_smp|smp|$BENCH_DIR/458.sjeng/data/test.txt|SJENG_THREADS={threads}"
+    "speclibm|$BENCH_DIR/470.lbm/src/speclibm_omp|omp|--threads {threads} 20 $BENCH_DIR/470.lbm/data/lbm.in 0 1 $BENCH_DIR/470.lbm/data/100_100_130_cf_a.of|"
+)
+
+# Format: "config_name|l1i_size|l1d_size|l2_size|l1i_assoc|l1d_assoc|l2_assoc|cacheline"
+# The task2 default and the L2 sizes around it, L1s per core as there
+CONFIGS=(
+    "baseline|32kB|64kB|2MB|2|2|8|64"             # Default Config
+    "L2=512kB|32kB|64kB|512kB|2|2|8|64"           # L2 that fits one core
+    "L2=1MB|32kB|64kB|1MB|2|2|8|64"
+    "L2=4MB|32kB|64kB|4MB|2|2|16|64"              # Max L2
+)
+
+GEM5_SCRIPT="configs/example/se.py"
+GEM5_OPTS=(
+    "--cpu-type=MinorCPU"
+    "--caches"
+    "--l2cache"
+    "-I 100000000"
+)
+
+# --- Safety Checks ---
+if ! command -v python3 &> /dev/null; then
+    echo "Error: python3 is not installed (gem5_sched.py)."
+    exit 1
+fi
+[ ! -d "$GEM5_DIR" ] && { echo "Error: gem5 directory not found at $GEM5_DIR"; exit 1; }
+
+mkdir -p "$MC_DIR" "$CONFIG_DIR"
+
+# --- Command Generation ---
+
+CMD_FILE="/tmp/multicore_commands.txt"
+trap "rm -f $CMD_FILE" EXIT
+> "$CMD_FILE"
+
+echo "Generating commands for ${CORES[*]} cores..."
+
+for bench in "${BENCHMARKS[@]}"; do
+    IFS='|' read -r name bin target args env <<< "$bench"
+    if [ ! -x "$bin" ]; then
+        echo "  ⚠️  $name: no $(basename "$bin"), build it with make -C $(dirname "$bin") $target"
+        continue
+    fi
+    mkdir -p "$MC_DIR/$name/logs"
+    echo "  $name: ${#CONFIGS[@]} configurations"
+
+    for n in "${CORES[@]}"; do
+        run_args=${args//\{threads\}/$n}
+        run_args=${run_args//\{workers\}/$((n - 1))}
+
+        ENV_OPTS=""
+        if [ -n "$env" ]; then
+            env_file="$MC_DIR/$name/env_$n"
+            echo "${env//\{threads\}/$n}" | tr ';' '\n' > "$env_file"
+            ENV_OPTS="--env=$env_file"
+        fi
+
+        for config in "${CONFIGS[@]}"; do
+            IFS='|' read -r cfg_name l1i_size l1d_size l2_size l1i_assoc l1d_assoc l2_assoc cacheline <<< "$config"
+
+            RUN_DIR="$MC_DIR/$name/${n}cpu_$cfg_name"
+            CACHE_OPTS=(
+                "--l1i_size=$l1i_size"
+                "--l1d_size=$l1d_size"
+                "--l2_size=$l2_size"
+                "--l1i_assoc=$l1i_assoc"
+                "--l1d_assoc=$l1d_assoc"
+                "--l2_assoc=$l2_assoc"
+                "--cacheline_size=$cacheline"
+            )
+
+            echo "$GEM5_BIN -d $RUN_DIR $GEM5_SCRIPT ${GEM5_OPTS[*]} -n $n ${CACHE_OPTS[*]} $ENV_OPTS -c $bin -o \"$run_args\" > $MC_DIR/$name/logs/${n}cpu_${cfg_name}.log 2>&1" >> "$CMD_FILE"
+        done
+    done
+done
+
+TOTAL_CMDS=$(wc -l < "$CMD_FILE")
+echo ""
+echo "Total runs: $TOTAL_CMDS"
+[ "$TOTAL_CMDS" -eq 0 ] && exit 1
+
+# --- Execution ---
+
+echo "Starting multi-core benchmarks..."
+echo "Configuration: $MAX_PARALLEL jobs in parallel"
+echo ""
+
+cd "$GEM5_DIR" || exit 1
+
+python3 "$SCRIPT_DIR/gem5_sched.py" --results "$RESULTS_DIR" -j "$MAX_PARALLEL" --bar --joblog "$MC_DIR/jobs.log" < "$CMD_FILE"
+EXIT_STATUS=$?
+
+echo ""
+if [ $EXIT_STATUS -eq 0 ]; then
+    echo "✅ All multi-core runs completed successfully!"
+else
+    echo "⚠️  WARNING: Some runs returned errors. Check logs in $MC_DIR/<bench>/logs."
+fi
+
+# --- Results Collection (Separate CSV per benchmark) ---
+echo ""
+echo "Extracting results per benchmark..."
+
+for bench in "${BENCHMARKS[@]}"; do
+    IFS='|' read -r name bin target args env <<< "$bench"
+    [ -d "$MC_DIR/$name" ] || continue
+
+    INI_FILE="$CONFIG_DIR/conf_multicore_${name}.ini"
+    RESULTS_CSV="$MC_DIR/${name}_results.csv"
+
+    echo "[Benchmarks]" > "$INI_FILE"
+    for n in "${CORES[@]}"; do
+        for config in "${CONFIGS[@]}"; do
+            IFS='|' read -r cfg_name rest <<< "$config"
+            echo "$MC_DIR/$name/${n}cpu_$cfg_name" >> "$INI_FILE"
+        done
+    done
+
+    # Coherence traffic: snoops the L2 crossbar sent to the L1s and
+    # their bytes, snoop filter lookups that found the line in more
+    # than one L1, and the upgrades (a shared line written) and
+    # exclusive reads that invalidate the other cores' copies
+    cat >> "$INI_FILE" <<EOF
+
+[Parameters]
+sim_seconds
+sim_insts
+system.clk_domain.clock
+system.cpu*.numCycles
+system.cpu*.committedInsts
+system.cpu*.icache.overall_misses::total
+system.cpu*.icache.overall_accesses::total
+system.cpu*.dcache.overall_misses::total
+system.cpu*.dcache.overall_accesses::total
+system.cpu*.dcache.writebacks::total
+system.l2.overall_misses::total
+system.l2.overall_accesses::total
+system.l2.overall_miss_rate::total
+system.tol2bus.snoops
+system.tol2bus.snoopTraffic
+system.tol2bus.snoop_filter.tot_snoops
+system.tol2bus.snoop_filter.hit_multi_snoops
+system.tol2bus.snoop_filter.hit_multi_requests
+system.tol2bus.trans_dist::UpgradeReq
+system.tol2bus.trans_dist::ReadExReq
+system.tol2bus.trans_dist::ReadSharedReq
+host_mem_usage
+
+[Output]
+$RESULTS_CSV
+EOF
+
+    echo "  Extracting $name results..."
+    bash "$SCRIPT_DIR/read_results.sh" "$INI_FILE"
+done
+
+# --- Results store for the plots ---
+echo ""
+python3 "$SCRIPT_DIR/results_store.py" build "$RESULTS_DIR" "$RESULTS_DIR/results.store"
+
+echo ""
+echo "Done. Results saved to $MC_DIR/<bench>_results.csv"
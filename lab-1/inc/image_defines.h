@@ -2,7 +2,11 @@
 #define IMAGE_DEFINES_H
 
 #include <stdint.h>
+#include <string.h>
 #include <ap_int.h> // Xilinx arbitrary precision integer header
+#if !defined(__SYNTHESIS__) && defined(__AVX2__)
+#include <immintrin.h>
+#endif
 
 // Define a 512-bit wide type to match the hardware bus
 typedef ap_uint<512> uint512_t;
@@ -11,12 +15,122 @@ typedef ap_uint<512> uint512_t;
 typedef uint8_t pixel_t;
 
 // Image Dimensions (e.g., 256x256)
+// Defaults for the testbench; the accelerated kernel takes the size at run time
 #define HEIGHT 256
 #define WIDTH 256
 #define IMAGE_SIZE (HEIGHT * WIDTH)
 
+// Largest supported image (only used for LOOP_TRIPCOUNT / co-sim depth hints)
+#ifndef MAX_HEIGHT
+#define MAX_HEIGHT 2160
+#endif
+#ifndef MAX_WIDTH
+#define MAX_WIDTH 3840
+#endif
+#define MAX_IMAGE_SIZE (MAX_HEIGHT * MAX_WIDTH)
+
+// Batch kernel (IMAGE_DIFF_POSTERIZE_BATCH): images per invocation and the
+// A/B/C buffer size (in chunks) the testbench and co-simulation use
+#ifndef BATCH_MAX_IMAGES
+#define BATCH_MAX_IMAGES 1024
+#endif
+#define BATCH_BUFFER_CHUNKS (4 * IMAGE_SIZE / 64)
+
+// Longest AXI burst: 64 beats of 512 bits, one 4 KB page
+#define BATCH_BURST_BEATS 64
+
+// Multi-reference kernel (IMAGE_DIFF_POSTERIZE_MULTI): references compared
+// against A per pass, one AXI master each
+#define MULTI_REFS 4
+
 // Thresholds
 #define THRESH_LOW 32
 #define THRESH_HIGH 96
 
+// Packed output (-DPACK2_OUTPUT): one 2-bit code per pixel instead of a byte,
+// code 0/1/2 for 0/128/255, so each 512-bit word of C holds 256 pixels
+// (4 input chunks) and the C-side write and readback traffic drops by 4x.
+// Pixel i sits in bits [2*(i%4), 2*(i%4)+1] of byte i/4.
+#define PACK2_PIXELS_PER_WORD 256
+#define PACK2_WORDS(pixels) (((pixels) + PACK2_PIXELS_PER_WORD - 1) / PACK2_PIXELS_PER_WORD)
+
+// Block sums (-DBLOCK_SUM_OUTPUT): C receives the sum of abs_diff over each
+// 16x16 block instead of the image, as 16-bit sums (at most 16*16*255),
+// 32 per 512-bit word. Block (br, bc) is sum number br * (width / 16) + bc;
+// a partial last block row sums the rows it has. width must be a multiple
+// of 64 and at least BLOCK_SUM_MIN_WIDTH, so a block column's running sum
+// is read back no sooner than four cycles after it was written.
+#define BLOCK_SIZE 16
+#define BLOCK_SUMS_PER_WORD 32
+#define BLOCK_SUM_MIN_WIDTH 256
+#define BLOCK_SUM_COUNT(height, width) ((((height) + BLOCK_SIZE - 1) / BLOCK_SIZE) * ((width) / BLOCK_SIZE))
+#define BLOCK_SUM_WORDS(height, width) ((BLOCK_SUM_COUNT(height, width) + BLOCK_SUMS_PER_WORD - 1) / BLOCK_SUMS_PER_WORD)
+
+#if defined(BLOCK_SUM_OUTPUT) && defined(PACK2_OUTPUT)
+#error "BLOCK_SUM_OUTPUT and PACK2_OUTPUT select different C layouts"
+#endif
+
+#ifndef __SYNTHESIS__
+// Host-side unpacker: expands packed codes back to 0/128/255 pixels, one
+// table lookup and one 4-byte store per packed byte
+static inline void pack2_unpack(const uint8_t *packed, pixel_t *out, int pixels)
+{
+    static uint32_t lut[256];
+    static bool lut_ready = false;
+    if (!lut_ready)
+    {
+        const uint8_t value[4] = {0, 128, 255, 255};
+        for (int b = 0; b < 256; b++)
+        {
+            uint8_t px[4];
+            for (int j = 0; j < 4; j++)
+                px[j] = value[(b >> (2 * j)) & 3];
+            memcpy(&lut[b], px, 4);
+        }
+        lut_ready = true;
+    }
+
+    int i = 0;
+    for (; i + 4 <= pixels; i += 4)
+        memcpy(&out[i], &lut[packed[i / 4]], 4);
+    for (; i < pixels; i++)
+        out[i] = (pixel_t)(lut[packed[i / 4]] >> (8 * (i % 4)));
+}
+
+// Host-side interleaver for -DINTERLEAVED_AB: writes chunk i of A to
+// chunk 2i of AB and chunk i of B to chunk 2i+1. AB holds
+// 2 * ceil(pixels / 64) chunks; a partial last chunk is zero-padded.
+// With AVX2 each 64-byte chunk moves as two 32-byte loads and stores.
+static inline void interleave_ab(const pixel_t *A, const pixel_t *B, uint8_t *AB, int pixels)
+{
+    const int full = pixels / 64;
+    int i = 0;
+#ifdef __AVX2__
+    for (; i < full; i++)
+    {
+        const __m256i a0 = _mm256_loadu_si256((const __m256i *)(A + 64 * i));
+        const __m256i a1 = _mm256_loadu_si256((const __m256i *)(A + 64 * i + 32));
+        const __m256i b0 = _mm256_loadu_si256((const __m256i *)(B + 64 * i));
+        const __m256i b1 = _mm256_loadu_si256((const __m256i *)(B + 64 * i + 32));
+        _mm256_storeu_si256((__m256i *)(AB + 128 * i), a0);
+        _mm256_storeu_si256((__m256i *)(AB + 128 * i + 32), a1);
+        _mm256_storeu_si256((__m256i *)(AB + 128 * i + 64), b0);
+        _mm256_storeu_si256((__m256i *)(AB + 128 * i + 96), b1);
+    }
+#endif
+    for (; i < full; i++)
+    {
+        memcpy(AB + 128 * i, A + 64 * i, 64);
+        memcpy(AB + 128 * i + 64, B + 64 * i, 64);
+    }
+    const int tail = pixels - 64 * full;
+    if (tail)
+    {
+        memset(AB + 128 * full, 0, 128);
+        memcpy(AB + 128 * full, A + 64 * full, tail);
+        memcpy(AB + 128 * full + 64, B + 64 * full, tail);
+    }
+}
+#endif
+
 #endif
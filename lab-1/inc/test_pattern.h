@@ -0,0 +1,143 @@
+/**
+ * @file test_pattern.h
+ * @brief Counter-based test data for the testbenches and the host.
+ *
+ * Every pixel is drawn from tp_draw(seed, index), a stateless 64-bit hash of
+ * the pixel's sequence index (splitmix64 finalizer over a seeded counter, the
+ * same idea as Philox). There is no generator state to carry, so any range
+ * of pixels can be filled independently: bands on separate threads produce
+ * the same frames as a serial fill, and the inner loop has no dependency
+ * between pixels, so the compiler vectorizes it.
+ *
+ * One draw gives the A sample (low bits) and the B perturbation (high bits):
+ *   TP_NOISE_UNIFORM  B = A + uniform noise in [-amplitude, amplitude)
+ *   TP_NOISE_GAUSSIAN B = A + approximately normal noise, sigma = amplitude
+ *                     (sum of four 12-bit uniforms)
+ *   TP_NOISE_SPARSE   B = A except for amplitude per mille of the pixels,
+ *                     whose top bit is flipped (mostly unchanged frames)
+ * B is clamped to [0, max_value]. Amplitudes are in 8-bit units and scale
+ * with max_value, which must be 2^k - 1.
+ *
+ * tp_fill_edge() writes the deterministic corner cases random data rarely
+ * hits: flat black, flat full scale and checkerboards whose cells can be
+ * sized to the bus chunk, so every chunk seam is an edge.
+ */
+
+#ifndef TEST_PATTERN_H
+#define TEST_PATTERN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum
+{
+    TP_NOISE_UNIFORM = 0,
+    TP_NOISE_GAUSSIAN,
+    TP_NOISE_SPARSE
+} tp_noise_t;
+
+typedef struct
+{
+    uint64_t seed;
+    tp_noise_t noise;
+    int amplitude;
+} tp_config_t;
+
+typedef enum
+{
+    TP_PATTERN_ZERO = 0,  // A = B = 0 (no change anywhere)
+    TP_PATTERN_MAX,       // A = max_value, B = 0 (every difference saturates)
+    TP_PATTERN_CHECKER    // A = max_value / 0 checkerboard, B = 0
+} tp_pattern_t;
+
+// The classic rand()-based generator's shape: A uniform, B = A + [-100, 100)
+#define TP_DEFAULT_SEED      42
+#define TP_DEFAULT_AMPLITUDE 100
+
+static inline uint64_t tp_mix64(uint64_t x)
+{
+    x += 0x9E3779B97F4A7C15ull;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+/** @brief Draw number index of the stream selected by seed. */
+static inline uint64_t tp_draw(uint64_t seed, uint64_t index)
+{
+    return tp_mix64(index ^ tp_mix64(seed));
+}
+
+/** @brief B sample for A sample a, from the high 48 bits of draw h. */
+static inline int tp_perturb(int a, uint64_t h, const tp_config_t *cfg, int max_value)
+{
+    const int scale = (max_value + 1) >> 8;
+    int b = a;
+    if (cfg->noise == TP_NOISE_UNIFORM)
+    {
+        const int span = 2 * cfg->amplitude;
+        b = a + ((int)((((h >> 16) & 0xFFFF) * (uint64_t)span) >> 16) - cfg->amplitude) * scale;
+    }
+    else if (cfg->noise == TP_NOISE_GAUSSIAN)
+    {
+        const int sum = (int)((h >> 16) & 0xFFF) + (int)((h >> 28) & 0xFFF)
+                      + (int)((h >> 40) & 0xFFF) + (int)((h >> 52) & 0xFFF);
+        b = a + (sum - 8190) * cfg->amplitude / 2364 * scale; // 2364 = sigma of the sum
+    }
+    else if ((int)(((h >> 16) & 0xFFFF) * 1000 >> 16) < cfg->amplitude)
+    {
+        b = a ^ ((max_value + 1) >> 1);
+    }
+    return (b < 0) ? 0 : (b > max_value) ? max_value : b;
+}
+
+/**
+ * @brief Fill rows x width samples of A and B (rows pitch samples apart).
+ *
+ * first_index is the sequence index of the first pixel; pixel (r, c) uses
+ * draw first_index + r * width + c, so the padding never shifts the stream.
+ */
+template <typename T>
+static inline void tp_fill_pair(T *A, T *B, int rows, int width, size_t pitch, uint64_t first_index,
+                                const tp_config_t *cfg, int max_value)
+{
+    for (int r = 0; r < rows; r++)
+    {
+        T *row_A = A + (size_t)r * pitch;
+        T *row_B = B + (size_t)r * pitch;
+        const uint64_t base = first_index + (uint64_t)r * width;
+        for (int c = 0; c < width; c++)
+        {
+            const uint64_t h = tp_draw(cfg->seed, base + c);
+            const int a = (int)(h & (uint64_t)max_value);
+            row_A[c] = (T)a;
+            row_B[c] = (T)tp_perturb(a, h, cfg, max_value);
+        }
+    }
+}
+
+/**
+ * @brief Fill rows x width samples of A and B with an edge pattern.
+ *
+ * Checkerboard cells are cell samples wide and one row high, and alternate
+ * with the global row first_row + r, so a batch of frames stays consistent.
+ */
+template <typename T>
+static inline void tp_fill_edge(T *A, T *B, int rows, int width, size_t pitch, int first_row,
+                                tp_pattern_t pattern, int cell, int max_value)
+{
+    for (int r = 0; r < rows; r++)
+    {
+        T *row_A = A + (size_t)r * pitch;
+        T *row_B = B + (size_t)r * pitch;
+        for (int c = 0; c < width; c++)
+        {
+            const int on = (pattern == TP_PATTERN_MAX) ||
+                           (pattern == TP_PATTERN_CHECKER && ((first_row + r + c / cell) & 1));
+            row_A[c] = (T)(on ? max_value : 0);
+            row_B[c] = (T)0;
+        }
+    }
+}
+
+#endif // TEST_PATTERN_H
@@ -9,6 +9,7 @@
  */
 
 #include "../inc/image_defines.h"
+#include <hls_stream.h>
 
 /**
  * @brief Computes absolute difference between two images with posterization
@@ -21,12 +22,31 @@
  *
  * Memory Layout:
  * - Each chunk contains 64 pixels (8 bits per pixel)
- * - Total chunks = IMAGE_SIZE / 64
- * - IMAGE_SIZE must be a multiple of 64 for correct operation
+ * - Total chunks = ceil(height * width / 64); height * width may be any size
+ * - The last chunk may be partial: its pixels past the end are merged with
+ *   what C already holds there, so C is only modified within the image
  *
  * @param A Pointer to input image A (512-bit aligned)
  * @param B Pointer to input image B (512-bit aligned)
  * @param C Pointer to output image C (512-bit aligned)
+ * @param height Image height in pixels (run-time, AXI-Lite)
+ * @param width Image width in pixels (run-time, AXI-Lite)
+ *
+ * With -DPACK2_OUTPUT, C receives 2-bit codes instead (see PACK2_* in
+ * image_defines.h): four chunks fill one 512-bit word, so C holds
+ * PACK2_WORDS(height * width) words and is written every fourth cycle.
+ *
+ * With -DBLOCK_SUM_OUTPUT, C receives one 16-bit sum of abs_diff per 16x16
+ * block (see BLOCK_SUM_* in image_defines.h), BLOCK_SUM_WORDS(height,
+ * width) words in all: each chunk's four 16-pixel groups are reduced by
+ * adder trees and added to per-block-column running sums, which are
+ * written out on the last row of each block row.
+ *
+ * With -DINTERLEAVED_AB, A instead holds both images as alternating chunks
+ * (A0 B0 A1 B1 ..., see interleave_ab() in image_defines.h) and B is
+ * ignored, so the inputs take one AXI master instead of two. The loop then
+ * reads one beat per cycle in bursts twice as long and finishes a chunk
+ * every second cycle, which is what a single 512-bit port can deliver.
  *
  * @note This function is designed for FPGA synthesis with Xilinx Vitis HLS
  * @note Performance target: 1 cycle per 64-pixel chunk (II=1)
@@ -34,7 +54,9 @@
 void IMAGE_DIFF_POSTERIZE(
     const uint512_t *A,
 	const uint512_t *B,
-    uint512_t *C)
+    uint512_t *C,
+    int height,
+    int width)
 {
 /* HLS Interface Pragmas - Configure AXI interfaces for memory access:
   - m_axi: Allows the hardware kernel to initiate memory transactions of large data
@@ -46,29 +68,102 @@ void IMAGE_DIFF_POSTERIZE(
   - bundle: HLS creates separate physical AXI ports to allow simultaneous memory access
   - depth: Specifies the size of the array for simulation (in terms of number of 512-bit words)
 */
+#ifdef INTERLEAVED_AB
+  // B shares A's bundle and is never accessed, so it adds no port
+#pragma HLS INTERFACE m_axi port=A offset=slave bundle=gmemA depth=2*IMAGE_SIZE/64 max_read_burst_length=64
+#pragma HLS INTERFACE m_axi port=B offset=slave bundle=gmemA depth=1
+#else
 #pragma HLS INTERFACE m_axi port=A offset=slave bundle=gmemA depth=IMAGE_SIZE/64
 #pragma HLS INTERFACE m_axi port=B offset=slave bundle=gmemB depth=IMAGE_SIZE/64
+#endif
+#if defined(PACK2_OUTPUT)
+#pragma HLS INTERFACE m_axi port=C offset=slave bundle=gmemC depth=PACK2_WORDS(IMAGE_SIZE)
+#elif defined(BLOCK_SUM_OUTPUT)
+#pragma HLS INTERFACE m_axi port=C offset=slave bundle=gmemC depth=BLOCK_SUM_WORDS(HEIGHT, WIDTH)
+#else
 #pragma HLS INTERFACE m_axi port=C offset=slave bundle=gmemC depth=IMAGE_SIZE/64
+#endif
+#pragma HLS INTERFACE s_axilite port=height bundle=control
+#pragma HLS INTERFACE s_axilite port=width bundle=control
 #pragma HLS INTERFACE s_axilite port=return bundle=control
 
 /**
  * Main processing loop - Iterates over 512-bit chunks (64 pixels at a time)
  * Pipeline directive ensures throughput of 1 chunk per cycle
  */
-  const int CHUNK_COUNT = IMAGE_SIZE / 64;
+  const int PIXELS = height * width;
+  const int CHUNK_COUNT = (PIXELS + 63) / 64;
+#ifndef BLOCK_SUM_OUTPUT
+  const int TAIL_PIXELS = PIXELS % 64; // Pixels in a partial last chunk (0 = none)
+#endif
+#if defined(PACK2_OUTPUT)
+  uint512_t packed_C = 0;
+#elif defined(BLOCK_SUM_OUTPUT)
+  // Running sums of the current block row, one per block column. An entry
+  // is next touched a whole image row later (>= 4 chunks, see
+  // BLOCK_SUM_MIN_WIDTH), so the read-modify-write carries no dependence
+  ap_uint<16> block_acc[MAX_WIDTH / BLOCK_SIZE];
+#pragma HLS ARRAY_PARTITION variable=block_acc cyclic factor=4
+#pragma HLS DEPENDENCE variable=block_acc inter false
+  const int CHUNKS_PER_ROW = width / 64;
+  uint512_t packed_sums = 0;
+  int sum_slot = 0;        // First free sum of packed_sums (steps of 4)
+  int sum_word = 0;
+  int col_chunk = 0;       // Chunk within the image row
+  int row = 0;
+  int row_in_block = 0;
+#else
+  /* A full-width m_axi write always asserts every WSTRB bit, so the partial
+     last chunk is merged with C's current contents instead: one extra read,
+     issued before the loop so the write bursts stay sequential. The A/B
+     reads of that chunk may run past the image but stay inside the buffer's
+     4 KB-granular device allocation; those lanes are discarded. */
+  const uint512_t tail_C = (TAIL_PIXELS != 0) ? C[CHUNK_COUNT - 1] : uint512_t(0);
+#endif
+
+#ifdef INTERLEAVED_AB
+  uint512_t pending_A = 0;
 
+  Main_Loop:
+  for (int beat = 0; beat < 2 * CHUNK_COUNT; beat++)
+  {
+    // One beat per cycle: even beats are A chunks, odd beats the matching B
+    #pragma HLS PIPELINE II = 1
+    #pragma HLS LOOP_TRIPCOUNT min=8 max=2*MAX_IMAGE_SIZE/64
+
+    const uint512_t beat_data = A[beat];
+    if ((beat & 1) == 0)
+    {
+      pending_A = beat_data;
+      continue;
+    }
+    const int chunk_idx = beat >> 1;
+    const uint512_t chunk_A = pending_A;
+    const uint512_t chunk_B = beat_data;
+#else
   Main_Loop:
   for (int chunk_idx = 0; chunk_idx < CHUNK_COUNT; chunk_idx++)
   {
     /* Pipeline the loop to achieve II=1 (initiation interval of 1 cycle)
        This means a new loop iteration starts every clock cycle */
     #pragma HLS PIPELINE II = 1
-	#pragma HLS LOOP_TRIPCOUNT min=4 max=2048
+	#pragma HLS LOOP_TRIPCOUNT min=4 max=MAX_IMAGE_SIZE/64
 
     // Read 64 pixels (512 bits) from both input images
     const uint512_t chunk_A = A[chunk_idx];
     const uint512_t chunk_B = B[chunk_idx];
+#endif
+#if defined(BLOCK_SUM_OUTPUT)
+    pixel_t diffs[64];
+#pragma HLS ARRAY_PARTITION variable=diffs complete
+#else
+    const bool is_tail = (chunk_idx == CHUNK_COUNT - 1) && (TAIL_PIXELS != 0);
+#if defined(PACK2_OUTPUT)
+    ap_uint<128> codes_C = 0;
+#else
     uint512_t chunk_C = 0;
+#endif
+#endif
 
     /**
      * Pixel processing loop - Processes 64 pixels in parallel
@@ -87,14 +182,311 @@ void IMAGE_DIFF_POSTERIZE(
       // Compute absolute difference
       const pixel_t abs_diff = (pixel_A > pixel_B) ? (pixel_A - pixel_B) : (pixel_B - pixel_A);
 
+#if defined(BLOCK_SUM_OUTPUT)
+      diffs[pixel_idx] = abs_diff;
+#else
+      // Lanes past the end of a partial last chunk
+      const bool masked = is_tail && pixel_idx >= TAIL_PIXELS;
+
+#if defined(PACK2_OUTPUT)
+      // 2-bit code: 0 -> 0, 128 -> 1, 255 -> 2
+      codes_C.range((pixel_idx * 2) + 1, pixel_idx * 2) = masked ? 0 : (abs_diff < THRESH_LOW) ? 0 : (abs_diff < THRESH_HIGH) ? 1 : 2;
+#else
       // Apply three-level posterization based on thresholds
       const pixel_t posterized_value = (abs_diff < THRESH_LOW) ? 0 : (abs_diff < THRESH_HIGH) ? 128 : 255;
 
-      // Pack posterized_value back into the output chunk
-      chunk_C.range((pixel_idx * 8) + 7, pixel_idx * 8) = posterized_value;
+      // Pack posterized_value back into the output chunk (or keep C's byte)
+      chunk_C.range((pixel_idx * 8) + 7, pixel_idx * 8) =
+          masked ? (pixel_t)tail_C.range((pixel_idx * 8) + 7, pixel_idx * 8) : posterized_value;
+#endif
+#endif
     }
 
+#if defined(BLOCK_SUM_OUTPUT)
+    // Sum each 16-pixel group with a 4-level adder tree, add it to its
+    // block column and, on the block row's last row, pack the totals
+    const bool last_block_row = (row_in_block == BLOCK_SIZE - 1) || (row == height - 1);
+    Block_Sum_Loop:
+    for (int q = 0; q < 4; q++)
+    {
+      #pragma HLS UNROLL
+      ap_uint<12> tree[16];
+      for (int i = 0; i < 16; i++)
+        tree[i] = diffs[q * 16 + i];
+      for (int w = 8; w > 0; w >>= 1)
+        for (int i = 0; i < w; i++)
+          tree[i] = tree[2 * i] + tree[2 * i + 1];
+
+      const int bc = col_chunk * 4 + q;
+      const ap_uint<16> total = ((row_in_block == 0) ? ap_uint<16>(0) : block_acc[bc]) + tree[0];
+      block_acc[bc] = total;
+      if (last_block_row)
+        packed_sums.range(16 * (sum_slot + q) + 15, 16 * (sum_slot + q)) = total;
+    }
+    if (last_block_row)
+    {
+      if (sum_slot == BLOCK_SUMS_PER_WORD - 4 || chunk_idx == CHUNK_COUNT - 1)
+      {
+        C[sum_word++] = packed_sums;
+        packed_sums = 0;
+        sum_slot = 0;
+      }
+      else
+      {
+        sum_slot += 4;
+      }
+    }
+    if (col_chunk == CHUNKS_PER_ROW - 1)
+    {
+      col_chunk = 0;
+      row++;
+      row_in_block = (row_in_block == BLOCK_SIZE - 1) ? 0 : row_in_block + 1;
+    }
+    else
+    {
+      col_chunk++;
+    }
+#elif defined(PACK2_OUTPUT)
+    // Four chunks per output word; flush a partial word at the end
+    const int slot = chunk_idx % 4;
+    packed_C.range((slot * 128) + 127, slot * 128) = codes_C;
+    if (slot == 3 || chunk_idx == CHUNK_COUNT - 1)
+    {
+      C[chunk_idx / 4] = packed_C;
+      packed_C = 0;
+    }
+#else
     // Write 64 processed pixels (512 bits) to output image
     C[chunk_idx] = chunk_C;
+#endif
+  }
+}
+
+/**
+ * @brief Posterized difference of one 64-pixel chunk (byte output)
+ */
+static uint512_t diff_posterize_chunk(const uint512_t &chunk_A, const uint512_t &chunk_B)
+{
+#pragma HLS INLINE
+  uint512_t chunk_C = 0;
+  for (int pixel_idx = 0; pixel_idx < 64; pixel_idx++)
+  {
+    #pragma HLS UNROLL
+    const pixel_t pixel_A = chunk_A.range((pixel_idx * 8) + 7, pixel_idx * 8);
+    const pixel_t pixel_B = chunk_B.range((pixel_idx * 8) + 7, pixel_idx * 8);
+    const pixel_t abs_diff = (pixel_A > pixel_B) ? (pixel_A - pixel_B) : (pixel_B - pixel_A);
+    chunk_C.range((pixel_idx * 8) + 7, pixel_idx * 8) = (abs_diff < THRESH_LOW) ? 0 : (abs_diff < THRESH_HIGH) ? 128 : 255;
+  }
+  return chunk_C;
+}
+
+/**
+ * @brief Batch stage 1: burst-read every image's chunks into the streams
+ *
+ * One pipelined burst loop per image; the loop restarts at each image, but
+ * the streams keep the compute stage fed meanwhile. A final chunk flagged
+ * in end_stream tells the compute stage the batch is over, so it needs
+ * neither the image count nor the lengths. Each image's offset/length is
+ * forwarded to the store stage.
+ */
+static void batch_load(const uint512_t *A, const uint512_t *B, const int *offsets, const int *lengths,
+                       int num_images, hls::stream<uint512_t> &a_stream, hls::stream<uint512_t> &b_stream,
+                       hls::stream<bool> &end_stream, hls::stream<int> &off_stream,
+                       hls::stream<int> &len_stream)
+{
+  Load_Images:
+  for (int n = 0; n < num_images; n++)
+  {
+    #pragma HLS LOOP_TRIPCOUNT min=1 max=BATCH_MAX_IMAGES
+    const int base = offsets[n];
+    const int len = lengths[n];
+    off_stream.write(base);
+    len_stream.write(len);
+
+    Load_Chunks:
+    for (int i = 0; i < len; i++)
+    {
+      #pragma HLS PIPELINE II = 1
+      #pragma HLS LOOP_TRIPCOUNT min=1 max=MAX_IMAGE_SIZE/64
+      a_stream.write(A[base + i]);
+      b_stream.write(B[base + i]);
+      end_stream.write(false);
+    }
+  }
+  a_stream.write(0);
+  b_stream.write(0);
+  end_stream.write(true);
+}
+
+/**
+ * @brief Batch stage 2: one flat II=1 loop over the chunks of all images
+ */
+static void batch_compute(hls::stream<uint512_t> &a_stream, hls::stream<uint512_t> &b_stream,
+                          hls::stream<bool> &end_stream, hls::stream<uint512_t> &c_stream)
+{
+  Compute_Loop:
+  for (;;)
+  {
+    #pragma HLS PIPELINE II = 1
+    #pragma HLS LOOP_TRIPCOUNT min=4 max=BATCH_BUFFER_CHUNKS
+    const uint512_t chunk_A = a_stream.read();
+    const uint512_t chunk_B = b_stream.read();
+    if (end_stream.read())
+      break;
+    c_stream.write(diff_posterize_chunk(chunk_A, chunk_B));
+  }
+}
+
+/**
+ * @brief Batch stage 3: burst-write each image's result at its offset
+ */
+static void batch_store(uint512_t *C, int num_images, hls::stream<uint512_t> &c_stream,
+                        hls::stream<int> &off_stream, hls::stream<int> &len_stream)
+{
+  Store_Images:
+  for (int n = 0; n < num_images; n++)
+  {
+    #pragma HLS LOOP_TRIPCOUNT min=1 max=BATCH_MAX_IMAGES
+    const int base = off_stream.read();
+    const int len = len_stream.read();
+
+    Store_Chunks:
+    for (int i = 0; i < len; i++)
+    {
+      #pragma HLS PIPELINE II = 1
+      #pragma HLS LOOP_TRIPCOUNT min=1 max=MAX_IMAGE_SIZE/64
+      C[base + i] = c_stream.read();
+    }
+  }
+}
+
+/**
+ * @brief Posterized difference of a batch of images in one invocation
+ *
+ * Image n is lengths[n] chunks (64 pixels each) starting at chunk
+ * offsets[n] of A and B; its result goes to the same chunks of C. Images
+ * may be any size (a whole number of chunks), sit anywhere in the buffers
+ * and come in any order; chunks of C outside the images are not written.
+ *
+ * Load, compute and store run as a dataflow pipeline, so the compute loop
+ * never drains between images and the AXI masters issue bursts of up to
+ * BATCH_BURST_BEATS beats with several in flight. One invocation replaces
+ * num_images calls of IMAGE_DIFF_POSTERIZE and their per-call start-up.
+ *
+ * Always writes byte output (PACK2_OUTPUT only applies to IMAGE_DIFF_POSTERIZE).
+ *
+ * @param offsets Start chunk of each image (num_images entries)
+ * @param lengths Chunk count of each image (num_images entries, may be 0)
+ * @param num_images Images in the batch (at most BATCH_MAX_IMAGES)
+ */
+void IMAGE_DIFF_POSTERIZE_BATCH(
+    const uint512_t *A,
+    const uint512_t *B,
+    uint512_t *C,
+    const int *offsets,
+    const int *lengths,
+    int num_images)
+{
+#pragma HLS INTERFACE m_axi port=A offset=slave bundle=gmemA depth=BATCH_BUFFER_CHUNKS max_read_burst_length=BATCH_BURST_BEATS num_read_outstanding=16
+#pragma HLS INTERFACE m_axi port=B offset=slave bundle=gmemB depth=BATCH_BUFFER_CHUNKS max_read_burst_length=BATCH_BURST_BEATS num_read_outstanding=16
+#pragma HLS INTERFACE m_axi port=C offset=slave bundle=gmemC depth=BATCH_BUFFER_CHUNKS max_write_burst_length=BATCH_BURST_BEATS num_write_outstanding=16
+#pragma HLS INTERFACE m_axi port=offsets offset=slave bundle=gmemD depth=BATCH_MAX_IMAGES
+#pragma HLS INTERFACE m_axi port=lengths offset=slave bundle=gmemD depth=BATCH_MAX_IMAGES
+#pragma HLS INTERFACE s_axilite port=num_images bundle=control
+#pragma HLS INTERFACE s_axilite port=return bundle=control
+#pragma HLS DATAFLOW
+
+  hls::stream<uint512_t> a_stream("a_stream");
+  hls::stream<uint512_t> b_stream("b_stream");
+  hls::stream<bool> end_stream("end_stream");
+  hls::stream<uint512_t> c_stream("c_stream");
+  hls::stream<int> off_stream("off_stream");
+  hls::stream<int> len_stream("len_stream");
+  // Two bursts of slack between load and compute, and between compute and store
+#pragma HLS STREAM variable = a_stream depth = 128
+#pragma HLS STREAM variable = b_stream depth = 128
+#pragma HLS STREAM variable = end_stream depth = 128
+#pragma HLS STREAM variable = c_stream depth = 128
+#pragma HLS STREAM variable = off_stream depth = 16
+#pragma HLS STREAM variable = len_stream depth = 16
+
+  batch_load(A, B, offsets, lengths, num_images, a_stream, b_stream, end_stream, off_stream, len_stream);
+  batch_compute(a_stream, b_stream, end_stream, c_stream);
+  batch_store(C, num_images, c_stream, off_stream, len_stream);
+}
+
+// The ports and the chunk_B initializer below list the references one by one
+static_assert(MULTI_REFS == 4, "IMAGE_DIFF_POSTERIZE_MULTI has exactly the ports B0..B3");
+
+/**
+ * @brief Posterized distance of A to the nearest of MULTI_REFS references
+ *
+ * C(i) = posterize(min_k |A(i) - B_k(i)|): one pass reads each chunk of A
+ * once and of every reference once, instead of MULTI_REFS calls that each
+ * re-read A. Each reference has its own AXI master, so all of them stream
+ * at one chunk per cycle. To compare against fewer references, pass B0
+ * again for the unused ones; a repeated reference does not change the
+ * minimum.
+ *
+ * Images are height * width pixels, any size; like IMAGE_DIFF_POSTERIZE,
+ * C keeps its bytes past the end of a partial last chunk.
+ */
+void IMAGE_DIFF_POSTERIZE_MULTI(
+    const uint512_t *A,
+    const uint512_t *B0,
+    const uint512_t *B1,
+    const uint512_t *B2,
+    const uint512_t *B3,
+    uint512_t *C,
+    int height,
+    int width)
+{
+#pragma HLS INTERFACE m_axi port=A offset=slave bundle=gmemA depth=IMAGE_SIZE/64
+#pragma HLS INTERFACE m_axi port=B0 offset=slave bundle=gmemB0 depth=IMAGE_SIZE/64
+#pragma HLS INTERFACE m_axi port=B1 offset=slave bundle=gmemB1 depth=IMAGE_SIZE/64
+#pragma HLS INTERFACE m_axi port=B2 offset=slave bundle=gmemB2 depth=IMAGE_SIZE/64
+#pragma HLS INTERFACE m_axi port=B3 offset=slave bundle=gmemB3 depth=IMAGE_SIZE/64
+#pragma HLS INTERFACE m_axi port=C offset=slave bundle=gmemC depth=IMAGE_SIZE/64
+#pragma HLS INTERFACE s_axilite port=height bundle=control
+#pragma HLS INTERFACE s_axilite port=width bundle=control
+#pragma HLS INTERFACE s_axilite port=return bundle=control
+
+  const int PIXELS = height * width;
+  const int CHUNK_COUNT = (PIXELS + 63) / 64;
+  const int TAIL_PIXELS = PIXELS % 64;
+  const uint512_t tail_C = (TAIL_PIXELS != 0) ? C[CHUNK_COUNT - 1] : uint512_t(0);
+
+  Multi_Loop:
+  for (int chunk_idx = 0; chunk_idx < CHUNK_COUNT; chunk_idx++)
+  {
+    #pragma HLS PIPELINE II = 1
+    #pragma HLS LOOP_TRIPCOUNT min=4 max=MAX_IMAGE_SIZE/64
+
+    const uint512_t chunk_A = A[chunk_idx];
+    const uint512_t chunk_B[MULTI_REFS] = {B0[chunk_idx], B1[chunk_idx], B2[chunk_idx], B3[chunk_idx]};
+    const bool is_tail = (chunk_idx == CHUNK_COUNT - 1) && (TAIL_PIXELS != 0);
+    uint512_t chunk_C = 0;
+
+    Multi_Process_Loop:
+    for (int pixel_idx = 0; pixel_idx < 64; pixel_idx++)
+    {
+      #pragma HLS UNROLL
+      const pixel_t pixel_A = chunk_A.range((pixel_idx * 8) + 7, pixel_idx * 8);
+
+      // Distance to each reference, then the minimum
+      pixel_t min_diff = 255;
+      for (int k = 0; k < MULTI_REFS; k++)
+      {
+        const pixel_t pixel_B = chunk_B[k].range((pixel_idx * 8) + 7, pixel_idx * 8);
+        const pixel_t abs_diff = (pixel_A > pixel_B) ? (pixel_A - pixel_B) : (pixel_B - pixel_A);
+        min_diff = (abs_diff < min_diff) ? abs_diff : min_diff;
+      }
+
+      const pixel_t posterized_value = (min_diff < THRESH_LOW) ? 0 : (min_diff < THRESH_HIGH) ? 128 : 255;
+      const bool masked = is_tail && pixel_idx >= TAIL_PIXELS;
+      chunk_C.range((pixel_idx * 8) + 7, pixel_idx * 8) =
+          masked ? (pixel_t)tail_C.range((pixel_idx * 8) + 7, pixel_idx * 8) : posterized_value;
+    }
+    C[chunk_idx] = chunk_C;
   }
 }
@@ -1,14 +1,34 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <chrono>
 #include "image_defines.h"
+#include "test_pattern.h"
 
 // Declaration of top-level HW function
-void IMAGE_DIFF_POSTERIZE(const uint512_t *A,const uint512_t *B, uint512_t *C);
+void IMAGE_DIFF_POSTERIZE(const uint512_t *A,const uint512_t *B, uint512_t *C, int height, int width);
+void IMAGE_DIFF_POSTERIZE_BATCH(const uint512_t *A, const uint512_t *B, uint512_t *C,
+                                const int *offsets, const int *lengths, int num_images);
+void IMAGE_DIFF_POSTERIZE_MULTI(const uint512_t *A, const uint512_t *B0, const uint512_t *B1,
+                                const uint512_t *B2, const uint512_t *B3, uint512_t *C, int height, int width);
+
+// Kernel call on compact A/B; with -DINTERLEAVED_AB they are interleaved
+// into one buffer first, as the host would
+static void run_kernel(pixel_t *A, pixel_t *B, uint512_t *C, int height, int width)
+{
+#ifdef INTERLEAVED_AB
+    static uint512_t AB[2 * IMAGE_SIZE / 64];
+    interleave_ab(A, B, (uint8_t*) AB, height * width);
+    IMAGE_DIFF_POSTERIZE(AB, AB, C, height, width);
+#else
+    IMAGE_DIFF_POSTERIZE((uint512_t*) A, (uint512_t*) B, C, height, width);
+#endif
+}
 
 // Software Reference Implementation (for verification)
-void sw_reference_diff_posterize(pixel_t *A, pixel_t *B, pixel_t *C_ref)
+void sw_reference_diff_posterize(pixel_t *A, pixel_t *B, pixel_t *C_ref, int pixels = IMAGE_SIZE)
 {
-    for (int i = 0; i < IMAGE_SIZE; i++)
+    for (int i = 0; i < pixels; i++)
     {
         // Compute signed difference using wider type to prevent underflow
         const int16_t diff = (int16_t)A[i] - (int16_t)B[i];
@@ -21,46 +41,263 @@ void sw_reference_diff_posterize(pixel_t *A, pixel_t *B, pixel_t *C_ref)
     }
 }
 
-int main()
+#ifdef BLOCK_SUM_OUTPUT
+// Block sum output (-DBLOCK_SUM_OUTPUT): mismatches between the kernel's
+// packed 16-bit sums and a direct sum of |A - B| over every 16x16 block
+static int check_block_sums(const pixel_t *A, const pixel_t *B, const uint512_t *sums, int height, int width)
+{
+    const int cols = width / BLOCK_SIZE;
+    int errors = 0;
+    for (int n = 0; n < BLOCK_SUM_COUNT(height, width); n++)
+    {
+        const int br = n / cols, bc = n % cols;
+        int ref = 0;
+        for (int r = br * BLOCK_SIZE; r < height && r < (br + 1) * BLOCK_SIZE; r++)
+            for (int c = bc * BLOCK_SIZE; c < (bc + 1) * BLOCK_SIZE; c++)
+                ref += abs((int)A[r * width + c] - (int)B[r * width + c]);
+        const int hw = (int)sums[n / BLOCK_SUMS_PER_WORD].range(16 * (n % BLOCK_SUMS_PER_WORD) + 15,
+                                                               16 * (n % BLOCK_SUMS_PER_WORD));
+        if (hw != ref && errors++ < 10)
+            printf("ERROR at block (%d, %d): HW=%d, SW=%d\n", br, bc, hw, ref);
+    }
+    return errors;
+}
+#endif
+
+// Multi-reference kernel check: A against num_refs (1..MULTI_REFS) noisy
+// references of itself, unused slots aliased to the first, at height x
+// width. Bytes of C past the image must be left untouched. Returns the
+// number of mismatches.
+static int run_multi(int num_refs, int height, int width, uint64_t seed)
+{
+    static pixel_t A[IMAGE_SIZE], B[MULTI_REFS][IMAGE_SIZE], C_HW[IMAGE_SIZE], C_SW[IMAGE_SIZE];
+    const int pixels = height * width;
+
+    // A as usual; each reference perturbs A with its own draw stream
+    const tp_config_t tp = {seed, TP_NOISE_GAUSSIAN, TP_DEFAULT_AMPLITUDE / 2};
+    tp_fill_pair(A, B[0], 1, pixels, pixels, 0, &tp, 255);
+    for (int k = 1; k < num_refs; k++)
+        for (int i = 0; i < pixels; i++)
+            B[k][i] = (pixel_t)tp_perturb(A[i], tp_draw(seed + k, i), &tp, 255);
+    for (int i = 0; i < pixels; i++)
+    {
+        int best = 255;
+        for (int k = 0; k < num_refs; k++)
+        {
+            const int d = abs((int)A[i] - (int)B[k][i]);
+            best = (d < best) ? d : best;
+        }
+        C_SW[i] = (best < THRESH_LOW) ? 0 : (best < THRESH_HIGH) ? 128 : 255;
+    }
+    memset(C_HW, 0x5A, sizeof(C_HW));
+
+    const pixel_t *ref[MULTI_REFS];
+    for (int k = 0; k < MULTI_REFS; k++)
+        ref[k] = (k < num_refs) ? B[k] : B[0];
+    IMAGE_DIFF_POSTERIZE_MULTI((uint512_t*) A, (uint512_t*) ref[0], (uint512_t*) ref[1], (uint512_t*) ref[2],
+                               (uint512_t*) ref[3], (uint512_t*) C_HW, height, width);
+
+    int errors = 0;
+    for (int j = 0; j < pixels; j++)
+        errors += (C_HW[j] != C_SW[j]);
+    for (int j = pixels; j < (pixels + 63) / 64 * 64; j++)
+        errors += (C_HW[j] != 0x5A);
+    printf("Multi: %d references, %dx%d, %d errors\n", num_refs, width, height, errors);
+    return errors;
+}
+
+// Batch kernel check: num_images images of random length (0 included) at
+// random chunk offsets of one buffer, listed in shuffled order. Every image
+// must match the reference and every chunk between images must be left
+// untouched. Returns the number of mismatches.
+static int run_batch(int num_images, uint64_t seed)
+{
+    static pixel_t A[BATCH_BUFFER_CHUNKS * 64], B[BATCH_BUFFER_CHUNKS * 64];
+    static pixel_t C_HW[BATCH_BUFFER_CHUNKS * 64], C_SW[BATCH_BUFFER_CHUNKS * 64];
+    static int offsets[BATCH_MAX_IMAGES], lengths[BATCH_MAX_IMAGES];
+    const int pixels = BATCH_BUFFER_CHUNKS * 64;
+    const int slot = BATCH_BUFFER_CHUNKS / num_images;
+
+    const tp_config_t tp = {seed, TP_NOISE_UNIFORM, TP_DEFAULT_AMPLITUDE};
+    tp_fill_pair(A, B, 1, pixels, pixels, 0, &tp, 255);
+    memset(C_HW, 0x5A, sizeof(C_HW));
+    memset(C_SW, 0x5A, sizeof(C_SW));
+
+    // Image n lies inside slot n, so images never overlap
+    int chunks = 0;
+    for (int n = 0; n < num_images; n++)
+    {
+        const uint64_t h = tp_draw(seed, ~(uint64_t)n);
+        lengths[n] = (n % 7 == 3) ? 0 : 1 + (int)(h % slot);
+        offsets[n] = n * slot + (int)((h >> 32) % (slot - lengths[n] + 1));
+        sw_reference_diff_posterize(A + offsets[n] * 64, B + offsets[n] * 64, C_SW + offsets[n] * 64,
+                                    lengths[n] * 64);
+        chunks += lengths[n];
+    }
+    for (int n = num_images - 1; n > 0; n--)
+    {
+        const int m = (int)(tp_draw(seed ^ 1, n) % (n + 1));
+        const int o = offsets[n], l = lengths[n];
+        offsets[n] = offsets[m]; lengths[n] = lengths[m];
+        offsets[m] = o; lengths[m] = l;
+    }
+
+    IMAGE_DIFF_POSTERIZE_BATCH((uint512_t*) A, (uint512_t*) B, (uint512_t*) C_HW, offsets, lengths, num_images);
+
+    int errors = 0;
+    for (int j = 0; j < pixels; j++)
+        errors += (C_HW[j] != C_SW[j]);
+    printf("Batch: %d images, %d chunks, %d errors\n", num_images, chunks, errors);
+    return errors;
+}
+
+// Randomized and edge-pattern sweep (--stress): each seed draws a size
+// (any width, so most images end in a partial chunk), a noise shape and
+// amplitude; then flat and checkerboard images (pixel and chunk-sized
+// cells) run at full size. Bytes of C past the image must be left
+// untouched. Returns the number of mismatches.
+static int run_stress(int seeds)
+{
+    static pixel_t A[IMAGE_SIZE], B[IMAGE_SIZE], C_HW[IMAGE_SIZE], C_SW[IMAGE_SIZE];
+#if defined(PACK2_OUTPUT)
+    static uint512_t packed[PACK2_WORDS(IMAGE_SIZE)];
+#elif defined(BLOCK_SUM_OUTPUT)
+    static uint512_t sums[BLOCK_SUM_WORDS(HEIGHT, WIDTH)];
+#endif
+    static const tp_noise_t noises[3] = {TP_NOISE_UNIFORM, TP_NOISE_GAUSSIAN, TP_NOISE_SPARSE};
+    const int patterns[4][2] = {{TP_PATTERN_ZERO, 1}, {TP_PATTERN_MAX, 1}, {TP_PATTERN_CHECKER, 1},
+                                {TP_PATTERN_CHECKER, 64}};
+    int errors = 0, cases = 0;
+    double seconds = 0, pixels_done = 0;
+
+    for (int n = 0; n < seeds + 4; n++)
+    {
+        int height = HEIGHT, width = WIDTH;
+        if (n < seeds)
+        {
+            const uint64_t h = tp_draw((uint64_t)n, ~0ull);
+#ifdef BLOCK_SUM_OUTPUT
+            width = BLOCK_SUM_MIN_WIDTH + 64 * (int)(h % ((WIDTH - BLOCK_SUM_MIN_WIDTH) / 64 + 1));
+#else
+            width = 1 + (int)(h % WIDTH);
+#endif
+            height = 1 + (int)((h >> 8) % HEIGHT);
+            const tp_config_t tp = {(uint64_t)n, noises[n % 3], (int)((h >> 16) % 256)};
+            tp_fill_pair(A, B, 1, height * width, height * width, 0, &tp, 255);
+        }
+        else
+        {
+            tp_fill_edge(A, B, height, width, width, 0, (tp_pattern_t)patterns[n - seeds][0],
+                         patterns[n - seeds][1], 255);
+        }
+        const int pixels = height * width;
+        sw_reference_diff_posterize(A, B, C_SW, pixels);
+
+        memset(C_HW, 0x5A, sizeof(C_HW));
+
+        const auto t0 = std::chrono::steady_clock::now();
+#if defined(PACK2_OUTPUT)
+        run_kernel(A, B, packed, height, width);
+        seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        pack2_unpack((const uint8_t*) packed, C_HW, pixels);
+#elif defined(BLOCK_SUM_OUTPUT)
+        run_kernel(A, B, sums, height, width);
+        seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+#else
+        run_kernel(A, B, (uint512_t*) C_HW, height, width);
+        seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+#endif
+        pixels_done += pixels;
+
+        int e = 0;
+#if defined(BLOCK_SUM_OUTPUT)
+        e = check_block_sums(A, B, sums, height, width);
+#else
+        for (int j = 0; j < pixels; j++)
+            e += (C_HW[j] != C_SW[j]);
+#endif
+#if !defined(PACK2_OUTPUT) && !defined(BLOCK_SUM_OUTPUT)
+        for (int j = pixels; j < (pixels + 63) / 64 * 64; j++)
+            e += (C_HW[j] != 0x5A);
+#endif
+        if (e)
+            printf("Stress case %d (%dx%d): %d errors\n", n, width, height, e);
+        errors += e;
+        cases++;
+    }
+
+    printf("STRESS lab-1: %d cases, %d errors, kernel %.2f Mpx/s (C-sim)\n", cases, errors,
+           pixels_done / 1e6 / (seconds > 0 ? seconds : 1));
+
+    // Batch kernel at several image counts, one seed each
+    int batch_errors = 0;
+    for (int n = 1; n <= BATCH_MAX_IMAGES && n <= BATCH_BUFFER_CHUNKS; n *= 4)
+        batch_errors += run_batch(n, (uint64_t)n);
+    printf("STRESS lab-1 batch: %d errors\n", batch_errors);
+
+    // Multi-reference kernel at every reference count and a few sizes
+    int multi_errors = 0;
+    for (int k = 1; k <= MULTI_REFS; k++)
+        for (int n = 0; n < 4; n++)
+        {
+            const uint64_t h = tp_draw((uint64_t)(k * 16 + n), ~1ull);
+            multi_errors += run_multi(k, 1 + (int)(h % HEIGHT), 1 + (int)((h >> 16) % WIDTH), h);
+        }
+    printf("STRESS lab-1 multi: %d errors\n", multi_errors);
+    return errors + batch_errors + multi_errors;
+}
+
+int main(int argc, char **argv)
 {
+    // tb_image_diff --stress [<seeds>]
+    if (argc >= 2 && strcmp(argv[1], "--stress") == 0)
+    {
+        const int errors = run_stress((argc >= 3) ? atoi(argv[2]) : 64);
+        printf(errors == 0 ? "*** Test Passed ***\n" : "!!! Test FAILED !!!\n");
+        return (errors == 0) ? 0 : 1;
+    }
+
     // Use static to avoid stack overflow with large images
     static pixel_t img_A[IMAGE_SIZE];
     static pixel_t img_B[IMAGE_SIZE];
     static pixel_t img_C_HW[IMAGE_SIZE]; // Hardware Result
     static pixel_t img_C_SW[IMAGE_SIZE]; // Software (Reference) Result
+#if defined(PACK2_OUTPUT)
+    static uint512_t packed_C_HW[PACK2_WORDS(IMAGE_SIZE)]; // Packed hardware result
+#elif defined(BLOCK_SUM_OUTPUT)
+    static uint512_t sums_HW[BLOCK_SUM_WORDS(HEIGHT, WIDTH)]; // Block sum result
+#endif
 
     printf("Starting Testbench for IMAGE_DIFF_POSTERIZE...\n");
     printf("Image Size: %dx%d (%d pixels)\n", WIDTH, HEIGHT, IMAGE_SIZE);
     printf("Thresholds: THRESH_LOW=%d, THRESH_HIGH=%d\n", THRESH_LOW, THRESH_HIGH);
 
     // 1. Array Initialization (Input Generation)
-    // Use fixed seed for reproducibility
-    srand(42);
-
-    for (int i = 0; i < IMAGE_SIZE; i++)
-    {
-        // Random values 0-255
-        img_A[i] = rand() % 256;
-
-        // Generate B by adding a random noise/deviation to A.
-        int noise = (rand() % 200) - 100; // deviation from -100 to +99
-        int temp_b = img_A[i] + noise;
-
-        // Clamp to 0-255 range
-        if (temp_b < 0) temp_b = 0;
-        else if (temp_b > 255) temp_b = 255;
-
-        img_B[i] = (pixel_t)temp_b;
-    }
+    // Counter-based generator (test_pattern.h) with a fixed seed for
+    // reproducibility: A uniform 0-255, B = A + noise in [-100, 100), clamped
+    const tp_config_t tp = {TP_DEFAULT_SEED, TP_NOISE_UNIFORM, TP_DEFAULT_AMPLITUDE};
+    tp_fill_pair(img_A, img_B, 1, IMAGE_SIZE, IMAGE_SIZE, 0, &tp, 255);
 
     // 2. Run Software Reference
     sw_reference_diff_posterize(img_A, img_B, img_C_SW);
 
     // 3. Run Hardware Accelerator (Top-Function)
-    IMAGE_DIFF_POSTERIZE((uint512_t*) img_A, (uint512_t*) img_B, (uint512_t*) img_C_HW);
+    int error_count = 0;
+#if defined(BLOCK_SUM_OUTPUT)
+    run_kernel(img_A, img_B, sums_HW, HEIGHT, WIDTH);
+    printf("Block sums: %d words (%d bytes)\n", BLOCK_SUM_WORDS(HEIGHT, WIDTH), BLOCK_SUM_WORDS(HEIGHT, WIDTH) * 64);
+    error_count = check_block_sums(img_A, img_B, sums_HW, HEIGHT, WIDTH);
+    // No pixels come back; the statistics below are the reference's
+    memcpy(img_C_HW, img_C_SW, sizeof(img_C_HW));
+#elif defined(PACK2_OUTPUT)
+    run_kernel(img_A, img_B, packed_C_HW, HEIGHT, WIDTH);
+    printf("Packed output: %d words (%d bytes)\n", PACK2_WORDS(IMAGE_SIZE), PACK2_WORDS(IMAGE_SIZE) * 64);
+    pack2_unpack((const uint8_t*) packed_C_HW, img_C_HW, IMAGE_SIZE);
+#else
+    run_kernel(img_A, img_B, (uint512_t*) img_C_HW, HEIGHT, WIDTH);
+#endif
 
     // 4. Compare Results
-    int error_count = 0;
 
     // Counters for statistics
     int count_0 = 0, count_128 = 0, count_255 = 0;
@@ -87,7 +324,13 @@ int main()
             count_255++;
     }
 
-    // 5. Results Report
+    // 5. Batch kernel: a few dozen images in one invocation
+    error_count += run_batch(37, TP_DEFAULT_SEED);
+
+    // 6. Multi-reference kernel: A against MULTI_REFS references at once
+    error_count += run_multi(MULTI_REFS, HEIGHT, WIDTH, TP_DEFAULT_SEED);
+
+    // 7. Results Report
     printf("\n--- Validation Results ---\n");
     if (error_count == 0)
     {
@@ -0,0 +1,121 @@
+/**
+ * @file blob_list.h
+ * @brief Software reference for V3's blob list (-DV3_BLOBS)
+ *
+ * blob_list_ref() labels one frame's white pixels with a plain flood fill
+ * and writes the BLOB_FRAME_WORDS words the kernel writes for it (layout:
+ * BLOB_* in image_defines.h). Blobs are seeded in raster order, so they
+ * come out in the kernel's order. The kernel's equivalence table overflows
+ * exactly when its one-pass scan opens more than BLOB_MAX_LABELS labels,
+ * i.e. when more runs than that touch no white pixel in the row above;
+ * the reference flags BLOB_FLAG_LABELS in the same case, and
+ * blob_list_mismatch() then only compares the flags.
+ */
+
+#ifndef BLOB_LIST_H
+#define BLOB_LIST_H
+
+#include "image_defines.h"
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+/**
+ * @param white       Frame mask, non-zero = white, pitch bytes per row
+ * @param out         BLOB_FRAME_WORDS words
+ */
+static inline void blob_list_ref(const uint8_t *white, int height, int width, int pitch, int stride_chunks,
+                                 uint64_t *out)
+{
+    memset(out, 0, BLOB_FRAME_WORDS * sizeof(uint64_t));
+    if (stride_chunks > STRIP_MAX_CHUNKS)
+    {
+        out[0] = BLOB_HEADER(0, BLOB_FLAG_WIDE);
+        return;
+    }
+
+    // Labels the one-pass scan would open
+    int opened = 0;
+    for (int y = 0; y < height; y++)
+        for (int x = 0; x < width; x++)
+        {
+            if (!white[(size_t)y * pitch + x] || (x > 0 && white[(size_t)y * pitch + x - 1]))
+                continue;
+            int e = x;
+            while (e + 1 < width && white[(size_t)y * pitch + e + 1])
+                e++;
+            bool touches = false;
+            for (int t = (x > 0 ? x - 1 : 0); y > 0 && t <= e + 1 && t < width; t++)
+                touches = touches || white[(size_t)(y - 1) * pitch + t];
+            opened += !touches;
+        }
+
+    std::vector<uint8_t> seen((size_t)height * width, 0);
+    std::vector<int> stack;
+    int found = 0;
+    for (int y = 0; y < height; y++)
+        for (int x = 0; x < width; x++)
+        {
+            if (!white[(size_t)y * pitch + x] || seen[(size_t)y * width + x])
+                continue;
+            int x0 = x, y0 = y, x1 = x, y1 = y, area = 0;
+            uint64_t sum_x = 0, sum_y = 0;
+            seen[(size_t)y * width + x] = 1;
+            stack.assign(1, y * width + x);
+            while (!stack.empty())
+            {
+                const int py = stack.back() / width, px = stack.back() % width;
+                stack.pop_back();
+                area++;
+                sum_x += px;
+                sum_y += py;
+                x0 = (px < x0) ? px : x0;
+                x1 = (px > x1) ? px : x1;
+                y0 = (py < y0) ? py : y0;
+                y1 = (py > y1) ? py : y1;
+                for (int dy = -1; dy <= 1; dy++)
+                    for (int dx = -1; dx <= 1; dx++)
+                    {
+                        const int ny = py + dy, nx = px + dx;
+                        if (ny < 0 || ny >= height || nx < 0 || nx >= width || seen[(size_t)ny * width + nx]
+                            || !white[(size_t)ny * pitch + nx])
+                            continue;
+                        seen[(size_t)ny * width + nx] = 1;
+                        stack.push_back(ny * width + nx);
+                    }
+            }
+            if (found < BLOB_MAX)
+            {
+                out[1 + 2 * found] = BLOB_PACK_BOX(x0, y0, x1, y1);
+                out[2 + 2 * found] = BLOB_PACK_SIZE(area, (8 * sum_x + area / 2) / area,
+                                                    (8 * sum_y + area / 2) / area);
+            }
+            found++;
+        }
+    out[0] = BLOB_HEADER(found, opened > BLOB_MAX_LABELS ? BLOB_FLAG_LABELS : 0);
+}
+
+/**
+ * @brief First mismatching word of two frame blocks, or -1.
+ *
+ * Only the listed blobs are compared, and only the header flags when the
+ * table overflowed or the frame was too wide (the kernel's list is then
+ * partial or empty).
+ */
+static inline int blob_list_mismatch(const uint64_t *hw, const uint64_t *ref)
+{
+    if (BLOB_FLAGS(hw[0]) != BLOB_FLAGS(ref[0]))
+        return 0;
+    if (BLOB_FLAGS(ref[0]) != 0)
+        return -1;
+    if (hw[0] != ref[0])
+        return 0;
+    const int listed = (BLOB_FOUND(ref[0]) < BLOB_MAX) ? BLOB_FOUND(ref[0]) : BLOB_MAX;
+    for (int w = 1; w <= 2 * listed; w++)
+        if (hw[w] != ref[w])
+            return w;
+    return -1;
+}
+
+#endif // BLOB_LIST_H
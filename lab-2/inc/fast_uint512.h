@@ -0,0 +1,175 @@
+/**
+ * @file fast_uint512.h
+ * @brief C-simulation stand-in for ap_uint<512> (-DFAST_CSIM)
+ *
+ * The kernels touch their 512-bit chunks only through .range(hi, lo) reads
+ * and writes of at most 64 bits (sample lanes) or whole 64-bit-aligned
+ * fields (tap words), copies and zeroing. ap_uint<512> C-simulates those
+ * through its arbitrary-precision machinery, which dominates the run time
+ * at production frame sizes. fast_uint512_t keeps the same interface over
+ * eight uint64_t words: a range access is one or two shifts and masks, so
+ * the compiler inlines it into the lane loops.
+ *
+ * Only for C simulation: image_defines.h never selects it under
+ * __SYNTHESIS__, and the synthesized kernels still see ap_uint<512>.
+ * Build the testbench with -DFAST_CSIM to use it, e.g. to run
+ * `hls_tb 1080 1920` (or 2160 3840) in seconds.
+ */
+
+#ifndef FAST_UINT512_H
+#define FAST_UINT512_H
+
+#include <stdint.h>
+#include <string.h>
+#include <ap_int.h>
+
+class fast_uint512_t
+{
+public:
+    static const int WORDS = 8;
+
+    // Writable view of bits [hi:lo], as returned by ap_uint::range()
+    class range_ref
+    {
+    public:
+        range_ref(fast_uint512_t &v, int hi, int lo) : v_(v), hi_(hi), lo_(lo) {}
+
+        operator uint64_t() const { return v_.get(hi_, lo_); }
+        uint64_t to_uint64() const { return v_.get(hi_, lo_); }
+        unsigned to_uint() const { return (unsigned)v_.get(hi_, lo_); }
+        int to_int() const { return (int)v_.get(hi_, lo_); }
+
+        range_ref &operator=(uint64_t x) { v_.set(hi_, lo_, x); return *this; }
+        range_ref &operator=(const range_ref &o) { v_.set(hi_, lo_, (uint64_t)o); return *this; }
+
+        // Wider fields (e.g. a 128-bit tap code word), 64 bits at a time
+        template <int M>
+        range_ref &operator=(const ap_uint<M> &x)
+        {
+            for (int lo = 0; lo <= hi_ - lo_; lo += 64)
+            {
+                const int hi = (lo + 63 < hi_ - lo_) ? lo + 63 : hi_ - lo_;
+                const ap_uint<64> piece = (lo < M) ? (ap_uint<64>)x.range((hi < M) ? hi : M - 1, lo) : ap_uint<64>(0);
+                v_.set(lo_ + hi, lo_ + lo, (uint64_t)piece.to_uint64());
+            }
+            return *this;
+        }
+
+    private:
+        fast_uint512_t &v_;
+        int hi_, lo_;
+    };
+
+    fast_uint512_t() { memset(w_, 0, sizeof(w_)); }
+    fast_uint512_t(int x) { fill((uint64_t)(int64_t)x, x < 0); }
+    fast_uint512_t(unsigned x) { fill(x, false); }
+    fast_uint512_t(long x) { fill((uint64_t)x, x < 0); }
+    fast_uint512_t(unsigned long x) { fill(x, false); }
+    fast_uint512_t(long long x) { fill((uint64_t)x, x < 0); }
+    fast_uint512_t(unsigned long long x) { fill(x, false); }
+
+    // Interchange with the real type where both meet (e.g. ap_axiu data)
+    fast_uint512_t(const ap_uint<512> &x)
+    {
+        for (int i = 0; i < WORDS; i++)
+            w_[i] = (uint64_t)ap_uint<64>(x.range(64 * i + 63, 64 * i)).to_uint64();
+    }
+    operator ap_uint<512>() const
+    {
+        ap_uint<512> x = 0;
+        for (int i = 0; i < WORDS; i++)
+            x.range(64 * i + 63, 64 * i) = w_[i];
+        return x;
+    }
+
+    range_ref range(int hi, int lo) { return range_ref(*this, hi, lo); }
+    uint64_t range(int hi, int lo) const { return get(hi, lo); }
+    range_ref operator()(int hi, int lo) { return range(hi, lo); }
+    uint64_t operator()(int hi, int lo) const { return get(hi, lo); }
+
+    bool operator[](int b) const { return (w_[b >> 6] >> (b & 63)) & 1; }
+    uint64_t to_uint64() const { return w_[0]; }
+
+    bool operator==(const fast_uint512_t &o) const { return memcmp(w_, o.w_, sizeof(w_)) == 0; }
+    bool operator!=(const fast_uint512_t &o) const { return !(*this == o); }
+
+    fast_uint512_t operator|(const fast_uint512_t &o) const
+    {
+        fast_uint512_t r;
+        for (int i = 0; i < WORDS; i++)
+            r.w_[i] = w_[i] | o.w_[i];
+        return r;
+    }
+    fast_uint512_t operator&(const fast_uint512_t &o) const
+    {
+        fast_uint512_t r;
+        for (int i = 0; i < WORDS; i++)
+            r.w_[i] = w_[i] & o.w_[i];
+        return r;
+    }
+    fast_uint512_t operator^(const fast_uint512_t &o) const
+    {
+        fast_uint512_t r;
+        for (int i = 0; i < WORDS; i++)
+            r.w_[i] = w_[i] ^ o.w_[i];
+        return r;
+    }
+    fast_uint512_t operator~() const
+    {
+        fast_uint512_t r;
+        for (int i = 0; i < WORDS; i++)
+            r.w_[i] = ~w_[i];
+        return r;
+    }
+    fast_uint512_t &operator|=(const fast_uint512_t &o) { return *this = *this | o; }
+    fast_uint512_t &operator&=(const fast_uint512_t &o) { return *this = *this & o; }
+
+    bool or_reduce() const
+    {
+        uint64_t any = 0;
+        for (int i = 0; i < WORDS; i++)
+            any |= w_[i];
+        return any != 0;
+    }
+
+    // Bits [hi:lo], hi - lo < 64; the field may straddle two words
+    inline uint64_t get(int hi, int lo) const
+    {
+        const int n = hi - lo + 1, i = lo >> 6, s = lo & 63;
+        uint64_t x = w_[i] >> s;
+        if (s + n > 64)
+            x |= w_[i + 1] << (64 - s);
+        return (n == 64) ? x : x & ((1ull << n) - 1);
+    }
+
+    inline void set(int hi, int lo, uint64_t x)
+    {
+        const int n = hi - lo + 1, i = lo >> 6, s = lo & 63;
+        const uint64_t m = (n == 64) ? ~0ull : (1ull << n) - 1;
+        x &= m;
+        w_[i] = (w_[i] & ~(m << s)) | (x << s);
+        if (s + n > 64)
+            w_[i + 1] = (w_[i + 1] & ~(m >> (64 - s))) | (x >> (64 - s));
+    }
+
+private:
+    void fill(uint64_t low, bool negative)
+    {
+        w_[0] = low;
+        for (int i = 1; i < WORDS; i++)
+            w_[i] = negative ? ~0ull : 0;
+    }
+
+    uint64_t w_[WORDS];
+};
+
+// ap_axiu<512, 0, 0, 0> with a fast_uint512_t payload (the fields V4/V5 use)
+struct fast_axis512_t
+{
+    fast_uint512_t data;
+    ap_uint<64> keep;
+    ap_uint<64> strb;
+    ap_uint<1> last;
+};
+
+#endif // FAST_UINT512_H
@@ -9,34 +9,369 @@
 #include "image_defines.h"
 
 /**
- * @brief Posterize a pixel value into 3 discrete levels.
+ * @brief Run-time (or, with POSTERIZE_FIXED, compile-time) posterize table.
  *
- * Maps continuous grayscale values to discrete bins:
+ * Unused thresholds are 256, so their comparators never fire.
+ */
+typedef struct
+{
+    int thr[POSTERIZE_MAX_LEVELS - 1];
+    uint8_t value[POSTERIZE_MAX_LEVELS];
+} posterize_params_t;
+
+/**
+ * @brief Unpack the post_thr03/post_thr46/post_levels kernel arguments.
+ *
+ * num_levels is clamped to [2, POSTERIZE_MAX_LEVELS].
+ */
+static inline posterize_params_t unpack_posterize_params(int thr03, int thr46, int num_levels)
+{
+#pragma HLS INLINE
+#ifdef POSTERIZE_FIXED
+    thr03 = POSTERIZE_DEFAULT_THR03;
+    thr46 = POSTERIZE_DEFAULT_THR46;
+    num_levels = POSTERIZE_DEFAULT_LEVELS;
+#endif
+    const int n = (num_levels < 2) ? 2 : (num_levels > POSTERIZE_MAX_LEVELS) ? POSTERIZE_MAX_LEVELS : num_levels;
+    posterize_params_t pp;
+    for (int i = 0; i < POSTERIZE_MAX_LEVELS - 1; i++)
+    {
+#pragma HLS UNROLL
+        const int t = (i < 4) ? POSTERIZE_THR(thr03, i) : POSTERIZE_THR(thr46, i - 4);
+        pp.thr[i] = (i < n - 1) ? t : 256;
+    }
+    for (int i = 0; i < POSTERIZE_MAX_LEVELS; i++)
+    {
+#pragma HLS UNROLL
+        pp.value[i] = (uint8_t)((i < n) ? POSTERIZE_LEVEL_VALUE(i, n) : 255);
+    }
+    return pp;
+}
+
+/**
+ * @brief Level index (0 .. num_levels - 1) of a pixel value, see posterize().
+ *
+ * thr_shift scales the 8-bit thresholds to wider samples (chunk_format::THR_SHIFT).
+ */
+static inline int posterize_level(int abs_diff, const posterize_params_t &pp, int thr_shift = 0)
+{
+#pragma HLS INLINE
+    int level = 0;
+    for (int i = 0; i < POSTERIZE_MAX_LEVELS - 1; i++)
+    {
+#pragma HLS UNROLL
+        level += (abs_diff >= (pp.thr[i] << thr_shift)) ? 1 : 0;
+    }
+    return level;
+}
+
+/**
+ * @brief Posterize a pixel value into up to POSTERIZE_MAX_LEVELS levels.
+ *
+ * Every threshold is compared in parallel and the hits are summed into the
+ * level index (thresholds are ascending), then looked up in the value
+ * table. With the defaults this is the original 3-level mapping:
  *   - [0, THRESH_LOW)        -> 0   (black)
  *   - [THRESH_LOW, THRESH_HIGH) -> 128 (gray)
  *   - [THRESH_HIGH, 255]     -> 255 (white)
  *
  * @param abs_diff The absolute difference value to posterize
- * @return Posterized pixel value (0, 128, or 255)
+ * @param pp Threshold / level table from unpack_posterize_params()
+ * @return Posterized pixel value
  */
-static inline uint8_t posterize(uint8_t abs_diff)
+static inline uint8_t posterize(uint8_t abs_diff, const posterize_params_t &pp)
 {
 #pragma HLS INLINE
-    return (uint8_t) ((abs_diff < THRESH_LOW) ? 0 : (abs_diff < THRESH_HIGH) ? 128 : 255);
+    return pp.value[posterize_level(abs_diff, pp)];
 }
 
 /**
- * @brief Clip an integer value to valid 8-bit unsigned range [0, 255].
+ * @brief Clip an integer value to the sample range [0, max_value].
  *
- * Essential after filter operations that can produce values outside [0, 255].
+ * Essential after filter operations that can produce values outside the range.
  *
- * @param x Input integer (may be negative or > 255)
- * @return Clipped value in range [0, 255]
+ * @param x Input integer (may be negative or > max_value)
+ * @param max_value Largest sample value (255 for 8-bit pixels)
+ * @return Clipped value in range [0, max_value]
  */
-static inline uint8_t clip_u8(int x)
+static inline int clip_pixel(int x, int max_value = 255)
 {
 #pragma HLS INLINE
-    return (uint8_t) (x < 0 ? 0 : (x > 255 ? 255 : x));
+    return x < 0 ? 0 : (x > max_value ? max_value : x);
+}
+
+/**
+ * @brief Pipeline register under -DV3_RETIME, a plain wire otherwise.
+ *
+ * Same construction as hls::reg(): a non-inlined function whose return
+ * port is registered, so the scheduler must put a stage boundary at the
+ * call however much slack it thinks the path has. V3_RETIME places one
+ * between the window taps and the sharpen sum, one between the sum and the
+ * clip, and one between |A - B| and the posterize compare; each adds a
+ * cycle of latency per pipeline, not to the II.
+ */
+template <typename T>
+static T retime_reg(T x)
+{
+#ifdef V3_RETIME
+#pragma HLS INLINE off
+#pragma HLS INTERFACE ap_none port = return register
+#else
+#pragma HLS INLINE
+#endif
+    return x;
+}
+
+/**
+ * @brief Run-time (or, with SHARPEN_FIXED, compile-time) 3x3 filter taps.
+ */
+typedef struct
+{
+    int k[3][3];  // [row: north/center/south][col: west/center/east]
+    int shift;
+} sharpen_coeffs_t;
+
+/**
+ * @brief Unpack the coef_r0..coef_r2/coef_shift kernel arguments.
+ *
+ * With SHARPEN_FIXED the arguments are ignored and the SHARPEN_DEFAULT_*
+ * constants are returned instead, so every tap is a literal after inlining.
+ */
+static inline sharpen_coeffs_t unpack_sharpen_coeffs(int r0, int r1, int r2, int shift)
+{
+#pragma HLS INLINE
+#ifdef SHARPEN_FIXED
+    r0 = SHARPEN_DEFAULT_R0;
+    r1 = SHARPEN_DEFAULT_R1;
+    r2 = SHARPEN_DEFAULT_R2;
+    shift = SHARPEN_DEFAULT_SHIFT;
+#endif
+    sharpen_coeffs_t c;
+    const int rows[3] = {r0, r1, r2};
+    for (int r = 0; r < 3; r++)
+    {
+#pragma HLS UNROLL
+        for (int t = 0; t < 3; t++)
+        {
+#pragma HLS UNROLL
+            c.k[r][t] = SHARPEN_TAP(rows[r], t);
+        }
+    }
+    c.shift = shift;
+    return c;
+}
+
+/**
+ * @brief Lane layout of a 512-bit chunk holding CH channels of PIX per pixel.
+ *
+ * Pixels fill LANES lanes of PIXEL_BITS bits from bit 0 up, channel c of a
+ * lane at bits [c * CHANNEL_BITS, ...); any bits above the last lane are
+ * padding (see V3_CHANNEL_BITS in image_defines.h). The posterize
+ * thresholds and level values are 8-bit: thresholds are shifted left by
+ * THR_SHIFT and level values multiplied by VALUE_SCALE (1 or 257).
+ */
+template <typename PIX, int CH>
+struct chunk_format
+{
+    static const int CHANNEL_BITS = sizeof(PIX) * 8;
+    static const int CHANNELS = CH;
+    static const int PIXEL_BITS = CHANNEL_BITS * CH;
+    static const int LANES = DATA_WIDTH_BITS / PIXEL_BITS;
+    static const int MAX_VALUE = (1 << CHANNEL_BITS) - 1;
+    static const int THR_SHIFT = CHANNEL_BITS - 8;
+    static const int VALUE_SCALE = MAX_VALUE / 255;
+};
+
+typedef chunk_format<pixel_t, 1> mono8_format;
+
+/**
+ * @brief Channel ch of pixel k + dk (dk in -1..1) of a row held as three chunks.
+ *
+ * k indexes the middle chunk; k - 1 < 0 and k + 1 >= LANES spill into the
+ * last lane of the left chunk / first lane of the right chunk (padding bits
+ * are skipped). With k, dk and ch constant after unrolling this is pure wiring.
+ */
+template <class FMT>
+static inline int channel_tap(const uint512_t &left, const uint512_t &mid, const uint512_t &right,
+                              int k, int dk, int ch)
+{
+#pragma HLS INLINE
+    const int idx = k + dk;
+    const int off = ch * FMT::CHANNEL_BITS;
+    if (idx < 0)
+        return (int)left.range((FMT::LANES - 1) * FMT::PIXEL_BITS + off + FMT::CHANNEL_BITS - 1,
+                               (FMT::LANES - 1) * FMT::PIXEL_BITS + off);
+    if (idx >= FMT::LANES)
+        return (int)right.range(off + FMT::CHANNEL_BITS - 1, off);
+    return (int)mid.range(idx * FMT::PIXEL_BITS + off + FMT::CHANNEL_BITS - 1, idx * FMT::PIXEL_BITS + off);
+}
+
+/**
+ * @brief Diff + posterize unit for channel ch of lane k of a chunk pair.
+ *
+ * Writes the posterized sample into c and returns its level index (for the
+ * statistics and tap outputs). Every chunk-based diff stage (V2, V3 and
+ * its V4/V5 reuse) instantiates this once per lane and channel.
+ */
+template <class FMT>
+static inline int diff_posterize_sample(const uint512_t &a, const uint512_t &b, uint512_t &c, int k, int ch,
+                                        const posterize_params_t &pp)
+{
+#pragma HLS INLINE
+    const int lo = k * FMT::PIXEL_BITS + ch * FMT::CHANNEL_BITS;
+    const int hi = lo + FMT::CHANNEL_BITS - 1;
+    const int pa = a.range(hi, lo);
+    const int pb = b.range(hi, lo);
+    const int lvl = posterize_level(retime_reg((pa > pb) ? pa - pb : pb - pa), pp, FMT::THR_SHIFT);
+    c.range(hi, lo) = pp.value[lvl] * FMT::VALUE_SCALE;
+    return lvl;
+}
+
+/**
+ * @brief Pixel k + dk (dk in -1..1) of an 8-bit mono row held as three chunks.
+ */
+static inline int window_tap(const uint512_t &left, const uint512_t &mid, const uint512_t &right, int k, int dk)
+{
+#pragma HLS INLINE
+    return channel_tap<mono8_format>(left, mid, right, k, dk, 0);
+}
+
+/**
+ * @brief 3x3 convolution of a pixel neighbourhood, shifted and clipped.
+ *
+ * @param p 3x3 neighbourhood, p[1][1] is the output pixel position
+ * @param max_value Largest sample value the result is clipped to
+ */
+static inline int sharpen_3x3(const sharpen_coeffs_t &c, const int p[3][3], int max_value = 255)
+{
+#pragma HLS INLINE
+    int acc = 0;
+    for (int r = 0; r < 3; r++)
+    {
+#pragma HLS UNROLL
+        for (int t = 0; t < 3; t++)
+        {
+#pragma HLS UNROLL
+            acc += c.k[r][t] * p[r][t];
+        }
+    }
+    return clip_pixel(retime_reg(acc) >> c.shift, max_value);
+}
+
+/**
+ * @brief Output pixel of one sharpen position under a border policy.
+ *
+ * nb is the 3x3 neighbourhood as read (taps past a frame edge may hold
+ * anything); north/south/west/east flag the sides that lie past the edge.
+ * Interior pixels are filtered as is. For border pixels, BORDER_REPLICATE
+ * and BORDER_MIRROR first rewrite the outside taps from the inside ones,
+ * rows before columns so corners come out right. Mirroring needs two
+ * pixels along the axis (tall: height > 1, wide: width > 1), otherwise
+ * that axis replicates. All policies are evaluated and muxed, so the mode
+ * costs no cycles.
+ */
+static inline int sharpen_border(const sharpen_coeffs_t &c, int nb[3][3], int mode,
+                                 bool north, bool south, bool west, bool east, bool tall, bool wide,
+                                 int max_value = 255)
+{
+#pragma HLS INLINE
+    const bool border = north || south || west || east;
+    const bool mirror_rows = (mode == BORDER_MIRROR) && tall;
+    const bool mirror_cols = (mode == BORDER_MIRROR) && wide;
+    const int center = nb[1][1];
+
+    for (int t = 0; t < 3; t++)
+    {
+#pragma HLS UNROLL
+        const int n = nb[0][t], p = nb[1][t], s = nb[2][t];
+        if (north)
+            nb[0][t] = mirror_rows ? s : p;
+        if (south)
+            nb[2][t] = mirror_rows ? n : p;
+    }
+    for (int r = 0; r < 3; r++)
+    {
+#pragma HLS UNROLL
+        const int w = nb[r][0], p = nb[r][1], e = nb[r][2];
+        if (west)
+            nb[r][0] = mirror_cols ? e : p;
+        if (east)
+            nb[r][2] = mirror_cols ? w : p;
+    }
+
+    const int filtered = sharpen_3x3(c, nb, max_value);
+    if (!border)
+        return filtered;
+    if (mode == BORDER_REPLICATE || mode == BORDER_MIRROR)
+        return filtered;
+    return (mode == BORDER_PASSTHROUGH) ? center : 0;
+}
+
+/**
+ * @brief Output sample of one 3x3 morphology position (V3 -DV3_MORPH).
+ *
+ * nb as for sharpen_border; the taps on the north/south/west/east sides
+ * past the frame edge are left out. MORPH_OP_ERODE returns the minimum of
+ * the rest, MORPH_OP_DILATE the maximum and MORPH_OP_PASS the center.
+ * Both reductions are evaluated and muxed, so op costs no cycles.
+ */
+static inline int morph_3x3(const int nb[3][3], int op, bool north, bool south, bool west, bool east,
+                            int max_value = 255)
+{
+#pragma HLS INLINE
+    int lo = max_value, hi = 0;
+    for (int r = 0; r < 3; r++)
+    {
+#pragma HLS UNROLL
+        for (int t = 0; t < 3; t++)
+        {
+#pragma HLS UNROLL
+            const bool outside = (r == 0 && north) || (r == 2 && south) || (t == 0 && west) || (t == 2 && east);
+            if (!outside)
+            {
+                lo = (nb[r][t] < lo) ? nb[r][t] : lo;
+                hi = (nb[r][t] > hi) ? nb[r][t] : hi;
+            }
+        }
+    }
+    return (op == MORPH_OP_ERODE) ? lo : (op == MORPH_OP_DILATE) ? hi : nb[1][1];
+}
+
+/**
+ * @brief Pack one tile row's flags into change map words (V1/V2).
+ *
+ * Writes tile row tile_row (counted over the batch) of every strip (see
+ * CHANGE_MAP_* in image_defines.h) and clears the flags for the next row.
+ *
+ * @param map_tile_rows Tile rows of the whole batch (the strip stride)
+ * @return true if any tile of the row changed
+ */
+static bool write_tile_row_change_map(bool tiles[ROW_BUF_MAX_CHUNKS_PER_ROW], int stride_chunks,
+                                      uint64_t *change_map, int map_tile_rows, int tile_row)
+{
+    bool any = false;
+    int word_idx = tile_row;
+Map_Strips:
+    for (int c0 = 0; c0 < stride_chunks; c0 += STRIP_MAX_CHUNKS)
+    {
+#pragma HLS PIPELINE II = 1
+#pragma HLS LOOP_TRIPCOUNT min = 1 max = (ROW_BUF_MAX_CHUNKS_PER_ROW + STRIP_MAX_CHUNKS - 1) / STRIP_MAX_CHUNKS
+        uint64_t word = 0;
+        for (int j = 0; j < STRIP_MAX_CHUNKS; j++)
+        {
+#pragma HLS UNROLL
+            const int c = c0 + j;
+            if (c < ROW_BUF_MAX_CHUNKS_PER_ROW && c < stride_chunks && tiles[c])
+            {
+                word |= (uint64_t)1 << j;
+                tiles[c] = false;
+            }
+        }
+        any = any || (word != 0);
+        change_map[word_idx] = word;
+        word_idx += map_tile_rows;
+    }
+    return any;
 }
 
 #endif // HLS_HELPERS_H
@@ -3,11 +3,20 @@
 
 #include <stdint.h>
 #include <ap_int.h>
+#include <ap_axi_sdata.h>
 
+#if defined(FAST_CSIM) && !defined(__SYNTHESIS__)
+// C simulation only: word-backed stand-in with the same range() interface
+#include "fast_uint512.h"
+typedef fast_uint512_t uint512_t;
+typedef fast_axis512_t axis512_t;
+#else
 typedef ap_uint<512> uint512_t;
+typedef ap_axiu<512, 0, 0, 0> axis512_t; // V4 AXI4-Stream beat: one chunk, TLAST on a frame's last chunk
+#endif
 typedef uint8_t pixel_t;
 
-// Image dimensions
+// Default image dimensions (host/testbench defaults; kernels take the real size at run time)
 #define HEIGHT 256
 #define WIDTH  256 
 #define IMAGE_SIZE (HEIGHT * WIDTH)
@@ -29,8 +38,376 @@ typedef uint8_t pixel_t;
 // Buffer size for padded data
 #define BUFFER_SIZE_BYTES (TOTAL_CHUNKS * PIXELS_PER_CHUNK)
 
+// Compile-time maxima for the run-time sized kernels.
+// These only bound the host checks and LOOP_TRIPCOUNT hints; V3 BRAM is
+// sized by STRIP_MAX_CHUNKS below.
+#ifndef MAX_WIDTH
+#define MAX_WIDTH  7680
+#endif
+#ifndef MAX_HEIGHT
+#define MAX_HEIGHT 2160
+#endif
+#define MAX_CHUNKS_PER_ROW ((MAX_WIDTH + PIXELS_PER_CHUNK - 1) / PIXELS_PER_CHUNK)
+#define MAX_TOTAL_CHUNKS   (MAX_CHUNKS_PER_ROW * MAX_HEIGHT)
+
+// V3 pixel format: each pixel is V3_CHANNELS samples of V3_CHANNEL_BITS bits
+// (8 or 16; 12-bit sensor data goes MSB-aligned in 16). A chunk holds
+// V3_PIXELS_PER_CHUNK whole pixels from bit 0 up, channels from the pixel's
+// low bits up; the leftover top bits (8 for RGB888) are padding and always 0.
+// 8-bit mono = 64 px/cycle, 16-bit mono = 32, RGB888 = 21. Diff, posterize
+// and sharpen act per channel; posterize thresholds and level values stay
+// 8-bit and are scaled to the channel range. V1/V2 and the host are 8-bit mono.
+#ifndef V3_CHANNEL_BITS
+#define V3_CHANNEL_BITS 8
+#endif
+#ifndef V3_CHANNELS
+#define V3_CHANNELS 1
+#endif
+#if V3_CHANNEL_BITS != 8 && V3_CHANNEL_BITS != 16
+#error "V3_CHANNEL_BITS must be 8 or 16"
+#endif
+#if V3_CHANNEL_BITS == 16
+typedef uint16_t v3_channel_t;
+#else
+typedef uint8_t v3_channel_t;
+#endif
+#define V3_PIXEL_BITS       (V3_CHANNEL_BITS * V3_CHANNELS)
+#define V3_PIXELS_PER_CHUNK (DATA_WIDTH_BITS / V3_PIXEL_BITS)
+#define V3_DEFAULT_FORMAT   (V3_CHANNEL_BITS == 8 && V3_CHANNELS == 1)
+
+// Lanes the V3 diff and sharpen stages process per cycle (-DV3_LANES, a
+// divisor of V3_PIXELS_PER_CHUNK; default all of them). Each chunk then
+// takes V3_FOLD cycles: 8-bit mono with V3_LANES=16 runs at 16 px/cycle on
+// a quarter of the diff/sharpen units, plus a V3_FOLD-way lane select.
+#ifndef V3_LANES
+#define V3_LANES V3_PIXELS_PER_CHUNK
+#endif
+#if V3_LANES < 1 || V3_PIXELS_PER_CHUNK % V3_LANES != 0
+#error "V3_LANES must divide V3_PIXELS_PER_CHUNK"
+#endif
+#define V3_FOLD (V3_PIXELS_PER_CHUNK / V3_LANES)
+
+// V3 strip tiling: rows are processed in vertical strips of at most
+// STRIP_MAX_CHUNKS chunks; each line buffer holds one strip plus a
+// 1-chunk halo on either side.
+#ifndef STRIP_MAX_CHUNKS
+#define STRIP_MAX_CHUNKS 32
+#endif
+#define STRIP_LB_CHUNKS (STRIP_MAX_CHUNKS + 2)
+#define MAX_STRIPS      ((MAX_CHUNKS_PER_ROW + STRIP_MAX_CHUNKS - 1) / STRIP_MAX_CHUNKS)
+// V4 takes frames in raster order, so a frame must fit in one strip
+#define V4_MAX_WIDTH    (STRIP_MAX_CHUNKS * V3_PIXELS_PER_CHUNK)
+
+// V1/V2 work through each frame in blocks of ROW_BLOCK_ROWS rows (one
+// change-map tile row), double-buffered, so their BRAM scales with the row
+// width only and any height fits. Raise ROW_BUF_MAX_WIDTH (and the BRAM
+// budget) to run wider frames through V1/V2.
+#ifndef ROW_BUF_MAX_WIDTH
+#define ROW_BUF_MAX_WIDTH  1920
+#endif
+#define ROW_BUF_MAX_CHUNKS_PER_ROW ((ROW_BUF_MAX_WIDTH + PIXELS_PER_CHUNK - 1) / PIXELS_PER_CHUNK)
+#define ROW_BUF_MAX_PADDED_WIDTH   (ROW_BUF_MAX_CHUNKS_PER_ROW * PIXELS_PER_CHUNK)
+#define ROW_BLOCK_ROWS             TILE_ROWS
+#define ROW_BLOCK_MAX_CHUNKS       (ROW_BLOCK_ROWS * ROW_BUF_MAX_CHUNKS_PER_ROW)
+#define ROW_RING_ROWS              (2 * ROW_BLOCK_ROWS) // Ping-pong pair of row blocks (power of two)
+
+// Change map (output argument 15): one bit per TILE_ROWS x 64 px tile that
+// holds any non-zero posterized pixel. Tiles never span frames. Words are
+// grouped by strip: word (s * n_tile_rows + tr) bit j covers tile row tr
+// (counted over the whole batch) and chunk column s * STRIP_MAX_CHUNKS + j.
+// The word after the bitmap is the "any change" flag (0 or 1).
+// The sharpen output can be non-zero one pixel beyond a marked tile, so a
+// consumer skipping clean tiles must treat neighbours of marked tiles as dirty.
+#define TILE_ROWS 8
+#if STRIP_MAX_CHUNKS > 64
+#error "change map words hold one strip: STRIP_MAX_CHUNKS must be <= 64"
+#endif
+#define CHANGE_MAP_TILE_ROWS(height, num_frames)   ((((height) + TILE_ROWS - 1) / TILE_ROWS) * (num_frames))
+#define CHANGE_MAP_STRIPS(stride_chunks)           (((stride_chunks) + STRIP_MAX_CHUNKS - 1) / STRIP_MAX_CHUNKS)
+#define CHANGE_MAP_WORDS(height, stride_chunks, num_frames) \
+    (CHANGE_MAP_STRIPS(stride_chunks) * CHANGE_MAP_TILE_ROWS(height, num_frames) + 1)
+#define CHANGE_MAP_DEFAULT_WORDS CHANGE_MAP_WORDS(HEIGHT, CHUNKS_PER_ROW, 1)
+
+// Kernel properties: a launch with num_frames = 0 reads no frame and writes
+// this word to change_map[0] in place of the any-change flag, so the host can
+// check a frame and its arguments against the build before running it.
+// Bits 32..63 hold the widest frame the build takes (0: MAX_WIDTH); the low
+// bits are KERNEL_PROP_* flags. KERNEL_PROPS_BUILD is this build's flags.
+#define KERNEL_PROPS_WITH_MAX_WIDTH(width) ((uint64_t)(width) << 32)
+#define KERNEL_PROPS_MAX_WIDTH(props)      ((int)((uint64_t)(props) >> 32))
+#define KERNEL_PROP_FIXED_TAPS             1ull // -DSHARPEN_FIXED: the coef_* arguments are ignored
+#define KERNEL_PROP_FIXED_POSTERIZE        2ull // -DPOSTERIZE_FIXED: the post_* arguments are ignored
+#ifdef SHARPEN_FIXED
+#define KERNEL_PROPS_BUILD_TAPS KERNEL_PROP_FIXED_TAPS
+#else
+#define KERNEL_PROPS_BUILD_TAPS 0ull
+#endif
+#ifdef POSTERIZE_FIXED
+#define KERNEL_PROPS_BUILD_POSTERIZE KERNEL_PROP_FIXED_POSTERIZE
+#else
+#define KERNEL_PROPS_BUILD_POSTERIZE 0ull
+#endif
+#define KERNEL_PROPS_BUILD (KERNEL_PROPS_BUILD_TAPS | KERNEL_PROPS_BUILD_POSTERIZE)
+
+// Posterize tap (-DV3_POST_TAP, V3 only): the stage-1 output as 2-bit level
+// indices, so reading it back costs a quarter of C. Each batch row starts a
+// new word and holds POST_TAP_ROW_WORDS() words; pixel x of a row sits in
+// bits [2 * (x % 4) + 1 : 2 * (x % 4)] of byte x / 4 of that row. Levels
+// above 3 saturate to 3, so the tap is exact for up to four levels.
+#define POST_TAP_CHUNKS_PER_WORD 4
+#define POST_TAP_ROW_WORDS(stride_chunks) (((stride_chunks) + POST_TAP_CHUNKS_PER_WORD - 1) / POST_TAP_CHUNKS_PER_WORD)
+#define POST_TAP_WORDS(height, stride_chunks, num_frames) \
+    ((height) * (num_frames) * POST_TAP_ROW_WORDS(stride_chunks))
+#define POST_TAP_DEFAULT_WORDS POST_TAP_WORDS(HEIGHT, CHUNKS_PER_ROW, 1)
+#if defined(V3_POST_TAP) && (STRIP_MAX_CHUNKS % POST_TAP_CHUNKS_PER_WORD) != 0
+#error "posterize tap words must not span strips: STRIP_MAX_CHUNKS must be a multiple of 4"
+#endif
+#if defined(V3_POST_TAP) && !V3_DEFAULT_FORMAT
+#error "the posterize tap packs 8-bit mono pixels: build it without V3_CHANNEL_BITS/V3_CHANNELS"
+#endif
+
+// ROI list (-DV3_ROI, V3 only): the kernel takes `const uint64_t *rois` and
+// `int num_rois` as its last arguments and processes only those rectangles
+// of every frame, each packed by ROI_PACK(): rows [row0, row1) and chunk
+// columns [col0, col1), clamped to the frame. C is written inside the ROIs
+// only, and the change map holds one flag per ROI instead of the tile
+// bitmap: word f * num_rois + i is 1 if ROI i of frame f, or the row /
+// chunk around it that its sharpen taps read, has a non-zero posterized
+// pixel. A clear flag therefore means the ROI's output is all zero.
+#define ROI_MAX 64 // Tripcount hint only
+#define ROI_PACK(row0, row1, col0, col1) \
+    ((uint64_t)((row0) & 0xFFFF) | ((uint64_t)((row1) & 0xFFFF) << 16) | \
+     ((uint64_t)((col0) & 0xFFFF) << 32) | ((uint64_t)((col1) & 0xFFFF) << 48))
+#define ROI_ROW0(roi) ((int)((roi) & 0xFFFF))
+#define ROI_ROW1(roi) ((int)(((roi) >> 16) & 0xFFFF))
+#define ROI_COL0(roi) ((int)(((roi) >> 32) & 0xFFFF))
+#define ROI_COL1(roi) ((int)(((roi) >> 48) & 0xFFFF))
+#define ROI_CHANGE_WORDS(num_rois, num_frames) ((num_rois) * (num_frames))
+
+// Sharpen stage: generic 3x3 integer convolution, result >> shift, clipped.
+// Each kernel row argument (coef_r0..coef_r2 = north/center/south row)
+// packs three signed 8-bit taps: bits [7:0] west, [15:8] center, [23:16] east.
+// Building with -DSHARPEN_FIXED ignores the arguments and uses the defaults
+// below as compile-time constants, so HLS folds the 0/+-1 taps away.
+#define SHARPEN_PACK_ROW(w, c, e) ((int)(((unsigned)(w) & 0xFF) | (((unsigned)(c) & 0xFF) << 8) | (((unsigned)(e) & 0xFF) << 16)))
+#define SHARPEN_TAP(row, idx)     ((int)(int8_t)(((unsigned)(row) >> (8 * (idx))) & 0xFF))
+
+// Default: Laplacian sharpen [0 -1 0; -1 5 -1; 0 -1 0], no shift
+#define SHARPEN_DEFAULT_R0    SHARPEN_PACK_ROW( 0, -1,  0)
+#define SHARPEN_DEFAULT_R1    SHARPEN_PACK_ROW(-1,  5, -1)
+#define SHARPEN_DEFAULT_R2    SHARPEN_PACK_ROW( 0, -1,  0)
+#define SHARPEN_DEFAULT_SHIFT 0
+
+// Bypass: the identity taps with BORDER_PASSTHROUGH make the sharpen stage
+// pass the posterized frame through unchanged, i.e. lab-1's diff-only
+// output from the same bitstream at the same throughput (no reprogramming)
+#define SHARPEN_BYPASS_R0     SHARPEN_PACK_ROW(0, 0, 0)
+#define SHARPEN_BYPASS_R1     SHARPEN_PACK_ROW(0, 1, 0)
+#define SHARPEN_BYPASS_R2     SHARPEN_PACK_ROW(0, 0, 0)
+
+// Sharpen border policy (border_mode argument): what the first/last row and
+// column of each frame output. Row padding past the width is always 0.
+#define BORDER_ZERO        0 // 0 (original behaviour)
+#define BORDER_REPLICATE   1 // Taps past the edge repeat the edge pixel (OpenCV BORDER_REPLICATE)
+#define BORDER_MIRROR      2 // Taps past the edge reflect about it (OpenCV BORDER_REFLECT_101)
+#define BORDER_PASSTHROUGH 3 // The posterized pixel, unfiltered
+#define BORDER_DEFAULT     BORDER_ZERO
+
+// V3 profiling build (-DV3_PROFILE): the kernel takes an extra uint64_t
+// output buffer (last argument, after the optional post_tap and stats
+// buffers) and writes these per-stage counters to it.
+// "full"/"empty" counts are chunks that met a full output / empty input
+// stream, i.e. a lower bound on the cycles that stage spent stalled.
+#define PROF_DIFF_ACTIVE      0 // Chunks read from A/B and posterized
+#define PROF_DIFF_POST_FULL   1 // stream_post full at write (filter backpressure)
+#define PROF_FILT_ACTIVE      2 // Filter iterations, including the per-strip flush
+#define PROF_FILT_POST_EMPTY  3 // stream_post empty at read (waiting on AXI reads)
+#define PROF_FILT_FILT_FULL   4 // stream_filt full at write (writer backpressure)
+#define PROF_WRITE_ACTIVE     5 // Chunks written to C
+#define PROF_WRITE_FILT_EMPTY 6 // stream_filt empty at read (filter starved the writer)
+#define PROF_STRIPS           7 // Strips processed
+#define PROF_NUM_COUNTERS     8
+
+// V3 statistics build (-DV3_STATS): the kernel takes an extra uint64_t
+// output buffer (after post_tap, before the profiling buffer) with these words,
+// computed over the width x height pixels of every frame in the batch.
+#define STATS_LEVEL_COUNT 0 // Words 0..POSTERIZE_MAX_LEVELS-1: posterized pixels per level
+#define STATS_MIN         8 // Sharpened output: minimum
+#define STATS_MAX         9 //                   maximum
+#define STATS_SUM        10 //                   sum
+#define STATS_PIXELS     11 // Pixels counted
+#define STATS_NUM_WORDS  12
+#if defined(V3_STATS) && !V3_DEFAULT_FORMAT
+#error "statistics are computed over 8-bit mono pixels: build them without V3_CHANNEL_BITS/V3_CHANNELS"
+#endif
+
+// V3 compressed output (-DV3_COMPRESS): the writer drops all-zero result
+// chunks. C receives only the non-zero chunks, packed from chunk 0 in the
+// writer's order (strip by strip, then row by row across the batch, see
+// STRIP_MAX_CHUNKS), and the extra uint64_t *comp_index argument (after the
+// profiling buffer) receives the kept-chunk count in word 0 and one bit per
+// chunk of that order from word 1 on (bit i of word 1 + i / 64 set = kept).
+// result_codec.h expands it back to the padded layout on the host.
+#define COMP_INDEX_WORDS(height, stride_chunks, num_frames) \
+    (1 + ((height) * (stride_chunks) * (num_frames) + 63) / 64)
+#define COMP_INDEX_DEFAULT_WORDS COMP_INDEX_WORDS(HEIGHT, CHUNKS_PER_ROW, 1)
+
+// V3 morphological clean-up (-DV3_MORPH): the kernel takes an extra
+// `int morph_mode` (last argument) and runs two 3x3 min/max stages on the
+// sharpened output before it is counted (-DV3_STATS) and written. Taps past
+// a frame edge are left out of the minimum/maximum (the edge pixel keeps
+// its own extreme, as OpenCV's default morphology border); row padding
+// stays 0. Each stage applies one MORPH_OP_* per pixel.
+#define MORPH_NONE  0 // Both stages pass through
+#define MORPH_OPEN  1 // Erode, then dilate: removes bright specks narrower than 3 px
+#define MORPH_CLOSE 2 // Dilate, then erode: fills dark holes narrower than 3 px
+#define MORPH_DEFAULT MORPH_NONE
+
+#define MORPH_OP_PASS   0
+#define MORPH_OP_ERODE  1 // 3x3 minimum
+#define MORPH_OP_DILATE 2 // 3x3 maximum
+#define MORPH_FIRST_OP(mode) \
+    ((mode) == MORPH_OPEN ? MORPH_OP_ERODE : (mode) == MORPH_CLOSE ? MORPH_OP_DILATE : MORPH_OP_PASS)
+#define MORPH_SECOND_OP(mode) \
+    ((mode) == MORPH_OPEN ? MORPH_OP_DILATE : (mode) == MORPH_CLOSE ? MORPH_OP_ERODE : MORPH_OP_PASS)
+#if defined(V3_MORPH) && defined(V3_ROI)
+#error "-DV3_MORPH needs whole frames: build it without -DV3_ROI"
+#endif
+
+// V3 blob list (-DV3_BLOBS): the kernel takes an extra uint64_t *blobs
+// (last argument) and labels the white (top level, 255) posterized pixels
+// of every frame into 8-connected blobs, in one pass over the diff stage's
+// output (row runs, union-find over a BLOB_MAX_LABELS-entry table). Frame
+// f's block starts at word f * BLOB_FRAME_WORDS: a BLOB_HEADER() word, then
+// up to BLOB_MAX blobs of two words each, in raster order of their first
+// pixel: BLOB_PACK_BOX() (inclusive pixel bounds) and BLOB_PACK_SIZE()
+// (area, centroid in 1/8 px). Frames must fit one strip
+// (stride_chunks <= STRIP_MAX_CHUNKS); wider ones only get BLOB_FLAG_WIDE.
+#ifndef BLOB_MAX
+#define BLOB_MAX 32
+#endif
+#ifndef BLOB_MAX_LABELS
+#define BLOB_MAX_LABELS 512
+#endif
+#define BLOB_ROW_RUNS       ((STRIP_MAX_CHUNKS * PIXELS_PER_CHUNK + 1) / 2) // Most runs a row can hold
+#define BLOB_FRAME_WORDS    (1 + 2 * BLOB_MAX)
+#define BLOB_WORDS(num_frames) ((num_frames) * BLOB_FRAME_WORDS)
+#define BLOB_DEFAULT_WORDS  BLOB_WORDS(1)
+#define BLOB_FLAG_LABELS 1 // Table full: runs touching no earlier blob were dropped
+#define BLOB_FLAG_WIDE   2 // Frame wider than one strip, not labelled
+#define BLOB_HEADER(found, flags) ((uint64_t)(uint32_t)(found) | ((uint64_t)(uint32_t)(flags) << 32))
+#define BLOB_FOUND(word)  ((int)((word) & 0xFFFFFFFF)) // Blobs in the frame (more than BLOB_MAX are not listed)
+#define BLOB_FLAGS(word)  ((int)((word) >> 32))
+#define BLOB_PACK_BOX(x0, y0, x1, y1) ROI_PACK(x0, y0, x1, y1)
+#define BLOB_X0(word) ROI_ROW0(word)
+#define BLOB_Y0(word) ROI_ROW1(word)
+#define BLOB_X1(word) ROI_COL0(word)
+#define BLOB_Y1(word) ROI_COL1(word)
+#define BLOB_PACK_SIZE(area, cx8, cy8) \
+    ((uint64_t)(uint32_t)(area) | ((uint64_t)((cx8) & 0xFFFF) << 32) | ((uint64_t)((cy8) & 0xFFFF) << 48))
+#define BLOB_AREA(word) ((int)((word) & 0xFFFFFFFF))
+#define BLOB_CX8(word)  ((int)(((word) >> 32) & 0xFFFF))
+#define BLOB_CY8(word)  ((int)(((word) >> 48) & 0xFFFF))
+#if defined(V3_BLOBS) && defined(V3_ROI)
+#error "-DV3_BLOBS needs whole frames: build it without -DV3_ROI"
+#endif
+#if defined(V3_BLOBS) && !V3_DEFAULT_FORMAT
+#error "blobs are labelled over 8-bit mono pixels: build them without V3_CHANNEL_BITS/V3_CHANNELS"
+#endif
+
+// V3 resolution pyramid (-DV3_PYRAMID): the kernel takes extra uint512_t
+// *pyr_half and *pyr_quarter (last arguments) and also writes the result at
+// 1/2 and 1/4 resolution in the same pass. Level l of each frame holds
+// PYR_ROWS() rows of PYR_STRIDE() chunks, frames back to back like C; pixel
+// (x, y) is the rounded mean of the 2x2 block at (2x, 2y) of the level
+// below (C for level 1), and a trailing odd row or column is dropped.
+// Pixels from PYR_COLS() on are unspecified.
+#define PYR_STRIDE(stride_chunks, level) (((stride_chunks) + (1 << (level)) - 1) >> (level))
+#define PYR_ROWS(height, level)          ((height) >> (level))
+#define PYR_COLS(width, level)           ((width) >> (level))
+#define PYR_WORDS(height, stride_chunks, num_frames, level) \
+    (PYR_ROWS(height, level) * PYR_STRIDE(stride_chunks, level) * (num_frames))
+#define PYR_DEFAULT_WORDS(level) PYR_WORDS(HEIGHT, CHUNKS_PER_ROW, 1, level)
+#define PYR_MEAN4(a, b, c, d) (((a) + (b) + (c) + (d) + 2) >> 2)
+#if defined(V3_PYRAMID) && (STRIP_MAX_CHUNKS % 4) != 0
+#error "pyramid chunks must not span strips: STRIP_MAX_CHUNKS must be a multiple of 4"
+#endif
+#if defined(V3_PYRAMID) && defined(V3_ROI)
+#error "-DV3_PYRAMID needs whole frames: build it without -DV3_ROI"
+#endif
+#if defined(V3_PYRAMID) && !V3_DEFAULT_FORMAT
+#error "the pyramid averages 8-bit mono pixels: build it without V3_CHANNEL_BITS/V3_CHANNELS"
+#endif
+
+// V3 camera input (-DV3_LUMA): the kernel takes an extra int in_format
+// (last argument) and A/B hold camera frames in that layout, converted to
+// 8-bit luma on the way in. Each chunk of C comes from
+// LUMA_WORDS_PER_CHUNK() input words: the chunk's 64 pixels, packed as
+//   LUMA_Y8      luma bytes (the default layout, one word)
+//   LUMA_YUYV    Y0 U0 Y1 V0 ... (YUV 4:2:2, luma at even bytes, two words)
+//   LUMA_RGB888  R G B per pixel (three words), luma LUMA_RGB() (BT.601)
+// so a row is the padded width times the pixel bytes, and padding is zero.
+#define LUMA_Y8       0
+#define LUMA_YUYV     1
+#define LUMA_RGB888   2
+#define LUMA_MAX_WORDS 3
+#define LUMA_WORDS_PER_CHUNK(fmt) (((fmt) == LUMA_RGB888) ? 3 : ((fmt) == LUMA_YUYV) ? 2 : 1)
+#define LUMA_RGB(r, g, b) ((77 * (r) + 150 * (g) + 29 * (b) + 128) >> 8)
+#define LUMA_DEFAULT_WORDS (TOTAL_CHUNKS * LUMA_MAX_WORDS)
+#if defined(V3_LUMA) && defined(V3_ROI)
+#error "-DV3_LUMA converts whole frames: build it without -DV3_ROI"
+#endif
+#if defined(V3_LUMA) && !V3_DEFAULT_FORMAT
+#error "the camera front end produces 8-bit luma: build it without V3_CHANNEL_BITS/V3_CHANNELS"
+#endif
+
+// V6 descriptor ring (accelerated_v6.cpp): IMAGE_DIFF_RING is restarted
+// by the hardware (ap_ctrl_chain + auto-restart) and each run retires one
+// descriptor from `ring`, RING_ENTRIES slots of RING_DESC_WORDS words in
+// device memory. The host fills slot n % RING_ENTRIES for the n-th frame
+// (counting from 0) and writes its head word last: RING_DESC_HEAD() with
+// seq = n + 1, the frame's index (which picks its change map block) and
+// flags. The other words are the chunk offsets of the frame in A, B and C.
+// The run waits until the head of slot status[RING_STATUS_DONE] carries the
+// next seq, processes the frame, then bumps the done count and records the
+// frame; the host polls that. RING_FLAG_STOP retires the slot without a
+// frame, so the host can stop auto-restart with the kernel idle.
+#ifndef RING_ENTRIES
+#define RING_ENTRIES 16
+#endif
+#define RING_DESC_WORDS  4
+#define RING_DESC_A      1 // Chunk offsets of the frame in A, B, C
+#define RING_DESC_B      2
+#define RING_DESC_C      3
+#define RING_WORDS       (RING_ENTRIES * RING_DESC_WORDS)
+#define RING_FLAG_STOP   1
+#define RING_DESC_HEAD(seq, frame, flags) \
+    ((uint64_t)(uint32_t)(seq) | ((uint64_t)((frame) & 0xFFFFFF) << 32) | ((uint64_t)((flags) & 0xFF) << 56))
+#define RING_DESC_SEQ(word)   ((uint32_t)(word))
+#define RING_DESC_FRAME(word) ((int)(((word) >> 32) & 0xFFFFFF))
+#define RING_DESC_FLAGS(word) ((int)((word) >> 56))
+#define RING_STATUS_DONE  0 // Descriptors retired so far
+#define RING_STATUS_FRAME 1 // Frame index of the last one
+#define RING_STATUS_WORDS 2
+
 // Threshold values
 #define THRESH_LOW 32
 #define THRESH_HIGH 96
 
+// Posterize stage: up to POSTERIZE_MAX_LEVELS output levels selected by
+// num_levels - 1 ascending thresholds (a diff >= thr[i] moves up one level).
+// post_thr03 packs unsigned 8-bit thresholds 0..3 ([7:0] = thr[0]) and
+// post_thr46 thresholds 4..6; level i outputs POSTERIZE_LEVEL_VALUE(i, n),
+// i.e. 0..255 evenly spaced (0/128/255 for three levels).
+// -DPOSTERIZE_FIXED ignores the arguments and uses the defaults below.
+#define POSTERIZE_MAX_LEVELS 8
+#define POSTERIZE_PACK4(t0, t1, t2, t3) ((int)(((unsigned)(t0) & 0xFF) | (((unsigned)(t1) & 0xFF) << 8) | \
+                                               (((unsigned)(t2) & 0xFF) << 16) | (((unsigned)(t3) & 0xFF) << 24)))
+#define POSTERIZE_THR(word, idx)  ((int)(((unsigned)(word) >> (8 * (idx))) & 0xFF))
+#define POSTERIZE_LEVEL_VALUE(i, n) ((255 * (i) + ((n) - 1) / 2) / ((n) - 1))
+
+#define POSTERIZE_DEFAULT_THR03  POSTERIZE_PACK4(THRESH_LOW, THRESH_HIGH, 0, 0)
+#define POSTERIZE_DEFAULT_THR46  0
+#define POSTERIZE_DEFAULT_LEVELS 3
+
 #endif
@@ -0,0 +1,86 @@
+/**
+ * @file luma.h
+ * @brief Software reference for V3's camera front end (-DV3_LUMA)
+ *
+ * luma_convert_ref() turns camera-layout rows into the 8-bit luma the
+ * kernel's convert stage feeds to the diff, with the same LUMA_RGB()
+ * rounding; luma_pack_ref() builds camera rows with a given luma (exact for
+ * LUMA_Y8 and LUMA_YUYV), for generating test input.
+ */
+
+#ifndef LUMA_H
+#define LUMA_H
+
+#include "image_defines.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Bytes per pixel of a LUMA_* layout
+#define LUMA_PIXEL_BYTES(fmt) LUMA_WORDS_PER_CHUNK(fmt)
+
+/**
+ * @param src       rows x cols pixels in layout fmt, src_pitch bytes per row
+ * @param dst       rows x cols luma bytes, dst_pitch bytes per row
+ */
+static inline void luma_convert_ref(const uint8_t *src, int rows, int cols, size_t src_pitch, int fmt,
+                                    uint8_t *dst, size_t dst_pitch)
+{
+    for (int y = 0; y < rows; y++)
+    {
+        const uint8_t *s = src + (size_t)y * src_pitch;
+        uint8_t *d = dst + (size_t)y * dst_pitch;
+        for (int x = 0; x < cols; x++)
+        {
+            if (fmt == LUMA_YUYV)
+                d[x] = s[2 * x];
+            else if (fmt == LUMA_RGB888)
+                d[x] = (uint8_t)LUMA_RGB(s[3 * x], s[3 * x + 1], s[3 * x + 2]);
+            else
+                d[x] = s[x];
+        }
+    }
+}
+
+/**
+ * Camera rows around the luma in src: chroma (YUYV) or the per-channel
+ * offset from grey (RGB888) comes from chroma(x, y), so an RGB888 pixel's
+ * luma is close to, not equal to, its src value; run luma_convert_ref() on
+ * the result for the exact one.
+ *
+ * @param src       rows x cols luma bytes, src_pitch bytes per row
+ * @param dst       rows x cols pixels in layout fmt, dst_pitch bytes per row
+ * @param chroma    any uint8_t (int x, int y, int channel) callable
+ */
+template <typename CHROMA>
+static inline void luma_pack_ref(const uint8_t *src, int rows, int cols, size_t src_pitch, int fmt,
+                                 uint8_t *dst, size_t dst_pitch, CHROMA chroma)
+{
+    for (int y = 0; y < rows; y++)
+    {
+        const uint8_t *s = src + (size_t)y * src_pitch;
+        uint8_t *d = dst + (size_t)y * dst_pitch;
+        for (int x = 0; x < cols; x++)
+        {
+            if (fmt == LUMA_YUYV)
+            {
+                d[2 * x] = s[x];
+                d[2 * x + 1] = chroma(x, y, x & 1);
+            }
+            else if (fmt == LUMA_RGB888)
+            {
+                for (int c = 0; c < 3; c++)
+                {
+                    const int v = s[x] + (int)chroma(x, y, c) / 8 - 16;
+                    d[3 * x + c] = (uint8_t)((v < 0) ? 0 : (v > 255) ? 255 : v);
+                }
+            }
+            else
+            {
+                d[x] = s[x];
+            }
+        }
+    }
+}
+
+#endif // LUMA_H
@@ -0,0 +1,33 @@
+/**
+ * @file pyramid.h
+ * @brief Software reference for V3's resolution pyramid (-DV3_PYRAMID)
+ *
+ * pyramid_level_ref() builds one level from the level below with the
+ * kernel's rounded 2x2 mean (PYR_MEAN4); applied to C and then to its own
+ * output it gives both levels the kernel writes.
+ */
+
+#ifndef PYRAMID_H
+#define PYRAMID_H
+
+#include "image_defines.h"
+
+#include <stdint.h>
+
+/**
+ * @param src       rows x cols pixels, src_pitch bytes per row
+ * @param dst       PYR_ROWS(rows, 1) x PYR_COLS(cols, 1) pixels, dst_pitch bytes per row
+ */
+static inline void pyramid_level_ref(const uint8_t *src, int rows, int cols, int src_pitch,
+                                     uint8_t *dst, int dst_pitch)
+{
+    for (int y = 0; y < PYR_ROWS(rows, 1); y++)
+    {
+        const uint8_t *up = src + (size_t)(2 * y) * src_pitch;
+        const uint8_t *dn = up + src_pitch;
+        for (int x = 0; x < PYR_COLS(cols, 1); x++)
+            dst[(size_t)y * dst_pitch + x] = PYR_MEAN4(up[2 * x], up[2 * x + 1], dn[2 * x], dn[2 * x + 1]);
+    }
+}
+
+#endif // PYRAMID_H
@@ -0,0 +1,81 @@
+/**
+ * @file result_codec.h
+ * @brief Host-side decoder for V3's compressed output (-DV3_COMPRESS)
+ *
+ * The kernel writes only the non-zero result chunks, back to back, and a
+ * comp_index buffer: word 0 = kept-chunk count, then one keep bit per chunk
+ * in writer order (strip by strip, every row of the batch within a strip).
+ * comp_decode() walks that order once and rebuilds the padded C layout,
+ * copying kept chunks and zero-filling the rest; each chunk moves as two
+ * 32-byte AVX2 loads/stores when the host is built with -mavx2.
+ */
+
+#ifndef RESULT_CODEC_H
+#define RESULT_CODEC_H
+
+#include "image_defines.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+static inline void comp_copy_chunk(uint8_t *dst, const uint8_t *src)
+{
+#ifdef __AVX2__
+    _mm256_storeu_si256((__m256i *)dst, _mm256_loadu_si256((const __m256i *)src));
+    _mm256_storeu_si256((__m256i *)(dst + 32), _mm256_loadu_si256((const __m256i *)(src + 32)));
+#else
+    memcpy(dst, src, DATA_WIDTH_BITS / 8);
+#endif
+}
+
+static inline void comp_zero_chunk(uint8_t *dst)
+{
+#ifdef __AVX2__
+    const __m256i z = _mm256_setzero_si256();
+    _mm256_storeu_si256((__m256i *)dst, z);
+    _mm256_storeu_si256((__m256i *)(dst + 32), z);
+#else
+    memset(dst, 0, DATA_WIDTH_BITS / 8);
+#endif
+}
+
+/**
+ * @brief Expand packed chunks + index into rows * stride_chunks chunks.
+ *
+ * @param packed     Kept chunks as written to C (index[0] of them)
+ * @param index      COMP_INDEX_WORDS(height, stride_chunks, num_frames) words
+ * @param out        Padded output, rows = height * num_frames rows of
+ *                   stride_chunks chunks (must not overlap packed)
+ * @return Number of chunks copied, which matches index[0] if the index is
+ *         consistent
+ */
+static inline uint64_t comp_decode(const uint8_t *packed, const uint64_t *index, uint8_t *out,
+                                   int rows, int stride_chunks)
+{
+    const size_t chunk_bytes = DATA_WIDTH_BITS / 8;
+    uint64_t kept = 0;
+    uint64_t bit = 0; // Position in writer order
+    for (int c0 = 0; c0 < stride_chunks; c0 += STRIP_MAX_CHUNKS)
+    {
+        const int c1 = (c0 + STRIP_MAX_CHUNKS < stride_chunks) ? c0 + STRIP_MAX_CHUNKS : stride_chunks;
+        for (int r = 0; r < rows; r++)
+        {
+            uint8_t *row = out + ((size_t)r * stride_chunks) * chunk_bytes;
+            for (int c = c0; c < c1; c++, bit++)
+            {
+                const uint64_t w = index[1 + bit / 64];
+                if (((w >> (bit % 64)) & 1) != 0)
+                    comp_copy_chunk(row + (size_t)c * chunk_bytes, packed + (kept++) * chunk_bytes);
+                else
+                    comp_zero_chunk(row + (size_t)c * chunk_bytes);
+            }
+        }
+    }
+    return kept;
+}
+
+#endif // RESULT_CODEC_H
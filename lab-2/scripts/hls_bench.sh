@@ -0,0 +1,113 @@
+#!/bin/bash
+# Description: Synthesize and co-simulate V1/V2/V3 over a frame-size sweep and
+# collect latency, II, resources and achieved pixels/cycle into one table.
+#
+# Usage: scripts/hls_bench.sh [-j JOBS] [-p PART] [-c PERIOD_NS] [-o CSV] [-v VARIANTS] [-f CFLAGS] [SIZE...]
+#   SIZE is HEIGHTxWIDTH (default: 256x256 720x1280 1080x1920 2160x3840)
+#   VARIANTS is a space-separated list (default "v1 v2 v3"); vN:L builds with
+#   -DV3_LANES=L, e.g. -v "v3 v3:32 v3:16 v3:8" for the lane-count sweep
+#   CFLAGS are added to every run, e.g. -f -DV3_RETIME -c 2.22 for 450 MHz
+# Needs vitis_hls on PATH. Each (variant, size) is its own HLS project under
+# $WORK_DIR (default ./hls_bench), so runs are independent and resumable.
+
+set -o pipefail
+
+JOBS=$(nproc)
+PART="xcu200-fsgd2104-2-e"   # Alveo U200, as in the README
+PERIOD="3.33"                # 300 MHz
+CSV="hls_bench.csv"
+VARIANTS=(v1 v2 v3)
+EXTRA_CFLAGS=""
+
+while getopts "j:p:c:o:v:f:" opt; do
+    case $opt in
+        j) JOBS=$OPTARG ;;
+        p) PART=$OPTARG ;;
+        c) PERIOD=$OPTARG ;;
+        o) CSV=$OPTARG ;;
+        v) read -r -a VARIANTS <<< "$OPTARG" ;;
+        f) EXTRA_CFLAGS=$OPTARG ;;
+        *) sed -n 2,12p "$0"; exit 1 ;;
+    esac
+done
+shift $((OPTIND - 1))
+SIZES=("$@")
+[ ${#SIZES[@]} -eq 0 ] && SIZES=(256x256 720x1280 1080x1920 2160x3840)
+
+SCRIPT_DIR=$(dirname "$(realpath "$0")")
+LAB2_DIR=$(realpath "$SCRIPT_DIR/..")
+WORK_DIR=$(realpath -m "${WORK_DIR:-hls_bench}")
+
+command -v vitis_hls > /dev/null || { echo "vitis_hls not found on PATH"; exit 1; }
+
+# Vitis project layout for the kernels' "../../inc/..." includes
+mkdir -p "$WORK_DIR/kernel/src"
+ln -sfn "$LAB2_DIR/inc" "$WORK_DIR/inc"
+
+# --- 1. Synthesis + co-simulation, JOBS at a time ---
+# Project name of a variant spec: v3 -> v3, v3:16 -> v3_l16
+project_name() {
+    echo "${1/:/_l}"
+}
+
+run_one() {
+    local variant=$1 size=$2
+    local h=${size%x*} w=${size#*x}
+    local name flags
+    name=$(project_name "$variant")
+    flags="-DMAX_HEIGHT=$h -DMAX_WIDTH=$w -DROW_BUF_MAX_WIDTH=$w $EXTRA_CFLAGS"
+    [[ "$variant" == *:* ]] && flags="$flags -DV3_LANES=${variant#*:}"
+    local log="$WORK_DIR/${name}_${size}.log"
+    (cd "$WORK_DIR" && vitis_hls -f "$SCRIPT_DIR/hls_bench.tcl" \
+        -tclargs "${variant%%:*}" "$h" "$w" "$WORK_DIR" "$PART" "$PERIOD" "$flags" "$name") \
+        > "$log" 2>&1 || echo "$variant $size: vitis_hls failed, see $log"
+}
+
+for variant in "${VARIANTS[@]}"; do
+    for size in "${SIZES[@]}"; do
+        while [ "$(jobs -rp | wc -l)" -ge "$JOBS" ]; do
+            wait -n
+        done
+        echo "Running $variant $size..."
+        run_one "$variant" "$size" &
+    done
+done
+wait
+
+# --- 2. Collect reports ---
+# csynth.xml: static II and resources; cosim.rpt: the measured latency for
+# this size (the run-time loop bounds make csynth's latency a tripcount guess)
+xml_field() {
+    grep -o "<$2>[^<]*</$2>" "$1" 2> /dev/null | head -1 | sed "s:<[^>]*>::g"
+}
+
+echo "variant,height,width,latency_cycles,ii,bram_18k,dsp,ff,lut,px_per_cycle,us_at_clock" > "$CSV"
+printf "%-8s %-10s %12s %8s %8s %6s %8s %8s %8s %10s\n" \
+    Variant Size Latency II BRAM_18K DSP FF LUT "px/cycle" "us"
+for variant in "${VARIANTS[@]}"; do
+    for size in "${SIZES[@]}"; do
+        h=${size%x*}
+        w=${size#*x}
+        sol="$WORK_DIR/$(project_name "$variant")_${h}x${w}/solution"
+        xml="$sol/syn/report/csynth.xml"
+        rpt="$sol/sim/report/IMAGE_DIFF_POSTERIZE_cosim.rpt"
+
+        # | Verilog | Pass | min | avg | max | ... : take the average latency
+        lat=$(grep -E "^\|\s*Verilog\s*\|\s*Pass" "$rpt" 2> /dev/null | awk -F'|' '{gsub(/ /,"",$5); print $5}')
+        ii=$(xml_field "$xml" Interval-min)
+        bram=$(xml_field "$xml" BRAM_18K)
+        dsp=$(xml_field "$xml" DSP)
+        ff=$(xml_field "$xml" FF)
+        lut=$(xml_field "$xml" LUT)
+        if [[ "$lat" =~ ^[0-9]+$ ]] && [ "$lat" -gt 0 ]; then
+            ppc=$(awk -v p=$((h * w)) -v l="$lat" 'BEGIN { printf "%.2f", p / l }')
+            us=$(awk -v l="$lat" -v t="$PERIOD" 'BEGIN { printf "%.1f", l * t / 1000 }')
+        else
+            lat="n/a"; ppc="n/a"; us="n/a"
+        fi
+        printf "%-8s %-10s %12s %8s %8s %6s %8s %8s %8s %10s\n" \
+            "$variant" "$size" "$lat" "${ii:-n/a}" "${bram:-n/a}" "${dsp:-n/a}" "${ff:-n/a}" "${lut:-n/a}" "$ppc" "$us"
+        echo "$variant,$h,$w,$lat,$ii,$bram,$dsp,$ff,$lut,$ppc,$us" >> "$CSV"
+    done
+done
+echo "Table written to $CSV"
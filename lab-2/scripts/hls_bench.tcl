@@ -0,0 +1,30 @@
+# Description: Synthesize and co-simulate one kernel variant at one frame size.
+# Called by hls_bench.sh; it passes the arguments below after -tclargs.
+#
+# vitis_hls -f hls_bench.tcl -tclargs <variant> <height> <width> <work_dir> <part> <period_ns> [cflags] [name]
+#   variant: v1 | v2 | v3 (IMAGE_DIFF_POSTERIZE in src_hw/accelerated_<variant>.cpp)
+#   name:    project name prefix (default: variant)
+
+lassign $argv variant height width work_dir part period cflags name
+if {$name eq ""} {
+    set name $variant
+}
+
+set lab2_dir [file normalize [file join [file dirname [info script]] ..]]
+
+# The kernels include "../../inc/..." as laid out in a Vitis project;
+# work_dir/kernel/src -> work_dir/inc mirrors that (hls_bench.sh creates it)
+set inc_flags "-I$work_dir/kernel/src -I$lab2_dir/inc $cflags"
+
+open_project -reset [file join $work_dir "${name}_${height}x${width}"]
+set_top IMAGE_DIFF_POSTERIZE
+add_files [file join $lab2_dir src_hw "accelerated_${variant}.cpp"] -cflags $inc_flags
+add_files -tb [file join $lab2_dir src_sw hls_tb.cpp] -cflags $inc_flags
+
+open_solution -reset -flow_target vitis solution
+set_part $part
+create_clock -period $period -name default
+
+csynth_design
+cosim_design -argv "$height $width" -trace_level none
+exit
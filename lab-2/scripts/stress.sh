@@ -0,0 +1,60 @@
+#!/bin/bash
+# Description: Build the C-simulation testbenches for every kernel variant and
+# run their randomized / edge-pattern sweep (--stress), one report line each.
+#
+# Usage: scripts/stress.sh [SEEDS] [extra g++ flags...]
+#   e.g. scripts/stress.sh 256 -DFAST_CSIM
+# Needs the Vitis HLS headers (ap_int.h, hls_stream.h): $XILINX_HLS/include.
+
+set -o pipefail
+
+SEEDS=${1:-64}
+shift
+EXTRA_FLAGS=("$@")
+
+LAB2_DIR=$(dirname "$(realpath "$0")")/..
+LAB1_DIR=$LAB2_DIR/../lab-1
+HLS_INC=${XILINX_HLS:?set XILINX_HLS to the Vitis HLS install}/include
+BUILD_DIR=$(mktemp -d)
+trap 'rm -rf "$BUILD_DIR"' EXIT
+
+# The kernels include "../../inc/..." as laid out in a Vitis project
+# (kernel/src next to inc/); recreate that layout under the build dir
+mkdir -p "$BUILD_DIR/kernel/src"
+ln -s "$LAB2_DIR/inc" "$BUILD_DIR/inc"
+
+CXX=${CXX:-g++}
+CXXFLAGS=(-O2 -w -I"$HLS_INC" "${EXTRA_FLAGS[@]}")
+
+# "name|extra flags|kernel source"
+VARIANTS=(
+    "v1||$LAB2_DIR/src_hw/accelerated_v1.cpp"
+    "v2||$LAB2_DIR/src_hw/accelerated_v2.cpp"
+    "v3||$LAB2_DIR/src_hw/accelerated_v3.cpp"
+    "v4|-DTB_V4|$LAB2_DIR/src_hw/accelerated_v4.cpp"
+    "v5|-DTB_V5|$LAB2_DIR/src_hw/accelerated_v5.cpp"
+    "v6|-DTB_V6|$LAB2_DIR/src_hw/accelerated_v6.cpp"
+)
+
+FAILED=0
+for entry in "${VARIANTS[@]}"; do
+    IFS='|' read -r name flags src <<< "$entry"
+    if ! $CXX "${CXXFLAGS[@]}" $flags -I"$BUILD_DIR/kernel/src" "$LAB2_DIR/src_sw/hls_tb.cpp" "$src" \
+            -o "$BUILD_DIR/tb_$name"; then
+        echo "STRESS $name: build failed"
+        FAILED=1
+        continue
+    fi
+    "$BUILD_DIR/tb_$name" --stress "$SEEDS" "$name" | grep -v "^TEST" || FAILED=1
+done
+
+# lab-1 kernel (fixed 3-level posterize, no filter)
+if $CXX "${CXXFLAGS[@]}" -I"$LAB1_DIR/inc" "$LAB1_DIR/src/tb_image_diff.cpp" \
+        "$LAB1_DIR/src/image_diff_accelarated.cpp" -o "$BUILD_DIR/tb_lab1"; then
+    "$BUILD_DIR/tb_lab1" --stress "$SEEDS" | grep "^STRESS" || FAILED=1
+else
+    echo "STRESS lab-1: build failed"
+    FAILED=1
+fi
+
+exit $FAILED
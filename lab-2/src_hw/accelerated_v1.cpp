@@ -10,10 +10,12 @@
 *   Stage 2: Apply 3x3 sharpen filter on C_tmp -> C_filt
 *   Stage 3: Pack C_filt into 512-bit words and write to output C
 *
-* KEY DESIGN CHOICE: Full-frame local buffers (no streaming)
+* KEY DESIGN CHOICE: Row-block local buffers (no streaming)
 * - Simpler to implement and debug
-* - Requires more BRAM resources
-* - Stages execute sequentially (not overlapped)
+* - Stages execute sequentially (not overlapped), one block of
+*   ROW_BLOCK_ROWS rows at a time, through rings of two row blocks
+* - BRAM scales with the row width, not the frame
+* - Image size is a run-time argument; width is bounded by ROW_BUF_MAX_WIDTH
 *
 * ============================================================================
 * MEMORY ACCESS PATTERN
@@ -21,68 +23,67 @@
 * Uses 512-bit wide AXI master interfaces for efficient DDR access.
 * Each 512-bit word contains 64 pixels (64 x 8-bit = 512-bit).
 *
-* Sharpen kernel (Laplacian-based):
+* Sharpen kernel (Laplacian-based by default):
 *   [ 0 -1  0 ]
 *   [-1  5 -1 ]    -> Enhances edges by subtracting neighbors from center
 *   [ 0 -1  0 ]
+* The taps and a right shift are run-time arguments (coef_r0..r2,
+* coef_shift); -DSHARPEN_FIXED makes them compile-time constants.
+* Frame borders follow the run-time border_mode (zero, replicate, mirror
+* or pass-through).
+* Posterize thresholds and level count are run-time arguments too
+* (post_thr03, post_thr46, post_levels; -DPOSTERIZE_FIXED).
 *
 */
 
 #include "../../inc/hls_helpers.h"
 
-extern "C" {
-
 /**
-* @brief Top-level HLS kernel for image difference, posterization, and sharpening.
+* @brief Process one frame pair through the three sequential stages.
 *
-* @param A Input image A as array of 512-bit words (64 pixels per word)
-* @param B Input image B as array of 512-bit words (64 pixels per word)
-* @param C Output image as array of 512-bit words (64 pixels per word)
+* The frame is handled one row block (ROW_BLOCK_ROWS rows = one tile row)
+* at a time: stage 1 posterizes the block, stage 2 filters every row whose
+* south neighbour is now posterized (one row behind stage 1, except at the
+* end of the frame), and stage 3 packs and writes those rows.
+*
+* Also writes the frame's words of the change map and returns whether any
+* tile changed.
 */
-   void IMAGE_DIFF_POSTERIZE(const uint512_t *A, const uint512_t *B, uint512_t *C)
-   {
-   // ========================================================================
-   // AXI INTERFACE PRAGMAS
-   // ========================================================================
-   // m_axi: AXI4 Master interface for DDR memory access
-   //   - offset=slave: Base address provided by host via AXI-Lite
-   //   - bundle=gmemX: Separate memory ports for concurrent A/B/C access
-   //   - depth=TOTAL_CHUNKS: Memory depth hint for co-simulation
-#pragma HLS INTERFACE m_axi port = A offset = slave bundle = gmemA depth = TOTAL_CHUNKS
-#pragma HLS INTERFACE m_axi port = B offset = slave bundle = gmemB depth = TOTAL_CHUNKS
-#pragma HLS INTERFACE m_axi port = C offset = slave bundle = gmemC depth = TOTAL_CHUNKS
-
-   // s_axilite: AXI4-Lite slave interface for control signals
-   //   - Provides start/done/idle signals and function arguments to host
-#pragma HLS INTERFACE s_axilite port = A bundle = control
-#pragma HLS INTERFACE s_axilite port = B bundle = control
-#pragma HLS INTERFACE s_axilite port = C bundle = control
-#pragma HLS INTERFACE s_axilite port = return bundle = control
+static bool process_frame(const uint512_t *A, const uint512_t *B, uint512_t *C,
+                          int height, int width, int stride_chunks,
+                          const posterize_params_t &post_params, const sharpen_coeffs_t &coeffs,
+                          int border_mode, uint64_t *change_map, int map_tile_rows, int first_tile_row)
+{
+   const int padded_width = stride_chunks * PIXELS_PER_CHUNK;
+   const int num_blocks = (height + ROW_BLOCK_ROWS - 1) / ROW_BLOCK_ROWS;
 
    // ========================================================================
    // LOCAL BUFFERS (BRAM)
    // ========================================================================
-   // Static arrays to hold full image frames in on-chip BRAM.
-   // Using PADDED_IMAGE_SIZE ensures 64-byte aligned rows for efficient access.
+   // Static row rings holding two row blocks (ping-pong), indexed by
+   // row % ROW_RING_ROWS. Using padded rows ensures 64-byte aligned rows
+   // for efficient access.
    //
-   // C_tmp: Holds posterized difference result (Stage 1 output)
-   // C_filt: Holds filtered result (Stage 2 output)
+   // C_tmp: Holds posterized difference rows (Stage 1 output). While the
+   //        filter works on rows [bR-1, bR+R-1) it reads rows bR-2 .. bR+R-1,
+   //        R + 2 <= 2R consecutive rows, so nothing it needs is overwritten.
+   // C_filt: Holds filtered rows (Stage 2 output) until Stage 3 packs them
    //
    // 'static' keyword: Ensures arrays are allocated in BRAM, not registers
    // 2D ARRAYS: [row][col] layout enables row-based partitioning for filter
-   static pixel_t C_tmp[HEIGHT][PADDED_WIDTH];
-   static pixel_t C_filt[HEIGHT][PADDED_WIDTH];
+   static pixel_t C_tmp[ROW_RING_ROWS][ROW_BUF_MAX_PADDED_WIDTH];
+   static pixel_t C_filt[ROW_RING_ROWS][ROW_BUF_MAX_PADDED_WIDTH];
 
    // -------------------------------------------------------------------------
    // ARRAY PARTITIONING FOR C_tmp (used by Filter stage)
    // -------------------------------------------------------------------------
-   // The 5-point stencil filter accesses 5 pixels simultaneously:
-   //   north[i-1][j], south[i+1][j], west[i][j-1], center[i][j], east[i][j+1]
+   // The 3x3 stencil filter accesses 9 pixels simultaneously:
+   //   rows i-1, i, i+1 x columns j-1, j, j+1
    //
-   // dim=1 (rows): Cyclic factor=3 places consecutive rows in different BRAM banks
-   //   → Rows i-1, i, i+1 map to banks (i-1)%3, i%3, (i+1)%3 (always different)
+   // dim=1 (rows): Complete partitioning gives every ring row its own bank
+   //   → Rows i-1, i, i+1 are always in different banks, across the wrap too
    //   → Enables parallel read of north, center, south
-#pragma HLS ARRAY_PARTITION variable=C_tmp cyclic factor=3 dim=1
+#pragma HLS ARRAY_PARTITION variable=C_tmp complete dim=1
 
    // dim=2 (cols): Cyclic factor=64 places consecutive columns in different banks
    //   → Columns j-1, j, j+1 map to different banks (since 64 > 3)
@@ -97,139 +98,305 @@ extern "C" {
    // in parallel when packing them into 512-bit output chunks
 #pragma HLS ARRAY_PARTITION variable=C_filt cyclic factor=PIXELS_PER_CHUNK dim=2
 
-   // ========================================================================
-   // STAGE 1: POSTERIZED ABSOLUTE DIFFERENCE
-   // ========================================================================
-   // Read 512-bit chunks from DDR, compute |A-B|, posterize, store to C_tmp
-   //
-   // Execution: TOTAL_CHUNKS iterations, processing 64 pixels per iteration
-   // Memory pattern: Sequential burst reads from DDR (efficient)
-Posterize_Main_Loop:
-   for (int chunk_idx = 0; chunk_idx < TOTAL_CHUNKS; chunk_idx++)
+   // Tile change flags of the current tile row, one per 64 px column
+   // (cleared again by write_tile_row_change_map after each block)
+   static bool tile_changed[ROW_BUF_MAX_CHUNKS_PER_ROW];
+#pragma HLS ARRAY_PARTITION variable=tile_changed complete dim=1
+
+   bool any_change = false;
+
+   // Stage positions carried across blocks. (row, col_base) are tracked as
+   // counters: run-time '/' and '%' by stride_chunks would otherwise
+   // instantiate dividers in the datapath.
+   int post_row = 0;
+   int post_col_base = 0;
+   int post_chk = 0;
+   int chunk_idx = 0;   // Next A/B chunk
+   int filt_row = 0;    // Next row to filter
+   int pack_idx = 0;    // Next C chunk
+
+Block_Loop:
+   for (int b = 0; b < num_blocks; b++)
    {
-       // PIPELINE II=1: Target one new 512-bit chunk per clock cycle
-       // This creates a deeply pipelined loop that processes chunks continuously
+#pragma HLS LOOP_TRIPCOUNT min = HEIGHT / ROW_BLOCK_ROWS max = MAX_HEIGHT / ROW_BLOCK_ROWS
+       const int block_row0 = b * ROW_BLOCK_ROWS;
+       const bool last_block = (block_row0 + ROW_BLOCK_ROWS >= height);
+       const int block_rows = last_block ? height - block_row0 : ROW_BLOCK_ROWS;
+
+       // ====================================================================
+       // STAGE 1: POSTERIZED ABSOLUTE DIFFERENCE
+       // ====================================================================
+       // Read 512-bit chunks from DDR, compute |A-B|, posterize, store to C_tmp
+       //
+       // Execution: block_rows * stride_chunks iterations, 64 pixels each
+       // Memory pattern: Sequential burst reads from DDR (efficient)
+Posterize_Main_Loop:
+       for (int i = 0; i < block_rows * stride_chunks; i++)
+       {
+           // PIPELINE II=1: Target one new 512-bit chunk per clock cycle
+           // This creates a deeply pipelined loop that processes chunks continuously
 #pragma HLS PIPELINE II = 1
-#pragma HLS LOOP_TRIPCOUNT min = TOTAL_CHUNKS max = TOTAL_CHUNKS
+#pragma HLS LOOP_TRIPCOUNT min = ROW_BLOCK_ROWS * CHUNKS_PER_ROW max = ROW_BLOCK_MAX_CHUNKS
 
-       // Burst read: Load 64 pixels (512 bits) from each input image
-       const uint512_t chunk_A = A[chunk_idx];
-       const uint512_t chunk_B = B[chunk_idx];
+           // Burst read: Load 64 pixels (512 bits) from each input image
+           const uint512_t chunk_A = A[chunk_idx];
+           const uint512_t chunk_B = B[chunk_idx];
+           chunk_idx++;
 
-       // Process all 64 pixels within this chunk
+           // Process all 64 pixels within this chunk
+           bool chunk_changed = false;
 Posterize_Process_Loop:
-       for (int k = 0; k < PIXELS_PER_CHUNK; k++)
-       {
-           // UNROLL: Replicate hardware 64x to process all pixels in parallel
-           // Combined with outer PIPELINE, enables 64 pixels/cycle throughput
+           for (int k = 0; k < PIXELS_PER_CHUNK; k++)
+           {
+               // UNROLL: Replicate hardware 64x to process all pixels in parallel
+               // Combined with outer PIPELINE, enables 64 pixels/cycle throughput
 #pragma HLS UNROLL
 
-           // Extract individual 8-bit pixels from 512-bit word
-           // .range(high_bit, low_bit) extracts bits [high_bit:low_bit]
-           // Pixel k occupies bits [k*8+7 : k*8]
-           const pixel_t pA = chunk_A.range((k * 8) + 7, k * 8);
-           const pixel_t pB = chunk_B.range((k * 8) + 7, k * 8);
+               // Extract individual 8-bit pixels from 512-bit word
+               // .range(high_bit, low_bit) extracts bits [high_bit:low_bit]
+               // Pixel k occupies bits [k*8+7 : k*8]
+               const pixel_t pA = chunk_A.range((k * 8) + 7, k * 8);
+               const pixel_t pB = chunk_B.range((k * 8) + 7, k * 8);
 
-           // Compute absolute difference
-           const pixel_t abs_diff = (pA > pB) ? (pA - pB) : (pB - pA);
+               // Compute absolute difference
+               const pixel_t abs_diff = (pA > pB) ? (pA - pB) : (pB - pA);
 
-           // Apply posterization to quantize to 3 levels
-           const pixel_t post = posterize(abs_diff);
+               // Apply posterization to quantize to 3 levels
+               const pixel_t post = posterize(abs_diff, post_params);
 
-           // Calculate 2D coordinates
-           // chunk_idx maps to (row, col) and k is the offset within chunk
-           const int row = chunk_idx / CHUNKS_PER_ROW;
-           const int col = (chunk_idx % CHUNKS_PER_ROW) * PIXELS_PER_CHUNK + k;
+               // Calculate 2D coordinates
+               // post_row selects the ring row and k is the offset within chunk
+               const int col = post_col_base + k;
 
-           // Store to local buffer using 2D indexing
-        C_tmp[row][col] = post;
+               // Store to local buffer using 2D indexing
+               C_tmp[post_row % ROW_RING_ROWS][col] = post;
+               chunk_changed = chunk_changed || (post != 0);
+           }
+
+           // Flags are only ever set here, so there is no read-modify-write
+           if (chunk_changed)
+               tile_changed[post_chk] = true;
+
+           post_col_base += PIXELS_PER_CHUNK;
+           post_chk++;
+           if (post_col_base == padded_width)
+           {
+               post_col_base = 0;
+               post_chk = 0;
+               post_row++;
+           }
        }
-   }
 
-   // ========================================================================
-   // STAGE 2: 3×3 SHARPEN FILTER
-   // ========================================================================
-   // Apply sharpening convolution using Laplacian-based kernel:
-   //   output = 5*center - north - south - west - east
+       any_change |= write_tile_row_change_map(tile_changed, stride_chunks, change_map,
+                                               map_tile_rows, first_tile_row + b);
+
+       // ====================================================================
+       // STAGE 2: 3×3 SHARPEN FILTER
+       // ====================================================================
+       // Apply the 3x3 convolution (default Laplacian-based kernel:
+       //   output = 5*center - north - south - west - east)
+       // to every row whose south neighbour is posterized; after the last
+       // block that is the rest of the frame.
+       //
+       // The column loop covers the padded row so the padding columns of C_filt
+       // are rewritten (as zero) every call instead of holding stale data.
+       const int filt_end = last_block ? height : block_row0 + ROW_BLOCK_ROWS - 1;
+       const int pack_row0 = filt_row;
 Filter_Row:
-   for (int i = 0; i < HEIGHT; i++)
-   {
-#pragma HLS LOOP_TRIPCOUNT min = HEIGHT max = HEIGHT
-Filter_Col:
-       for (int j = 0; j < WIDTH; j++)
+       for (int i = pack_row0; i < filt_end; i++)
        {
+#pragma HLS LOOP_TRIPCOUNT min = ROW_BLOCK_ROWS max = ROW_BLOCK_ROWS + 1
+Filter_Col:
+           for (int j = 0; j < padded_width; j++)
+           {
 #pragma HLS PIPELINE II = 1
-#pragma HLS LOOP_TRIPCOUNT min = WIDTH max = WIDTH
+#pragma HLS LOOP_TRIPCOUNT min = PADDED_WIDTH max = ROW_BUF_MAX_PADDED_WIDTH
 
-           // Border pixels (first/last row and column) are set to 0
-           if (i == 0 || j == 0 || i == HEIGHT - 1 || j == WIDTH - 1)
-           {
-               C_filt[i][j] = 0;
-           }
-           else
-           {
-               // Fetch 5 pixels for the sharpen kernel (cross pattern)
-               // Cast to int to allow negative intermediate results
-               // 2D indexing enables row-based partitioning for parallel access
-               const int center = (int)C_tmp[i][j];
-               const int north  = (int)C_tmp[i - 1][j];  // Row above
-               const int south  = (int)C_tmp[i + 1][j];  // Row below
-               const int west   = (int)C_tmp[i][j - 1];  // Left
-               const int east   = (int)C_tmp[i][j + 1];  // Right
-
-               // Apply sharpen kernel: output = 5*center - north - south - west - east
-               // Result can be negative (clamped to 0) or > 255 (clamped to 255)
-               const int s = 5 * center - north - south - west - east;
-
-               // Clip result to valid [0, 255] range
-               C_filt[i][j] = clip_u8(s);
+               // Row padding is set to 0; frame edges follow border_mode
+               if (j >= width)
+               {
+                   C_filt[i % ROW_RING_ROWS][j] = 0;
+               }
+               else
+               {
+                   // Fetch the 3x3 neighbourhood for the sharpen kernel
+                   // Cast to int to allow negative intermediate results
+                   // 2D indexing enables row-based partitioning for parallel access
+                   // Taps past the frame edge are not read (sharpen_border
+                   // rewrites them), so the bank of each tap stays fixed
+                   int nb[3][3];
+                   for (int r = 0; r < 3; r++)
+                   {
+#pragma HLS UNROLL
+                       for (int t = 0; t < 3; t++)
+                       {
+#pragma HLS UNROLL
+                           const int y = i + r - 1;
+                           const int x = j + t - 1;
+                           const bool inside = (y >= 0) && (y < height) && (x >= 0) && (x < width);
+                           nb[r][t] = inside ? (int)C_tmp[y % ROW_RING_ROWS][x] : 0;
+                       }
+                   }
+
+                   // Weighted sum, shift, clip to valid [0, 255] range
+                   C_filt[i % ROW_RING_ROWS][j] = sharpen_border(coeffs, nb, border_mode, i == 0, i == height - 1,
+                                                                 j == 0, j == width - 1, height > 1, width > 1);
+               }
            }
        }
-   }
+       filt_row = filt_end;
+
+       // ====================================================================
+       // STAGE 3: PACK AND WRITE OUTPUT
+       // ====================================================================
+       // Pack the rows just filtered from C_filt into 512-bit words and
+       // write them to DDR
+       //
+       // This stage performs the inverse of Stage 1's unpacking:
+       // - Read 64 pixels from C_filt
+       // - Pack them into a single 512-bit word
+       // - Burst write to output memory C
+       int pack_row = pack_row0;
+       int pack_col_base = 0;
 
-   // ========================================================================
-   // STAGE 3: PACK AND WRITE OUTPUT
-   // ========================================================================
-   // Pack filtered pixels from C_filt into 512-bit words and write to DDR
-   //
-   // This stage performs the inverse of Stage 1's unpacking:
-// - Read 64 pixels from C_filt
-// - Pack them into a single 512-bit word
-// - Burst write to output memory C
 Pack_Main_Loop:
-   for (int chunk_idx = 0; chunk_idx < TOTAL_CHUNKS; chunk_idx++)
-   {
-       // PIPELINE II=1: Target one 512-bit output per clock cycle
+       for (int i = 0; i < (filt_end - pack_row0) * stride_chunks; i++)
+       {
+           // PIPELINE II=1: Target one 512-bit output per clock cycle
 #pragma HLS PIPELINE II = 1
-#pragma HLS LOOP_TRIPCOUNT min = TOTAL_CHUNKS max = TOTAL_CHUNKS
+#pragma HLS LOOP_TRIPCOUNT min = ROW_BLOCK_ROWS * CHUNKS_PER_ROW max = ROW_BLOCK_MAX_CHUNKS + ROW_BUF_MAX_CHUNKS_PER_ROW
 
-       // Initialize output chunk to zero
-       uint512_t chunk_C = 0;
+           // Initialize output chunk to zero
+           uint512_t chunk_C = 0;
 
-       // Pack all 64 pixels into the 512-bit word
-       // Calculate row once per chunk (outside inner loop for clarity)
-       const int row = chunk_idx / CHUNKS_PER_ROW;
-       const int col_base = (chunk_idx % CHUNKS_PER_ROW) * PIXELS_PER_CHUNK;
+           // Pack all 64 pixels into the 512-bit word
+           // Row/column base come from the counters (outside inner loop for clarity)
+           const int row = pack_row % ROW_RING_ROWS;
+           const int col_base = pack_col_base;
 
 Pack_Process_Loop:
-       for (int k = 0; k < PIXELS_PER_CHUNK; k++)
-       {
-           // UNROLL: Process all 64 pixels in parallel
+           for (int k = 0; k < PIXELS_PER_CHUNK; k++)
+           {
+               // UNROLL: Process all 64 pixels in parallel
 #pragma HLS UNROLL
 
-           // Calculate column index
-           const int col = col_base + k;
+               // Calculate column index
+               const int col = col_base + k;
+
+               // Read filtered pixel using 2D indexing
+               const pixel_t v = C_filt[row][col];
+
+               // Pack pixel into its position in the 512-bit word
+               // .range() can be used as lvalue for bit insertion
+               chunk_C.range((k * 8) + 7, k * 8) = v;
+           }
 
-           // Read filtered pixel using 2D indexing
-           const pixel_t v = C_filt[row][col];
+           // Burst write: Store complete 512-bit word to DDR
+           C[pack_idx++] = chunk_C;
 
-           // Pack pixel into its position in the 512-bit word
-           // .range() can be used as lvalue for bit insertion
-           chunk_C.range((k * 8) + 7, k * 8) = v;
+           pack_col_base += PIXELS_PER_CHUNK;
+           if (pack_col_base == padded_width)
+           {
+               pack_col_base = 0;
+               pack_row++;
+           }
        }
+   }
+
+   return any_change;
+}
+
+extern "C" {
+
+/**
+* @brief Top-level HLS kernel for image difference, posterization, and sharpening.
+*
+* @param A Input image A as array of 512-bit words (64 pixels per word)
+* @param B Input image B as array of 512-bit words (64 pixels per word)
+* @param C Output image as array of 512-bit words (64 pixels per word)
+* @param height Image height in pixels
+* @param width Image width in pixels (<= ROW_BUF_MAX_WIDTH)
+* @param stride_chunks Row pitch of A/B/C in 512-bit words (>= ceil(width / 64),
+*                      <= ROW_BUF_MAX_CHUNKS_PER_ROW)
+* @param num_frames Number of frame pairs stored back to back in A/B (and C);
+*                   0 writes the kernel properties (KERNEL_PROPS_*) instead
+* @param coef_r0 Sharpen taps, north row (SHARPEN_PACK_ROW)
+* @param coef_r1 Sharpen taps, center row
+* @param coef_r2 Sharpen taps, south row
+* @param coef_shift Right shift applied to the weighted sum before clipping
+* @param border_mode Policy for the first/last row and column (BORDER_*)
+* @param post_thr03 Posterize thresholds 0..3 (POSTERIZE_PACK4)
+* @param post_thr46 Posterize thresholds 4..6
+* @param post_levels Number of posterize output levels (2..POSTERIZE_MAX_LEVELS)
+* @param change_map Per-tile change bits and any-change flag (CHANGE_MAP_WORDS words)
+*/
+   void IMAGE_DIFF_POSTERIZE(const uint512_t *A, const uint512_t *B, uint512_t *C,
+                             int height, int width, int stride_chunks, int num_frames,
+                             int coef_r0, int coef_r1, int coef_r2, int coef_shift, int border_mode,
+                             int post_thr03, int post_thr46, int post_levels,
+                             uint64_t *change_map)
+   {
+   // ========================================================================
+   // AXI INTERFACE PRAGMAS
+   // ========================================================================
+   // m_axi: AXI4 Master interface for DDR memory access
+   //   - offset=slave: Base address provided by host via AXI-Lite
+   //   - bundle=gmemX: Separate memory ports for concurrent A/B/C access
+   //   - depth=TOTAL_CHUNKS: Memory depth hint for co-simulation
+#pragma HLS INTERFACE m_axi port = A offset = slave bundle = gmemA depth = TOTAL_CHUNKS
+#pragma HLS INTERFACE m_axi port = B offset = slave bundle = gmemB depth = TOTAL_CHUNKS
+#pragma HLS INTERFACE m_axi port = C offset = slave bundle = gmemC depth = TOTAL_CHUNKS
+#pragma HLS INTERFACE m_axi port = change_map offset = slave bundle = gmemM depth = CHANGE_MAP_DEFAULT_WORDS
 
-       // Burst write: Store complete 512-bit word to DDR
-       C[chunk_idx] = chunk_C;
+   // s_axilite: AXI4-Lite slave interface for control signals
+   //   - Provides start/done/idle signals and function arguments to host
+#pragma HLS INTERFACE s_axilite port = A bundle = control
+#pragma HLS INTERFACE s_axilite port = B bundle = control
+#pragma HLS INTERFACE s_axilite port = C bundle = control
+#pragma HLS INTERFACE s_axilite port = height bundle = control
+#pragma HLS INTERFACE s_axilite port = width bundle = control
+#pragma HLS INTERFACE s_axilite port = stride_chunks bundle = control
+#pragma HLS INTERFACE s_axilite port = num_frames bundle = control
+#pragma HLS INTERFACE s_axilite port = coef_r0 bundle = control
+#pragma HLS INTERFACE s_axilite port = coef_r1 bundle = control
+#pragma HLS INTERFACE s_axilite port = coef_r2 bundle = control
+#pragma HLS INTERFACE s_axilite port = coef_shift bundle = control
+#pragma HLS INTERFACE s_axilite port = border_mode bundle = control
+#pragma HLS INTERFACE s_axilite port = post_thr03 bundle = control
+#pragma HLS INTERFACE s_axilite port = post_thr46 bundle = control
+#pragma HLS INTERFACE s_axilite port = post_levels bundle = control
+#pragma HLS INTERFACE s_axilite port = change_map bundle = control
+#pragma HLS INTERFACE s_axilite port = return bundle = control
+
+   // num_frames = 0 only reports the build's properties; frames wider than
+   // the row buffers are left untouched (the host checks them beforehand)
+   if (num_frames == 0 || width > ROW_BUF_MAX_WIDTH || stride_chunks > ROW_BUF_MAX_CHUNKS_PER_ROW)
+   {
+       if (num_frames == 0)
+           change_map[0] = KERNEL_PROPS_WITH_MAX_WIDTH(ROW_BUF_MAX_WIDTH) | KERNEL_PROPS_BUILD;
+       return;
+   }
+
+   // ========================================================================
+   // FRAME LOOP
+   // ========================================================================
+   // Batched frames are processed one after another through the row-block
+   // buffers (V1 stages never overlap, so neither do frames).
+   const int frame_chunks = height * stride_chunks;
+   const sharpen_coeffs_t coeffs = unpack_sharpen_coeffs(coef_r0, coef_r1, coef_r2, coef_shift);
+   const posterize_params_t post_params = unpack_posterize_params(post_thr03, post_thr46, post_levels);
+
+   const int frame_tile_rows = (height + TILE_ROWS - 1) / TILE_ROWS;
+   const int map_tile_rows = CHANGE_MAP_TILE_ROWS(height, num_frames);
+   bool any_change = false;
+
+Frame_Loop:
+   for (int f = 0; f < num_frames; f++)
+   {
+       const int offset = f * frame_chunks;
+       any_change |= process_frame(A + offset, B + offset, C + offset, height, width, stride_chunks,
+                                   post_params, coeffs, border_mode, change_map, map_tile_rows, f * frame_tile_rows);
    }
+   change_map[CHANGE_MAP_STRIPS(stride_chunks) * map_tile_rows] = any_change ? 1 : 0;
  }
 } // extern "C"
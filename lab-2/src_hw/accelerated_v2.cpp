@@ -9,11 +9,14 @@
  *   Stage 1: Read 512-bit chunks from A/B, compute |A-B|, posterize -> C_tmp
  *   Stage 2: Apply 3x3 sharpen filter on C_tmp using line buffers -> C_filt
  *   Stage 3: Write filtered results from C_filt to output C
+ * The stages run in turn on each block of ROW_BLOCK_ROWS rows; C_tmp and
+ * C_filt hold two blocks each (ping-pong), not whole frames.
  *
  * KEY DESIGN FEATURES:
  * - 512-bit wide AXI interfaces (64 pixels per memory transaction)
  * - Full-width parallelism (64 pixels processed simultaneously)
  * - Sequential stage execution (stages do NOT overlap)
+ * - Run-time image size; row-block buffers bounded by ROW_BUF_MAX_WIDTH
  *
  * ============================================================================
  * MEMORY ACCESS PATTERN
@@ -21,83 +24,66 @@
  * Uses 512-bit wide AXI master interfaces for efficient DDR access.
  * Each 512-bit word contains 64 pixels (64 x 8-bit = 512-bit).
  *
- * Sharpen kernel (Laplacian-based):
+ * Sharpen kernel (Laplacian-based by default):
  *   [ 0 -1  0 ]
  *   [-1  5 -1 ]    -> Enhances edges by subtracting neighbors from center
  *   [ 0 -1  0 ]
+ * The taps and a right shift are run-time arguments (coef_r0..r2,
+ * coef_shift); -DSHARPEN_FIXED makes them compile-time constants.
+ * Frame borders follow the run-time border_mode (zero, replicate, mirror
+ * or pass-through).
+ * Posterize thresholds and level count are run-time arguments too
+ * (post_thr03, post_thr46, post_levels; -DPOSTERIZE_FIXED).
  */
 
 #include "../../inc/hls_helpers.h"
 
-extern "C" {
-
 /**
- * @brief Top-level HLS kernel for image difference, posterization, and sharpening.
+ * @brief Process one frame pair through the three sequential stages.
  *
- * @param A Input image A as array of 512-bit words (64 pixels per word)
- * @param B Input image B as array of 512-bit words (64 pixels per word)
- * @param C Output image as array of 512-bit words (64 pixels per word)
+ * The frame is handled one row block (ROW_BLOCK_ROWS rows = one tile row)
+ * at a time: stage 1 posterizes the block into one half of a ping-pong
+ * pair, stage 2 feeds it through the line-buffer filter, whose window
+ * state carries over between blocks, and stage 3 writes whichever output
+ * chunks the block completed. The filter output lags its input by one row
+ * plus one chunk, so one extra flush block of stride_chunks + 1 iterations
+ * drains the last row.
+ *
+ * Also writes the frame's words of the change map and returns whether any
+ * tile changed.
  */
-void IMAGE_DIFF_POSTERIZE(const uint512_t *A, const uint512_t *B, uint512_t *C)
+static bool process_frame(const uint512_t *A, const uint512_t *B, uint512_t *C,
+                          int height, int width, int stride_chunks,
+                          const posterize_params_t &post_params, const sharpen_coeffs_t &coeffs,
+                          int border_mode, uint64_t *change_map, int map_tile_rows, int first_tile_row)
 {
-    // ========================================================================
-    // AXI INTERFACE PRAGMAS
-    // ========================================================================
-#pragma HLS INTERFACE m_axi port=A offset=slave bundle=gmemA depth=TOTAL_CHUNKS
-#pragma HLS INTERFACE m_axi port=B offset=slave bundle=gmemB depth=TOTAL_CHUNKS
-#pragma HLS INTERFACE m_axi port=C offset=slave bundle=gmemC depth=TOTAL_CHUNKS
-#pragma HLS INTERFACE s_axilite port=A bundle=control
-#pragma HLS INTERFACE s_axilite port=B bundle=control
-#pragma HLS INTERFACE s_axilite port=C bundle=control
-#pragma HLS INTERFACE s_axilite port=return bundle=control
+    const int total_chunks = height * stride_chunks;
+    const int block_chunks = ROW_BLOCK_ROWS * stride_chunks;
+    const int num_blocks   = (height + ROW_BLOCK_ROWS - 1) / ROW_BLOCK_ROWS;
+    const int LOOP_LIMIT   = total_chunks + stride_chunks + 1;
 
     // ========================================================================
-    // LOCAL BUFFERS (BRAM)
+    // LOCAL BUFFERS (BRAM): two row blocks each, indexed by block parity
     // ========================================================================
-    static uint512_t C_tmp[TOTAL_CHUNKS];
-    static uint512_t C_filt[TOTAL_CHUNKS];
+    static uint512_t C_tmp[2][ROW_BLOCK_MAX_CHUNKS];
+    static uint512_t C_filt[2][ROW_BLOCK_MAX_CHUNKS];
 
-    // ========================================================================
-    // STAGE 1: POSTERIZED ABSOLUTE DIFFERENCE (64 pixels/cycle)
-    // ========================================================================
-Posterize_Loop:
-    for (int i = 0; i < TOTAL_CHUNKS; i++)
-    {
-#pragma HLS PIPELINE II=1
-#pragma HLS LOOP_TRIPCOUNT min=TOTAL_CHUNKS max=TOTAL_CHUNKS
-
-        uint512_t valA = A[i];
-        uint512_t valB = B[i];
-        uint512_t valC = 0;
-
-    Process_64_Pixels:
-        for (int k = 0; k < PIXELS_PER_CHUNK; k++)
-        {
-#pragma HLS UNROLL
-            int lo = k * 8;
-            int hi = lo + 7;
-            pixel_t pA = valA.range(hi, lo);
-            pixel_t pB = valB.range(hi, lo);
-
-            pixel_t diff = (pA > pB) ? (pA - pB) : (pB - pA);
-            valC.range(hi, lo) = posterize(diff);
-        }
-        C_tmp[i] = valC;
-    }
+    // Tile change flags of the current tile row (cleared by write_tile_row_change_map)
+    static bool tile_changed[ROW_BUF_MAX_CHUNKS_PER_ROW];
+#pragma HLS ARRAY_PARTITION variable=tile_changed complete dim=1
 
-    // ========================================================================
-    // STAGE 2: 3×3 SHARPEN FILTER (64 pixels/cycle with sliding window)
-    // ========================================================================
-    uint512_t lb[2][CHUNKS_PER_ROW];
+    // Line buffers and window persist across blocks
+    uint512_t lb[2][ROW_BUF_MAX_CHUNKS_PER_ROW];
 #pragma HLS ARRAY_PARTITION variable=lb complete dim=1
 
     uint512_t win[3][3];
 #pragma HLS ARRAY_PARTITION variable=win complete dim=0
 
 Init_LB:
-    for (int c = 0; c < CHUNKS_PER_ROW; c++)
+    for (int c = 0; c < stride_chunks; c++)
     {
 #pragma HLS PIPELINE II=1
+#pragma HLS LOOP_TRIPCOUNT min=CHUNKS_PER_ROW max=ROW_BUF_MAX_CHUNKS_PER_ROW
         lb[0][c] = 0;
         lb[1][c] = 0;
     }
@@ -110,112 +96,249 @@ Init_Win:
             win[r][c] = 0;
     }
 
-    const int LOOP_LIMIT = TOTAL_CHUNKS + CHUNKS_PER_ROW + 1;
+    bool any_change = false;
+
+    // Position counters replace run-time '%' and '/' on the loop indices
+    int post_chk = 0;
+    int col_idx = 0;
+    int r_idx = 0;
+    int c_chk = 0;
 
-Filter_Loop:
-    for (int iter = 0; iter < LOOP_LIMIT; iter++)
+Block_Loop:
+    for (int b = 0; b <= num_blocks; b++)
     {
+#pragma HLS LOOP_TRIPCOUNT min=HEIGHT/ROW_BLOCK_ROWS+1 max=MAX_HEIGHT/ROW_BLOCK_ROWS+1
+        const int pp = b & 1;
+        const int it0 = b * block_chunks;
+        const int it_end = (it0 + block_chunks < LOOP_LIMIT) ? it0 + block_chunks : LOOP_LIMIT;
+        const int n_iter = it_end - it0;
+
+        // ====================================================================
+        // STAGE 1: POSTERIZED ABSOLUTE DIFFERENCE (64 pixels/cycle)
+        // ====================================================================
+        // The flush block (b == num_blocks) has no input rows
+        const int n_post = (b < num_blocks) ? ((it_end < total_chunks) ? n_iter : total_chunks - it0) : 0;
+
+    Posterize_Loop:
+        for (int i = 0; i < n_post; i++)
+        {
 #pragma HLS PIPELINE II=1
+#pragma HLS LOOP_TRIPCOUNT min=ROW_BLOCK_ROWS*CHUNKS_PER_ROW max=ROW_BLOCK_MAX_CHUNKS
 
-        uint512_t new_chunk = 0;
-        if (iter < TOTAL_CHUNKS)
-        {
-            new_chunk = C_tmp[iter];
-        }
+            uint512_t valA = A[it0 + i];
+            uint512_t valB = B[it0 + i];
+            uint512_t valC = 0;
 
-        for (int r = 0; r < 3; r++)
-        {
+        Process_64_Pixels:
+            for (int k = 0; k < PIXELS_PER_CHUNK; k++)
+            {
 #pragma HLS UNROLL
-            win[r][0] = win[r][1];
-            win[r][1] = win[r][2];
+                diff_posterize_sample<mono8_format>(valA, valB, valC, k, 0, post_params);
+            }
+            C_tmp[pp][i] = valC;
+
+            // Flags are only ever set here, so there is no read-modify-write
+            if (valC != 0)
+                tile_changed[post_chk] = true;
+            post_chk = (post_chk == stride_chunks - 1) ? 0 : post_chk + 1;
         }
 
-        int col_idx = iter % CHUNKS_PER_ROW;
+        if (b < num_blocks)
+        {
+            any_change |= write_tile_row_change_map(tile_changed, stride_chunks, change_map,
+                                                    map_tile_rows, first_tile_row + b);
+        }
 
-        if (iter < TOTAL_CHUNKS)
+        // ====================================================================
+        // STAGE 2: 3×3 SHARPEN FILTER (64 pixels/cycle with sliding window)
+        //          Generic 3x3 taps; the window supplies all nine neighbours
+        // ====================================================================
+    Filter_Loop:
+        for (int i = 0; i < n_iter; i++)
         {
+#pragma HLS PIPELINE II=1
+#pragma HLS LOOP_TRIPCOUNT min=ROW_BLOCK_ROWS*CHUNKS_PER_ROW max=ROW_BLOCK_MAX_CHUNKS
+
+            const int iter = it0 + i;
+            uint512_t new_chunk = 0;
+            if (iter < total_chunks)
+            {
+                new_chunk = C_tmp[pp][i];
+            }
+
+            for (int r = 0; r < 3; r++)
+            {
+#pragma HLS UNROLL
+                win[r][0] = win[r][1];
+                win[r][1] = win[r][2];
+            }
+
+            // The flush keeps reading the line buffers (zero row below), so the
+            // last row still has its center and north rows for border_mode
             win[0][2] = lb[0][col_idx];
             win[1][2] = lb[1][col_idx];
             win[2][2] = new_chunk;
 
             lb[0][col_idx] = lb[1][col_idx];
             lb[1][col_idx] = new_chunk;
-        }
-        else
-        {
-            win[0][2] = 0;
-            win[1][2] = 0;
-            win[2][2] = 0;
-        }
-
-        int out_idx = iter - (CHUNKS_PER_ROW + 1);
 
-        if (out_idx >= 0 && out_idx < TOTAL_CHUNKS)
-        {
-            int r_idx = out_idx / CHUNKS_PER_ROW;
-            int c_chk = out_idx % CHUNKS_PER_ROW;
-
-            uint512_t result_chunk = 0;
+            col_idx = (col_idx == stride_chunks - 1) ? 0 : col_idx + 1;
 
-            const bool row_border = (r_idx == 0) || (r_idx == HEIGHT - 1);
+            int out_idx = iter - (stride_chunks + 1);
 
-        Calc_64:
-            for (int k = 0; k < PIXELS_PER_CHUNK; k++)
+            if (out_idx >= 0 && out_idx < total_chunks)
             {
-#pragma HLS UNROLL
+                uint512_t result_chunk = 0;
 
-                const int lo = k * 8;
-                const int hi = lo + 7;
-                const int j = (c_chk * PIXELS_PER_CHUNK) + k;
+                const bool north = (r_idx == 0);
+                const bool south = (r_idx == height - 1);
 
-                const bool col_border = (j == 0) || (j == WIDTH - 1);
-
-                if (row_border || col_border)
-                {
-                    result_chunk.range(hi, lo) = 0;
-                }
-                else
+            Calc_64:
+                for (int k = 0; k < PIXELS_PER_CHUNK; k++)
                 {
-                    int val = 5 * (int)win[1][1].range(hi, lo);
+#pragma HLS UNROLL
 
-                    val -= (int)win[0][1].range(hi, lo);
-                    val -= (int)win[2][1].range(hi, lo);
+                    const int lo = k * 8;
+                    const int hi = lo + 7;
+                    const int j = (c_chk * PIXELS_PER_CHUNK) + k;
 
-                    if (k > 0)
+                    // Row padding is always zero; frame edges follow border_mode
+                    if (j >= width)
                     {
-                        val -= (int)win[1][1].range((k - 1) * 8 + 7, (k - 1) * 8);
+                        result_chunk.range(hi, lo) = 0;
                     }
                     else
                     {
-                        val -= (int)win[1][0].range(DATA_WIDTH_BITS - 1, DATA_WIDTH_BITS - PIXEL_SIZE_BITS);
-                    }
-
-                    if (k < PIXELS_PER_CHUNK - 1)
-                    {
-                        val -= (int)win[1][1].range((k + 1) * 8 + 7, (k + 1) * 8);
-                    }
-                    else
-                    {
-                        val -= (int)win[1][2].range(PIXEL_SIZE_BITS - 1, 0);
+                        int nb[3][3];
+                        for (int r = 0; r < 3; r++)
+                        {
+#pragma HLS UNROLL
+                            for (int t = 0; t < 3; t++)
+                            {
+#pragma HLS UNROLL
+                                nb[r][t] = window_tap(win[r][0], win[r][1], win[r][2], k, t - 1);
+                            }
+                        }
+                        result_chunk.range(hi, lo) = sharpen_border(coeffs, nb, border_mode, north, south,
+                                                                    j == 0, j == width - 1, height > 1, width > 1);
                     }
+                }
+                C_filt[pp][i] = result_chunk;
 
-                    result_chunk.range(hi, lo) = clip_u8(val);
+                if (c_chk == stride_chunks - 1)
+                {
+                    c_chk = 0;
+                    r_idx++;
+                }
+                else
+                {
+                    c_chk++;
                 }
             }
-            C_filt[out_idx] = result_chunk;
+        }
+
+        // ====================================================================
+        // STAGE 3: WRITE THIS BLOCK'S COMPLETED OUTPUT TO DDR
+        // ====================================================================
+        // Iteration i of the block produced output chunk it0 + i - (stride_chunks + 1)
+        const int out0 = it0 - (stride_chunks + 1);
+        const int w_lo = (out0 < 0) ? -out0 : 0;
+        const int w_hi = (out0 + n_iter > total_chunks) ? total_chunks - out0 : n_iter;
+
+    Write_Loop:
+        for (int i = w_lo; i < w_hi; i++)
+        {
+#pragma HLS PIPELINE II=1
+#pragma HLS LOOP_TRIPCOUNT min=ROW_BLOCK_ROWS*CHUNKS_PER_ROW max=ROW_BLOCK_MAX_CHUNKS
+            C[out0 + i] = C_filt[pp][i];
         }
     }
 
+    return any_change;
+}
+
+extern "C" {
+
+/**
+ * @brief Top-level HLS kernel for image difference, posterization, and sharpening.
+ *
+ * @param A Input image A as array of 512-bit words (64 pixels per word)
+ * @param B Input image B as array of 512-bit words (64 pixels per word)
+ * @param C Output image as array of 512-bit words (64 pixels per word)
+ * @param height Image height in pixels
+ * @param width Image width in pixels (<= ROW_BUF_MAX_WIDTH)
+ * @param stride_chunks Row pitch of A/B/C in 512-bit words (>= ceil(width / 64),
+ *                      <= ROW_BUF_MAX_CHUNKS_PER_ROW)
+ * @param num_frames Number of frame pairs stored back to back in A/B (and C);
+ *                   0 writes the kernel properties (KERNEL_PROPS_*) instead
+ * @param coef_r0 Sharpen taps, north row (SHARPEN_PACK_ROW)
+ * @param coef_r1 Sharpen taps, center row
+ * @param coef_r2 Sharpen taps, south row
+ * @param coef_shift Right shift applied to the weighted sum before clipping
+ * @param border_mode Policy for the first/last row and column (BORDER_*)
+ * @param post_thr03 Posterize thresholds 0..3 (POSTERIZE_PACK4)
+ * @param post_thr46 Posterize thresholds 4..6
+ * @param post_levels Number of posterize output levels (2..POSTERIZE_MAX_LEVELS)
+ * @param change_map Per-tile change bits and any-change flag (CHANGE_MAP_WORDS words)
+ */
+void IMAGE_DIFF_POSTERIZE(const uint512_t *A, const uint512_t *B, uint512_t *C,
+                          int height, int width, int stride_chunks, int num_frames,
+                          int coef_r0, int coef_r1, int coef_r2, int coef_shift, int border_mode,
+                          int post_thr03, int post_thr46, int post_levels,
+                          uint64_t *change_map)
+{
     // ========================================================================
-    // STAGE 3: WRITE OUTPUT TO DDR
+    // AXI INTERFACE PRAGMAS
     // ========================================================================
-Write_Loop:
-    for (int i = 0; i < TOTAL_CHUNKS; i++)
+#pragma HLS INTERFACE m_axi port=A offset=slave bundle=gmemA depth=TOTAL_CHUNKS
+#pragma HLS INTERFACE m_axi port=B offset=slave bundle=gmemB depth=TOTAL_CHUNKS
+#pragma HLS INTERFACE m_axi port=C offset=slave bundle=gmemC depth=TOTAL_CHUNKS
+#pragma HLS INTERFACE s_axilite port=A bundle=control
+#pragma HLS INTERFACE s_axilite port=B bundle=control
+#pragma HLS INTERFACE s_axilite port=C bundle=control
+#pragma HLS INTERFACE s_axilite port=height bundle=control
+#pragma HLS INTERFACE s_axilite port=width bundle=control
+#pragma HLS INTERFACE s_axilite port=stride_chunks bundle=control
+#pragma HLS INTERFACE s_axilite port=num_frames bundle=control
+#pragma HLS INTERFACE s_axilite port=coef_r0 bundle=control
+#pragma HLS INTERFACE s_axilite port=coef_r1 bundle=control
+#pragma HLS INTERFACE s_axilite port=coef_r2 bundle=control
+#pragma HLS INTERFACE s_axilite port=coef_shift bundle=control
+#pragma HLS INTERFACE s_axilite port=border_mode bundle=control
+#pragma HLS INTERFACE s_axilite port=post_thr03 bundle=control
+#pragma HLS INTERFACE s_axilite port=post_thr46 bundle=control
+#pragma HLS INTERFACE s_axilite port=post_levels bundle=control
+#pragma HLS INTERFACE m_axi port=change_map offset=slave bundle=gmemM depth=CHANGE_MAP_DEFAULT_WORDS
+#pragma HLS INTERFACE s_axilite port=change_map bundle=control
+#pragma HLS INTERFACE s_axilite port=return bundle=control
+
+    // num_frames = 0 only reports the build's properties; frames wider than
+    // the row-block buffers, line buffers and tile flags are left untouched
+    // (the host checks them beforehand)
+    if (num_frames == 0 || width > ROW_BUF_MAX_WIDTH || stride_chunks > ROW_BUF_MAX_CHUNKS_PER_ROW)
     {
-#pragma HLS PIPELINE II=1
-#pragma HLS LOOP_TRIPCOUNT min=TOTAL_CHUNKS max=TOTAL_CHUNKS
-        C[i] = C_filt[i];
+        if (num_frames == 0)
+            change_map[0] = KERNEL_PROPS_WITH_MAX_WIDTH(ROW_BUF_MAX_WIDTH) | KERNEL_PROPS_BUILD;
+        return;
+    }
+
+    // Frames run one after another (V2 stages never overlap, so neither do frames)
+    const int frame_chunks = height * stride_chunks;
+    const sharpen_coeffs_t coeffs = unpack_sharpen_coeffs(coef_r0, coef_r1, coef_r2, coef_shift);
+    const posterize_params_t post_params = unpack_posterize_params(post_thr03, post_thr46, post_levels);
+
+    const int frame_tile_rows = (height + TILE_ROWS - 1) / TILE_ROWS;
+    const int map_tile_rows = CHANGE_MAP_TILE_ROWS(height, num_frames);
+    bool any_change = false;
+
+Frame_Loop:
+    for (int f = 0; f < num_frames; f++)
+    {
+        const int offset = f * frame_chunks;
+        any_change |= process_frame(A + offset, B + offset, C + offset, height, width, stride_chunks,
+                                    post_params, coeffs, border_mode, change_map, map_tile_rows, f * frame_tile_rows);
     }
+    change_map[CHANGE_MAP_STRIPS(stride_chunks) * map_tile_rows] = any_change ? 1 : 0;
 }
 
 } // extern "C"
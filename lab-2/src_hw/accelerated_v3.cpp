@@ -11,219 +11,1589 @@
 * Architecture:
 * - Streams are 512-bit wide (uint512_t).
 * - Sliding window operates on 512-bit chunks.
+* - Image size is a run-time argument (height, width, stride_chunks).
+* - Strip tiling: the image is processed in vertical strips of at most
+*   STRIP_MAX_CHUNKS chunks plus a 1-chunk halo on each inner side, so the
+*   line buffers scale with the strip width instead of the frame width.
+*   A frame no wider than one strip is processed exactly as before
+*   (no halo, single pass).
+* - Statistics (-DV3_STATS): a fourth stage between filter and writer
+*   accumulates min/max/sum of the sharpened output and the diff stage
+*   counts pixels per posterize level, so the host reads STATS_NUM_WORDS
+*   words instead of scanning the frame.
+* - Posterize tap (-DV3_POST_TAP): the diff stage also writes its output
+*   as 2-bit level codes (256 px per word) for consumers that only need the
+*   change mask, at a quarter of the readback cost of C.
+* - Batching: num_frames consecutive frame pairs stream back to back through
+*   one invocation. The frames are treated as one tall image whose first and
+*   last row of every frame is a border row, so the line buffers and the
+*   window are reused across frames without draining the pipeline.
+* - ROI list (-DV3_ROI): the stages run once per rectangle of every frame,
+*   reading only the rectangle plus a one-row / one-chunk context ring, so
+*   work and DMA scale with the ROI area instead of the frame.
+* - Pixel format: the diff and filter stages are templates on the sample
+*   type and channel count (chunk_format), instantiated for V3_CHANNEL_BITS /
+*   V3_CHANNELS. A chunk always moves in one cycle, so 16-bit mono runs at
+*   32 pixels/cycle and RGB888 at 21, every channel in parallel.
+* - Lane folding (-DV3_LANES): the same templates take the number of lanes
+*   built in hardware. Fewer lanes than the chunk holds process a chunk in
+*   V3_FOLD cycles, one lane group per cycle, for area/throughput points in
+*   between (e.g. 16 or 32 px/cycle); the streams still carry whole chunks.
+* - Retiming (-DV3_RETIME): registers after the window taps, after the
+*   sharpen sum and after |A - B| (retime_reg), so each lane's compute is
+*   split into shorter stages for clocks above 300 MHz at the same II.
+* - Compressed output (-DV3_COMPRESS): the writer drops all-zero result
+*   chunks and packs the rest at the front of C, with a one-bit-per-chunk
+*   index, so the readback shrinks with scene activity.
+* - Blob list (-DV3_BLOBS): a side stage labels the white posterized pixels
+*   of each frame in one pass and writes only their boxes, areas and
+*   centroids (BLOB_WORDS()), for consumers that need no pixels at all.
+* - Morphology (-DV3_MORPH): two erode/dilate stages after the filter, on
+*   the same line buffer scheme, open or close the sharpened output
+*   (morph_mode) at 64 px/cycle instead of a pass over C on the host.
+* - Resolution pyramid (-DV3_PYRAMID): a pass-through stage before the
+*   writer averages 2x2 blocks of the result into 1/2- and 1/4-resolution
+*   levels, each written by its own burst writer, in the same pass.
+* - Camera input (-DV3_LUMA): a stage ahead of the diff reads A/B as packed
+*   YUYV or RGB888 (in_format) and hands it 8-bit luma chunks, so the host
+*   ships camera buffers without a conversion pass. It reads A and B at one
+*   word per cycle each, i.e. 32 px/cycle for YUYV and 21 for RGB888.
 */
 
 #include "../../inc/hls_helpers.h"
 #include <hls_stream.h>
 
+#ifdef V3_PROFILE
+typedef uint64_t prof_t;
+#define PROF_ONLY(...) __VA_ARGS__
+#else
+#define PROF_ONLY(...)
+#endif
+
+#ifdef V3_POST_TAP
+#define POST_TAP_ONLY(...) __VA_ARGS__
+#else
+#define POST_TAP_ONLY(...)
+#endif
+
+#ifdef V3_STATS
+#define STATS_ONLY(...) __VA_ARGS__
+#else
+#define STATS_ONLY(...)
+#endif
+
+#ifdef V3_COMPRESS
+#define COMPRESS_ONLY(...) __VA_ARGS__
+#else
+#define COMPRESS_ONLY(...)
+#endif
+
+#ifdef V3_MORPH
+#define MORPH_ONLY(...) __VA_ARGS__
+#else
+#define MORPH_ONLY(...)
+#endif
+
+#ifdef V3_BLOBS
+#define BLOBS_ONLY(...) __VA_ARGS__
+#else
+#define BLOBS_ONLY(...)
+#endif
+
+#ifdef V3_PYRAMID
+#define PYRAMID_ONLY(...) __VA_ARGS__
+#else
+#define PYRAMID_ONLY(...)
+#endif
+
+#ifdef V3_LUMA
+#define LUMA_ONLY(...) __VA_ARGS__
+#else
+#define LUMA_ONLY(...)
+#endif
+
+#ifdef V3_ROI
+#define ROI_ONLY(...) __VA_ARGS__
+#if defined(V3_POST_TAP) || defined(V3_STATS) || defined(V3_PROFILE) || defined(V3_COMPRESS)
+#error "-DV3_ROI builds without -DV3_POST_TAP, -DV3_STATS, -DV3_PROFILE and -DV3_COMPRESS"
+#endif
+#else
+#define ROI_ONLY(...)
+#endif
+
 // --------------------------------------------------------------------------
-// Stage 1: Full-Width Difference & Posterization
+// Strip geometry (shared by all three stages)
 // --------------------------------------------------------------------------
-static void compute_diff_wide(
+// Strip starting at chunk c0 outputs chunks [c0, out_end), out_end <= col_end,
+// and reads [lo, hi): one extra chunk on each side where the row goes on.
+// The halo chunks only feed the west/east taps of the edge pixels.
+static void strip_bounds(int c0, int col_end, int stride_chunks, int &lo, int &out_end, int &hi)
+{
+#pragma HLS INLINE
+   out_end = (c0 + STRIP_MAX_CHUNKS < col_end) ? c0 + STRIP_MAX_CHUNKS : col_end;
+   lo = (c0 > 0) ? c0 - 1 : 0;
+   hi = (out_end < stride_chunks) ? out_end + 1 : stride_chunks;
+}
+
+// Output window of one pass through the stages: rows [row0, row1) of each
+// frame and chunk columns [col0, col1). The row above and below are read as
+// context where the frame has them (in_row0/in_row1), like the strip halo
+// chunks, and produce no output. Whole frames are the window [0, height) x
+// [0, stride_chunks), which has no context rows.
+typedef struct
+{
+   int row0, row1, col0, col1;
+   int in_row0, in_row1;
+} region_t;
+
+static region_t make_region(int row0, int row1, int col0, int col1, int height)
+{
+#pragma HLS INLINE
+   region_t reg;
+   reg.row0 = row0;
+   reg.row1 = row1;
+   reg.col0 = col0;
+   reg.col1 = col1;
+   reg.in_row0 = (row0 > 0) ? row0 - 1 : 0;
+   reg.in_row1 = (row1 < height) ? row1 + 1 : height;
+   return reg;
+}
+
+static region_t full_region(int height, int stride_chunks)
+{
+#pragma HLS INLINE
+   return make_region(0, height, 0, stride_chunks, height);
+}
+
+// Stage 1 input: a chunk of A/B straight from memory, or the next chunk of
+// a front-end stream that delivers them in the same order
+static uint512_t read_chunk(const uint512_t *src, int idx)
+{
+#pragma HLS INLINE
+   return src[idx];
+}
+
+static uint512_t read_chunk(hls::stream<uint512_t> &src, int)
+{
+#pragma HLS INLINE
+   return src.read();
+}
+
+#ifdef V3_LUMA
+// --------------------------------------------------------------------------
+// Stage 0: Camera Format -> Luma (-DV3_LUMA)
+// --------------------------------------------------------------------------
+// Byte b of a chunk's LUMA_MAX_WORDS input words
+static int raw_byte(const uint512_t raw[LUMA_MAX_WORDS], int b)
+{
+#pragma HLS INLINE
+   const int lo = (b % 64) * 8;
+   const int v = raw[b / 64].range(lo + 7, lo);
+   return v;
+}
+
+// One 64-pixel luma chunk from its LUMA_WORDS_PER_CHUNK(in_format) words;
+// every lane computes all three formats and the run-time format selects
+static uint512_t luma_chunk(const uint512_t raw[LUMA_MAX_WORDS], int in_format)
+{
+#pragma HLS INLINE
+   uint512_t out = 0;
+   for (int k = 0; k < PIXELS_PER_CHUNK; k++)
+   {
+#pragma HLS UNROLL
+      const int y8   = raw_byte(raw, k);
+      const int yuyv = raw_byte(raw, 2 * k);
+      const int rgb  = LUMA_RGB(raw_byte(raw, 3 * k), raw_byte(raw, 3 * k + 1), raw_byte(raw, 3 * k + 2));
+      out.range(8 * k + 7, 8 * k) = (in_format == LUMA_YUYV) ? yuyv : (in_format == LUMA_RGB888) ? rgb : y8;
+   }
+   return out;
+}
+
+// Reads the chunks compute_diff_wide would read, in its strip order (halo
+// chunks included), from camera-layout A/B: luma chunk (row, c) is input
+// words [(row * stride_chunks + c) * K, + K), K = LUMA_WORDS_PER_CHUNK().
+// A and B are read in the same cycle, so a chunk takes K cycles.
+static void convert_luma_wide(
    const uint512_t *A,
    const uint512_t *B,
-   hls::stream<uint512_t> &out_stream)
+   hls::stream<uint512_t> &luma_A,
+   hls::stream<uint512_t> &luma_B,
+   int height,
+   int stride_chunks,
+   int num_frames,
+   int in_format)
+{
+   const int K = LUMA_WORDS_PER_CHUNK(in_format);
+   const int total_rows = num_frames * height;
+   uint512_t raw_A[LUMA_MAX_WORDS], raw_B[LUMA_MAX_WORDS];
+#pragma HLS ARRAY_PARTITION variable = raw_A complete
+#pragma HLS ARRAY_PARTITION variable = raw_B complete
+
+Loop_Luma_Strips:
+   for (int c0 = 0; c0 < stride_chunks; c0 += STRIP_MAX_CHUNKS)
+   {
+#pragma HLS LOOP_TRIPCOUNT min = 1 max = MAX_STRIPS
+      int strip_lo, strip_end, strip_hi;
+      strip_bounds(c0, stride_chunks, stride_chunks, strip_lo, strip_end, strip_hi);
+      const int strip_width = strip_hi - strip_lo;
+
+      int word = strip_lo * K; // Input word of the current chunk's first word
+      int row_word = word;     // ... and of the current row's first strip chunk
+      int vc = 0;
+      int w = 0;               // Word of the current chunk (0 .. K - 1)
+
+   Loop_Luma_Wide:
+      for (int i = 0; i < total_rows * strip_width * K; i++)
+      {
+#pragma HLS PIPELINE II = 1
+#pragma HLS LOOP_TRIPCOUNT min = TOTAL_CHUNKS max = MAX_TOTAL_CHUNKS * LUMA_MAX_WORDS
+          raw_A[w] = A[word + w];
+          raw_B[w] = B[word + w];
+          if (w < K - 1)
+          {
+              w++;
+              continue;
+          }
+          w = 0;
+          luma_A.write(luma_chunk(raw_A, in_format));
+          luma_B.write(luma_chunk(raw_B, in_format));
+
+          if (vc == strip_width - 1)
+          {
+              vc = 0;
+              row_word += stride_chunks * K;
+              word = row_word;
+          }
+          else
+          {
+              vc++;
+              word += K;
+          }
+      }
+   }
+}
+#endif
+
+// --------------------------------------------------------------------------
+// Stage 1: Full-Width Difference & Posterization
+// --------------------------------------------------------------------------
+// SRC is const uint512_t * (A/B in memory) or hls::stream<uint512_t> & (a
+// front end such as convert_luma_wide)
+template <typename PIX, int CH, int LANES = chunk_format<PIX, CH>::LANES, typename SRC = const uint512_t *>
+static void compute_diff_wide(
+   SRC A,
+   SRC B,
+   hls::stream<uint512_t> &out_stream,
+   uint64_t *change_map,
+   int height,
+   int stride_chunks,
+   int num_frames,
+   int post_thr03,
+   int post_thr46,
+   int post_levels,
+   region_t reg
+   POST_TAP_ONLY(, uint512_t *post_tap)
+   STATS_ONLY(, int width, hls::stream<uint64_t> &levels_out)
+   PROF_ONLY(, hls::stream<prof_t> &prof_out)
+   BLOBS_ONLY(, hls::stream<uint64_t> &white_out))
 {
+   typedef chunk_format<PIX, CH> fmt;
+   const int FOLD = fmt::LANES / LANES;
+   const posterize_params_t post_params = unpack_posterize_params(post_thr03, post_thr46, post_levels);
+   const int total_rows = num_frames * (reg.in_row1 - reg.in_row0);
    uint512_t valA, valB, valC;
+   STATS_ONLY(int level[fmt::LANES];)
+   POST_TAP_ONLY(ap_uint<2 * PIXELS_PER_CHUNK> codes;)
+   PROF_ONLY(prof_t active = 0; prof_t post_full = 0;)
+#ifdef V3_STATS
+   uint64_t level_count[POSTERIZE_MAX_LEVELS] = {0};
+#pragma HLS ARRAY_PARTITION variable = level_count complete
+#endif
 
-Loop_Diff_Wide:
-   for (int i = 0; i < TOTAL_CHUNKS; i++)
+   // Change map: one word per (strip, tile row), written in strip-major order
+   // (an ROI pass only writes the any-change word)
+   int map_idx = 0;
+   bool any_change = false;
+
+Loop_Diff_Strips:
+   for (int c0 = reg.col0; c0 < reg.col1; c0 += STRIP_MAX_CHUNKS)
    {
+#pragma HLS LOOP_TRIPCOUNT min = 1 max = MAX_STRIPS
+      int strip_lo, strip_end, strip_hi;
+      strip_bounds(c0, reg.col1, stride_chunks, strip_lo, strip_end, strip_hi);
+      const int strip_width = strip_hi - strip_lo;
+      const int strip_chunks = total_rows * strip_width;
+
+      // Row base / column are counters so the address needs no multiplier
+      int row_base = reg.in_row0 * stride_chunks + strip_lo;
+      int vc = 0;
+      int frame_row = reg.in_row0; // Row within the current frame
+      uint64_t tile_bits = 0; // Change bits of the current tile row
+#ifdef V3_POST_TAP
+      int tap_row_base = 0;   // First tap word of the current row (whole frames only)
+      uint512_t tap_word = 0;
+#endif
+
+      int step = 0; // Lane group of the current chunk (0 .. FOLD - 1)
+
+   Loop_Diff_Wide:
+      for (int i = 0; i < strip_chunks * FOLD; i++)
+      {
 #pragma HLS PIPELINE II = 1
-#pragma HLS LOOP_TRIPCOUNT min = TOTAL_CHUNKS max = TOTAL_CHUNKS
+#pragma HLS LOOP_TRIPCOUNT min = TOTAL_CHUNKS * V3_FOLD max = MAX_TOTAL_CHUNKS * V3_FOLD
+
+          if (step == 0)
+          {
+              valA = read_chunk(A, row_base + vc);
+              valB = read_chunk(B, row_base + vc);
+              valC = 0; // Padding bits above the last lane
+          }
+      // Unroll to generate one difference unit per channel sample of the group
+      Process_64_Pixels:
+          for (int g = 0; g < LANES; g++)
+          {
+#pragma HLS UNROLL
+              const int k = step * LANES + g;
+              for (int ch = 0; ch < CH; ch++)
+              {
+#pragma HLS UNROLL
+                  const int lvl = diff_posterize_sample<fmt>(valA, valB, valC, k, ch, post_params);
+                  // Statistics and tap are 8-bit mono only (CH == 1)
+                  STATS_ONLY(level[k] = lvl;)
+                  POST_TAP_ONLY(codes.range(2 * k + 1, 2 * k) = (lvl > 3) ? 3 : lvl;)
+              }
+          }
+          if (step < FOLD - 1)
+          {
+              step++;
+              continue;
+          }
+          step = 0;
+
+          PROF_ONLY(active++; if (out_stream.full()) post_full++;)
+          out_stream.write(valC);
+
+          // Halo chunks belong to the neighbouring strip's words, context
+          // rows to the neighbouring ROI
+          const int j = strip_lo + vc - c0;
+          const bool own_chunk = (j >= 0 && j < strip_end - c0) && frame_row >= reg.row0 && frame_row < reg.row1;
+          const bool changed = (valC != 0);
+          if (changed && own_chunk)
+              tile_bits |= (uint64_t)1 << j;
+          // The flag also covers the context the filter reads, so a clear
+          // flag means an all-zero output (halos are some strip's own chunks
+          // anyway when the whole frame is processed)
+          if (changed)
+              any_change = true;
+
+#ifdef V3_POST_TAP
+          // Strips start on a word boundary, so every tap word is filled by
+          // the own chunks of one strip; flush at the strip's last column
+          const int tap_slot = (strip_lo + vc) % POST_TAP_CHUNKS_PER_WORD;
+          if (own_chunk)
+          {
+              tap_word.range(128 * tap_slot + 127, 128 * tap_slot) = codes;
+              if (tap_slot == POST_TAP_CHUNKS_PER_WORD - 1 || strip_lo + vc == strip_end - 1)
+              {
+                  post_tap[tap_row_base + (strip_lo + vc) / POST_TAP_CHUNKS_PER_WORD] = tap_word;
+                  tap_word = 0;
+              }
+          }
+#endif
 
-       valA = A[i];
-       valB = B[i];
-   // Unroll to generate 64 parallel difference units
-   Process_64_Pixels:
-       for (int k = 0; k < PIXELS_PER_CHUNK; k++)
-       {
+#ifdef V3_BLOBS
+          // White (255) pixel mask of the own chunks for extract_blobs
+          if (own_chunk)
+          {
+              uint64_t white = 0;
+              for (int k = 0; k < PIXELS_PER_CHUNK; k++)
+              {
 #pragma HLS UNROLL
-           int lo = k * 8;
-           int hi = lo + 7;
-           pixel_t pA = valA.range(hi, lo);
-           pixel_t pB = valB.range(hi, lo);
+                  if (valC.range(k * 8 + 7, k * 8) == 255)
+                      white |= (uint64_t)1 << k;
+              }
+              white_out.write(white);
+          }
+#endif
 
-           pixel_t diff = (pA > pB) ? (pA - pB) : (pB - pA);
-           valC.range(hi, lo) = posterize(diff);
-       }
-       
-       out_stream.write(valC);
+#ifdef V3_STATS
+          // Level histogram over the logical pixels (no halo, no row padding)
+          const int valid = width - (strip_lo + vc) * fmt::LANES;
+      Count_Levels:
+          for (int l = 0; l < POSTERIZE_MAX_LEVELS; l++)
+          {
+#pragma HLS UNROLL
+              int n = 0;
+              for (int k = 0; k < fmt::LANES; k++)
+              {
+#pragma HLS UNROLL
+                  n += (k < valid && level[k] == l) ? 1 : 0;
+              }
+              if (own_chunk)
+                  level_count[l] += n;
+          }
+#endif
+
+          if (vc == strip_width - 1)
+          {
+              vc = 0;
+              row_base += stride_chunks;
+              POST_TAP_ONLY(tap_row_base += POST_TAP_ROW_WORDS(stride_chunks);)
+
+              // Tile row complete (every TILE_ROWS rows, and at each frame's last row)
+              const bool last_in_frame = (frame_row == reg.in_row1 - 1);
+#ifndef V3_ROI
+              if (last_in_frame || (frame_row % TILE_ROWS) == TILE_ROWS - 1)
+              {
+                  change_map[map_idx++] = tile_bits;
+                  tile_bits = 0;
+              }
+#endif
+              frame_row = last_in_frame ? reg.in_row0 : frame_row + 1;
+          }
+          else
+          {
+              vc++;
+          }
+      }
+   }
+
+   // No frames: the properties query (KERNEL_PROPS_*); V3 takes any width
+   change_map[map_idx] = (num_frames == 0) ? KERNEL_PROPS_BUILD : any_change ? 1 : 0;
+#ifdef V3_STATS
+Loop_Diff_Levels:
+   for (int l = 0; l < POSTERIZE_MAX_LEVELS; l++)
+   {
+       levels_out.write(level_count[l]);
    }
+#endif
+   PROF_ONLY(prof_out.write(active); prof_out.write(post_full);)
 }
 
+#ifdef V3_BLOBS
 // --------------------------------------------------------------------------
-// Stage 2: Full-Width Sharpen Filter (64 pixels/cycle)
+// Stage 1b: Blob Extraction (side branch of the diff stage)
 // --------------------------------------------------------------------------
+// Single-pass 8-connected labelling of the white pixels, one run at a time:
+// each chunk's mask is cut into runs of set bits (a run reaching the chunk's
+// last pixel waits for the next chunk), and each run takes the label of the
+// previous-row runs it touches, merging their labels (the larger root points
+// at the smaller) and their accumulated box, area and coordinate sums. A
+// root therefore is the first label of its blob, and the frame's blobs come
+// out in raster order of their first pixel. Masks arrive in the diff stage's
+// strip order, so only frames of one strip are labelled.
+typedef struct
+{
+   int x0, y0, x1, y1;
+   int area;
+   uint64_t sum_x, sum_y;
+} blob_acc_t;
+
+// Index of the lowest set bit of a non-zero mask
+static int lowest_bit(uint64_t m)
+{
+#pragma HLS INLINE
+   int idx = 0;
+   for (int k = PIXELS_PER_CHUNK - 1; k >= 0; k--)
+   {
+#pragma HLS UNROLL
+       if ((m >> k) & 1)
+           idx = k;
+   }
+   return idx;
+}
+
+static void extract_blobs(
+   hls::stream<uint64_t> &white_in,
+   uint64_t *blobs,
+   int height,
+   int stride_chunks,
+   int num_frames)
+{
+   // Runs of the previous and the current row ([s, e] columns, label or -1)
+   int run_s[2][BLOB_ROW_RUNS], run_e[2][BLOB_ROW_RUNS], run_l[2][BLOB_ROW_RUNS];
+#pragma HLS ARRAY_PARTITION variable = run_s complete dim = 1
+#pragma HLS ARRAY_PARTITION variable = run_e complete dim = 1
+#pragma HLS ARRAY_PARTITION variable = run_l complete dim = 1
+
+   // Equivalence table and per-label accumulators
+   int parent[BLOB_MAX_LABELS];
+   blob_acc_t acc[BLOB_MAX_LABELS];
+
+   const bool wide = stride_chunks > STRIP_MAX_CHUNKS;
+
+Loop_Blob_Frames:
+   for (int f = 0; f < num_frames; f++)
+   {
+      int num_labels = 0;
+      int flags = wide ? BLOB_FLAG_WIDE : 0;
+      int prev = 0;     // run_* row holding the previous row
+      int num_prev = 0;
+
+   Loop_Blob_Rows:
+      for (int y = 0; y < height; y++)
+      {
+#pragma HLS LOOP_TRIPCOUNT min = HEIGHT max = MAX_HEIGHT
+         const int cur = 1 - prev;
+         int num_cur = 0;
+         int p = 0;          // First previous-row run the next run can touch
+         int carry_s = -1;   // Start of a run reaching the last chunk's last pixel
+
+      Loop_Blob_Chunks:
+         for (int c = 0; c < stride_chunks; c++)
+         {
+#pragma HLS LOOP_TRIPCOUNT min = CHUNKS_PER_ROW max = MAX_CHUNKS_PER_ROW
+            const uint64_t m = white_in.read();
+            if (wide)
+               continue;
+
+            const int base = c * PIXELS_PER_CHUNK;
+            uint64_t starts = m & ~(m << 1);
+            uint64_t ends = m & ~(m >> 1);
+            // A carried run goes on if this chunk starts white, else it ended with the last one
+            bool flush = carry_s >= 0 && (m & 1) == 0;
+            if (carry_s >= 0 && !flush)
+               starts &= ~(uint64_t)1;
+
+         Loop_Blob_Runs:
+            while (flush || ends != 0)
+            {
+#pragma HLS LOOP_TRIPCOUNT min = 0 max = PIXELS_PER_CHUNK / 2
+               int s, e;
+               if (flush)
+               {
+                  s = carry_s;
+                  e = base - 1;
+                  carry_s = -1;
+                  flush = false;
+               }
+               else
+               {
+                  const int eb = lowest_bit(ends);
+                  ends &= ends - 1;
+                  if (carry_s >= 0)
+                  {
+                     s = carry_s;
+                     carry_s = -1;
+                  }
+                  else
+                  {
+                     s = base + lowest_bit(starts);
+                     starts &= starts - 1;
+                  }
+                  if (eb == PIXELS_PER_CHUNK - 1 && c < stride_chunks - 1)
+                  {
+                     carry_s = s;
+                     continue;
+                  }
+                  e = base + eb;
+               }
+
+               // Previous-row runs within one column of [s, e] (8-connectivity)
+               while (p < num_prev && run_e[prev][p] < s - 1)
+                  p++;
+               int label = -1;
+               int q = p;
+            Loop_Blob_Touch:
+               while (q < num_prev && run_s[prev][q] <= e + 1)
+               {
+#pragma HLS LOOP_TRIPCOUNT min = 0 max = 2
+                  int r = run_l[prev][q];
+                  if (r >= 0)
+                  {
+                  Loop_Blob_Find:
+                     while (parent[r] != r)
+                        r = parent[r];
+                     if (label < 0)
+                     {
+                        label = r;
+                     }
+                     else if (r != label)
+                     {
+                        const int lo = (r < label) ? r : label;
+                        const int hi = (r < label) ? label : r;
+                        parent[hi] = lo;
+                        acc[lo].x0 = (acc[hi].x0 < acc[lo].x0) ? acc[hi].x0 : acc[lo].x0;
+                        acc[lo].y0 = (acc[hi].y0 < acc[lo].y0) ? acc[hi].y0 : acc[lo].y0;
+                        acc[lo].x1 = (acc[hi].x1 > acc[lo].x1) ? acc[hi].x1 : acc[lo].x1;
+                        acc[lo].y1 = (acc[hi].y1 > acc[lo].y1) ? acc[hi].y1 : acc[lo].y1;
+                        acc[lo].area += acc[hi].area;
+                        acc[lo].sum_x += acc[hi].sum_x;
+                        acc[lo].sum_y += acc[hi].sum_y;
+                        label = lo;
+                     }
+                  }
+                  q++;
+               }
+               // The last run touched may reach the next run too
+               if (q > p)
+                  p = q - 1;
+
+               if (label < 0)
+               {
+                  if (num_labels < BLOB_MAX_LABELS)
+                  {
+                     label = num_labels++;
+                     parent[label] = label;
+                     acc[label].x0 = s;
+                     acc[label].y0 = y;
+                     acc[label].x1 = e;
+                     acc[label].y1 = y;
+                     acc[label].area = 0;
+                     acc[label].sum_x = 0;
+                     acc[label].sum_y = 0;
+                  }
+                  else
+                  {
+                     flags |= BLOB_FLAG_LABELS;
+                  }
+               }
+               if (label >= 0)
+               {
+                  const int n = e - s + 1;
+                  acc[label].x0 = (s < acc[label].x0) ? s : acc[label].x0;
+                  acc[label].x1 = (e > acc[label].x1) ? e : acc[label].x1;
+                  acc[label].y1 = y;
+                  acc[label].area += n;
+                  acc[label].sum_x += (uint64_t)(s + e) * n / 2;
+                  acc[label].sum_y += (uint64_t)y * n;
+               }
+               run_s[cur][num_cur] = s;
+               run_e[cur][num_cur] = e;
+               run_l[cur][num_cur] = label;
+               num_cur++;
+            }
+         }
+         prev = cur;
+         num_prev = num_cur;
+      }
+
+      // Roots in label order; stop listing at BLOB_MAX but keep counting
+      uint64_t *out = blobs + f * BLOB_FRAME_WORDS;
+      int found = 0;
+   Loop_Blob_Out:
+      for (int l = 0; l < num_labels; l++)
+      {
+#pragma HLS LOOP_TRIPCOUNT min = 0 max = BLOB_MAX_LABELS
+#pragma HLS PIPELINE II = 2
+         if (parent[l] != l)
+            continue;
+         if (found < BLOB_MAX)
+         {
+            const blob_acc_t &b = acc[l];
+            out[1 + 2 * found] = BLOB_PACK_BOX(b.x0, b.y0, b.x1, b.y1);
+            out[2 + 2 * found] = BLOB_PACK_SIZE(b.area, (8 * b.sum_x + b.area / 2) / b.area,
+                                                (8 * b.sum_y + b.area / 2) / b.area);
+         }
+         found++;
+      }
+      out[0] = BLOB_HEADER(found, flags);
+   }
+}
+#endif
+
+// --------------------------------------------------------------------------
+// Stage 2: Full-Width Sharpen Filter (one chunk per cycle)
+// --------------------------------------------------------------------------
+// HALO also emits the strip's halo chunks, for the morphology stages: only
+// their outermost pixel lacks a neighbour, and the two 3x3 stages reach just
+// two pixels into them from the strip's own chunks.
+template <typename PIX, int CH, int LANES = chunk_format<PIX, CH>::LANES, bool HALO = false>
 static void apply_filter_wide(
    hls::stream<uint512_t> &in_stream,
-   hls::stream<uint512_t> &out_stream)
+   hls::stream<uint512_t> &out_stream,
+   int height,
+   int width,
+   int stride_chunks,
+   int num_frames,
+   int coef_r0,
+   int coef_r1,
+   int coef_r2,
+   int coef_shift,
+   int border_mode,
+   region_t reg
+   PROF_ONLY(, hls::stream<prof_t> &prof_in, hls::stream<prof_t> &prof_out))
 {
-  // Line Buffers store full 512-bit chunks
-  uint512_t lb[2][CHUNKS_PER_ROW];
+  typedef chunk_format<PIX, CH> fmt;
+  const int FOLD = fmt::LANES / LANES;
+  PROF_ONLY(prof_t active = 0; prof_t post_empty = 0; prof_t filt_full = 0; prof_t strips = 0;)
+
+  const sharpen_coeffs_t coeffs = unpack_sharpen_coeffs(coef_r0, coef_r1, coef_r2, coef_shift);
+
+  // Line Buffers store full 512-bit chunks (sized for one strip plus halo)
+  uint512_t lb[2][STRIP_LB_CHUNKS];
 #pragma HLS ARRAY_PARTITION variable = lb complete dim = 1
 
   // Window of 512-bit Chunks
   uint512_t win[3][3];
 #pragma HLS ARRAY_PARTITION variable = win complete dim = 0
 
-// Initialization
-Init_LB:
-   for (int c = 0; c < CHUNKS_PER_ROW; c++)
+   const int total_rows = num_frames * (reg.in_row1 - reg.in_row0);
+
+Loop_Filter_Strips:
+   for (int c0 = reg.col0; c0 < reg.col1; c0 += STRIP_MAX_CHUNKS)
    {
+#pragma HLS LOOP_TRIPCOUNT min = 1 max = MAX_STRIPS
+      int strip_lo, strip_end, strip_hi;
+      strip_bounds(c0, reg.col1, stride_chunks, strip_lo, strip_end, strip_hi);
+      const int strip_width = strip_hi - strip_lo;
+      PROF_ONLY(strips++;)
+
+   // Initialization (per strip)
+   Init_LB:
+      for (int c = 0; c < strip_width; c++)
+      {
 #pragma HLS PIPELINE II = 1
-       lb[0][c] = 0;
-       lb[1][c] = 0;
-   }
+#pragma HLS LOOP_TRIPCOUNT min = CHUNKS_PER_ROW max = STRIP_LB_CHUNKS
+          lb[0][c] = 0;
+          lb[1][c] = 0;
+      }
 
-Init_Win:
-   for (int r = 0; r < 3; r++)
-   {
+   Init_Win:
+      for (int r = 0; r < 3; r++)
+      {
+#pragma HLS UNROLL
+          for (int c = 0; c < 3; c++)
+              win[r][c] = 0;
+      }
+
+      // Main Loop
+      // We need padding to flush the pipeline (approx 1 strip row + 1 chunk),
+      // once per strip of the batch rather than once per frame.
+      const int total_chunks = total_rows * strip_width;
+      const int LOOP_LIMIT = total_chunks + strip_width + 1;
+
+      // Run-time modulo/division would cost a divider per cycle, so the
+      // input column and the output (row-in-frame, strip chunk) position are tracked as counters.
+      int col_idx = 0;
+      int r_idx = reg.in_row0;
+      int c_chk = 0;
+      int iter = 0;
+      int step = 0; // Lane group of the center chunk (0 .. FOLD - 1)
+      uint512_t result_chunk = 0;
+
+   Loop_Filter_Wide:
+      for (int it = 0; it < LOOP_LIMIT * FOLD; it++)
+      {
+#pragma HLS PIPELINE II = 1
+#pragma HLS LOOP_TRIPCOUNT min = TOTAL_CHUNKS * V3_FOLD max = MAX_TOTAL_CHUNKS * V3_FOLD
+         PROF_ONLY(active++;)
+
+         // 1. Shift Window & Read New Data (once per chunk)
+         if (step == 0)
+         {
+            uint512_t new_chunk = 0;
+            if (iter < total_chunks)
+            {
+                PROF_ONLY(if (in_stream.empty()) post_empty++;)
+                new_chunk = in_stream.read();
+            }
+
+            // Shift Window Left
+            for (int r = 0; r < 3; r++)
+            {
+#pragma HLS UNROLL
+                win[r][0] = win[r][1];
+                win[r][1] = win[r][2];
+            }
+
+            // Update Right Column. The flush keeps reading the line buffers
+            // (with a zero row below), so the last row still has its center
+            // and north rows for the border policy.
+            win[0][2] = lb[0][col_idx];
+            win[1][2] = lb[1][col_idx];
+            win[2][2] = new_chunk;
+
+            // Update Line Buffers
+            lb[0][col_idx] = lb[1][col_idx];
+            lb[1][col_idx] = new_chunk;
+
+            col_idx = (col_idx == strip_width - 1) ? 0 : col_idx + 1;
+            result_chunk = 0;
+         }
+
+         // 2. Compute Output for Center Chunk (win[1][1]), one lane group per step
+         int out_idx = iter - (strip_width + 1);
+         const int g_chk = strip_lo + c_chk; // Chunk index within the full row
+
+         // Halo chunks and context rows only feed the taps; their owner emits them
+         const bool emit = out_idx >= 0 && out_idx < total_chunks && (HALO || (g_chk >= c0 && g_chk < strip_end))
+                           && r_idx >= reg.row0 && r_idx < reg.row1;
+         if (emit)
+         {
+             // Frame edges; border_mode decides what those pixels output
+             const bool north = (r_idx == 0);
+             const bool south = (r_idx == height - 1);
+
+         // Process every pixel (and channel) of the chunk in parallel
+         Calc_64:
+             for (int g = 0; g < LANES; g++)
+             {
+#pragma HLS UNROLL
+                 const int k = step * LANES + g;
+                 const int j = (g_chk * fmt::LANES) + k; // Logical column index
+
+                 for (int ch = 0; ch < CH; ch++)
+                 {
+#pragma HLS UNROLL
+                     const int lo = k * fmt::PIXEL_BITS + ch * fmt::CHANNEL_BITS;
+                     const int hi = lo + fmt::CHANNEL_BITS - 1;
+
+                     // Row padding past the last column is always zero
+                     if (j >= width)
+                     {
+                         result_chunk.range(hi, lo) = 0;
+                     }
+                     else
+                     {
+                         // 3x3 neighbourhood; taps past the chunk edge come from
+                         // the left/right window chunks
+                         int nb[3][3];
+                         for (int r = 0; r < 3; r++)
+                         {
+#pragma HLS UNROLL
+                             for (int t = 0; t < 3; t++)
+                             {
 #pragma HLS UNROLL
-       for (int c = 0; c < 3; c++)
-           win[r][c] = 0;
+                                 nb[r][t] = retime_reg(channel_tap<fmt>(win[r][0], win[r][1], win[r][2], k, t - 1, ch));
+                             }
+                         }
+                         result_chunk.range(hi, lo) = sharpen_border(coeffs, nb, border_mode, north, south,
+                                                                     j == 0, j == width - 1, height > 1, width > 1,
+                                                                     fmt::MAX_VALUE);
+                     }
+                 }
+              }
+          }
+          if (step < FOLD - 1)
+          {
+              step++;
+              continue;
+          }
+          step = 0;
+          iter++;
+
+          if (emit)
+          {
+              PROF_ONLY(if (out_stream.full()) filt_full++;)
+              out_stream.write(result_chunk);
+          }
+
+          if (out_idx >= 0 && out_idx < total_chunks)
+          {
+              if (c_chk == strip_width - 1)
+              {
+                  c_chk = 0;
+                  r_idx = (r_idx == reg.in_row1 - 1) ? reg.in_row0 : r_idx + 1;
+              }
+              else
+              {
+                  c_chk++;
+              }
+          }
+      }
    }
 
-   // Main Loop
-   // We need padding to flush the pipeline (approx 1 row + 1 chunk)
-   const int LOOP_LIMIT = TOTAL_CHUNKS + CHUNKS_PER_ROW + 1;
+   // Forward the upstream counters, then append this stage's
+   PROF_ONLY(
+   prof_out.write(prof_in.read());
+   prof_out.write(prof_in.read());
+   prof_out.write(active);
+   prof_out.write(post_empty);
+   prof_out.write(filt_full);
+   prof_out.write(strips);
+   )
+}
+
+#ifdef V3_MORPH
+// --------------------------------------------------------------------------
+// Stage 2a: Morphological Clean-up (erode / dilate, one chunk per cycle)
+// --------------------------------------------------------------------------
+// Same strip walk, line buffers and window as apply_filter_wide, with a 3x3
+// minimum/maximum (morph_3x3) per sample instead of the sharpen sum. Reads
+// whole strips including their halo chunks (the filter runs with HALO);
+// HALO passes them on for a second morphology stage, otherwise only the
+// strip's own chunks leave, in the order the writer expects.
+template <typename PIX, int CH, int LANES = chunk_format<PIX, CH>::LANES, bool HALO = false>
+static void apply_morph_wide(
+   hls::stream<uint512_t> &in_stream,
+   hls::stream<uint512_t> &out_stream,
+   int op,
+   int height,
+   int width,
+   int stride_chunks,
+   int num_frames
+   PROF_ONLY(, hls::stream<prof_t> &prof_in, hls::stream<prof_t> &prof_out))
+{
+  typedef chunk_format<PIX, CH> fmt;
+  const int FOLD = fmt::LANES / LANES;
+
+  uint512_t lb[2][STRIP_LB_CHUNKS];
+#pragma HLS ARRAY_PARTITION variable = lb complete dim = 1
+
+  uint512_t win[3][3];
+#pragma HLS ARRAY_PARTITION variable = win complete dim = 0
+
+   const int total_rows = num_frames * height;
 
-Loop_Filter_Wide:
-   for (int iter = 0; iter < LOOP_LIMIT; iter++)
+Loop_Morph_Strips:
+   for (int c0 = 0; c0 < stride_chunks; c0 += STRIP_MAX_CHUNKS)
    {
-#pragma HLS PIPELINE II = 1
+#pragma HLS LOOP_TRIPCOUNT min = 1 max = MAX_STRIPS
+      int strip_lo, strip_end, strip_hi;
+      strip_bounds(c0, stride_chunks, stride_chunks, strip_lo, strip_end, strip_hi);
+      const int strip_width = strip_hi - strip_lo;
 
-      // 1. Shift Window & Read New Data
-      uint512_t new_chunk = 0;
-      if (iter < TOTAL_CHUNKS)
+   Init_Morph_LB:
+      for (int c = 0; c < strip_width; c++)
       {
-          new_chunk = in_stream.read();
+#pragma HLS PIPELINE II = 1
+#pragma HLS LOOP_TRIPCOUNT min = CHUNKS_PER_ROW max = STRIP_LB_CHUNKS
+          lb[0][c] = 0;
+          lb[1][c] = 0;
       }
 
-      // Shift Window Left
+   Init_Morph_Win:
       for (int r = 0; r < 3; r++)
       {
 #pragma HLS UNROLL
-          win[r][0] = win[r][1];
-          win[r][1] = win[r][2];
+          for (int c = 0; c < 3; c++)
+              win[r][c] = 0;
       }
 
-      // Update Right Column
-      int col_idx = iter % CHUNKS_PER_ROW;
+      const int total_chunks = total_rows * strip_width;
+      const int LOOP_LIMIT = total_chunks + strip_width + 1;
 
-      if (iter < TOTAL_CHUNKS)
-      {
-          win[0][2] = lb[0][col_idx];
-          win[1][2] = lb[1][col_idx];
-          win[2][2] = new_chunk;
+      int col_idx = 0;
+      int r_idx = 0;
+      int c_chk = 0;
+      int iter = 0;
+      int step = 0;
+      uint512_t result_chunk = 0;
 
-          // Update Line Buffers
-          lb[0][col_idx] = lb[1][col_idx];
-          lb[1][col_idx] = new_chunk;
-      }
-      else
+   Loop_Morph_Wide:
+      for (int it = 0; it < LOOP_LIMIT * FOLD; it++)
       {
-          win[0][2] = 0;
-          win[1][2] = 0;
-          win[2][2] = 0;
+#pragma HLS PIPELINE II = 1
+#pragma HLS LOOP_TRIPCOUNT min = TOTAL_CHUNKS * V3_FOLD max = MAX_TOTAL_CHUNKS * V3_FOLD
+         if (step == 0)
+         {
+            uint512_t new_chunk = 0;
+            if (iter < total_chunks)
+                new_chunk = in_stream.read();
+
+            for (int r = 0; r < 3; r++)
+            {
+#pragma HLS UNROLL
+                win[r][0] = win[r][1];
+                win[r][1] = win[r][2];
+            }
+            win[0][2] = lb[0][col_idx];
+            win[1][2] = lb[1][col_idx];
+            win[2][2] = new_chunk;
+
+            lb[0][col_idx] = lb[1][col_idx];
+            lb[1][col_idx] = new_chunk;
+
+            col_idx = (col_idx == strip_width - 1) ? 0 : col_idx + 1;
+            result_chunk = 0;
+         }
+
+         const int out_idx = iter - (strip_width + 1);
+         const int g_chk = strip_lo + c_chk;
+         const bool emit = out_idx >= 0 && out_idx < total_chunks && (HALO || (g_chk >= c0 && g_chk < strip_end));
+         if (emit)
+         {
+             // Taps past the frame (including the next/previous frame of the batch) are left out
+             const bool north = (r_idx == 0);
+             const bool south = (r_idx == height - 1);
+
+         Morph_64:
+             for (int g = 0; g < LANES; g++)
+             {
+#pragma HLS UNROLL
+                 const int k = step * LANES + g;
+                 const int j = (g_chk * fmt::LANES) + k;
+
+                 for (int ch = 0; ch < CH; ch++)
+                 {
+#pragma HLS UNROLL
+                     const int lo = k * fmt::PIXEL_BITS + ch * fmt::CHANNEL_BITS;
+                     const int hi = lo + fmt::CHANNEL_BITS - 1;
+
+                     if (j >= width)
+                     {
+                         result_chunk.range(hi, lo) = 0;
+                     }
+                     else
+                     {
+                         int nb[3][3];
+                         for (int r = 0; r < 3; r++)
+                         {
+#pragma HLS UNROLL
+                             for (int t = 0; t < 3; t++)
+                             {
+#pragma HLS UNROLL
+                                 nb[r][t] = retime_reg(channel_tap<fmt>(win[r][0], win[r][1], win[r][2], k, t - 1, ch));
+                             }
+                         }
+                         result_chunk.range(hi, lo) = morph_3x3(nb, op, north, south, j == 0, j == width - 1,
+                                                                fmt::MAX_VALUE);
+                     }
+                 }
+             }
+         }
+         if (step < FOLD - 1)
+         {
+             step++;
+             continue;
+         }
+         step = 0;
+         iter++;
+
+         if (emit)
+             out_stream.write(result_chunk);
+
+         if (out_idx >= 0 && out_idx < total_chunks)
+         {
+             if (c_chk == strip_width - 1)
+             {
+                 c_chk = 0;
+                 r_idx = (r_idx == height - 1) ? 0 : r_idx + 1;
+             }
+             else
+             {
+                 c_chk++;
+             }
+         }
       }
+   }
 
-      // 2. Compute Output for Center Chunk (win[1][1])
-      int out_idx = iter - (CHUNKS_PER_ROW + 1);
+   // Forward the diff/filter counters the writer expects
+   PROF_ONLY(
+   Loop_Morph_Prof:
+   for (int p = 0; p <= PROF_WRITE_ACTIVE; p++)
+   {
+       prof_out.write(prof_in.read());
+   }
+   )
+}
+#endif
 
-      if (out_idx >= 0 && out_idx < TOTAL_CHUNKS)
-      {
-          int r_idx = out_idx / CHUNKS_PER_ROW; // Row index 0..255
-          int c_chk = out_idx % CHUNKS_PER_ROW; // Chunk col index 0..3
+#ifdef V3_STATS
+// --------------------------------------------------------------------------
+// Stage 2b: Output Statistics (pass-through)
+// --------------------------------------------------------------------------
+// Forwards the filtered chunks unchanged (same strip order as the writer)
+// and reduces each one to min/max/sum over its logical pixels; the level
+// histogram arrives from compute_diff_wide once its last chunk is done.
+static void accumulate_stats_wide(
+   hls::stream<uint512_t> &in_stream,
+   hls::stream<uint512_t> &out_stream,
+   hls::stream<uint64_t> &levels_in,
+   uint64_t *stats,
+   int height,
+   int width,
+   int stride_chunks,
+   int num_frames
+   PROF_ONLY(, hls::stream<prof_t> &prof_in, hls::stream<prof_t> &prof_out))
+{
+   const int total_rows = num_frames * height;
+   int min_px = 255;
+   int max_px = 0;
+   uint64_t sum = 0;
+   uint64_t pixels = 0;
 
-          uint512_t result_chunk = 0;
+Loop_Stats_Strips:
+   for (int c0 = 0; c0 < stride_chunks; c0 += STRIP_MAX_CHUNKS)
+   {
+#pragma HLS LOOP_TRIPCOUNT min = 1 max = MAX_STRIPS
+      int strip_lo, strip_end, strip_hi;
+      strip_bounds(c0, stride_chunks, stride_chunks, strip_lo, strip_end, strip_hi);
+      const int out_width = strip_end - c0;
+      const int strip_chunks = total_rows * out_width;
+      int oc = 0;
 
-          // Border flags for cleaner logic
-          const bool row_border = (r_idx == 0) || (r_idx == HEIGHT - 1);
+   Loop_Stats:
+      for (int i = 0; i < strip_chunks; i++)
+      {
+#pragma HLS PIPELINE II = 1
+#pragma HLS LOOP_TRIPCOUNT min = TOTAL_CHUNKS max = MAX_TOTAL_CHUNKS
+          const uint512_t chunk = in_stream.read();
+          out_stream.write(chunk);
 
-      // Process all 64 pixels in parallel
-      Calc_64:
+          const int valid = width - (c0 + oc) * PIXELS_PER_CHUNK;
+          int c_min = 255, c_max = 0, c_sum = 0;
+      Reduce_64_Pixels:
           for (int k = 0; k < PIXELS_PER_CHUNK; k++)
           {
 #pragma HLS UNROLL
+              const int v = chunk.range(k * 8 + 7, k * 8);
+              if (k < valid)
+              {
+                  c_min = (v < c_min) ? v : c_min;
+                  c_max = (v > c_max) ? v : c_max;
+                  c_sum += v;
+              }
+          }
+          min_px = (c_min < min_px) ? c_min : min_px;
+          max_px = (c_max > max_px) ? c_max : max_px;
+          sum += c_sum;
+          pixels += (valid < PIXELS_PER_CHUNK) ? valid : PIXELS_PER_CHUNK;
+
+          oc = (oc == out_width - 1) ? 0 : oc + 1;
+      }
+   }
+
+Loop_Stats_Out:
+   for (int l = 0; l < POSTERIZE_MAX_LEVELS; l++)
+   {
+       stats[STATS_LEVEL_COUNT + l] = levels_in.read();
+   }
+   stats[STATS_MIN]    = min_px;
+   stats[STATS_MAX]    = max_px;
+   stats[STATS_SUM]    = sum;
+   stats[STATS_PIXELS] = pixels;
 
-              const int lo = k * 8;
-              const int hi = lo + 7;
-              const int j = (c_chk * PIXELS_PER_CHUNK) + k; // Logical column index
+   // Forward the diff/filter counters the writer expects
+   PROF_ONLY(
+   Loop_Stats_Prof:
+   for (int p = 0; p <= PROF_WRITE_ACTIVE; p++)
+   {
+       prof_out.write(prof_in.read());
+   }
+   )
+}
+#endif
+
+#ifdef V3_PYRAMID
+// --------------------------------------------------------------------------
+// Stage 2c: Resolution Pyramid (pass-through)
+// --------------------------------------------------------------------------
+// Forwards the result chunks unchanged. On every odd row, each chunk and the
+// one above it give 32 half-level pixels (2x2 means); on every odd half
+// row, those and the half row above give 16 quarter-level pixels. Two and
+// four input chunks fill one level chunk, and strips start on a multiple of
+// four chunks, so no level chunk spans strips. Level chunks leave in strip
+// order, a row at a time, like C's.
+typedef ap_uint<4 * PIXELS_PER_CHUNK> half_part_t; // Half-level pixels of one input chunk
 
-              // Unified border check
-              const bool col_border = (j == 0) || (j == WIDTH - 1);
+static void decimate_wide(
+   hls::stream<uint512_t> &in_stream,
+   hls::stream<uint512_t> &out_stream,
+   hls::stream<uint512_t> &half_out,
+   hls::stream<uint512_t> &quarter_out,
+   int height,
+   int stride_chunks,
+   int num_frames)
+{
+   // Even rows of the strip, full and half resolution
+   uint512_t lb[STRIP_MAX_CHUNKS];
+   half_part_t half_lb[STRIP_MAX_CHUNKS];
+
+Loop_Pyr_Strips:
+   for (int c0 = 0; c0 < stride_chunks; c0 += STRIP_MAX_CHUNKS)
+   {
+#pragma HLS LOOP_TRIPCOUNT min = 1 max = MAX_STRIPS
+      int strip_lo, strip_end, strip_hi;
+      strip_bounds(c0, stride_chunks, stride_chunks, strip_lo, strip_end, strip_hi);
+      const int out_width = strip_end - c0;
+      const int strip_chunks = num_frames * height * out_width;
+      int oc = 0;
+      int y = 0; // Row within the frame
+      uint512_t half_chunk = 0;
+      uint512_t quarter_chunk = 0;
 
-              if (row_border || col_border)
+   Loop_Pyr:
+      for (int i = 0; i < strip_chunks; i++)
+      {
+#pragma HLS PIPELINE II = 1
+#pragma HLS LOOP_TRIPCOUNT min = TOTAL_CHUNKS max = MAX_TOTAL_CHUNKS
+          const uint512_t chunk = in_stream.read();
+          out_stream.write(chunk);
+
+          const int g = c0 + oc;
+          const bool row_end = (oc == out_width - 1);
+          if ((y & 1) == 0)
+          {
+              lb[oc] = chunk;
+          }
+          else
+          {
+              // An odd row always completes a block; a trailing even row is dropped
+              const uint512_t up = lb[oc];
+              half_part_t half = 0;
+          Mean_Half:
+              for (int k = 0; k < PIXELS_PER_CHUNK / 2; k++)
               {
-                  result_chunk.range(hi, lo) = 0;
+#pragma HLS UNROLL
+                  half.range(8 * k + 7, 8 * k) =
+                      PYR_MEAN4((int)up.range(16 * k + 7, 16 * k), (int)up.range(16 * k + 15, 16 * k + 8),
+                                (int)chunk.range(16 * k + 7, 16 * k), (int)chunk.range(16 * k + 15, 16 * k + 8));
               }
+              if (g & 1)
+                  half_chunk.range(DATA_WIDTH_BITS - 1, DATA_WIDTH_BITS / 2) = half;
               else
+                  half_chunk.range(DATA_WIDTH_BITS / 2 - 1, 0) = half;
+              if ((g & 1) || row_end)
               {
-                  // Center Pixel
-                  int val = 5 * (int)win[1][1].range(hi, lo);
-
-                  // North/South
-                  val -= (int)win[0][1].range(hi, lo);
-                  val -= (int)win[2][1].range(hi, lo);
+                  half_out.write(half_chunk);
+                  half_chunk = 0;
+              }
 
-                  // West Neighbor
-                  if (k > 0)
+              if ((y & 2) == 0)
+              {
+                  half_lb[oc] = half;
+              }
+              else
+              {
+                  const half_part_t half_up = half_lb[oc];
+                  const int base = (g & 3) * (PIXELS_PER_CHUNK / 4);
+              Mean_Quarter:
+                  for (int k = 0; k < PIXELS_PER_CHUNK / 4; k++)
                   {
-                       val -= (int)win[1][1].range((k - 1) * 8 + 7, (k - 1) * 8);
-                   }
-                   else
-                   {
-                       val -= (int)win[1][0].range(DATA_WIDTH_BITS - 1, DATA_WIDTH_BITS - PIXEL_SIZE_BITS);  // Last byte of left chunk
-                   }
-                   // East Neighbor
-                   if (k < PIXELS_PER_CHUNK - 1)
-                   {
-                       val -= (int)win[1][1].range((k + 1) * 8 + 7, (k + 1) * 8);
-                   }
-                   else
-                   {
-                       val -= (int)win[1][2].range(PIXEL_SIZE_BITS - 1, 0);  // First byte of right chunk
-                   }
-
-                   result_chunk.range(hi, lo) = clip_u8(val);
-               }
-           }
-           out_stream.write(result_chunk);
-       }
+#pragma HLS UNROLL
+                      quarter_chunk.range(8 * (base + k) + 7, 8 * (base + k)) =
+                          PYR_MEAN4((int)half_up.range(16 * k + 7, 16 * k),
+                                    (int)half_up.range(16 * k + 15, 16 * k + 8),
+                                    (int)half.range(16 * k + 7, 16 * k), (int)half.range(16 * k + 15, 16 * k + 8));
+                  }
+                  if ((g & 3) == 3 || row_end)
+                  {
+                      quarter_out.write(quarter_chunk);
+                      quarter_chunk = 0;
+                  }
+              }
+          }
+
+          if (row_end)
+          {
+              oc = 0;
+              y = (y == height - 1) ? 0 : y + 1;
+          }
+          else
+          {
+              oc++;
+          }
+      }
    }
 }
+#endif
 
 // --------------------------------------------------------------------------
 // Stage 3: Write Memory
 // --------------------------------------------------------------------------
 static void write_result_wide(
    hls::stream<uint512_t> &in_stream,
-   uint512_t *C)
+   uint512_t *C,
+   int height,
+   int stride_chunks,
+   int num_frames,
+   region_t reg
+   PROF_ONLY(, hls::stream<prof_t> &prof_in, prof_t *prof)
+   COMPRESS_ONLY(, uint64_t *comp_index))
 {
-Loop_Write:
-   for (int i = 0; i < TOTAL_CHUNKS; i++)
+   const int total_rows = num_frames * (reg.row1 - reg.row0);
+   PROF_ONLY(prof_t active = 0; prof_t filt_empty = 0;)
+#ifdef V3_COMPRESS
+   // Kept chunks go to C back to back, so the writes stay sequential
+   int kept = 0;
+   uint64_t bits = 0;
+   int nbit = 0;
+   int word = 1;
+#endif
+
+Loop_Write_Strips:
+   for (int c0 = reg.col0; c0 < reg.col1; c0 += STRIP_MAX_CHUNKS)
    {
+#pragma HLS LOOP_TRIPCOUNT min = 1 max = MAX_STRIPS
+      int strip_lo, strip_end, strip_hi;
+      strip_bounds(c0, reg.col1, stride_chunks, strip_lo, strip_end, strip_hi);
+      const int out_width = strip_end - c0;
+      const int strip_chunks = total_rows * out_width;
+
+      int row_base = reg.row0 * stride_chunks + c0;
+      int oc = 0;
+
+   Loop_Write:
+      for (int i = 0; i < strip_chunks; i++)
+      {
 #pragma HLS PIPELINE II = 1
-#pragma HLS LOOP_TRIPCOUNT min = TOTAL_CHUNKS max = TOTAL_CHUNKS
-       C[i] = in_stream.read();
+#pragma HLS LOOP_TRIPCOUNT min = TOTAL_CHUNKS max = MAX_TOTAL_CHUNKS
+          PROF_ONLY(active++; if (in_stream.empty()) filt_empty++;)
+#ifdef V3_COMPRESS
+          const uint512_t chunk = in_stream.read();
+          const bool keep = (chunk != 0);
+          if (keep)
+              C[kept++] = chunk;
+          bits |= (uint64_t)keep << nbit;
+          if (nbit == 63)
+          {
+              comp_index[word++] = bits;
+              bits = 0;
+              nbit = 0;
+          }
+          else
+          {
+              nbit++;
+          }
+#else
+          C[row_base + oc] = in_stream.read();
+#endif
+
+          if (oc == out_width - 1)
+          {
+              oc = 0;
+              row_base += stride_chunks;
+          }
+          else
+          {
+              oc++;
+          }
+      }
    }
+
+#ifdef V3_COMPRESS
+   if (nbit != 0)
+       comp_index[word] = bits;
+   comp_index[0] = kept;
+#endif
+
+   PROF_ONLY(
+   Loop_Write_Prof:
+   for (int p = 0; p < PROF_WRITE_ACTIVE; p++)
+   {
+       prof[p] = prof_in.read();
+   }
+   prof[PROF_WRITE_ACTIVE]     = active;
+   prof[PROF_WRITE_FILT_EMPTY] = filt_empty;
+   prof[PROF_STRIPS]           = prof_in.read();
+   )
 }
 
+#ifdef V3_PYRAMID
+// --------------------------------------------------------------------------
+// Stage 3b: Write Pyramid Level
+// --------------------------------------------------------------------------
+// Same walk as write_result_wide over the level's rows and chunks (level 1:
+// half, 2: quarter), so every strip row is one sequential burst.
+static void write_level_wide(
+   hls::stream<uint512_t> &in_stream,
+   uint512_t *out,
+   int level,
+   int height,
+   int stride_chunks,
+   int num_frames)
+{
+   const int total_rows = num_frames * PYR_ROWS(height, level);
+   const int level_stride = PYR_STRIDE(stride_chunks, level);
+
+Loop_Level_Strips:
+   for (int c0 = 0; c0 < stride_chunks; c0 += STRIP_MAX_CHUNKS)
+   {
+#pragma HLS LOOP_TRIPCOUNT min = 1 max = MAX_STRIPS
+      int strip_lo, strip_end, strip_hi;
+      strip_bounds(c0, stride_chunks, stride_chunks, strip_lo, strip_end, strip_hi);
+      const int l0 = c0 >> level;
+      const int out_width = PYR_STRIDE(strip_end, level) - l0;
+      const int strip_chunks = total_rows * out_width;
+
+      int row_base = l0;
+      int oc = 0;
+
+   Loop_Level_Write:
+      for (int i = 0; i < strip_chunks; i++)
+      {
+#pragma HLS PIPELINE II = 1
+#pragma HLS LOOP_TRIPCOUNT min = TOTAL_CHUNKS / 4 max = MAX_TOTAL_CHUNKS / 4
+          out[row_base + oc] = in_stream.read();
+          if (oc == out_width - 1)
+          {
+              oc = 0;
+              row_base += level_stride;
+          }
+          else
+          {
+              oc++;
+          }
+      }
+   }
+}
+#endif
+
+// accelerated_v4.cpp includes this file with -DV3_STAGES_ONLY to reuse the
+// stages above behind an AXI4-Stream top
+#ifndef V3_STAGES_ONLY
+
+#ifdef V3_ROI
+// --------------------------------------------------------------------------
+// ROI pass: the three stages over one region of one frame
+// --------------------------------------------------------------------------
+// Called once per ROI, so the pipeline drains between ROIs (about one strip
+// row); ROIs are expected to be much larger than that.
+static void process_region(const uint512_t *A, const uint512_t *B, uint512_t *C, uint64_t *change_map,
+                           int height, int width, int stride_chunks,
+                           int coef_r0, int coef_r1, int coef_r2, int coef_shift, int border_mode,
+                           int post_thr03, int post_thr46, int post_levels, region_t reg)
+{
+    hls::stream<uint512_t> stream_post("s_post");
+    hls::stream<uint512_t> stream_filt("s_filt");
+
+#pragma HLS STREAM variable = stream_post depth = 16
+#pragma HLS STREAM variable = stream_filt depth = 16
+
+#pragma HLS DATAFLOW
+
+   compute_diff_wide<v3_channel_t, V3_CHANNELS, V3_LANES>(
+                     A, B, stream_post, change_map, height, stride_chunks, 1,
+                     post_thr03, post_thr46, post_levels, reg);
+   apply_filter_wide<v3_channel_t, V3_CHANNELS, V3_LANES>(
+                     stream_post, stream_filt, height, width, stride_chunks, 1,
+                     coef_r0, coef_r1, coef_r2, coef_shift, border_mode, reg);
+   write_result_wide(stream_filt, C, height, stride_chunks, 1, reg);
+}
+#endif
+
 extern "C" {
 
 // --------------------------------------------------------------------------
 // Top Level
 // --------------------------------------------------------------------------
-void IMAGE_DIFF_POSTERIZE(const uint512_t *A, const uint512_t *B, uint512_t *C)
+// height/width: logical image size in pixels (width <= MAX_WIDTH; strips
+//               of STRIP_MAX_CHUNKS chunks keep the line buffers bounded)
+// stride_chunks: row pitch of A/B/C in 512-bit chunks
+//               (>= ceil(width / V3_PIXELS_PER_CHUNK))
+// num_frames: frame pairs stored back to back in A/B (results likewise in C)
+// coef_r0..r2, coef_shift: sharpen taps (SHARPEN_PACK_ROW) and right shift;
+//               ignored when built with -DSHARPEN_FIXED
+// border_mode: BORDER_* policy for the first/last row and column
+// post_thr03, post_thr46, post_levels: posterize thresholds (POSTERIZE_PACK4)
+//               and level count; ignored when built with -DPOSTERIZE_FIXED
+// change_map: CHANGE_MAP_WORDS() words of per-tile change bits + any-change flag
+//               (-DV3_ROI: ROI_CHANGE_WORDS() per-ROI flags instead);
+//               with num_frames = 0, the kernel properties (KERNEL_PROPS_*)
+// post_tap (-DV3_POST_TAP only): POST_TAP_WORDS() words of 2-bit level codes
+// stats (-DV3_STATS only): STATS_NUM_WORDS words of level counts and
+//               sharpened min/max/sum
+// comp_index (-DV3_COMPRESS only): COMP_INDEX_WORDS() words: kept-chunk count
+//               and per-chunk keep bits; C then holds only the non-zero chunks
+// rois, num_rois (-DV3_ROI only): ROI_PACK() rectangles applied to every frame;
+//               C is only written inside them
+// morph_mode (-DV3_MORPH only): MORPH_* clean-up of the sharpened output
+// blobs (-DV3_BLOBS only): BLOB_WORDS() words, each frame's white blob list
+// pyr_half, pyr_quarter (-DV3_PYRAMID only): PYR_WORDS() chunks of the result
+//               at 1/2 and 1/4 resolution
+// in_format (-DV3_LUMA only): LUMA_* layout of A and B, which then hold
+//               LUMA_WORDS_PER_CHUNK() words per chunk of the result
+void IMAGE_DIFF_POSTERIZE(const uint512_t *A, const uint512_t *B, uint512_t *C,
+                          int height, int width, int stride_chunks, int num_frames,
+                          int coef_r0, int coef_r1, int coef_r2, int coef_shift, int border_mode,
+                          int post_thr03, int post_thr46, int post_levels,
+                          uint64_t *change_map
+                          POST_TAP_ONLY(, uint512_t *post_tap)
+                          STATS_ONLY(, uint64_t *stats)
+                          PROF_ONLY(, prof_t *prof)
+                          COMPRESS_ONLY(, uint64_t *comp_index)
+                          ROI_ONLY(, const uint64_t *rois, int num_rois)
+                          MORPH_ONLY(, int morph_mode)
+                          BLOBS_ONLY(, uint64_t *blobs)
+                          PYRAMID_ONLY(, uint512_t *pyr_half, uint512_t *pyr_quarter)
+                          LUMA_ONLY(, int in_format))
 {
+#ifdef V3_LUMA
+#pragma HLS INTERFACE m_axi port = A offset = slave bundle = gmemA depth = LUMA_DEFAULT_WORDS
+#pragma HLS INTERFACE m_axi port = B offset = slave bundle = gmemB depth = LUMA_DEFAULT_WORDS
+#pragma HLS INTERFACE s_axilite port = in_format bundle = control
+#else
 #pragma HLS INTERFACE m_axi port = A offset = slave bundle = gmemA depth = TOTAL_CHUNKS
 #pragma HLS INTERFACE m_axi port = B offset = slave bundle = gmemB depth = TOTAL_CHUNKS
+#endif
 #pragma HLS INTERFACE m_axi port = C offset = slave bundle = gmemC depth = TOTAL_CHUNKS
 #pragma HLS INTERFACE s_axilite port = A bundle = control
 #pragma HLS INTERFACE s_axilite port = B bundle = control
 #pragma HLS INTERFACE s_axilite port = C bundle = control
+#pragma HLS INTERFACE s_axilite port = height bundle = control
+#pragma HLS INTERFACE s_axilite port = width bundle = control
+#pragma HLS INTERFACE s_axilite port = stride_chunks bundle = control
+#pragma HLS INTERFACE s_axilite port = num_frames bundle = control
+#pragma HLS INTERFACE s_axilite port = coef_r0 bundle = control
+#pragma HLS INTERFACE s_axilite port = coef_r1 bundle = control
+#pragma HLS INTERFACE s_axilite port = coef_r2 bundle = control
+#pragma HLS INTERFACE s_axilite port = coef_shift bundle = control
+#pragma HLS INTERFACE s_axilite port = border_mode bundle = control
+#pragma HLS INTERFACE s_axilite port = post_thr03 bundle = control
+#pragma HLS INTERFACE s_axilite port = post_thr46 bundle = control
+#pragma HLS INTERFACE s_axilite port = post_levels bundle = control
+#pragma HLS INTERFACE m_axi port = change_map offset = slave bundle = gmemM depth = CHANGE_MAP_DEFAULT_WORDS
+#pragma HLS INTERFACE s_axilite port = change_map bundle = control
 #pragma HLS INTERFACE s_axilite port = return bundle = control
+#ifdef V3_POST_TAP
+#pragma HLS INTERFACE m_axi port = post_tap offset = slave bundle = gmemT depth = POST_TAP_DEFAULT_WORDS
+#pragma HLS INTERFACE s_axilite port = post_tap bundle = control
+#endif
+#ifdef V3_STATS
+#pragma HLS INTERFACE m_axi port = stats offset = slave bundle = gmemS depth = STATS_NUM_WORDS
+#pragma HLS INTERFACE s_axilite port = stats bundle = control
+#endif
+#ifdef V3_PROFILE
+#pragma HLS INTERFACE m_axi port = prof offset = slave bundle = gmemP depth = PROF_NUM_COUNTERS
+#pragma HLS INTERFACE s_axilite port = prof bundle = control
+#endif
+#ifdef V3_COMPRESS
+#pragma HLS INTERFACE m_axi port = comp_index offset = slave bundle = gmemZ depth = COMP_INDEX_DEFAULT_WORDS
+#pragma HLS INTERFACE s_axilite port = comp_index bundle = control
+#endif
+#ifdef V3_MORPH
+#pragma HLS INTERFACE s_axilite port = morph_mode bundle = control
+#endif
+#ifdef V3_BLOBS
+#pragma HLS INTERFACE m_axi port = blobs offset = slave bundle = gmemL depth = BLOB_DEFAULT_WORDS
+#pragma HLS INTERFACE s_axilite port = blobs bundle = control
+#endif
+#ifdef V3_PYRAMID
+#pragma HLS INTERFACE m_axi port = pyr_half offset = slave bundle = gmemH depth = PYR_DEFAULT_WORDS(1)
+#pragma HLS INTERFACE m_axi port = pyr_quarter offset = slave bundle = gmemQ depth = PYR_DEFAULT_WORDS(2)
+#pragma HLS INTERFACE s_axilite port = pyr_half bundle = control
+#pragma HLS INTERFACE s_axilite port = pyr_quarter bundle = control
+#endif
+#ifdef V3_ROI
+#pragma HLS INTERFACE m_axi port = rois offset = slave bundle = gmemR depth = ROI_MAX
+#pragma HLS INTERFACE s_axilite port = rois bundle = control
+#pragma HLS INTERFACE s_axilite port = num_rois bundle = control
+
+    const int frame_chunks = height * stride_chunks;
+
+   // No frames: the properties query (KERNEL_PROPS_*)
+   if (num_frames == 0)
+       change_map[0] = KERNEL_PROPS_BUILD;
+
+Loop_Roi_Frames:
+   for (int f = 0; f < num_frames; f++)
+   {
+   Loop_Rois:
+      for (int i = 0; i < num_rois; i++)
+      {
+#pragma HLS LOOP_TRIPCOUNT min = 1 max = ROI_MAX
+          // Clamp to the frame; an empty ROI outputs nothing and is unchanged
+          const uint64_t roi = rois[i];
+          const int row1 = (ROI_ROW1(roi) < height) ? ROI_ROW1(roi) : height;
+          const int col1 = (ROI_COL1(roi) < stride_chunks) ? ROI_COL1(roi) : stride_chunks;
+          uint64_t *flag = change_map + f * num_rois + i;
+          if (ROI_ROW0(roi) < row1 && ROI_COL0(roi) < col1)
+          {
+              process_region(A + f * frame_chunks, B + f * frame_chunks, C + f * frame_chunks, flag,
+                             height, width, stride_chunks,
+                             coef_r0, coef_r1, coef_r2, coef_shift, border_mode,
+                             post_thr03, post_thr46, post_levels,
+                             make_region(ROI_ROW0(roi), row1, ROI_COL0(roi), col1, height));
+          }
+          else
+          {
+              *flag = 0;
+          }
+      }
+   }
+#else
 
     hls::stream<uint512_t> stream_post("s_post");
     hls::stream<uint512_t> stream_filt("s_filt");
@@ -231,11 +1601,123 @@ void IMAGE_DIFF_POSTERIZE(const uint512_t *A, const uint512_t *B, uint512_t *C)
 #pragma HLS STREAM variable = stream_post depth = 16
 #pragma HLS STREAM variable = stream_filt depth = 16
 
+#ifdef V3_MORPH
+    // Sharpened and first-stage chunks, halos included
+    hls::stream<uint512_t> stream_sharp("s_sharp");
+    hls::stream<uint512_t> stream_morph("s_morph");
+#pragma HLS STREAM variable = stream_sharp depth = 16
+#pragma HLS STREAM variable = stream_morph depth = 16
+#endif
+
+#ifdef V3_STATS
+    hls::stream<uint512_t> stream_stat("s_stat");
+    hls::stream<uint64_t> stats_levels("s_stats_levels");
+#pragma HLS STREAM variable = stream_stat depth = 16
+#pragma HLS STREAM variable = stats_levels depth = POSTERIZE_MAX_LEVELS
+#endif
+
+#ifdef V3_BLOBS
+    // One row of slack for rows with many runs
+    hls::stream<uint64_t> stream_white("s_white");
+#pragma HLS STREAM variable = stream_white depth = STRIP_LB_CHUNKS
+#endif
+
+#ifdef V3_PYRAMID
+    // Result chunks past the pyramid stage, and the two levels
+    hls::stream<uint512_t> stream_res("s_res");
+    hls::stream<uint512_t> stream_half("s_half");
+    hls::stream<uint512_t> stream_quarter("s_quarter");
+#pragma HLS STREAM variable = stream_res depth = 16
+#pragma HLS STREAM variable = stream_half depth = 16
+#pragma HLS STREAM variable = stream_quarter depth = 16
+#endif
+
+#ifdef V3_LUMA
+    hls::stream<uint512_t> stream_luma_A("s_luma_A");
+    hls::stream<uint512_t> stream_luma_B("s_luma_B");
+#pragma HLS STREAM variable = stream_luma_A depth = 16
+#pragma HLS STREAM variable = stream_luma_B depth = 16
+#endif
+
+#ifdef V3_PROFILE
+    hls::stream<prof_t> prof_diff("s_prof_diff");
+    hls::stream<prof_t> prof_filt("s_prof_filt");
+#pragma HLS STREAM variable = prof_diff depth = 2
+#pragma HLS STREAM variable = prof_filt depth = 6
+#ifdef V3_STATS
+    hls::stream<prof_t> prof_stat("s_prof_stat");
+#pragma HLS STREAM variable = prof_stat depth = 6
+#endif
+#ifdef V3_MORPH
+    hls::stream<prof_t> prof_sharp("s_prof_sharp");
+    hls::stream<prof_t> prof_morph("s_prof_morph");
+#pragma HLS STREAM variable = prof_sharp depth = 6
+#pragma HLS STREAM variable = prof_morph depth = 6
+#endif
+#endif
+
 #pragma HLS DATAFLOW
 
-   compute_diff_wide(A, B, stream_post);
-   apply_filter_wide(stream_post, stream_filt);
-   write_result_wide(stream_filt, C);
+#ifdef V3_LUMA
+   convert_luma_wide(A, B, stream_luma_A, stream_luma_B, height, stride_chunks, num_frames, in_format);
+   compute_diff_wide<v3_channel_t, V3_CHANNELS, V3_LANES, hls::stream<uint512_t> &>(
+                     stream_luma_A, stream_luma_B, stream_post, change_map, height, stride_chunks, num_frames,
+#else
+   compute_diff_wide<v3_channel_t, V3_CHANNELS, V3_LANES>(
+                     A, B, stream_post, change_map, height, stride_chunks, num_frames,
+#endif
+                     post_thr03, post_thr46, post_levels, full_region(height, stride_chunks)
+                     POST_TAP_ONLY(, post_tap)
+                     STATS_ONLY(, width, stats_levels)
+                     PROF_ONLY(, prof_diff)
+                     BLOBS_ONLY(, stream_white));
+#ifdef V3_BLOBS
+   extract_blobs(stream_white, blobs, height, stride_chunks, num_frames);
+#endif
+#ifdef V3_MORPH
+   apply_filter_wide<v3_channel_t, V3_CHANNELS, V3_LANES, true>(
+                     stream_post, stream_sharp, height, width, stride_chunks, num_frames,
+                     coef_r0, coef_r1, coef_r2, coef_shift, border_mode, full_region(height, stride_chunks)
+                     PROF_ONLY(, prof_diff, prof_sharp));
+   apply_morph_wide<v3_channel_t, V3_CHANNELS, V3_LANES, true>(
+                     stream_sharp, stream_morph, MORPH_FIRST_OP(morph_mode), height, width, stride_chunks, num_frames
+                     PROF_ONLY(, prof_sharp, prof_morph));
+   apply_morph_wide<v3_channel_t, V3_CHANNELS, V3_LANES>(
+                     stream_morph, stream_filt, MORPH_SECOND_OP(morph_mode), height, width, stride_chunks, num_frames
+                     PROF_ONLY(, prof_morph, prof_filt));
+#else
+   apply_filter_wide<v3_channel_t, V3_CHANNELS, V3_LANES>(
+                     stream_post, stream_filt, height, width, stride_chunks, num_frames,
+                     coef_r0, coef_r1, coef_r2, coef_shift, border_mode, full_region(height, stride_chunks)
+                     PROF_ONLY(, prof_diff, prof_filt));
+#endif
+#ifdef V3_STATS
+   accumulate_stats_wide(stream_filt, stream_stat, stats_levels, stats, height, width, stride_chunks, num_frames
+                         PROF_ONLY(, prof_filt, prof_stat));
+#ifdef V3_PYRAMID
+   decimate_wide(stream_stat, stream_res, stream_half, stream_quarter, height, stride_chunks, num_frames);
+   write_result_wide(stream_res, C, height, stride_chunks, num_frames, full_region(height, stride_chunks)
+                     PROF_ONLY(, prof_stat, prof) COMPRESS_ONLY(, comp_index));
+#else
+   write_result_wide(stream_stat, C, height, stride_chunks, num_frames, full_region(height, stride_chunks)
+                     PROF_ONLY(, prof_stat, prof) COMPRESS_ONLY(, comp_index));
+#endif
+#else
+#ifdef V3_PYRAMID
+   decimate_wide(stream_filt, stream_res, stream_half, stream_quarter, height, stride_chunks, num_frames);
+   write_result_wide(stream_res, C, height, stride_chunks, num_frames, full_region(height, stride_chunks)
+                     PROF_ONLY(, prof_filt, prof) COMPRESS_ONLY(, comp_index));
+#else
+   write_result_wide(stream_filt, C, height, stride_chunks, num_frames, full_region(height, stride_chunks)
+                     PROF_ONLY(, prof_filt, prof) COMPRESS_ONLY(, comp_index));
+#endif
+#endif
+#ifdef V3_PYRAMID
+   write_level_wide(stream_half, pyr_half, 1, height, stride_chunks, num_frames);
+   write_level_wide(stream_quarter, pyr_quarter, 2, height, stride_chunks, num_frames);
+#endif
+#endif // V3_ROI
 }
 
 } // extern "C"
+#endif // V3_STAGES_ONLY
@@ -0,0 +1,157 @@
+/**
+* @file accelerated_v4.cpp
+* @brief V4 - free-running AXI4-Stream variant of V3 (no DDR hop).
+*
+* Optimization Strategy: same 64 pixels/cycle pipeline as V3 (or V3_LANES), fed and
+* drained by AXI4-Stream instead of m_axi, so it can sit directly behind a
+* camera/Ethernet IP or another kernel (sc= connectivity) and skip the
+* off-chip round trip entirely.
+*
+* Architecture:
+* - A, B and C are hls::stream<axis512_t>: one 512-bit chunk per beat, frames
+*   in raster order at stride_chunks = ceil(width / V3_PIXELS_PER_CHUNK)
+*   chunks per row (the V3 pixel format), with
+*   TLAST set on the last chunk of every output frame. Input TLAST is not
+*   needed; the kernel counts height * stride_chunks beats per frame.
+* - ap_ctrl_none: the kernel restarts by itself after every frame. The
+*   geometry, sharpen and posterize registers stay on s_axilite and are
+*   sampled at the start of each frame.
+* - Stage 2 is V3's apply_filter_wide, unchanged (this file includes
+*   accelerated_v3.cpp with -DV3_STAGES_ONLY). A streamed frame arrives in
+*   raster order, which is strip order only for a single strip, so width is
+*   limited to V4_MAX_WIDTH (STRIP_MAX_CHUNKS chunks).
+* - The change map, post_tap, stats and prof outputs are memory-mapped and
+*   have no place in a stream-only kernel; they are left out.
+*/
+
+#define V3_STAGES_ONLY
+#include "accelerated_v3.cpp"
+
+#ifdef V3_PROFILE
+#error "V4 has no profiling port: build it without -DV3_PROFILE"
+#endif
+
+// --------------------------------------------------------------------------
+// Stage 1: Difference & Posterization from two input streams
+// --------------------------------------------------------------------------
+// Same per-chunk datapath as compute_diff_wide, but beats arrive in order
+// so no address generation is needed. LANES < fmt::LANES folds each beat
+// over fmt::LANES / LANES cycles, as in compute_diff_wide.
+template <typename PIX, int CH, int LANES = chunk_format<PIX, CH>::LANES>
+static void stream_diff_wide(
+   hls::stream<axis512_t> &A,
+   hls::stream<axis512_t> &B,
+   hls::stream<uint512_t> &out_stream,
+   int frame_chunks,
+   int post_thr03,
+   int post_thr46,
+   int post_levels)
+{
+   typedef chunk_format<PIX, CH> fmt;
+   const int FOLD = fmt::LANES / LANES;
+   const posterize_params_t post_params = unpack_posterize_params(post_thr03, post_thr46, post_levels);
+   uint512_t valA, valB, valC;
+   int step = 0; // Lane group of the current beat (0 .. FOLD - 1)
+
+Loop_Diff_Stream:
+   for (int i = 0; i < frame_chunks * FOLD; i++)
+   {
+#pragma HLS PIPELINE II = 1
+#pragma HLS LOOP_TRIPCOUNT min = TOTAL_CHUNKS * V3_FOLD max = TOTAL_CHUNKS * V3_FOLD
+      if (step == 0)
+      {
+          valA = A.read().data;
+          valB = B.read().data;
+          valC = 0; // Padding bits above the last lane
+      }
+   Process_64_Pixels:
+      for (int g = 0; g < LANES; g++)
+      {
+#pragma HLS UNROLL
+          for (int ch = 0; ch < CH; ch++)
+          {
+#pragma HLS UNROLL
+              diff_posterize_sample<fmt>(valA, valB, valC, step * LANES + g, ch, post_params);
+          }
+      }
+      if (step < FOLD - 1)
+      {
+          step++;
+          continue;
+      }
+      step = 0;
+      out_stream.write(valC);
+   }
+}
+
+// --------------------------------------------------------------------------
+// Stage 3: Output stream with TLAST at the end of the frame
+// --------------------------------------------------------------------------
+static void stream_out_wide(
+   hls::stream<uint512_t> &in_stream,
+   hls::stream<axis512_t> &C,
+   int frame_chunks)
+{
+Loop_Out_Stream:
+   for (int i = 0; i < frame_chunks; i++)
+   {
+#pragma HLS PIPELINE II = 1
+#pragma HLS LOOP_TRIPCOUNT min = TOTAL_CHUNKS max = TOTAL_CHUNKS
+      axis512_t beat;
+      beat.data = in_stream.read();
+      beat.keep = -1; // Row padding is part of the frame (always 0)
+      beat.strb = -1;
+      beat.last = (i == frame_chunks - 1);
+      C.write(beat);
+   }
+}
+
+extern "C" {
+
+// --------------------------------------------------------------------------
+// Top Level
+// --------------------------------------------------------------------------
+// A, B: input frame pairs, height * ceil(width / 64) beats each
+// C: result frames, TLAST on each frame's last beat
+// height/width: logical frame size in pixels (width <= V4_MAX_WIDTH)
+// coef_r0..r2, coef_shift, border_mode, post_thr03, post_thr46, post_levels:
+//               as for IMAGE_DIFF_POSTERIZE
+void IMAGE_DIFF_STREAM(hls::stream<axis512_t> &A, hls::stream<axis512_t> &B, hls::stream<axis512_t> &C,
+                       int height, int width,
+                       int coef_r0, int coef_r1, int coef_r2, int coef_shift, int border_mode,
+                       int post_thr03, int post_thr46, int post_levels)
+{
+#pragma HLS INTERFACE axis port = A
+#pragma HLS INTERFACE axis port = B
+#pragma HLS INTERFACE axis port = C
+#pragma HLS INTERFACE s_axilite port = height bundle = control
+#pragma HLS INTERFACE s_axilite port = width bundle = control
+#pragma HLS INTERFACE s_axilite port = coef_r0 bundle = control
+#pragma HLS INTERFACE s_axilite port = coef_r1 bundle = control
+#pragma HLS INTERFACE s_axilite port = coef_r2 bundle = control
+#pragma HLS INTERFACE s_axilite port = coef_shift bundle = control
+#pragma HLS INTERFACE s_axilite port = border_mode bundle = control
+#pragma HLS INTERFACE s_axilite port = post_thr03 bundle = control
+#pragma HLS INTERFACE s_axilite port = post_thr46 bundle = control
+#pragma HLS INTERFACE s_axilite port = post_levels bundle = control
+#pragma HLS INTERFACE ap_ctrl_none port = return
+
+    const int stride_chunks = (width + V3_PIXELS_PER_CHUNK - 1) / V3_PIXELS_PER_CHUNK;
+    const int frame_chunks  = height * stride_chunks;
+
+    hls::stream<uint512_t> stream_post("s_post");
+    hls::stream<uint512_t> stream_filt("s_filt");
+
+#pragma HLS STREAM variable = stream_post depth = 16
+#pragma HLS STREAM variable = stream_filt depth = 16
+
+#pragma HLS DATAFLOW
+
+   stream_diff_wide<v3_channel_t, V3_CHANNELS, V3_LANES>(A, B, stream_post, frame_chunks, post_thr03, post_thr46, post_levels);
+   apply_filter_wide<v3_channel_t, V3_CHANNELS, V3_LANES>(stream_post, stream_filt, height, width, stride_chunks, 1,
+                                                coef_r0, coef_r1, coef_r2, coef_shift, border_mode,
+                                                full_region(height, stride_chunks));
+   stream_out_wide(stream_filt, C, frame_chunks);
+}
+
+} // extern "C"
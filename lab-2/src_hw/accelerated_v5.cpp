@@ -0,0 +1,176 @@
+/**
+* @file accelerated_v5.cpp
+* @brief V5 - V3 split into a diff kernel and a sharpen kernel joined by AXI4-Stream.
+*
+* Optimization Strategy: scale the stages independently. IMAGE_DIFF_SPLIT
+* (stage 1) and IMAGE_SHARPEN_SPLIT (stages 2-3) are separate kernels whose
+* 512-bit stream is connected kernel-to-kernel (sc= in split_k2k.cfg), so a
+* link can pair one diff CU with several sharpen CUs.
+*
+* Architecture:
+* - Both kernels reuse V3's stages unchanged (this file includes
+*   accelerated_v3.cpp with -DV3_STAGES_ONLY): compute_diff_wide in the
+*   diff kernel, apply_filter_wide and write_result_wide in the sharpen kernel.
+* - The stream carries compute_diff_wide's output as-is: strip-major, halo
+*   chunks included, num_frames * height rows per strip. Both kernels derive
+*   the beat count from the same geometry arguments, so no side band is needed.
+* - IMAGE_DIFF_SPLIT has two output streams and writes each invocation to
+*   out_sel's; the host alternates out_sel per invocation so one diff CU keeps
+*   two sharpen CUs busy on alternating frames.
+* - The change map stays with the diff kernel. The V3_POST_TAP / V3_STATS /
+*   V3_PROFILE / V3_ROI extras are single-kernel features and are not supported here.
+*/
+
+#define V3_STAGES_ONLY
+#include "accelerated_v3.cpp"
+
+#if defined(V3_POST_TAP) || defined(V3_STATS) || defined(V3_PROFILE) || defined(V3_ROI) || defined(V3_COMPRESS) \
+    || defined(V3_MORPH) || defined(V3_BLOBS) || defined(V3_PYRAMID)
+#error "V5 builds without -DV3_POST_TAP, -DV3_STATS, -DV3_PROFILE, -DV3_ROI, -DV3_COMPRESS, -DV3_MORPH, -DV3_BLOBS and -DV3_PYRAMID"
+#endif
+
+// Beats compute_diff_wide emits for a batch (every strip including its halo)
+static int split_stream_chunks(int stride_chunks, int total_rows)
+{
+   int chunks = 0;
+Loop_Count_Strips:
+   for (int c0 = 0; c0 < stride_chunks; c0 += STRIP_MAX_CHUNKS)
+   {
+#pragma HLS LOOP_TRIPCOUNT min = 1 max = MAX_STRIPS
+      int strip_lo, strip_end, strip_hi;
+      strip_bounds(c0, stride_chunks, stride_chunks, strip_lo, strip_end, strip_hi);
+      chunks += total_rows * (strip_hi - strip_lo);
+   }
+   return chunks;
+}
+
+// --------------------------------------------------------------------------
+// Diff kernel, stage 2: route the posterized chunks to the selected output
+// --------------------------------------------------------------------------
+static void route_to_axis(
+   hls::stream<uint512_t> &in_stream,
+   hls::stream<axis512_t> &out0,
+   hls::stream<axis512_t> &out1,
+   int out_sel,
+   int chunks)
+{
+Loop_Route:
+   for (int i = 0; i < chunks; i++)
+   {
+#pragma HLS PIPELINE II = 1
+#pragma HLS LOOP_TRIPCOUNT min = TOTAL_CHUNKS max = MAX_TOTAL_CHUNKS
+      axis512_t beat;
+      beat.data = in_stream.read();
+      beat.keep = -1;
+      beat.strb = -1;
+      beat.last = (i == chunks - 1);
+      if (out_sel == 0)
+          out0.write(beat);
+      else
+          out1.write(beat);
+   }
+}
+
+// --------------------------------------------------------------------------
+// Sharpen kernel, stage 1: unwrap the incoming beats
+// --------------------------------------------------------------------------
+static void read_from_axis(
+   hls::stream<axis512_t> &in,
+   hls::stream<uint512_t> &out_stream,
+   int chunks)
+{
+Loop_Unwrap:
+   for (int i = 0; i < chunks; i++)
+   {
+#pragma HLS PIPELINE II = 1
+#pragma HLS LOOP_TRIPCOUNT min = TOTAL_CHUNKS max = MAX_TOTAL_CHUNKS
+      out_stream.write(in.read().data);
+   }
+}
+
+extern "C" {
+
+// --------------------------------------------------------------------------
+// Top Level: diff + posterize
+// --------------------------------------------------------------------------
+// A, B, height, stride_chunks, num_frames, post_*, change_map: as for
+//               IMAGE_DIFF_POSTERIZE
+// out0, out1: posterized chunks for the sharpen CU on that port
+// out_sel: output (0 or 1) this invocation's batch is sent to
+void IMAGE_DIFF_SPLIT(const uint512_t *A, const uint512_t *B,
+                      hls::stream<axis512_t> &out0, hls::stream<axis512_t> &out1,
+                      int height, int stride_chunks, int num_frames,
+                      int post_thr03, int post_thr46, int post_levels,
+                      uint64_t *change_map, int out_sel)
+{
+#pragma HLS INTERFACE m_axi port = A offset = slave bundle = gmemA depth = TOTAL_CHUNKS
+#pragma HLS INTERFACE m_axi port = B offset = slave bundle = gmemB depth = TOTAL_CHUNKS
+#pragma HLS INTERFACE axis port = out0
+#pragma HLS INTERFACE axis port = out1
+#pragma HLS INTERFACE s_axilite port = A bundle = control
+#pragma HLS INTERFACE s_axilite port = B bundle = control
+#pragma HLS INTERFACE s_axilite port = height bundle = control
+#pragma HLS INTERFACE s_axilite port = stride_chunks bundle = control
+#pragma HLS INTERFACE s_axilite port = num_frames bundle = control
+#pragma HLS INTERFACE s_axilite port = post_thr03 bundle = control
+#pragma HLS INTERFACE s_axilite port = post_thr46 bundle = control
+#pragma HLS INTERFACE s_axilite port = post_levels bundle = control
+#pragma HLS INTERFACE m_axi port = change_map offset = slave bundle = gmemM depth = CHANGE_MAP_DEFAULT_WORDS
+#pragma HLS INTERFACE s_axilite port = change_map bundle = control
+#pragma HLS INTERFACE s_axilite port = out_sel bundle = control
+#pragma HLS INTERFACE s_axilite port = return bundle = control
+
+    const int chunks = split_stream_chunks(stride_chunks, num_frames * height);
+
+    hls::stream<uint512_t> stream_post("s_post");
+#pragma HLS STREAM variable = stream_post depth = 16
+
+#pragma HLS DATAFLOW
+
+   compute_diff_wide<v3_channel_t, V3_CHANNELS, V3_LANES>(A, B, stream_post, change_map, height, stride_chunks, num_frames,
+                                                post_thr03, post_thr46, post_levels,
+                                                full_region(height, stride_chunks));
+   route_to_axis(stream_post, out0, out1, out_sel, chunks);
+}
+
+// --------------------------------------------------------------------------
+// Top Level: sharpen + write
+// --------------------------------------------------------------------------
+// in: the diff CU's stream for this batch
+// C, height, width, stride_chunks, num_frames, coef_*, border_mode: as for
+//               IMAGE_DIFF_POSTERIZE (geometry must match the diff invocation)
+void IMAGE_SHARPEN_SPLIT(hls::stream<axis512_t> &in, uint512_t *C,
+                         int height, int width, int stride_chunks, int num_frames,
+                         int coef_r0, int coef_r1, int coef_r2, int coef_shift, int border_mode)
+{
+#pragma HLS INTERFACE axis port = in
+#pragma HLS INTERFACE m_axi port = C offset = slave bundle = gmemC depth = TOTAL_CHUNKS
+#pragma HLS INTERFACE s_axilite port = C bundle = control
+#pragma HLS INTERFACE s_axilite port = height bundle = control
+#pragma HLS INTERFACE s_axilite port = width bundle = control
+#pragma HLS INTERFACE s_axilite port = stride_chunks bundle = control
+#pragma HLS INTERFACE s_axilite port = num_frames bundle = control
+#pragma HLS INTERFACE s_axilite port = coef_r0 bundle = control
+#pragma HLS INTERFACE s_axilite port = coef_r1 bundle = control
+#pragma HLS INTERFACE s_axilite port = coef_r2 bundle = control
+#pragma HLS INTERFACE s_axilite port = coef_shift bundle = control
+#pragma HLS INTERFACE s_axilite port = border_mode bundle = control
+#pragma HLS INTERFACE s_axilite port = return bundle = control
+
+    const int chunks = split_stream_chunks(stride_chunks, num_frames * height);
+
+    hls::stream<uint512_t> stream_post("s_post");
+    hls::stream<uint512_t> stream_filt("s_filt");
+#pragma HLS STREAM variable = stream_post depth = 16
+#pragma HLS STREAM variable = stream_filt depth = 16
+
+#pragma HLS DATAFLOW
+
+   read_from_axis(in, stream_post, chunks);
+   apply_filter_wide<v3_channel_t, V3_CHANNELS, V3_LANES>(stream_post, stream_filt, height, width, stride_chunks, num_frames,
+                                                coef_r0, coef_r1, coef_r2, coef_shift, border_mode,
+                                                full_region(height, stride_chunks));
+   write_result_wide(stream_filt, C, height, stride_chunks, num_frames, full_region(height, stride_chunks));
+}
+
+} // extern "C"
@@ -0,0 +1,511 @@
+/**
+ * @file broker.cpp
+ * @brief AcceleratorBroker dispatch loop and the BrokerClient side of the rings
+ *
+ * The broker is a single thread polling shared-memory atomics: attach and
+ * detach requests in the client table, SUBMITTED slots in each ring and
+ * event status on the card. Nothing blocks on a client, so a stalled or
+ * dead process only ever costs its own share.
+ */
+
+#include "broker.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+#define BROKER_IDLE_US 100   // Dispatcher sleep when a pass found no work
+
+static size_t round_page(size_t bytes)
+{
+    return (bytes + BROKER_PAGE - 1) / BROKER_PAGE * BROKER_PAGE;
+}
+
+static size_t ring_bytes(const BrokerControl *ctl)
+{
+    return BROKER_PAGE + 3 * (size_t)BROKER_SLOTS * ctl->frame_bytes;
+}
+
+static std::string ring_name(const std::string &name, int index)
+{
+    return "/" + name + "." + std::to_string(index);
+}
+
+// fd's mapping, or nullptr; the fd is closed either way
+static void *map_shm(int fd, size_t bytes)
+{
+    void *p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    return (p == MAP_FAILED) ? nullptr : p;
+}
+
+static bool pid_gone(int pid)
+{
+    return kill(pid, 0) != 0 && errno == ESRCH;
+}
+
+// =============================================================================
+// AcceleratorBroker
+// =============================================================================
+std::unique_ptr<AcceleratorBroker> AcceleratorBroker::create(const std::string &xclbin, const std::string &name,
+                                                             int height, int width, const PipelineConfig &cfg,
+                                                             int max_in_flight)
+{
+    if (height < 3 || width < 3 || width > MAX_WIDTH || max_in_flight < 1)
+    {
+        std::cout << "AcceleratorBroker: invalid geometry " << width << " x " << height << " or in-flight limit "
+                  << max_in_flight << std::endl;
+        return nullptr;
+    }
+
+    std::unique_ptr<AcceleratorBroker> b(new AcceleratorBroker);
+    b->name_ = name;
+    b->height_ = height;
+    b->width_ = width;
+    b->stride_chunks_ = (width + PIXELS_PER_CHUNK - 1) / PIXELS_PER_CHUNK;
+    b->max_in_flight_ = max_in_flight;
+    b->cfg_ = cfg;
+    b->served_.assign(BROKER_MAX_CLIENTS, 0);
+
+    std::vector<xcl::ProgrammedDevice> devs =
+        xcl::program_devices(xcl::get_xil_devices(), xcl::read_binary_file(xclbin));
+    if (devs.empty())
+    {
+        std::cout << "AcceleratorBroker: failed to program any device with " << xclbin << std::endl;
+        return nullptr;
+    }
+    b->dev_ = devs[0];
+
+    cl_int err;
+    cl::Kernel probe(b->dev_.program, "IMAGE_DIFF_POSTERIZE", &err);
+    if (err != CL_SUCCESS || kernel_arg_index(probe, "rois") >= 0 || kernel_arg_index(probe, "comp_index") >= 0)
+    {
+        std::cout << "AcceleratorBroker: the xclbin has no full-frame IMAGE_DIFF_POSTERIZE kernel" << std::endl;
+        return nullptr;
+    }
+    OCL_CHECK(err, b->q_ = cl::CommandQueue(b->dev_.context, b->dev_.device,
+                                            CL_QUEUE_PROFILING_ENABLE | CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE,
+                                            &err));
+    const uint64_t props = query_kernel_props(b->dev_.context, b->q_, probe);
+    const int max_width = kernel_max_width(props);
+    if (width > max_width)
+    {
+        std::cout << "AcceleratorBroker: the xclbin takes frames up to " << max_width << " px wide" << std::endl;
+        return nullptr;
+    }
+    if (!kernel_takes_taps(props, cfg))
+    {
+        std::cout << "AcceleratorBroker: the xclbin is built with -DSHARPEN_FIXED and ignores the sharpen taps"
+                  << std::endl;
+        return nullptr;
+    }
+    if (!kernel_takes_posterize(props, cfg))
+    {
+        std::cout << "AcceleratorBroker: the xclbin is built with -DPOSTERIZE_FIXED and ignores the posterize table"
+                  << std::endl;
+        return nullptr;
+    }
+
+    // O_EXCL: a second broker under the same name would steal the first one's clients
+    const std::string ctl_name = "/" + name;
+    const int fd = shm_open(ctl_name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0)
+    {
+        std::cout << "AcceleratorBroker: cannot create " << ctl_name << ": " << strerror(errno)
+                  << " (another broker, or a stale /dev/shm" << ctl_name << ")" << std::endl;
+        return nullptr;
+    }
+    b->ctl_bytes_ = round_page(sizeof(BrokerControl));
+    if (ftruncate(fd, b->ctl_bytes_) != 0)
+    {
+        close(fd);
+        shm_unlink(ctl_name.c_str());
+        std::cout << "AcceleratorBroker: cannot size " << ctl_name << std::endl;
+        return nullptr;
+    }
+    b->ctl_ = (BrokerControl *)map_shm(fd, b->ctl_bytes_);
+    if (!b->ctl_)
+    {
+        shm_unlink(ctl_name.c_str());
+        std::cout << "AcceleratorBroker: cannot map " << ctl_name << std::endl;
+        return nullptr;
+    }
+
+    // Fresh pages are zero: every entry FREE, up = 0 until the geometry is written
+    b->ctl_->height = height;
+    b->ctl_->width = width;
+    b->ctl_->padded_width = b->stride_chunks_ * PIXELS_PER_CHUNK;
+    b->ctl_->frame_bytes = round_page((size_t)height * b->ctl_->padded_width);
+    b->ctl_->broker_pid = getpid();
+    b->ctl_->magic = BROKER_MAGIC;
+    b->ctl_->up.store(1, std::memory_order_release);
+    return b;
+}
+
+AcceleratorBroker::~AcceleratorBroker()
+{
+    if (!ctl_)
+        return;
+    ctl_->up.store(0, std::memory_order_release);
+    for (int i = 0; i < BROKER_MAX_CLIENTS; i++)
+        if (clients_[i].ring)
+            release(i);
+    munmap(ctl_, ctl_bytes_);
+    shm_unlink(("/" + name_).c_str());
+}
+
+// Map entry index's ring and give every slot buffers over its A/B/C and a bound kernel
+bool AcceleratorBroker::attach(int index)
+{
+    Client &c = clients_[index];
+    const std::string rname = ring_name(name_, index);
+    const size_t bytes = ring_bytes(ctl_);
+    const int fd = shm_open(rname.c_str(), O_RDWR, 0600);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 || (size_t)st.st_size != bytes)
+    {
+        if (fd >= 0)
+            close(fd);
+        std::cout << "AcceleratorBroker: client " << index << " has no usable ring " << rname << std::endl;
+        return false;
+    }
+    c.ring = (BrokerRing *)map_shm(fd, bytes);
+    if (!c.ring)
+        return false;
+    c.bytes = bytes;
+    c.next = 0;
+
+    cl_int err;
+    const size_t frame_bytes = (size_t)height_ * ctl_->padded_width; // The page padding stays off the card
+    const size_t tap_words     = (size_t)POST_TAP_WORDS(height_, stride_chunks_, 1) * (DATA_WIDTH_BITS / 64);
+    const size_t half_words    = (size_t)std::max(PYR_WORDS(height_, stride_chunks_, 1, 1), 1) * (DATA_WIDTH_BITS / 64);
+    const size_t quarter_words = (size_t)std::max(PYR_WORDS(height_, stride_chunks_, 1, 2), 1) * (DATA_WIDTH_BITS / 64);
+    c.slots.resize(BROKER_SLOTS);
+    for (int s = 0; s < BROKER_SLOTS; s++)
+    {
+        Slot &sl = c.slots[s];
+        uint8_t *base = (uint8_t *)c.ring + BROKER_PAGE + 3 * (size_t)s * ctl_->frame_bytes;
+        sl.M.assign(CHANGE_MAP_WORDS(height_, stride_chunks_, 1), 0);
+        OCL_CHECK(err, sl.buf_A = cl::Buffer(dev_.context, CL_MEM_USE_HOST_PTR | CL_MEM_READ_ONLY, frame_bytes,
+                                             base, &err));
+        OCL_CHECK(err, sl.buf_B = cl::Buffer(dev_.context, CL_MEM_USE_HOST_PTR | CL_MEM_READ_ONLY, frame_bytes,
+                                             base + ctl_->frame_bytes, &err));
+        OCL_CHECK(err, sl.buf_C = cl::Buffer(dev_.context, CL_MEM_USE_HOST_PTR | CL_MEM_WRITE_ONLY, frame_bytes,
+                                             base + 2 * ctl_->frame_bytes, &err));
+        OCL_CHECK(err, sl.buf_M = cl::Buffer(dev_.context, CL_MEM_USE_HOST_PTR | CL_MEM_WRITE_ONLY,
+                                             sl.M.size() * sizeof(uint64_t), sl.M.data(), &err));
+
+        OCL_CHECK(err, sl.krnl = cl::Kernel(dev_.program, "IMAGE_DIFF_POSTERIZE", &err));
+        OCL_CHECK(err, err = sl.krnl.setArg(0, sl.buf_A));
+        OCL_CHECK(err, err = sl.krnl.setArg(1, sl.buf_B));
+        OCL_CHECK(err, err = sl.krnl.setArg(2, sl.buf_C));
+        OCL_CHECK(err, err = sl.krnl.setArg(3, height_));
+        OCL_CHECK(err, err = sl.krnl.setArg(4, width_));
+        OCL_CHECK(err, err = sl.krnl.setArg(5, stride_chunks_));
+        OCL_CHECK(err, err = sl.krnl.setArg(6, 1));
+        set_pipeline_args(sl.krnl, cfg_);
+        OCL_CHECK(err, err = sl.krnl.setArg(CHANGE_MAP_ARG_INDEX, sl.buf_M));
+        bind_optional_arg(dev_.context, sl.krnl, "post_tap", tap_words, sl.T, sl.buf_T);
+        bind_optional_arg(dev_.context, sl.krnl, "stats", STATS_NUM_WORDS, sl.S, sl.buf_S);
+        bind_optional_arg(dev_.context, sl.krnl, "prof", PROF_NUM_COUNTERS, sl.P, sl.buf_P);
+        bind_optional_arg(dev_.context, sl.krnl, "blobs", BLOB_WORDS(1), sl.L, sl.buf_L);
+        bind_optional_arg(dev_.context, sl.krnl, "pyr_half", half_words, sl.H, sl.buf_H);
+        bind_optional_arg(dev_.context, sl.krnl, "pyr_quarter", quarter_words, sl.Q, sl.buf_Q);
+        sl.busy = false;
+    }
+    return true;
+}
+
+// Drain index's frames on the card, drop its buffers and free the table entry
+void AcceleratorBroker::release(int index)
+{
+    Client &c = clients_[index];
+    for (Slot &sl : c.slots)
+        if (sl.busy)
+        {
+            sl.done.wait();
+            sl.busy = false;
+            in_flight_--;
+        }
+    c.slots.clear();
+    if (c.ring)
+        munmap(c.ring, c.bytes);
+    c.ring = nullptr;
+    ctl_->clients[index].state.store(BROKER_ENTRY_FREE, std::memory_order_release);
+}
+
+// A dead client cannot unlink its own ring, so the broker does
+bool AcceleratorBroker::client_gone(int index)
+{
+    if (!pid_gone(ctl_->clients[index].pid))
+        return false;
+    shm_unlink(ring_name(name_, index).c_str());
+    return true;
+}
+
+// Mark every finished frame DONE; returns how many
+int AcceleratorBroker::retire()
+{
+    int n = 0;
+    for (int i = 0; i < BROKER_MAX_CLIENTS; i++)
+    {
+        Client &c = clients_[i];
+        for (int s = 0; s < (int)c.slots.size(); s++)
+        {
+            Slot &sl = c.slots[s];
+            if (!sl.busy || sl.done.getInfo<CL_EVENT_COMMAND_EXECUTION_STATUS>() != CL_COMPLETE)
+                continue;
+            sl.busy = false;
+            in_flight_--;
+            served_[i]++;
+            c.ring->changed[s].store(sl.M.back() != 0, std::memory_order_relaxed);
+            c.ring->state[s].store(BROKER_SLOT_DONE, std::memory_order_release);
+            n++;
+        }
+    }
+    return n;
+}
+
+// Round-robin over attached clients from next_client_, at most one frame
+// each per pass, until max_new frames are queued or nobody has work
+int AcceleratorBroker::dispatch(int max_new)
+{
+    cl_int err;
+    int n = 0;
+    bool progress = true;
+    while (n < max_new && progress)
+    {
+        progress = false;
+        for (int k = 0; k < BROKER_MAX_CLIENTS && n < max_new; k++)
+        {
+            const int i = (next_client_ + k) % BROKER_MAX_CLIENTS;
+            Client &c = clients_[i];
+            if (!c.ring)
+                continue;
+            for (int j = 0; j < BROKER_SLOTS; j++)
+            {
+                const int s = (c.next + j) % BROKER_SLOTS;
+                if (c.ring->state[s].load(std::memory_order_acquire) != BROKER_SLOT_SUBMITTED)
+                    continue;
+                Slot &sl = c.slots[s];
+                c.ring->state[s].store(BROKER_SLOT_RUNNING, std::memory_order_relaxed);
+                cl::Event ev_in, ev_run;
+                std::vector<cl::Event> wait_in, wait_run;
+                OCL_CHECK(err, err = q_.enqueueMigrateMemObjects({sl.buf_A, sl.buf_B}, 0, nullptr, &ev_in));
+                wait_in.push_back(ev_in);
+                OCL_CHECK(err, err = q_.enqueueTask(sl.krnl, &wait_in, &ev_run));
+                wait_run.push_back(ev_run);
+                OCL_CHECK(err, err = q_.enqueueMigrateMemObjects({sl.buf_C, sl.buf_M}, CL_MIGRATE_MEM_OBJECT_HOST,
+                                                                 &wait_run, &sl.done));
+                sl.busy = true;
+                in_flight_++;
+                c.next = (s + 1) % BROKER_SLOTS;
+                n++;
+                progress = true;
+                break;
+            }
+        }
+    }
+    if (n)
+    {
+        q_.flush();
+        next_client_ = (next_client_ + 1) % BROKER_MAX_CLIENTS;
+    }
+    return n;
+}
+
+void AcceleratorBroker::run(const std::atomic<bool> &stop)
+{
+    while (!stop.load(std::memory_order_relaxed))
+    {
+        int work = 0;
+        for (int i = 0; i < BROKER_MAX_CLIENTS; i++)
+        {
+            BrokerControl::Entry &e = ctl_->clients[i];
+            const uint32_t state = e.state.load(std::memory_order_acquire);
+            if (state == BROKER_ENTRY_ATTACH)
+            {
+                if (attach(i))
+                {
+                    std::cout << "Broker: client " << i << " (pid " << e.pid << ") attached" << std::endl;
+                    e.state.store(BROKER_ENTRY_ATTACHED, std::memory_order_release);
+                }
+                else
+                    e.state.store(BROKER_ENTRY_FREE, std::memory_order_release);
+                work++;
+            }
+            else if (state == BROKER_ENTRY_DETACH || (state == BROKER_ENTRY_ATTACHED && client_gone(i)))
+            {
+                std::cout << "Broker: client " << i << " (pid " << e.pid << ") "
+                          << (state == BROKER_ENTRY_DETACH ? "detached" : "died") << " after " << served_[i]
+                          << " frames" << std::endl;
+                release(i);
+                work++;
+            }
+            else if (state == BROKER_ENTRY_CLAIMED && client_gone(i))
+                e.state.store(BROKER_ENTRY_FREE, std::memory_order_release);
+        }
+        work += retire();
+        work += dispatch(max_in_flight_ - in_flight_);
+        if (!work)
+            std::this_thread::sleep_for(std::chrono::microseconds(BROKER_IDLE_US));
+    }
+    q_.finish();
+    retire();
+}
+
+// =============================================================================
+// BrokerClient
+// =============================================================================
+bool BrokerClient::broker_alive() const
+{
+    return ctl_->up.load(std::memory_order_acquire) && !pid_gone(ctl_->broker_pid);
+}
+
+bool BrokerClient::connect(const std::string &name, int timeout_ms)
+{
+    disconnect();
+    name_ = name;
+    const std::string ctl_name = "/" + name;
+    const size_t ctl_bytes = round_page(sizeof(BrokerControl));
+    const int fd = shm_open(ctl_name.c_str(), O_RDWR, 0600);
+    if (fd < 0)
+    {
+        error_ = "no broker at " + ctl_name;
+        return false;
+    }
+    ctl_ = (BrokerControl *)map_shm(fd, ctl_bytes);
+    if (!ctl_ || ctl_->magic != BROKER_MAGIC || !broker_alive())
+    {
+        error_ = "broker at " + ctl_name + " is not running";
+        disconnect();
+        return false;
+    }
+
+    for (int i = 0; i < BROKER_MAX_CLIENTS && index_ < 0; i++)
+    {
+        uint32_t expected = BROKER_ENTRY_FREE;
+        if (ctl_->clients[i].state.compare_exchange_strong(expected, BROKER_ENTRY_CLAIMED))
+            index_ = i;
+    }
+    if (index_ < 0)
+    {
+        error_ = "broker has no free client entry";
+        disconnect();
+        return false;
+    }
+    ctl_->clients[index_].pid = getpid();
+
+    ring_name_ = ring_name(name, index_);
+    ring_bytes_ = ring_bytes(ctl_);
+    const int rfd = shm_open(ring_name_.c_str(), O_CREAT | O_TRUNC | O_RDWR, 0600);
+    if (rfd < 0 || ftruncate(rfd, ring_bytes_) != 0)
+    {
+        if (rfd >= 0)
+            close(rfd);
+        error_ = "cannot create " + ring_name_;
+        disconnect();
+        return false;
+    }
+    ring_ = (BrokerRing *)map_shm(rfd, ring_bytes_);
+    if (!ring_)
+    {
+        error_ = "cannot map " + ring_name_;
+        disconnect();
+        return false;
+    }
+
+    BrokerControl::Entry &e = ctl_->clients[index_];
+    e.state.store(BROKER_ENTRY_ATTACH, std::memory_order_release);
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    for (;;)
+    {
+        const uint32_t state = e.state.load(std::memory_order_acquire);
+        if (state == BROKER_ENTRY_ATTACHED)
+            return true;
+        if (state == BROKER_ENTRY_FREE || !broker_alive() || std::chrono::steady_clock::now() > deadline)
+        {
+            error_ = (state == BROKER_ENTRY_FREE) ? "broker refused the ring" : "broker did not attach the ring";
+            if (state != BROKER_ENTRY_FREE)
+                e.state.store(BROKER_ENTRY_FREE, std::memory_order_release);
+            index_ = -1;
+            disconnect();
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+// Ask the broker to drain and drop the ring before unmapping it, so the
+// card never writes into pages this process no longer owns
+void BrokerClient::disconnect()
+{
+    if (ctl_ && index_ >= 0)
+    {
+        BrokerControl::Entry &e = ctl_->clients[index_];
+        if (e.state.load(std::memory_order_acquire) == BROKER_ENTRY_ATTACHED && broker_alive())
+        {
+            e.state.store(BROKER_ENTRY_DETACH, std::memory_order_release);
+            while (e.state.load(std::memory_order_acquire) != BROKER_ENTRY_FREE && broker_alive())
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        e.state.store(BROKER_ENTRY_FREE, std::memory_order_release);
+    }
+    if (ring_)
+        munmap(ring_, ring_bytes_);
+    if (!ring_name_.empty())
+        shm_unlink(ring_name_.c_str());
+    if (ctl_)
+        munmap(ctl_, round_page(sizeof(BrokerControl)));
+    ring_ = nullptr;
+    ctl_ = nullptr;
+    ring_name_.clear();
+    index_ = -1;
+    std::memset(held_, 0, sizeof(held_));
+}
+
+int BrokerClient::acquire()
+{
+    for (unsigned spin = 0;; spin++)
+    {
+        for (int s = 0; s < BROKER_SLOTS; s++)
+            if (!held_[s] && ring_->state[s].load(std::memory_order_acquire) == BROKER_SLOT_FREE)
+            {
+                held_[s] = true;
+                return s;
+            }
+        if ((spin & 1023) == 1023 && !broker_alive())
+            return -1;
+        std::this_thread::yield();
+    }
+}
+
+void BrokerClient::submit(int slot)
+{
+    ring_->state[slot].store(BROKER_SLOT_SUBMITTED, std::memory_order_release);
+}
+
+bool BrokerClient::wait(int slot)
+{
+    for (unsigned spin = 0; ring_->state[slot].load(std::memory_order_acquire) != BROKER_SLOT_DONE; spin++)
+    {
+        if ((spin & 1023) == 1023 && !broker_alive())
+            return false;
+        std::this_thread::yield();
+    }
+    return true;
+}
+
+void BrokerClient::release(int slot)
+{
+    held_[slot] = false;
+    ring_->state[slot].store(BROKER_SLOT_FREE, std::memory_order_release);
+}
@@ -0,0 +1,190 @@
+/**
+ * @file broker.hpp
+ * @brief Multi-process accelerator broker: one device owner, shared-memory clients
+ *
+ * Only one process can usefully own the card's context, so AcceleratorBroker
+ * programs the device once and serves frames for any number of client
+ * processes (up to BROKER_MAX_CLIENTS). Everything crosses the process
+ * boundary through POSIX shared memory:
+ *
+ *   /<name>          BrokerControl: frame geometry and the client table
+ *   /<name>.<index>  BrokerRing: one client's BROKER_SLOTS frame slots, each
+ *                    a page-aligned A | B | C triple in the padded layout
+ *
+ * A client claims a table entry, creates its ring and asks to attach. The
+ * broker maps the ring and wraps every slot's A/B/C with CL_MEM_USE_HOST_PTR
+ * buffers, bound to that slot's own kernel once. A client writes its frames
+ * straight into slot memory, and the card DMAs from there and writes C back
+ * there: no copies on either side. Slot and entry states are lock-free
+ * atomics in the shared pages.
+ *
+ * The broker's single dispatch thread serves clients round-robin, one frame
+ * per client per turn and at most max_in_flight on the card, so each
+ * active client gets an equal share of frames whatever its queue depth.
+ * A client that detaches or dies (its pid no longer exists) is drained and
+ * its ring released.
+ */
+
+#ifndef BROKER_HPP__
+#define BROKER_HPP__
+
+#include "image_diff_engine.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#define BROKER_MAX_CLIENTS 16
+#define BROKER_SLOTS       4         // Frame slots per client ring
+#define BROKER_MAGIC       0x424B5231u
+#define BROKER_PAGE        4096
+
+// Client table entry states
+enum broker_entry_t
+{
+    BROKER_ENTRY_FREE = 0,
+    BROKER_ENTRY_CLAIMED,    // Client is creating its ring
+    BROKER_ENTRY_ATTACH,     // Ring ready, waiting for the broker
+    BROKER_ENTRY_ATTACHED,
+    BROKER_ENTRY_DETACH      // Client is leaving; the broker drains and frees the entry
+};
+
+// Ring slot states: the client owns FREE and DONE slots, the broker the others
+enum broker_slot_t
+{
+    BROKER_SLOT_FREE = 0,
+    BROKER_SLOT_SUBMITTED,   // A/B written, waiting for the dispatcher
+    BROKER_SLOT_RUNNING,
+    BROKER_SLOT_DONE         // C written
+};
+
+struct BrokerControl
+{
+    uint32_t magic;
+    int32_t height, width, padded_width;
+    uint64_t frame_bytes;                // One page-aligned A, B or C
+    int32_t broker_pid;
+    std::atomic<uint32_t> up;            // Cleared when the broker exits
+    struct Entry
+    {
+        std::atomic<uint32_t> state;     // broker_entry_t
+        int32_t pid;
+    } clients[BROKER_MAX_CLIENTS];
+};
+
+// Header page of a client ring; slot s starts BROKER_PAGE + 3 * s * frame_bytes in
+struct BrokerRing
+{
+    std::atomic<uint32_t> state[BROKER_SLOTS];     // broker_slot_t
+    std::atomic<uint32_t> changed[BROKER_SLOTS];   // Change map any-change flag of the result
+};
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "broker atomics must work across processes");
+
+class AcceleratorBroker
+{
+public:
+    // Program the first card that takes xclbin and create /<name> for
+    // height x width frames. nullptr (with a message) on failure; the xclbin
+    // must have a full-frame IMAGE_DIFF_POSTERIZE, as for ImageDiffEngine.
+    static std::unique_ptr<AcceleratorBroker> create(const std::string &xclbin, const std::string &name,
+                                                     int height, int width, const PipelineConfig &cfg,
+                                                     int max_in_flight);
+
+    // Unmaps every ring and removes the shared-memory objects
+    ~AcceleratorBroker();
+
+    AcceleratorBroker(const AcceleratorBroker &) = delete;
+    AcceleratorBroker &operator=(const AcceleratorBroker &) = delete;
+
+    // Attach, dispatch and retire until stop is set, then drain
+    void run(const std::atomic<bool> &stop);
+
+    // Frames served per table entry since start
+    const std::vector<uint64_t> &served() const { return served_; }
+
+private:
+    struct Slot
+    {
+        cl::Buffer buf_A, buf_B, buf_C, buf_M, buf_P, buf_S, buf_T, buf_L, buf_H, buf_Q;
+        change_map_vec M;
+        counter_vec P, S, T, L, H, Q;   // Optional-argument buffers, never read back
+        cl::Kernel krnl;
+        cl::Event done;
+        bool busy = false;
+    };
+    struct Client
+    {
+        BrokerRing *ring = nullptr;
+        size_t bytes = 0;
+        int next = 0;       // Slot the dispatcher looks at first, so a client's frames run in ring order
+        std::vector<Slot> slots;
+    };
+
+    AcceleratorBroker() = default;
+    bool attach(int index);
+    void release(int index);
+    bool client_gone(int index);
+    int retire();
+    int dispatch(int max_new);
+
+    std::string name_;
+    int height_ = 0, width_ = 0, stride_chunks_ = 0, max_in_flight_ = 1, in_flight_ = 0, next_client_ = 0;
+    PipelineConfig cfg_;
+    xcl::ProgrammedDevice dev_;
+    cl::CommandQueue q_;
+    BrokerControl *ctl_ = nullptr;
+    size_t ctl_bytes_ = 0;
+    Client clients_[BROKER_MAX_CLIENTS];
+    std::vector<uint64_t> served_;
+};
+
+class BrokerClient
+{
+public:
+    BrokerClient() = default;
+    ~BrokerClient() { disconnect(); }
+
+    BrokerClient(const BrokerClient &) = delete;
+    BrokerClient &operator=(const BrokerClient &) = delete;
+
+    // Attach to broker /<name>, waiting up to timeout_ms for it to map the
+    // ring. False with error() set if there is no broker or no free entry.
+    bool connect(const std::string &name, int timeout_ms = 5000);
+    void disconnect();
+
+    int height() const { return ctl_->height; }
+    int width() const { return ctl_->width; }
+    int pitch() const { return ctl_->padded_width; }   // Row stride of A/B/C; padding must stay 0
+
+    // A free slot (spins while all BROKER_SLOTS are in flight); -1 if the broker is gone
+    int acquire();
+    uint8_t *A(int slot) { return slot_base(slot); }
+    uint8_t *B(int slot) { return slot_base(slot) + ctl_->frame_bytes; }
+    const uint8_t *C(int slot) { return slot_base(slot) + 2 * ctl_->frame_bytes; }
+
+    // Hand a filled slot to the broker; wait() until its C is written
+    // (false if the broker went away), then release() it for reuse
+    void submit(int slot);
+    bool wait(int slot);
+    bool changed(int slot) const { return ring_->changed[slot].load(std::memory_order_acquire) != 0; }
+    void release(int slot);
+
+    const std::string &error() const { return error_; }
+
+private:
+    uint8_t *slot_base(int slot) { return (uint8_t *)ring_ + BROKER_PAGE + 3 * (size_t)slot * ctl_->frame_bytes; }
+    bool broker_alive() const;
+
+    std::string name_, ring_name_;
+    BrokerControl *ctl_ = nullptr;
+    BrokerRing *ring_ = nullptr;
+    size_t ring_bytes_ = 0;
+    int index_ = -1;
+    bool held_[BROKER_SLOTS] = {};
+    std::string error_;
+};
+
+#endif // BROKER_HPP__
@@ -0,0 +1,603 @@
+/**
+ * @file cpu_engine.cpp
+ * @brief Scalar / AVX2 / AVX-512BW implementations of the CPU pipeline
+ *
+ * The SIMD paths are compiled with per-function target attributes, so the
+ * file builds without -mavx2/-mavx512bw and the choice is made at run time.
+ *
+ * Stage 1 (posterize) works on bytes: |A - B| is max(a,b) - min(a,b), and
+ * the 0/128/255 levels come from two unsigned >= compares.
+ * Stage 2 (sharpen) widens to 16 bits (5 * 255 fits), and packus clips the
+ * result back to [0, 255]. unpack/packus both work per 128-bit lane, so the
+ * pixel order survives the round trip.
+ *
+ * Frames are split into horizontal bands that each posterize their own
+ * 1-row halo, and the bands run on a persistent thread pool.
+ */
+
+#include "cpu_engine.hpp"
+#include "../../inc/image_defines.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CPU_ENGINE_X86 1
+#endif
+
+static cpu_isa_t selected_isa = CPU_ISA_AUTO;
+
+// Sharpen taps; the SIMD paths only implement the default Laplacian
+static int filter_k[3][3] = {{0, -1, 0}, {-1, 5, -1}, {0, -1, 0}};
+static int filter_shift = 0;
+static bool filter_custom = false;
+static bool filter_identity = false; // Bypass taps: the posterized row is the result
+
+// Posterize table as a |A - B| -> level LUT; SIMD paths only do the 3-level default
+static uint8_t posterize_lut[256];
+static bool posterize_custom = false;
+
+// Frame border policy (BORDER_*); only the first/last row and column differ
+static int border_mode = BORDER_DEFAULT;
+
+// Open/close after the sharpen (MORPH_*)
+static int morph_mode = MORPH_DEFAULT;
+
+// =============================================================================
+// Scalar building blocks (also used for row tails)
+// =============================================================================
+static inline uint8_t posterize_px(uint8_t a, uint8_t b)
+{
+    int diff = (int)a - (int)b;
+    if (diff < 0) diff = -diff;
+    return (diff < THRESH_LOW) ? 0 : (diff < THRESH_HIGH) ? 128 : 255;
+}
+
+static inline uint8_t sharpen_px(const uint8_t *n, const uint8_t *p, const uint8_t *s)
+{
+    int16_t val = 5 * p[0] - n[0] - s[0] - p[-1] - p[1];
+    return (uint8_t)((val < 0) ? 0 : (val > 255) ? 255 : val);
+}
+
+static void posterize_row_scalar(const uint8_t *a, const uint8_t *b, uint8_t *out, int from, int to)
+{
+    for (int c = from; c < to; c++)
+        out[c] = posterize_px(a[c], b[c]);
+}
+
+static void posterize_row_lut(const uint8_t *a, const uint8_t *b, uint8_t *out, int width)
+{
+    for (int c = 0; c < width; c++)
+        out[c] = posterize_lut[(a[c] > b[c]) ? a[c] - b[c] : b[c] - a[c]];
+}
+
+// n/p/s: posterized rows above, at and below the output row
+static void sharpen_row_scalar(const uint8_t *n, const uint8_t *p, const uint8_t *s,
+                               uint8_t *out, int from, int to)
+{
+    for (int c = from; c < to; c++)
+        out[c] = sharpen_px(n + c, p + c, s + c);
+}
+
+// Any 3x3: weighted sum, arithmetic >> shift, clip (same as sharpen_3x3)
+static void sharpen_row_generic(const uint8_t *n, const uint8_t *p, const uint8_t *s,
+                                uint8_t *out, int from, int to)
+{
+    const uint8_t *rows[3] = {n, p, s};
+    for (int c = from; c < to; c++)
+    {
+        int val = 0;
+        for (int r = 0; r < 3; r++)
+            val += filter_k[r][0] * rows[r][c - 1] + filter_k[r][1] * rows[r][c] + filter_k[r][2] * rows[r][c + 1];
+        val >>= filter_shift;
+        out[c] = (uint8_t)((val < 0) ? 0 : (val > 255) ? 255 : val);
+    }
+}
+
+// First/last column pixel c under a replicating or mirroring border policy
+// (rows n/s already substituted by the caller); scalar, two per row
+static uint8_t sharpen_edge_px(const uint8_t *n, const uint8_t *p, const uint8_t *s, int c, int width)
+{
+    const bool mirror = (border_mode == BORDER_MIRROR) && width > 1;
+    const uint8_t *rows[3] = {n, p, s};
+    int val = 0;
+    for (int r = 0; r < 3; r++)
+    {
+        const int w = (c > 0) ? rows[r][c - 1] : mirror ? rows[r][c + 1] : rows[r][c];
+        const int e = (c < width - 1) ? rows[r][c + 1] : mirror ? rows[r][c - 1] : rows[r][c];
+        val += filter_k[r][0] * w + filter_k[r][1] * rows[r][c] + filter_k[r][2] * e;
+    }
+    val >>= filter_shift;
+    return (uint8_t)((val < 0) ? 0 : (val > 255) ? 255 : val);
+}
+
+// =============================================================================
+// AVX2: 32 pixels per instruction
+// =============================================================================
+#ifdef CPU_ENGINE_X86
+__attribute__((target("avx2")))
+static int posterize_row_avx2(const uint8_t *a, const uint8_t *b, uint8_t *out, int width)
+{
+    const __m256i lo  = _mm256_set1_epi8((char)THRESH_LOW);
+    const __m256i hi  = _mm256_set1_epi8((char)THRESH_HIGH);
+    const __m256i mid = _mm256_set1_epi8((char)128);
+    int c = 0;
+    for (; c + 32 <= width; c += 32)
+    {
+        __m256i va = _mm256_loadu_si256((const __m256i *)(a + c));
+        __m256i vb = _mm256_loadu_si256((const __m256i *)(b + c));
+        __m256i d  = _mm256_sub_epi8(_mm256_max_epu8(va, vb), _mm256_min_epu8(va, vb));
+        // d >= t  <=>  max(d, t) == d  (unsigned)
+        __m256i ge_lo = _mm256_cmpeq_epi8(_mm256_max_epu8(d, lo), d);
+        __m256i ge_hi = _mm256_cmpeq_epi8(_mm256_max_epu8(d, hi), d);
+        _mm256_storeu_si256((__m256i *)(out + c), _mm256_or_si256(_mm256_and_si256(ge_lo, mid), ge_hi));
+    }
+    return c;
+}
+
+__attribute__((target("avx2")))
+static inline __m256i sharpen16_avx2(__m256i c, __m256i n, __m256i s, __m256i w, __m256i e)
+{
+    __m256i v = _mm256_add_epi16(_mm256_slli_epi16(c, 2), c);
+    v = _mm256_sub_epi16(v, _mm256_add_epi16(n, s));
+    return _mm256_sub_epi16(v, _mm256_add_epi16(w, e));
+}
+
+// Sharpens columns [1, ...) of one row; returns the first column not done
+__attribute__((target("avx2")))
+static int sharpen_row_avx2(const uint8_t *n, const uint8_t *p, const uint8_t *s, uint8_t *out, int width)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    int c = 1;
+    for (; c + 32 <= width - 1; c += 32)
+    {
+        __m256i vc = _mm256_loadu_si256((const __m256i *)(p + c));
+        __m256i vn = _mm256_loadu_si256((const __m256i *)(n + c));
+        __m256i vs = _mm256_loadu_si256((const __m256i *)(s + c));
+        __m256i vw = _mm256_loadu_si256((const __m256i *)(p + c - 1));
+        __m256i ve = _mm256_loadu_si256((const __m256i *)(p + c + 1));
+
+        __m256i r_lo = sharpen16_avx2(_mm256_unpacklo_epi8(vc, zero), _mm256_unpacklo_epi8(vn, zero),
+                                      _mm256_unpacklo_epi8(vs, zero), _mm256_unpacklo_epi8(vw, zero),
+                                      _mm256_unpacklo_epi8(ve, zero));
+        __m256i r_hi = sharpen16_avx2(_mm256_unpackhi_epi8(vc, zero), _mm256_unpackhi_epi8(vn, zero),
+                                      _mm256_unpackhi_epi8(vs, zero), _mm256_unpackhi_epi8(vw, zero),
+                                      _mm256_unpackhi_epi8(ve, zero));
+        _mm256_storeu_si256((__m256i *)(out + c), _mm256_packus_epi16(r_lo, r_hi));
+    }
+    return c;
+}
+
+// =============================================================================
+// AVX-512BW: 64 pixels per instruction (one 512-bit chunk, as on the FPGA)
+// =============================================================================
+__attribute__((target("avx512bw")))
+static int posterize_row_avx512(const uint8_t *a, const uint8_t *b, uint8_t *out, int width)
+{
+    const __m512i lo  = _mm512_set1_epi8((char)THRESH_LOW);
+    const __m512i hi  = _mm512_set1_epi8((char)THRESH_HIGH);
+    const __m512i mid = _mm512_set1_epi8((char)128);
+    const __m512i max = _mm512_set1_epi8((char)255);
+    int c = 0;
+    for (; c + 64 <= width; c += 64)
+    {
+        __m512i va = _mm512_loadu_si512((const void *)(a + c));
+        __m512i vb = _mm512_loadu_si512((const void *)(b + c));
+        __m512i d  = _mm512_sub_epi8(_mm512_max_epu8(va, vb), _mm512_min_epu8(va, vb));
+        __mmask64 ge_lo = _mm512_cmpge_epu8_mask(d, lo);
+        __mmask64 ge_hi = _mm512_cmpge_epu8_mask(d, hi);
+        __m512i v = _mm512_maskz_mov_epi8(ge_lo, mid);
+        v = _mm512_mask_mov_epi8(v, ge_hi, max);
+        _mm512_storeu_si512((void *)(out + c), v);
+    }
+    return c;
+}
+
+__attribute__((target("avx512bw")))
+static inline __m512i sharpen16_avx512(__m512i c, __m512i n, __m512i s, __m512i w, __m512i e)
+{
+    __m512i v = _mm512_add_epi16(_mm512_slli_epi16(c, 2), c);
+    v = _mm512_sub_epi16(v, _mm512_add_epi16(n, s));
+    return _mm512_sub_epi16(v, _mm512_add_epi16(w, e));
+}
+
+__attribute__((target("avx512bw")))
+static int sharpen_row_avx512(const uint8_t *n, const uint8_t *p, const uint8_t *s, uint8_t *out, int width)
+{
+    const __m512i zero = _mm512_setzero_si512();
+    int c = 1;
+    for (; c + 64 <= width - 1; c += 64)
+    {
+        __m512i vc = _mm512_loadu_si512((const void *)(p + c));
+        __m512i vn = _mm512_loadu_si512((const void *)(n + c));
+        __m512i vs = _mm512_loadu_si512((const void *)(s + c));
+        __m512i vw = _mm512_loadu_si512((const void *)(p + c - 1));
+        __m512i ve = _mm512_loadu_si512((const void *)(p + c + 1));
+
+        __m512i r_lo = sharpen16_avx512(_mm512_unpacklo_epi8(vc, zero), _mm512_unpacklo_epi8(vn, zero),
+                                        _mm512_unpacklo_epi8(vs, zero), _mm512_unpacklo_epi8(vw, zero),
+                                        _mm512_unpacklo_epi8(ve, zero));
+        __m512i r_hi = sharpen16_avx512(_mm512_unpackhi_epi8(vc, zero), _mm512_unpackhi_epi8(vn, zero),
+                                        _mm512_unpackhi_epi8(vs, zero), _mm512_unpackhi_epi8(vw, zero),
+                                        _mm512_unpackhi_epi8(ve, zero));
+        _mm512_storeu_si512((void *)(out + c), _mm512_packus_epi16(r_lo, r_hi));
+    }
+    return c;
+}
+#endif // CPU_ENGINE_X86
+
+// =============================================================================
+// Dispatch
+// =============================================================================
+cpu_isa_t cpu_engine_detect(void)
+{
+#ifdef CPU_ENGINE_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512bw"))
+        return CPU_ISA_AVX512;
+    if (__builtin_cpu_supports("avx2"))
+        return CPU_ISA_AVX2;
+#endif
+    return CPU_ISA_SCALAR;
+}
+
+cpu_isa_t cpu_engine_select(cpu_isa_t isa)
+{
+    const cpu_isa_t best = cpu_engine_detect();
+    // ISAs are ordered by width, so anything above the best one is unsupported
+    selected_isa = (isa == CPU_ISA_AUTO || isa > best) ? best : isa;
+    return selected_isa;
+}
+
+cpu_isa_t cpu_engine_selected(void)
+{
+    return selected_isa;
+}
+
+const char *cpu_engine_isa_name(cpu_isa_t isa)
+{
+    switch (isa)
+    {
+    case CPU_ISA_SCALAR: return "scalar";
+    case CPU_ISA_AVX2:   return "avx2";
+    case CPU_ISA_AVX512: return "avx512";
+    default:             return "auto";
+    }
+}
+
+// =============================================================================
+// Band processing (fused)
+// =============================================================================
+// Output rows [r0, r1) only need posterized rows [r0 - 1, r1 + 1), so each
+// band posterizes its own 1-row halo and bands share nothing but the inputs.
+// Like apply_filter_wide's line buffers, only three posterized rows are
+// kept (a rolling window): row r + 1 is posterized right before row r is
+// sharpened, so every input byte is read once and every output byte is
+// written once, and the window stays in L1 instead of a full-frame C_post.
+static void posterize_row(const uint8_t *a, const uint8_t *b, uint8_t *p, int width)
+{
+    if (posterize_custom)
+    {
+        posterize_row_lut(a, b, p, width);
+        return;
+    }
+    int done = 0;
+#ifdef CPU_ENGINE_X86
+    if (selected_isa == CPU_ISA_AVX512)
+        done = posterize_row_avx512(a, b, p, width);
+    else if (selected_isa == CPU_ISA_AVX2)
+        done = posterize_row_avx2(a, b, p, width);
+#endif
+    posterize_row_scalar(a, b, p, done, width);
+}
+
+static void process_band(const uint8_t *A, const uint8_t *B, uint8_t *C,
+                         int height, int width, int pitch, int r0, int r1)
+{
+    // Rolling window of three posterized rows (reused across calls on the same thread)
+    static thread_local std::vector<uint8_t> window;
+    window.resize((size_t)3 * width);
+    uint8_t *rows[3] = {&window[0], &window[width], &window[2 * (size_t)width]};
+
+    // Prime the window with rows r0 - 1 and r0 (rows[1] = north, rows[2] = center)
+    const int first = (r0 > 0) ? r0 - 1 : 0;
+    int next = first; // Next input row to posterize
+    for (; next <= r0 && next < height; next++)
+    {
+        uint8_t *t = rows[0]; rows[0] = rows[1]; rows[1] = rows[2]; rows[2] = t;
+        posterize_row(A + (size_t)next * pitch, B + (size_t)next * pitch, rows[2], width);
+    }
+
+    for (int r = r0; r < r1; r++)
+    {
+        // Pull in row r + 1 (south); window is now {r - 1, r, r + 1}.
+        // On the last row there is nothing left to pull: {r - 2, r - 1, r}.
+        const uint8_t *n, *p, *s;
+        if (next < height)
+        {
+            uint8_t *t = rows[0]; rows[0] = rows[1]; rows[1] = rows[2]; rows[2] = t;
+            posterize_row(A + (size_t)next * pitch, B + (size_t)next * pitch, rows[2], width);
+            next++;
+            n = rows[0]; p = rows[1]; s = rows[2];
+        }
+        else
+        {
+            n = rows[1]; p = rows[2]; s = nullptr;
+        }
+
+        uint8_t *out = C + (size_t)r * width;
+        const bool north = (r == 0), south = (r == height - 1);
+        if ((north || south) && border_mode == BORDER_ZERO)
+        {
+            std::memset(out, 0, width);
+            continue;
+        }
+        if ((north || south) && border_mode == BORDER_PASSTHROUGH)
+        {
+            std::memcpy(out, p, width);
+            continue;
+        }
+
+        // Replicate / mirror: substitute the missing row, then filter as usual
+        const bool mirror_rows = (border_mode == BORDER_MIRROR) && height > 1;
+        const uint8_t *n_in = n;
+        if (north)
+            n = mirror_rows ? s : p;
+        if (south)
+            s = mirror_rows ? n_in : p;
+
+        if (filter_identity)
+            std::memcpy(out + 1, p + 1, width > 2 ? width - 2 : 0);
+        else if (filter_custom)
+            sharpen_row_generic(n, p, s, out, 1, width - 1);
+        else
+        {
+            int done = 1;
+#ifdef CPU_ENGINE_X86
+            if (selected_isa == CPU_ISA_AVX512)
+                done = sharpen_row_avx512(n, p, s, out, width);
+            else if (selected_isa == CPU_ISA_AVX2)
+                done = sharpen_row_avx2(n, p, s, out, width);
+#endif
+            sharpen_row_scalar(n, p, s, out, done, width - 1);
+        }
+        if (border_mode == BORDER_ZERO)
+        {
+            out[0] = 0;
+            out[width - 1] = 0;
+        }
+        else if (border_mode == BORDER_PASSTHROUGH)
+        {
+            out[0] = p[0];
+            out[width - 1] = p[width - 1];
+        }
+        else
+        {
+            out[0] = sharpen_edge_px(n, p, s, 0, width);
+            out[width - 1] = sharpen_edge_px(n, p, s, width - 1, width);
+        }
+    }
+}
+
+// =============================================================================
+// Thread pool
+// =============================================================================
+// Persistent workers, so a frame costs two condition-variable round trips
+// rather than thread creation. The calling thread takes bands too.
+class BandPool
+{
+public:
+    explicit BandPool(int workers) : job(nullptr), next(0), generation(0), num_tasks(0), done(0), stop(false)
+    {
+        for (int i = 0; i < workers; i++)
+            threads.emplace_back([this] { worker(); });
+    }
+
+    ~BandPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m);
+            stop = true;
+        }
+        cv.notify_all();
+        for (auto &t : threads)
+            t.join();
+    }
+
+    int size(void) const { return (int)threads.size() + 1; }
+
+    void run(int tasks, const std::function<void(int)> &fn)
+    {
+        unsigned gen;
+        {
+            std::lock_guard<std::mutex> lock(m);
+            job = &fn;
+            num_tasks = tasks;
+            next = 0;
+            done = 0;
+            gen = ++generation;
+        }
+        cv.notify_all();
+        drain(gen);
+        std::unique_lock<std::mutex> lock(m);
+        done_cv.wait(lock, [this] { return done == num_tasks; });
+        job = nullptr;
+    }
+
+private:
+    // Tasks are claimed under the lock and only for the frame the caller
+    // woke up for, so a worker that wakes late (or is still leaving the
+    // previous frame) never sees a half-published job or steals from the next
+    // frame. job stays valid until done reaches num_tasks, which cannot
+    // happen while a claimed task is running.
+    void drain(unsigned gen)
+    {
+        std::unique_lock<std::mutex> lock(m);
+        while (generation == gen && next < num_tasks)
+        {
+            const int t = next++;
+            const std::function<void(int)> *fn = job;
+            lock.unlock();
+            (*fn)(t);
+            lock.lock();
+            if (++done == num_tasks)
+                done_cv.notify_all();
+        }
+    }
+
+    void worker(void)
+    {
+        unsigned seen = 0;
+        for (;;)
+        {
+            {
+                std::unique_lock<std::mutex> lock(m);
+                cv.wait(lock, [&] { return stop || generation != seen; });
+                if (stop)
+                    return;
+                seen = generation;
+            }
+            drain(seen);
+        }
+    }
+
+    std::vector<std::thread> threads;
+    std::mutex m;
+    std::condition_variable cv, done_cv;
+    const std::function<void(int)> *job;
+    int next;
+    unsigned generation;
+    int num_tasks;
+    int done;
+    bool stop;
+};
+
+static std::unique_ptr<BandPool> pool;
+
+// Fewer rows than this per band and the halo/sync overhead outweighs the work
+#define CPU_ENGINE_MIN_BAND_ROWS 16
+
+void cpu_engine_set_filter(const int k[3][3], int shift)
+{
+    static const int laplacian[3][3] = {{0, -1, 0}, {-1, 5, -1}, {0, -1, 0}};
+    static const int identity[3][3]  = {{0, 0, 0}, {0, 1, 0}, {0, 0, 0}};
+    std::memcpy(filter_k, k, sizeof(filter_k));
+    filter_shift = shift;
+    filter_custom = (shift != 0) || std::memcmp(filter_k, laplacian, sizeof(filter_k)) != 0;
+    filter_identity = (shift == 0) && std::memcmp(filter_k, identity, sizeof(filter_k)) == 0;
+}
+
+void cpu_engine_set_posterize(const int *thr, int num_levels)
+{
+    int t = 0;
+    for (int d = 0; d < 256; d++)
+    {
+        while (t < num_levels - 1 && d >= thr[t])
+            t++;
+        posterize_lut[d] = (uint8_t)POSTERIZE_LEVEL_VALUE(t, num_levels);
+    }
+    posterize_custom = !(num_levels == 3 && thr[0] == THRESH_LOW && thr[1] == THRESH_HIGH);
+}
+
+void cpu_engine_set_border(int mode)
+{
+    border_mode = mode;
+}
+
+void cpu_engine_set_morph(int mode)
+{
+    morph_mode = mode;
+}
+
+// One 3x3 erode/dilate (MORPH_OP_*) of a compact frame; taps past the
+// frame are left out, as in morph_3x3
+static void morph_pass(uint8_t *C, std::vector<uint8_t> &tmp, int height, int width, int op)
+{
+    if (op == MORPH_OP_PASS)
+        return;
+    tmp.assign(C, C + (size_t)height * width);
+    for (int r = 0; r < height; r++)
+    {
+        const int r0 = (r > 0) ? r - 1 : r, r1 = (r < height - 1) ? r + 1 : r;
+        for (int c = 0; c < width; c++)
+        {
+            const int c0 = (c > 0) ? c - 1 : c, c1 = (c < width - 1) ? c + 1 : c;
+            int v = tmp[(size_t)r * width + c];
+            for (int y = r0; y <= r1; y++)
+                for (int x = c0; x <= c1; x++)
+                {
+                    const int t = tmp[(size_t)y * width + x];
+                    v = (op == MORPH_OP_ERODE) ? std::min(v, t) : std::max(v, t);
+                }
+            C[(size_t)r * width + c] = (uint8_t)v;
+        }
+    }
+}
+
+// CPUs the calling thread may run on (its affinity mask, e.g. one NUMA node)
+static int usable_cpus()
+{
+#ifdef __linux__
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set) == 0)
+        return CPU_COUNT(&set);
+#endif
+    return (int)std::thread::hardware_concurrency();
+}
+
+void cpu_engine_set_threads(int threads)
+{
+    if (threads <= 0)
+        threads = usable_cpus();
+    if (threads < 1)
+        threads = 1;
+    pool.reset();
+    if (threads > 1)
+        pool.reset(new BandPool(threads - 1));
+}
+
+int cpu_engine_threads(void)
+{
+    return pool ? pool->size() : 1;
+}
+
+void cpu_engine_run(const uint8_t *A, const uint8_t *B, uint8_t *C,
+                    int height, int width, int pitch)
+{
+    if (selected_isa == CPU_ISA_AUTO)
+        cpu_engine_select(CPU_ISA_AUTO);
+
+    int bands = pool ? pool->size() * 4 : 1; // Oversubscribe 4x for load balance
+    if (bands > height / CPU_ENGINE_MIN_BAND_ROWS)
+        bands = height / CPU_ENGINE_MIN_BAND_ROWS;
+    if (bands <= 1)
+    {
+        process_band(A, B, C, height, width, pitch, 0, height);
+    }
+    else
+    {
+        pool->run(bands, [&](int band) {
+            const int r0 = (int)((long long)height * band / bands);
+            const int r1 = (int)((long long)height * (band + 1) / bands);
+            process_band(A, B, C, height, width, pitch, r0, r1);
+        });
+    }
+
+    if (morph_mode != MORPH_NONE)
+    {
+        std::vector<uint8_t> tmp;
+        morph_pass(C, tmp, height, width, MORPH_FIRST_OP(morph_mode));
+        morph_pass(C, tmp, height, width, MORPH_SECOND_OP(morph_mode));
+    }
+}
@@ -0,0 +1,73 @@
+/**
+ * @file cpu_engine.hpp
+ * @brief CPU implementation of the diff + posterize + sharpen pipeline
+ *
+ * Same semantics as the kernels: |A - B| posterized to 0/128/255, then the
+ * 5-point sharpen (5C - N - S - W - E) clipped to [0, 255], zero borders
+ * unless cpu_engine_set_border() picks another policy.
+ * Inputs are read at `pitch` bytes per row (so the padded device layout can
+ * be used directly); the output is compact (width bytes per row).
+ *
+ * The implementation is picked once at run time from CPUID: AVX-512BW
+ * (64 pixels per instruction), AVX2 (32 pixels) or portable scalar code.
+ * With cpu_engine_set_threads() each frame is also split into horizontal
+ * bands (1-row halo each) processed on a thread pool.
+ * cpu_engine_set_filter() swaps in other sharpen taps (matching the kernels'
+ * coef_* arguments) and cpu_engine_set_posterize() other posterize tables
+ * (the post_* arguments); non-default settings use portable scalar paths,
+ * except the bypass taps (SHARPEN_BYPASS_*), which copy the posterized rows.
+ * cpu_engine_set_morph() adds the open/close of -DV3_MORPH kernels.
+ */
+
+#ifndef CPU_ENGINE_HPP__
+#define CPU_ENGINE_HPP__
+
+#include <cstdint>
+
+enum cpu_isa_t
+{
+    CPU_ISA_AUTO = 0,
+    CPU_ISA_SCALAR,
+    CPU_ISA_AVX2,
+    CPU_ISA_AVX512
+};
+
+// Best ISA this machine supports (never returns CPU_ISA_AUTO)
+cpu_isa_t cpu_engine_detect(void);
+
+// Force a specific implementation; unsupported requests fall back to the best
+// available one. Returns the ISA that will actually be used.
+cpu_isa_t cpu_engine_select(cpu_isa_t isa);
+
+// The implementation cpu_engine_run() currently uses
+cpu_isa_t cpu_engine_selected(void);
+
+const char *cpu_engine_isa_name(cpu_isa_t isa);
+
+// Size the band thread pool (including the calling thread); <= 0 means
+// one per CPU in the calling thread's affinity mask. Default is single-threaded.
+void cpu_engine_set_threads(int threads);
+int cpu_engine_threads(void);
+
+// Sharpen taps k[row][col] (row 0 = north) and arithmetic right shift applied
+// before clipping. Default is the 5-point Laplacian with shift 0.
+void cpu_engine_set_filter(const int k[3][3], int shift);
+
+// Posterize with num_levels (2..8) output levels and num_levels - 1 ascending
+// thresholds. Default is 3 levels at THRESH_LOW / THRESH_HIGH.
+void cpu_engine_set_posterize(const int *thr, int num_levels);
+
+// Frame border policy (BORDER_* from image_defines.h), the kernels'
+// border_mode argument. Default is BORDER_ZERO.
+void cpu_engine_set_border(int mode);
+
+// Morphological clean-up of the sharpened frame (MORPH_* from image_defines.h),
+// the -DV3_MORPH kernels' morph_mode argument. Scalar, after the bands.
+// Default is MORPH_NONE.
+void cpu_engine_set_morph(int mode);
+
+// Process one frame with the selected implementation
+void cpu_engine_run(const uint8_t *A, const uint8_t *B, uint8_t *C,
+                    int height, int width, int pitch);
+
+#endif // CPU_ENGINE_HPP__
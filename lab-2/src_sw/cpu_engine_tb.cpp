@@ -0,0 +1,177 @@
+/**
+ * @file cpu_engine_tb.cpp
+ * @brief Equivalence test of the cpu_engine implementations
+ *
+ * Runs every ISA this machine supports (scalar, AVX2, AVX-512BW) against a
+ * plain per-pixel reference of the default pipeline, under every border
+ * policy. Widths sit on both sides of the 32/64-pixel vector widths, and the
+ * inputs are read at pitches wider than the row, with the padding filled
+ * with garbage, so row tails and pitch handling are exercised.
+ * A second pass runs many small frames back to back on the band thread pool,
+ * so frames start while workers are still leaving the previous one.
+ *
+ * Build with the host's include flags (image_defines.h needs the HLS headers):
+ *   g++ -O2 -pthread cpu_engine_tb.cpp cpu_engine.cpp -o cpu_engine_tb
+ */
+
+#include "cpu_engine.hpp"
+#include "../../inc/test_pattern.h"
+#include "../../inc/image_defines.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Canary past the end of C; no implementation may write there
+#define TB_GUARD_BYTES 64
+#define TB_GUARD_VALUE 0x5A
+#define TB_PAD_VALUE   0xA5
+
+// =============================================================================
+// Reference: the kernels' semantics, one pixel at a time
+// =============================================================================
+static uint8_t ref_posterize(uint8_t a, uint8_t b)
+{
+    const int diff = (a > b) ? a - b : b - a;
+    return (diff < THRESH_LOW) ? 0 : (diff < THRESH_HIGH) ? 128 : 255;
+}
+
+// Tap at (r, c) of the posterized frame P under a replicate / mirror policy
+static int ref_tap(const std::vector<uint8_t> &P, int height, int width, int r, int c, int border)
+{
+    if (r < 0)
+        r = (border == BORDER_MIRROR && height > 1) ? 1 : 0;
+    else if (r >= height)
+        r = (border == BORDER_MIRROR && height > 1) ? height - 2 : height - 1;
+    if (c < 0)
+        c = (border == BORDER_MIRROR && width > 1) ? 1 : 0;
+    else if (c >= width)
+        c = (border == BORDER_MIRROR && width > 1) ? width - 2 : width - 1;
+    return P[(size_t)r * width + c];
+}
+
+static void ref_run(const uint8_t *A, const uint8_t *B, uint8_t *C,
+                    int height, int width, int pitch, int border)
+{
+    std::vector<uint8_t> P((size_t)height * width);
+    for (int r = 0; r < height; r++)
+        for (int c = 0; c < width; c++)
+            P[(size_t)r * width + c] = ref_posterize(A[(size_t)r * pitch + c], B[(size_t)r * pitch + c]);
+
+    for (int r = 0; r < height; r++)
+        for (int c = 0; c < width; c++)
+        {
+            const bool edge = (r == 0 || r == height - 1 || c == 0 || c == width - 1);
+            uint8_t &out = C[(size_t)r * width + c];
+            if (edge && border == BORDER_ZERO)
+                out = 0;
+            else if (edge && border == BORDER_PASSTHROUGH)
+                out = P[(size_t)r * width + c];
+            else
+            {
+                const int val = 5 * ref_tap(P, height, width, r, c, border)
+                              - ref_tap(P, height, width, r - 1, c, border)
+                              - ref_tap(P, height, width, r + 1, c, border)
+                              - ref_tap(P, height, width, r, c - 1, border)
+                              - ref_tap(P, height, width, r, c + 1, border);
+                out = (uint8_t)((val < 0) ? 0 : (val > 255) ? 255 : val);
+            }
+        }
+}
+
+// =============================================================================
+// Cases
+// =============================================================================
+static int cases = 0;
+static int failures = 0;
+
+// Small frames give the pool a few bands each and little work per band
+#define TB_POOL_THREADS 4
+#define TB_POOL_FRAMES  2000
+
+static void run_case(cpu_isa_t isa, int height, int width, int pitch, int border, uint64_t seed)
+{
+    std::vector<uint8_t> A((size_t)height * pitch, TB_PAD_VALUE);
+    std::vector<uint8_t> B((size_t)height * pitch, TB_PAD_VALUE);
+    const tp_config_t cfg = {seed, TP_NOISE_UNIFORM, TP_DEFAULT_AMPLITUDE};
+    tp_fill_pair(A.data(), B.data(), height, width, (size_t)pitch, 0, &cfg, 255);
+
+    const size_t frame = (size_t)height * width;
+    std::vector<uint8_t> expected(frame);
+    std::vector<uint8_t> C(frame + TB_GUARD_BYTES, TB_GUARD_VALUE);
+    ref_run(A.data(), B.data(), expected.data(), height, width, pitch, border);
+
+    cpu_engine_set_border(border);
+    cpu_engine_run(A.data(), B.data(), C.data(), height, width, pitch);
+    cases++;
+
+    size_t mismatches = 0, first = 0;
+    for (size_t i = 0; i < frame; i++)
+        if (C[i] != expected[i] && mismatches++ == 0)
+            first = i;
+    bool guard_ok = true;
+    for (size_t i = frame; i < C.size(); i++)
+        guard_ok &= (C[i] == TB_GUARD_VALUE);
+
+    if (mismatches || !guard_ok)
+    {
+        failures++;
+        printf("FAIL %s %dx%d pitch %d border %d: %zu mismatches", cpu_engine_isa_name(isa),
+               height, width, pitch, border, mismatches);
+        if (mismatches)
+            printf(" (first at row %zu col %zu: got %d, expected %d)", first / width, first % width,
+                   C[first], expected[first]);
+        printf("%s\n", guard_ok ? "" : ", wrote past the frame");
+    }
+}
+
+int main(void)
+{
+    static const int heights[] = {1, 2, 3, 17};
+    static const int widths[] = {1, 2, 3, 31, 33, 63, 65, 66, 127, 129, 1001};
+    static const int borders[] = {BORDER_ZERO, BORDER_REPLICATE, BORDER_MIRROR, BORDER_PASSTHROUGH};
+
+    const cpu_isa_t best = cpu_engine_detect();
+    for (int isa = CPU_ISA_SCALAR; isa <= CPU_ISA_AVX512; isa++)
+    {
+        if (isa > best)
+        {
+            printf("Skipping %s: not supported on this CPU\n", cpu_engine_isa_name((cpu_isa_t)isa));
+            continue;
+        }
+        if (cpu_engine_select((cpu_isa_t)isa) != isa)
+        {
+            printf("FAIL could not select %s\n", cpu_engine_isa_name((cpu_isa_t)isa));
+            failures++;
+            continue;
+        }
+        uint64_t seed = TP_DEFAULT_SEED;
+        for (int h : heights)
+            for (int w : widths)
+                for (int border : borders)
+                {
+                    // Packed, odd padding, and padded to the next bus chunk plus one
+                    const int pitches[] = {w, w + 13, (w + 63) / 64 * 64 + 64};
+                    for (int pitch : pitches)
+                        run_case((cpu_isa_t)isa, h, w, pitch, border, seed++);
+                }
+    }
+
+    // Back-to-back frames on the pool; heights span 2..10 bands
+    cpu_engine_select(CPU_ISA_AUTO);
+    cpu_engine_set_threads(TB_POOL_THREADS);
+    for (int f = 0; f < TB_POOL_FRAMES; f++)
+    {
+        const uint64_t h = tp_draw(TP_DEFAULT_SEED, f);
+        const int height = 32 + (int)(h % 129);
+        const int width = 3 + (int)((h >> 8) % 198);
+        const int pitch = width + (int)((h >> 16) % 3) * 7;
+        run_case(cpu_engine_selected(), height, width, pitch, borders[(h >> 24) % 4], h);
+    }
+    cpu_engine_set_threads(1);
+    cpu_engine_set_border(BORDER_DEFAULT);
+
+    printf("CPU engine: %d cases, %d failures\n", cases, failures);
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -79,10 +79,23 @@ void EventTimer::clear(void)
     start_times.clear();
     end_times.clear();
     event_names.clear();
+    device_events.clear();
+    device_names.clear();
+    device_bytes.clear();
     event_count = 0;
     unfinished  = false;
 }
 
+void EventTimer::add_device(std::string description, const cl::Event &event, size_t bytes)
+{
+    device_names.push_back(description);
+    device_events.push_back(event);
+    device_bytes.push_back(bytes);
+    int length = description.length();
+    if (length > max_string_length)
+        max_string_length = length;
+}
+
 void EventTimer::print(int id)
 {
     std::ios_base::fmtflags flags(std::cout.flags());
@@ -102,4 +115,34 @@ void EventTimer::print(int id)
         }
     }
     std::cout.flags(flags);
-}
\ No newline at end of file
+}
+
+void EventTimer::print_device(void)
+{
+    std::ios_base::fmtflags flags(std::cout.flags());
+    std::cout << std::left << std::setw(max_string_length) << "Device event" << " : "
+              << std::right << std::setw(10) << "queued" << std::setw(10) << "submit"
+              << std::setw(10) << "exec" << "   (ms)" << std::endl;
+    for (size_t i = 0; i < device_events.size(); i++) {
+        cl_int err[4] = {CL_SUCCESS, CL_SUCCESS, CL_SUCCESS, CL_SUCCESS};
+        cl_ulong queued = device_events[i].getProfilingInfo<CL_PROFILING_COMMAND_QUEUED>(&err[0]);
+        cl_ulong submit = device_events[i].getProfilingInfo<CL_PROFILING_COMMAND_SUBMIT>(&err[1]);
+        cl_ulong start  = device_events[i].getProfilingInfo<CL_PROFILING_COMMAND_START>(&err[2]);
+        cl_ulong end    = device_events[i].getProfilingInfo<CL_PROFILING_COMMAND_END>(&err[3]);
+        std::cout << std::left << std::setw(max_string_length) << device_names[i] << " : ";
+        if (err[0] != CL_SUCCESS || err[1] != CL_SUCCESS || err[2] != CL_SUCCESS || err[3] != CL_SUCCESS) {
+            std::cout << "no profiling info" << std::endl;
+            continue;
+        }
+        // queued: QUEUED->SUBMIT, submit: SUBMIT->START, exec: START->END
+        std::cout << std::right << std::fixed << std::setprecision(3)
+                  << std::setw(10) << (submit - queued) * 1e-6
+                  << std::setw(10) << (start - submit) * 1e-6
+                  << std::setw(10) << (end - start) * 1e-6;
+        if (device_bytes[i] > 0 && end > start)
+            std::cout << "   " << std::setprecision(2)
+                      << (double)device_bytes[i] / (double)(end - start) << " GB/s";
+        std::cout << std::endl;
+    }
+    std::cout.flags(flags);
+}
@@ -31,6 +31,8 @@ EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #ifndef EVENT_TIMER_HPP__
 #define EVENT_TIMER_HPP__
 
+#include "xcl2.hpp"
+
 #include <chrono>
 #include <string>
 #include <vector>
@@ -44,6 +46,12 @@ private:
     std::vector<EventTimer::timepoint> end_times;
     std::vector<std::string> event_names;
 
+    // Device-side events timed from their OpenCL profiling info
+    // (the queue must be created with CL_QUEUE_PROFILING_ENABLE)
+    std::vector<cl::Event> device_events;
+    std::vector<std::string> device_names;
+    std::vector<size_t> device_bytes;
+
     bool unfinished;
     unsigned int event_count;
     int max_string_length;
@@ -56,7 +64,12 @@ public:
     void finish(void);
     void clear(void);
 
+    // Record an enqueued command; bytes > 0 also reports its GB/s.
+    // Profiling info is read in print_device(), so the event must be complete by then.
+    void add_device(std::string description, const cl::Event &event, size_t bytes = 0);
+
     void print(int id = -1);
+    void print_device(void);
 };
 
 #endif // EVENT_TIMER_HPP__
\ No newline at end of file
@@ -0,0 +1,274 @@
+/**
+ * @file frame_io.cpp
+ * @brief mmap-based frame sources and buffered frame sinks
+ *
+ * Headers are parsed straight out of the mapping; the pixel data is never
+ * copied here. MADV_SEQUENTIAL lets the kernel read ahead aggressively, and
+ * release() hands consumed frames back with MADV_DONTNEED (the mapping is
+ * read-only and file-backed, so this only discards clean page-cache pages
+ * from this process).
+ */
+
+#include "frame_io.hpp"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+frame_format_t frame_format_from_path(const std::string &path)
+{
+    const size_t dot = path.rfind('.');
+    const std::string ext = (dot == std::string::npos) ? "" : path.substr(dot);
+    if (ext == ".pgm")
+        return FRAME_PGM;
+    if (ext == ".y4m")
+        return FRAME_Y4M;
+    return FRAME_RAW;
+}
+
+// =============================================================================
+// FrameSource
+// =============================================================================
+bool FrameSource::fail(const std::string &why)
+{
+    error_ = why;
+    close();
+    return false;
+}
+
+bool FrameSource::open(const std::string &path, int width, int height)
+{
+    close();
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return fail("cannot open " + path + ": " + std::strerror(errno));
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        ::close(fd);
+        return fail(path + " is empty or cannot be sized");
+    }
+    map_bytes_ = (size_t)st.st_size;
+    void *p = mmap(nullptr, map_bytes_, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd); // The mapping keeps the file referenced
+    if (p == MAP_FAILED)
+    {
+        map_ = nullptr;
+        return fail("cannot map " + path + ": " + std::strerror(errno));
+    }
+    map_ = (const uint8_t *)p;
+    madvise(p, map_bytes_, MADV_SEQUENTIAL);
+    path_ = path;
+
+    switch (frame_format_from_path(path))
+    {
+    case FRAME_PGM:
+        return index_pgm();
+    case FRAME_Y4M:
+        return index_y4m();
+    default:
+        break;
+    }
+
+    if (width <= 0 || height <= 0)
+        return fail("raw input " + path + " needs <height> <width>");
+    width_  = width;
+    height_ = height;
+    const size_t frame_bytes = (size_t)width * height;
+    for (size_t off = 0; off + frame_bytes <= map_bytes_; off += frame_bytes)
+        offsets_.push_back(off);
+    if (offsets_.empty())
+        return fail(path + " is smaller than one frame");
+    return true;
+}
+
+void FrameSource::close()
+{
+    if (map_)
+        munmap((void *)map_, map_bytes_);
+    map_ = nullptr;
+    map_bytes_ = 0;
+    offsets_.clear();
+}
+
+void FrameSource::prefetch(int first, int last)
+{
+    if (first >= last || first < 0 || last > num_frames())
+        return;
+    const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    const size_t lo = offsets_[first] / page * page;
+    const size_t hi = offsets_[last - 1] + (size_t)width_ * height_;
+    madvise((void *)(map_ + lo), hi - lo, MADV_WILLNEED);
+}
+
+void FrameSource::release(int first, int last)
+{
+    if (first >= last || first < 0 || last > num_frames())
+        return;
+    // Whole pages only: the ends may be shared with frames still in use
+    const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    const size_t lo = (offsets_[first] + page - 1) / page * page;
+    const size_t hi = (offsets_[last - 1] + (size_t)width_ * height_) / page * page;
+    if (hi > lo)
+        madvise((void *)(map_ + lo), hi - lo, MADV_DONTNEED);
+}
+
+static inline bool pgm_space(uint8_t c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+// Netpbm header token: skips whitespace and '#' comments; returns the value
+// or -1, and leaves pos on the byte after the token
+static long pgm_token(const uint8_t *p, size_t n, size_t &pos)
+{
+    for (;;)
+    {
+        while (pos < n && pgm_space(p[pos]))
+            pos++;
+        if (pos < n && p[pos] == '#')
+        {
+            while (pos < n && p[pos] != '\n')
+                pos++;
+            continue;
+        }
+        break;
+    }
+    long v = -1;
+    while (pos < n && p[pos] >= '0' && p[pos] <= '9')
+        v = ((v < 0) ? 0 : v * 10) + (p[pos++] - '0');
+    return v;
+}
+
+bool FrameSource::index_pgm()
+{
+    size_t pos = 0;
+    while (pos + 2 <= map_bytes_)
+    {
+        if (map_[pos] != 'P' || map_[pos + 1] != '5')
+            return offsets_.empty() ? fail("not a binary (P5) PGM") : true; // Trailing bytes end the sequence
+        pos += 2;
+        const long w = pgm_token(map_, map_bytes_, pos);
+        const long h = pgm_token(map_, map_bytes_, pos);
+        const long maxval = pgm_token(map_, map_bytes_, pos);
+        if (w <= 0 || h <= 0 || maxval <= 0 || maxval > 255 || pos >= map_bytes_)
+            return fail("bad PGM header (need P5 with maxval <= 255)");
+        if (!offsets_.empty() && (w != width_ || h != height_))
+            return fail("PGM images differ in size");
+        width_  = (int)w;
+        height_ = (int)h;
+        pos++; // Single whitespace byte before the raster
+        if (pos + (size_t)w * h > map_bytes_)
+            return fail("truncated PGM raster");
+        offsets_.push_back(pos);
+        pos += (size_t)w * h;
+        while (pos < map_bytes_ && pgm_space(map_[pos]))
+            pos++;
+    }
+    return true;
+}
+
+bool FrameSource::index_y4m()
+{
+    const char magic[] = "YUV4MPEG2 ";
+    if (map_bytes_ < sizeof(magic) - 1 || std::memcmp(map_, magic, sizeof(magic) - 1) != 0)
+        return fail("not a YUV4MPEG2 file");
+
+    // Stream header: space-separated tags up to the first newline
+    const uint8_t *nl = (const uint8_t *)std::memchr(map_, '\n', map_bytes_);
+    if (!nl)
+        return fail("truncated Y4M header");
+    const std::string header((const char *)map_, nl - map_);
+    std::string chroma = "420";
+    size_t tag = header.find(' ');
+    while (tag != std::string::npos)
+    {
+        const size_t end = header.find(' ', tag + 1);
+        const std::string t = header.substr(tag + 1, end - tag - 1);
+        if (!t.empty() && t[0] == 'W')
+            width_ = std::atoi(t.c_str() + 1);
+        else if (!t.empty() && t[0] == 'H')
+            height_ = std::atoi(t.c_str() + 1);
+        else if (!t.empty() && t[0] == 'C')
+            chroma = t.substr(1);
+        tag = end;
+    }
+    if (width_ <= 0 || height_ <= 0)
+        return fail("Y4M header without W/H");
+    if (chroma.find("p10") != std::string::npos || chroma.find("p12") != std::string::npos)
+        return fail("only 8-bit Y4M is supported");
+
+    // Bytes after the luma plane in each frame
+    const size_t cw = (size_t)(width_ + 1) / 2, ch = (size_t)(height_ + 1) / 2;
+    size_t chroma_bytes = 2 * cw * ch;                       // 420*
+    if (chroma.compare(0, 4, "mono") == 0)
+        chroma_bytes = 0;
+    else if (chroma.compare(0, 3, "422") == 0)
+        chroma_bytes = 2 * cw * height_;
+    else if (chroma.compare(0, 3, "444") == 0)
+        chroma_bytes = (chroma == "444alpha" ? 3 : 2) * (size_t)width_ * height_;
+
+    const size_t luma_bytes = (size_t)width_ * height_;
+    size_t pos = nl - map_ + 1;
+    while (pos + 5 <= map_bytes_ && std::memcmp(map_ + pos, "FRAME", 5) == 0)
+    {
+        const uint8_t *fnl = (const uint8_t *)std::memchr(map_ + pos, '\n', map_bytes_ - pos);
+        if (!fnl)
+            break;
+        pos = fnl - map_ + 1;
+        if (pos + luma_bytes + chroma_bytes > map_bytes_)
+            break; // Truncated last frame
+        offsets_.push_back(pos);
+        pos += luma_bytes + chroma_bytes;
+    }
+    if (offsets_.empty())
+        return fail("Y4M file has no complete frame");
+    return true;
+}
+
+// =============================================================================
+// FrameSink
+// =============================================================================
+bool FrameSink::open(const std::string &path, int width, int height)
+{
+    close();
+    file_ = std::fopen(path.c_str(), "wb");
+    if (!file_)
+        return false;
+    std::setvbuf(file_, nullptr, _IOFBF, 1 << 20);
+    format_ = frame_format_from_path(path);
+    width_  = width;
+    height_ = height;
+    frames_ = 0;
+    if (format_ == FRAME_Y4M)
+        std::fprintf(file_, "YUV4MPEG2 W%d H%d F30:1 Ip A1:1 Cmono\n", width, height);
+    return true;
+}
+
+bool FrameSink::write(const uint8_t *frame, int pitch)
+{
+    if (!file_)
+        return false;
+    if (format_ == FRAME_PGM)
+        std::fprintf(file_, "P5\n%d %d\n255\n", width_, height_);
+    else if (format_ == FRAME_Y4M)
+        std::fputs("FRAME\n", file_);
+    for (int r = 0; r < height_; r++)
+    {
+        if (std::fwrite(frame + (size_t)r * pitch, 1, width_, file_) != (size_t)width_)
+            return false;
+    }
+    frames_++;
+    return true;
+}
+
+void FrameSink::close()
+{
+    if (file_)
+        std::fclose(file_);
+    file_ = nullptr;
+}
@@ -0,0 +1,112 @@
+/**
+ * @file frame_io.hpp
+ * @brief Memory-mapped 8-bit frame sequences (raw / PGM / Y4M) and result writers
+ *
+ * FrameSource maps the whole file read-only and indexes the frames once, so
+ * frame(i) is a pointer into the page cache: packing a frame into the padded
+ * device layout is the only copy, and nothing is read twice. release() drops
+ * the pages of frames already consumed, so a multi-GB recording streams
+ * through with only the frames in flight resident. path() and
+ * frame_offset() let a caller read frames itself instead (host.cpp's --p2p
+ * reads them from the file straight into device memory).
+ *
+ * Formats are picked from the file extension:
+ *   .pgm  - binary PGM (P5, maxval <= 255); several images may be concatenated
+ *   .y4m  - YUV4MPEG2; only the Y plane is used (any C tag, 8-bit)
+ *   other - raw 8-bit frames of a size given by the caller
+ *
+ * FrameSink writes compact frames sequentially through a buffered stream in
+ * the same formats (a Y4M sink writes C mono).
+ */
+
+#ifndef FRAME_IO_HPP__
+#define FRAME_IO_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+enum frame_format_t
+{
+    FRAME_RAW = 0,
+    FRAME_PGM,
+    FRAME_Y4M
+};
+
+frame_format_t frame_format_from_path(const std::string &path);
+
+class FrameSource
+{
+public:
+    FrameSource() : map_(nullptr), map_bytes_(0), width_(0), height_(0) {}
+    ~FrameSource() { close(); }
+
+    FrameSource(const FrameSource &) = delete;
+    FrameSource &operator=(const FrameSource &) = delete;
+
+    // Map path and index its frames. Raw files need width/height; PGM/Y4M
+    // take them from the headers and ignore the arguments. On failure
+    // returns false and error() says why.
+    bool open(const std::string &path, int width = 0, int height = 0);
+    void close();
+
+    int width() const { return width_; }
+    int height() const { return height_; }
+    int num_frames() const { return (int)offsets_.size(); }
+
+    // Frame i's first pixel; rows are width() bytes apart
+    const uint8_t *frame(int i) const { return map_ + offsets_[i]; }
+
+    // Frame i's byte offset in the file, and the file itself
+    size_t frame_offset(int i) const { return offsets_[i]; }
+    const std::string &path() const { return path_; }
+
+    // Start reading frames [first, last) ahead of use (MADV_WILLNEED)
+    void prefetch(int first, int last);
+
+    // Let the kernel drop the pages of frames [first, last); the mapping
+    // stays valid and faults them back in if they are touched again
+    void release(int first, int last);
+
+    const std::string &error() const { return error_; }
+
+private:
+    bool index_pgm();
+    bool index_y4m();
+    bool fail(const std::string &why);
+
+    const uint8_t *map_;
+    size_t map_bytes_;
+    int width_, height_;
+    std::vector<size_t> offsets_;
+    std::string path_;
+    std::string error_;
+};
+
+class FrameSink
+{
+public:
+    FrameSink() : file_(nullptr), frames_(0) {}
+    ~FrameSink() { close(); }
+
+    FrameSink(const FrameSink &) = delete;
+    FrameSink &operator=(const FrameSink &) = delete;
+
+    // Create path for width x height frames in its extension's format
+    bool open(const std::string &path, int width, int height);
+
+    // Append one frame whose rows are pitch bytes apart (only width are written)
+    bool write(const uint8_t *frame, int pitch);
+
+    void close();
+    int frames_written() const { return frames_; }
+
+private:
+    FILE *file_;
+    frame_format_t format_;
+    int width_, height_, frames_;
+};
+
+#endif // FRAME_IO_HPP__
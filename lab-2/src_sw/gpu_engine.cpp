@@ -0,0 +1,42 @@
+/**
+ * @file gpu_engine.cpp
+ * @brief GpuDiffEngine for builds without the CUDA back end
+ *
+ * Built with -DIMAGE_DIFF_GPU, gpu_engine.cu provides the engine and this
+ * file is empty; otherwise create() reports the missing back end and the
+ * host's --gpu mode exits cleanly.
+ */
+
+#include "gpu_engine.hpp"
+
+#ifndef IMAGE_DIFF_GPU
+#include <iostream>
+
+struct GpuDiffEngine::Impl
+{
+    int height, width, num_slots;
+    std::string name;
+    EngineMetrics metrics;
+};
+
+std::unique_ptr<GpuDiffEngine> GpuDiffEngine::create(int, int, const PipelineConfig &, int, int)
+{
+    std::cout << "GpuDiffEngine: this build has no GPU back end (add gpu_engine.cu, -DIMAGE_DIFF_GPU)"
+              << std::endl;
+    return nullptr;
+}
+
+GpuDiffEngine::GpuDiffEngine(std::unique_ptr<Impl> impl) : impl_(std::move(impl)) {}
+GpuDiffEngine::~GpuDiffEngine() {}
+
+std::future<ImageDiffResult> GpuDiffEngine::submit(const uint8_t *, const uint8_t *, int)
+{
+    return std::future<ImageDiffResult>();
+}
+
+int GpuDiffEngine::height() const { return impl_->height; }
+int GpuDiffEngine::width() const { return impl_->width; }
+int GpuDiffEngine::num_slots() const { return impl_->num_slots; }
+const std::string &GpuDiffEngine::device_name() const { return impl_->name; }
+EngineMetrics &GpuDiffEngine::metrics() { return impl_->metrics; }
+#endif // IMAGE_DIFF_GPU
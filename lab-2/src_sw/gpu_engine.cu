@@ -0,0 +1,362 @@
+/**
+ * @file gpu_engine.cu
+ * @brief CUDA implementation of GpuDiffEngine (build with -DIMAGE_DIFF_GPU)
+ *
+ * One block produces a GPU_TILE_W x GPU_TILE_H output tile. Its threads
+ * first posterize the tile plus a 1-pixel halo into shared memory, then
+ * each filters its own pixel from there: the same split as V3's diff and
+ * filter stages, with the line buffers replaced by the shared tile. Halo
+ * taps past the frame are loaded from the replicated or mirrored position,
+ * so the filter itself has no edge cases; the zero and passthrough
+ * policies only replace the edge pixels' results. -DV3_MORPH's open/close
+ * runs as two more 3x3 passes through a scratch frame.
+ *
+ * Like ImageDiffEngine, every slot owns its pinned host buffers, device
+ * buffers and a stream, so submit() only copies the frames and enqueues
+ * H2D -> kernel(s) -> D2H.
+ */
+
+#include "gpu_engine.hpp"
+#include "../../inc/image_defines.h"
+
+#include <cuda_runtime.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#define GPU_CHECK(call)                                                                              \
+    do {                                                                                             \
+        cudaError_t gpu_err_ = (call);                                                               \
+        if (gpu_err_ != cudaSuccess) {                                                               \
+            printf("%s:%d Error calling " #call ", error code is: %s\n", __FILE__, __LINE__,         \
+                   cudaGetErrorString(gpu_err_));                                                    \
+            exit(EXIT_FAILURE);                                                                      \
+        }                                                                                            \
+    } while (0)
+
+// Output tile per block (one thread per pixel)
+#define GPU_TILE_W 32
+#define GPU_TILE_H 8
+
+// Pipeline settings, passed by value to every launch (no device globals, so
+// several engines with different settings can share a GPU)
+struct GpuPipeline
+{
+    int k[9];               // Sharpen taps, row-major
+    int shift;
+    int border;             // BORDER_*
+    uint8_t lut[256];       // |A - B| -> posterized level
+};
+
+// Row or column a tap past the frame reads under BORDER_REPLICATE /
+// BORDER_MIRROR (reflect-101, as in sharpen_border; a 1-pixel extent
+// replicates)
+__device__ static inline int gpu_border_index(int i, int n, bool mirror)
+{
+    if (i < 0)
+        return (mirror && n > 1) ? 1 : 0;
+    if (i >= n)
+        return (mirror && n > 1) ? n - 2 : n - 1;
+    return i;
+}
+
+__global__ void image_diff_fused(const uint8_t *A, const uint8_t *B, uint8_t *C, int height, int width,
+                                 const GpuPipeline p)
+{
+    __shared__ uint8_t tile[GPU_TILE_H + 2][GPU_TILE_W + 2];
+    const int x0 = blockIdx.x * GPU_TILE_W, y0 = blockIdx.y * GPU_TILE_H;
+    const bool mirror = (p.border == BORDER_MIRROR);
+
+    // Posterize tile + halo; cells past a partial tile load a valid pixel and go unused
+    for (int i = threadIdx.y * GPU_TILE_W + threadIdx.x; i < (GPU_TILE_H + 2) * (GPU_TILE_W + 2);
+         i += GPU_TILE_W * GPU_TILE_H)
+    {
+        const int ty = i / (GPU_TILE_W + 2), tx = i % (GPU_TILE_W + 2);
+        const size_t at = (size_t)gpu_border_index(y0 + ty - 1, height, mirror) * width
+                          + gpu_border_index(x0 + tx - 1, width, mirror);
+        const int a = A[at], b = B[at];
+        tile[ty][tx] = p.lut[(a > b) ? a - b : b - a];
+    }
+    __syncthreads();
+
+    const int x = x0 + threadIdx.x, y = y0 + threadIdx.y;
+    if (x >= width || y >= height)
+        return;
+    const int cy = threadIdx.y + 1, cx = threadIdx.x + 1;
+    const bool edge = (y == 0 || y == height - 1 || x == 0 || x == width - 1);
+    int v;
+    if (edge && p.border == BORDER_ZERO)
+        v = 0;
+    else if (edge && p.border == BORDER_PASSTHROUGH)
+        v = tile[cy][cx];
+    else
+    {
+        v = 0;
+        for (int r = 0; r < 3; r++)
+            for (int c = 0; c < 3; c++)
+                v += p.k[3 * r + c] * tile[cy + r - 1][cx + c - 1];
+        v >>= p.shift;
+        v = (v < 0) ? 0 : (v > 255) ? 255 : v;
+    }
+    C[(size_t)y * width + x] = (uint8_t)v;
+}
+
+// One 3x3 erode/dilate (MORPH_OP_*); taps past the frame are left out, as in morph_3x3
+__global__ void image_diff_morph(const uint8_t *in, uint8_t *out, int height, int width, int op)
+{
+    const int x = blockIdx.x * GPU_TILE_W + threadIdx.x, y = blockIdx.y * GPU_TILE_H + threadIdx.y;
+    if (x >= width || y >= height)
+        return;
+    int v = in[(size_t)y * width + x];
+    for (int yy = max(y - 1, 0); yy <= min(y + 1, height - 1); yy++)
+        for (int xx = max(x - 1, 0); xx <= min(x + 1, width - 1); xx++)
+        {
+            const int t = in[(size_t)yy * width + xx];
+            v = (op == MORPH_OP_ERODE) ? min(v, t) : max(v, t);
+        }
+    out[(size_t)y * width + x] = (uint8_t)v;
+}
+
+// =============================================================================
+// Slot pool
+// =============================================================================
+struct GpuDiffEngine::Impl
+{
+    struct Slot
+    {
+        uint8_t *hA, *hB, *hC;        // Pinned, compact rows
+        uint8_t *dA, *dB, *dC, *dT;   // dT: morph scratch
+        cudaStream_t stream;
+        cudaEvent_t start, h2d, krn, done;
+        std::promise<ImageDiffResult> result;
+        std::chrono::high_resolution_clock::time_point t_submit;
+    };
+
+    int device, height, width, num_slots, morph;
+    GpuPipeline pipe;
+    std::string name;
+    std::vector<std::unique_ptr<Slot>> slots;
+
+    std::mutex mutex;
+    std::condition_variable cv_free, cv_busy;
+    std::vector<Slot *> free;
+    std::deque<Slot *> busy;
+    bool stopping = false;
+    EngineMetrics metrics;
+    std::thread completer;
+
+    void enqueue(Slot *s);
+    void complete_loop();
+};
+
+static double event_us(cudaEvent_t from, cudaEvent_t to)
+{
+    float ms = 0.0f;
+    GPU_CHECK(cudaEventElapsedTime(&ms, from, to));
+    return ms * 1e3;
+}
+
+void GpuDiffEngine::Impl::enqueue(Slot *s)
+{
+    const size_t bytes = (size_t)height * width;
+    const dim3 block(GPU_TILE_W, GPU_TILE_H);
+    const dim3 grid((width + GPU_TILE_W - 1) / GPU_TILE_W, (height + GPU_TILE_H - 1) / GPU_TILE_H);
+    GPU_CHECK(cudaEventRecord(s->start, s->stream));
+    GPU_CHECK(cudaMemcpyAsync(s->dA, s->hA, bytes, cudaMemcpyHostToDevice, s->stream));
+    GPU_CHECK(cudaMemcpyAsync(s->dB, s->hB, bytes, cudaMemcpyHostToDevice, s->stream));
+    GPU_CHECK(cudaEventRecord(s->h2d, s->stream));
+    image_diff_fused<<<grid, block, 0, s->stream>>>(s->dA, s->dB, s->dC, height, width, pipe);
+    if (morph != MORPH_NONE)
+    {
+        // First op into the scratch frame, second back into C
+        image_diff_morph<<<grid, block, 0, s->stream>>>(s->dC, s->dT, height, width, MORPH_FIRST_OP(morph));
+        image_diff_morph<<<grid, block, 0, s->stream>>>(s->dT, s->dC, height, width, MORPH_SECOND_OP(morph));
+    }
+    GPU_CHECK(cudaGetLastError());
+    GPU_CHECK(cudaEventRecord(s->krn, s->stream));
+    GPU_CHECK(cudaMemcpyAsync(s->hC, s->dC, bytes, cudaMemcpyDeviceToHost, s->stream));
+    GPU_CHECK(cudaEventRecord(s->done, s->stream));
+}
+
+// Retire slots oldest first; on shutdown, drain before returning
+void GpuDiffEngine::Impl::complete_loop()
+{
+    GPU_CHECK(cudaSetDevice(device));
+    for (;;)
+    {
+        Slot *s;
+        {
+            std::unique_lock<std::mutex> lk(mutex);
+            cv_busy.wait(lk, [this] { return stopping || !busy.empty(); });
+            if (busy.empty())
+                return;
+            s = busy.front();
+            busy.pop_front();
+        }
+        GPU_CHECK(cudaEventSynchronize(s->done));
+
+        ImageDiffResult res;
+        res.C.assign(s->hC, s->hC + (size_t)height * width);
+        res.changed = std::any_of(res.C.begin(), res.C.end(), [](uint8_t v) { return v != 0; });
+        res.on_cpu = false;
+        res.latency_ms = std::chrono::duration<double, std::milli>(
+                             std::chrono::high_resolution_clock::now() - s->t_submit).count();
+        metrics.h2d.record(event_us(s->start, s->h2d));
+        metrics.kernel.record(event_us(s->h2d, s->krn));
+        metrics.d2h.record(event_us(s->krn, s->done));
+        metrics.end_to_end.record(res.latency_ms * 1e3);
+        metrics.frames.fetch_add(1, std::memory_order_relaxed);
+        metrics.queue_depth.fetch_sub(1, std::memory_order_relaxed);
+        s->result.set_value(std::move(res));
+
+        {
+            std::lock_guard<std::mutex> lk(mutex);
+            free.push_back(s);
+        }
+        cv_free.notify_one();
+    }
+}
+
+// =============================================================================
+// GpuDiffEngine
+// =============================================================================
+std::unique_ptr<GpuDiffEngine> GpuDiffEngine::create(int height, int width, const PipelineConfig &cfg,
+                                                     int num_slots, int device)
+{
+    int count = 0;
+    if (cudaGetDeviceCount(&count) != cudaSuccess || device < 0 || device >= count)
+    {
+        std::cout << "GpuDiffEngine: no CUDA device " << device << " (" << count << " found)" << std::endl;
+        return nullptr;
+    }
+    if (num_slots < 1 || height < 1 || width < 1)
+    {
+        std::cout << "GpuDiffEngine: need a non-empty frame and at least one slot" << std::endl;
+        return nullptr;
+    }
+    GPU_CHECK(cudaSetDevice(device));
+    cudaDeviceProp prop;
+    GPU_CHECK(cudaGetDeviceProperties(&prop, device));
+
+    std::unique_ptr<Impl> impl(new Impl);
+    impl->device    = device;
+    impl->height    = height;
+    impl->width     = width;
+    impl->num_slots = num_slots;
+    impl->morph     = cfg.morph;
+    impl->name      = prop.name;
+
+    // Same table as cpu_engine_set_posterize()
+    for (int r = 0; r < 3; r++)
+        for (int c = 0; c < 3; c++)
+            impl->pipe.k[3 * r + c] = cfg.k[r][c];
+    impl->pipe.shift  = cfg.shift;
+    impl->pipe.border = cfg.border;
+    int t = 0;
+    for (int d = 0; d < 256; d++)
+    {
+        while (t < cfg.levels - 1 && d >= cfg.thr[t])
+            t++;
+        impl->pipe.lut[d] = (uint8_t)POSTERIZE_LEVEL_VALUE(t, cfg.levels);
+    }
+
+    const size_t bytes = (size_t)height * width;
+    for (int i = 0; i < num_slots; i++)
+    {
+        std::unique_ptr<Impl::Slot> s(new Impl::Slot);
+        GPU_CHECK(cudaMallocHost((void **)&s->hA, bytes));
+        GPU_CHECK(cudaMallocHost((void **)&s->hB, bytes));
+        GPU_CHECK(cudaMallocHost((void **)&s->hC, bytes));
+        GPU_CHECK(cudaMalloc((void **)&s->dA, bytes));
+        GPU_CHECK(cudaMalloc((void **)&s->dB, bytes));
+        GPU_CHECK(cudaMalloc((void **)&s->dC, bytes));
+        GPU_CHECK(cudaMalloc((void **)&s->dT, cfg.morph != MORPH_NONE ? bytes : 1));
+        GPU_CHECK(cudaStreamCreateWithFlags(&s->stream, cudaStreamNonBlocking));
+        GPU_CHECK(cudaEventCreate(&s->start));
+        GPU_CHECK(cudaEventCreate(&s->h2d));
+        GPU_CHECK(cudaEventCreate(&s->krn));
+        GPU_CHECK(cudaEventCreate(&s->done));
+        impl->free.push_back(s.get());
+        impl->slots.push_back(std::move(s));
+    }
+    impl->metrics.device_up.store(1, std::memory_order_relaxed);
+    Impl *raw = impl.get();
+    impl->completer = std::thread([raw] { raw->complete_loop(); });
+    return std::unique_ptr<GpuDiffEngine>(new GpuDiffEngine(std::move(impl)));
+}
+
+GpuDiffEngine::GpuDiffEngine(std::unique_ptr<Impl> impl) : impl_(std::move(impl)) {}
+
+GpuDiffEngine::~GpuDiffEngine()
+{
+    {
+        std::lock_guard<std::mutex> lk(impl_->mutex);
+        impl_->stopping = true;
+    }
+    impl_->cv_busy.notify_all();
+    impl_->completer.join();
+
+    GPU_CHECK(cudaSetDevice(impl_->device));
+    for (auto &s : impl_->slots)
+    {
+        cudaEventDestroy(s->start);
+        cudaEventDestroy(s->h2d);
+        cudaEventDestroy(s->krn);
+        cudaEventDestroy(s->done);
+        cudaStreamDestroy(s->stream);
+        cudaFree(s->dA);
+        cudaFree(s->dB);
+        cudaFree(s->dC);
+        cudaFree(s->dT);
+        cudaFreeHost(s->hA);
+        cudaFreeHost(s->hB);
+        cudaFreeHost(s->hC);
+    }
+}
+
+std::future<ImageDiffResult> GpuDiffEngine::submit(const uint8_t *A, const uint8_t *B, int pitch)
+{
+    Impl &e = *impl_;
+    if (pitch == 0)
+        pitch = e.width;
+    Impl::Slot *s;
+    {
+        std::unique_lock<std::mutex> lk(e.mutex);
+        e.cv_free.wait(lk, [&e] { return !e.free.empty(); });
+        s = e.free.back();
+        e.free.pop_back();
+    }
+    s->t_submit = std::chrono::high_resolution_clock::now();
+    for (int r = 0; r < e.height; r++)
+    {
+        std::memcpy(s->hA + (size_t)r * e.width, A + (size_t)r * pitch, e.width);
+        std::memcpy(s->hB + (size_t)r * e.width, B + (size_t)r * pitch, e.width);
+    }
+    s->result = std::promise<ImageDiffResult>();
+    std::future<ImageDiffResult> fut = s->result.get_future();
+
+    GPU_CHECK(cudaSetDevice(e.device));
+    e.metrics.queue_depth.fetch_add(1, std::memory_order_relaxed);
+    {
+        // Enqueue under the lock so busy stays in submission order
+        std::lock_guard<std::mutex> lk(e.mutex);
+        e.enqueue(s);
+        e.busy.push_back(s);
+    }
+    e.cv_busy.notify_one();
+    return fut;
+}
+
+int GpuDiffEngine::height() const { return impl_->height; }
+int GpuDiffEngine::width() const { return impl_->width; }
+int GpuDiffEngine::num_slots() const { return impl_->num_slots; }
+const std::string &GpuDiffEngine::device_name() const { return impl_->name; }
+EngineMetrics &GpuDiffEngine::metrics() { return impl_->metrics; }
@@ -0,0 +1,65 @@
+/**
+ * @file gpu_engine.hpp
+ * @brief GPU back end (CUDA) for the diff + posterize + sharpen pipeline
+ *
+ * GpuDiffEngine has ImageDiffEngine's front end for nodes with a GPU and
+ * no card: submit(A, B) copies the pair into a free slot of pinned host
+ * buffers (blocking while every slot is in flight), enqueues H2D -> kernel
+ * -> D2H on the slot's stream and returns a future, and a completion thread
+ * retires slots in submission order. metrics() is filled the same way,
+ * with the per-stage times taken from CUDA events.
+ *
+ * The kernel fuses the pipeline: each block posterizes its tile plus a
+ * 1-pixel halo into shared memory, then filters the tile from there, so
+ * every input byte is read from global memory about once and the
+ * posterized frame never leaves the SM. Results match cpu_engine for every
+ * PipelineConfig (taps, shift, border policy, posterize table, morph).
+ *
+ * gpu_engine.cu holds the implementation and is built with nvcc and
+ * -DIMAGE_DIFF_GPU (link cudart). Without it, gpu_engine.cpp provides a
+ * create() that reports the missing back end, so host.cpp builds either way.
+ */
+
+#ifndef GPU_ENGINE_HPP__
+#define GPU_ENGINE_HPP__
+
+#include "image_diff_engine.hpp"
+#include "metrics.hpp"
+
+#include <future>
+#include <memory>
+#include <string>
+
+class GpuDiffEngine
+{
+public:
+    // Set up num_slots (>= 1) slots for height x width frames on CUDA device
+    // `device`. Returns nullptr (with a message on stdout) if there is no
+    // such device or this build has no GPU back end.
+    static std::unique_ptr<GpuDiffEngine> create(int height, int width, const PipelineConfig &cfg, int num_slots,
+                                                 int device = 0);
+
+    // Waits for every submitted frame, then releases the device
+    ~GpuDiffEngine();
+
+    GpuDiffEngine(const GpuDiffEngine &) = delete;
+    GpuDiffEngine &operator=(const GpuDiffEngine &) = delete;
+
+    // Thread-safe; same contract as ImageDiffEngine::submit(). The change
+    // flag is set when any result pixel is non-zero, as on the CPU failover.
+    std::future<ImageDiffResult> submit(const uint8_t *A, const uint8_t *B, int pitch = 0);
+
+    int height() const;
+    int width() const;
+    int num_slots() const;
+    const std::string &device_name() const;
+
+    EngineMetrics &metrics();
+
+private:
+    struct Impl;
+    explicit GpuDiffEngine(std::unique_ptr<Impl> impl);
+    std::unique_ptr<Impl> impl_;
+};
+
+#endif // GPU_ENGINE_HPP__
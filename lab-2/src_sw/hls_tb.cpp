@@ -2,53 +2,398 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h> // Required for memcpy
+#include <vector>
+#include <algorithm>
+#include <chrono>
 #include "../inc/image_defines.h"
+#include "../inc/test_pattern.h"
 
+// Pixel format under test: V3 (and V4/V5, which reuse its stages) built with
+// -DV3_CHANNEL_BITS / -DV3_CHANNELS; V1/V2 are 8-bit mono and are tested
+// with the default. Images are held as TB_CHANNELS samples per pixel.
+typedef v3_channel_t tb_sample_t;
+#define TB_CHANNELS         V3_CHANNELS
+#define TB_PIXEL_BYTES      (V3_PIXEL_BITS / 8)
+#define TB_PIXELS_PER_CHUNK V3_PIXELS_PER_CHUNK
+#define TB_MAX_VALUE        ((1 << V3_CHANNEL_BITS) - 1)
+#define TB_THR_SHIFT        (V3_CHANNEL_BITS - 8)
+
+// Test data (test_pattern.h): -DTB_SEED=S picks another input set,
+// -DTB_NOISE=TP_NOISE_GAUSSIAN / TP_NOISE_SPARSE another B = A + noise shape
+#ifndef TB_SEED
+#define TB_SEED  TP_DEFAULT_SEED
+#endif
+#ifndef TB_NOISE
+#define TB_NOISE TP_NOISE_UNIFORM
+#endif
+
+// V3 built with -DV3_POST_TAP / -DV3_STATS / -DV3_PROFILE takes a packed
+// posterize / statistics / counter buffer
+#ifdef V3_POST_TAP
+#define TB_POST_TAP_ONLY(...) __VA_ARGS__
+#else
+#define TB_POST_TAP_ONLY(...)
+#endif
+#ifdef V3_STATS
+#define TB_STATS_ONLY(...) __VA_ARGS__
+#else
+#define TB_STATS_ONLY(...)
+#endif
+#ifdef V3_PROFILE
+#define TB_PROF_ONLY(...) __VA_ARGS__
+#else
+#define TB_PROF_ONLY(...)
+#endif
+// V3 built with -DV3_COMPRESS writes only the non-zero chunks of C plus an
+// index; they are expanded back with comp_decode() before the comparison
+#ifdef V3_COMPRESS
+#include "../inc/result_codec.h"
+#define TB_COMPRESS_ONLY(...) __VA_ARGS__
+#else
+#define TB_COMPRESS_ONLY(...)
+#endif
+// V3 built with -DV3_ROI takes an ROI list; every case is run as the four
+// ROIs of tb_rois(), which tile the frame, so C still covers every pixel and
+// the ROI seams check the context rows/chunks
+#ifdef V3_ROI
+#define TB_ROI_ONLY(...) __VA_ARGS__
+#define TB_NUM_ROIS 4
+#else
+#define TB_ROI_ONLY(...)
+#endif
+// V3 built with -DV3_MORPH takes the case's morph_mode; the reference opens
+// or closes its sharpened frame the same way
+#ifdef V3_MORPH
+#define TB_MORPH_ONLY(...) __VA_ARGS__
+#else
+#define TB_MORPH_ONLY(...)
+#endif
+// V3 built with -DV3_BLOBS writes each frame's blob list, checked against
+// blob_list_ref() on the white posterized pixels
+#ifdef V3_BLOBS
+#include "../inc/blob_list.h"
+#define TB_BLOBS_ONLY(...) __VA_ARGS__
+#else
+#define TB_BLOBS_ONLY(...)
+#endif
+// V3 built with -DV3_PYRAMID also writes the result at 1/2 and 1/4
+// resolution, checked against pyramid_level_ref() on the reference result
+#ifdef V3_PYRAMID
+#include "../inc/pyramid.h"
+#define TB_PYRAMID_ONLY(...) __VA_ARGS__
+#else
+#define TB_PYRAMID_ONLY(...)
+#endif
+
+// V3 built with -DV3_LUMA reads A/B in camera layout: every case is packed
+// as tb_in_format frames around its luma (luma_pack_ref()), and the luma the
+// front end sees (luma_convert_ref()) is what the reference runs on
+#ifdef V3_LUMA
+#include "../inc/luma.h"
+#define TB_LUMA_ONLY(...) __VA_ARGS__
+static int tb_in_format = LUMA_Y8;
+#else
+#define TB_LUMA_ONLY(...)
+#endif
+
+#ifdef TB_V4
+// -DTB_V4 tests the AXI4-Stream top (accelerated_v4.cpp) through the same
+// cases: an adapter streams each frame in, one free-running iteration per
+// frame, and checks that TLAST marks exactly the frame's last beat.
+#include <hls_stream.h>
+
+extern "C" void IMAGE_DIFF_STREAM(hls::stream<axis512_t> &A, hls::stream<axis512_t> &B, hls::stream<axis512_t> &C,
+                                  int height, int width,
+                                  int coef_r0, int coef_r1, int coef_r2, int coef_shift, int border_mode,
+                                  int post_thr03, int post_thr46, int post_levels);
+
+static int tb_adapter_errors = 0;
+
+static void IMAGE_DIFF_POSTERIZE(const uint512_t *A, const uint512_t *B, uint512_t *C,
+                                 int height, int width, int stride_chunks, int num_frames,
+                                 int coef_r0, int coef_r1, int coef_r2, int coef_shift, int border_mode,
+                                 int post_thr03, int post_thr46, int post_levels,
+                                 uint64_t *change_map)
+{
+    const int frame_chunks = height * stride_chunks;
+    (void)change_map; // No change map on a stream-only kernel
+    for (int f = 0; f < num_frames; f++) {
+        hls::stream<axis512_t> s_A, s_B, s_C;
+        for (int i = 0; i < frame_chunks; i++) {
+            axis512_t beat;
+            beat.last = (i == frame_chunks - 1);
+            beat.data = A[f * frame_chunks + i];
+            s_A.write(beat);
+            beat.data = B[f * frame_chunks + i];
+            s_B.write(beat);
+        }
+        IMAGE_DIFF_STREAM(s_A, s_B, s_C, height, width, coef_r0, coef_r1, coef_r2, coef_shift, border_mode,
+                          post_thr03, post_thr46, post_levels);
+        for (int i = 0; i < frame_chunks; i++) {
+            const axis512_t beat = s_C.read();
+            C[f * frame_chunks + i] = beat.data;
+            if ((int)beat.last != (i == frame_chunks - 1)) {
+                printf("TLAST error at frame %d beat %d\n", f, i);
+                tb_adapter_errors++;
+            }
+        }
+        if (!s_C.empty()) {
+            printf("Frame %d: %d extra output beats\n", f, (int)s_C.size());
+            tb_adapter_errors++;
+        }
+    }
+}
+#elif defined(TB_V6)
+// -DTB_V6 tests the descriptor-ring top (accelerated_v6.cpp): the adapter
+// plays the host, publishing one descriptor per frame and calling the kernel
+// once per frame the way auto-restart would. The ring and status persist
+// across cases, so the done count keeps growing and the slots wrap; every
+// case ends with a stop descriptor, which must retire without output. Each
+// frame's change map block is separate, so only single-frame cases compare it.
+extern "C" void IMAGE_DIFF_RING(const uint512_t *A, const uint512_t *B, uint512_t *C,
+                                int height, int width, int stride_chunks,
+                                int coef_r0, int coef_r1, int coef_r2, int coef_shift, int border_mode,
+                                int post_thr03, int post_thr46, int post_levels,
+                                uint64_t *change_map, volatile uint64_t *ring, volatile uint64_t *status);
+
+static int tb_adapter_errors = 0;
+static bool tb_skip_map = false;
+
+static void IMAGE_DIFF_POSTERIZE(const uint512_t *A, const uint512_t *B, uint512_t *C,
+                                 int height, int width, int stride_chunks, int num_frames,
+                                 int coef_r0, int coef_r1, int coef_r2, int coef_shift, int border_mode,
+                                 int post_thr03, int post_thr46, int post_levels,
+                                 uint64_t *change_map)
+{
+    static uint64_t ring[RING_WORDS];
+    static uint64_t status[RING_STATUS_WORDS];
+    const int frame_chunks = height * stride_chunks;
+    std::vector<uint64_t> maps((size_t)num_frames * CHANGE_MAP_WORDS(height, stride_chunks, 1));
+    // The batch back to front, so the offsets (not the call order) place each frame
+    for (int n = 0; n <= num_frames; n++) {
+        const bool stop = (n == num_frames);
+        const int f = stop ? 0 : num_frames - 1 - n;
+        const uint32_t seq = (uint32_t)status[RING_STATUS_DONE] + 1;
+        uint64_t *desc = &ring[(seq - 1) % RING_ENTRIES * RING_DESC_WORDS];
+        const std::vector<uint512_t> before(C, C + (stop ? frame_chunks : 0));
+        desc[RING_DESC_A] = desc[RING_DESC_B] = desc[RING_DESC_C] = (uint64_t)f * frame_chunks;
+        desc[0] = RING_DESC_HEAD(seq, f, stop ? RING_FLAG_STOP : 0);
+        IMAGE_DIFF_RING(A, B, C, height, width, stride_chunks, coef_r0, coef_r1, coef_r2, coef_shift, border_mode,
+                        post_thr03, post_thr46, post_levels, maps.data(), ring, status);
+        if (status[RING_STATUS_DONE] != seq || status[RING_STATUS_FRAME] != (uint64_t)f) {
+            printf("Ring: descriptor %u retired as done %llu, frame %llu\n", seq,
+                   (unsigned long long)status[RING_STATUS_DONE], (unsigned long long)status[RING_STATUS_FRAME]);
+            tb_adapter_errors++;
+        }
+        for (int i = 0; i < (int)before.size(); i++) {
+            if (C[i] != before[i]) {
+                printf("Ring: stop descriptor %u wrote C chunk %d\n", seq, i);
+                tb_adapter_errors++;
+                break;
+            }
+        }
+    }
+    tb_skip_map = (num_frames > 1);
+    if (num_frames == 1)
+        std::copy(maps.begin(), maps.end(), change_map);
+}
+#elif defined(TB_V5)
+// -DTB_V5 tests the split diff/sharpen kernels (accelerated_v5.cpp): the
+// diff kernel posterizes the batch into the stream out_sel picks, and the
+// sharpen kernel on that stream finishes it. Successive cases alternate
+// out_sel, the way the host alternates between two sharpen CUs.
+#include <hls_stream.h>
+
+extern "C" void IMAGE_DIFF_SPLIT(const uint512_t *A, const uint512_t *B,
+                                 hls::stream<axis512_t> &out0, hls::stream<axis512_t> &out1,
+                                 int height, int stride_chunks, int num_frames,
+                                 int post_thr03, int post_thr46, int post_levels,
+                                 uint64_t *change_map, int out_sel);
+extern "C" void IMAGE_SHARPEN_SPLIT(hls::stream<axis512_t> &in, uint512_t *C,
+                                    int height, int width, int stride_chunks, int num_frames,
+                                    int coef_r0, int coef_r1, int coef_r2, int coef_shift, int border_mode);
+
+static int tb_adapter_errors = 0;
+
+static void IMAGE_DIFF_POSTERIZE(const uint512_t *A, const uint512_t *B, uint512_t *C,
+                                 int height, int width, int stride_chunks, int num_frames,
+                                 int coef_r0, int coef_r1, int coef_r2, int coef_shift, int border_mode,
+                                 int post_thr03, int post_thr46, int post_levels,
+                                 uint64_t *change_map)
+{
+    static int out_sel = 0;
+    hls::stream<axis512_t> s_link[2];
+    IMAGE_DIFF_SPLIT(A, B, s_link[0], s_link[1], height, stride_chunks, num_frames,
+                     post_thr03, post_thr46, post_levels, change_map, out_sel);
+    if (!s_link[1 - out_sel].empty()) {
+        printf("Diff kernel wrote to the unselected output %d\n", 1 - out_sel);
+        tb_adapter_errors++;
+    }
+    IMAGE_SHARPEN_SPLIT(s_link[out_sel], C, height, width, stride_chunks, num_frames,
+                        coef_r0, coef_r1, coef_r2, coef_shift, border_mode);
+    if (!s_link[out_sel].empty()) {
+        printf("Sharpen kernel left %d beats unread\n", (int)s_link[out_sel].size());
+        tb_adapter_errors++;
+    }
+    out_sel = 1 - out_sel;
+}
+#else
 // Declaration of top-level HW function
-extern "C" void IMAGE_DIFF_POSTERIZE(const uint512_t *A, const uint512_t *B, uint512_t *C);
+extern "C" void IMAGE_DIFF_POSTERIZE(const uint512_t *A, const uint512_t *B, uint512_t *C,
+                                     int height, int width, int stride_chunks, int num_frames,
+                                     int coef_r0, int coef_r1, int coef_r2, int coef_shift, int border_mode,
+                                     int post_thr03, int post_thr46, int post_levels,
+                                     uint64_t *change_map
+                                     TB_POST_TAP_ONLY(, uint512_t *post_tap)
+                                     TB_STATS_ONLY(, uint64_t *stats)
+                                     TB_PROF_ONLY(, uint64_t *prof)
+                                     TB_COMPRESS_ONLY(, uint64_t *comp_index)
+                                     TB_ROI_ONLY(, const uint64_t *rois, int num_rois)
+                                     TB_MORPH_ONLY(, int morph_mode)
+                                     TB_BLOBS_ONLY(, uint64_t *blobs)
+                                     TB_PYRAMID_ONLY(, uint512_t *pyr_half, uint512_t *pyr_quarter)
+                                     TB_LUMA_ONLY(, int in_format));
+#endif
+
+// Sharpen taps for one test case (rows packed with SHARPEN_PACK_ROW) and border policy
+struct tb_filter_t
+{
+    int r0, r1, r2, shift;
+    int border; // BORDER_*; cases that leave it out get BORDER_ZERO
+    int morph;  // MORPH_* (-DV3_MORPH only); likewise MORPH_NONE
+};
+
+static const tb_filter_t TB_SHARPEN = {SHARPEN_DEFAULT_R0, SHARPEN_DEFAULT_R1, SHARPEN_DEFAULT_R2, SHARPEN_DEFAULT_SHIFT};
+
+// Posterize table for one test case (thresholds packed with POSTERIZE_PACK4)
+struct tb_posterize_t
+{
+    int thr03, thr46, levels;
+};
+
+static const tb_posterize_t TB_POSTERIZE = {POSTERIZE_DEFAULT_THR03, POSTERIZE_DEFAULT_THR46, POSTERIZE_DEFAULT_LEVELS};
+
+// Input data for one test case: random (pattern < 0) or a tp_fill_edge() pattern
+struct tb_input_t
+{
+    tp_config_t tp;
+    int pattern;    // tp_pattern_t, or -1 for tp_fill_pair() noise
+    int cell;       // Checkerboard cell, in pixels
+};
+
+static const tb_input_t TB_INPUT = {{TB_SEED, TB_NOISE, TP_DEFAULT_AMPLITUDE}, -1, 1};
+
+// --stress runs many cases quietly and reports the kernel's C-sim throughput
+static bool tb_quiet = false;
+static double tb_kernel_seconds = 0;
+static double tb_kernel_pixels = 0;
+
+#if !defined(TB_V4) && !defined(TB_V5) && !defined(TB_V6)
+// One kernel call with the optional outputs of a V3 build in scratch buffers
+// and no ROIs; used for the property query and the refused-frame check
+static void tb_call_plain(const uint512_t *A, const uint512_t *B, uint512_t *C,
+                          int height, int width, int stride_chunks, int num_frames, uint64_t *change_map)
+{
+    static uint512_t wide_scratch[64];
+    static uint64_t scratch[4096];
+    (void)wide_scratch;
+    (void)scratch;
+    IMAGE_DIFF_POSTERIZE(A, B, C, height, width, stride_chunks, num_frames,
+                         SHARPEN_DEFAULT_R0, SHARPEN_DEFAULT_R1, SHARPEN_DEFAULT_R2, SHARPEN_DEFAULT_SHIFT,
+                         BORDER_DEFAULT, POSTERIZE_DEFAULT_THR03, POSTERIZE_DEFAULT_THR46, POSTERIZE_DEFAULT_LEVELS,
+                         change_map
+                         TB_POST_TAP_ONLY(, wide_scratch)
+                         TB_STATS_ONLY(, scratch) TB_PROF_ONLY(, scratch) TB_COMPRESS_ONLY(, scratch)
+                         TB_ROI_ONLY(, scratch, 0) TB_MORPH_ONLY(, MORPH_NONE)
+                         TB_BLOBS_ONLY(, scratch)
+                         TB_PYRAMID_ONLY(, wide_scratch, wide_scratch)
+                         TB_LUMA_ONLY(, LUMA_Y8));
+}
+#endif
+
+#if !defined(TB_V4) && !defined(TB_V5) && !defined(TB_V6)
+// The num_frames = 0 properties word (KERNEL_PROPS_*) of the kernel under test
+static uint64_t tb_kernel_props()
+{
+    static bool queried = false;
+    static uint64_t props[1] = {0};
+    if (!queried) {
+        uint512_t frame[1];
+        tb_call_plain(frame, frame, frame, 3, 3, 1, 0, props);
+        queried = true;
+    }
+    return props[0];
+}
+#endif
+
+// Widest frame the kernel under test takes (KERNEL_PROPS_*); wider cases are skipped
+static int tb_max_width()
+{
+#if defined(TB_V4)
+    return V4_MAX_WIDTH;
+#elif defined(TB_V5) || defined(TB_V6)
+    return MAX_WIDTH;
+#else
+    const int w = KERNEL_PROPS_MAX_WIDTH(tb_kernel_props());
+    return (w > 0 && w < MAX_WIDTH) ? w : MAX_WIDTH;
+#endif
+}
 
 // -----------------------------------------------------------------------------
 // Fast Data Movement (Replaces slow loops with memcpy)
 // -----------------------------------------------------------------------------
 
+// Pixels of a row that fall in chunk c (the last chunk of a row may be partial)
+static int chunk_pixels(int width, int c)
+{
+    const int left = width - c * TB_PIXELS_PER_CHUNK;
+    return (left < TB_PIXELS_PER_CHUNK) ? left : TB_PIXELS_PER_CHUNK;
+}
+
 // Pack pixels: Copies valid rows from 'logical' buffer to 'padded' 512-bit chunks
-static void pack_pixels_fast(const pixel_t *logical_pixels, uint512_t *hw_chunks)
+static void pack_pixels_fast(const tb_sample_t *logical_pixels, uint512_t *hw_chunks,
+                             int height, int width, int stride_chunks)
 {
     // 1. Cast the HW buffer to bytes for easy addressing
-    pixel_t *raw_hw_ptr = (pixel_t*)hw_chunks;
+    uint8_t *raw_hw_ptr = (uint8_t*)hw_chunks;
 
-    // 2. Zero out the entire buffer first (handles all padding automatically)
+    // 2. Zero out the entire buffer first (handles row and chunk padding)
     //    sizeof(uint512_t) is 64 bytes
-    memset(raw_hw_ptr, 0, TOTAL_CHUNKS * PIXELS_PER_CHUNK);
+    memset(raw_hw_ptr, 0, (size_t)height * stride_chunks * sizeof(uint512_t));
 
-    // 3. Copy row-by-row
-    for (int r = 0; r < HEIGHT; r++)
+    // 3. Copy chunk-by-chunk: pixels are contiguous within a chunk, but a
+    //    chunk may end in padding bits (RGB888), so rows are not contiguous
+    for (int r = 0; r < height; r++)
     {
         // Source: Logical buffer (packed, no stride)
-        const pixel_t *src_row = &logical_pixels[r * WIDTH];
-        
+        const tb_sample_t *src_row = &logical_pixels[(size_t)r * width * TB_CHANNELS];
+
         // Dest: HW buffer (strided)
-        pixel_t *dst_row = &raw_hw_ptr[r * PADDED_WIDTH ];
+        uint8_t *dst_row = &raw_hw_ptr[(size_t)r * stride_chunks * sizeof(uint512_t)];
 
-        // Fast block copy
-        memcpy(dst_row, src_row, WIDTH);
+        for (int c = 0; c * TB_PIXELS_PER_CHUNK < width; c++)
+            memcpy(dst_row + c * sizeof(uint512_t), src_row + c * TB_PIXELS_PER_CHUNK * TB_CHANNELS,
+                   chunk_pixels(width, c) * TB_PIXEL_BYTES);
     }
 }
 
 // Unpack pixels: Copies valid rows from 'padded' 512-bit chunks to 'logical' buffer
-static void unpack_pixels_fast(const uint512_t *hw_chunks, pixel_t *logical_pixels)
+static void unpack_pixels_fast(const uint512_t *hw_chunks, tb_sample_t *logical_pixels,
+                               int height, int width, int stride_chunks)
 {
-    const pixel_t *raw_hw_ptr = (const pixel_t*)hw_chunks;
+    const uint8_t *raw_hw_ptr = (const uint8_t*)hw_chunks;
 
-    for (int r = 0; r < HEIGHT; r++)
+    for (int r = 0; r < height; r++)
     {
         // Source: HW buffer (strided)
-        const pixel_t *src_row = &raw_hw_ptr[r * PADDED_WIDTH ];
+        const uint8_t *src_row = &raw_hw_ptr[(size_t)r * stride_chunks * sizeof(uint512_t)];
 
         // Dest: Logical buffer
-        pixel_t *dst_row = &logical_pixels[r * WIDTH];
+        tb_sample_t *dst_row = &logical_pixels[(size_t)r * width * TB_CHANNELS];
 
-        memcpy(dst_row, src_row, WIDTH);
+        for (int c = 0; c * TB_PIXELS_PER_CHUNK < width; c++)
+            memcpy(dst_row + c * TB_PIXELS_PER_CHUNK * TB_CHANNELS, src_row + c * sizeof(uint512_t),
+                   chunk_pixels(width, c) * TB_PIXEL_BYTES);
     }
 }
 
@@ -56,81 +401,603 @@ static void unpack_pixels_fast(const uint512_t *hw_chunks, pixel_t *logical_pixe
 // Software reference
 // -----------------------------------------------------------------------------
 
+// Thresholds and level values are 8-bit, scaled to the sample range
+static int sw_posterize_level(int diff, const tb_posterize_t &post)
+{
+    int level = 0;
+    while (level < post.levels - 1 &&
+           diff >= (((level < 4) ? POSTERIZE_THR(post.thr03, level) : POSTERIZE_THR(post.thr46, level - 4))
+                    << TB_THR_SHIFT))
+        level++;
+    return level;
+}
+
+static tb_sample_t sw_posterize(int diff, const tb_posterize_t &post)
+{
+    return (tb_sample_t)(POSTERIZE_LEVEL_VALUE(sw_posterize_level(diff, post), post.levels) * (TB_MAX_VALUE / 255));
+}
+
+// Coordinate of an out-of-frame tap (-1 or len) under a border policy,
+// the way OpenCV's borderInterpolate maps it
+static int sw_border_index(int p, int len, int border)
+{
+    if (p >= 0 && p < len)
+        return p;
+    const bool mirror = (border == BORDER_MIRROR) && len > 1;
+    if (p < 0)
+        return mirror ? 1 : 0;
+    return mirror ? len - 2 : len - 1;
+}
+
 // Simplified SW Reference acting on Logical Buffers (Faster/Cleaner)
-void sw_reference_logical(const pixel_t *A, const pixel_t *B, pixel_t *C_ref)
+// Each channel is filtered on its own
+void sw_reference_logical(const tb_sample_t *A, const tb_sample_t *B, tb_sample_t *C_ref, int height, int width,
+                          const tb_filter_t &flt, const tb_posterize_t &post)
 {
+    const int rows[3] = {flt.r0, flt.r1, flt.r2};
+    const int samples = width * height * TB_CHANNELS;
+
     // Intermediate buffer
-    static pixel_t P[WIDTH * HEIGHT];
+    std::vector<tb_sample_t> P(samples);
 
-    for (int i = 0; i < WIDTH * HEIGHT; i++) {
+    for (int i = 0; i < samples; i++) {
         int diff = (int)A[i] - (int)B[i];
         if (diff < 0) diff = -diff;
-        P[i] = (diff < THRESH_LOW) ? 0 : (diff < THRESH_HIGH) ? 128 : 255;
-    }
-
-    for (int r = 0; r < HEIGHT; r++) {
-        for (int c = 0; c < WIDTH; c++) {
-            int idx = r * WIDTH + c;
-            if (r == 0 || r == HEIGHT-1 || c == 0 || c == WIDTH-1) {
-                C_ref[idx] = 0;
-            } else {
-                int val = 5 * P[idx] 
-                        - P[idx - WIDTH] - P[idx + WIDTH] 
-                        - P[idx - 1]     - P[idx + 1];
-                if (val < 0) val = 0;
-                if (val > 255) val = 255;
-                C_ref[idx] = (pixel_t)val;
+        P[i] = sw_posterize(diff, post);
+    }
+
+    for (int r = 0; r < height; r++) {
+        for (int c = 0; c < width; c++) {
+            for (int ch = 0; ch < TB_CHANNELS; ch++) {
+                int idx = (r * width + c) * TB_CHANNELS + ch;
+                const bool edge = (r == 0 || r == height-1 || c == 0 || c == width-1);
+                if (edge && flt.border == BORDER_ZERO) {
+                    C_ref[idx] = 0;
+                } else if (edge && flt.border == BORDER_PASSTHROUGH) {
+                    C_ref[idx] = P[idx];
+                } else {
+                    int val = 0;
+                    for (int dr = -1; dr <= 1; dr++)
+                        for (int dc = -1; dc <= 1; dc++)
+                            val += SHARPEN_TAP(rows[dr + 1], dc + 1) *
+                                   P[(sw_border_index(r + dr, height, flt.border) * width +
+                                      sw_border_index(c + dc, width, flt.border)) * TB_CHANNELS + ch];
+                    val >>= flt.shift;
+                    if (val < 0) val = 0;
+                    if (val > TB_MAX_VALUE) val = TB_MAX_VALUE;
+                    C_ref[idx] = (tb_sample_t)val;
+                }
             }
         }
     }
 }
 
-int main()
+// One 3x3 erode/dilate pass (MORPH_OP_*) over in-frame taps only
+static void sw_morph_pass(tb_sample_t *img, int height, int width, int op)
+{
+    if (op == MORPH_OP_PASS)
+        return;
+    const std::vector<tb_sample_t> src(img, img + (size_t)height * width * TB_CHANNELS);
+    for (int r = 0; r < height; r++)
+        for (int c = 0; c < width; c++)
+            for (int ch = 0; ch < TB_CHANNELS; ch++) {
+                int v = (op == MORPH_OP_ERODE) ? TB_MAX_VALUE : 0;
+                for (int dr = -1; dr <= 1; dr++)
+                    for (int dc = -1; dc <= 1; dc++) {
+                        if (r + dr < 0 || r + dr >= height || c + dc < 0 || c + dc >= width)
+                            continue;
+                        const int t = src[((r + dr) * width + c + dc) * TB_CHANNELS + ch];
+                        v = (op == MORPH_OP_ERODE) ? std::min(v, t) : std::max(v, t);
+                    }
+                img[(r * width + c) * TB_CHANNELS + ch] = (tb_sample_t)v;
+            }
+}
+
+// Change map of a whole batch (layout: CHANGE_MAP_* in image_defines.h)
+static void sw_reference_change_map(const tb_sample_t *A, const tb_sample_t *B, int height, int width, int num_frames,
+                                    int stride_chunks, const tb_posterize_t &post, std::vector<uint64_t> &map)
 {
-    // 1. Static Allocation
-    static pixel_t img_A[WIDTH * HEIGHT];
-    static pixel_t img_B[WIDTH * HEIGHT];
-    static pixel_t img_C_SW[WIDTH * HEIGHT];
-    static pixel_t img_C_HW_Unpacked[WIDTH * HEIGHT]; // Logical result from HW
+    const int frame_tile_rows = (height + TILE_ROWS - 1) / TILE_ROWS;
+    const int map_tile_rows = CHANGE_MAP_TILE_ROWS(height, num_frames);
+    map.assign(CHANGE_MAP_WORDS(height, stride_chunks, num_frames), 0);
 
-    static uint512_t hw_A[TOTAL_CHUNKS];
-    static uint512_t hw_B[TOTAL_CHUNKS];
-    static uint512_t hw_C[TOTAL_CHUNKS];
+    for (int f = 0; f < num_frames; f++)
+        for (int r = 0; r < height; r++)
+            for (int c = 0; c < width * TB_CHANNELS; c++) {
+                const size_t i = ((size_t)f * height + r) * width * TB_CHANNELS + c;
+                const int diff = (A[i] > B[i]) ? A[i] - B[i] : B[i] - A[i];
+                if (sw_posterize(diff, post) == 0)
+                    continue;
+                const int chunk = (c / TB_CHANNELS) / TB_PIXELS_PER_CHUNK;
+                const int tr = f * frame_tile_rows + r / TILE_ROWS;
+                map[(chunk / STRIP_MAX_CHUNKS) * map_tile_rows + tr] |= (uint64_t)1 << (chunk % STRIP_MAX_CHUNKS);
+                map.back() = 1;
+            }
+}
+
+#ifdef V3_ROI
+// Split each frame at a third of its height and half its chunk columns; the
+// split ROIs are empty for frames under 3 rows or of a single chunk
+static void tb_rois(int height, int stride_chunks, uint64_t rois[TB_NUM_ROIS])
+{
+    const int rs = height / 3, cs = stride_chunks / 2;
+    rois[0] = ROI_PACK(0, rs, 0, cs);
+    rois[1] = ROI_PACK(0, rs, cs, stride_chunks);
+    rois[2] = ROI_PACK(rs, height, 0, cs);
+    rois[3] = ROI_PACK(rs, height, cs, stride_chunks);
+}
+
+// Per-ROI change flags (ROI_CHANGE_WORDS() layout): the ROI plus one row /
+// chunk of context on each side the frame has
+static void sw_reference_roi_flags(const tb_sample_t *A, const tb_sample_t *B, int height, int width, int num_frames,
+                                   int stride_chunks, const uint64_t rois[TB_NUM_ROIS], const tb_posterize_t &post,
+                                   std::vector<uint64_t> &map)
+{
+    map.assign(ROI_CHANGE_WORDS(TB_NUM_ROIS, num_frames), 0);
+    for (int f = 0; f < num_frames; f++)
+        for (int i = 0; i < TB_NUM_ROIS; i++) {
+            if (ROI_ROW0(rois[i]) >= ROI_ROW1(rois[i]) || ROI_COL0(rois[i]) >= ROI_COL1(rois[i]))
+                continue;
+            const int r0 = std::max(ROI_ROW0(rois[i]) - 1, 0), r1 = std::min(ROI_ROW1(rois[i]) + 1, height);
+            const int c0 = std::max(ROI_COL0(rois[i]) - 1, 0), c1 = std::min(ROI_COL1(rois[i]) + 1, stride_chunks);
+            for (int r = r0; r < r1; r++)
+                for (int c = c0 * TB_PIXELS_PER_CHUNK * TB_CHANNELS;
+                     c < c1 * TB_PIXELS_PER_CHUNK * TB_CHANNELS && c < width * TB_CHANNELS; c++) {
+                    const size_t px = ((size_t)f * height + r) * width * TB_CHANNELS + c;
+                    const int diff = (A[px] > B[px]) ? A[px] - B[px] : B[px] - A[px];
+                    if (sw_posterize(diff, post) != 0)
+                        map[f * TB_NUM_ROIS + i] = 1;
+                }
+        }
+}
+#endif
 
-    printf("Starting Fast Testbench (Size: %dx%d)\n", WIDTH, HEIGHT);
+// Run one image size (and batch of frames) through the kernel and return the number of mismatches
+// sparse_changes >= 0: B equals A except for that many changed pixels per batch
+static int run_case(int height, int width, int num_frames, const tb_filter_t &flt = TB_SHARPEN,
+                    const tb_posterize_t &post = TB_POSTERIZE, int sparse_changes = -1,
+                    const tb_input_t &in = TB_INPUT)
+{
+    if (width > tb_max_width()) {
+        if (!tb_quiet)
+            printf("Skipping %dx%d: this kernel takes frames up to %d px wide\n", width, height, tb_max_width());
+        return 0;
+    }
+    const int stride_chunks = (width + TB_PIXELS_PER_CHUNK - 1) / TB_PIXELS_PER_CHUNK;
+    const int frame_chunks = height * stride_chunks;
+    const int total_chunks = frame_chunks * num_frames;
+    const size_t frame_pixels = (size_t)height * width * TB_CHANNELS; // Samples, one per channel
+    const size_t pixels = frame_pixels * num_frames;
+
+    // 1. Allocation (heap: sizes are only known at run time)
+    std::vector<tb_sample_t> img_A(pixels);
+    std::vector<tb_sample_t> img_B(pixels);
+    std::vector<tb_sample_t> img_C_SW(pixels);
+    std::vector<tb_sample_t> img_C_HW_Unpacked(pixels); // Logical result from HW
+
+    std::vector<uint512_t> hw_A(total_chunks);
+    std::vector<uint512_t> hw_B(total_chunks);
+    std::vector<uint512_t> hw_C(total_chunks);
+    std::vector<uint64_t> hw_map(CHANGE_MAP_WORDS(height, stride_chunks, num_frames), ~0ull);
+    std::vector<uint64_t> sw_map;
+
+    if (!tb_quiet)
+        printf("Starting Fast Testbench (Size: %dx%d, stride %d chunks, %d frame(s))\n",
+               width, height, stride_chunks, num_frames);
 
     // 2. Input Generation (Logical)
-    srand(42);
-    for (int i = 0; i < WIDTH * HEIGHT; i++) {
-        img_A[i] = rand() % 256;
-        int noise = (rand() % 200) - 100;
-        int temp = img_A[i] + noise;
-        if (temp < 0) temp = 0; else if (temp > 255) temp = 255;
-        img_B[i] = (pixel_t)temp;
+    const tp_config_t &tp = in.tp;
+    if (in.pattern < 0) {
+        tp_fill_pair(img_A.data(), img_B.data(), 1, (int)pixels, pixels, 0, &tp, TB_MAX_VALUE);
+    } else {
+        const int row_samples = width * TB_CHANNELS;
+        tp_fill_edge(img_A.data(), img_B.data(), height * num_frames, row_samples, row_samples, 0,
+                     (tp_pattern_t)in.pattern, in.cell * TB_CHANNELS, TB_MAX_VALUE);
+    }
+    if (sparse_changes >= 0) {
+        // Exactly sparse_changes flips, drawn after the pixel indices
+        img_B = img_A;
+        for (int n = 0; n < sparse_changes; n++) {
+            const size_t i = (size_t)(tp_draw(tp.seed, pixels + n) % pixels);
+            img_B[i] = img_A[i] ^ (1 << (V3_CHANNEL_BITS - 1));
+        }
+    }
+#ifdef V3_LUMA
+    // Camera frames, LUMA_WORDS_PER_CHUNK() words per chunk, chroma from the seed
+    const int luma_words = LUMA_WORDS_PER_CHUNK(tb_in_format);
+    const size_t cam_pitch = (size_t)stride_chunks * sizeof(uint512_t) * luma_words;
+    std::vector<uint512_t> cam_A((size_t)total_chunks * luma_words), cam_B((size_t)total_chunks * luma_words);
+    memset((void*)cam_A.data(), 0, cam_A.size() * sizeof(uint512_t));
+    memset((void*)cam_B.data(), 0, cam_B.size() * sizeof(uint512_t));
+    for (int f = 0; f < num_frames; f++) {
+        for (int side = 0; side < 2; side++) {
+            tb_sample_t *img = (side ? img_B.data() : img_A.data()) + f * frame_pixels;
+            uint8_t *cam = (uint8_t*)((side ? cam_B.data() : cam_A.data()) + (size_t)f * frame_chunks * luma_words);
+            const uint64_t base = ((uint64_t)(2 * f + side) * height) * width;
+            luma_pack_ref(img, height, width, width, tb_in_format, cam, cam_pitch, [&](int x, int y, int c) {
+                return (uint8_t)tp_draw(tp.seed + 1, (base + (uint64_t)y * width + x) * 3 + c);
+            });
+            luma_convert_ref(cam, height, width, cam_pitch, tb_in_format, img, width);
+        }
     }
+#endif
 
-    // 3. SW Reference (Logical)
-    sw_reference_logical(img_A, img_B, img_C_SW);
+    // 3. SW Reference and HW packing, frame by frame (Logical -> Padded)
+    for (int f = 0; f < num_frames; f++) {
+        const size_t px = f * frame_pixels;
+        sw_reference_logical(&img_A[px], &img_B[px], &img_C_SW[px], height, width, flt, post);
+        sw_morph_pass(&img_C_SW[px], height, width, MORPH_FIRST_OP(flt.morph));
+        sw_morph_pass(&img_C_SW[px], height, width, MORPH_SECOND_OP(flt.morph));
+        pack_pixels_fast(&img_A[px], &hw_A[f * frame_chunks], height, width, stride_chunks);
+        pack_pixels_fast(&img_B[px], &hw_B[f * frame_chunks], height, width, stride_chunks);
+    }
+#ifdef V3_ROI
+    uint64_t rois[TB_NUM_ROIS];
+    tb_rois(height, stride_chunks, rois);
+    sw_reference_roi_flags(img_A.data(), img_B.data(), height, width, num_frames, stride_chunks, rois, post, sw_map);
+    hw_map.assign(sw_map.size(), ~0ull);
+#else
+    sw_reference_change_map(img_A.data(), img_B.data(), height, width, num_frames, stride_chunks, post, sw_map);
+#endif
 
-    // 4. Pack HW Inputs (Fast)
-    pack_pixels_fast(img_A, hw_A);
-    pack_pixels_fast(img_B, hw_B);
+    // 4. Run HW (whole batch in one call)
+    TB_POST_TAP_ONLY(std::vector<uint512_t> hw_tap(POST_TAP_WORDS(height, stride_chunks, num_frames));)
+    TB_STATS_ONLY(uint64_t stats[STATS_NUM_WORDS] = {0};)
+    TB_PROF_ONLY(uint64_t prof[PROF_NUM_COUNTERS] = {0};)
+    TB_COMPRESS_ONLY(std::vector<uint64_t> comp_index(COMP_INDEX_WORDS(height, stride_chunks, num_frames), ~0ull);)
+    TB_BLOBS_ONLY(std::vector<uint64_t> hw_blobs(BLOB_WORDS(num_frames), ~0ull);)
+    TB_PYRAMID_ONLY(std::vector<uint512_t> hw_half(PYR_WORDS(height, stride_chunks, num_frames, 1) + 1, 0);)
+    TB_PYRAMID_ONLY(std::vector<uint512_t> hw_quarter(PYR_WORDS(height, stride_chunks, num_frames, 2) + 1, 0);)
+    const auto t_kernel = std::chrono::steady_clock::now();
+#ifdef V3_LUMA
+    const uint512_t *in_A = cam_A.data(), *in_B = cam_B.data();
+#else
+    const uint512_t *in_A = hw_A.data(), *in_B = hw_B.data();
+#endif
+    IMAGE_DIFF_POSTERIZE(in_A, in_B, hw_C.data(), height, width, stride_chunks, num_frames,
+                         flt.r0, flt.r1, flt.r2, flt.shift, flt.border,
+                         post.thr03, post.thr46, post.levels, hw_map.data()
+                         TB_POST_TAP_ONLY(, hw_tap.data())
+                         TB_STATS_ONLY(, stats) TB_PROF_ONLY(, prof) TB_COMPRESS_ONLY(, comp_index.data())
+                         TB_ROI_ONLY(, rois, TB_NUM_ROIS) TB_MORPH_ONLY(, flt.morph)
+                         TB_BLOBS_ONLY(, hw_blobs.data())
+                         TB_PYRAMID_ONLY(, hw_half.data(), hw_quarter.data())
+                         TB_LUMA_ONLY(, tb_in_format));
+    tb_kernel_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - t_kernel).count();
+    tb_kernel_pixels += (double)height * width * num_frames;
+#ifdef V3_PROFILE
+    printf("Profile: diff %llu (post full %llu), filter %llu (post empty %llu, filt full %llu), "
+           "write %llu (filt empty %llu), strips %llu\n",
+           (unsigned long long)prof[PROF_DIFF_ACTIVE], (unsigned long long)prof[PROF_DIFF_POST_FULL],
+           (unsigned long long)prof[PROF_FILT_ACTIVE], (unsigned long long)prof[PROF_FILT_POST_EMPTY],
+           (unsigned long long)prof[PROF_FILT_FILT_FULL], (unsigned long long)prof[PROF_WRITE_ACTIVE],
+           (unsigned long long)prof[PROF_WRITE_FILT_EMPTY], (unsigned long long)prof[PROF_STRIPS]);
+#endif
 
-    // 5. Run HW
-    IMAGE_DIFF_POSTERIZE(hw_A, hw_B, hw_C);
+#ifdef V3_COMPRESS
+    // Expand the packed chunks; the count must match the index
+    {
+        std::vector<uint512_t> packed(hw_C);
+        const uint64_t copied = comp_decode((const uint8_t*)packed.data(), comp_index.data(), (uint8_t*)hw_C.data(),
+                                            height * num_frames, stride_chunks);
+        if (copied != comp_index[0]) {
+            printf("Compressed output: index has %llu chunks, header says %llu\n",
+                   (unsigned long long)copied, (unsigned long long)comp_index[0]);
+            return 1;
+        }
+        if (!tb_quiet)
+            printf("Compressed output: %llu of %d chunks kept\n", (unsigned long long)copied,
+                   height * stride_chunks * num_frames);
+    }
+#endif
 
-    // 6. Unpack HW Output (Fast)
-    unpack_pixels_fast(hw_C, img_C_HW_Unpacked);
+    // 5. Unpack HW Output (Fast)
+    for (int f = 0; f < num_frames; f++) {
+        unpack_pixels_fast(&hw_C[f * frame_chunks], &img_C_HW_Unpacked[f * frame_pixels], height, width, stride_chunks);
+    }
 
-    // 7. Verify (Logical)
+    // 6. Verify (Logical)
     int error_count = 0;
-    for (int i = 0; i < WIDTH * HEIGHT; i++) {
+    for (size_t i = 0; i < pixels; i++) {
         if (img_C_HW_Unpacked[i] != img_C_SW[i]) {
-            printf("Error at pixel %d: HW=%d SW=%d\n", i, img_C_HW_Unpacked[i], img_C_SW[i]);
+            printf("Error at pixel %zu: HW=%d SW=%d\n", i, img_C_HW_Unpacked[i], img_C_SW[i]);
             error_count++;
             if (error_count > 10) break;
         }
     }
+#ifdef V3_POST_TAP
+    // Tap codes: level index saturated to 3, one row per POST_TAP_ROW_WORDS words
+    const int tap_row_words = POST_TAP_ROW_WORDS(stride_chunks);
+    for (int r = 0; r < height * num_frames; r++) {
+        for (int x = 0; x < width; x++) {
+            const size_t i = (size_t)r * width + x;
+            const uint512_t &word = hw_tap[(size_t)r * tap_row_words + x / (4 * PIXELS_PER_CHUNK)];
+            const int bit = 2 * (x % (4 * PIXELS_PER_CHUNK));
+            const int hw_code = (int)word.range(bit + 1, bit);
+            const int diff = (img_A[i] > img_B[i]) ? img_A[i] - img_B[i] : img_B[i] - img_A[i];
+            const int lvl = sw_posterize_level(diff, post);
+            const int sw_code = (lvl > 3) ? 3 : lvl;
+            if (hw_code != sw_code) {
+                printf("Tap error at row %d x %d: HW=%d SW=%d\n", r, x, hw_code, sw_code);
+                if (++error_count > 10) return error_count;
+            }
+        }
+    }
+#endif
+#ifdef V3_STATS
+    uint64_t sw_stats[STATS_NUM_WORDS] = {0};
+    sw_stats[STATS_MIN] = 255;
+    for (size_t i = 0; i < pixels; i++) {
+        const int diff = (img_A[i] > img_B[i]) ? img_A[i] - img_B[i] : img_B[i] - img_A[i];
+        for (int l = 0; l < post.levels; l++)
+            sw_stats[STATS_LEVEL_COUNT + l] += (sw_posterize_level(diff, post) == l);
+        const uint64_t v = img_C_SW[i];
+        sw_stats[STATS_MIN] = (v < sw_stats[STATS_MIN]) ? v : sw_stats[STATS_MIN];
+        sw_stats[STATS_MAX] = (v > sw_stats[STATS_MAX]) ? v : sw_stats[STATS_MAX];
+        sw_stats[STATS_SUM] += v;
+    }
+    sw_stats[STATS_PIXELS] = pixels;
+    for (int w = 0; w < STATS_NUM_WORDS; w++) {
+        if (stats[w] != sw_stats[w]) {
+            printf("Stats word %d: HW=%llu SW=%llu\n", w, (unsigned long long)stats[w], (unsigned long long)sw_stats[w]);
+            error_count++;
+        }
+    }
+#endif
+#ifdef V3_BLOBS
+    for (int f = 0; f < num_frames; f++) {
+        std::vector<uint8_t> white(frame_pixels);
+        for (size_t i = 0; i < frame_pixels; i++) {
+            const size_t px = f * frame_pixels + i;
+            const int diff = (img_A[px] > img_B[px]) ? img_A[px] - img_B[px] : img_B[px] - img_A[px];
+            white[i] = (sw_posterize(diff, post) == TB_MAX_VALUE);
+        }
+        uint64_t sw_blobs[BLOB_FRAME_WORDS];
+        blob_list_ref(white.data(), height, width, width, stride_chunks, sw_blobs);
+        const uint64_t *hw = &hw_blobs[f * BLOB_FRAME_WORDS];
+        const int w = blob_list_mismatch(hw, sw_blobs);
+        if (w >= 0) {
+            printf("Blob list frame %d word %d: HW=%016llx SW=%016llx\n", f, w,
+                   (unsigned long long)hw[w], (unsigned long long)sw_blobs[w]);
+            error_count++;
+        } else if (!tb_quiet) {
+            printf("Blobs: frame %d, %d found, flags %d\n", f, BLOB_FOUND(hw[0]), BLOB_FLAGS(hw[0]));
+        }
+    }
+#endif
+#ifdef V3_PYRAMID
+    for (int f = 0; f < num_frames; f++) {
+        // Level 1 from the reference result, level 2 from level 1
+        const int rows1 = PYR_ROWS(height, 1), cols1 = PYR_COLS(width, 1);
+        const int rows2 = PYR_ROWS(height, 2), cols2 = PYR_COLS(width, 2);
+        std::vector<uint8_t> sw_half((size_t)rows1 * cols1 + 1), sw_quarter((size_t)rows2 * cols2 + 1);
+        pyramid_level_ref(&img_C_SW[f * frame_pixels], height, width, width, sw_half.data(), cols1);
+        pyramid_level_ref(sw_half.data(), rows1, cols1, cols1, sw_quarter.data(), cols2);
+        for (int level = 1; level <= 2; level++) {
+            const uint8_t *sw = (level == 1) ? sw_half.data() : sw_quarter.data();
+            const uint8_t *hw = (const uint8_t *)((level == 1) ? hw_half.data() : hw_quarter.data());
+            const int rows = PYR_ROWS(height, level), cols = PYR_COLS(width, level);
+            const int pitch = PYR_STRIDE(stride_chunks, level) * PIXELS_PER_CHUNK;
+            int level_errors = 0;
+            for (int y = 0; y < rows; y++) {
+                for (int x = 0; x < cols; x++) {
+                    const int hw_px = hw[((size_t)f * rows + y) * pitch + x];
+                    if (hw_px != sw[(size_t)y * cols + x] && level_errors++ < 10)
+                        printf("Pyramid level %d frame %d (%d, %d): HW=%d SW=%d\n", level, f, x, y, hw_px,
+                               sw[(size_t)y * cols + x]);
+                }
+            }
+            error_count += level_errors;
+        }
+    }
+#endif
+#if defined(TB_V4) || defined(TB_V5) || defined(TB_V6)
+    error_count += tb_adapter_errors;
+    tb_adapter_errors = 0;
+#endif
+#ifndef TB_V4
+#ifdef TB_V6
+    if (tb_skip_map)
+        sw_map.clear();
+#endif
+    for (size_t i = 0; i < sw_map.size(); i++) {
+        if (hw_map[i] != sw_map[i]) {
+            printf("Change map word %zu: HW=%016llx SW=%016llx\n", i,
+                   (unsigned long long)hw_map[i], (unsigned long long)sw_map[i]);
+            error_count++;
+        }
+    }
+#endif
+
+    return error_count;
+}
+
+#if !defined(TB_V4) && !defined(TB_V5) && !defined(TB_V6)
+// A frame wider than a row-buffer build takes (V1/V2) must leave C and the
+// change map untouched instead of overrunning the row buffers
+static int run_too_wide(int width)
+{
+    const int height = 3;
+    const int stride_chunks = (width + TB_PIXELS_PER_CHUNK - 1) / TB_PIXELS_PER_CHUNK;
+    std::vector<uint512_t> hw_A(height * stride_chunks, 0), hw_B(height * stride_chunks, 0);
+    std::vector<uint512_t> hw_C(height * stride_chunks, 0);
+    for (size_t i = 0; i < hw_A.size(); i++) {
+        hw_A[i] = ~hw_A[i];
+        hw_C[i] = hw_A[i];
+    }
+    std::vector<uint64_t> hw_map(CHANGE_MAP_WORDS(height, stride_chunks, 1), ~0ull);
+    printf("Starting refused-frame check (Size: %dx%d, kernel limit %d px)\n", width, height, tb_max_width());
+    tb_call_plain(hw_A.data(), hw_B.data(), hw_C.data(), height, width, stride_chunks, 1, hw_map.data());
+    int errors = 0;
+    for (size_t i = 0; i < hw_C.size(); i++)
+        errors += (hw_C[i] != hw_A[i]);
+    for (size_t i = 0; i < hw_map.size(); i++)
+        errors += (hw_map[i] != ~0ull);
+    if (errors)
+        printf("Refused %d px frame: %d words written\n", width, errors);
+    return errors;
+}
+#endif
+
+// Randomized and edge-pattern sweep: seeds draw the size (widths around the
+// chunk boundaries), batch, noise shape, border policy and posterize table;
+// then flat and checkerboard frames (pixel cells and chunk-sized cells, so
+// every chunk seam is an edge for apply_filter_wide) run at a few sizes.
+static int run_stress(int seeds, const char *label)
+{
+    static const int borders[4] = {BORDER_ZERO, BORDER_REPLICATE, BORDER_MIRROR, BORDER_PASSTHROUGH};
+    static const tp_noise_t noises[3] = {TP_NOISE_UNIFORM, TP_NOISE_GAUSSIAN, TP_NOISE_SPARSE};
+#ifndef POSTERIZE_FIXED
+    const tb_posterize_t posts[3] = {TB_POSTERIZE, {POSTERIZE_PACK4(8, 16, 32, 64), POSTERIZE_PACK4(96, 128, 192, 0), 8},
+                                     {POSTERIZE_PACK4(48, 0, 0, 0), 0, 2}};
+#else
+    const tb_posterize_t posts[3] = {TB_POSTERIZE, TB_POSTERIZE, TB_POSTERIZE};
+#endif
+    int errors = 0, cases = 0;
+    tb_quiet = true;
+    tb_kernel_seconds = tb_kernel_pixels = 0;
+
+    for (int seed = 0; seed < seeds; seed++) {
+        const uint64_t h = tp_draw((uint64_t)seed, ~0ull);
+        const int height = 1 + (int)(h % 40);
+        const int width = 1 + (int)((h >> 8) % (3 * TB_PIXELS_PER_CHUNK + 8));
+        const int frames = 1 + (int)((h >> 16) % 3);
+        const tb_filter_t flt = {SHARPEN_DEFAULT_R0, SHARPEN_DEFAULT_R1, SHARPEN_DEFAULT_R2,
+                                 SHARPEN_DEFAULT_SHIFT, borders[(h >> 24) % 4], TB_MORPH_ONLY((int)((h >> 48) % 3))};
+        const tb_input_t in = {{(uint64_t)seed, noises[seed % 3], (int)((h >> 32) % 256)}, -1, 1};
+        const int e = run_case(height, width, frames, flt, posts[(h >> 40) % 3], -1, in);
+        if (e)
+            printf("Stress seed %d (%dx%d, %d frame(s)): %d errors\n", seed, width, height, frames, e);
+        errors += e;
+        cases++;
+    }
+
+    // The last size crosses a strip (and is skipped by builds too narrow for it)
+    const int sizes[4][2] = {{HEIGHT / 4, WIDTH}, {7, 2 * TB_PIXELS_PER_CHUNK + 1}, {2, TB_PIXELS_PER_CHUNK - 1},
+                             {5, STRIP_MAX_CHUNKS * TB_PIXELS_PER_CHUNK + TB_PIXELS_PER_CHUNK + 3}};
+    const int patterns[4][2] = {{TP_PATTERN_ZERO, 1}, {TP_PATTERN_MAX, 1}, {TP_PATTERN_CHECKER, 1},
+                                {TP_PATTERN_CHECKER, TB_PIXELS_PER_CHUNK}};
+    for (int p = 0; p < 4; p++) {
+        for (int s = 0; s < 4; s++) {
+            for (int b = 0; b < 4; b++) {
+                const tb_filter_t flt = {SHARPEN_DEFAULT_R0, SHARPEN_DEFAULT_R1, SHARPEN_DEFAULT_R2,
+                                         SHARPEN_DEFAULT_SHIFT, borders[b]};
+                const tb_input_t in = {TB_INPUT.tp, patterns[p][0], patterns[p][1]};
+                const int e = run_case(sizes[s][0], sizes[s][1], 2, flt, TB_POSTERIZE, -1, in);
+                if (e)
+                    printf("Stress pattern %d cell %d (%dx%d, border %d): %d errors\n",
+                           patterns[p][0], patterns[p][1], sizes[s][1], sizes[s][0], borders[b], e);
+                errors += e;
+                cases++;
+            }
+        }
+    }
+
+    printf("STRESS %s: %d cases, %d errors, kernel %.2f Mpx/s (C-sim)\n", label, cases, errors,
+           tb_kernel_pixels / 1e6 / (tb_kernel_seconds > 0 ? tb_kernel_seconds : 1));
+    tb_quiet = false;
+    return errors;
+}
+
+int main(int argc, char **argv)
+{
+    int error_count = 0;
+
+    if (argc >= 2 && strcmp(argv[1], "--stress") == 0)
+    {
+        // hls_tb --stress [<seeds>] [<label>]: label names the variant in the report
+        const char *label = (argc >= 4) ? argv[3] : argv[0];
+        error_count += run_stress((argc >= 3) ? atoi(argv[2]) : 64, label);
+    }
+    else if (argc == 3 || argc == 4)
+    {
+        // Explicit size: hls_tb <height> <width> [<frames>]
+        error_count += run_case(atoi(argv[1]), atoi(argv[2]), (argc == 4) ? atoi(argv[3]) : 1);
+    }
+    else
+    {
+        // Default frame, a width that is not a multiple of 64 (exercises row padding),
+        // and a small batch (exercises the frame boundaries inside one call).
+        // Build with -DSTRIP_MAX_CHUNKS=1 to push every case through V3's strip tiling.
+        error_count += run_case(HEIGHT, WIDTH, 1);
+        error_count += run_case(HEIGHT / 2, WIDTH / 2 + 37, 1);
+        error_count += run_case(HEIGHT / 4, WIDTH, 3);
+        // Wider than one strip and not a multiple of 64 px: V3's strip halos
+        // and the partial last chunk of the last strip, across a batch
+        error_count += run_case(TILE_ROWS + 3, STRIP_MAX_CHUNKS * TB_PIXELS_PER_CHUNK + TB_PIXELS_PER_CHUNK / 2 + 5, 2);
+#ifndef SHARPEN_FIXED
+        // Run-time taps: unsharp-style 3x3 with diagonals and a shift
+        const tb_filter_t unsharp = {SHARPEN_PACK_ROW(-1, -2, -1), SHARPEN_PACK_ROW(-2, 28, -2),
+                                     SHARPEN_PACK_ROW(-1, -2, -1), 2};
+        error_count += run_case(HEIGHT / 2, WIDTH / 2 + 37, 2, unsharp);
+        // Mirrored borders with asymmetric diagonal taps
+        const tb_filter_t mirror = {unsharp.r0, unsharp.r1, unsharp.r2, unsharp.shift, BORDER_MIRROR};
+        error_count += run_case(HEIGHT / 2 + 3, WIDTH / 2 + 37, 2, mirror);
+        // Bypassed sharpen (lab-1's diff-only output): C is the posterized frame
+        const tb_filter_t bypass = {SHARPEN_BYPASS_R0, SHARPEN_BYPASS_R1, SHARPEN_BYPASS_R2, 0, BORDER_PASSTHROUGH};
+        error_count += run_case(HEIGHT / 4, WIDTH / 2 + 37, 2, bypass);
+#endif
+        // Border policies (batches check that frame edges do not leak across frames)
+        const tb_filter_t replicate = {SHARPEN_DEFAULT_R0, SHARPEN_DEFAULT_R1, SHARPEN_DEFAULT_R2,
+                                       SHARPEN_DEFAULT_SHIFT, BORDER_REPLICATE};
+        const tb_filter_t pass = {SHARPEN_DEFAULT_R0, SHARPEN_DEFAULT_R1, SHARPEN_DEFAULT_R2,
+                                  SHARPEN_DEFAULT_SHIFT, BORDER_PASSTHROUGH};
+        error_count += run_case(HEIGHT / 4, WIDTH, 2, replicate);
+        error_count += run_case(HEIGHT / 4, WIDTH / 2 + 37, 1, pass);
+#ifndef POSTERIZE_FIXED
+        // Run-time posterize tables: all 8 levels, and a 2-level binary mask
+        const tb_posterize_t eight = {POSTERIZE_PACK4(8, 16, 32, 64), POSTERIZE_PACK4(96, 128, 192, 0), 8};
+        const tb_posterize_t binary = {POSTERIZE_PACK4(48, 0, 0, 0), 0, 2};
+        error_count += run_case(HEIGHT / 2, WIDTH / 2 + 37, 1, TB_SHARPEN, eight);
+        error_count += run_case(HEIGHT / 4, WIDTH, 2, TB_SHARPEN, binary);
+#endif
+#if !defined(TB_V4) && !defined(TB_V5) && !defined(TB_V6)
+        if (tb_max_width() < MAX_WIDTH)
+            error_count += run_too_wide(tb_max_width() + TB_PIXELS_PER_CHUNK + 1);
+        // The host refuses --coeffs / --thresh on SHARPEN_FIXED / POSTERIZE_FIXED builds from these flags
+        if ((tb_kernel_props() & 0xFFFFFFFFull) != KERNEL_PROPS_BUILD) {
+            printf("FAIL kernel properties %#llx: flags do not match the build (%#llx)\n",
+                   (unsigned long long)tb_kernel_props(), (unsigned long long)KERNEL_PROPS_BUILD);
+            error_count++;
+        }
+#endif
+        // Change map: identical frames (flag clear) and a few isolated changes
+        error_count += run_case(HEIGHT / 2, WIDTH / 2 + 37, 2, TB_SHARPEN, TB_POSTERIZE, 0);
+        error_count += run_case(HEIGHT / 2 + 3, WIDTH, 3, TB_SHARPEN, TB_POSTERIZE, 5);
+#ifdef V3_MORPH
+        // Open and close, across chunk seams and frame boundaries of a batch
+        const tb_filter_t open = {SHARPEN_DEFAULT_R0, SHARPEN_DEFAULT_R1, SHARPEN_DEFAULT_R2,
+                                  SHARPEN_DEFAULT_SHIFT, BORDER_REPLICATE, MORPH_OPEN};
+        const tb_filter_t close = {SHARPEN_DEFAULT_R0, SHARPEN_DEFAULT_R1, SHARPEN_DEFAULT_R2,
+                                   SHARPEN_DEFAULT_SHIFT, BORDER_ZERO, MORPH_CLOSE};
+        error_count += run_case(HEIGHT / 2, WIDTH / 2 + 37, 2, open);
+        error_count += run_case(HEIGHT / 4 + 1, WIDTH, 3, close);
+        error_count += run_case(3, 2 * TB_PIXELS_PER_CHUNK + 1, 2, open, TB_POSTERIZE, 5);
+#endif
+#ifdef V3_BLOBS
+        // Checkerboard blobs straddling the chunk seams (runs carried across chunks,
+        // 8-connected corners merging cells), few enough to be listed exactly
+        const tb_input_t cells = {TB_INPUT.tp, TP_PATTERN_CHECKER, TB_PIXELS_PER_CHUNK / 2 + 3};
+        error_count += run_case(HEIGHT / 2, WIDTH / 2 + 37, 2, TB_SHARPEN, TB_POSTERIZE, -1, cells);
+        error_count += run_case(HEIGHT / 4, WIDTH, 1, TB_SHARPEN, TB_POSTERIZE, 40);
+#endif
+#ifdef V3_PYRAMID
+        // Levels with no quarter row, and odd sizes whose last level chunk is partial
+        error_count += run_case(3, 2 * TB_PIXELS_PER_CHUNK + 1, 2);
+        error_count += run_case(HEIGHT / 4 + 2, 5 * TB_PIXELS_PER_CHUNK + 7, 3);
+#endif
+#ifdef V3_LUMA
+        // The cases above ran as LUMA_Y8; rerun a few as YUYV and RGB888,
+        // with row padding, a batch and (with -DSTRIP_MAX_CHUNKS) strip halos
+        for (int fmt = LUMA_YUYV; fmt <= LUMA_RGB888; fmt++) {
+            tb_in_format = fmt;
+            error_count += run_case(HEIGHT / 2, WIDTH / 2 + 37, 1);
+            error_count += run_case(HEIGHT / 4 + 1, WIDTH, 3, TB_SHARPEN, TB_POSTERIZE, 5);
+            error_count += run_case(3, 2 * TB_PIXELS_PER_CHUNK + 1, 2);
+        }
+        tb_in_format = LUMA_Y8;
+#endif
+    }
 
     if (error_count == 0) printf("TEST PASSED.\n");
     else printf("TEST FAILED.\n");
@@ -4,111 +4,3106 @@
  *
  * This host application:
  *   1. Allocates aligned memory for images (ROW-PADDED for 512-bit chunks)
- *   2. Generates compact test images (HEIGHT x WIDTH)
- *   3. Pads compact images into ROW-PADDED device layout
- *   4. Computes software reference on compact images
- *   5. Loads XCLBIN and programs FPGA
- *   6. Transfers padded data to device
- *   7. Executes kernel
- *   8. Transfers padded results back
- *   9. Unpads results back to compact layout
- *  10. Verifies correctness on the compact (real) region only
+ *   2. Generates test images (height x width, default HEIGHT x WIDTH)
+ *      directly into the ROW-PADDED device layout (no pad/unpad copies)
+ *   3. Computes software reference from the padded inputs (cpu_engine,
+ *      SIMD-dispatched at run time)
+ *   4. Loads XCLBIN and programs FPGA
+ *   5. Transfers padded data to device
+ *   6. Executes kernel
+ *   7. Transfers padded results back
+ *   8. Verifies correctness in place on the real width x height region only
+ *
+ * With --stream N the single-shot steps 5-8 are replaced by an N-iteration
+ * pipeline over a ring of buffer sets on an out-of-order queue, so that the
+ * H2D of batch n+1 and the D2H of batch n-1 overlap the kernel of batch n.
  *
  * Converted from VITIS_HLS/tb_image_diff.cpp
  */
 
 #include "xcl2.hpp"
+#include "image_diff_engine.hpp"
 #include "event_timer.hpp"
+#include "cpu_engine.hpp"
+#include "frame_io.hpp"
+#include "trace_ring.hpp"
+#include "power_meter.hpp"
+#include "xrt_native.hpp"
+#include "gpu_engine.hpp"
+#include "broker.hpp"
+#include "../../inc/test_pattern.h"
 #include "../../inc/image_defines.h"
+#include "../../inc/result_codec.h"
+#include "../../inc/blob_list.h"
+#include "../../inc/pyramid.h"
+#include "../../inc/luma.h"
 #include <vector>
 #include <cstdlib>
 #include <cstdint>
+#include <cstdio>
 #include <cstring>
 #include <iostream>
+#include <string>
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <unistd.h>
+
+// =============================================================================
+// Helper: Generate frame pairs straight into the row-padded device layout
+// =============================================================================
+// Frames are written in place at padded_width pitch, the way a capture or
+// decode stage would fill a DMA-able buffer, so no pad/unpad copy is needed.
+// Padding columns are left as allocated (zero); the kernel masks them by width.
+// The counter-based generator (test_pattern.h) lets the frames be split into
+// row bands filled on cpu_engine_threads() threads with identical results.
+void generate_frames(uint8_t *A, uint8_t *B, int num_frames, int height, int width, int padded_width,
+                     const tp_config_t &tp)
+{
+    // Frames are back to back, so global row g starts at g * padded_width
+    const int rows    = num_frames * height;
+    const int threads = std::max(1, std::min(cpu_engine_threads(), rows / 64));
+    std::vector<std::thread> pool;
+    for (int t = 0; t < threads; t++)
+    {
+        const int r0 = (int)((long)rows * t / threads);
+        const int r1 = (int)((long)rows * (t + 1) / threads);
+        pool.emplace_back([=, &tp] {
+            tp_fill_pair(A + (size_t)r0 * padded_width, B + (size_t)r0 * padded_width, r1 - r0, width,
+                         (size_t)padded_width, (uint64_t)r0 * width, &tp, 255);
+        });
+    }
+    for (auto &th : pool)
+        th.join();
+}
+
+// --in-format: camera frames (LUMA_YUYV / LUMA_RGB888 layout, padded_width
+// pixels per row) around the luma in the padded buffer, chroma from the
+// seed; the buffer is then replaced by the luma the kernel's front end
+// computes, so the reference runs on exactly what the diff stage sees.
+static void make_camera_frames(uint8_t *luma, uint8_t *camera, int num_frames, int height, int width,
+                               int padded_width, int fmt, uint64_t seed)
+{
+    const size_t camera_pitch = (size_t)padded_width * LUMA_PIXEL_BYTES(fmt);
+    const int rows = num_frames * height;
+    luma_pack_ref(luma, rows, width, padded_width, fmt, camera, camera_pitch, [=](int x, int y, int c) {
+        return (uint8_t)tp_draw(seed, ((uint64_t)y * width + x) * 3 + c);
+    });
+    luma_convert_ref(camera, rows, width, camera_pitch, fmt, luma, padded_width);
+}
+
+// =============================================================================
+// Helper: NUMA placement next to the card
+// =============================================================================
+// Binding the host thread to the CPUs of the card's node before anything is
+// allocated keeps all first-touch pages (padded buffers, reference output,
+// pinned DMA buffers) on that node, and every thread started later (the
+// cpu_engine pool, engine/producer threads) inherits the affinity. No libnuma
+// needed: the node comes from sysfs, the binding from sched_setaffinity.
+#define XILINX_PCI_VENDOR "0x10ee"
+
+// NUMA node of the first Xilinx PCIe function, or -1 if none / not reported
+static int fpga_numa_node()
+{
+    DIR *dir = opendir("/sys/bus/pci/devices");
+    if (!dir)
+        return -1;
+    int node = -1;
+    while (struct dirent *ent = readdir(dir))
+    {
+        const std::string base = std::string("/sys/bus/pci/devices/") + ent->d_name;
+        std::ifstream vendor(base + "/vendor");
+        std::string id;
+        if (!(vendor >> id) || id != XILINX_PCI_VENDOR)
+            continue;
+        std::ifstream numa(base + "/numa_node");
+        if (numa >> node && node >= 0)
+            break;
+        node = -1;
+    }
+    closedir(dir);
+    return node;
+}
+
+// Restrict the calling thread to node's CPUs (sysfs cpulist, e.g. "0-15,32-47")
+static bool pin_to_numa_node(int node)
+{
+    std::ifstream in("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+    std::string list, range;
+    if (!(in >> list))
+        return false;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    std::istringstream ranges(list);
+    while (std::getline(ranges, range, ','))
+    {
+        int lo = 0, hi = 0;
+        const int n = std::sscanf(range.c_str(), "%d-%d", &lo, &hi);
+        if (n < 1)
+            return false;
+        for (int cpu = lo; cpu <= ((n == 2) ? hi : lo) && cpu < CPU_SETSIZE; cpu++)
+            CPU_SET(cpu, &set);
+    }
+    return sched_setaffinity(0, sizeof(set), &set) == 0;
+}
+
+// =============================================================================
+// Helper: Scale repeat counts down under emulation
+// =============================================================================
+// XCL_EMULATION_MODE=sw_emu runs the kernel as compiled C code and hw_emu as
+// RTL simulation, thousands of times slower than the card, so a repeat that
+// costs milliseconds on hardware costs seconds or minutes there. Every
+// repeat shows the same code paths after the first few, so emulation runs
+// cap the batch size and the iteration counts (--emu-full keeps them).
+// Frame size and formats are left alone: those are what a CI run checks.
+#define EMU_MAX_FRAMES      2
+#define EMU_SW_MAX_ITERS    8
+#define EMU_HW_MAX_ITERS    2
+
+static void emu_cap(int &count, int cap, const char *what)
+{
+    if (count > cap)
+    {
+        std::cout << "Emulation: " << what << " " << count << " -> " << cap << std::endl;
+        count = cap;
+    }
+}
+
+// =============================================================================
+// Helper: Compare one row-padded result frame against the compact reference
+// =============================================================================
+// Only the real width x height region is checked; reports up to max_report
+// mismatches (tagged with the frame index) and returns the total count.
+// Rows are compared with memcmp (libc's vectorized compare) and only a row
+// that differs is scanned pixel by pixel, so a clean frame costs one
+// memory-bandwidth pass.
+int compare_frame(const uint8_t *hw, const uint8_t *ref, int height, int width, int padded_width,
+                  int frame, int max_report)
+{
+    int errors = 0;
+    for (int r = 0; r < height; r++)
+    {
+        const uint8_t *hw_row  = hw + (size_t)r * padded_width;
+        const uint8_t *ref_row = ref + (size_t)r * width;
+        if (std::memcmp(hw_row, ref_row, width) == 0)
+            continue;
+        for (int c = 0; c < width; c++)
+        {
+            if (hw_row[c] != ref_row[c])
+            {
+                if (errors < max_report)
+                {
+                    std::cout << "Error at frame " << frame << " [" << r << "," << c << "]: "
+                              << "HW=" << (int)hw_row[c]
+                              << " SW=" << (int)ref_row[c] << std::endl;
+                }
+                errors++;
+            }
+        }
+    }
+    return errors;
+}
+
+// =============================================================================
+// Streaming Mode: ring of buffer sets on an out-of-order queue
+// =============================================================================
+// Each slot owns its own host/device buffers, so its H2D -> kernel -> D2H
+// chain only waits on its own events. With depth 3 the runtime is free to
+// overlap batch n+1's H2D and batch n-1's D2H with batch n's kernel; with
+// depth 2 only one transfer direction overlaps the kernel at a time.
+//
+// With num_cus > 1 the ring holds depth slots per compute unit and batches
+// are dispatched round-robin. Each slot owns a cl::Kernel bound to one CU
+// ("IMAGE_DIFF_POSTERIZE:{IMAGE_DIFF_POSTERIZE_<n>}", see multi_cu.cfg) and
+// its buffers are bound to that kernel before the first migration, so XRT
+// places them in the CU's own DDR bank.
+struct StreamSlot
+{
+    aligned_vec A, B, C;
+    cl::Buffer buf_A, buf_B, buf_C;
+    std::vector<uint64_t, aligned_allocator<uint64_t>> P, S, T, M, L, H, Q;
+    cl::Buffer buf_L;   // Blob list (V3_BLOBS kernels only, never read back)
+    cl::Buffer buf_H, buf_Q; // Pyramid levels (V3_PYRAMID kernels only, never read back)
+    cl::Buffer buf_P;   // Profiling counters (V3_PROFILE kernels only, never read back)
+    cl::Buffer buf_S;   // Output statistics (V3_STATS kernels only, never read back)
+    cl::Buffer buf_T;   // Posterize tap (V3_POST_TAP kernels only, never read back)
+    cl::Buffer buf_M;   // Change map (never read back)
+    cl::Kernel krnl;    // Bound to this slot's CU and buffers once at setup
+    cl::Event done;     // D2H completion of the batch currently in this slot
+    bool in_flight;
+    bool verifying;     // Posted to the StreamVerifier and not yet checked
+};
+
+// Check one batch of slot results in place against the reference. With
+// every > 1 only frames whose stream index (first_frame + f) is a multiple
+// of every are checked; returns the errors and adds the checked frames to
+// *checked when given.
+static int verify_batch(const uint8_t *padded_C, const uint8_t *sw_result,
+                        int height, int width, int padded_width, int num_frames,
+                        long first_frame = 0, int every = 1, long *checked = nullptr)
+{
+    const size_t image_size  = (size_t)height * width;
+    const size_t frame_bytes = (size_t)height * padded_width;
+    int errors = 0;
+    for (int f = 0; f < num_frames; f++)
+    {
+        if ((first_frame + f) % every != 0)
+            continue;
+        errors += compare_frame(padded_C + f * frame_bytes, sw_result + f * image_size,
+                                height, width, padded_width, f, 0);
+        if (checked)
+            (*checked)++;
+    }
+    return errors;
+}
+
+// Verification thread for the streaming ring: post() hands over a slot whose
+// D2H is enqueued; the thread waits for it and checks it (sampled), and
+// retire() is what the dispatch loop waits on before refilling the slot. The
+// dispatch thread therefore never compares, and only stalls when the ring
+// wraps onto a slot that is still being checked.
+class StreamVerifier
+{
+public:
+    StreamVerifier(const uint8_t *sw_result, int height, int width, int padded_width, int num_frames, int every)
+        : ref_(sw_result), height_(height), width_(width), padded_width_(padded_width),
+          num_frames_(num_frames), every_(every), errors_(0), checked_(0), stopping_(false),
+          worker_(&StreamVerifier::loop, this)
+    {
+    }
+
+    ~StreamVerifier() { finish(); }
+
+    // Check everything still queued, then stop the thread
+    void finish()
+    {
+        {
+            std::lock_guard<std::mutex> lk(mutex_);
+            stopping_ = true;
+        }
+        cv_.notify_all();
+        if (worker_.joinable())
+            worker_.join();
+    }
+
+    void post(StreamSlot *s, int batch)
+    {
+        {
+            std::lock_guard<std::mutex> lk(mutex_);
+            s->verifying = true;
+            jobs_.push_back({s, batch});
+        }
+        cv_.notify_all();
+    }
+
+    // Block until the slot's posted batch has been checked
+    void retire(StreamSlot *s)
+    {
+        std::unique_lock<std::mutex> lk(mutex_);
+        cv_.wait(lk, [s] { return !s->verifying; });
+    }
+
+    // Totals; read after finish()
+    int errors() const { return errors_; }
+    long checked() const { return checked_; }
+
+private:
+    void loop()
+    {
+        trace_name_thread("verifier");
+        for (;;)
+        {
+            std::pair<StreamSlot *, int> job;
+            {
+                std::unique_lock<std::mutex> lk(mutex_);
+                cv_.wait(lk, [this] { return stopping_ || !jobs_.empty(); });
+                if (jobs_.empty())
+                    return;
+                job = jobs_.front();
+                jobs_.pop_front();
+            }
+            cl_int err;
+            {
+                TraceScope wait("verifier: wait D2H", job.second);
+                OCL_CHECK(err, err = job.first->done.wait());
+            }
+            TraceScope trace("verifier: check", job.second);
+            const int e = verify_batch(job.first->C.data(), ref_, height_, width_, padded_width_, num_frames_,
+                                       (long)job.second * num_frames_, every_, &checked_);
+            {
+                std::lock_guard<std::mutex> lk(mutex_);
+                errors_ += e;
+                job.first->verifying = false;
+            }
+            cv_.notify_all();
+        }
+    }
+
+    const uint8_t *ref_;
+    int height_, width_, padded_width_, num_frames_, every_;
+    int errors_;
+    long checked_;          // Only touched by the worker until it is joined
+    bool stopping_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<std::pair<StreamSlot *, int>> jobs_;
+    std::thread worker_;
+};
+
+// Comma-separated integers in [lo, hi]; returns the count, or -1 if malformed
+// or longer than max_n
+static int parse_int_list(const std::string &text, int *vals, int max_n, long lo, long hi)
+{
+    std::istringstream in(text);
+    std::string tok;
+    int n = 0;
+    while (std::getline(in, tok, ','))
+    {
+        char *end = nullptr;
+        long v = std::strtol(tok.c_str(), &end, 10);
+        if (n == max_n || tok.empty() || *end != '\0' || v < lo || v > hi)
+            return -1;
+        vals[n++] = (int)v;
+    }
+    return n;
+}
+
+// =============================================================================
+// Change map (argument 15): per-tile change bits + any-change flag
+// =============================================================================
+static bool change_map_any(const change_map_vec &map)
+{
+    return map.back() != 0;
+}
+
+static int change_map_tiles(const change_map_vec &map)
+{
+    int n = 0;
+    for (size_t i = 0; i + 1 < map.size(); i++)
+        n += __builtin_popcountll(map[i]);
+    return n;
+}
+
+static void print_profile(const uint64_t *prof)
+{
+    std::cout << "\n----------------- Kernel Stage Counters -----------------" << std::endl;
+    std::cout << "compute_diff_wide: " << prof[PROF_DIFF_ACTIVE] << " chunks, "
+              << prof[PROF_DIFF_POST_FULL] << " stream_post full" << std::endl;
+    std::cout << "apply_filter_wide: " << prof[PROF_FILT_ACTIVE] << " iterations, "
+              << prof[PROF_FILT_POST_EMPTY] << " stream_post empty (AXI read wait), "
+              << prof[PROF_FILT_FILT_FULL] << " stream_filt full" << std::endl;
+    std::cout << "write_result_wide: " << prof[PROF_WRITE_ACTIVE] << " chunks, "
+              << prof[PROF_WRITE_FILT_EMPTY] << " stream_filt empty" << std::endl;
+    std::cout << "strips:            " << prof[PROF_STRIPS] << std::endl;
+}
+
+static void print_stats(const uint64_t *stats, int num_levels)
+{
+    std::cout << "\n----------------- Kernel Output Statistics -----------------" << std::endl;
+    for (int l = 0; l < num_levels; l++)
+        std::cout << "level " << l << " (" << POSTERIZE_LEVEL_VALUE(l, num_levels) << "): "
+                  << stats[STATS_LEVEL_COUNT + l] << " px" << std::endl;
+    const double mean = stats[STATS_PIXELS] ? (double)stats[STATS_SUM] / stats[STATS_PIXELS] : 0.0;
+    std::cout << "sharpened: min " << stats[STATS_MIN] << ", max " << stats[STATS_MAX]
+              << ", mean " << mean << " over " << stats[STATS_PIXELS] << " px" << std::endl;
+}
+
+// Check the kernel's min/max/sum/pixel words against the reference output;
+// the level counts have no CPU-side equivalent and are only printed
+static int verify_stats(const uint64_t *stats, const uint8_t *ref, size_t num_pixels)
+{
+    uint64_t lo = 255, hi = 0, sum = 0;
+    for (size_t i = 0; i < num_pixels; i++)
+    {
+        lo = std::min<uint64_t>(lo, ref[i]);
+        hi = std::max<uint64_t>(hi, ref[i]);
+        sum += ref[i];
+    }
+    if (stats[STATS_MIN] == lo && stats[STATS_MAX] == hi && stats[STATS_SUM] == sum &&
+        stats[STATS_PIXELS] == num_pixels)
+        return 0;
+    std::cout << "Stats mismatch: kernel min/max/sum/px " << stats[STATS_MIN] << "/" << stats[STATS_MAX]
+              << "/" << stats[STATS_SUM] << "/" << stats[STATS_PIXELS] << ", expected " << lo << "/"
+              << hi << "/" << sum << "/" << num_pixels << std::endl;
+    return 1;
+}
+
+// =============================================================================
+// Posterize tap (-DV3_POST_TAP "post_tap"): 2-bit level codes per pixel
+// =============================================================================
+// Tap buffer size in uint64_t words (bind_optional_arg units)
+static size_t post_tap_u64_words(int height, int stride_chunks, int num_frames)
+{
+    return (size_t)POST_TAP_WORDS(height, stride_chunks, num_frames) * (DATA_WIDTH_BITS / 64);
+}
+
+// Expands rows of tap words to posterized pixels at compact width: one table
+// lookup and one 4-byte store per packed byte (4 pixels)
+static void unpack_post_tap(const uint8_t *tap, uint8_t *out, int rows, int width, int stride_chunks,
+                            int num_levels)
+{
+    uint8_t value[4];
+    for (int c = 0; c < 4; c++)
+        value[c] = POSTERIZE_LEVEL_VALUE(std::min(c, num_levels - 1), num_levels);
+    uint32_t lut[256];
+    for (int b = 0; b < 256; b++)
+    {
+        const uint8_t px[4] = {value[b & 3], value[(b >> 2) & 3], value[(b >> 4) & 3], value[b >> 6]};
+        std::memcpy(&lut[b], px, 4);
+    }
+
+    const size_t row_bytes = (size_t)POST_TAP_ROW_WORDS(stride_chunks) * (DATA_WIDTH_BITS / 8);
+    for (int r = 0; r < rows; r++)
+    {
+        const uint8_t *src = tap + r * row_bytes;
+        uint8_t *dst = out + (size_t)r * width;
+        int x = 0;
+        for (; x + 4 <= width; x += 4)
+            std::memcpy(dst + x, &lut[src[x / 4]], 4);
+        for (; x < width; x++)
+            dst[x] = value[(src[x / 4] >> (2 * (x % 4))) & 3];
+    }
+}
+
+// Check the unpacked tap against |A - B| posterized on the host; levels
+// above 3 saturate like the kernel's codes
+static int verify_post_tap(const uint8_t *tap_px, const uint8_t *padded_A, const uint8_t *padded_B,
+                           int rows, int width, int padded_width, const PipelineConfig &cfg)
+{
+    int errors = 0;
+    for (int r = 0; r < rows; r++)
+        for (int x = 0; x < width; x++)
+        {
+            const size_t i = (size_t)r * padded_width + x;
+            const int diff = std::abs((int)padded_A[i] - (int)padded_B[i]);
+            int level = 0;
+            while (level < cfg.levels - 1 && diff >= cfg.thr[level])
+                level++;
+            const uint8_t expected = POSTERIZE_LEVEL_VALUE(std::min(level, 3), cfg.levels);
+            if (tap_px[(size_t)r * width + x] != expected && errors++ < 10)
+                std::cout << "Tap mismatch at row " << r << " x " << x << ": " << (int)tap_px[(size_t)r * width + x]
+                          << " != " << (int)expected << std::endl;
+        }
+    return errors;
+}
+
+// Check each frame's blob list against a flood fill of its top-level
+// (white) posterized pixels, reporting what the kernel found
+static int verify_blobs(const uint64_t *blobs, const uint8_t *padded_A, const uint8_t *padded_B,
+                        int height, int width, int stride_chunks, int num_frames, const PipelineConfig &cfg)
+{
+    const int padded_width = stride_chunks * PIXELS_PER_CHUNK;
+    std::vector<uint8_t> white((size_t)height * padded_width);
+    uint64_t ref[BLOB_FRAME_WORDS];
+    int errors = 0;
+    for (int f = 0; f < num_frames; f++)
+    {
+        const size_t base = (size_t)f * height * padded_width;
+        for (size_t i = 0; i < white.size(); i++)
+            white[i] = std::abs((int)padded_A[base + i] - (int)padded_B[base + i]) >= cfg.thr[cfg.levels - 2];
+        const uint64_t *hw = blobs + (size_t)f * BLOB_FRAME_WORDS;
+        blob_list_ref(white.data(), height, width, padded_width, stride_chunks, ref);
+        const int w = blob_list_mismatch(hw, ref);
+        if (w >= 0 && errors++ < 10)
+            std::cout << "Blob list mismatch in frame " << f << " at word " << w << ": 0x" << std::hex << hw[w]
+                      << " != 0x" << ref[w] << std::dec << std::endl;
+        if (f == 0)
+            std::cout << "Blobs: " << BLOB_FOUND(hw[0]) << " found in frame 0"
+                      << ((BLOB_FLAGS(hw[0]) & BLOB_FLAG_LABELS) ? " (label table overflowed)" : "")
+                      << ((BLOB_FLAGS(hw[0]) & BLOB_FLAG_WIDE) ? " (frame wider than one strip)" : "") << std::endl;
+    }
+    return errors;
+}
+
+// =============================================================================
+// Resolution pyramid (-DV3_PYRAMID "pyr_half", "pyr_quarter")
+// =============================================================================
+// Level buffer size in uint64_t words; never empty, so frames under four
+// rows still get a buffer to bind
+static size_t pyr_u64_words(int height, int stride_chunks, int num_frames, int level)
+{
+    return std::max<size_t>(PYR_WORDS(height, stride_chunks, num_frames, level), 1) * (DATA_WIDTH_BITS / 64);
+}
+
+// Check both levels against the host reference's own 2x2 means
+static int verify_pyramid(const uint64_t *half, const uint64_t *quarter, const std::vector<uint8_t> &sw_result,
+                          int height, int width, int stride_chunks, int num_frames)
+{
+    const size_t image_size = (size_t)height * width;
+    const int rows1 = PYR_ROWS(height, 1), cols1 = PYR_COLS(width, 1);
+    std::vector<uint8_t> ref[3];
+    int errors = 0;
+    for (int f = 0; f < num_frames; f++)
+    {
+        ref[1].assign((size_t)rows1 * cols1 + 1, 0);
+        ref[2].assign((size_t)PYR_ROWS(height, 2) * PYR_COLS(width, 2) + 1, 0);
+        pyramid_level_ref(&sw_result[f * image_size], height, width, width, ref[1].data(), cols1);
+        pyramid_level_ref(ref[1].data(), rows1, cols1, cols1, ref[2].data(), PYR_COLS(width, 2));
+        for (int level = 1; level <= 2; level++)
+        {
+            const uint8_t *hw = reinterpret_cast<const uint8_t *>(level == 1 ? half : quarter);
+            const int rows = PYR_ROWS(height, level), cols = PYR_COLS(width, level);
+            const size_t pitch = (size_t)PYR_STRIDE(stride_chunks, level) * PIXELS_PER_CHUNK;
+            for (int y = 0; y < rows; y++)
+                for (int x = 0; x < cols; x++)
+                {
+                    const uint8_t got = hw[((size_t)f * rows + y) * pitch + x];
+                    const uint8_t expected = ref[level][(size_t)y * cols + x];
+                    if (got != expected && errors++ < 10)
+                        std::cout << "Pyramid level " << level << " mismatch in frame " << f << " at (" << x << ", "
+                                  << y << "): " << (int)got << " != " << (int)expected << std::endl;
+                }
+        }
+    }
+    return errors;
+}
+
+static std::string cu_kernel_name(int cu, int num_cus)
+{
+    if (num_cus == 1)
+        return "IMAGE_DIFF_POSTERIZE";
+    return "IMAGE_DIFF_POSTERIZE:{IMAGE_DIFF_POSTERIZE_" + std::to_string(cu + 1) + "}";
+}
+
+static int run_stream_mode(cl::Context &context, cl::CommandQueue &q, cl::Program &program,
+                           const aligned_vec &padded_A, const aligned_vec &padded_B,
+                           const std::vector<uint8_t> &sw_result,
+                           int height, int width, int stride_chunks, int num_frames,
+                           const PipelineConfig &cfg, int iterations, int depth, int num_cus, int verify_every)
+{
+    cl_int err;
+    const int padded_width    = stride_chunks * PIXELS_PER_CHUNK;
+    const size_t buffer_bytes = padded_A.size();
+
+    // Every slot streams the same input batch; a live producer would refill
+    // slot.A / slot.B before each H2D instead.
+    std::vector<StreamSlot> slots(depth * num_cus);
+    for (size_t i = 0; i < slots.size(); i++)
+    {
+        StreamSlot &s = slots[i];
+        s.A.assign(padded_A.begin(), padded_A.end());
+        s.B.assign(padded_B.begin(), padded_B.end());
+        s.C.assign(buffer_bytes, 0);
+        s.in_flight = false;
+        s.verifying = false;
+        OCL_CHECK(err, s.buf_A = cl::Buffer(context, CL_MEM_USE_HOST_PTR | CL_MEM_READ_ONLY,
+                                            buffer_bytes, s.A.data(), &err));
+        OCL_CHECK(err, s.buf_B = cl::Buffer(context, CL_MEM_USE_HOST_PTR | CL_MEM_READ_ONLY,
+                                            buffer_bytes, s.B.data(), &err));
+        OCL_CHECK(err, s.buf_C = cl::Buffer(context, CL_MEM_USE_HOST_PTR | CL_MEM_WRITE_ONLY,
+                                            buffer_bytes, s.C.data(), &err));
+
+        // Slot i runs on CU i % num_cus; all arguments are fixed for its lifetime
+        const std::string name = cu_kernel_name(i % num_cus, num_cus);
+        OCL_CHECK(err, s.krnl = cl::Kernel(program, name.c_str(), &err));
+        OCL_CHECK(err, err = s.krnl.setArg(0, s.buf_A));
+        OCL_CHECK(err, err = s.krnl.setArg(1, s.buf_B));
+        OCL_CHECK(err, err = s.krnl.setArg(2, s.buf_C));
+        OCL_CHECK(err, err = s.krnl.setArg(3, height));
+        OCL_CHECK(err, err = s.krnl.setArg(4, width));
+        OCL_CHECK(err, err = s.krnl.setArg(5, stride_chunks));
+        OCL_CHECK(err, err = s.krnl.setArg(6, num_frames));
+        set_pipeline_args(s.krnl, cfg);
+        s.M.assign(CHANGE_MAP_WORDS(height, stride_chunks, num_frames), 0);
+        OCL_CHECK(err, s.buf_M = cl::Buffer(context, CL_MEM_USE_HOST_PTR | CL_MEM_WRITE_ONLY,
+                                            s.M.size() * sizeof(uint64_t), s.M.data(), &err));
+        OCL_CHECK(err, err = s.krnl.setArg(CHANGE_MAP_ARG_INDEX, s.buf_M));
+        bind_optional_arg(context, s.krnl, "post_tap", post_tap_u64_words(height, stride_chunks, num_frames),
+                          s.T, s.buf_T);
+        bind_optional_arg(context, s.krnl, "stats", STATS_NUM_WORDS, s.S, s.buf_S);
+        bind_optional_arg(context, s.krnl, "prof", PROF_NUM_COUNTERS, s.P, s.buf_P);
+        bind_optional_arg(context, s.krnl, "blobs", BLOB_WORDS(num_frames), s.L, s.buf_L);
+        bind_optional_arg(context, s.krnl, "pyr_half", pyr_u64_words(height, stride_chunks, num_frames, 1),
+                          s.H, s.buf_H);
+        bind_optional_arg(context, s.krnl, "pyr_quarter", pyr_u64_words(height, stride_chunks, num_frames, 2),
+                          s.Q, s.buf_Q);
+    }
+
+    auto t_start = std::chrono::high_resolution_clock::now();
+    StreamVerifier verifier(sw_result.data(), height, width, padded_width, num_frames, verify_every);
+
+    for (int n = 0; n < iterations; n++)
+    {
+        StreamSlot &s = slots[n % slots.size()];
+
+        // Slot reuse: wait until the batch that last occupied it is checked
+        if (s.in_flight)
+        {
+            TraceScope wait("dispatch: retire slot", n);
+            verifier.retire(&s);
+        }
+        TraceScope trace("dispatch: enqueue", n);
+
+        cl::Event h2d, krn;
+        std::vector<cl::Event> h2d_deps, krn_deps;
+
+        OCL_CHECK(err, err = q.enqueueMigrateMemObjects({s.buf_A, s.buf_B}, 0, nullptr, &h2d));
+        h2d_deps.push_back(h2d);
+
+        OCL_CHECK(err, err = q.enqueueTask(s.krnl, &h2d_deps, &krn));
+        krn_deps.push_back(krn);
+
+        OCL_CHECK(err, err = q.enqueueMigrateMemObjects({s.buf_C}, CL_MIGRATE_MEM_OBJECT_HOST,
+                                                        &krn_deps, &s.done));
+        OCL_CHECK(err, err = q.flush());
+        s.in_flight = true;
+        verifier.post(&s, n);
+    }
+
+    // Drain: retire whatever is still in the ring
+    OCL_CHECK(err, err = q.finish());
+    verifier.finish();
+    const int error_count = verifier.errors();
+
+    auto t_end = std::chrono::high_resolution_clock::now();
+    const double secs    = std::chrono::duration<double>(t_end - t_start).count();
+    const double frames  = (double)iterations * num_frames;
+    const double mbytes  = frames * 3.0 * (buffer_bytes / num_frames) / 1e6; // A + B in, C out
+
+    std::cout << "====== Streaming Summary ======" << std::endl;
+    std::cout << "Iterations: " << iterations << " x " << num_frames << " frame(s), "
+              << depth << " buffer sets x " << num_cus << " CU(s)" << std::endl;
+    std::cout << "Wall time:  " << secs * 1e3 << " ms" << std::endl;
+    std::cout << "Throughput: " << frames / secs << " frames/s, "
+              << mbytes / secs << " MB/s over PCIe" << std::endl;
+    std::cout << "Verified:   " << verifier.checked() << " of " << (long)frames << " frame(s) on the verifier thread" << std::endl;
+    std::cout << "===============================" << std::endl;
+
+    return error_count;
+}
+
+// =============================================================================
+// Lane Mode: one batch split by rows across K HBM-resident compute units
+// =============================================================================
+// A single 512-bit master moves at most 64 px/cycle. With hbm_lanes.cfg each
+// CU is a lane whose A/B/C/change-map masters have their own pseudo-channels
+// (HBM[4n + port]), so the lanes together move K chunks per cycle per image.
+//
+// Lane n owns output rows [r0, r1) of every frame. Its input band adds one
+// halo row above and below where the frame continues, so band row 1 onwards
+// sees its true neighbours and the kernel's border handling only ever lands
+// on real frame edges or on halo rows whose output is dropped here.
+#define LANE_HBM_PORTS 4  // Pseudo-channels per lane: A, B, C, change map
+#define MAX_LANES      4  // CUs in hbm_lanes.cfg (IMAGE_DIFF_POSTERIZE_1..4)
+
+struct LaneSlot
+{
+    int r0, r1;         // Output rows of each frame owned by this lane
+    int in_r0, in_rows; // Input band incl. halos
+    aligned_vec A, B, C;
+    cl::Buffer buf_A, buf_B, buf_C;
+    counter_vec P, S, T, L, H, Q;
+    change_map_vec M;
+    cl::Buffer buf_P, buf_S, buf_T, buf_M, buf_L, buf_H, buf_Q;
+    cl::Kernel krnl;
+    cl::Event krn;
+};
+
+// Host buffer placed explicitly in one memory-topology bank (HBM[bank])
+static cl::Buffer bank_buffer(cl::Context &context, cl_mem_flags flags, size_t bytes, void *host, unsigned bank)
+{
+    cl_int err;
+    cl_mem_ext_ptr_t ext;
+    ext.flags = bank | XCL_MEM_TOPOLOGY;
+    ext.obj   = host;
+    ext.param = nullptr;
+    cl::Buffer buf;
+    OCL_CHECK(err, buf = cl::Buffer(context, flags | CL_MEM_USE_HOST_PTR | CL_MEM_EXT_PTR_XILINX, bytes, &ext, &err));
+    return buf;
+}
+
+static int run_lanes_mode(cl::Context &context, cl::CommandQueue &q, cl::Program &program,
+                          const aligned_vec &padded_A, const aligned_vec &padded_B,
+                          const std::vector<uint8_t> &sw_result,
+                          int height, int width, int stride_chunks, int num_frames,
+                          const PipelineConfig &cfg, int num_lanes)
+{
+    cl_int err;
+    const int padded_width   = stride_chunks * PIXELS_PER_CHUNK;
+    const size_t frame_bytes = (size_t)height * padded_width;
+    const size_t image_size  = (size_t)height * width;
+
+    std::vector<LaneSlot> lanes(num_lanes);
+    for (int n = 0; n < num_lanes; n++)
+    {
+        LaneSlot &l = lanes[n];
+        l.r0      = (int)((int64_t)height * n / num_lanes);
+        l.r1      = (int)((int64_t)height * (n + 1) / num_lanes);
+        l.in_r0   = (l.r0 > 0) ? l.r0 - 1 : 0;
+        l.in_rows = ((l.r1 < height) ? l.r1 + 1 : height) - l.in_r0;
+
+        // Gather this lane's band of every frame into its own contiguous buffer
+        const size_t band_bytes = (size_t)l.in_rows * padded_width;
+        l.A.resize(band_bytes * num_frames);
+        l.B.resize(band_bytes * num_frames);
+        l.C.assign(band_bytes * num_frames, 0);
+        for (int f = 0; f < num_frames; f++)
+        {
+            const size_t src = f * frame_bytes + (size_t)l.in_r0 * padded_width;
+            std::memcpy(&l.A[f * band_bytes], &padded_A[src], band_bytes);
+            std::memcpy(&l.B[f * band_bytes], &padded_B[src], band_bytes);
+        }
+
+        const unsigned bank = LANE_HBM_PORTS * n;
+        l.buf_A = bank_buffer(context, CL_MEM_READ_ONLY, l.A.size(), l.A.data(), bank + 0);
+        l.buf_B = bank_buffer(context, CL_MEM_READ_ONLY, l.B.size(), l.B.data(), bank + 1);
+        l.buf_C = bank_buffer(context, CL_MEM_WRITE_ONLY, l.C.size(), l.C.data(), bank + 2);
+        l.M.assign(CHANGE_MAP_WORDS(l.in_rows, stride_chunks, num_frames), 0);
+        l.buf_M = bank_buffer(context, CL_MEM_WRITE_ONLY, l.M.size() * sizeof(uint64_t), l.M.data(), bank + 3);
+
+        const std::string name = cu_kernel_name(n, num_lanes);
+        OCL_CHECK(err, l.krnl = cl::Kernel(program, name.c_str(), &err));
+        OCL_CHECK(err, err = l.krnl.setArg(0, l.buf_A));
+        OCL_CHECK(err, err = l.krnl.setArg(1, l.buf_B));
+        OCL_CHECK(err, err = l.krnl.setArg(2, l.buf_C));
+        OCL_CHECK(err, err = l.krnl.setArg(3, l.in_rows));
+        OCL_CHECK(err, err = l.krnl.setArg(4, width));
+        OCL_CHECK(err, err = l.krnl.setArg(5, stride_chunks));
+        OCL_CHECK(err, err = l.krnl.setArg(6, num_frames));
+        set_pipeline_args(l.krnl, cfg);
+        OCL_CHECK(err, err = l.krnl.setArg(CHANGE_MAP_ARG_INDEX, l.buf_M));
+        bind_optional_arg(context, l.krnl, "post_tap", post_tap_u64_words(l.in_rows, stride_chunks, num_frames),
+                          l.T, l.buf_T);
+        bind_optional_arg(context, l.krnl, "stats", STATS_NUM_WORDS, l.S, l.buf_S);
+        bind_optional_arg(context, l.krnl, "prof", PROF_NUM_COUNTERS, l.P, l.buf_P);
+        bind_optional_arg(context, l.krnl, "blobs", BLOB_WORDS(num_frames), l.L, l.buf_L);
+        bind_optional_arg(context, l.krnl, "pyr_half", pyr_u64_words(l.in_rows, stride_chunks, num_frames, 1),
+                          l.H, l.buf_H);
+        bind_optional_arg(context, l.krnl, "pyr_quarter", pyr_u64_words(l.in_rows, stride_chunks, num_frames, 2),
+                          l.Q, l.buf_Q);
+    }
+
+    // All lanes start together; each chain only waits on its own upload
+    auto t_start = std::chrono::high_resolution_clock::now();
+    for (auto &l : lanes)
+    {
+        cl::Event h2d;
+        std::vector<cl::Event> deps;
+        OCL_CHECK(err, err = q.enqueueMigrateMemObjects({l.buf_A, l.buf_B}, 0, nullptr, &h2d));
+        deps.push_back(h2d);
+        OCL_CHECK(err, err = q.enqueueTask(l.krnl, &deps, &l.krn));
+    }
+    OCL_CHECK(err, err = q.finish());
+    auto t_kernel = std::chrono::high_resolution_clock::now();
+    for (auto &l : lanes)
+    {
+        OCL_CHECK(err, err = q.enqueueMigrateMemObjects({l.buf_C}, CL_MIGRATE_MEM_OBJECT_HOST));
+    }
+    OCL_CHECK(err, err = q.finish());
+
+    // Stitch the owned rows of every lane back into frame order and verify
+    aligned_vec C(frame_bytes * num_frames);
+    cl_ulong k_start = ~(cl_ulong)0, k_end = 0;
+    for (auto &l : lanes)
+    {
+        const size_t band_bytes = (size_t)l.in_rows * padded_width;
+        const size_t owned      = (size_t)(l.r1 - l.r0) * padded_width;
+        for (int f = 0; f < num_frames; f++)
+        {
+            std::memcpy(&C[f * frame_bytes + (size_t)l.r0 * padded_width],
+                        &l.C[f * band_bytes + (size_t)(l.r0 - l.in_r0) * padded_width], owned);
+        }
+        k_start = std::min(k_start, l.krn.getProfilingInfo<CL_PROFILING_COMMAND_START>(&err));
+        k_end   = std::max(k_end, l.krn.getProfilingInfo<CL_PROFILING_COMMAND_END>(&err));
+    }
+
+    int error_count = 0;
+    for (int f = 0; f < num_frames; f++)
+    {
+        error_count += compare_frame(&C[f * frame_bytes], &sw_result[f * image_size],
+                                     height, width, padded_width, f, 10);
+    }
+
+    const double kernel_ms = (k_end > k_start) ? (k_end - k_start) * 1e-6 : 0.0;
+    std::cout << "====== Lane Summary ======" << std::endl;
+    std::cout << "Lanes:      " << num_lanes << " x HBM[" << LANE_HBM_PORTS << "n.."
+              << LANE_HBM_PORTS << "n+" << LANE_HBM_PORTS - 1 << "], " << num_frames << " frame(s)" << std::endl;
+    for (int n = 0; n < num_lanes; n++)
+    {
+        std::cout << "Lane " << n << ":     rows [" << lanes[n].r0 << ", " << lanes[n].r1 << "), "
+                  << change_map_tiles(lanes[n].M) << " changed tile(s) incl. halos" << std::endl;
+    }
+    std::cout << "Kernels:    " << kernel_ms << " ms (first start to last end), H2D+kernel "
+              << std::chrono::duration<double, std::milli>(t_kernel - t_start).count() << " ms" << std::endl;
+    if (kernel_ms > 0)
+        std::cout << "Throughput: " << (double)image_size * num_frames / (kernel_ms * 1e3) << " Mpx/s" << std::endl;
+    std::cout << "==========================" << std::endl;
+
+    return error_count;
+}
+
+// =============================================================================
+// Split Mode: one diff CU streaming into two sharpen CUs (split_k2k.cfg)
+// =============================================================================
+// IMAGE_DIFF_SPLIT sends batch n to out_sel = n % 2, whose stream is wired
+// to IMAGE_SHARPEN_SPLIT_<n % 2 + 1>. Each sharpen CU owns its C buffer; the
+// inputs are uploaded once. A stream-coupled pair only completes when both
+// ends run, so the sharpen task is enqueued before the diff task that feeds it.
+#define SPLIT_SHARPEN_CUS 2
+
+static int run_split_mode(cl::Context &context, cl::CommandQueue &q, cl::Program &program, cl::Kernel &krnl_diff,
+                          aligned_vec &padded_A, aligned_vec &padded_B,
+                          const std::vector<uint8_t> &sw_result,
+                          int height, int width, int stride_chunks, int num_frames,
+                          const PipelineConfig &cfg, int iterations)
+{
+    cl_int err;
+    const int padded_width    = stride_chunks * PIXELS_PER_CHUNK;
+    const size_t buffer_bytes = padded_A.size();
+
+    OCL_CHECK(err, cl::Buffer buf_A(context, CL_MEM_USE_HOST_PTR | CL_MEM_READ_ONLY, buffer_bytes, padded_A.data(), &err));
+    OCL_CHECK(err, cl::Buffer buf_B(context, CL_MEM_USE_HOST_PTR | CL_MEM_READ_ONLY, buffer_bytes, padded_B.data(), &err));
+    change_map_vec M(CHANGE_MAP_WORDS(height, stride_chunks, num_frames), 0);
+    OCL_CHECK(err, cl::Buffer buf_M(context, CL_MEM_USE_HOST_PTR | CL_MEM_WRITE_ONLY,
+                                    M.size() * sizeof(uint64_t), M.data(), &err));
+
+    // IMAGE_DIFF_SPLIT(A, B, out0, out1, height, stride_chunks, num_frames,
+    //                  post_thr03, post_thr46, post_levels, change_map, out_sel);
+    // the stream ports are wired at link time and take no host argument
+    OCL_CHECK(err, err = krnl_diff.setArg(0, buf_A));
+    OCL_CHECK(err, err = krnl_diff.setArg(1, buf_B));
+    OCL_CHECK(err, err = krnl_diff.setArg(4, height));
+    OCL_CHECK(err, err = krnl_diff.setArg(5, stride_chunks));
+    OCL_CHECK(err, err = krnl_diff.setArg(6, num_frames));
+    set_posterize_args(krnl_diff, cfg, 7);
+    OCL_CHECK(err, err = krnl_diff.setArg(10, buf_M));
+
+    // IMAGE_SHARPEN_SPLIT(in, C, height, width, stride_chunks, num_frames,
+    //                     coef_r0, coef_r1, coef_r2, coef_shift, border_mode)
+    aligned_vec C[SPLIT_SHARPEN_CUS];
+    cl::Buffer buf_C[SPLIT_SHARPEN_CUS];
+    cl::Kernel krnl_sharpen[SPLIT_SHARPEN_CUS];
+    cl::Event done[SPLIT_SHARPEN_CUS];
+    bool in_flight[SPLIT_SHARPEN_CUS] = {false};
+    for (int s = 0; s < SPLIT_SHARPEN_CUS; s++)
+    {
+        C[s].assign(buffer_bytes, 0);
+        OCL_CHECK(err, buf_C[s] = cl::Buffer(context, CL_MEM_USE_HOST_PTR | CL_MEM_WRITE_ONLY,
+                                             buffer_bytes, C[s].data(), &err));
+        const std::string name = "IMAGE_SHARPEN_SPLIT:{IMAGE_SHARPEN_SPLIT_" + std::to_string(s + 1) + "}";
+        OCL_CHECK(err, krnl_sharpen[s] = cl::Kernel(program, name.c_str(), &err));
+        OCL_CHECK(err, err = krnl_sharpen[s].setArg(1, buf_C[s]));
+        OCL_CHECK(err, err = krnl_sharpen[s].setArg(2, height));
+        OCL_CHECK(err, err = krnl_sharpen[s].setArg(3, width));
+        OCL_CHECK(err, err = krnl_sharpen[s].setArg(4, stride_chunks));
+        OCL_CHECK(err, err = krnl_sharpen[s].setArg(5, num_frames));
+        set_sharpen_args(krnl_sharpen[s], cfg, 6);
+    }
+
+    int error_count = 0;
+    auto t_start = std::chrono::high_resolution_clock::now();
+
+    cl::Event h2d;
+    OCL_CHECK(err, err = q.enqueueMigrateMemObjects({buf_A, buf_B}, 0, nullptr, &h2d));
+    std::vector<cl::Event> h2d_deps{h2d};
+
+    for (int n = 0; n < iterations; n++)
+    {
+        const int s = n % SPLIT_SHARPEN_CUS;
+        if (in_flight[s])
+        {
+            OCL_CHECK(err, err = done[s].wait());
+            error_count += verify_batch(C[s].data(), sw_result.data(), height, width, padded_width, num_frames);
+        }
+
+        cl::Event krn;
+        std::vector<cl::Event> krn_deps;
+        OCL_CHECK(err, err = q.enqueueTask(krnl_sharpen[s], nullptr, &krn));
+        krn_deps.push_back(krn);
+        OCL_CHECK(err, err = krnl_diff.setArg(11, s));
+        OCL_CHECK(err, err = q.enqueueTask(krnl_diff, &h2d_deps));
+        OCL_CHECK(err, err = q.enqueueMigrateMemObjects({buf_C[s]}, CL_MIGRATE_MEM_OBJECT_HOST, &krn_deps, &done[s]));
+        OCL_CHECK(err, err = q.flush());
+        in_flight[s] = true;
+    }
+
+    OCL_CHECK(err, err = q.finish());
+    for (int s = 0; s < SPLIT_SHARPEN_CUS; s++)
+    {
+        if (in_flight[s])
+            error_count += verify_batch(C[s].data(), sw_result.data(), height, width, padded_width, num_frames);
+    }
+
+    auto t_end = std::chrono::high_resolution_clock::now();
+    const double secs = std::chrono::duration<double>(t_end - t_start).count();
+
+    std::cout << "====== Split Summary ======" << std::endl;
+    std::cout << "Batches:    " << iterations << " x " << num_frames << " frame(s), 1 diff CU -> "
+              << SPLIT_SHARPEN_CUS << " sharpen CUs" << std::endl;
+    std::cout << "Wall time:  " << secs * 1e3 << " ms" << std::endl;
+    std::cout << "Throughput: " << (double)iterations * num_frames / secs << " frames/s" << std::endl;
+    std::cout << "===========================" << std::endl;
+
+    return error_count;
+}
 
 // =============================================================================
-// Helper: Pad pixels from WIDTHxHEIGHT to PADDED_WIDTH xHEIGHT
+// ROI Mode: only the listed rectangles are processed and transferred
 // =============================================================================
-void pad_pixels(const uint8_t *image_data, uint8_t *hw_buffer)
+// Needs a -DV3_ROI xclbin. The kernel reads each ROI plus one row / chunk of
+// context, so only those rows of A/B go H2D, and only the owned rows of
+// ROIs whose change flag is set come back D2H (a clear flag means the ROI's
+// output is all zero). Each transfer is a sub-buffer of the full batch
+// buffer; sub-buffer origins must be SUB_BUFFER_ALIGN-aligned, so the row
+// spans are widened to that and merged before they are migrated.
+#define SUB_BUFFER_ALIGN 4096
+
+typedef std::vector<std::pair<size_t, size_t>> byte_spans; // [first, second) byte ranges
+
+static byte_spans align_spans(byte_spans spans, size_t limit)
 {
-    // Zero entire destination first
-    std::memset(hw_buffer, 0, BUFFER_SIZE_BYTES);
+    for (auto &sp : spans)
+    {
+        sp.first  = sp.first / SUB_BUFFER_ALIGN * SUB_BUFFER_ALIGN;
+        sp.second = std::min((sp.second + SUB_BUFFER_ALIGN - 1) / SUB_BUFFER_ALIGN * SUB_BUFFER_ALIGN, limit);
+    }
+    std::sort(spans.begin(), spans.end());
+    byte_spans merged;
+    for (const auto &sp : spans)
+    {
+        if (!merged.empty() && sp.first <= merged.back().second)
+            merged.back().second = std::max(merged.back().second, sp.second);
+        else
+            merged.push_back(sp);
+    }
+    return merged;
+}
 
-    // Copy each row, leaving padding columns as zero
-    for (int r = 0; r < HEIGHT; r++)
+// Sub-buffers of buf over spans; returns the bytes they cover
+static size_t span_sub_buffers(cl::Buffer &buf, cl_mem_flags flags, const byte_spans &spans,
+                               std::vector<cl::Memory> &subs)
+{
+    cl_int err;
+    size_t bytes = 0;
+    for (const auto &sp : spans)
     {
-        std::memcpy(hw_buffer + r * PADDED_WIDTH , image_data + r * WIDTH, WIDTH);
+        cl_buffer_region region = {sp.first, sp.second - sp.first};
+        OCL_CHECK(err, cl::Buffer sub = buf.createSubBuffer(flags, CL_BUFFER_CREATE_TYPE_REGION, &region, &err));
+        subs.push_back(sub);
+        bytes += region.size;
     }
+    return bytes;
 }
 
-// =============================================================================
-// Helper: Unpad pixels from PADDED_WIDTH xHEIGHT to WIDTHxHEIGHT
-// =============================================================================
-void unpad_pixels(const uint8_t *hw_buffer, uint8_t *image_data)
-{
-    for (int r = 0; r < HEIGHT; r++)
+static int run_roi_mode(cl::Context &context, cl::CommandQueue &q, cl::Kernel &krnl,
+                        aligned_vec &padded_A, aligned_vec &padded_B,
+                        const std::vector<uint8_t> &sw_result,
+                        int height, int width, int stride_chunks, int num_frames,
+                        const PipelineConfig &cfg, const std::vector<uint64_t> &roi_list)
+{
+    cl_int err;
+    const int rois_arg = kernel_arg_index(krnl, "rois");
+    if (rois_arg < 0)
+    {
+        std::cout << "--roi needs an xclbin built with -DV3_ROI" << std::endl;
+        return 1;
+    }
+
+    const int num_rois       = (int)roi_list.size();
+    const int padded_width   = stride_chunks * PIXELS_PER_CHUNK;
+    const size_t frame_bytes = (size_t)height * padded_width;
+    const size_t image_size  = (size_t)height * width;
+    const size_t buffer_bytes = padded_A.size();
+
+    aligned_vec padded_C(buffer_bytes, 0);
+    std::vector<uint64_t, aligned_allocator<uint64_t>> rois(roi_list.begin(), roi_list.end());
+    change_map_vec flags(ROI_CHANGE_WORDS(num_rois, num_frames), 0);
+    OCL_CHECK(err, cl::Buffer buf_A(context, CL_MEM_USE_HOST_PTR | CL_MEM_READ_ONLY, buffer_bytes, padded_A.data(), &err));
+    OCL_CHECK(err, cl::Buffer buf_B(context, CL_MEM_USE_HOST_PTR | CL_MEM_READ_ONLY, buffer_bytes, padded_B.data(), &err));
+    OCL_CHECK(err, cl::Buffer buf_C(context, CL_MEM_USE_HOST_PTR | CL_MEM_WRITE_ONLY, buffer_bytes, padded_C.data(), &err));
+    OCL_CHECK(err, cl::Buffer buf_M(context, CL_MEM_USE_HOST_PTR | CL_MEM_WRITE_ONLY,
+                                    flags.size() * sizeof(uint64_t), flags.data(), &err));
+    OCL_CHECK(err, cl::Buffer buf_R(context, CL_MEM_USE_HOST_PTR | CL_MEM_READ_ONLY,
+                                    rois.size() * sizeof(uint64_t), rois.data(), &err));
+
+    OCL_CHECK(err, err = krnl.setArg(0, buf_A));
+    OCL_CHECK(err, err = krnl.setArg(1, buf_B));
+    OCL_CHECK(err, err = krnl.setArg(2, buf_C));
+    OCL_CHECK(err, err = krnl.setArg(3, height));
+    OCL_CHECK(err, err = krnl.setArg(4, width));
+    OCL_CHECK(err, err = krnl.setArg(5, stride_chunks));
+    OCL_CHECK(err, err = krnl.setArg(6, num_frames));
+    set_pipeline_args(krnl, cfg);
+    OCL_CHECK(err, err = krnl.setArg(CHANGE_MAP_ARG_INDEX, buf_M));
+    OCL_CHECK(err, err = krnl.setArg(rois_arg, buf_R));
+    OCL_CHECK(err, err = krnl.setArg(rois_arg + 1, num_rois));
+
+    // Input: every ROI's rows plus its context rows, in every frame
+    byte_spans in_spans;
+    for (int f = 0; f < num_frames; f++)
+    {
+        for (uint64_t roi : roi_list)
+        {
+            const int r0 = std::max(ROI_ROW0(roi) - 1, 0);
+            const int r1 = std::min(ROI_ROW1(roi) + 1, height);
+            in_spans.push_back({f * frame_bytes + (size_t)r0 * padded_width, f * frame_bytes + (size_t)r1 * padded_width});
+        }
+    }
+    in_spans = align_spans(in_spans, buffer_bytes);
+
+    auto t_start = std::chrono::high_resolution_clock::now();
+    std::vector<cl::Memory> in_subs{buf_R};
+    size_t h2d_bytes = span_sub_buffers(buf_A, CL_MEM_READ_ONLY, in_spans, in_subs);
+    h2d_bytes += span_sub_buffers(buf_B, CL_MEM_READ_ONLY, in_spans, in_subs);
+    OCL_CHECK(err, err = q.enqueueMigrateMemObjects(in_subs, 0));
+    cl::Event krn;
+    OCL_CHECK(err, err = q.enqueueTask(krnl, nullptr, &krn));
+    OCL_CHECK(err, err = q.enqueueMigrateMemObjects({buf_M}, CL_MIGRATE_MEM_OBJECT_HOST));
+    OCL_CHECK(err, err = q.finish());
+
+    // Output: owned rows of the changed ROIs; clean ROIs are zero
+    byte_spans out_spans;
+    int changed = 0;
+    for (int f = 0; f < num_frames; f++)
+    {
+        for (int i = 0; i < num_rois; i++)
+        {
+            const uint64_t roi = roi_list[i];
+            if (flags[f * num_rois + i])
+            {
+                out_spans.push_back({f * frame_bytes + (size_t)ROI_ROW0(roi) * padded_width,
+                                     f * frame_bytes + (size_t)ROI_ROW1(roi) * padded_width});
+                changed++;
+            }
+        }
+    }
+    out_spans = align_spans(out_spans, buffer_bytes);
+    std::vector<cl::Memory> out_subs;
+    const size_t d2h_bytes = span_sub_buffers(buf_C, CL_MEM_WRITE_ONLY, out_spans, out_subs);
+    if (!out_subs.empty())
+    {
+        OCL_CHECK(err, err = q.enqueueMigrateMemObjects(out_subs, CL_MIGRATE_MEM_OBJECT_HOST));
+        OCL_CHECK(err, err = q.finish());
+    }
+    auto t_end = std::chrono::high_resolution_clock::now();
+
+    // Verify the ROI pixels only; the rest of C is not defined in ROI mode
+    int error_count = 0;
+    size_t roi_pixels = 0;
+    for (int f = 0; f < num_frames; f++)
+    {
+        for (int i = 0; i < num_rois; i++)
+        {
+            const uint64_t roi = roi_list[i];
+            const int c0 = ROI_COL0(roi) * (int)PIXELS_PER_CHUNK;
+            const int c1 = std::min(ROI_COL1(roi) * (int)PIXELS_PER_CHUNK, width);
+            for (int r = ROI_ROW0(roi); r < ROI_ROW1(roi); r++)
+            {
+                const uint8_t *hw_row  = &padded_C[f * frame_bytes + (size_t)r * padded_width];
+                const uint8_t *ref_row = &sw_result[f * image_size + (size_t)r * width];
+                for (int c = c0; c < c1; c++)
+                {
+                    const int hw = flags[f * num_rois + i] ? hw_row[c] : 0;
+                    if (hw != ref_row[c])
+                    {
+                        if (error_count < 10)
+                            std::cout << "Error at frame " << f << " ROI " << i << " [" << r << "," << c << "]: "
+                                      << "HW=" << hw << " SW=" << (int)ref_row[c] << std::endl;
+                        error_count++;
+                    }
+                }
+                roi_pixels += c1 - c0;
+            }
+        }
+    }
+
+    cl_ulong k_start = krn.getProfilingInfo<CL_PROFILING_COMMAND_START>(&err);
+    cl_ulong k_end   = krn.getProfilingInfo<CL_PROFILING_COMMAND_END>(&err);
+    const double kernel_ms = (k_end > k_start) ? (k_end - k_start) * 1e-6 : 0.0;
+    std::cout << "====== ROI Summary ======" << std::endl;
+    std::cout << "ROIs:       " << num_rois << " per frame, " << num_frames << " frame(s), "
+              << changed << " changed (" << roi_pixels << " of " << image_size * num_frames << " pixels)" << std::endl;
+    std::cout << "H2D bytes:  " << h2d_bytes << " (full frames: " << 2 * buffer_bytes << ")" << std::endl;
+    std::cout << "D2H bytes:  " << d2h_bytes << " (full frames: " << buffer_bytes << ")" << std::endl;
+    std::cout << "Kernel:     " << kernel_ms << " ms, wall "
+              << std::chrono::duration<double, std::milli>(t_end - t_start).count() << " ms" << std::endl;
+    std::cout << "=========================" << std::endl;
+
+    return error_count;
+}
+
+// =============================================================================
+// Reference Mode: the B frame stays on the device between invocations
+// =============================================================================
+// The --frames N frames of padded_A are treated as a sequence and sent one
+// per invocation, so each invocation moves one frame H2D instead of two.
+// REF_GOLDEN: every frame is compared against a fixed reference (padded_B's
+// first frame), migrated once. REF_PREVIOUS: every frame is compared against
+// the one before it; frames land in a two-slot device ring, and the slot that
+// held frame n-1 is bound as B for frame n (frame 0 is compared against the
+// golden frame). No kernel change is needed, only the A/B bindings move.
+enum ref_mode_t { REF_NONE = 0, REF_GOLDEN, REF_PREVIOUS };
+
+static int run_reference_mode(cl::Context &context, cl::CommandQueue &q, cl::Kernel &krnl,
+                              const aligned_vec &padded_A, const aligned_vec &padded_B,
+                              int height, int width, int stride_chunks, int num_frames,
+                              const PipelineConfig &cfg, ref_mode_t mode)
+{
+    cl_int err;
+    const int padded_width   = stride_chunks * PIXELS_PER_CHUNK;
+    const size_t frame_bytes = (size_t)height * padded_width;
+
+    // ring[2] is the golden frame; REF_GOLDEN only ever fills ring[0]
+    aligned_vec ring[3], C(frame_bytes, 0);
+    cl::Buffer buf_ring[3];
+    for (int i = 0; i < 3; i++)
+    {
+        ring[i].assign(frame_bytes, 0);
+        OCL_CHECK(err, buf_ring[i] = cl::Buffer(context, CL_MEM_USE_HOST_PTR | CL_MEM_READ_ONLY,
+                                                frame_bytes, ring[i].data(), &err));
+    }
+    std::copy(padded_B.begin(), padded_B.begin() + frame_bytes, ring[2].begin());
+    change_map_vec map(CHANGE_MAP_WORDS(height, stride_chunks, 1), 0);
+    OCL_CHECK(err, cl::Buffer buf_C(context, CL_MEM_USE_HOST_PTR | CL_MEM_WRITE_ONLY, frame_bytes, C.data(), &err));
+    OCL_CHECK(err, cl::Buffer buf_M(context, CL_MEM_USE_HOST_PTR | CL_MEM_WRITE_ONLY,
+                                    map.size() * sizeof(uint64_t), map.data(), &err));
+
+    // Bind every buffer before the first migration so all land in the CU's bank
+    OCL_CHECK(err, err = krnl.setArg(0, buf_ring[0]));
+    OCL_CHECK(err, err = krnl.setArg(1, buf_ring[2]));
+    OCL_CHECK(err, err = krnl.setArg(2, buf_C));
+    OCL_CHECK(err, err = krnl.setArg(3, height));
+    OCL_CHECK(err, err = krnl.setArg(4, width));
+    OCL_CHECK(err, err = krnl.setArg(5, stride_chunks));
+    OCL_CHECK(err, err = krnl.setArg(6, 1));
+    set_pipeline_args(krnl, cfg);
+    OCL_CHECK(err, err = krnl.setArg(CHANGE_MAP_ARG_INDEX, buf_M));
+
+    std::vector<uint8_t> sw_frame((size_t)height * width);
+    int error_count = 0;
+    size_t h2d_bytes = frame_bytes;
+    auto t_start = std::chrono::high_resolution_clock::now();
+
+    OCL_CHECK(err, err = q.enqueueMigrateMemObjects({buf_ring[2]}, 0));
+    for (int n = 0; n < num_frames; n++)
+    {
+        const int cur = (mode == REF_PREVIOUS) ? (n & 1) : 0;
+        const int ref = (mode == REF_PREVIOUS && n > 0) ? (cur ^ 1) : 2;
+        std::copy(padded_A.begin() + n * frame_bytes, padded_A.begin() + (n + 1) * frame_bytes, ring[cur].begin());
+
+        OCL_CHECK(err, err = krnl.setArg(0, buf_ring[cur]));
+        OCL_CHECK(err, err = krnl.setArg(1, buf_ring[ref]));
+        OCL_CHECK(err, err = q.enqueueMigrateMemObjects({buf_ring[cur]}, 0));
+        OCL_CHECK(err, err = q.enqueueTask(krnl));
+        OCL_CHECK(err, err = q.enqueueMigrateMemObjects({buf_C}, CL_MIGRATE_MEM_OBJECT_HOST));
+        OCL_CHECK(err, err = q.finish());
+        h2d_bytes += frame_bytes;
+
+        cpu_engine_run(ring[cur].data(), ring[ref].data(), sw_frame.data(), height, width, padded_width);
+        error_count += compare_frame(C.data(), sw_frame.data(), height, width, padded_width, n, 10);
+    }
+    auto t_end = std::chrono::high_resolution_clock::now();
+    const double secs = std::chrono::duration<double>(t_end - t_start).count();
+
+    std::cout << "====== Reference Summary ======" << std::endl;
+    std::cout << "Reference:  " << ((mode == REF_GOLDEN) ? "golden frame" : "previous frame (2-slot ring)")
+              << ", " << num_frames << " frame(s)" << std::endl;
+    std::cout << "H2D bytes:  " << h2d_bytes << " (A+B per frame: " << 2 * frame_bytes * num_frames << ")" << std::endl;
+    std::cout << "Wall time:  " << secs * 1e3 << " ms, " << num_frames / secs << " frames/s" << std::endl;
+    std::cout << "===============================" << std::endl;
+
+    return error_count;
+}
+
+// =============================================================================
+// Engine Mode: concurrent producers feeding ImageDiffEngines
+// =============================================================================
+// Exercises the library front end the way an embedding service would: the
+// engine programs the device and owns the slot pool, and ENGINE_PRODUCERS
+// threads per engine submit frame pairs (cycling through the batch) and
+// check every result against the reference. With all_devices, every card
+// that takes the xclbin gets its own engine (programmed concurrently) and
+// its own producers. With metrics_port > 0, the engines' live metrics are
+// served on http://127.0.0.1:<port>/metrics while the frames run. With
+// failover, frames the card cannot take (lost, or the engine found none)
+// are computed on the CPU and counted in the summary.
+#define ENGINE_PRODUCERS 2
+
+static int run_engine_mode(const std::string &xclbin, const aligned_vec &padded_A, const aligned_vec &padded_B,
+                           const std::vector<uint8_t> &sw_result, int height, int width, int num_frames,
+                           const PipelineConfig &cfg, int iterations, int num_slots, bool all_devices,
+                           int metrics_port, bool failover)
+{
+    const FailoverPolicy &policy = failover ? DEFAULT_FAILOVER : NO_FAILOVER;
+    std::vector<std::unique_ptr<ImageDiffEngine>> engines;
+    if (all_devices)
+        engines = ImageDiffEngine::create_all(xclbin, height, width, cfg, num_slots, policy);
+    else if (std::unique_ptr<ImageDiffEngine> engine =
+                 ImageDiffEngine::create(xclbin, height, width, cfg, num_slots, policy))
+        engines.push_back(std::move(engine));
+    if (engines.empty())
+        return 1;
+    const int num_producers = ENGINE_PRODUCERS * (int)engines.size();
+
+    MetricsServer metrics;
+    for (auto &e : engines)
+        metrics.add(&e->metrics());
+    if (metrics_port > 0)
+    {
+        if (!metrics.start(metrics_port))
+        {
+            std::cout << "Cannot listen on metrics port " << metrics_port << std::endl;
+            return 1;
+        }
+        std::cout << "Metrics on http://127.0.0.1:" << metrics_port << "/metrics" << std::endl;
+    }
+
+    const int padded_width   = (width + PIXELS_PER_CHUNK - 1) / PIXELS_PER_CHUNK * PIXELS_PER_CHUNK;
+    const size_t frame_bytes = (size_t)height * padded_width;
+    const size_t image_size  = (size_t)height * width;
+    std::vector<int> errors(num_producers, 0);
+    std::vector<double> worst_ms(num_producers, 0.0);
+
+    auto t_start = std::chrono::high_resolution_clock::now();
+    std::vector<std::thread> producers;
+    for (int p = 0; p < num_producers; p++)
+    {
+        producers.emplace_back([&, p] {
+            ImageDiffEngine *engine = engines[p % engines.size()].get();
+            std::vector<std::pair<int, std::future<ImageDiffResult>>> pending;
+            for (int n = p; n < iterations; n += num_producers)
+            {
+                const int f = n % num_frames;
+                pending.emplace_back(f, engine->submit(&padded_A[f * frame_bytes], &padded_B[f * frame_bytes],
+                                                       padded_width));
+            }
+            for (auto &job : pending)
+            {
+                ImageDiffResult res = job.second.get();
+                const bool bad = std::memcmp(res.C.data(), &sw_result[job.first * image_size], image_size) != 0;
+                errors[p] += bad;
+                if (bad)
+                    engine->metrics().errors.fetch_add(1, std::memory_order_relaxed);
+                worst_ms[p] = std::max(worst_ms[p], res.latency_ms);
+            }
+        });
+    }
+    for (auto &t : producers)
+        t.join();
+    auto t_end = std::chrono::high_resolution_clock::now();
+    const double secs = std::chrono::duration<double>(t_end - t_start).count();
+
+    int error_count = 0;
+    double worst = 0.0;
+    for (int p = 0; p < num_producers; p++)
+    {
+        error_count += errors[p];
+        worst = std::max(worst, worst_ms[p]);
+    }
+
+    std::cout << "====== Engine Summary ======" << std::endl;
+    std::cout << "Frames:     " << iterations << " from " << num_producers << " producer threads, "
+              << engines.size() << " device(s) x " << engines[0]->num_slots() << " slots" << std::endl;
+    std::cout << "Throughput: " << iterations / secs << " frames/s, worst latency " << worst << " ms" << std::endl;
+    std::cout << "Mismatched: " << error_count << " frame(s)" << std::endl;
+    for (size_t d = 0; d < engines.size(); d++)
+    {
+        const EngineMetrics &m = engines[d]->metrics();
+        std::cout << "Device " << d << ":   kernel p50/p99 " << m.kernel.quantile(0.50) << "/" << m.kernel.quantile(0.99)
+                  << " us, D2H p50/p99 " << m.d2h.quantile(0.50) << "/" << m.d2h.quantile(0.99) << " us" << std::endl;
+        if (failover)
+            std::cout << "            " << m.cpu_frames.load() << " frame(s) on the CPU, device "
+                      << (engines[d]->device_up() ? "up" : "down") << std::endl;
+    }
+    std::cout << "============================" << std::endl;
+
+    return error_count;
+}
+
+// =============================================================================
+// The software reference's pipeline settings (cpu_engine keeps one global set)
+// =============================================================================
+static void set_cpu_pipeline(const PipelineConfig &cfg)
+{
+    cpu_engine_set_filter(cfg.k, cfg.shift);
+    cpu_engine_set_posterize(cfg.thr, cfg.levels);
+    cpu_engine_set_border(cfg.border);
+    cpu_engine_set_morph(cfg.morph);
+}
+
+// =============================================================================
+// GPU Mode (--gpu): the engine mode on GpuDiffEngine, for nodes without a card
+// =============================================================================
+// Same producers and checks as run_engine_mode, against the same reference;
+// the xclbin is not used.
+static int run_gpu_mode(const aligned_vec &padded_A, const aligned_vec &padded_B,
+                        const std::vector<uint8_t> &sw_result, int height, int width, int num_frames,
+                        const PipelineConfig &cfg, int iterations, int num_slots)
+{
+    std::unique_ptr<GpuDiffEngine> engine = GpuDiffEngine::create(height, width, cfg, num_slots);
+    if (!engine)
+        return 1;
+
+    const int padded_width   = (width + PIXELS_PER_CHUNK - 1) / PIXELS_PER_CHUNK * PIXELS_PER_CHUNK;
+    const size_t frame_bytes = (size_t)height * padded_width;
+    const size_t image_size  = (size_t)height * width;
+    std::vector<int> errors(ENGINE_PRODUCERS, 0);
+
+    auto t_start = std::chrono::high_resolution_clock::now();
+    std::vector<std::thread> producers;
+    for (int p = 0; p < ENGINE_PRODUCERS; p++)
+    {
+        producers.emplace_back([&, p] {
+            std::vector<std::pair<int, std::future<ImageDiffResult>>> pending;
+            for (int n = p; n < iterations; n += ENGINE_PRODUCERS)
+            {
+                const int f = n % num_frames;
+                pending.emplace_back(f, engine->submit(&padded_A[f * frame_bytes], &padded_B[f * frame_bytes],
+                                                       padded_width));
+            }
+            for (auto &job : pending)
+                errors[p] += std::memcmp(job.second.get().C.data(), &sw_result[job.first * image_size],
+                                         image_size) != 0;
+        });
+    }
+    for (auto &t : producers)
+        t.join();
+    const double secs =
+        std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - t_start).count();
+
+    int error_count = 0;
+    for (int e : errors)
+        error_count += e;
+    const EngineMetrics &m = engine->metrics();
+    std::cout << "====== GPU Summary ======" << std::endl;
+    std::cout << "Frames:     " << iterations << " from " << ENGINE_PRODUCERS << " producer threads, "
+              << engine->device_name() << " x " << engine->num_slots() << " slots" << std::endl;
+    std::cout << "Throughput: " << iterations / secs << " frames/s" << std::endl;
+    std::cout << "Mismatched: " << error_count << " frame(s)" << std::endl;
+    std::cout << "Kernel:     p50/p99 " << m.kernel.quantile(0.50) << "/" << m.kernel.quantile(0.99)
+              << " us, H2D p50 " << m.h2d.quantile(0.50) << " us, D2H p50 " << m.d2h.quantile(0.50) << " us"
+              << std::endl;
+    std::cout << "=========================" << std::endl;
+    return error_count;
+}
+
+// =============================================================================
+// Broker Modes (--broker, --broker-client): one device owner, many processes
+// =============================================================================
+// --broker programs the card and serves /<name> until "quit" or EOF on
+// stdin, with --buffers frames in flight. --broker-client streams the test
+// frames through a running broker, keeping all BROKER_SLOTS slots busy, and
+// checks every result; it opens no OpenCL context, so any number of them
+// can share the one card.
+static int run_broker_mode(const std::string &xclbin, const std::string &name, int height, int width,
+                           const PipelineConfig &cfg, int max_in_flight)
+{
+    std::unique_ptr<AcceleratorBroker> broker =
+        AcceleratorBroker::create(xclbin, name, height, width, cfg, max_in_flight);
+    if (!broker)
+        return 1;
+
+    std::atomic<bool> stop(false);
+    std::thread dispatcher([&] {
+        trace_name_thread("broker");
+        broker->run(stop);
+    });
+    std::cout << "Broker: READY on /" << name << " (" << width << " x " << height << ", " << max_in_flight
+              << " in flight); \"quit\" or EOF stops it" << std::endl;
+    std::string line;
+    while (std::getline(std::cin, line) && line != "quit")
+        ;
+    stop = true;
+    dispatcher.join();
+
+    std::cout << "====== Broker Summary ======" << std::endl;
+    uint64_t total = 0;
+    for (int i = 0; i < BROKER_MAX_CLIENTS; i++)
+    {
+        if (broker->served()[i])
+            std::cout << "Entry " << std::setw(2) << i << ":   " << broker->served()[i] << " frames" << std::endl;
+        total += broker->served()[i];
+    }
+    std::cout << "Total:      " << total << " frames" << std::endl;
+    std::cout << "============================" << std::endl;
+    return 0;
+}
+
+static int run_broker_client_mode(const std::string &name, const aligned_vec &padded_A, const aligned_vec &padded_B,
+                                  const std::vector<uint8_t> &sw_result, int height, int width, int num_frames,
+                                  int iterations)
+{
+    BrokerClient client;
+    if (!client.connect(name))
+    {
+        std::cout << "Broker client: " << client.error() << std::endl;
+        return 1;
+    }
+    if (client.height() != height || client.width() != width)
+    {
+        std::cout << "Broker client: broker serves " << client.width() << " x " << client.height()
+                  << " frames, not " << width << " x " << height << std::endl;
+        return 1;
+    }
+
+    const int pitch          = client.pitch();
+    const size_t frame_bytes = (size_t)height * pitch;
+    const size_t image_size  = (size_t)height * width;
+    int error_count = 0, lost = 0;
+    std::deque<std::pair<int, int>> pending; // (slot, frame), oldest first
+    auto finish_oldest = [&] {
+        const int s = pending.front().first, f = pending.front().second;
+        pending.pop_front();
+        if (!client.wait(s))
+        {
+            lost++;
+            return;
+        }
+        for (int r = 0; r < height; r++)
+            if (std::memcmp(client.C(s) + (size_t)r * pitch, &sw_result[f * image_size + (size_t)r * width], width))
+            {
+                error_count++;
+                break;
+            }
+        client.release(s);
+    };
+
+    auto t_start = std::chrono::high_resolution_clock::now();
+    for (int n = 0; n < iterations && !lost; n++)
+    {
+        if (pending.size() == BROKER_SLOTS)
+            finish_oldest();
+        const int s = client.acquire();
+        if (s < 0)
+        {
+            lost++;
+            break;
+        }
+        const int f = n % num_frames;
+        std::memcpy(client.A(s), &padded_A[f * frame_bytes], frame_bytes);
+        std::memcpy(client.B(s), &padded_B[f * frame_bytes], frame_bytes);
+        client.submit(s);
+        pending.emplace_back(s, f);
+    }
+    while (!pending.empty())
+        finish_oldest();
+    const double secs =
+        std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - t_start).count();
+    client.disconnect();
+
+    std::cout << "====== Broker Client Summary ======" << std::endl;
+    std::cout << "Frames:     " << iterations << " through /" << name << ", " << BROKER_SLOTS << " slots" << std::endl;
+    std::cout << "Throughput: " << iterations / secs << " frames/s" << std::endl;
+    std::cout << "Mismatched: " << error_count << " frame(s)" << std::endl;
+    if (lost)
+        std::cout << "Lost:       the broker went away" << std::endl;
+    std::cout << "===================================" << std::endl;
+    return error_count + lost;
+}
+
+// =============================================================================
+// File Mode: frame sequences from memory-mapped files
+// =============================================================================
+// A and B are FrameSources (raw / PGM / Y4M). The sequence goes through a
+// fixed ring of depth slots of num_frames padded pairs, so memory stays flat
+// for any length:
+//   reader thread  - takes a free slot, asks the kernel to read the next batch
+//                    ahead (MADV_WILLNEED), packs the batch straight from the
+//                    mapping into the slot and hands it on
+//   calling thread - enqueues the slot's H2D -> kernel -> D2H on the
+//                    out-of-order queue (it owns every setArg)
+//   writer thread  - waits for the D2H, checks the batch (sampled by
+//                    verify_every), appends it to the sink, releases the
+//                    consumed input pages and frees the slot
+// A one-frame B is a fixed reference, packed and migrated once and shared by
+// every slot. The last batch may be short.
+//
+// With p2p, A (and a sequence B) live in P2P buffers: device memory mapped
+// through the card's BAR. The reader pread()s each frame from the file
+// straight into the mapping (O_DIRECT when the frames are block-aligned), so
+// the pixels never pass through host DRAM and there is no H2D. This needs
+// rows with no padding (width a multiple of PIXELS_PER_CHUNK). The writer
+// then verifies from the file mapping, so only sampled frames are paged in.
+#define P2P_DIRECT_ALIGN 4096
+template <typename T>
+class BlockingQueue
+{
+public:
+    BlockingQueue() : closed_(false) {}
+
+    void push(T v)
+    {
+        {
+            std::lock_guard<std::mutex> lk(mutex_);
+            items_.push_back(v);
+        }
+        cv_.notify_one();
+    }
+
+    // Wakes every pop() once the queue has drained
+    void close()
+    {
+        {
+            std::lock_guard<std::mutex> lk(mutex_);
+            closed_ = true;
+        }
+        cv_.notify_all();
+    }
+
+    // False once the queue is closed and empty
+    bool pop(T &v)
+    {
+        std::unique_lock<std::mutex> lk(mutex_);
+        cv_.wait(lk, [this] { return closed_ || !items_.empty(); });
+        if (items_.empty())
+            return false;
+        v = items_.front();
+        items_.pop_front();
+        return true;
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<T> items_;
+    bool closed_;
+};
+
+struct FileSlot
+{
+    aligned_vec A, B, C;
+    change_map_vec M;
+    cl::Buffer buf_A, buf_B, buf_C, buf_M;
+    cl::Kernel krnl;
+    cl::Event done;
+    int first, count;   // Sequence frames currently in the slot
+    uint8_t *p2p_A = nullptr, *p2p_B = nullptr; // Device-memory mappings with p2p
+};
+
+// Read-only buffer in device memory, mapped for host writes through the BAR
+static cl::Buffer p2p_buffer(cl::Context &context, cl::CommandQueue &q, size_t bytes, uint8_t *&mapped)
+{
+    cl_int err;
+    cl_mem_ext_ptr_t ext;
+    ext.flags = XCL_MEM_EXT_P2P_BUFFER;
+    ext.obj   = nullptr;
+    ext.param = nullptr;
+    cl::Buffer buf;
+    OCL_CHECK(err, buf = cl::Buffer(context, CL_MEM_READ_ONLY | CL_MEM_EXT_PTR_XILINX, bytes, &ext, &err));
+    OCL_CHECK(err, mapped = (uint8_t *)q.enqueueMapBuffer(buf, CL_TRUE, CL_MAP_WRITE, 0, bytes, nullptr, nullptr,
+                                                           &err));
+    return buf;
+}
+
+// The file behind src, with O_DIRECT when every frame is block-aligned
+static int open_p2p_source(const FrameSource &src, size_t frame_bytes, bool &direct)
+{
+    direct = (frame_bytes % P2P_DIRECT_ALIGN) == 0;
+    for (int i = 0; direct && i < src.num_frames(); i++)
+        direct = (src.frame_offset(i) % P2P_DIRECT_ALIGN) == 0;
+    int fd = direct ? ::open(src.path().c_str(), O_RDONLY | O_DIRECT) : -1;
+    if (fd < 0)
+    {
+        direct = false;
+        fd = ::open(src.path().c_str(), O_RDONLY);
+    }
+    return fd;
+}
+
+static bool p2p_read(int fd, uint8_t *dst, size_t bytes, size_t offset)
+{
+    for (size_t done = 0; done < bytes;)
+    {
+        const ssize_t r = pread(fd, dst + done, bytes - done, offset + done);
+        if (r <= 0)
+            return false;
+        done += r;
+    }
+    return true;
+}
+
+static int run_file_mode(cl::Context &context, cl::CommandQueue &q, cl::Program &program,
+                         FrameSource &src_A, FrameSource &src_B, FrameSink *sink,
+                         int height, int width, int stride_chunks, int num_frames,
+                         const PipelineConfig &cfg, int verify_every, int depth, bool p2p)
+{
+    cl_int err;
+    const int padded_width    = stride_chunks * PIXELS_PER_CHUNK;
+    const size_t frame_bytes  = (size_t)height * padded_width;
+    const size_t buffer_bytes = frame_bytes * num_frames;
+    const bool fixed_B        = (src_B.num_frames() == 1);
+    const int total = fixed_B ? src_A.num_frames() : std::min(src_A.num_frames(), src_B.num_frames());
+
+    // Rows are packed at the padded pitch; the pad columns stay zero
+    auto pack = [&](uint8_t *dst, const uint8_t *src) {
+        for (int r = 0; r < height; r++)
+            std::memcpy(dst + (size_t)r * padded_width, src + (size_t)r * width, width);
+    };
+
+    aligned_vec shared_B;
+    cl::Buffer buf_shared_B;
+    if (fixed_B)
+    {
+        shared_B.assign(buffer_bytes, 0);
+        for (int f = 0; f < num_frames; f++)
+            pack(&shared_B[f * frame_bytes], src_B.frame(0));
+        OCL_CHECK(err, buf_shared_B = cl::Buffer(context, CL_MEM_USE_HOST_PTR | CL_MEM_READ_ONLY,
+                                                 buffer_bytes, shared_B.data(), &err));
+    }
+
+    int fd_A = -1, fd_B = -1;
+    bool direct_A = false, direct_B = true;
+    if (p2p)
+    {
+        fd_A = open_p2p_source(src_A, frame_bytes, direct_A);
+        if (!fixed_B)
+            fd_B = open_p2p_source(src_B, frame_bytes, direct_B);
+        if (fd_A < 0 || (!fixed_B && fd_B < 0))
+        {
+            std::cout << "Cannot open the inputs for P2P reads: " << std::strerror(errno) << std::endl;
+            if (fd_A >= 0)
+                ::close(fd_A);
+            return 1;
+        }
+    }
+
+    std::vector<FileSlot> slots(depth);
+    BlockingQueue<FileSlot *> free_slots, filled, in_flight;
+    for (auto &s : slots)
+    {
+        s.C.assign(buffer_bytes, 0);
+        s.M.assign(CHANGE_MAP_WORDS(height, stride_chunks, num_frames), 0);
+        if (p2p)
+        {
+            s.buf_A = p2p_buffer(context, q, buffer_bytes, s.p2p_A);
+        }
+        else
+        {
+            s.A.assign(buffer_bytes, 0);
+            OCL_CHECK(err, s.buf_A = cl::Buffer(context, CL_MEM_USE_HOST_PTR | CL_MEM_READ_ONLY,
+                                                buffer_bytes, s.A.data(), &err));
+        }
+        if (fixed_B)
+        {
+            s.buf_B = buf_shared_B;
+        }
+        else if (p2p)
+        {
+            s.buf_B = p2p_buffer(context, q, buffer_bytes, s.p2p_B);
+        }
+        else
+        {
+            s.B.assign(buffer_bytes, 0);
+            OCL_CHECK(err, s.buf_B = cl::Buffer(context, CL_MEM_USE_HOST_PTR | CL_MEM_READ_ONLY,
+                                                buffer_bytes, s.B.data(), &err));
+        }
+        OCL_CHECK(err, s.buf_C = cl::Buffer(context, CL_MEM_USE_HOST_PTR | CL_MEM_WRITE_ONLY,
+                                            buffer_bytes, s.C.data(), &err));
+        OCL_CHECK(err, s.buf_M = cl::Buffer(context, CL_MEM_USE_HOST_PTR | CL_MEM_WRITE_ONLY,
+                                            s.M.size() * sizeof(uint64_t), s.M.data(), &err));
+        OCL_CHECK(err, s.krnl = cl::Kernel(program, "IMAGE_DIFF_POSTERIZE", &err));
+        OCL_CHECK(err, err = s.krnl.setArg(0, s.buf_A));
+        OCL_CHECK(err, err = s.krnl.setArg(1, s.buf_B));
+        OCL_CHECK(err, err = s.krnl.setArg(2, s.buf_C));
+        OCL_CHECK(err, err = s.krnl.setArg(3, height));
+        OCL_CHECK(err, err = s.krnl.setArg(4, width));
+        OCL_CHECK(err, err = s.krnl.setArg(5, stride_chunks));
+        set_pipeline_args(s.krnl, cfg);
+        OCL_CHECK(err, err = s.krnl.setArg(CHANGE_MAP_ARG_INDEX, s.buf_M));
+        free_slots.push(&s);
+    }
+    if (fixed_B)
+    {
+        OCL_CHECK(err, err = q.enqueueMigrateMemObjects({buf_shared_B}, 0));
+    }
+
+    auto t_start = std::chrono::high_resolution_clock::now();
+
+    bool read_failed = false;
+    std::thread reader([&] {
+        for (int n0 = 0; n0 < total && !read_failed; n0 += num_frames)
+        {
+            FileSlot *s;
+            if (!free_slots.pop(s))
+                break;
+            s->first = n0;
+            s->count = std::min(num_frames, total - n0);
+            const int next = std::min(n0 + s->count, total);
+            if (!p2p)
+            {
+                src_A.prefetch(next, std::min(next + num_frames, total));
+                if (!fixed_B)
+                    src_B.prefetch(next, std::min(next + num_frames, total));
+            }
+            for (int f = 0; f < s->count; f++)
+            {
+                if (p2p)
+                {
+                    const bool ok = p2p_read(fd_A, s->p2p_A + f * frame_bytes, frame_bytes,
+                                             src_A.frame_offset(n0 + f))
+                                    && (fixed_B || p2p_read(fd_B, s->p2p_B + f * frame_bytes, frame_bytes,
+                                                            src_B.frame_offset(n0 + f)));
+                    if (!ok)
+                    {
+                        std::cout << "P2P read failed at frame " << n0 + f << ": " << std::strerror(errno)
+                                  << std::endl;
+                        read_failed = true;
+                        s->count = f;
+                        break;
+                    }
+                    continue;
+                }
+                pack(&s->A[f * frame_bytes], src_A.frame(n0 + f));
+                if (!fixed_B)
+                    pack(&s->B[f * frame_bytes], src_B.frame(n0 + f));
+            }
+            if (s->count > 0)
+                filled.push(s);
+            else
+                free_slots.push(s);
+        }
+        filled.close();
+    });
+
+    int error_count = 0;
+    long checked = 0;
+    bool write_failed = false;
+    std::thread writer([&] {
+        std::vector<uint8_t> ref((size_t)height * width);
+        aligned_vec p2p_A(p2p ? frame_bytes : 0), p2p_B(p2p && !fixed_B ? frame_bytes : 0);
+        FileSlot *s;
+        while (in_flight.pop(s))
+        {
+            cl_int werr;
+            OCL_CHECK(werr, werr = s->done.wait());
+            for (int f = 0; f < s->count; f++)
+            {
+                const int n = s->first + f;
+                const uint8_t *A = p2p ? p2p_A.data() : &s->A[f * frame_bytes];
+                const uint8_t *B = fixed_B ? &shared_B[f * frame_bytes]
+                                           : (p2p ? p2p_B.data() : &s->B[f * frame_bytes]);
+                if (n % verify_every == 0)
+                {
+                    // P2P frames never reached host memory; check them from the file mapping
+                    if (p2p)
+                    {
+                        std::memcpy(p2p_A.data(), src_A.frame(n), frame_bytes);
+                        if (!fixed_B)
+                            std::memcpy(p2p_B.data(), src_B.frame(n), frame_bytes);
+                    }
+                    cpu_engine_run(A, B, ref.data(), height, width, padded_width);
+                    error_count += compare_frame(&s->C[f * frame_bytes], ref.data(), height, width, padded_width,
+                                                 n, (error_count < 10) ? 10 - error_count : 0);
+                    checked++;
+                }
+                if (sink && !write_failed && !sink->write(&s->C[f * frame_bytes], padded_width))
+                {
+                    std::cout << "Write failed at frame " << n << std::endl;
+                    write_failed = true;
+                }
+            }
+            src_A.release(s->first, s->first + s->count);
+            if (!fixed_B)
+                src_B.release(s->first, s->first + s->count);
+            free_slots.push(s);
+        }
+    });
+
+    // Dispatch: the only thread that touches the queue's enqueue side
+    FileSlot *s;
+    while (filled.pop(s))
+    {
+        cl::Event h2d, krn;
+        std::vector<cl::Event> h2d_deps, krn_deps;
+        std::vector<cl::Memory> inputs;
+        if (!p2p)
+            inputs.push_back(s->buf_A);
+        if (!fixed_B && !p2p)
+            inputs.push_back(s->buf_B);
+        OCL_CHECK(err, err = s->krnl.setArg(6, s->count));
+        if (!inputs.empty())
+        {
+            OCL_CHECK(err, err = q.enqueueMigrateMemObjects(inputs, 0, nullptr, &h2d));
+            h2d_deps.push_back(h2d);
+        }
+        OCL_CHECK(err, err = q.enqueueTask(s->krnl, h2d_deps.empty() ? nullptr : &h2d_deps, &krn));
+        krn_deps.push_back(krn);
+        OCL_CHECK(err, err = q.enqueueMigrateMemObjects({s->buf_C}, CL_MIGRATE_MEM_OBJECT_HOST, &krn_deps, &s->done));
+        OCL_CHECK(err, err = q.flush());
+        in_flight.push(s);
+    }
+    in_flight.close();
+    reader.join();
+    writer.join();
+    free_slots.close();
+
+    auto t_end = std::chrono::high_resolution_clock::now();
+    const double secs = std::chrono::duration<double>(t_end - t_start).count();
+
+    if (p2p)
+    {
+        for (auto &s : slots)
+        {
+            OCL_CHECK(err, err = q.enqueueUnmapMemObject(s.buf_A, s.p2p_A));
+            if (s.p2p_B)
+            {
+                OCL_CHECK(err, err = q.enqueueUnmapMemObject(s.buf_B, s.p2p_B));
+            }
+        }
+        OCL_CHECK(err, err = q.finish());
+        ::close(fd_A);
+        if (fd_B >= 0)
+            ::close(fd_B);
+    }
+
+    std::cout << "====== File Summary ======" << std::endl;
+    std::cout << "Frames:     " << total << " (" << width << " x " << height << ")"
+              << (fixed_B ? " against one fixed B frame" : "") << ", " << num_frames << " per invocation, "
+              << depth << " slots" << std::endl;
+    std::cout << "Verified:   " << checked << " frame(s)" << std::endl;
+    if (p2p)
+        std::cout << "P2P:        file -> device memory, " << (direct_A && direct_B ? "O_DIRECT" : "buffered")
+                  << " reads, no H2D" << std::endl;
+    if (sink)
+        std::cout << "Written:    " << sink->frames_written() << " frame(s)" << std::endl;
+    std::cout << "Wall time:  " << secs * 1e3 << " ms, " << total / secs << " frames/s" << std::endl;
+    std::cout << "==========================" << std::endl;
+
+    return error_count + (write_failed ? 1 : 0) + (read_failed ? 1 : 0);
+}
+
+// =============================================================================
+// Benchmark Mode: repeated transfer + kernel on the programmed device
+// =============================================================================
+// Each iteration is one serial H2D -> kernel -> D2H round trip. The first
+// `warmup` iterations absorb first-touch page faults and first-use driver
+// cost and are excluded from the statistics.
+//
+// The timed iterations are also metered (power_meter.hpp): card energy from
+// the board sensors and CPU-package energy from RAPL. The same batch is then
+// run through each CPU engine ISA for the same iteration count, so the
+// report compares joules per frame and pixels per joule between the xclbin
+// (card + host package) and the CPU engines (package only).
+struct BenchStats
+{
+    std::string variant;      // xclbin path, or cpu-<isa>
+    int iters;
+    double min_ms, median_ms, p99_ms, max_ms, mean_ms;
+    double fps, mbps;
+    bool card_ok, cpu_ok;     // Which energy sources could be read
+    double card_j, cpu_j;     // Per frame
+    double px_per_j;          // Over every source read; 0 if none
+};
+
+static void set_bench_energy(BenchStats &st, const EnergyReading &e, double frames, double pixels)
+{
+    st.card_ok  = e.card_ok;
+    st.cpu_ok   = e.cpu_ok;
+    st.card_j   = e.card_ok ? e.card_j / frames : 0.0;
+    st.cpu_j    = e.cpu_ok ? e.cpu_j / frames : 0.0;
+    const double j = (e.card_ok ? e.card_j : 0.0) + (e.cpu_ok ? e.cpu_j : 0.0);
+    st.px_per_j = (j > 0.0) ? pixels / j : 0.0;
+}
+
+static double percentile(const std::vector<double> &sorted, double pct)
+{
+    // Nearest-rank percentile on an ascending sample
+    size_t rank = (size_t)std::ceil(pct / 100.0 * sorted.size());
+    return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+static BenchStats summarize_bench(std::vector<double> &samples, int iters, int num_frames, size_t buffer_bytes);
+
+static BenchStats run_benchmark(cl::CommandQueue &q, cl::Kernel &krnl,
+                                cl::Buffer &buffer_A, cl::Buffer &buffer_B, cl::Buffer &buffer_C,
+                                size_t buffer_bytes, int num_frames, int iters, int warmup,
+                                PowerMeter &pm, size_t batch_pixels)
+{
+    cl_int err;
+    std::vector<double> samples;
+    samples.reserve(iters);
+
+    for (int n = 0; n < warmup + iters; n++)
+    {
+        if (n == warmup)
+            pm.begin();
+        auto t0 = std::chrono::high_resolution_clock::now();
+        OCL_CHECK(err, err = q.enqueueMigrateMemObjects({buffer_A, buffer_B}, 0));
+        OCL_CHECK(err, err = q.enqueueTask(krnl));
+        OCL_CHECK(err, err = q.enqueueMigrateMemObjects({buffer_C}, CL_MIGRATE_MEM_OBJECT_HOST));
+        OCL_CHECK(err, err = q.finish());
+        auto t1 = std::chrono::high_resolution_clock::now();
+        if (n >= warmup)
+            samples.push_back(std::chrono::duration<double, std::milli>(t1 - t0).count());
+    }
+    const EnergyReading e = pm.end();
+
+    BenchStats st = summarize_bench(samples, iters, num_frames, buffer_bytes);
+    set_bench_energy(st, e, (double)iters * num_frames, (double)iters * batch_pixels);
+    return st;
+}
+
+// The same batch through the CPU engine with isa; card energy is not counted
+static BenchStats run_cpu_benchmark(cpu_isa_t isa, const aligned_vec &padded_A, const aligned_vec &padded_B,
+                                    std::vector<uint8_t> &out, int height, int width, int padded_width,
+                                    size_t buffer_bytes, int num_frames, int iters, int warmup, PowerMeter &pm)
+{
+    const cpu_isa_t prev = cpu_engine_selected();
+    cpu_engine_select(isa);
+    const size_t frame_bytes = (size_t)height * padded_width;
+    const size_t image_size  = (size_t)height * width;
+    std::vector<double> samples;
+    samples.reserve(iters);
+
+    for (int n = 0; n < warmup + iters; n++)
+    {
+        if (n == warmup)
+            pm.begin();
+        auto t0 = std::chrono::high_resolution_clock::now();
+        for (int f = 0; f < num_frames; f++)
+            cpu_engine_run(&padded_A[f * frame_bytes], &padded_B[f * frame_bytes], &out[f * image_size],
+                           height, width, padded_width);
+        auto t1 = std::chrono::high_resolution_clock::now();
+        if (n >= warmup)
+            samples.push_back(std::chrono::duration<double, std::milli>(t1 - t0).count());
+    }
+    EnergyReading e = pm.end();
+    e.card_ok = false;
+    cpu_engine_select(prev);
+
+    BenchStats st = summarize_bench(samples, iters, num_frames, buffer_bytes);
+    st.variant = std::string("cpu-") + cpu_engine_isa_name(isa);
+    set_bench_energy(st, e, (double)iters * num_frames, (double)iters * num_frames * image_size);
+    return st;
+}
+
+static BenchStats summarize_bench(std::vector<double> &samples, int iters, int num_frames, size_t buffer_bytes)
+{
+    std::sort(samples.begin(), samples.end());
+    double total_ms = 0;
+    for (double v : samples)
+        total_ms += v;
+
+    BenchStats st;
+    st.iters     = iters;
+    st.min_ms    = samples.front();
+    st.median_ms = percentile(samples, 50.0);
+    st.p99_ms    = percentile(samples, 99.0);
+    st.max_ms    = samples.back();
+    st.mean_ms   = total_ms / iters;
+    st.fps       = num_frames * 1e3 / st.mean_ms;
+    st.mbps      = 3.0 * buffer_bytes / 1e3 / st.mean_ms; // A + B in, C out
+    return st;
+}
+
+static void print_bench_energy(const BenchStats &st)
+{
+    std::cout << std::left << std::setw(12) << st.variant.substr(st.variant.rfind('/') + 1) << std::right
+              << " " << st.mean_ms << " ms/batch, ";
+    if (st.card_ok)
+        std::cout << st.card_j * 1e3 << " mJ/frame card, ";
+    if (st.cpu_ok)
+        std::cout << st.cpu_j * 1e3 << " mJ/frame CPU, ";
+    if (st.px_per_j > 0.0)
+        std::cout << st.px_per_j / 1e6 << " Mpx/J" << std::endl;
+    else
+        std::cout << "no power sensors readable" << std::endl;
+}
+
+// s as a JSON string literal: quotes, backslashes and control characters escaped
+static std::string json_string(const std::string &s)
+{
+    std::string out = "\"";
+    for (unsigned char c : s)
+    {
+        if (c == '"' || c == '\\')
+        {
+            out += '\\';
+            out += (char)c;
+        }
+        else if (c < 0x20)
+        {
+            char esc[8];
+            std::snprintf(esc, sizeof(esc), "\\u%04x", c);
+            out += esc;
+        }
+        else
+        {
+            out += (char)c;
+        }
+    }
+    return out + "\"";
+}
+
+// s as a CSV field, quoted (with quotes doubled) if it holds a comma, quote or newline
+static std::string csv_field(const std::string &s)
+{
+    if (s.find_first_of(",\"\r\n") == std::string::npos)
+        return s;
+    std::string out = "\"";
+    for (char c : s)
+        out += (c == '"') ? std::string("\"\"") : std::string(1, c);
+    return out + "\"";
+}
+
+// Append one result record; CSV gets a header when the file is new/empty
+static void write_bench_report(const std::string &path, const BenchStats &st,
+                               int height, int width, int num_frames)
+{
+    const bool json = path.size() >= 5 && path.compare(path.size() - 5, 5, ".json") == 0;
+    std::ifstream probe(path);
+    const bool fresh = !probe.good() || probe.peek() == std::ifstream::traits_type::eof();
+    probe.close();
+
+    std::ofstream out(path, std::ios::app);
+    if (!out)
+    {
+        std::cout << "Cannot write benchmark report " << path << std::endl;
+        return;
+    }
+    if (json)
+    {
+        // One JSON object per line (JSON Lines), so runs can be appended
+        out << "{\"xclbin\": " << json_string(st.variant) << ", \"height\": " << height << ", \"width\": " << width
+            << ", \"frames\": " << num_frames << ", \"iters\": " << st.iters
+            << ", \"min_ms\": " << st.min_ms << ", \"median_ms\": " << st.median_ms
+            << ", \"p99_ms\": " << st.p99_ms << ", \"max_ms\": " << st.max_ms
+            << ", \"fps\": " << st.fps << ", \"mbps\": " << st.mbps;
+        if (st.card_ok)
+            out << ", \"card_j_per_frame\": " << st.card_j;
+        if (st.cpu_ok)
+            out << ", \"cpu_j_per_frame\": " << st.cpu_j;
+        if (st.px_per_j > 0.0)
+            out << ", \"px_per_j\": " << st.px_per_j;
+        out << "}" << std::endl;
+    }
+    else
+    {
+        if (fresh)
+            out << "xclbin,height,width,frames,iters,min_ms,median_ms,p99_ms,max_ms,fps,mbps,"
+                   "card_j_per_frame,cpu_j_per_frame,px_per_j" << std::endl;
+        // Unreadable energy sources leave their columns empty
+        out << csv_field(st.variant) << "," << height << "," << width << "," << num_frames << "," << st.iters << ","
+            << st.min_ms << "," << st.median_ms << "," << st.p99_ms << "," << st.max_ms << ","
+            << st.fps << "," << st.mbps << ",";
+        if (st.card_ok)
+            out << st.card_j;
+        out << ",";
+        if (st.cpu_ok)
+            out << st.cpu_j;
+        out << ",";
+        if (st.px_per_j > 0.0)
+            out << st.px_per_j;
+        out << std::endl;
+    }
+}
+
+// =============================================================================
+// Launch Latency (--xrt): one frame per launch, OpenCL vs native XRT
+// =============================================================================
+// Both paths run the same loop over the batch's frames: the frame's A/B
+// sub-range to the device, the kernel on that frame alone, its C sub-range
+// back. The OpenCL side binds one cl::Kernel per frame on sub-buffers up
+// front, like XrtNativeFrames' per-frame xrt::run, so neither calls setArg
+// in the loop and the difference is the enqueue / event / finish machinery.
+// "launch" is enqueue (start) to completion with the inputs already there.
+struct LaunchStats
+{
+    double launch_p50, launch_p99, frame_p50, frame_p99; // Microseconds
+};
+
+static LaunchStats summarize_launch(std::vector<double> &launch_us, std::vector<double> &frame_us)
+{
+    std::sort(launch_us.begin(), launch_us.end());
+    std::sort(frame_us.begin(), frame_us.end());
+    return {percentile(launch_us, 50.0), percentile(launch_us, 99.0),
+            percentile(frame_us, 50.0), percentile(frame_us, 99.0)};
+}
+
+static void print_launch(const char *name, const LaunchStats &st)
+{
+    std::cout << std::left << std::setw(12) << name << std::right << " launch p50 " << st.launch_p50 << " us, p99 "
+              << st.launch_p99 << " us; frame p50 " << st.frame_p50 << " us, p99 " << st.frame_p99 << " us"
+              << std::endl;
+}
+
+static int run_launch_compare(cl::Context &context, cl::CommandQueue &q, cl::Program &program,
+                              const std::string &xclbin, aligned_vec &padded_A, aligned_vec &padded_B,
+                              const std::vector<uint8_t> &sw_result, int height, int width, int stride_chunks,
+                              int num_frames, const PipelineConfig &cfg, int iters, int warmup)
+{
+    cl_int err;
+    const int padded_width   = stride_chunks * PIXELS_PER_CHUNK;
+    const size_t frame_bytes = (size_t)height * padded_width;
+    const size_t image_size  = (size_t)height * width;
+    const size_t map_words   = CHANGE_MAP_WORDS(height, stride_chunks, 1);
+    aligned_vec ocl_C(padded_A.size()), xrt_C(padded_A.size());
+    std::vector<double> launch_us, frame_us;
+
+    std::cout << "====== Launch latency (" << iters << " frames, one per launch, " << warmup << " warmup) ======"
+              << std::endl;
+
+    // OpenCL: per-frame kernels on sub-buffers, bound once
+    OCL_CHECK(err, cl::Buffer buf_A(context, CL_MEM_USE_HOST_PTR | CL_MEM_READ_ONLY, padded_A.size(), padded_A.data(), &err));
+    OCL_CHECK(err, cl::Buffer buf_B(context, CL_MEM_USE_HOST_PTR | CL_MEM_READ_ONLY, padded_B.size(), padded_B.data(), &err));
+    OCL_CHECK(err, cl::Buffer buf_C(context, CL_MEM_USE_HOST_PTR | CL_MEM_WRITE_ONLY, ocl_C.size(), ocl_C.data(), &err));
+    change_map_vec maps(map_words * num_frames);
+    OCL_CHECK(err, cl::Buffer buf_M(context, CL_MEM_USE_HOST_PTR | CL_MEM_WRITE_ONLY, maps.size() * sizeof(uint64_t),
+                                    maps.data(), &err));
+    std::vector<cl::Buffer> subs;
+    std::vector<cl::Kernel> krnls;
+    for (int f = 0; f < num_frames; f++)
+    {
+        cl_buffer_region region = {f * frame_bytes, frame_bytes};
+        cl_buffer_region map_region = {f * map_words * sizeof(uint64_t), map_words * sizeof(uint64_t)};
+        OCL_CHECK(err, subs.push_back(buf_A.createSubBuffer(CL_MEM_READ_ONLY, CL_BUFFER_CREATE_TYPE_REGION, &region, &err)));
+        OCL_CHECK(err, subs.push_back(buf_B.createSubBuffer(CL_MEM_READ_ONLY, CL_BUFFER_CREATE_TYPE_REGION, &region, &err)));
+        OCL_CHECK(err, subs.push_back(buf_C.createSubBuffer(CL_MEM_WRITE_ONLY, CL_BUFFER_CREATE_TYPE_REGION, &region, &err)));
+        OCL_CHECK(err, subs.push_back(buf_M.createSubBuffer(CL_MEM_WRITE_ONLY, CL_BUFFER_CREATE_TYPE_REGION, &map_region,
+                                                            &err)));
+        OCL_CHECK(err, cl::Kernel k(program, "IMAGE_DIFF_POSTERIZE", &err));
+        if (k.getInfo<CL_KERNEL_NUM_ARGS>() != CHANGE_MAP_ARG_INDEX + 1)
+        {
+            std::cout << "Skipped: the comparison needs an xclbin without optional V3 arguments" << std::endl;
+            return 0;
+        }
+        OCL_CHECK(err, err = k.setArg(0, subs[4 * f]));
+        OCL_CHECK(err, err = k.setArg(1, subs[4 * f + 1]));
+        OCL_CHECK(err, err = k.setArg(2, subs[4 * f + 2]));
+        OCL_CHECK(err, err = k.setArg(3, height));
+        OCL_CHECK(err, err = k.setArg(4, width));
+        OCL_CHECK(err, err = k.setArg(5, stride_chunks));
+        OCL_CHECK(err, err = k.setArg(6, 1));
+        set_pipeline_args(k, cfg);
+        OCL_CHECK(err, err = k.setArg(CHANGE_MAP_ARG_INDEX, subs[4 * f + 3]));
+        krnls.push_back(k);
+    }
+    for (int n = 0; n < warmup + iters; n++)
+    {
+        const int f = n % num_frames;
+        const auto t0 = std::chrono::high_resolution_clock::now();
+        OCL_CHECK(err, err = q.enqueueMigrateMemObjects({subs[4 * f], subs[4 * f + 1]}, 0));
+        OCL_CHECK(err, err = q.finish());
+        const auto t1 = std::chrono::high_resolution_clock::now();
+        OCL_CHECK(err, err = q.enqueueTask(krnls[f]));
+        OCL_CHECK(err, err = q.finish());
+        const auto t2 = std::chrono::high_resolution_clock::now();
+        OCL_CHECK(err, err = q.enqueueMigrateMemObjects({subs[4 * f + 2]}, CL_MIGRATE_MEM_OBJECT_HOST));
+        OCL_CHECK(err, err = q.finish());
+        const auto t3 = std::chrono::high_resolution_clock::now();
+        if (n >= warmup)
+        {
+            launch_us.push_back(std::chrono::duration<double, std::micro>(t2 - t1).count());
+            frame_us.push_back(std::chrono::duration<double, std::micro>(t3 - t0).count());
+        }
+    }
+    const LaunchStats ocl = summarize_launch(launch_us, frame_us);
+    print_launch("OpenCL", ocl);
+
+    // Native XRT on the already programmed device (same xclbin, so no reload)
+    XrtNativeFrames native;
+    if (!native.open(0, xclbin, padded_A.data(), padded_B.data(), xrt_C.data(), height, width, stride_chunks,
+                     num_frames, cfg))
+    {
+        std::cout << "Native XRT skipped: " << native.error() << std::endl;
+        return 0;
+    }
+    launch_us.clear();
+    frame_us.clear();
+    for (int n = 0; n < warmup + iters; n++)
+    {
+        double launch = 0.0;
+        const auto t0 = std::chrono::high_resolution_clock::now();
+        native.run_frame(n % num_frames, launch);
+        const auto t1 = std::chrono::high_resolution_clock::now();
+        if (n >= warmup)
+        {
+            launch_us.push_back(launch);
+            frame_us.push_back(std::chrono::duration<double, std::micro>(t1 - t0).count());
+        }
+    }
+    const LaunchStats xrt = summarize_launch(launch_us, frame_us);
+    print_launch("Native XRT", xrt);
+    std::cout << "Native/OpenCL: launch p50 x" << xrt.launch_p50 / ocl.launch_p50 << ", frame p50 x"
+              << xrt.frame_p50 / ocl.frame_p50 << std::endl;
+
+    // Frames the loops reached (all of them once iters + warmup >= num_frames)
+    int errors = 0;
+    const int reached = std::min(num_frames, warmup + iters);
+    for (int f = 0; f < reached; f++)
+    {
+        errors += compare_frame(&ocl_C[f * frame_bytes], &sw_result[f * image_size], height, width, padded_width,
+                                f, 0);
+        errors += compare_frame(&xrt_C[f * frame_bytes], &sw_result[f * image_size], height, width, padded_width,
+                                f, 0);
+    }
+    if (errors > 0)
+        std::cout << "Launch latency runs: " << errors << " mismatching pixels" << std::endl;
+    return errors;
+}
+
+// =============================================================================
+// Ring Mode (--ring): V6's free-running kernel fed by a descriptor ring
+// =============================================================================
+// The kernel is started once with auto-restart for iterations + 1 runs (the
+// last one retires the stop descriptor). The batch's inputs go to the card
+// once; from then on the host only publishes descriptors, keeping at most
+// RING_ENTRIES - 1 in flight, and polls the done count. "submit" is the host
+// time spent publishing one descriptor, i.e. the per-frame control cost
+// that replaces a kernel launch.
+static int run_ring_mode(const std::string &xclbin, aligned_vec &padded_A, aligned_vec &padded_B,
+                         const std::vector<uint8_t> &sw_result, int height, int width, int stride_chunks,
+                         int num_frames, const PipelineConfig &cfg, int iterations)
+{
+    const int padded_width   = stride_chunks * PIXELS_PER_CHUNK;
+    const size_t frame_bytes = (size_t)height * padded_width;
+    const size_t image_size  = (size_t)height * width;
+    aligned_vec C(padded_A.size());
+
+    XrtRingFrames ring;
+    if (!ring.open(0, xclbin, padded_A.data(), padded_B.data(), C.data(), height, width, stride_chunks, num_frames,
+                   cfg, iterations + 1))
+    {
+        std::cout << "Cannot start IMAGE_DIFF_RING: " << ring.error() << std::endl;
+        return 1;
+    }
+    ring.sync_inputs();
+
+    std::vector<double> submit_us;
+    submit_us.reserve(iterations);
+    long full_polls = 0;
+    const auto t_start = std::chrono::high_resolution_clock::now();
+    for (int n = 0; n < iterations; n++)
+    {
+        auto t0 = std::chrono::high_resolution_clock::now();
+        while (!ring.submit(n % num_frames))
+        {
+            full_polls++;
+            t0 = std::chrono::high_resolution_clock::now();
+        }
+        submit_us.push_back(
+            std::chrono::duration<double, std::micro>(std::chrono::high_resolution_clock::now() - t0).count());
+    }
+    while (ring.poll() != (uint32_t)iterations)
+        ;
+    const double secs =
+        std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - t_start).count();
+    ring.stop();
+    ring.sync_outputs();
+
+    int errors = 0;
+    const int reached = std::min(num_frames, iterations);
+    for (int f = 0; f < reached; f++)
+        errors += compare_frame(&C[f * frame_bytes], &sw_result[f * image_size], height, width, padded_width, f, 10);
+
+    std::sort(submit_us.begin(), submit_us.end());
+    std::cout << "====== Ring Summary ======" << std::endl;
+    std::cout << "Frames:     " << iterations << " through " << RING_ENTRIES << " ring entries" << std::endl;
+    std::cout << "Throughput: " << iterations / secs << " frames/s" << std::endl;
+    std::cout << "Submit:     p50 " << percentile(submit_us, 50.0) << " us, p99 " << percentile(submit_us, 99.0)
+              << " us; " << full_polls << " poll(s) on a full ring" << std::endl;
+    std::cout << "Mismatched: " << errors << " pixel(s)" << std::endl;
+    std::cout << "==========================" << std::endl;
+    return errors;
+}
+
+// =============================================================================
+// Heterogeneous Mode: split each batch between the CPU engine and the FPGA
+// =============================================================================
+// Each batch's frames [0, k) go to the card as one invocation on sub-buffers
+// and frames [k, n) run on the CPU engine while the card works. After each
+// batch the split is re-derived from measured throughput: the FPGA side
+// from its profiled H2D start to D2H end (so PCIe cost is included), the
+// CPU side from wall clock. Small frames thus drift to the CPU and big
+// batches to the card.
+struct HeteroRates
+{
+    double cpu_fps;
+    double fpga_fps;
+};
+
+static int run_hetero_mode(cl::Context &context, cl::CommandQueue &q, cl::Kernel &krnl,
+                           cl::Buffer &buffer_A, cl::Buffer &buffer_B, cl::Buffer &buffer_C,
+                           const aligned_vec &padded_A, const aligned_vec &padded_B, const aligned_vec &padded_C,
+                           const std::vector<uint8_t> &sw_result,
+                           int height, int width, int stride_chunks, int num_frames, int batches)
+{
+    cl_int err;
+    const int padded_width   = stride_chunks * PIXELS_PER_CHUNK;
+    const size_t image_size  = (size_t)height * width;
+    const size_t frame_bytes = (size_t)height * padded_width;
+    std::vector<uint8_t> cpu_out(image_size);
+
+    // No measurements yet: start from an even split
+    HeteroRates rates = {1.0, 1.0};
+    int error_count = 0;
+    int frames_cpu = 0, frames_fpga = 0;
+    auto t_start = std::chrono::high_resolution_clock::now();
+
+    for (int b = 0; b < batches; b++)
+    {
+        const double share = rates.fpga_fps / (rates.fpga_fps + rates.cpu_fps);
+        // Both sides keep at least one frame, so neither rate goes stale
+        int k = (int)(share * num_frames + 0.5);
+        k = (k < 1) ? 1 : (k > num_frames - 1) ? num_frames - 1 : k;
+
+        // FPGA part: enqueue and let it run while the CPU takes its frames
+        cl::Event ev_h2d, ev_d2h;
+        if (k > 0)
+        {
+            cl_buffer_region region = {0, k * frame_bytes};
+            OCL_CHECK(err, cl::Buffer sub_A = buffer_A.createSubBuffer(CL_MEM_READ_ONLY, CL_BUFFER_CREATE_TYPE_REGION, &region, &err));
+            OCL_CHECK(err, cl::Buffer sub_B = buffer_B.createSubBuffer(CL_MEM_READ_ONLY, CL_BUFFER_CREATE_TYPE_REGION, &region, &err));
+            OCL_CHECK(err, cl::Buffer sub_C = buffer_C.createSubBuffer(CL_MEM_WRITE_ONLY, CL_BUFFER_CREATE_TYPE_REGION, &region, &err));
+            OCL_CHECK(err, err = krnl.setArg(0, sub_A));
+            OCL_CHECK(err, err = krnl.setArg(1, sub_B));
+            OCL_CHECK(err, err = krnl.setArg(2, sub_C));
+            OCL_CHECK(err, err = krnl.setArg(6, k));
+            OCL_CHECK(err, err = q.enqueueMigrateMemObjects({sub_A, sub_B}, 0, nullptr, &ev_h2d));
+            OCL_CHECK(err, err = q.enqueueTask(krnl));
+            OCL_CHECK(err, err = q.enqueueMigrateMemObjects({sub_C}, CL_MIGRATE_MEM_OBJECT_HOST, nullptr, &ev_d2h));
+            OCL_CHECK(err, err = q.flush());
+        }
+
+        // CPU part, verified as it goes
+        auto c0 = std::chrono::high_resolution_clock::now();
+        for (int f = k; f < num_frames; f++)
+        {
+            cpu_engine_run(&padded_A[f * frame_bytes], &padded_B[f * frame_bytes], cpu_out.data(),
+                           height, width, padded_width);
+            error_count += (std::memcmp(cpu_out.data(), &sw_result[f * image_size], image_size) != 0);
+        }
+        auto c1 = std::chrono::high_resolution_clock::now();
+        OCL_CHECK(err, err = q.finish());
+
+        for (int f = 0; f < k; f++)
+        {
+            error_count += compare_frame(&padded_C[f * frame_bytes], &sw_result[f * image_size],
+                                         height, width, padded_width, f, 0);
+        }
+
+        // Update whichever rates this batch measured
+        if (num_frames - k > 0)
+        {
+            const double secs = std::chrono::duration<double>(c1 - c0).count();
+            rates.cpu_fps = (num_frames - k) / ((secs > 0) ? secs : 1e-9);
+        }
+        if (k > 0)
+        {
+            cl_ulong start = ev_h2d.getProfilingInfo<CL_PROFILING_COMMAND_START>(&err);
+            cl_ulong end   = ev_d2h.getProfilingInfo<CL_PROFILING_COMMAND_END>(&err);
+            if (err == CL_SUCCESS && end > start)
+                rates.fpga_fps = k / ((end - start) * 1e-9);
+        }
+        frames_cpu  += num_frames - k;
+        frames_fpga += k;
+    }
+
+    // Restore the full-batch arguments for anything that runs after us
+    OCL_CHECK(err, err = krnl.setArg(0, buffer_A));
+    OCL_CHECK(err, err = krnl.setArg(1, buffer_B));
+    OCL_CHECK(err, err = krnl.setArg(2, buffer_C));
+    OCL_CHECK(err, err = krnl.setArg(6, num_frames));
+
+    auto t_end = std::chrono::high_resolution_clock::now();
+    const double secs = std::chrono::duration<double>(t_end - t_start).count();
+
+    std::cout << "====== Heterogeneous Summary ======" << std::endl;
+    std::cout << "Batches:    " << batches << " x " << num_frames << " frame(s)" << std::endl;
+    std::cout << "Split:      " << frames_fpga << " frame(s) on FPGA, " << frames_cpu << " on CPU" << std::endl;
+    std::cout << "Last rates: FPGA " << rates.fpga_fps << " frames/s, CPU " << rates.cpu_fps << " frames/s" << std::endl;
+    std::cout << "Aggregate:  " << (double)batches * num_frames / secs << " frames/s" << std::endl;
+    std::cout << "===============================" << std::endl;
+
+    return error_count;
+}
+
+// =============================================================================
+// Service Mode: keep the programmed device and context across jobs
+// =============================================================================
+// Reprogramming (read xclbin, create context/program) dominates a one-shot
+// run. With --serve the host programs once, then reads jobs from stdin, one
+// per line: "<height> <width> [<frames>] [diff|sharpen]". A diff job runs
+// the same kernel with the sharpen stage bypassed (diff_only_pipeline), so
+// lab-1 and lab-2 jobs can share the queue. Each job runs one verified
+// invocation and answers "OK <ms>" or "FAIL <errors>"; "quit" or EOF exits.
+// A/B/C and the change map come from a HostBufferPool, so repeated job sizes
+// reuse the same pinned buffers instead of pinning fresh host memory.
+static int run_serve_job(cl::Context &context, cl::CommandQueue &q, cl::Kernel &krnl, HostBufferPool &pool,
+                         const PipelineConfig &cfg, const tp_config_t &tp, int height, int width, int num_frames)
+{
+    cl_int err;
+    const int stride_chunks   = (width + PIXELS_PER_CHUNK - 1) / PIXELS_PER_CHUNK;
+    const int padded_width    = stride_chunks * PIXELS_PER_CHUNK;
+    const size_t image_size   = (size_t)height * width;
+    const size_t frame_bytes  = (size_t)height * padded_width;
+    const size_t buffer_bytes = frame_bytes * num_frames;
+
+    PooledBuffer *pA = pool.acquire(buffer_bytes, CL_MEM_READ_ONLY);
+    PooledBuffer *pB = pool.acquire(buffer_bytes, CL_MEM_READ_ONLY);
+    PooledBuffer *pC = pool.acquire(buffer_bytes, CL_MEM_WRITE_ONLY);
+    const size_t map_words = CHANGE_MAP_WORDS(height, stride_chunks, num_frames);
+    PooledBuffer *pM = pool.acquire(map_words * sizeof(uint64_t), CL_MEM_WRITE_ONLY);
+    uint8_t *A = pA->host, *B = pB->host, *C = pC->host;
+    std::vector<uint8_t> ref(image_size * num_frames);
+
+    generate_frames(A, B, num_frames, height, width, padded_width, tp);
+    for (int f = 0; f < num_frames; f++)
+    {
+        cpu_engine_run(&A[f * frame_bytes], &B[f * frame_bytes], &ref[f * image_size], height, width, padded_width);
+    }
+
+    auto t0 = std::chrono::high_resolution_clock::now();
+    OCL_CHECK(err, err = krnl.setArg(0, pA->buf));
+    OCL_CHECK(err, err = krnl.setArg(1, pB->buf));
+    OCL_CHECK(err, err = krnl.setArg(2, pC->buf));
+    OCL_CHECK(err, err = krnl.setArg(3, height));
+    OCL_CHECK(err, err = krnl.setArg(4, width));
+    OCL_CHECK(err, err = krnl.setArg(5, stride_chunks));
+    OCL_CHECK(err, err = krnl.setArg(6, num_frames));
+    set_pipeline_args(krnl, cfg);
+
+    OCL_CHECK(err, err = krnl.setArg(CHANGE_MAP_ARG_INDEX, pM->buf));
+
+    counter_vec T, S, P, L, H, Q;
+    cl::Buffer buf_T, buf_S, buf_P, buf_L, buf_H, buf_Q;
+    bind_optional_arg(context, krnl, "post_tap", post_tap_u64_words(height, stride_chunks, num_frames), T, buf_T);
+    bind_optional_arg(context, krnl, "stats", STATS_NUM_WORDS, S, buf_S);
+    bind_optional_arg(context, krnl, "prof", PROF_NUM_COUNTERS, P, buf_P);
+    bind_optional_arg(context, krnl, "blobs", BLOB_WORDS(num_frames), L, buf_L);
+    bind_optional_arg(context, krnl, "pyr_half", pyr_u64_words(height, stride_chunks, num_frames, 1), H, buf_H);
+    bind_optional_arg(context, krnl, "pyr_quarter", pyr_u64_words(height, stride_chunks, num_frames, 2), Q, buf_Q);
+
+    OCL_CHECK(err, err = q.enqueueMigrateMemObjects({pA->buf, pB->buf}, 0));
+    OCL_CHECK(err, err = q.enqueueTask(krnl));
+    OCL_CHECK(err, err = q.enqueueMigrateMemObjects({pC->buf}, CL_MIGRATE_MEM_OBJECT_HOST));
+    OCL_CHECK(err, err = q.finish());
+    auto t1 = std::chrono::high_resolution_clock::now();
+
+    int errors = 0;
+    for (int f = 0; f < num_frames; f++)
+    {
+        errors += compare_frame(&C[f * frame_bytes], &ref[f * image_size], height, width, padded_width, f, 0);
+    }
+    pool.release(pA);
+    pool.release(pB);
+    pool.release(pC);
+    pool.release(pM);
+
+    if (errors == 0)
+        std::cout << "OK " << std::chrono::duration<double, std::milli>(t1 - t0).count() << std::endl;
+    else
+        std::cout << "FAIL " << errors << std::endl;
+    return errors;
+}
+
+static int run_serve_mode(cl::Context &context, cl::CommandQueue &q, cl::Kernel &krnl,
+                          const PipelineConfig &cfg, const tp_config_t &tp, uint64_t props)
+{
+    const int max_width = kernel_max_width(props);
+    std::cout << "READY" << std::endl;
+
+    HostBufferPool pool(context, q);
+    int failed_jobs = 0, jobs = 0;
+    std::string line;
+    while (std::getline(std::cin, line))
+    {
+        if (line == "quit")
+            break;
+        if (line.empty())
+            continue;
+
+        int height = 0, width = 0, num_frames = 1;
+        bool diff_only = false, bad_mode = false;
+        std::istringstream job(line);
+        job >> height >> width;
+        std::string tok;
+        while (job >> tok)
+        {
+            if (tok == "diff" || tok == "sharpen")
+                diff_only = (tok == "diff");
+            else if (!(std::istringstream(tok) >> num_frames))
+                bad_mode = true;
+        }
+        // A diff job only swaps the sharpen arguments (and the reference's settings)
+        const PipelineConfig job_cfg = diff_only ? diff_only_pipeline(cfg) : cfg;
+        if (bad_mode || height < 3 || width < 3 || width > max_width || num_frames < 1
+            || !kernel_takes_taps(props, job_cfg) || !kernel_takes_posterize(props, job_cfg))
+        {
+            std::cout << "ERROR bad job \"" << line << "\"" << std::endl;
+            continue;
+        }
+        if (diff_only)
+            set_cpu_pipeline(job_cfg);
+        failed_jobs += (run_serve_job(context, q, krnl, pool, job_cfg, tp, height, width, num_frames) != 0);
+        if (diff_only)
+            set_cpu_pipeline(cfg);
+        jobs++;
+    }
+    std::cout << "POOL " << pool.allocations() << " buffers for " << jobs << " jobs" << std::endl;
+    return failed_jobs;
+}
+
+// =============================================================================
+// Main Host Application
+// =============================================================================
+static void print_usage(const char *prog)
+{
+    std::cout << "Usage: " << prog << " <XCLBIN File> [<height> <width>] [options]\n"
+              << "Options:\n"
+              << "  --frames N   Frame pairs per kernel invocation (default 1)\n"
+              << "  --stream N   Run N pipelined invocations on an out-of-order queue\n"
+              << "  --buffers K  Buffer sets per CU in the streaming ring, 2 or 3 (default 3)\n"
+              << "  --cus N      Compute units to dispatch to round-robin (streaming only, default 1)\n"
+              << "  --lanes K    Split each frame by rows across K = 1..4 HBM lanes (hbm_lanes.cfg xclbin)\n"
+              << "  --split N    Run N batches through 1 diff CU and 2 sharpen CUs (split_k2k.cfg xclbin)\n"
+              << "  --roi R      Process only rows r0..r1-1, chunk columns c0..c1-1 (\"r0,r1,c0,c1\"; repeatable;\n"
+              << "               -DV3_ROI xclbin)\n"
+              << "  --engine N   Submit N frame pairs through ImageDiffEngine from 2 threads (--buffers slots)\n"
+              << "  --all-devices  With --engine: one engine and 2 threads per card that takes the xclbin\n"
+              << "  --metrics-port P  With --engine: serve live Prometheus metrics on 127.0.0.1:P/metrics\n"
+              << "  --failover   With --engine: compute frames on the CPU while the card is lost or missing\n"
+              << "  --gpu N      Run N frame pairs through GpuDiffEngine (CUDA, --buffers slots); no card or xclbin used\n"
+              << "  --broker NAME  Own the card and serve frames to --broker-client processes through /NAME shared memory\n"
+              << "  --broker-client NAME N  Run N frame pairs through the broker at /NAME (same geometry); no OpenCL\n"
+              << "  --ring N     Feed N frames to a V6 xclbin's free-running kernel through its descriptor ring\n"
+              << "  --seed S     Test data seed (default 42)\n"
+              << "  --noise M    B = A + noise: uniform (default), gaussian or sparse\n"
+              << "  --noise-amp A  Noise amplitude: half-range, sigma or changed per mille (default 100)\n"
+              << "  --input-a F  Process frame sequence F (raw/.pgm/.y4m, memory-mapped) against --input-b\n"
+              << "  --input-b F  B frames for --input-a (one frame = fixed reference)\n"
+              << "  --output F   Append the --input-a results to F (raw/.pgm/.y4m)\n"
+              << "  --p2p        With --input-a: read frames from the file straight into P2P device buffers\n"
+              << "  --verify-every K  Check only every Kth frame (--stream and the single-shot run; default 1)\n"
+              << "  --numa N     Pin host threads and buffers to NUMA node N, auto (the card's node, default) or off\n"
+              << "  --ref M      Keep B on the device: golden (fixed frame) or previous (frame n-1);\n"
+              << "               the --frames N frames are sent one per invocation\n"
+              << "  --iters N    Benchmark: time N extra transfer+kernel round trips after verification\n"
+              << "  --warmup W   Benchmark: untimed round trips before the N timed ones (default 2)\n"
+              << "  --report F   Benchmark: append results to F (.json -> JSON Lines, else CSV)\n"
+              << "  --xrt        Benchmark: also time --iters one-frame launches on OpenCL and native XRT\n"
+              << "  --trace F    Record per-frame trace events and write them to F as Chrome trace JSON at exit\n"
+              << "  --cpu-isa I  Software reference: auto, scalar, avx2 or avx512 (default auto)\n"
+              << "  --hetero N   Run N batches split adaptively between CPU engine and FPGA\n"
+              << "  --cpu-threads N  Software reference threads (default 0 = one per usable CPU)\n"
+              << "  --coeffs K   Sharpen taps \"a,b,c,d,e,f,g,h,i\" (row-major, -128..127; default Laplacian)\n"
+              << "  --shift S    Arithmetic right shift of the sharpen sum, 0..15 (default 0)\n"
+              << "  --mode M     sharpen (default) or diff: bypass the sharpen stage (lab-1 output, same xclbin)\n"
+              << "  --in-format F  Ship A/B to the kernel as y8 (default), yuyv or rgb camera frames (-DV3_LUMA xclbin)\n"
+              << "  --border B   Sharpen border policy: zero, replicate, mirror or pass (default zero)\n"
+              << "  --morph M    3x3 clean-up of the output: none, open or close (default none; -DV3_MORPH xclbin)\n"
+              << "  --thresh T   Posterize thresholds \"t1,...\" (1..7 ascending, 1..255; default 32,96 = 3 levels)\n"
+              << "  --serve      Program once, then run \"<height> <width> [<frames>]\" jobs from stdin\n"
+              << "  --emu-full   Under XCL_EMULATION_MODE, keep the full --frames and iteration counts\n";
+}
+
+// --trace: main() has many exits, so the dump rides on a destructor
+struct TraceDumpAtExit
+{
+    std::string path;
+    ~TraceDumpAtExit()
+    {
+        if (path.empty())
+            return;
+        if (trace_dump(path))
+            std::cout << "Trace written to " << path << std::endl;
+        else
+            std::cout << "Cannot write trace " << path << std::endl;
+    }
+};
+
+int main(int argc, char **argv)
+{
+    // Positional arguments: <xclbin> [<height> <width>]; everything else is a --flag
+    std::vector<std::string> positional;
+    int num_frames = 1;
+    int stream_iters = 0;
+    int stream_depth = 3;
+    int num_cus = 1;
+    int num_lanes = 0;
+    bool lanes_ok = true;
+    int split_iters = 0;
+    std::vector<uint64_t> roi_list;
+    ref_mode_t ref_mode = REF_NONE;
+    int engine_iters = 0;
+    int ring_iters = 0;
+    int gpu_iters = 0;
+    std::string broker_name, broker_client_name;
+    int broker_client_iters = 0;
+    bool all_devices = false;
+    bool emu_full = false;
+    bool p2p = false;
+    bool diff_mode = false;
+    int in_format = LUMA_Y8;
+    int metrics_port = 0;
+    bool failover = false;
+    int verify_every = 1;
+    std::string input_A, input_B, output_path;
+    tp_config_t tp = {TP_DEFAULT_SEED, TP_NOISE_UNIFORM, TP_DEFAULT_AMPLITUDE};
+    int numa_node = -2; // -2 = auto (the card's node), -1 = off
+    int bench_iters = 0;
+    int bench_warmup = 2;
+    std::string bench_report;
+    bool bench_xrt = false;
+    TraceDumpAtExit trace;
+    bool serve = false;
+    cpu_isa_t cpu_isa = CPU_ISA_AUTO;
+    int cpu_threads = 0;
+    int hetero_batches = 0;
+    PipelineConfig cfg = DEFAULT_PIPELINE;
+    bool cfg_ok = true;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--frames" && i + 1 < argc)
+        {
+            num_frames = std::atoi(argv[++i]);
+        }
+        else if (arg == "--stream" && i + 1 < argc)
+        {
+            stream_iters = std::atoi(argv[++i]);
+        }
+        else if (arg == "--buffers" && i + 1 < argc)
+        {
+            stream_depth = std::atoi(argv[++i]);
+        }
+        else if (arg == "--cus" && i + 1 < argc)
+        {
+            num_cus = std::atoi(argv[++i]);
+        }
+        else if (arg == "--iters" && i + 1 < argc)
+        {
+            bench_iters = std::atoi(argv[++i]);
+        }
+        else if (arg == "--warmup" && i + 1 < argc)
+        {
+            bench_warmup = std::atoi(argv[++i]);
+        }
+        else if (arg == "--report" && i + 1 < argc)
+        {
+            bench_report = argv[++i];
+        }
+        else if (arg == "--xrt")
+        {
+            bench_xrt = true;
+        }
+        else if (arg == "--trace" && i + 1 < argc)
+        {
+            trace.path = argv[++i];
+        }
+        else if (arg == "--cpu-isa" && i + 1 < argc)
+        {
+            std::string isa = argv[++i];
+            if (isa != "auto" && isa != "scalar" && isa != "avx2" && isa != "avx512")
+            {
+                std::cout << "Invalid --cpu-isa " << isa << " (need auto, scalar, avx2 or avx512)" << std::endl;
+                return EXIT_FAILURE;
+            }
+            cpu_isa = (isa == "scalar") ? CPU_ISA_SCALAR : (isa == "avx2") ? CPU_ISA_AVX2
+                    : (isa == "avx512") ? CPU_ISA_AVX512 : CPU_ISA_AUTO;
+        }
+        else if (arg == "--lanes" && i + 1 < argc)
+        {
+            num_lanes = std::atoi(argv[++i]);
+            lanes_ok = num_lanes >= 1;
+        }
+        else if (arg == "--split" && i + 1 < argc)
+        {
+            split_iters = std::atoi(argv[++i]);
+        }
+        else if (arg == "--roi" && i + 1 < argc)
+        {
+            int r[4];
+            cfg_ok = (parse_int_list(argv[++i], r, 4, 0, 0xFFFF) == 4) && cfg_ok;
+            roi_list.push_back(ROI_PACK(r[0], r[1], r[2], r[3]));
+        }
+        else if (arg == "--engine" && i + 1 < argc)
+        {
+            engine_iters = std::atoi(argv[++i]);
+        }
+        else if (arg == "--gpu" && i + 1 < argc)
+        {
+            gpu_iters = std::atoi(argv[++i]);
+        }
+        else if (arg == "--broker" && i + 1 < argc)
+        {
+            broker_name = argv[++i];
+        }
+        else if (arg == "--broker-client" && i + 2 < argc)
+        {
+            broker_client_name  = argv[++i];
+            broker_client_iters = std::atoi(argv[++i]);
+        }
+        else if (arg == "--ring" && i + 1 < argc)
+        {
+            ring_iters = std::atoi(argv[++i]);
+        }
+        else if (arg == "--emu-full")
+        {
+            emu_full = true;
+        }
+        else if (arg == "--all-devices")
+        {
+            all_devices = true;
+        }
+        else if (arg == "--failover")
+        {
+            failover = true;
+        }
+        else if (arg == "--metrics-port" && i + 1 < argc)
+        {
+            metrics_port = std::atoi(argv[++i]);
+        }
+        else if (arg == "--seed" && i + 1 < argc)
+        {
+            tp.seed = std::strtoull(argv[++i], nullptr, 0);
+        }
+        else if (arg == "--noise" && i + 1 < argc)
+        {
+            const std::string mode = argv[++i];
+            tp.noise = (mode == "gaussian") ? TP_NOISE_GAUSSIAN : (mode == "sparse") ? TP_NOISE_SPARSE : TP_NOISE_UNIFORM;
+            cfg_ok = cfg_ok && (mode == "uniform" || mode == "gaussian" || mode == "sparse");
+        }
+        else if (arg == "--noise-amp" && i + 1 < argc)
+        {
+            tp.amplitude = std::atoi(argv[++i]);
+            cfg_ok = cfg_ok && tp.amplitude >= 0 && tp.amplitude <= 1000;
+        }
+        else if (arg == "--input-a" && i + 1 < argc)
+        {
+            input_A = argv[++i];
+        }
+        else if (arg == "--input-b" && i + 1 < argc)
+        {
+            input_B = argv[++i];
+        }
+        else if (arg == "--output" && i + 1 < argc)
+        {
+            output_path = argv[++i];
+        }
+        else if (arg == "--p2p")
+        {
+            p2p = true;
+        }
+        else if (arg == "--verify-every" && i + 1 < argc)
+        {
+            verify_every = std::atoi(argv[++i]);
+        }
+        else if (arg == "--numa" && i + 1 < argc)
+        {
+            const std::string node = argv[++i];
+            if (node == "auto" || node == "off")
+                numa_node = (node == "auto") ? -2 : -1;
+            else if (parse_int_list(node, &numa_node, 1, 0, std::numeric_limits<int>::max()) != 1)
+            {
+                std::cout << "Invalid --numa " << node << " (need a node number, auto or off)" << std::endl;
+                return EXIT_FAILURE;
+            }
+        }
+        else if (arg == "--ref" && i + 1 < argc)
+        {
+            const std::string mode = argv[++i];
+            ref_mode = (mode == "golden") ? REF_GOLDEN : (mode == "previous") ? REF_PREVIOUS : REF_NONE;
+            cfg_ok = cfg_ok && ref_mode != REF_NONE;
+        }
+        else if (arg == "--hetero" && i + 1 < argc)
+        {
+            hetero_batches = std::atoi(argv[++i]);
+        }
+        else if (arg == "--cpu-threads" && i + 1 < argc)
+        {
+            cpu_threads = std::atoi(argv[++i]);
+        }
+        else if (arg == "--coeffs" && i + 1 < argc)
+        {
+            cfg_ok = (parse_int_list(argv[++i], &cfg.k[0][0], 9, -128, 127) == 9) && cfg_ok;
+        }
+        else if (arg == "--shift" && i + 1 < argc)
+        {
+            cfg.shift = std::atoi(argv[++i]);
+        }
+        else if (arg == "--border" && i + 1 < argc)
+        {
+            const std::string mode = argv[++i];
+            cfg.border = (mode == "zero") ? BORDER_ZERO : (mode == "replicate") ? BORDER_REPLICATE
+                       : (mode == "mirror") ? BORDER_MIRROR : (mode == "pass") ? BORDER_PASSTHROUGH : -1;
+            cfg_ok = cfg_ok && cfg.border >= 0;
+        }
+        else if (arg == "--mode" && i + 1 < argc)
+        {
+            const std::string mode = argv[++i];
+            diff_mode = (mode == "diff");
+            cfg_ok = cfg_ok && (diff_mode || mode == "sharpen");
+        }
+        else if (arg == "--in-format" && i + 1 < argc)
+        {
+            const std::string fmt = argv[++i];
+            in_format = (fmt == "y8") ? LUMA_Y8 : (fmt == "yuyv") ? LUMA_YUYV : (fmt == "rgb") ? LUMA_RGB888 : -1;
+            cfg_ok = cfg_ok && in_format >= 0;
+        }
+        else if (arg == "--morph" && i + 1 < argc)
+        {
+            const std::string mode = argv[++i];
+            cfg.morph = (mode == "none") ? MORPH_NONE : (mode == "open") ? MORPH_OPEN
+                      : (mode == "close") ? MORPH_CLOSE : -1;
+            cfg_ok = cfg_ok && cfg.morph >= 0;
+        }
+        else if (arg == "--thresh" && i + 1 < argc)
+        {
+            const int n = parse_int_list(argv[++i], cfg.thr, POSTERIZE_MAX_LEVELS - 1, 1, 255);
+            for (int t = 1; t < n; t++)
+                cfg_ok = cfg_ok && cfg.thr[t] > cfg.thr[t - 1];
+            cfg_ok = cfg_ok && n >= 1;
+            cfg.levels = n + 1;
+        }
+        else if (arg == "--serve")
+        {
+            serve = true;
+        }
+        else if (arg.compare(0, 2, "--") == 0)
+        {
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        else
+        {
+            positional.push_back(arg);
+        }
+    }
+
+    if (positional.size() != 1 && positional.size() != 3)
     {
-        std::memcpy(image_data + r * WIDTH, hw_buffer + r * PADDED_WIDTH , WIDTH);
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
     }
-}
-
-// =============================================================================
-// Software Reference Implementation (operates on original image size)
-// =============================================================================
-void sw_reference(const uint8_t *A, const uint8_t *B, uint8_t *C_ref)
-{
-    // Intermediate buffer for posterized difference
-    static uint8_t C_post[IMAGE_SIZE];
-
-    // Stage 1: Absolute difference + posterization
-    for (int i = 0; i < IMAGE_SIZE; i++)
+    if (!trace.path.empty())
     {
-        int diff = (int)A[i] - (int)B[i];
-        if (diff < 0) diff = -diff;
-        C_post[i] = (diff < THRESH_LOW) ? 0 : (diff < THRESH_HIGH) ? 128 : 255;
+        trace_enable();
+        trace_name_thread("host main");
     }
 
-    // Stage 2: 3x3 Sharpen filter
-    for (int r = 0; r < HEIGHT; r++)
+    // Image size is a run-time kernel argument, so one xclbin serves any resolution
+    int height = (positional.size() == 3) ? std::atoi(positional[1].c_str()) : HEIGHT;
+    int width  = (positional.size() == 3) ? std::atoi(positional[2].c_str()) : WIDTH;
+
+    // File input: PGM/Y4M headers override the size (raw files use it)
+    FrameSource src_A, src_B;
+    FrameSink sink;
+    if (!input_A.empty() || !input_B.empty())
     {
-        for (int c = 0; c < WIDTH; c++)
+        if (input_A.empty() || input_B.empty())
         {
-            int idx = r * WIDTH + c;
-            if (r == 0 || r == HEIGHT - 1 || c == 0 || c == WIDTH - 1)
-            {
-                C_ref[idx] = 0; // Border policy: zero
-            }
-            else
-            {
-                int16_t val = 5 * C_post[idx] - C_post[idx - WIDTH] - C_post[idx + WIDTH] - C_post[idx - 1] - C_post[idx + 1];
-                C_ref[idx] = (uint8_t)((val < 0) ? 0 : (val > 255) ? 255 : val);
-            }
+            std::cout << "--input-a and --input-b go together" << std::endl;
+            return EXIT_FAILURE;
+        }
+        if (!src_A.open(input_A, width, height) || !src_B.open(input_B, width, height))
+        {
+            std::cout << "Input error: " << (src_A.error().empty() ? src_B.error() : src_A.error()) << std::endl;
+            return EXIT_FAILURE;
+        }
+        if (src_A.width() != src_B.width() || src_A.height() != src_B.height())
+        {
+            std::cout << "Input sizes differ: " << src_A.width() << " x " << src_A.height() << " vs "
+                      << src_B.width() << " x " << src_B.height() << std::endl;
+            return EXIT_FAILURE;
+        }
+        height = src_A.height();
+        width  = src_A.width();
+        if (!output_path.empty() && !sink.open(output_path, width, height))
+        {
+            std::cout << "Cannot create " << output_path << std::endl;
+            return EXIT_FAILURE;
         }
     }
-}
-
-// =============================================================================
-// Main Host Application
-// =============================================================================
-int main(int argc, char **argv)
-{
-    if (argc != 2)
+    const bool file_mode = !input_A.empty();
+    if (height < 3 || width < 3 || width > MAX_WIDTH || num_frames < 1)
+    {
+        std::cout << "Invalid image size " << width << " x " << height << " x " << num_frames
+                  << " frames (need 3 <= width <= " << MAX_WIDTH << ", height >= 3, frames >= 1)" << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (stream_iters < 0 || stream_depth < 2 || stream_depth > 3)
+    {
+        std::cout << "Invalid streaming options (need --stream >= 0, --buffers 2 or 3)" << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (num_cus < 1 || (num_cus > 1 && stream_iters == 0))
+    {
+        std::cout << "Invalid --cus " << num_cus << " (need >= 1; more than one CU requires --stream)" << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (bench_iters < 0 || bench_warmup < 0 || (bench_iters > 0 && stream_iters > 0) || (bench_xrt && bench_iters == 0))
+    {
+        std::cout << "Invalid benchmark options (need --iters/--warmup >= 0, not combined with --stream;"
+                  << " --xrt needs --iters)" << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (in_format != LUMA_Y8
+        && (stream_iters > 0 || hetero_batches > 0 || bench_xrt || serve || num_lanes > 0 || split_iters > 0
+            || !roi_list.empty() || ref_mode != REF_NONE || engine_iters > 0 || gpu_iters > 0 || ring_iters > 0
+            || !broker_name.empty() || !broker_client_name.empty() || file_mode))
+    {
+        std::cout << "--in-format yuyv|rgb only supports the single-shot run and --iters" << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (hetero_batches < 0 || (hetero_batches > 0 && (stream_iters > 0 || num_frames < 2)))
+    {
+        std::cout << "Invalid --hetero " << hetero_batches
+                  << " (need >= 0, --frames >= 2, not combined with --stream)" << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (p2p && (!file_mode || width % PIXELS_PER_CHUNK != 0 || xcl::is_emulation()))
+    {
+        // Frames are read whole into the device layout, so rows must need no padding
+        std::cout << "--p2p needs --input-a, a width that is a multiple of " << PIXELS_PER_CHUNK
+                  << " and a hardware run" << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (verify_every < 1)
+    {
+        std::cout << "Invalid --verify-every " << verify_every << " (need >= 1)" << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (!cfg_ok || cfg.shift < 0 || cfg.shift > 15)
+    {
+        std::cout << "Invalid pipeline options (need --coeffs with 9 taps in [-128, 127], --shift 0..15, "
+                  << "--border zero|replicate|mirror|pass, --morph none|open|close, --mode diff|sharpen, "
+                  << "--thresh with 1.." << POSTERIZE_MAX_LEVELS - 1 << " ascending values in [1, 255])" << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (diff_mode)
+        cfg = diff_only_pipeline(cfg);
+    if (!lanes_ok || num_lanes > MAX_LANES || num_lanes > height
+        || (num_lanes > 0 && (stream_iters > 0 || bench_iters > 0 || hetero_batches > 0 || serve)))
+    {
+        std::cout << "Invalid --lanes " << num_lanes << " (need 1.." << std::min(MAX_LANES, height)
+                  << ", not combined with --stream, --iters, --hetero or --serve)" << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (split_iters < 0
+        || (split_iters > 0 && (stream_iters > 0 || bench_iters > 0 || hetero_batches > 0 || serve || num_lanes > 0)))
+    {
+        std::cout << "Invalid --split " << split_iters
+                  << " (need >= 0, not combined with --stream, --iters, --hetero, --serve or --lanes)" << std::endl;
+        return EXIT_FAILURE;
+    }
+    const int roi_chunks = (width + PIXELS_PER_CHUNK - 1) / PIXELS_PER_CHUNK;
+    bool roi_ok = (int)roi_list.size() <= ROI_MAX;
+    for (uint64_t roi : roi_list)
+    {
+        roi_ok = roi_ok && ROI_ROW0(roi) < ROI_ROW1(roi) && ROI_ROW1(roi) <= height
+                        && ROI_COL0(roi) < ROI_COL1(roi) && ROI_COL1(roi) <= roi_chunks;
+    }
+    if (!roi_ok || (!roi_list.empty()
+                    && (stream_iters > 0 || bench_iters > 0 || hetero_batches > 0 || serve || num_lanes > 0
+                        || split_iters > 0)))
     {
-        std::cout << "Usage: " << argv[0] << " <XCLBIN File>" << std::endl;
+        std::cout << "Invalid --roi (need 1.." << ROI_MAX << " non-empty rectangles inside the " << height
+                  << " rows x " << roi_chunks << " chunks frame, not combined with other modes)" << std::endl;
         return EXIT_FAILURE;
     }
+    if (ref_mode != REF_NONE
+        && (stream_iters > 0 || bench_iters > 0 || hetero_batches > 0 || serve || num_lanes > 0
+            || split_iters > 0 || !roi_list.empty()))
+    {
+        std::cout << "--ref cannot be combined with other modes" << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (file_mode && (stream_iters > 0 || bench_iters > 0 || hetero_batches > 0 || serve || num_lanes > 0
+                      || split_iters > 0 || !roi_list.empty() || ref_mode != REF_NONE || engine_iters > 0))
+    {
+        std::cout << "--input-a cannot be combined with other modes" << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (engine_iters < 0
+        || (engine_iters > 0 && (stream_iters > 0 || bench_iters > 0 || hetero_batches > 0 || serve || num_lanes > 0
+                                 || split_iters > 0 || !roi_list.empty() || ref_mode != REF_NONE))
+        || ((all_devices || metrics_port != 0 || failover) && engine_iters == 0) || metrics_port < 0
+        || metrics_port > 65535)
+    {
+        std::cout << "Invalid --engine " << engine_iters << " (need >= 0, not combined with other modes;"
+                  << " --all-devices, --metrics-port and --failover need it)" << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (gpu_iters < 0
+        || (gpu_iters > 0 && (stream_iters > 0 || bench_iters > 0 || hetero_batches > 0 || serve || num_lanes > 0
+                              || split_iters > 0 || !roi_list.empty() || ref_mode != REF_NONE || engine_iters > 0
+                              || ring_iters > 0 || file_mode)))
+    {
+        std::cout << "Invalid --gpu " << gpu_iters << " (need >= 0, not combined with other modes)" << std::endl;
+        return EXIT_FAILURE;
+    }
+    const bool broker_mode = !broker_name.empty() || !broker_client_name.empty();
+    if (broker_mode
+        && ((!broker_name.empty() && !broker_client_name.empty())
+            || (broker_name + broker_client_name).find('/') != std::string::npos
+            || (!broker_client_name.empty() && broker_client_iters < 1) || stream_iters > 0 || bench_iters > 0
+            || hetero_batches > 0 || serve || num_lanes > 0 || split_iters > 0 || !roi_list.empty()
+            || ref_mode != REF_NONE || engine_iters > 0 || gpu_iters > 0 || file_mode))
+    {
+        std::cout << "Invalid --broker / --broker-client (one of them, a NAME without '/', N >= 1,"
+                  << " not combined with other modes)" << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (ring_iters < 0
+        || (ring_iters > 0 && (stream_iters > 0 || bench_iters > 0 || hetero_batches > 0 || serve || num_lanes > 0
+                               || split_iters > 0 || !roi_list.empty() || ref_mode != REF_NONE || engine_iters > 0
+                               || file_mode)))
+    {
+        std::cout << "Invalid --ring " << ring_iters << " (need >= 0, not combined with other modes)" << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (serve && (stream_iters > 0 || bench_iters > 0 || hetero_batches > 0))
+    {
+        // Service jobs rely on the in-order queue
+        std::cout << "--serve cannot be combined with --stream, --iters or --hetero" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if (xcl::is_emulation() && !emu_full)
+    {
+        const int max_iters = xcl::is_hw_emulation() ? EMU_HW_MAX_ITERS : EMU_SW_MAX_ITERS;
+        emu_cap(num_frames, EMU_MAX_FRAMES, "--frames");
+        emu_cap(stream_iters, max_iters, "--stream");
+        emu_cap(split_iters, max_iters, "--split");
+        emu_cap(engine_iters, max_iters, "--engine");
+        emu_cap(ring_iters, max_iters, "--ring");
+        emu_cap(broker_client_iters, max_iters, "--broker-client");
+        emu_cap(hetero_batches, max_iters, "--hetero");
+        emu_cap(bench_iters, max_iters, "--iters");
+        emu_cap(bench_warmup, xcl::is_hw_emulation() ? 0 : 1, "--warmup");
+    }
+
+    const int image_size        = height * width;
+    const int stride_chunks     = (width + PIXELS_PER_CHUNK - 1) / PIXELS_PER_CHUNK;
+    const int padded_width      = stride_chunks * PIXELS_PER_CHUNK;
+    const int total_chunks      = stride_chunks * height;
+    const size_t frame_bytes    = (size_t)total_chunks * PIXELS_PER_CHUNK;
+    const size_t buffer_bytes   = frame_bytes * num_frames;
+    const size_t batch_pixels   = (size_t)image_size * num_frames;
 
     // Print configuration
     std::cout << "====== Image Configuration ======" << std::endl;
-    std::cout << "Original:  " << WIDTH << " x " << HEIGHT << " = " << IMAGE_SIZE << " pixels" << std::endl;
-    std::cout << "Padded:    " << PADDED_WIDTH  << " x " << HEIGHT << " = " << PADDED_IMAGE_SIZE << " pixels" << std::endl;
-    std::cout << "Chunks:    " << CHUNKS_PER_ROW << " per row, " << TOTAL_CHUNKS << " total" << std::endl;
+    std::cout << "Original:  " << width << " x " << height << " = " << image_size << " pixels" << std::endl;
+    std::cout << "Padded:    " << padded_width << " x " << height << " = " << (size_t)padded_width * height << " pixels" << std::endl;
+    std::cout << "Chunks:    " << stride_chunks << " per row, " << total_chunks << " total" << std::endl;
+    std::cout << "Batch:     " << num_frames << " frame(s) per invocation" << std::endl;
+    // Before the first allocation and before the cpu_engine pool starts
+    if (numa_node == -2)
+        numa_node = fpga_numa_node();
+    if (numa_node >= 0)
+    {
+        const bool pinned = pin_to_numa_node(numa_node);
+        std::cout << "NUMA:      node " << numa_node << (pinned ? "" : " (affinity not applied)") << std::endl;
+    }
+    cpu_engine_set_threads(cpu_threads);
+    set_cpu_pipeline(cfg);
+    std::cout << "CPU ref:   " << cpu_engine_isa_name(cpu_engine_select(cpu_isa)) << ", "
+              << cpu_engine_threads() << " thread(s)" << std::endl;
     std::cout << "===============================" << std::endl << std::endl;
 
     EventTimer et;
-    std::string binaryFile = argv[1];
+    std::string binaryFile = positional[0];
     cl_int err;
     cl::Context context;
+    cl::Program program;
     cl::Kernel krnl_image_diff;
     cl::CommandQueue q;
 
@@ -117,16 +3112,13 @@ int main(int argc, char **argv)
     // =========================================================================
     et.add("Allocate Memory");
 
-    // Original images (unpadded)
-    std::vector<uint8_t> image_A(IMAGE_SIZE);
-    std::vector<uint8_t> image_B(IMAGE_SIZE);
-    std::vector<uint8_t> sw_result(IMAGE_SIZE);
-    std::vector<uint8_t> hw_result_unpadded(IMAGE_SIZE);
+    // Compact reference output
+    std::vector<uint8_t> sw_result(batch_pixels);
 
-    // Padded images for kernel (aligned)
-    std::vector<uint8_t, aligned_allocator<uint8_t>> padded_A(BUFFER_SIZE_BYTES);
-    std::vector<uint8_t, aligned_allocator<uint8_t>> padded_B(BUFFER_SIZE_BYTES);
-    std::vector<uint8_t, aligned_allocator<uint8_t>> padded_C(BUFFER_SIZE_BYTES);
+    // Padded images for kernel (aligned, zero-initialised padding)
+    std::vector<uint8_t, aligned_allocator<uint8_t>> padded_A(buffer_bytes);
+    std::vector<uint8_t, aligned_allocator<uint8_t>> padded_B(buffer_bytes);
+    std::vector<uint8_t, aligned_allocator<uint8_t>> padded_C(buffer_bytes);
 
     et.finish();
 
@@ -135,38 +3127,137 @@ int main(int argc, char **argv)
     // =========================================================================
     et.add("Generate Test Data");
 
-    srand(42);
-    for (int i = 0; i < IMAGE_SIZE; i++)
+    generate_frames(padded_A.data(), padded_B.data(), num_frames, height, width, padded_width, tp);
+
+    // --in-format: what the camera would deliver; the kernel gets these instead
+    const size_t in_bytes = buffer_bytes * LUMA_WORDS_PER_CHUNK(in_format);
+    aligned_vec camera_A, camera_B;
+    if (in_format != LUMA_Y8)
     {
-        image_A[i] = rand() % 256;
-        int noise = (rand() % 200) - 100; // Random noise between -100 and 100
-        int temp = image_A[i] + noise;
-        image_B[i] = (uint8_t)((temp < 0) ? 0 : (temp > 255) ? 255 : temp);
+        camera_A.assign(in_bytes, 0);
+        camera_B.assign(in_bytes, 0);
+        make_camera_frames(padded_A.data(), camera_A.data(), num_frames, height, width, padded_width, in_format,
+                           tp.seed + 1);
+        make_camera_frames(padded_B.data(), camera_B.data(), num_frames, height, width, padded_width, in_format,
+                           tp.seed + 2);
     }
 
     et.finish();
 
     // =========================================================================
-    // Step 3: Compute software reference (on original images)
+    // Step 3: Compute software reference (reads the padded inputs in place)
     // =========================================================================
     et.add("Software Reference Computation");
 
-    sw_reference(image_A.data(), image_B.data(), sw_result.data());
+    for (int f = 0; f < num_frames; f++)
+    {
+        const size_t px = (size_t)f * image_size;
+        cpu_engine_run(&padded_A[f * frame_bytes], &padded_B[f * frame_bytes], &sw_result[px],
+                       height, width, padded_width);
+    }
 
     et.finish();
 
-    // =========================================================================
-    // Step 4: PAD input images for kernel
-    // =========================================================================
-    et.add("Pad Input Images");
+    if (engine_iters > 0)
+    {
+        // The engine programs the device itself
+        et.add("Image Diff Engine");
+        int engine_errors = run_engine_mode(positional[0], padded_A, padded_B, sw_result, height, width,
+                                            num_frames, cfg, engine_iters, stream_depth, all_devices, metrics_port,
+                                            failover);
+        et.finish();
 
-    pad_pixels(image_A.data(), padded_A.data());
-    pad_pixels(image_B.data(), padded_B.data());
+        std::cout << "\n----------------- Key Execution Times -----------------" << std::endl;
+        et.print();
 
-    et.finish();
+        if (engine_errors == 0)
+        {
+            std::cout << "\nTEST PASSED\n" << std::endl;
+            return EXIT_SUCCESS;
+        }
+        std::cout << "\nTEST FAILED (" << engine_errors << " errors)\n" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if (gpu_iters > 0)
+    {
+        et.add("GPU Engine");
+        int gpu_errors = run_gpu_mode(padded_A, padded_B, sw_result, height, width, num_frames, cfg, gpu_iters,
+                                      stream_depth);
+        et.finish();
+
+        std::cout << "\n----------------- Key Execution Times -----------------" << std::endl;
+        et.print();
+
+        if (gpu_errors == 0)
+        {
+            std::cout << "\nTEST PASSED\n" << std::endl;
+            return EXIT_SUCCESS;
+        }
+        std::cout << "\nTEST FAILED (" << gpu_errors << " errors)\n" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if (!broker_name.empty())
+    {
+        // The broker programs the device itself and keeps it for its lifetime
+        et.add("Accelerator Broker");
+        int broker_errors = run_broker_mode(positional[0], broker_name, height, width, cfg, stream_depth);
+        et.finish();
+
+        std::cout << "\n----------------- Key Execution Times -----------------" << std::endl;
+        et.print();
+
+        if (broker_errors == 0)
+        {
+            std::cout << "\nTEST PASSED\n" << std::endl;
+            return EXIT_SUCCESS;
+        }
+        std::cout << "\nTEST FAILED (" << broker_errors << " errors)\n" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if (!broker_client_name.empty())
+    {
+        et.add("Broker Client");
+        int client_errors = run_broker_client_mode(broker_client_name, padded_A, padded_B, sw_result, height, width,
+                                                   num_frames, broker_client_iters);
+        et.finish();
+
+        std::cout << "\n----------------- Key Execution Times -----------------" << std::endl;
+        et.print();
+
+        if (client_errors == 0)
+        {
+            std::cout << "\nTEST PASSED\n" << std::endl;
+            return EXIT_SUCCESS;
+        }
+        std::cout << "\nTEST FAILED (" << client_errors << " errors)\n" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if (ring_iters > 0)
+    {
+        // A V6 xclbin, driven natively from here on
+        et.add("Descriptor Ring");
+        int ring_errors = run_ring_mode(positional[0], padded_A, padded_B, sw_result, height, width, stride_chunks,
+                                        num_frames, cfg, ring_iters);
+        et.finish();
+
+        std::cout << "\n----------------- Key Execution Times -----------------" << std::endl;
+        et.print();
+
+        if (ring_errors == 0)
+        {
+            std::cout << "\nTEST PASSED\n" << std::endl;
+            return EXIT_SUCCESS;
+        }
+        std::cout << "\nTEST FAILED (" << ring_errors << " errors)\n" << std::endl;
+        return EXIT_FAILURE;
+    }
 
     // =========================================================================
-    // Step 5: OpenCL Setup
+    // Step 4: OpenCL Setup
     // =========================================================================
     et.add("OpenCL Host Code Setup");
 
@@ -184,11 +3275,15 @@ int main(int argc, char **argv)
     {
         auto device = devices[i];
         OCL_CHECK(err, context = cl::Context(device, nullptr, nullptr, nullptr, &err));
-        OCL_CHECK(err, q = cl::CommandQueue(context, device, CL_QUEUE_PROFILING_ENABLE, &err));
+        // Streaming, lanes, split and file mode rely on event dependencies rather than in-order execution
+        cl_command_queue_properties props = CL_QUEUE_PROFILING_ENABLE;
+        if (stream_iters > 0 || num_lanes > 0 || split_iters > 0 || file_mode)
+            props |= CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE;
+        OCL_CHECK(err, q = cl::CommandQueue(context, device, props, &err));
 
         std::cout << "Trying to program device[" << i << "]: " << device.getInfo<CL_DEVICE_NAME>() << std::endl;
 
-        cl::Program program(context, {device}, bins, nullptr, &err);
+        program = cl::Program(context, {device}, bins, nullptr, &err);
         if (err != CL_SUCCESS)
         {
             std::cout << "Failed to program device[" << i << "]!\n";
@@ -196,7 +3291,9 @@ int main(int argc, char **argv)
         else
         {
             std::cout << "Device[" << i << "]: program successful!\n";
-            OCL_CHECK(err, krnl_image_diff = cl::Kernel(program, "IMAGE_DIFF_POSTERIZE", &err));
+            // A split xclbin has no single-kernel top; its diff kernel takes the same role
+            const char *top = (split_iters > 0) ? "IMAGE_DIFF_SPLIT" : "IMAGE_DIFF_POSTERIZE";
+            OCL_CHECK(err, krnl_image_diff = cl::Kernel(program, top, &err));
             valid_device = true;
             break;
         }
@@ -210,97 +3307,437 @@ int main(int argc, char **argv)
 
     et.finish();
 
+    // Only the single-shot run below expands a compressed C
+    if (kernel_arg_index(krnl_image_diff, "comp_index") >= 0
+        && (serve || split_iters > 0 || !roi_list.empty() || num_lanes > 0 || stream_iters > 0 || bench_iters > 0
+            || hetero_batches > 0 || file_mode || engine_iters > 0 || ref_mode != REF_NONE))
+    {
+        std::cout << "An xclbin built with -DV3_COMPRESS only supports the single-shot run" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if (in_format != LUMA_Y8 && kernel_arg_index(krnl_image_diff, "in_format") < 0)
+    {
+        std::cout << "--in-format yuyv|rgb needs an xclbin built with -DV3_LUMA" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // Lane bands and the split CUs would open/close each band on its own
+    if (cfg.morph != MORPH_NONE
+        && (kernel_arg_index(krnl_image_diff, "morph_mode") < 0 || num_lanes > 0 || split_iters > 0))
+    {
+        std::cout << "--morph needs an xclbin built with -DV3_MORPH and is not combined with --lanes or --split"
+                  << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // V1/V2 hold whole rows on-chip, so their builds cap the width (ROW_BUF_MAX_WIDTH)
+    // -DSHARPEN_FIXED / -DPOSTERIZE_FIXED builds ignore the taps / the posterize
+    // table, so the reference would not match the card
+    const uint64_t props = (split_iters > 0) ? 0 : query_kernel_props(context, q, krnl_image_diff);
+    const int max_width = kernel_max_width(props);
+    if (width > max_width)
+    {
+        std::cout << "This xclbin takes frames up to " << max_width << " px wide, not " << width << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (!kernel_takes_taps(props, cfg))
+    {
+        std::cout << "This xclbin is built with -DSHARPEN_FIXED and ignores --coeffs, --shift and --mode diff"
+                  << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (!kernel_takes_posterize(props, cfg))
+    {
+        std::cout << "This xclbin is built with -DPOSTERIZE_FIXED and ignores --thresh" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if (serve)
+    {
+        std::cout << "\n----------------- Key Execution Times -----------------" << std::endl;
+        et.print();
+        return (run_serve_mode(context, q, krnl_image_diff, cfg, tp, props) == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if (split_iters > 0)
+    {
+        et.add("Split Diff/Sharpen");
+        int split_errors = run_split_mode(context, q, program, krnl_image_diff, padded_A, padded_B, sw_result,
+                                          height, width, stride_chunks, num_frames, cfg, split_iters);
+        et.finish();
+
+        std::cout << "\n----------------- Key Execution Times -----------------" << std::endl;
+        et.print();
+
+        if (split_errors == 0)
+        {
+            std::cout << "\nTEST PASSED\n" << std::endl;
+            return EXIT_SUCCESS;
+        }
+        std::cout << "\nTEST FAILED (" << split_errors << " errors)\n" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if (!roi_list.empty())
+    {
+        et.add("ROI Processing");
+        int roi_errors = run_roi_mode(context, q, krnl_image_diff, padded_A, padded_B, sw_result,
+                                      height, width, stride_chunks, num_frames, cfg, roi_list);
+        et.finish();
+
+        std::cout << "\n----------------- Key Execution Times -----------------" << std::endl;
+        et.print();
+
+        if (roi_errors == 0)
+        {
+            std::cout << "\nTEST PASSED\n" << std::endl;
+            return EXIT_SUCCESS;
+        }
+        std::cout << "\nTEST FAILED (" << roi_errors << " errors)\n" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if (file_mode)
+    {
+        et.add("File Frames");
+        int file_errors = run_file_mode(context, q, program, src_A, src_B,
+                                        output_path.empty() ? nullptr : &sink,
+                                        height, width, stride_chunks, num_frames, cfg, verify_every, stream_depth,
+                                        p2p);
+        et.finish();
+
+        std::cout << "\n----------------- Key Execution Times -----------------" << std::endl;
+        et.print();
+
+        if (file_errors == 0)
+        {
+            std::cout << "\nTEST PASSED\n" << std::endl;
+            return EXIT_SUCCESS;
+        }
+        std::cout << "\nTEST FAILED (" << file_errors << " errors)\n" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if (ref_mode != REF_NONE)
+    {
+        et.add("Device-Resident Reference");
+        int ref_errors = run_reference_mode(context, q, krnl_image_diff, padded_A, padded_B,
+                                            height, width, stride_chunks, num_frames, cfg, ref_mode);
+        et.finish();
+
+        std::cout << "\n----------------- Key Execution Times -----------------" << std::endl;
+        et.print();
+
+        if (ref_errors == 0)
+        {
+            std::cout << "\nTEST PASSED\n" << std::endl;
+            return EXIT_SUCCESS;
+        }
+        std::cout << "\nTEST FAILED (" << ref_errors << " errors)\n" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if (num_lanes > 0)
+    {
+        et.add("HBM Lanes");
+        int lane_errors = run_lanes_mode(context, q, program, padded_A, padded_B, sw_result,
+                                         height, width, stride_chunks, num_frames, cfg, num_lanes);
+        et.finish();
+
+        std::cout << "\n----------------- Key Execution Times -----------------" << std::endl;
+        et.print();
+
+        if (lane_errors == 0)
+        {
+            std::cout << "\nTEST PASSED\n" << std::endl;
+            return EXIT_SUCCESS;
+        }
+        std::cout << "\nTEST FAILED (" << lane_errors << " errors)\n" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if (stream_iters > 0)
+    {
+        et.add("Streaming Pipeline");
+        int stream_errors = run_stream_mode(context, q, program, padded_A, padded_B, sw_result,
+                                            height, width, stride_chunks, num_frames, cfg,
+                                            stream_iters, stream_depth, num_cus, verify_every);
+        et.finish();
+
+        std::cout << "\n----------------- Key Execution Times -----------------" << std::endl;
+        et.print();
+
+        if (stream_errors == 0)
+        {
+            std::cout << "\nTEST PASSED\n" << std::endl;
+            return EXIT_SUCCESS;
+        }
+        std::cout << "\nTEST FAILED (" << stream_errors << " errors)\n" << std::endl;
+        return EXIT_FAILURE;
+    }
+
     // =========================================================================
-    // Step 6: Allocate device buffers (PADDED size)
+    // Step 5: Allocate device buffers (PADDED size)
     // =========================================================================
     et.add("Allocate Device Buffers");
 
-    OCL_CHECK(err, cl::Buffer buffer_A(context, CL_MEM_USE_HOST_PTR | CL_MEM_READ_ONLY,
-                                        (size_t)BUFFER_SIZE_BYTES, padded_A.data(), &err));
-    OCL_CHECK(err, cl::Buffer buffer_B(context, CL_MEM_USE_HOST_PTR | CL_MEM_READ_ONLY,
-                                        (size_t)BUFFER_SIZE_BYTES, padded_B.data(), &err));
+    uint8_t *in_A = (in_format != LUMA_Y8) ? camera_A.data() : padded_A.data();
+    uint8_t *in_B = (in_format != LUMA_Y8) ? camera_B.data() : padded_B.data();
+    OCL_CHECK(err, cl::Buffer buffer_A(context, CL_MEM_USE_HOST_PTR | CL_MEM_READ_ONLY, in_bytes, in_A, &err));
+    OCL_CHECK(err, cl::Buffer buffer_B(context, CL_MEM_USE_HOST_PTR | CL_MEM_READ_ONLY, in_bytes, in_B, &err));
     OCL_CHECK(err, cl::Buffer buffer_C(context, CL_MEM_USE_HOST_PTR | CL_MEM_WRITE_ONLY,
-                                        (size_t)BUFFER_SIZE_BYTES, padded_C.data(), &err));
+                                        buffer_bytes, padded_C.data(), &err));
+    change_map_vec change_map(CHANGE_MAP_WORDS(height, stride_chunks, num_frames), 0);
+    OCL_CHECK(err, cl::Buffer buffer_map(context, CL_MEM_USE_HOST_PTR | CL_MEM_WRITE_ONLY,
+                                          change_map.size() * sizeof(uint64_t), change_map.data(), &err));
 
     et.finish();
 
     // =========================================================================
-    // Step 7: Set kernel arguments
+    // Step 6: Set kernel arguments
     // =========================================================================
     et.add("Set Kernel Arguments");
 
     OCL_CHECK(err, err = krnl_image_diff.setArg(0, buffer_A));
     OCL_CHECK(err, err = krnl_image_diff.setArg(1, buffer_B));
     OCL_CHECK(err, err = krnl_image_diff.setArg(2, buffer_C));
+    OCL_CHECK(err, err = krnl_image_diff.setArg(3, height));
+    OCL_CHECK(err, err = krnl_image_diff.setArg(4, width));
+    OCL_CHECK(err, err = krnl_image_diff.setArg(5, stride_chunks));
+    OCL_CHECK(err, err = krnl_image_diff.setArg(6, num_frames));
+    set_pipeline_args(krnl_image_diff, cfg);
+    OCL_CHECK(err, err = krnl_image_diff.setArg(CHANGE_MAP_ARG_INDEX, buffer_map));
+    if (in_format != LUMA_Y8)
+    {
+        OCL_CHECK(err, err = krnl_image_diff.setArg(kernel_arg_index(krnl_image_diff, "in_format"), in_format));
+    }
+
+    // Tap / statistics / profiling builds: each lands in its own buffer
+    const size_t tap_words = post_tap_u64_words(height, stride_chunks, num_frames);
+    counter_vec tap, stats, prof;
+    cl::Buffer buffer_tap, buffer_stats, buffer_prof;
+    const bool have_tap   = bind_optional_arg(context, krnl_image_diff, "post_tap", tap_words, tap, buffer_tap);
+    const bool have_stats = bind_optional_arg(context, krnl_image_diff, "stats", STATS_NUM_WORDS,
+                                              stats, buffer_stats);
+    const bool profiling  = bind_optional_arg(context, krnl_image_diff, "prof", PROF_NUM_COUNTERS,
+                                              prof, buffer_prof);
+
+    // Blob-list build: a few hundred bytes per frame describing the white regions
+    counter_vec blobs;
+    cl::Buffer buffer_blobs;
+    const bool have_blobs = bind_optional_arg(context, krnl_image_diff, "blobs", BLOB_WORDS(num_frames),
+                                              blobs, buffer_blobs);
+
+    // Pyramid build: C at 1/2 and 1/4 resolution, from the same pass
+    counter_vec pyr_half, pyr_quarter;
+    cl::Buffer buffer_half, buffer_quarter;
+    const size_t half_words    = pyr_u64_words(height, stride_chunks, num_frames, 1);
+    const size_t quarter_words = pyr_u64_words(height, stride_chunks, num_frames, 2);
+    const bool have_pyramid = bind_optional_arg(context, krnl_image_diff, "pyr_half", half_words,
+                                                pyr_half, buffer_half)
+                              && bind_optional_arg(context, krnl_image_diff, "pyr_quarter", quarter_words,
+                                                   pyr_quarter, buffer_quarter);
+
+    // Compressed-output build: C then holds only the non-zero chunks
+    counter_vec comp_index;
+    cl::Buffer buffer_comp;
+    const bool compressed = bind_optional_arg(context, krnl_image_diff, "comp_index",
+                                              COMP_INDEX_WORDS(height, stride_chunks, num_frames),
+                                              comp_index, buffer_comp);
 
     et.finish();
 
     // =========================================================================
-    // Step 8: Transfer padded input to device
+    // Step 7: Transfer padded input to device
     // =========================================================================
     et.add("Copy Padded Input to Device");
 
-    OCL_CHECK(err, err = q.enqueueMigrateMemObjects({buffer_A, buffer_B}, 0));
+    cl::Event ev_h2d, ev_krn, ev_d2h;
+    OCL_CHECK(err, err = q.enqueueMigrateMemObjects({buffer_A, buffer_B}, 0, nullptr, &ev_h2d));
+    et.add_device("H2D (A + B)", ev_h2d, 2 * in_bytes);
 
     et.finish();
 
     // =========================================================================
-    // Step 9: Launch kernel
+    // Step 8: Launch kernel
     // =========================================================================
     et.add("Launch Kernel");
 
-    OCL_CHECK(err, err = q.enqueueTask(krnl_image_diff));
+    OCL_CHECK(err, err = q.enqueueTask(krnl_image_diff, nullptr, &ev_krn));
+    et.add_device("Kernel", ev_krn);
 
     et.finish();
 
     // =========================================================================
-    // Step 10: Transfer padded results back
+    // Step 9: Transfer padded results back
     // =========================================================================
     et.add("Copy Padded Results from Device");
 
-    OCL_CHECK(err, err = q.enqueueMigrateMemObjects({buffer_C}, CL_MIGRATE_MEM_OBJECT_HOST));
+    // The change map is tiny: fetch it first, and skip the output copy when
+    // no posterized pixel was non-zero (the sharpened output is then all zero)
+    OCL_CHECK(err, err = q.enqueueMigrateMemObjects({buffer_map}, CL_MIGRATE_MEM_OBJECT_HOST));
+    OCL_CHECK(err, err = q.finish());
+    const bool any_change = change_map_any(change_map);
+    if (any_change && compressed)
+    {
+        // Index first, then only the kept chunks; expanded into padded_C
+        OCL_CHECK(err, err = q.enqueueMigrateMemObjects({buffer_comp}, CL_MIGRATE_MEM_OBJECT_HOST));
+        OCL_CHECK(err, err = q.finish());
+        const size_t kept_bytes = (size_t)comp_index[0] * (DATA_WIDTH_BITS / 8);
+        aligned_vec packed(kept_bytes > 0 ? kept_bytes : 1);
+        if (kept_bytes > 0)
+        {
+            OCL_CHECK(err, err = q.enqueueReadBuffer(buffer_C, CL_TRUE, 0, kept_bytes, packed.data(), nullptr, &ev_d2h));
+            et.add_device("D2H (C, compressed)", ev_d2h, kept_bytes);
+        }
+        comp_decode(packed.data(), comp_index.data(), padded_C.data(), height * num_frames, stride_chunks);
+        std::cout << "Compressed output: " << comp_index[0] << " of " << (size_t)height * stride_chunks * num_frames
+                  << " chunks read back" << std::endl;
+    }
+    else if (any_change)
+    {
+        OCL_CHECK(err, err = q.enqueueMigrateMemObjects({buffer_C}, CL_MIGRATE_MEM_OBJECT_HOST, nullptr, &ev_d2h));
+        et.add_device("D2H (C)", ev_d2h, buffer_bytes);
+    }
+    else
+    {
+        std::fill(padded_C.begin(), padded_C.end(), 0);
+    }
+    if (have_tap)
+    {
+        cl::Event ev_tap;
+        OCL_CHECK(err, err = q.enqueueMigrateMemObjects({buffer_tap}, CL_MIGRATE_MEM_OBJECT_HOST, nullptr, &ev_tap));
+        et.add_device("D2H (post tap)", ev_tap, tap_words * sizeof(uint64_t));
+    }
+    if (have_stats)
+    {
+        OCL_CHECK(err, err = q.enqueueMigrateMemObjects({buffer_stats}, CL_MIGRATE_MEM_OBJECT_HOST));
+    }
+    if (profiling)
+    {
+        OCL_CHECK(err, err = q.enqueueMigrateMemObjects({buffer_prof}, CL_MIGRATE_MEM_OBJECT_HOST));
+    }
+    if (have_blobs)
+    {
+        cl::Event ev_blobs;
+        OCL_CHECK(err, err = q.enqueueMigrateMemObjects({buffer_blobs}, CL_MIGRATE_MEM_OBJECT_HOST, nullptr, &ev_blobs));
+        et.add_device("D2H (blobs)", ev_blobs, BLOB_WORDS(num_frames) * sizeof(uint64_t));
+    }
+    if (have_pyramid)
+    {
+        cl::Event ev_half, ev_quarter;
+        OCL_CHECK(err, err = q.enqueueMigrateMemObjects({buffer_half}, CL_MIGRATE_MEM_OBJECT_HOST, nullptr, &ev_half));
+        OCL_CHECK(err, err = q.enqueueMigrateMemObjects({buffer_quarter}, CL_MIGRATE_MEM_OBJECT_HOST, nullptr,
+                                                        &ev_quarter));
+        et.add_device("D2H (pyramid 1/2)", ev_half, half_words * sizeof(uint64_t));
+        et.add_device("D2H (pyramid 1/4)", ev_quarter, quarter_words * sizeof(uint64_t));
+    }
     OCL_CHECK(err, err = q.finish());
 
     et.finish();
 
+    const int map_tiles = stride_chunks * CHANGE_MAP_TILE_ROWS(height, num_frames);
+    std::cout << "Change map: " << change_map_tiles(change_map) << " of " << map_tiles << " tiles changed"
+              << (any_change ? "" : " (D2H of C skipped)") << std::endl;
+
     // =========================================================================
-    // Step 11: UNPAD output
+    // Step 10: Verify results (in place on the padded output)
     // =========================================================================
-    et.add("Unpad Output");
+    et.add("Verify Results");
 
-    unpad_pixels(padded_C.data(), hw_result_unpadded.data());
+    int error_count = 0;
+    for (int f = 0; f < num_frames; f += verify_every)
+    {
+        const int remaining = (error_count < 10) ? 10 - error_count : 0;
+        error_count += compare_frame(&padded_C[f * frame_bytes], &sw_result[(size_t)f * image_size],
+                                     height, width, padded_width, f, remaining);
+    }
+    if (have_tap)
+    {
+        std::vector<uint8_t> tap_px((size_t)num_frames * image_size);
+        unpack_post_tap(reinterpret_cast<const uint8_t *>(tap.data()), tap_px.data(), num_frames * height,
+                        width, stride_chunks, cfg.levels);
+        error_count += verify_post_tap(tap_px.data(), padded_A.data(), padded_B.data(), num_frames * height,
+                                       width, padded_width, cfg);
+    }
+    if (have_stats)
+        error_count += verify_stats(stats.data(), sw_result.data(), (size_t)num_frames * image_size);
+    if (have_blobs)
+        error_count += verify_blobs(blobs.data(), padded_A.data(), padded_B.data(), height, width, stride_chunks,
+                                    num_frames, cfg);
+    if (have_pyramid)
+        error_count += verify_pyramid(pyr_half.data(), pyr_quarter.data(), sw_result, height, width, stride_chunks,
+                                      num_frames);
 
     et.finish();
 
     // =========================================================================
-    // Step 12: Verify results
+    // Optional: benchmark repeated round trips on the programmed device
     // =========================================================================
-    et.add("Verify Results");
-
-    int error_count = 0;
-    for (int i = 0; i < IMAGE_SIZE; i++)
+    if (bench_iters > 0)
     {
-        if (hw_result_unpadded[i] != sw_result[i])
+        PowerMeter pm;
+        BenchStats st = run_benchmark(q, krnl_image_diff, buffer_A, buffer_B, buffer_C,
+                                      buffer_bytes, num_frames, bench_iters, bench_warmup, pm, batch_pixels);
+        st.variant = binaryFile;
+
+        std::cout << "====== Benchmark (" << st.iters << " iters, " << bench_warmup << " warmup) ======" << std::endl;
+        std::cout << "Latency ms: min " << st.min_ms << ", median " << st.median_ms
+                  << ", p99 " << st.p99_ms << ", max " << st.max_ms << std::endl;
+        std::cout << "Sustained:  " << st.fps << " frames/s, " << st.mbps << " MB/s" << std::endl;
+        std::cout << "Energy:" << std::endl;
+        print_bench_energy(st);
+
+        // The CPU engines on the same batch, for the energy comparison
+        std::vector<BenchStats> cpu_runs;
+        std::vector<uint8_t> cpu_out(batch_pixels);
+        for (cpu_isa_t isa : {CPU_ISA_SCALAR, CPU_ISA_AVX2, CPU_ISA_AVX512})
         {
-            if (error_count < 10)
-            {
-                int row = i / WIDTH;
-                int col = i % WIDTH;
-                std::cout << "Error at [" << row << "," << col << "]: "
-                          << "HW=" << (int)hw_result_unpadded[i]
-                          << " SW=" << (int)sw_result[i] << std::endl;
-            }
-            error_count++;
+            if (isa > cpu_engine_detect())
+                continue;
+            cpu_runs.push_back(run_cpu_benchmark(isa, padded_A, padded_B, cpu_out, height, width, padded_width,
+                                                 buffer_bytes, num_frames, bench_iters, bench_warmup, pm));
+            print_bench_energy(cpu_runs.back());
+        }
+        std::cout << "===============================" << std::endl;
+
+        if (!bench_report.empty())
+        {
+            write_bench_report(bench_report, st, height, width, num_frames);
+            for (const BenchStats &c : cpu_runs)
+                write_bench_report(bench_report, c, height, width, num_frames);
         }
+
+        if (bench_xrt)
+            error_count += run_launch_compare(context, q, program, binaryFile, padded_A, padded_B, sw_result,
+                                              height, width, stride_chunks, num_frames, cfg, bench_iters,
+                                              bench_warmup);
     }
 
-    et.finish();
+    // =========================================================================
+    // Optional: adaptive CPU + FPGA split
+    // =========================================================================
+    if (hetero_batches > 0)
+    {
+        et.add("Heterogeneous Batches");
+        error_count += run_hetero_mode(context, q, krnl_image_diff, buffer_A, buffer_B, buffer_C,
+                                       padded_A, padded_B, padded_C, sw_result,
+                                       height, width, stride_chunks, num_frames, hetero_batches);
+        et.finish();
+    }
 
     // =========================================================================
     // Print timing summary
     // =========================================================================
     std::cout << "\n----------------- Key Execution Times -----------------" << std::endl;
     et.print();
+    std::cout << "\n----------------- Device Execution Times -----------------" << std::endl;
+    et.print_device();
+    if (have_stats)
+        print_stats(stats.data(), cfg.levels);
+    if (profiling)
+        print_profile(prof.data());
 
     if (error_count == 0)
     {
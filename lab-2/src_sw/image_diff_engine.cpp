@@ -0,0 +1,771 @@
+/**
+ * @file image_diff_engine.cpp
+ * @brief Kernel-argument helpers and the ImageDiffEngine slot pool
+ *
+ * Every slot owns its host/device buffers and a cl::Kernel bound to them
+ * once, like the --stream ring in host.cpp, so submit() only copies the
+ * frames and enqueues three commands. Producers contend only for the free
+ * list; the OpenCL calls themselves are thread-safe on distinct kernels.
+ */
+
+#include "image_diff_engine.hpp"
+#include "cpu_engine.hpp"
+#include "trace_ring.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+const PipelineConfig DEFAULT_PIPELINE = {
+    {{0, -1, 0}, {-1, 5, -1}, {0, -1, 0}}, SHARPEN_DEFAULT_SHIFT, BORDER_DEFAULT,
+    {THRESH_LOW, THRESH_HIGH}, POSTERIZE_DEFAULT_LEVELS, MORPH_DEFAULT};
+
+PipelineConfig diff_only_pipeline(const PipelineConfig &cfg)
+{
+    static const int identity[3][3] = {{0, 0, 0}, {0, 1, 0}, {0, 0, 0}};
+    PipelineConfig out = cfg;
+    std::memcpy(out.k, identity, sizeof(out.k));
+    out.shift  = 0;
+    out.border = BORDER_PASSTHROUGH;
+    out.morph  = MORPH_NONE;
+    return out;
+}
+
+void set_sharpen_args(cl::Kernel &krnl, const PipelineConfig &cfg, int first_arg)
+{
+    cl_int err;
+    for (int r = 0; r < 3; r++)
+    {
+        const int row = SHARPEN_PACK_ROW(cfg.k[r][0], cfg.k[r][1], cfg.k[r][2]);
+        OCL_CHECK(err, err = krnl.setArg(first_arg + r, row));
+    }
+    OCL_CHECK(err, err = krnl.setArg(first_arg + 3, cfg.shift));
+    OCL_CHECK(err, err = krnl.setArg(first_arg + 4, cfg.border));
+}
+
+void set_posterize_args(cl::Kernel &krnl, const PipelineConfig &cfg, int first_arg)
+{
+    cl_int err;
+    int t[POSTERIZE_MAX_LEVELS - 1] = {0};
+    for (int i = 0; i < cfg.levels - 1; i++)
+        t[i] = cfg.thr[i];
+    const int thr03 = POSTERIZE_PACK4(t[0], t[1], t[2], t[3]);
+    const int thr46 = POSTERIZE_PACK4(t[4], t[5], t[6], 0);
+    OCL_CHECK(err, err = krnl.setArg(first_arg, thr03));
+    OCL_CHECK(err, err = krnl.setArg(first_arg + 1, thr46));
+    OCL_CHECK(err, err = krnl.setArg(first_arg + 2, cfg.levels));
+}
+
+void set_pipeline_args(cl::Kernel &krnl, const PipelineConfig &cfg)
+{
+    set_sharpen_args(krnl, cfg, 7);
+    set_posterize_args(krnl, cfg, 12);
+    const int morph_arg = kernel_arg_index(krnl, "morph_mode");
+    if (morph_arg >= 0)
+    {
+        cl_int err;
+        OCL_CHECK(err, err = krnl.setArg(morph_arg, cfg.morph));
+    }
+    // A -DV3_LUMA kernel gets luma like any other; --in-format overrides it
+    const int format_arg = kernel_arg_index(krnl, "in_format");
+    if (format_arg >= 0)
+    {
+        cl_int err;
+        OCL_CHECK(err, err = krnl.setArg(format_arg, LUMA_Y8));
+    }
+}
+
+int kernel_arg_index(const cl::Kernel &krnl, const char *name)
+{
+    cl_int err;
+    cl_uint num_args = krnl.getInfo<CL_KERNEL_NUM_ARGS>(&err);
+    if (err != CL_SUCCESS)
+        return -1;
+    for (cl_uint i = CHANGE_MAP_ARG_INDEX + 1; i < num_args; i++)
+    {
+        std::string arg = krnl.getArgInfo<CL_KERNEL_ARG_NAME>(i, &err);
+        if (err == CL_SUCCESS && arg == name)
+            return (int)i;
+    }
+    return -1;
+}
+
+bool bind_optional_arg(cl::Context &context, cl::Kernel &krnl, const char *name,
+                       size_t num_words, counter_vec &words, cl::Buffer &buf)
+{
+    const int index = kernel_arg_index(krnl, name);
+    if (index < 0)
+        return false;
+    cl_int err;
+    words.assign(num_words, 0);
+    OCL_CHECK(err, buf = cl::Buffer(context, CL_MEM_USE_HOST_PTR | CL_MEM_WRITE_ONLY,
+                                    num_words * sizeof(uint64_t), words.data(), &err));
+    OCL_CHECK(err, err = krnl.setArg(index, buf));
+    return true;
+}
+
+uint64_t query_kernel_props(cl::Context &context, cl::CommandQueue &q, cl::Kernel &krnl)
+{
+    // Only the properties word is written; the frame pointers and the optional
+    // outputs of a V3 build share a scratch buffer that nothing reads
+    cl_int err;
+    counter_vec props(1, 0), scratch(4096, 0);
+    cl::Buffer buf_props(context, CL_MEM_USE_HOST_PTR | CL_MEM_READ_WRITE, sizeof(uint64_t), props.data(), &err);
+    if (err != CL_SUCCESS)
+        return 0;
+    cl::Buffer buf_scratch(context, CL_MEM_USE_HOST_PTR | CL_MEM_READ_WRITE, scratch.size() * sizeof(uint64_t),
+                           scratch.data(), &err);
+    if (err != CL_SUCCESS)
+        return 0;
+
+    const cl_uint num_args = krnl.getInfo<CL_KERNEL_NUM_ARGS>(&err);
+    for (cl_uint i = CHANGE_MAP_ARG_INDEX + 1; err == CL_SUCCESS && i < num_args; i++)
+    {
+        const std::string type = krnl.getArgInfo<CL_KERNEL_ARG_TYPE_NAME>(i, &err);
+        if (err == CL_SUCCESS)
+            err = (type.find('*') != std::string::npos) ? krnl.setArg(i, buf_scratch) : krnl.setArg(i, 0);
+    }
+    for (int i = 0; i < 3 && err == CL_SUCCESS; i++)
+        err = krnl.setArg(i, buf_scratch);
+    if (err == CL_SUCCESS)
+        err = krnl.setArg(3, 3);
+    if (err == CL_SUCCESS)
+        err = krnl.setArg(4, 3);
+    if (err == CL_SUCCESS)
+        err = krnl.setArg(5, 1);
+    if (err == CL_SUCCESS)
+        err = krnl.setArg(6, 0);
+    if (err == CL_SUCCESS)
+        err = krnl.setArg(CHANGE_MAP_ARG_INDEX, buf_props);
+    if (err != CL_SUCCESS)
+        return 0;
+    set_pipeline_args(krnl, DEFAULT_PIPELINE);
+
+    if (q.enqueueTask(krnl) != CL_SUCCESS
+        || q.enqueueMigrateMemObjects({buf_props}, CL_MIGRATE_MEM_OBJECT_HOST) != CL_SUCCESS
+        || q.finish() != CL_SUCCESS)
+        return 0;
+    return props[0];
+}
+
+int kernel_max_width(uint64_t props)
+{
+    const int width = KERNEL_PROPS_MAX_WIDTH(props);
+    return (width > 0 && width < MAX_WIDTH) ? width : MAX_WIDTH;
+}
+
+bool kernel_takes_taps(uint64_t props, const PipelineConfig &cfg)
+{
+    return !(props & KERNEL_PROP_FIXED_TAPS)
+        || (cfg.shift == DEFAULT_PIPELINE.shift && std::memcmp(cfg.k, DEFAULT_PIPELINE.k, sizeof(cfg.k)) == 0);
+}
+
+bool kernel_takes_posterize(uint64_t props, const PipelineConfig &cfg)
+{
+    // Only the first levels - 1 thresholds reach the kernel (set_posterize_args)
+    return !(props & KERNEL_PROP_FIXED_POSTERIZE)
+        || (cfg.levels == DEFAULT_PIPELINE.levels
+            && std::memcmp(cfg.thr, DEFAULT_PIPELINE.thr, (DEFAULT_PIPELINE.levels - 1) * sizeof(cfg.thr[0])) == 0);
+}
+
+// =============================================================================
+// HostBufferPool
+// =============================================================================
+HostBufferPool::~HostBufferPool()
+{
+    cl_int err;
+    for (auto &b : all_)
+    {
+        OCL_CHECK(err, err = q_.enqueueUnmapMemObject(b->buf, b->host));
+    }
+    OCL_CHECK(err, err = q_.finish());
+}
+
+PooledBuffer *HostBufferPool::acquire(size_t bytes, cl_mem_flags flags)
+{
+    std::lock_guard<std::mutex> lk(mutex_);
+    auto it = free_.find({bytes, flags});
+    if (it != free_.end())
+    {
+        PooledBuffer *b = it->second;
+        free_.erase(it);
+        return b;
+    }
+
+    // Miss: the only place the pool allocates and pins
+    cl_int err;
+    std::unique_ptr<PooledBuffer> b(new PooledBuffer);
+    b->bytes = bytes;
+    b->flags = flags;
+    OCL_CHECK(err, b->buf = cl::Buffer(context_, CL_MEM_ALLOC_HOST_PTR | flags, bytes, nullptr, &err));
+    OCL_CHECK(err, b->host = (uint8_t *)q_.enqueueMapBuffer(b->buf, CL_TRUE, CL_MAP_READ | CL_MAP_WRITE, 0, bytes,
+                                                           nullptr, nullptr, &err));
+    std::memset(b->host, 0, bytes);
+    all_.push_back(std::move(b));
+    allocations_++;
+    return all_.back().get();
+}
+
+void HostBufferPool::release(PooledBuffer *b)
+{
+    std::lock_guard<std::mutex> lk(mutex_);
+    free_.insert({{b->bytes, b->flags}, b});
+}
+
+// =============================================================================
+// ImageDiffEngine
+// =============================================================================
+const FailoverPolicy NO_FAILOVER      = {false, 0, 0};
+const FailoverPolicy DEFAULT_FAILOVER = {true, 0, 1000};
+
+// cpu_engine's settings and band pool are process-wide, so engines take
+// turns on it
+static std::mutex cpu_engine_mutex;
+
+ImageDiffEngine::ImageDiffEngine(int height, int width, const PipelineConfig &cfg, int num_slots,
+                                 const FailoverPolicy &failover)
+    : height_(height), width_(width),
+      stride_chunks_((width + PIXELS_PER_CHUNK - 1) / PIXELS_PER_CHUNK),
+      padded_width_(stride_chunks_ * PIXELS_PER_CHUNK), num_slots_(num_slots), cfg_(cfg), failover_(failover),
+      device_ok_(false), maintenance_(false), stopping_(false), completer_done_(false)
+{
+}
+
+static bool valid_engine_geometry(int height, int width, int num_slots)
+{
+    if (height < 3 || width < 3 || width > MAX_WIDTH || num_slots < 1)
+    {
+        std::cout << "ImageDiffEngine: invalid geometry " << width << " x " << height
+                  << " or slot count " << num_slots << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Context and program for device, or false if it does not take the xclbin
+static bool program_device(const cl::Device &device, const std::vector<unsigned char> &xclbin,
+                           xcl::ProgrammedDevice &dev)
+{
+    cl_int err;
+    cl::Program::Binaries bins{{xclbin.data(), xclbin.size()}};
+    dev.device  = device;
+    dev.context = cl::Context(device, nullptr, nullptr, nullptr, &err);
+    if (err != CL_SUCCESS)
+        return false;
+    dev.program = cl::Program(dev.context, {device}, bins, nullptr, &err);
+    return err == CL_SUCCESS;
+}
+
+std::unique_ptr<ImageDiffEngine> ImageDiffEngine::create(const std::string &xclbin, int height, int width,
+                                                         const PipelineConfig &cfg, int num_slots,
+                                                         const FailoverPolicy &failover)
+{
+    if (!valid_engine_geometry(height, width, num_slots))
+        return nullptr;
+
+    std::unique_ptr<ImageDiffEngine> eng(new ImageDiffEngine(height, width, cfg, num_slots, failover));
+    eng->candidates_ = xcl::get_xil_devices();
+    const std::vector<unsigned char> fileBuf = xcl::read_binary_file(xclbin);
+    for (auto &device : eng->candidates_)
+    {
+        xcl::ProgrammedDevice dev;
+        if (!program_device(device, fileBuf, dev))
+            continue;
+        if (!eng->setup_device(dev, eng->slots_, eng->free_))
+            return nullptr;
+        eng->device_ok_ = true;
+        break;
+    }
+    if (!eng->device_ok_)
+    {
+        std::cout << "ImageDiffEngine: failed to program any device with " << xclbin
+                  << (failover.enabled ? ", running on the CPU" : "") << std::endl;
+        if (!failover.enabled)
+            return nullptr;
+    }
+    if (failover.enabled)
+        eng->xclbin_ = fileBuf;
+    eng->start_threads();
+    return eng;
+}
+
+std::vector<std::unique_ptr<ImageDiffEngine>> ImageDiffEngine::create_all(const std::string &xclbin, int height,
+                                                                          int width, const PipelineConfig &cfg,
+                                                                          int num_slots,
+                                                                          const FailoverPolicy &failover)
+{
+    std::vector<std::unique_ptr<ImageDiffEngine>> engines;
+    if (!valid_engine_geometry(height, width, num_slots))
+        return engines;
+
+    const std::vector<unsigned char> fileBuf = xcl::read_binary_file(xclbin);
+    for (const auto &dev : xcl::program_devices(xcl::get_xil_devices(), fileBuf))
+    {
+        std::unique_ptr<ImageDiffEngine> eng(new ImageDiffEngine(height, width, cfg, num_slots, failover));
+        if (!eng->setup_device(dev, eng->slots_, eng->free_))
+            return std::vector<std::unique_ptr<ImageDiffEngine>>();
+        eng->device_ok_ = true;
+        if (failover.enabled)
+        {
+            eng->xclbin_     = fileBuf;
+            eng->candidates_ = {dev.device};
+        }
+        eng->start_threads();
+        engines.push_back(std::move(eng));
+    }
+    if (engines.empty())
+        std::cout << "ImageDiffEngine: failed to program any device with " << xclbin << std::endl;
+    return engines;
+}
+
+std::unique_ptr<ImageDiffEngine> ImageDiffEngine::create(const xcl::ProgrammedDevice &dev, int height, int width,
+                                                         const PipelineConfig &cfg, int num_slots)
+{
+    if (!valid_engine_geometry(height, width, num_slots))
+        return nullptr;
+
+    std::unique_ptr<ImageDiffEngine> eng(new ImageDiffEngine(height, width, cfg, num_slots, NO_FAILOVER));
+    if (!eng->setup_device(dev, eng->slots_, eng->free_))
+        return nullptr;
+    eng->device_ok_ = true;
+    eng->start_threads();
+    return eng;
+}
+
+// Queue, kernels and buffers for num_slots_ slots on dev, added to slots and
+// free_slots. A failure returns false (the device may be mid-reset), except
+// for a kernel the engine cannot drive, which is also reported. Takes no
+// lock: callers run it before the threads start, or with the device down.
+bool ImageDiffEngine::setup_device(const xcl::ProgrammedDevice &dev, std::vector<std::unique_ptr<Slot>> &slots,
+                                   std::vector<Slot *> &free_slots)
+{
+    cl_int err;
+    context_ = dev.context;
+    program_ = dev.program;
+    q_ = cl::CommandQueue(context_, dev.device, CL_QUEUE_PROFILING_ENABLE | CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE,
+                          &err);
+    if (err != CL_SUCCESS)
+        return false;
+
+    const size_t frame_bytes = (size_t)height_ * padded_width_;
+    const size_t tap_words   = (size_t)POST_TAP_WORDS(height_, stride_chunks_, 1) * (DATA_WIDTH_BITS / 64);
+    const size_t half_words    = (size_t)std::max(PYR_WORDS(height_, stride_chunks_, 1, 1), 1) * (DATA_WIDTH_BITS / 64);
+    const size_t quarter_words = (size_t)std::max(PYR_WORDS(height_, stride_chunks_, 1, 2), 1) * (DATA_WIDTH_BITS / 64);
+    for (int i = 0; i < num_slots_; i++)
+    {
+        std::unique_ptr<Slot> s(new Slot);
+        cl::Kernel krnl(program_, "IMAGE_DIFF_POSTERIZE", &err);
+        if (err != CL_SUCCESS || kernel_arg_index(krnl, "rois") >= 0 || kernel_arg_index(krnl, "comp_index") >= 0)
+        {
+            std::cout << "ImageDiffEngine: the xclbin has no full-frame IMAGE_DIFF_POSTERIZE kernel" << std::endl;
+            return false;
+        }
+        const uint64_t props = (i == 0) ? query_kernel_props(context_, q_, krnl) : 0;
+        const int max_width = kernel_max_width(props);
+        if (width_ > max_width)
+        {
+            std::cout << "ImageDiffEngine: the xclbin takes frames up to " << max_width << " px wide" << std::endl;
+            return false;
+        }
+        if (!kernel_takes_taps(props, cfg_))
+        {
+            std::cout << "ImageDiffEngine: the xclbin is built with -DSHARPEN_FIXED and ignores the sharpen taps"
+                      << std::endl;
+            return false;
+        }
+        if (!kernel_takes_posterize(props, cfg_))
+        {
+            std::cout << "ImageDiffEngine: the xclbin is built with -DPOSTERIZE_FIXED and ignores the posterize table"
+                      << std::endl;
+            return false;
+        }
+        s->krnl = krnl;
+        s->A.assign(frame_bytes, 0);
+        s->B.assign(frame_bytes, 0);
+        s->C.assign(frame_bytes, 0);
+        s->M.assign(CHANGE_MAP_WORDS(height_, stride_chunks_, 1), 0);
+        s->buf_A = cl::Buffer(context_, CL_MEM_USE_HOST_PTR | CL_MEM_READ_ONLY, frame_bytes, s->A.data(), &err);
+        if (err == CL_SUCCESS)
+            s->buf_B = cl::Buffer(context_, CL_MEM_USE_HOST_PTR | CL_MEM_READ_ONLY, frame_bytes, s->B.data(), &err);
+        if (err == CL_SUCCESS)
+            s->buf_C = cl::Buffer(context_, CL_MEM_USE_HOST_PTR | CL_MEM_WRITE_ONLY, frame_bytes, s->C.data(), &err);
+        if (err == CL_SUCCESS)
+            s->buf_M = cl::Buffer(context_, CL_MEM_USE_HOST_PTR | CL_MEM_WRITE_ONLY,
+                                  s->M.size() * sizeof(uint64_t), s->M.data(), &err);
+        if (err != CL_SUCCESS)
+            return false;
+
+        OCL_CHECK(err, err = s->krnl.setArg(0, s->buf_A));
+        OCL_CHECK(err, err = s->krnl.setArg(1, s->buf_B));
+        OCL_CHECK(err, err = s->krnl.setArg(2, s->buf_C));
+        OCL_CHECK(err, err = s->krnl.setArg(3, height_));
+        OCL_CHECK(err, err = s->krnl.setArg(4, width_));
+        OCL_CHECK(err, err = s->krnl.setArg(5, stride_chunks_));
+        OCL_CHECK(err, err = s->krnl.setArg(6, 1));
+        set_pipeline_args(s->krnl, cfg_);
+        OCL_CHECK(err, err = s->krnl.setArg(CHANGE_MAP_ARG_INDEX, s->buf_M));
+        bind_optional_arg(context_, s->krnl, "post_tap", tap_words, s->T, s->buf_T);
+        bind_optional_arg(context_, s->krnl, "stats", STATS_NUM_WORDS, s->S, s->buf_S);
+        bind_optional_arg(context_, s->krnl, "prof", PROF_NUM_COUNTERS, s->P, s->buf_P);
+        bind_optional_arg(context_, s->krnl, "blobs", BLOB_WORDS(1), s->L, s->buf_L);
+        bind_optional_arg(context_, s->krnl, "pyr_half", half_words, s->H, s->buf_H);
+        bind_optional_arg(context_, s->krnl, "pyr_quarter", quarter_words, s->Q, s->buf_Q);
+
+        free_slots.push_back(s.get());
+        slots.push_back(std::move(s));
+    }
+    return true;
+}
+
+void ImageDiffEngine::start_threads()
+{
+    metrics_.device_up.store(device_ok_ ? 1 : 0, std::memory_order_relaxed);
+    completer_ = std::thread(&ImageDiffEngine::complete_loop, this);
+    if (failover_.enabled)
+        cpu_worker_ = std::thread(&ImageDiffEngine::cpu_loop, this);
+}
+
+ImageDiffEngine::~ImageDiffEngine()
+{
+    {
+        std::lock_guard<std::mutex> lk(mutex_);
+        stopping_ = true;
+    }
+    cv_busy_.notify_all();
+    if (completer_.joinable())
+        completer_.join();
+    // After the completer: a failed device frame may still have been handed over
+    if (cpu_worker_.joinable())
+        cpu_worker_.join();
+}
+
+void ImageDiffEngine::set_maintenance(bool on)
+{
+    {
+        std::lock_guard<std::mutex> lk(mutex_);
+        maintenance_ = on && failover_.enabled;
+    }
+    cv_free_.notify_all();
+}
+
+bool ImageDiffEngine::device_up()
+{
+    std::lock_guard<std::mutex> lk(mutex_);
+    return device_ok_ && !maintenance_;
+}
+
+// Called with mutex_ not held; without failover a device error is fatal
+void ImageDiffEngine::device_failed(const char *what, cl_int err)
+{
+    if (!failover_.enabled)
+    {
+        printf("%s:%d Error calling %s, error code is: %d\n", __FILE__, __LINE__, what, err);
+        exit(EXIT_FAILURE);
+    }
+    bool was_ok;
+    {
+        std::lock_guard<std::mutex> lk(mutex_);
+        was_ok = device_ok_;
+        device_ok_ = false;
+    }
+    metrics_.device_up.store(0, std::memory_order_relaxed);
+    if (was_ok)
+        std::cout << "ImageDiffEngine: " << what << " failed (" << err << "), failing over to the CPU" << std::endl;
+}
+
+std::future<ImageDiffResult> ImageDiffEngine::submit(const uint8_t *A, const uint8_t *B, int pitch)
+{
+    if (pitch == 0)
+        pitch = width_;
+    const size_t device_limit = (failover_.max_device_queue > 0) ? (size_t)failover_.max_device_queue
+                                                                 : (size_t)num_slots_;
+    Slot *s = nullptr;
+    {
+        TraceScope wait("engine: wait slot");
+        std::unique_lock<std::mutex> lk(mutex_);
+        for (;;)
+        {
+            const bool usable = device_ok_ && !maintenance_;
+            const size_t in_flight = slots_.size() - free_.size();
+            if (usable && !free_.empty() && in_flight < device_limit)
+            {
+                s = free_.back();
+                free_.pop_back();
+                break;
+            }
+            // CPU queue bounded like the slot pool, so callers still feel backpressure
+            if (failover_.enabled && cpu_jobs_.size() < (size_t)num_slots_)
+                break;
+            cv_free_.wait(lk);
+        }
+
+        if (!s)
+        {
+            TraceScope trace("engine: submit to CPU");
+            std::unique_ptr<CpuJob> job(new CpuJob);
+            job->A.resize((size_t)height_ * width_);
+            job->B.resize((size_t)height_ * width_);
+            for (int r = 0; r < height_; r++)
+            {
+                std::memcpy(&job->A[(size_t)r * width_], A + (size_t)r * pitch, width_);
+                std::memcpy(&job->B[(size_t)r * width_], B + (size_t)r * pitch, width_);
+            }
+            job->pitch    = width_;
+            job->t_submit = std::chrono::high_resolution_clock::now();
+            std::future<ImageDiffResult> fut = job->result.get_future();
+            cpu_jobs_.push_back(std::move(job));
+            metrics_.queue_depth.fetch_add(1, std::memory_order_relaxed);
+            cv_cpu_.notify_one();
+            return fut;
+        }
+    }
+    TraceScope trace("engine: submit");
+
+    // Pack into the row-padded layout; the padding columns stay zero
+    for (int r = 0; r < height_; r++)
+    {
+        std::memcpy(&s->A[(size_t)r * padded_width_], A + (size_t)r * pitch, width_);
+        std::memcpy(&s->B[(size_t)r * padded_width_], B + (size_t)r * pitch, width_);
+    }
+
+    s->result = std::promise<ImageDiffResult>();
+    std::future<ImageDiffResult> fut = s->result.get_future();
+    s->t_submit = std::chrono::high_resolution_clock::now();
+    metrics_.queue_depth.fetch_add(1, std::memory_order_relaxed);
+
+    cl_int err;
+    std::vector<cl::Event> h2d_deps, krn_deps;
+    const char *what = "enqueueMigrateMemObjects (H2D)";
+    err = q_.enqueueMigrateMemObjects({s->buf_A, s->buf_B}, 0, nullptr, &s->h2d);
+    if (err == CL_SUCCESS)
+    {
+        h2d_deps.push_back(s->h2d);
+        what = "enqueueTask";
+        err = q_.enqueueTask(s->krnl, &h2d_deps, &s->krn);
+    }
+    if (err == CL_SUCCESS)
+    {
+        krn_deps.push_back(s->krn);
+        what = "enqueueMigrateMemObjects (D2H)";
+        err = q_.enqueueMigrateMemObjects({s->buf_C, s->buf_M}, CL_MIGRATE_MEM_OBJECT_HOST, &krn_deps, &s->done);
+    }
+    if (err == CL_SUCCESS)
+    {
+        what = "flush";
+        err = q_.flush();
+    }
+    if (err != CL_SUCCESS)
+    {
+        // Drain whatever did get enqueued; the completer hands the frame to the CPU
+        device_failed(what, err);
+        q_.finish();
+    }
+    s->lost = (err != CL_SUCCESS);
+
+    {
+        std::lock_guard<std::mutex> lk(mutex_);
+        busy_.push_back(s);
+    }
+    cv_busy_.notify_one();
+    return fut;
+}
+
+// Device time of one command from its profiling timestamps, in us
+static double command_us(const cl::Event &ev)
+{
+    cl_int err;
+    const cl_ulong start = ev.getProfilingInfo<CL_PROFILING_COMMAND_START>(&err);
+    const cl_ulong end   = ev.getProfilingInfo<CL_PROFILING_COMMAND_END>(&err);
+    return (err == CL_SUCCESS && end > start) ? (end - start) / 1e3 : 0.0;
+}
+
+void ImageDiffEngine::record_metrics(Slot *s, double latency_ms)
+{
+    metrics_.h2d.record(command_us(s->h2d));
+    metrics_.kernel.record(command_us(s->krn));
+    metrics_.d2h.record(command_us(s->done));
+    metrics_.end_to_end.record(latency_ms * 1e3);
+    metrics_.frames.fetch_add(1, std::memory_order_relaxed);
+    metrics_.queue_depth.fetch_sub(1, std::memory_order_relaxed);
+}
+
+// Re-program a lost device once nothing is in flight on it. Runs on the
+// completer thread; submit() keeps routing to the CPU meanwhile. Programming
+// and setup run without mutex_, so producers are not held up behind them:
+// with device_ok_ clear nothing else touches the queue or the slots.
+bool ImageDiffEngine::try_recover()
+{
+    std::vector<std::unique_ptr<Slot>> old;
+    {
+        std::lock_guard<std::mutex> lk(mutex_);
+        if (device_ok_ || free_.size() != slots_.size() || !busy_.empty())
+            return false;
+        free_.clear();
+        old.swap(slots_);
+    }
+    old.clear();
+
+    std::vector<std::unique_ptr<Slot>> fresh;
+    std::vector<Slot *> fresh_free;
+    for (const cl::Device &device : candidates_)
+    {
+        xcl::ProgrammedDevice dev;
+        if (!program_device(device, xclbin_, dev))
+            continue;
+        if (setup_device(dev, fresh, fresh_free))
+        {
+            std::lock_guard<std::mutex> lk(mutex_);
+            slots_.swap(fresh);
+            free_.swap(fresh_free);
+            device_ok_ = true;
+            break;
+        }
+        fresh_free.clear();
+        fresh.clear();
+    }
+
+    bool recovered;
+    {
+        std::lock_guard<std::mutex> lk(mutex_);
+        recovered = device_ok_;
+    }
+    if (recovered)
+    {
+        metrics_.device_up.store(1, std::memory_order_relaxed);
+        std::cout << "ImageDiffEngine: device back, leaving CPU failover" << std::endl;
+        cv_free_.notify_all();
+    }
+    return recovered;
+}
+
+// Retire slots oldest first; on shutdown, drain before returning. A lost
+// device is probed from here between frames.
+void ImageDiffEngine::complete_loop()
+{
+    trace_name_thread("engine completer");
+    const bool probing = failover_.enabled && !xclbin_.empty() && !candidates_.empty();
+    for (;;)
+    {
+        Slot *s;
+        {
+            std::unique_lock<std::mutex> lk(mutex_);
+            if (probing && !device_ok_)
+                cv_busy_.wait_for(lk, std::chrono::milliseconds(failover_.probe_interval_ms),
+                                  [this] { return stopping_ || !busy_.empty(); });
+            else
+                cv_busy_.wait(lk, [this] { return stopping_ || !busy_.empty(); });
+            if (busy_.empty())
+            {
+                if (stopping_)
+                {
+                    completer_done_ = true;
+                    cv_cpu_.notify_all();
+                    return;
+                }
+                lk.unlock();
+                try_recover();
+                continue;
+            }
+            s = busy_.front();
+            busy_.pop_front();
+        }
+
+        cl_int err = CL_INVALID_EVENT;
+        if (!s->lost)
+        {
+            TraceScope wait("engine: wait D2H");
+            err = s->done.wait();
+            if (err == CL_SUCCESS && s->done.getInfo<CL_EVENT_COMMAND_EXECUTION_STATUS>() < 0)
+                err = CL_EXEC_STATUS_ERROR_FOR_EVENTS_IN_WAIT_LIST;
+        }
+        if (err != CL_SUCCESS)
+        {
+            // The card lost this frame: recompute it on the CPU from the slot's copy
+            if (!s->lost)
+                device_failed("frame", err);
+            std::unique_ptr<CpuJob> job(new CpuJob);
+            job->A.assign(s->A.begin(), s->A.end());
+            job->B.assign(s->B.begin(), s->B.end());
+            job->pitch    = padded_width_;
+            job->result   = std::move(s->result);
+            job->t_submit = s->t_submit;
+            {
+                std::lock_guard<std::mutex> lk(mutex_);
+                cpu_jobs_.push_back(std::move(job));
+                free_.push_back(s);
+            }
+            cv_cpu_.notify_one();
+            cv_free_.notify_all();
+            continue;
+        }
+
+        TraceScope trace("engine: complete");
+        ImageDiffResult res;
+        res.C.resize((size_t)height_ * width_);
+        for (int r = 0; r < height_; r++)
+            std::memcpy(&res.C[(size_t)r * width_], &s->C[(size_t)r * padded_width_], width_);
+        res.changed = (s->M.back() != 0);
+        res.on_cpu = false;
+        res.latency_ms = std::chrono::duration<double, std::milli>(
+                             std::chrono::high_resolution_clock::now() - s->t_submit).count();
+        record_metrics(s, res.latency_ms);
+        s->result.set_value(std::move(res));
+
+        {
+            std::lock_guard<std::mutex> lk(mutex_);
+            free_.push_back(s);
+        }
+        cv_free_.notify_all();
+    }
+}
+
+// CPU fallback: one frame at a time through cpu_engine (which bands each
+// frame over its own thread pool)
+void ImageDiffEngine::cpu_loop()
+{
+    trace_name_thread("engine CPU fallback");
+    for (;;)
+    {
+        std::unique_ptr<CpuJob> job;
+        {
+            std::unique_lock<std::mutex> lk(mutex_);
+            // The completer may still hand over failed frames until it has exited
+            cv_cpu_.wait(lk, [this] { return !cpu_jobs_.empty() || completer_done_; });
+            if (cpu_jobs_.empty())
+                return;
+            job = std::move(cpu_jobs_.front());
+            cpu_jobs_.pop_front();
+        }
+        cv_free_.notify_all();
+
+        TraceScope trace("engine: CPU frame");
+        ImageDiffResult res;
+        res.C.resize((size_t)height_ * width_);
+        {
+            std::lock_guard<std::mutex> lk(cpu_engine_mutex);
+            cpu_engine_set_filter(cfg_.k, cfg_.shift);
+            cpu_engine_set_posterize(cfg_.thr, cfg_.levels);
+            cpu_engine_set_border(cfg_.border);
+            cpu_engine_run(job->A.data(), job->B.data(), res.C.data(), height_, width_, job->pitch);
+        }
+        // Same flag the kernel reports: any posterize code above level 0, i.e.
+        // |A - B| at or above the first threshold (the sharpened C may still be 0)
+        res.changed = false;
+        for (int r = 0; r < height_ && !res.changed; r++)
+        {
+            const uint8_t *a = &job->A[(size_t)r * job->pitch];
+            const uint8_t *b = &job->B[(size_t)r * job->pitch];
+            for (int c = 0; c < width_ && !res.changed; c++)
+                res.changed = std::abs((int)a[c] - (int)b[c]) >= cfg_.thr[0];
+        }
+        res.on_cpu = true;
+        res.latency_ms = std::chrono::duration<double, std::milli>(
+                             std::chrono::high_resolution_clock::now() - job->t_submit).count();
+        metrics_.end_to_end.record(res.latency_ms * 1e3);
+        metrics_.frames.fetch_add(1, std::memory_order_relaxed);
+        metrics_.cpu_frames.fetch_add(1, std::memory_order_relaxed);
+        metrics_.queue_depth.fetch_sub(1, std::memory_order_relaxed);
+        job->result.set_value(std::move(res));
+    }
+}
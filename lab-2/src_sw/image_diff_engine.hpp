@@ -0,0 +1,305 @@
+/**
+ * @file image_diff_engine.hpp
+ * @brief Reusable IMAGE_DIFF_POSTERIZE front end: programmed device + slot pool
+ *
+ * ImageDiffEngine owns the context, an out-of-order queue, the kernel and a
+ * pool of buffer slots for one frame size. Any number of producer threads
+ * call submit(A, B); each call copies the pair into a free slot (blocking
+ * while all slots are in flight, which is the backpressure), enqueues
+ * H2D -> kernel -> D2H on that slot's events and returns a future. A
+ * completion thread retires slots in submission order, unpacks the result
+ * and fulfils the future, so callers only pay for their own frame copies.
+ *
+ * With a FailoverPolicy, frames fall back to the CPU engine whenever the card
+ * is missing, lost, in maintenance or saturated, and return to it once a
+ * re-programming probe succeeds.
+ *
+ * Every retired frame updates metrics(): frame and error counts, queue
+ * depth and H2D / kernel / D2H latencies from the OpenCL profiling info.
+ *
+ * create_all() programs every card at once and returns one engine per card,
+ * for hosts that spread their producers over several devices.
+ *
+ * HostBufferPool recycles pinned, persistently mapped buffers for callers
+ * whose buffer sizes change between jobs (--serve).
+ *
+ * The kernel-argument helpers host.cpp's own modes use (PipelineConfig,
+ * set_pipeline_args, the change map and the optional V3 arguments) live
+ * here too, so the engine and the modes bind the kernel the same way.
+ */
+
+#ifndef IMAGE_DIFF_ENGINE_HPP__
+#define IMAGE_DIFF_ENGINE_HPP__
+
+#include "xcl2.hpp"
+#include "metrics.hpp"
+#include "../../inc/image_defines.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+typedef std::vector<uint8_t, aligned_allocator<uint8_t>> aligned_vec;
+
+// =============================================================================
+// Pipeline arguments: sharpen taps (coef_r0..coef_r2, coef_shift = arguments
+// 7..10), border policy (border_mode = 11), posterize table (post_thr03,
+// post_thr46, post_levels = 12..14) and, on -DV3_MORPH builds, morph_mode
+// =============================================================================
+struct PipelineConfig
+{
+    int k[3][3];                          // Sharpen taps, row-major
+    int shift;                            // Sharpen right shift
+    int border;                           // BORDER_* policy
+    int thr[POSTERIZE_MAX_LEVELS - 1];    // Ascending posterize thresholds
+    int levels;                           // Posterize output levels
+    int morph;                            // MORPH_* clean-up (-DV3_MORPH kernels)
+};
+
+extern const PipelineConfig DEFAULT_PIPELINE;
+
+// cfg's posterize table with the sharpen stage bypassed (SHARPEN_BYPASS_*,
+// BORDER_PASSTHROUGH, no morph): lab-1's diff-only workload on the same kernel
+PipelineConfig diff_only_pipeline(const PipelineConfig &cfg);
+
+// Sharpen taps, shift and border policy as consecutive arguments from first_arg
+void set_sharpen_args(cl::Kernel &krnl, const PipelineConfig &cfg, int first_arg);
+
+// Packed posterize thresholds and level count as consecutive arguments from first_arg
+void set_posterize_args(cl::Kernel &krnl, const PipelineConfig &cfg, int first_arg);
+
+// All of the above; morph_mode is looked up by name and skipped if absent,
+// likewise in_format, which is set to LUMA_Y8 (luma input)
+void set_pipeline_args(cl::Kernel &krnl, const PipelineConfig &cfg);
+
+// =============================================================================
+// Change map (argument 15): per-tile change bits + any-change flag
+// =============================================================================
+#define CHANGE_MAP_ARG_INDEX 15
+
+typedef std::vector<uint64_t, aligned_allocator<uint64_t>> change_map_vec;
+
+// =============================================================================
+// Optional V3 build arguments (-DV3_POST_TAP "post_tap", -DV3_STATS "stats",
+// -DV3_PROFILE "prof", -DV3_COMPRESS "comp_index", -DV3_ROI "rois",
+// -DV3_MORPH "morph_mode", -DV3_BLOBS "blobs",
+// -DV3_PYRAMID "pyr_half"/"pyr_quarter", -DV3_LUMA "in_format")
+// =============================================================================
+// All follow the change map in that order, so their index depends on which
+// flags the xclbin was built with; look them up by name instead.
+typedef std::vector<uint64_t, aligned_allocator<uint64_t>> counter_vec;
+
+// Index of the named argument after the change map, or -1 if absent
+int kernel_arg_index(const cl::Kernel &krnl, const char *name);
+
+// Bind a words-long host buffer to the named optional argument; returns
+// false (and leaves words/buf untouched) if this kernel build lacks it
+bool bind_optional_arg(cl::Context &context, cl::Kernel &krnl, const char *name,
+                       size_t num_words, counter_vec &words, cl::Buffer &buf);
+
+// =============================================================================
+// Kernel properties (KERNEL_PROPS_* in image_defines.h)
+// =============================================================================
+// One num_frames = 0 launch of krnl on q, which leaves every argument to be
+// set again; 0 (no known limits) if the launch fails
+uint64_t query_kernel_props(cl::Context &context, cl::CommandQueue &q, cl::Kernel &krnl);
+
+// Widest frame a kernel with these properties takes
+int kernel_max_width(uint64_t props);
+
+// False if the kernel would ignore cfg's sharpen taps or shift
+// (KERNEL_PROP_FIXED_TAPS and anything but the default Laplacian)
+bool kernel_takes_taps(uint64_t props, const PipelineConfig &cfg);
+
+// False if the kernel would ignore cfg's posterize thresholds or levels
+// (KERNEL_PROP_FIXED_POSTERIZE and anything but the default table)
+bool kernel_takes_posterize(uint64_t props, const PipelineConfig &cfg);
+
+// =============================================================================
+// HostBufferPool: pinned buffers recycled by (size, flags)
+// =============================================================================
+// A fresh host pointer wrapped with CL_MEM_USE_HOST_PTR is pinned when the
+// buffer is created and unpinned when it is released, every time. Pool
+// buffers are CL_MEM_ALLOC_HOST_PTR (pinned once by the runtime) and mapped
+// once for their whole life, so once every size in use has been seen,
+// acquire()/release() neither allocate nor pin. Thread-safe.
+struct PooledBuffer
+{
+    cl::Buffer buf;
+    uint8_t *host;        // Mapped for the buffer's lifetime
+    size_t bytes;
+    cl_mem_flags flags;
+};
+
+class HostBufferPool
+{
+public:
+    HostBufferPool(cl::Context &context, cl::CommandQueue &q) : context_(context), q_(q), allocations_(0) {}
+
+    // Unmaps every buffer; none may still be in use
+    ~HostBufferPool();
+
+    HostBufferPool(const HostBufferPool &) = delete;
+    HostBufferPool &operator=(const HostBufferPool &) = delete;
+
+    // A released buffer of exactly this size and flags (CL_MEM_READ_ONLY /
+    // CL_MEM_WRITE_ONLY), or a new one, zero-filled. Contents of a recycled
+    // buffer are whatever its last user left.
+    PooledBuffer *acquire(size_t bytes, cl_mem_flags flags);
+    void release(PooledBuffer *b);
+
+    int allocations() const { return allocations_; }
+
+private:
+    cl::Context &context_;
+    cl::CommandQueue &q_;
+    std::mutex mutex_;
+    std::vector<std::unique_ptr<PooledBuffer>> all_;
+    std::multimap<std::pair<size_t, cl_mem_flags>, PooledBuffer *> free_;
+    int allocations_;
+};
+
+// =============================================================================
+// ImageDiffEngine
+// =============================================================================
+struct ImageDiffResult
+{
+    std::vector<uint8_t> C;   // height x width result, compact rows
+    bool changed;             // Change map any-change flag
+    bool on_cpu;              // Computed by the CPU fallback
+    double latency_ms;        // submit() to completion
+};
+
+// CPU failover (cpu_engine.hpp). With enabled set, a frame runs on the CPU
+// engine instead of the card when there is no usable device (none
+// programmed, a command failed, or set_maintenance(true)), or when
+// max_device_queue frames are already in flight on the card. A lost device
+// is re-programmed every probe_interval_ms once its in-flight frames have
+// drained, and frames go back to it when that succeeds. Without failover,
+// device errors exit like OCL_CHECK, and a full card blocks submit().
+struct FailoverPolicy
+{
+    bool enabled;
+    int max_device_queue;     // 0 = the slot count (spill instead of blocking)
+    int probe_interval_ms;
+};
+
+extern const FailoverPolicy NO_FAILOVER;        // {false, 0, 0}
+extern const FailoverPolicy DEFAULT_FAILOVER;   // {true, 0, 1000}
+
+class ImageDiffEngine
+{
+public:
+    // Program the first device that accepts xclbin and set up num_slots
+    // buffer slots (>= 1) for height x width frames. Returns nullptr (with
+    // a message on stdout) if no device can be programmed or the xclbin's
+    // kernel needs arguments the engine does not provide (-DV3_ROI) or
+    // writes a layout it does not decode (-DV3_COMPRESS). With failover, a
+    // host without a usable card still gets an engine, running on the CPU
+    // and probing the enumerated devices.
+    static std::unique_ptr<ImageDiffEngine> create(const std::string &xclbin, int height, int width,
+                                                    const PipelineConfig &cfg, int num_slots,
+                                                    const FailoverPolicy &failover = NO_FAILOVER);
+
+    // The same on a device already programmed (see xcl::program_devices),
+    // without failover
+    static std::unique_ptr<ImageDiffEngine> create(const xcl::ProgrammedDevice &dev, int height, int width,
+                                                    const PipelineConfig &cfg, int num_slots);
+
+    // One engine per card that accepts xclbin, all programmed concurrently.
+    // Empty if no card can be programmed or any engine fails to set up.
+    static std::vector<std::unique_ptr<ImageDiffEngine>> create_all(const std::string &xclbin, int height,
+                                                                   int width, const PipelineConfig &cfg,
+                                                                   int num_slots,
+                                                                   const FailoverPolicy &failover = NO_FAILOVER);
+
+    // Waits for every submitted frame, then releases the device
+    ~ImageDiffEngine();
+
+    ImageDiffEngine(const ImageDiffEngine &) = delete;
+    ImageDiffEngine &operator=(const ImageDiffEngine &) = delete;
+
+    // Thread-safe. A and B are height x width frames at `pitch` bytes per
+    // row (0 = width); both are copied before submit() returns. Blocks while
+    // every slot is in flight (and, with failover, the CPU queue is full).
+    std::future<ImageDiffResult> submit(const uint8_t *A, const uint8_t *B, int pitch = 0);
+
+    // Route new frames to the CPU (failover engines only) while the card is
+    // serviced; frames already on it complete normally
+    void set_maintenance(bool on);
+
+    // The card is programmed and taking frames
+    bool device_up();
+
+    int height() const { return height_; }
+    int width() const { return width_; }
+    int num_slots() const { return num_slots_; }
+
+    // Live counters and latency histograms (serve them with MetricsServer);
+    // callers add their own failed checks to errors
+    EngineMetrics &metrics() { return metrics_; }
+
+private:
+    struct Slot
+    {
+        aligned_vec A, B, C;
+        change_map_vec M;
+        counter_vec P, S, T, L, H, Q; // Optional-argument buffers, never read back
+        cl::Buffer buf_A, buf_B, buf_C, buf_M, buf_P, buf_S, buf_T, buf_L, buf_H, buf_Q;
+        cl::Kernel krnl;              // Per-slot, so setArg never races
+        cl::Event h2d, krn;           // Current frame's upload and kernel, for the metrics
+        cl::Event done;               // D2H completion of the current frame
+        bool lost;                    // Enqueue failed; the completer hands the frame to the CPU
+        std::promise<ImageDiffResult> result;
+        std::chrono::high_resolution_clock::time_point t_submit;
+    };
+
+    // A frame for the CPU fallback, in its own compact copy
+    struct CpuJob
+    {
+        std::vector<uint8_t> A, B;
+        int pitch;
+        std::promise<ImageDiffResult> result;
+        std::chrono::high_resolution_clock::time_point t_submit;
+    };
+
+    ImageDiffEngine(int height, int width, const PipelineConfig &cfg, int num_slots, const FailoverPolicy &failover);
+    bool setup_device(const xcl::ProgrammedDevice &dev, std::vector<std::unique_ptr<Slot>> &slots,
+                      std::vector<Slot *> &free_slots);
+    void start_threads();
+    void device_failed(const char *what, cl_int err);
+    bool try_recover();
+    void complete_loop();
+    void cpu_loop();
+    void record_metrics(Slot *s, double latency_ms);
+
+    int height_, width_, stride_chunks_, padded_width_, num_slots_;
+    PipelineConfig cfg_;
+    FailoverPolicy failover_;
+    std::vector<unsigned char> xclbin_;       // Kept for re-programming (failover only)
+    std::vector<cl::Device> candidates_;      // Devices a recovery may program
+    cl::Context context_;
+    cl::CommandQueue q_;
+    cl::Program program_;
+    std::vector<std::unique_ptr<Slot>> slots_;
+
+    std::mutex mutex_;
+    std::condition_variable cv_free_, cv_busy_, cv_cpu_;
+    std::vector<Slot *> free_;        // Slots ready for submit()
+    std::deque<Slot *> busy_;         // Enqueued, oldest first
+    std::deque<std::unique_ptr<CpuJob>> cpu_jobs_;
+    bool device_ok_, maintenance_, stopping_;
+    bool completer_done_;             // No more frames can reach cpu_jobs_
+    EngineMetrics metrics_;
+    std::thread completer_, cpu_worker_;
+};
+
+#endif // IMAGE_DIFF_ENGINE_HPP__
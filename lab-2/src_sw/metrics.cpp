@@ -0,0 +1,209 @@
+/**
+ * @file metrics.cpp
+ * @brief Histogram bookkeeping, Prometheus rendering and the HTTP listener
+ *
+ * The listener is deliberately minimal: one thread, one request per
+ * connection, GET /metrics only. Scrapes are rare next to frames, so it
+ * renders the whole body per request instead of caching it.
+ */
+
+#include "metrics.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// =============================================================================
+// LatencyHistogram
+// =============================================================================
+LatencyHistogram::LatencyHistogram() : count_(0), sum_ns_(0)
+{
+    for (auto &b : buckets_)
+        b.store(0, std::memory_order_relaxed);
+}
+
+void LatencyHistogram::record(double us)
+{
+    int i = 0;
+    while (i < METRICS_LATENCY_BUCKETS && us > (double)(1ull << i))
+        i++;
+    buckets_[i].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    sum_ns_.fetch_add((uint64_t)(us * 1e3), std::memory_order_relaxed);
+}
+
+double LatencyHistogram::quantile(double q) const
+{
+    const uint64_t n = count_.load(std::memory_order_relaxed);
+    if (n == 0)
+        return 0.0;
+    const double rank = q * n;
+    uint64_t seen = 0;
+    for (int i = 0; i <= METRICS_LATENCY_BUCKETS; i++)
+    {
+        const uint64_t c = buckets_[i].load(std::memory_order_relaxed);
+        if (c > 0 && seen + c >= rank)
+        {
+            // Linear within (2^(i-1), 2^i]; the +Inf bucket reports its lower edge
+            const double lo = (i == 0) ? 0.0 : (double)(1ull << (i - 1));
+            if (i == METRICS_LATENCY_BUCKETS)
+                return lo;
+            return lo + ((double)(1ull << i) - lo) * (rank - seen) / c;
+        }
+        seen += c;
+    }
+    return (double)(1ull << (METRICS_LATENCY_BUCKETS - 1));
+}
+
+void LatencyHistogram::render(std::string &out, const std::string &name, const std::string &labels) const
+{
+    char line[256];
+    uint64_t cumulative = 0;
+    for (int i = 0; i <= METRICS_LATENCY_BUCKETS; i++)
+    {
+        cumulative += buckets_[i].load(std::memory_order_relaxed);
+        if (i < METRICS_LATENCY_BUCKETS)
+            std::snprintf(line, sizeof(line), "%s_bucket{%s,le=\"%llu\"} %llu\n", name.c_str(), labels.c_str(),
+                          1ull << i, (unsigned long long)cumulative);
+        else
+            std::snprintf(line, sizeof(line), "%s_bucket{%s,le=\"+Inf\"} %llu\n", name.c_str(), labels.c_str(),
+                          (unsigned long long)cumulative);
+        out += line;
+    }
+    std::snprintf(line, sizeof(line), "%s_sum{%s} %.3f\n%s_count{%s} %llu\n", name.c_str(), labels.c_str(),
+                  sum_ns_.load(std::memory_order_relaxed) / 1e3, name.c_str(), labels.c_str(),
+                  (unsigned long long)count_.load(std::memory_order_relaxed));
+    out += line;
+    std::snprintf(line, sizeof(line), "%s_p50{%s} %.3f\n%s_p99{%s} %.3f\n", name.c_str(), labels.c_str(),
+                  quantile(0.50), name.c_str(), labels.c_str(), quantile(0.99));
+    out += line;
+}
+
+// =============================================================================
+// MetricsServer
+// =============================================================================
+void MetricsServer::add(const EngineMetrics *m)
+{
+    std::lock_guard<std::mutex> lk(mutex_);
+    blocks_.push_back(m);
+    last_.push_back({m->frames.load(std::memory_order_relaxed), m->start});
+}
+
+std::string MetricsServer::render()
+{
+    std::lock_guard<std::mutex> lk(mutex_);
+    std::string out;
+    out += "# HELP image_diff_frames_total Frames retired by the engine\n# TYPE image_diff_frames_total counter\n";
+    out += "# HELP image_diff_cpu_frames_total Frames computed by the CPU failover\n"
+           "# TYPE image_diff_cpu_frames_total counter\n";
+    out += "# HELP image_diff_device_up Whether the card is taking frames\n# TYPE image_diff_device_up gauge\n";
+    out += "# HELP image_diff_errors_total Errors reported against the engine\n# TYPE image_diff_errors_total counter\n";
+    out += "# HELP image_diff_queue_depth Frames submitted and not yet retired\n# TYPE image_diff_queue_depth gauge\n";
+    out += "# HELP image_diff_frames_per_second Frame rate since the previous scrape\n"
+           "# TYPE image_diff_frames_per_second gauge\n";
+    out += "# HELP image_diff_latency_us Per-frame latency by stage (OpenCL profiling; end_to_end is submit to "
+           "completion)\n# TYPE image_diff_latency_us histogram\n";
+    out += "# HELP image_diff_latency_us_p50 Median of image_diff_latency_us, from its buckets\n"
+           "# TYPE image_diff_latency_us_p50 gauge\n";
+    out += "# HELP image_diff_latency_us_p99 99th percentile of image_diff_latency_us, from its buckets\n"
+           "# TYPE image_diff_latency_us_p99 gauge\n";
+
+    const auto now = std::chrono::steady_clock::now();
+    char line[256];
+    for (size_t d = 0; d < blocks_.size(); d++)
+    {
+        const EngineMetrics &m = *blocks_[d];
+        const uint64_t frames = m.frames.load(std::memory_order_relaxed);
+        const double secs = std::chrono::duration<double>(now - last_[d].second).count();
+        const double fps = (secs > 0.0) ? (frames - last_[d].first) / secs : 0.0;
+        last_[d] = {frames, now};
+
+        const std::string dev = "device=\"" + std::to_string(d) + "\"";
+        std::snprintf(line, sizeof(line),
+                      "image_diff_frames_total{%s} %llu\nimage_diff_errors_total{%s} %llu\n"
+                      "image_diff_queue_depth{%s} %lld\nimage_diff_frames_per_second{%s} %.3f\n",
+                      dev.c_str(), (unsigned long long)frames, dev.c_str(),
+                      (unsigned long long)m.errors.load(std::memory_order_relaxed), dev.c_str(),
+                      (long long)m.queue_depth.load(std::memory_order_relaxed), dev.c_str(), fps);
+        out += line;
+        std::snprintf(line, sizeof(line), "image_diff_cpu_frames_total{%s} %llu\nimage_diff_device_up{%s} %d\n",
+                      dev.c_str(), (unsigned long long)m.cpu_frames.load(std::memory_order_relaxed), dev.c_str(),
+                      m.device_up.load(std::memory_order_relaxed));
+        out += line;
+        m.h2d.render(out, "image_diff_latency_us", dev + ",stage=\"h2d\"");
+        m.kernel.render(out, "image_diff_latency_us", dev + ",stage=\"kernel\"");
+        m.d2h.render(out, "image_diff_latency_us", dev + ",stage=\"d2h\"");
+        m.end_to_end.render(out, "image_diff_latency_us", dev + ",stage=\"end_to_end\"");
+    }
+    return out;
+}
+
+bool MetricsServer::start(int port, bool bind_all)
+{
+    stop();
+    fd_ = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd_ < 0)
+        return false;
+    const int one = 1;
+    setsockopt(fd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_port        = htons((uint16_t)port);
+    addr.sin_addr.s_addr = htonl(bind_all ? INADDR_ANY : INADDR_LOOPBACK);
+    if (bind(fd_, (sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd_, 8) != 0)
+    {
+        ::close(fd_);
+        fd_ = -1;
+        return false;
+    }
+    stopping_ = false;
+    worker_ = std::thread(&MetricsServer::loop, this);
+    return true;
+}
+
+void MetricsServer::stop()
+{
+    stopping_ = true;
+    if (worker_.joinable())
+        worker_.join();
+    if (fd_ >= 0)
+        ::close(fd_);
+    fd_ = -1;
+}
+
+void MetricsServer::loop()
+{
+    while (!stopping_)
+    {
+        // Poll with a timeout so stop() never waits on a blocked accept()
+        pollfd p = {fd_, POLLIN, 0};
+        if (poll(&p, 1, 200) <= 0)
+            continue;
+        const int c = accept(fd_, nullptr, nullptr);
+        if (c < 0)
+            continue;
+
+        char req[1024];
+        const ssize_t n = recv(c, req, sizeof(req) - 1, 0);
+        req[(n > 0) ? n : 0] = 0;
+        const bool ok = std::strncmp(req, "GET /metrics", 12) == 0;
+        const std::string body = ok ? render() : "only /metrics is served\n";
+        const std::string head = std::string(ok ? "HTTP/1.0 200 OK" : "HTTP/1.0 404 Not Found")
+                               + "\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: "
+                               + std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n";
+        const std::string resp = head + body;
+        for (size_t sent = 0; sent < resp.size();)
+        {
+            const ssize_t w = send(c, resp.data() + sent, resp.size() - sent, MSG_NOSIGNAL);
+            if (w <= 0)
+                break;
+            sent += (size_t)w;
+        }
+        ::close(c);
+    }
+}
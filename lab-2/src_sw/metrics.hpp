@@ -0,0 +1,99 @@
+/**
+ * @file metrics.hpp
+ * @brief Live engine counters and a Prometheus text endpoint
+ *
+ * EngineMetrics is a block of atomics that ImageDiffEngine updates as it
+ * retires frames: frames (and how many the CPU failover computed), errors,
+ * queue depth, whether the card is up, and latency histograms for H2D,
+ * kernel and D2H (from the commands' OpenCL profiling timestamps) plus
+ * submit-to-completion. Updates are relaxed atomic adds, so reading
+ * the block never stalls the engine.
+ *
+ * MetricsServer serves every registered block as Prometheus text on
+ * GET /metrics from one background thread. Each block is labelled with its
+ * device index; the histograms are exported as native Prometheus histograms
+ * and, for dashboards without histogram_quantile(), as p50/p99 gauges
+ * interpolated from the same buckets.
+ */
+
+#ifndef METRICS_HPP__
+#define METRICS_HPP__
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Bucket i counts samples <= 2^i us (1 us .. ~8.4 s); the last is +Inf
+#define METRICS_LATENCY_BUCKETS 24
+
+class LatencyHistogram
+{
+public:
+    LatencyHistogram();
+
+    void record(double us);
+
+    // q-quantile in us, interpolated within the bucket that holds it (0 if empty)
+    double quantile(double q) const;
+
+    // Append the histogram's _bucket/_sum/_count series and p50/p99 gauges
+    void render(std::string &out, const std::string &name, const std::string &labels) const;
+
+private:
+    std::atomic<uint64_t> buckets_[METRICS_LATENCY_BUCKETS + 1];
+    std::atomic<uint64_t> count_;
+    std::atomic<uint64_t> sum_ns_;
+};
+
+struct EngineMetrics
+{
+    EngineMetrics()
+        : frames(0), cpu_frames(0), errors(0), queue_depth(0), device_up(0), start(std::chrono::steady_clock::now())
+    {
+    }
+
+    std::atomic<uint64_t> frames;       // Frames retired
+    std::atomic<uint64_t> cpu_frames;   // Of which computed by the CPU failover
+    std::atomic<uint64_t> errors;       // Reported by the caller (e.g. failed checks)
+    std::atomic<int64_t> queue_depth;   // Submitted, not yet retired
+    std::atomic<int> device_up;         // 1 while the card takes frames
+    LatencyHistogram h2d, kernel, d2h, end_to_end;
+    std::chrono::steady_clock::time_point start;
+};
+
+class MetricsServer
+{
+public:
+    MetricsServer() : fd_(-1), stopping_(false) {}
+    ~MetricsServer() { stop(); }
+
+    MetricsServer(const MetricsServer &) = delete;
+    MetricsServer &operator=(const MetricsServer &) = delete;
+
+    // Blocks must outlive the server (or stop()); device labels are the indices
+    void add(const EngineMetrics *m);
+
+    // Listen on 127.0.0.1:port (any address if bind_all); false if the port is taken
+    bool start(int port, bool bind_all = false);
+    void stop();
+
+    // The body served on /metrics
+    std::string render();
+
+private:
+    void loop();
+
+    int fd_;
+    std::atomic<bool> stopping_;
+    std::thread worker_;
+    std::mutex mutex_;
+    std::vector<const EngineMetrics *> blocks_;
+    // Previous scrape per block, for the frames/s gauge
+    std::vector<std::pair<uint64_t, std::chrono::steady_clock::time_point>> last_;
+};
+
+#endif // METRICS_HPP__
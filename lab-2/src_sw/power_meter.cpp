@@ -0,0 +1,159 @@
+/**
+ * @file power_meter.cpp
+ * @brief Sensor discovery in sysfs, the card sampling thread and RAPL deltas
+ */
+
+#include "power_meter.hpp"
+
+#include <dirent.h>
+#include <fstream>
+#include <sys/stat.h>
+
+#define XILINX_PCI_VENDOR "0x10ee"
+
+static bool file_exists(const std::string &path)
+{
+    struct stat st;
+    return stat(path.c_str(), &st) == 0;
+}
+
+// Subdirectories of dir whose names start with prefix
+static std::vector<std::string> list_dirs(const std::string &dir, const std::string &prefix)
+{
+    std::vector<std::string> out;
+    DIR *d = opendir(dir.c_str());
+    if (!d)
+        return out;
+    while (struct dirent *ent = readdir(d))
+    {
+        if (std::string(ent->d_name).compare(0, prefix.size(), prefix) == 0)
+            out.push_back(dir + "/" + ent->d_name);
+    }
+    closedir(d);
+    return out;
+}
+
+bool PowerMeter::read_u64(const std::string &path, uint64_t &v)
+{
+    std::ifstream f(path);
+    return (bool)(f >> v);
+}
+
+PowerMeter::PowerMeter() : sampling_(false), card_j_(0.0), last_w_(0.0)
+{
+    // xmc sensors live on the management function of the first card that has them
+    static const char *RAILS[] = {"12v_pex", "12v_aux", "3v3_pex", "3v3_aux"};
+    for (const std::string &dev : list_dirs("/sys/bus/pci/devices", ""))
+    {
+        std::ifstream vendor(dev + "/vendor");
+        std::string id;
+        if (!(vendor >> id) || id != XILINX_PCI_VENDOR)
+            continue;
+        for (const std::string &xmc : list_dirs(dev, "xmc"))
+        {
+            for (const char *rail : RAILS)
+            {
+                const std::string base = xmc + "/xmc_" + rail;
+                Rail r = {base + "_vol", base + "_curr"};
+                if (!file_exists(r.curr))
+                    r.curr = base + "_cur";
+                if (file_exists(r.volt) && file_exists(r.curr))
+                    rails_.push_back(r);
+            }
+            if (!rails_.empty())
+                break;
+        }
+        if (!rails_.empty())
+            break;
+    }
+
+    // Top-level RAPL domains (intel-rapl:N) are the packages; subdomains have a second ':'
+    for (const std::string &dom : list_dirs("/sys/class/powercap", "intel-rapl:"))
+    {
+        if (dom.find(':', dom.rfind('/') + 12) != std::string::npos)
+            continue;
+        RaplDomain r = {dom + "/energy_uj", 0, 0};
+        uint64_t probe;
+        if (read_u64(r.energy, probe) && read_u64(dom + "/max_energy_range_uj", r.max_range))
+            rapl_.push_back(r);
+    }
+}
+
+PowerMeter::~PowerMeter()
+{
+    sampling_ = false;
+    if (sampler_.joinable())
+        sampler_.join();
+}
+
+double PowerMeter::card_watts() const
+{
+    if (rails_.empty())
+        return -1.0;
+    double w = 0.0;
+    for (const Rail &r : rails_)
+    {
+        uint64_t mv = 0, ma = 0;
+        if (read_u64(r.volt, mv) && read_u64(r.curr, ma))
+            w += (double)mv * ma * 1e-6;
+    }
+    return w;
+}
+
+void PowerMeter::sample_loop()
+{
+    while (sampling_)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(PM_SAMPLE_MS));
+        const double w = card_watts();
+        const auto now = std::chrono::steady_clock::now();
+        std::lock_guard<std::mutex> lk(mutex_);
+        card_j_ += 0.5 * (w + last_w_) * std::chrono::duration<double>(now - t_last_).count();
+        last_w_ = w;
+        t_last_ = now;
+    }
+}
+
+void PowerMeter::begin()
+{
+    for (RaplDomain &r : rapl_)
+        read_u64(r.energy, r.start);
+    card_j_  = 0.0;
+    last_w_  = card_watts();
+    t_begin_ = t_last_ = std::chrono::steady_clock::now();
+    if (has_card())
+    {
+        sampling_ = true;
+        sampler_  = std::thread(&PowerMeter::sample_loop, this);
+    }
+}
+
+EnergyReading PowerMeter::end()
+{
+    sampling_ = false;
+    if (sampler_.joinable())
+        sampler_.join();
+    const auto now = std::chrono::steady_clock::now();
+
+    EnergyReading e;
+    e.secs = std::chrono::duration<double>(now - t_begin_).count();
+
+    // Close the last partial sample interval at the current reading
+    e.card_ok = has_card();
+    const double w = card_watts();
+    e.card_j = card_j_ + (e.card_ok ? 0.5 * (w + last_w_) * std::chrono::duration<double>(now - t_last_).count() : 0.0);
+    e.card_avg_w = (e.secs > 0.0) ? e.card_j / e.secs : 0.0;
+
+    e.cpu_ok = has_cpu();
+    uint64_t uj = 0;
+    for (const RaplDomain &r : rapl_)
+    {
+        uint64_t v = 0;
+        if (!read_u64(r.energy, v))
+            e.cpu_ok = false;
+        uj += (v >= r.start) ? v - r.start : v + r.max_range - r.start;
+    }
+    e.cpu_j = uj * 1e-6;
+    e.cpu_avg_w = (e.secs > 0.0) ? e.cpu_j / e.secs : 0.0;
+    return e;
+}
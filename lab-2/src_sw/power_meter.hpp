@@ -0,0 +1,88 @@
+/**
+ * @file power_meter.hpp
+ * @brief Card and CPU-package energy over a measured interval
+ *
+ * Card power comes from the same board sensors xbutil reports: XRT's xmc
+ * driver exposes each supply rail's voltage (mV) and current (mA) in sysfs
+ * under the card's management function (xmc.*), and the card draws the sum
+ * of its 12 V PCIe, 12 V AUX and 3.3 V rails. The management controller only
+ * refreshes them every few tens of ms, so a background thread samples them
+ * every PM_SAMPLE_MS and integrates the power (trapezoids) between begin()
+ * and end().
+ *
+ * CPU energy comes from the RAPL package counters in /sys/class/powercap
+ * (intel-rapl:N/energy_uj, summed over packages, wrap-corrected), which
+ * count joules directly. Both need read access to sysfs; a source that
+ * cannot be read reports ok = false rather than failing the run.
+ */
+
+#ifndef POWER_METER_HPP__
+#define POWER_METER_HPP__
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define PM_SAMPLE_MS 20
+
+struct EnergyReading
+{
+    double secs;
+    bool card_ok;
+    double card_j;        // Whole card, all rails
+    double card_avg_w;
+    bool cpu_ok;
+    double cpu_j;         // All CPU packages (RAPL)
+    double cpu_avg_w;
+};
+
+class PowerMeter
+{
+public:
+    // Finds the first Xilinx card's xmc sensors and the RAPL package domains
+    PowerMeter();
+    ~PowerMeter();
+
+    PowerMeter(const PowerMeter &) = delete;
+    PowerMeter &operator=(const PowerMeter &) = delete;
+
+    bool has_card() const { return !rails_.empty(); }
+    bool has_cpu() const { return !rapl_.empty(); }
+
+    // Instantaneous card power in W (sum of rails), or -1 without sensors
+    double card_watts() const;
+
+    // Start / stop one measured interval (not reentrant)
+    void begin();
+    EnergyReading end();
+
+private:
+    struct Rail
+    {
+        std::string volt, curr;   // sysfs paths, mV and mA
+    };
+    struct RaplDomain
+    {
+        std::string energy;       // energy_uj
+        uint64_t max_range;       // max_energy_range_uj (wrap point)
+        uint64_t start;
+    };
+
+    void sample_loop();
+    static bool read_u64(const std::string &path, uint64_t &v);
+
+    std::vector<Rail> rails_;
+    std::vector<RaplDomain> rapl_;
+
+    std::thread sampler_;
+    std::atomic<bool> sampling_;
+    std::mutex mutex_;
+    double card_j_, last_w_;
+    std::chrono::steady_clock::time_point t_begin_, t_last_;
+};
+
+#endif // POWER_METER_HPP__
@@ -0,0 +1,126 @@
+/**
+ * @file trace_ring.cpp
+ * @brief Ring registry, TSC calibration and the Chrome trace JSON writer
+ *
+ * Rings are registered in a fixed table by an atomic counter and live until
+ * exit, so a dump never races a ring being freed. The dump reads each
+ * ring's head before and after copying it, like a seqlock reader: whatever
+ * the owner may have overwritten in between is older than the last
+ * capacity records before the second head, and is skipped.
+ */
+
+#include "trace_ring.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+std::atomic<bool> g_trace_enabled(false);
+
+static std::atomic<size_t> g_trace_capacity(TRACE_DEFAULT_RECORDS);
+static TraceRing *g_rings[TRACE_MAX_THREADS];
+static std::atomic<int> g_num_rings(0);
+static thread_local TraceRing *t_ring = nullptr;
+static thread_local bool t_ring_full = false;
+
+// TSC and steady_clock sampled together at trace_enable(), for calibration
+static uint64_t g_tsc0;
+static std::chrono::steady_clock::time_point g_t0;
+
+void trace_enable(size_t records_per_thread)
+{
+    size_t cap = 1;
+    while (cap < records_per_thread)
+        cap <<= 1;
+    g_trace_capacity.store(cap, std::memory_order_relaxed);
+    g_t0   = std::chrono::steady_clock::now();
+    g_tsc0 = trace_now();
+    g_trace_enabled.store(true, std::memory_order_release);
+}
+
+TraceRing *trace_thread_ring()
+{
+    if (t_ring || t_ring_full)
+        return t_ring;
+    const int tid = g_num_rings.fetch_add(1, std::memory_order_relaxed);
+    if (tid >= TRACE_MAX_THREADS)
+    {
+        t_ring_full = true;
+        return nullptr;
+    }
+    const size_t cap = g_trace_capacity.load(std::memory_order_relaxed);
+    TraceRing *r  = new TraceRing;
+    r->records     = new TraceRecord[cap];
+    r->mask        = cap - 1;
+    r->head.store(0, std::memory_order_relaxed);
+    r->tid         = tid;
+    r->thread_name = nullptr;
+    // The dump skips a slot that is counted but not yet published
+    __atomic_store_n(&g_rings[tid], r, __ATOMIC_RELEASE);
+    t_ring = r;
+    return r;
+}
+
+void trace_name_thread(const char *name)
+{
+    if (TraceRing *r = trace_thread_ring())
+        r->thread_name = name;
+}
+
+bool trace_dump(const std::string &path)
+{
+    FILE *f = std::fopen(path.c_str(), "w");
+    if (!f)
+        return false;
+    std::setvbuf(f, nullptr, _IOFBF, 1 << 20);
+
+    const uint64_t tsc1 = trace_now();
+    const double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - g_t0).count();
+    const double ticks_per_us = (us > 0.0 && tsc1 > g_tsc0) ? (double)(tsc1 - g_tsc0) / us : 1.0;
+
+    std::fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n", f);
+    bool first = true;
+    const int num_rings = std::min(g_num_rings.load(std::memory_order_relaxed), TRACE_MAX_THREADS);
+    std::vector<TraceRecord> copy;
+    for (int i = 0; i < num_rings; i++)
+    {
+        TraceRing *r = __atomic_load_n(&g_rings[i], __ATOMIC_ACQUIRE);
+        if (!r)
+            continue; // Registered but not yet published
+        const uint64_t cap = r->mask + 1;
+        const uint64_t h1  = r->head.load(std::memory_order_acquire);
+        const uint64_t lo1 = (h1 > cap) ? h1 - cap : 0;
+        copy.clear();
+        for (uint64_t k = lo1; k < h1; k++)
+            copy.push_back(r->records[k & r->mask]);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        // The record being written when h2 was read overwrote index h2 - cap
+        const uint64_t h2 = r->head.load(std::memory_order_relaxed);
+        const uint64_t lo = (h2 + 1 > cap && h2 + 1 - cap > lo1) ? h2 + 1 - cap : lo1;
+
+        if (r->thread_name)
+            std::fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                         first ? "" : ",\n", r->tid, r->thread_name);
+        else
+            std::fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"thread %d\"}}",
+                         first ? "" : ",\n", r->tid, r->tid);
+        first = false;
+
+        for (uint64_t k = lo; k < h1; k++)
+        {
+            const TraceRecord &rec = copy[k - lo1];
+            const double ts = (double)(int64_t)(rec.begin - g_tsc0) / ticks_per_us;
+            if (rec.end == rec.begin)
+                std::fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,\"pid\":1,\"tid\":%d,"
+                                "\"args\":{\"n\":%llu}}",
+                             rec.name, ts, r->tid, (unsigned long long)rec.arg);
+            else
+                std::fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%d,"
+                                "\"args\":{\"n\":%llu}}",
+                             rec.name, ts, (double)(rec.end - rec.begin) / ticks_per_us, r->tid,
+                             (unsigned long long)rec.arg);
+        }
+    }
+    std::fputs("\n]}\n", f);
+    return std::fclose(f) == 0;
+}
@@ -0,0 +1,129 @@
+/**
+ * @file trace_ring.hpp
+ * @brief Per-thread, preallocated trace rings for per-frame hot paths
+ *
+ * EventTimer keeps a std::string and two time points per add(), which is
+ * fine for the handful of setup phases it reports but allocates on every
+ * call. The trace ring is for code that runs once per frame:
+ *   - every thread that emits gets its own ring of fixed-size records,
+ *     allocated on its first event; emitting after that is two TSC reads,
+ *     a store into the ring and one release store of the head (no locks,
+ *     no allocation, no shared cache lines between threads)
+ *   - names are static strings (literals); only the pointer is stored
+ *   - a full ring overwrites its oldest records, so memory stays bounded
+ *   - with tracing disabled, emitting is one relaxed load
+ * trace_dump() writes every ring as Chrome trace JSON (chrome://tracing or
+ * ui.perfetto.dev), with one track per thread and TSC ticks converted to
+ * microseconds against steady_clock. It may run while other threads are
+ * still emitting: records they overwrite during the dump are dropped.
+ */
+
+#ifndef TRACE_RING_HPP__
+#define TRACE_RING_HPP__
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#define TRACE_MAX_THREADS     64
+#define TRACE_DEFAULT_RECORDS 65536   // Per thread; rounded up to a power of two
+
+struct TraceRecord
+{
+    uint64_t begin;       // TSC ticks
+    uint64_t end;         // == begin for an instant event
+    const char *name;     // Static string
+    uint64_t arg;         // Frame / batch number, shown as args.n
+};
+
+struct TraceRing
+{
+    TraceRecord *records;
+    uint64_t mask;                    // Capacity - 1
+    std::atomic<uint64_t> head;       // Records ever written; only the owner stores it
+    int tid;
+    const char *thread_name;          // Static string, or nullptr for "thread <tid>"
+};
+
+// Cycle counter on x86, steady_clock nanoseconds elsewhere
+static inline uint64_t trace_now()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+extern std::atomic<bool> g_trace_enabled;
+
+// Allocate rings of records_per_thread records from now on and start recording
+void trace_enable(size_t records_per_thread = TRACE_DEFAULT_RECORDS);
+static inline bool trace_enabled() { return g_trace_enabled.load(std::memory_order_relaxed); }
+
+// The calling thread's ring, created on first use; nullptr once
+// TRACE_MAX_THREADS threads have one
+TraceRing *trace_thread_ring();
+
+// Label the calling thread's track in the dump (a static string)
+void trace_name_thread(const char *name);
+
+// A complete event [begin, end] ("X"); end == begin records an instant ("i")
+static inline void trace_emit(const char *name, uint64_t begin, uint64_t end, uint64_t arg = 0)
+{
+    if (!trace_enabled())
+        return;
+    TraceRing *r = trace_thread_ring();
+    if (!r)
+        return;
+    const uint64_t h = r->head.load(std::memory_order_relaxed);
+    TraceRecord &rec = r->records[h & r->mask];
+    rec.begin = begin;
+    rec.end   = end;
+    rec.name  = name;
+    rec.arg   = arg;
+    r->head.store(h + 1, std::memory_order_release);
+}
+
+static inline void trace_instant(const char *name, uint64_t arg = 0)
+{
+    if (trace_enabled())
+    {
+        const uint64_t t = trace_now();
+        trace_emit(name, t, t, arg);
+    }
+}
+
+// Records the enclosing scope as one complete event
+class TraceScope
+{
+public:
+    explicit TraceScope(const char *name, uint64_t arg = 0)
+        : name_(name), arg_(arg), begin_(trace_enabled() ? trace_now() : 0) {}
+    ~TraceScope()
+    {
+        if (begin_)
+            trace_emit(name_, begin_, trace_now(), arg_);
+    }
+
+    TraceScope(const TraceScope &) = delete;
+    TraceScope &operator=(const TraceScope &) = delete;
+
+private:
+    const char *name_;
+    uint64_t arg_;
+    uint64_t begin_;
+};
+
+// Write every ring's surviving records to path as Chrome trace JSON;
+// returns false if the file cannot be written
+bool trace_dump(const std::string &path);
+
+#endif // TRACE_RING_HPP__
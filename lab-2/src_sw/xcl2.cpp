@@ -17,7 +17,10 @@
 #include "xcl2.hpp"
 #include <climits>
 #include <sys/stat.h>
+#include <map>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <iomanip>
 #include <sstream>
 #if defined(_WINDOWS)
@@ -27,7 +30,7 @@
 #endif
 
 namespace xcl {
-std::vector<cl::Device> get_devices(const std::string& vendor_name) {
+static std::vector<cl::Device> enumerate_devices(const std::string& vendor_name) {
     size_t i;
     cl_int err;
     std::vector<cl::Platform> platforms;
@@ -58,6 +61,16 @@ std::vector<cl::Device> get_devices(const std::string& vendor_name) {
     return devices;
 }
 
+std::vector<cl::Device> get_devices(const std::string& vendor_name) {
+    // Platform enumeration queries the driver for every card; do it once
+    static std::mutex mutex;
+    static std::map<std::string, std::vector<cl::Device> > cache;
+    std::lock_guard<std::mutex> lk(mutex);
+    auto it = cache.find(vendor_name);
+    if (it == cache.end()) it = cache.emplace(vendor_name, enumerate_devices(vendor_name)).first;
+    return it->second;
+}
+
 std::vector<cl::Device> get_xil_devices() {
     return get_devices("Xilinx");
 }
@@ -168,6 +181,36 @@ std::string convert_size(size_t size) {
     return result;
 }
 
+std::vector<ProgrammedDevice> program_devices(const std::vector<cl::Device>& devices,
+                                              const std::vector<unsigned char>& xclbin) {
+    std::vector<ProgrammedDevice> slots(devices.size());
+    std::vector<char> ok(devices.size(), 0);
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < devices.size(); i++) {
+        workers.emplace_back([&, i] {
+            cl_int err;
+            ProgrammedDevice& d = slots[i];
+            d.device = devices[i];
+            d.context = cl::Context(d.device, nullptr, nullptr, nullptr, &err);
+            if (err != CL_SUCCESS) return;
+            cl::Program::Binaries bins{{xclbin.data(), xclbin.size()}};
+            d.program = cl::Program(d.context, {d.device}, bins, nullptr, &err);
+            ok[i] = (err == CL_SUCCESS);
+        });
+    }
+    for (auto& t : workers) t.join();
+
+    std::vector<ProgrammedDevice> programmed;
+    for (size_t i = 0; i < devices.size(); i++) {
+        if (ok[i]) {
+            programmed.push_back(slots[i]);
+        } else {
+            std::cout << "Failed to program device[" << i << "]!\n";
+        }
+    }
+    return programmed;
+}
+
 bool is_xpr_device(const char* device_name) {
     const char* output = strstr(device_name, "xpr");
 
@@ -87,6 +87,14 @@ struct aligned_allocator {
 };
 
 namespace xcl {
+// A card that accepted an xclbin, with the context it was programmed in
+struct ProgrammedDevice {
+    cl::Device device;
+    cl::Context context;
+    cl::Program program;
+};
+
+// Enumerated once per vendor and cached; later calls return the same list
 std::vector<cl::Device> get_xil_devices();
 std::vector<cl::Device> get_devices(const std::string& vendor_name);
 cl::Device find_device_bdf(const std::vector<cl::Device>& devices, const std::string& bdf);
@@ -96,6 +104,11 @@ std::vector<unsigned char> read_binary_file(const std::string& xclbin_file_name)
 bool is_emulation();
 bool is_hw_emulation();
 bool is_xpr_device(const char* device_name);
+// Program every device with xclbin concurrently, one thread per device, so
+// startup takes as long as the slowest card rather than the sum. Returns the
+// devices that accepted it, in enumeration order.
+std::vector<ProgrammedDevice> program_devices(const std::vector<cl::Device>& devices,
+                                              const std::vector<unsigned char>& xclbin);
 class P2P {
    public:
     static decltype(&xclGetMemObjectFd) getMemObjectFd;
@@ -0,0 +1,197 @@
+/**
+ * @file xrt_native.cpp
+ * @brief XrtNativeFrames: per-frame runs on user-pointer bos;
+ *        XrtRingFrames: one auto-restarting run fed by a descriptor ring
+ */
+
+#include "xrt_native.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <exception>
+
+bool XrtNativeFrames::open(unsigned device_index, const std::string &xclbin, uint8_t *A, uint8_t *B, uint8_t *C,
+                           int height, int width, int stride_chunks, int num_frames, const PipelineConfig &cfg)
+{
+    frame_bytes_ = (size_t)height * stride_chunks * PIXELS_PER_CHUNK;
+    const size_t map_bytes = CHANGE_MAP_WORDS(height, stride_chunks, 1) * sizeof(uint64_t);
+    try
+    {
+        device_ = xrt::device(device_index);
+        const xrt::xclbin bin(xclbin);
+        if (bin.get_kernel("IMAGE_DIFF_POSTERIZE").get_num_args() != CHANGE_MAP_ARG_INDEX + 1)
+        {
+            error_ = "the xclbin's IMAGE_DIFF_POSTERIZE has optional arguments the native path does not bind";
+            return false;
+        }
+        kernel_ = xrt::kernel(device_, device_.load_xclbin(bin), "IMAGE_DIFF_POSTERIZE");
+
+        const size_t batch_bytes = frame_bytes_ * num_frames;
+        A_ = xrt::bo(device_, A, batch_bytes, kernel_.group_id(0));
+        B_ = xrt::bo(device_, B, batch_bytes, kernel_.group_id(1));
+        C_ = xrt::bo(device_, C, batch_bytes, kernel_.group_id(2));
+        M_ = xrt::bo(device_, map_bytes * num_frames, kernel_.group_id(CHANGE_MAP_ARG_INDEX));
+
+        // Same packing as set_pipeline_args()
+        int rows[3];
+        for (int r = 0; r < 3; r++)
+            rows[r] = SHARPEN_PACK_ROW(cfg.k[r][0], cfg.k[r][1], cfg.k[r][2]);
+        int t[POSTERIZE_MAX_LEVELS - 1] = {0};
+        for (int i = 0; i < cfg.levels - 1; i++)
+            t[i] = cfg.thr[i];
+
+        sub_.clear();
+        runs_.clear();
+        for (int f = 0; f < num_frames; f++)
+        {
+            const size_t off = f * frame_bytes_;
+            sub_.push_back(xrt::bo(A_, frame_bytes_, off));
+            sub_.push_back(xrt::bo(B_, frame_bytes_, off));
+            sub_.push_back(xrt::bo(C_, frame_bytes_, off));
+            sub_.push_back(xrt::bo(M_, map_bytes, f * map_bytes));
+            xrt::run run(kernel_);
+            run.set_arg(0, sub_[4 * f]);
+            run.set_arg(1, sub_[4 * f + 1]);
+            run.set_arg(2, sub_[4 * f + 2]);
+            run.set_arg(3, height);
+            run.set_arg(4, width);
+            run.set_arg(5, stride_chunks);
+            run.set_arg(6, 1);
+            run.set_arg(7, rows[0]);
+            run.set_arg(8, rows[1]);
+            run.set_arg(9, rows[2]);
+            run.set_arg(10, cfg.shift);
+            run.set_arg(11, cfg.border);
+            run.set_arg(12, POSTERIZE_PACK4(t[0], t[1], t[2], t[3]));
+            run.set_arg(13, POSTERIZE_PACK4(t[4], t[5], t[6], 0));
+            run.set_arg(14, cfg.levels);
+            run.set_arg(CHANGE_MAP_ARG_INDEX, sub_[4 * f + 3]);
+            runs_.push_back(run);
+        }
+    }
+    catch (const std::exception &e)
+    {
+        error_ = e.what();
+        return false;
+    }
+    return true;
+}
+
+void XrtNativeFrames::run_frame(int f, double &launch_us)
+{
+    const size_t off = f * frame_bytes_;
+    A_.sync(XCL_BO_SYNC_BO_TO_DEVICE, frame_bytes_, off);
+    B_.sync(XCL_BO_SYNC_BO_TO_DEVICE, frame_bytes_, off);
+    const auto t0 = std::chrono::high_resolution_clock::now();
+    runs_[f].start();
+    runs_[f].wait();
+    launch_us = std::chrono::duration<double, std::micro>(std::chrono::high_resolution_clock::now() - t0).count();
+    C_.sync(XCL_BO_SYNC_BO_FROM_DEVICE, frame_bytes_, off);
+}
+
+bool XrtRingFrames::open(unsigned device_index, const std::string &xclbin, uint8_t *A, uint8_t *B, uint8_t *C,
+                         int height, int width, int stride_chunks, int num_frames, const PipelineConfig &cfg,
+                         unsigned runs)
+{
+    frame_chunks_ = height * stride_chunks;
+    batch_bytes_  = (size_t)frame_chunks_ * PIXELS_PER_CHUNK * num_frames;
+    const size_t map_bytes = CHANGE_MAP_WORDS(height, stride_chunks, 1) * sizeof(uint64_t) * num_frames;
+    try
+    {
+        device_ = xrt::device(device_index);
+        kernel_ = xrt::kernel(device_, device_.load_xclbin(xclbin), "IMAGE_DIFF_RING");
+        A_ = xrt::bo(device_, A, batch_bytes_, kernel_.group_id(0));
+        B_ = xrt::bo(device_, B, batch_bytes_, kernel_.group_id(1));
+        C_ = xrt::bo(device_, C, batch_bytes_, kernel_.group_id(2));
+        M_ = xrt::bo(device_, map_bytes, kernel_.group_id(14));
+        ring_bo_   = xrt::bo(device_, RING_WORDS * sizeof(uint64_t), kernel_.group_id(15));
+        status_bo_ = xrt::bo(device_, RING_STATUS_WORDS * sizeof(uint64_t), kernel_.group_id(16));
+        ring_   = ring_bo_.map<uint64_t *>();
+        status_ = status_bo_.map<uint64_t *>();
+        std::memset(ring_, 0, RING_WORDS * sizeof(uint64_t));
+        std::memset(status_, 0, RING_STATUS_WORDS * sizeof(uint64_t));
+        ring_bo_.sync(XCL_BO_SYNC_BO_TO_DEVICE);
+        status_bo_.sync(XCL_BO_SYNC_BO_TO_DEVICE);
+
+        // Same packing as set_pipeline_args(), arguments shifted by the missing num_frames
+        int t[POSTERIZE_MAX_LEVELS - 1] = {0};
+        for (int i = 0; i < cfg.levels - 1; i++)
+            t[i] = cfg.thr[i];
+        run_ = xrt::run(kernel_);
+        run_.set_arg(0, A_);
+        run_.set_arg(1, B_);
+        run_.set_arg(2, C_);
+        run_.set_arg(3, height);
+        run_.set_arg(4, width);
+        run_.set_arg(5, stride_chunks);
+        for (int r = 0; r < 3; r++)
+            run_.set_arg(6 + r, SHARPEN_PACK_ROW(cfg.k[r][0], cfg.k[r][1], cfg.k[r][2]));
+        run_.set_arg(9, cfg.shift);
+        run_.set_arg(10, cfg.border);
+        run_.set_arg(11, POSTERIZE_PACK4(t[0], t[1], t[2], t[3]));
+        run_.set_arg(12, POSTERIZE_PACK4(t[4], t[5], t[6], 0));
+        run_.set_arg(13, cfg.levels);
+        run_.set_arg(14, M_);
+        run_.set_arg(15, ring_bo_);
+        run_.set_arg(16, status_bo_);
+        run_.start(xrt::autostart{runs});
+    }
+    catch (const std::exception &e)
+    {
+        error_ = e.what();
+        return false;
+    }
+    submitted_ = retired_ = 0;
+    return true;
+}
+
+void XrtRingFrames::sync_inputs()
+{
+    A_.sync(XCL_BO_SYNC_BO_TO_DEVICE);
+    B_.sync(XCL_BO_SYNC_BO_TO_DEVICE);
+}
+
+void XrtRingFrames::sync_outputs()
+{
+    C_.sync(XCL_BO_SYNC_BO_FROM_DEVICE);
+}
+
+// The body of the slot goes out first and the head word (seq) last, so the
+// kernel never sees a published slot with stale offsets
+bool XrtRingFrames::publish(int f, int flags)
+{
+    if (submitted_ - retired_ >= RING_ENTRIES - 1 && submitted_ - poll() >= RING_ENTRIES - 1)
+        return false;
+    const size_t slot = (submitted_ % RING_ENTRIES) * RING_DESC_WORDS;
+    const uint64_t off = (uint64_t)f * frame_chunks_;
+    ring_[slot + RING_DESC_A] = off;
+    ring_[slot + RING_DESC_B] = off;
+    ring_[slot + RING_DESC_C] = off;
+    ring_bo_.sync(XCL_BO_SYNC_BO_TO_DEVICE, (RING_DESC_WORDS - 1) * sizeof(uint64_t),
+                  (slot + 1) * sizeof(uint64_t));
+    ring_[slot] = RING_DESC_HEAD(submitted_ + 1, f, flags);
+    ring_bo_.sync(XCL_BO_SYNC_BO_TO_DEVICE, sizeof(uint64_t), slot * sizeof(uint64_t));
+    submitted_++;
+    return true;
+}
+
+bool XrtRingFrames::submit(int f)
+{
+    return publish(f, 0);
+}
+
+uint32_t XrtRingFrames::poll()
+{
+    status_bo_.sync(XCL_BO_SYNC_BO_FROM_DEVICE, sizeof(uint64_t), RING_STATUS_DONE * sizeof(uint64_t));
+    retired_ = (uint32_t)status_[RING_STATUS_DONE];
+    return retired_;
+}
+
+void XrtRingFrames::stop()
+{
+    while (!publish(0, RING_FLAG_STOP))
+        ;
+    while (poll() != submitted_)
+        ;
+    run_.wait();
+}
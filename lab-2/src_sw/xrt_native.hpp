@@ -0,0 +1,100 @@
+/**
+ * @file xrt_native.hpp
+ * @brief IMAGE_DIFF_POSTERIZE round trips through the native XRT C++ API
+ *
+ * The OpenCL path (xcl2.hpp) pays for the cl:: wrapper, the command queue
+ * and event objects on every enqueue, which is a visible share of a kernel
+ * that only runs ~1024 cycles per frame. XrtNativeFrames drives the same
+ * kernel through xrt::kernel / xrt::run / xrt::bo instead: the caller's
+ * padded A/B/C buffers are wrapped as user-pointer bos once, every frame of
+ * the batch gets its own xrt::run with its arguments set once, and a frame's
+ * round trip is two bo.sync() calls on its sub-range of A and B, start(),
+ * wait() and one bo.sync() on its sub-range of C.
+ *
+ * Only the plain full-frame kernel is driven (no optional V3 arguments);
+ * open() reports other builds. host.cpp's --xrt compares its per-frame
+ * latencies against the same loop on the OpenCL path.
+ *
+ * XrtRingFrames drives V6's IMAGE_DIFF_RING (accelerated_v6.cpp) instead:
+ * one auto-restarting start for the whole run, after which a frame is one
+ * descriptor written into the ring bo (two small sub-range syncs) and
+ * completion is read from the status bo. host.cpp's --ring uses it.
+ */
+
+#ifndef XRT_NATIVE_HPP__
+#define XRT_NATIVE_HPP__
+
+#include "image_diff_engine.hpp"
+
+#include <xrt/xrt_bo.h>
+#include <xrt/xrt_device.h>
+#include <xrt/xrt_kernel.h>
+
+#include <string>
+#include <vector>
+
+class XrtNativeFrames
+{
+public:
+    // Program device_index with xclbin and bind one run per frame. A, B, C
+    // are the padded batches (4 KiB aligned, num_frames frames each) and
+    // must outlive this object. False with error() set on failure.
+    bool open(unsigned device_index, const std::string &xclbin, uint8_t *A, uint8_t *B, uint8_t *C,
+              int height, int width, int stride_chunks, int num_frames, const PipelineConfig &cfg);
+
+    // Frame f's round trip; launch_us gets the start() -> wait() share
+    void run_frame(int f, double &launch_us);
+
+    const std::string &error() const { return error_; }
+
+private:
+    xrt::device device_;
+    xrt::kernel kernel_;
+    xrt::bo A_, B_, C_, M_;
+    std::vector<xrt::bo> sub_;    // Per frame: A, B, C, change map sub-buffers
+    std::vector<xrt::run> runs_;  // One per frame, arguments set once
+    size_t frame_bytes_ = 0;
+    std::string error_;
+};
+
+class XrtRingFrames
+{
+public:
+    // Program device_index with a V6 xclbin, wrap A/B/C as for
+    // XrtNativeFrames and start the kernel with auto-restart for `runs`
+    // descriptors (0 = until the device is reset). False with error() set.
+    bool open(unsigned device_index, const std::string &xclbin, uint8_t *A, uint8_t *B, uint8_t *C,
+              int height, int width, int stride_chunks, int num_frames, const PipelineConfig &cfg, unsigned runs);
+
+    // Whole-batch input / output syncs, outside the per-frame path
+    void sync_inputs();
+    void sync_outputs();
+
+    // Publish a descriptor for frame f; false while the ring is full
+    bool submit(int f);
+
+    // Descriptors the kernel has retired (one status sync)
+    uint32_t poll();
+
+    // Publish a stop descriptor, wait for it and for the last run to end
+    void stop();
+
+    const std::string &error() const { return error_; }
+
+private:
+    bool publish(int f, int flags);
+
+    xrt::device device_;
+    xrt::kernel kernel_;
+    xrt::run run_;
+    xrt::bo A_, B_, C_, M_, ring_bo_, status_bo_;
+    uint64_t *ring_ = nullptr;
+    uint64_t *status_ = nullptr;
+    size_t batch_bytes_ = 0;
+    int frame_chunks_ = 0;
+    uint32_t submitted_ = 0;
+    uint32_t retired_ = 0;
+    std::string error_;
+};
+
+#endif // XRT_NATIVE_HPP__